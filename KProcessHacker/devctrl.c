@@ -21,6 +21,137 @@
 
 #include <kph.h>
 
+typedef struct _KPHP_CONTROL_STATISTICS
+{
+    volatile LONG64 Calls;
+    volatile LONG64 TotalTime;
+    volatile LONG64 MaximumTime;
+} KPHP_CONTROL_STATISTICS, *PKPHP_CONTROL_STATISTICS;
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(PAGE, KpiQueryControlStatistics)
+#endif
+
+KPHP_CONTROL_STATISTICS KphpControlStatistics[KPH_MAXIMUM_CONTROL_FUNCTIONS];
+
+VOID KphpRecordControlStatistics(
+    __in ULONG IoControlCode,
+    __in LONG64 Time
+    )
+{
+    ULONG function;
+    PKPHP_CONTROL_STATISTICS statistics;
+    LONG64 maximumTime;
+
+    function = ((IoControlCode >> 2) & 0xfff) - 0x800;
+
+    if (DEVICE_TYPE_FROM_CTL_CODE(IoControlCode) != KPH_DEVICE_TYPE || function >= KPH_MAXIMUM_CONTROL_FUNCTIONS)
+        return;
+
+    statistics = &KphpControlStatistics[function];
+
+    InterlockedIncrement64(&statistics->Calls);
+    InterlockedExchangeAdd64(&statistics->TotalTime, Time);
+
+    while ((maximumTime = statistics->MaximumTime) < Time)
+    {
+        if (InterlockedCompareExchange64(&statistics->MaximumTime, Time, maximumTime) == maximumTime)
+            break;
+    }
+}
+
+/**
+ * Gets the number of calls and time spent for each control code.
+ *
+ * \param Buffer A buffer which receives the statistics.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes required.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiQueryControlStatistics(
+    __out_bcount(BufferLength) PKPH_CONTROL_STATISTICS Buffer,
+    __in ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    LARGE_INTEGER frequency;
+    ULONG numberOfEntries;
+    ULONG returnLength;
+    ULONG i;
+    ULONG j;
+
+    PAGED_CODE();
+
+    KeQueryPerformanceCounter(&frequency);
+
+    numberOfEntries = 0;
+
+    for (i = 0; i < KPH_MAXIMUM_CONTROL_FUNCTIONS; i++)
+    {
+        if (KphpControlStatistics[i].Calls != 0)
+            numberOfEntries++;
+    }
+
+    // Calls made between counting and copying are simply left out.
+    returnLength = FIELD_OFFSET(KPH_CONTROL_STATISTICS, Entries) + numberOfEntries * sizeof(KPH_CONTROL_STATISTICS_ENTRY);
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Buffer, BufferLength, sizeof(ULONG));
+
+            if (ReturnLength)
+                ProbeForWrite(ReturnLength, sizeof(ULONG), sizeof(ULONG));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    __try
+    {
+        if (BufferLength >= returnLength)
+        {
+            Buffer->Reserved = 0;
+            Buffer->Frequency = frequency;
+
+            for (i = 0, j = 0; i < KPH_MAXIMUM_CONTROL_FUNCTIONS && j < numberOfEntries; i++)
+            {
+                PKPHP_CONTROL_STATISTICS statistics = &KphpControlStatistics[i];
+
+                if (statistics->Calls == 0)
+                    continue;
+
+                Buffer->Entries[j].ControlCode = KPH_CTL_CODE(i);
+                Buffer->Entries[j].Reserved = 0;
+                Buffer->Entries[j].Calls = statistics->Calls;
+                Buffer->Entries[j].TotalTime = statistics->TotalTime;
+                Buffer->Entries[j].MaximumTime = statistics->MaximumTime;
+                j++;
+            }
+
+            Buffer->NumberOfEntries = j;
+        }
+        else
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+        }
+
+        if (ReturnLength)
+            *ReturnLength = returnLength;
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    return status;
+}
+
 NTSTATUS KphDispatchDeviceControl(
     __in PDEVICE_OBJECT DeviceObject,
     __in PIRP Irp
@@ -34,6 +165,8 @@ NTSTATUS KphDispatchDeviceControl(
     KPROCESSOR_MODE accessMode;
     UCHAR capturedInput[16 * sizeof(ULONG_PTR)];
     PVOID capturedInputPointer;
+    LARGE_INTEGER startTime;
+    LARGE_INTEGER endTime;
 
 #define VERIFY_INPUT_LENGTH \
     do { \
@@ -47,6 +180,8 @@ NTSTATUS KphDispatchDeviceControl(
         } \
     } while (0)
 
+    startTime = KeQueryPerformanceCounter(NULL);
+
     stackLocation = IoGetCurrentIrpStackLocation(Irp);
     originalInput = stackLocation->Parameters.DeviceIoControl.Type3InputBuffer;
     inputLength = stackLocation->Parameters.DeviceIoControl.InputBufferLength;
@@ -109,6 +244,25 @@ NTSTATUS KphDispatchDeviceControl(
                 );
         }
         break;
+    case KPH_QUERYCONTROLSTATISTICS:
+        {
+            struct
+            {
+                PKPH_CONTROL_STATISTICS Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiQueryControlStatistics(
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
     case KPH_OPENPROCESS:
         {
             struct
@@ -326,6 +480,67 @@ NTSTATUS KphDispatchDeviceControl(
                 );
         }
         break;
+    case KPH_READVIRTUALMEMORYBATCH:
+        {
+            struct
+            {
+                HANDLE ProcessHandle;
+                PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries;
+                ULONG NumberOfEntries;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiReadVirtualMemoryBatch(
+                input->ProcessHandle,
+                input->Entries,
+                input->NumberOfEntries,
+                accessMode
+                );
+        }
+        break;
+    case KPH_ENUMERATEPROCESSIDS:
+        {
+            struct
+            {
+                HANDLE StartProcessId;
+                HANDLE EndProcessId;
+                PVOID Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiEnumerateProcessIds(
+                input->StartProcessId,
+                input->EndProcessId,
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
+    case KPH_QUERYINFORMATIONPROCESSES:
+        {
+            struct
+            {
+                PKPH_PROCESS_BATCH_ENTRY Entries;
+                ULONG NumberOfEntries;
+                ULONG Fields;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiQueryInformationProcesses(
+                input->Entries,
+                input->NumberOfEntries,
+                input->Fields,
+                accessMode
+                );
+        }
+        break;
     case KPH_OPENTHREAD:
         {
             struct
@@ -457,6 +672,33 @@ NTSTATUS KphDispatchDeviceControl(
                 );
         }
         break;
+    case KPH_CAPTURESTACKBACKTRACETHREADS:
+        {
+            struct
+            {
+                HANDLE ProcessHandle;
+                PKPH_STACK_BACK_TRACE_ENTRY Entries;
+                ULONG NumberOfEntries;
+                ULONG FramesToSkip;
+                ULONG FramesToCapture;
+                ULONG Flags;
+                PVOID *BackTraces;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiCaptureStackBackTraceThreads(
+                input->ProcessHandle,
+                input->Entries,
+                input->NumberOfEntries,
+                input->FramesToSkip,
+                input->FramesToCapture,
+                input->Flags,
+                input->BackTraces,
+                accessMode
+                );
+        }
+        break;
     case KPH_QUERYINFORMATIONTHREAD:
         {
             struct
@@ -522,6 +764,77 @@ NTSTATUS KphDispatchDeviceControl(
                 );
         }
         break;
+    case KPH_QUERYPROCESSHANDLEDIGEST:
+        {
+            struct
+            {
+                HANDLE ProcessHandle;
+                PVOID Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiQueryProcessHandleDigest(
+                input->ProcessHandle,
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
+    case KPH_ENUMERATEPROCESSHANDLERANGE:
+        {
+            struct
+            {
+                HANDLE ProcessHandle;
+                HANDLE StartHandle;
+                HANDLE EndHandle;
+                PVOID Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiEnumerateProcessHandleRange(
+                input->ProcessHandle,
+                input->StartHandle,
+                input->EndHandle,
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
+    case KPH_ENUMERATEPROCESSHANDLENAMES:
+        {
+            struct
+            {
+                HANDLE ProcessHandle;
+                HANDLE StartHandle;
+                PKPH_OBJECT_TYPE_MASK TypeMask;
+                PVOID Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiEnumerateProcessHandleNames(
+                input->ProcessHandle,
+                input->StartHandle,
+                input->TypeMask,
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
     case KPH_QUERYINFORMATIONOBJECT:
         {
             struct
@@ -597,6 +910,40 @@ NTSTATUS KphDispatchDeviceControl(
                 );
         }
         break;
+    case KPH_SETNOTIFYEVENT:
+        {
+            struct
+            {
+                HANDLE EventHandle;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiSetNotifyEvent(
+                input->EventHandle,
+                accessMode
+                );
+        }
+        break;
+    case KPH_READNOTIFYEVENTS:
+        {
+            struct
+            {
+                PKPH_NOTIFY_EVENT_INFORMATION Buffer;
+                ULONG BufferLength;
+                PULONG ReturnLength;
+            } *input = capturedInputPointer;
+
+            VERIFY_INPUT_LENGTH;
+
+            status = KpiReadNotifyEvents(
+                input->Buffer,
+                input->BufferLength,
+                input->ReturnLength,
+                accessMode
+                );
+        }
+        break;
     case KPH_OPENDRIVER:
         {
             struct
@@ -643,6 +990,9 @@ NTSTATUS KphDispatchDeviceControl(
     }
 
 ControlEnd:
+    endTime = KeQueryPerformanceCounter(NULL);
+    KphpRecordControlStatistics(ioControlCode, endTime.QuadPart - startTime.QuadPart);
+
     Irp->IoStatus.Status = status;
     Irp->IoStatus.Information = 0;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
@@ -49,6 +49,13 @@ NTSTATUS KphDispatchDeviceControl(
     __in PIRP Irp
     );
 
+NTSTATUS KpiQueryControlStatistics(
+    __out_bcount(BufferLength) PKPH_CONTROL_STATISTICS Buffer,
+    __in ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 // dynimp
 
 extern _ExfUnblockPushLock ExfUnblockPushLock_I;
@@ -67,6 +74,28 @@ PVOID KphGetSystemRoutineAddress(
     __in PWSTR SystemRoutineName
     );
 
+// notify
+
+VOID KphNotifyInitialization(
+    VOID
+    );
+
+VOID KphNotifyUninitialization(
+    VOID
+    );
+
+NTSTATUS KpiSetNotifyEvent(
+    __in_opt HANDLE EventHandle,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
+NTSTATUS KpiReadNotifyEvents(
+    __out_bcount(BufferLength) PKPH_NOTIFY_EVENT_INFORMATION Buffer,
+    __in ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 // object
 
 POBJECT_TYPE KphGetObjectType(
@@ -94,6 +123,34 @@ NTSTATUS KpiEnumerateProcessHandles(
     __in KPROCESSOR_MODE AccessMode
     );
 
+NTSTATUS KpiEnumerateProcessHandleRange(
+    __in HANDLE ProcessHandle,
+    __in HANDLE StartHandle,
+    __in HANDLE EndHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
+NTSTATUS KpiEnumerateProcessHandleNames(
+    __in HANDLE ProcessHandle,
+    __in HANDLE StartHandle,
+    __in_opt PKPH_OBJECT_TYPE_MASK TypeMask,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
+NTSTATUS KpiQueryProcessHandleDigest(
+    __in HANDLE ProcessHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 NTSTATUS KphQueryNameObject(
     __in PVOID Object,
     __out_bcount(BufferLength) POBJECT_NAME_INFORMATION Buffer,
@@ -218,6 +275,22 @@ NTSTATUS KpiSetInformationProcess(
     __in KPROCESSOR_MODE AccessMode
     );
 
+NTSTATUS KpiEnumerateProcessIds(
+    __in HANDLE StartProcessId,
+    __in HANDLE EndProcessId,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
+NTSTATUS KpiQueryInformationProcesses(
+    __inout_ecount(NumberOfEntries) PKPH_PROCESS_BATCH_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in ULONG Fields,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 BOOLEAN KphAcquireProcessRundownProtection(
     __in PEPROCESS Process
     );
@@ -300,6 +373,7 @@ NTSTATUS KphCaptureStackBackTraceThread(
     __in PETHREAD Thread,
     __in ULONG FramesToSkip,
     __in ULONG FramesToCapture,
+    __in ULONG Flags,
     __out_ecount(FramesToCapture) PVOID *BackTrace,
     __out_opt PULONG CapturedFrames,
     __out_opt PULONG BackTraceHash,
@@ -316,6 +390,17 @@ NTSTATUS KpiCaptureStackBackTraceThread(
     __in KPROCESSOR_MODE AccessMode
     );
 
+NTSTATUS KpiCaptureStackBackTraceThreads(
+    __in HANDLE ProcessHandle,
+    __inout_ecount(NumberOfEntries) PKPH_STACK_BACK_TRACE_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in ULONG FramesToSkip,
+    __in ULONG FramesToCapture,
+    __in ULONG Flags,
+    __out_ecount(NumberOfEntries * FramesToCapture) PVOID *BackTraces,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 NTSTATUS KpiQueryInformationThread(
     __in HANDLE ThreadHandle,
     __in KPH_THREAD_INFORMATION_CLASS ThreadInformationClass,
@@ -354,6 +439,13 @@ NTSTATUS KpiReadVirtualMemory(
     __in KPROCESSOR_MODE AccessMode
     );
 
+NTSTATUS KpiReadVirtualMemoryBatch(
+    __in HANDLE ProcessHandle,
+    __inout_ecount(NumberOfEntries) PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
 NTSTATUS KpiWriteVirtualMemory(
     __in HANDLE ProcessHandle,
     __in_opt PVOID BaseAddress,
@@ -324,6 +324,20 @@ PsSetContextThread(
     __in KPROCESSOR_MODE PreviousMode
     );
 
+NTKERNELAPI
+NTSTATUS
+NTAPI
+PsGetProcessExitStatus(
+    __in PEPROCESS Process
+    );
+
+NTKERNELAPI
+PUCHAR
+NTAPI
+PsGetProcessImageFileName(
+    __in PEPROCESS Process
+    );
+
 typedef struct _EJOB *PEJOB;
 
 extern POBJECT_TYPE *PsJobType;
@@ -66,6 +66,7 @@ NTSTATUS DriverEntry(
         return status;
 
     KphDynamicImport();
+    KphNotifyInitialization();
 
     if (!NT_SUCCESS(status = KphpReadDriverParameters(RegistryPath)))
         return status;
@@ -108,6 +109,7 @@ VOID DriverUnload(
 {
     PAGED_CODE();
 
+    KphNotifyUninitialization();
     IoDeleteDevice(KphDeviceObject);
 
     dprintf("Driver unloaded\n");
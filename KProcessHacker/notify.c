@@ -0,0 +1,478 @@
+/*
+ * KProcessHacker
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <kph.h>
+
+#define KPHP_NOTIFY_MAXIMUM_RINGS 64
+
+typedef struct _KPHP_NOTIFY_RING
+{
+    KSPIN_LOCK Lock;
+    ULONG Head; // index of the oldest event
+    ULONG Count;
+    ULONG LostCount;
+    ULONG Sequence;
+    KPH_NOTIFY_EVENT Events[KPH_NOTIFY_RING_SIZE];
+} KPHP_NOTIFY_RING, *PKPHP_NOTIFY_RING;
+
+NTSTATUS KphpRegisterNotifyRoutines(
+    VOID
+    );
+
+VOID KphpCreateProcessNotifyRoutine(
+    __in HANDLE ParentId,
+    __in HANDLE ProcessId,
+    __in BOOLEAN Create
+    );
+
+VOID KphpCreateThreadNotifyRoutine(
+    __in HANDLE ProcessId,
+    __in HANDLE ThreadId,
+    __in BOOLEAN Create
+    );
+
+VOID KphpLoadImageNotifyRoutine(
+    __in_opt PUNICODE_STRING FullImageName,
+    __in HANDLE ProcessId,
+    __in PIMAGE_INFO ImageInfo
+    );
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(PAGE, KphNotifyInitialization)
+#pragma alloc_text(PAGE, KphNotifyUninitialization)
+#pragma alloc_text(PAGE, KphpRegisterNotifyRoutines)
+#pragma alloc_text(PAGE, KpiSetNotifyEvent)
+#pragma alloc_text(PAGE, KpiReadNotifyEvents)
+#endif
+
+FAST_MUTEX KphpNotifyMutex;
+PKPHP_NOTIFY_RING KphpNotifyRings;
+ULONG KphpNotifyRingCount;
+BOOLEAN KphpNotifyProcessRegistered;
+BOOLEAN KphpNotifyThreadRegistered;
+BOOLEAN KphpNotifyImageRegistered;
+KSPIN_LOCK KphpNotifyEventLock;
+PKEVENT KphpNotifyEvent;
+
+VOID KphNotifyInitialization(
+    VOID
+    )
+{
+    PAGED_CODE();
+
+    ExInitializeFastMutex(&KphpNotifyMutex);
+    KeInitializeSpinLock(&KphpNotifyEventLock);
+}
+
+/**
+ * Removes the notification routines and frees the event buffers.
+ */
+VOID KphNotifyUninitialization(
+    VOID
+    )
+{
+    PAGED_CODE();
+
+    if (KphpNotifyProcessRegistered)
+        PsSetCreateProcessNotifyRoutine(KphpCreateProcessNotifyRoutine, TRUE);
+    if (KphpNotifyThreadRegistered)
+        PsRemoveCreateThreadNotifyRoutine(KphpCreateThreadNotifyRoutine);
+    if (KphpNotifyImageRegistered)
+        PsRemoveLoadImageNotifyRoutine(KphpLoadImageNotifyRoutine);
+
+    if (KphpNotifyEvent)
+        ObDereferenceObject(KphpNotifyEvent);
+    if (KphpNotifyRings)
+        ExFreePoolWithTag(KphpNotifyRings, 'NhpK');
+}
+
+NTSTATUS KphpRegisterNotifyRoutines(
+    VOID
+    )
+{
+    NTSTATUS status;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (!KphpNotifyRings)
+    {
+        // There is a buffer for each processor so that events raised on different
+        // processors don't contend for the same lock.
+
+        KphpNotifyRingCount = min((ULONG)KeNumberProcessors, KPHP_NOTIFY_MAXIMUM_RINGS);
+        KphpNotifyRings = ExAllocatePoolWithTag(
+            NonPagedPool,
+            KphpNotifyRingCount * sizeof(KPHP_NOTIFY_RING),
+            'NhpK'
+            );
+
+        if (!KphpNotifyRings)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        for (i = 0; i < KphpNotifyRingCount; i++)
+        {
+            KeInitializeSpinLock(&KphpNotifyRings[i].Lock);
+            KphpNotifyRings[i].Head = 0;
+            KphpNotifyRings[i].Count = 0;
+            KphpNotifyRings[i].LostCount = 0;
+            KphpNotifyRings[i].Sequence = 0;
+        }
+    }
+
+    if (!KphpNotifyProcessRegistered)
+    {
+        if (!NT_SUCCESS(status = PsSetCreateProcessNotifyRoutine(KphpCreateProcessNotifyRoutine, FALSE)))
+            return status;
+
+        KphpNotifyProcessRegistered = TRUE;
+    }
+
+    if (!KphpNotifyThreadRegistered)
+    {
+        if (!NT_SUCCESS(status = PsSetCreateThreadNotifyRoutine(KphpCreateThreadNotifyRoutine)))
+            return status;
+
+        KphpNotifyThreadRegistered = TRUE;
+    }
+
+    if (!KphpNotifyImageRegistered)
+    {
+        if (!NT_SUCCESS(status = PsSetLoadImageNotifyRoutine(KphpLoadImageNotifyRoutine)))
+            return status;
+
+        KphpNotifyImageRegistered = TRUE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Records an event in the buffer of the current processor and signals the client's
+ * event object.
+ *
+ * \param Event The event to record. The Processor, Sequence and TimeStamp fields
+ * are filled in by this function.
+ */
+VOID KphpRecordNotifyEvent(
+    __inout PKPH_NOTIFY_EVENT Event
+    )
+{
+    PKPHP_NOTIFY_RING ring;
+    KIRQL oldIrql;
+
+    if (!KphpNotifyEvent)
+        return;
+
+    // The thread may move to another processor before it acquires the lock, but that
+    // only affects which buffer the event goes into.
+    Event->Processor = (USHORT)(KeGetCurrentProcessorNumber() % KphpNotifyRingCount);
+    ring = &KphpNotifyRings[Event->Processor];
+
+    KeAcquireSpinLock(&ring->Lock, &oldIrql);
+
+    Event->Sequence = ring->Sequence++;
+    Event->TimeStamp.QuadPart = KeQueryInterruptTime();
+
+    if (ring->Count < KPH_NOTIFY_RING_SIZE)
+    {
+        ring->Events[(ring->Head + ring->Count) % KPH_NOTIFY_RING_SIZE] = *Event;
+        ring->Count++;
+    }
+    else
+    {
+        // The client isn't keeping up. Drop the new event; the client finds out from
+        // LostCount and falls back to polling.
+        ring->LostCount++;
+    }
+
+    KeReleaseSpinLock(&ring->Lock, oldIrql);
+
+    KeAcquireSpinLock(&KphpNotifyEventLock, &oldIrql);
+
+    if (KphpNotifyEvent)
+        KeSetEvent(KphpNotifyEvent, 0, FALSE);
+
+    KeReleaseSpinLock(&KphpNotifyEventLock, oldIrql);
+}
+
+VOID KphpCopyProcessImageFileName(
+    __in PEPROCESS Process,
+    __out_ecount(16) PCHAR ImageFileName
+    )
+{
+    PUCHAR imageFileName;
+
+    imageFileName = PsGetProcessImageFileName(Process);
+    memcpy(ImageFileName, imageFileName, 15);
+    ImageFileName[15] = 0;
+}
+
+VOID KphpCreateProcessNotifyRoutine(
+    __in HANDLE ParentId,
+    __in HANDLE ProcessId,
+    __in BOOLEAN Create
+    )
+{
+    KPH_NOTIFY_EVENT event;
+    PEPROCESS process;
+
+    memset(&event, 0, sizeof(KPH_NOTIFY_EVENT));
+    event.ProcessId = ProcessId;
+
+    if (Create)
+    {
+        event.Type = KphNotifyProcessCreate;
+        event.ParentProcessId = ParentId;
+
+        if (NT_SUCCESS(PsLookupProcessByProcessId(ProcessId, &process)))
+        {
+            KphpCopyProcessImageFileName(process, event.ImageFileName);
+            ObDereferenceObject(process);
+        }
+    }
+    else
+    {
+        // This is called in the context of the exiting process.
+        process = PsGetCurrentProcess();
+
+        event.Type = KphNotifyProcessExit;
+        event.ExitStatus = PsGetProcessExitStatus(process);
+        KphpCopyProcessImageFileName(process, event.ImageFileName);
+    }
+
+    KphpRecordNotifyEvent(&event);
+}
+
+VOID KphpCreateThreadNotifyRoutine(
+    __in HANDLE ProcessId,
+    __in HANDLE ThreadId,
+    __in BOOLEAN Create
+    )
+{
+    KPH_NOTIFY_EVENT event;
+
+    memset(&event, 0, sizeof(KPH_NOTIFY_EVENT));
+    event.Type = Create ? KphNotifyThreadCreate : KphNotifyThreadExit;
+    event.ProcessId = ProcessId;
+    event.ThreadId = ThreadId;
+
+    KphpRecordNotifyEvent(&event);
+}
+
+VOID KphpLoadImageNotifyRoutine(
+    __in_opt PUNICODE_STRING FullImageName,
+    __in HANDLE ProcessId,
+    __in PIMAGE_INFO ImageInfo
+    )
+{
+    KPH_NOTIFY_EVENT event;
+
+    memset(&event, 0, sizeof(KPH_NOTIFY_EVENT));
+    event.Type = KphNotifyImageLoad;
+    event.ProcessId = ProcessId;
+    event.ImageBase = ImageInfo->ImageBase;
+    event.ImageSize = ImageInfo->ImageSize;
+
+    KphpRecordNotifyEvent(&event);
+}
+
+/**
+ * Sets the event object that is signaled when process, thread or image
+ * notifications are recorded.
+ *
+ * \param EventHandle A handle to an event object, or NULL to stop recording
+ * notifications.
+ * \param AccessMode The mode in which to perform access checks.
+ *
+ * \remarks The notification routines are registered the first time an event
+ * object is set, and stay registered until the driver is unloaded.
+ */
+NTSTATUS KpiSetNotifyEvent(
+    __in_opt HANDLE EventHandle,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PKEVENT event = NULL;
+    PKEVENT oldEvent;
+    KIRQL oldIrql;
+
+    PAGED_CODE();
+
+    if (EventHandle)
+    {
+        status = ObReferenceObjectByHandle(
+            EventHandle,
+            EVENT_MODIFY_STATE,
+            *ExEventObjectType,
+            AccessMode,
+            &event,
+            NULL
+            );
+
+        if (!NT_SUCCESS(status))
+            return status;
+    }
+
+    ExAcquireFastMutex(&KphpNotifyMutex);
+
+    if (event)
+        status = KphpRegisterNotifyRoutines();
+
+    if (NT_SUCCESS(status))
+    {
+        KeAcquireSpinLock(&KphpNotifyEventLock, &oldIrql);
+        oldEvent = KphpNotifyEvent;
+        KphpNotifyEvent = event;
+        KeReleaseSpinLock(&KphpNotifyEventLock, oldIrql);
+
+        event = oldEvent;
+    }
+
+    ExReleaseFastMutex(&KphpNotifyMutex);
+
+    if (event)
+        ObDereferenceObject(event);
+
+    return status;
+}
+
+/**
+ * Removes recorded notifications from the event buffers.
+ *
+ * \param Buffer A buffer which receives the notifications. Notifications from
+ * different processors are not in order; use the TimeStamp fields to order them.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes written to
+ * \a Buffer.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiReadNotifyEvents(
+    __out_bcount(BufferLength) PKPH_NOTIFY_EVENT_INFORMATION Buffer,
+    __in ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PKPH_NOTIFY_EVENT_INFORMATION information;
+    ULONG maximumCount;
+    ULONG returnLength;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (BufferLength < FIELD_OFFSET(KPH_NOTIFY_EVENT_INFORMATION, Events))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Buffer, BufferLength, sizeof(ULONG));
+
+            if (ReturnLength)
+                ProbeForWrite(ReturnLength, sizeof(ULONG), sizeof(ULONG));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    maximumCount = (BufferLength - FIELD_OFFSET(KPH_NOTIFY_EVENT_INFORMATION, Events)) / sizeof(KPH_NOTIFY_EVENT);
+
+    ExAcquireFastMutex(&KphpNotifyMutex);
+
+    if (!KphpNotifyRings)
+    {
+        ExReleaseFastMutex(&KphpNotifyMutex);
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    // The events are copied out of the buffers while holding their spin locks, so they
+    // go through a non-paged buffer before being copied to the caller.
+
+    maximumCount = min(maximumCount, KphpNotifyRingCount * KPH_NOTIFY_RING_SIZE);
+    information = ExAllocatePoolWithTag(
+        NonPagedPool,
+        FIELD_OFFSET(KPH_NOTIFY_EVENT_INFORMATION, Events) + max(maximumCount, 1) * sizeof(KPH_NOTIFY_EVENT),
+        'NhpK'
+        );
+
+    if (!information)
+    {
+        ExReleaseFastMutex(&KphpNotifyMutex);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    information->EventCount = 0;
+    information->LostCount = 0;
+
+    for (i = 0; i < KphpNotifyRingCount; i++)
+    {
+        PKPHP_NOTIFY_RING ring = &KphpNotifyRings[i];
+        KIRQL oldIrql;
+
+        KeAcquireSpinLock(&ring->Lock, &oldIrql);
+
+        while (ring->Count != 0 && information->EventCount < maximumCount)
+        {
+            information->Events[information->EventCount++] = ring->Events[ring->Head];
+            ring->Head = (ring->Head + 1) % KPH_NOTIFY_RING_SIZE;
+            ring->Count--;
+        }
+
+        information->LostCount += ring->LostCount;
+        ring->LostCount = 0;
+
+        KeReleaseSpinLock(&ring->Lock, oldIrql);
+    }
+
+    ExReleaseFastMutex(&KphpNotifyMutex);
+
+    returnLength = FIELD_OFFSET(KPH_NOTIFY_EVENT_INFORMATION, Events) + information->EventCount * sizeof(KPH_NOTIFY_EVENT);
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            memcpy(Buffer, information, returnLength);
+
+            if (ReturnLength)
+                *ReturnLength = returnLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            status = GetExceptionCode();
+        }
+    }
+    else
+    {
+        memcpy(Buffer, information, returnLength);
+
+        if (ReturnLength)
+            *ReturnLength = returnLength;
+    }
+
+    ExFreePoolWithTag(information, 'NhpK');
+
+    return status;
+}
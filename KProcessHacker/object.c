@@ -38,8 +38,34 @@ typedef struct _KPHP_ENUMERATE_PROCESS_HANDLES_CONTEXT
     PVOID CurrentEntry;
     ULONG Count;
     NTSTATUS Status;
+    ULONG_PTR StartHandle;
+    ULONG_PTR EndHandle;
 } KPHP_ENUMERATE_PROCESS_HANDLES_CONTEXT, *PKPHP_ENUMERATE_PROCESS_HANDLES_CONTEXT;
 
+typedef struct _KPHP_QUERY_PROCESS_HANDLE_DIGEST_CONTEXT
+{
+    PKPH_PROCESS_HANDLE_DIGEST Buffer;
+    ULONG MaximumRanges;
+    ULONG HandleCount;
+    ULONG NumberOfRanges;
+    NTSTATUS Status;
+} KPHP_QUERY_PROCESS_HANDLE_DIGEST_CONTEXT, *PKPHP_QUERY_PROCESS_HANDLE_DIGEST_CONTEXT;
+
+typedef struct _KPHP_ENUMERATE_PROCESS_HANDLE_NAMES_CONTEXT
+{
+    ULONG_PTR StartHandle;
+    PKPH_OBJECT_TYPE_MASK TypeMask;
+    PKPH_PROCESS_HANDLE Handles; // each object is referenced
+    ULONG Count;
+    HANDLE NextHandle;
+} KPHP_ENUMERATE_PROCESS_HANDLE_NAMES_CONTEXT, *PKPHP_ENUMERATE_PROCESS_HANDLE_NAMES_CONTEXT;
+
+VOID KphpCaptureProcessHandle(
+    __in PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __out PKPH_PROCESS_HANDLE HandleInfo
+    );
+
 BOOLEAN KphpEnumerateProcessHandlesEnumCallback61(
     __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
     __in HANDLE Handle,
@@ -53,14 +79,59 @@ BOOLEAN KphpEnumerateProcessHandlesEnumCallback(
     __in PVOID Context
     );
 
+NTSTATUS KphpEnumerateProcessHandles(
+    __in HANDLE ProcessHandle,
+    __in ULONG_PTR StartHandle,
+    __in ULONG_PTR EndHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    );
+
+BOOLEAN KphpQueryProcessHandleDigestEnumCallback61(
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    );
+
+BOOLEAN KphpQueryProcessHandleDigestEnumCallback(
+    __in PHANDLE_TABLE HandleTable,
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    );
+
+BOOLEAN KphpEnumerateProcessHandleNamesEnumCallback61(
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    );
+
+BOOLEAN KphpEnumerateProcessHandleNamesEnumCallback(
+    __in PHANDLE_TABLE HandleTable,
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    );
+
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, KphGetObjectType)
 #pragma alloc_text(PAGE, KphReferenceProcessHandleTable)
 #pragma alloc_text(PAGE, KphDereferenceProcessHandleTable)
 #pragma alloc_text(PAGE, KphUnlockHandleTableEntry)
+#pragma alloc_text(PAGE, KphpCaptureProcessHandle)
 #pragma alloc_text(PAGE, KphpEnumerateProcessHandlesEnumCallback61)
 #pragma alloc_text(PAGE, KphpEnumerateProcessHandlesEnumCallback)
+#pragma alloc_text(PAGE, KphpEnumerateProcessHandles)
 #pragma alloc_text(PAGE, KpiEnumerateProcessHandles)
+#pragma alloc_text(PAGE, KpiEnumerateProcessHandleRange)
+#pragma alloc_text(PAGE, KphpQueryProcessHandleDigestEnumCallback61)
+#pragma alloc_text(PAGE, KphpQueryProcessHandleDigestEnumCallback)
+#pragma alloc_text(PAGE, KpiQueryProcessHandleDigest)
+#pragma alloc_text(PAGE, KphpEnumerateProcessHandleNamesEnumCallback61)
+#pragma alloc_text(PAGE, KphpEnumerateProcessHandleNamesEnumCallback)
+#pragma alloc_text(PAGE, KpiEnumerateProcessHandleNames)
 #pragma alloc_text(PAGE, KphQueryNameObject)
 #pragma alloc_text(PAGE, KphQueryNameFileObject)
 #pragma alloc_text(PAGE, KpiQueryInformationObject)
@@ -183,41 +254,63 @@ VOID KphUnlockHandleTableEntry(
         ExfUnblockPushLock_I(handleContentionEvent, NULL);
 }
 
-BOOLEAN KphpEnumerateProcessHandlesEnumCallback61(
-    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+/**
+ * Fills in handle information from a locked handle table entry.
+ *
+ * \param HandleTableEntry The handle table entry.
+ * \param Handle The handle value.
+ * \param HandleInfo A variable which receives the handle information.
+ */
+VOID KphpCaptureProcessHandle(
+    __in PHANDLE_TABLE_ENTRY HandleTableEntry,
     __in HANDLE Handle,
-    __in PVOID Context
+    __out PKPH_PROCESS_HANDLE HandleInfo
     )
 {
-    PKPHP_ENUMERATE_PROCESS_HANDLES_CONTEXT context = Context;
-    KPH_PROCESS_HANDLE handleInfo;
     POBJECT_HEADER objectHeader;
     POBJECT_TYPE objectType;
-    PKPH_PROCESS_HANDLE entryInBuffer;
 
     PAGED_CODE();
 
     objectHeader = ObpDecodeObject(HandleTableEntry->Object);
-    handleInfo.Handle = Handle;
-    handleInfo.Object = objectHeader ? &objectHeader->Body : NULL;
-    handleInfo.GrantedAccess = ObpDecodeGrantedAccess(HandleTableEntry->GrantedAccess);
-    handleInfo.ObjectTypeIndex = -1;
-    handleInfo.Reserved1 = 0;
-    handleInfo.HandleAttributes = ObpGetHandleAttributes(HandleTableEntry);
-    handleInfo.Reserved2 = 0;
-
-    if (handleInfo.Object)
+    HandleInfo->Handle = Handle;
+    HandleInfo->Object = objectHeader ? &objectHeader->Body : NULL;
+    HandleInfo->GrantedAccess = ObpDecodeGrantedAccess(HandleTableEntry->GrantedAccess);
+    HandleInfo->ObjectTypeIndex = -1;
+    HandleInfo->Reserved1 = 0;
+    HandleInfo->HandleAttributes = ObpGetHandleAttributes(HandleTableEntry);
+    HandleInfo->Reserved2 = 0;
+
+    if (HandleInfo->Object)
     {
-        objectType = KphGetObjectType(handleInfo.Object);
+        objectType = KphGetObjectType(HandleInfo->Object);
 
         if (objectType && KphDynOtIndex != -1)
         {
             if (KphDynNtVersion >= PHNT_WIN7)
-                handleInfo.ObjectTypeIndex = (USHORT)*(PUCHAR)((ULONG_PTR)objectType + KphDynOtIndex);
+                HandleInfo->ObjectTypeIndex = (USHORT)*(PUCHAR)((ULONG_PTR)objectType + KphDynOtIndex);
             else
-                handleInfo.ObjectTypeIndex = (USHORT)*(PULONG)((ULONG_PTR)objectType + KphDynOtIndex);
+                HandleInfo->ObjectTypeIndex = (USHORT)*(PULONG)((ULONG_PTR)objectType + KphDynOtIndex);
         }
     }
+}
+
+BOOLEAN KphpEnumerateProcessHandlesEnumCallback61(
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    )
+{
+    PKPHP_ENUMERATE_PROCESS_HANDLES_CONTEXT context = Context;
+    KPH_PROCESS_HANDLE handleInfo;
+    PKPH_PROCESS_HANDLE entryInBuffer;
+
+    PAGED_CODE();
+
+    if ((ULONG_PTR)Handle < context->StartHandle || (ULONG_PTR)Handle > context->EndHandle)
+        return FALSE;
+
+    KphpCaptureProcessHandle(HandleTableEntry, Handle, &handleInfo);
 
     // Advance the current entry pointer regardless of whether the information will be written;
     // this will allow the parent function to report the correct return length.
@@ -271,19 +364,10 @@ BOOLEAN KphpEnumerateProcessHandlesEnumCallback(
     return result;
 }
 
-/**
- * Enumerates the handles of a process.
- *
- * \param ProcessHandle A handle to a process.
- * \param Buffer The buffer in which the handle information will
- * be stored.
- * \param BufferLength The number of bytes available in \a Buffer.
- * \param ReturnLength A variable which receives the number of bytes
- * required to be available in \a Buffer.
- * \param AccessMode The mode in which to perform access checks.
- */
-NTSTATUS KpiEnumerateProcessHandles(
+NTSTATUS KphpEnumerateProcessHandles(
     __in HANDLE ProcessHandle,
+    __in ULONG_PTR StartHandle,
+    __in ULONG_PTR EndHandle,
     __out_bcount(BufferLength) PVOID Buffer,
     __in_opt ULONG BufferLength,
     __out_opt PULONG ReturnLength,
@@ -347,6 +431,8 @@ NTSTATUS KpiEnumerateProcessHandles(
     context.CurrentEntry = ((PKPH_PROCESS_HANDLE_INFORMATION)Buffer)->Handles;
     context.Count = 0;
     context.Status = STATUS_SUCCESS;
+    context.StartHandle = StartHandle;
+    context.EndHandle = EndHandle;
 
     // Enumerate the handles.
 
@@ -421,6 +507,631 @@ NTSTATUS KpiEnumerateProcessHandles(
     return context.Status;
 }
 
+/**
+ * Enumerates the handles of a process.
+ *
+ * \param ProcessHandle A handle to a process.
+ * \param Buffer The buffer in which the handle information will
+ * be stored.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes
+ * required to be available in \a Buffer.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiEnumerateProcessHandles(
+    __in HANDLE ProcessHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    PAGED_CODE();
+
+    return KphpEnumerateProcessHandles(
+        ProcessHandle,
+        0,
+        MAXULONG_PTR,
+        Buffer,
+        BufferLength,
+        ReturnLength,
+        AccessMode
+        );
+}
+
+/**
+ * Enumerates a range of handles of a process.
+ *
+ * \param ProcessHandle A handle to a process.
+ * \param StartHandle The lowest handle value to include.
+ * \param EndHandle The highest handle value to include.
+ * \param Buffer The buffer in which the handle information will
+ * be stored.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes
+ * required to be available in \a Buffer.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiEnumerateProcessHandleRange(
+    __in HANDLE ProcessHandle,
+    __in HANDLE StartHandle,
+    __in HANDLE EndHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    PAGED_CODE();
+
+    if ((ULONG_PTR)StartHandle > (ULONG_PTR)EndHandle)
+        return STATUS_INVALID_PARAMETER;
+
+    return KphpEnumerateProcessHandles(
+        ProcessHandle,
+        (ULONG_PTR)StartHandle,
+        (ULONG_PTR)EndHandle,
+        Buffer,
+        BufferLength,
+        ReturnLength,
+        AccessMode
+        );
+}
+
+FORCEINLINE ULONG KphpMixHandleDigest(
+    __in ULONG Digest,
+    __in ULONG_PTR Value
+    )
+{
+#ifdef _M_X64
+    Value ^= Value >> 32;
+#endif
+
+    return (Digest ^ (ULONG)Value) * 16777619;
+}
+
+BOOLEAN KphpQueryProcessHandleDigestEnumCallback61(
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    )
+{
+    PKPHP_QUERY_PROCESS_HANDLE_DIGEST_CONTEXT context = Context;
+    ULONG index;
+    POBJECT_HEADER objectHeader;
+    PKPH_PROCESS_HANDLE_RANGE range;
+
+    PAGED_CODE();
+
+    index = (ULONG)((ULONG_PTR)Handle >> KPH_HANDLE_RANGE_SHIFT);
+    context->HandleCount++;
+
+    if (context->NumberOfRanges < index + 1)
+        context->NumberOfRanges = index + 1;
+
+    if (index >= context->MaximumRanges)
+    {
+        if (context->Status == STATUS_SUCCESS)
+            context->Status = STATUS_BUFFER_TOO_SMALL;
+
+        return FALSE;
+    }
+
+    objectHeader = ObpDecodeObject(HandleTableEntry->Object);
+    range = &context->Buffer->Ranges[index];
+
+    __try
+    {
+        ULONG digest;
+
+        digest = range->Digest;
+        digest = KphpMixHandleDigest(digest, (ULONG_PTR)Handle);
+        digest = KphpMixHandleDigest(digest, objectHeader ? (ULONG_PTR)&objectHeader->Body : 0);
+        digest = KphpMixHandleDigest(digest, ObpDecodeGrantedAccess(HandleTableEntry->GrantedAccess));
+        digest = KphpMixHandleDigest(digest, ObpGetHandleAttributes(HandleTableEntry));
+        range->Digest = digest;
+        range->HandleCount++;
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        if (context->Status == STATUS_SUCCESS)
+            context->Status = GetExceptionCode();
+    }
+
+    return FALSE;
+}
+
+BOOLEAN KphpQueryProcessHandleDigestEnumCallback(
+    __in PHANDLE_TABLE HandleTable,
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    )
+{
+    BOOLEAN result;
+
+    PAGED_CODE();
+
+    result = KphpQueryProcessHandleDigestEnumCallback61(HandleTableEntry, Handle, Context);
+    KphUnlockHandleTableEntry(HandleTable, HandleTableEntry);
+
+    return result;
+}
+
+/**
+ * Computes a digest of the handle table of a process.
+ *
+ * \param ProcessHandle A handle to a process.
+ * \param Buffer The buffer in which the digest will be stored.
+ * The digest contains a handle count and a hash for each range
+ * of KPH_HANDLE_RANGE_SIZE handle values; a range whose hash has
+ * not changed between two queries is very likely to contain the
+ * same handles.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes
+ * required to be available in \a Buffer.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiQueryProcessHandleDigest(
+    __in HANDLE ProcessHandle,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status;
+    PEPROCESS process;
+    PHANDLE_TABLE handleTable;
+    KPHP_QUERY_PROCESS_HANDLE_DIGEST_CONTEXT context;
+    PKPH_PROCESS_HANDLE_DIGEST digest = Buffer;
+    ULONG returnLength;
+
+    PAGED_CODE();
+
+    if (KphDynNtVersion >= PHNT_WIN8 &&
+        (!ExfUnblockPushLock_I || KphDynHtHandleContentionEvent == -1))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Buffer, BufferLength, sizeof(ULONG));
+
+            if (ReturnLength)
+                ProbeForWrite(ReturnLength, sizeof(ULONG), sizeof(ULONG));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    context.Buffer = digest;
+    context.MaximumRanges = 0;
+    context.HandleCount = 0;
+    context.NumberOfRanges = 0;
+    context.Status = STATUS_SUCCESS;
+
+    if (BufferLength >= FIELD_OFFSET(KPH_PROCESS_HANDLE_DIGEST, Ranges))
+    {
+        context.MaximumRanges = (BufferLength - FIELD_OFFSET(KPH_PROCESS_HANDLE_DIGEST, Ranges)) / sizeof(KPH_PROCESS_HANDLE_RANGE);
+
+        __try
+        {
+            RtlZeroMemory(digest->Ranges, context.MaximumRanges * sizeof(KPH_PROCESS_HANDLE_RANGE));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    // Reference the process object.
+    status = ObReferenceObjectByHandle(
+        ProcessHandle,
+        0,
+        *PsProcessType,
+        AccessMode,
+        &process,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    // Get its handle table.
+    handleTable = KphReferenceProcessHandleTable(process);
+
+    if (!handleTable)
+    {
+        ObDereferenceObject(process);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    if (KphDynNtVersion >= PHNT_WIN8)
+    {
+        ExEnumHandleTable(
+            handleTable,
+            KphpQueryProcessHandleDigestEnumCallback,
+            &context,
+            NULL
+            );
+    }
+    else
+    {
+        ExEnumHandleTable(
+            handleTable,
+            (PEX_ENUM_HANDLE_CALLBACK)KphpQueryProcessHandleDigestEnumCallback61,
+            &context,
+            NULL
+            );
+    }
+
+    KphDereferenceProcessHandleTable(process);
+    ObDereferenceObject(process);
+
+    if (BufferLength >= FIELD_OFFSET(KPH_PROCESS_HANDLE_DIGEST, Ranges))
+    {
+        __try
+        {
+            digest->HandleCount = context.HandleCount;
+            digest->NumberOfRanges = context.NumberOfRanges;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+    else
+    {
+        context.Status = STATUS_BUFFER_TOO_SMALL;
+    }
+
+    if (ReturnLength)
+    {
+        returnLength = FIELD_OFFSET(KPH_PROCESS_HANDLE_DIGEST, Ranges) +
+            context.NumberOfRanges * sizeof(KPH_PROCESS_HANDLE_RANGE);
+
+        __try
+        {
+            *ReturnLength = returnLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    return context.Status;
+}
+
+BOOLEAN KphpEnumerateProcessHandleNamesEnumCallback61(
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    )
+{
+    PKPHP_ENUMERATE_PROCESS_HANDLE_NAMES_CONTEXT context = Context;
+    KPH_PROCESS_HANDLE handleInfo;
+
+    PAGED_CODE();
+
+    if ((ULONG_PTR)Handle < context->StartHandle)
+        return FALSE;
+
+    KphpCaptureProcessHandle(HandleTableEntry, Handle, &handleInfo);
+
+    if (context->TypeMask && !KPH_TEST_OBJECT_TYPE_MASK(context->TypeMask, handleInfo.ObjectTypeIndex))
+        return FALSE;
+
+    // Stop at the first matching handle we have no room for; the caller continues from it.
+    if (context->Count == KPH_MAXIMUM_HANDLE_NAMES)
+    {
+        context->NextHandle = Handle;
+        return TRUE;
+    }
+
+    // The name is queried after the handle table entry has been unlocked.
+    if (handleInfo.Object)
+        ObReferenceObject(handleInfo.Object);
+
+    context->Handles[context->Count++] = handleInfo;
+
+    return FALSE;
+}
+
+BOOLEAN KphpEnumerateProcessHandleNamesEnumCallback(
+    __in PHANDLE_TABLE HandleTable,
+    __inout PHANDLE_TABLE_ENTRY HandleTableEntry,
+    __in HANDLE Handle,
+    __in PVOID Context
+    )
+{
+    BOOLEAN result;
+
+    PAGED_CODE();
+
+    result = KphpEnumerateProcessHandleNamesEnumCallback61(HandleTableEntry, Handle, Context);
+    KphUnlockHandleTableEntry(HandleTable, HandleTableEntry);
+
+    return result;
+}
+
+/**
+ * Enumerates the handles of a process along with their object names.
+ *
+ * \param ProcessHandle A handle to a process.
+ * \param StartHandle The lowest handle value to include. Specify NULL
+ * to start a new enumeration, or the NextHandle value from the previous
+ * call to continue one.
+ * \param TypeMask The object types to include. Specify NULL to include
+ * handles of all types.
+ * \param Buffer The buffer in which a KPH_PROCESS_HANDLE_NAME_INFORMATION
+ * structure will be stored.
+ * \param BufferLength The number of bytes available in \a Buffer. At
+ * most KPH_MAXIMUM_HANDLE_NAMES handles are returned, and fewer if their
+ * names do not fit.
+ * \param ReturnLength A variable which receives the number of bytes
+ * written to \a Buffer, or the number of bytes required for the first
+ * handle if STATUS_BUFFER_TOO_SMALL is returned.
+ * \param AccessMode The mode in which to perform access checks.
+ */
+NTSTATUS KpiEnumerateProcessHandleNames(
+    __in HANDLE ProcessHandle,
+    __in HANDLE StartHandle,
+    __in_opt PKPH_OBJECT_TYPE_MASK TypeMask,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status;
+    PEPROCESS process;
+    PHANDLE_TABLE handleTable;
+    KPH_OBJECT_TYPE_MASK typeMask;
+    KPHP_ENUMERATE_PROCESS_HANDLE_NAMES_CONTEXT context;
+    PKPH_PROCESS_HANDLE_NAME_INFORMATION information = Buffer;
+    POBJECT_NAME_INFORMATION nameInfo;
+    ULONG nameInfoLength;
+    PKPH_PROCESS_HANDLE_NAME entry;
+    PKPH_PROCESS_HANDLE_NAME lastEntry;
+    ULONG entryLength;
+    ULONG offset;
+    ULONG count;
+    HANDLE nextHandle;
+    ULONG returnLength;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (KphDynNtVersion >= PHNT_WIN8 &&
+        (!ExfUnblockPushLock_I || KphDynHtHandleContentionEvent == -1))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Buffer, BufferLength, sizeof(ULONG_PTR));
+
+            if (ReturnLength)
+                ProbeForWrite(ReturnLength, sizeof(ULONG), sizeof(ULONG));
+
+            if (TypeMask)
+            {
+                ProbeForRead(TypeMask, sizeof(KPH_OBJECT_TYPE_MASK), sizeof(ULONG));
+                typeMask = *TypeMask;
+            }
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+    else
+    {
+        if (TypeMask)
+            typeMask = *TypeMask;
+    }
+
+    // Reference the process object.
+    status = ObReferenceObjectByHandle(
+        ProcessHandle,
+        0,
+        *PsProcessType,
+        AccessMode,
+        &process,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    // Get its handle table.
+    handleTable = KphReferenceProcessHandleTable(process);
+
+    if (!handleTable)
+    {
+        ObDereferenceObject(process);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    context.StartHandle = (ULONG_PTR)StartHandle;
+    context.TypeMask = TypeMask ? &typeMask : NULL;
+    context.Handles = ExAllocatePoolWithTag(PagedPool, KPH_MAXIMUM_HANDLE_NAMES * sizeof(KPH_PROCESS_HANDLE), 'NhpK');
+    context.Count = 0;
+    context.NextHandle = NULL;
+
+    if (!context.Handles)
+    {
+        KphDereferenceProcessHandleTable(process);
+        ObDereferenceObject(process);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if (KphDynNtVersion >= PHNT_WIN8)
+    {
+        ExEnumHandleTable(
+            handleTable,
+            KphpEnumerateProcessHandleNamesEnumCallback,
+            &context,
+            NULL
+            );
+    }
+    else
+    {
+        ExEnumHandleTable(
+            handleTable,
+            (PEX_ENUM_HANDLE_CALLBACK)KphpEnumerateProcessHandleNamesEnumCallback61,
+            &context,
+            NULL
+            );
+    }
+
+    KphDereferenceProcessHandleTable(process);
+    ObDereferenceObject(process);
+
+    // Query the names now that no handle table entries are locked, since the I/O manager may
+    // need to send a request to a file system driver.
+
+    nameInfoLength = sizeof(OBJECT_NAME_INFORMATION) + MAXUSHORT;
+    nameInfo = ExAllocatePoolWithTag(PagedPool, nameInfoLength, 'NhpK');
+    lastEntry = NULL;
+    entryLength = 0;
+    offset = FIELD_OFFSET(KPH_PROCESS_HANDLE_NAME_INFORMATION, Handles);
+    count = 0;
+    nextHandle = context.NextHandle;
+
+    if (BufferLength < offset)
+    {
+        status = STATUS_BUFFER_TOO_SMALL;
+        returnLength = offset;
+    }
+    else
+    {
+        for (i = 0; i < context.Count; i++)
+        {
+            NTSTATUS nameStatus;
+            ULONG nameReturnLength;
+            USHORT nameLength;
+
+            nameLength = 0;
+
+            if (!nameInfo)
+            {
+                nameStatus = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            else if (!context.Handles[i].Object)
+            {
+                nameStatus = STATUS_INVALID_HANDLE;
+            }
+            else
+            {
+                nameStatus = KphQueryNameObject(
+                    context.Handles[i].Object,
+                    nameInfo,
+                    nameInfoLength,
+                    &nameReturnLength
+                    );
+
+                if (NT_SUCCESS(nameStatus) && nameInfo->Name.Buffer)
+                    nameLength = nameInfo->Name.Length;
+            }
+
+            entryLength = sizeof(KPH_PROCESS_HANDLE_NAME) + nameLength + sizeof(WCHAR);
+            entryLength = (entryLength + sizeof(ULONG_PTR) - 1) & ~(sizeof(ULONG_PTR) - 1);
+
+            // Stop when the buffer is full, and let the caller continue from this handle.
+            if (offset + entryLength > BufferLength)
+            {
+                if (count == 0)
+                    status = STATUS_BUFFER_TOO_SMALL;
+
+                nextHandle = context.Handles[i].Handle;
+                break;
+            }
+
+            entry = (PKPH_PROCESS_HANDLE_NAME)((ULONG_PTR)Buffer + offset);
+
+            __try
+            {
+                entry->NextEntryOffset = 0;
+                entry->NameStatus = nameStatus;
+                entry->Handle = context.Handles[i];
+                entry->ObjectName.Length = nameLength;
+                entry->ObjectName.MaximumLength = nameLength + sizeof(WCHAR);
+                entry->ObjectName.Buffer = (PWSTR)((ULONG_PTR)entry + sizeof(KPH_PROCESS_HANDLE_NAME));
+
+                if (nameLength != 0)
+                    memcpy(entry->ObjectName.Buffer, nameInfo->Name.Buffer, nameLength);
+
+                entry->ObjectName.Buffer[nameLength / sizeof(WCHAR)] = 0;
+
+                if (lastEntry)
+                    lastEntry->NextEntryOffset = (ULONG)((ULONG_PTR)entry - (ULONG_PTR)lastEntry);
+            }
+            __except (EXCEPTION_EXECUTE_HANDLER)
+            {
+                status = GetExceptionCode();
+                break;
+            }
+
+            lastEntry = entry;
+            offset += entryLength;
+            count++;
+        }
+
+        returnLength = status == STATUS_BUFFER_TOO_SMALL ? offset + entryLength : offset;
+    }
+
+    // Release the references taken during the enumeration.
+    for (i = 0; i < context.Count; i++)
+    {
+        if (context.Handles[i].Object)
+            ObDereferenceObject(context.Handles[i].Object);
+    }
+
+    if (nameInfo)
+        ExFreePoolWithTag(nameInfo, 'NhpK');
+
+    ExFreePoolWithTag(context.Handles, 'NhpK');
+
+    if (NT_SUCCESS(status))
+    {
+        __try
+        {
+            information->HandleCount = count;
+            information->Reserved = 0;
+            information->NextHandle = nextHandle;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    if (ReturnLength && (NT_SUCCESS(status) || status == STATUS_BUFFER_TOO_SMALL))
+    {
+        __try
+        {
+            *ReturnLength = returnLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    return status;
+}
+
 /**
  * Queries the name of an object.
  *
@@ -32,6 +32,8 @@
 #pragma alloc_text(PAGE, KpiTerminateProcess)
 #pragma alloc_text(PAGE, KpiQueryInformationProcess)
 #pragma alloc_text(PAGE, KpiSetInformationProcess)
+#pragma alloc_text(PAGE, KpiEnumerateProcessIds)
+#pragma alloc_text(PAGE, KpiQueryInformationProcesses)
 #endif
 
 /**
@@ -893,6 +895,337 @@ NTSTATUS KpiSetInformationProcess(
     return status;
 }
 
+/**
+ * Enumerates the processes in the client ID table.
+ *
+ * \param StartProcessId The lowest process ID to include.
+ * \param EndProcessId The highest process ID to include.
+ * \param Buffer The buffer in which the process information will
+ * be stored.
+ * \param BufferLength The number of bytes available in \a Buffer.
+ * \param ReturnLength A variable which receives the number of bytes
+ * required to be available in \a Buffer.
+ * \param AccessMode The mode in which to perform access checks.
+ *
+ * \remarks Every process ID in the range is looked up directly, so
+ * processes which have been unlinked from the active process list are
+ * still found. This is done in a single request to avoid the cost of
+ * opening a handle for each process ID.
+ */
+NTSTATUS KpiEnumerateProcessIds(
+    __in HANDLE StartProcessId,
+    __in HANDLE EndProcessId,
+    __out_bcount(BufferLength) PVOID Buffer,
+    __in_opt ULONG BufferLength,
+    __out_opt PULONG ReturnLength,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PKPH_PROCESS_ID_INFORMATION processIdInfo = Buffer;
+    ULONG_PTR processId;
+    ULONG count = 0;
+    ULONG returnLength;
+
+    PAGED_CODE();
+
+    if ((ULONG_PTR)StartProcessId > (ULONG_PTR)EndProcessId)
+        return STATUS_INVALID_PARAMETER;
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Buffer, BufferLength, sizeof(ULONG));
+
+            if (ReturnLength)
+                ProbeForWrite(ReturnLength, sizeof(ULONG), sizeof(ULONG));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    // Process IDs are multiples of 4.
+    processId = ((ULONG_PTR)StartProcessId + 3) & ~(ULONG_PTR)3;
+
+    for (; processId <= (ULONG_PTR)EndProcessId; processId += 4)
+    {
+        PEPROCESS process;
+        KPH_PROCESS_ID_ENTRY entry;
+        ULONG offset;
+
+        if (NT_SUCCESS(PsLookupProcessByProcessId((HANDLE)processId, &process)))
+        {
+            entry.ProcessId = (HANDLE)processId;
+            entry.CreateTime.QuadPart = PsGetProcessCreateTimeQuadPart(process);
+            entry.ExitStatus = PsGetProcessExitStatus(process);
+            entry.Flags = entry.ExitStatus != STATUS_PENDING ? KPH_PROCESS_ID_EXITED : 0;
+            ObDereferenceObject(process);
+
+            offset = FIELD_OFFSET(KPH_PROCESS_ID_INFORMATION, Processes) + count * sizeof(KPH_PROCESS_ID_ENTRY);
+            count++;
+
+            if (offset + sizeof(KPH_PROCESS_ID_ENTRY) <= BufferLength)
+            {
+                __try
+                {
+                    *(PKPH_PROCESS_ID_ENTRY)((ULONG_PTR)Buffer + offset) = entry;
+                }
+                __except (EXCEPTION_EXECUTE_HANDLER)
+                {
+                    return GetExceptionCode();
+                }
+            }
+            else
+            {
+                // Keep counting so we can report the required length.
+                status = STATUS_BUFFER_TOO_SMALL;
+            }
+        }
+
+        // Don't wrap around at the end of the range.
+        if (processId > MAXULONG_PTR - 4)
+            break;
+    }
+
+    returnLength = FIELD_OFFSET(KPH_PROCESS_ID_INFORMATION, Processes) + count * sizeof(KPH_PROCESS_ID_ENTRY);
+
+    if (BufferLength >= FIELD_OFFSET(KPH_PROCESS_ID_INFORMATION, Processes))
+    {
+        __try
+        {
+            processIdInfo->NumberOfProcesses = count;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+    else
+    {
+        status = STATUS_BUFFER_TOO_SMALL;
+    }
+
+    if (ReturnLength)
+    {
+        __try
+        {
+            *ReturnLength = returnLength;
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Queries information about several processes.
+ *
+ * \param Entries An array of entries, each identifying a process by
+ * its ID. The remaining fields of each entry receive the information
+ * for that process.
+ * \param NumberOfEntries The number of entries in \a Entries.
+ * \param Fields The information to query, a combination of
+ * KPH_PROCESS_FIELD_* values.
+ * \param AccessMode The mode in which to perform access checks.
+ *
+ * \return STATUS_SUCCESS if every entry was processed, even if some
+ * of the queries failed.
+ *
+ * \remarks Processes are looked up by their IDs, so no handles are
+ * opened by the caller and no access checks are performed on the
+ * processes. This replaces a handle open and several queries for each
+ * process with a single request.
+ */
+NTSTATUS KpiQueryInformationProcesses(
+    __inout_ecount(NumberOfEntries) PKPH_PROCESS_BATCH_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in ULONG Fields,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PKPH_PROCESS_BATCH_ENTRY entries;
+    SIZE_T entriesLength;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (NumberOfEntries == 0 || NumberOfEntries > KPH_MAXIMUM_PROCESS_BATCH_ENTRIES)
+        return STATUS_INVALID_PARAMETER_2;
+    if (Fields & ~KPH_PROCESS_FIELD_ALL)
+        return STATUS_INVALID_PARAMETER_3;
+
+    entriesLength = NumberOfEntries * sizeof(KPH_PROCESS_BATCH_ENTRY);
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Entries, entriesLength, sizeof(ULONG_PTR));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    entries = ExAllocatePoolWithTag(PagedPool, entriesLength, 'QhpK');
+
+    if (!entries)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    __try
+    {
+        memcpy(entries, Entries, entriesLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        ExFreePoolWithTag(entries, 'QhpK');
+        return GetExceptionCode();
+    }
+
+    for (i = 0; i < NumberOfEntries; i++)
+    {
+        PKPH_PROCESS_BATCH_ENTRY entry = &entries[i];
+        PEPROCESS process;
+        HANDLE processHandle;
+
+        entry->CreateTime.QuadPart = 0;
+        entry->ValidFields = 0;
+        entry->PriorityClass = 0;
+        entry->IsProtectedProcess = FALSE;
+        entry->Reserved = 0;
+        entry->IoPriority = 0;
+        entry->PagePriority = 0;
+        entry->ExecuteFlags = 0;
+        entry->HandleCount = 0;
+
+        if (!NT_SUCCESS(entry->Status = PsLookupProcessByProcessId(entry->ProcessId, &process)))
+            continue;
+
+        entry->CreateTime.QuadPart = PsGetProcessCreateTimeQuadPart(process);
+
+        if ((Fields & KPH_PROCESS_FIELD_PROTECTION) && PsIsProtectedProcess_I)
+        {
+            entry->IsProtectedProcess = PsIsProtectedProcess_I(process);
+            entry->ValidFields |= KPH_PROCESS_FIELD_PROTECTION;
+        }
+
+        // One kernel handle is shared by the queries which need a handle.
+        if ((Fields & (KPH_PROCESS_FIELD_PRIORITY_CLASS | KPH_PROCESS_FIELD_IO_PRIORITY |
+            KPH_PROCESS_FIELD_PAGE_PRIORITY | KPH_PROCESS_FIELD_HANDLE_COUNT)) &&
+            NT_SUCCESS(ObOpenObjectByPointer(
+            process,
+            OBJ_KERNEL_HANDLE,
+            NULL,
+            PROCESS_QUERY_INFORMATION,
+            *PsProcessType,
+            KernelMode,
+            &processHandle
+            )))
+        {
+            if (Fields & KPH_PROCESS_FIELD_PRIORITY_CLASS)
+            {
+                struct
+                {
+                    BOOLEAN Foreground;
+                    UCHAR PriorityClass;
+                } priorityClass;
+
+                if (NT_SUCCESS(ZwQueryInformationProcess(
+                    processHandle,
+                    ProcessPriorityClass,
+                    &priorityClass,
+                    sizeof(priorityClass),
+                    NULL
+                    )))
+                {
+                    entry->PriorityClass = priorityClass.PriorityClass;
+                    entry->ValidFields |= KPH_PROCESS_FIELD_PRIORITY_CLASS;
+                }
+            }
+
+            if ((Fields & KPH_PROCESS_FIELD_IO_PRIORITY) && NT_SUCCESS(ZwQueryInformationProcess(
+                processHandle,
+                ProcessIoPriority,
+                &entry->IoPriority,
+                sizeof(ULONG),
+                NULL
+                )))
+            {
+                entry->ValidFields |= KPH_PROCESS_FIELD_IO_PRIORITY;
+            }
+
+            if ((Fields & KPH_PROCESS_FIELD_PAGE_PRIORITY) && NT_SUCCESS(ZwQueryInformationProcess(
+                processHandle,
+                ProcessPagePriority,
+                &entry->PagePriority,
+                sizeof(ULONG),
+                NULL
+                )))
+            {
+                entry->ValidFields |= KPH_PROCESS_FIELD_PAGE_PRIORITY;
+            }
+
+            if ((Fields & KPH_PROCESS_FIELD_HANDLE_COUNT) && NT_SUCCESS(ZwQueryInformationProcess(
+                processHandle,
+                ProcessHandleCount,
+                &entry->HandleCount,
+                sizeof(ULONG),
+                NULL
+                )))
+            {
+                entry->ValidFields |= KPH_PROCESS_FIELD_HANDLE_COUNT;
+            }
+
+            ZwClose(processHandle);
+        }
+
+        if ((Fields & KPH_PROCESS_FIELD_EXECUTE_FLAGS) && KphAcquireProcessRundownProtection(process))
+        {
+            KAPC_STATE apcState;
+
+            // Execute options can only be queried for the current process.
+            KeStackAttachProcess(process, &apcState);
+
+            if (NT_SUCCESS(ZwQueryInformationProcess(
+                NtCurrentProcess(),
+                ProcessExecuteFlags,
+                &entry->ExecuteFlags,
+                sizeof(ULONG),
+                NULL
+                )))
+            {
+                entry->ValidFields |= KPH_PROCESS_FIELD_EXECUTE_FLAGS;
+            }
+
+            KeUnstackDetachProcess(&apcState);
+            KphReleaseProcessRundownProtection(process);
+        }
+
+        ObDereferenceObject(process);
+    }
+
+    __try
+    {
+        memcpy(Entries, entries, entriesLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    ExFreePoolWithTag(entries, 'QhpK');
+
+    return status;
+}
+
 /**
  * Prevents a process from terminating.
  *
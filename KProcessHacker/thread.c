@@ -36,6 +36,7 @@ typedef struct _CAPTURE_BACKTRACE_THREAD_CONTEXT
     KEVENT CompletedEvent;
     ULONG FramesToSkip;
     ULONG FramesToCapture;
+    ULONG Flags;
     PVOID *BackTrace;
     ULONG CapturedFrames;
     ULONG BackTraceHash;
@@ -72,6 +73,7 @@ VOID KphpExitThreadSpecialApc(
 #pragma alloc_text(PAGE, KphCaptureStackBackTraceThread)
 #pragma alloc_text(PAGE, KphpCaptureStackBackTraceThreadSpecialApc)
 #pragma alloc_text(PAGE, KpiCaptureStackBackTraceThread)
+#pragma alloc_text(PAGE, KpiCaptureStackBackTraceThreads)
 #pragma alloc_text(PAGE, KpiQueryInformationThread)
 #pragma alloc_text(PAGE, KpiSetInformationThread)
 #endif
@@ -637,6 +639,7 @@ ULONG KphCaptureStackBackTrace(
  * \param FramesToSkip The number of frames to skip from the
  * bottom of the stack.
  * \param FramesToCapture The number of frames to capture.
+ * \param Flags A combination of flags for RtlWalkFrameChain.
  * \param BackTrace An array in which the stack trace will be
  * stored.
  * \param CapturedFrames A variable which receives the number of
@@ -651,6 +654,7 @@ NTSTATUS KphCaptureStackBackTraceThread(
     __in PETHREAD Thread,
     __in ULONG FramesToSkip,
     __in ULONG FramesToCapture,
+    __in ULONG Flags,
     __out_ecount(FramesToCapture) PVOID *BackTrace,
     __out_opt PULONG CapturedFrames,
     __out_opt PULONG BackTraceHash,
@@ -726,6 +730,7 @@ NTSTATUS KphCaptureStackBackTraceThread(
     // Initialize the context structure.
     context.FramesToSkip = FramesToSkip;
     context.FramesToCapture = FramesToCapture;
+    context.Flags = Flags;
     context.BackTrace = backTrace;
 
     // Check if we're trying to get a stack trace of the current thread.
@@ -833,7 +838,7 @@ VOID KphpCaptureStackBackTraceThreadSpecialApc(
     context->CapturedFrames = KphCaptureStackBackTrace(
         context->FramesToSkip,
         context->FramesToCapture,
-        0,
+        context->Flags,
         context->BackTrace,
         &context->BackTraceHash
         );
@@ -894,6 +899,7 @@ NTSTATUS KpiCaptureStackBackTraceThread(
         thread,
         FramesToSkip,
         FramesToCapture,
+        0,
         BackTrace,
         CapturedFrames,
         BackTraceHash,
@@ -904,6 +910,190 @@ NTSTATUS KpiCaptureStackBackTraceThread(
     return status;
 }
 
+/**
+ * Captures the stack traces of several threads in a process.
+ *
+ * \param ProcessHandle A handle to the process containing the
+ * threads.
+ * \param Entries An array of entries, each specifying the ID of a
+ * thread. The other fields of each entry receive the result for
+ * that thread.
+ * \param NumberOfEntries The number of entries in \a Entries.
+ * \param FramesToSkip The number of frames to skip from the
+ * bottom of each stack.
+ * \param FramesToCapture The maximum number of frames to capture
+ * for each thread.
+ * \param Flags A combination of flags.
+ * \li \c KPH_STACK_BACK_TRACE_USER_MODE Capture the user-mode stacks
+ * instead of the kernel-mode stacks.
+ * \param BackTraces An array which receives the stack traces. The
+ * stack trace of the thread in entry \a i is stored starting at
+ * element \a i * \a FramesToCapture.
+ * \param AccessMode The mode in which to perform access checks.
+ *
+ * \return STATUS_SUCCESS if every entry was processed, even if some
+ * of the captures failed.
+ */
+NTSTATUS KpiCaptureStackBackTraceThreads(
+    __in HANDLE ProcessHandle,
+    __inout_ecount(NumberOfEntries) PKPH_STACK_BACK_TRACE_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in ULONG FramesToSkip,
+    __in ULONG FramesToCapture,
+    __in ULONG Flags,
+    __out_ecount(NumberOfEntries * FramesToCapture) PVOID *BackTraces,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status;
+    PEPROCESS process;
+    PKPH_STACK_BACK_TRACE_ENTRY entries;
+    SIZE_T entriesLength;
+    PVOID *backTrace;
+    ULONG walkFlags;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (NumberOfEntries == 0 || NumberOfEntries > KPH_MAXIMUM_STACK_BACK_TRACE_BATCH_ENTRIES)
+        return STATUS_INVALID_PARAMETER_3;
+    if (FramesToCapture == 0 || FramesToCapture > MAX_STACK_DEPTH)
+        return STATUS_INVALID_PARAMETER_5;
+    if ((Flags & ~KPH_STACK_BACK_TRACE_USER_MODE) != 0)
+        return STATUS_INVALID_PARAMETER_6;
+
+    walkFlags = (Flags & KPH_STACK_BACK_TRACE_USER_MODE) ? RTL_WALK_USER_MODE_STACK : 0;
+    entriesLength = NumberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY);
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Entries, entriesLength, sizeof(ULONG_PTR));
+            ProbeForWrite(BackTraces, NumberOfEntries * FramesToCapture * sizeof(PVOID), sizeof(PVOID));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    // Capture the entries so the caller can't change them while we're working.
+    entries = ExAllocatePoolWithTag(PagedPool, entriesLength, 'ThpK');
+
+    if (!entries)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    backTrace = ExAllocatePoolWithTag(PagedPool, FramesToCapture * sizeof(PVOID), 'ThpK');
+
+    if (!backTrace)
+    {
+        ExFreePoolWithTag(entries, 'ThpK');
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    __try
+    {
+        memcpy(entries, Entries, entriesLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        ExFreePoolWithTag(backTrace, 'ThpK');
+        ExFreePoolWithTag(entries, 'ThpK');
+        return GetExceptionCode();
+    }
+
+    status = ObReferenceObjectByHandle(
+        ProcessHandle,
+        0,
+        *PsProcessType,
+        AccessMode,
+        &process,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        ExFreePoolWithTag(backTrace, 'ThpK');
+        ExFreePoolWithTag(entries, 'ThpK');
+        return status;
+    }
+
+    for (i = 0; i < NumberOfEntries; i++)
+    {
+        PKPH_STACK_BACK_TRACE_ENTRY entry = &entries[i];
+        CLIENT_ID clientId;
+        PETHREAD thread;
+
+        entry->CapturedFrames = 0;
+        entry->BackTraceHash = 0;
+
+        // Only threads that belong to the process can be captured.
+        clientId.UniqueProcess = PsGetProcessId(process);
+        clientId.UniqueThread = entry->ThreadId;
+        entry->Status = PsLookupProcessThreadByCid(&clientId, NULL, &thread);
+
+        if (!NT_SUCCESS(entry->Status))
+            continue;
+
+        entry->Status = KphCaptureStackBackTraceThread(
+            thread,
+            FramesToSkip,
+            FramesToCapture,
+            walkFlags,
+            backTrace,
+            &entry->CapturedFrames,
+            &entry->BackTraceHash,
+            KernelMode
+            );
+        ObDereferenceObject(thread);
+
+        if (!NT_SUCCESS(entry->Status))
+            continue;
+
+        if (AccessMode != KernelMode)
+        {
+            __try
+            {
+                memcpy(&BackTraces[i * FramesToCapture], backTrace, entry->CapturedFrames * sizeof(PVOID));
+            }
+            __except (EXCEPTION_EXECUTE_HANDLER)
+            {
+                status = GetExceptionCode();
+                break;
+            }
+        }
+        else
+        {
+            memcpy(&BackTraces[i * FramesToCapture], backTrace, entry->CapturedFrames * sizeof(PVOID));
+        }
+    }
+
+    ObDereferenceObject(process);
+
+    if (NT_SUCCESS(status))
+    {
+        __try
+        {
+            for (i = 0; i < NumberOfEntries; i++)
+            {
+                Entries[i].CapturedFrames = entries[i].CapturedFrames;
+                Entries[i].BackTraceHash = entries[i].BackTraceHash;
+                Entries[i].Status = entries[i].Status;
+            }
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            status = GetExceptionCode();
+        }
+    }
+
+    ExFreePoolWithTag(backTrace, 'ThpK');
+    ExFreePoolWithTag(entries, 'ThpK');
+
+    return status;
+}
+
 /**
  * Queries thread information.
  *
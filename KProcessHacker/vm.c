@@ -30,6 +30,7 @@ ULONG KphpGetCopyExceptionInfo(
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, KphCopyVirtualMemory)
 #pragma alloc_text(PAGE, KpiReadVirtualMemory)
+#pragma alloc_text(PAGE, KpiReadVirtualMemoryBatch)
 #pragma alloc_text(PAGE, KpiWriteVirtualMemory)
 #pragma alloc_text(PAGE, KpiReadVirtualMemoryUnsafe)
 #endif
@@ -407,6 +408,139 @@ NTSTATUS KpiReadVirtualMemory(
     return status;
 }
 
+/**
+ * Copies several ranges of memory from another process into the
+ * current process.
+ *
+ * \param ProcessHandle A handle to a process. The handle must
+ * have PROCESS_VM_READ access.
+ * \param Entries An array of entries, each describing a range to copy.
+ * The Status and NumberOfBytesRead fields of each entry receive the
+ * result for that range.
+ * \param NumberOfEntries The number of entries in \a Entries.
+ * \param AccessMode The mode in which to perform access checks.
+ *
+ * \return STATUS_SUCCESS if every entry was processed, even if some
+ * of the copies failed.
+ */
+NTSTATUS KpiReadVirtualMemoryBatch(
+    __in HANDLE ProcessHandle,
+    __inout_ecount(NumberOfEntries) PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    __in ULONG NumberOfEntries,
+    __in KPROCESSOR_MODE AccessMode
+    )
+{
+    NTSTATUS status;
+    PEPROCESS process;
+    PKPH_VIRTUAL_MEMORY_READ_ENTRY entries;
+    SIZE_T entriesLength;
+    ULONG i;
+
+    PAGED_CODE();
+
+    if (NumberOfEntries == 0 || NumberOfEntries > KPH_MAXIMUM_READ_BATCH_ENTRIES)
+        return STATUS_INVALID_PARAMETER_3;
+
+    entriesLength = NumberOfEntries * sizeof(KPH_VIRTUAL_MEMORY_READ_ENTRY);
+
+    if (AccessMode != KernelMode)
+    {
+        __try
+        {
+            ProbeForWrite(Entries, entriesLength, sizeof(ULONG_PTR));
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            return GetExceptionCode();
+        }
+    }
+
+    // Capture the entries so the caller can't change them while we're copying.
+    entries = ExAllocatePoolWithTag(PagedPool, entriesLength, 'ThpK');
+
+    if (!entries)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    __try
+    {
+        memcpy(entries, Entries, entriesLength);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        ExFreePoolWithTag(entries, 'ThpK');
+        return GetExceptionCode();
+    }
+
+    status = ObReferenceObjectByHandle(
+        ProcessHandle,
+        0,
+        *PsProcessType,
+        AccessMode,
+        &process,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        ExFreePoolWithTag(entries, 'ThpK');
+        return status;
+    }
+
+    for (i = 0; i < NumberOfEntries; i++)
+    {
+        PKPH_VIRTUAL_MEMORY_READ_ENTRY entry = &entries[i];
+
+        entry->NumberOfBytesRead = 0;
+
+        if (AccessMode != KernelMode && (
+            (ULONG_PTR)entry->BaseAddress + entry->BufferSize < (ULONG_PTR)entry->BaseAddress ||
+            (ULONG_PTR)entry->Buffer + entry->BufferSize < (ULONG_PTR)entry->Buffer ||
+            (ULONG_PTR)entry->BaseAddress + entry->BufferSize > (ULONG_PTR)MmHighestUserAddress ||
+            (ULONG_PTR)entry->Buffer + entry->BufferSize > (ULONG_PTR)MmHighestUserAddress
+            ))
+        {
+            entry->Status = STATUS_ACCESS_VIOLATION;
+            continue;
+        }
+
+        if (entry->BufferSize != 0)
+        {
+            entry->Status = KphCopyVirtualMemory(
+                process,
+                entry->BaseAddress,
+                PsGetCurrentProcess(),
+                entry->Buffer,
+                entry->BufferSize,
+                AccessMode,
+                &entry->NumberOfBytesRead
+                );
+        }
+        else
+        {
+            entry->Status = STATUS_SUCCESS;
+        }
+    }
+
+    ObDereferenceObject(process);
+
+    __try
+    {
+        for (i = 0; i < NumberOfEntries; i++)
+        {
+            Entries[i].NumberOfBytesRead = entries[i].NumberOfBytesRead;
+            Entries[i].Status = entries[i].Status;
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    ExFreePoolWithTag(entries, 'ThpK');
+
+    return status;
+}
+
 /**
  * Copies memory from the current process into another process.
  *
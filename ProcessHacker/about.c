@@ -138,6 +138,22 @@ FORCEINLINE ULONG PhpGetObjectTypeObjectCount(
     return info.NumberOfObjects;
 }
 
+FORCEINLINE ULONG PhpGetObjectTypeCacheHitPercentage(
+    _In_ PPH_OBJECT_TYPE ObjectType
+    )
+{
+    PH_OBJECT_TYPE_INFORMATION info;
+    ULONG64 total;
+
+    PhGetObjectTypeInformation(ObjectType, &info);
+    total = (ULONG64)info.NumberOfCacheHits + info.NumberOfCacheMisses;
+
+    if (total == 0)
+        return 0;
+
+    return (ULONG)((ULONG64)info.NumberOfCacheHits * 100 / total);
+}
+
 PPH_STRING PhGetDiagnosticsString(
     VOID
     )
@@ -149,7 +165,7 @@ PPH_STRING PhGetDiagnosticsString(
     PhAppendFormatStringBuilder(&stringBuilder, L"OBJECT INFORMATION\r\n");
 
 #define OBJECT_TYPE_COUNT(Type) PhAppendFormatStringBuilder(&stringBuilder, \
-    L#Type L": %u objects\r\n", PhpGetObjectTypeObjectCount(Type))
+    L#Type L": %u objects, %u%% cache hits\r\n", PhpGetObjectTypeObjectCount(Type), PhpGetObjectTypeCacheHitPercentage(Type))
 
     // ref
     OBJECT_TYPE_COUNT(PhObjectTypeObject);
@@ -175,5 +191,20 @@ PPH_STRING PhGetDiagnosticsString(
     OBJECT_TYPE_COUNT(PhHandleItemType);
     OBJECT_TYPE_COUNT(PhMemoryItemType);
 
+    {
+        PH_IMAGE_CACHE_STATISTICS imageCacheStatistics;
+
+        PhGetImageCacheStatistics(&imageCacheStatistics);
+        PhAppendFormatStringBuilder(&stringBuilder, L"\r\nIMAGE CACHE\r\n");
+        PhAppendFormatStringBuilder(
+            &stringBuilder,
+            L"%u entries, %u hits, %u misses, %u evictions\r\n",
+            imageCacheStatistics.NumberOfEntries,
+            imageCacheStatistics.NumberOfHits,
+            imageCacheStatistics.NumberOfMisses,
+            imageCacheStatistics.NumberOfEvictions
+            );
+    }
+
     return PhFinalStringBuilderString(&stringBuilder);
 }
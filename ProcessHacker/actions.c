@@ -34,10 +34,36 @@
 #include <winsta.h>
 #include <iphlpapi.h>
 
+#define WM_PH_BULK_ACTION_COMPLETED (WM_APP + 301)
+
+// Actions on more processes than this show a progress window.
+#define PH_BULK_ACTION_PROGRESS_THRESHOLD 16
+
 typedef DWORD (WINAPI *_SetTcpEntry)(
     _In_ PMIB_TCPROW pTcpRow
     );
 
+typedef struct _PH_BULK_PROCESS_ACTION
+{
+    PHSVC_API_CONTROLPROCESS_COMMAND Command;
+    ULONG Argument;
+    PPH_PROCESS_ITEM *Processes;
+    PULONG Levels;
+    ULONG NumberOfProcesses;
+    PNTSTATUS Statuses;
+
+    HWND WindowHandle;
+    HANDLE ThreadHandle;
+    volatile LONG NumberOfCompleted;
+    BOOLEAN Stop;
+} PH_BULK_PROCESS_ACTION, *PPH_BULK_PROCESS_ACTION;
+
+typedef struct _PH_BULK_PROCESS_ACTION_ITEM
+{
+    PPH_BULK_PROCESS_ACTION Action;
+    ULONG Index;
+} PH_BULK_PROCESS_ACTION_ITEM, *PPH_BULK_PROCESS_ACTION_ITEM;
+
 static PWSTR DangerousProcesses[] =
 {
     L"csrss.exe", L"dwm.exe", L"logonui.exe", L"lsass.exe", L"lsm.exe",
@@ -968,36 +994,23 @@ static BOOLEAN PhpShowErrorProcess(
     }
 }
 
-BOOLEAN PhUiTerminateProcesses(
-    _In_ HWND hWnd,
-    _In_ PPH_PROCESS_ITEM *Processes,
-    _In_ ULONG NumberOfProcesses
+/**
+ * Performs an action on a process. This matches the handling of the
+ * same command in phsvc.
+ */
+static NTSTATUS PhpControlProcess(
+    _In_ HANDLE ProcessId,
+    _In_ PHSVC_API_CONTROLPROCESS_COMMAND Command,
+    _In_ ULONG Argument
     )
 {
-    BOOLEAN success = TRUE;
-    BOOLEAN cancelled = FALSE;
-    ULONG i;
-
-    if (!PhpShowContinueMessageProcesses(
-        hWnd,
-        L"terminate",
-        L"Terminating a process will cause unsaved data to be lost.",
-        FALSE,
-        Processes,
-        NumberOfProcesses
-        ))
-        return FALSE;
+    NTSTATUS status;
+    HANDLE processHandle;
 
-    for (i = 0; i < NumberOfProcesses; i++)
+    switch (Command)
     {
-        NTSTATUS status;
-        HANDLE processHandle;
-
-        if (NT_SUCCESS(status = PhOpenProcess(
-            &processHandle,
-            PROCESS_TERMINATE,
-            Processes[i]->ProcessId
-            )))
+    case PhSvcControlProcessTerminate:
+        if (NT_SUCCESS(status = PhOpenProcess(&processHandle, PROCESS_TERMINATE, ProcessId)))
         {
             // An exit status of 1 is used here for compatibility reasons:
             // 1. Both Task Manager and Process Explorer use 1.
@@ -1006,111 +1019,384 @@ BOOLEAN PhUiTerminateProcesses(
             status = PhTerminateProcess(processHandle, 1);
             NtClose(processHandle);
         }
+        break;
+    case PhSvcControlProcessSuspend:
+        if (NT_SUCCESS(status = PhOpenProcess(&processHandle, PROCESS_SUSPEND_RESUME, ProcessId)))
+        {
+            status = PhSuspendProcess(processHandle);
+            NtClose(processHandle);
+        }
+        break;
+    case PhSvcControlProcessResume:
+        if (NT_SUCCESS(status = PhOpenProcess(&processHandle, PROCESS_SUSPEND_RESUME, ProcessId)))
+        {
+            status = PhResumeProcess(processHandle);
+            NtClose(processHandle);
+        }
+        break;
+    case PhSvcControlProcessPriority:
+        if (NT_SUCCESS(status = PhOpenProcess(&processHandle, PROCESS_SET_INFORMATION, ProcessId)))
+        {
+            PROCESS_PRIORITY_CLASS priorityClass;
 
-        if (!NT_SUCCESS(status))
+            priorityClass.Foreground = FALSE;
+            priorityClass.PriorityClass = (UCHAR)Argument;
+            status = NtSetInformationProcess(processHandle, ProcessPriorityClass, &priorityClass, sizeof(PROCESS_PRIORITY_CLASS));
+
+            NtClose(processHandle);
+        }
+        break;
+    case PhSvcControlProcessIoPriority:
+        if (NT_SUCCESS(status = PhOpenProcess(&processHandle, PROCESS_SET_INFORMATION, ProcessId)))
         {
-            BOOLEAN connected;
+            status = PhSetProcessIoPriority(processHandle, Argument);
+            NtClose(processHandle);
+        }
+        break;
+    default:
+        status = STATUS_INVALID_PARAMETER;
+        break;
+    }
 
-            success = FALSE;
+    return status;
+}
 
-            if (!cancelled && PhpShowErrorAndConnectToPhSvc(
-                hWnd,
-                PhaConcatStrings2(L"Unable to terminate ", Processes[i]->ProcessName->Buffer)->Buffer,
-                status,
-                &connected
-                ))
+static NTSTATUS PhpBulkProcessActionWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_BULK_PROCESS_ACTION_ITEM item = Parameter;
+    PPH_BULK_PROCESS_ACTION action = item->Action;
+    NTSTATUS status;
+
+    if (!action->Stop)
+        status = PhpControlProcess(action->Processes[item->Index]->ProcessId, action->Command, action->Argument);
+    else
+        status = STATUS_CANCELLED;
+
+    action->Statuses[item->Index] = status;
+    _InterlockedIncrement(&action->NumberOfCompleted);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID PhpExecuteBulkProcessAction(
+    _Inout_ PPH_BULK_PROCESS_ACTION Action
+    )
+{
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    PPH_BULK_PROCESS_ACTION_ITEM items;
+    PVOID *contexts;
+    ULONG numberOfContexts;
+    ULONG maximumLevel;
+    ULONG level;
+    ULONG i;
+
+    items = PhAllocate(Action->NumberOfProcesses * sizeof(PH_BULK_PROCESS_ACTION_ITEM));
+    contexts = PhAllocate(Action->NumberOfProcesses * sizeof(PVOID));
+    maximumLevel = 0;
+
+    for (i = 0; i < Action->NumberOfProcesses; i++)
+    {
+        items[i].Action = Action;
+        items[i].Index = i;
+
+        if (Action->Levels && Action->Levels[i] > maximumLevel)
+            maximumLevel = Action->Levels[i];
+    }
+
+    PhInitializeWorkQueue(&workQueue, 0, PhSystemBasicInformation.NumberOfProcessors, 1000);
+
+    // Each level runs in parallel, deepest first, so that children are
+    // terminated before their parents.
+    for (level = maximumLevel; level != -1; level--)
+    {
+        numberOfContexts = 0;
+
+        for (i = 0; i < Action->NumberOfProcesses; i++)
+        {
+            if (!Action->Levels || Action->Levels[i] == level)
+                contexts[numberOfContexts++] = &items[i];
+        }
+
+        if (numberOfContexts == 0)
+            continue;
+
+        PhInitializeWorkQueueBatch(&workQueueBatch);
+        PhQueueItemsWorkQueueEx(&workQueue, PhpBulkProcessActionWorker, contexts, numberOfContexts, &workQueueBatch);
+        PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+    }
+
+    PhDeleteWorkQueue(&workQueue);
+
+    PhFree(contexts);
+    PhFree(items);
+}
+
+static NTSTATUS PhpBulkProcessActionThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_BULK_PROCESS_ACTION action = Parameter;
+
+    PhpExecuteBulkProcessAction(action);
+    SendMessage(action->WindowHandle, WM_PH_BULK_ACTION_COMPLETED, 0, 0);
+
+    return STATUS_SUCCESS;
+}
+
+static INT_PTR CALLBACK PhpBulkProcessActionDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            PPH_BULK_PROCESS_ACTION action = (PPH_BULK_PROCESS_ACTION)lParam;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+            SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)action);
+
+            SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETRANGE32, 0, action->NumberOfProcesses);
+
+            action->WindowHandle = hwndDlg;
+            action->ThreadHandle = PhCreateThread(0, PhpBulkProcessActionThreadStart, action);
+
+            if (!action->ThreadHandle)
             {
-                if (connected)
-                {
-                    if (NT_SUCCESS(status = PhSvcCallControlProcess(Processes[i]->ProcessId, PhSvcControlProcessTerminate, 0)))
-                        success = TRUE;
-                    else
-                        PhpShowErrorProcess(hWnd, L"terminate", Processes[i], status, 0);
+                PhShowStatus(hwndDlg, L"Unable to create the thread", 0, GetLastError());
+                EndDialog(hwndDlg, IDCANCEL);
+            }
 
-                    PhUiDisconnectFromPhSvc();
-                }
-                else
+            SetTimer(hwndDlg, 1, 200, NULL);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PPH_BULK_PROCESS_ACTION action = (PPH_BULK_PROCESS_ACTION)GetProp(hwndDlg, PhMakeContextAtom());
+
+            if (action->ThreadHandle)
+                NtClose(action->ThreadHandle);
+
+            RemoveProp(hwndDlg, PhMakeContextAtom());
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
                 {
-                    cancelled = TRUE;
+                    PPH_BULK_PROCESS_ACTION action = (PPH_BULK_PROCESS_ACTION)GetProp(hwndDlg, PhMakeContextAtom());
+
+                    // Processes which have not been started are marked as cancelled.
+                    EnableWindow(GetDlgItem(hwndDlg, IDCANCEL), FALSE);
+                    action->Stop = TRUE;
                 }
+                break;
             }
-            else
+        }
+        break;
+    case WM_TIMER:
+        {
+            if (wParam == 1)
             {
-                if (!PhpShowErrorProcess(hWnd, L"terminate", Processes[i], status, 0))
-                    break;
+                PPH_BULK_PROCESS_ACTION action = (PPH_BULK_PROCESS_ACTION)GetProp(hwndDlg, PhMakeContextAtom());
+                ULONG numberOfCompleted;
+
+                numberOfCompleted = action->NumberOfCompleted;
+
+                SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, PhaFormatString(
+                    L"Processed %u of %u processes...",
+                    numberOfCompleted,
+                    action->NumberOfProcesses
+                    )->Buffer);
+                SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETPOS, numberOfCompleted, 0);
             }
         }
+        break;
+    case WM_PH_BULK_ACTION_COMPLETED:
+        {
+            EndDialog(hwndDlg, IDOK);
+        }
+        break;
     }
 
-    return success;
+    return FALSE;
 }
 
-BOOLEAN PhpUiTerminateTreeProcess(
+/**
+ * Performs an action on multiple processes using a pool of worker threads,
+ * then retries any failures through phsvc in a single batch if the user
+ * elevates.
+ *
+ * \param hWnd The window to display user interface components on.
+ * \param Verb A verb describing the action for error messages.
+ * \param Command The action to perform.
+ * \param Argument The argument for \a Command.
+ * \param Processes The processes.
+ * \param Levels An optional array of tree depths. Processes with a greater
+ * depth are completed before processes with a smaller depth are started.
+ * \a Processes must be ordered from the greatest depth to the smallest so
+ * that the phsvc batch follows the same order.
+ * \param NumberOfProcesses The number of processes.
+ *
+ * \return TRUE if the action succeeded for every process, otherwise FALSE.
+ */
+static BOOLEAN PhpUiBulkProcessAction(
     _In_ HWND hWnd,
-    _In_ PPH_PROCESS_ITEM Process,
-    _In_ PVOID Processes,
-    _Inout_ PBOOLEAN Success
+    _In_ PWSTR Verb,
+    _In_ PHSVC_API_CONTROLPROCESS_COMMAND Command,
+    _In_ ULONG Argument,
+    _In_reads_(NumberOfProcesses) PPH_PROCESS_ITEM *Processes,
+    _In_reads_opt_(NumberOfProcesses) PULONG Levels,
+    _In_ ULONG NumberOfProcesses
     )
 {
-    NTSTATUS status;
-    PSYSTEM_PROCESS_INFORMATION process;
-    HANDLE processHandle;
-    PPH_PROCESS_ITEM processItem;
+    BOOLEAN success = TRUE;
+    BOOLEAN connected = FALSE;
+    PH_BULK_PROCESS_ACTION action;
+    ULONG firstFailed = -1;
+    ULONG i;
 
-    // Note:
-    // FALSE should be written to Success if any part of the operation failed.
-    // The return value of this function indicates whether to continue with
-    // the operation (FALSE if user cancelled).
+    if (NumberOfProcesses == 0)
+        return TRUE;
 
-    // Terminate the process.
+    memset(&action, 0, sizeof(PH_BULK_PROCESS_ACTION));
+    action.Command = Command;
+    action.Argument = Argument;
+    action.Processes = Processes;
+    action.Levels = Levels;
+    action.NumberOfProcesses = NumberOfProcesses;
+    action.Statuses = PhAllocate(NumberOfProcesses * sizeof(NTSTATUS));
+    memset(action.Statuses, 0, NumberOfProcesses * sizeof(NTSTATUS));
 
-    if (NT_SUCCESS(status = PhOpenProcess(
-        &processHandle,
-        PROCESS_TERMINATE,
-        Process->ProcessId
-        )))
+    if (NumberOfProcesses > PH_BULK_ACTION_PROGRESS_THRESHOLD)
     {
-        status = PhTerminateProcess(processHandle, 1);
-        NtClose(processHandle);
+        DialogBoxParam(
+            PhInstanceHandle,
+            MAKEINTRESOURCE(IDD_PROGRESS),
+            hWnd,
+            PhpBulkProcessActionDlgProc,
+            (LPARAM)&action
+            );
     }
-
-    if (!NT_SUCCESS(status))
+    else
     {
-        *Success = FALSE;
-
-        if (!PhpShowErrorProcess(hWnd, L"terminate", Process, status, 0))
-            return FALSE;
+        PhpExecuteBulkProcessAction(&action);
     }
 
-    // Terminate the process' children.
-
-    process = PH_FIRST_PROCESS(Processes);
+    for (i = 0; i < NumberOfProcesses; i++)
+    {
+        if (!NT_SUCCESS(action.Statuses[i]) && action.Statuses[i] != STATUS_CANCELLED)
+        {
+            firstFailed = i;
+            break;
+        }
+    }
 
-    do
+    if (firstFailed != -1 && PhpShowErrorAndConnectToPhSvc(
+        hWnd,
+        PhaFormatString(L"Unable to %s %s", Verb, Processes[firstFailed]->ProcessName->Buffer)->Buffer,
+        action.Statuses[firstFailed],
+        &connected
+        ))
     {
-        if (
-            process->UniqueProcessId != Process->ProcessId &&
-            process->InheritedFromUniqueProcessId == Process->ProcessId
-            )
+        if (connected)
         {
-            if (processItem = PhReferenceProcessItem(process->UniqueProcessId))
+            PHANDLE processIds;
+            PULONG indices;
+            PNTSTATUS statuses;
+            ULONG count = 0;
+
+            // Retry every failure using one request.
+
+            processIds = PhAllocate(NumberOfProcesses * sizeof(HANDLE));
+            indices = PhAllocate(NumberOfProcesses * sizeof(ULONG));
+            statuses = PhAllocate(NumberOfProcesses * sizeof(NTSTATUS));
+
+            for (i = firstFailed; i < NumberOfProcesses; i++)
             {
-                // Check the creation time to make sure it is a descendant.
-                if (processItem->CreateTime.QuadPart >= Process->CreateTime.QuadPart)
+                if (!NT_SUCCESS(action.Statuses[i]) && action.Statuses[i] != STATUS_CANCELLED)
                 {
-                    if (!PhpUiTerminateTreeProcess(hWnd, processItem, Processes, Success))
-                    {
-                        PhDereferenceObject(processItem);
-                        return FALSE;
-                    }
+                    processIds[count] = Processes[i]->ProcessId;
+                    indices[count] = i;
+                    count++;
                 }
+            }
+
+            PhSvcCallControlProcessBatch(processIds, count, Command, Argument, statuses);
+
+            for (i = 0; i < count; i++)
+                action.Statuses[indices[i]] = statuses[i];
+
+            PhFree(statuses);
+            PhFree(indices);
+            PhFree(processIds);
+
+            PhUiDisconnectFromPhSvc();
+        }
+        else
+        {
+            // The user cancelled elevation, so don't show this error again.
+            success = FALSE;
+            firstFailed++;
+        }
+    }
+    else
+    {
+        firstFailed = 0;
+    }
+
+    for (i = 0; i < NumberOfProcesses; i++)
+    {
+        if (!NT_SUCCESS(action.Statuses[i]))
+        {
+            success = FALSE;
 
-                PhDereferenceObject(processItem);
+            if (i >= firstFailed && action.Statuses[i] != STATUS_CANCELLED)
+            {
+                if (!PhpShowErrorProcess(hWnd, Verb, Processes[i], action.Statuses[i], 0))
+                    break;
             }
         }
-    } while (process = PH_NEXT_PROCESS(process));
+    }
 
-    return TRUE;
+    PhFree(action.Statuses);
+
+    return success;
+}
+
+BOOLEAN PhUiTerminateProcesses(
+    _In_ HWND hWnd,
+    _In_ PPH_PROCESS_ITEM *Processes,
+    _In_ ULONG NumberOfProcesses
+    )
+{
+    if (!PhpShowContinueMessageProcesses(
+        hWnd,
+        L"terminate",
+        L"Terminating a process will cause unsaved data to be lost.",
+        FALSE,
+        Processes,
+        NumberOfProcesses
+        ))
+        return FALSE;
+
+    return PhpUiBulkProcessAction(
+        hWnd,
+        L"terminate",
+        PhSvcControlProcessTerminate,
+        0,
+        Processes,
+        NULL,
+        NumberOfProcesses
+        );
 }
 
 BOOLEAN PhUiTerminateTreeProcess(
@@ -1119,9 +1405,17 @@ BOOLEAN PhUiTerminateTreeProcess(
     )
 {
     NTSTATUS status;
-    BOOLEAN success = TRUE;
+    BOOLEAN success;
     BOOLEAN cont = FALSE;
     PVOID processes;
+    PSYSTEM_PROCESS_INFORMATION process;
+    PPH_PROCESS_ITEM processItem;
+    PPH_LIST processList;
+    PPH_LIST levelList;
+    PPH_PROCESS_ITEM *processItems;
+    PULONG levels;
+    ULONG count;
+    ULONG i;
 
     if (PhGetIntegerSetting(L"EnableWarnings"))
     {
@@ -1147,9 +1441,78 @@ BOOLEAN PhUiTerminateTreeProcess(
         return FALSE;
     }
 
-    PhpUiTerminateTreeProcess(hWnd, Process, processes, &success);
+    // Find the descendants breadth-first, recording the depth of each process.
+
+    processList = PhCreateList(16);
+    levelList = PhCreateList(16);
+
+    PhReferenceObject(Process);
+    PhAddItemList(processList, Process);
+    PhAddItemList(levelList, ULongToPtr(0));
+
+    for (i = 0; i < processList->Count; i++)
+    {
+        PPH_PROCESS_ITEM parentItem = processList->Items[i];
+
+        process = PH_FIRST_PROCESS(processes);
+
+        do
+        {
+            if (
+                process->UniqueProcessId != parentItem->ProcessId &&
+                process->InheritedFromUniqueProcessId == parentItem->ProcessId
+                )
+            {
+                if (processItem = PhReferenceProcessItem(process->UniqueProcessId))
+                {
+                    // Check the creation time to make sure it is a descendant.
+                    if (
+                        processItem->CreateTime.QuadPart >= parentItem->CreateTime.QuadPart &&
+                        PhFindItemList(processList, processItem) == -1
+                        )
+                    {
+                        PhAddItemList(processList, processItem);
+                        PhAddItemList(levelList, ULongToPtr(PtrToUlong(levelList->Items[i]) + 1));
+                    }
+                    else
+                    {
+                        PhDereferenceObject(processItem);
+                    }
+                }
+            }
+        } while (process = PH_NEXT_PROCESS(process));
+    }
+
     PhFree(processes);
 
+    // The list is ordered by depth, so reversing it puts the leaves first.
+
+    count = processList->Count;
+    processItems = PhAllocate(count * sizeof(PPH_PROCESS_ITEM));
+    levels = PhAllocate(count * sizeof(ULONG));
+
+    for (i = 0; i < count; i++)
+    {
+        processItems[i] = processList->Items[count - i - 1];
+        levels[i] = PtrToUlong(levelList->Items[count - i - 1]);
+    }
+
+    success = PhpUiBulkProcessAction(
+        hWnd,
+        L"terminate",
+        PhSvcControlProcessTerminate,
+        0,
+        processItems,
+        levels,
+        count
+        );
+
+    PhDereferenceObjects(processItems, count);
+    PhFree(levels);
+    PhFree(processItems);
+    PhDereferenceObject(levelList);
+    PhDereferenceObject(processList);
+
     return success;
 }
 
@@ -1159,10 +1522,6 @@ BOOLEAN PhUiSuspendProcesses(
     _In_ ULONG NumberOfProcesses
     )
 {
-    BOOLEAN success = TRUE;
-    BOOLEAN cancelled = FALSE;
-    ULONG i;
-
     if (!PhpShowContinueMessageProcesses(
         hWnd,
         L"suspend",
@@ -1173,57 +1532,15 @@ BOOLEAN PhUiSuspendProcesses(
         ))
         return FALSE;
 
-    for (i = 0; i < NumberOfProcesses; i++)
-    {
-        NTSTATUS status;
-        HANDLE processHandle;
-
-        if (NT_SUCCESS(status = PhOpenProcess(
-            &processHandle,
-            PROCESS_SUSPEND_RESUME,
-            Processes[i]->ProcessId
-            )))
-        {
-            status = PhSuspendProcess(processHandle);
-            NtClose(processHandle);
-        }
-
-        if (!NT_SUCCESS(status))
-        {
-            BOOLEAN connected;
-
-            success = FALSE;
-
-            if (!cancelled && PhpShowErrorAndConnectToPhSvc(
-                hWnd,
-                PhaConcatStrings2(L"Unable to suspend ", Processes[i]->ProcessName->Buffer)->Buffer,
-                status,
-                &connected
-                ))
-            {
-                if (connected)
-                {
-                    if (NT_SUCCESS(status = PhSvcCallControlProcess(Processes[i]->ProcessId, PhSvcControlProcessSuspend, 0)))
-                        success = TRUE;
-                    else
-                        PhpShowErrorProcess(hWnd, L"suspend", Processes[i], status, 0);
-
-                    PhUiDisconnectFromPhSvc();
-                }
-                else
-                {
-                    cancelled = TRUE;
-                }
-            }
-            else
-            {
-                if (!PhpShowErrorProcess(hWnd, L"suspend", Processes[i], status, 0))
-                    break;
-            }
-        }
-    }
-
-    return success;
+    return PhpUiBulkProcessAction(
+        hWnd,
+        L"suspend",
+        PhSvcControlProcessSuspend,
+        0,
+        Processes,
+        NULL,
+        NumberOfProcesses
+        );
 }
 
 BOOLEAN PhUiResumeProcesses(
@@ -1232,10 +1549,6 @@ BOOLEAN PhUiResumeProcesses(
     _In_ ULONG NumberOfProcesses
     )
 {
-    BOOLEAN success = TRUE;
-    BOOLEAN cancelled = FALSE;
-    ULONG i;
-
     if (!PhpShowContinueMessageProcesses(
         hWnd,
         L"resume",
@@ -1246,57 +1559,15 @@ BOOLEAN PhUiResumeProcesses(
         ))
         return FALSE;
 
-    for (i = 0; i < NumberOfProcesses; i++)
-    {
-        NTSTATUS status;
-        HANDLE processHandle;
-
-        if (NT_SUCCESS(status = PhOpenProcess(
-            &processHandle,
-            PROCESS_SUSPEND_RESUME,
-            Processes[i]->ProcessId
-            )))
-        {
-            status = PhResumeProcess(processHandle);
-            NtClose(processHandle);
-        }
-
-        if (!NT_SUCCESS(status))
-        {
-            BOOLEAN connected;
-
-            success = FALSE;
-
-            if (!cancelled && PhpShowErrorAndConnectToPhSvc(
-                hWnd,
-                PhaConcatStrings2(L"Unable to resume ", Processes[i]->ProcessName->Buffer)->Buffer,
-                status,
-                &connected
-                ))
-            {
-                if (connected)
-                {
-                    if (NT_SUCCESS(status = PhSvcCallControlProcess(Processes[i]->ProcessId, PhSvcControlProcessResume, 0)))
-                        success = TRUE;
-                    else
-                        PhpShowErrorProcess(hWnd, L"resume", Processes[i], status, 0);
-
-                    PhUiDisconnectFromPhSvc();
-                }
-                else
-                {
-                    cancelled = TRUE;
-                }
-            }
-            else
-            {
-                if (!PhpShowErrorProcess(hWnd, L"resume", Processes[i], status, 0))
-                    break;
-            }
-        }
-    }
-
-    return success;
+    return PhpUiBulkProcessAction(
+        hWnd,
+        L"resume",
+        PhSvcControlProcessResume,
+        0,
+        Processes,
+        NULL,
+        NumberOfProcesses
+        );
 }
 
 BOOLEAN PhUiRestartProcess(
@@ -1737,63 +2008,17 @@ BOOLEAN PhUiSetIoPriorityProcesses(
     _In_ ULONG IoPriority
     )
 {
-    BOOLEAN success = TRUE;
-    BOOLEAN cancelled = FALSE;
-    ULONG i;
-
-    for (i = 0; i < NumberOfProcesses; i++)
-    {
-        NTSTATUS status;
-        HANDLE processHandle;
-
-        if (NT_SUCCESS(status = PhOpenProcess(
-            &processHandle,
-            PROCESS_SET_INFORMATION,
-            Processes[i]->ProcessId
-            )))
-        {
-            status = PhSetProcessIoPriority(processHandle, IoPriority);
-
-            NtClose(processHandle);
-        }
-
-        if (!NT_SUCCESS(status))
-        {
-            BOOLEAN connected;
-
-            success = FALSE;
-
-            // The operation may have failed due to the lack of SeIncreaseBasePriorityPrivilege.
-            if (!cancelled && PhpShowErrorAndConnectToPhSvc(
-                hWnd,
-                PhaConcatStrings2(L"Unable to set the I/O priority of ", Processes[i]->ProcessName->Buffer)->Buffer,
-                status,
-                &connected
-                ))
-            {
-                if (connected)
-                {
-                    if (NT_SUCCESS(status = PhSvcCallControlProcess(Processes[i]->ProcessId, PhSvcControlProcessIoPriority, IoPriority)))
-                        success = TRUE;
-                    else
-                        PhpShowErrorProcess(hWnd, L"set the I/O priority of", Processes[i], status, 0);
-
-                    PhUiDisconnectFromPhSvc();
-                }
-                else
-                {
-                    cancelled = TRUE;
-                }
-            }
-            else
-            {
-                if (!PhpShowErrorProcess(hWnd, L"set the I/O priority of", Processes[i], status, 0))
-                    break;
-            }
-        }
-    }
-
-    return success;
+    // The operation may fail due to the lack of SeIncreaseBasePriorityPrivilege,
+    // in which case the failures are retried through phsvc.
+    return PhpUiBulkProcessAction(
+        hWnd,
+        L"set the I/O priority of",
+        PhSvcControlProcessIoPriority,
+        IoPriority,
+        Processes,
+        NULL,
+        NumberOfProcesses
+        );
 }
 
 BOOLEAN PhUiSetPagePriorityProcess(
@@ -1837,66 +2062,17 @@ BOOLEAN PhUiSetPriorityProcesses(
     _In_ ULONG PriorityClass
     )
 {
-    BOOLEAN success = TRUE;
-    BOOLEAN cancelled = FALSE;
-    ULONG i;
-
-    for (i = 0; i < NumberOfProcesses; i++)
-    {
-        NTSTATUS status;
-        HANDLE processHandle;
-        PROCESS_PRIORITY_CLASS priorityClass;
-
-        if (NT_SUCCESS(status = PhOpenProcess(
-            &processHandle,
-            PROCESS_SET_INFORMATION,
-            Processes[i]->ProcessId
-            )))
-        {
-            priorityClass.Foreground = FALSE;
-            priorityClass.PriorityClass = (UCHAR)PriorityClass;
-            status = NtSetInformationProcess(processHandle, ProcessPriorityClass, &priorityClass, sizeof(PROCESS_PRIORITY_CLASS));
-
-            NtClose(processHandle);
-        }
-
-        if (!NT_SUCCESS(status))
-        {
-            BOOLEAN connected;
-
-            success = FALSE;
-
-            // The operation may have failed due to the lack of SeIncreaseBasePriorityPrivilege.
-            if (!cancelled && PhpShowErrorAndConnectToPhSvc(
-                hWnd,
-                PhaConcatStrings2(L"Unable to set the priority of ", Processes[i]->ProcessName->Buffer)->Buffer,
-                status,
-                &connected
-                ))
-            {
-                if (connected)
-                {
-                    if (NT_SUCCESS(status = PhSvcCallControlProcess(Processes[i]->ProcessId, PhSvcControlProcessPriority, PriorityClass)))
-                        success = TRUE;
-                    else
-                        PhpShowErrorProcess(hWnd, L"set the priority of", Processes[i], status, 0);
-
-                    PhUiDisconnectFromPhSvc();
-                }
-                else
-                {
-                    cancelled = TRUE;
-                }
-            }
-            else
-            {
-                if (!PhpShowErrorProcess(hWnd, L"set the priority of", Processes[i], status, 0))
-                    break;
-            }
-        }
-    }
-
-    return success;
+    // The operation may fail due to the lack of SeIncreaseBasePriorityPrivilege,
+    // in which case the failures are retried through phsvc.
+    return PhpUiBulkProcessAction(
+        hWnd,
+        L"set the priority of",
+        PhSvcControlProcessPriority,
+        PriorityClass,
+        Processes,
+        NULL,
+        NumberOfProcesses
+        );
 }
 
 BOOLEAN PhUiSetDepStatusProcess(
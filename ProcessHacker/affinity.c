@@ -44,6 +44,11 @@ INT_PTR CALLBACK PhpProcessAffinityDlgProc(
     _In_ LPARAM lParam
     );
 
+VOID PhpSetAffinityDialogTitle(
+    _In_ HWND hwndDlg,
+    _In_ PAFFINITY_DIALOG_CONTEXT Context
+    );
+
 VOID PhShowProcessAffinityDialog(
     _In_ HWND ParentWindowHandle,
     _In_opt_ PPH_PROCESS_ITEM ProcessItem,
@@ -202,6 +207,9 @@ static INT_PTR CALLBACK PhpProcessAffinityDlgProc(
                 break;
             }
 
+            if (PhNumberOfProcessorGroups > 1)
+                PhpSetAffinityDialogTitle(hwndDlg, context);
+
             // Disable the CPU checkboxes which aren't part of the system affinity mask,
             // and check the CPU checkboxes which are part of the affinity mask.
 
@@ -311,3 +319,80 @@ static INT_PTR CALLBACK PhpProcessAffinityDlgProc(
 
     return FALSE;
 }
+
+/**
+ * Shows the processor groups of the process or thread in the dialog title.
+ *
+ * \remarks An affinity mask only covers the processors in one group, so on systems with
+ * more than one group the title says which group the check boxes refer to.
+ */
+VOID PhpSetAffinityDialogTitle(
+    _In_ HWND hwndDlg,
+    _In_ PAFFINITY_DIALOG_CONTEXT Context
+    )
+{
+    PH_STRING_BUILDER sb;
+    ULONG i;
+
+    PhInitializeStringBuilder(&sb, 40);
+    PhAppendStringBuilder2(&sb, L"Affinity");
+
+    if (Context->ProcessItem)
+    {
+        HANDLE processHandle;
+        USHORT groups[64];
+        ULONG returnLength;
+
+        if (NT_SUCCESS(PhOpenProcess(
+            &processHandle,
+            ProcessQueryAccess,
+            Context->ProcessItem->ProcessId
+            )))
+        {
+            if (NT_SUCCESS(NtQueryInformationProcess(
+                processHandle,
+                ProcessGroupInformation,
+                groups,
+                sizeof(groups),
+                &returnLength
+                )) && returnLength >= sizeof(USHORT))
+            {
+                // The first group is the one the process affinity mask applies to.
+                PhAppendFormatStringBuilder(&sb, returnLength > sizeof(USHORT) ? L" - groups %u" : L" - group %u", groups[0]);
+
+                for (i = 1; i < returnLength / sizeof(USHORT); i++)
+                    PhAppendFormatStringBuilder(&sb, L", %u", groups[i]);
+            }
+
+            NtClose(processHandle);
+        }
+    }
+    else if (Context->ThreadItem)
+    {
+        HANDLE threadHandle;
+        GROUP_AFFINITY groupAffinity;
+
+        if (NT_SUCCESS(PhOpenThread(
+            &threadHandle,
+            ThreadQueryAccess,
+            Context->ThreadItem->ThreadId
+            )))
+        {
+            if (NT_SUCCESS(NtQueryInformationThread(
+                threadHandle,
+                ThreadGroupInformation,
+                &groupAffinity,
+                sizeof(GROUP_AFFINITY),
+                NULL
+                )))
+            {
+                PhAppendFormatStringBuilder(&sb, L" - group %u", groupAffinity.Group);
+            }
+
+            NtClose(threadHandle);
+        }
+    }
+
+    SetWindowText(hwndDlg, sb.String->Buffer);
+    PhDeleteStringBuilder(&sb);
+}
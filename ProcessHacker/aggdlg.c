@@ -0,0 +1,498 @@
+/*
+ * Process Hacker -
+ *   session and user totals
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <phapp.h>
+#include <procagg.h>
+#include <settings.h>
+
+#define WM_PH_AGGREGATES_UPDATED (WM_APP + 320)
+
+typedef enum _PHP_AGGREGATE_COLUMN
+{
+    PhpAggregateNameColumn,
+    PhpAggregateProcessesColumn,
+    PhpAggregateCpuColumn,
+    PhpAggregatePeakCpuColumn,
+    PhpAggregatePrivateBytesColumn,
+    PhpAggregateWorkingSetColumn,
+    PhpAggregateIoReadOtherColumn,
+    PhpAggregateIoWriteColumn,
+    PhpAggregateCpuTimeColumn,
+    PhpAggregateMaximumColumn
+} PHP_AGGREGATE_COLUMN;
+
+typedef struct _PHP_AGGREGATE_NODE
+{
+    PH_TREENEW_NODE Node;
+
+    PPH_PROCESS_AGGREGATE Aggregate; // NULL for the category nodes
+    PPH_LIST Children; // category nodes only
+    ULONG RunId;
+
+    PH_PROCESS_AGGREGATE_VALUES Values;
+    FLOAT PeakCpuUsage;
+
+    PH_STRINGREF TextCache[PhpAggregateMaximumColumn];
+    PPH_STRING Text[PhpAggregateMaximumColumn];
+} PHP_AGGREGATE_NODE, *PPHP_AGGREGATE_NODE;
+
+typedef struct _PHP_AGGREGATES_CONTEXT
+{
+    HWND TreeNewHandle;
+    PH_CALLBACK_REGISTRATION ProcessesUpdatedRegistration;
+
+    PHP_AGGREGATE_NODE CategoryNodes[PhProcessAggregateTypeMaximum];
+    PPH_LIST RootList;
+    PPH_HASHTABLE NodeHashtable; // PPH_PROCESS_AGGREGATE -> PPHP_AGGREGATE_NODE
+    ULONG RunId;
+
+    ULONG SortColumn;
+    PH_SORT_ORDER SortOrder;
+    PFLOAT HistoryBuffer;
+} PHP_AGGREGATES_CONTEXT, *PPHP_AGGREGATES_CONTEXT;
+
+INT_PTR CALLBACK PhpProcessAggregatesDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
+VOID PhShowProcessAggregatesDialog(
+    _In_ HWND ParentWindowHandle
+    )
+{
+    DialogBox(
+        PhInstanceHandle,
+        MAKEINTRESOURCE(IDD_PROCESSAGGREGATES),
+        ParentWindowHandle,
+        PhpProcessAggregatesDlgProc
+        );
+}
+
+static VOID PhpDestroyAggregateNode(
+    _In_ PPHP_AGGREGATE_NODE Node
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PhpAggregateMaximumColumn; i++)
+        PhClearReference(&Node->Text[i]);
+
+    if (Node->Aggregate)
+        PhDereferenceObject(Node->Aggregate);
+
+    PhFree(Node);
+}
+
+static int __cdecl PhpAggregateNodeCompare(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPHP_AGGREGATES_CONTEXT aggregatesContext = context;
+    PPHP_AGGREGATE_NODE node1 = *(PPHP_AGGREGATE_NODE *)elem1;
+    PPHP_AGGREGATE_NODE node2 = *(PPHP_AGGREGATE_NODE *)elem2;
+    int result = 0;
+
+    switch (aggregatesContext->SortColumn)
+    {
+    case PhpAggregateNameColumn:
+        if (node1->Aggregate->Type == PhProcessAggregateSession)
+            result = uintcmp(node1->Aggregate->SessionId, node2->Aggregate->SessionId);
+        else
+            result = PhCompareStringWithNull(node1->Aggregate->Name, node2->Aggregate->Name, TRUE);
+        break;
+    case PhpAggregateProcessesColumn:
+        result = uintcmp(node1->Values.NumberOfProcesses, node2->Values.NumberOfProcesses);
+        break;
+    case PhpAggregateCpuColumn:
+        result = singlecmp(node1->Values.CpuUsage, node2->Values.CpuUsage);
+        break;
+    case PhpAggregatePeakCpuColumn:
+        result = singlecmp(node1->PeakCpuUsage, node2->PeakCpuUsage);
+        break;
+    case PhpAggregatePrivateBytesColumn:
+        result = uintptrcmp(node1->Values.PrivateBytes, node2->Values.PrivateBytes);
+        break;
+    case PhpAggregateWorkingSetColumn:
+        result = uintptrcmp(node1->Values.WorkingSetSize, node2->Values.WorkingSetSize);
+        break;
+    case PhpAggregateIoReadOtherColumn:
+        result = uint64cmp(node1->Values.IoReadOtherDelta, node2->Values.IoReadOtherDelta);
+        break;
+    case PhpAggregateIoWriteColumn:
+        result = uint64cmp(node1->Values.IoWriteDelta, node2->Values.IoWriteDelta);
+        break;
+    case PhpAggregateCpuTimeColumn:
+        result = uint64cmp(node1->Values.CpuTime, node2->Values.CpuTime);
+        break;
+    }
+
+    return PhModifySort(result, aggregatesContext->SortOrder);
+}
+
+static VOID PhpSortAggregateNodes(
+    _In_ PPHP_AGGREGATES_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    if (Context->SortOrder == NoSortOrder)
+        return;
+
+    for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+    {
+        PPH_LIST children = Context->CategoryNodes[i].Children;
+
+        qsort_s(children->Items, children->Count, sizeof(PVOID), PhpAggregateNodeCompare, Context);
+    }
+}
+
+static VOID PhpUpdateAggregateNodeText(
+    _In_ PPHP_AGGREGATE_NODE Node
+    )
+{
+    WCHAR timeSpan[PH_TIMESPAN_STR_LEN_1];
+    ULONG interval;
+
+    interval = max(PhCsUpdateInterval, 1);
+
+    if (Node->Aggregate->Type == PhProcessAggregateSession)
+        PhMoveReference(&Node->Text[PhpAggregateNameColumn], PhFormatString(L"Session %u", Node->Aggregate->SessionId));
+    else
+        PhSetReference(&Node->Text[PhpAggregateNameColumn], Node->Aggregate->Name);
+
+    PhMoveReference(&Node->Text[PhpAggregateProcessesColumn], PhFormatUInt64(Node->Values.NumberOfProcesses, TRUE));
+    PhMoveReference(&Node->Text[PhpAggregateCpuColumn], PhFormatString(L"%.2f", Node->Values.CpuUsage * 100));
+    PhMoveReference(&Node->Text[PhpAggregatePeakCpuColumn], PhFormatString(L"%.2f", Node->PeakCpuUsage * 100));
+    PhMoveReference(&Node->Text[PhpAggregatePrivateBytesColumn], PhFormatSize(Node->Values.PrivateBytes, -1));
+    PhMoveReference(&Node->Text[PhpAggregateWorkingSetColumn], PhFormatSize(Node->Values.WorkingSetSize, -1));
+    PhMoveReference(&Node->Text[PhpAggregateIoReadOtherColumn], PhFormatString(
+        L"%s/s", PhaFormatSize(Node->Values.IoReadOtherDelta * 1000 / interval, -1)->Buffer));
+    PhMoveReference(&Node->Text[PhpAggregateIoWriteColumn], PhFormatString(
+        L"%s/s", PhaFormatSize(Node->Values.IoWriteDelta * 1000 / interval, -1)->Buffer));
+    PhPrintTimeSpan(timeSpan, Node->Values.CpuTime, PH_TIMESPAN_HMSM);
+    PhMoveReference(&Node->Text[PhpAggregateCpuTimeColumn], PhCreateString(timeSpan));
+}
+
+static VOID PhpRefreshAggregateNodes(
+    _In_ PPHP_AGGREGATES_CONTEXT Context
+    )
+{
+    PPH_PROCESS_AGGREGATE *aggregates;
+    ULONG numberOfAggregates;
+    ULONG i;
+    ULONG j;
+
+    Context->RunId++;
+
+    PhEnumProcessAggregates(&aggregates, &numberOfAggregates);
+
+    for (i = 0; i < numberOfAggregates; i++)
+    {
+        PPH_PROCESS_AGGREGATE aggregate = aggregates[i];
+        PPHP_AGGREGATE_NODE node;
+        PH_PROCESS_AGGREGATE_HISTORY history;
+
+        if (node = PhFindItemSimpleHashtable2(Context->NodeHashtable, aggregate))
+        {
+            PhDereferenceObject(aggregate);
+        }
+        else
+        {
+            node = PhAllocate(sizeof(PHP_AGGREGATE_NODE));
+            memset(node, 0, sizeof(PHP_AGGREGATE_NODE));
+            PhInitializeTreeNewNode(&node->Node);
+            node->Node.TextCache = node->TextCache;
+            node->Node.TextCacheSize = PhpAggregateMaximumColumn;
+            node->Aggregate = aggregate; // reference from PhEnumProcessAggregates
+
+            PhAddItemSimpleHashtable(Context->NodeHashtable, aggregate, node);
+            PhAddItemList(Context->CategoryNodes[aggregate->Type].Children, node);
+        }
+
+        node->RunId = Context->RunId;
+        PhGetProcessAggregateValues(aggregate, &node->Values);
+
+        // The peak comes from the aggregate's history, so it covers the time before this window
+        // was opened.
+        history.Count = PhStatisticsSampleCount;
+        history.CpuUsage = Context->HistoryBuffer;
+        history.PrivateBytes = NULL;
+        history.IoReadOther = NULL;
+        history.IoWrite = NULL;
+        PhCopyProcessAggregateHistory(aggregate, &history);
+
+        node->PeakCpuUsage = node->Values.CpuUsage;
+
+        for (j = 0; j < history.Count; j++)
+        {
+            if (node->PeakCpuUsage < history.CpuUsage[j])
+                node->PeakCpuUsage = history.CpuUsage[j];
+        }
+
+        PhpUpdateAggregateNodeText(node);
+        PhInvalidateTreeNewNodeText(&node->Node, NULL);
+    }
+
+    PhFree(aggregates);
+
+    // Remove nodes for aggregates which no longer exist.
+    for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+    {
+        PPH_LIST children = Context->CategoryNodes[i].Children;
+
+        for (j = 0; j < children->Count; j++)
+        {
+            PPHP_AGGREGATE_NODE node = children->Items[j];
+
+            if (node->RunId != Context->RunId)
+            {
+                PhRemoveItemSimpleHashtable(Context->NodeHashtable, node->Aggregate);
+                PhRemoveItemList(children, j);
+                j--;
+                PhpDestroyAggregateNode(node);
+            }
+        }
+    }
+
+    PhpSortAggregateNodes(Context);
+    TreeNew_NodesStructured(Context->TreeNewHandle);
+}
+
+static BOOLEAN NTAPI PhpAggregateTreeNewCallback(
+    _In_ HWND hwnd,
+    _In_ PH_TREENEW_MESSAGE Message,
+    _In_opt_ PVOID Parameter1,
+    _In_opt_ PVOID Parameter2,
+    _In_opt_ PVOID Context
+    )
+{
+    PPHP_AGGREGATES_CONTEXT context = Context;
+    PPHP_AGGREGATE_NODE node;
+
+    switch (Message)
+    {
+    case TreeNewGetChildren:
+        {
+            PPH_TREENEW_GET_CHILDREN getChildren = Parameter1;
+
+            node = (PPHP_AGGREGATE_NODE)getChildren->Node;
+
+            if (!node)
+            {
+                getChildren->Children = (PPH_TREENEW_NODE *)context->RootList->Items;
+                getChildren->NumberOfChildren = context->RootList->Count;
+            }
+            else if (node->Children)
+            {
+                getChildren->Children = (PPH_TREENEW_NODE *)node->Children->Items;
+                getChildren->NumberOfChildren = node->Children->Count;
+            }
+        }
+        return TRUE;
+    case TreeNewIsLeaf:
+        {
+            PPH_TREENEW_IS_LEAF isLeaf = Parameter1;
+
+            node = (PPHP_AGGREGATE_NODE)isLeaf->Node;
+            isLeaf->IsLeaf = !node->Children;
+        }
+        return TRUE;
+    case TreeNewGetCellText:
+        {
+            PPH_TREENEW_GET_CELL_TEXT getCellText = Parameter1;
+
+            node = (PPHP_AGGREGATE_NODE)getCellText->Node;
+
+            if (getCellText->Id >= PhpAggregateMaximumColumn)
+                return FALSE;
+
+            getCellText->Text = PhGetStringRef(node->Text[getCellText->Id]);
+            getCellText->Flags = TN_CACHE;
+        }
+        return TRUE;
+    case TreeNewSortChanged:
+        {
+            TreeNew_GetSort(hwnd, &context->SortColumn, &context->SortOrder);
+            PhpSortAggregateNodes(context);
+            TreeNew_NodesStructured(hwnd);
+        }
+        return TRUE;
+    case TreeNewKeyDown:
+        {
+            PPH_TREENEW_KEY_EVENT keyEvent = Parameter1;
+
+            switch (keyEvent->VirtualKey)
+            {
+            case 'C':
+                if (GetKeyState(VK_CONTROL) < 0)
+                {
+                    PPH_STRING text;
+
+                    text = PhGetTreeNewText(hwnd, 0);
+                    PhSetClipboardString(hwnd, &text->sr);
+                    PhDereferenceObject(text);
+                }
+                break;
+            }
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static VOID NTAPI PhpAggregatesUpdatedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPHP_AGGREGATES_CONTEXT context = Context;
+
+    PostMessage(GetParent(context->TreeNewHandle), WM_PH_AGGREGATES_UPDATED, 0, 0);
+}
+
+INT_PTR CALLBACK PhpProcessAggregatesDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    PPHP_AGGREGATES_CONTEXT context = NULL;
+
+    if (uMsg == WM_INITDIALOG)
+    {
+        context = PhAllocate(sizeof(PHP_AGGREGATES_CONTEXT));
+        memset(context, 0, sizeof(PHP_AGGREGATES_CONTEXT));
+        SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)context);
+    }
+    else
+    {
+        context = (PPHP_AGGREGATES_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+    }
+
+    if (!context)
+        return FALSE;
+
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            static PWSTR categoryNames[PhProcessAggregateTypeMaximum] = { L"Sessions", L"Users", L"Jobs" };
+            HWND tnHandle;
+            ULONG i;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+
+            context->TreeNewHandle = tnHandle = GetDlgItem(hwndDlg, IDC_LIST);
+            context->RootList = PhCreateList(PhProcessAggregateTypeMaximum);
+            context->NodeHashtable = PhCreateSimpleHashtable(32);
+            context->HistoryBuffer = PhAllocate(sizeof(FLOAT) * max(PhStatisticsSampleCount, 1));
+            context->SortColumn = PhpAggregateCpuColumn;
+            context->SortOrder = DescendingSortOrder;
+
+            for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+            {
+                PPHP_AGGREGATE_NODE node = &context->CategoryNodes[i];
+
+                PhInitializeTreeNewNode(&node->Node);
+                node->Node.TextCache = node->TextCache;
+                node->Node.TextCacheSize = PhpAggregateMaximumColumn;
+                node->Children = PhCreateList(8);
+                node->Text[PhpAggregateNameColumn] = PhCreateString(categoryNames[i]);
+                PhAddItemList(context->RootList, node);
+            }
+
+            PhSetControlTheme(tnHandle, L"explorer");
+            TreeNew_SetCallback(tnHandle, PhpAggregateTreeNewCallback, context);
+
+            PhAddTreeNewColumn(tnHandle, PhpAggregateNameColumn, TRUE, L"Name", 160, PH_ALIGN_LEFT, -2, 0);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateProcessesColumn, TRUE, L"Processes", 60, PH_ALIGN_RIGHT, 0, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateCpuColumn, TRUE, L"CPU", 45, PH_ALIGN_RIGHT, 1, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregatePeakCpuColumn, TRUE, L"Peak CPU", 55, PH_ALIGN_RIGHT, 2, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregatePrivateBytesColumn, TRUE, L"Private bytes", 80, PH_ALIGN_RIGHT, 3, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateWorkingSetColumn, TRUE, L"Working set", 80, PH_ALIGN_RIGHT, 4, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateIoReadOtherColumn, TRUE, L"I/O read+other", 85, PH_ALIGN_RIGHT, 5, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateIoWriteColumn, TRUE, L"I/O write", 70, PH_ALIGN_RIGHT, 6, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpAggregateCpuTimeColumn, TRUE, L"CPU time", 80, PH_ALIGN_RIGHT, 7, DT_RIGHT);
+
+            TreeNew_SetTriState(tnHandle, TRUE);
+            TreeNew_SetSort(tnHandle, context->SortColumn, context->SortOrder);
+
+            PhpRefreshAggregateNodes(context);
+
+            PhRegisterCallback(
+                &PhProcessesUpdatedEvent,
+                PhpAggregatesUpdatedHandler,
+                context,
+                &context->ProcessesUpdatedRegistration
+                );
+        }
+        break;
+    case WM_DESTROY:
+        {
+            ULONG i;
+            ULONG j;
+
+            PhUnregisterCallback(&PhProcessesUpdatedEvent, &context->ProcessesUpdatedRegistration);
+
+            for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+            {
+                PPH_LIST children = context->CategoryNodes[i].Children;
+
+                for (j = 0; j < children->Count; j++)
+                    PhpDestroyAggregateNode(children->Items[j]);
+
+                PhDereferenceObject(children);
+                PhClearReference(&context->CategoryNodes[i].Text[PhpAggregateNameColumn]);
+            }
+
+            PhDereferenceObject(context->RootList);
+            PhDereferenceObject(context->NodeHashtable);
+            PhFree(context->HistoryBuffer);
+
+            RemoveProp(hwndDlg, PhMakeContextAtom());
+            PhFree(context);
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+            case IDOK:
+                EndDialog(hwndDlg, IDOK);
+                break;
+            }
+        }
+        break;
+    case WM_PH_AGGREGATES_UPDATED:
+        {
+            PhpRefreshAggregateNodes(context);
+        }
+        break;
+    }
+
+    return FALSE;
+}
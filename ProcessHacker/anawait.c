@@ -60,8 +60,56 @@ typedef struct _ANALYZE_WAIT_CONTEXT
     PH_STRING_BUILDER StringBuilder;
 
     PVOID PrevParams[4];
+
+    // Wait chain analysis. WaitHandles is NULL when analyzing a single thread.
+    PPH_LIST WaitHandles;
+    PVOID WaitAddress;
+    CLIENT_ID MessageReceiver;
+    HANDLE AlpcServerProcessId;
 } ANALYZE_WAIT_CONTEXT, *PANALYZE_WAIT_CONTEXT;
 
+typedef struct _WAIT_GRAPH_EDGE
+{
+    PPH_STRING Reason;
+    CLIENT_ID Owner; // UniqueThread is NULL if only the owning process is known
+    ULONG TargetIndex; // index of the owning node, or -1 if it is not in the graph
+} WAIT_GRAPH_EDGE, *PWAIT_GRAPH_EDGE;
+
+typedef struct _WAIT_GRAPH_NODE
+{
+    struct _WAIT_GRAPH *Graph;
+    HANDLE ThreadId;
+    BOOLEAN Waiting;
+    UCHAR Color;
+    ULONG Parent;
+    PPH_STRING Description;
+    PPH_LIST Edges;
+} WAIT_GRAPH_NODE, *PWAIT_GRAPH_NODE;
+
+typedef struct _WAIT_GRAPH_CRITICAL_SECTION
+{
+    PVOID Address;
+    HANDLE OwningThread;
+} WAIT_GRAPH_CRITICAL_SECTION, *PWAIT_GRAPH_CRITICAL_SECTION;
+
+typedef struct _WAIT_GRAPH
+{
+    HANDLE ProcessId;
+    HANDLE ProcessHandle;
+    BOOLEAN UseStackWalk;
+    PPH_SYMBOL_PROVIDER SymbolProvider;
+
+    ULONG NumberOfCriticalSections;
+    PWAIT_GRAPH_CRITICAL_SECTION CriticalSections;
+
+    ULONG NumberOfNodes;
+    PWAIT_GRAPH_NODE Nodes; // sorted by thread ID
+} WAIT_GRAPH, *PWAIT_GRAPH;
+
+#define WAIT_GRAPH_WHITE 0
+#define WAIT_GRAPH_GRAY 1
+#define WAIT_GRAPH_BLACK 2
+
 VOID PhpAnalyzeWaitPassive(
     _In_ HWND hWnd,
     _In_ HANDLE ProcessId,
@@ -93,21 +141,25 @@ VOID PhpGetWfmoInformation(
     _In_ PHANDLE AddressOfHandles,
     _In_ WAIT_TYPE WaitType,
     _In_ BOOLEAN Alertable,
-    _Inout_ PPH_STRING_BUILDER StringBuilder
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _Inout_opt_ PPH_LIST WaitHandles
     );
 
 PPH_STRING PhpaGetSendMessageReceiver(
-    _In_ HANDLE ThreadId
+    _In_ HANDLE ThreadId,
+    _Out_opt_ PCLIENT_ID ReceiverClientId
     );
 
 PPH_STRING PhpaGetAlpcInformation(
-    _In_ HANDLE ThreadId
+    _In_ HANDLE ThreadId,
+    _Out_opt_ PHANDLE ServerProcessId
     );
 
 static PH_INITONCE ServiceNumbersInitOnce = PH_INITONCE_INIT;
 static USHORT NumberForWfso = -1;
 static USHORT NumberForWfmo = -1;
 static USHORT NumberForRf = -1;
+static USHORT NumberForWfabti = -1;
 
 VOID PhUiAnalyzeWaitThread(
     _In_ HWND hWnd,
@@ -153,6 +205,7 @@ VOID PhUiAnalyzeWaitThread(
         return;
     }
 
+    memset(&context, 0, sizeof(ANALYZE_WAIT_CONTEXT));
     context.ProcessId = ProcessId;
     context.ThreadId = ThreadId;
 
@@ -251,7 +304,7 @@ VOID PhpAnalyzeWaitPassive(
     }
     else
     {
-        string = PhpaGetSendMessageReceiver(ThreadId);
+        string = PhpaGetSendMessageReceiver(ThreadId, NULL);
 
         if (string)
         {
@@ -260,7 +313,7 @@ VOID PhpAnalyzeWaitPassive(
         }
         else
         {
-            string = PhpaGetAlpcInformation(ThreadId);
+            string = PhpaGetAlpcInformation(ThreadId, NULL);
 
             if (string)
             {
@@ -442,7 +495,7 @@ static BOOLEAN NTAPI PhpWalkThreadStackAnalyzeCallback(
             &PhpaGetHandleString(context->ProcessHandle, handle)->sr
             );
 
-        if (alpcInfo = PhpaGetAlpcInformation(context->ThreadId))
+        if (alpcInfo = PhpaGetAlpcInformation(context->ThreadId, &context->AlpcServerProcessId))
         {
             PhAppendStringBuilder2(
                 &context->StringBuilder,
@@ -495,7 +548,7 @@ static BOOLEAN NTAPI PhpWalkThreadStackAnalyzeCallback(
             L"Thread is sending a USER message:\r\n"
             );
 
-        receiverString = PhpaGetSendMessageReceiver(context->ThreadId);
+        receiverString = PhpaGetSendMessageReceiver(context->ThreadId, &context->MessageReceiver);
 
         if (receiverString)
         {
@@ -538,6 +591,21 @@ static BOOLEAN NTAPI PhpWalkThreadStackAnalyzeCallback(
             &context->StringBuilder,
             &PhpaGetHandleString(context->ProcessHandle, handle)->sr
             );
+
+        // Critical sections use their own address as the key.
+        context->WaitAddress = key;
+    }
+    else if (NT_FUNC_MATCH("WaitForAlertByThreadId"))
+    {
+        PVOID address = StackFrame->Params[0];
+
+        PhAppendFormatStringBuilder(
+            &context->StringBuilder,
+            L"Thread is waiting for an alert (address 0x%Ix).",
+            address
+            );
+
+        context->WaitAddress = address;
     }
     else if (
         NT_FUNC_MATCH("WaitForMultipleObjects") ||
@@ -564,7 +632,8 @@ static BOOLEAN NTAPI PhpWalkThreadStackAnalyzeCallback(
             addressOfHandles,
             waitType,
             alertable,
-            &context->StringBuilder
+            &context->StringBuilder,
+            context->WaitHandles
             );
     }
     else if (
@@ -590,6 +659,9 @@ static BOOLEAN NTAPI PhpWalkThreadStackAnalyzeCallback(
             &context->StringBuilder,
             &PhpaGetHandleString(context->ProcessHandle, handle)->sr
             );
+
+        if (context->WaitHandles)
+            PhAddItemList(context->WaitHandles, handle);
     }
     else if (NT_FUNC_MATCH("WaitForWorkViaWorkerFactory"))
     {
@@ -623,7 +695,7 @@ static VOID PhpAnalyzeWaitFallbacks(
 
     // We didn't detect NtUserMessageCall, but this may still apply due to another
     // win32k system call (e.g. from EnableWindow).
-    if (!Context->Found && (info = PhpaGetSendMessageReceiver(Context->ThreadId)))
+    if (!Context->Found && (info = PhpaGetSendMessageReceiver(Context->ThreadId, &Context->MessageReceiver)))
     {
         PhAppendStringBuilder2(
             &Context->StringBuilder,
@@ -636,7 +708,7 @@ static VOID PhpAnalyzeWaitFallbacks(
     }
 
     // Nt(Alpc)ConnectPort doesn't get detected anywhere else.
-    if (!Context->Found && (info = PhpaGetAlpcInformation(Context->ThreadId)))
+    if (!Context->Found && (info = PhpaGetAlpcInformation(Context->ThreadId, &Context->AlpcServerProcessId)))
     {
         PhAppendStringBuilder2(
             &Context->StringBuilder,
@@ -768,6 +840,23 @@ static NTSTATUS PhpRfThreadStart(
     return STATUS_SUCCESS;
 }
 
+#ifdef _WIN64
+static VOID PhpGetSystemCallNumberFromStub(
+    _In_ PSTR Name,
+    _Inout_ PUSHORT SystemCallNumber
+    )
+{
+    PUCHAR stub;
+
+    if (stub = PhGetModuleProcAddress(L"ntdll.dll", Name))
+    {
+        // mov r10, rcx; mov eax, imm32
+        if (stub[0] == 0x4c && stub[1] == 0x8b && stub[2] == 0xd1 && stub[3] == 0xb8)
+            *SystemCallNumber = *(PUSHORT)(stub + 4);
+    }
+}
+#endif
+
 static VOID PhpInitializeServiceNumbers(
     VOID
     )
@@ -848,6 +937,12 @@ static VOID PhpInitializeServiceNumbers(
             NtClose(pipeWriteHandle);
         }
 
+#ifdef _WIN64
+        // NtWaitForAlertByThreadId (Windows 8 and above) can't be probed like the calls above
+        // because its wait reason is WrAlertByThreadId, so read the number from the ntdll stub.
+        PhpGetSystemCallNumberFromStub("NtWaitForAlertByThreadId", &NumberForWfabti);
+#endif
+
         PhEndInitOnce(&ServiceNumbersInitOnce);
     }
 }
@@ -903,7 +998,8 @@ static VOID PhpGetWfmoInformation(
     _In_ PHANDLE AddressOfHandles,
     _In_ WAIT_TYPE WaitType,
     _In_ BOOLEAN Alertable,
-    _Inout_ PPH_STRING_BUILDER StringBuilder
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _Inout_opt_ PPH_LIST WaitHandles
     )
 {
     NTSTATUS status;
@@ -964,6 +1060,9 @@ static VOID PhpGetWfmoInformation(
                     StringBuilder,
                     L"\r\n"
                     );
+
+                if (WaitHandles)
+                    PhAddItemList(WaitHandles, handles[i]);
             }
         }
     }
@@ -978,7 +1077,8 @@ static VOID PhpGetWfmoInformation(
 }
 
 static PPH_STRING PhpaGetSendMessageReceiver(
-    _In_ HANDLE ThreadId
+    _In_ HANDLE ThreadId,
+    _Out_opt_ PCLIENT_ID ReceiverClientId
     )
 {
     static _GetSendMessageReceiver GetSendMessageReceiver_I;
@@ -1012,6 +1112,9 @@ static PPH_STRING PhpaGetSendMessageReceiver(
     clientId.UniqueThread = UlongToHandle(threadId);
     clientIdName = PhAutoDereferenceObject(PhGetClientIdName(&clientId));
 
+    if (ReceiverClientId)
+        *ReceiverClientId = clientId;
+
     if (!GetClassName(windowHandle, windowClass, sizeof(windowClass) / sizeof(WCHAR)))
         windowClass[0] = 0;
 
@@ -1021,7 +1124,8 @@ static PPH_STRING PhpaGetSendMessageReceiver(
 }
 
 static PPH_STRING PhpaGetAlpcInformation(
-    _In_ HANDLE ThreadId
+    _In_ HANDLE ThreadId,
+    _Out_opt_ PHANDLE ServerProcessId
     )
 {
     static _NtAlpcQueryInformation NtAlpcQueryInformation_I;
@@ -1065,6 +1169,9 @@ static PPH_STRING PhpaGetAlpcInformation(
         clientId.UniqueThread = NULL;
         clientIdName = PhAutoDereferenceObject(PhGetClientIdName(&clientId));
 
+        if (ServerProcessId)
+            *ServerProcessId = serverInfo->Out.ConnectedProcessId;
+
         string = PhaFormatString(L"ALPC Port: %.*s (%s)", serverInfo->Out.ConnectionPortName.Length / 2, serverInfo->Out.ConnectionPortName.Buffer, clientIdName->Buffer);
     }
 
@@ -1073,3 +1180,620 @@ static PPH_STRING PhpaGetAlpcInformation(
 
     return string;
 }
+
+static VOID PhpAnalyzeWaitGraphPassive(
+    _Inout_ PANALYZE_WAIT_CONTEXT Context
+    )
+{
+    HANDLE threadHandle;
+    THREAD_LAST_SYSCALL_INFORMATION lastSystemCall;
+
+    PhpInitializeServiceNumbers();
+
+    if (!NT_SUCCESS(PhOpenThread(&threadHandle, THREAD_GET_CONTEXT, Context->ThreadId)))
+        return;
+
+    if (NT_SUCCESS(NtQueryInformationThread(
+        threadHandle,
+        ThreadLastSystemCall,
+        &lastSystemCall,
+        sizeof(THREAD_LAST_SYSCALL_INFORMATION),
+        NULL
+        )))
+    {
+        Context->Found = TRUE;
+
+        if (lastSystemCall.SystemCallNumber == NumberForWfso)
+        {
+            PhAppendStringBuilder2(&Context->StringBuilder, L"Thread is waiting for:\r\n");
+            PhAppendStringBuilder(&Context->StringBuilder, &PhpaGetHandleString(Context->ProcessHandle, lastSystemCall.FirstArgument)->sr);
+            PhAddItemList(Context->WaitHandles, lastSystemCall.FirstArgument);
+        }
+        else if (lastSystemCall.SystemCallNumber == NumberForWfmo)
+        {
+            PhAppendFormatStringBuilder(&Context->StringBuilder, L"Thread is waiting for multiple (%u) objects.", PtrToUlong(lastSystemCall.FirstArgument));
+        }
+        else if (lastSystemCall.SystemCallNumber == NumberForRf)
+        {
+            PhAppendStringBuilder2(&Context->StringBuilder, L"Thread is waiting for file I/O:\r\n");
+            PhAppendStringBuilder(&Context->StringBuilder, &PhpaGetHandleString(Context->ProcessHandle, lastSystemCall.FirstArgument)->sr);
+        }
+        else if (lastSystemCall.SystemCallNumber == NumberForWfabti)
+        {
+            PhAppendFormatStringBuilder(&Context->StringBuilder, L"Thread is waiting for an alert (address 0x%Ix).", lastSystemCall.FirstArgument);
+            Context->WaitAddress = lastSystemCall.FirstArgument;
+        }
+        else
+        {
+            Context->Found = FALSE;
+        }
+    }
+
+    NtClose(threadHandle);
+}
+
+/**
+ * Finds the owners of critical sections in a process. Only critical sections
+ * with debug information are linked into the process lock list, so this does
+ * not find every critical section.
+ */
+static VOID PhpGetWaitGraphCriticalSections(
+    _Inout_ PWAIT_GRAPH Graph
+    )
+{
+    PROCESS_BASIC_INFORMATION basicInfo;
+    PVOID loaderLock;
+    RTL_CRITICAL_SECTION criticalSection;
+    RTL_CRITICAL_SECTION_DEBUG debugInfo;
+    PLIST_ENTRY startEntry;
+    PLIST_ENTRY listEntry;
+    ULONG allocatedCount;
+    ULONG i;
+
+    if (!NT_SUCCESS(PhGetProcessBasicInformation(Graph->ProcessHandle, &basicInfo)))
+        return;
+
+    // Start from the loader lock, which is always in the list.
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        Graph->ProcessHandle,
+        PTR_ADD_OFFSET(basicInfo.PebBaseAddress, FIELD_OFFSET(PEB, LoaderLock)),
+        &loaderLock,
+        sizeof(PVOID),
+        NULL
+        )))
+        return;
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(Graph->ProcessHandle, loaderLock, &criticalSection, sizeof(RTL_CRITICAL_SECTION), NULL)) ||
+        !criticalSection.DebugInfo)
+        return;
+
+    allocatedCount = 64;
+    Graph->CriticalSections = PhAllocate(allocatedCount * sizeof(WAIT_GRAPH_CRITICAL_SECTION));
+
+    startEntry = &criticalSection.DebugInfo->ProcessLocksList;
+    listEntry = startEntry;
+
+    for (i = 0; i < 0x10000; i++)
+    {
+        if (!NT_SUCCESS(PhReadVirtualMemory(
+            Graph->ProcessHandle,
+            CONTAINING_RECORD(listEntry, RTL_CRITICAL_SECTION_DEBUG, ProcessLocksList),
+            &debugInfo,
+            sizeof(RTL_CRITICAL_SECTION_DEBUG),
+            NULL
+            )))
+            break;
+
+        // The list head in ntdll is not part of a debug structure; reading it gives garbage,
+        // which is harmless because the address will not match any waiter.
+        if (debugInfo.CriticalSection && NT_SUCCESS(PhReadVirtualMemory(
+            Graph->ProcessHandle,
+            debugInfo.CriticalSection,
+            &criticalSection,
+            sizeof(RTL_CRITICAL_SECTION),
+            NULL
+            )) && criticalSection.OwningThread)
+        {
+            if (Graph->NumberOfCriticalSections == allocatedCount)
+            {
+                allocatedCount *= 2;
+                Graph->CriticalSections = PhReAllocate(Graph->CriticalSections, allocatedCount * sizeof(WAIT_GRAPH_CRITICAL_SECTION));
+            }
+
+            Graph->CriticalSections[Graph->NumberOfCriticalSections].Address = debugInfo.CriticalSection;
+            Graph->CriticalSections[Graph->NumberOfCriticalSections].OwningThread = criticalSection.OwningThread;
+            Graph->NumberOfCriticalSections++;
+        }
+
+        listEntry = debugInfo.ProcessLocksList.Flink;
+
+        if (listEntry == startEntry)
+            break;
+    }
+}
+
+static VOID PhpAddWaitGraphEdge(
+    _Inout_ PWAIT_GRAPH_NODE Node,
+    _In_ PPH_STRING Reason,
+    _In_ HANDLE OwnerProcessId,
+    _In_opt_ HANDLE OwnerThreadId
+    )
+{
+    PWAIT_GRAPH_EDGE edge;
+
+    edge = PhAllocate(sizeof(WAIT_GRAPH_EDGE));
+    edge->Reason = Reason;
+    edge->Owner.UniqueProcess = OwnerProcessId;
+    edge->Owner.UniqueThread = OwnerThreadId;
+    edge->TargetIndex = -1;
+    PhAddItemList(Node->Edges, edge);
+}
+
+static VOID PhpAddWaitGraphHandleEdge(
+    _In_ PWAIT_GRAPH Graph,
+    _Inout_ PWAIT_GRAPH_NODE Node,
+    _In_ HANDLE Handle
+    )
+{
+    PPH_STRING typeName = NULL;
+    PPH_STRING name = NULL;
+    HANDLE objectHandle;
+    CLIENT_ID owner = { 0 };
+
+    PhGetHandleInformation(Graph->ProcessHandle, Handle, -1, NULL, &typeName, NULL, &name);
+
+    if (!typeName)
+        goto CleanupExit;
+
+    // Only mutants, threads and processes have an owner we can wait for.
+    if (PhEqualString2(typeName, L"Mutant", TRUE))
+    {
+        MUTANT_OWNER_INFORMATION ownerInfo;
+
+        if (NT_SUCCESS(NtDuplicateObject(Graph->ProcessHandle, Handle, NtCurrentProcess(), &objectHandle, MUTANT_QUERY_STATE, 0, 0)))
+        {
+            if (NT_SUCCESS(NtQueryMutant(objectHandle, MutantOwnerInformation, &ownerInfo, sizeof(MUTANT_OWNER_INFORMATION), NULL)))
+                owner = ownerInfo.ClientId;
+
+            NtClose(objectHandle);
+        }
+    }
+    else if (PhEqualString2(typeName, L"Thread", TRUE))
+    {
+        THREAD_BASIC_INFORMATION basicInfo;
+
+        if (NT_SUCCESS(NtDuplicateObject(Graph->ProcessHandle, Handle, NtCurrentProcess(), &objectHandle, ThreadQueryAccess, 0, 0)))
+        {
+            if (NT_SUCCESS(PhGetThreadBasicInformation(objectHandle, &basicInfo)))
+                owner = basicInfo.ClientId;
+
+            NtClose(objectHandle);
+        }
+    }
+    else if (PhEqualString2(typeName, L"Process", TRUE))
+    {
+        PROCESS_BASIC_INFORMATION basicInfo;
+
+        if (NT_SUCCESS(NtDuplicateObject(Graph->ProcessHandle, Handle, NtCurrentProcess(), &objectHandle, ProcessQueryAccess, 0, 0)))
+        {
+            if (NT_SUCCESS(PhGetProcessBasicInformation(objectHandle, &basicInfo)))
+                owner.UniqueProcess = basicInfo.UniqueProcessId;
+
+            NtClose(objectHandle);
+        }
+    }
+
+    if (owner.UniqueProcess)
+    {
+        PhpAddWaitGraphEdge(
+            Node,
+            PhFormatString(
+                L"%s %s",
+                typeName->Buffer,
+                !PhIsNullOrEmptyString(name) ? name->Buffer : L"(unnamed object)"
+                ),
+            owner.UniqueProcess,
+            owner.UniqueThread
+            );
+    }
+
+CleanupExit:
+    if (typeName)
+        PhDereferenceObject(typeName);
+    if (name)
+        PhDereferenceObject(name);
+}
+
+static NTSTATUS PhpAnalyzeWaitGraphThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PWAIT_GRAPH_NODE node = (PWAIT_GRAPH_NODE)Parameter;
+    PWAIT_GRAPH graph = node->Graph;
+    PH_AUTO_POOL autoPool;
+    ANALYZE_WAIT_CONTEXT context;
+    HANDLE threadHandle;
+    CLIENT_ID clientId;
+    ULONG i;
+
+    PhInitializeAutoPool(&autoPool);
+
+    memset(&context, 0, sizeof(ANALYZE_WAIT_CONTEXT));
+    context.ProcessId = graph->ProcessId;
+    context.ThreadId = node->ThreadId;
+    context.ProcessHandle = graph->ProcessHandle;
+    context.SymbolProvider = graph->SymbolProvider;
+    context.WaitHandles = PhCreateList(4);
+    PhInitializeStringBuilder(&context.StringBuilder, 100);
+
+    if (graph->UseStackWalk)
+    {
+        if (NT_SUCCESS(PhOpenThread(
+            &threadHandle,
+            ThreadQueryAccess | THREAD_GET_CONTEXT | THREAD_SUSPEND_RESUME,
+            node->ThreadId
+            )))
+        {
+            clientId.UniqueProcess = graph->ProcessId;
+            clientId.UniqueThread = node->ThreadId;
+
+            PhWalkThreadStack(
+                threadHandle,
+                graph->ProcessHandle,
+                &clientId,
+                graph->SymbolProvider,
+                PH_WALK_I386_STACK,
+                PhpWalkThreadStackAnalyzeCallback,
+                &context
+                );
+            NtClose(threadHandle);
+        }
+    }
+    else
+    {
+        PhpAnalyzeWaitGraphPassive(&context);
+    }
+
+    PhpAnalyzeWaitFallbacks(&context);
+
+    if (context.Found)
+    {
+        node->Description = PhFinalStringBuilderString(&context.StringBuilder);
+        PhReferenceObject(node->Description);
+    }
+
+    for (i = 0; i < context.WaitHandles->Count; i++)
+        PhpAddWaitGraphHandleEdge(graph, node, context.WaitHandles->Items[i]);
+
+    if (context.WaitAddress)
+    {
+        for (i = 0; i < graph->NumberOfCriticalSections; i++)
+        {
+            if (graph->CriticalSections[i].Address == context.WaitAddress)
+            {
+                PhpAddWaitGraphEdge(
+                    node,
+                    PhFormatString(L"Critical section 0x%Ix", context.WaitAddress),
+                    graph->ProcessId,
+                    graph->CriticalSections[i].OwningThread
+                    );
+                break;
+            }
+        }
+    }
+
+    if (context.MessageReceiver.UniqueThread)
+    {
+        PhpAddWaitGraphEdge(
+            node,
+            PhCreateString(L"USER message"),
+            context.MessageReceiver.UniqueProcess,
+            context.MessageReceiver.UniqueThread
+            );
+    }
+
+    if (context.AlpcServerProcessId)
+    {
+        PhpAddWaitGraphEdge(node, PhCreateString(L"ALPC request"), context.AlpcServerProcessId, NULL);
+    }
+
+    PhDereferenceObject(context.WaitHandles);
+    PhDeleteStringBuilder(&context.StringBuilder);
+    PhDeleteAutoPool(&autoPool);
+
+    return STATUS_SUCCESS;
+}
+
+static int __cdecl PhpWaitGraphNodeCompareFunction(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PWAIT_GRAPH_NODE node1 = (PWAIT_GRAPH_NODE)elem1;
+    PWAIT_GRAPH_NODE node2 = (PWAIT_GRAPH_NODE)elem2;
+
+    return uintptrcmp((ULONG_PTR)node1->ThreadId, (ULONG_PTR)node2->ThreadId);
+}
+
+static ULONG PhpFindWaitGraphNode(
+    _In_ PWAIT_GRAPH Graph,
+    _In_ HANDLE ThreadId
+    )
+{
+    WAIT_GRAPH_NODE lookupNode;
+    PWAIT_GRAPH_NODE node;
+
+    lookupNode.ThreadId = ThreadId;
+    node = bsearch(&lookupNode, Graph->Nodes, Graph->NumberOfNodes, sizeof(WAIT_GRAPH_NODE), PhpWaitGraphNodeCompareFunction);
+
+    return node ? (ULONG)(node - Graph->Nodes) : -1;
+}
+
+static PWAIT_GRAPH_EDGE PhpFindWaitGraphEdge(
+    _In_ PWAIT_GRAPH_NODE Node,
+    _In_ ULONG TargetIndex
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Node->Edges->Count; i++)
+    {
+        PWAIT_GRAPH_EDGE edge = Node->Edges->Items[i];
+
+        if (edge->TargetIndex == TargetIndex)
+            return edge;
+    }
+
+    return NULL;
+}
+
+static VOID PhpFindWaitGraphCycles(
+    _In_ PWAIT_GRAPH Graph,
+    _In_ ULONG Index,
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _Inout_ PULONG NumberOfCycles
+    )
+{
+    PWAIT_GRAPH_NODE node = &Graph->Nodes[Index];
+    ULONG i;
+
+    node->Color = WAIT_GRAPH_GRAY;
+
+    for (i = 0; i < node->Edges->Count; i++)
+    {
+        PWAIT_GRAPH_EDGE edge = node->Edges->Items[i];
+        PWAIT_GRAPH_NODE target;
+
+        if (edge->TargetIndex == -1)
+            continue;
+
+        target = &Graph->Nodes[edge->TargetIndex];
+
+        if (target->Color == WAIT_GRAPH_WHITE)
+        {
+            target->Parent = Index;
+            PhpFindWaitGraphCycles(Graph, edge->TargetIndex, StringBuilder, NumberOfCycles);
+        }
+        else if (target->Color == WAIT_GRAPH_GRAY)
+        {
+            ULONG current;
+            ULONG next;
+
+            // The nodes from the target down to this node are on the DFS stack, so following
+            // the parent links back from this node reaches the target.
+            (*NumberOfCycles)++;
+            PhAppendFormatStringBuilder(StringBuilder, L"Deadlock %lu:\r\n", *NumberOfCycles);
+
+            next = edge->TargetIndex;
+            current = Index;
+
+            while (TRUE)
+            {
+                PWAIT_GRAPH_EDGE cycleEdge = PhpFindWaitGraphEdge(&Graph->Nodes[current], next);
+
+                PhAppendFormatStringBuilder(
+                    StringBuilder,
+                    L"    Thread %lu waits for thread %lu (%s)\r\n",
+                    HandleToUlong(Graph->Nodes[current].ThreadId),
+                    HandleToUlong(Graph->Nodes[next].ThreadId),
+                    cycleEdge ? cycleEdge->Reason->Buffer : L"unknown"
+                    );
+
+                if (current == edge->TargetIndex)
+                    break;
+
+                next = current;
+                current = Graph->Nodes[current].Parent;
+            }
+        }
+    }
+
+    node->Color = WAIT_GRAPH_BLACK;
+}
+
+/**
+ * Analyzes the waits of every thread in a process, builds a graph of
+ * thread -> owner edges and reports any cycles.
+ *
+ * \param hWnd The parent window.
+ * \param ProcessId The ID of the process.
+ * \param SymbolProvider A symbol provider for the process. This is used to walk
+ * stacks on 32-bit systems and for WOW64 processes.
+ */
+VOID PhUiAnalyzeWaitProcess(
+    _In_ HWND hWnd,
+    _In_ HANDLE ProcessId,
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
+    )
+{
+    NTSTATUS status;
+    WAIT_GRAPH graph;
+    PVOID processes;
+    PSYSTEM_PROCESS_INFORMATION processInfo;
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    PH_STRING_BUILDER stringBuilder;
+    CLIENT_ID clientId;
+    PPH_STRING clientIdName;
+    ULONG numberOfWaiting = 0;
+    ULONG numberOfCycles = 0;
+    ULONG i;
+    ULONG j;
+#ifdef _WIN64
+    BOOLEAN isWow64 = FALSE;
+#endif
+
+    memset(&graph, 0, sizeof(WAIT_GRAPH));
+    graph.ProcessId = ProcessId;
+    graph.SymbolProvider = SymbolProvider;
+    graph.UseStackWalk = TRUE;
+
+    if (!NT_SUCCESS(status = PhOpenProcess(
+        &graph.ProcessHandle,
+        ProcessQueryAccess | PROCESS_DUP_HANDLE | PROCESS_VM_READ,
+        ProcessId
+        )))
+    {
+        PhShowStatus(hWnd, L"Unable to open the process", status, 0);
+        return;
+    }
+
+#ifdef _WIN64
+    // See PhUiAnalyzeWaitThread.
+    PhGetProcessIsWow64(graph.ProcessHandle, &isWow64);
+    graph.UseStackWalk = isWow64;
+
+    // The lock list uses native pointers.
+    if (!isWow64)
+#endif
+        PhpGetWaitGraphCriticalSections(&graph);
+
+    if (!NT_SUCCESS(status = PhEnumProcesses(&processes)))
+    {
+        PhShowStatus(hWnd, L"Unable to enumerate processes", status, 0);
+        NtClose(graph.ProcessHandle);
+        return;
+    }
+
+    if (processInfo = PhFindProcessInformation(processes, ProcessId))
+    {
+        graph.NumberOfNodes = processInfo->NumberOfThreads;
+        graph.Nodes = PhAllocate(graph.NumberOfNodes * sizeof(WAIT_GRAPH_NODE));
+        memset(graph.Nodes, 0, graph.NumberOfNodes * sizeof(WAIT_GRAPH_NODE));
+
+        for (i = 0; i < graph.NumberOfNodes; i++)
+        {
+            graph.Nodes[i].Graph = &graph;
+            graph.Nodes[i].ThreadId = processInfo->Threads[i].ClientId.UniqueThread;
+            graph.Nodes[i].Waiting = processInfo->Threads[i].ThreadState == Waiting;
+            graph.Nodes[i].Edges = PhCreateList(2);
+        }
+
+        qsort(graph.Nodes, graph.NumberOfNodes, sizeof(WAIT_GRAPH_NODE), PhpWaitGraphNodeCompareFunction);
+    }
+
+    PhFree(processes);
+
+    // Analyze every waiting thread in parallel.
+    PhInitializeWorkQueue(&workQueue, 0, PhSystemBasicInformation.NumberOfProcessors, 1000);
+    PhInitializeWorkQueueBatch(&workQueueBatch);
+
+    for (i = 0; i < graph.NumberOfNodes; i++)
+    {
+        if (graph.Nodes[i].Waiting)
+        {
+            PVOID node = &graph.Nodes[i];
+
+            PhQueueItemsWorkQueueEx(&workQueue, PhpAnalyzeWaitGraphThreadStart, &node, 1, &workQueueBatch);
+            numberOfWaiting++;
+        }
+    }
+
+    PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+    PhDeleteWorkQueue(&workQueue);
+
+    // Link the edges to nodes in this process.
+    for (i = 0; i < graph.NumberOfNodes; i++)
+    {
+        for (j = 0; j < graph.Nodes[i].Edges->Count; j++)
+        {
+            PWAIT_GRAPH_EDGE edge = graph.Nodes[i].Edges->Items[j];
+
+            if (edge->Owner.UniqueProcess == ProcessId && edge->Owner.UniqueThread)
+                edge->TargetIndex = PhpFindWaitGraphNode(&graph, edge->Owner.UniqueThread);
+        }
+    }
+
+    PhInitializeStringBuilder(&stringBuilder, 0x1000);
+
+    clientId.UniqueProcess = ProcessId;
+    clientId.UniqueThread = NULL;
+    clientIdName = PhGetClientIdName(&clientId);
+    PhAppendFormatStringBuilder(
+        &stringBuilder,
+        L"Wait chain analysis for %s: %lu threads, %lu waiting.\r\n\r\n",
+        clientIdName->Buffer,
+        graph.NumberOfNodes,
+        numberOfWaiting
+        );
+    PhDereferenceObject(clientIdName);
+
+    for (i = 0; i < graph.NumberOfNodes; i++)
+    {
+        if (graph.Nodes[i].Color == WAIT_GRAPH_WHITE)
+            PhpFindWaitGraphCycles(&graph, i, &stringBuilder, &numberOfCycles);
+    }
+
+    if (numberOfCycles == 0)
+        PhAppendStringBuilder2(&stringBuilder, L"No deadlocks were found.\r\n");
+
+    PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+
+    for (i = 0; i < graph.NumberOfNodes; i++)
+    {
+        PWAIT_GRAPH_NODE node = &graph.Nodes[i];
+
+        if (!node->Description && node->Edges->Count == 0)
+            continue;
+
+        PhAppendFormatStringBuilder(&stringBuilder, L"Thread %lu:\r\n", HandleToUlong(node->ThreadId));
+
+        if (node->Description)
+        {
+            PhAppendStringBuilder(&stringBuilder, &node->Description->sr);
+            PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+        }
+
+        for (j = 0; j < node->Edges->Count; j++)
+        {
+            PWAIT_GRAPH_EDGE edge = node->Edges->Items[j];
+
+            clientIdName = PhGetClientIdName(&edge->Owner);
+            PhAppendFormatStringBuilder(&stringBuilder, L"-> %s, owned by %s\r\n", edge->Reason->Buffer, clientIdName->Buffer);
+            PhDereferenceObject(clientIdName);
+
+            PhDereferenceObject(edge->Reason);
+            PhFree(edge);
+        }
+
+        PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+    }
+
+    PhShowInformationDialog(hWnd, stringBuilder.String->Buffer);
+    PhDeleteStringBuilder(&stringBuilder);
+
+    for (i = 0; i < graph.NumberOfNodes; i++)
+    {
+        if (graph.Nodes[i].Description)
+            PhDereferenceObject(graph.Nodes[i].Description);
+
+        PhDereferenceObject(graph.Nodes[i].Edges);
+    }
+
+    if (graph.Nodes)
+        PhFree(graph.Nodes);
+    if (graph.CriticalSections)
+        PhFree(graph.CriticalSections);
+
+    NtClose(graph.ProcessHandle);
+}
@@ -29,6 +29,7 @@
 #include <phsvccl.h>
 #include "mxml/mxml.h"
 #include "pcre/pcre2.h"
+#include <regexsup.h>
 #include <winsta.h>
 
 #pragma warning(push)
@@ -704,6 +705,188 @@ VOID PhEnumChildWindows(
     }
 }
 
+static PPH_OBJECT_TYPE PhpWindowSnapshotType = NULL;
+static PH_QUEUED_LOCK PhpWindowSnapshotLock = PH_QUEUED_LOCK_INIT;
+static PPH_WINDOW_SNAPSHOT PhpWindowSnapshot = NULL;
+
+static VOID NTAPI PhpWindowSnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_WINDOW_SNAPSHOT snapshot = Object;
+
+    PhFree(snapshot->Windows);
+    PhFree(snapshot->ProcessIndex);
+}
+
+static int __cdecl PhpWindowSnapshotProcessIndexCompare(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_WINDOW_SNAPSHOT snapshot = context;
+    ULONG index1 = *(PULONG)elem1;
+    ULONG index2 = *(PULONG)elem2;
+    int result;
+
+    result = uintptrcmp((ULONG_PTR)snapshot->Windows[index1].ProcessId, (ULONG_PTR)snapshot->Windows[index2].ProcessId);
+
+    // Keep the windows of each process in Z order.
+    if (result == 0)
+        result = uintcmp(index1, index2);
+
+    return result;
+}
+
+static PPH_WINDOW_SNAPSHOT PhpCreateWindowSnapshot(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PPH_WINDOW_SNAPSHOT snapshot;
+    PPH_WINDOW_SNAPSHOT_ENTRY windows;
+    ULONG allocatedWindows;
+    ULONG numberOfWindows;
+    HWND window;
+    ULONG i;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpWindowSnapshotType = PhCreateObjectType(L"WindowSnapshot", 0, PhpWindowSnapshotDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    allocatedWindows = 256;
+    windows = PhAllocate(allocatedWindows * sizeof(PH_WINDOW_SNAPSHOT_ENTRY));
+    numberOfWindows = 0;
+    window = NULL;
+
+    // Same enumeration and limit as PhEnumChildWindows(NULL, 0x800, ...).
+    while (numberOfWindows < 0x800 && (window = FindWindowEx(NULL, window, NULL, NULL)))
+    {
+        ULONG processId;
+        ULONG threadId;
+
+        if (numberOfWindows == allocatedWindows)
+        {
+            allocatedWindows *= 2;
+            windows = PhReAllocate(windows, allocatedWindows * sizeof(PH_WINDOW_SNAPSHOT_ENTRY));
+        }
+
+        threadId = GetWindowThreadProcessId(window, &processId);
+        windows[numberOfWindows].WindowHandle = window;
+        windows[numberOfWindows].ProcessId = UlongToHandle(processId);
+        windows[numberOfWindows].ThreadId = UlongToHandle(threadId);
+        numberOfWindows++;
+    }
+
+    snapshot = PhCreateObject(sizeof(PH_WINDOW_SNAPSHOT), PhpWindowSnapshotType);
+    snapshot->NumberOfWindows = numberOfWindows;
+    snapshot->Windows = windows;
+    snapshot->ProcessIndex = PhAllocate(max(numberOfWindows, 1) * sizeof(ULONG));
+
+    for (i = 0; i < numberOfWindows; i++)
+        snapshot->ProcessIndex[i] = i;
+
+    qsort_s(snapshot->ProcessIndex, numberOfWindows, sizeof(ULONG), PhpWindowSnapshotProcessIndexCompare, snapshot);
+
+    return snapshot;
+}
+
+/**
+ * Gets a snapshot of the top-level windows.
+ *
+ * \return The snapshot. You must dereference it when you no longer need it.
+ *
+ * \remarks The snapshot is shared and is only created again after
+ * PhInvalidateWindowSnapshot() is called, which happens on every
+ * process provider update.
+ */
+PPH_WINDOW_SNAPSHOT PhReferenceWindowSnapshot(
+    VOID
+    )
+{
+    PPH_WINDOW_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockExclusive(&PhpWindowSnapshotLock);
+
+    if (!PhpWindowSnapshot)
+        PhpWindowSnapshot = PhpCreateWindowSnapshot();
+
+    snapshot = PhpWindowSnapshot;
+    PhReferenceObject(snapshot);
+
+    PhReleaseQueuedLockExclusive(&PhpWindowSnapshotLock);
+
+    return snapshot;
+}
+
+/**
+ * Discards the shared window snapshot so that the next call to
+ * PhReferenceWindowSnapshot() enumerates the windows again.
+ */
+VOID PhInvalidateWindowSnapshot(
+    VOID
+    )
+{
+    PPH_WINDOW_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockExclusive(&PhpWindowSnapshotLock);
+    snapshot = PhpWindowSnapshot;
+    PhpWindowSnapshot = NULL;
+    PhReleaseQueuedLockExclusive(&PhpWindowSnapshotLock);
+
+    if (snapshot)
+        PhDereferenceObject(snapshot);
+}
+
+/**
+ * Finds the windows of a process in a window snapshot.
+ *
+ * \param Snapshot A window snapshot.
+ * \param ProcessId The ID of the process.
+ * \param Indices A variable which receives a pointer to an array of indices into
+ * the Windows array of \a Snapshot, in Z order. The array is owned by the snapshot.
+ *
+ * \return The number of windows owned by the process.
+ */
+ULONG PhFindProcessWindowsSnapshot(
+    _In_ PPH_WINDOW_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _Out_ PULONG *Indices
+    )
+{
+    ULONG low;
+    ULONG high;
+    ULONG start;
+
+    // Find the first window owned by the process.
+
+    low = 0;
+    high = Snapshot->NumberOfWindows;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+
+        if ((ULONG_PTR)Snapshot->Windows[Snapshot->ProcessIndex[mid]].ProcessId < (ULONG_PTR)ProcessId)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    start = low;
+
+    while (high < Snapshot->NumberOfWindows && Snapshot->Windows[Snapshot->ProcessIndex[high]].ProcessId == ProcessId)
+        high++;
+
+    *Indices = &Snapshot->ProcessIndex[start];
+
+    return high - start;
+}
+
 typedef struct _GET_PROCESS_MAIN_WINDOW_CONTEXT
 {
     HWND Window;
@@ -718,16 +901,15 @@ BOOL CALLBACK PhpGetProcessMainWindowEnumWindowsProc(
     )
 {
     PGET_PROCESS_MAIN_WINDOW_CONTEXT context = (PGET_PROCESS_MAIN_WINDOW_CONTEXT)lParam;
-    ULONG processId;
     HWND parentWindow;
     WINDOWINFO windowInfo;
 
+    // Note: the caller only passes windows owned by the process.
+
     if (!IsWindowVisible(hwnd))
         return TRUE;
 
-    GetWindowThreadProcessId(hwnd, &processId);
-
-    if (UlongToHandle(processId) == context->ProcessId &&
+    if (
         !((parentWindow = GetParent(hwnd)) && IsWindowVisible(parentWindow)) && // skip windows with a visible parent
         PhGetWindowTextEx(hwnd, PH_GET_WINDOW_TEXT_INTERNAL | PH_GET_WINDOW_TEXT_LENGTH_ONLY, NULL) != 0) // skip windows with no title
     {
@@ -759,6 +941,19 @@ HWND PhGetProcessMainWindow(
 {
     GET_PROCESS_MAIN_WINDOW_CONTEXT context;
     HANDLE processHandle = NULL;
+    PPH_WINDOW_SNAPSHOT snapshot;
+    PULONG indices;
+    ULONG numberOfWindows;
+    ULONG i;
+
+    snapshot = PhReferenceWindowSnapshot();
+    numberOfWindows = PhFindProcessWindowsSnapshot(snapshot, ProcessId, &indices);
+
+    if (numberOfWindows == 0)
+    {
+        PhDereferenceObject(snapshot);
+        return NULL;
+    }
 
     memset(&context, 0, sizeof(GET_PROCESS_MAIN_WINDOW_CONTEXT));
     context.ProcessId = ProcessId;
@@ -771,11 +966,17 @@ HWND PhGetProcessMainWindow(
     if (processHandle && IsImmersiveProcess_I)
         context.IsImmersive = IsImmersiveProcess_I(processHandle);
 
-    PhEnumChildWindows(NULL, 0x800, PhpGetProcessMainWindowEnumWindowsProc, (LPARAM)&context);
+    for (i = 0; i < numberOfWindows; i++)
+    {
+        if (!PhpGetProcessMainWindowEnumWindowsProc(snapshot->Windows[indices[i]].WindowHandle, (LPARAM)&context))
+            break;
+    }
 
     if (!ProcessHandle && processHandle)
         NtClose(processHandle);
 
+    PhDereferenceObject(snapshot);
+
     return context.ImmersiveWindow ? context.ImmersiveWindow : context.Window;
 }
 
@@ -1870,6 +2071,407 @@ VOID PhApplyTreeNewFilters(
     TreeNew_NodesStructured(Support->TreeNewHandle);
 }
 
+typedef enum _PH_TN_FILTER_TERM_TYPE
+{
+    FilterTermSubstring,
+    FilterTermRegex,
+    FilterTermNumber
+} PH_TN_FILTER_TERM_TYPE;
+
+typedef enum _PH_TN_FILTER_COMPARISON
+{
+    FilterCompareEqual,
+    FilterCompareLess,
+    FilterCompareLessOrEqual,
+    FilterCompareGreater,
+    FilterCompareGreaterOrEqual
+} PH_TN_FILTER_COMPARISON;
+
+typedef struct _PH_TN_FILTER_TERM
+{
+    PH_TN_FILTER_TERM_TYPE Type;
+    union
+    {
+        PH_STRINGREF Substring;
+        PPH_REGEX Regex;
+        struct
+        {
+            PH_STRINGREF FieldName;
+            PH_TN_FILTER_COMPARISON Comparison;
+            DOUBLE Value;
+        } Number;
+    } u;
+} PH_TN_FILTER_TERM, *PPH_TN_FILTER_TERM;
+
+typedef struct _PH_TN_FILTER_QUERY
+{
+    PPH_STRING Text; // terms point into this string
+    ULONG NumberOfTerms;
+    ULONG NumberOfStringTerms;
+    ULONG NumberOfNumberTerms;
+    PPH_TN_FILTER_TERM Terms;
+} PH_TN_FILTER_QUERY;
+
+static PPH_OBJECT_TYPE PhpTreeNewFilterQueryType = NULL;
+
+VOID NTAPI PhpTreeNewFilterQueryDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_TN_FILTER_QUERY query = Object;
+    ULONG i;
+
+    for (i = 0; i < query->NumberOfTerms; i++)
+    {
+        if (query->Terms[i].Type == FilterTermRegex)
+            PhDereferenceObject(query->Terms[i].u.Regex);
+    }
+
+    if (query->Terms)
+        PhFree(query->Terms);
+
+    PhDereferenceObject(query->Text);
+}
+
+static BOOLEAN PhpParseFilterQueryNumber(
+    _In_ PPH_STRINGREF Text,
+    _Out_ DOUBLE *Value
+    )
+{
+    PH_STRINGREF number;
+    PH_STRINGREF integerPart;
+    PH_STRINGREF fractionPart;
+    LONG64 integer;
+    LONG64 fraction;
+    DOUBLE value;
+    DOUBLE multiplier;
+    SIZE_T i;
+
+    number = *Text;
+    multiplier = 1;
+
+    // Size suffixes, e.g. "private>500mb".
+    if (number.Length >= 2 * sizeof(WCHAR) &&
+        (number.Buffer[number.Length / sizeof(WCHAR) - 1] | 0x20) == 'b')
+    {
+        number.Length -= sizeof(WCHAR);
+    }
+
+    if (number.Length != 0)
+    {
+        switch (number.Buffer[number.Length / sizeof(WCHAR) - 1] | 0x20)
+        {
+        case 'k':
+            multiplier = 1024.0;
+            break;
+        case 'm':
+            multiplier = 1024.0 * 1024;
+            break;
+        case 'g':
+            multiplier = 1024.0 * 1024 * 1024;
+            break;
+        }
+
+        if (multiplier != 1)
+            number.Length -= sizeof(WCHAR);
+    }
+
+    PhSplitStringRefAtChar(&number, '.', &integerPart, &fractionPart);
+
+    if (integerPart.Length == 0 || !PhStringToInteger64(&integerPart, 10, &integer) || integer < 0)
+        return FALSE;
+
+    value = (DOUBLE)integer;
+
+    if (fractionPart.Length != 0)
+    {
+        if (!PhStringToInteger64(&fractionPart, 10, &fraction) || fraction < 0)
+            return FALSE;
+
+        for (i = 0; i < fractionPart.Length / sizeof(WCHAR); i++)
+            value *= 10;
+
+        value += (DOUBLE)fraction;
+
+        for (i = 0; i < fractionPart.Length / sizeof(WCHAR); i++)
+            value /= 10;
+    }
+
+    *Value = value * multiplier;
+
+    return TRUE;
+}
+
+static BOOLEAN PhpParseFilterQueryNumberTerm(
+    _In_ PPH_STRINGREF Text,
+    _Out_ PPH_TN_FILTER_TERM Term
+    )
+{
+    SIZE_T count;
+    SIZE_T i;
+    PH_TN_FILTER_COMPARISON comparison;
+    PH_STRINGREF value;
+
+    count = Text->Length / sizeof(WCHAR);
+
+    // The field name is a run of letters, followed by the operator.
+    for (i = 0; i < count; i++)
+    {
+        WCHAR c = Text->Buffer[i] | 0x20;
+
+        if (c < 'a' || c > 'z')
+            break;
+    }
+
+    if (i == 0 || i == count)
+        return FALSE;
+
+    Term->u.Number.FieldName.Buffer = Text->Buffer;
+    Term->u.Number.FieldName.Length = i * sizeof(WCHAR);
+
+    switch (Text->Buffer[i])
+    {
+    case '=':
+        comparison = FilterCompareEqual;
+        break;
+    case '<':
+        comparison = FilterCompareLess;
+        break;
+    case '>':
+        comparison = FilterCompareGreater;
+        break;
+    default:
+        return FALSE;
+    }
+
+    i++;
+
+    if (i < count && Text->Buffer[i] == '=' && comparison != FilterCompareEqual)
+    {
+        comparison = comparison == FilterCompareLess ? FilterCompareLessOrEqual : FilterCompareGreaterOrEqual;
+        i++;
+    }
+
+    value.Buffer = Text->Buffer + i;
+    value.Length = (count - i) * sizeof(WCHAR);
+
+    if (!PhpParseFilterQueryNumber(&value, &Term->u.Number.Value))
+        return FALSE;
+
+    Term->Type = FilterTermNumber;
+    Term->u.Number.Comparison = comparison;
+
+    return TRUE;
+}
+
+/**
+ * Compiles a filter query.
+ *
+ * \param Text The query text. Terms are separated by "|", and a node matches the query if
+ * it matches any term. A term is one of:
+ * \li \c /pattern/, a case-insensitive regular expression.
+ * \li \c field<op>number, where op is one of =, <, <=, > or >=. The number may have a
+ * fraction and a k, m or g size suffix (optionally followed by b), e.g. "cpu>5" or
+ * "private>=1.5gb". The filter decides which fields exist.
+ * \li Any other text, which matches if it appears in a string field.
+ *
+ * \return The compiled query. You must dereference it when you no longer need it.
+ *
+ * \remarks The query is compiled once so that filters can evaluate it for each node and
+ * each field without parsing it again. Regular expressions are JIT compiled where PCRE2
+ * supports it.
+ */
+PPH_TN_FILTER_QUERY PhCreateTreeNewFilterQuery(
+    _In_ PPH_STRINGREF Text
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PPH_TN_FILTER_QUERY query;
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+    ULONG maximumTerms;
+    SIZE_T i;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpTreeNewFilterQueryType = PhCreateObjectType(L"TreeNewFilterQuery", 0, PhpTreeNewFilterQueryDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    query = PhCreateObject(sizeof(PH_TN_FILTER_QUERY), PhpTreeNewFilterQueryType);
+    memset(query, 0, sizeof(PH_TN_FILTER_QUERY));
+    query->Text = PhCreateString2(Text);
+
+    maximumTerms = 1;
+
+    for (i = 0; i < Text->Length / sizeof(WCHAR); i++)
+    {
+        if (Text->Buffer[i] == '|')
+            maximumTerms++;
+    }
+
+    query->Terms = PhAllocate(sizeof(PH_TN_FILTER_TERM) * maximumTerms);
+    remainingPart = query->Text->sr;
+
+    while (remainingPart.Length != 0)
+    {
+        PPH_TN_FILTER_TERM term;
+
+        PhSplitStringRefAtChar(&remainingPart, '|', &part, &remainingPart);
+
+        if (part.Length == 0)
+            continue;
+
+        term = &query->Terms[query->NumberOfTerms];
+
+        if (part.Length > 2 * sizeof(WCHAR) && part.Buffer[0] == '/' && part.Buffer[part.Length / sizeof(WCHAR) - 1] == '/')
+        {
+            PH_STRINGREF pattern;
+
+            pattern.Buffer = part.Buffer + 1;
+            pattern.Length = part.Length - 2 * sizeof(WCHAR);
+
+            // Compiled patterns are cached, so re-parsing the query on every keystroke only
+            // compiles the term that changed.
+            term->u.Regex = PhCompileRegex(&pattern, PH_REGEX_IGNORE_CASE, NULL, NULL);
+
+            if (term->u.Regex)
+            {
+                term->Type = FilterTermRegex;
+                query->NumberOfStringTerms++;
+                query->NumberOfTerms++;
+                continue;
+            }
+
+            // The user is probably still typing; fall back to matching the text.
+        }
+        else if (PhpParseFilterQueryNumberTerm(&part, term))
+        {
+            query->NumberOfNumberTerms++;
+            query->NumberOfTerms++;
+            continue;
+        }
+
+        term->Type = FilterTermSubstring;
+        term->u.Substring = part;
+        query->NumberOfStringTerms++;
+        query->NumberOfTerms++;
+    }
+
+    return query;
+}
+
+/**
+ * Determines whether a string field matches a filter query.
+ *
+ * \param Query A compiled query.
+ * \param Text The text of the field.
+ *
+ * \return TRUE if a substring or regular expression term matches the text.
+ */
+BOOLEAN PhMatchTreeNewFilterQueryString(
+    _In_ PPH_TN_FILTER_QUERY Query,
+    _In_ PPH_STRINGREF Text
+    )
+{
+    ULONG i;
+
+    if (Query->NumberOfStringTerms == 0)
+        return FALSE;
+
+    for (i = 0; i < Query->NumberOfTerms; i++)
+    {
+        PPH_TN_FILTER_TERM term = &Query->Terms[i];
+
+        switch (term->Type)
+        {
+        case FilterTermSubstring:
+            if (PhFindStringInStringRef(Text, &term->u.Substring, TRUE) != -1)
+                return TRUE;
+            break;
+        case FilterTermRegex:
+            if (PhMatchRegex(term->u.Regex, Text))
+                return TRUE;
+            break;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Determines whether a numeric field matches a filter query.
+ *
+ * \param Query A compiled query.
+ * \param FieldName The name of the field, e.g. "cpu".
+ * \param Value The value of the field.
+ *
+ * \return TRUE if a comparison term for the field matches the value.
+ */
+BOOLEAN PhMatchTreeNewFilterQueryNumber(
+    _In_ PPH_TN_FILTER_QUERY Query,
+    _In_ PWSTR FieldName,
+    _In_ DOUBLE Value
+    )
+{
+    ULONG i;
+
+    if (Query->NumberOfNumberTerms == 0)
+        return FALSE;
+
+    for (i = 0; i < Query->NumberOfTerms; i++)
+    {
+        PPH_TN_FILTER_TERM term = &Query->Terms[i];
+        BOOLEAN match;
+
+        if (term->Type != FilterTermNumber)
+            continue;
+        if (!PhEqualStringRef2(&term->u.Number.FieldName, FieldName, TRUE))
+            continue;
+
+        switch (term->u.Number.Comparison)
+        {
+        case FilterCompareEqual:
+            match = Value == term->u.Number.Value;
+            break;
+        case FilterCompareLess:
+            match = Value < term->u.Number.Value;
+            break;
+        case FilterCompareLessOrEqual:
+            match = Value <= term->u.Number.Value;
+            break;
+        case FilterCompareGreater:
+            match = Value > term->u.Number.Value;
+            break;
+        case FilterCompareGreaterOrEqual:
+            match = Value >= term->u.Number.Value;
+            break;
+        default:
+            match = FALSE;
+            break;
+        }
+
+        if (match)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Determines whether a filter query contains numeric comparisons. The results for such
+ * queries can change whenever the nodes are updated.
+ *
+ * \param Query A compiled query.
+ */
+BOOLEAN PhIsTreeNewFilterQueryNumeric(
+    _In_ PPH_TN_FILTER_QUERY Query
+    )
+{
+    return Query->NumberOfNumberTerms != 0;
+}
+
 VOID NTAPI PhpCopyCellEMenuItemDeleteFunction(
     _In_ struct _PH_EMENU_ITEM *Item
     )
@@ -0,0 +1,184 @@
+/*
+ * Process Hacker -
+ *   replay controls
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <phapp.h>
+#include <capture.h>
+
+#define WM_PH_REPLAY_UPDATED (WM_APP + 322)
+
+INT_PTR CALLBACK PhpReplayDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
+static HWND PhpReplayWindowHandle = NULL;
+static HWND PositionHandle;
+static BOOLEAN PositionTracking; // the user is dragging the slider
+static PH_CALLBACK_REGISTRATION ProcessesUpdatedRegistration;
+
+VOID PhShowProviderReplayDialog(
+    VOID
+    )
+{
+    if (!PhProviderReplayActive)
+    {
+        PhShowInformation(PhMainWndHandle, L"Replay controls are only available when Process Hacker is started with -replay.");
+        return;
+    }
+
+    if (!PhpReplayWindowHandle)
+    {
+        PhpReplayWindowHandle = CreateDialog(
+            PhInstanceHandle,
+            MAKEINTRESOURCE(IDD_REPLAY),
+            PhMainWndHandle,
+            PhpReplayDlgProc
+            );
+        PhRegisterDialog(PhpReplayWindowHandle);
+        ShowWindow(PhpReplayWindowHandle, SW_SHOW);
+    }
+
+    if (IsIconic(PhpReplayWindowHandle))
+        ShowWindow(PhpReplayWindowHandle, SW_RESTORE);
+    else
+        SetForegroundWindow(PhpReplayWindowHandle);
+}
+
+static VOID NTAPI ProcessesUpdatedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PostMessage(PhpReplayWindowHandle, WM_PH_REPLAY_UPDATED, 0, 0);
+}
+
+static VOID PhpUpdateReplayPosition(
+    _In_ HWND hwndDlg,
+    _In_ ULONG Index
+    )
+{
+    LARGE_INTEGER time;
+    SYSTEMTIME systemTime;
+    PPH_STRING timeString;
+
+    if (!PositionTracking)
+        SendMessage(PositionHandle, TBM_SETPOS, TRUE, Index);
+
+    if (PhGetProviderReplayTime(Index, &time))
+    {
+        PhLargeIntegerToLocalSystemTime(&systemTime, &time);
+        timeString = PhFormatDateTime(&systemTime);
+        SetDlgItemText(hwndDlg, IDC_TIME, PhaFormatString(
+            L"Frame %u of %u: %s",
+            Index + 1,
+            PhGetProviderReplayCount(),
+            timeString->Buffer
+            )->Buffer);
+        PhDereferenceObject(timeString);
+    }
+    else
+    {
+        SetDlgItemText(hwndDlg, IDC_TIME, L"The capture is empty.");
+    }
+}
+
+INT_PTR CALLBACK PhpReplayDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            ULONG count;
+
+            PositionHandle = GetDlgItem(hwndDlg, IDC_POSITION);
+            PositionTracking = FALSE;
+
+            count = PhGetProviderReplayCount();
+            SendMessage(PositionHandle, TBM_SETRANGEMIN, FALSE, 0);
+            SendMessage(PositionHandle, TBM_SETRANGEMAX, FALSE, count != 0 ? count - 1 : 0);
+            SendMessage(PositionHandle, TBM_SETPAGESIZE, 0, max(count / 20, 1));
+
+            SetDlgItemText(hwndDlg, IDC_PAUSE, PhIsProviderReplayPaused() ? L"Resume" : L"Pause");
+
+            PhRegisterCallback(&PhProcessesUpdatedEvent, ProcessesUpdatedCallback, NULL, &ProcessesUpdatedRegistration);
+            PhpUpdateReplayPosition(hwndDlg, PhGetProviderReplayPosition());
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PhUnregisterCallback(&PhProcessesUpdatedEvent, &ProcessesUpdatedRegistration);
+            PhUnregisterDialog(PhpReplayWindowHandle);
+            PhpReplayWindowHandle = NULL;
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+            case IDOK:
+                DestroyWindow(hwndDlg);
+                break;
+            case IDC_PAUSE:
+                {
+                    BOOLEAN paused;
+
+                    paused = !PhIsProviderReplayPaused();
+                    PhSetProviderReplayPaused(paused);
+                    SetDlgItemText(hwndDlg, IDC_PAUSE, paused ? L"Resume" : L"Pause");
+                }
+                break;
+            }
+        }
+        break;
+    case WM_HSCROLL:
+        {
+            if ((HWND)lParam != PositionHandle)
+                break;
+
+            switch (LOWORD(wParam))
+            {
+            case TB_THUMBTRACK:
+                PositionTracking = TRUE;
+                PhpUpdateReplayPosition(hwndDlg, (ULONG)SendMessage(PositionHandle, TBM_GETPOS, 0, 0));
+                break;
+            case TB_ENDTRACK:
+                PositionTracking = FALSE;
+                PhSeekProviderReplay((ULONG)SendMessage(PositionHandle, TBM_GETPOS, 0, 0));
+                break;
+            }
+        }
+        break;
+    case WM_PH_REPLAY_UPDATED:
+        {
+            PhpUpdateReplayPosition(hwndDlg, PhGetProviderReplayPosition());
+        }
+        break;
+    }
+
+    return FALSE;
+}
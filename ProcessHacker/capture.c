@@ -0,0 +1,741 @@
+/*
+ * Process Hacker -
+ *   provider capture and replay
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * When started with -record, the process provider appends the raw system information it
+ * queries in each update (the SYSTEM_PROCESS_INFORMATION buffer, the system performance
+ * information and the per-processor times) to a capture file. When started with -replay, the
+ * provider reads the same information back from a capture file instead of querying the system,
+ * one frame per update, so the process tree, graphs and statistics behave as they did when the
+ * capture was made. Nothing else about replayed processes is queried from the live system.
+ *
+ * A capture file is a file pool. The user context points to a PH_CAPTURE_HEADER, which links a
+ * chain of index blocks with the time and RVA of each frame. Process buffers are compressed
+ * with LZNT1. The whole index is read when the capture is opened, which makes seeking cheap.
+ */
+
+#include <phapp.h>
+#include <capture.h>
+#include <filepool.h>
+
+#define PH_CAPTURE_MAGIC ('PCHP')
+#define PH_CAPTURE_VERSION 1
+#define PH_CAPTURE_SEGMENT_SHIFT 24 // a frame has to fit in a single segment
+#define PH_CAPTURE_INDEX_ENTRIES 1024
+#define PH_CAPTURE_MAXIMUM_PROCESSES_SIZE (256 * 1024 * 1024)
+#define PH_CAPTURE_MAXIMUM_PROCESSORS 4096
+
+typedef struct _PH_CAPTURE_HEADER
+{
+    ULONG Version;
+    USHORT PointerSize;
+    USHORT Reserved;
+    ULONG NumberOfFrames;
+    ULONG FirstIndexRva;
+    ULONG LastIndexRva;
+} PH_CAPTURE_HEADER, *PPH_CAPTURE_HEADER;
+
+typedef struct _PH_CAPTURE_INDEX_ENTRY
+{
+    LARGE_INTEGER Time;
+    ULONG Rva;
+    ULONG Reserved;
+} PH_CAPTURE_INDEX_ENTRY, *PPH_CAPTURE_INDEX_ENTRY;
+
+typedef struct _PH_CAPTURE_INDEX
+{
+    ULONG NextRva;
+    ULONG Count;
+    PH_CAPTURE_INDEX_ENTRY Entries[PH_CAPTURE_INDEX_ENTRIES];
+} PH_CAPTURE_INDEX, *PPH_CAPTURE_INDEX;
+
+typedef struct _PH_CAPTURE_FRAME_HEADER
+{
+    LARGE_INTEGER Time;
+    SYSTEM_PERFORMANCE_INFORMATION PerfInformation;
+    ULONG NumberOfProcessors;
+    USHORT CompressionFormat; // COMPRESSION_FORMAT_NONE or COMPRESSION_FORMAT_LZNT1
+    USHORT Reserved;
+    ULONG64 ProcessesBase; // address of the process buffer when it was captured
+    ULONG ProcessesSize; // uncompressed
+    ULONG DataSize;
+    // SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION[NumberOfProcessors] follows, then the process
+    // buffer.
+} PH_CAPTURE_FRAME_HEADER, *PPH_CAPTURE_FRAME_HEADER;
+
+BOOLEAN PhProviderCaptureActive = FALSE;
+BOOLEAN PhProviderReplayActive = FALSE;
+
+// Both are only used by the process provider once recording or replay has started.
+static PPH_FILE_POOL PhpCapturePool = NULL;
+static ULONG PhpCaptureHeaderRva;
+
+// Recording
+static PVOID PhpCaptureWorkSpace = NULL;
+static PVOID PhpCaptureBuffer = NULL;
+static ULONG PhpCaptureBufferSize = 0;
+static PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION PhpCaptureCpuInformation = NULL;
+static ULONG PhpCaptureNumberOfProcessors = 0;
+
+// Replay
+static PPH_CAPTURE_INDEX_ENTRY PhpReplayIndex = NULL;
+static ULONG PhpReplayCount = 0;
+static PH_QUEUED_LOCK PhpReplayLock = PH_QUEUED_LOCK_INIT;
+static ULONG PhpReplayNextIndex = 0; // protected by PhpReplayLock
+static ULONG PhpReplayPosition = 0; // the last frame that was read; protected by PhpReplayLock
+static BOOLEAN PhpReplayPaused = FALSE; // protected by PhpReplayLock
+static BOOLEAN PhpReplaySeekPending = FALSE; // shows the new frame while paused; protected by PhpReplayLock
+static BOOLEAN PhpReplayDiscontinuity = FALSE; // protected by PhpReplayLock
+static PPH_REPLAY_FRAME_SOURCE PhpReplaySource = NULL;
+
+/**
+ * Creates a capture file and starts recording process provider updates into it.
+ *
+ * \param FileName The file name of the capture. An existing file is overwritten.
+ *
+ * \remarks This function must be called before the process provider starts.
+ */
+NTSTATUS PhStartProviderCapture(
+    _In_ PWSTR FileName
+    )
+{
+    NTSTATUS status;
+    PH_FILE_POOL_PARAMETERS parameters;
+    PPH_FILE_POOL pool;
+    PPH_CAPTURE_HEADER header;
+    ULONG headerRva;
+    ULONG compressBufferWorkSpaceSize;
+    ULONG compressFragmentWorkSpaceSize;
+    ULONGLONG userContext;
+
+    status = RtlGetCompressionWorkSpaceSize(
+        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD,
+        &compressBufferWorkSpaceSize,
+        &compressFragmentWorkSpaceSize
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    memset(&parameters, 0, sizeof(PH_FILE_POOL_PARAMETERS));
+    parameters.SegmentShift = PH_CAPTURE_SEGMENT_SHIFT;
+    parameters.MaximumInactiveViews = 2; // frames are only ever appended
+
+    status = PhCreateFilePool2(
+        &pool,
+        FileName,
+        FALSE,
+        FILE_SHARE_READ,
+        FILE_OVERWRITE_IF,
+        &parameters
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    header = PhAllocateFilePool(pool, sizeof(PH_CAPTURE_HEADER), &headerRva);
+
+    if (!header)
+    {
+        PhDestroyFilePool(pool);
+        return STATUS_DISK_FULL;
+    }
+
+    header->Version = PH_CAPTURE_VERSION;
+    header->PointerSize = sizeof(PVOID);
+    header->Reserved = 0;
+    header->NumberOfFrames = 0;
+    header->FirstIndexRva = 0;
+    header->LastIndexRva = 0;
+    PhDereferenceFilePool(pool, header);
+
+    userContext = ((ULONGLONG)PH_CAPTURE_MAGIC << 32) | headerRva;
+    PhSetUserContextFilePool(pool, &userContext);
+
+    PhpCaptureWorkSpace = PhAllocate(compressBufferWorkSpaceSize);
+    PhpCapturePool = pool;
+    PhpCaptureHeaderRva = headerRva;
+    PhProviderCaptureActive = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Saves the per-processor times for the next frame.
+ *
+ * \param CpuInformation The per-processor times, as returned by the system.
+ * \param NumberOfProcessors The number of entries in \a CpuInformation.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+VOID PhCaptureProcessorInformation(
+    _In_ PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors
+    )
+{
+    if (!PhpCaptureCpuInformation)
+    {
+        PhpCaptureCpuInformation = PhAllocate(sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * NumberOfProcessors);
+        PhpCaptureNumberOfProcessors = NumberOfProcessors;
+    }
+
+    memcpy(PhpCaptureCpuInformation, CpuInformation, sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * PhpCaptureNumberOfProcessors);
+}
+
+static ULONG PhpGetProcessInformationSize(
+    _In_ PVOID Processes,
+    _In_ ULONG BufferSize
+    )
+{
+    PSYSTEM_PROCESS_INFORMATION process;
+    ULONG_PTR bufferEnd;
+    ULONG_PTR end;
+    ULONG_PTR processEnd;
+
+    bufferEnd = (ULONG_PTR)Processes + BufferSize;
+    end = (ULONG_PTR)Processes;
+    process = PH_FIRST_PROCESS(Processes);
+
+    do
+    {
+        processEnd = (ULONG_PTR)process->Threads + process->NumberOfThreads * sizeof(SYSTEM_THREAD_INFORMATION);
+
+        // The image name is stored after the threads.
+        if ((ULONG_PTR)process->ImageName.Buffer >= (ULONG_PTR)Processes &&
+            (ULONG_PTR)process->ImageName.Buffer + process->ImageName.MaximumLength <= bufferEnd &&
+            processEnd < (ULONG_PTR)process->ImageName.Buffer + process->ImageName.MaximumLength)
+        {
+            processEnd = (ULONG_PTR)process->ImageName.Buffer + process->ImageName.MaximumLength;
+        }
+
+        if (end < processEnd)
+            end = processEnd;
+    } while (process = PH_NEXT_PROCESS(process));
+
+    if (end > bufferEnd)
+        end = bufferEnd;
+
+    return (ULONG)(end - (ULONG_PTR)Processes);
+}
+
+static BOOLEAN PhpAddCaptureIndexEntry(
+    _In_ PLARGE_INTEGER Time,
+    _In_ ULONG FrameRva
+    )
+{
+    PPH_CAPTURE_HEADER header;
+    PPH_CAPTURE_INDEX index;
+    PPH_CAPTURE_INDEX newIndex;
+    ULONG newIndexRva;
+
+    if (!(header = PhReferenceFilePoolByRva(PhpCapturePool, PhpCaptureHeaderRva)))
+        return FALSE;
+
+    index = header->LastIndexRva ? PhReferenceFilePoolByRva(PhpCapturePool, header->LastIndexRva) : NULL;
+
+    if (!index || index->Count == PH_CAPTURE_INDEX_ENTRIES)
+    {
+        if (!(newIndex = PhAllocateFilePool(PhpCapturePool, sizeof(PH_CAPTURE_INDEX), &newIndexRva)))
+        {
+            if (index)
+                PhDereferenceFilePool(PhpCapturePool, index);
+
+            PhDereferenceFilePool(PhpCapturePool, header);
+
+            return FALSE;
+        }
+
+        newIndex->NextRva = 0;
+        newIndex->Count = 0;
+
+        if (index)
+        {
+            index->NextRva = newIndexRva;
+            PhDereferenceFilePool(PhpCapturePool, index);
+        }
+        else
+        {
+            header->FirstIndexRva = newIndexRva;
+        }
+
+        header->LastIndexRva = newIndexRva;
+        index = newIndex;
+    }
+
+    index->Entries[index->Count].Time = *Time;
+    index->Entries[index->Count].Rva = FrameRva;
+    index->Entries[index->Count].Reserved = 0;
+    index->Count++;
+
+    // The frame only becomes visible to readers once it is counted.
+    header->NumberOfFrames++;
+
+    PhDereferenceFilePool(PhpCapturePool, index);
+    PhDereferenceFilePool(PhpCapturePool, header);
+
+    return TRUE;
+}
+
+/**
+ * Appends a frame to the capture file.
+ *
+ * \param PerfInformation The system performance information for this update.
+ * \param Processes The process buffer for this update, before it has been modified.
+ * \param BufferSize The size of the allocation containing \a Processes.
+ *
+ * \remarks This function must only be called by the process provider, after
+ * PhCaptureProcessorInformation.
+ */
+VOID PhWriteProviderCaptureFrame(
+    _In_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _In_ PVOID Processes,
+    _In_ ULONG BufferSize
+    )
+{
+    NTSTATUS status;
+    LARGE_INTEGER time;
+    ULONG processesSize;
+    ULONG compressedSize;
+    USHORT compressionFormat;
+    PVOID data;
+    ULONG dataSize;
+    ULONG cpuInformationSize;
+    PPH_CAPTURE_FRAME_HEADER frame;
+    ULONG frameRva;
+
+    if (!PhpCaptureCpuInformation)
+        return;
+
+    PhQuerySystemTime(&time);
+    processesSize = PhpGetProcessInformationSize(Processes, BufferSize);
+
+    // Incompressible data can grow slightly.
+    if (PhpCaptureBufferSize < processesSize + processesSize / 8 + 0x1000)
+    {
+        if (PhpCaptureBuffer)
+            PhFree(PhpCaptureBuffer);
+
+        PhpCaptureBufferSize = processesSize + processesSize / 4 + 0x1000;
+        PhpCaptureBuffer = PhAllocate(PhpCaptureBufferSize);
+    }
+
+    status = RtlCompressBuffer(
+        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD,
+        Processes,
+        processesSize,
+        PhpCaptureBuffer,
+        PhpCaptureBufferSize,
+        0x1000,
+        &compressedSize,
+        PhpCaptureWorkSpace
+        );
+
+    if (NT_SUCCESS(status) && compressedSize < processesSize)
+    {
+        compressionFormat = COMPRESSION_FORMAT_LZNT1;
+        data = PhpCaptureBuffer;
+        dataSize = compressedSize;
+    }
+    else
+    {
+        compressionFormat = COMPRESSION_FORMAT_NONE;
+        data = Processes;
+        dataSize = processesSize;
+    }
+
+    cpuInformationSize = sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * PhpCaptureNumberOfProcessors;
+    frame = PhAllocateFilePool(PhpCapturePool, sizeof(PH_CAPTURE_FRAME_HEADER) + cpuInformationSize + dataSize, &frameRva);
+
+    if (!frame)
+        return; // too large or the disk is full; the frame is dropped
+
+    frame->Time = time;
+    frame->PerfInformation = *PerfInformation;
+    frame->NumberOfProcessors = PhpCaptureNumberOfProcessors;
+    frame->CompressionFormat = compressionFormat;
+    frame->Reserved = 0;
+    frame->ProcessesBase = (ULONG64)(ULONG_PTR)Processes;
+    frame->ProcessesSize = processesSize;
+    frame->DataSize = dataSize;
+    memcpy(PTR_ADD_OFFSET(frame, sizeof(PH_CAPTURE_FRAME_HEADER)), PhpCaptureCpuInformation, cpuInformationSize);
+    memcpy(PTR_ADD_OFFSET(frame, sizeof(PH_CAPTURE_FRAME_HEADER) + cpuInformationSize), data, dataSize);
+    PhDereferenceFilePool(PhpCapturePool, frame);
+
+    if (!PhpAddCaptureIndexEntry(&time, frameRva))
+        PhFreeFilePoolByRva(PhpCapturePool, frameRva);
+}
+
+/**
+ * Opens a capture file. The process provider will read its information from the capture
+ * instead of the system.
+ *
+ * \param FileName The file name of the capture.
+ *
+ * \remarks This function must be called before the process provider starts.
+ */
+NTSTATUS PhOpenProviderReplay(
+    _In_ PWSTR FileName
+    )
+{
+    NTSTATUS status;
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+    PPH_CAPTURE_HEADER header;
+    PPH_CAPTURE_INDEX index;
+    ULONG indexRva;
+    ULONG numberOfFrames;
+    ULONG count;
+
+    status = PhCreateFilePool2(
+        &pool,
+        FileName,
+        TRUE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        FILE_OPEN,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    PhGetUserContextFilePool(pool, &userContext);
+
+    if ((ULONG)(userContext >> 32) != PH_CAPTURE_MAGIC ||
+        !(header = PhReferenceFilePoolByRva(pool, (ULONG)userContext)))
+    {
+        PhDestroyFilePool(pool);
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    if (header->Version != PH_CAPTURE_VERSION || header->PointerSize != sizeof(PVOID))
+    {
+        PhDereferenceFilePool(pool, header);
+        PhDestroyFilePool(pool);
+        return STATUS_REVISION_MISMATCH;
+    }
+
+    numberOfFrames = header->NumberOfFrames;
+    indexRva = header->FirstIndexRva;
+    PhDereferenceFilePool(pool, header);
+
+    PhpReplayIndex = PhAllocate(sizeof(PH_CAPTURE_INDEX_ENTRY) * max(numberOfFrames, 1));
+    count = 0;
+
+    while (count < numberOfFrames && indexRva && (index = PhReferenceFilePoolByRva(pool, indexRva)))
+    {
+        ULONG entries;
+
+        entries = min(index->Count, PH_CAPTURE_INDEX_ENTRIES);
+        entries = min(entries, numberOfFrames - count);
+        memcpy(&PhpReplayIndex[count], index->Entries, sizeof(PH_CAPTURE_INDEX_ENTRY) * entries);
+        count += entries;
+
+        indexRva = index->NextRva;
+        PhDereferenceFilePool(pool, index);
+    }
+
+    PhpCapturePool = pool;
+    PhpReplayCount = count;
+    PhProviderReplayActive = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Gets the number of frames in the capture being replayed.
+ */
+ULONG PhGetProviderReplayCount(
+    VOID
+    )
+{
+    return PhpReplayCount;
+}
+
+/**
+ * Gets the time at which a frame was captured.
+ *
+ * \param Index The index of the frame.
+ * \param Time A variable which receives the time.
+ */
+BOOLEAN PhGetProviderReplayTime(
+    _In_ ULONG Index,
+    _Out_ PLARGE_INTEGER Time
+    )
+{
+    if (Index >= PhpReplayCount)
+        return FALSE;
+
+    *Time = PhpReplayIndex[Index].Time;
+
+    return TRUE;
+}
+
+/**
+ * Gets the index of the frame shown by the process provider.
+ */
+ULONG PhGetProviderReplayPosition(
+    VOID
+    )
+{
+    ULONG position;
+
+    PhAcquireQueuedLockShared(&PhpReplayLock);
+    position = PhpReplayPosition;
+    PhReleaseQueuedLockShared(&PhpReplayLock);
+
+    return position;
+}
+
+/**
+ * Sets the frame that the process provider reads in its next update.
+ *
+ * \param Index The index of the frame.
+ *
+ * \remarks If the replay is paused, the frame is still shown once.
+ */
+VOID PhSeekProviderReplay(
+    _In_ ULONG Index
+    )
+{
+    if (PhpReplayCount == 0)
+        return;
+
+    if (Index >= PhpReplayCount)
+        Index = PhpReplayCount - 1;
+
+    PhAcquireQueuedLockExclusive(&PhpReplayLock);
+
+    // Counters go backwards when the replay does, so the provider has to start over.
+    if (Index < PhpReplayNextIndex)
+        PhpReplayDiscontinuity = TRUE;
+
+    PhpReplayNextIndex = Index;
+    PhpReplaySeekPending = TRUE;
+
+    PhReleaseQueuedLockExclusive(&PhpReplayLock);
+}
+
+BOOLEAN PhIsProviderReplayPaused(
+    VOID
+    )
+{
+    return PhpReplayPaused;
+}
+
+VOID PhSetProviderReplayPaused(
+    _In_ BOOLEAN Paused
+    )
+{
+    PhAcquireQueuedLockExclusive(&PhpReplayLock);
+    PhpReplayPaused = Paused;
+    PhReleaseQueuedLockExclusive(&PhpReplayLock);
+}
+
+/**
+ * Makes the process provider replay frames supplied by a function instead of a capture file.
+ *
+ * \param Source A function which supplies each frame. It has the same contract as
+ * PhReadProviderReplayFrame.
+ *
+ * \remarks This function must be called before the process provider starts. The replay
+ * controls don't apply to frames from a source.
+ */
+VOID PhSetProviderReplaySource(
+    _In_ PPH_REPLAY_FRAME_SOURCE Source
+    )
+{
+    PhpReplaySource = Source;
+    PhProviderReplayActive = TRUE;
+}
+
+static BOOLEAN PhpRebaseReplayProcesses(
+    _Inout_ PVOID Processes,
+    _In_ ULONG Size,
+    _In_ ULONG64 OriginalBase
+    )
+{
+    PSYSTEM_PROCESS_INFORMATION process;
+    ULONG offset;
+    ULONG64 nameOffset;
+
+    offset = 0;
+
+    while (TRUE)
+    {
+        process = PTR_ADD_OFFSET(Processes, offset);
+
+        if (Size - offset < FIELD_OFFSET(SYSTEM_PROCESS_INFORMATION, Threads) ||
+            process->NumberOfThreads > (Size - offset - FIELD_OFFSET(SYSTEM_PROCESS_INFORMATION, Threads)) / sizeof(SYSTEM_THREAD_INFORMATION))
+        {
+            return FALSE;
+        }
+
+        nameOffset = (ULONG64)(ULONG_PTR)process->ImageName.Buffer - OriginalBase;
+
+        if (process->ImageName.Buffer && nameOffset < Size &&
+            process->ImageName.MaximumLength <= Size - nameOffset &&
+            process->ImageName.Length <= process->ImageName.MaximumLength)
+        {
+            process->ImageName.Buffer = PTR_ADD_OFFSET(Processes, nameOffset);
+        }
+        else
+        {
+            process->ImageName.Buffer = NULL;
+            process->ImageName.Length = 0;
+            process->ImageName.MaximumLength = 0;
+        }
+
+        if (process->NextEntryOffset == 0)
+            return TRUE;
+        if (process->NextEntryOffset >= Size - offset)
+            return FALSE;
+
+        offset += process->NextEntryOffset;
+    }
+}
+
+static BOOLEAN PhpReadReplayFrame(
+    _In_ ULONG Index,
+    _Out_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _Out_writes_(NumberOfProcessors) PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors,
+    _Out_ PPH_REPLAY_FRAME Frame
+    )
+{
+    PPH_CAPTURE_FRAME_HEADER frame;
+    PVOID data;
+    PVOID processes;
+    ULONG processesSize;
+
+    if (!(frame = PhReferenceFilePoolByRva(PhpCapturePool, PhpReplayIndex[Index].Rva)))
+        return FALSE;
+
+    if (frame->NumberOfProcessors > PH_CAPTURE_MAXIMUM_PROCESSORS ||
+        frame->ProcessesSize < sizeof(SYSTEM_PROCESS_INFORMATION) ||
+        frame->ProcessesSize > PH_CAPTURE_MAXIMUM_PROCESSES_SIZE ||
+        frame->DataSize > PH_CAPTURE_MAXIMUM_PROCESSES_SIZE)
+    {
+        PhDereferenceFilePool(PhpCapturePool, frame);
+        return FALSE;
+    }
+
+    processes = PhAllocate(frame->ProcessesSize);
+    data = PTR_ADD_OFFSET(frame, sizeof(PH_CAPTURE_FRAME_HEADER) +
+        sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * frame->NumberOfProcessors);
+
+    if (frame->CompressionFormat == COMPRESSION_FORMAT_LZNT1)
+    {
+        if (!NT_SUCCESS(RtlDecompressBuffer(
+            COMPRESSION_FORMAT_LZNT1,
+            processes,
+            frame->ProcessesSize,
+            data,
+            frame->DataSize,
+            &processesSize
+            )))
+        {
+            processesSize = 0;
+        }
+    }
+    else
+    {
+        processesSize = min(frame->DataSize, frame->ProcessesSize);
+        memcpy(processes, data, processesSize);
+    }
+
+    if (processesSize == 0 || !PhpRebaseReplayProcesses(processes, processesSize, frame->ProcessesBase))
+    {
+        PhFree(processes);
+        PhDereferenceFilePool(PhpCapturePool, frame);
+        return FALSE;
+    }
+
+    *PerfInformation = frame->PerfInformation;
+
+    // The capture may have been made on a computer with a different number of processors.
+    memset(CpuInformation, 0, sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * NumberOfProcessors);
+    memcpy(
+        CpuInformation,
+        PTR_ADD_OFFSET(frame, sizeof(PH_CAPTURE_FRAME_HEADER)),
+        sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * min(frame->NumberOfProcessors, NumberOfProcessors)
+        );
+
+    Frame->Time = frame->Time;
+    Frame->Processes = processes;
+    Frame->ProcessesSize = processesSize;
+
+    PhDereferenceFilePool(PhpCapturePool, frame);
+
+    return TRUE;
+}
+
+/**
+ * Reads the next frame of the capture being replayed.
+ *
+ * \param PerfInformation A variable which receives the system performance information.
+ * \param CpuInformation A buffer which receives the per-processor times.
+ * \param NumberOfProcessors The number of entries in \a CpuInformation.
+ * \param Frame A variable which receives the rest of the frame.
+ *
+ * \return TRUE if a frame was read, or FALSE if the replay is paused or has reached the end
+ * of the capture.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+BOOLEAN PhReadProviderReplayFrame(
+    _Out_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _Out_writes_(NumberOfProcessors) PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors,
+    _Out_ PPH_REPLAY_FRAME Frame
+    )
+{
+    ULONG index;
+    BOOLEAN discontinuity;
+
+    if (PhpReplaySource)
+        return PhpReplaySource(PerfInformation, CpuInformation, NumberOfProcessors, Frame);
+
+    PhAcquireQueuedLockExclusive(&PhpReplayLock);
+
+    if ((PhpReplayPaused && !PhpReplaySeekPending) || PhpReplayNextIndex >= PhpReplayCount)
+    {
+        PhReleaseQueuedLockExclusive(&PhpReplayLock);
+        return FALSE;
+    }
+
+    index = PhpReplayNextIndex++;
+    PhpReplaySeekPending = FALSE;
+    discontinuity = PhpReplayDiscontinuity;
+    PhpReplayDiscontinuity = FALSE;
+
+    PhReleaseQueuedLockExclusive(&PhpReplayLock);
+
+    // Damaged frames are skipped.
+    if (!PhpReadReplayFrame(index, PerfInformation, CpuInformation, NumberOfProcessors, Frame))
+        return FALSE;
+
+    Frame->Discontinuity = discontinuity;
+
+    PhAcquireQueuedLockExclusive(&PhpReplayLock);
+    PhpReplayPosition = index;
+    PhReleaseQueuedLockExclusive(&PhpReplayLock);
+
+    return TRUE;
+}
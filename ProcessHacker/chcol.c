@@ -96,6 +96,42 @@ static ULONG IndexOfStringInList(
     return -1;
 }
 
+static VOID PhpUpdateColumnInfo(
+    _In_ HWND hwndDlg,
+    _In_ PCOLUMNS_DIALOG_CONTEXT Context,
+    _In_ HWND ListBoxHandle
+    )
+{
+    INT sel;
+    PPH_STRING string;
+    PPH_STRING info = NULL;
+    ULONG i;
+
+    sel = ListBox_GetCurSel(ListBoxHandle);
+
+    if (sel != -1 && (string = PhGetListBoxString(ListBoxHandle, sel)))
+    {
+        if (Context->Type == PH_CONTROL_TYPE_TREE_NEW)
+        {
+            for (i = 0; i < Context->Columns->Count; i++)
+            {
+                PPH_TREENEW_COLUMN column = Context->Columns->Items[i];
+
+                if (PhEqualString2(string, column->Text, FALSE))
+                {
+                    info = PhGetProcessTreeListColumnInfo(Context->ControlHandle, column->Id);
+                    break;
+                }
+            }
+        }
+
+        PhDereferenceObject(string);
+    }
+
+    SetDlgItemText(hwndDlg, IDC_COLUMNINFO, PhGetStringOrEmpty(info));
+    PhClearReference(&info);
+}
+
 INT_PTR CALLBACK PhpColumnsDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -279,6 +315,7 @@ INT_PTR CALLBACK PhpColumnsDlgProc(
                             INT sel = ListBox_GetCurSel(context->InactiveList);
 
                             EnableWindow(GetDlgItem(hwndDlg, IDC_SHOW), sel != -1);
+                            PhpUpdateColumnInfo(hwndDlg, context, context->InactiveList);
                         }
                         break;
                     }
@@ -301,6 +338,7 @@ INT_PTR CALLBACK PhpColumnsDlgProc(
                             EnableWindow(GetDlgItem(hwndDlg, IDC_HIDE), sel != -1 && count != 1);
                             EnableWindow(GetDlgItem(hwndDlg, IDC_MOVEUP), sel != 0 && sel != -1);
                             EnableWindow(GetDlgItem(hwndDlg, IDC_MOVEDOWN), sel != count - 1 && sel != -1);
+                            PhpUpdateColumnInfo(hwndDlg, context, context->ActiveList);
                         }
                         break;
                     }
@@ -54,6 +54,88 @@ BOOLEAN NTAPI PhpCommandModeOptionCallback(
     return TRUE;
 }
 
+NTSTATUS PhpCommandModeDumpProcesses(
+    VOID
+    )
+{
+    NTSTATUS status;
+    PVOID processes;
+    PSYSTEM_PROCESS_INFORMATION process;
+    PPH_LIST processIdList;
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+    SIZE_T i;
+
+    if (!PhStartupParameters.CommandValue)
+        return STATUS_INVALID_PARAMETER;
+
+    if (!NT_SUCCESS(status = PhEnumProcesses(&processes)))
+        return status;
+
+    processIdList = PhCreateList(8);
+    remainingPart = PhStartupParameters.CommandObject->sr;
+
+    // The object is a comma-separated list of process IDs and image names. An image name
+    // selects every process with that name.
+    while (remainingPart.Length != 0)
+    {
+        PhSplitStringRefAtChar(&remainingPart, ',', &part, &remainingPart);
+
+        if (part.Length == 0)
+            continue;
+
+        for (i = 0; i < part.Length / 2; i++)
+        {
+            if (!PhIsDigitCharacter(part.Buffer[i]))
+                break;
+        }
+
+        if (i == part.Length / 2)
+        {
+            ULONG64 processId64;
+
+            if (PhStringToInteger64(&part, 10, &processId64))
+                PhAddItemList(processIdList, (PVOID)processId64);
+        }
+        else
+        {
+            process = PH_FIRST_PROCESS(processes);
+
+            do
+            {
+                PH_STRINGREF imageName;
+
+                PhUnicodeStringToStringRef(&process->ImageName, &imageName);
+
+                if (PhEqualStringRef(&imageName, &part, TRUE))
+                    PhAddItemList(processIdList, process->UniqueProcessId);
+            } while (process = PH_NEXT_PROCESS(process));
+        }
+    }
+
+    PhFree(processes);
+
+    if (processIdList->Count != 0)
+    {
+        status = PhCreateDumpFilesProcesses(
+            (PHANDLE)processIdList->Items,
+            processIdList->Count,
+            &PhStartupParameters.CommandValue->sr,
+            PH_DUMP_BATCH_DEFAULT_CONCURRENCY,
+            PH_DUMP_BATCH_USE_SNAPSHOT | PH_DUMP_BATCH_COMPRESS,
+            NULL
+            );
+    }
+    else
+    {
+        status = STATUS_NOT_FOUND;
+    }
+
+    PhDereferenceObject(processIdList);
+
+    return status;
+}
+
 NTSTATUS PhCommandModeStart(
     VOID
     )
@@ -86,6 +168,9 @@ NTSTATUS PhCommandModeStart(
         if (!PhStartupParameters.CommandObject)
             return STATUS_INVALID_PARAMETER;
 
+        if (PhEqualString2(PhStartupParameters.CommandAction, L"dump", TRUE))
+            return PhpCommandModeDumpProcesses();
+
         processIdLength = PhStartupParameters.CommandObject->Length / 2;
 
         for (i = 0; i < processIdLength; i++)
@@ -277,6 +362,14 @@ NTSTATUS PhCommandModeStart(
             }
         }
     }
+    else if (PhEqualString2(PhStartupParameters.CommandType, L"monitor", TRUE))
+    {
+        return PhCommandModeMonitor();
+    }
+    else if (PhEqualString2(PhStartupParameters.CommandType, L"benchmark", TRUE))
+    {
+        return PhCommandModeBenchmark();
+    }
     else if (PhEqualString2(PhStartupParameters.CommandType, L"service", TRUE))
     {
         SC_HANDLE serviceHandle;
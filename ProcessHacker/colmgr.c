@@ -28,6 +28,7 @@
 typedef struct _PH_CM_SORT_CONTEXT
 {
     PPH_PLUGIN_TREENEW_SORT_FUNCTION SortFunction;
+    PPH_PLUGIN_TREENEW_SORT_KEY_FUNCTION SortKeyFunction;
     ULONG SubId;
     PVOID Context;
     PPH_CM_POST_SORT_FUNCTION PostSortFunction;
@@ -241,6 +242,7 @@ BOOLEAN PhCmForwardMessage(
     pluginMessage.Parameter1 = Parameter1;
     pluginMessage.Parameter2 = Parameter2;
 
+    PhPluginEnsureInitialized(plugin);
     PhInvokeCallback(PhGetPluginCallback(plugin, PluginCallbackTreeNewMessage), &pluginMessage);
 
     return TRUE;
@@ -262,6 +264,16 @@ static int __cdecl PhCmpSortFunction(
     return sortContext->PostSortFunction(result, node1, node2, sortContext->SortOrder);
 }
 
+static ULONG64 NTAPI PhCmpSortKeyFunction(
+    _In_ PPH_TREENEW_NODE Node,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_CM_SORT_CONTEXT sortContext = Context;
+
+    return sortContext->SortKeyFunction(Node, sortContext->SubId, sortContext->Context);
+}
+
 BOOLEAN PhCmForwardSort(
     _In_ PPH_TREENEW_NODE *Nodes,
     _In_ ULONG NumberOfNodes,
@@ -286,11 +298,16 @@ BOOLEAN PhCmForwardSort(
         return TRUE;
 
     sortContext.SortFunction = column->SortFunction;
+    sortContext.SortKeyFunction = column->SortKeyFunction;
     sortContext.SubId = column->SubId;
     sortContext.Context = column->Context;
     sortContext.PostSortFunction = Manager->PostSortFunction;
     sortContext.SortOrder = SortOrder;
-    qsort_s(Nodes, NumberOfNodes, sizeof(PVOID), PhCmpSortFunction, &sortContext);
+
+    if (sortContext.SortKeyFunction)
+        PhSortTreeNewNodesByKey(Nodes, NumberOfNodes, PhCmpSortKeyFunction, SortOrder, PhCmpSortFunction, &sortContext);
+    else
+        PhSortTreeNewNodesEx(Nodes, NumberOfNodes, PhCmpSortFunction, &sortContext);
 
     return TRUE;
 }
@@ -28,6 +28,7 @@
 
 #include <phapp.h>
 #include <phintrnl.h>
+#include <kphuser.h>
 #include <symprv.h>
 #include <refp.h>
 
@@ -49,7 +50,8 @@ NTSTATUS PhpDebugConsoleThreadStart(
     _In_ PVOID Parameter
     );
 
-extern PH_FREE_LIST PhObjectSmallFreeList;
+extern PH_FREE_LIST PhObjectSizeClassFreeLists[PH_OBJECT_SIZE_CLASS_COUNT];
+extern PPH_OBJECT_TYPE PhObjectTypeTable[PH_OBJECT_TYPE_TABLE_SIZE];
 
 static HANDLE DebugConsoleThreadHandle;
 static PPH_SYMBOL_PROVIDER DebugConsoleSymbolProvider;
@@ -263,6 +265,44 @@ static VOID PhpDumpObjectInfo(
     }
 }
 
+static VOID PhpPrintCallbackStatistics(
+    _In_ PWSTR Name,
+    _In_ PPH_CALLBACK Callback,
+    _In_ ULONG64 Frequency
+    )
+{
+    PLIST_ENTRY listEntry;
+
+    wprintf(L"%s\n", Name);
+
+    PhAcquireQueuedLockShared(&Callback->ListLock);
+
+    listEntry = Callback->ListHead.Flink;
+
+    while (listEntry != &Callback->ListHead)
+    {
+        PPH_CALLBACK_REGISTRATION registration;
+        ULONG64 averageTime = 0;
+
+        registration = CONTAINING_RECORD(listEntry, PH_CALLBACK_REGISTRATION, ListEntry);
+
+        if (registration->InvocationCount != 0)
+            averageTime = registration->TotalTime / registration->InvocationCount;
+
+        wprintf(L"\t%s%s\n", PhpGetSymbolForAddress(registration->Function),
+            (registration->Flags & PH_CALLBACK_ASYNCHRONOUS) ? L" (async)" : L"");
+        wprintf(L"\t\tCalls: %u (%u coalesced)\n", registration->InvocationCount, registration->CoalescedCount);
+        wprintf(L"\t\tTime (us): total %I64u, mean %I64u, max %I64u\n",
+            registration->TotalTime * 1000000 / Frequency,
+            averageTime * 1000000 / Frequency,
+            registration->MaximumTime * 1000000 / Frequency);
+
+        listEntry = listEntry->Flink;
+    }
+
+    PhReleaseQueuedLockShared(&Callback->ListLock);
+}
+
 static VOID PhpPrintHashtableStatistics(
     _In_ PPH_HASHTABLE Hashtable
     )
@@ -400,6 +440,44 @@ static int __cdecl PhpStringEntryCompareByCount(
     return uintptrcmp(entry2->Count, entry1->Count);
 }
 
+#ifdef PH_LOCK_PROFILING
+static int __cdecl PhpLockSiteCompareByWaitTime(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_LOCK_SITE site1 = *(PPH_LOCK_SITE *)elem1;
+    PPH_LOCK_SITE site2 = *(PPH_LOCK_SITE *)elem2;
+
+    return int64cmp(site2->WaitTime, site1->WaitTime);
+}
+#endif
+
+#ifdef PH_ALLOCATION_PROFILING
+static int __cdecl PhpAllocationSiteCompareByCount(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_ALLOCATION_SITE site1 = (PPH_ALLOCATION_SITE)elem1;
+    PPH_ALLOCATION_SITE site2 = (PPH_ALLOCATION_SITE)elem2;
+
+    return uint64cmp(site2->Count, site1->Count);
+}
+
+static PWSTR PhpGetAllocationSiteTypeName(
+    _In_ USHORT TypeIndex
+    )
+{
+    if (TypeIndex == PH_ALLOCATION_SITE_NO_TYPE)
+        return L"(heap)";
+    if (TypeIndex < PH_OBJECT_TYPE_TABLE_SIZE && PhObjectTypeTable[TypeIndex])
+        return PhObjectTypeTable[TypeIndex]->Name;
+
+    return L"(unknown)";
+}
+#endif
+
 static NTSTATUS PhpLeakEnumerationRoutine(
     _In_ LONG Reserved,
     _In_ PVOID HeapHandle,
@@ -739,13 +817,19 @@ NTSTATUS PhpDebugConsoleThreadStart(
                 L"dumpautopool\n"
                 L"threads\n"
                 L"provthreads\n"
+                L"callbacks\n"
+                L"locks\n"
                 L"workqueues\n"
                 L"procrecords\n"
                 L"procitem\n"
+                L"indexes\n"
                 L"uniquestr\n"
                 L"enableleakdetect\n"
                 L"leakdetect\n"
                 L"mem\n"
+                L"startup\n"
+                L"kphstats\n"
+                L"allocs [seconds]\n"
                 );
         }
         else if (PhEqualStringZ(command, L"exit", TRUE))
@@ -881,7 +965,14 @@ NTSTATUS PhpDebugConsoleThreadStart(
         else if (PhEqualStringZ(command, L"stats", TRUE))
         {
 #ifdef DEBUG
-            wprintf(L"Object small free list count: %u\n", PhObjectSmallFreeList.Count);
+            ULONG i;
+
+            for (i = 0; i < PH_OBJECT_SIZE_CLASS_COUNT; i++)
+            {
+                wprintf(L"Object size class %u free list count: %u (%Iu bytes)\n",
+                    i, PhObjectSizeClassFreeLists[i].Count, PhObjectSizeClassFreeLists[i].Size);
+            }
+
             wprintf(L"Statistics:\n");
 #define PRINT_STATISTIC(Name) wprintf(L#Name L": %u\n", PhLibStatisticsBlock.Name);
 
@@ -893,8 +984,10 @@ NTSTATUS PhpDebugConsoleThreadStart(
             PRINT_STATISTIC(RefObjectsDestroyed);
             PRINT_STATISTIC(RefObjectsAllocated);
             PRINT_STATISTIC(RefObjectsFreed);
-            PRINT_STATISTIC(RefObjectsAllocatedFromSmallFreeList);
-            PRINT_STATISTIC(RefObjectsFreedToSmallFreeList);
+            PRINT_STATISTIC(RefObjectsAllocatedFromSizeClassFreeList);
+            PRINT_STATISTIC(RefObjectsFreedToSizeClassFreeList);
+            PRINT_STATISTIC(RefObjectsAllocatedFromThreadCache);
+            PRINT_STATISTIC(RefObjectsFreedToThreadCache);
             PRINT_STATISTIC(RefObjectsAllocatedFromTypeFreeList);
             PRINT_STATISTIC(RefObjectsFreedToTypeFreeList);
             PRINT_STATISTIC(RefObjectsDeleteDeferred);
@@ -1263,6 +1356,7 @@ NTSTATUS PhpDebugConsoleThreadStart(
                     PPH_PROVIDER_THREAD providerThread = PhDbgProviderList->Items[i];
                     THREAD_BASIC_INFORMATION basicInfo;
                     PLIST_ENTRY providerEntry;
+                    PH_PROVIDER_STATISTICS statistics;
 
                     if (providerThread->ThreadHandle)
                     {
@@ -1274,6 +1368,8 @@ NTSTATUS PhpDebugConsoleThreadStart(
                         wprintf(L"Thread not running\n");
                     }
 
+                    wprintf(L"\tInterval: %ums (%u overruns)\n", providerThread->Interval, providerThread->OverrunCount);
+
                     PhAcquireQueuedLockExclusive(&providerThread->Lock);
 
                     providerEntry = providerThread->ListHead.Flink;
@@ -1288,6 +1384,18 @@ NTSTATUS PhpDebugConsoleThreadStart(
                         wprintf(L"\t\tEnabled: %s\n", registration->Enabled ? L"Yes" : L"No");
                         wprintf(L"\t\tFunction: %s\n", PhpGetSymbolForAddress(registration->Function));
 
+                        PhGetStatisticsProvider(registration, &statistics);
+                        wprintf(L"\t\tRuns: %u (%u overruns, %u skipped)\n", statistics.RunCount, statistics.OverrunCount, statistics.SkipCount);
+
+                        if (registration->TargetInterval != 0 || registration->Budget != 0 || registration->ScheduleFlags != 0)
+                        {
+                            wprintf(L"\t\tSchedule: target %ums, budget %uus, %u consumers%s\n",
+                                registration->TargetInterval, registration->Budget, registration->ConsumerCount,
+                                (registration->ScheduleFlags & PH_PROVIDER_TRACK_CONSUMERS) ? L" (tracked)" : L"");
+                        }
+                        wprintf(L"\t\tRun time (us): last %I64u, mean %I64u, p99 %I64u, max %I64u\n",
+                            statistics.LastRunTime, statistics.AverageRunTime, statistics.Percentile99RunTime, statistics.MaximumRunTime);
+
                         if (registration->Object)
                         {
                             wprintf(L"\t\tObject:\n");
@@ -1320,6 +1428,7 @@ NTSTATUS PhpDebugConsoleThreadStart(
                 for (i = 0; i < PhDbgWorkQueueList->Count; i++)
                 {
                     PPH_WORK_QUEUE workQueue = PhDbgWorkQueueList->Items[i];
+                    PH_WORK_QUEUE_STATISTICS statistics;
                     PLIST_ENTRY workQueueItemEntry;
 
                     wprintf(L"Work queue at %s\n", PhpGetSymbolForAddress(workQueue));
@@ -1330,6 +1439,13 @@ NTSTATUS PhpDebugConsoleThreadStart(
                     wprintf(L"Current threads: %u\n", workQueue->CurrentThreads);
                     wprintf(L"Busy count: %u\n", workQueue->BusyCount);
 
+                    PhGetStatisticsWorkQueue(workQueue, &statistics);
+                    wprintf(L"Lock-free: %s\n", (workQueue->Flags & PH_WORK_QUEUE_LOCK_FREE) ? L"Yes" : L"No");
+                    wprintf(L"Depth: %u (max. %u)\n", statistics.Depth, statistics.MaximumDepth);
+                    wprintf(L"Items queued: %u, dequeued: %u\n", statistics.NumberOfItemsQueued, statistics.NumberOfItemsDequeued);
+                    wprintf(L"Enqueue cycles: %I64u (avg.)\n", statistics.AverageEnqueueCycles);
+                    wprintf(L"Wait cycles: %I64u (avg.), %I64u (max.)\n", statistics.AverageWaitCycles, statistics.MaximumWaitCycles);
+
                     PhAcquireQueuedLockExclusive(&workQueue->QueueLock);
 
                     // List the items backwards.
@@ -1357,6 +1473,73 @@ NTSTATUS PhpDebugConsoleThreadStart(
             }
 #else
             wprintf(commandDebugOnly);
+#endif
+        }
+        else if (PhEqualStringZ(command, L"callbacks", TRUE))
+        {
+            LARGE_INTEGER performanceCounter;
+            LARGE_INTEGER performanceFrequency;
+
+            NtQueryPerformanceCounter(&performanceCounter, &performanceFrequency);
+
+            PhpPrintCallbackStatistics(L"ProcessAdded", &PhProcessAddedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ProcessModified", &PhProcessModifiedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ProcessRemoved", &PhProcessRemovedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ProcessesUpdated", &PhProcessesUpdatedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ServiceAdded", &PhServiceAddedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ServiceModified", &PhServiceModifiedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ServiceRemoved", &PhServiceRemovedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"ServicesUpdated", &PhServicesUpdatedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"NetworkItemAdded", &PhNetworkItemAddedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"NetworkItemModified", &PhNetworkItemModifiedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"NetworkItemRemoved", &PhNetworkItemRemovedEvent, performanceFrequency.QuadPart);
+            PhpPrintCallbackStatistics(L"NetworkItemsUpdated", &PhNetworkItemsUpdatedEvent, performanceFrequency.QuadPart);
+        }
+        else if (PhEqualStringZ(command, L"locks", TRUE))
+        {
+#ifdef PH_LOCK_PROFILING
+            LARGE_INTEGER performanceCounter;
+            LARGE_INTEGER performanceFrequency;
+            PPH_LIST list;
+            PPH_LOCK_SITE site;
+            ULONG i;
+
+            NtQueryPerformanceCounter(&performanceCounter, &performanceFrequency);
+
+            list = PhCreateList(64);
+
+            for (site = PhLockSiteListHead; site; site = site->Next)
+                PhAddItemList(list, site);
+
+            qsort(list->Items, list->Count, sizeof(PPH_LOCK_SITE), PhpLockSiteCompareByWaitTime);
+
+            wprintf(L"Acquired\tContended\tRate\tWait (us)\tMax (us)\tSite\n");
+
+            for (i = 0; i < list->Count; i++)
+            {
+                site = list->Items[i];
+
+                if (site->Contentions == 0 && i >= 40)
+                    break;
+
+                wprintf(L"%I64u\t%I64u\t%.2f%%\t%I64u\t%I64u\t%S:%u (%s %s)\n",
+                    site->Acquisitions,
+                    site->Contentions,
+                    site->Acquisitions != 0 ? (DOUBLE)site->Contentions * 100 / site->Acquisitions : 0.0,
+                    site->WaitTime * 1000000 / performanceFrequency.QuadPart,
+                    site->MaximumWaitTime * 1000000 / performanceFrequency.QuadPart,
+                    site->FileName,
+                    site->Line,
+                    site->FastLock ? L"fast" : L"queued",
+                    site->Exclusive ? L"exclusive" : L"shared"
+                    );
+            }
+
+            wprintf(L"\nTotal lock sites: %u\n", list->Count);
+
+            PhDereferenceObject(list);
+#else
+            wprintf(L"Lock profiling is not enabled in this build. Define PH_LOCK_PROFILING.\n");
 #endif
         }
         else if (PhEqualStringZ(command, L"procrecords", TRUE))
@@ -1449,6 +1632,34 @@ NTSTATUS PhpDebugConsoleThreadStart(
 
             PhDereferenceObjects(processes, numberOfProcesses);
         }
+        else if (PhEqualStringZ(command, L"indexes", TRUE))
+        {
+            PH_HANDLE_INDEX index;
+#ifdef DEBUG
+            ULONG averageProbeLength;
+#endif
+
+            PhAcquireQueuedLockShared(&PhProcessHashSetLock);
+            index = PhProcessIndex;
+            PhReleaseQueuedLockShared(&PhProcessHashSetLock);
+
+#ifdef DEBUG
+            averageProbeLength = PhGetAverageProbeLengthHandleIndex(&index);
+            wprintf(L"Process items: %u entries, %u slots, %I64u lookups, average probe length %u.%02u\n",
+                index.Count, index.Capacity, index.NumberOfLookups, averageProbeLength / 100, averageProbeLength % 100);
+#else
+            wprintf(L"Process items: %u entries, %u slots\n", index.Count, index.Capacity);
+#endif
+
+            index = PhProcessNodeIndex;
+#ifdef DEBUG
+            averageProbeLength = PhGetAverageProbeLengthHandleIndex(&index);
+            wprintf(L"Process nodes: %u entries, %u slots, %I64u lookups, average probe length %u.%02u\n",
+                index.Count, index.Capacity, index.NumberOfLookups, averageProbeLength / 100, averageProbeLength % 100);
+#else
+            wprintf(L"Process nodes: %u entries, %u slots\n", index.Count, index.Capacity);
+#endif
+        }
         else if (PhEqualStringZ(command, L"uniquestr", TRUE))
         {
 #ifdef DEBUG
@@ -1671,6 +1882,166 @@ PrintMemUsage:
             wprintf(L"Usage: mem address [numberOfBytes]\n");
             wprintf(L"Example: mem 12345678 16\n");
         }
+        else if (PhEqualStringZ(command, L"startup", TRUE))
+        {
+            LARGE_INTEGER counter;
+            LARGE_INTEGER frequency;
+            ULONG count;
+            ULONG i;
+
+            NtQueryPerformanceCounter(&counter, &frequency);
+            count = min((ULONG)PhNumberOfStartupPhases, PH_STARTUP_PHASE_MAXIMUM);
+
+            wprintf(L"%-24s %10s %10s %8s\n", L"Phase", L"Start (ms)", L"Time (ms)", L"Thread");
+
+            for (i = 0; i < count; i++)
+            {
+                PPH_STARTUP_PHASE phase = &PhStartupPhases[i];
+
+                wprintf(L"%-24s %10.2f ", phase->Name,
+                    (DOUBLE)(phase->StartCounter.QuadPart - PhStartupCounter.QuadPart) * 1000 / frequency.QuadPart);
+
+                if (phase->EndCounter.QuadPart != 0)
+                    wprintf(L"%10.2f ", (DOUBLE)(phase->EndCounter.QuadPart - phase->StartCounter.QuadPart) * 1000 / frequency.QuadPart);
+                else
+                    wprintf(L"%10s ", L"-");
+
+                wprintf(L"%8Iu\n", (ULONG_PTR)phase->ThreadId);
+            }
+        }
+        else if (PhEqualStringZ(command, L"kphstats", TRUE))
+        {
+            NTSTATUS status;
+            PKPH_CONTROL_STATISTICS statistics;
+            ULONG i;
+
+            if (!KphIsConnected())
+            {
+                wprintf(L"KProcessHacker is not connected.\n");
+                goto EndCommand;
+            }
+
+            if (!NT_SUCCESS(status = KphQueryControlStatistics2(&statistics)))
+            {
+                wprintf(L"Unable to query statistics: 0x%x\n", status);
+                goto EndCommand;
+            }
+
+            wprintf(L"%-8s %12s %12s %12s %12s\n", L"Function", L"Calls", L"Total (ms)", L"Average (us)", L"Max (us)");
+
+            for (i = 0; i < statistics->NumberOfEntries; i++)
+            {
+                PKPH_CONTROL_STATISTICS_ENTRY entry = &statistics->Entries[i];
+
+                wprintf(
+                    L"%-8u %12I64u %12.2f %12.2f %12.2f\n",
+                    ((entry->ControlCode >> 2) & 0xfff) - 0x800,
+                    entry->Calls,
+                    (DOUBLE)entry->TotalTime * 1000 / statistics->Frequency.QuadPart,
+                    (DOUBLE)entry->TotalTime * 1000000 / statistics->Frequency.QuadPart / entry->Calls,
+                    (DOUBLE)entry->MaximumTime * 1000000 / statistics->Frequency.QuadPart
+                    );
+            }
+
+            PhFree(statistics);
+        }
+        else if (PhEqualStringZ(command, L"allocs", TRUE))
+        {
+#ifdef PH_ALLOCATION_PROFILING
+            PWSTR secondsString = wcstok_s(NULL, delims, &context);
+            PH_STRINGREF secondsStringRef;
+            ULONG64 seconds = 1;
+            PPH_ALLOCATION_SITE oldSites;
+            PPH_ALLOCATION_SITE sites;
+            ULONG numberOfOldSites;
+            ULONG numberOfSites;
+            ULONG64 typeCounts[PH_OBJECT_TYPE_TABLE_SIZE + 1] = { 0 };
+            ULONG64 typeBytes[PH_OBJECT_TYPE_TABLE_SIZE + 1] = { 0 };
+            ULONG i;
+            ULONG j;
+
+            if (secondsString)
+            {
+                PhInitializeStringRef(&secondsStringRef, secondsString);
+
+                if (!PhStringToInteger64(&secondsStringRef, 10, &seconds) || seconds == 0 || seconds > 60)
+                {
+                    wprintf(L"Usage: allocs [seconds]\nThe interval must be between 1 and 60 seconds.\n");
+                    goto EndCommand;
+                }
+            }
+
+            oldSites = PhAllocate(sizeof(PH_ALLOCATION_SITE) * (PH_ALLOCATION_SITE_COUNT + 1));
+            sites = PhAllocate(sizeof(PH_ALLOCATION_SITE) * (PH_ALLOCATION_SITE_COUNT + 1));
+
+            numberOfOldSites = PhGetAllocationSites(oldSites, PH_ALLOCATION_SITE_COUNT + 1);
+            Sleep((ULONG)seconds * 1000);
+            numberOfSites = PhGetAllocationSites(sites, PH_ALLOCATION_SITE_COUNT + 1);
+
+            // Sites keep their order and are never removed, so the old sites can be matched with
+            // the new ones in a single pass.
+            for (i = 0, j = 0; i < numberOfSites; i++)
+            {
+                if (
+                    j < numberOfOldSites &&
+                    oldSites[j].CallerAddress == sites[i].CallerAddress &&
+                    oldSites[j].TypeIndex == sites[i].TypeIndex
+                    )
+                {
+                    sites[i].Count -= oldSites[j].Count;
+                    sites[i].Bytes -= oldSites[j].Bytes;
+                    j++;
+                }
+
+                if (sites[i].TypeIndex < PH_OBJECT_TYPE_TABLE_SIZE)
+                {
+                    typeCounts[sites[i].TypeIndex] += sites[i].Count;
+                    typeBytes[sites[i].TypeIndex] += sites[i].Bytes;
+                }
+                else
+                {
+                    typeCounts[PH_OBJECT_TYPE_TABLE_SIZE] += sites[i].Count;
+                    typeBytes[PH_OBJECT_TYPE_TABLE_SIZE] += sites[i].Bytes;
+                }
+            }
+
+            qsort(sites, numberOfSites, sizeof(PH_ALLOCATION_SITE), PhpAllocationSiteCompareByCount);
+
+            wprintf(L"%-24s %12s %12s\n", L"Type", L"Count/s", L"Bytes/s");
+
+            for (i = 0; i <= PH_OBJECT_TYPE_TABLE_SIZE; i++)
+            {
+                if (typeCounts[i] == 0)
+                    continue;
+
+                wprintf(L"%-24s %12I64u %12I64u\n",
+                    PhpGetAllocationSiteTypeName(i < PH_OBJECT_TYPE_TABLE_SIZE ? (USHORT)i : PH_ALLOCATION_SITE_NO_TYPE),
+                    typeCounts[i] / seconds,
+                    typeBytes[i] / seconds
+                    );
+            }
+
+            wprintf(L"\n%12s %12s %-24s %s\n", L"Count/s", L"Bytes/s", L"Type", L"Site");
+
+            for (i = 0; i < numberOfSites && i < 40; i++)
+            {
+                if (sites[i].Count == 0)
+                    break;
+
+                wprintf(L"%12I64u %12I64u %-24s %s\n",
+                    sites[i].Count / seconds,
+                    sites[i].Bytes / seconds,
+                    PhpGetAllocationSiteTypeName(sites[i].TypeIndex),
+                    sites[i].CallerAddress ? PhpGetSymbolForAddress(sites[i].CallerAddress) : L"(other sites)"
+                    );
+            }
+
+            PhFree(sites);
+            PhFree(oldSites);
+#else
+            wprintf(L"Allocation profiling is not enabled in this build. Define PH_ALLOCATION_PROFILING.\n");
+#endif
+        }
         else
         {
             wprintf(L"Unrecognized command.\n");
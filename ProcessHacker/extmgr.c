@@ -45,6 +45,8 @@ VOID PhEmInitialization(
     for (i = 0; i < EmMaximumObjectType; i++)
     {
         InitializeListHead(&PhEmObjectTypeState[i].ExtensionListHead);
+        InitializeListHead(&PhEmObjectTypeState[i].ColumnListHead);
+        PhInitializeQueuedLock(&PhEmObjectTypeState[i].SlotLock);
     }
 }
 
@@ -61,6 +63,7 @@ VOID PhEmInitializeAppContext(
 {
     AppContext->AppName = *AppName;
     memset(AppContext->Extensions, 0, sizeof(AppContext->Extensions));
+    memset(AppContext->BulkCallbacks, 0, sizeof(AppContext->BulkCallbacks));
 
     InsertTailList(&PhEmAppContextListHead, &AppContext->ListEntry);
     PhEmAppContextCount++;
@@ -145,6 +148,92 @@ SIZE_T PhEmGetObjectSize(
     return InitialSize + PhEmObjectTypeState[ObjectType].ExtensionOffset;
 }
 
+static VOID PhpEmAllocateObjectSlot(
+    _Inout_ PPH_EM_OBJECT_TYPE_STATE ObjectTypeState,
+    _In_ PVOID Object
+    )
+{
+    PULONG slotPointer;
+    ULONG slot;
+    PLIST_ENTRY listEntry;
+
+    slotPointer = (PULONG)((PCHAR)Object + ObjectTypeState->InitialSize + ObjectTypeState->SlotOffset);
+
+    PhAcquireQueuedLockExclusive(&ObjectTypeState->SlotLock);
+
+    if (ObjectTypeState->FreeSlots && ObjectTypeState->FreeSlots->Count != 0)
+    {
+        slot = PtrToUlong(ObjectTypeState->FreeSlots->Items[ObjectTypeState->FreeSlots->Count - 1]);
+        ObjectTypeState->FreeSlots->Count--;
+    }
+    else if (ObjectTypeState->NumberOfSlots < PH_EM_MAXIMUM_SLOTS)
+    {
+        slot = ObjectTypeState->NumberOfSlots++;
+
+        if (slot == ObjectTypeState->AllocatedSlots)
+        {
+            ObjectTypeState->AllocatedSlots += PH_EM_COLUMN_CHUNK_SLOTS;
+
+            if (ObjectTypeState->SlotObjects)
+                ObjectTypeState->SlotObjects = PhReAllocate(ObjectTypeState->SlotObjects, ObjectTypeState->AllocatedSlots * sizeof(PVOID));
+            else
+                ObjectTypeState->SlotObjects = PhAllocate(ObjectTypeState->AllocatedSlots * sizeof(PVOID));
+
+            // Add a chunk to every column. Existing chunks never move.
+            for (listEntry = ObjectTypeState->ColumnListHead.Flink; listEntry != &ObjectTypeState->ColumnListHead; listEntry = listEntry->Flink)
+            {
+                PPH_EM_OBJECT_COLUMN column = CONTAINING_RECORD(listEntry, PH_EM_OBJECT_COLUMN, ListEntry);
+
+                column->Chunks[slot / PH_EM_COLUMN_CHUNK_SLOTS] = PhAllocate(column->ElementSize * PH_EM_COLUMN_CHUNK_SLOTS);
+            }
+        }
+    }
+    else
+    {
+        slot = PH_EM_INVALID_SLOT;
+    }
+
+    if (slot != PH_EM_INVALID_SLOT)
+    {
+        ObjectTypeState->SlotObjects[slot] = Object;
+
+        for (listEntry = ObjectTypeState->ColumnListHead.Flink; listEntry != &ObjectTypeState->ColumnListHead; listEntry = listEntry->Flink)
+        {
+            PPH_EM_OBJECT_COLUMN column = CONTAINING_RECORD(listEntry, PH_EM_OBJECT_COLUMN, ListEntry);
+
+            memset(PhEmGetObjectColumnElement(column, slot), 0, column->ElementSize);
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&ObjectTypeState->SlotLock);
+
+    *slotPointer = slot;
+}
+
+static VOID PhpEmFreeObjectSlot(
+    _Inout_ PPH_EM_OBJECT_TYPE_STATE ObjectTypeState,
+    _In_ PVOID Object
+    )
+{
+    ULONG slot;
+
+    slot = *(PULONG)((PCHAR)Object + ObjectTypeState->InitialSize + ObjectTypeState->SlotOffset);
+
+    if (slot == PH_EM_INVALID_SLOT)
+        return;
+
+    PhAcquireQueuedLockExclusive(&ObjectTypeState->SlotLock);
+
+    ObjectTypeState->SlotObjects[slot] = NULL;
+
+    if (!ObjectTypeState->FreeSlots)
+        ObjectTypeState->FreeSlots = PhCreateList(PH_EM_COLUMN_CHUNK_SLOTS);
+
+    PhAddItemList(ObjectTypeState->FreeSlots, UlongToPtr(slot));
+
+    PhReleaseQueuedLockExclusive(&ObjectTypeState->SlotLock);
+}
+
 /**
  * Invokes callbacks for an object operation.
  *
@@ -167,6 +256,11 @@ VOID PhEmCallObjectOperation(
 
     objectTypeState = &PhEmObjectTypeState[ObjectType];
 
+    // The slot is assigned before the create callbacks and released after the delete callbacks,
+    // so both can use the object's column elements.
+    if (objectTypeState->SlotsEnabled && Operation == EmObjectCreate)
+        PhpEmAllocateObjectSlot(objectTypeState, Object);
+
     listEntry = objectTypeState->ExtensionListHead.Flink;
 
     while (listEntry != &objectTypeState->ExtensionListHead)
@@ -184,6 +278,163 @@ VOID PhEmCallObjectOperation(
 
         listEntry = listEntry->Flink;
     }
+
+    if (objectTypeState->SlotsEnabled && Operation == EmObjectDelete)
+        PhpEmFreeObjectSlot(objectTypeState, Object);
+}
+
+/**
+ * Adds a column to the columnar extension store of an object type.
+ *
+ * \param AppContext The application context.
+ * \param ObjectType The object type.
+ * \param ElementSize The size of each element, in bytes.
+ *
+ * \return The column. Elements are zeroed when an object is created.
+ *
+ * \remarks Unlike object extensions, column elements of all objects are kept together, so a bulk
+ * update callback can process one field of every object without touching the objects
+ * themselves. This function must be called before any objects of the type are created.
+ */
+PPH_EM_OBJECT_COLUMN PhEmAddObjectColumn(
+    _Inout_ PPH_EM_APP_CONTEXT AppContext,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ ULONG ElementSize
+    )
+{
+    PPH_EM_OBJECT_TYPE_STATE objectTypeState;
+    PPH_EM_OBJECT_COLUMN column;
+
+    objectTypeState = &PhEmObjectTypeState[ObjectType];
+
+    if (!objectTypeState->SlotsEnabled)
+    {
+        // Reserve room in each object for its slot.
+        objectTypeState->SlotOffset = objectTypeState->ExtensionOffset;
+        objectTypeState->ExtensionOffset += sizeof(ULONG_PTR);
+        objectTypeState->SlotsEnabled = TRUE;
+    }
+
+    column = PhAllocate(sizeof(PH_EM_OBJECT_COLUMN));
+    memset(column, 0, sizeof(PH_EM_OBJECT_COLUMN));
+    column->ObjectType = ObjectType;
+    column->ElementSize = ElementSize;
+
+    PhAcquireQueuedLockExclusive(&objectTypeState->SlotLock);
+    InsertTailList(&objectTypeState->ColumnListHead, &column->ListEntry);
+    PhReleaseQueuedLockExclusive(&objectTypeState->SlotLock);
+
+    return column;
+}
+
+/**
+ * Gets the slot of an object in the columnar extension store.
+ *
+ * \param ObjectType The object type.
+ * \param Object The object.
+ *
+ * \return The slot, or -1 if the object has no slot.
+ */
+ULONG PhEmGetObjectSlot(
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PVOID Object
+    )
+{
+    PPH_EM_OBJECT_TYPE_STATE objectTypeState;
+
+    objectTypeState = &PhEmObjectTypeState[ObjectType];
+
+    if (!objectTypeState->SlotsEnabled)
+        return PH_EM_INVALID_SLOT;
+
+    return *(PULONG)((PCHAR)Object + objectTypeState->InitialSize + objectTypeState->SlotOffset);
+}
+
+/**
+ * Gets a column element.
+ *
+ * \param Column The column.
+ * \param Slot The slot of the object.
+ *
+ * \return A pointer to the element, or NULL if the slot is invalid.
+ */
+PVOID PhEmGetObjectColumnElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ ULONG Slot
+    )
+{
+    PCHAR chunk;
+
+    if (Slot >= PH_EM_MAXIMUM_SLOTS)
+        return NULL;
+
+    chunk = Column->Chunks[Slot / PH_EM_COLUMN_CHUNK_SLOTS];
+
+    if (!chunk)
+        return NULL;
+
+    return chunk + (SIZE_T)Column->ElementSize * (Slot % PH_EM_COLUMN_CHUNK_SLOTS);
+}
+
+/**
+ * Sets the bulk update callback for an object type.
+ *
+ * \param AppContext The application context.
+ * \param ObjectType The object type.
+ * \param BulkCallback The callback, which receives every live object of the type each time the
+ * provider for the type completes an update.
+ */
+VOID PhEmSetObjectBulkCallback(
+    _Inout_ PPH_EM_APP_CONTEXT AppContext,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PPH_EM_OBJECT_BULK_CALLBACK BulkCallback
+    )
+{
+    AppContext->BulkCallbacks[ObjectType] = BulkCallback;
+    PhEmObjectTypeState[ObjectType].HasBulkCallbacks = TRUE;
+}
+
+/**
+ * Invokes bulk update callbacks for an object type.
+ *
+ * \param ObjectType The object type.
+ *
+ * \remarks No objects of the type are created or deleted while the callbacks are executing. The
+ * callbacks must not create or delete objects of the type themselves.
+ */
+VOID PhEmCallObjectBulkUpdate(
+    _In_ PH_EM_OBJECT_TYPE ObjectType
+    )
+{
+    PPH_EM_OBJECT_TYPE_STATE objectTypeState;
+    PLIST_ENTRY listEntry;
+
+    objectTypeState = &PhEmObjectTypeState[ObjectType];
+
+    if (!objectTypeState->HasBulkCallbacks || !objectTypeState->SlotsEnabled)
+        return;
+
+    PhAcquireQueuedLockShared(&objectTypeState->SlotLock);
+
+    listEntry = PhEmAppContextListHead.Flink;
+
+    while (listEntry != &PhEmAppContextListHead)
+    {
+        PPH_EM_APP_CONTEXT appContext = CONTAINING_RECORD(listEntry, PH_EM_APP_CONTEXT, ListEntry);
+
+        if (appContext->BulkCallbacks[ObjectType])
+        {
+            appContext->BulkCallbacks[ObjectType](
+                ObjectType,
+                objectTypeState->SlotObjects,
+                objectTypeState->NumberOfSlots
+                );
+        }
+
+        listEntry = listEntry->Flink;
+    }
+
+    PhReleaseQueuedLockShared(&objectTypeState->SlotLock);
 }
 
 /**
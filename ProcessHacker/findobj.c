@@ -25,7 +25,7 @@
 #include <kphuser.h>
 #include <settings.h>
 #include <procprpp.h>
-#include "pcre/pcre2.h"
+#include <regexsup.h>
 #include <windowsx.h>
 
 #define WM_PH_SEARCH_UPDATE (WM_APP + 801)
@@ -72,10 +72,10 @@ static RECT MinimumSize;
 static HANDLE SearchThreadHandle = NULL;
 static BOOLEAN SearchStop;
 static PPH_STRING SearchString;
-static pcre2_code *SearchRegexCompiledExpression;
-static pcre2_match_data *SearchRegexMatchData;
+static PPH_REGEX SearchRegex;
 static PPH_LIST SearchResults = NULL;
 static ULONG SearchResultsAddIndex;
+static ULONG SearchTimeouts;
 static PH_QUEUED_LOCK SearchResultsLock = PH_QUEUED_LOCK_INIT;
 
 static ULONG64 SearchPointer;
@@ -295,33 +295,16 @@ static INT_PTR CALLBACK PhpFindObjectsDlgProc(
 
                         PhMoveReference(&SearchString, PhGetWindowText(GetDlgItem(hwndDlg, IDC_FILTER)));
 
-                        if (SearchRegexCompiledExpression)
-                        {
-                            pcre2_code_free(SearchRegexCompiledExpression);
-                            SearchRegexCompiledExpression = NULL;
-                        }
-
-                        if (SearchRegexMatchData)
-                        {
-                            pcre2_match_data_free(SearchRegexMatchData);
-                            SearchRegexMatchData = NULL;
-                        }
+                        PhClearReference(&SearchRegex);
 
                         if (Button_GetCheck(GetDlgItem(hwndDlg, IDC_REGEX)) == BST_CHECKED)
                         {
-                            int errorCode;
-                            PCRE2_SIZE errorOffset;
-
-                            SearchRegexCompiledExpression = pcre2_compile(
-                                SearchString->Buffer,
-                                SearchString->Length / sizeof(WCHAR),
-                                PCRE2_CASELESS | PCRE2_DOTALL,
-                                &errorCode,
-                                &errorOffset,
-                                NULL
-                                );
+                            INT errorCode;
+                            SIZE_T errorOffset;
+
+                            SearchRegex = PhCompileRegex(&SearchString->sr, PH_REGEX_IGNORE_CASE, &errorCode, &errorOffset);
 
-                            if (!SearchRegexCompiledExpression)
+                            if (!SearchRegex)
                             {
                                 PhShowError(hwndDlg, L"Unable to compile the regular expression: \"%s\" at position %zu.",
                                     PhGetStringOrDefault(PhAutoDereferenceObject(PhPcre2GetErrorMessage(errorCode)), L"Unknown error"),
@@ -329,8 +312,6 @@ static INT_PTR CALLBACK PhpFindObjectsDlgProc(
                                     );
                                 break;
                             }
-
-                            SearchRegexMatchData = pcre2_match_data_create_from_pattern(SearchRegexCompiledExpression, NULL);
                         }
 
                         // Clean up previous results.
@@ -359,6 +340,8 @@ static INT_PTR CALLBACK PhpFindObjectsDlgProc(
 
                         SearchResults = PhCreateList(128);
                         SearchResultsAddIndex = 0;
+                        SearchTimeouts = 0;
+                        SetWindowText(hwndDlg, L"Find Handles or DLLs");
 
                         SearchThreadHandle = PhCreateThread(0, PhpFindObjectsThreadStart, NULL);
 
@@ -697,6 +680,15 @@ static INT_PTR CALLBACK PhpFindObjectsDlgProc(
 
             SetCursor(LoadCursor(NULL, IDC_ARROW));
 
+            if (SearchTimeouts != 0)
+            {
+                PPH_STRING title;
+
+                title = PhFormatString(L"Find Handles or DLLs (%lu queries timed out)", SearchTimeouts);
+                SetWindowText(hwndDlg, title->Buffer);
+                PhDereferenceObject(title);
+            }
+
             if (handleSearchStatus == STATUS_INSUFFICIENT_RESOURCES)
             {
                 PhShowWarning(
@@ -716,104 +708,231 @@ static BOOLEAN MatchSearchString(
     _In_ PPH_STRINGREF Input
     )
 {
-    if (SearchRegexCompiledExpression && SearchRegexMatchData)
-    {
-        return pcre2_match(
-            SearchRegexCompiledExpression,
-            Input->Buffer,
-            Input->Length / sizeof(WCHAR),
-            0,
-            0,
-            SearchRegexMatchData,
-            NULL
-            ) >= 0;
-    }
+    if (SearchRegex)
+        return PhMatchRegex(SearchRegex, Input);
     else
-    {
         return PhFindStringInStringRef(Input, &SearchString->sr, TRUE) != -1;
-    }
+}
+
+static VOID AddSearchResult(
+    _In_ PPHP_OBJECT_SEARCH_RESULT SearchResult
+    )
+{
+    PhAcquireQueuedLockExclusive(&SearchResultsLock);
+
+    PhAddItemList(SearchResults, SearchResult);
+
+    // Update the search results in batches of 40.
+    if (SearchResults->Count % 40 == 0)
+        PostMessage(PhFindObjectsWindowHandle, WM_PH_SEARCH_UPDATE, 0, 0);
+
+    PhReleaseQueuedLockExclusive(&SearchResultsLock);
 }
 
 typedef struct _SEARCH_HANDLE_CONTEXT
 {
-    BOOLEAN NeedToFree;
-    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX HandleInfo;
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX Handles;
+    ULONG NumberOfHandles;
     HANDLE ProcessHandle;
+    USHORT SkipObjectTypeIndex; // handles of this type are searched by separate work items
+    BOOLEAN ObjectMatch; // the handles refer to the search pointer, so their names don't need to match
 } SEARCH_HANDLE_CONTEXT, *PSEARCH_HANDLE_CONTEXT;
 
+static BOOLEAN SearchHandleNames(
+    _In_ PSEARCH_HANDLE_CONTEXT Context
+    )
+{
+    NTSTATUS status;
+    PKPH_PROCESS_HANDLE_NAME_INFORMATION buffer;
+    ULONG bufferSize;
+    ULONG returnLength;
+    HANDLE startHandle;
+
+    // KProcessHacker returns the handles of the process together with their names, a few
+    // hundred at a time, so we don't need a request for each handle.
+
+    bufferSize = 0x10000;
+    buffer = PhAllocate(bufferSize);
+    startHandle = NULL;
+
+    while (TRUE)
+    {
+        PKPH_PROCESS_HANDLE_NAME entry;
+        ULONG i;
+
+        status = KphEnumerateProcessHandleNames(
+            Context->ProcessHandle,
+            startHandle,
+            NULL,
+            buffer,
+            bufferSize,
+            &returnLength
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL)
+        {
+            // A single name didn't fit.
+            PhFree(buffer);
+            bufferSize = returnLength;
+            buffer = PhAllocate(bufferSize);
+            continue;
+        }
+
+        if (!NT_SUCCESS(status))
+        {
+            PhFree(buffer);
+
+            // If the first request failed, the caller searches the handles one at a time.
+            return startHandle != NULL;
+        }
+
+        entry = buffer->Handles;
+
+        for (i = 0; i < buffer->HandleCount && !SearchStop; i++)
+        {
+            PH_STRINGREF objectName;
+            PPH_STRING typeName;
+            PPH_STRING bestObjectName;
+
+            PhUnicodeStringToStringRef(&entry->ObjectName, &objectName);
+
+            if (NT_SUCCESS(PhGetHandleInformationFromName(
+                Context->ProcessHandle,
+                entry->Handle.Handle,
+                entry->Handle.ObjectTypeIndex == USHRT_MAX ? -1 : entry->Handle.ObjectTypeIndex,
+                NT_SUCCESS(entry->NameStatus) ? &objectName : NULL,
+                &typeName,
+                &bestObjectName
+                )))
+            {
+                // Handles to the search pointer were already found through the object index.
+                if (!(UseSearchPointer && entry->Handle.Object == (PVOID)SearchPointer) &&
+                    MatchSearchString(&bestObjectName->sr))
+                {
+                    PPHP_OBJECT_SEARCH_RESULT searchResult;
+
+                    searchResult = PhAllocate(sizeof(PHP_OBJECT_SEARCH_RESULT));
+                    searchResult->ProcessId = (HANDLE)Context->Handles[0].UniqueProcessId;
+                    searchResult->ResultType = HandleSearchResult;
+                    searchResult->Handle = entry->Handle.Handle;
+                    searchResult->TypeName = typeName;
+                    searchResult->Name = bestObjectName;
+                    PhPrintPointer(searchResult->HandleString, (PVOID)searchResult->Handle);
+                    searchResult->Info.Object = entry->Handle.Object;
+                    searchResult->Info.UniqueProcessId = Context->Handles[0].UniqueProcessId;
+                    searchResult->Info.HandleValue = (ULONG_PTR)entry->Handle.Handle;
+                    searchResult->Info.GrantedAccess = entry->Handle.GrantedAccess;
+                    searchResult->Info.CreatorBackTraceIndex = 0;
+                    searchResult->Info.ObjectTypeIndex = entry->Handle.ObjectTypeIndex;
+                    searchResult->Info.HandleAttributes = entry->Handle.HandleAttributes;
+                    searchResult->Info.Reserved = 0;
+
+                    AddSearchResult(searchResult);
+                }
+                else
+                {
+                    PhDereferenceObject(typeName);
+                    PhDereferenceObject(bestObjectName);
+                }
+            }
+
+            entry = PTR_ADD_OFFSET(entry, entry->NextEntryOffset);
+        }
+
+        startHandle = buffer->NextHandle;
+
+        if (!startHandle || SearchStop)
+            break;
+    }
+
+    PhFree(buffer);
+
+    return TRUE;
+}
+
 static NTSTATUS NTAPI SearchHandleFunction(
     _In_ PVOID Parameter
     )
 {
     PSEARCH_HANDLE_CONTEXT context = Parameter;
-    PPH_STRING typeName;
-    PPH_STRING bestObjectName;
-
-    if (!SearchStop && NT_SUCCESS(PhGetHandleInformation(
-        context->ProcessHandle,
-        (HANDLE)context->HandleInfo->HandleValue,
-        context->HandleInfo->ObjectTypeIndex,
-        NULL,
-        &typeName,
-        NULL,
-        &bestObjectName
-        )))
+    ULONG i;
+
+    // With KProcessHacker there is a single work item for each process.
+    if (!context->ObjectMatch && KphIsConnected() && SearchHandleNames(context))
+        goto CleanupExit;
+
+    for (i = 0; i < context->NumberOfHandles; i++)
     {
-        PPH_STRING upperBestObjectName;
+        PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handleInfo = &context->Handles[i];
+        PPH_STRING typeName;
+        PPH_STRING bestObjectName;
 
-        upperBestObjectName = PhDuplicateString(bestObjectName);
-        PhUpperString(upperBestObjectName);
+        if (SearchStop)
+            break;
 
-        if (MatchSearchString(&upperBestObjectName->sr) ||
-            (UseSearchPointer && context->HandleInfo->Object == (PVOID)SearchPointer))
+        if (handleInfo->ObjectTypeIndex == context->SkipObjectTypeIndex)
+            continue;
+
+        // Handles to the search pointer were already found through the object index.
+        if (!context->ObjectMatch && UseSearchPointer && handleInfo->Object == (PVOID)SearchPointer)
+            continue;
+
+        if (!NT_SUCCESS(PhGetHandleInformation(
+            context->ProcessHandle,
+            (HANDLE)handleInfo->HandleValue,
+            handleInfo->ObjectTypeIndex,
+            NULL,
+            &typeName,
+            NULL,
+            &bestObjectName
+            )))
+            continue;
+
+        // The search is case-insensitive, so the name doesn't need to be converted first.
+        if (context->ObjectMatch || MatchSearchString(&bestObjectName->sr))
         {
             PPHP_OBJECT_SEARCH_RESULT searchResult;
 
             searchResult = PhAllocate(sizeof(PHP_OBJECT_SEARCH_RESULT));
-            searchResult->ProcessId = (HANDLE)context->HandleInfo->UniqueProcessId;
+            searchResult->ProcessId = (HANDLE)handleInfo->UniqueProcessId;
             searchResult->ResultType = HandleSearchResult;
-            searchResult->Handle = (HANDLE)context->HandleInfo->HandleValue;
+            searchResult->Handle = (HANDLE)handleInfo->HandleValue;
             searchResult->TypeName = typeName;
             searchResult->Name = bestObjectName;
             PhPrintPointer(searchResult->HandleString, (PVOID)searchResult->Handle);
-            searchResult->Info = *context->HandleInfo;
-
-            PhAcquireQueuedLockExclusive(&SearchResultsLock);
-
-            PhAddItemList(SearchResults, searchResult);
+            searchResult->Info = *handleInfo;
 
-            // Update the search results in batches of 40.
-            if (SearchResults->Count % 40 == 0)
-                PostMessage(PhFindObjectsWindowHandle, WM_PH_SEARCH_UPDATE, 0, 0);
-
-            PhReleaseQueuedLockExclusive(&SearchResultsLock);
+            AddSearchResult(searchResult);
         }
         else
         {
             PhDereferenceObject(typeName);
             PhDereferenceObject(bestObjectName);
         }
-
-        PhDereferenceObject(upperBestObjectName);
     }
 
-    if (context->NeedToFree)
-        PhFree(context);
+CleanupExit:
+    PhFree(context);
 
     return STATUS_SUCCESS;
 }
 
+typedef struct _SEARCH_MODULES_CONTEXT
+{
+    HANDLE ProcessId;
+} SEARCH_MODULES_CONTEXT, *PSEARCH_MODULES_CONTEXT;
+
 static BOOLEAN NTAPI EnumModulesCallback(
     _In_ PPH_MODULE_INFO Module,
     _In_opt_ PVOID Context
     )
 {
-    PPH_STRING upperFileName;
+    PSEARCH_MODULES_CONTEXT context = Context;
 
-    upperFileName = PhDuplicateString(Module->FileName);
-    PhUpperString(upperFileName);
+    if (SearchStop)
+        return FALSE;
 
-    if (MatchSearchString(&upperFileName->sr) ||
+    if (MatchSearchString(&Module->FileName->sr) ||
         (UseSearchPointer && Module->BaseAddress == (PVOID)SearchPointer))
     {
         PPHP_OBJECT_SEARCH_RESULT searchResult;
@@ -833,7 +952,7 @@ static BOOLEAN NTAPI EnumModulesCallback(
         }
 
         searchResult = PhAllocate(sizeof(PHP_OBJECT_SEARCH_RESULT));
-        searchResult->ProcessId = (HANDLE)Context;
+        searchResult->ProcessId = context->ProcessId;
         searchResult->ResultType = (Module->Type == PH_MODULE_TYPE_MAPPED_FILE || Module->Type == PH_MODULE_TYPE_MAPPED_IMAGE) ? MappedFileSearchResult : ModuleSearchResult;
         searchResult->Handle = (HANDLE)Module->BaseAddress;
         searchResult->TypeName = PhCreateString(typeName);
@@ -841,20 +960,77 @@ static BOOLEAN NTAPI EnumModulesCallback(
         PhPrintPointer(searchResult->HandleString, Module->BaseAddress);
         memset(&searchResult->Info, 0, sizeof(SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX));
 
-        PhAcquireQueuedLockExclusive(&SearchResultsLock);
+        AddSearchResult(searchResult);
+    }
 
-        PhAddItemList(SearchResults, searchResult);
+    return TRUE;
+}
 
-        // Update the search results in batches of 40.
-        if (SearchResults->Count % 40 == 0)
-            PostMessage(PhFindObjectsWindowHandle, WM_PH_SEARCH_UPDATE, 0, 0);
+static NTSTATUS NTAPI SearchModulesFunction(
+    _In_ PVOID Parameter
+    )
+{
+    SEARCH_MODULES_CONTEXT context;
 
-        PhReleaseQueuedLockExclusive(&SearchResultsLock);
+    if (!SearchStop)
+    {
+        context.ProcessId = Parameter;
+
+        PhEnumGenericModules(
+            context.ProcessId,
+            NULL,
+            PH_ENUM_GENERIC_MAPPED_FILES | PH_ENUM_GENERIC_MAPPED_IMAGES,
+            EnumModulesCallback,
+            &context
+            );
     }
 
-    PhDereferenceObject(upperFileName);
+    return STATUS_SUCCESS;
+}
 
-    return TRUE;
+static VOID QueueSearchHandles(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _Inout_ PPH_WORK_QUEUE_BATCH WorkQueueBatch,
+    _In_ PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX Handles,
+    _In_ ULONG NumberOfHandles,
+    _In_ HANDLE ProcessHandle,
+    _In_ USHORT SkipObjectTypeIndex,
+    _In_ BOOLEAN ObjectMatch
+    )
+{
+    PSEARCH_HANDLE_CONTEXT context;
+
+    context = PhAllocate(sizeof(SEARCH_HANDLE_CONTEXT));
+    context->Handles = Handles;
+    context->NumberOfHandles = NumberOfHandles;
+    context->ProcessHandle = ProcessHandle;
+    context->SkipObjectTypeIndex = SkipObjectTypeIndex;
+    context->ObjectMatch = ObjectMatch;
+
+    PhQueueItemsWorkQueueEx(WorkQueue, SearchHandleFunction, &context, 1, WorkQueueBatch);
+}
+
+static HANDLE GetSearchProcessHandle(
+    _Inout_ PPH_HASHTABLE ProcessHandleHashtable,
+    _In_ HANDLE ProcessId
+    )
+{
+    PVOID *processHandlePtr;
+    HANDLE processHandle;
+
+    // Open a handle to the process if we don't already have one.
+
+    processHandlePtr = PhFindItemSimpleHashtable(ProcessHandleHashtable, ProcessId);
+
+    if (processHandlePtr)
+        return (HANDLE)*processHandlePtr;
+
+    if (!NT_SUCCESS(PhOpenProcess(&processHandle, PROCESS_DUP_HANDLE, ProcessId)))
+        return NULL;
+
+    PhAddItemSimpleHashtable(ProcessHandleHashtable, ProcessId, processHandle);
+
+    return processHandle;
 }
 
 static NTSTATUS PhpFindObjectsThreadStart(
@@ -862,10 +1038,15 @@ static NTSTATUS PhpFindObjectsThreadStart(
     )
 {
     NTSTATUS status = STATUS_SUCCESS;
-    PSYSTEM_HANDLE_INFORMATION_EX handles;
-    PPH_HASHTABLE processHandleHashtable;
-    PVOID processes;
+    PPH_HANDLE_SNAPSHOT snapshot = NULL;
+    PPH_HASHTABLE processHandleHashtable = NULL;
+    PVOID processes = NULL;
     PSYSTEM_PROCESS_INFORMATION process;
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    ULONG numberOfThreads;
+    ULONG initialTimeouts;
+    ULONG timeouts;
     ULONG i;
 
     // Refuse to search with no filter.
@@ -877,20 +1058,26 @@ static NTSTATUS PhpFindObjectsThreadStart(
 
     PhUpperString(SearchString);
 
-    if (NT_SUCCESS(status = PhEnumHandlesEx(&handles)))
+    // The search is partitioned by process: each process gets a work item for its handles and
+    // another for its modules, and results are added to the list as soon as they are found.
+    PhGetCallWithTimeoutStatistics(&numberOfThreads, &initialTimeouts);
+    PhInitializeWorkQueueEx(&workQueue, 1, numberOfThreads, 1000, PH_WORK_QUEUE_LOCK_FREE);
+    PhInitializeWorkQueueBatch(&workQueueBatch);
+
+    // The snapshot may be shared with handle providers that updated just now.
+    if (NT_SUCCESS(status = PhReferenceHandleSnapshot(1000, &snapshot)))
     {
         static PH_INITONCE initOnce = PH_INITONCE_INIT;
         static ULONG fileObjectTypeIndex = -1;
 
-        BOOLEAN useWorkQueue = FALSE;
-        PH_WORK_QUEUE workQueue;
+        PSYSTEM_HANDLE_INFORMATION_EX handles = snapshot->Information;
+        USHORT skipObjectTypeIndex = USHRT_MAX;
+        ULONG numberOfHandles;
+
         processHandleHashtable = PhCreateSimpleHashtable(8);
 
         if (!KphIsConnected() && WindowsVersion >= WINDOWS_VISTA)
         {
-            useWorkQueue = TRUE;
-            PhInitializeWorkQueue(&workQueue, 1, 20, 1000);
-
             if (PhBeginInitOnce(&initOnce))
             {
                 UNICODE_STRING fileTypeName;
@@ -899,86 +1086,65 @@ static NTSTATUS PhpFindObjectsThreadStart(
                 fileObjectTypeIndex = PhGetObjectTypeNumber(&fileTypeName);
                 PhEndInitOnce(&initOnce);
             }
+
+            // Queries for file handles may hang until they time out, so they each get a work
+            // item of their own.
+            if (fileObjectTypeIndex != -1)
+                skipObjectTypeIndex = (USHORT)fileObjectTypeIndex;
         }
 
-        for (i = 0; i < handles->NumberOfHandles; i++)
-        {
-            PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handleInfo = &handles->Handles[i];
-            PVOID *processHandlePtr;
-            HANDLE processHandle;
+        numberOfHandles = snapshot->NumberOfHandles;
 
-            if (SearchStop)
-                break;
+        if (UseSearchPointer)
+        {
+            PULONG indices;
+            ULONG count;
 
-            // Open a handle to the process if we don't already have one.
+            // Look up the handles to the search pointer directly instead of waiting for
+            // the name queries of every handle in the system.
 
-            processHandlePtr = PhFindItemSimpleHashtable(
-                processHandleHashtable,
-                (PVOID)handleInfo->UniqueProcessId
-                );
+            count = PhFindObjectHandlesSnapshot(snapshot, (PVOID)SearchPointer, &indices);
 
-            if (processHandlePtr)
+            for (i = 0; i < count; i++)
             {
-                processHandle = (HANDLE)*processHandlePtr;
-            }
-            else
-            {
-                if (NT_SUCCESS(PhOpenProcess(
-                    &processHandle,
-                    PROCESS_DUP_HANDLE,
-                    (HANDLE)handleInfo->UniqueProcessId
-                    )))
-                {
-                    PhAddItemSimpleHashtable(
-                        processHandleHashtable,
-                        (PVOID)handleInfo->UniqueProcessId,
-                        processHandle
-                        );
-                }
-                else
-                {
-                    continue;
-                }
+                PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handleInfo = &handles->Handles[indices[i]];
+                HANDLE processHandle;
+
+                if (processHandle = GetSearchProcessHandle(processHandleHashtable, (HANDLE)handleInfo->UniqueProcessId))
+                    QueueSearchHandles(&workQueue, &workQueueBatch, handleInfo, 1, processHandle, USHRT_MAX, TRUE);
             }
+        }
 
-            if (useWorkQueue && handleInfo->ObjectTypeIndex == (USHORT)fileObjectTypeIndex)
-            {
-                PSEARCH_HANDLE_CONTEXT searchHandleContext;
+        for (i = 0; i < numberOfHandles && !SearchStop; )
+        {
+            PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handleInfo = &handles->Handles[i];
+            HANDLE processHandle;
+            ULONG count;
+            ULONG j;
 
-                searchHandleContext = PhAllocate(sizeof(SEARCH_HANDLE_CONTEXT));
-                searchHandleContext->NeedToFree = TRUE;
-                searchHandleContext->HandleInfo = handleInfo;
-                searchHandleContext->ProcessHandle = processHandle;
-                PhQueueItemWorkQueue(&workQueue, SearchHandleFunction, searchHandleContext);
-            }
-            else
+            // Handles are grouped by process.
+            for (count = 1; i + count < numberOfHandles; count++)
             {
-                SEARCH_HANDLE_CONTEXT searchHandleContext;
-
-                searchHandleContext.NeedToFree = FALSE;
-                searchHandleContext.HandleInfo = handleInfo;
-                searchHandleContext.ProcessHandle = processHandle;
-                SearchHandleFunction(&searchHandleContext);
+                if (handles->Handles[i + count].UniqueProcessId != handleInfo->UniqueProcessId)
+                    break;
             }
-        }
 
-        if (useWorkQueue)
-        {
-            PhWaitForWorkQueue(&workQueue);
-            PhDeleteWorkQueue(&workQueue);
-        }
+            i += count;
 
-        {
-            PPH_KEY_VALUE_PAIR entry;
+            if (!(processHandle = GetSearchProcessHandle(processHandleHashtable, (HANDLE)handleInfo->UniqueProcessId)))
+                continue;
 
-            i = 0;
+            QueueSearchHandles(&workQueue, &workQueueBatch, handleInfo, count, processHandle, skipObjectTypeIndex, FALSE);
 
-            while (PhEnumHashtable(processHandleHashtable, &entry, &i))
-                NtClose((HANDLE)entry->Value);
+            if (skipObjectTypeIndex != USHRT_MAX)
+            {
+                for (j = 0; j < count; j++)
+                {
+                    if (handleInfo[j].ObjectTypeIndex == skipObjectTypeIndex)
+                        QueueSearchHandles(&workQueue, &workQueueBatch, &handleInfo[j], 1, processHandle, USHRT_MAX, FALSE);
+                }
+            }
         }
-
-        PhDereferenceObject(processHandleHashtable);
-        PhFree(handles);
     }
 
     if (NT_SUCCESS(PhEnumProcesses(&processes)))
@@ -987,18 +1153,39 @@ static NTSTATUS PhpFindObjectsThreadStart(
 
         do
         {
-            PhEnumGenericModules(
-                process->UniqueProcessId,
-                NULL,
-                PH_ENUM_GENERIC_MAPPED_FILES | PH_ENUM_GENERIC_MAPPED_IMAGES,
-                EnumModulesCallback,
-                (PVOID)process->UniqueProcessId
-                );
+            PVOID context = process->UniqueProcessId;
+
+            if (SearchStop)
+                break;
+
+            PhQueueItemsWorkQueueEx(&workQueue, SearchModulesFunction, &context, 1, &workQueueBatch);
         } while (process = PH_NEXT_PROCESS(process));
+    }
 
-        PhFree(processes);
+    PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+    PhDeleteWorkQueue(&workQueue);
+
+    // Other callers may have timed out in the meantime, but this is only used for reporting.
+    PhGetCallWithTimeoutStatistics(NULL, &timeouts);
+    SearchTimeouts = timeouts - initialTimeouts;
+
+    if (processHandleHashtable)
+    {
+        PPH_KEY_VALUE_PAIR entry;
+
+        i = 0;
+
+        while (PhEnumHashtable(processHandleHashtable, &entry, &i))
+            NtClose((HANDLE)entry->Value);
+
+        PhDereferenceObject(processHandleHashtable);
     }
 
+    if (snapshot)
+        PhDereferenceObject(snapshot);
+    if (processes)
+        PhFree(processes);
+
 Exit:
     PostMessage(PhFindObjectsWindowHandle, WM_PH_SEARCH_FINISHED, status, 0);
 
@@ -45,6 +45,10 @@ INT_PTR CALLBACK PhpGdiHandlesDlgProc(
     _In_ LPARAM lParam
     );
 
+static PPH_OBJECT_TYPE PhpGdiHandleSnapshotType = NULL;
+static PH_QUEUED_LOCK PhpGdiHandleSnapshotLock = PH_QUEUED_LOCK_INIT;
+static PPH_GDI_HANDLE_SNAPSHOT PhpGdiHandleSnapshot = NULL;
+
 VOID PhShowGdiHandlesDialog(
     _In_ HWND ParentWindowHandle,
     _In_ PPH_PROCESS_ITEM ProcessItem
@@ -219,6 +223,210 @@ PPH_STRING PhpGetGdiHandleInformation(
     return NULL;
 }
 
+static VOID NTAPI PhpGdiHandleSnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_GDI_HANDLE_SNAPSHOT snapshot = Object;
+
+    PhFree(snapshot->Handles);
+}
+
+static int __cdecl PhpGdiHandleSnapshotKeyCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    return uintcmp(*(PULONG)elem1, *(PULONG)elem2);
+}
+
+static PPH_GDI_HANDLE_SNAPSHOT PhpCreateGdiHandleSnapshot(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PPH_GDI_HANDLE_SNAPSHOT snapshot;
+    PGDI_SHARED_MEMORY gdiShared;
+    PULONG seenProcessIds;
+    PPH_PROCESS_ITEM *processItems;
+    ULONG numberOfProcessItems;
+    ULONG i;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpGdiHandleSnapshotType = PhCreateObjectType(L"GdiHandleSnapshot", 0, PhpGdiHandleSnapshotDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    snapshot = PhCreateObject(sizeof(PH_GDI_HANDLE_SNAPSHOT), PhpGdiHandleSnapshotType);
+    snapshot->SessionId = NtCurrentPeb()->SessionId;
+    snapshot->NumberOfHandles = 0;
+    snapshot->Handles = PhAllocate(GDI_MAX_HANDLE_COUNT * sizeof(ULONG));
+    memset(snapshot->AmbiguousProcessIds, 0, sizeof(snapshot->AmbiguousProcessIds));
+
+    // The handle table is shared by every process in our session, so a single pass gives the
+    // handles of all of them.
+
+    gdiShared = (PGDI_SHARED_MEMORY)NtCurrentPeb()->GdiSharedHandleTable;
+
+    if (gdiShared)
+    {
+        for (i = 0; i < GDI_MAX_HANDLE_COUNT; i++)
+        {
+            PGDI_HANDLE_ENTRY handle = &gdiShared->Handles[i];
+
+            // Skip free entries. Unlike the dialog, count every type so that the totals match
+            // GetGuiResources.
+            if (GDI_HANDLE_TYPE((ULONG)handle->Unique << GDI_HANDLE_TYPE_SHIFT) == GDI_DEF_TYPE)
+                continue;
+
+            snapshot->Handles[snapshot->NumberOfHandles++] = ((ULONG)handle->Owner.ProcessId << 16) | i;
+        }
+
+        // Handles are already in index order, so sorting the keys groups them by process and
+        // keeps each group in index order.
+        qsort(snapshot->Handles, snapshot->NumberOfHandles, sizeof(ULONG), PhpGdiHandleSnapshotKeyCompare);
+    }
+
+    // The table only stores the low 16 bits of process IDs. Remember which of these are shared
+    // by several processes in our session so their counts are not attributed to the wrong one.
+
+    seenProcessIds = PhAllocate(sizeof(snapshot->AmbiguousProcessIds));
+    memset(seenProcessIds, 0, sizeof(snapshot->AmbiguousProcessIds));
+
+    PhEnumProcessItems(&processItems, &numberOfProcessItems);
+
+    for (i = 0; i < numberOfProcessItems; i++)
+    {
+        ULONG truncatedProcessId;
+
+        if (processItems[i]->SessionId == snapshot->SessionId)
+        {
+            truncatedProcessId = HandleToUlong(processItems[i]->ProcessId) & 0xffff;
+
+            if (seenProcessIds[truncatedProcessId / 32] & (1 << (truncatedProcessId % 32)))
+                snapshot->AmbiguousProcessIds[truncatedProcessId / 32] |= 1 << (truncatedProcessId % 32);
+            else
+                seenProcessIds[truncatedProcessId / 32] |= 1 << (truncatedProcessId % 32);
+        }
+
+        PhDereferenceObject(processItems[i]);
+    }
+
+    PhFree(processItems);
+    PhFree(seenProcessIds);
+
+    return snapshot;
+}
+
+/**
+ * Gets a snapshot of the GDI handle table of the current session.
+ *
+ * \return The snapshot. You must dereference it when you no longer need it.
+ *
+ * \remarks The snapshot is shared and is only created again after
+ * PhInvalidateGdiHandleSnapshot() is called, which happens on every
+ * process provider update.
+ */
+PPH_GDI_HANDLE_SNAPSHOT PhReferenceGdiHandleSnapshot(
+    VOID
+    )
+{
+    PPH_GDI_HANDLE_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockExclusive(&PhpGdiHandleSnapshotLock);
+
+    if (!PhpGdiHandleSnapshot)
+        PhpGdiHandleSnapshot = PhpCreateGdiHandleSnapshot();
+
+    snapshot = PhpGdiHandleSnapshot;
+    PhReferenceObject(snapshot);
+
+    PhReleaseQueuedLockExclusive(&PhpGdiHandleSnapshotLock);
+
+    return snapshot;
+}
+
+/**
+ * Discards the shared GDI handle snapshot so that the next call to
+ * PhReferenceGdiHandleSnapshot() reads the handle table again.
+ */
+VOID PhInvalidateGdiHandleSnapshot(
+    VOID
+    )
+{
+    PPH_GDI_HANDLE_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockExclusive(&PhpGdiHandleSnapshotLock);
+    snapshot = PhpGdiHandleSnapshot;
+    PhpGdiHandleSnapshot = NULL;
+    PhReleaseQueuedLockExclusive(&PhpGdiHandleSnapshotLock);
+
+    if (snapshot)
+        PhDereferenceObject(snapshot);
+}
+
+/**
+ * Finds the GDI handles of a process in a GDI handle snapshot.
+ *
+ * \param Snapshot A GDI handle snapshot.
+ * \param ProcessId The ID of the process.
+ * \param SessionId The session ID of the process.
+ * \param Handles A variable which receives a pointer to an array of keys, in handle table
+ * index order. Use PH_GDI_HANDLE_SNAPSHOT_INDEX() to get the index of each handle. The array
+ * is owned by the snapshot.
+ * \param NumberOfHandles A variable which receives the number of handles owned by the process.
+ *
+ * \return FALSE if the snapshot cannot be used for the process, either because it belongs to
+ * another session or because its ID cannot be told apart from another process in the table.
+ */
+BOOLEAN PhFindGdiHandlesSnapshot(
+    _In_ PPH_GDI_HANDLE_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _In_ ULONG SessionId,
+    _Out_ PULONG *Handles,
+    _Out_ PULONG NumberOfHandles
+    )
+{
+    ULONG truncatedProcessId;
+    ULONG low;
+    ULONG high;
+    ULONG start;
+
+    truncatedProcessId = HandleToUlong(ProcessId) & 0xffff;
+
+    if (SessionId != Snapshot->SessionId)
+        return FALSE;
+    if (Snapshot->AmbiguousProcessIds[truncatedProcessId / 32] & (1 << (truncatedProcessId % 32)))
+        return FALSE;
+
+    // Find the first handle owned by the process.
+
+    low = 0;
+    high = Snapshot->NumberOfHandles;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+
+        if ((Snapshot->Handles[mid] >> 16) < truncatedProcessId)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    start = low;
+
+    while (high < Snapshot->NumberOfHandles && (Snapshot->Handles[high] >> 16) == truncatedProcessId)
+        high++;
+
+    *Handles = &Snapshot->Handles[start];
+    *NumberOfHandles = high - start;
+
+    return TRUE;
+}
+
 VOID PhpRefreshGdiHandles(
     _In_ HWND hwndDlg,
     _In_ PGDI_HANDLES_CONTEXT Context
@@ -230,6 +438,9 @@ VOID PhpRefreshGdiHandles(
     USHORT processId;
     PGDI_HANDLE_ENTRY handle;
     PPH_GDI_HANDLE_ITEM gdiHandleItem;
+    PPH_GDI_HANDLE_SNAPSHOT snapshot;
+    PULONG handles;
+    ULONG numberOfHandles;
 
     lvHandle = GetDlgItem(hwndDlg, IDC_LIST);
 
@@ -251,14 +462,32 @@ VOID PhpRefreshGdiHandles(
     gdiShared = (PGDI_SHARED_MEMORY)NtCurrentPeb()->GdiSharedHandleTable;
     processId = (USHORT)Context->ProcessItem->ProcessId;
 
-    for (i = 0; i < GDI_MAX_HANDLE_COUNT; i++)
+    // Refresh the shared snapshot, since the user asked for the current handles.
+    PhInvalidateGdiHandleSnapshot();
+    snapshot = PhReferenceGdiHandleSnapshot();
+
+    if (!gdiShared || !PhFindGdiHandlesSnapshot(
+        snapshot,
+        Context->ProcessItem->ProcessId,
+        Context->ProcessItem->SessionId,
+        &handles,
+        &numberOfHandles
+        ))
     {
+        numberOfHandles = 0;
+    }
+
+    for (i = 0; i < numberOfHandles; i++)
+    {
+        ULONG index;
         PWSTR typeName;
         INT lvItemIndex;
         WCHAR pointer[PH_PTR_STR_LEN_1];
 
-        handle = &gdiShared->Handles[i];
+        index = PH_GDI_HANDLE_SNAPSHOT_INDEX(handles[i]);
+        handle = &gdiShared->Handles[index];
 
+        // The entry may have been reused since the snapshot was taken.
         if (handle->Owner.ProcessId != processId)
             continue;
 
@@ -269,7 +498,7 @@ VOID PhpRefreshGdiHandles(
 
         gdiHandleItem = PhAllocate(sizeof(PH_GDI_HANDLE_ITEM));
         gdiHandleItem->Entry = handle;
-        gdiHandleItem->Handle = GDI_MAKE_HANDLE(i, handle->Unique);
+        gdiHandleItem->Handle = GDI_MAKE_HANDLE(index, handle->Unique);
         gdiHandleItem->Object = handle->Object;
         gdiHandleItem->TypeName = typeName;
         gdiHandleItem->Information = PhpGetGdiHandleInformation(gdiHandleItem->Handle);
@@ -283,6 +512,8 @@ VOID PhpRefreshGdiHandles(
         PhSetListViewSubItem(lvHandle, lvItemIndex, 3, PhGetString(gdiHandleItem->Information));
     }
 
+    PhDereferenceObject(snapshot);
+
     ExtendedListView_SortItems(lvHandle);
     ExtendedListView_SetRedraw(lvHandle, TRUE);
 }
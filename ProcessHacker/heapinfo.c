@@ -0,0 +1,403 @@
+/*
+ * Process Hacker -
+ *   heap statistics
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <phapp.h>
+
+#define WM_PH_HEAP_STATUS_UPDATE (WM_APP + 301)
+
+#define PH_HEAP_COMPLETED 1
+
+// Size class 0 holds blocks of up to 16 bytes, and each following class doubles the limit. The
+// last class holds everything larger.
+#define PH_HEAP_SIZE_CLASS_COUNT 24
+
+typedef struct _PH_HEAP_SIZE_CLASS
+{
+    ULONG BusyCount;
+    ULONG FreeCount;
+    ULONG64 BusyBytes;
+    ULONG64 FreeBytes;
+} PH_HEAP_SIZE_CLASS, *PPH_HEAP_SIZE_CLASS;
+
+typedef struct _HEAP_STATISTICS_CONTEXT
+{
+    HANDLE ProcessId;
+    HWND WindowHandle;
+    HANDLE ThreadHandle;
+
+    BOOLEAN Cancel;
+    NTSTATUS Status;
+    ULONG NumberOfHeaps;
+    volatile ULONG HeapsProcessed;
+    volatile ULONG64 EntriesProcessed;
+    PPH_STRING Text;
+} HEAP_STATISTICS_CONTEXT, *PHEAP_STATISTICS_CONTEXT;
+
+INT_PTR CALLBACK PhpHeapStatisticsProgressDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
+VOID PhShowProcessHeapStatistics(
+    _In_ HWND ParentWindowHandle,
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    HEAP_STATISTICS_CONTEXT context;
+
+    memset(&context, 0, sizeof(HEAP_STATISTICS_CONTEXT));
+    context.ProcessId = ProcessItem->ProcessId;
+
+    if (DialogBoxParam(
+        PhInstanceHandle,
+        MAKEINTRESOURCE(IDD_PROGRESS),
+        ParentWindowHandle,
+        PhpHeapStatisticsProgressDlgProc,
+        (LPARAM)&context
+        ) == IDOK)
+    {
+        if (NT_SUCCESS(context.Status) && context.Text)
+            PhShowInformationDialog(ParentWindowHandle, context.Text->Buffer);
+        else if (!context.Cancel)
+            PhShowStatus(ParentWindowHandle, L"Unable to query the process heaps", context.Status, 0);
+    }
+
+    PhClearReference(&context.Text);
+}
+
+static ULONG PhpGetHeapSizeClass(
+    _In_ SIZE_T Size
+    )
+{
+    ULONG index;
+
+    if (Size <= 16)
+        return 0;
+    if (Size - 1 > MAXULONG)
+        return PH_HEAP_SIZE_CLASS_COUNT - 1;
+
+    _BitScanReverse(&index, (ULONG)(Size - 1));
+    index -= 3;
+
+    return min(index, PH_HEAP_SIZE_CLASS_COUNT - 1);
+}
+
+static VOID PhpAppendHeapStatistics(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PRTL_HEAP_INFORMATION Heap,
+    _In_ PPH_HEAP_SIZE_CLASS SizeClasses
+    )
+{
+    ULONG busyCount = 0;
+    ULONG freeCount = 0;
+    ULONG64 busyBytes = 0;
+    ULONG64 freeBytes = 0;
+    ULONG i;
+
+    for (i = 0; i < PH_HEAP_SIZE_CLASS_COUNT; i++)
+    {
+        busyCount += SizeClasses[i].BusyCount;
+        freeCount += SizeClasses[i].FreeCount;
+        busyBytes += SizeClasses[i].BusyBytes;
+        freeBytes += SizeClasses[i].FreeBytes;
+    }
+
+    PhAppendFormatStringBuilder(
+        StringBuilder,
+        L"Heap 0x%Ix (flags 0x%x)\r\n",
+        (ULONG_PTR)Heap->BaseAddress,
+        Heap->Flags
+        );
+    PhAppendFormatStringBuilder(
+        StringBuilder,
+        L"    Committed: %s, allocated: %s\r\n",
+        PhaFormatSize(Heap->BytesCommitted, -1)->Buffer,
+        PhaFormatSize(Heap->BytesAllocated, -1)->Buffer
+        );
+    PhAppendFormatStringBuilder(
+        StringBuilder,
+        L"    Busy blocks: %s (%s), free blocks: %s (%s)\r\n",
+        PhaFormatUInt64(busyCount, TRUE)->Buffer,
+        PhaFormatSize(busyBytes, -1)->Buffer,
+        PhaFormatUInt64(freeCount, TRUE)->Buffer,
+        PhaFormatSize(freeBytes, -1)->Buffer
+        );
+
+    if (busyCount == 0 && freeCount == 0)
+    {
+        PhAppendStringBuilder2(StringBuilder, L"\r\n");
+        return;
+    }
+
+    PhAppendStringBuilder2(StringBuilder, L"    Size class       Busy        Busy bytes    Free        Free bytes\r\n");
+
+    for (i = 0; i < PH_HEAP_SIZE_CLASS_COUNT; i++)
+    {
+        PPH_HEAP_SIZE_CLASS sizeClass = &SizeClasses[i];
+        PPH_STRING limitText;
+
+        if (sizeClass->BusyCount == 0 && sizeClass->FreeCount == 0)
+            continue;
+
+        if (i == PH_HEAP_SIZE_CLASS_COUNT - 1)
+            limitText = PhaFormatString(L"> %s", PhaFormatSize(16ULL << (i - 1), -1)->Buffer);
+        else
+            limitText = PhaFormatString(L"<= %s", PhaFormatSize(16ULL << i, -1)->Buffer);
+
+        PhAppendFormatStringBuilder(
+            StringBuilder,
+            L"    %-16s %-11s %-13s %-11s %s\r\n",
+            limitText->Buffer,
+            PhaFormatUInt64(sizeClass->BusyCount, TRUE)->Buffer,
+            PhaFormatSize(sizeClass->BusyBytes, -1)->Buffer,
+            PhaFormatUInt64(sizeClass->FreeCount, TRUE)->Buffer,
+            PhaFormatSize(sizeClass->FreeBytes, -1)->Buffer
+            );
+    }
+
+    PhAppendStringBuilder2(StringBuilder, L"\r\n");
+}
+
+NTSTATUS PhpHeapStatisticsThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PHEAP_STATISTICS_CONTEXT context = Parameter;
+    NTSTATUS status;
+    PH_AUTO_POOL autoPool;
+    PRTL_DEBUG_INFORMATION debugBuffer;
+    PRTL_PROCESS_HEAPS heaps;
+    PH_STRING_BUILDER stringBuilder;
+    PH_HEAP_SIZE_CLASS sizeClasses[PH_HEAP_SIZE_CLASS_COUNT];
+    ULONG i;
+    ULONG j;
+
+    PhInitializeAutoPool(&autoPool);
+
+    debugBuffer = RtlCreateQueryDebugBuffer(0, FALSE);
+
+    if (!debugBuffer)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CleanupExit;
+    }
+
+    // The target builds the entry table itself, so a single call replaces walking millions of
+    // (encoded) blocks across process boundaries. The call cannot be interrupted; cancellation
+    // takes effect once the table is available.
+    status = RtlQueryProcessDebugInformation(
+        context->ProcessId,
+        RTL_QUERY_PROCESS_HEAP_SUMMARY | RTL_QUERY_PROCESS_HEAP_ENTRIES,
+        debugBuffer
+        );
+
+    if (!NT_SUCCESS(status))
+        goto CleanupExit;
+
+    heaps = debugBuffer->Heaps;
+
+    if (!heaps)
+    {
+        status = STATUS_UNSUCCESSFUL;
+        goto CleanupExit;
+    }
+
+    context->NumberOfHeaps = heaps->NumberOfHeaps;
+    PhInitializeStringBuilder(&stringBuilder, 0x1000);
+
+    PhAppendFormatStringBuilder(
+        &stringBuilder,
+        L"%lu heaps\r\n\r\n",
+        heaps->NumberOfHeaps
+        );
+
+    for (i = 0; i < heaps->NumberOfHeaps; i++)
+    {
+        PRTL_HEAP_INFORMATION heap = &heaps->Heaps[i];
+        PRTL_HEAP_ENTRY entry = heap->Entries;
+
+        if (context->Cancel)
+        {
+            status = STATUS_CANCELLED;
+            break;
+        }
+
+        memset(sizeClasses, 0, sizeof(sizeClasses));
+
+        for (j = 0; j < heap->NumberOfEntries; j++, entry++)
+        {
+            PPH_HEAP_SIZE_CLASS sizeClass;
+
+            if (entry->Flags & (RTL_HEAP_SEGMENT | RTL_HEAP_UNCOMMITTED_RANGE))
+                continue;
+
+            sizeClass = &sizeClasses[PhpGetHeapSizeClass(entry->Size)];
+
+            if (entry->Flags & RTL_HEAP_BUSY)
+            {
+                sizeClass->BusyCount++;
+                sizeClass->BusyBytes += entry->Size;
+            }
+            else
+            {
+                sizeClass->FreeCount++;
+                sizeClass->FreeBytes += entry->Size;
+            }
+        }
+
+        PhpAppendHeapStatistics(&stringBuilder, heap, sizeClasses);
+        PhDrainAutoPool(&autoPool);
+
+        context->EntriesProcessed += heap->NumberOfEntries;
+        context->HeapsProcessed = i + 1;
+    }
+
+    if (NT_SUCCESS(status))
+        context->Text = PhFinalStringBuilderString(&stringBuilder);
+    else
+        PhDeleteStringBuilder(&stringBuilder);
+
+CleanupExit:
+    if (debugBuffer)
+        RtlDestroyQueryDebugBuffer(debugBuffer);
+
+    PhDeleteAutoPool(&autoPool);
+
+    context->Status = status;
+
+    SendMessage(
+        context->WindowHandle,
+        WM_PH_HEAP_STATUS_UPDATE,
+        PH_HEAP_COMPLETED,
+        0
+        );
+
+    return STATUS_SUCCESS;
+}
+
+INT_PTR CALLBACK PhpHeapStatisticsProgressDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            PHEAP_STATISTICS_CONTEXT context = (PHEAP_STATISTICS_CONTEXT)lParam;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+            SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)context);
+
+            SetWindowText(hwndDlg, L"Heap Statistics");
+            SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, L"Querying heaps...");
+
+            PhSetWindowStyle(GetDlgItem(hwndDlg, IDC_PROGRESS), PBS_MARQUEE, PBS_MARQUEE);
+            SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETMARQUEE, TRUE, 75);
+
+            context->WindowHandle = hwndDlg;
+            context->ThreadHandle = PhCreateThread(0, PhpHeapStatisticsThreadStart, context);
+
+            if (!context->ThreadHandle)
+            {
+                PhShowStatus(hwndDlg, L"Unable to create the heap thread", 0, GetLastError());
+                EndDialog(hwndDlg, IDCANCEL);
+                return FALSE;
+            }
+
+            SetTimer(hwndDlg, 1, 500, NULL);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PHEAP_STATISTICS_CONTEXT context;
+
+            context = (PHEAP_STATISTICS_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+
+            KillTimer(hwndDlg, 1);
+
+            if (context->ThreadHandle)
+                NtClose(context->ThreadHandle);
+
+            RemoveProp(hwndDlg, PhMakeContextAtom());
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+                {
+                    PHEAP_STATISTICS_CONTEXT context =
+                        (PHEAP_STATISTICS_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+
+                    // The thread owns the context until it reports completion.
+                    EnableWindow(GetDlgItem(hwndDlg, IDCANCEL), FALSE);
+                    SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, L"Cancelling...");
+                    context->Cancel = TRUE;
+                }
+                break;
+            }
+        }
+        break;
+    case WM_TIMER:
+        {
+            if (wParam == 1)
+            {
+                PHEAP_STATISTICS_CONTEXT context =
+                    (PHEAP_STATISTICS_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+                PPH_STRING progressText;
+                PPH_STRING numberText;
+
+                if (context->Cancel || context->NumberOfHeaps == 0)
+                    break;
+
+                numberText = PhFormatUInt64(context->EntriesProcessed, TRUE);
+                progressText = PhFormatString(
+                    L"Processed %lu of %lu heaps (%s blocks)...",
+                    context->HeapsProcessed,
+                    context->NumberOfHeaps,
+                    numberText->Buffer
+                    );
+                PhDereferenceObject(numberText);
+                SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, progressText->Buffer);
+                PhDereferenceObject(progressText);
+                InvalidateRect(GetDlgItem(hwndDlg, IDC_PROGRESSTEXT), NULL, FALSE);
+            }
+        }
+        break;
+    case WM_PH_HEAP_STATUS_UPDATE:
+        {
+            switch (wParam)
+            {
+            case PH_HEAP_COMPLETED:
+                EndDialog(hwndDlg, IDOK);
+                break;
+            }
+        }
+        break;
+    }
+
+    return FALSE;
+}
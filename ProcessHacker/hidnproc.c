@@ -21,13 +21,17 @@
  */
 
 /*
- * There are two methods of hidden process detection implemented in this module.
+ * There are three methods of hidden process detection implemented in this module.
  *
  * Brute Force. This attempts to open all possible PIDs within a certain range
  * in order to find processes which have been unlinked from the active process
  * list (EPROCESS.ActiveProcessLinks). This method is not effective when
  * either NtOpenProcess is hooked or PsLookupProcessByProcessId is hooked
- * (KProcessHacker cannot bypass this).
+ * (KProcessHacker cannot bypass this). The range is probed in parallel.
+ *
+ * KProcessHacker. This is the same as Brute Force, except that the PIDs are
+ * looked up by the driver in a single request instead of being opened one by
+ * one.
  *
  * CSR Handles. This enumerates handles in all running CSR processes, and works
  * even when a process has been unlinked from the active process list and
@@ -72,6 +76,25 @@ HWND PhHiddenProcessesListViewHandle = NULL;
 static PH_LAYOUT_MANAGER WindowLayoutManager;
 static RECT MinimumSize;
 
+#define PH_HIDDEN_PROCESS_MINIMUM_SCAN_LIMIT 65536
+#define PH_HIDDEN_PROCESS_SCAN_MARGIN 65536
+#define PH_HIDDEN_PROCESS_CHUNK_SIZE 1024 // must be a power of two
+#define PH_HIDDEN_PROCESS_MAXIMUM_THREADS 16
+
+typedef struct _PHP_PROCESS_ID_SET
+{
+    RTL_BITMAP Bitmap;
+    ULONG Limit;
+} PHP_PROCESS_ID_SET, *PPHP_PROCESS_ID_SET;
+
+typedef struct _PHP_BRUTE_FORCE_CHUNK
+{
+    PPHP_PROCESS_ID_SET KnownProcessIds;
+    ULONG StartProcessId;
+    ULONG EndProcessId;
+    PPH_LIST Entries;
+} PHP_BRUTE_FORCE_CHUNK, *PPHP_BRUTE_FORCE_CHUNK;
+
 static PH_HIDDEN_PROCESS_METHOD ProcessesMethod;
 static PPH_LIST ProcessesList = NULL;
 static ULONG NumberOfHiddenProcesses;
@@ -163,6 +186,10 @@ static INT_PTR CALLBACK PhpHiddenProcessesDlgProc(
 
             ComboBox_AddString(GetDlgItem(hwndDlg, IDC_METHOD), L"Brute Force");
             ComboBox_AddString(GetDlgItem(hwndDlg, IDC_METHOD), L"CSR Handles");
+
+            if (KphIsConnected())
+                ComboBox_AddString(GetDlgItem(hwndDlg, IDC_METHOD), L"KProcessHacker");
+
             PhSelectComboBoxString(GetDlgItem(hwndDlg, IDC_METHOD), L"CSR Handles", FALSE);
 
             EnableWindow(GetDlgItem(hwndDlg, IDC_TERMINATE), FALSE);
@@ -220,10 +247,12 @@ static INT_PTR CALLBACK PhpHiddenProcessesDlgProc(
 
                     ProcessesList = PhCreateList(40);
 
-                    ProcessesMethod =
-                        PhEqualString2(method, L"Brute Force", TRUE) ?
-                        BruteForceScanMethod :
-                        CsrHandlesScanMethod;
+                    if (PhEqualString2(method, L"Brute Force", TRUE))
+                        ProcessesMethod = BruteForceScanMethod;
+                    else if (PhEqualString2(method, L"KProcessHacker", TRUE))
+                        ProcessesMethod = KphScanMethod;
+                    else
+                        ProcessesMethod = CsrHandlesScanMethod;
                     NumberOfHiddenProcesses = 0;
                     NumberOfTerminatedProcesses = 0;
 
@@ -278,7 +307,7 @@ static INT_PTR CALLBACK PhpHiddenProcessesDlgProc(
 
                             for (i = 0; i < numberOfEntries; i++)
                             {
-                                if (ProcessesMethod == BruteForceScanMethod)
+                                if (ProcessesMethod != CsrHandlesScanMethod)
                                 {
                                     status = PhOpenProcess(
                                         &processHandle,
@@ -361,7 +390,8 @@ static INT_PTR CALLBACK PhpHiddenProcessesDlgProc(
                             PhWritePhTextHeader(fileStream);
                             PhWriteStringAsUtf8FileStream2(fileStream, L"Method: ");
                             PhWriteStringAsUtf8FileStream2(fileStream,
-                                ProcessesMethod == BruteForceScanMethod ? L"Brute Force\r\n" : L"CSR Handles\r\n");
+                                ProcessesMethod == BruteForceScanMethod ? L"Brute Force\r\n" :
+                                ProcessesMethod == KphScanMethod ? L"KProcessHacker\r\n" : L"CSR Handles\r\n");
                             PhWriteStringFormatAsUtf8FileStream(
                                 fileStream,
                                 L"Hidden: %u\r\nTerminated: %u\r\n\r\n",
@@ -587,7 +617,7 @@ static PPH_PROCESS_ITEM PhpCreateProcessItemForHiddenProcess(
         processItem->ProcessName = PhCreateString(L"Unknown");
     }
 
-    if (ProcessesMethod == BruteForceScanMethod)
+    if (ProcessesMethod != CsrHandlesScanMethod)
     {
         status = PhOpenProcess(
             &processHandle,
@@ -658,40 +688,22 @@ static PPH_PROCESS_ITEM PhpCreateProcessItemForHiddenProcess(
 
     if (processItem->FileName)
     {
-        // Small icon, large icon.
-        ExtractIconEx(
-            processItem->FileName->Buffer,
-            0,
-            &processItem->LargeIcon,
-            &processItem->SmallIcon,
-            1
-            );
-
-        // Version info.
-        PhInitializeImageVersionInfo(&processItem->VersionInfo, processItem->FileName->Buffer);
-    }
-
-    // Use the default EXE icon if we didn't get the file's icon.
-    {
-        if (!processItem->SmallIcon || !processItem->LargeIcon)
+        // Small icon, large icon, version info.
+        if (processItem->ImageCacheEntry = PhReferenceImageCacheEntry(processItem->FileName))
         {
-            if (processItem->SmallIcon)
-            {
-                DestroyIcon(processItem->SmallIcon);
-                processItem->SmallIcon = NULL;
-            }
-            else if (processItem->LargeIcon)
-            {
-                DestroyIcon(processItem->LargeIcon);
-                processItem->LargeIcon = NULL;
-            }
-
-            PhGetStockApplicationIcon(&processItem->SmallIcon, &processItem->LargeIcon);
-            processItem->SmallIcon = DuplicateIcon(NULL, processItem->SmallIcon);
-            processItem->LargeIcon = DuplicateIcon(NULL, processItem->LargeIcon);
+            PhGetImageCacheEntryIcons(processItem->ImageCacheEntry, &processItem->SmallIcon, &processItem->LargeIcon);
+            PhGetImageCacheEntryVersionInfo(processItem->ImageCacheEntry, &processItem->VersionInfo);
+        }
+        else
+        {
+            PhInitializeImageVersionInfo(&processItem->VersionInfo, processItem->FileName->Buffer);
         }
     }
 
+    // Use the default EXE icon if we didn't get the file's icon.
+    if (!processItem->SmallIcon || !processItem->LargeIcon)
+        PhGetStockApplicationIcon(&processItem->SmallIcon, &processItem->LargeIcon);
+
     // POSIX, command line
 
     status = PhOpenProcess(
@@ -746,117 +758,321 @@ static PPH_PROCESS_ITEM PhpCreateProcessItemForHiddenProcess(
     return processItem;
 }
 
-NTSTATUS PhpEnumHiddenProcessesBruteForce(
-    _In_ PPH_ENUM_HIDDEN_PROCESSES_CALLBACK Callback,
-    _In_opt_ PVOID Context
+static NTSTATUS PhpCreateProcessIdSet(
+    _Out_ PPHP_PROCESS_ID_SET ProcessIdSet
     )
 {
     NTSTATUS status;
     PVOID processes;
     PSYSTEM_PROCESS_INFORMATION process;
-    PPH_LIST pids;
-    ULONG pid;
-    BOOLEAN stop = FALSE;
+    ULONG maximumProcessId;
+    ULONG limit;
+    PULONG buffer;
 
     if (!NT_SUCCESS(status = PhEnumProcesses(&processes)))
         return status;
 
-    pids = PhCreateList(40);
+    maximumProcessId = 0;
+    process = PH_FIRST_PROCESS(processes);
+
+    do
+    {
+        if (HandleToUlong(process->UniqueProcessId) > maximumProcessId)
+            maximumProcessId = HandleToUlong(process->UniqueProcessId);
+    } while (process = PH_NEXT_PROCESS(process));
+
+    // Hidden processes can have IDs above the highest visible one, so scan past it.
+    limit = max(maximumProcessId + PH_HIDDEN_PROCESS_SCAN_MARGIN, PH_HIDDEN_PROCESS_MINIMUM_SCAN_LIMIT);
+    limit = (limit + PH_HIDDEN_PROCESS_CHUNK_SIZE - 1) & ~(PH_HIDDEN_PROCESS_CHUNK_SIZE - 1);
+
+    // One bit per process ID. IDs are multiples of 4.
+    buffer = PhAllocate(limit / 4 / 8);
+    RtlInitializeBitMap(&ProcessIdSet->Bitmap, buffer, limit / 4);
+    RtlClearAllBits(&ProcessIdSet->Bitmap);
+    ProcessIdSet->Limit = limit;
 
     process = PH_FIRST_PROCESS(processes);
 
     do
     {
-        PhAddItemList(pids, process->UniqueProcessId);
+        RtlSetBits(&ProcessIdSet->Bitmap, HandleToUlong(process->UniqueProcessId) / 4, 1);
     } while (process = PH_NEXT_PROCESS(process));
 
     PhFree(processes);
 
-    for (pid = 8; pid <= 65536; pid += 4)
+    return STATUS_SUCCESS;
+}
+
+static VOID PhpDeleteProcessIdSet(
+    _In_ PPHP_PROCESS_ID_SET ProcessIdSet
+    )
+{
+    PhFree(ProcessIdSet->Bitmap.Buffer);
+}
+
+static BOOLEAN PhpIsProcessIdInSet(
+    _In_ PPHP_PROCESS_ID_SET ProcessIdSet,
+    _In_ HANDLE ProcessId
+    )
+{
+    ULONG processId = HandleToUlong(ProcessId);
+
+    return processId < ProcessIdSet->Limit && RtlCheckBit(&ProcessIdSet->Bitmap, processId / 4);
+}
+
+/**
+ * Probes a single process ID for the brute force scan.
+ *
+ * \param ProcessId The process ID to probe.
+ * \param KnownProcessIds The set of process IDs in the active process list.
+ * \param Entry A variable which receives the entry to report. If a file name
+ * is present, you must dereference it when you no longer need it.
+ *
+ * \return TRUE if \a Entry should be reported, otherwise FALSE.
+ */
+static BOOLEAN PhpProbeHiddenProcessId(
+    _In_ HANDLE ProcessId,
+    _In_ PPHP_PROCESS_ID_SET KnownProcessIds,
+    _Out_ PPH_HIDDEN_PROCESS_ENTRY Entry
+    )
+{
+    NTSTATUS status;
+    HANDLE processHandle;
+    KERNEL_USER_TIMES times;
+    PPH_STRING fileName;
+
+    Entry->ProcessId = ProcessId;
+
+    status = PhOpenProcess(
+        &processHandle,
+        ProcessQueryAccess,
+        ProcessId
+        );
+
+    if (NT_SUCCESS(status))
     {
-        NTSTATUS status2;
-        HANDLE processHandle;
-        PH_HIDDEN_PROCESS_ENTRY entry;
-        KERNEL_USER_TIMES times;
-        PPH_STRING fileName;
+        if (NT_SUCCESS(status = PhGetProcessTimes(
+            processHandle,
+            &times
+            )) &&
+            NT_SUCCESS(status = PhGetProcessImageFileName(
+            processHandle,
+            &fileName
+            )))
+        {
+            Entry->FileName = PhGetFileName(fileName);
+            PhDereferenceObject(fileName);
 
-        status2 = PhOpenProcess(
-            &processHandle,
-            ProcessQueryAccess,
-            UlongToHandle(pid)
-            );
+            if (times.ExitTime.QuadPart != 0)
+                Entry->Type = TerminatedProcess;
+            else if (PhpIsProcessIdInSet(KnownProcessIds, ProcessId))
+                Entry->Type = NormalProcess;
+            else
+                Entry->Type = HiddenProcess;
+
+            NtClose(processHandle);
+
+            return TRUE;
+        }
+
+        NtClose(processHandle);
+    }
 
-        if (NT_SUCCESS(status2))
+    // Use an alternative method if we don't have sufficient access.
+    if (status == STATUS_ACCESS_DENIED && WindowsVersion >= WINDOWS_VISTA)
+    {
+        if (NT_SUCCESS(status = PhGetProcessImageFileNameByProcessId(ProcessId, &fileName)))
         {
-            entry.ProcessId = UlongToHandle(pid);
+            Entry->FileName = PhGetFileName(fileName);
+            PhDereferenceObject(fileName);
 
-            if (NT_SUCCESS(status2 = PhGetProcessTimes(
-                processHandle,
-                &times
-                )) &&
-                NT_SUCCESS(status2 = PhGetProcessImageFileName(
-                processHandle,
-                &fileName
-                )))
-            {
-                entry.FileName = PhGetFileName(fileName);
-                PhDereferenceObject(fileName);
+            if (PhpIsProcessIdInSet(KnownProcessIds, ProcessId))
+                Entry->Type = NormalProcess;
+            else
+                Entry->Type = HiddenProcess;
 
-                if (times.ExitTime.QuadPart != 0)
-                    entry.Type = TerminatedProcess;
-                else if (PhFindItemList(pids, UlongToHandle(pid)) != -1)
-                    entry.Type = NormalProcess;
-                else
-                    entry.Type = HiddenProcess;
+            return TRUE;
+        }
+    }
 
-                if (!Callback(&entry, Context))
-                    stop = TRUE;
+    if (status == STATUS_INVALID_CID || status == STATUS_INVALID_PARAMETER)
+        return FALSE;
 
-                PhDereferenceObject(entry.FileName);
-            }
+    Entry->FileName = NULL;
+    Entry->Type = UnknownProcess;
 
-            NtClose(processHandle);
+    return TRUE;
+}
+
+NTSTATUS NTAPI PhpBruteForceChunkFunction(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_BRUTE_FORCE_CHUNK chunk = Parameter;
+    ULONG pid;
+
+    for (pid = chunk->StartProcessId; pid < chunk->EndProcessId; pid += 4)
+    {
+        PH_HIDDEN_PROCESS_ENTRY entry;
+
+        if (PhpProbeHiddenProcessId(UlongToHandle(pid), chunk->KnownProcessIds, &entry))
+        {
+            if (!chunk->Entries)
+                chunk->Entries = PhCreateList(4);
+
+            PhAddItemList(chunk->Entries, PhAllocateCopy(&entry, sizeof(PH_HIDDEN_PROCESS_ENTRY)));
         }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS PhpEnumHiddenProcessesBruteForce(
+    _In_ PPH_ENUM_HIDDEN_PROCESSES_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    )
+{
+    NTSTATUS status;
+    PHP_PROCESS_ID_SET knownProcessIds;
+    PPHP_BRUTE_FORCE_CHUNK chunks;
+    ULONG numberOfChunks;
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    ULONG numberOfThreads;
+    ULONG i;
+    ULONG j;
+    BOOLEAN stop = FALSE;
+
+    if (!NT_SUCCESS(status = PhpCreateProcessIdSet(&knownProcessIds)))
+        return status;
+
+    // The PID range is split into chunks which are probed in parallel. Each chunk
+    // collects its own entries so that the callback can be invoked on this thread,
+    // in PID order, once every chunk has been probed.
+    numberOfChunks = knownProcessIds.Limit / PH_HIDDEN_PROCESS_CHUNK_SIZE;
+    chunks = PhAllocate(numberOfChunks * sizeof(PHP_BRUTE_FORCE_CHUNK));
+
+    numberOfThreads = min((ULONG)PhSystemBasicInformation.NumberOfProcessors, PH_HIDDEN_PROCESS_MAXIMUM_THREADS);
+    PhInitializeWorkQueueEx(&workQueue, 0, numberOfThreads, 1000, PH_WORK_QUEUE_LOCK_FREE);
+    PhInitializeWorkQueueBatch(&workQueueBatch);
 
-        // Use an alternative method if we don't have sufficient access.
-        if (status2 == STATUS_ACCESS_DENIED && WindowsVersion >= WINDOWS_VISTA)
+    for (i = 0; i < numberOfChunks; i++)
+    {
+        PPHP_BRUTE_FORCE_CHUNK chunk = &chunks[i];
+
+        chunk->KnownProcessIds = &knownProcessIds;
+        chunk->StartProcessId = max(i * PH_HIDDEN_PROCESS_CHUNK_SIZE, 8);
+        chunk->EndProcessId = (i + 1) * PH_HIDDEN_PROCESS_CHUNK_SIZE;
+        chunk->Entries = NULL;
+
+        PhQueueItemsWorkQueueEx(&workQueue, PhpBruteForceChunkFunction, &chunk, 1, &workQueueBatch);
+    }
+
+    PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+    PhDeleteWorkQueue(&workQueue);
+
+    for (i = 0; i < numberOfChunks; i++)
+    {
+        if (!chunks[i].Entries)
+            continue;
+
+        for (j = 0; j < chunks[i].Entries->Count; j++)
         {
-            if (NT_SUCCESS(status2 = PhGetProcessImageFileNameByProcessId(UlongToHandle(pid), &fileName)))
-            {
-                entry.ProcessId = UlongToHandle(pid);
-                entry.FileName = PhGetFileName(fileName);
-                PhDereferenceObject(fileName);
+            PPH_HIDDEN_PROCESS_ENTRY entry = chunks[i].Entries->Items[j];
 
-                if (PhFindItemList(pids, UlongToHandle(pid)) != -1)
-                    entry.Type = NormalProcess;
-                else
-                    entry.Type = HiddenProcess;
+            if (!stop && !Callback(entry, Context))
+                stop = TRUE;
 
-                if (!Callback(&entry, Context))
-                    stop = TRUE;
+            if (entry->FileName)
+                PhDereferenceObject(entry->FileName);
 
-                PhDereferenceObject(entry.FileName);
-            }
+            PhFree(entry);
         }
 
-        if (status2 == STATUS_INVALID_CID || status2 == STATUS_INVALID_PARAMETER)
-            status2 = STATUS_SUCCESS;
+        PhDereferenceObject(chunks[i].Entries);
+    }
+
+    PhFree(chunks);
+    PhpDeleteProcessIdSet(&knownProcessIds);
+
+    return status;
+}
+
+NTSTATUS PhpEnumHiddenProcessesKph(
+    _In_ PPH_ENUM_HIDDEN_PROCESSES_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    )
+{
+    NTSTATUS status;
+    PHP_PROCESS_ID_SET knownProcessIds;
+    PKPH_PROCESS_ID_INFORMATION processIds;
+    ULONG i;
 
-        if (!NT_SUCCESS(status2))
+    if (!KphIsConnected())
+        return STATUS_NOT_SUPPORTED;
+
+    if (!NT_SUCCESS(status = PhpCreateProcessIdSet(&knownProcessIds)))
+        return status;
+
+    // The driver looks up every PID in the range itself, so there is no need
+    // to open a handle to each possible process.
+    status = KphEnumerateProcessIds2(
+        UlongToHandle(8),
+        UlongToHandle(knownProcessIds.Limit - 4),
+        &processIds
+        );
+
+    if (NT_SUCCESS(status))
+    {
+        for (i = 0; i < processIds->NumberOfProcesses; i++)
         {
-            entry.ProcessId = UlongToHandle(pid);
+            PKPH_PROCESS_ID_ENTRY processId = &processIds->Processes[i];
+            PH_HIDDEN_PROCESS_ENTRY entry;
+            HANDLE processHandle;
+            PPH_STRING fileName;
+            BOOLEAN cont;
+
+            entry.ProcessId = processId->ProcessId;
             entry.FileName = NULL;
-            entry.Type = UnknownProcess;
 
-            if (!Callback(&entry, Context))
-                stop = TRUE;
+            if (NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess, processId->ProcessId)))
+            {
+                if (NT_SUCCESS(PhGetProcessImageFileName(processHandle, &fileName)))
+                {
+                    entry.FileName = PhGetFileName(fileName);
+                    PhDereferenceObject(fileName);
+                }
+
+                NtClose(processHandle);
+            }
+
+            if (!entry.FileName && WindowsVersion >= WINDOWS_VISTA &&
+                NT_SUCCESS(PhGetProcessImageFileNameByProcessId(processId->ProcessId, &fileName)))
+            {
+                entry.FileName = PhGetFileName(fileName);
+                PhDereferenceObject(fileName);
+            }
+
+            if (processId->Flags & KPH_PROCESS_ID_EXITED)
+                entry.Type = TerminatedProcess;
+            else if (PhpIsProcessIdInSet(&knownProcessIds, processId->ProcessId))
+                entry.Type = NormalProcess;
+            else
+                entry.Type = HiddenProcess;
+
+            cont = Callback(&entry, Context);
+
+            if (entry.FileName)
+                PhDereferenceObject(entry.FileName);
+
+            if (!cont)
+                break;
         }
 
-        if (stop)
-            break;
+        PhFree(processIds);
     }
 
-    PhDereferenceObject(pids);
+    PhpDeleteProcessIdSet(&knownProcessIds);
 
     return status;
 }
@@ -865,7 +1081,7 @@ typedef struct _CSR_HANDLES_CONTEXT
 {
     PPH_ENUM_HIDDEN_PROCESSES_CALLBACK Callback;
     PVOID Context;
-    PPH_LIST Pids;
+    PPHP_PROCESS_ID_SET Pids;
 } CSR_HANDLES_CONTEXT, *PCSR_HANDLES_CONTEXT;
 
 static BOOLEAN NTAPI PhpCsrProcessHandlesCallback(
@@ -903,7 +1119,7 @@ static BOOLEAN NTAPI PhpCsrProcessHandlesCallback(
 
             if (times.ExitTime.QuadPart != 0)
                 entry.Type = TerminatedProcess;
-            else if (PhFindItemList(context->Pids, Handle->ProcessId) != -1)
+            else if (PhpIsProcessIdInSet(context->Pids, Handle->ProcessId))
                 entry.Type = NormalProcess;
             else
                 entry.Type = HiddenProcess;
@@ -935,32 +1151,19 @@ NTSTATUS PhpEnumHiddenProcessesCsrHandles(
     )
 {
     NTSTATUS status;
-    PVOID processes;
-    PSYSTEM_PROCESS_INFORMATION process;
-    PPH_LIST pids;
+    PHP_PROCESS_ID_SET pids;
     CSR_HANDLES_CONTEXT context;
 
-    if (!NT_SUCCESS(status = PhEnumProcesses(&processes)))
+    if (!NT_SUCCESS(status = PhpCreateProcessIdSet(&pids)))
         return status;
 
-    pids = PhCreateList(40);
-
-    process = PH_FIRST_PROCESS(processes);
-
-    do
-    {
-        PhAddItemList(pids, process->UniqueProcessId);
-    } while (process = PH_NEXT_PROCESS(process));
-
-    PhFree(processes);
-
     context.Callback = Callback;
     context.Context = Context;
-    context.Pids = pids;
+    context.Pids = &pids;
 
     status = PhEnumCsrProcessHandles(PhpCsrProcessHandlesCallback, &context);
 
-    PhDereferenceObject(pids);
+    PhpDeleteProcessIdSet(&pids);
 
     return status;
 }
@@ -978,6 +1181,13 @@ NTSTATUS PhEnumHiddenProcesses(
             Context
             );
     }
+    else if (Method == KphScanMethod)
+    {
+        return PhpEnumHiddenProcessesKph(
+            Callback,
+            Context
+            );
+    }
     else
     {
         return PhpEnumHiddenProcessesCsrHandles(
@@ -27,14 +27,14 @@
 #include <phplug.h>
 #include <emenu.h>
 
-BOOLEAN PhpHandleNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    );
-
-ULONG PhpHandleNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    );
+#undef T
+#undef K
+#define T PPH_HANDLE_NODE
+#define K HANDLE
+#define PH_OPEN_HASHTABLE_KEY(Entry) ((Entry)->Handle)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_HANDLE
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_SCALAR
+#include <ohashtbl_i.h>
 
 VOID PhpDestroyHandleNode(
     _In_ PPH_HANDLE_NODE HandleNode
@@ -60,6 +60,15 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
     _In_opt_ PVOID Context
     );
 
+FORCEINLINE VOID PhpResolveHandleNodeNames(
+    _In_ PPH_HANDLE_LIST_CONTEXT Context,
+    _In_ PPH_HANDLE_NODE HandleNode
+    )
+{
+    if (HandleNode->HandleItem->NamesPending && Context->Provider)
+        PhResolveHandleItemNames(Context->Provider, HandleNode->HandleItem);
+}
+
 VOID PhInitializeHandleList(
     _In_ HWND ParentWindowHandle,
     _In_ HWND TreeNewHandle,
@@ -71,13 +80,8 @@ VOID PhInitializeHandleList(
     memset(Context, 0, sizeof(PH_HANDLE_LIST_CONTEXT));
     Context->EnableStateHighlighting = TRUE;
 
-    Context->NodeHashtable = PhCreateHashtable(
-        sizeof(PPH_HANDLE_NODE),
-        PhpHandleNodeHashtableCompareFunction,
-        PhpHandleNodeHashtableHashFunction,
-        100
-        );
-    Context->NodeList = PhCreateList(100);
+    PhInitializeOpenHashtable_PPH_HANDLE_NODE(&Context->NodeHashtable, 100);
+    PhInitializeArray_PPH_HANDLE_NODE(&Context->NodeList, 100);
 
     Context->ParentWindowHandle = ParentWindowHandle;
     Context->TreeNewHandle = TreeNewHandle;
@@ -115,29 +119,11 @@ VOID PhDeleteHandleList(
 
     PhCmDeleteManager(&Context->Cm);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
-        PhpDestroyHandleNode(Context->NodeList->Items[i]);
-
-    PhDereferenceObject(Context->NodeHashtable);
-    PhDereferenceObject(Context->NodeList);
-}
-
-BOOLEAN PhpHandleNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    )
-{
-    PPH_HANDLE_NODE handleNode1 = *(PPH_HANDLE_NODE *)Entry1;
-    PPH_HANDLE_NODE handleNode2 = *(PPH_HANDLE_NODE *)Entry2;
+    for (i = 0; i < Context->NodeList.Count; i++)
+        PhpDestroyHandleNode(Context->NodeList.Items[i]);
 
-    return handleNode1->Handle == handleNode2->Handle;
-}
-
-ULONG PhpHandleNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    )
-{
-    return HandleToUlong((*(PPH_HANDLE_NODE *)Entry)->Handle) / 4;
+    PhDeleteOpenHashtable_PPH_HANDLE_NODE(&Context->NodeHashtable);
+    PhDeleteArray_PPH_HANDLE_NODE(&Context->NodeList);
 }
 
 VOID PhLoadSettingsHandleList(
@@ -182,15 +168,20 @@ VOID PhSetOptionsHandleList(
 
         modified = FALSE;
 
-        for (i = 0; i < Context->NodeList->Count; i++)
+        for (i = 0; i < Context->NodeList.Count; i++)
         {
-            PPH_HANDLE_NODE node = Context->NodeList->Items[i];
+            PPH_HANDLE_NODE node = Context->NodeList.Items[i];
             BOOLEAN visible;
 
             visible = TRUE;
 
-            if (HideUnnamedHandles && PhIsNullOrEmptyString(node->HandleItem->BestObjectName))
-                visible = FALSE;
+            if (HideUnnamedHandles)
+            {
+                PhpResolveHandleNodeNames(Context, node);
+
+                if (PhIsNullOrEmptyString(node->HandleItem->BestObjectName))
+                    visible = FALSE;
+            }
 
             if (node->Node.Visible != visible)
             {
@@ -241,11 +232,16 @@ PPH_HANDLE_NODE PhAddHandleNode(
     handleNode->Node.TextCache = handleNode->TextCache;
     handleNode->Node.TextCacheSize = PHHNTLC_MAXIMUM;
 
-    PhAddEntryHashtable(Context->NodeHashtable, &handleNode);
-    PhAddItemList(Context->NodeList, handleNode);
+    PhAddEntryOpenHashtable_PPH_HANDLE_NODE(&Context->NodeHashtable, handleNode, NULL);
+    PhAddItemArray_PPH_HANDLE_NODE(&Context->NodeList, handleNode);
 
-    if (Context->HideUnnamedHandles && PhIsNullOrEmptyString(HandleItem->BestObjectName))
-        handleNode->Node.Visible = FALSE;
+    if (Context->HideUnnamedHandles)
+    {
+        PhpResolveHandleNodeNames(Context, handleNode);
+
+        if (PhIsNullOrEmptyString(HandleItem->BestObjectName))
+            handleNode->Node.Visible = FALSE;
+    }
 
     PhEmCallObjectOperation(EmHandleNodeType, handleNode, EmObjectCreate);
 
@@ -259,16 +255,9 @@ PPH_HANDLE_NODE PhFindHandleNode(
     _In_ HANDLE Handle
     )
 {
-    PH_HANDLE_NODE lookupHandleNode;
-    PPH_HANDLE_NODE lookupHandleNodePtr = &lookupHandleNode;
     PPH_HANDLE_NODE *handleNode;
 
-    lookupHandleNode.Handle = Handle;
-
-    handleNode = (PPH_HANDLE_NODE *)PhFindEntryHashtable(
-        Context->NodeHashtable,
-        &lookupHandleNodePtr
-        );
+    handleNode = PhFindEntryOpenHashtable_PPH_HANDLE_NODE(&Context->NodeHashtable, Handle);
 
     if (handleNode)
         return *handleNode;
@@ -282,7 +271,7 @@ VOID PhRemoveHandleNode(
     )
 {
     // Remove from the hashtable here to avoid problems in case the key is re-used.
-    PhRemoveEntryHashtable(Context->NodeHashtable, &HandleNode);
+    PhRemoveEntryOpenHashtable_PPH_HANDLE_NODE(&Context->NodeHashtable, HandleNode->Handle);
 
     if (Context->EnableStateHighlighting)
     {
@@ -308,6 +297,8 @@ VOID PhpDestroyHandleNode(
     PhEmCallObjectOperation(EmHandleNodeType, HandleNode, EmObjectDelete);
 
     if (HandleNode->GrantedAccessSymbolicText) PhDereferenceObject(HandleNode->GrantedAccessSymbolicText);
+    if (HandleNode->NameSortKeySource) PhDereferenceObject(HandleNode->NameSortKeySource);
+    if (HandleNode->NameSortKey) PhDereferenceObject(HandleNode->NameSortKey);
 
     PhDereferenceObject(HandleNode->HandleItem);
 
@@ -323,8 +314,8 @@ VOID PhpRemoveHandleNode(
 
     // Remove from list and cleanup.
 
-    if ((index = PhFindItemList(Context->NodeList, HandleNode)) != -1)
-        PhRemoveItemList(Context->NodeList, index);
+    if ((index = PhFindItemArray_PPH_HANDLE_NODE(&Context->NodeList, HandleNode)) != -1)
+        PhRemoveItemArray_PPH_HANDLE_NODE(&Context->NodeList, index);
 
     PhpDestroyHandleNode(HandleNode);
 
@@ -390,9 +381,28 @@ BEGIN_SORT_FUNCTION(Type)
 }
 END_SORT_FUNCTION
 
+static PPH_BYTES PhpGetHandleNodeNameSortKey(
+    _In_ PPH_HANDLE_NODE HandleNode
+    )
+{
+    PPH_STRING name = HandleNode->HandleItem->BestObjectName;
+
+    // The name may be resolved after the node is created, so the key is recreated whenever the
+    // name changes.
+    if (!HandleNode->NameSortKey || HandleNode->NameSortKeySource != name)
+    {
+        PH_STRINGREF nameSr = PhGetStringRef(name);
+
+        PhSetReference(&HandleNode->NameSortKeySource, name);
+        PhMoveReference(&HandleNode->NameSortKey, PhCreateNaturalSortKey(&nameSr, TRUE));
+    }
+
+    return HandleNode->NameSortKey;
+}
+
 BEGIN_SORT_FUNCTION(Name)
 {
-    sortResult = PhCompareStringWithNull(handleItem1->BestObjectName, handleItem2->BestObjectName, TRUE);
+    sortResult = PhCompareNaturalSortKey(PhpGetHandleNodeNameSortKey(node1), PhpGetHandleNodeNameSortKey(node2));
 }
 END_SORT_FUNCTION
 
@@ -475,8 +485,8 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
                 int (__cdecl *sortFunction)(void *, const void *, const void *);
 
                 if (!PhCmForwardSort(
-                    (PPH_TREENEW_NODE *)context->NodeList->Items,
-                    context->NodeList->Count,
+                    (PPH_TREENEW_NODE *)context->NodeList.Items,
+                    context->NodeList.Count,
                     context->TreeNewSortColumn,
                     context->TreeNewSortOrder,
                     &context->Cm
@@ -494,11 +504,20 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
 
                 if (sortFunction)
                 {
-                    qsort_s(context->NodeList->Items, context->NodeList->Count, sizeof(PVOID), sortFunction, context);
+                    // Names must be available for all nodes before we can sort by them.
+                    if (context->TreeNewSortColumn == PHHNTLC_NAME || context->TreeNewSortColumn == PHHNTLC_ORIGINALNAME)
+                    {
+                        ULONG i;
+
+                        for (i = 0; i < context->NodeList.Count; i++)
+                            PhpResolveHandleNodeNames(context, context->NodeList.Items[i]);
+                    }
+
+                    qsort_s(context->NodeList.Items, context->NodeList.Count, sizeof(PPH_HANDLE_NODE), sortFunction, context);
                 }
 
-                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList->Items;
-                getChildren->NumberOfChildren = context->NodeList->Count;
+                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList.Items;
+                getChildren->NumberOfChildren = context->NodeList.Count;
             }
         }
         return TRUE;
@@ -513,6 +532,7 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
         {
             PPH_TREENEW_GET_CELL_TEXT getCellText = Parameter1;
             PPH_HANDLE_ITEM handleItem;
+            BOOLEAN cache = TRUE;
 
             node = (PPH_HANDLE_NODE)getCellText->Node;
             handleItem = node->HandleItem;
@@ -523,13 +543,19 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
                 getCellText->Text = handleItem->TypeName->sr;
                 break;
             case PHHNTLC_NAME:
+                PhpResolveHandleNodeNames(context, node);
                 getCellText->Text = PhGetStringRef(handleItem->BestObjectName);
                 break;
             case PHHNTLC_HANDLE:
-                PhInitializeStringRefLongHint(&getCellText->Text, handleItem->HandleString);
+                // Hex values are cheap to format, so they aren't stored with every handle.
+                PhPrintPointer(context->CellText, (PVOID)handleItem->Handle);
+                PhInitializeStringRefLongHint(&getCellText->Text, context->CellText);
+                cache = FALSE;
                 break;
             case PHHNTLC_OBJECTADDRESS:
-                PhInitializeStringRefLongHint(&getCellText->Text, handleItem->ObjectString);
+                PhPrintPointer(context->CellText, handleItem->Object);
+                PhInitializeStringRefLongHint(&getCellText->Text, context->CellText);
+                cache = FALSE;
                 break;
             case PHHNTLC_ATTRIBUTES:
                 switch (handleItem->Attributes & (OBJ_PROTECT_CLOSE | OBJ_INHERIT))
@@ -546,7 +572,9 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
                 }
                 break;
             case PHHNTLC_GRANTEDACCESS:
-                PhInitializeStringRefLongHint(&getCellText->Text, handleItem->GrantedAccessString);
+                PhPrintPointer(context->CellText, UlongToPtr(handleItem->GrantedAccess));
+                PhInitializeStringRefLongHint(&getCellText->Text, context->CellText);
+                cache = FALSE;
                 break;
             case PHHNTLC_GRANTEDACCESSSYMBOLIC:
                 if (handleItem->GrantedAccess != 0)
@@ -568,12 +596,19 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
                     }
 
                     if (node->GrantedAccessSymbolicText->Length != 0)
+                    {
                         getCellText->Text = node->GrantedAccessSymbolicText->sr;
+                    }
                     else
-                        PhInitializeStringRefLongHint(&getCellText->Text, handleItem->GrantedAccessString);
+                    {
+                        PhPrintPointer(context->CellText, UlongToPtr(handleItem->GrantedAccess));
+                        PhInitializeStringRefLongHint(&getCellText->Text, context->CellText);
+                        cache = FALSE;
+                    }
                 }
                 break;
             case PHHNTLC_ORIGINALNAME:
+                PhpResolveHandleNodeNames(context, node);
                 getCellText->Text = PhGetStringRef(handleItem->ObjectName);
                 break;
             case PHHNTLC_FILESHAREACCESS:
@@ -598,7 +633,8 @@ BOOLEAN NTAPI PhpHandleTreeNewCallback(
                 return FALSE;
             }
 
-            getCellText->Flags = TN_CACHE;
+            if (cache)
+                getCellText->Flags = TN_CACHE;
         }
         return TRUE;
     case TreeNewGetNodeColor:
@@ -704,12 +740,13 @@ PPH_HANDLE_ITEM PhGetSelectedHandleItem(
     PPH_HANDLE_ITEM handleItem = NULL;
     ULONG i;
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_HANDLE_NODE node = Context->NodeList->Items[i];
+        PPH_HANDLE_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
+            PhpResolveHandleNodeNames(Context, node);
             handleItem = node->HandleItem;
             break;
         }
@@ -729,12 +766,13 @@ VOID PhGetSelectedHandleItems(
 
     list = PhCreateList(2);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_HANDLE_NODE node = Context->NodeList->Items[i];
+        PPH_HANDLE_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
+            PhpResolveHandleNodeNames(Context, node);
             PhAddItemList(list, node->HandleItem);
         }
     }
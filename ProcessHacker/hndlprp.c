@@ -241,12 +241,17 @@ INT_PTR CALLBACK PhpHandleGeneralDlgProc(
             HANDLE processHandle;
             OBJECT_BASIC_INFORMATION basicInfo;
             BOOLEAN haveBasicInfo = FALSE;
+            WCHAR objectString[PH_PTR_STR_LEN_1];
+            WCHAR grantedAccessString[PH_PTR_STR_LEN_1];
 
             SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)context);
 
+            PhPrintPointer(objectString, context->HandleItem->Object);
+            PhPrintPointer(grantedAccessString, UlongToPtr(context->HandleItem->GrantedAccess));
+
             SetDlgItemText(hwndDlg, IDC_NAME, PhGetString(context->HandleItem->BestObjectName));
             SetDlgItemText(hwndDlg, IDC_TYPE, context->HandleItem->TypeName->Buffer);
-            SetDlgItemText(hwndDlg, IDC_ADDRESS, context->HandleItem->ObjectString);
+            SetDlgItemText(hwndDlg, IDC_ADDRESS, objectString);
 
             if (PhGetAccessEntries(
                 context->HandleItem->TypeName->Buffer,
@@ -255,7 +260,7 @@ INT_PTR CALLBACK PhpHandleGeneralDlgProc(
                 ))
             {
                 PPH_STRING accessString;
-                PPH_STRING grantedAccessString;
+                PPH_STRING grantedAccessAndSymbolicString;
 
                 accessString = PhGetAccessString(
                     context->HandleItem->GrantedAccess,
@@ -265,17 +270,17 @@ INT_PTR CALLBACK PhpHandleGeneralDlgProc(
 
                 if (accessString->Length != 0)
                 {
-                    grantedAccessString = PhFormatString(
+                    grantedAccessAndSymbolicString = PhFormatString(
                         L"%s (%s)",
-                        context->HandleItem->GrantedAccessString,
+                        grantedAccessString,
                         accessString->Buffer
                         );
-                    SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, grantedAccessString->Buffer);
-                    PhDereferenceObject(grantedAccessString);
+                    SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, grantedAccessAndSymbolicString->Buffer);
+                    PhDereferenceObject(grantedAccessAndSymbolicString);
                 }
                 else
                 {
-                    SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, context->HandleItem->GrantedAccessString);
+                    SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, grantedAccessString);
                 }
 
                 PhDereferenceObject(accessString);
@@ -284,7 +289,7 @@ INT_PTR CALLBACK PhpHandleGeneralDlgProc(
             }
             else
             {
-                SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, context->HandleItem->GrantedAccessString);
+                SetDlgItemText(hwndDlg, IDC_GRANTED_ACCESS, grantedAccessString);
             }
 
             if (NT_SUCCESS(PhOpenProcess(
@@ -30,6 +30,14 @@ typedef struct _PHP_CREATE_HANDLE_ITEM_CONTEXT
     PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX Handle;
 } PHP_CREATE_HANDLE_ITEM_CONTEXT, *PPHP_CREATE_HANDLE_ITEM_CONTEXT;
 
+typedef struct _PHP_HANDLE_NAME_CACHE_ITEM
+{
+    PVOID Object;
+    ULONG RefCount; // number of handle items using this entry
+    PPH_STRING ObjectName;
+    PPH_STRING BestObjectName;
+} PHP_HANDLE_NAME_CACHE_ITEM, *PPHP_HANDLE_NAME_CACHE_ITEM;
+
 VOID NTAPI PhpHandleProviderDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
@@ -40,9 +48,24 @@ VOID NTAPI PhpHandleItemDeleteProcedure(
     _In_ ULONG Flags
     );
 
+BOOLEAN PhpHandleNameCacheHashtableCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    );
+
+ULONG NTAPI PhpHandleNameCacheHashtableHashFunction(
+    _In_ PVOID Entry
+    );
+
 PPH_OBJECT_TYPE PhHandleProviderType;
 PPH_OBJECT_TYPE PhHandleItemType;
 
+// Object names are shared between handles (and processes) referring to the same object.
+static PPH_HASHTABLE PhpHandleNameCacheHashtable;
+static PH_QUEUED_LOCK PhpHandleNameCacheHashtableLock = PH_QUEUED_LOCK_INIT;
+// Interned type names by object type number, never freed.
+static PPH_STRING PhpHandleTypeNames[MAX_OBJECT_TYPE_NUMBER];
+
 BOOLEAN PhHandleProviderInitialization(
     VOID
     )
@@ -50,6 +73,20 @@ BOOLEAN PhHandleProviderInitialization(
     PhHandleProviderType = PhCreateObjectType(L"HandleProvider", 0, PhpHandleProviderDeleteProcedure);
     PhHandleItemType = PhCreateObjectType(L"HandleItem", 0, PhpHandleItemDeleteProcedure);
 
+    PhpHandleNameCacheHashtable = PhCreateHashtable(
+        sizeof(PPHP_HANDLE_NAME_CACHE_ITEM),
+        PhpHandleNameCacheHashtableCompareFunction,
+        PhpHandleNameCacheHashtableHashFunction,
+        64
+        );
+
+    PhRegisterCallback(
+        &PhProcessesUpdatedEvent,
+        PhpHandleSnapshotProcessesUpdatedHandler,
+        NULL,
+        &PhpHandleSnapshotProcessesUpdatedRegistration
+        );
+
     return TRUE;
 }
 
@@ -84,6 +121,8 @@ PPH_HANDLE_PROVIDER PhCreateHandleProvider(
         );
 
     handleProvider->TempListHashtable = PhCreateSimpleHashtable(20);
+    handleProvider->HandleDigest = NULL;
+    handleProvider->LazyNames = FALSE;
 
     PhEmCallObjectOperation(EmHandleProviderType, handleProvider, EmObjectCreate);
 
@@ -111,6 +150,8 @@ VOID PhpHandleProviderDeleteProcedure(
     if (handleProvider->ProcessHandle) NtClose(handleProvider->ProcessHandle);
 
     PhDereferenceObject(handleProvider->TempListHashtable);
+
+    if (handleProvider->HandleDigest) PhFree(handleProvider->HandleDigest);
 }
 
 PPH_HANDLE_ITEM PhCreateHandleItem(
@@ -128,12 +169,10 @@ PPH_HANDLE_ITEM PhCreateHandleItem(
     if (Handle)
     {
         handleItem->Handle = (HANDLE)Handle->HandleValue;
-        PhPrintPointer(handleItem->HandleString, (PVOID)handleItem->Handle);
         handleItem->Object = Handle->Object;
-        PhPrintPointer(handleItem->ObjectString, handleItem->Object);
         handleItem->Attributes = Handle->HandleAttributes;
         handleItem->GrantedAccess = (ACCESS_MASK)Handle->GrantedAccess;
-        PhPrintPointer(handleItem->GrantedAccessString, UlongToPtr(handleItem->GrantedAccess));
+        handleItem->TypeIndex = Handle->ObjectTypeIndex;
     }
 
     PhEmCallObjectOperation(EmHandleItemType, handleItem, EmObjectCreate);
@@ -141,6 +180,67 @@ PPH_HANDLE_ITEM PhCreateHandleItem(
     return handleItem;
 }
 
+BOOLEAN PhpHandleNameCacheHashtableCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPHP_HANDLE_NAME_CACHE_ITEM cacheItem1 = *(PPHP_HANDLE_NAME_CACHE_ITEM *)Entry1;
+    PPHP_HANDLE_NAME_CACHE_ITEM cacheItem2 = *(PPHP_HANDLE_NAME_CACHE_ITEM *)Entry2;
+
+    return cacheItem1->Object == cacheItem2->Object;
+}
+
+ULONG NTAPI PhpHandleNameCacheHashtableHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPHP_HANDLE_NAME_CACHE_ITEM cacheItem = *(PPHP_HANDLE_NAME_CACHE_ITEM *)Entry;
+
+    return PhHashIntPtr((ULONG_PTR)cacheItem->Object);
+}
+
+PPHP_HANDLE_NAME_CACHE_ITEM PhpLookupHandleNameCacheItem(
+    _In_ PVOID Object
+    )
+{
+    PHP_HANDLE_NAME_CACHE_ITEM lookupCacheItem;
+    PPHP_HANDLE_NAME_CACHE_ITEM lookupCacheItemPtr = &lookupCacheItem;
+    PPHP_HANDLE_NAME_CACHE_ITEM *cacheItemPtr;
+
+    lookupCacheItem.Object = Object;
+    cacheItemPtr = (PPHP_HANDLE_NAME_CACHE_ITEM *)PhFindEntryHashtable(
+        PhpHandleNameCacheHashtable,
+        &lookupCacheItemPtr
+        );
+
+    if (cacheItemPtr)
+        return *cacheItemPtr;
+    else
+        return NULL;
+}
+
+VOID PhpDereferenceHandleNameCacheItem(
+    _In_ PVOID Object
+    )
+{
+    PPHP_HANDLE_NAME_CACHE_ITEM cacheItem;
+
+    PhAcquireQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+
+    cacheItem = PhpLookupHandleNameCacheItem(Object);
+
+    if (cacheItem && --cacheItem->RefCount == 0)
+    {
+        PhRemoveEntryHashtable(PhpHandleNameCacheHashtable, &cacheItem);
+        PhClearReference(&cacheItem->ObjectName);
+        PhClearReference(&cacheItem->BestObjectName);
+        PhFree(cacheItem);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+}
+
 VOID PhpHandleItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
@@ -150,6 +250,9 @@ VOID PhpHandleItemDeleteProcedure(
 
     PhEmCallObjectOperation(EmHandleItemType, handleItem, EmObjectDelete);
 
+    if (handleItem->NameCacheReferenced)
+        PhpDereferenceHandleNameCacheItem(handleItem->Object);
+
     if (handleItem->TypeName) PhDereferenceObject(handleItem->TypeName);
     if (handleItem->ObjectName) PhDereferenceObject(handleItem->ObjectName);
     if (handleItem->BestObjectName) PhDereferenceObject(handleItem->BestObjectName);
@@ -170,6 +273,62 @@ FORCEINLINE ULONG PhHashHandleItem(
     return HandleToUlong(Value->Handle) / 4;
 }
 
+/**
+ * Gets the name of an object type. The name is only queried from the handle the first
+ * time a type is seen.
+ *
+ * \param ProcessHandle A handle to the process which owns the handle.
+ * \param Handle The handle.
+ * \param TypeIndex The object type number of the handle.
+ *
+ * \return A referenced interned string, or NULL if the type name could not be queried.
+ */
+PPH_STRING PhpReferenceHandleTypeName(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE Handle,
+    _In_ ULONG TypeIndex
+    )
+{
+    PPH_STRING typeName;
+
+    if (TypeIndex < MAX_OBJECT_TYPE_NUMBER && (typeName = PhpHandleTypeNames[TypeIndex]))
+    {
+        PhReferenceObject(typeName);
+        return typeName;
+    }
+
+    typeName = NULL;
+    PhGetHandleInformationEx(
+        ProcessHandle,
+        Handle,
+        TypeIndex,
+        0,
+        NULL,
+        NULL,
+        &typeName,
+        NULL,
+        NULL,
+        NULL
+        );
+
+    if (!typeName)
+        return NULL;
+
+    // There are only a few dozen object types, shared by every handle.
+    PhMoveReference(&typeName, PhInternString(typeName));
+
+    if (TypeIndex < MAX_OBJECT_TYPE_NUMBER)
+    {
+        PhReferenceObject(typeName);
+
+        // Handle items can be created on several threads at once (see PhpCreateHandleItemFunction).
+        if (_InterlockedCompareExchangePointer(&PhpHandleTypeNames[TypeIndex], typeName, NULL) != NULL)
+            PhDereferenceObject(typeName);
+    }
+
+    return typeName;
+}
+
 PPH_HANDLE_ITEM PhpLookupHandleItem(
     _In_ PPH_HANDLE_PROVIDER HandleProvider,
     _In_ HANDLE Handle
@@ -241,6 +400,102 @@ VOID PhDereferenceAllHandleItems(
     PhReleaseQueuedLockExclusive(&HandleProvider->HandleHashSetLock);
 }
 
+/**
+ * Resolves the object names of a handle item created by a provider
+ * in lazy name mode.
+ *
+ * \param HandleProvider The provider which created the handle item.
+ * \param HandleItem The handle item.
+ *
+ * \return TRUE if the names of the handle item were resolved by this
+ * call, otherwise FALSE if they were already available.
+ */
+BOOLEAN PhResolveHandleItemNames(
+    _In_ PPH_HANDLE_PROVIDER HandleProvider,
+    _In_ PPH_HANDLE_ITEM HandleItem
+    )
+{
+    PPHP_HANDLE_NAME_CACHE_ITEM cacheItem;
+    PPH_STRING objectName = NULL;
+    PPH_STRING bestObjectName = NULL;
+    BOOLEAN result = FALSE;
+
+    if (!HandleItem->NamesPending)
+        return FALSE;
+
+    // Another handle to the same object may have been resolved already.
+    if (HandleItem->Object)
+    {
+        PhAcquireQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+
+        if (HandleItem->NamesPending && (cacheItem = PhpLookupHandleNameCacheItem(HandleItem->Object)))
+        {
+            PhSetReference(&HandleItem->ObjectName, cacheItem->ObjectName);
+            PhSetReference(&HandleItem->BestObjectName, cacheItem->BestObjectName);
+            cacheItem->RefCount++;
+            HandleItem->NameCacheReferenced = TRUE;
+            MemoryBarrier();
+            HandleItem->NamesPending = FALSE;
+            result = TRUE;
+        }
+
+        PhReleaseQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+
+        if (result)
+            return TRUE;
+    }
+
+    PhGetHandleInformationEx(
+        HandleProvider->ProcessHandle,
+        HandleItem->Handle,
+        -1,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        &objectName,
+        &bestObjectName,
+        NULL
+        );
+
+    PhAcquireQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+
+    if (HandleItem->NamesPending)
+    {
+        PhMoveReference(&HandleItem->ObjectName, objectName);
+        PhMoveReference(&HandleItem->BestObjectName, bestObjectName);
+        objectName = NULL;
+        bestObjectName = NULL;
+
+        if (HandleItem->Object)
+        {
+            if (!(cacheItem = PhpLookupHandleNameCacheItem(HandleItem->Object)))
+            {
+                cacheItem = PhAllocate(sizeof(PHP_HANDLE_NAME_CACHE_ITEM));
+                cacheItem->Object = HandleItem->Object;
+                cacheItem->RefCount = 0;
+                PhSetReference(&cacheItem->ObjectName, HandleItem->ObjectName);
+                PhSetReference(&cacheItem->BestObjectName, HandleItem->BestObjectName);
+                PhAddEntryHashtable(PhpHandleNameCacheHashtable, &cacheItem);
+            }
+
+            cacheItem->RefCount++;
+            HandleItem->NameCacheReferenced = TRUE;
+        }
+
+        MemoryBarrier();
+        HandleItem->NamesPending = FALSE;
+        result = TRUE;
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpHandleNameCacheHashtableLock);
+
+    PhClearReference(&objectName);
+    PhClearReference(&bestObjectName);
+
+    return result;
+}
+
 VOID PhpAddHandleItem(
     _In_ PPH_HANDLE_PROVIDER HandleProvider,
     _In_ _Assume_refs_(1) PPH_HANDLE_ITEM HandleItem
@@ -274,6 +529,453 @@ VOID PhpRemoveHandleItem(
     PhDereferenceObject(HandleItem);
 }
 
+#define PHP_HANDLE_SNAPSHOT_RETAIN_TIME 2000
+#define PHP_HANDLE_SNAPSHOT_PARALLEL_THRESHOLD 0x10000
+#define PHP_HANDLE_SNAPSHOT_MAXIMUM_CHUNKS 8
+
+typedef struct _PHP_HANDLE_SNAPSHOT_RUN
+{
+    ULONG_PTR ProcessId;
+    ULONG Start;
+    ULONG Count;
+} PHP_HANDLE_SNAPSHOT_RUN, *PPHP_HANDLE_SNAPSHOT_RUN;
+
+typedef struct _PHP_SORT_HANDLE_INDEX_CONTEXT
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX Handles;
+    PULONG Index;
+    ULONG Count;
+} PHP_SORT_HANDLE_INDEX_CONTEXT, *PPHP_SORT_HANDLE_INDEX_CONTEXT;
+
+static PPH_OBJECT_TYPE PhpHandleSnapshotType = NULL;
+static PH_QUEUED_LOCK PhpHandleSnapshotLock = PH_QUEUED_LOCK_INIT;
+static PPH_HANDLE_SNAPSHOT PhpHandleSnapshot = NULL;
+static PH_CALLBACK_REGISTRATION PhpHandleSnapshotProcessesUpdatedRegistration;
+
+static VOID NTAPI PhpHandleSnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_HANDLE_SNAPSHOT snapshot = Object;
+
+    PhFree(snapshot->Information);
+    PhFree(snapshot->ProcessIndex);
+
+    if (snapshot->ObjectIndex)
+        PhFree(snapshot->ObjectIndex);
+}
+
+static int __cdecl PhpHandleSnapshotRunCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPHP_HANDLE_SNAPSHOT_RUN run1 = (PPHP_HANDLE_SNAPSHOT_RUN)elem1;
+    PPHP_HANDLE_SNAPSHOT_RUN run2 = (PPHP_HANDLE_SNAPSHOT_RUN)elem2;
+    int result;
+
+    result = uintptrcmp(run1->ProcessId, run2->ProcessId);
+
+    if (result == 0)
+        result = uintcmp(run1->Start, run2->Start);
+
+    return result;
+}
+
+static int __cdecl PhpHandleSnapshotObjectIndexCompare(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles = context;
+    ULONG index1 = *(PULONG)elem1;
+    ULONG index2 = *(PULONG)elem2;
+    int result;
+
+    result = uintptrcmp((ULONG_PTR)handles[index1].Object, (ULONG_PTR)handles[index2].Object);
+
+    // Keep the handles to each object in snapshot order.
+    if (result == 0)
+        result = uintcmp(index1, index2);
+
+    return result;
+}
+
+static NTSTATUS PhpSortHandleIndexFunction(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_SORT_HANDLE_INDEX_CONTEXT context = Parameter;
+
+    qsort_s(context->Index, context->Count, sizeof(ULONG), PhpHandleSnapshotObjectIndexCompare, context->Handles);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID PhpBuildHandleSnapshotProcessIndex(
+    _Inout_ PPH_HANDLE_SNAPSHOT Snapshot
+    )
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles = Snapshot->Information->Handles;
+    PPHP_HANDLE_SNAPSHOT_RUN runs;
+    ULONG allocatedRuns;
+    ULONG numberOfRuns;
+    ULONG i;
+    ULONG j;
+    ULONG k;
+
+    // The kernel returns the handles of each process in a contiguous run, so sorting
+    // the runs is much cheaper than sorting the handles themselves.
+
+    allocatedRuns = 256;
+    runs = PhAllocate(allocatedRuns * sizeof(PHP_HANDLE_SNAPSHOT_RUN));
+    numberOfRuns = 0;
+
+    for (i = 0; i < Snapshot->NumberOfHandles; i++)
+    {
+        if (numberOfRuns != 0 && runs[numberOfRuns - 1].ProcessId == handles[i].UniqueProcessId)
+        {
+            runs[numberOfRuns - 1].Count++;
+            continue;
+        }
+
+        if (numberOfRuns == allocatedRuns)
+        {
+            allocatedRuns *= 2;
+            runs = PhReAllocate(runs, allocatedRuns * sizeof(PHP_HANDLE_SNAPSHOT_RUN));
+        }
+
+        runs[numberOfRuns].ProcessId = handles[i].UniqueProcessId;
+        runs[numberOfRuns].Start = i;
+        runs[numberOfRuns].Count = 1;
+        numberOfRuns++;
+    }
+
+    qsort(runs, numberOfRuns, sizeof(PHP_HANDLE_SNAPSHOT_RUN), PhpHandleSnapshotRunCompare);
+
+    k = 0;
+
+    for (i = 0; i < numberOfRuns; i++)
+    {
+        for (j = 0; j < runs[i].Count; j++)
+            Snapshot->ProcessIndex[k++] = runs[i].Start + j;
+    }
+
+    PhFree(runs);
+}
+
+static VOID PhpBuildHandleSnapshotObjectIndex(
+    _Inout_ PPH_HANDLE_SNAPSHOT Snapshot
+    )
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles = Snapshot->Information->Handles;
+    ULONG count = Snapshot->NumberOfHandles;
+    PULONG index;
+    ULONG numberOfChunks;
+    ULONG chunkSize;
+    ULONG i;
+
+    index = PhAllocate(max(count, 1) * sizeof(ULONG));
+
+    for (i = 0; i < count; i++)
+        index[i] = i;
+
+    numberOfChunks = min(PhSystemBasicInformation.NumberOfProcessors, PHP_HANDLE_SNAPSHOT_MAXIMUM_CHUNKS);
+
+    if (count < PHP_HANDLE_SNAPSHOT_PARALLEL_THRESHOLD || numberOfChunks < 2)
+    {
+        qsort_s(index, count, sizeof(ULONG), PhpHandleSnapshotObjectIndexCompare, handles);
+    }
+    else
+    {
+        PH_WORK_QUEUE workQueue;
+        PH_WORK_QUEUE_BATCH workQueueBatch;
+        PHP_SORT_HANDLE_INDEX_CONTEXT chunks[PHP_HANDLE_SNAPSHOT_MAXIMUM_CHUNKS];
+        PVOID contexts[PHP_HANDLE_SNAPSHOT_MAXIMUM_CHUNKS];
+        PULONG buffer;
+        PULONG source;
+        PULONG destination;
+        ULONG width;
+
+        // Sort the index in chunks on separate threads, then merge the chunks.
+
+        chunkSize = (count + numberOfChunks - 1) / numberOfChunks;
+
+        for (i = 0; i < numberOfChunks; i++)
+        {
+            chunks[i].Handles = handles;
+            chunks[i].Index = &index[i * chunkSize];
+            chunks[i].Count = min(chunkSize, count - i * chunkSize);
+            contexts[i] = &chunks[i];
+        }
+
+        PhInitializeWorkQueueEx(&workQueue, 0, numberOfChunks, 1000, 0);
+        PhInitializeWorkQueueBatch(&workQueueBatch);
+        PhQueueItemsWorkQueueEx(&workQueue, PhpSortHandleIndexFunction, contexts, numberOfChunks, &workQueueBatch);
+        PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+        PhDeleteWorkQueue(&workQueue);
+
+        buffer = PhAllocate(count * sizeof(ULONG));
+        source = index;
+        destination = buffer;
+
+        for (width = chunkSize; width < count; width *= 2)
+        {
+            ULONG start;
+
+            for (start = 0; start < count; start += width * 2)
+            {
+                ULONG left = start;
+                ULONG middle = min(start + width, count);
+                ULONG right = middle;
+                ULONG end = min(start + width * 2, count);
+                ULONG k = start;
+
+                while (left < middle && right < end)
+                {
+                    if (PhpHandleSnapshotObjectIndexCompare(handles, &source[left], &source[right]) <= 0)
+                        destination[k++] = source[left++];
+                    else
+                        destination[k++] = source[right++];
+                }
+
+                while (left < middle)
+                    destination[k++] = source[left++];
+                while (right < end)
+                    destination[k++] = source[right++];
+            }
+
+            source = destination;
+            destination = source == index ? buffer : index;
+        }
+
+        if (source != index)
+            memcpy(index, source, count * sizeof(ULONG));
+
+        PhFree(buffer);
+    }
+
+    Snapshot->ObjectIndex = index;
+}
+
+/**
+ * Creates a handle snapshot from handle information.
+ *
+ * \param Information The handle information, allocated with PhAllocate. The snapshot takes
+ * ownership of it.
+ * \param Snapshot A variable which receives the snapshot.
+ */
+VOID PhCreateHandleSnapshot(
+    _In_ PSYSTEM_HANDLE_INFORMATION_EX Information,
+    _Out_ PPH_HANDLE_SNAPSHOT *Snapshot
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PSYSTEM_HANDLE_INFORMATION_EX information = Information;
+    PPH_HANDLE_SNAPSHOT snapshot;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpHandleSnapshotType = PhCreateObjectType(L"HandleSnapshot", 0, PhpHandleSnapshotDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    snapshot = PhCreateObject(sizeof(PH_HANDLE_SNAPSHOT), PhpHandleSnapshotType);
+    snapshot->Information = information;
+    snapshot->NumberOfHandles = (ULONG)information->NumberOfHandles;
+    snapshot->CreateTickCount = GetTickCount();
+    snapshot->ProcessIndex = PhAllocate(max(snapshot->NumberOfHandles, 1) * sizeof(ULONG));
+    snapshot->ObjectIndex = NULL;
+    PhInitializeInitOnce(&snapshot->ObjectIndexInitOnce);
+
+    PhpBuildHandleSnapshotProcessIndex(snapshot);
+
+    *Snapshot = snapshot;
+}
+
+static NTSTATUS PhpCreateHandleSnapshot(
+    _Out_ PPH_HANDLE_SNAPSHOT *Snapshot
+    )
+{
+    NTSTATUS status;
+    PSYSTEM_HANDLE_INFORMATION_EX information;
+
+    if (!NT_SUCCESS(status = PhEnumHandlesEx(&information)))
+        return status;
+
+    PhCreateHandleSnapshot(information, Snapshot);
+
+    return status;
+}
+
+static VOID NTAPI PhpHandleSnapshotProcessesUpdatedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_HANDLE_SNAPSHOT snapshot = NULL;
+
+    // Don't keep a large snapshot around once nobody could ask for it anymore.
+
+    PhAcquireQueuedLockExclusive(&PhpHandleSnapshotLock);
+
+    if (PhpHandleSnapshot && GetTickCount() - PhpHandleSnapshot->CreateTickCount > PHP_HANDLE_SNAPSHOT_RETAIN_TIME)
+    {
+        snapshot = PhpHandleSnapshot;
+        PhpHandleSnapshot = NULL;
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpHandleSnapshotLock);
+
+    if (snapshot)
+        PhDereferenceObject(snapshot);
+}
+
+/**
+ * Gets a snapshot of all handles in the system.
+ *
+ * \param MaximumAge The maximum age of a shared snapshot that can be returned,
+ * in milliseconds. Use 0 to always enumerate the handles again.
+ * \param Snapshot A variable which receives the snapshot. You must dereference it
+ * when you no longer need it.
+ *
+ * \remarks The snapshot is shared, so handle providers and searches running at
+ * about the same time only enumerate the handles once.
+ */
+NTSTATUS PhReferenceHandleSnapshot(
+    _In_ ULONG MaximumAge,
+    _Out_ PPH_HANDLE_SNAPSHOT *Snapshot
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PPH_HANDLE_SNAPSHOT oldSnapshot = NULL;
+
+    PhAcquireQueuedLockExclusive(&PhpHandleSnapshotLock);
+
+    if (PhpHandleSnapshot && GetTickCount() - PhpHandleSnapshot->CreateTickCount > MaximumAge)
+    {
+        oldSnapshot = PhpHandleSnapshot;
+        PhpHandleSnapshot = NULL;
+    }
+
+    if (!PhpHandleSnapshot)
+        status = PhpCreateHandleSnapshot(&PhpHandleSnapshot);
+
+    if (NT_SUCCESS(status))
+    {
+        PhReferenceObject(PhpHandleSnapshot);
+        *Snapshot = PhpHandleSnapshot;
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpHandleSnapshotLock);
+
+    if (oldSnapshot)
+        PhDereferenceObject(oldSnapshot);
+
+    return status;
+}
+
+/**
+ * Finds the handles of a process in a handle snapshot.
+ *
+ * \param Snapshot A handle snapshot.
+ * \param ProcessId The ID of the process.
+ * \param Indices A variable which receives a pointer to an array of indices into
+ * the Handles array of the snapshot, in snapshot order. The array is owned by the
+ * snapshot.
+ *
+ * \return The number of handles owned by the process.
+ */
+ULONG PhFindProcessHandlesSnapshot(
+    _In_ PPH_HANDLE_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _Out_ PULONG *Indices
+    )
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles = Snapshot->Information->Handles;
+    ULONG low;
+    ULONG high;
+    ULONG start;
+
+    low = 0;
+    high = Snapshot->NumberOfHandles;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+
+        if (handles[Snapshot->ProcessIndex[mid]].UniqueProcessId < (ULONG_PTR)ProcessId)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    start = low;
+
+    while (high < Snapshot->NumberOfHandles && handles[Snapshot->ProcessIndex[high]].UniqueProcessId == (ULONG_PTR)ProcessId)
+        high++;
+
+    *Indices = &Snapshot->ProcessIndex[start];
+
+    return high - start;
+}
+
+/**
+ * Finds the handles to an object in a handle snapshot.
+ *
+ * \param Snapshot A handle snapshot.
+ * \param Object The address of the object.
+ * \param Indices A variable which receives a pointer to an array of indices into
+ * the Handles array of the snapshot, in snapshot order. The array is owned by the
+ * snapshot.
+ *
+ * \return The number of handles to the object.
+ *
+ * \remarks The object index is built the first time this function is called
+ * for a snapshot.
+ */
+ULONG PhFindObjectHandlesSnapshot(
+    _In_ PPH_HANDLE_SNAPSHOT Snapshot,
+    _In_ PVOID Object,
+    _Out_ PULONG *Indices
+    )
+{
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles = Snapshot->Information->Handles;
+    ULONG low;
+    ULONG high;
+    ULONG start;
+
+    if (PhBeginInitOnce(&Snapshot->ObjectIndexInitOnce))
+    {
+        PhpBuildHandleSnapshotObjectIndex(Snapshot);
+        PhEndInitOnce(&Snapshot->ObjectIndexInitOnce);
+    }
+
+    low = 0;
+    high = Snapshot->NumberOfHandles;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+
+        if ((ULONG_PTR)handles[Snapshot->ObjectIndex[mid]].Object < (ULONG_PTR)Object)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    start = low;
+
+    while (high < Snapshot->NumberOfHandles && handles[Snapshot->ObjectIndex[high]].Object == Object)
+        high++;
+
+    *Indices = &Snapshot->ObjectIndex[start];
+
+    return high - start;
+}
+
 /**
  * Enumerates all handles in a process.
  *
@@ -341,16 +1043,34 @@ NTSTATUS PhEnumHandlesGeneric(
 
     if (WindowsVersion >= WINDOWS_XP)
     {
+        PPH_HANDLE_SNAPSHOT snapshot;
         PSYSTEM_HANDLE_INFORMATION_EX handles;
+        PULONG indices;
+        ULONG count;
+        ULONG i;
 
-        // Enumerate handles using the new method; no conversion
-        // necessary.
+        // Enumerate handles using the new method. Handle providers updating together
+        // share one system-wide snapshot, and the process index means only this
+        // process' handles are copied.
 
-        if (!NT_SUCCESS(status = PhEnumHandlesEx(&handles)))
+        if (!NT_SUCCESS(status = PhReferenceHandleSnapshot(500, &snapshot)))
             return status;
 
+        count = PhFindProcessHandlesSnapshot(snapshot, ProcessId, &indices);
+        handles = PhAllocate(
+            FIELD_OFFSET(SYSTEM_HANDLE_INFORMATION_EX, Handles) +
+            sizeof(SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX) * max(count, 1)
+            );
+        handles->NumberOfHandles = count;
+        handles->Reserved = 0;
+
+        for (i = 0; i < count; i++)
+            handles->Handles[i] = snapshot->Information->Handles[indices[i]];
+
+        PhDereferenceObject(snapshot);
+
         *Handles = handles;
-        *FilterNeeded = TRUE;
+        *FilterNeeded = FALSE;
     }
     else
     {
@@ -411,6 +1131,121 @@ NTSTATUS PhEnumHandlesGeneric(
     return STATUS_SUCCESS;
 }
 
+FORCEINLINE BOOLEAN PhpIsHandleRangeChanged(
+    _In_ PKPH_PROCESS_HANDLE_DIGEST OldDigest,
+    _In_ PKPH_PROCESS_HANDLE_DIGEST NewDigest,
+    _In_ ULONG Index
+    )
+{
+    static KPH_PROCESS_HANDLE_RANGE emptyRange = { 0, 0 };
+    PKPH_PROCESS_HANDLE_RANGE oldRange;
+    PKPH_PROCESS_HANDLE_RANGE newRange;
+
+    oldRange = Index < OldDigest->NumberOfRanges ? &OldDigest->Ranges[Index] : &emptyRange;
+    newRange = Index < NewDigest->NumberOfRanges ? &NewDigest->Ranges[Index] : &emptyRange;
+
+    return oldRange->HandleCount != newRange->HandleCount || oldRange->Digest != newRange->Digest;
+}
+
+/**
+ * Enumerates the handles in a process which lie in ranges that
+ * differ between two handle digests.
+ *
+ * \param ProcessId The ID of the process.
+ * \param ProcessHandle A handle to the process.
+ * \param OldDigest The digest from the previous enumeration.
+ * \param NewDigest The current digest.
+ * \param Handles A variable which receives a pointer to a buffer containing
+ * information about the handles.
+ */
+NTSTATUS PhpEnumChangedHandlesKph(
+    _In_ HANDLE ProcessId,
+    _In_ HANDLE ProcessHandle,
+    _In_ PKPH_PROCESS_HANDLE_DIGEST OldDigest,
+    _In_ PKPH_PROCESS_HANDLE_DIGEST NewDigest,
+    _Out_ PSYSTEM_HANDLE_INFORMATION_EX *Handles
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PSYSTEM_HANDLE_INFORMATION_EX convertedHandles;
+    ULONG count;
+    ULONG allocatedCount;
+    ULONG numberOfRanges;
+    ULONG startIndex;
+    ULONG endIndex;
+    ULONG i;
+
+    count = 0;
+    allocatedCount = 64;
+    convertedHandles = PhAllocate(
+        FIELD_OFFSET(SYSTEM_HANDLE_INFORMATION_EX, Handles) +
+        sizeof(SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX) * allocatedCount
+        );
+
+    numberOfRanges = max(OldDigest->NumberOfRanges, NewDigest->NumberOfRanges);
+
+    for (startIndex = 0; startIndex < numberOfRanges; startIndex = endIndex)
+    {
+        PKPH_PROCESS_HANDLE_INFORMATION handles;
+
+        if (!PhpIsHandleRangeChanged(OldDigest, NewDigest, startIndex))
+        {
+            endIndex = startIndex + 1;
+            continue;
+        }
+
+        // Merge adjacent changed ranges into a single request.
+        for (endIndex = startIndex + 1; endIndex < numberOfRanges; endIndex++)
+        {
+            if (!PhpIsHandleRangeChanged(OldDigest, NewDigest, endIndex))
+                break;
+        }
+
+        if (!NT_SUCCESS(status = KphEnumerateProcessHandleRange2(
+            ProcessHandle,
+            (HANDLE)((ULONG_PTR)startIndex << KPH_HANDLE_RANGE_SHIFT),
+            (HANDLE)(((ULONG_PTR)endIndex << KPH_HANDLE_RANGE_SHIFT) - 1),
+            &handles
+            )))
+            break;
+
+        if (count + handles->HandleCount > allocatedCount)
+        {
+            allocatedCount = max(allocatedCount * 2, count + handles->HandleCount);
+            convertedHandles = PhReAllocate(
+                convertedHandles,
+                FIELD_OFFSET(SYSTEM_HANDLE_INFORMATION_EX, Handles) +
+                sizeof(SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX) * allocatedCount
+                );
+        }
+
+        for (i = 0; i < handles->HandleCount; i++)
+        {
+            convertedHandles->Handles[count].Object = handles->Handles[i].Object;
+            convertedHandles->Handles[count].UniqueProcessId = (ULONG_PTR)ProcessId;
+            convertedHandles->Handles[count].HandleValue = (ULONG_PTR)handles->Handles[i].Handle;
+            convertedHandles->Handles[count].GrantedAccess = (ULONG)handles->Handles[i].GrantedAccess;
+            convertedHandles->Handles[count].CreatorBackTraceIndex = 0;
+            convertedHandles->Handles[count].ObjectTypeIndex = handles->Handles[i].ObjectTypeIndex;
+            convertedHandles->Handles[count].HandleAttributes = handles->Handles[i].HandleAttributes;
+            count++;
+        }
+
+        PhFree(handles);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(convertedHandles);
+        return status;
+    }
+
+    convertedHandles->NumberOfHandles = count;
+    *Handles = convertedHandles;
+
+    return status;
+}
+
 NTSTATUS PhpCreateHandleItemFunction(
     _In_ PVOID Parameter
     )
@@ -419,22 +1254,27 @@ NTSTATUS PhpCreateHandleItemFunction(
     PPH_HANDLE_ITEM handleItem;
 
     handleItem = PhCreateHandleItem(context->Handle);
-
-    PhGetHandleInformationEx(
+    handleItem->TypeName = PhpReferenceHandleTypeName(
         context->Provider->ProcessHandle,
         handleItem->Handle,
-        context->Handle->ObjectTypeIndex,
-        0,
-        NULL,
-        NULL,
-        &handleItem->TypeName,
-        &handleItem->ObjectName,
-        &handleItem->BestObjectName,
-        NULL
+        handleItem->TypeIndex
         );
 
     if (handleItem->TypeName)
     {
+        PhGetHandleInformationEx(
+            context->Provider->ProcessHandle,
+            handleItem->Handle,
+            handleItem->TypeIndex,
+            0,
+            NULL,
+            NULL,
+            NULL,
+            &handleItem->ObjectName,
+            &handleItem->BestObjectName,
+            NULL
+            );
+
         // Add the handle item to the hashtable.
         PhAcquireQueuedLockExclusive(&context->Provider->HandleHashSetLock);
         PhpAddHandleItem(context->Provider, handleItem);
@@ -463,6 +1303,8 @@ VOID PhHandleProviderUpdate(
     PPH_HANDLE_PROVIDER handleProvider = (PPH_HANDLE_PROVIDER)Object;
     PSYSTEM_HANDLE_INFORMATION_EX handleInfo;
     BOOLEAN filterNeeded;
+    PKPH_PROCESS_HANDLE_DIGEST oldDigest;
+    PKPH_PROCESS_HANDLE_DIGEST newDigest = NULL;
     PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles;
     ULONG numberOfHandles;
     ULONG i;
@@ -470,22 +1312,67 @@ VOID PhHandleProviderUpdate(
     PPH_KEY_VALUE_PAIR handlePair;
     BOOLEAN useWorkQueue = FALSE;
     PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    PVOID workQueueContexts[64];
+    ULONG numberOfWorkQueueContexts = 0;
 
     if (!handleProvider->ProcessHandle)
         goto UpdateExit;
 
-    if (!NT_SUCCESS(handleProvider->RunStatus = PhEnumHandlesGeneric(
+    // If KProcessHacker can give us a digest of the handle table, we only need to enumerate the
+    // ranges of handles which have changed since the last update. The digest must be taken before
+    // the handles are enumerated so that any changes made in between are picked up next time.
+    oldDigest = handleProvider->HandleDigest;
+    handleProvider->HandleDigest = NULL;
+
+    if (KphIsConnected())
+    {
+        if (!NT_SUCCESS(KphQueryProcessHandleDigest2(handleProvider->ProcessHandle, &newDigest)))
+            newDigest = NULL;
+    }
+
+    if (oldDigest && newDigest && NT_SUCCESS(PhpEnumChangedHandlesKph(
         handleProvider->ProcessId,
         handleProvider->ProcessHandle,
-        &handleInfo,
-        &filterNeeded
+        oldDigest,
+        newDigest,
+        &handleInfo
         )))
-        goto UpdateExit;
+    {
+        filterNeeded = FALSE;
+        handleProvider->RunStatus = STATUS_SUCCESS;
+    }
+    else
+    {
+        if (oldDigest)
+        {
+            PhFree(oldDigest);
+            oldDigest = NULL;
+        }
+
+        if (!NT_SUCCESS(handleProvider->RunStatus = PhEnumHandlesGeneric(
+            handleProvider->ProcessId,
+            handleProvider->ProcessHandle,
+            &handleInfo,
+            &filterNeeded
+            )))
+        {
+            if (newDigest)
+                PhFree(newDigest);
+
+            goto UpdateExit;
+        }
+    }
 
-    if (!KphIsConnected() && WindowsVersion >= WINDOWS_VISTA)
+    // Only the type name is queried in lazy name mode, which never blocks.
+    if (!KphIsConnected() && WindowsVersion >= WINDOWS_VISTA && !handleProvider->LazyNames)
     {
+        ULONG numberOfThreads;
+
         useWorkQueue = TRUE;
-        PhInitializeWorkQueue(&workQueue, 1, 20, 1000);
+        PhGetCallWithTimeoutStatistics(&numberOfThreads, NULL);
+        PhInitializeWorkQueueEx(&workQueue, 1, numberOfThreads, 1000, PH_WORK_QUEUE_LOCK_FREE);
+        PhInitializeWorkQueueBatch(&workQueueBatch);
 
         if (PhBeginInitOnce(&initOnce))
         {
@@ -546,6 +1433,14 @@ VOID PhHandleProviderUpdate(
 
                 handleItem = CONTAINING_RECORD(entry, PH_HANDLE_ITEM, HashEntry);
 
+                // Only the changed ranges were enumerated; handles elsewhere are unchanged.
+                if (oldDigest && !PhpIsHandleRangeChanged(
+                    oldDigest,
+                    newDigest,
+                    (ULONG)((ULONG_PTR)handleItem->Handle >> KPH_HANDLE_RANGE_SHIFT)
+                    ))
+                    continue;
+
                 // Check if the handle still exists.
 
                 tempHashtableValue = (PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX *)PhFindItemSimpleHashtable(
@@ -617,23 +1512,24 @@ VOID PhHandleProviderUpdate(
                 context = PhAllocate(sizeof(PHP_CREATE_HANDLE_ITEM_CONTEXT));
                 context->Provider = handleProvider;
                 context->Handle = handle;
-                PhQueueItemWorkQueue(&workQueue, PhpCreateHandleItemFunction, context);
+                workQueueContexts[numberOfWorkQueueContexts++] = context;
+
+                // Submit the items in batches so that the workers can start while we continue.
+                if (numberOfWorkQueueContexts == sizeof(workQueueContexts) / sizeof(PVOID))
+                {
+                    PhQueueItemsWorkQueueEx(&workQueue, PhpCreateHandleItemFunction,
+                        workQueueContexts, numberOfWorkQueueContexts, &workQueueBatch);
+                    numberOfWorkQueueContexts = 0;
+                }
+
                 continue;
             }
 
             handleItem = PhCreateHandleItem(handle);
-
-            PhGetHandleInformationEx(
+            handleItem->TypeName = PhpReferenceHandleTypeName(
                 handleProvider->ProcessHandle,
                 handleItem->Handle,
-                handle->ObjectTypeIndex,
-                0,
-                NULL,
-                NULL,
-                &handleItem->TypeName,
-                &handleItem->ObjectName,
-                &handleItem->BestObjectName,
-                NULL
+                handleItem->TypeIndex
                 );
 
             // We need at least a type name to continue.
@@ -643,6 +1539,28 @@ VOID PhHandleProviderUpdate(
                 continue;
             }
 
+            // In lazy name mode the type name is all we need, so no query is made at all for
+            // handles of a known type.
+            if (handleProvider->LazyNames)
+            {
+                handleItem->NamesPending = TRUE;
+            }
+            else
+            {
+                PhGetHandleInformationEx(
+                    handleProvider->ProcessHandle,
+                    handleItem->Handle,
+                    handleItem->TypeIndex,
+                    0,
+                    NULL,
+                    NULL,
+                    NULL,
+                    &handleItem->ObjectName,
+                    &handleItem->BestObjectName,
+                    NULL
+                    );
+            }
+
             if (PhEqualString2(handleItem->TypeName, L"File", TRUE) && KphIsConnected())
             {
                 KPH_FILE_OBJECT_INFORMATION objectInfo;
@@ -693,12 +1611,19 @@ VOID PhHandleProviderUpdate(
 
     if (useWorkQueue)
     {
-        PhWaitForWorkQueue(&workQueue);
+        PhQueueItemsWorkQueueEx(&workQueue, PhpCreateHandleItemFunction,
+            workQueueContexts, numberOfWorkQueueContexts, &workQueueBatch);
+        PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
         PhDeleteWorkQueue(&workQueue);
     }
 
     PhFree(handleInfo);
 
+    if (oldDigest)
+        PhFree(oldDigest);
+
+    handleProvider->HandleDigest = newDigest;
+
     // Re-create the temporary hashtable if it got too big.
     if (handleProvider->TempListHashtable->AllocatedEntries > 8192)
     {
@@ -21,11 +21,13 @@
  */
 
 #include <phapp.h>
+#include <hndltrnd.h>
 
 typedef struct _HANDLE_STATISTICS_ENTRY
 {
     PPH_STRING Name;
     ULONG Count;
+    FLOAT GrowthRate;
 } HANDLE_STATISTICS_ENTRY, *PHANDLE_STATISTICS_ENTRY;
 
 typedef struct _HANDLE_STATISTICS_CONTEXT
@@ -112,6 +114,18 @@ static INT NTAPI PhpTypeCountCompareFunction(
     return uintcmp(entry1->Count, entry2->Count);
 }
 
+static INT NTAPI PhpTypeGrowthCompareFunction(
+    _In_ PVOID Item1,
+    _In_ PVOID Item2,
+    _In_opt_ PVOID Context
+    )
+{
+    PHANDLE_STATISTICS_ENTRY entry1 = Item1;
+    PHANDLE_STATISTICS_ENTRY entry2 = Item2;
+
+    return singlecmp(entry1->GrowthRate, entry2->GrowthRate);
+}
+
 INT_PTR CALLBACK PhpHandleStatisticsDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -125,6 +139,7 @@ INT_PTR CALLBACK PhpHandleStatisticsDlgProc(
         {
             PHANDLE_STATISTICS_CONTEXT context = (PHANDLE_STATISTICS_CONTEXT)lParam;
             HANDLE processId;
+            PPH_PROCESS_ITEM processItem;
             ULONG_PTR i;
             HWND lvHandle;
 
@@ -168,9 +183,15 @@ INT_PTR CALLBACK PhpHandleStatisticsDlgProc(
             PhSetControlTheme(lvHandle, L"explorer");
             PhAddListViewColumn(lvHandle, 0, 0, 0, LVCFMT_LEFT, 140, L"Type");
             PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_LEFT, 100, L"Count");
+            PhAddListViewColumn(lvHandle, 2, 2, 2, LVCFMT_LEFT, 80, L"Growth/min");
+            PhAddListViewColumn(lvHandle, 3, 3, 3, LVCFMT_LEFT, 140, L"Trend");
 
             PhSetExtendedListView(lvHandle);
             ExtendedListView_SetCompareFunction(lvHandle, 1, PhpTypeCountCompareFunction);
+            ExtendedListView_SetCompareFunction(lvHandle, 2, PhpTypeGrowthCompareFunction);
+
+            // The trends come from the background handle samples (see hndltrnd.c).
+            processItem = PhReferenceProcessItem(processId);
 
             for (i = 0; i < MAX_OBJECT_TYPE_NUMBER; i++)
             {
@@ -201,11 +222,40 @@ INT_PTR CALLBACK PhpHandleStatisticsDlgProc(
 
                 PhDereferenceObject(countString);
 
+                if (processItem)
+                {
+                    PH_HANDLE_TYPE_TREND trend;
+
+                    if (PhGetHandleTypeTrend(processItem, (ULONG)i, &trend) && trend.Minutes != 0)
+                    {
+                        PPH_STRING growthString;
+                        PPH_STRING trendString;
+
+                        entry->GrowthRate = trend.GrowthRate;
+
+                        growthString = PhFormatString(L"%+.2f", trend.GrowthRate);
+                        trendString = PhFormatString(
+                            L"%u \x2192 %u in %.0f min",
+                            trend.OldestCount,
+                            trend.NewestCount,
+                            trend.Minutes
+                            );
+                        PhSetListViewSubItem(lvHandle, lvItemIndex, 2, growthString->Buffer);
+                        PhSetListViewSubItem(lvHandle, lvItemIndex, 3, trendString->Buffer);
+
+                        PhDereferenceObject(trendString);
+                        PhDereferenceObject(growthString);
+                    }
+                }
+
                 if (unknownType)
                     PhDereferenceObject(unknownType);
             }
 
             ExtendedListView_SortItems(lvHandle);
+
+            if (processItem)
+                PhDereferenceObject(processItem);
         }
         break;
     case WM_DESTROY:
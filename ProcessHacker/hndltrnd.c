@@ -0,0 +1,527 @@
+/*
+ * Process Hacker -
+ *   handle count trends
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Handle leaks show up as handle counts that rise slowly over minutes or hours, which is hard to
+ * see from the total handle count of a process. Every HandleTrendInterval process provider
+ * updates, the shared system handle snapshot is taken on the global work queue and the handles of
+ * each process are counted by object type. The counts are kept for the last
+ * PH_HANDLE_TREND_HISTORY_SIZE samples, and the growth rate of the total and of each type is the
+ * least squares slope over those samples, in handles per minute.
+ *
+ * The snapshot already groups handles by process, so a sample costs one pass over the handles
+ * in the system. The results for the total and the fastest growing type are stored in the
+ * process items; the per-type trends can be queried with PhGetHandleTypeTrend.
+ */
+
+#include <phapp.h>
+#include <hndltrnd.h>
+
+#define PH_HANDLE_TREND_HISTORY_SIZE 60
+#define PH_HANDLE_TREND_MINIMUM_SAMPLES 3
+
+typedef struct _PH_HANDLE_TREND_TYPE
+{
+    ULONG TypeIndex;
+    ULONG Counts[PH_HANDLE_TREND_HISTORY_SIZE];
+} PH_HANDLE_TREND_TYPE, *PPH_HANDLE_TREND_TYPE;
+
+typedef struct _PH_HANDLE_TREND_PROCESS
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+    ULONG RunId;
+
+    ULONG Count; // number of valid samples
+    ULONG Index; // position of the newest sample
+    FLOAT Times[PH_HANDLE_TREND_HISTORY_SIZE]; // minutes since sampling started
+    ULONG Totals[PH_HANDLE_TREND_HISTORY_SIZE];
+    PPH_LIST Types; // PPH_HANDLE_TREND_TYPE
+} PH_HANDLE_TREND_PROCESS, *PPH_HANDLE_TREND_PROCESS;
+
+static PH_CALLBACK_REGISTRATION PhpHandleTrendProcessesUpdatedRegistration;
+static ULONG PhpHandleTrendInterval;
+static ULONG PhpHandleTrendUpdateCount = 0;
+static BOOLEAN PhpHandleTrendSamplePending = FALSE;
+static ULONG PhpHandleTrendRunId = 0;
+static LARGE_INTEGER PhpHandleTrendStartTime;
+
+static PH_QUEUED_LOCK PhpHandleTrendLock = PH_QUEUED_LOCK_INIT;
+static PPH_HASHTABLE PhpHandleTrendHashtable; // PH_HANDLE_TREND_PROCESS, protected by PhpHandleTrendLock
+static PPH_STRING PhpHandleTrendTypeNames[MAX_OBJECT_TYPE_NUMBER]; // protected by PhpHandleTrendLock
+
+static BOOLEAN NTAPI PhpHandleTrendEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PPH_HANDLE_TREND_PROCESS)Entry1)->ProcessId == ((PPH_HANDLE_TREND_PROCESS)Entry2)->ProcessId;
+}
+
+static ULONG NTAPI PhpHandleTrendHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashIntPtr((ULONG_PTR)((PPH_HANDLE_TREND_PROCESS)Entry)->ProcessId);
+}
+
+static VOID PhpDeleteHandleTrendProcess(
+    _In_ PPH_HANDLE_TREND_PROCESS Process
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Process->Types->Count; i++)
+        PhFree(Process->Types->Items[i]);
+
+    PhDereferenceObject(Process->Types);
+}
+
+static FLOAT PhpGetHandleTrendSlope(
+    _In_ PPH_HANDLE_TREND_PROCESS Process,
+    _In_ PULONG Counts
+    )
+{
+    FLOAT meanTime = 0;
+    FLOAT meanCount = 0;
+    FLOAT covariance = 0;
+    FLOAT variance = 0;
+    ULONG i;
+
+    if (Process->Count < PH_HANDLE_TREND_MINIMUM_SAMPLES)
+        return 0;
+
+    // The samples don't need to be in order for a least squares fit.
+
+    for (i = 0; i < Process->Count; i++)
+    {
+        meanTime += Process->Times[i];
+        meanCount += (FLOAT)Counts[i];
+    }
+
+    meanTime /= Process->Count;
+    meanCount /= Process->Count;
+
+    for (i = 0; i < Process->Count; i++)
+    {
+        FLOAT timeDelta = Process->Times[i] - meanTime;
+
+        covariance += timeDelta * ((FLOAT)Counts[i] - meanCount);
+        variance += timeDelta * timeDelta;
+    }
+
+    if (variance == 0)
+        return 0;
+
+    return covariance / variance;
+}
+
+static VOID PhpUpdateHandleTrendTypeNames(
+    VOID
+    )
+{
+    POBJECT_TYPES_INFORMATION objectTypes;
+    POBJECT_TYPE_INFORMATION objectType;
+    ULONG typeIndex;
+    ULONG i;
+
+    if (!NT_SUCCESS(PhEnumObjectTypes(&objectTypes)))
+        return;
+
+    objectType = PH_FIRST_OBJECT_TYPE(objectTypes);
+
+    for (i = 0; i < objectTypes->NumberOfTypes; i++)
+    {
+        if (WindowsVersion >= WINDOWS_8_1)
+            typeIndex = objectType->TypeIndex;
+        else if (WindowsVersion >= WINDOWS_7)
+            typeIndex = i + 2;
+        else
+            typeIndex = i + 1;
+
+        if (typeIndex < MAX_OBJECT_TYPE_NUMBER && !PhpHandleTrendTypeNames[typeIndex])
+            PhpHandleTrendTypeNames[typeIndex] = PhCreateStringFromUnicodeString(&objectType->TypeName);
+
+        objectType = PH_NEXT_OBJECT_TYPE(objectType);
+    }
+
+    PhFree(objectTypes);
+}
+
+static VOID PhpAddHandleTrendSample(
+    _In_ PPH_HANDLE_TREND_PROCESS Process,
+    _In_ FLOAT Time,
+    _In_reads_(MAX_OBJECT_TYPE_NUMBER) PULONG TypeCounts,
+    _Out_ PBOOLEAN NewType
+    )
+{
+    ULONG index;
+    ULONG total;
+    ULONG i;
+
+    *NewType = FALSE;
+
+    if (Process->Count == 0)
+        index = 0;
+    else
+        index = (Process->Index + 1) % PH_HANDLE_TREND_HISTORY_SIZE;
+
+    Process->Index = index;
+
+    if (Process->Count < PH_HANDLE_TREND_HISTORY_SIZE)
+        Process->Count++;
+
+    Process->Times[index] = Time;
+
+    // Update the types we already know about, clearing their counts so that the new types are
+    // left.
+
+    total = 0;
+
+    for (i = 0; i < Process->Types->Count; i++)
+    {
+        PPH_HANDLE_TREND_TYPE type = Process->Types->Items[i];
+
+        type->Counts[index] = TypeCounts[type->TypeIndex];
+        total += TypeCounts[type->TypeIndex];
+        TypeCounts[type->TypeIndex] = 0;
+    }
+
+    for (i = 0; i < MAX_OBJECT_TYPE_NUMBER; i++)
+    {
+        PPH_HANDLE_TREND_TYPE type;
+
+        if (TypeCounts[i] == 0)
+            continue;
+
+        // We have counted all handles of the process in each sample, so the earlier counts for a
+        // new type really were zero.
+        type = PhAllocate(sizeof(PH_HANDLE_TREND_TYPE));
+        memset(type, 0, sizeof(PH_HANDLE_TREND_TYPE));
+        type->TypeIndex = i;
+        type->Counts[index] = TypeCounts[i];
+        total += TypeCounts[i];
+        PhAddItemList(Process->Types, type);
+
+        if (!PhpHandleTrendTypeNames[i])
+            *NewType = TRUE;
+    }
+
+    Process->Totals[index] = total;
+}
+
+static VOID PhpPublishHandleTrend(
+    _In_ PPH_HANDLE_TREND_PROCESS Process,
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    FLOAT topRate = 0;
+    ULONG topTypeIndex = 0;
+    ULONG i;
+
+    for (i = 0; i < Process->Types->Count; i++)
+    {
+        PPH_HANDLE_TREND_TYPE type = Process->Types->Items[i];
+        FLOAT rate;
+
+        rate = PhpGetHandleTrendSlope(Process, type->Counts);
+
+        if (topRate < rate)
+        {
+            topRate = rate;
+            topTypeIndex = type->TypeIndex;
+        }
+    }
+
+    ProcessItem->HandleGrowthRate = PhpGetHandleTrendSlope(Process, Process->Totals);
+    ProcessItem->TopHandleTypeGrowthRate = topRate;
+    ProcessItem->TopHandleTypeIndex = topTypeIndex;
+}
+
+static NTSTATUS PhpHandleTrendSampleFunction(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_HANDLE_SNAPSHOT snapshot;
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handles;
+    PULONG typeCounts;
+    LARGE_INTEGER systemTime;
+    FLOAT time;
+    BOOLEAN newTypes;
+    PPH_HANDLE_TREND_PROCESS process;
+    PPH_LIST staleProcesses;
+    ULONG enumerationKey;
+    ULONG i;
+
+    // Snapshots taken by handle providers in the last second are good enough.
+    if (!NT_SUCCESS(PhReferenceHandleSnapshot(1000, &snapshot)))
+    {
+        PhpHandleTrendSamplePending = FALSE;
+        return STATUS_SUCCESS;
+    }
+
+    handles = snapshot->Information->Handles;
+    typeCounts = PhAllocate(MAX_OBJECT_TYPE_NUMBER * sizeof(ULONG));
+    memset(typeCounts, 0, MAX_OBJECT_TYPE_NUMBER * sizeof(ULONG));
+
+    PhQuerySystemTime(&systemTime);
+    time = (FLOAT)((DOUBLE)(systemTime.QuadPart - PhpHandleTrendStartTime.QuadPart) / PH_TICKS_PER_MIN);
+    newTypes = FALSE;
+
+    PhAcquireQueuedLockExclusive(&PhpHandleTrendLock);
+
+    PhpHandleTrendRunId++;
+
+    // The process index groups the handles of each process together.
+
+    i = 0;
+
+    while (i < snapshot->NumberOfHandles)
+    {
+        HANDLE processId = (HANDLE)handles[snapshot->ProcessIndex[i]].UniqueProcessId;
+        PPH_PROCESS_ITEM processItem;
+        PH_HANDLE_TREND_PROCESS lookupProcess;
+        BOOLEAN added;
+        BOOLEAN newType;
+
+        for (; i < snapshot->NumberOfHandles; i++)
+        {
+            PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handle = &handles[snapshot->ProcessIndex[i]];
+
+            if ((HANDLE)handle->UniqueProcessId != processId)
+                break;
+
+            if (handle->ObjectTypeIndex < MAX_OBJECT_TYPE_NUMBER)
+                typeCounts[handle->ObjectTypeIndex]++;
+        }
+
+        if (!(processItem = PhReferenceProcessItem(processId)))
+        {
+            memset(typeCounts, 0, MAX_OBJECT_TYPE_NUMBER * sizeof(ULONG));
+            continue;
+        }
+
+        lookupProcess.ProcessId = processId;
+        process = PhAddEntryHashtableEx(PhpHandleTrendHashtable, &lookupProcess, &added);
+
+        if (!added && process->CreateTime.QuadPart != processItem->CreateTime.QuadPart)
+        {
+            // The process ID has been reused.
+            PhpDeleteHandleTrendProcess(process);
+            added = TRUE;
+        }
+
+        if (added)
+        {
+            process->CreateTime = processItem->CreateTime;
+            process->Count = 0;
+            process->Index = 0;
+            process->Types = PhCreateList(16);
+        }
+
+        process->RunId = PhpHandleTrendRunId;
+
+        // This clears typeCounts.
+        PhpAddHandleTrendSample(process, time, typeCounts, &newType);
+        PhpPublishHandleTrend(process, processItem);
+
+        if (newType)
+            newTypes = TRUE;
+
+        PhDereferenceObject(processItem);
+    }
+
+    // Remove processes which have exited.
+
+    staleProcesses = NULL;
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpHandleTrendHashtable, &process, &enumerationKey))
+    {
+        if (process->RunId != PhpHandleTrendRunId)
+        {
+            if (!staleProcesses)
+                staleProcesses = PhCreateList(4);
+
+            PhpDeleteHandleTrendProcess(process);
+            PhAddItemList(staleProcesses, process->ProcessId);
+        }
+    }
+
+    if (staleProcesses)
+    {
+        PH_HANDLE_TREND_PROCESS lookupProcess;
+
+        for (i = 0; i < staleProcesses->Count; i++)
+        {
+            lookupProcess.ProcessId = staleProcesses->Items[i];
+            PhRemoveEntryHashtable(PhpHandleTrendHashtable, &lookupProcess);
+        }
+
+        PhDereferenceObject(staleProcesses);
+    }
+
+    if (newTypes)
+        PhpUpdateHandleTrendTypeNames();
+
+    PhReleaseQueuedLockExclusive(&PhpHandleTrendLock);
+
+    PhFree(typeCounts);
+    PhDereferenceObject(snapshot);
+
+    PhpHandleTrendSamplePending = FALSE;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID NTAPI PhpHandleTrendProcessesUpdatedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    if (PhProviderReplayActive)
+        return;
+
+    if (++PhpHandleTrendUpdateCount < PhpHandleTrendInterval)
+        return;
+
+    PhpHandleTrendUpdateCount = 0;
+
+    // Skip this sample if the last one hasn't finished.
+    if (PhpHandleTrendSamplePending)
+        return;
+
+    PhpHandleTrendSamplePending = TRUE;
+    PhQueueItemGlobalWorkQueue(PhpHandleTrendSampleFunction, NULL);
+}
+
+VOID PhHandleTrendInitialization(
+    VOID
+    )
+{
+    PhpHandleTrendInterval = PhGetIntegerSetting(L"HandleTrendInterval");
+
+    if (PhpHandleTrendInterval == 0)
+        return;
+
+    PhpHandleTrendHashtable = PhCreateHashtable(
+        sizeof(PH_HANDLE_TREND_PROCESS),
+        PhpHandleTrendEqualFunction,
+        PhpHandleTrendHashFunction,
+        64
+        );
+    PhQuerySystemTime(&PhpHandleTrendStartTime);
+
+    // Take the first sample on the first update.
+    PhpHandleTrendUpdateCount = PhpHandleTrendInterval - 1;
+
+    PhRegisterCallback(
+        &PhProcessesUpdatedEvent,
+        PhpHandleTrendProcessesUpdatedHandler,
+        NULL,
+        &PhpHandleTrendProcessesUpdatedRegistration
+        );
+}
+
+/**
+ * Gets the name of an object type recorded by handle trend sampling.
+ *
+ * \param TypeIndex The object type index.
+ *
+ * \return The name of the type, or NULL if it is not known. You must dereference the string
+ * when you no longer need it.
+ */
+PPH_STRING PhGetHandleTrendTypeName(
+    _In_ ULONG TypeIndex
+    )
+{
+    PPH_STRING name = NULL;
+
+    if (TypeIndex >= MAX_OBJECT_TYPE_NUMBER)
+        return NULL;
+
+    PhAcquireQueuedLockShared(&PhpHandleTrendLock);
+    PhSetReference(&name, PhpHandleTrendTypeNames[TypeIndex]);
+    PhReleaseQueuedLockShared(&PhpHandleTrendLock);
+
+    return name;
+}
+
+/**
+ * Gets the trend of the number of handles of an object type in a process.
+ *
+ * \param ProcessItem The process item.
+ * \param TypeIndex The object type index.
+ * \param Trend A variable which receives the trend.
+ *
+ * \return TRUE if the process has been sampled at least once, otherwise FALSE.
+ */
+BOOLEAN PhGetHandleTypeTrend(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG TypeIndex,
+    _Out_ PPH_HANDLE_TYPE_TREND Trend
+    )
+{
+    BOOLEAN result = FALSE;
+    PH_HANDLE_TREND_PROCESS lookupProcess;
+    PPH_HANDLE_TREND_PROCESS process;
+    ULONG oldestIndex;
+    ULONG i;
+
+    memset(Trend, 0, sizeof(PH_HANDLE_TYPE_TREND));
+
+    if (!PhpHandleTrendHashtable)
+        return FALSE;
+
+    lookupProcess.ProcessId = ProcessItem->ProcessId;
+
+    PhAcquireQueuedLockShared(&PhpHandleTrendLock);
+
+    process = PhFindEntryHashtable(PhpHandleTrendHashtable, &lookupProcess);
+
+    if (process && process->Count != 0 && process->CreateTime.QuadPart == ProcessItem->CreateTime.QuadPart)
+    {
+        if (process->Count < PH_HANDLE_TREND_HISTORY_SIZE)
+            oldestIndex = 0;
+        else
+            oldestIndex = (process->Index + 1) % PH_HANDLE_TREND_HISTORY_SIZE;
+
+        Trend->Minutes = process->Times[process->Index] - process->Times[oldestIndex];
+
+        for (i = 0; i < process->Types->Count; i++)
+        {
+            PPH_HANDLE_TREND_TYPE type = process->Types->Items[i];
+
+            if (type->TypeIndex == TypeIndex)
+            {
+                Trend->OldestCount = type->Counts[oldestIndex];
+                Trend->NewestCount = type->Counts[process->Index];
+                Trend->GrowthRate = PhpGetHandleTrendSlope(process, type->Counts);
+                break;
+            }
+        }
+
+        result = TRUE;
+    }
+
+    PhReleaseQueuedLockShared(&PhpHandleTrendLock);
+
+    return result;
+}
@@ -0,0 +1,334 @@
+/*
+ * Process Hacker -
+ *   image metadata cache
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The image cache stores metadata that is expensive to retrieve from image files, such as
+ * icons and version information, so that it is only retrieved once for each file no matter
+ * how many processes and modules refer to it. Entries are keyed by file name and are only
+ * reused while the file ID, size and last write time of the file stay the same. Each piece
+ * of metadata is retrieved the first time it is requested.
+ *
+ * Entries are reference counted objects. The cache keeps a reference to each entry and
+ * evicts the least recently used entries when it grows too large; evicted entries stay alive
+ * as long as something else references them.
+ */
+
+#include <phapp.h>
+
+#define PH_IMAGE_CACHE_MAXIMUM_ENTRIES 512
+
+#undef T
+#undef K
+#define T PPH_IMAGE_CACHE_ENTRY
+#define K PPH_STRINGREF
+#include <ohashtbl_h.h>
+#define PH_OPEN_HASHTABLE_KEY(Entry) (&(Entry)->FileName->sr)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_STRINGREF_IGNORECASE
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_STRINGREF_IGNORECASE
+#include <ohashtbl_i.h>
+
+VOID NTAPI PhpImageCacheEntryDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
+static PH_INITONCE PhpImageCacheInitOnce = PH_INITONCE_INIT;
+static PPH_OBJECT_TYPE PhpImageCacheEntryType;
+static PH_OPEN_HASHTABLE_PPH_IMAGE_CACHE_ENTRY PhpImageCacheHashtable;
+static LIST_ENTRY PhpImageCacheLruListHead; // most recently used first
+static PH_QUEUED_LOCK PhpImageCacheLock = PH_QUEUED_LOCK_INIT;
+static PH_IMAGE_CACHE_STATISTICS PhpImageCacheStatistics;
+
+VOID PhpInitializeImageCache(
+    VOID
+    )
+{
+    if (PhBeginInitOnce(&PhpImageCacheInitOnce))
+    {
+        PhpImageCacheEntryType = PhCreateObjectType(L"ImageCacheEntry", 0, PhpImageCacheEntryDeleteProcedure);
+        PhInitializeOpenHashtable_PPH_IMAGE_CACHE_ENTRY(&PhpImageCacheHashtable, 64);
+        InitializeListHead(&PhpImageCacheLruListHead);
+
+        PhEndInitOnce(&PhpImageCacheInitOnce);
+    }
+}
+
+VOID NTAPI PhpImageCacheEntryDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_IMAGE_CACHE_ENTRY entry = (PPH_IMAGE_CACHE_ENTRY)Object;
+
+    PhDereferenceObject(entry->FileName);
+
+    if (entry->SmallIcon) DestroyIcon(entry->SmallIcon);
+    if (entry->LargeIcon) DestroyIcon(entry->LargeIcon);
+
+    PhDeleteImageVersionInfo(&entry->VersionInfo);
+}
+
+/**
+ * Gets the values which identify a version of a file.
+ *
+ * \param FileName The file name.
+ * \param Key A variable which receives the file ID, size and last write time of the file.
+ */
+NTSTATUS PhQueryImageFileKey(
+    _In_ PWSTR FileName,
+    _Out_ PPH_IMAGE_FILE_KEY Key
+    )
+{
+    NTSTATUS status;
+    HANDLE fileHandle;
+    IO_STATUS_BLOCK isb;
+    FILE_INTERNAL_INFORMATION internalInfo;
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+
+    if (!NT_SUCCESS(status = PhCreateFileWin32(
+        &fileHandle,
+        FileName,
+        FILE_READ_ATTRIBUTES | SYNCHRONIZE,
+        0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        FILE_OPEN,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        )))
+        return status;
+
+    status = NtQueryInformationFile(
+        fileHandle,
+        &isb,
+        &internalInfo,
+        sizeof(FILE_INTERNAL_INFORMATION),
+        FileInternalInformation
+        );
+
+    if (NT_SUCCESS(status))
+    {
+        status = NtQueryInformationFile(
+            fileHandle,
+            &isb,
+            &networkOpenInfo,
+            sizeof(FILE_NETWORK_OPEN_INFORMATION),
+            FileNetworkOpenInformation
+            );
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        Key->FileId = internalInfo.IndexNumber;
+        Key->EndOfFile = networkOpenInfo.EndOfFile;
+        Key->LastWriteTime = networkOpenInfo.LastWriteTime;
+    }
+
+    NtClose(fileHandle);
+
+    return status;
+}
+
+/**
+ * Gets the cache entry for a file.
+ *
+ * \param FileName The file name.
+ *
+ * \return The cache entry, or NULL if the file could not be identified. You must dereference
+ * the entry using PhDereferenceObject() when you no longer need it.
+ */
+PPH_IMAGE_CACHE_ENTRY PhReferenceImageCacheEntry(
+    _In_ PPH_STRING FileName
+    )
+{
+    PH_IMAGE_FILE_KEY key;
+    PPH_IMAGE_CACHE_ENTRY *existingEntry;
+    PPH_IMAGE_CACHE_ENTRY entry;
+    PPH_IMAGE_CACHE_ENTRY evictedEntry = NULL;
+    PPH_IMAGE_CACHE_ENTRY replacedEntry = NULL;
+
+    PhpInitializeImageCache();
+
+    if (!NT_SUCCESS(PhQueryImageFileKey(FileName->Buffer, &key)))
+    {
+        _InterlockedIncrement((PLONG)&PhpImageCacheStatistics.NumberOfMisses);
+        return NULL;
+    }
+
+    PhAcquireQueuedLockExclusive(&PhpImageCacheLock);
+
+    existingEntry = PhFindEntryOpenHashtable_PPH_IMAGE_CACHE_ENTRY(&PhpImageCacheHashtable, &FileName->sr);
+
+    if (existingEntry && memcmp(&(*existingEntry)->Key, &key, sizeof(PH_IMAGE_FILE_KEY)) == 0)
+    {
+        entry = *existingEntry;
+        RemoveEntryList(&entry->LruListEntry);
+        InsertHeadList(&PhpImageCacheLruListHead, &entry->LruListEntry);
+        PhReferenceObject(entry);
+        _InterlockedIncrement((PLONG)&PhpImageCacheStatistics.NumberOfHits);
+
+        PhReleaseQueuedLockExclusive(&PhpImageCacheLock);
+
+        return entry;
+    }
+
+    if (existingEntry)
+    {
+        // The file has changed.
+        replacedEntry = *existingEntry;
+        PhRemoveEntryOpenHashtable_PPH_IMAGE_CACHE_ENTRY(&PhpImageCacheHashtable, &replacedEntry->FileName->sr);
+        RemoveEntryList(&replacedEntry->LruListEntry);
+    }
+    else if (PhpImageCacheHashtable.Count >= PH_IMAGE_CACHE_MAXIMUM_ENTRIES)
+    {
+        evictedEntry = CONTAINING_RECORD(PhpImageCacheLruListHead.Blink, PH_IMAGE_CACHE_ENTRY, LruListEntry);
+        PhRemoveEntryOpenHashtable_PPH_IMAGE_CACHE_ENTRY(&PhpImageCacheHashtable, &evictedEntry->FileName->sr);
+        RemoveEntryList(&evictedEntry->LruListEntry);
+        _InterlockedIncrement((PLONG)&PhpImageCacheStatistics.NumberOfEvictions);
+    }
+
+    entry = PhCreateObject(sizeof(PH_IMAGE_CACHE_ENTRY), PhpImageCacheEntryType);
+    memset(entry, 0, sizeof(PH_IMAGE_CACHE_ENTRY));
+    PhSetReference(&entry->FileName, FileName);
+    entry->Key = key;
+    PhInitializeInitOnce(&entry->IconInitOnce);
+    PhInitializeInitOnce(&entry->VersionInfoInitOnce);
+
+    PhAddEntryOpenHashtable_PPH_IMAGE_CACHE_ENTRY(&PhpImageCacheHashtable, entry, NULL);
+    InsertHeadList(&PhpImageCacheLruListHead, &entry->LruListEntry);
+    PhReferenceObject(entry); // for the caller
+    _InterlockedIncrement((PLONG)&PhpImageCacheStatistics.NumberOfMisses);
+    PhpImageCacheStatistics.NumberOfEntries = PhpImageCacheHashtable.Count;
+
+    PhReleaseQueuedLockExclusive(&PhpImageCacheLock);
+
+    // Entries may be freed here, so do this outside of the lock.
+    if (replacedEntry) PhDereferenceObject(replacedEntry);
+    if (evictedEntry) PhDereferenceObject(evictedEntry);
+
+    return entry;
+}
+
+/**
+ * Gets the icons of a file.
+ *
+ * \param Entry A cache entry.
+ * \param SmallIcon A variable which receives the small icon, or NULL if the file has no icon.
+ * \param LargeIcon A variable which receives the large icon, or NULL if the file has no icon.
+ *
+ * \remarks The icons are owned by the cache entry and must not be destroyed. They remain valid
+ * as long as you hold a reference to the entry.
+ */
+VOID PhGetImageCacheEntryIcons(
+    _In_ PPH_IMAGE_CACHE_ENTRY Entry,
+    _Out_ HICON *SmallIcon,
+    _Out_ HICON *LargeIcon
+    )
+{
+    if (PhBeginInitOnce(&Entry->IconInitOnce))
+    {
+        HICON smallIcon;
+        HICON largeIcon;
+
+        if (ExtractIconEx(Entry->FileName->Buffer, 0, &largeIcon, &smallIcon, 1) == 0)
+        {
+            smallIcon = NULL;
+            largeIcon = NULL;
+        }
+
+        // We need both icons.
+        if (!smallIcon || !largeIcon)
+        {
+            if (smallIcon) DestroyIcon(smallIcon);
+            if (largeIcon) DestroyIcon(largeIcon);
+            smallIcon = NULL;
+            largeIcon = NULL;
+        }
+
+        Entry->SmallIcon = smallIcon;
+        Entry->LargeIcon = largeIcon;
+
+        PhEndInitOnce(&Entry->IconInitOnce);
+    }
+
+    *SmallIcon = Entry->SmallIcon;
+    *LargeIcon = Entry->LargeIcon;
+}
+
+/**
+ * Gets the version information of a file.
+ *
+ * \param Entry A cache entry.
+ * \param VersionInfo A variable which receives a copy of the version information. Use
+ * PhDeleteImageVersionInfo() when you no longer need it.
+ */
+VOID PhGetImageCacheEntryVersionInfo(
+    _In_ PPH_IMAGE_CACHE_ENTRY Entry,
+    _Out_ PPH_IMAGE_VERSION_INFO VersionInfo
+    )
+{
+    if (PhBeginInitOnce(&Entry->VersionInfoInitOnce))
+    {
+        PhInitializeImageVersionInfo(&Entry->VersionInfo, Entry->FileName->Buffer);
+        PhEndInitOnce(&Entry->VersionInfoInitOnce);
+    }
+
+    PhSetReference(&VersionInfo->CompanyName, Entry->VersionInfo.CompanyName);
+    PhSetReference(&VersionInfo->FileDescription, Entry->VersionInfo.FileDescription);
+    PhSetReference(&VersionInfo->FileVersion, Entry->VersionInfo.FileVersion);
+    PhSetReference(&VersionInfo->ProductName, Entry->VersionInfo.ProductName);
+}
+
+/**
+ * Initializes a structure with the version information of a file, using the image cache if
+ * possible.
+ *
+ * \param VersionInfo The version information structure.
+ * \param FileName The file name.
+ */
+VOID PhInitializeImageVersionInfoCached(
+    _Out_ PPH_IMAGE_VERSION_INFO VersionInfo,
+    _In_opt_ PPH_STRING FileName
+    )
+{
+    PPH_IMAGE_CACHE_ENTRY entry;
+
+    memset(VersionInfo, 0, sizeof(PH_IMAGE_VERSION_INFO));
+
+    if (!PhIsNullOrEmptyString(FileName) && (entry = PhReferenceImageCacheEntry(FileName)))
+    {
+        PhGetImageCacheEntryVersionInfo(entry, VersionInfo);
+        PhDereferenceObject(entry);
+    }
+    else
+    {
+        PhInitializeImageVersionInfo(VersionInfo, PhGetString(FileName));
+    }
+}
+
+/**
+ * Gets statistics for the image cache.
+ *
+ * \param Statistics A variable which receives the statistics.
+ */
+VOID PhGetImageCacheStatistics(
+    _Out_ PPH_IMAGE_CACHE_STATISTICS Statistics
+    )
+{
+    *Statistics = PhpImageCacheStatistics;
+}
@@ -0,0 +1,596 @@
+/*
+ * Process Hacker -
+ *   image page comparison
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The code of each module is compared against the file it was loaded from. The file is laid out
+ * the way the loader lays it out (headers, then each section at its virtual address) and the
+ * base relocations are applied for the actual base address, so that unmodified code pages are
+ * identical to the pages in memory. Only sections that are executable and not writable are
+ * compared.
+ *
+ * Pages are compared by their 64-bit hashes first; the exact position of a modification is only
+ * searched for in pages whose hashes differ. Modules are compared in parallel.
+ *
+ * Some differences are expected: images that use dynamic value relocations (e.g. for import
+ * control flow guard) and hot-patched images are modified by the system.
+ */
+
+#include <phapp.h>
+#include <symprv.h>
+
+typedef struct _IMAGE_PAGE_CHANGE
+{
+    ULONG Rva; // RVA of the page
+    ULONG FirstDifference; // RVA of the first modified byte
+    ULONG NumberOfBytes; // number of modified bytes in the page
+} IMAGE_PAGE_CHANGE, *PIMAGE_PAGE_CHANGE;
+
+typedef struct _IMAGE_COMPARE_MODULE
+{
+    HANDLE ProcessHandle;
+    PPH_STRING FileName;
+    PVOID BaseAddress;
+    ULONG Size;
+
+    NTSTATUS Status;
+    ULONG NumberOfComparedPages;
+    ULONG NumberOfChanges;
+    ULONG AllocatedChanges;
+    PIMAGE_PAGE_CHANGE Changes;
+} IMAGE_COMPARE_MODULE, *PIMAGE_COMPARE_MODULE;
+
+typedef struct _IMAGE_COMPARE_CONTEXT
+{
+    HANDLE ProcessHandle;
+    PPH_LIST Modules;
+} IMAGE_COMPARE_CONTEXT, *PIMAGE_COMPARE_CONTEXT;
+
+static BOOLEAN NTAPI PhpEnumImageCompareModulesCallback(
+    _In_ PPH_MODULE_INFO Module,
+    _In_opt_ PVOID Context
+    )
+{
+    PIMAGE_COMPARE_CONTEXT context = Context;
+    PIMAGE_COMPARE_MODULE module;
+
+    if (Module->Type != PH_MODULE_TYPE_MODULE && Module->Type != PH_MODULE_TYPE_WOW64_MODULE)
+        return TRUE;
+    if (!Module->FileName)
+        return TRUE;
+
+    module = PhAllocate(sizeof(IMAGE_COMPARE_MODULE));
+    memset(module, 0, sizeof(IMAGE_COMPARE_MODULE));
+    module->ProcessHandle = context->ProcessHandle;
+    PhSetReference(&module->FileName, Module->FileName);
+    module->BaseAddress = Module->BaseAddress;
+    module->Size = Module->Size;
+
+    PhAddItemList(context->Modules, module);
+
+    return TRUE;
+}
+
+static VOID PhpAddImagePageChange(
+    _Inout_ PIMAGE_COMPARE_MODULE Module,
+    _In_ ULONG Rva,
+    _In_ ULONG FirstDifference,
+    _In_ ULONG NumberOfBytes
+    )
+{
+    PIMAGE_PAGE_CHANGE change;
+
+    if (Module->NumberOfChanges == Module->AllocatedChanges)
+    {
+        Module->AllocatedChanges = Module->AllocatedChanges ? Module->AllocatedChanges * 2 : 16;
+        Module->Changes = PhReAllocate(Module->Changes, Module->AllocatedChanges * sizeof(IMAGE_PAGE_CHANGE));
+    }
+
+    change = &Module->Changes[Module->NumberOfChanges++];
+    change->Rva = Rva;
+    change->FirstDifference = FirstDifference;
+    change->NumberOfBytes = NumberOfBytes;
+}
+
+static NTSTATUS PhpLayoutMappedImage(
+    _In_ PPH_MAPPED_IMAGE MappedImage,
+    _In_ ULONG SizeOfHeaders,
+    _Out_writes_bytes_(SizeOfImage) PUCHAR Image,
+    _In_ ULONG SizeOfImage
+    )
+{
+    ULONG i;
+
+    if (SizeOfHeaders > SizeOfImage || SizeOfHeaders > MappedImage->Size)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    memset(Image, 0, SizeOfImage);
+    memcpy(Image, MappedImage->ViewBase, SizeOfHeaders);
+
+    for (i = 0; i < MappedImage->NumberOfSections; i++)
+    {
+        PIMAGE_SECTION_HEADER section = &MappedImage->Sections[i];
+        ULONG size;
+
+        size = section->SizeOfRawData;
+
+        if (section->Misc.VirtualSize != 0 && section->Misc.VirtualSize < size)
+            size = section->Misc.VirtualSize;
+
+        if (size == 0)
+            continue;
+
+        if ((ULONG64)section->PointerToRawData + size > MappedImage->Size ||
+            (ULONG64)section->VirtualAddress + size > SizeOfImage)
+        {
+            return STATUS_INVALID_IMAGE_FORMAT;
+        }
+
+        memcpy(&Image[section->VirtualAddress], PTR_ADD_OFFSET(MappedImage->ViewBase, section->PointerToRawData), size);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS PhpRelocateImage(
+    _Inout_updates_bytes_(SizeOfImage) PUCHAR Image,
+    _In_ ULONG SizeOfImage,
+    _In_ PIMAGE_DATA_DIRECTORY RelocationDirectory,
+    _In_ ULONG64 Delta
+    )
+{
+    ULONG offset;
+    ULONG end;
+
+    if (Delta == 0 || RelocationDirectory->VirtualAddress == 0)
+        return STATUS_SUCCESS;
+    if ((ULONG64)RelocationDirectory->VirtualAddress + RelocationDirectory->Size > SizeOfImage)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    offset = RelocationDirectory->VirtualAddress;
+    end = offset + RelocationDirectory->Size;
+
+    while (offset + sizeof(IMAGE_BASE_RELOCATION) <= end)
+    {
+        PIMAGE_BASE_RELOCATION block = (PIMAGE_BASE_RELOCATION)&Image[offset];
+        PUSHORT entries;
+        ULONG numberOfEntries;
+        ULONG i;
+
+        if (block->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) || block->SizeOfBlock > end - offset)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        entries = (PUSHORT)(block + 1);
+        numberOfEntries = (block->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(USHORT);
+
+        for (i = 0; i < numberOfEntries; i++)
+        {
+            ULONG64 target = (ULONG64)block->VirtualAddress + (entries[i] & 0xfff);
+
+            switch (entries[i] >> 12)
+            {
+            case IMAGE_REL_BASED_HIGHLOW:
+                if (target + sizeof(ULONG) <= SizeOfImage)
+                    *(PULONG)&Image[target] += (ULONG)Delta;
+                break;
+            case IMAGE_REL_BASED_DIR64:
+                if (target + sizeof(ULONG64) <= SizeOfImage)
+                    *(PULONG64)&Image[target] += Delta;
+                break;
+            }
+        }
+
+        offset += block->SizeOfBlock;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static VOID PhpCompareImagePage(
+    _Inout_ PIMAGE_COMPARE_MODULE Module,
+    _In_ ULONG Rva,
+    _In_reads_(PAGE_SIZE) PUCHAR Expected,
+    _In_reads_(PAGE_SIZE) PUCHAR Actual
+    )
+{
+    SIZE_T firstDifference;
+    ULONG numberOfBytes;
+    ULONG i;
+
+    Module->NumberOfComparedPages++;
+
+    if (PhHashBytes64(Expected, PAGE_SIZE) == PhHashBytes64(Actual, PAGE_SIZE))
+        return;
+
+    firstDifference = PhCountEqualBytes(Expected, Actual, PAGE_SIZE);
+
+    if (firstDifference == PAGE_SIZE)
+        return;
+
+    numberOfBytes = 0;
+
+    for (i = (ULONG)firstDifference; i < PAGE_SIZE; i++)
+    {
+        if (Expected[i] != Actual[i])
+            numberOfBytes++;
+    }
+
+    PhpAddImagePageChange(Module, Rva, Rva + (ULONG)firstDifference, numberOfBytes);
+}
+
+static NTSTATUS PhpCompareImageModule(
+    _Inout_ PIMAGE_COMPARE_MODULE Module
+    )
+{
+    NTSTATUS status;
+    PH_MAPPED_IMAGE mappedImage;
+    PIMAGE_DATA_DIRECTORY dataDirectory;
+    PUCHAR expected;
+    PUCHAR actual;
+    ULONG64 imageBase;
+    ULONG sizeOfImage;
+    ULONG sizeOfHeaders;
+    ULONG iatStart;
+    ULONG iatEnd;
+    ULONG i;
+
+    if (!NT_SUCCESS(status = PhLoadMappedImage(Module->FileName->Buffer, NULL, TRUE, &mappedImage)))
+        return status;
+
+    if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        PIMAGE_OPTIONAL_HEADER32 optionalHeader = (PIMAGE_OPTIONAL_HEADER32)&mappedImage.NtHeaders->OptionalHeader;
+
+        imageBase = optionalHeader->ImageBase;
+        sizeOfImage = optionalHeader->SizeOfImage;
+        sizeOfHeaders = optionalHeader->SizeOfHeaders;
+    }
+    else
+    {
+        PIMAGE_OPTIONAL_HEADER64 optionalHeader = (PIMAGE_OPTIONAL_HEADER64)&mappedImage.NtHeaders->OptionalHeader;
+
+        imageBase = optionalHeader->ImageBase;
+        sizeOfImage = optionalHeader->SizeOfImage;
+        sizeOfHeaders = optionalHeader->SizeOfHeaders;
+    }
+
+    // A different size means that the file was replaced after the module was loaded.
+    if (sizeOfImage != Module->Size)
+    {
+        PhUnloadMappedImage(&mappedImage);
+        return STATUS_IMAGE_CHECKSUM_MISMATCH;
+    }
+
+    sizeOfImage = (sizeOfImage + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    expected = PhAllocatePage(sizeOfImage, NULL);
+    actual = PhAllocatePage(PAGE_SIZE * 16, NULL);
+
+    if (!expected || !actual)
+    {
+        status = STATUS_NO_MEMORY;
+        goto CleanupExit;
+    }
+
+    if (!NT_SUCCESS(status = PhpLayoutMappedImage(&mappedImage, sizeOfHeaders, expected, sizeOfImage)))
+        goto CleanupExit;
+
+    if (NT_SUCCESS(PhGetMappedImageDataEntry(&mappedImage, IMAGE_DIRECTORY_ENTRY_BASERELOC, &dataDirectory)))
+    {
+        if (!NT_SUCCESS(status = PhpRelocateImage(
+            expected,
+            sizeOfImage,
+            dataDirectory,
+            (ULONG64)Module->BaseAddress - imageBase
+            )))
+        {
+            goto CleanupExit;
+        }
+    }
+
+    // The loader writes the import address table, which is sometimes merged into the code
+    // section.
+
+    iatStart = 0;
+    iatEnd = 0;
+
+    if (NT_SUCCESS(PhGetMappedImageDataEntry(&mappedImage, IMAGE_DIRECTORY_ENTRY_IAT, &dataDirectory)) &&
+        (ULONG64)dataDirectory->VirtualAddress + dataDirectory->Size <= sizeOfImage)
+    {
+        iatStart = dataDirectory->VirtualAddress;
+        iatEnd = dataDirectory->VirtualAddress + dataDirectory->Size;
+    }
+
+    for (i = 0; i < mappedImage.NumberOfSections; i++)
+    {
+        PIMAGE_SECTION_HEADER section = &mappedImage.Sections[i];
+        ULONG64 endRva;
+        ULONG start;
+        ULONG end;
+        ULONG rva;
+
+        if (!(section->Characteristics & IMAGE_SCN_MEM_EXECUTE) || (section->Characteristics & IMAGE_SCN_MEM_WRITE))
+            continue;
+
+        start = section->VirtualAddress & ~(PAGE_SIZE - 1);
+        endRva = (ULONG64)section->VirtualAddress + (section->Misc.VirtualSize ? section->Misc.VirtualSize : section->SizeOfRawData);
+        endRva = (endRva + PAGE_SIZE - 1) & ~(ULONG64)(PAGE_SIZE - 1);
+        end = (ULONG)min(endRva, sizeOfImage);
+
+        for (rva = start; rva < end; )
+        {
+            SIZE_T length = min(end - rva, PAGE_SIZE * 16);
+            ULONG page;
+
+            if (NT_SUCCESS(PhReadVirtualMemory(
+                Module->ProcessHandle,
+                PTR_ADD_OFFSET(Module->BaseAddress, rva),
+                actual,
+                length,
+                NULL
+                )))
+            {
+                if (iatStart < iatEnd && iatStart < rva + length && iatEnd > rva)
+                {
+                    ULONG maskStart = max(iatStart, rva);
+                    ULONG maskEnd = min(iatEnd, rva + (ULONG)length);
+
+                    memcpy(&expected[maskStart], &actual[maskStart - rva], maskEnd - maskStart);
+                }
+
+                for (page = 0; page < length; page += PAGE_SIZE)
+                    PhpCompareImagePage(Module, rva + page, &expected[rva + page], &actual[page]);
+            }
+            else
+            {
+                // Compare the pages that are readable.
+                for (page = 0; page < length; page += PAGE_SIZE)
+                {
+                    if (!NT_SUCCESS(PhReadVirtualMemory(
+                        Module->ProcessHandle,
+                        PTR_ADD_OFFSET(Module->BaseAddress, rva + page),
+                        actual,
+                        PAGE_SIZE,
+                        NULL
+                        )))
+                    {
+                        continue;
+                    }
+
+                    if (iatStart < iatEnd && iatStart < rva + page + PAGE_SIZE && iatEnd > rva + page)
+                    {
+                        ULONG maskStart = max(iatStart, rva + page);
+                        ULONG maskEnd = min(iatEnd, rva + page + PAGE_SIZE);
+
+                        memcpy(&expected[maskStart], &actual[maskStart - rva - page], maskEnd - maskStart);
+                    }
+
+                    PhpCompareImagePage(Module, rva + page, &expected[rva + page], actual);
+                }
+            }
+
+            rva += (ULONG)length;
+        }
+    }
+
+    status = STATUS_SUCCESS;
+
+CleanupExit:
+    if (actual)
+        PhFreePage(actual);
+    if (expected)
+        PhFreePage(expected);
+
+    PhUnloadMappedImage(&mappedImage);
+
+    return status;
+}
+
+static NTSTATUS NTAPI PhpCompareImageModuleThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PIMAGE_COMPARE_MODULE module = Parameter;
+
+    module->Status = PhpCompareImageModule(module);
+
+    return STATUS_SUCCESS;
+}
+
+static int __cdecl PhpImageCompareModuleCompareFunction(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PIMAGE_COMPARE_MODULE module1 = *(PIMAGE_COMPARE_MODULE *)elem1;
+    PIMAGE_COMPARE_MODULE module2 = *(PIMAGE_COMPARE_MODULE *)elem2;
+
+    return uintptrcmp((ULONG_PTR)module1->BaseAddress, (ULONG_PTR)module2->BaseAddress);
+}
+
+/**
+ * Compares the code of the modules of a process against the image files and shows the
+ * modified pages.
+ *
+ * \param ParentWindowHandle The parent window.
+ * \param ProcessId The ID of the process.
+ */
+VOID PhShowModifiedImagePages(
+    _In_ HWND ParentWindowHandle,
+    _In_ HANDLE ProcessId
+    )
+{
+    NTSTATUS status;
+    IMAGE_COMPARE_CONTEXT context;
+    PH_WORK_QUEUE workQueue;
+    PPH_SYMBOL_PROVIDER symbolProvider;
+    PH_STRING_BUILDER stringBuilder;
+    CLIENT_ID clientId;
+    PPH_STRING clientIdName;
+    ULONG numberOfComparedPages;
+    ULONG numberOfChanges;
+    ULONG i;
+    ULONG j;
+
+    if (!NT_SUCCESS(status = PhOpenProcess(
+        &context.ProcessHandle,
+        ProcessQueryAccess | PROCESS_VM_READ,
+        ProcessId
+        )))
+    {
+        PhShowStatus(ParentWindowHandle, L"Unable to open the process", status, 0);
+        return;
+    }
+
+    context.Modules = PhCreateList(100);
+
+    if (!NT_SUCCESS(status = PhEnumGenericModules(
+        ProcessId,
+        context.ProcessHandle,
+        0,
+        PhpEnumImageCompareModulesCallback,
+        &context
+        )))
+    {
+        PhShowStatus(ParentWindowHandle, L"Unable to enumerate the modules", status, 0);
+        goto CleanupExit;
+    }
+
+    SetCursor(LoadCursor(NULL, IDC_WAIT));
+
+    PhInitializeWorkQueue(&workQueue, 0, PhSystemBasicInformation.NumberOfProcessors, 1000);
+
+    for (i = 0; i < context.Modules->Count; i++)
+        PhQueueItemWorkQueue(&workQueue, PhpCompareImageModuleThreadStart, context.Modules->Items[i]);
+
+    PhWaitForWorkQueue(&workQueue);
+    PhDeleteWorkQueue(&workQueue);
+
+    qsort(context.Modules->Items, context.Modules->Count, sizeof(PVOID), PhpImageCompareModuleCompareFunction);
+
+    numberOfComparedPages = 0;
+    numberOfChanges = 0;
+    symbolProvider = NULL;
+
+    for (i = 0; i < context.Modules->Count; i++)
+    {
+        PIMAGE_COMPARE_MODULE module = context.Modules->Items[i];
+
+        numberOfComparedPages += module->NumberOfComparedPages;
+        numberOfChanges += module->NumberOfChanges;
+
+        // Only load symbols for the modules that were modified.
+        if (module->NumberOfChanges != 0)
+        {
+            if (!symbolProvider)
+                symbolProvider = PhCreateSymbolProvider(ProcessId);
+
+            PhLoadModuleSymbolProvider(
+                symbolProvider,
+                module->FileName->Buffer,
+                (ULONG64)module->BaseAddress,
+                module->Size
+                );
+        }
+    }
+
+    PhInitializeStringBuilder(&stringBuilder, 0x1000);
+
+    clientId.UniqueProcess = ProcessId;
+    clientId.UniqueThread = NULL;
+    clientIdName = PhGetClientIdName(&clientId);
+    PhAppendFormatStringBuilder(
+        &stringBuilder,
+        L"Code comparison for %s: %lu modules, %lu pages compared, %lu pages modified.\r\n\r\n",
+        clientIdName->Buffer,
+        context.Modules->Count,
+        numberOfComparedPages,
+        numberOfChanges
+        );
+    PhDereferenceObject(clientIdName);
+
+    for (i = 0; i < context.Modules->Count; i++)
+    {
+        PIMAGE_COMPARE_MODULE module = context.Modules->Items[i];
+
+        if (!NT_SUCCESS(module->Status))
+        {
+            PPH_STRING message = PhGetNtMessage(module->Status);
+
+            PhAppendFormatStringBuilder(
+                &stringBuilder,
+                L"%s: unable to compare: %s\r\n\r\n",
+                module->FileName->Buffer,
+                PhGetStringOrDefault(message, L"Unknown error.")
+                );
+            PhClearReference(&message);
+
+            continue;
+        }
+
+        if (module->NumberOfChanges == 0)
+            continue;
+
+        PhAppendFormatStringBuilder(&stringBuilder, L"%s:\r\n", module->FileName->Buffer);
+
+        for (j = 0; j < module->NumberOfChanges; j++)
+        {
+            PIMAGE_PAGE_CHANGE change = &module->Changes[j];
+            PVOID address = PTR_ADD_OFFSET(module->BaseAddress, change->FirstDifference);
+            PPH_STRING symbol;
+
+            symbol = PhGetSymbolFromAddress(symbolProvider, (ULONG64)address, NULL, NULL, NULL, NULL);
+            PhAppendFormatStringBuilder(
+                &stringBuilder,
+                L"0x%Ix (%s): %lu bytes modified in page +0x%lx\r\n",
+                (ULONG_PTR)address,
+                PhGetStringOrDefault(symbol, L"unknown"),
+                change->NumberOfBytes,
+                change->Rva
+                );
+            PhClearReference(&symbol);
+        }
+
+        PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+    }
+
+    if (numberOfChanges == 0)
+        PhAppendStringBuilder2(&stringBuilder, L"No modified code was found.\r\n");
+
+    PhShowInformationDialog(ParentWindowHandle, stringBuilder.String->Buffer);
+    PhDeleteStringBuilder(&stringBuilder);
+
+    if (symbolProvider)
+        PhDereferenceObject(symbolProvider);
+
+CleanupExit:
+    for (i = 0; i < context.Modules->Count; i++)
+    {
+        PIMAGE_COMPARE_MODULE module = context.Modules->Items[i];
+
+        PhClearReference(&module->FileName);
+
+        if (module->Changes)
+            PhFree(module->Changes);
+
+        PhFree(module);
+    }
+
+    PhDereferenceObject(context.Modules);
+    NtClose(context.ProcessHandle);
+}
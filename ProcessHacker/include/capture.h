@@ -0,0 +1,85 @@
+#ifndef PH_CAPTURE_H
+#define PH_CAPTURE_H
+
+extern BOOLEAN PhProviderCaptureActive;
+extern BOOLEAN PhProviderReplayActive;
+
+NTSTATUS PhStartProviderCapture(
+    _In_ PWSTR FileName
+    );
+
+NTSTATUS PhOpenProviderReplay(
+    _In_ PWSTR FileName
+    );
+
+ULONG PhGetProviderReplayCount(
+    VOID
+    );
+
+BOOLEAN PhGetProviderReplayTime(
+    _In_ ULONG Index,
+    _Out_ PLARGE_INTEGER Time
+    );
+
+ULONG PhGetProviderReplayPosition(
+    VOID
+    );
+
+VOID PhSeekProviderReplay(
+    _In_ ULONG Index
+    );
+
+BOOLEAN PhIsProviderReplayPaused(
+    VOID
+    );
+
+VOID PhSetProviderReplayPaused(
+    _In_ BOOLEAN Paused
+    );
+
+// Process provider
+
+typedef struct _PH_REPLAY_FRAME
+{
+    LARGE_INTEGER Time;
+    PVOID Processes; // allocated with PhAllocate
+    ULONG ProcessesSize;
+    BOOLEAN Discontinuity; // the replay was moved backwards since the previous frame
+} PH_REPLAY_FRAME, *PPH_REPLAY_FRAME;
+
+typedef BOOLEAN (NTAPI *PPH_REPLAY_FRAME_SOURCE)(
+    _Out_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _Out_writes_(NumberOfProcessors) PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors,
+    _Out_ PPH_REPLAY_FRAME Frame
+    );
+
+VOID PhSetProviderReplaySource(
+    _In_ PPH_REPLAY_FRAME_SOURCE Source
+    );
+
+VOID PhCaptureProcessorInformation(
+    _In_ PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors
+    );
+
+VOID PhWriteProviderCaptureFrame(
+    _In_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _In_ PVOID Processes,
+    _In_ ULONG BufferSize
+    );
+
+BOOLEAN PhReadProviderReplayFrame(
+    _Out_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _Out_writes_(NumberOfProcessors) PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors,
+    _Out_ PPH_REPLAY_FRAME Frame
+    );
+
+// captdlg
+
+VOID PhShowProviderReplayDialog(
+    VOID
+    );
+
+#endif
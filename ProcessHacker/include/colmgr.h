@@ -30,6 +30,7 @@ typedef struct _PH_CM_COLUMN
     ULONG SubId;
     PVOID Context;
     PVOID SortFunction;
+    PVOID SortKeyFunction;
 } PH_CM_COLUMN, *PPH_CM_COLUMN;
 
 VOID PhCmInitializeManager(
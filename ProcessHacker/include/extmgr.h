@@ -39,6 +39,21 @@ typedef VOID (NTAPI *PPH_EM_OBJECT_CALLBACK)(
     _In_ PH_EM_OBJECT_TYPE ObjectType,
     _In_ PVOID Extension
     );
+
+/**
+ * A bulk update callback.
+ *
+ * \param ObjectType The object type.
+ * \param Objects An array of live objects, indexed by slot. Entries for unused slots are NULL.
+ * \param NumberOfSlots The number of entries in \a Objects.
+ */
+typedef VOID (NTAPI *PPH_EM_OBJECT_BULK_CALLBACK)(
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_reads_(NumberOfSlots) PVOID *Objects,
+    _In_ ULONG NumberOfSlots
+    );
+
+typedef struct _PH_EM_OBJECT_COLUMN *PPH_EM_OBJECT_COLUMN;
 // end_phapppub
 
 typedef struct _PH_EM_APP_CONTEXT
@@ -46,6 +61,7 @@ typedef struct _PH_EM_APP_CONTEXT
     LIST_ENTRY ListEntry;
     PH_STRINGREF AppName;
     struct _PH_EM_OBJECT_EXTENSION *Extensions[EmMaximumObjectType];
+    PPH_EM_OBJECT_BULK_CALLBACK BulkCallbacks[EmMaximumObjectType];
 } PH_EM_APP_CONTEXT, *PPH_EM_APP_CONTEXT;
 
 #endif
@@ -3,11 +3,28 @@
 
 #include <extmgr.h>
 
+#define PH_EM_COLUMN_CHUNK_SLOTS 256
+#define PH_EM_COLUMN_MAXIMUM_CHUNKS 1024
+#define PH_EM_MAXIMUM_SLOTS (PH_EM_COLUMN_CHUNK_SLOTS * PH_EM_COLUMN_MAXIMUM_CHUNKS)
+#define PH_EM_INVALID_SLOT ((ULONG)-1)
+
 typedef struct _PH_EM_OBJECT_TYPE_STATE
 {
     SIZE_T InitialSize;
     SIZE_T ExtensionOffset;
     LIST_ENTRY ExtensionListHead;
+
+    // Columnar storage. Every object of a type with columns is assigned a dense slot, stored in
+    // the object at SlotOffset.
+    BOOLEAN SlotsEnabled;
+    BOOLEAN HasBulkCallbacks;
+    SIZE_T SlotOffset;
+    LIST_ENTRY ColumnListHead;
+    PH_QUEUED_LOCK SlotLock;
+    PVOID *SlotObjects;
+    ULONG NumberOfSlots;
+    ULONG AllocatedSlots;
+    PPH_LIST FreeSlots;
 } PH_EM_OBJECT_TYPE_STATE, *PPH_EM_OBJECT_TYPE_STATE;
 
 typedef struct _PH_EM_OBJECT_EXTENSION
@@ -18,6 +35,16 @@ typedef struct _PH_EM_OBJECT_EXTENSION
     PPH_EM_OBJECT_CALLBACK Callbacks[EmMaximumObjectOperation];
 } PH_EM_OBJECT_EXTENSION, *PPH_EM_OBJECT_EXTENSION;
 
+// Column data is split into fixed-size chunks so that element pointers stay valid while new
+// slots are being allocated.
+typedef struct _PH_EM_OBJECT_COLUMN
+{
+    LIST_ENTRY ListEntry;
+    PH_EM_OBJECT_TYPE ObjectType;
+    ULONG ElementSize;
+    PVOID Chunks[PH_EM_COLUMN_MAXIMUM_CHUNKS];
+} PH_EM_OBJECT_COLUMN;
+
 VOID PhEmInitialization(
     VOID
     );
@@ -52,6 +79,32 @@ VOID PhEmCallObjectOperation(
     _In_ PH_EM_OBJECT_OPERATION Operation
     );
 
+PPH_EM_OBJECT_COLUMN PhEmAddObjectColumn(
+    _Inout_ PPH_EM_APP_CONTEXT AppContext,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ ULONG ElementSize
+    );
+
+ULONG PhEmGetObjectSlot(
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PVOID Object
+    );
+
+PVOID PhEmGetObjectColumnElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ ULONG Slot
+    );
+
+VOID PhEmSetObjectBulkCallback(
+    _Inout_ PPH_EM_APP_CONTEXT AppContext,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PPH_EM_OBJECT_BULK_CALLBACK BulkCallback
+    );
+
+VOID PhEmCallObjectBulkUpdate(
+    _In_ PH_EM_OBJECT_TYPE ObjectType
+    );
+
 BOOLEAN PhEmParseCompoundId(
     _In_ PPH_STRINGREF CompoundId,
     _Out_ PPH_STRINGREF AppName,
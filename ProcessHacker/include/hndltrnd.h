@@ -0,0 +1,26 @@
+#ifndef PH_HNDLTRND_H
+#define PH_HNDLTRND_H
+
+typedef struct _PH_HANDLE_TYPE_TREND
+{
+    FLOAT GrowthRate; // handles per minute
+    ULONG OldestCount;
+    ULONG NewestCount;
+    FLOAT Minutes; // time between the oldest and newest samples
+} PH_HANDLE_TYPE_TREND, *PPH_HANDLE_TYPE_TREND;
+
+VOID PhHandleTrendInitialization(
+    VOID
+    );
+
+PPH_STRING PhGetHandleTrendTypeName(
+    _In_ ULONG TypeIndex
+    );
+
+BOOLEAN PhGetHandleTypeTrend(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG TypeIndex,
+    _Out_ PPH_HANDLE_TYPE_TREND Trend
+    );
+
+#endif
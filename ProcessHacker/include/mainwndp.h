@@ -7,6 +7,28 @@
 
 #define TIMER_FLUSH_PROCESS_QUERY_DATA 1
 
+#define PH_MWP_ITEM_ADDED 1
+#define PH_MWP_ITEM_MODIFIED 2
+#define PH_MWP_ITEM_REMOVED 3
+#define PH_MWP_ITEM_ALERT 4 // process provider only; Item is a PPH_PROCESS_ALERT
+
+typedef struct _PH_MWP_ITEM_EVENT
+{
+    ULONG Type;
+    ULONG RunId;
+    PVOID Item;
+} PH_MWP_ITEM_EVENT, *PPH_MWP_ITEM_EVENT;
+
+// Item events are collected here by the provider threads and applied by the main thread
+// in one batch when the provider signals the end of its update.
+typedef struct _PH_MWP_ITEM_EVENT_QUEUE
+{
+    PH_QUEUED_LOCK Lock;
+    ULONG Count;
+    ULONG AllocatedCount;
+    PPH_MWP_ITEM_EVENT Events;
+} PH_MWP_ITEM_EVENT_QUEUE, *PPH_MWP_ITEM_EVENT_QUEUE;
+
 LRESULT CALLBACK PhMwpWndProc(
     _In_ HWND hWnd,
     _In_ UINT uMsg,
@@ -115,6 +137,24 @@ ULONG_PTR PhMwpOnUserMessage(
 
 // Callbacks
 
+VOID PhMwpQueueItemEvent(
+    _Inout_ PPH_MWP_ITEM_EVENT_QUEUE Queue,
+    _In_ ULONG Type,
+    _In_ ULONG RunId,
+    _In_ PVOID Item
+    );
+
+BOOLEAN PhMwpTakeItemEvents(
+    _Inout_ PPH_MWP_ITEM_EVENT_QUEUE Queue,
+    _Out_ PPH_MWP_ITEM_EVENT *Events,
+    _Out_ PULONG Count
+    );
+
+VOID NTAPI PhMwpProviderRunCompletedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
 VOID NTAPI PhMwpProcessAddedHandler(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -135,6 +175,16 @@ VOID NTAPI PhMwpProcessesUpdatedHandler(
     _In_opt_ PVOID Context
     );
 
+VOID NTAPI PhMwpProcessAlertHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
+VOID NTAPI PhMwpProcessNotificationHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
 VOID NTAPI PhMwpServiceAddedHandler(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -362,10 +412,22 @@ VOID PhMwpOnProcessRemoved(
     _In_ PPH_PROCESS_ITEM ProcessItem
     );
 
+VOID PhMwpOnProcessAlert(
+    _In_ _Assume_refs_(1) PPH_PROCESS_ALERT Alert
+    );
+
+VOID NTAPI PhMwpOnShortLivedProcess(
+    _In_ PVOID Parameter
+    );
+
 VOID PhMwpOnProcessesUpdated(
     VOID
     );
 
+VOID PhMwpFlushProcessEvents(
+    VOID
+    );
+
 // Services
 
 VOID PhMwpNeedServiceTreeList(
@@ -400,6 +462,10 @@ VOID PhMwpOnServicesUpdated(
     VOID
     );
 
+VOID PhMwpFlushServiceEvents(
+    VOID
+    );
+
 // Network
 
 VOID PhMwpNeedNetworkTreeList(
@@ -439,6 +505,10 @@ VOID PhMwpOnNetworkItemsUpdated(
     VOID
     );
 
+VOID PhMwpFlushNetworkEvents(
+    VOID
+    );
+
 // Users
 
 VOID PhMwpUpdateUsersMenu(
@@ -1,24 +1,46 @@
 #ifndef PH_MEMSRCH_H
 #define PH_MEMSRCH_H
 
-typedef struct _PH_MEMORY_RESULT
+#define PH_MEMORY_RESULTS_CHUNK_COUNT 4096 // results per chunk
+#define PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE (1024 * 1024) // 1 MB
+
+typedef struct _PH_MEMORY_RESULTS_CHUNK
+{
+    PVOID Address[PH_MEMORY_RESULTS_CHUNK_COUNT];
+    ULONG64 TextOffset[PH_MEMORY_RESULTS_CHUNK_COUNT]; // offset in the text arena
+    ULONG Length[PH_MEMORY_RESULTS_CHUNK_COUNT]; // in bytes
+    USHORT TextLength[PH_MEMORY_RESULTS_CHUNK_COUNT]; // in characters
+} PH_MEMORY_RESULTS_CHUNK, *PPH_MEMORY_RESULTS_CHUNK;
+
+// A search can produce millions of results, so they are stored column by column in fixed size
+// chunks instead of one allocation per result. The display text of every result is printable
+// ASCII and is kept as one byte per character in a shared arena; use PhGetMemoryResultText to
+// decode it.
+typedef struct _PH_MEMORY_RESULTS
 {
-    LONG RefCount;
-    PVOID Address;
-    SIZE_T Length;
-    PH_STRINGREF Display;
-} PH_MEMORY_RESULT, *PPH_MEMORY_RESULT;
+    ULONG Count;
+    PPH_LIST Chunks; // PPH_MEMORY_RESULTS_CHUNK
+    PPH_LIST TextBlocks; // PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE bytes each
+    ULONG TextBlockUsed; // bytes used in the last text block
+} PH_MEMORY_RESULTS, *PPH_MEMORY_RESULTS;
 
 typedef VOID (NTAPI *PPH_MEMORY_RESULT_CALLBACK)(
-    _In_ _Assume_refs_(1) PPH_MEMORY_RESULT Result,
+    _In_ PVOID Address,
+    _In_ SIZE_T Length,
+    _In_reads_(TextLength) PUCHAR Text,
+    _In_ ULONG TextLength,
     _In_opt_ PVOID Context
     );
 
 #define PH_DISPLAY_BUFFER_COUNT (PAGE_SIZE * 2 - 1)
+// Small enough for the copied chunk to still be in the cache when it is scanned.
+#define PH_MEMORY_STRING_CHUNK_SIZE (1024 * 1024) // 1 MB
+#define PH_MEMORY_STRING_MAXIMUM_THREADS 8
 
 typedef struct _PH_MEMORY_SEARCH_OPTIONS
 {
     BOOLEAN Cancel;
+    // Invoked from worker threads, one at a time. Results are not reported in address order.
     PPH_MEMORY_RESULT_CALLBACK Callback;
     PVOID Context;
 } PH_MEMORY_SEARCH_OPTIONS, *PPH_MEMORY_SEARCH_OPTIONS;
@@ -40,22 +62,46 @@ VOID PhFreeForMemorySearch(
     _In_ _Post_invalid_ PVOID Memory
     );
 
-PVOID PhCreateMemoryResult(
-    _In_ PVOID Address,
-    _In_ SIZE_T Length
+PPH_MEMORY_RESULTS PhCreateMemoryResults(
+    VOID
     );
 
-VOID PhReferenceMemoryResult(
-    _In_ PPH_MEMORY_RESULT Result
+BOOLEAN PhAddMemoryResult(
+    _Inout_ PPH_MEMORY_RESULTS Results,
+    _In_ PVOID Address,
+    _In_ SIZE_T Length,
+    _In_reads_(TextLength) PUCHAR Text,
+    _In_ ULONG TextLength
     );
 
-VOID PhDereferenceMemoryResult(
-    _In_ PPH_MEMORY_RESULT Result
+VOID PhSortMemoryResultsByAddress(
+    _Inout_ PPH_MEMORY_RESULTS Results
     );
 
-VOID PhDereferenceMemoryResults(
-    _In_reads_(NumberOfResults) PPH_MEMORY_RESULT *Results,
-    _In_ ULONG NumberOfResults
+ULONG PhGetMemoryResultText(
+    _In_ PPH_MEMORY_RESULTS Results,
+    _In_ ULONG Index,
+    _Out_writes_(PH_DISPLAY_BUFFER_COUNT + 1) PWSTR Buffer
     );
 
+FORCEINLINE PVOID PhGetMemoryResultAddress(
+    _In_ PPH_MEMORY_RESULTS Results,
+    _In_ ULONG Index
+    )
+{
+    PPH_MEMORY_RESULTS_CHUNK chunk = Results->Chunks->Items[Index / PH_MEMORY_RESULTS_CHUNK_COUNT];
+
+    return chunk->Address[Index % PH_MEMORY_RESULTS_CHUNK_COUNT];
+}
+
+FORCEINLINE ULONG PhGetMemoryResultLength(
+    _In_ PPH_MEMORY_RESULTS Results,
+    _In_ ULONG Index
+    )
+{
+    PPH_MEMORY_RESULTS_CHUNK chunk = Results->Chunks->Items[Index / PH_MEMORY_RESULTS_CHUNK_COUNT];
+
+    return chunk->Length[Index % PH_MEMORY_RESULTS_CHUNK_COUNT];
+}
+
 #endif
@@ -277,6 +277,11 @@ VOID PhMipListSectionSortFunction(
     _In_opt_ PVOID Context
     );
 
+VOID PhMipSortProcessListByTopItems(
+    _Inout_ PPH_LIST List,
+    _In_ PH_PROCESS_TOP_TYPE Type
+    );
+
 VOID PhMipTickListSection(
     _In_ PPH_MINIINFO_LIST_SECTION ListSection
     );
@@ -335,11 +340,6 @@ BOOLEAN PhMipCpuListSectionCallback(
     _In_opt_ PVOID Parameter2
     );
 
-int __cdecl PhMipCpuListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    );
-
 int __cdecl PhMipCpuListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -354,11 +354,6 @@ BOOLEAN PhMipCommitListSectionCallback(
     _In_opt_ PVOID Parameter2
     );
 
-int __cdecl PhMipCommitListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    );
-
 int __cdecl PhMipCommitListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -373,11 +368,6 @@ BOOLEAN PhMipPhysicalListSectionCallback(
     _In_opt_ PVOID Parameter2
     );
 
-int __cdecl PhMipPhysicalListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    );
-
 int __cdecl PhMipPhysicalListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -392,11 +382,6 @@ BOOLEAN PhMipIoListSectionCallback(
     _In_opt_ PVOID Parameter2
     );
 
-int __cdecl PhMipIoListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    );
-
 int __cdecl PhMipIoListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -0,0 +1,56 @@
+#ifndef PH_MONITOR_H
+#define PH_MONITOR_H
+
+// The wire format of the headless monitor; see monitor.c.
+
+#define PH_MONITOR_MAGIC ('NMHP')
+#define PH_MONITOR_DELTA_MAGIC ('DMHP')
+#define PH_MONITOR_VERSION 1
+
+#define PH_MONITOR_DELTA_ADDED 1
+#define PH_MONITOR_DELTA_REMOVED 2
+#define PH_MONITOR_DELTA_CHANGED 3
+
+// The pipe name used by the remote hosts window when only a host name is given.
+#define PH_MONITOR_DEFAULT_PIPE_NAME L"ProcessHackerMonitor"
+
+typedef enum _PH_MONITOR_FIELD
+{
+    PhMonitorFieldName,
+    PhMonitorFieldCpu,
+    PhMonitorFieldPrivateBytes,
+    PhMonitorFieldWorkingSet,
+    PhMonitorFieldIoRead,
+    PhMonitorFieldIoWrite,
+    PhMonitorFieldIoOther,
+    PhMonitorFieldThreads,
+    PhMonitorFieldHandles,
+    PhMonitorFieldServices,
+    PhMonitorFieldConnections,
+    PhMonitorFieldMaximum
+} PH_MONITOR_FIELD;
+
+#include <pshpack1.h>
+typedef struct _PH_MONITOR_HEADER
+{
+    ULONG Magic;
+    USHORT Version;
+    USHORT NumberOfFields;
+    UCHAR Fields[PhMonitorFieldMaximum];
+} PH_MONITOR_HEADER, *PPH_MONITOR_HEADER;
+
+typedef struct _PH_MONITOR_SAMPLE_HEADER
+{
+    ULONG Length; // including this header
+    LARGE_INTEGER Time;
+    ULONG NumberOfProcesses;
+} PH_MONITOR_SAMPLE_HEADER, *PPH_MONITOR_SAMPLE_HEADER;
+#include <poppack.h>
+
+// remotes
+
+VOID PhShowRemoteHostsDialog(
+    _In_ HWND ParentWindowHandle
+    );
+
+#endif
@@ -158,6 +158,10 @@ VOID PhNfNotifyMiniInfoPinned(
     _In_ BOOLEAN Pinned
     );
 
+VOID PhNfNotifySessionConnected(
+    _In_ BOOLEAN Connected
+    );
+
 // begin_phapppub
 // Public registration data
 
@@ -69,6 +69,8 @@ typedef struct _PH_STARTUP_PARAMETERS
 
     PPH_LIST PluginParameters;
     PPH_STRING SelectTab;
+    PPH_STRING RecordFileName;
+    PPH_STRING ReplayFileName;
 } PH_STARTUP_PARAMETERS, *PPH_STARTUP_PARAMETERS;
 
 extern PPH_STRING PhApplicationDirectory;
@@ -85,6 +87,34 @@ extern PH_STARTUP_PARAMETERS PhStartupParameters;
 
 extern PH_PROVIDER_THREAD PhPrimaryProviderThread;
 extern PH_PROVIDER_THREAD PhSecondaryProviderThread;
+extern PH_PROVIDER_THREAD PhServiceProviderThread;
+extern PH_PROVIDER_THREAD PhNetworkProviderThread;
+
+#define PH_STARTUP_PHASE_MAXIMUM 32
+
+typedef struct _PH_STARTUP_PHASE
+{
+    PWSTR Name;
+    HANDLE ThreadId;
+    LARGE_INTEGER StartCounter;
+    LARGE_INTEGER EndCounter; // zero if the phase has not ended
+} PH_STARTUP_PHASE, *PPH_STARTUP_PHASE;
+
+extern PH_STARTUP_PHASE PhStartupPhases[PH_STARTUP_PHASE_MAXIMUM];
+extern volatile LONG PhNumberOfStartupPhases;
+extern LARGE_INTEGER PhStartupCounter;
+
+ULONG PhBeginStartupPhase(
+    _In_ PWSTR Name
+    );
+
+VOID PhEndStartupPhase(
+    _In_ ULONG Index
+    );
+
+VOID PhCompleteStartupPhases(
+    VOID
+    );
 
 // begin_phapppub
 PHAPPAPI
@@ -237,6 +267,45 @@ VOID PhEnumChildWindows(
     _In_ LPARAM lParam
     );
 
+// begin_phapppub
+typedef struct _PH_WINDOW_SNAPSHOT_ENTRY
+{
+    HWND WindowHandle;
+    HANDLE ProcessId;
+    HANDLE ThreadId;
+} PH_WINDOW_SNAPSHOT_ENTRY, *PPH_WINDOW_SNAPSHOT_ENTRY;
+
+typedef struct _PH_WINDOW_SNAPSHOT
+{
+    ULONG NumberOfWindows;
+    PPH_WINDOW_SNAPSHOT_ENTRY Windows; // top-level windows in Z order
+    PULONG ProcessIndex; // indices into Windows, sorted by process ID
+} PH_WINDOW_SNAPSHOT, *PPH_WINDOW_SNAPSHOT;
+
+PHAPPAPI
+PPH_WINDOW_SNAPSHOT
+NTAPI
+PhReferenceWindowSnapshot(
+    VOID
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhInvalidateWindowSnapshot(
+    VOID
+    );
+
+PHAPPAPI
+ULONG
+NTAPI
+PhFindProcessWindowsSnapshot(
+    _In_ PPH_WINDOW_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _Out_ PULONG *Indices
+    );
+// end_phapppub
+
 HWND PhGetProcessMainWindow(
     _In_ HANDLE ProcessId,
     _In_opt_ HANDLE ProcessHandle
@@ -558,6 +627,39 @@ NTAPI
 PhApplyTreeNewFilters(
     _In_ PPH_TN_FILTER_SUPPORT Support
     );
+
+typedef struct _PH_TN_FILTER_QUERY *PPH_TN_FILTER_QUERY;
+
+PHAPPAPI
+PPH_TN_FILTER_QUERY
+NTAPI
+PhCreateTreeNewFilterQuery(
+    _In_ PPH_STRINGREF Text
+    );
+
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhMatchTreeNewFilterQueryString(
+    _In_ PPH_TN_FILTER_QUERY Query,
+    _In_ PPH_STRINGREF Text
+    );
+
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhMatchTreeNewFilterQueryNumber(
+    _In_ PPH_TN_FILTER_QUERY Query,
+    _In_ PWSTR FieldName,
+    _In_ DOUBLE Value
+    );
+
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhIsTreeNewFilterQueryNumeric(
+    _In_ PPH_TN_FILTER_QUERY Query
+    );
 // end_phapppub
 
 typedef struct _PH_COPY_CELL_CONTEXT
@@ -745,7 +847,7 @@ typedef struct _PH_SHOWMEMORYEDITOR
 typedef struct _PH_SHOWMEMORYRESULTS
 {
     HANDLE ProcessId;
-    PPH_LIST Results;
+    struct _PH_MEMORY_RESULTS *Results;
 } PH_SHOWMEMORYRESULTS, *PPH_SHOWMEMORYRESULTS;
 
 // begin_phapppub
@@ -799,8 +901,9 @@ typedef struct _PH_ADDITIONAL_TAB_PAGE
 #define PH_NOTIFY_SERVICE_DELETE 0x8
 #define PH_NOTIFY_SERVICE_START 0x10
 #define PH_NOTIFY_SERVICE_STOP 0x20
-#define PH_NOTIFY_MAXIMUM 0x40
-#define PH_NOTIFY_VALID_MASK 0x3f
+#define PH_NOTIFY_PROCESS_ALERT 0x40
+#define PH_NOTIFY_MAXIMUM 0x80
+#define PH_NOTIFY_VALID_MASK 0x7f
 // end_phapppub
 
 BOOLEAN PhMainWndInitialization(
@@ -1137,6 +1240,28 @@ PhFormatLogEntry(
     );
 // end_phapppub
 
+// logfile
+
+#define PH_LOG_FILE_EXPORT_CSV 0
+#define PH_LOG_FILE_EXPORT_JSON 1
+
+VOID PhLogFileInitialization(
+    VOID
+    );
+
+BOOLEAN PhIsLogFileEnabled(
+    VOID
+    );
+
+VOID PhLogFileAddEntry(
+    _In_ PPH_LOG_ENTRY Entry
+    );
+
+NTSTATUS PhExportLogFile(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Format
+    );
+
 // dbgcon
 
 VOID PhShowDebugConsole(
@@ -1544,6 +1669,18 @@ NTSTATUS PhCommandModeStart(
     VOID
     );
 
+// monitor
+
+NTSTATUS PhCommandModeMonitor(
+    VOID
+    );
+
+// provbench
+
+NTSTATUS PhCommandModeBenchmark(
+    VOID
+    );
+
 // anawait
 
 VOID PhUiAnalyzeWaitThread(
@@ -1553,6 +1690,12 @@ VOID PhUiAnalyzeWaitThread(
     _In_ PPH_SYMBOL_PROVIDER SymbolProvider
     );
 
+VOID PhUiAnalyzeWaitProcess(
+    _In_ HWND hWnd,
+    _In_ HANDLE ProcessId,
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
+    );
+
 // mdump
 
 BOOLEAN PhUiCreateDumpFileProcess(
@@ -1560,6 +1703,26 @@ BOOLEAN PhUiCreateDumpFileProcess(
     _In_ PPH_PROCESS_ITEM Process
     );
 
+BOOLEAN PhUiCreateDumpFileProcesses(
+    _In_ HWND hWnd,
+    _In_ PPH_PROCESS_ITEM *Processes,
+    _In_ ULONG NumberOfProcesses
+    );
+
+#define PH_DUMP_BATCH_USE_SNAPSHOT 0x1
+#define PH_DUMP_BATCH_COMPRESS 0x2
+
+#define PH_DUMP_BATCH_DEFAULT_CONCURRENCY 4
+
+NTSTATUS PhCreateDumpFilesProcesses(
+    _In_reads_(NumberOfProcesses) PHANDLE ProcessIds,
+    _In_ ULONG NumberOfProcesses,
+    _In_ PPH_STRINGREF DirectoryName,
+    _In_ ULONG MaximumConcurrentDumps,
+    _In_ ULONG Flags,
+    _Out_writes_opt_(NumberOfProcesses) PNTSTATUS Statuses
+    );
+
 // about
 
 VOID PhShowAboutDialog(
@@ -1647,11 +1810,37 @@ VOID PhShowFindObjectsDialog(
 
 // gdihndl
 
+#define PH_GDI_HANDLE_SNAPSHOT_INDEX(Key) ((Key) & 0xffff)
+
+typedef struct _PH_GDI_HANDLE_SNAPSHOT
+{
+    ULONG SessionId;
+    ULONG NumberOfHandles;
+    PULONG Handles; // (truncated process ID << 16) | handle table index, sorted
+    ULONG AmbiguousProcessIds[0x10000 / 32]; // truncated process IDs shared by several processes
+} PH_GDI_HANDLE_SNAPSHOT, *PPH_GDI_HANDLE_SNAPSHOT;
+
 VOID PhShowGdiHandlesDialog(
     _In_ HWND ParentWindowHandle,
     _In_ PPH_PROCESS_ITEM ProcessItem
     );
 
+PPH_GDI_HANDLE_SNAPSHOT PhReferenceGdiHandleSnapshot(
+    VOID
+    );
+
+VOID PhInvalidateGdiHandleSnapshot(
+    VOID
+    );
+
+BOOLEAN PhFindGdiHandlesSnapshot(
+    _In_ PPH_GDI_HANDLE_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _In_ ULONG SessionId,
+    _Out_ PULONG *Handles,
+    _Out_ PULONG NumberOfHandles
+    );
+
 // hidnproc
 
 VOID PhShowHiddenProcessesDialog(
@@ -1673,6 +1862,13 @@ VOID PhShowHandleStatisticsDialog(
     _In_ HANDLE ProcessId
     );
 
+// imgcmp
+
+VOID PhShowModifiedImagePages(
+    _In_ HWND ParentWindowHandle,
+    _In_ HANDLE ProcessId
+    );
+
 // infodlg
 
 VOID PhShowInformationDialog(
@@ -1735,7 +1931,14 @@ VOID PhShowMemoryProtectDialog(
 
 VOID PhShowMemoryResultsDialog(
     _In_ HANDLE ProcessId,
-    _In_ PPH_LIST Results
+    _In_ struct _PH_MEMORY_RESULTS *Results
+    );
+
+// heapinfo
+
+VOID PhShowProcessHeapStatistics(
+    _In_ HWND ParentWindowHandle,
+    _In_ PPH_PROCESS_ITEM ProcessItem
     );
 
 // memsrch
@@ -1930,6 +2133,14 @@ VOID PhShowThreadStackDialog(
     _In_ PPH_THREAD_PROVIDER ThreadProvider
     );
 
+VOID PhShowThreadStackSampleDialog(
+    _In_ HWND ParentWindowHandle,
+    _In_ HANDLE ProcessId,
+    _In_reads_opt_(NumberOfThreadIds) PHANDLE ThreadIds,
+    _In_ ULONG NumberOfThreadIds,
+    _In_ PPH_THREAD_PROVIDER ThreadProvider
+    );
+
 // tokprp
 
 PPH_STRING PhGetGroupAttributesString(
@@ -44,6 +44,7 @@ typedef enum _PH_GENERAL_CALLBACK
     GeneralCallbackMemoryItemListControl = 31, // PPH_PLUGIN_MEMORY_ITEM_LIST_CONTROL Data [properties thread]
     GeneralCallbackMiniInformationInitializing = 32, // PPH_PLUGIN_MINIINFO_POINTERS Data [main thread]
     GeneralCallbackMiListSectionMenuInitializing = 33, // PPH_PLUGIN_MENU_INFORMATION Data [main thread]
+    GeneralCallbackProviderRunCompleted = 34, // PPH_PROVIDER_RUN_INFORMATION Data [provider thread]
     GeneralCallbackMaximum
 } PH_GENERAL_CALLBACK, *PPH_GENERAL_CALLBACK;
 
@@ -56,6 +57,7 @@ typedef enum _PH_PLUGIN_CALLBACK
     PluginCallbackTreeNewMessage = 4, // PPH_PLUGIN_TREENEW_MESSAGE Message [main/properties thread]
     PluginCallbackPhSvcRequest = 5, // PPH_PLUGIN_PHSVC_REQUEST Message [phsvc thread]
     PluginCallbackMenuHook = 6, // PH_PLUGIN_MENU_HOOK_INFORMATION MenuHookInfo [menu thread]
+    PluginCallbackInitialize = 7, // [main/properties thread] // only invoked if LazyInitialization is set
     PluginCallbackMaximum
 } PH_PLUGIN_CALLBACK, *PPH_PLUGIN_CALLBACK;
 
@@ -91,6 +93,7 @@ typedef struct _PH_PLUGIN_NOTIFY_EVENT
     // Parameter is:
     // PPH_PROCESS_ITEM for Type = PH_NOTIFY_PROCESS_*
     // PPH_SERVICE_ITEM for Type = PH_NOTIFY_SERVICE_*
+    // PPH_PROCESS_ALERT for Type = PH_NOTIFY_PROCESS_ALERT
 
     ULONG Type;
     BOOLEAN Handled;
@@ -342,6 +345,12 @@ typedef LONG (NTAPI *PPH_PLUGIN_TREENEW_SORT_FUNCTION)(
     _In_ PVOID Context
     );
 
+typedef ULONG64 (NTAPI *PPH_PLUGIN_TREENEW_SORT_KEY_FUNCTION)(
+    _In_ PVOID Node,
+    _In_ ULONG SubId,
+    _In_ PVOID Context
+    );
+
 typedef NTSTATUS (NTAPI *PPHSVC_SERVER_PROBE_BUFFER)(
     _In_ PPH_RELATIVE_STRINGREF String,
     _In_ ULONG Alignment,
@@ -401,7 +410,8 @@ typedef struct _PH_PLUGIN_INFORMATION
     PWSTR Description;
     PWSTR Url;
     BOOLEAN HasOptions;
-    BOOLEAN Reserved1[3];
+    BOOLEAN LazyInitialization; // PluginCallbackInitialize is invoked when the plugin is first used
+    BOOLEAN Reserved1[2];
     PVOID Interface;
 } PH_PLUGIN_INFORMATION, *PPH_PLUGIN_INFORMATION;
 
@@ -428,6 +438,7 @@ typedef struct _PH_PLUGIN
 
     PH_CALLBACK Callbacks[PluginCallbackMaximum];
     PH_EM_APP_CONTEXT AppContext;
+    PH_INITONCE InitializeOnce;
 // begin_phapppub
 } PH_PLUGIN, *PPH_PLUGIN;
 // end_phapppub
@@ -473,6 +484,13 @@ PhGetGeneralCallback(
     _In_ PH_GENERAL_CALLBACK Callback
     );
 
+PHAPPAPI
+VOID
+NTAPI
+PhPluginEnsureInitialized(
+    _In_ PPH_PLUGIN Plugin
+    );
+
 PHAPPAPI
 ULONG
 NTAPI
@@ -612,6 +630,16 @@ PhPluginAddTreeNewColumn(
     _In_opt_ PPH_PLUGIN_TREENEW_SORT_FUNCTION SortFunction
     );
 
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhPluginSetTreeNewColumnSortKey(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PVOID CmData,
+    _In_ ULONG SubId,
+    _In_ PPH_PLUGIN_TREENEW_SORT_KEY_FUNCTION SortKeyFunction
+    );
+
 PHAPPAPI
 VOID
 NTAPI
@@ -632,6 +660,40 @@ PhPluginGetObjectExtension(
     _In_ PH_EM_OBJECT_TYPE ObjectType
     );
 
+PHAPPAPI
+PPH_EM_OBJECT_COLUMN
+NTAPI
+PhPluginAddObjectColumn(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ ULONG ElementSize
+    );
+
+PHAPPAPI
+PVOID
+NTAPI
+PhPluginGetObjectColumnElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ PVOID Object
+    );
+
+PHAPPAPI
+PVOID
+NTAPI
+PhPluginGetObjectColumnSlotElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ ULONG Slot
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhPluginSetObjectBulkCallback(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PPH_EM_OBJECT_BULK_CALLBACK BulkCallback
+    );
+
 PHAPPAPI
 struct _PH_NF_ICON *
 NTAPI
@@ -35,6 +35,7 @@ typedef struct _PHSVC_CLIENT
     HANDLE PortHandle;
     PVOID ClientViewBase;
     PVOID ClientViewLimit;
+    volatile LONG PendingCalls; // calls running on worker threads
 } PHSVC_CLIENT, *PPHSVC_CLIENT;
 
 NTSTATUS PhSvcClientInitialization(
@@ -98,6 +99,10 @@ VOID PhSvcDispatchApiCall(
     _Out_ PHANDLE ReplyPortHandle
     );
 
+BOOLEAN PhSvcIsLongRunningApiCall(
+    _In_ PPHSVC_API_PAYLOAD Payload
+    );
+
 PVOID PhSvcValidateString(
     _In_ PPH_RELATIVE_STRINGREF String,
     _In_ ULONG Alignment
@@ -235,4 +240,9 @@ NTSTATUS PhSvcApiWriteMiniDumpProcess(
     _Inout_ PPHSVC_API_PAYLOAD Payload
     );
 
+NTSTATUS PhSvcApiBatch(
+    _In_ PPHSVC_CLIENT Client,
+    _Inout_ PPHSVC_API_PAYLOAD Payload
+    );
+
 #endif
@@ -25,6 +25,7 @@ typedef enum _PHSVC_API_NUMBER
     PhSvcSetServiceSecurityApiNumber = 17,
     PhSvcLoadDbgHelpApiNumber = 18, // WOW64 compatible
     PhSvcWriteMiniDumpProcessApiNumber = 19, // WOW64 compatible
+    PhSvcBatchApiNumber = 20,
     PhSvcMaximumApiNumber
 } PHSVC_API_NUMBER, *PPHSVC_API_NUMBER;
 
@@ -260,6 +261,26 @@ typedef union _PHSVC_API_WRITEMINIDUMPPROCESS
     } i;
 } PHSVC_API_WRITEMINIDUMPPROCESS, *PPHSVC_API_WRITEMINIDUMPPROCESS;
 
+#define PHSVC_API_BATCH_STOP_ON_FAILURE 0x1
+
+typedef union _PHSVC_API_BATCH
+{
+    struct
+    {
+        // Calls is an array of PHSVC_API_PAYLOAD structures. It is located in the port section
+        // unless SectionHandle is non-zero, in which case it is located in that section (a handle
+        // in the server's process).
+        PH_RELATIVE_STRINGREF Calls;
+        ULONG SectionHandle;
+        ULONG Flags;
+    } i;
+    struct
+    {
+        ULONG NumberOfCalls;
+        ULONG NumberOfFailures;
+    } o;
+} PHSVC_API_BATCH, *PPHSVC_API_BATCH;
+
 typedef union _PHSVC_API_PAYLOAD
 {
     PHSVC_API_CONNECTINFO ConnectInfo;
@@ -287,6 +308,7 @@ typedef union _PHSVC_API_PAYLOAD
             PHSVC_API_SETSERVICESECURITY SetServiceSecurity;
             PHSVC_API_LOADDBGHELP LoadDbgHelp;
             PHSVC_API_WRITEMINIDUMPPROCESS WriteMiniDumpProcess;
+            PHSVC_API_BATCH Batch;
         } u;
     };
 } PHSVC_API_PAYLOAD, *PPHSVC_API_PAYLOAD;
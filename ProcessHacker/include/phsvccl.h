@@ -152,4 +152,26 @@ NTSTATUS PhSvcCallWriteMiniDumpProcess(
     _In_ ULONG DumpType
     );
 
+NTSTATUS PhSvcCallBatch(
+    _Inout_updates_(NumberOfCalls) PPHSVC_API_PAYLOAD Calls,
+    _In_ ULONG NumberOfCalls,
+    _In_ ULONG Flags,
+    _Out_opt_ PULONG NumberOfCallsProcessed
+    );
+
+NTSTATUS PhSvcCallControlProcessBatch(
+    _In_reads_(NumberOfProcesses) PHANDLE ProcessIds,
+    _In_ ULONG NumberOfProcesses,
+    _In_ PHSVC_API_CONTROLPROCESS_COMMAND Command,
+    _In_ ULONG Argument,
+    _Out_writes_(NumberOfProcesses) PNTSTATUS Statuses
+    );
+
+NTSTATUS PhSvcCallControlServiceBatch(
+    _In_reads_(NumberOfServices) PWSTR *ServiceNames,
+    _In_ ULONG NumberOfServices,
+    _In_ PHSVC_API_CONTROLSERVICE_COMMAND Command,
+    _Out_writes_(NumberOfServices) PNTSTATUS Statuses
+    );
+
 #endif
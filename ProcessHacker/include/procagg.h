@@ -0,0 +1,90 @@
+#ifndef PH_PROCAGG_H
+#define PH_PROCAGG_H
+
+typedef enum _PH_PROCESS_AGGREGATE_TYPE
+{
+    PhProcessAggregateSession,
+    PhProcessAggregateUser,
+    PhProcessAggregateJob,
+    PhProcessAggregateTypeMaximum
+} PH_PROCESS_AGGREGATE_TYPE;
+
+typedef struct _PH_PROCESS_AGGREGATE_VALUES
+{
+    // Totals for the current update period
+    ULONG NumberOfProcesses;
+    FLOAT CpuUsage;
+    SIZE_T PrivateBytes;
+    SIZE_T WorkingSetSize;
+    ULONG64 IoReadOtherDelta;
+    ULONG64 IoWriteDelta;
+
+    // Accumulated since the aggregate was created
+    ULONG64 CpuTime; // kernel and user time, in 100ns units
+    ULONG64 IoReadOtherBytes;
+    ULONG64 IoWriteBytes;
+} PH_PROCESS_AGGREGATE_VALUES, *PPH_PROCESS_AGGREGATE_VALUES;
+
+typedef struct _PH_PROCESS_AGGREGATE
+{
+    PH_PROCESS_AGGREGATE_TYPE Type;
+    ULONG SessionId; // PhProcessAggregateSession
+    PPH_STRING Name; // user name or job name; NULL for sessions
+
+    // Use PhGetProcessAggregateValues and PhCopyProcessAggregateHistory to access these.
+    PH_PROCESS_AGGREGATE_VALUES Values;
+    PH_CIRCULAR_BUFFER_FLOAT CpuHistory;
+    PH_CIRCULAR_BUFFER_SIZE_T PrivateBytesHistory;
+    PH_CIRCULAR_BUFFER_ULONG64 IoReadOtherHistory;
+    PH_CIRCULAR_BUFFER_ULONG64 IoWriteHistory;
+
+    // Private to the process provider
+    PH_PROCESS_AGGREGATE_VALUES Pending;
+} PH_PROCESS_AGGREGATE, *PPH_PROCESS_AGGREGATE;
+
+typedef struct _PH_PROCESS_AGGREGATE_HISTORY
+{
+    ULONG Count;
+    PFLOAT CpuUsage;
+    PSIZE_T PrivateBytes;
+    PULONG64 IoReadOther;
+    PULONG64 IoWrite;
+} PH_PROCESS_AGGREGATE_HISTORY, *PPH_PROCESS_AGGREGATE_HISTORY;
+
+VOID PhEnumProcessAggregates(
+    _Out_ PPH_PROCESS_AGGREGATE **Aggregates,
+    _Out_ PULONG NumberOfAggregates
+    );
+
+VOID PhGetProcessAggregateValues(
+    _In_ PPH_PROCESS_AGGREGATE Aggregate,
+    _Out_ PPH_PROCESS_AGGREGATE_VALUES Values
+    );
+
+VOID PhCopyProcessAggregateHistory(
+    _In_ PPH_PROCESS_AGGREGATE Aggregate,
+    _Inout_ PPH_PROCESS_AGGREGATE_HISTORY History
+    );
+
+// Process provider
+
+VOID PhUpdateProcessItemAggregates(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ BOOLEAN NewProcess
+    );
+
+VOID PhRemoveProcessItemAggregates(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    );
+
+VOID PhPublishProcessAggregates(
+    _In_ BOOLEAN AddHistory
+    );
+
+// aggdlg
+
+VOID PhShowProcessAggregatesDialog(
+    _In_ HWND ParentWindowHandle
+    );
+
+#endif
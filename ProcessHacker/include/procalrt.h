@@ -0,0 +1,18 @@
+#ifndef PH_PROCALRT_H
+#define PH_PROCALRT_H
+
+VOID PhSetProcessAlertRules(
+    _In_ PPH_STRINGREF Rules
+    );
+
+// Process provider
+
+VOID PhUpdateProcessItemAlerts(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    );
+
+VOID PhPublishProcessAlerts(
+    VOID
+    );
+
+#endif
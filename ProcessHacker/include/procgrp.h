@@ -28,4 +28,8 @@ VOID PhFreeProcessGroupList(
     _In_ PPH_LIST List
     );
 
+VOID PhInvalidateProcessGroups(
+    VOID
+    );
+
 #endif
\ No newline at end of file
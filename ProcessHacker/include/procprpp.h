@@ -265,6 +265,7 @@ typedef struct _PH_MEMORY_CONTEXT
     BOOLEAN MemoryItemListValid;
     NTSTATUS LastRunStatus;
     PPH_STRING ErrorMessage;
+    PPH_MEMORY_SNAPSHOT Snapshot;
 // begin_phapppub
 } PH_MEMORY_CONTEXT, *PPH_MEMORY_CONTEXT;
 // end_phapppub
@@ -278,6 +279,12 @@ typedef struct _PH_STATISTICS_CONTEXT
     HWND WindowHandle;
     BOOLEAN Enabled;
     HANDLE ProcessHandle;
+
+    // Counting the shareable and shared pages walks the working set, so the counters are
+    // only queried again when the working set size changes.
+    BOOLEAN WsCountersValid;
+    SIZE_T WsCountersWorkingSetSize;
+    PH_PROCESS_WS_COUNTERS WsCounters;
 } PH_STATISTICS_CONTEXT, *PPH_STATISTICS_CONTEXT;
 
 #define WM_PH_PERFORMANCE_UPDATE (WM_APP + 241)
@@ -291,10 +298,12 @@ typedef struct _PH_PERFORMANCE_CONTEXT
     PH_GRAPH_STATE CpuGraphState;
     PH_GRAPH_STATE PrivateGraphState;
     PH_GRAPH_STATE IoGraphState;
+    PH_GRAPH_STATE ThreadStatesGraphState;
 
     HWND CpuGraphHandle;
     HWND PrivateGraphHandle;
     HWND IoGraphHandle;
+    HWND ThreadStatesGraphHandle;
 } PH_PERFORMANCE_CONTEXT, *PPH_PERFORMANCE_CONTEXT;
 
 #endif
@@ -12,19 +12,43 @@ PHAPPAPI extern PH_CALLBACK PhProcessAddedEvent; // phapppub
 PHAPPAPI extern PH_CALLBACK PhProcessModifiedEvent; // phapppub
 PHAPPAPI extern PH_CALLBACK PhProcessRemovedEvent; // phapppub
 PHAPPAPI extern PH_CALLBACK PhProcessesUpdatedEvent; // phapppub
+PHAPPAPI extern PH_CALLBACK PhProcessNotificationEvent; // phapppub
+PHAPPAPI extern PH_CALLBACK PhProcessAlertEvent; // phapppub
 
 extern PPH_LIST PhProcessRecordList;
 extern PH_QUEUED_LOCK PhProcessRecordListLock;
+extern PH_HANDLE_INDEX PhProcessIndex;
+extern PH_QUEUED_LOCK PhProcessHashSetLock;
 
 extern ULONG PhStatisticsSampleCount;
+extern ULONG PhStatisticsBucketSize;
+extern ULONG PhStatisticsBucketCount;
 extern BOOLEAN PhEnableProcessQueryStage2;
 extern BOOLEAN PhEnablePurgeProcessRecords;
+extern ULONG PhProcessRecordStoreDays;
 extern BOOLEAN PhEnableCycleCpuUsage;
+extern BOOLEAN PhEnableProcessNonPoll;
 
 extern PVOID PhProcessInformation; // only can be used if running on same thread as process provider
 extern ULONG PhProcessInformationSequenceNumber;
 extern SYSTEM_PERFORMANCE_INFORMATION PhPerfInformation;
 extern PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION PhCpuInformation;
+
+typedef struct _PH_PROCESSOR_LOCATION
+{
+    USHORT Group;
+    UCHAR Number; // within the group
+    UCHAR Reserved;
+    ULONG Node;
+} PH_PROCESSOR_LOCATION, *PPH_PROCESSOR_LOCATION;
+
+// The per-processor arrays below are indexed by processor across all groups.
+extern ULONG PhNumberOfProcessors;
+extern USHORT PhNumberOfProcessorGroups;
+extern PPH_PROCESSOR_LOCATION PhProcessorLocations;
+extern ULONG PhNumberOfNumaNodes;
+extern PFLOAT PhNodesKernelUsage;
+extern PFLOAT PhNodesUserUsage;
 extern SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION PhCpuTotals;
 extern ULONG PhTotalProcesses;
 extern ULONG PhTotalThreads;
@@ -61,6 +85,11 @@ extern PPH_CIRCULAR_BUFFER_FLOAT PhCpusKernelHistory;
 extern PPH_CIRCULAR_BUFFER_FLOAT PhCpusUserHistory;
 //extern PPH_CIRCULAR_BUFFER_FLOAT PhCpusOtherHistory;
 
+extern PH_CIRCULAR_BUFFER_TIER_FLOAT PhCpuKernelHistoryTier;
+extern PH_CIRCULAR_BUFFER_TIER_FLOAT PhCpuUserHistoryTier;
+extern PPH_CIRCULAR_BUFFER_TIER_FLOAT PhCpusKernelHistoryTier;
+extern PPH_CIRCULAR_BUFFER_TIER_FLOAT PhCpusUserHistoryTier;
+
 extern PH_CIRCULAR_BUFFER_ULONG64 PhIoReadHistory;
 extern PH_CIRCULAR_BUFFER_ULONG64 PhIoWriteHistory;
 extern PH_CIRCULAR_BUFFER_ULONG64 PhIoOtherHistory;
@@ -215,23 +244,63 @@ typedef struct _PH_PROCESS_ITEM
     ULONG PeakNumberOfThreads; // since WIN7
     ULONG HardFaultCount; // since WIN7
 
+    // Thread states in the last snapshot
+    ULONG RunningThreadCount;
+    ULONG ReadyThreadCount; // ready, standby or deferred ready
+    ULONG WaitingThreadCount;
+    KWAIT_REASON TopWaitReason; // most common wait reason, MaximumWaitReason if no threads are waiting
+    ULONG TopWaitReasonCount;
+
+    // Handle count trend (see hndltrnd.c), in handles per minute
+    FLOAT HandleGrowthRate;
+    FLOAT TopHandleTypeGrowthRate;
+    ULONG TopHandleTypeIndex; // only valid if TopHandleTypeGrowthRate is positive
+
     ULONG SequenceNumber;
-    PH_CIRCULAR_BUFFER_FLOAT CpuKernelHistory;
-    PH_CIRCULAR_BUFFER_FLOAT CpuUserHistory;
-    PH_CIRCULAR_BUFFER_ULONG64 IoReadHistory;
-    PH_CIRCULAR_BUFFER_ULONG64 IoWriteHistory;
-    PH_CIRCULAR_BUFFER_ULONG64 IoOtherHistory;
-    PH_CIRCULAR_BUFFER_SIZE_T PrivateBytesHistory;
-    //PH_CIRCULAR_BUFFER_SIZE_T WorkingSetHistory;
+    // CPU, I/O and private bytes history. Use the PhGetProcessItem*History and
+    // PhCopyProcessItem*History functions to access the samples.
+    struct _PH_PROCESS_HISTORY_CHUNK *HistoryChunk;
+    PH_CIRCULAR_BUFFER_SLOT HistorySlot;
 
     // New fields
     PH_UINTPTR_DELTA PrivateBytesDelta;
     PPH_STRING PackageFullName;
 
     PH_QUEUED_LOCK RemoveLock;
+
+    // Pending stage 1 query, protected by the lock of the query deque
+    struct _PH_PROCESS_QUERY_ITEM *QueryItem;
+    ULONG QueryDequeIndex;
+
+    // Owns SmallIcon and LargeIcon if present. Otherwise the icons are stock icons.
+    struct _PH_IMAGE_CACHE_ENTRY *ImageCacheEntry;
+
+    // Session, user and job rollups (see procagg.c), owned by the process provider
+    struct _PH_PROCESS_AGGREGATE *Aggregates[3];
+
+    // Copies of the per-tick values used for ranking and sorting, stored next to the hot records
+    // of other process items
+    struct _PH_PROCESS_HOT_DATA *HotData;
 } PH_PROCESS_ITEM, *PPH_PROCESS_ITEM;
 // end_phapppub
 
+// The per-tick values that the top process lists and the process tree sort keys are computed
+// from. The records are packed into the history chunks and indexed by history slot, so the loops
+// that rank every process read a dense array instead of striding across the process items. Only
+// the process provider writes to the records.
+typedef struct _PH_PROCESS_HOT_DATA
+{
+    PPH_PROCESS_ITEM ProcessItem; // NULL unless the item is in the process index
+    ULONG RunId; // see PhpUpdateHotDataProcessItem
+    FLOAT CpuUsage;
+    ULONG64 UserTime;
+    ULONG64 IoDelta; // read + write + other
+    ULONG64 IoValue; // read + write + other
+    SIZE_T PagefileUsage;
+    SIZE_T WorkingSetSize;
+    ULONG NumberOfHandles;
+} PH_PROCESS_HOT_DATA, *PPH_PROCESS_HOT_DATA;
+
 // begin_phapppub
 // The process itself is dead.
 #define PH_PROCESS_RECORD_DEAD 0x1
@@ -255,6 +324,20 @@ typedef struct _PH_PROCESS_RECORD
     PPH_STRING CommandLine;
     /*PPH_STRING UserName;*/
 } PH_PROCESS_RECORD, *PPH_PROCESS_RECORD;
+
+typedef struct _PH_PROCESS_INFORMATION_SNAPSHOT
+{
+    PVOID Processes; // use PH_FIRST_PROCESS and PH_NEXT_PROCESS
+    ULONG BufferSize;
+} PH_PROCESS_INFORMATION_SNAPSHOT, *PPH_PROCESS_INFORMATION_SNAPSHOT;
+
+// Passed to PhProcessAlertEvent when a process exceeds one of the ProcessAlertRules (see procalrt.c).
+typedef struct _PH_PROCESS_ALERT
+{
+    PPH_PROCESS_ITEM ProcessItem;
+    PPH_STRING Rule;
+    PPH_STRING Message;
+} PH_PROCESS_ALERT, *PPH_PROCESS_ALERT;
 // end_phapppub
 
 BOOLEAN PhProcessProviderInitialization(
@@ -283,6 +366,13 @@ NTAPI
 PhGetProcessPriorityClassString(
     _In_ ULONG PriorityClass
     );
+
+PHAPPAPI
+PPH_PROCESS_INFORMATION_SNAPSHOT
+NTAPI
+PhReferenceProcessInformationSnapshot(
+    VOID
+    );
 // end_phapppub
 
 PPH_PROCESS_ITEM PhCreateProcessItem(
@@ -304,8 +394,32 @@ PhEnumProcessItems(
     _Out_opt_ PPH_PROCESS_ITEM **ProcessItems,
     _Out_ PULONG NumberOfProcessItems
     );
+
+typedef enum _PH_PROCESS_TOP_TYPE
+{
+    PhProcessTopCpu, // CPU usage, then user time
+    PhProcessTopPrivateBytes,
+    PhProcessTopWorkingSet,
+    PhProcessTopIo, // read + write + other delta, then total
+    PhProcessTopMaximum
+} PH_PROCESS_TOP_TYPE;
+
+#define PH_PROCESS_TOP_COUNT 64
+
+PHAPPAPI
+ULONG
+NTAPI
+PhGetTopProcessItems(
+    _In_ PH_PROCESS_TOP_TYPE Type,
+    _Out_writes_to_(Count, return) PPH_PROCESS_ITEM *ProcessItems,
+    _In_ ULONG Count
+    );
 // end_phapppub
 
+VOID PhPrioritizeProcessItemQuery(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    );
+
 typedef struct _PH_VERIFY_FILE_INFO *PPH_VERIFY_FILE_INFO;
 
 VERIFY_RESULT PhVerifyFileWithAdditionalCatalog(
@@ -321,6 +435,117 @@ VERIFY_RESULT PhVerifyFileCached(
     _In_ BOOLEAN CachedOnly
     );
 
+typedef VOID (NTAPI *PPH_VERIFY_FILE_CALLBACK)(
+    _In_ VERIFY_RESULT VerifyResult,
+    _In_opt_ _Assume_refs_(1) PPH_STRING SignerName,
+    _In_opt_ PVOID Context
+    );
+
+VOID PhQueueVerifyFile(
+    _In_ PPH_STRING FileName,
+    _In_opt_ PPH_STRING PackageFullName,
+    _In_ PPH_VERIFY_FILE_CALLBACK Callback,
+    _In_opt_ PVOID Context,
+    _Out_opt_ PVOID *RequestHandle
+    );
+
+VOID PhPrioritizeVerifyFile(
+    _Inout_ PVOID *RequestHandle
+    );
+
+typedef struct _PH_FILE_POOL *PPH_FILE_POOL;
+typedef struct _PH_FILE_POOL_PARAMETERS *PPH_FILE_POOL_PARAMETERS;
+
+NTSTATUS PhCreateStoreFilePool(
+    _Out_ PPH_FILE_POOL *Pool,
+    _In_ PPH_STRINGREF FileName,
+    _In_ ULONG Magic,
+    _In_opt_ PPH_FILE_POOL_PARAMETERS Parameters,
+    _Out_ PULONGLONG UserContext
+    );
+
+// begin_phapppub
+PHAPPAPI
+VOID
+NTAPI
+PhGetProcessItemCpuHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PFLOAT KernelUsage,
+    _Out_opt_ PFLOAT UserUsage
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhGetProcessItemIoHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PULONG64 ReadDelta,
+    _Out_opt_ PULONG64 WriteDelta,
+    _Out_opt_ PULONG64 OtherDelta
+    );
+
+PHAPPAPI
+SIZE_T
+NTAPI
+PhGetProcessItemPrivateBytesHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhCopyProcessItemCpuHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT KernelUsage,
+    _Out_writes_(Count) PFLOAT UserUsage
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhCopyProcessItemIoHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT ReadOtherDelta,
+    _Out_writes_(Count) PFLOAT WriteDelta
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhCopyProcessItemPrivateBytesHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT PrivateBytes
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhGetProcessItemThreadStateHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PULONG Running,
+    _Out_opt_ PULONG Ready,
+    _Out_opt_ PULONG Waiting,
+    _Out_opt_ PKWAIT_REASON TopWaitReason
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhCopyProcessItemThreadStateHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT Running,
+    _Out_writes_(Count) PFLOAT Ready
+    );
+// end_phapppub
+
 // begin_phapppub
 PHAPPAPI
 BOOLEAN
@@ -338,12 +563,121 @@ PhGetStatisticsTimeString(
     _In_opt_ PPH_PROCESS_ITEM ProcessItem,
     _In_ ULONG Index
     );
+
+/**
+ * A read-only view of a provider-owned history. Sample \a i (0 is the newest) is at
+ * PhGetItemHistoryView(). The samples belong to the provider and are overwritten as new samples
+ * are added, so readers should check PhIsHistoryViewCurrent() after reading and retry if it
+ * returns FALSE.
+ */
+typedef struct _PH_HISTORY_VIEW
+{
+    ULONG Generation;
+    ULONG Count;
+    ULONG SizeMinusOne;
+    LONG Index;
+    ULONG Stride;
+    PVOID Data;
+} PH_HISTORY_VIEW, *PPH_HISTORY_VIEW;
+
+#define PhGetItemHistoryView(View, Type, Index) \
+    (((Type *)(View)->Data)[(((View)->Index + (LONG)(Index)) & (View)->SizeMinusOne) * (View)->Stride])
+
+typedef enum _PH_SYSTEM_HISTORY_VIEW_TYPE
+{
+    PhSystemCpuKernelHistoryView, // FLOAT, fraction of total CPU time
+    PhSystemCpuUserHistoryView, // FLOAT
+    PhSystemCpusKernelHistoryView, // FLOAT, fraction of one processor
+    PhSystemCpusUserHistoryView, // FLOAT
+    PhSystemIoReadHistoryView, // ULONG64, bytes
+    PhSystemIoWriteHistoryView, // ULONG64
+    PhSystemIoOtherHistoryView, // ULONG64
+    PhSystemCommitHistoryView, // ULONG, pages
+    PhSystemPhysicalHistoryView, // ULONG, pages
+    PhSystemMaxCpuHistoryView, // ULONG, process ID
+    PhSystemMaxIoHistoryView, // ULONG, process ID
+    PhSystemHistoryViewMaximum
+} PH_SYSTEM_HISTORY_VIEW_TYPE;
+
+typedef enum _PH_PROCESS_HISTORY_VIEW_TYPE
+{
+    PhProcessCpuKernelHistoryView, // USHORT, PH_PROCESS_HISTORY_CPU_SCALE is 100%
+    PhProcessCpuUserHistoryView, // USHORT
+    PhProcessIoReadHistoryView, // FLOAT, bytes
+    PhProcessIoWriteHistoryView, // FLOAT
+    PhProcessIoOtherHistoryView, // FLOAT
+    PhProcessPrivatePagesHistoryView, // ULONG, pages
+    PhProcessRunningThreadsHistoryView, // USHORT, threads
+    PhProcessReadyThreadsHistoryView, // USHORT
+    PhProcessWaitingThreadsHistoryView, // USHORT
+    PhProcessHistoryViewMaximum
+} PH_PROCESS_HISTORY_VIEW_TYPE;
+
+#define PH_PROCESS_HISTORY_CPU_SCALE 65535.0f
+
+PHAPPAPI
+ULONG
+NTAPI
+PhGetStatisticsGeneration(
+    VOID
+    );
+
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhGetSystemHistoryView(
+    _In_ PH_SYSTEM_HISTORY_VIEW_TYPE Type,
+    _In_ ULONG Processor,
+    _Out_ PPH_HISTORY_VIEW View
+    );
+
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhGetProcessItemHistoryView(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PH_PROCESS_HISTORY_VIEW_TYPE Type,
+    _Out_ PPH_HISTORY_VIEW View
+    );
+
+FORCEINLINE
+BOOLEAN
+PhIsHistoryViewCurrent(
+    _In_ PPH_HISTORY_VIEW View
+    )
+{
+    // Finish reading the samples before checking the generation.
+    MemoryBarrier();
+
+    return PhGetStatisticsGeneration() == View->Generation;
+}
 // end_phapppub
 
 VOID PhFlushProcessQueryData(
     _In_ BOOLEAN SendModifiedEvent
     );
 
+typedef enum _PH_SYSTEM_GRAPH_SAMPLES
+{
+    SystemGraphCpuKernel, // fraction of total CPU time
+    SystemGraphCpuUser, // fraction of total CPU time
+    SystemGraphIoReadOther, // bytes
+    SystemGraphIoWrite, // bytes
+    SystemGraphCommit, // fraction of the commit limit
+    SystemGraphPhysical, // fraction of physical memory
+    SystemGraphSamplesMaximum
+} PH_SYSTEM_GRAPH_SAMPLES;
+
+ULONG PhCopySystemGraphSamples(
+    _In_ PH_SYSTEM_GRAPH_SAMPLES Type,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT Samples
+    );
+
+FLOAT PhGetSystemIoGraphMaximum(
+    _In_ ULONG Count
+    );
+
 VOID PhProcessProviderUpdate(
     _In_ PVOID Object
     );
@@ -411,6 +745,7 @@ PhReferenceProcessItemForRecord(
 // srvprv
 
 extern PPH_OBJECT_TYPE PhServiceItemType;
+extern PH_QUEUED_LOCK PhServiceProcessLinkLock;
 
 PHAPPAPI extern PH_CALLBACK PhServiceAddedEvent; // phapppub
 PHAPPAPI extern PH_CALLBACK PhServiceModifiedEvent; // phapppub
@@ -444,6 +779,12 @@ typedef struct _PH_SERVICE_ITEM
     BOOLEAN NeedsConfigUpdate;
 
     WCHAR ProcessIdString[PH_INT32_STR_LEN_1];
+
+    // CPU usage, for services in shared host processes (see srvcpu.c)
+    BOOLEAN CpuHistoryValid;
+    ULONG CpuRunId;
+    FLOAT CpuUsage;
+    PH_CIRCULAR_BUFFER_FLOAT CpuHistory;
 // begin_phapppub
 } PH_SERVICE_ITEM, *PPH_SERVICE_ITEM;
 // end_phapppub
@@ -502,6 +843,31 @@ VOID PhServiceProviderUpdate(
     _In_ PVOID Object
     );
 
+// srvdep
+
+VOID PhSetServiceDependencies(
+    _In_ PPH_STRINGREF ServiceName,
+    _In_opt_ PWSTR Dependencies
+    );
+
+VOID PhRemoveServiceDependencies(
+    _In_ PPH_STRINGREF ServiceName
+    );
+
+// begin_phapppub
+#define PH_SERVICE_DEPENDENCIES_DEPENDENTS 0x1
+#define PH_SERVICE_DEPENDENCIES_TRANSITIVE 0x2
+
+PHAPPAPI
+PPH_SERVICE_ITEM *
+NTAPI
+PhGetServiceDependencies(
+    _In_ PPH_SERVICE_ITEM ServiceItem,
+    _In_ ULONG Flags,
+    _Out_ PULONG NumberOfServices
+    );
+// end_phapppub
+
 // netprv
 
 extern PPH_OBJECT_TYPE PhNetworkItemType;
@@ -566,6 +932,22 @@ PPH_STRING PhGetHostNameFromAddress(
     _In_ PPH_IP_ADDRESS Address
     );
 
+// begin_phapppub
+PHAPPAPI
+VOID
+NTAPI
+PhSetNetworkProviderChangeNotifications(
+    _In_ BOOLEAN Enable
+    );
+
+PHAPPAPI
+VOID
+NTAPI
+PhNotifyNetworkConnectionsChanged(
+    VOID
+    );
+// end_phapppub
+
 VOID PhNetworkProviderUpdate(
     _In_ PVOID Object
     );
@@ -617,11 +999,19 @@ typedef struct _PH_MODULE_ITEM
     USHORT ImageDllCharacteristics;
 
     LARGE_INTEGER LoadTime;
+
+    PVOID VerifyRequest; // pending verification, see PhPrioritizeVerifyFile
 } PH_MODULE_ITEM, *PPH_MODULE_ITEM;
 
+#undef T
+#undef K
+#define T PPH_MODULE_ITEM
+#define K PVOID
+#include <ohashtbl_h.h>
+
 typedef struct _PH_MODULE_PROVIDER
 {
-    PPH_HASHTABLE ModuleHashtable;
+    PH_OPEN_HASHTABLE_PPH_MODULE_ITEM ModuleHashtable; // keyed by base address
     PH_FAST_LOCK ModuleHashtableLock;
     PH_CALLBACK ModuleAddedEvent;
     PH_CALLBACK ModuleModifiedEvent;
@@ -633,6 +1023,11 @@ typedef struct _PH_MODULE_PROVIDER
     PPH_STRING PackageFullName;
     SLIST_HEADER QueryListHead;
     NTSTATUS RunStatus;
+
+    PVOID LoaderListHeadAddress; // address of the loader's module list head in the process
+    LIST_ENTRY LastLoaderListHead;
+    SIZE_T LastVirtualSize;
+    ULONG UpdatesSinceFullScan;
 } PH_MODULE_PROVIDER, *PPH_MODULE_PROVIDER;
 // end_phapppub
 
@@ -698,13 +1093,21 @@ typedef struct _PH_THREAD_ITEM
     BOOLEAN JustResolved;
 
     WCHAR ThreadIdString[PH_INT32_STR_LEN_1];
+
+    ULONG64 LastSeenRunId; // RunId of the last provider update that saw this thread
 } PH_THREAD_ITEM, *PPH_THREAD_ITEM;
 
+#undef T
+#undef K
+#define T PPH_THREAD_ITEM
+#define K HANDLE
+#include <ohashtbl_h.h>
+
 typedef enum _PH_KNOWN_PROCESS_TYPE PH_KNOWN_PROCESS_TYPE;
 
 typedef struct _PH_THREAD_PROVIDER
 {
-    PPH_HASHTABLE ThreadHashtable;
+    PH_OPEN_HASHTABLE_PPH_THREAD_ITEM ThreadHashtable; // keyed by thread ID
     PH_FAST_LOCK ThreadHashtableLock;
     PH_CALLBACK ThreadAddedEvent;
     PH_CALLBACK ThreadModifiedEvent;
@@ -724,6 +1127,8 @@ typedef struct _PH_THREAD_PROVIDER
     LONG SymbolsLoading;
     ULONG64 RunId;
     ULONG64 SymbolsLoadedRunId;
+    PH_INITONCE SymbolsPriorityInitOnce; // Symbol options loaded, background symbol load queued
+    BOOLEAN SymbolsRequeryPending;
 } PH_THREAD_PROVIDER, *PPH_THREAD_PROVIDER;
 // end_phapppub
 
@@ -799,14 +1204,16 @@ typedef struct _PH_HANDLE_ITEM
     ULONG Attributes;
     ACCESS_MASK GrantedAccess;
     ULONG FileFlags;
+    USHORT TypeIndex; // object type number
 
-    PPH_STRING TypeName;
+    // Processes can have hundreds of thousands of handles, so the strings are shared and any
+    // other text is formatted on demand.
+    PPH_STRING TypeName; // interned, shared by all handles with the same TypeIndex
     PPH_STRING ObjectName;
     PPH_STRING BestObjectName;
 
-    WCHAR HandleString[PH_PTR_STR_LEN_1];
-    WCHAR ObjectString[PH_PTR_STR_LEN_1];
-    WCHAR GrantedAccessString[PH_PTR_STR_LEN_1];
+    BOOLEAN NamesPending; // ObjectName and BestObjectName have not been resolved yet
+    BOOLEAN NameCacheReferenced;
 } PH_HANDLE_ITEM, *PPH_HANDLE_ITEM;
 
 typedef struct _PH_HANDLE_PROVIDER
@@ -826,6 +1233,8 @@ typedef struct _PH_HANDLE_PROVIDER
 
     PPH_HASHTABLE TempListHashtable;
     NTSTATUS RunStatus;
+    PVOID HandleDigest;
+    BOOLEAN LazyNames; // defer object name resolution to PhResolveHandleItemNames
 } PH_HANDLE_PROVIDER, *PPH_HANDLE_PROVIDER;
 // end_phapppub
 
@@ -850,6 +1259,16 @@ VOID PhDereferenceAllHandleItems(
     _In_ PPH_HANDLE_PROVIDER HandleProvider
     );
 
+// begin_phapppub
+PHAPPAPI
+BOOLEAN
+NTAPI
+PhResolveHandleItemNames(
+    _In_ PPH_HANDLE_PROVIDER HandleProvider,
+    _In_ PPH_HANDLE_ITEM HandleItem
+    );
+// end_phapppub
+
 NTSTATUS PhEnumHandlesGeneric(
     _In_ HANDLE ProcessId,
     _In_ HANDLE ProcessHandle,
@@ -857,6 +1276,49 @@ NTSTATUS PhEnumHandlesGeneric(
     _Out_ PBOOLEAN FilterNeeded
     );
 
+// begin_phapppub
+typedef struct _PH_HANDLE_SNAPSHOT
+{
+    PSYSTEM_HANDLE_INFORMATION_EX Information;
+    ULONG NumberOfHandles;
+    ULONG CreateTickCount;
+    PULONG ProcessIndex; // indices into Information->Handles, sorted by process ID
+    PULONG ObjectIndex; // indices into Information->Handles, sorted by object address; built on first use
+    PH_INITONCE ObjectIndexInitOnce;
+} PH_HANDLE_SNAPSHOT, *PPH_HANDLE_SNAPSHOT;
+
+PHAPPAPI
+NTSTATUS
+NTAPI
+PhReferenceHandleSnapshot(
+    _In_ ULONG MaximumAge,
+    _Out_ PPH_HANDLE_SNAPSHOT *Snapshot
+    );
+
+PHAPPAPI
+ULONG
+NTAPI
+PhFindProcessHandlesSnapshot(
+    _In_ PPH_HANDLE_SNAPSHOT Snapshot,
+    _In_ HANDLE ProcessId,
+    _Out_ PULONG *Indices
+    );
+
+PHAPPAPI
+ULONG
+NTAPI
+PhFindObjectHandlesSnapshot(
+    _In_ PPH_HANDLE_SNAPSHOT Snapshot,
+    _In_ PVOID Object,
+    _Out_ PULONG *Indices
+    );
+// end_phapppub
+
+VOID PhCreateHandleSnapshot(
+    _In_ PSYSTEM_HANDLE_INFORMATION_EX Information,
+    _Out_ PPH_HANDLE_SNAPSHOT *Snapshot
+    );
+
 VOID PhHandleProviderUpdate(
     _In_ PVOID Object
     );
@@ -1007,4 +1469,121 @@ PhQueryMemoryItemList(
     );
 // end_phapppub
 
+#define PH_MEMORY_SNAPSHOT_UNREADABLE 0
+
+typedef struct _PH_MEMORY_SNAPSHOT_REGION
+{
+    PVOID BaseAddress;
+    SIZE_T RegionSize;
+    ULONG Protect;
+    ULONG Type;
+    ULONG FirstPage; // index of the hash of the first page of the region
+} PH_MEMORY_SNAPSHOT_REGION, *PPH_MEMORY_SNAPSHOT_REGION;
+
+/**
+ * The committed regions of a process at some point in time, with a hash of the contents of
+ * each page. The contents themselves are not kept.
+ */
+typedef struct _PH_MEMORY_SNAPSHOT
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER Time;
+    ULONG NumberOfRegions;
+    PPH_MEMORY_SNAPSHOT_REGION Regions; // sorted by address
+    ULONG NumberOfPages;
+    PULONG64 PageHashes; // PH_MEMORY_SNAPSHOT_UNREADABLE for pages that couldn't be read
+} PH_MEMORY_SNAPSHOT, *PPH_MEMORY_SNAPSHOT;
+
+typedef enum _PH_MEMORY_SNAPSHOT_CHANGE_TYPE
+{
+    MemorySnapshotRegionNew,
+    MemorySnapshotRegionFreed,
+    MemorySnapshotRegionGrown,
+    MemorySnapshotRegionShrunk,
+    MemorySnapshotRegionModified
+} PH_MEMORY_SNAPSHOT_CHANGE_TYPE;
+
+typedef struct _PH_MEMORY_SNAPSHOT_CHANGE
+{
+    PH_MEMORY_SNAPSHOT_CHANGE_TYPE ChangeType;
+    PVOID BaseAddress;
+    SIZE_T RegionSize;
+    ULONG Type;
+    ULONG AddedPages; // pages committed since the old snapshot
+    ULONG RemovedPages; // pages no longer committed
+    ULONG ModifiedPages; // pages present in both snapshots with different contents
+} PH_MEMORY_SNAPSHOT_CHANGE, *PPH_MEMORY_SNAPSHOT_CHANGE;
+
+NTSTATUS PhCreateMemorySnapshot(
+    _In_ HANDLE ProcessId,
+    _Out_ PPH_MEMORY_SNAPSHOT *Snapshot
+    );
+
+VOID PhCompareMemorySnapshots(
+    _In_ PPH_MEMORY_SNAPSHOT OldSnapshot,
+    _In_ PPH_MEMORY_SNAPSHOT NewSnapshot,
+    _Out_ PPH_MEMORY_SNAPSHOT_CHANGE *Changes,
+    _Out_ PULONG NumberOfChanges
+    );
+
+// imgcache
+
+typedef struct _PH_IMAGE_FILE_KEY
+{
+    LARGE_INTEGER FileId;
+    LARGE_INTEGER EndOfFile;
+    LARGE_INTEGER LastWriteTime;
+} PH_IMAGE_FILE_KEY, *PPH_IMAGE_FILE_KEY;
+
+typedef struct _PH_IMAGE_CACHE_ENTRY
+{
+    LIST_ENTRY LruListEntry;
+    PPH_STRING FileName;
+    PH_IMAGE_FILE_KEY Key;
+
+    PH_INITONCE IconInitOnce;
+    HICON SmallIcon;
+    HICON LargeIcon;
+
+    PH_INITONCE VersionInfoInitOnce;
+    PH_IMAGE_VERSION_INFO VersionInfo;
+} PH_IMAGE_CACHE_ENTRY, *PPH_IMAGE_CACHE_ENTRY;
+
+typedef struct _PH_IMAGE_CACHE_STATISTICS
+{
+    ULONG NumberOfEntries;
+    ULONG NumberOfHits;
+    ULONG NumberOfMisses;
+    ULONG NumberOfEvictions;
+} PH_IMAGE_CACHE_STATISTICS, *PPH_IMAGE_CACHE_STATISTICS;
+
+NTSTATUS PhQueryImageFileKey(
+    _In_ PWSTR FileName,
+    _Out_ PPH_IMAGE_FILE_KEY Key
+    );
+
+PPH_IMAGE_CACHE_ENTRY PhReferenceImageCacheEntry(
+    _In_ PPH_STRING FileName
+    );
+
+VOID PhGetImageCacheEntryIcons(
+    _In_ PPH_IMAGE_CACHE_ENTRY Entry,
+    _Out_ HICON *SmallIcon,
+    _Out_ HICON *LargeIcon
+    );
+
+VOID PhGetImageCacheEntryVersionInfo(
+    _In_ PPH_IMAGE_CACHE_ENTRY Entry,
+    _Out_ PPH_IMAGE_VERSION_INFO VersionInfo
+    );
+
+VOID PhInitializeImageVersionInfoCached(
+    _Out_ PPH_IMAGE_VERSION_INFO VersionInfo,
+    _In_opt_ PPH_STRING FileName
+    );
+
+VOID PhGetImageCacheStatistics(
+    _Out_ PPH_IMAGE_CACHE_STATISTICS Statistics
+    );
+
 #endif
@@ -0,0 +1,20 @@
+#ifndef PH_REGEXSUP_H
+#define PH_REGEXSUP_H
+
+#define PH_REGEX_IGNORE_CASE 0x1
+
+typedef struct _PH_REGEX *PPH_REGEX;
+
+PPH_REGEX PhCompileRegex(
+    _In_ PPH_STRINGREF Pattern,
+    _In_ ULONG Flags,
+    _Out_opt_ PINT ErrorCode,
+    _Out_opt_ PSIZE_T ErrorOffset
+    );
+
+BOOLEAN PhMatchRegex(
+    _In_ PPH_REGEX Regex,
+    _In_ PPH_STRINGREF Text
+    );
+
+#endif
@@ -8,6 +8,8 @@ typedef enum _PH_SETTING_TYPE
     IntegerSettingType,
     IntegerPairSettingType
 } PH_SETTING_TYPE, PPH_SETTING_TYPE;
+
+typedef struct _PH_SETTING *PPH_SETTING;
 // end_phapppub
 
 typedef struct _PH_SETTING
@@ -22,7 +24,7 @@ typedef struct _PH_SETTING
         ULONG Integer;
         PH_INTEGER_PAIR IntegerPair;
     } u;
-} PH_SETTING, *PPH_SETTING;
+} PH_SETTING;
 
 VOID PhSettingsInitialization(
     VOID
@@ -85,6 +87,38 @@ PhSetStringSetting2(
     _In_ PWSTR Name,
     _In_ PPH_STRINGREF Value
     );
+
+// Setting handles
+
+PHAPPAPI extern PH_CALLBACK PhSettingChangedEvent; // Parameter: PPH_SETTING, or NULL if any setting may have changed
+
+PHAPPAPI
+_May_raise_ PPH_SETTING
+NTAPI
+PhGetSettingHandle(
+    _In_ PWSTR Name
+    );
+
+PHAPPAPI
+_May_raise_ ULONG
+NTAPI
+PhGetIntegerSettingValue(
+    _In_ PPH_SETTING Setting
+    );
+
+PHAPPAPI
+_May_raise_ PH_INTEGER_PAIR
+NTAPI
+PhGetIntegerPairSettingValue(
+    _In_ PPH_SETTING Setting
+    );
+
+PHAPPAPI
+_May_raise_ PPH_STRING
+NTAPI
+PhGetStringSettingValue(
+    _In_ PPH_SETTING Setting
+    );
 // end_phapppub
 
 VOID PhClearIgnoredSettings(
@@ -2,6 +2,31 @@
 #define PH_SETTINGSP_H
 
 #include <shlobj.h>
+#include <filepool.h>
+
+#define PH_SETTINGS_STORE_MAGIC ('sbHP') // stored in the high part of the user context
+#define PH_SETTINGS_STORE_BUCKET_COUNT 512 // must be a power of two
+#define PH_SETTINGS_STORE_MAXIMUM_ENTRIES 65536
+
+// The RVA of the header is stored in the low part of the user context of the file pool.
+typedef struct _PH_SETTINGS_STORE_HEADER
+{
+    // The XML settings file at the time the store was last synchronized with it.
+    LARGE_INTEGER XmlLastWriteTime;
+    LARGE_INTEGER XmlEndOfFile;
+    ULONG Buckets[PH_SETTINGS_STORE_BUCKET_COUNT]; // RVA of the first entry in each bucket
+} PH_SETTINGS_STORE_HEADER, *PPH_SETTINGS_STORE_HEADER;
+
+typedef struct _PH_SETTINGS_STORE_ENTRY
+{
+    ULONG NextRva;
+    ULONG Size;
+    ULONG Hash;
+    USHORT NameLength; // in bytes
+    USHORT Reserved;
+    ULONG ValueLength; // in bytes
+    WCHAR Data[1]; // name, followed by value
+} PH_SETTINGS_STORE_ENTRY, *PPH_SETTINGS_STORE_ENTRY;
 
 BOOLEAN NTAPI PhpSettingsHashtableCompareFunction(
     _In_ PVOID Entry1,
@@ -39,4 +64,35 @@ PVOID PhpLookupSetting(
     _In_ PPH_STRINGREF Name
     );
 
+PPH_SETTING PhpFindIgnoredSetting(
+    _In_ PPH_STRINGREF Name
+    );
+
+NTSTATUS PhpOpenSettingsStore(
+    _In_ PWSTR FileName,
+    _In_ BOOLEAN Overwrite
+    );
+
+BOOLEAN PhpIsSettingsStoreCurrent(
+    _In_ PWSTR FileName
+    );
+
+BOOLEAN PhpLoadSettingsStore(
+    VOID
+    );
+
+BOOLEAN PhpWriteSettingsStoreEntry(
+    _Inout_ PPH_SETTINGS_STORE_HEADER Header,
+    _In_ PPH_STRINGREF Name,
+    _In_ PPH_STRINGREF Value
+    );
+
+BOOLEAN PhpUpdateSettingsStore(
+    VOID
+    );
+
+VOID PhpUpdateSettingsStoreXmlTime(
+    _In_ PWSTR FileName
+    );
+
 #endif
@@ -0,0 +1,14 @@
+#ifndef PH_SRVCPU_H
+#define PH_SRVCPU_H
+
+VOID PhUpdateServiceCpuUsage(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PSYSTEM_PROCESS_INFORMATION Process,
+    _In_ ULONG64 SysTotalTime
+    );
+
+VOID PhFlushServiceCpuUsage(
+    VOID
+    );
+
+#endif
@@ -12,6 +12,7 @@
 #define PH_SYSINFO_SEPARATOR_WIDTH 2
 
 #define PH_SYSINFO_CPU_PADDING 5
+#define PH_SYSINFO_CPU_HEATMAP_CLASSNAME L"PhSysInfoCpuHeatmap"
 #define PH_SYSINFO_MEMORY_PADDING 3
 
 #define SI_MSG_SYSINFO_FIRST (WM_APP + 150)
@@ -268,6 +269,26 @@ VOID PhSipSetOneGraphPerCpu(
     VOID
     );
 
+VOID PhSipCreateCpuHeatmap(
+    VOID
+    );
+
+VOID PhSipAddCpuHeatmapColumn(
+    VOID
+    );
+
+ULONG PhSipGetCpuHeatmapPixel(
+    _In_ FLOAT Kernel,
+    _In_ FLOAT User
+    );
+
+LRESULT CALLBACK PhSipCpuHeatmapWndProc(
+    _In_ HWND hwnd,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
 VOID PhSipNotifyCpuGraph(
     _In_ ULONG Index,
     _In_ NMHDR *Header
@@ -293,8 +314,8 @@ VOID PhSipGetCpuBrandString(
     _Out_writes_(49) PWSTR BrandString
     );
 
-BOOLEAN PhSipGetCpuFrequencyFromDistribution(
-    _Out_ DOUBLE *Fraction
+VOID PhSipSampleCpuFrequency(
+    VOID
     );
 
 NTSTATUS PhSipQueryProcessorPerformanceDistribution(
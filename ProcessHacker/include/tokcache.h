@@ -0,0 +1,27 @@
+#ifndef PH_TOKCACHE_H
+#define PH_TOKCACHE_H
+
+#define PH_TOKEN_CACHE_USER 0x1
+#define PH_TOKEN_CACHE_ELEVATION 0x2
+#define PH_TOKEN_CACHE_INTEGRITY 0x4
+#define PH_TOKEN_CACHE_VIRTUALIZATION 0x8
+
+typedef struct _PH_TOKEN_CACHE_INFORMATION
+{
+    ULONG ValidFields; // PH_TOKEN_CACHE_*
+
+    PPH_STRING UserName; // owned by the caller
+    TOKEN_ELEVATION_TYPE ElevationType;
+    MANDATORY_LEVEL IntegrityLevel;
+    PWSTR IntegrityString;
+    BOOLEAN VirtualizationAllowed;
+    BOOLEAN VirtualizationEnabled;
+} PH_TOKEN_CACHE_INFORMATION, *PPH_TOKEN_CACHE_INFORMATION;
+
+VOID PhQueryTokenCache(
+    _In_ HANDLE TokenHandle,
+    _In_ ULONG Fields,
+    _Out_ PPH_TOKEN_CACHE_INFORMATION Information
+    );
+
+#endif
@@ -192,8 +192,14 @@ FORCEINLINE VOID PhChangeShStateTn(
 #define PHPRTLC_APPID 73
 #define PHPRTLC_DPIAWARENESS 74
 #define PHPRTLC_CFGUARD 75
-
-#define PHPRTLC_MAXIMUM 76
+#define PHPRTLC_RUNNINGTHREADS 76
+#define PHPRTLC_READYTHREADS 77
+#define PHPRTLC_WAITINGTHREADS 78
+#define PHPRTLC_TOPWAITREASON 79
+#define PHPRTLC_HANDLEGROWTH 80
+#define PHPRTLC_TOPHANDLEGROWTH 81
+
+#define PHPRTLC_MAXIMUM 82
 #define PHPRTLC_IOGROUP_COUNT 9
 
 #define PHPN_WSCOUNTERS 0x1
@@ -207,6 +213,9 @@ FORCEINLINE VOID PhChangeShStateTn(
 #define PHPN_IMAGE 0x100
 #define PHPN_APPID 0x200
 #define PHPN_DPIAWARENESS 0x400
+#define PHPN_FIELD_COUNT 11
+
+#define PHPN_AGGREGATE_FIELD_COUNT 10
 
 // begin_phapppub
 typedef struct _PH_PROCESS_NODE
@@ -219,12 +228,17 @@ typedef struct _PH_PROCESS_NODE
 
     HANDLE ProcessId;
     PPH_PROCESS_ITEM ProcessItem;
+    struct _PH_PROCESS_HOT_DATA *HotData; // ProcessItem->HotData
 
     struct _PH_PROCESS_NODE *Parent;
     PPH_LIST Children;
 // end_phapppub
 
+    // Removed nodes stay in the node lists until they are compacted.
+    BOOLEAN Removed;
+
     PH_STRINGREF TextCache[PHPRTLC_MAXIMUM];
+    ULONG TextCacheDirtyMask[PH_TREENEW_TEXT_CACHE_MASK_SIZE(PHPRTLC_MAXIMUM)];
 
     PH_STRINGREF DescriptionText;
 
@@ -272,7 +286,7 @@ typedef struct _PH_PROCESS_NODE
 
     // Text buffers
     WCHAR CpuUsageText[PH_INT32_STR_LEN_1];
-    PPH_STRING IoTotalRateText;
+    WCHAR IoTotalRateText[PH_INT64_STR_LEN_1];
     PPH_STRING PrivateBytesText;
     PPH_STRING PeakPrivateBytesText;
     PPH_STRING WorkingSetText;
@@ -285,17 +299,23 @@ typedef struct _PH_PROCESS_NODE
     PPH_STRING PageFaultsText;
     WCHAR BasePriorityText[PH_INT32_STR_LEN_1];
     WCHAR ThreadsText[PH_INT32_STR_LEN_1 + 3];
+    WCHAR RunningThreadsText[PH_INT32_STR_LEN_1 + 3];
+    WCHAR ReadyThreadsText[PH_INT32_STR_LEN_1 + 3];
+    WCHAR WaitingThreadsText[PH_INT32_STR_LEN_1 + 3];
+    WCHAR TopWaitReasonText[32 + PH_INT32_STR_LEN_1];
+    WCHAR HandleGrowthText[PH_INT32_STR_LEN_1 + 4];
+    WCHAR TopHandleGrowthText[64];
     WCHAR HandlesText[PH_INT32_STR_LEN_1 + 3];
     WCHAR GdiHandlesText[PH_INT32_STR_LEN_1 + 3];
     WCHAR UserHandlesText[PH_INT32_STR_LEN_1 + 3];
-    PPH_STRING IoRoRateText;
-    PPH_STRING IoWRateText;
+    WCHAR IoRoRateText[PH_INT64_STR_LEN_1];
+    WCHAR IoWRateText[PH_INT64_STR_LEN_1];
     WCHAR PagePriorityText[PH_INT32_STR_LEN_1];
     PPH_STRING StartTimeText;
     WCHAR TotalCpuTimeText[PH_TIMESPAN_STR_LEN_1];
     WCHAR KernelCpuTimeText[PH_TIMESPAN_STR_LEN_1];
     WCHAR UserCpuTimeText[PH_TIMESPAN_STR_LEN_1];
-    PPH_STRING RelativeStartTimeText;
+    WCHAR RelativeStartTimeText[PH_TIMESPAN_RELATIVE_STR_LEN_1 + 4];
     PPH_STRING WindowTitleText;
     PPH_STRING CyclesText;
     PPH_STRING CyclesDeltaText;
@@ -309,16 +329,21 @@ typedef struct _PH_PROCESS_NODE
     PPH_STRING PeakNonPagedPoolText;
     PPH_STRING MinimumWorkingSetText;
     PPH_STRING MaximumWorkingSetText;
-    PPH_STRING PrivateBytesDeltaText;
+    WCHAR PrivateBytesDeltaText[PH_INT64_STR_LEN_1];
 
     // Graph buffers
     PH_GRAPH_BUFFERS CpuGraphBuffers;
     PH_GRAPH_BUFFERS PrivateGraphBuffers;
     PH_GRAPH_BUFFERS IoGraphBuffers;
+
+    // Sums over the node and its descendants, indexed by PHP_AGGREGATE_FIELD (proctree.c)
+    ULONG64 AggregateValues[PHPN_AGGREGATE_FIELD_COUNT];
 // begin_phapppub
 } PH_PROCESS_NODE, *PPH_PROCESS_NODE;
 // end_phapppub
 
+extern PH_HANDLE_INDEX PhProcessNodeIndex;
+
 VOID PhProcessTreeListInitialization(
     VOID
     );
@@ -440,6 +465,11 @@ VOID PhCopyProcessTree(
     VOID
     );
 
+PPH_STRING PhGetProcessTreeListColumnInfo(
+    _In_ HWND TreeNewHandle,
+    _In_ ULONG Id
+    );
+
 VOID PhWriteProcessTree(
     _Inout_ PPH_FILE_STREAM FileStream,
     _In_ ULONG Mode
@@ -464,8 +494,9 @@ PPH_LIST PhDuplicateProcessNodeList(
 #define PHSVTLC_ERRORCONTROL 7
 #define PHSVTLC_GROUP 8
 #define PHSVTLC_DESCRIPTION 9
+#define PHSVTLC_CPU 10
 
-#define PHSVTLC_MAXIMUM 10
+#define PHSVTLC_MAXIMUM 11
 
 #define PHSN_CONFIG 0x1
 #define PHSN_DESCRIPTION 0x2
@@ -480,11 +511,15 @@ typedef struct _PH_SERVICE_NODE
     PPH_SERVICE_ITEM ServiceItem;
 // end_phapppub
 
+    // Removed nodes stay in the node list until it is compacted.
+    BOOLEAN Removed;
+
     PH_STRINGREF TextCache[PHSVTLC_MAXIMUM];
 
     ULONG ValidMask;
 
     WCHAR StartTypeText[12 + 24 + 1];
+    WCHAR CpuUsageText[PH_INT32_STR_LEN_1];
     // Config
     PPH_STRING BinaryPath;
     PPH_STRING LoadOrderGroup;
@@ -739,10 +774,18 @@ typedef struct _PH_THREAD_NODE
     PPH_STRING CyclesDeltaText; // used for Context Switches Delta as well
     PPH_STRING StartAddressText;
     PPH_STRING PriorityText;
+    LONG PriorityTextWin32; // priority that PriorityText was created for
 // begin_phapppub
 } PH_THREAD_NODE, *PPH_THREAD_NODE;
 // end_phapppub
 
+#undef T
+#undef K
+#define T PPH_THREAD_NODE
+#define K HANDLE
+#include <ohashtbl_h.h>
+#include <tarray_h.h>
+
 typedef struct _PH_THREAD_LIST_CONTEXT
 {
     HWND ParentWindowHandle;
@@ -753,8 +796,8 @@ typedef struct _PH_THREAD_LIST_CONTEXT
     BOOLEAN UseCycleTime;
     BOOLEAN HasServices;
 
-    PPH_HASHTABLE NodeHashtable;
-    PPH_LIST NodeList;
+    PH_OPEN_HASHTABLE_PPH_THREAD_NODE NodeHashtable; // keyed by thread ID
+    PH_ARRAY_PPH_THREAD_NODE NodeList;
 
     BOOLEAN EnableStateHighlighting;
     PPH_POINTER_LIST NodeStateList;
@@ -866,6 +909,13 @@ typedef struct _PH_MODULE_NODE
 } PH_MODULE_NODE, *PPH_MODULE_NODE;
 // end_phapppub
 
+#undef T
+#undef K
+#define T PPH_MODULE_NODE
+#define K PPH_MODULE_ITEM
+#include <ohashtbl_h.h>
+#include <tarray_h.h>
+
 typedef struct _PH_MODULE_LIST_CONTEXT
 {
     HWND ParentWindowHandle;
@@ -874,8 +924,8 @@ typedef struct _PH_MODULE_LIST_CONTEXT
     PH_SORT_ORDER TreeNewSortOrder;
     PH_CM_MANAGER Cm;
 
-    PPH_HASHTABLE NodeHashtable;
-    PPH_LIST NodeList;
+    PH_OPEN_HASHTABLE_PPH_MODULE_NODE NodeHashtable; // keyed by module item
+    PH_ARRAY_PPH_MODULE_NODE NodeList;
 
     BOOLEAN EnableStateHighlighting;
     PPH_POINTER_LIST NodeStateList;
@@ -972,10 +1022,20 @@ typedef struct _PH_HANDLE_NODE
 
     PPH_STRING GrantedAccessSymbolicText;
     WCHAR FileShareAccessText[4];
+
+    PPH_STRING NameSortKeySource; // name that NameSortKey was created from
+    PPH_BYTES NameSortKey;
 // begin_phapppub
 } PH_HANDLE_NODE, *PPH_HANDLE_NODE;
 // end_phapppub
 
+#undef T
+#undef K
+#define T PPH_HANDLE_NODE
+#define K HANDLE
+#include <ohashtbl_h.h>
+#include <tarray_h.h>
+
 typedef struct _PH_HANDLE_LIST_CONTEXT
 {
     HWND ParentWindowHandle;
@@ -984,12 +1044,15 @@ typedef struct _PH_HANDLE_LIST_CONTEXT
     PH_SORT_ORDER TreeNewSortOrder;
     PH_CM_MANAGER Cm;
     BOOLEAN HideUnnamedHandles;
+    PPH_HANDLE_PROVIDER Provider; // used to resolve names of handle items on demand
 
-    PPH_HASHTABLE NodeHashtable;
-    PPH_LIST NodeList;
+    PH_OPEN_HASHTABLE_PPH_HANDLE_NODE NodeHashtable; // keyed by handle
+    PH_ARRAY_PPH_HANDLE_NODE NodeList;
 
     BOOLEAN EnableStateHighlighting;
     PPH_POINTER_LIST NodeStateList;
+
+    WCHAR CellText[PH_PTR_STR_LEN_1]; // text formatted on demand, valid until the next TreeNewGetCellText
 } PH_HANDLE_LIST_CONTEXT, *PPH_HANDLE_LIST_CONTEXT;
 
 VOID PhInitializeHandleList(
@@ -1142,6 +1205,11 @@ VOID PhSetOptionsMemoryList(
     );
 
 VOID PhReplaceMemoryList(
+    _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
+    _In_opt_ PPH_MEMORY_ITEM_LIST List
+    );
+
+VOID PhUpdateMemoryList(
     _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
     _In_ PPH_MEMORY_ITEM_LIST List
     );
@@ -37,6 +37,8 @@ VOID PhLogInitialization(
     if (entries > 0x1000) entries = 0x1000;
     PhInitializeCircularBuffer_PVOID(&PhLogBuffer, entries);
     memset(PhLogBuffer.Data, 0, sizeof(PVOID) * PhLogBuffer.Size);
+
+    PhLogFileInitialization();
 }
 
 PPH_LOG_ENTRY PhpCreateLogEntry(
@@ -150,6 +152,8 @@ VOID PhpLogEntry(
 {
     PPH_LOG_ENTRY oldEntry;
 
+    PhLogFileAddEntry(Entry);
+
     oldEntry = PhAddItemCircularBuffer2_PVOID(&PhLogBuffer, Entry);
 
     if (oldEntry)
@@ -0,0 +1,790 @@
+/*
+ * Process Hacker -
+ *   persistent event log
+ *
+ * Copyright (C) 2016 wj32
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The in-memory log only keeps the last few thousand entries. When the LogFileName setting
+ * is set, every entry is also appended to a memory-mapped file laid out as follows:
+ *
+ * [header, padded to PH_LOG_FILE_HEADER_SIZE]
+ * [MaximumRecords fixed-size PH_LOG_FILE_RECORD structures]
+ * [string table of StringTableSize bytes]
+ *
+ * Strings in the table are stored as a ULONG byte count followed by the characters, padded to a
+ * ULONG boundary, and records refer to them by offset. Process and service names are interned so
+ * that each distinct name is only stored once. NumberOfRecords is only incremented after a record
+ * and its strings have been written, so readers can take a snapshot of the count and read the
+ * records below it without any locking. The file is never wrapped; once it is full, new entries
+ * only go to the in-memory log.
+ */
+
+#include <phapp.h>
+#include <settings.h>
+
+#define PH_LOG_FILE_MAGIC ('GLHP')
+#define PH_LOG_FILE_VERSION 1
+#define PH_LOG_FILE_HEADER_SIZE 0x1000
+#define PH_LOG_FILE_NO_STRING ULONG_MAX
+
+#define PH_LOG_FILE_FLAG_RECORDS_FULL 0x1
+#define PH_LOG_FILE_FLAG_STRINGS_FULL 0x2
+
+#define PH_LOG_FILE_MINIMUM_RECORDS 0x1000
+#ifdef _WIN64
+#define PH_LOG_FILE_MAXIMUM_RECORDS 0x4000000 // 2 GB of records
+#else
+#define PH_LOG_FILE_MAXIMUM_RECORDS 0x800000 // 256 MB of records
+#endif
+#define PH_LOG_FILE_STRING_BYTES_PER_RECORD 16
+#define PH_LOG_FILE_MAXIMUM_STRING_LENGTH 0x2000 // in bytes
+#define PH_LOG_FILE_EXPORT_FLUSH_SIZE 0x10000 // in bytes
+
+typedef struct _PH_LOG_FILE_HEADER
+{
+    ULONG Magic;
+    ULONG Version;
+    ULONG RecordSize;
+    ULONG MaximumRecords;
+    ULONG StringTableOffset;
+    ULONG StringTableSize;
+    volatile ULONG NumberOfRecords;
+    volatile ULONG StringTableLength;
+    ULONG Flags;
+} PH_LOG_FILE_HEADER, *PPH_LOG_FILE_HEADER;
+
+typedef struct _PH_LOG_FILE_RECORD
+{
+    LARGE_INTEGER Time;
+    UCHAR Type;
+    UCHAR Reserved1;
+    USHORT Reserved2;
+    ULONG ProcessId;
+    ULONG ParentProcessId;
+    NTSTATUS ExitStatus;
+    ULONG String1; // process or service name
+    ULONG String2; // parent name, display name or message
+} PH_LOG_FILE_RECORD, *PPH_LOG_FILE_RECORD;
+
+C_ASSERT(sizeof(PH_LOG_FILE_HEADER) <= PH_LOG_FILE_HEADER_SIZE);
+C_ASSERT(sizeof(PH_LOG_FILE_RECORD) == 32);
+
+typedef struct _PH_LOG_FILE_STRING_ENTRY
+{
+    PH_STRINGREF String;
+    ULONG Offset;
+} PH_LOG_FILE_STRING_ENTRY, *PPH_LOG_FILE_STRING_ENTRY;
+
+static PH_QUEUED_LOCK PhpLogFileLock = PH_QUEUED_LOCK_INIT;
+static PPH_LOG_FILE_HEADER PhpLogFileHeader = NULL;
+static PPH_LOG_FILE_RECORD PhpLogFileRecords;
+static PUCHAR PhpLogFileStrings;
+static PPH_HASHTABLE PhpLogFileStringHashtable;
+static BOOLEAN PhpLogFileWritable;
+
+static BOOLEAN NTAPI PhpLogFileStringEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_LOG_FILE_STRING_ENTRY entry1 = Entry1;
+    PPH_LOG_FILE_STRING_ENTRY entry2 = Entry2;
+
+    return PhEqualStringRef(&entry1->String, &entry2->String, FALSE);
+}
+
+static ULONG NTAPI PhpLogFileStringHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_LOG_FILE_STRING_ENTRY entry = Entry;
+
+    return PhHashStringRef(&entry->String, FALSE);
+}
+
+static BOOLEAN PhpIsValidLogFileHeader(
+    _In_ PPH_LOG_FILE_HEADER Header,
+    _In_ ULONG64 FileSize
+    )
+{
+    if (Header->Magic != PH_LOG_FILE_MAGIC || Header->Version != PH_LOG_FILE_VERSION)
+        return FALSE;
+    if (Header->RecordSize != sizeof(PH_LOG_FILE_RECORD))
+        return FALSE;
+    if (Header->MaximumRecords < PH_LOG_FILE_MINIMUM_RECORDS || Header->MaximumRecords > PH_LOG_FILE_MAXIMUM_RECORDS)
+        return FALSE;
+    if (Header->StringTableOffset != PH_LOG_FILE_HEADER_SIZE + Header->MaximumRecords * sizeof(PH_LOG_FILE_RECORD))
+        return FALSE;
+    if (Header->StringTableSize > PH_LOG_FILE_MAXIMUM_RECORDS * PH_LOG_FILE_STRING_BYTES_PER_RECORD)
+        return FALSE;
+    if (Header->NumberOfRecords > Header->MaximumRecords || Header->StringTableLength > Header->StringTableSize)
+        return FALSE;
+    if (FileSize < (ULONG64)Header->StringTableOffset + Header->StringTableSize)
+        return FALSE;
+
+    return TRUE;
+}
+
+/**
+ * Rebuilds the string hashtable from the string table of an existing log file.
+ */
+static VOID PhpLoadLogFileStrings(
+    VOID
+    )
+{
+    ULONG offset;
+    ULONG length;
+    PH_LOG_FILE_STRING_ENTRY entry;
+
+    offset = 0;
+
+    while (PhpLogFileHeader->StringTableLength - offset >= sizeof(ULONG))
+    {
+        length = *(PULONG)(PhpLogFileStrings + offset);
+
+        if (length == 0 || (length & 1) || length > PH_LOG_FILE_MAXIMUM_STRING_LENGTH ||
+            length > PhpLogFileHeader->StringTableLength - offset - sizeof(ULONG))
+        {
+            // Discard anything after a damaged entry.
+            PhpLogFileHeader->StringTableLength = offset;
+            break;
+        }
+
+        entry.String.Buffer = (PWCH)(PhpLogFileStrings + offset + sizeof(ULONG));
+        entry.String.Length = length;
+        entry.Offset = offset;
+        PhAddEntryHashtable(PhpLogFileStringHashtable, &entry);
+
+        offset += ALIGN_UP(sizeof(ULONG) + length, ULONG);
+    }
+}
+
+static NTSTATUS PhpOpenLogFile(
+    _In_ PWSTR FileName,
+    _In_ ULONG MaximumRecords,
+    _In_ ULONG StringTableSize
+    )
+{
+    NTSTATUS status;
+    HANDLE fileHandle;
+    HANDLE sectionHandle;
+    LARGE_INTEGER fileSize;
+    LARGE_INTEGER sectionSize;
+    PH_LOG_FILE_HEADER header;
+    BOOLEAN existing;
+    PVOID viewBase;
+    SIZE_T viewSize;
+
+    status = PhCreateFileWin32(
+        &fileHandle,
+        FileName,
+        FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+        FILE_ATTRIBUTE_NORMAL,
+        FILE_SHARE_READ,
+        FILE_OPEN_IF,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    existing = FALSE;
+
+    if (!NT_SUCCESS(status = PhGetFileSize(fileHandle, &fileSize)))
+        goto CleanupExit;
+
+    if (fileSize.QuadPart != 0)
+    {
+        IO_STATUS_BLOCK isb;
+        LARGE_INTEGER offset;
+
+        // Keep using the layout of an existing log so its records stay readable, but never
+        // overwrite a file that isn't one of ours.
+
+        offset.QuadPart = 0;
+        memset(&header, 0, sizeof(PH_LOG_FILE_HEADER));
+
+        if (fileSize.QuadPart >= sizeof(PH_LOG_FILE_HEADER))
+        {
+            status = NtReadFile(fileHandle, NULL, NULL, NULL, &isb, &header, sizeof(PH_LOG_FILE_HEADER), &offset, NULL);
+
+            if (!NT_SUCCESS(status))
+                goto CleanupExit;
+        }
+
+        if (!PhpIsValidLogFileHeader(&header, fileSize.QuadPart))
+        {
+            status = STATUS_FILE_CORRUPT_ERROR;
+            goto CleanupExit;
+        }
+
+        MaximumRecords = header.MaximumRecords;
+        StringTableSize = header.StringTableSize;
+        existing = TRUE;
+    }
+
+    sectionSize.QuadPart = PH_LOG_FILE_HEADER_SIZE + (ULONG64)MaximumRecords * sizeof(PH_LOG_FILE_RECORD) + StringTableSize;
+    status = NtCreateSection(
+        &sectionHandle,
+        SECTION_ALL_ACCESS,
+        NULL,
+        &sectionSize,
+        PAGE_READWRITE,
+        SEC_COMMIT,
+        fileHandle
+        );
+
+    if (!NT_SUCCESS(status))
+        goto CleanupExit;
+
+    viewBase = NULL;
+    viewSize = 0;
+    status = NtMapViewOfSection(
+        sectionHandle,
+        NtCurrentProcess(),
+        &viewBase,
+        0,
+        0,
+        NULL,
+        &viewSize,
+        ViewShare,
+        0,
+        PAGE_READWRITE
+        );
+    NtClose(sectionHandle);
+
+    if (!NT_SUCCESS(status))
+        goto CleanupExit;
+
+    PhpLogFileHeader = viewBase;
+
+    if (!existing)
+    {
+        PhpLogFileHeader->Magic = PH_LOG_FILE_MAGIC;
+        PhpLogFileHeader->Version = PH_LOG_FILE_VERSION;
+        PhpLogFileHeader->RecordSize = sizeof(PH_LOG_FILE_RECORD);
+        PhpLogFileHeader->MaximumRecords = MaximumRecords;
+        PhpLogFileHeader->StringTableOffset = PH_LOG_FILE_HEADER_SIZE + MaximumRecords * sizeof(PH_LOG_FILE_RECORD);
+        PhpLogFileHeader->StringTableSize = StringTableSize;
+        PhpLogFileHeader->NumberOfRecords = 0;
+        PhpLogFileHeader->StringTableLength = 0;
+        PhpLogFileHeader->Flags = 0;
+    }
+
+    PhpLogFileRecords = PTR_ADD_OFFSET(viewBase, PH_LOG_FILE_HEADER_SIZE);
+    PhpLogFileStrings = PTR_ADD_OFFSET(viewBase, PhpLogFileHeader->StringTableOffset);
+    PhpLogFileStringHashtable = PhCreateHashtable(
+        sizeof(PH_LOG_FILE_STRING_ENTRY),
+        PhpLogFileStringEqualFunction,
+        PhpLogFileStringHashFunction,
+        256
+        );
+
+    if (existing)
+        PhpLoadLogFileStrings();
+
+    PhpLogFileWritable = PhpLogFileHeader->NumberOfRecords < PhpLogFileHeader->MaximumRecords;
+
+CleanupExit:
+    // The view keeps the file open.
+    NtClose(fileHandle);
+
+    return status;
+}
+
+/**
+ * Opens the log file specified by the LogFileName setting, if any.
+ */
+VOID PhLogFileInitialization(
+    VOID
+    )
+{
+    NTSTATUS status;
+    PPH_STRING fileName;
+    PPH_STRING expandedFileName;
+    ULONG maximumRecords;
+
+    fileName = PhGetStringSetting(L"LogFileName");
+
+    if (!PhIsNullOrEmptyString(fileName))
+    {
+        if (expandedFileName = PhExpandEnvironmentStrings(&fileName->sr))
+            PhMoveReference(&fileName, expandedFileName);
+
+        maximumRecords = PhGetIntegerSetting(L"LogFileMaximumRecords");
+        if (maximumRecords < PH_LOG_FILE_MINIMUM_RECORDS) maximumRecords = PH_LOG_FILE_MINIMUM_RECORDS;
+        if (maximumRecords > PH_LOG_FILE_MAXIMUM_RECORDS) maximumRecords = PH_LOG_FILE_MAXIMUM_RECORDS;
+
+        status = PhpOpenLogFile(
+            fileName->Buffer,
+            maximumRecords,
+            maximumRecords * PH_LOG_FILE_STRING_BYTES_PER_RECORD
+            );
+
+        if (!NT_SUCCESS(status))
+            PhShowStatus(PhMainWndHandle, L"Unable to open the log file", status, 0);
+    }
+
+    PhClearReference(&fileName);
+}
+
+/**
+ * Determines whether entries are being recorded to a log file.
+ */
+BOOLEAN PhIsLogFileEnabled(
+    VOID
+    )
+{
+    return !!PhpLogFileHeader;
+}
+
+static ULONG PhpAddLogFileString(
+    _In_opt_ PPH_STRING String,
+    _In_ BOOLEAN Intern
+    )
+{
+    PH_LOG_FILE_STRING_ENTRY lookupEntry;
+    PPH_LOG_FILE_STRING_ENTRY entry;
+    ULONG length;
+    ULONG size;
+    ULONG offset;
+
+    if (PhIsNullOrEmptyString(String))
+        return PH_LOG_FILE_NO_STRING;
+
+    if (Intern)
+    {
+        lookupEntry.String = String->sr;
+
+        if (entry = PhFindEntryHashtable(PhpLogFileStringHashtable, &lookupEntry))
+            return entry->Offset;
+    }
+
+    length = (ULONG)min(String->Length, PH_LOG_FILE_MAXIMUM_STRING_LENGTH);
+    size = ALIGN_UP(sizeof(ULONG) + length, ULONG);
+    offset = PhpLogFileHeader->StringTableLength;
+
+    if (size > PhpLogFileHeader->StringTableSize - offset)
+    {
+        PhpLogFileHeader->Flags |= PH_LOG_FILE_FLAG_STRINGS_FULL;
+        return PH_LOG_FILE_NO_STRING;
+    }
+
+    *(PULONG)(PhpLogFileStrings + offset) = length;
+    memcpy(PhpLogFileStrings + offset + sizeof(ULONG), String->Buffer, length);
+    PhpLogFileHeader->StringTableLength = offset + size;
+
+    if (Intern)
+    {
+        lookupEntry.String.Buffer = (PWCH)(PhpLogFileStrings + offset + sizeof(ULONG));
+        lookupEntry.String.Length = length;
+        lookupEntry.Offset = offset;
+        PhAddEntryHashtable(PhpLogFileStringHashtable, &lookupEntry);
+    }
+
+    return offset;
+}
+
+static VOID PhpAddLogFileRecord(
+    _In_ PPH_LOG_ENTRY Entry
+    )
+{
+    ULONG index;
+    PPH_LOG_FILE_RECORD record;
+
+    index = PhpLogFileHeader->NumberOfRecords;
+
+    if (index >= PhpLogFileHeader->MaximumRecords)
+    {
+        PhpLogFileHeader->Flags |= PH_LOG_FILE_FLAG_RECORDS_FULL;
+        PhpLogFileWritable = FALSE;
+        return;
+    }
+
+    record = &PhpLogFileRecords[index];
+    memset(record, 0, sizeof(PH_LOG_FILE_RECORD));
+    record->Time = Entry->Time;
+    record->Type = Entry->Type;
+    record->String1 = PH_LOG_FILE_NO_STRING;
+    record->String2 = PH_LOG_FILE_NO_STRING;
+
+    if (Entry->Type >= PH_LOG_ENTRY_PROCESS_FIRST && Entry->Type <= PH_LOG_ENTRY_PROCESS_LAST)
+    {
+        record->ProcessId = HandleToUlong(Entry->Process.ProcessId);
+        record->ParentProcessId = HandleToUlong(Entry->Process.ParentProcessId);
+        record->ExitStatus = Entry->Process.ExitStatus;
+        record->String1 = PhpAddLogFileString(Entry->Process.Name, TRUE);
+        record->String2 = PhpAddLogFileString(Entry->Process.ParentName, TRUE);
+    }
+    else if (Entry->Type >= PH_LOG_ENTRY_SERVICE_FIRST && Entry->Type <= PH_LOG_ENTRY_SERVICE_LAST)
+    {
+        record->String1 = PhpAddLogFileString(Entry->Service.Name, TRUE);
+        record->String2 = PhpAddLogFileString(Entry->Service.DisplayName, TRUE);
+    }
+    else if (Entry->Type == PH_LOG_ENTRY_MESSAGE)
+    {
+        record->String2 = PhpAddLogFileString(Entry->Message, FALSE);
+    }
+
+    // Publish the record only after it and its strings are complete.
+    MemoryBarrier();
+    PhpLogFileHeader->NumberOfRecords = index + 1;
+}
+
+/**
+ * Appends an entry to the log file.
+ *
+ * \param Entry The log entry.
+ */
+VOID PhLogFileAddEntry(
+    _In_ PPH_LOG_ENTRY Entry
+    )
+{
+    if (!PhpLogFileHeader)
+        return;
+
+    PhAcquireQueuedLockExclusive(&PhpLogFileLock);
+
+    if (PhpLogFileWritable)
+    {
+        __try
+        {
+            PhpAddLogFileRecord(Entry);
+        }
+        __except (GetExceptionCode() == STATUS_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+        {
+            // The volume is probably full. Stop writing to the file.
+            PhpLogFileWritable = FALSE;
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpLogFileLock);
+}
+
+static BOOLEAN PhpGetLogFileString(
+    _In_ ULONG Offset,
+    _In_ ULONG StringTableLength,
+    _Out_ PPH_STRINGREF String
+    )
+{
+    ULONG length;
+
+    if (Offset == PH_LOG_FILE_NO_STRING || Offset > StringTableLength || StringTableLength - Offset < sizeof(ULONG))
+        return FALSE;
+
+    length = *(PULONG)(PhpLogFileStrings + Offset);
+
+    if (length > StringTableLength - Offset - sizeof(ULONG))
+        return FALSE;
+
+    String->Buffer = (PWCH)(PhpLogFileStrings + Offset + sizeof(ULONG));
+    String->Length = length;
+
+    return TRUE;
+}
+
+static PWSTR PhpGetLogFileEventName(
+    _In_ UCHAR Type
+    )
+{
+    switch (Type)
+    {
+    case PH_LOG_ENTRY_PROCESS_CREATE:
+        return L"process_create";
+    case PH_LOG_ENTRY_PROCESS_DELETE:
+        return L"process_delete";
+    case PH_LOG_ENTRY_SERVICE_CREATE:
+        return L"service_create";
+    case PH_LOG_ENTRY_SERVICE_DELETE:
+        return L"service_delete";
+    case PH_LOG_ENTRY_SERVICE_START:
+        return L"service_start";
+    case PH_LOG_ENTRY_SERVICE_STOP:
+        return L"service_stop";
+    case PH_LOG_ENTRY_SERVICE_CONTINUE:
+        return L"service_continue";
+    case PH_LOG_ENTRY_SERVICE_PAUSE:
+        return L"service_pause";
+    case PH_LOG_ENTRY_MESSAGE:
+        return L"message";
+    default:
+        return L"unknown";
+    }
+}
+
+static VOID PhpAppendLogFileTime(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PLARGE_INTEGER Time
+    )
+{
+    TIME_FIELDS timeFields;
+
+    RtlTimeToTimeFields(Time, &timeFields);
+    PhAppendFormatStringBuilder(
+        StringBuilder,
+        L"%04u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        timeFields.Year,
+        timeFields.Month,
+        timeFields.Day,
+        timeFields.Hour,
+        timeFields.Minute,
+        timeFields.Second,
+        timeFields.Milliseconds
+        );
+}
+
+static VOID PhpAppendCsvString(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PPH_STRINGREF String
+    )
+{
+    SIZE_T i;
+    SIZE_T count;
+
+    count = String->Length / sizeof(WCHAR);
+
+    for (i = 0; i < count; i++)
+    {
+        WCHAR c = String->Buffer[i];
+
+        if (c == ',' || c == '"' || c == '\r' || c == '\n')
+            break;
+    }
+
+    if (i == count)
+    {
+        PhAppendStringBuilder(StringBuilder, String);
+        return;
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, '"');
+
+    for (i = 0; i < count; i++)
+    {
+        if (String->Buffer[i] == '"')
+            PhAppendCharStringBuilder(StringBuilder, '"');
+
+        PhAppendCharStringBuilder(StringBuilder, String->Buffer[i]);
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, '"');
+}
+
+static VOID PhpAppendJsonString(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PPH_STRINGREF String
+    )
+{
+    SIZE_T i;
+    SIZE_T count;
+
+    count = String->Length / sizeof(WCHAR);
+    PhAppendCharStringBuilder(StringBuilder, '"');
+
+    for (i = 0; i < count; i++)
+    {
+        WCHAR c = String->Buffer[i];
+
+        switch (c)
+        {
+        case '"':
+            PhAppendStringBuilder2(StringBuilder, L"\\\"");
+            break;
+        case '\\':
+            PhAppendStringBuilder2(StringBuilder, L"\\\\");
+            break;
+        case '\r':
+            PhAppendStringBuilder2(StringBuilder, L"\\r");
+            break;
+        case '\n':
+            PhAppendStringBuilder2(StringBuilder, L"\\n");
+            break;
+        case '\t':
+            PhAppendStringBuilder2(StringBuilder, L"\\t");
+            break;
+        default:
+            if (c < ' ')
+                PhAppendFormatStringBuilder(StringBuilder, L"\\u%04x", c);
+            else
+                PhAppendCharStringBuilder(StringBuilder, c);
+            break;
+        }
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, '"');
+}
+
+static VOID PhpAppendJsonStringMember(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PWSTR Name,
+    _In_ ULONG Offset,
+    _In_ ULONG StringTableLength
+    )
+{
+    PH_STRINGREF string;
+
+    if (!PhpGetLogFileString(Offset, StringTableLength, &string))
+        return;
+
+    PhAppendFormatStringBuilder(StringBuilder, L",\"%s\":", Name);
+    PhpAppendJsonString(StringBuilder, &string);
+}
+
+static VOID PhpFormatLogFileRecordCsv(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PPH_LOG_FILE_RECORD Record,
+    _In_ ULONG StringTableLength
+    )
+{
+    PH_STRINGREF string;
+
+    PhpAppendLogFileTime(StringBuilder, &Record->Time);
+    PhAppendCharStringBuilder(StringBuilder, ',');
+    PhAppendStringBuilder2(StringBuilder, PhpGetLogFileEventName(Record->Type));
+
+    if (Record->Type >= PH_LOG_ENTRY_PROCESS_FIRST && Record->Type <= PH_LOG_ENTRY_PROCESS_LAST)
+    {
+        PhAppendFormatStringBuilder(StringBuilder, L",%u,%u,", Record->ProcessId, Record->ParentProcessId);
+
+        if (Record->Type == PH_LOG_ENTRY_PROCESS_DELETE)
+            PhAppendFormatStringBuilder(StringBuilder, L"0x%x", Record->ExitStatus);
+    }
+    else
+    {
+        PhAppendStringBuilder2(StringBuilder, L",,,");
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, ',');
+
+    if (PhpGetLogFileString(Record->String1, StringTableLength, &string))
+        PhpAppendCsvString(StringBuilder, &string);
+
+    PhAppendCharStringBuilder(StringBuilder, ',');
+
+    if (PhpGetLogFileString(Record->String2, StringTableLength, &string))
+        PhpAppendCsvString(StringBuilder, &string);
+
+    PhAppendStringBuilder2(StringBuilder, L"\r\n");
+}
+
+static VOID PhpFormatLogFileRecordJson(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PPH_LOG_FILE_RECORD Record,
+    _In_ ULONG StringTableLength
+    )
+{
+    PhAppendStringBuilder2(StringBuilder, L"{\"time\":\"");
+    PhpAppendLogFileTime(StringBuilder, &Record->Time);
+    PhAppendFormatStringBuilder(StringBuilder, L"\",\"event\":\"%s\"", PhpGetLogFileEventName(Record->Type));
+
+    if (Record->Type >= PH_LOG_ENTRY_PROCESS_FIRST && Record->Type <= PH_LOG_ENTRY_PROCESS_LAST)
+    {
+        PhAppendFormatStringBuilder(StringBuilder, L",\"process_id\":%u", Record->ProcessId);
+        PhpAppendJsonStringMember(StringBuilder, L"name", Record->String1, StringTableLength);
+        PhAppendFormatStringBuilder(StringBuilder, L",\"parent_process_id\":%u", Record->ParentProcessId);
+        PhpAppendJsonStringMember(StringBuilder, L"parent_name", Record->String2, StringTableLength);
+
+        if (Record->Type == PH_LOG_ENTRY_PROCESS_DELETE)
+            PhAppendFormatStringBuilder(StringBuilder, L",\"exit_status\":\"0x%x\"", Record->ExitStatus);
+    }
+    else if (Record->Type >= PH_LOG_ENTRY_SERVICE_FIRST && Record->Type <= PH_LOG_ENTRY_SERVICE_LAST)
+    {
+        PhpAppendJsonStringMember(StringBuilder, L"name", Record->String1, StringTableLength);
+        PhpAppendJsonStringMember(StringBuilder, L"display_name", Record->String2, StringTableLength);
+    }
+    else
+    {
+        PhpAppendJsonStringMember(StringBuilder, L"message", Record->String2, StringTableLength);
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, '}');
+}
+
+/**
+ * Writes the contents of the log file to a stream.
+ *
+ * \param FileStream The stream to write to.
+ * \param Format The output format, either PH_LOG_FILE_EXPORT_CSV or PH_LOG_FILE_EXPORT_JSON.
+ *
+ * \remarks Records are formatted in batches, so memory usage does not depend on the size of
+ * the log. Entries added while the export is in progress are not included.
+ */
+NTSTATUS PhExportLogFile(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Format
+    )
+{
+    NTSTATUS status;
+    ULONG numberOfRecords;
+    ULONG stringTableLength;
+    ULONG i;
+    PH_STRING_BUILDER stringBuilder;
+
+    if (!PhpLogFileHeader)
+        return STATUS_NOT_FOUND;
+
+    // Records below the snapshot, and the strings they refer to, are never modified again.
+    numberOfRecords = PhpLogFileHeader->NumberOfRecords;
+    MemoryBarrier();
+    stringTableLength = PhpLogFileHeader->StringTableLength;
+
+    status = STATUS_SUCCESS;
+    PhInitializeStringBuilder(&stringBuilder, PH_LOG_FILE_EXPORT_FLUSH_SIZE / sizeof(WCHAR));
+
+    if (Format == PH_LOG_FILE_EXPORT_CSV)
+        PhAppendStringBuilder2(&stringBuilder, L"time,event,process_id,parent_process_id,exit_status,name,detail\r\n");
+    else
+        PhAppendStringBuilder2(&stringBuilder, L"[");
+
+    for (i = 0; i < numberOfRecords; i++)
+    {
+        if (Format == PH_LOG_FILE_EXPORT_CSV)
+        {
+            PhpFormatLogFileRecordCsv(&stringBuilder, &PhpLogFileRecords[i], stringTableLength);
+        }
+        else
+        {
+            PhAppendStringBuilder2(&stringBuilder, i != 0 ? L",\r\n" : L"\r\n");
+            PhpFormatLogFileRecordJson(&stringBuilder, &PhpLogFileRecords[i], stringTableLength);
+        }
+
+        if (stringBuilder.String->Length >= PH_LOG_FILE_EXPORT_FLUSH_SIZE)
+        {
+            status = PhWriteStringAsUtf8FileStreamEx(FileStream, stringBuilder.String->Buffer, stringBuilder.String->Length);
+
+            if (!NT_SUCCESS(status))
+                break;
+
+            PhRemoveEndStringBuilder(&stringBuilder, stringBuilder.String->Length / sizeof(WCHAR));
+        }
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        if (Format != PH_LOG_FILE_EXPORT_CSV)
+            PhAppendStringBuilder2(&stringBuilder, L"\r\n]\r\n");
+
+        status = PhWriteStringAsUtf8FileStreamEx(FileStream, stringBuilder.String->Buffer, stringBuilder.String->Length);
+    }
+
+    PhDeleteStringBuilder(&stringBuilder);
+
+    return status;
+}
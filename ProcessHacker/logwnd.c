@@ -245,11 +245,23 @@ INT_PTR CALLBACK PhpLogDlgProc(
                         { L"Text files (*.txt)", L"*.txt" },
                         { L"All files (*.*)", L"*.*" }
                     };
+                    static PH_FILETYPE_FILTER logFileFilters[] =
+                    {
+                        { L"Text files (*.txt)", L"*.txt" },
+                        { L"Full log as CSV (*.csv)", L"*.csv" },
+                        { L"Full log as JSON (*.json)", L"*.json" },
+                        { L"All files (*.*)", L"*.*" }
+                    };
                     PVOID fileDialog;
 
                     fileDialog = PhCreateSaveFileDialog();
 
-                    PhSetFileDialogFilter(fileDialog, filters, sizeof(filters) / sizeof(PH_FILETYPE_FILTER));
+                    // When a log file is being recorded, CSV and JSON exports cover the whole file
+                    // instead of the entries shown in the window.
+                    if (PhIsLogFileEnabled())
+                        PhSetFileDialogFilter(fileDialog, logFileFilters, sizeof(logFileFilters) / sizeof(PH_FILETYPE_FILTER));
+                    else
+                        PhSetFileDialogFilter(fileDialog, filters, sizeof(filters) / sizeof(PH_FILETYPE_FILTER));
                     PhSetFileDialogFileName(fileDialog, L"Process Hacker Log.txt");
 
                     if (PhShowFileDialog(hwndDlg, fileDialog))
@@ -258,10 +270,21 @@ INT_PTR CALLBACK PhpLogDlgProc(
                         PPH_STRING fileName;
                         PPH_FILE_STREAM fileStream;
                         PPH_STRING string;
+                        ULONG exportFormat;
 
                         fileName = PhGetFileDialogFileName(fileDialog);
                         PhAutoDereferenceObject(fileName);
 
+                        exportFormat = ULONG_MAX;
+
+                        if (PhIsLogFileEnabled())
+                        {
+                            if (PhEndsWithString2(fileName, L".csv", TRUE))
+                                exportFormat = PH_LOG_FILE_EXPORT_CSV;
+                            else if (PhEndsWithString2(fileName, L".json", TRUE))
+                                exportFormat = PH_LOG_FILE_EXPORT_JSON;
+                        }
+
                         if (NT_SUCCESS(status = PhCreateFileStream(
                             &fileStream,
                             fileName->Buffer,
@@ -271,12 +294,19 @@ INT_PTR CALLBACK PhpLogDlgProc(
                             0
                             )))
                         {
-                            PhWriteStringAsUtf8FileStream(fileStream, &PhUnicodeByteOrderMark);
-                            PhWritePhTextHeader(fileStream);
-
-                            string = PhpGetStringForSelectedLogEntries(TRUE);
-                            PhWriteStringAsUtf8FileStreamEx(fileStream, string->Buffer, string->Length);
-                            PhDereferenceObject(string);
+                            if (exportFormat != ULONG_MAX)
+                            {
+                                status = PhExportLogFile(fileStream, exportFormat);
+                            }
+                            else
+                            {
+                                PhWriteStringAsUtf8FileStream(fileStream, &PhUnicodeByteOrderMark);
+                                PhWritePhTextHeader(fileStream);
+
+                                string = PhpGetStringForSelectedLogEntries(TRUE);
+                                PhWriteStringAsUtf8FileStreamEx(fileStream, string->Buffer, string->Length);
+                                PhDereferenceObject(string);
+                            }
 
                             PhDereferenceObject(fileStream);
                         }
@@ -27,6 +27,7 @@
 #include <extmgri.h>
 #include <hexedit.h>
 #include <colorbox.h>
+#include <capture.h>
 #include <shlobj.h>
 
 LONG PhMainMessageLoop(
@@ -45,6 +46,10 @@ VOID PhInitializeKph(
     VOID
     );
 
+NTSTATUS PhpInitializeKphThreadStart(
+    _In_ PVOID Parameter
+    );
+
 BOOLEAN PhInitializeAppSystem(
     VOID
     );
@@ -53,6 +58,10 @@ VOID PhpInitializeSettings(
     VOID
     );
 
+VOID PhpLoadFileHashCacheStore(
+    VOID
+    );
+
 VOID PhpProcessStartupParameters(
     VOID
     );
@@ -75,6 +84,12 @@ PH_STARTUP_PARAMETERS PhStartupParameters;
 
 PH_PROVIDER_THREAD PhPrimaryProviderThread;
 PH_PROVIDER_THREAD PhSecondaryProviderThread;
+PH_PROVIDER_THREAD PhServiceProviderThread;
+PH_PROVIDER_THREAD PhNetworkProviderThread;
+
+PH_STARTUP_PHASE PhStartupPhases[PH_STARTUP_PHASE_MAXIMUM];
+volatile LONG PhNumberOfStartupPhases = 0;
+LARGE_INTEGER PhStartupCounter;
 
 static PPH_LIST DialogList = NULL;
 static PPH_LIST FilterList = NULL;
@@ -88,10 +103,15 @@ INT WINAPI wWinMain(
     )
 {
     LONG result;
+    ULONG phase;
+    HANDLE kphThreadHandle = NULL;
 #ifdef DEBUG
     PHP_BASE_THREAD_DBG dbg;
 #endif
 
+    NtQueryPerformanceCounter(&PhStartupCounter, NULL);
+    phase = PhBeginStartupPhase(L"Initialization");
+
     CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
 #ifndef DEBUG
     SetErrorMode(SEM_NOOPENFILEERRORBOX | SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX);
@@ -141,20 +161,30 @@ INT WINAPI wWinMain(
         RtlExitUserProcess(PhRunAsServiceStart(PhStartupParameters.RunAsServiceMode));
     }
 
+    PhEndStartupPhase(phase);
+
+    phase = PhBeginStartupPhase(L"Settings");
     PhpInitializeSettings();
+    PhEndStartupPhase(phase);
 
     // Activate a previous instance if required.
     if (PhGetIntegerSetting(L"AllowOnlyOneInstance") &&
         !PhStartupParameters.NewInstance &&
         !PhStartupParameters.ShowOptions &&
         !PhStartupParameters.CommandMode &&
-        !PhStartupParameters.PhSvc)
+        !PhStartupParameters.PhSvc &&
+        !PhStartupParameters.ReplayFileName)
     {
         PhActivatePreviousInstance();
     }
 
     if (PhGetIntegerSetting(L"EnableKph") && !PhStartupParameters.NoKph && !PhIsExecutingInWow64())
-        PhInitializeKph();
+    {
+        // Connecting to the driver can take a while (especially if it has to be loaded), and
+        // nothing needs it until the main window is created. Command mode needs it straight away.
+        if (PhStartupParameters.CommandMode || !(kphThreadHandle = PhCreateThread(0, PhpInitializeKphThreadStart, NULL)))
+            PhInitializeKph();
+    }
 
     if (PhStartupParameters.CommandMode && PhStartupParameters.CommandType && PhStartupParameters.CommandAction)
     {
@@ -178,14 +208,16 @@ INT WINAPI wWinMain(
     TlsSetValue(PhDbgThreadDbgTlsIndex, &dbg);
 #endif
 
-    PhInitializeAutoPool(&BaseAutoPool);
+    PhInitializeAutoPoolEx(&BaseAutoPool, PH_AUTO_POOL_USE_ARENA);
 
+    phase = PhBeginStartupPhase(L"Controls");
     PhEmInitialization();
     PhGuiSupportInitialization();
     PhTreeNewInitialization();
     PhGraphControlInitialization();
     PhHexEditInitialization();
     PhColorBoxInitialization();
+    PhEndStartupPhase(phase);
 
     PhSmallIconSize.X = GetSystemMetrics(SM_CXSMICON);
     PhSmallIconSize.Y = GetSystemMetrics(SM_CYSMICON);
@@ -211,12 +243,23 @@ INT WINAPI wWinMain(
     }
 #endif
 
+    PhpLoadFileHashCacheStore();
+
     PhPluginsEnabled = PhGetIntegerSetting(L"EnablePlugins") && !PhStartupParameters.NoPlugins;
 
     if (PhPluginsEnabled)
     {
+        phase = PhBeginStartupPhase(L"Plugins");
         PhPluginsInitialization();
         PhLoadPlugins();
+        PhEndStartupPhase(phase);
+    }
+
+    if (kphThreadHandle)
+    {
+        // The window title and the providers depend on whether KProcessHacker is connected.
+        NtWaitForSingleObject(kphThreadHandle, FALSE, NULL);
+        NtClose(kphThreadHandle);
     }
 
     if (PhStartupParameters.PhSvc)
@@ -261,12 +304,38 @@ INT WINAPI wWinMain(
         NtSetInformationProcess(NtCurrentProcess(), ProcessPriorityClass, &priorityClass, sizeof(PROCESS_PRIORITY_CLASS));
     }
 
+    // The providers start with the main window.
+    if (PhStartupParameters.ReplayFileName)
+    {
+        NTSTATUS status;
+
+        if (!NT_SUCCESS(status = PhOpenProviderReplay(PhStartupParameters.ReplayFileName->Buffer)))
+        {
+            PhShowStatus(NULL, L"Unable to open the capture", status, 0);
+            return 1;
+        }
+    }
+    else if (PhStartupParameters.RecordFileName)
+    {
+        NTSTATUS status;
+
+        if (!NT_SUCCESS(status = PhStartProviderCapture(PhStartupParameters.RecordFileName->Buffer)))
+            PhShowStatus(NULL, L"Unable to create the capture", status, 0);
+    }
+
+    phase = PhBeginStartupPhase(L"Main window");
+
     if (!PhMainWndInitialization(nCmdShow))
     {
         PhShowError(NULL, L"Unable to initialize the main window.");
         return 1;
     }
 
+    PhEndStartupPhase(phase);
+
+    // Ended by the main window when the first process update has been applied.
+    PhBeginStartupPhase(L"First process update");
+
     PhDrainAutoPool(&BaseAutoPool);
 
     result = PhMainMessageLoop();
@@ -519,6 +588,106 @@ VOID PhInitializeKph(
     PhDereferenceObject(kprocesshackerFileName);
 }
 
+NTSTATUS PhpInitializeKphThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    ULONG phase;
+
+    phase = PhBeginStartupPhase(L"KProcessHacker");
+    PhInitializeKph();
+    PhEndStartupPhase(phase);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Starts timing a startup phase.
+ *
+ * \param Name The name of the phase. The string must remain valid for the
+ * lifetime of the process.
+ *
+ * \return An index to pass to PhEndStartupPhase(), or -1 if too many phases
+ * have been recorded.
+ */
+ULONG PhBeginStartupPhase(
+    _In_ PWSTR Name
+    )
+{
+    ULONG index;
+    PPH_STARTUP_PHASE phase;
+
+    // Phases can be recorded from more than one thread.
+    index = _InterlockedIncrement(&PhNumberOfStartupPhases) - 1;
+
+    if (index >= PH_STARTUP_PHASE_MAXIMUM)
+    {
+        _InterlockedDecrement(&PhNumberOfStartupPhases);
+        return -1;
+    }
+
+    phase = &PhStartupPhases[index];
+    phase->Name = Name;
+    phase->ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
+    phase->EndCounter.QuadPart = 0;
+    NtQueryPerformanceCounter(&phase->StartCounter, NULL);
+
+    return index;
+}
+
+VOID PhEndStartupPhase(
+    _In_ ULONG Index
+    )
+{
+    if (Index < PH_STARTUP_PHASE_MAXIMUM)
+        NtQueryPerformanceCounter(&PhStartupPhases[Index].EndCounter, NULL);
+}
+
+/**
+ * Ends the phase that waits for the first process update and writes the
+ * timings to the log if the LogStartupPhases setting is enabled.
+ */
+VOID PhCompleteStartupPhases(
+    VOID
+    )
+{
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    ULONG count;
+    ULONG i;
+
+    count = min((ULONG)PhNumberOfStartupPhases, PH_STARTUP_PHASE_MAXIMUM);
+
+    for (i = 0; i < count; i++)
+    {
+        if (PhStartupPhases[i].EndCounter.QuadPart == 0 &&
+            PhEqualStringZ(PhStartupPhases[i].Name, L"First process update", FALSE))
+        {
+            PhEndStartupPhase(i);
+        }
+    }
+
+    if (!PhGetIntegerSetting(L"LogStartupPhases"))
+        return;
+
+    NtQueryPerformanceCounter(&counter, &frequency);
+
+    for (i = 0; i < count; i++)
+    {
+        PPH_STARTUP_PHASE phase = &PhStartupPhases[i];
+
+        if (phase->EndCounter.QuadPart == 0)
+            continue;
+
+        PhLogMessageEntry(PH_LOG_ENTRY_MESSAGE, PhFormatString(
+            L"Startup: %s took %.2f ms (started at %.2f ms)",
+            phase->Name,
+            (DOUBLE)(phase->EndCounter.QuadPart - phase->StartCounter.QuadPart) * 1000 / frequency.QuadPart,
+            (DOUBLE)(phase->StartCounter.QuadPart - PhStartupCounter.QuadPart) * 1000 / frequency.QuadPart
+            ));
+    }
+}
+
 BOOLEAN PhInitializeAppSystem(
     VOID
     )
@@ -655,6 +824,21 @@ VOID PhpInitializeSettings(
     }
 }
 
+VOID PhpLoadFileHashCacheStore(
+    VOID
+    )
+{
+    static PH_STRINGREF storeFileName = PH_STRINGREF_INIT(L"\\hashcache.dat");
+
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+
+    // Hashes computed by verification and by plugins are kept across sessions, keyed by the
+    // volume serial number, file ID, size and last write time of the file.
+    if (NT_SUCCESS(PhCreateStoreFilePool(&pool, &storeFileName, PH_FILE_HASH_CACHE_STORE_MAGIC, NULL, &userContext)))
+        PhSetFileHashCacheStore(pool);
+}
+
 #define PH_ARG_SETTINGS 1
 #define PH_ARG_NOSETTINGS 2
 #define PH_ARG_SHOWVISIBLE 3
@@ -682,6 +866,8 @@ VOID PhpInitializeSettings(
 #define PH_ARG_PRIORITY 25
 #define PH_ARG_PLUGIN 26
 #define PH_ARG_SELECTTAB 27
+#define PH_ARG_RECORD 28
+#define PH_ARG_REPLAY 29
 
 BOOLEAN NTAPI PhpCommandLineOptionCallback(
     _In_opt_ PPH_COMMAND_LINE_OPTION Option,
@@ -803,6 +989,12 @@ BOOLEAN NTAPI PhpCommandLineOptionCallback(
         case PH_ARG_SELECTTAB:
             PhSwapReference(&PhStartupParameters.SelectTab, Value);
             break;
+        case PH_ARG_RECORD:
+            PhSwapReference(&PhStartupParameters.RecordFileName, Value);
+            break;
+        case PH_ARG_REPLAY:
+            PhSwapReference(&PhStartupParameters.ReplayFileName, Value);
+            break;
         }
     }
     else
@@ -857,7 +1049,9 @@ VOID PhpProcessStartupParameters(
         { PH_ARG_SELECTPID, L"selectpid", MandatoryArgumentType },
         { PH_ARG_PRIORITY, L"priority", MandatoryArgumentType },
         { PH_ARG_PLUGIN, L"plugin", MandatoryArgumentType },
-        { PH_ARG_SELECTTAB, L"selecttab", MandatoryArgumentType }
+        { PH_ARG_SELECTTAB, L"selecttab", MandatoryArgumentType },
+        { PH_ARG_RECORD, L"record", MandatoryArgumentType },
+        { PH_ARG_REPLAY, L"replay", MandatoryArgumentType }
     };
     PH_STRINGREF commandLine;
 
@@ -893,6 +1087,8 @@ VOID PhpProcessStartupParameters(
             L"-nosettings\n"
             L"-plugin pluginname:value\n"
             L"-priority r|h|n|l\n"
+            L"-record capture-filename\n"
+            L"-replay capture-filename\n"
             L"-s\n"
             L"-selectpid pid-to-select\n"
             L"-selecttab name-of-tab-to-select\n"
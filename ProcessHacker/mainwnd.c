@@ -34,6 +34,11 @@
 #include <symprv.h>
 #include <sysinfo.h>
 #include <miniinfo.h>
+#include <procagg.h>
+#include <procalrt.h>
+#include <capture.h>
+#include <monitor.h>
+#include <hndltrnd.h>
 #include <mainwndp.h>
 #include <windowsx.h>
 #include <shlobj.h>
@@ -77,6 +82,7 @@ static HWND NetworkTreeListHandle;
 static HFONT CurrentCustomFont;
 
 static BOOLEAN NetworkFirstTime = TRUE;
+static BOOLEAN NetworkConsumerReferenced = FALSE;
 static BOOLEAN ServiceTreeListLoaded = FALSE;
 static BOOLEAN NetworkTreeListLoaded = FALSE;
 static HMENU SubMenuHandles[5];
@@ -87,11 +93,25 @@ static BOOLEAN UpdateAutomatically = TRUE;
 
 static PH_CALLBACK_REGISTRATION SymInitRegistration;
 
+// The process, service and network providers each have their own thread so that a slow provider
+// doesn't delay the others.
+static PPH_PROVIDER_THREAD ProviderThreads[] =
+{
+    &PhPrimaryProviderThread,
+    &PhSecondaryProviderThread,
+    &PhServiceProviderThread,
+    &PhNetworkProviderThread
+};
+static PH_CALLBACK_REGISTRATION ProviderRunCompletedRegistrations[RTL_NUMBER_OF(ProviderThreads)];
+
 static PH_PROVIDER_REGISTRATION ProcessProviderRegistration;
 static PH_CALLBACK_REGISTRATION ProcessAddedRegistration;
 static PH_CALLBACK_REGISTRATION ProcessModifiedRegistration;
 static PH_CALLBACK_REGISTRATION ProcessRemovedRegistration;
 static PH_CALLBACK_REGISTRATION ProcessesUpdatedRegistration;
+static PH_CALLBACK_REGISTRATION ProcessNotificationRegistration;
+static PH_CALLBACK_REGISTRATION ProcessAlertRegistration;
+static PH_MWP_ITEM_EVENT_QUEUE ProcessEventQueue = { PH_QUEUED_LOCK_INIT };
 static BOOLEAN ProcessesNeedsRedraw = FALSE;
 static PPH_PROCESS_NODE ProcessToScrollTo = NULL;
 
@@ -101,6 +121,7 @@ static PH_CALLBACK_REGISTRATION ServiceModifiedRegistration;
 static PH_CALLBACK_REGISTRATION ServiceRemovedRegistration;
 static PH_CALLBACK_REGISTRATION ServicesUpdatedRegistration;
 static PPH_POINTER_LIST ServicesPendingList;
+static PH_MWP_ITEM_EVENT_QUEUE ServiceEventQueue = { PH_QUEUED_LOCK_INIT };
 static BOOLEAN ServicesNeedsRedraw = FALSE;
 
 static PH_PROVIDER_REGISTRATION NetworkProviderRegistration;
@@ -108,6 +129,7 @@ static PH_CALLBACK_REGISTRATION NetworkItemAddedRegistration;
 static PH_CALLBACK_REGISTRATION NetworkItemModifiedRegistration;
 static PH_CALLBACK_REGISTRATION NetworkItemRemovedRegistration;
 static PH_CALLBACK_REGISTRATION NetworkItemsUpdatedRegistration;
+static PH_MWP_ITEM_EVENT_QUEUE NetworkEventQueue = { PH_QUEUED_LOCK_INIT };
 static BOOLEAN NetworkNeedsRedraw = FALSE;
 
 static ULONG SelectedRunAsMode;
@@ -134,23 +156,7 @@ BOOLEAN PhMainWndInitialization(
 {
     PH_STRING_BUILDER stringBuilder;
     PH_RECTANGLE windowRectangle;
-
-    if (PhGetIntegerSetting(L"FirstRun"))
-    {
-        PPH_STRING autoDbghelpPath;
-
-        // Try to set up the dbghelp path automatically if this is the first run.
-
-        autoDbghelpPath = PhMwpFindDbghelpPath();
-
-        if (autoDbghelpPath)
-        {
-            PhSetStringSetting2(L"DbgHelpPath", &autoDbghelpPath->sr);
-            PhDereferenceObject(autoDbghelpPath);
-        }
-
-        PhSetIntegerSetting(L"FirstRun", FALSE);
-    }
+    ULONG i;
 
     // This was added to be able to delay-load dbghelp.dll and symsrv.dll.
     PhRegisterCallback(&PhSymInitCallback, PhMwpSymInitHandler, NULL, &SymInitRegistration);
@@ -221,6 +227,7 @@ BOOLEAN PhMainWndInitialization(
 
     PhMwpLoadSettings();
     PhLogInitialization();
+    PhHandleTrendInitialization();
     PhQueueItemGlobalWorkQueue(PhMwpDelayedLoadFunction, NULL);
 
     PhMwpSelectionChangedTabControl(-1);
@@ -228,8 +235,8 @@ BOOLEAN PhMainWndInitialization(
     // Perform a layout.
     PhMwpOnSize();
 
-    PhStartProviderThread(&PhPrimaryProviderThread);
-    PhStartProviderThread(&PhSecondaryProviderThread);
+    for (i = 0; i < RTL_NUMBER_OF(ProviderThreads); i++)
+        PhStartProviderThread(ProviderThreads[i]);
 
     // See PhMwpOnTimer for more details.
     if (PhCsUpdateInterval > PH_FLUSH_PROCESS_QUERY_DATA_INTERVAL_1)
@@ -274,6 +281,9 @@ BOOLEAN PhMainWndInitialization(
     if (PhGetIntegerSetting(L"MiniInfoWindowPinned"))
         PhPinMiniInformation(MiniInfoManualPinType, 1, 0, PH_MINIINFO_LOAD_POSITION, NULL, NULL);
 
+    if (PhProviderReplayActive)
+        PhShowProviderReplayDialog();
+
     return TRUE;
 }
 
@@ -401,6 +411,7 @@ VOID PhMwpInitializeProviders(
     )
 {
     ULONG interval;
+    ULONG i;
 
     interval = PhGetIntegerSetting(L"UpdateInterval");
 
@@ -410,22 +421,38 @@ VOID PhMwpInitializeProviders(
         PH_SET_INTEGER_CACHED_SETTING(UpdateInterval, interval);
     }
 
-    PhInitializeProviderThread(&PhPrimaryProviderThread, interval);
-    PhInitializeProviderThread(&PhSecondaryProviderThread, interval);
+    for (i = 0; i < RTL_NUMBER_OF(ProviderThreads); i++)
+    {
+        PhInitializeProviderThread(ProviderThreads[i], interval);
+        PhRegisterCallback(&ProviderThreads[i]->RunCompletedEvent, PhMwpProviderRunCompletedHandler, NULL, &ProviderRunCompletedRegistrations[i]);
+    }
+
+    // Spread the main window providers over different processors, keeping away from processor 0
+    // which usually handles more interrupts.
+    if (PhSystemBasicInformation.NumberOfProcessors >= 4)
+    {
+        PhSetIdealProcessorProviderThread(&PhPrimaryProviderThread, 1);
+        PhSetIdealProcessorProviderThread(&PhServiceProviderThread, 2);
+        PhSetIdealProcessorProviderThread(&PhNetworkProviderThread, 3);
+    }
 
     PhRegisterProvider(&PhPrimaryProviderThread, PhProcessProviderUpdate, NULL, &ProcessProviderRegistration);
     PhSetEnabledProvider(&ProcessProviderRegistration, TRUE);
-    PhRegisterProvider(&PhPrimaryProviderThread, PhServiceProviderUpdate, NULL, &ServiceProviderRegistration);
+    PhRegisterProvider(&PhServiceProviderThread, PhServiceProviderUpdate, NULL, &ServiceProviderRegistration);
     PhSetEnabledProvider(&ServiceProviderRegistration, TRUE);
-    PhRegisterProvider(&PhPrimaryProviderThread, PhNetworkProviderUpdate, NULL, &NetworkProviderRegistration);
+    PhRegisterProvider(&PhNetworkProviderThread, PhNetworkProviderUpdate, NULL, &NetworkProviderRegistration);
+    // Keep the network list reasonably fresh while it is hidden, but don't pay the full cost.
+    PhSetScheduleProvider(&NetworkProviderRegistration, 0, 0, PH_PROVIDER_TRACK_CONSUMERS);
 }
 
 VOID PhMwpApplyUpdateInterval(
     _In_ ULONG Interval
     )
 {
-    PhSetIntervalProviderThread(&PhPrimaryProviderThread, Interval);
-    PhSetIntervalProviderThread(&PhSecondaryProviderThread, Interval);
+    ULONG i;
+
+    for (i = 0; i < RTL_NUMBER_OF(ProviderThreads); i++)
+        PhSetIntervalProviderThread(ProviderThreads[i], Interval);
 
     if (Interval > PH_FLUSH_PROCESS_QUERY_DATA_INTERVAL_LONG_TERM)
         SetTimer(PhMainWndHandle, TIMER_FLUSH_PROCESS_QUERY_DATA, PH_FLUSH_PROCESS_QUERY_DATA_INTERVAL_LONG_TERM, NULL);
@@ -539,6 +566,18 @@ VOID PhMwpInitializeControls(
         NULL,
         &ProcessesUpdatedRegistration
         );
+    PhRegisterCallback(
+        &PhProcessNotificationEvent,
+        PhMwpProcessNotificationHandler,
+        NULL,
+        &ProcessNotificationRegistration
+        );
+    PhRegisterCallback(
+        &PhProcessAlertEvent,
+        PhMwpProcessAlertHandler,
+        NULL,
+        &ProcessAlertRegistration
+        );
 
     PhRegisterCallback(
         &PhServiceAddedEvent,
@@ -1081,7 +1120,7 @@ VOID PhMwpOnCommand(
             PhSetEnabledProvider(&ProcessProviderRegistration, UpdateAutomatically);
             PhSetEnabledProvider(&ServiceProviderRegistration, UpdateAutomatically);
 
-            if (TabCtrl_GetCurSel(TabControlHandle) == NetworkTabIndex)
+            if (!NetworkFirstTime)
                 PhSetEnabledProvider(&NetworkProviderRegistration, UpdateAutomatically);
         }
         break;
@@ -1129,6 +1168,21 @@ VOID PhMwpOnCommand(
             PhShowPagefilesDialog(PhMainWndHandle);
         }
         break;
+    case ID_TOOLS_REMOTEHOSTS:
+        {
+            PhShowRemoteHostsDialog(PhMainWndHandle);
+        }
+        break;
+    case ID_TOOLS_REPLAY:
+        {
+            PhShowProviderReplayDialog();
+        }
+        break;
+    case ID_TOOLS_PROCESSAGGREGATES:
+        {
+            PhShowProcessAggregatesDialog(PhMainWndHandle);
+        }
+        break;
     case ID_TOOLS_STARTTASKMANAGER:
         {
             PPH_STRING systemDirectory;
@@ -1275,14 +1329,19 @@ VOID PhMwpOnCommand(
         break;
     case ID_PROCESS_CREATEDUMPFILE:
         {
-            PPH_PROCESS_ITEM processItem = PhGetSelectedProcessItem();
+            PPH_PROCESS_ITEM *processes;
+            ULONG numberOfProcesses;
 
-            if (processItem)
-            {
-                PhReferenceObject(processItem);
-                PhUiCreateDumpFileProcess(PhMainWndHandle, processItem);
-                PhDereferenceObject(processItem);
-            }
+            PhGetSelectedProcessItems(&processes, &numberOfProcesses);
+            PhReferenceObjects(processes, numberOfProcesses);
+
+            if (numberOfProcesses == 1)
+                PhUiCreateDumpFileProcess(PhMainWndHandle, processes[0]);
+            else if (numberOfProcesses > 1)
+                PhUiCreateDumpFileProcesses(PhMainWndHandle, processes, numberOfProcesses);
+
+            PhDereferenceObjects(processes, numberOfProcesses);
+            PhFree(processes);
         }
         break;
     case ID_PROCESS_DEBUG:
@@ -2123,6 +2182,14 @@ VOID PhMwpOnWtsSessionChange(
             PhMwpUpdateUsersMenu();
         }
     }
+
+    if (SessionId == NtCurrentPeb()->SessionId)
+    {
+        if (Reason == WTS_CONSOLE_DISCONNECT || Reason == WTS_REMOTE_DISCONNECT)
+            PhNfNotifySessionConnected(FALSE);
+        else if (Reason == WTS_CONSOLE_CONNECT || Reason == WTS_REMOTE_CONNECT)
+            PhNfNotifySessionConnected(TRUE);
+    }
 }
 
 ULONG_PTR PhMwpOnUserMessage(
@@ -2229,10 +2296,6 @@ ULONG_PTR PhMwpOnUserMessage(
                 showMemoryResults->ProcessId,
                 showMemoryResults->Results
                 );
-            PhDereferenceMemoryResults(
-                (PPH_MEMORY_RESULT *)showMemoryResults->Results->Items,
-                showMemoryResults->Results->Count
-                );
             PhDereferenceObject(showMemoryResults->Results);
             PhFree(showMemoryResults);
         }
@@ -2384,81 +2447,99 @@ ULONG_PTR PhMwpOnUserMessage(
             PhMwpActivateWindow(!!PhGetIntegerSetting(L"IconTogglesVisibility"));
         }
         break;
-    case WM_PH_PROCESS_ADDED:
-        {
-            ULONG runId = (ULONG)WParam;
-            PPH_PROCESS_ITEM processItem = (PPH_PROCESS_ITEM)LParam;
-
-            PhMwpOnProcessAdded(processItem, runId);
-        }
-        break;
-    case WM_PH_PROCESS_MODIFIED:
-        {
-            PhMwpOnProcessModified((PPH_PROCESS_ITEM)LParam);
-        }
-        break;
-    case WM_PH_PROCESS_REMOVED:
-        {
-            PhMwpOnProcessRemoved((PPH_PROCESS_ITEM)LParam);
-        }
-        break;
     case WM_PH_PROCESSES_UPDATED:
         {
+            PhMwpFlushProcessEvents();
             PhMwpOnProcessesUpdated();
         }
         break;
-    case WM_PH_SERVICE_ADDED:
-        {
-            ULONG runId = (ULONG)WParam;
-            PPH_SERVICE_ITEM serviceItem = (PPH_SERVICE_ITEM)LParam;
-
-            PhMwpOnServiceAdded(serviceItem, runId);
-        }
-        break;
-    case WM_PH_SERVICE_MODIFIED:
-        {
-            PPH_SERVICE_MODIFIED_DATA serviceModifiedData = (PPH_SERVICE_MODIFIED_DATA)LParam;
-
-            PhMwpOnServiceModified(serviceModifiedData);
-            PhFree(serviceModifiedData);
-        }
-        break;
-    case WM_PH_SERVICE_REMOVED:
-        {
-            PhMwpOnServiceRemoved((PPH_SERVICE_ITEM)LParam);
-        }
-        break;
     case WM_PH_SERVICES_UPDATED:
         {
+            PhMwpFlushServiceEvents();
             PhMwpOnServicesUpdated();
         }
         break;
-    case WM_PH_NETWORK_ITEM_ADDED:
-        {
-            ULONG runId = (ULONG)WParam;
-            PPH_NETWORK_ITEM networkItem = (PPH_NETWORK_ITEM)LParam;
-
-            PhMwpOnNetworkItemAdded(runId, networkItem);
-        }
-        break;
-    case WM_PH_NETWORK_ITEM_MODIFIED:
+    case WM_PH_NETWORK_ITEMS_UPDATED:
         {
-            PhMwpOnNetworkItemModified((PPH_NETWORK_ITEM)LParam);
+            PhMwpFlushNetworkEvents();
+            PhMwpOnNetworkItemsUpdated();
         }
         break;
-    case WM_PH_NETWORK_ITEM_REMOVED:
+    }
+
+    return 0;
+}
+
+VOID PhMwpQueueItemEvent(
+    _Inout_ PPH_MWP_ITEM_EVENT_QUEUE Queue,
+    _In_ ULONG Type,
+    _In_ ULONG RunId,
+    _In_ PVOID Item
+    )
+{
+    PPH_MWP_ITEM_EVENT event;
+
+    PhAcquireQueuedLockExclusive(&Queue->Lock);
+
+    if (Queue->Count == Queue->AllocatedCount)
+    {
+        if (Queue->Events)
         {
-            PhMwpOnNetworkItemRemoved((PPH_NETWORK_ITEM)LParam);
+            Queue->AllocatedCount *= 2;
+            Queue->Events = PhReAllocate(Queue->Events, Queue->AllocatedCount * sizeof(PH_MWP_ITEM_EVENT));
         }
-        break;
-    case WM_PH_NETWORK_ITEMS_UPDATED:
+        else
         {
-            PhMwpOnNetworkItemsUpdated();
+            Queue->AllocatedCount = 64;
+            Queue->Events = PhAllocate(Queue->AllocatedCount * sizeof(PH_MWP_ITEM_EVENT));
         }
-        break;
     }
 
-    return 0;
+    event = &Queue->Events[Queue->Count++];
+    event->Type = Type;
+    event->RunId = RunId;
+    event->Item = Item;
+
+    PhReleaseQueuedLockExclusive(&Queue->Lock);
+}
+
+BOOLEAN PhMwpTakeItemEvents(
+    _Inout_ PPH_MWP_ITEM_EVENT_QUEUE Queue,
+    _Out_ PPH_MWP_ITEM_EVENT *Events,
+    _Out_ PULONG Count
+    )
+{
+    PhAcquireQueuedLockExclusive(&Queue->Lock);
+
+    *Events = Queue->Events;
+    *Count = Queue->Count;
+
+    Queue->Events = NULL;
+    Queue->Count = 0;
+    Queue->AllocatedCount = 0;
+
+    PhReleaseQueuedLockExclusive(&Queue->Lock);
+
+    if (*Count == 0)
+    {
+        if (*Events)
+            PhFree(*Events);
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID NTAPI PhMwpProviderRunCompletedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    // Let plugins watch for slow providers. This is called on the provider thread after every
+    // run, so it needs to stay cheap.
+    if (PhPluginsEnabled)
+        PhInvokeCallback(PhGetGeneralCallback(GeneralCallbackProviderRunCompleted), Parameter);
 }
 
 VOID NTAPI PhMwpProcessAddedHandler(
@@ -2471,11 +2552,11 @@ VOID NTAPI PhMwpProcessAddedHandler(
     // Reference the process item so it doesn't get deleted before
     // we handle the event in the main thread.
     PhReferenceObject(processItem);
-    PostMessage(
-        PhMainWndHandle,
-        WM_PH_PROCESS_ADDED,
-        (WPARAM)PhGetRunIdProvider(&ProcessProviderRegistration),
-        (LPARAM)processItem
+    PhMwpQueueItemEvent(
+        &ProcessEventQueue,
+        PH_MWP_ITEM_ADDED,
+        PhGetRunIdProvider(&ProcessProviderRegistration),
+        processItem
         );
 }
 
@@ -2486,7 +2567,7 @@ VOID NTAPI PhMwpProcessModifiedHandler(
 {
     PPH_PROCESS_ITEM processItem = (PPH_PROCESS_ITEM)Parameter;
 
-    PostMessage(PhMainWndHandle, WM_PH_PROCESS_MODIFIED, 0, (LPARAM)processItem);
+    PhMwpQueueItemEvent(&ProcessEventQueue, PH_MWP_ITEM_MODIFIED, 0, processItem);
 }
 
 VOID NTAPI PhMwpProcessRemovedHandler(
@@ -2498,7 +2579,7 @@ VOID NTAPI PhMwpProcessRemovedHandler(
 
     // We already have a reference to the process item, so we don't need to
     // reference it here.
-    PostMessage(PhMainWndHandle, WM_PH_PROCESS_REMOVED, 0, (LPARAM)processItem);
+    PhMwpQueueItemEvent(&ProcessEventQueue, PH_MWP_ITEM_REMOVED, 0, processItem);
 }
 
 VOID NTAPI PhMwpProcessesUpdatedHandler(
@@ -2509,6 +2590,63 @@ VOID NTAPI PhMwpProcessesUpdatedHandler(
     PostMessage(PhMainWndHandle, WM_PH_PROCESSES_UPDATED, 0, 0);
 }
 
+VOID NTAPI PhMwpProcessAlertHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_PROCESS_ALERT alert = (PPH_PROCESS_ALERT)Parameter;
+
+    PhReferenceObject(alert);
+    PhMwpQueueItemEvent(&ProcessEventQueue, PH_MWP_ITEM_ALERT, 0, alert);
+}
+
+VOID NTAPI PhMwpProcessNotificationHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PKPH_NOTIFY_EVENT_INFORMATION information = Parameter;
+    BOOLEAN boost;
+    ULONG i;
+
+    // If events were lost, only an update can tell what changed.
+    boost = information->LostCount != 0;
+
+    for (i = 0; i < information->EventCount; i++)
+    {
+        PKPH_NOTIFY_EVENT event = &information->Events[i];
+        PPH_PROCESS_ITEM processItem;
+
+        if (event->Type != KphNotifyProcessCreate && event->Type != KphNotifyProcessExit)
+            continue;
+
+        boost = TRUE;
+
+        // A process that exits before the process provider sees it never gets a process
+        // item, so it would not appear in the log at all.
+        if (event->Type == KphNotifyProcessExit)
+        {
+            if (processItem = PhReferenceProcessItem(event->ProcessId))
+            {
+                PhDereferenceObject(processItem);
+            }
+            else
+            {
+                ProcessHacker_Invoke(PhMainWndHandle, PhMwpOnShortLivedProcess, PhFormatString(
+                    L"Short-lived process: %hs (%u); exit status 0x%x",
+                    event->ImageFileName,
+                    HandleToUlong(event->ProcessId),
+                    event->ExitStatus
+                    ));
+            }
+        }
+    }
+
+    if (boost)
+        PhBoostProvider(&ProcessProviderRegistration, NULL);
+}
+
 VOID NTAPI PhMwpServiceAddedHandler(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -2517,11 +2655,11 @@ VOID NTAPI PhMwpServiceAddedHandler(
     PPH_SERVICE_ITEM serviceItem = (PPH_SERVICE_ITEM)Parameter;
 
     PhReferenceObject(serviceItem);
-    PostMessage(
-        PhMainWndHandle,
-        WM_PH_SERVICE_ADDED,
+    PhMwpQueueItemEvent(
+        &ServiceEventQueue,
+        PH_MWP_ITEM_ADDED,
         PhGetRunIdProvider(&ServiceProviderRegistration),
-        (LPARAM)serviceItem
+        serviceItem
         );
 }
 
@@ -2535,7 +2673,7 @@ VOID NTAPI PhMwpServiceModifiedHandler(
 
     copy = PhAllocateCopy(serviceModifiedData, sizeof(PH_SERVICE_MODIFIED_DATA));
 
-    PostMessage(PhMainWndHandle, WM_PH_SERVICE_MODIFIED, 0, (LPARAM)copy);
+    PhMwpQueueItemEvent(&ServiceEventQueue, PH_MWP_ITEM_MODIFIED, 0, copy);
 }
 
 VOID NTAPI PhMwpServiceRemovedHandler(
@@ -2545,7 +2683,7 @@ VOID NTAPI PhMwpServiceRemovedHandler(
 {
     PPH_SERVICE_ITEM serviceItem = (PPH_SERVICE_ITEM)Parameter;
 
-    PostMessage(PhMainWndHandle, WM_PH_SERVICE_REMOVED, 0, (LPARAM)serviceItem);
+    PhMwpQueueItemEvent(&ServiceEventQueue, PH_MWP_ITEM_REMOVED, 0, serviceItem);
 }
 
 VOID NTAPI PhMwpServicesUpdatedHandler(
@@ -2564,11 +2702,11 @@ VOID NTAPI PhMwpNetworkItemAddedHandler(
     PPH_NETWORK_ITEM networkItem = (PPH_NETWORK_ITEM)Parameter;
 
     PhReferenceObject(networkItem);
-    PostMessage(
-        PhMainWndHandle,
-        WM_PH_NETWORK_ITEM_ADDED,
+    PhMwpQueueItemEvent(
+        &NetworkEventQueue,
+        PH_MWP_ITEM_ADDED,
         PhGetRunIdProvider(&NetworkProviderRegistration),
-        (LPARAM)networkItem
+        networkItem
         );
 }
 
@@ -2579,7 +2717,7 @@ VOID NTAPI PhMwpNetworkItemModifiedHandler(
 {
     PPH_NETWORK_ITEM networkItem = (PPH_NETWORK_ITEM)Parameter;
 
-    PostMessage(PhMainWndHandle, WM_PH_NETWORK_ITEM_MODIFIED, 0, (LPARAM)networkItem);
+    PhMwpQueueItemEvent(&NetworkEventQueue, PH_MWP_ITEM_MODIFIED, 0, networkItem);
 }
 
 VOID NTAPI PhMwpNetworkItemRemovedHandler(
@@ -2589,7 +2727,7 @@ VOID NTAPI PhMwpNetworkItemRemovedHandler(
 {
     PPH_NETWORK_ITEM networkItem = (PPH_NETWORK_ITEM)Parameter;
 
-    PostMessage(PhMainWndHandle, WM_PH_NETWORK_ITEM_REMOVED, 0, (LPARAM)networkItem);
+    PhMwpQueueItemEvent(&NetworkEventQueue, PH_MWP_ITEM_REMOVED, 0, networkItem);
 }
 
 VOID NTAPI PhMwpNetworkItemsUpdatedHandler(
@@ -2620,11 +2758,16 @@ VOID PhMwpLoadSettings(
         PhSetWindowOpacity(PhMainWndHandle, opacity);
 
     PhStatisticsSampleCount = PhGetIntegerSetting(L"SampleCount");
+    PhStatisticsBucketSize = PhGetIntegerSetting(L"SampleBucketSize");
+    PhStatisticsBucketCount = PhGetIntegerSetting(L"SampleBucketCount");
     PhEnableProcessQueryStage2 = !!PhGetIntegerSetting(L"EnableStage2");
     PhEnablePurgeProcessRecords = !PhGetIntegerSetting(L"NoPurgeProcessRecords");
+    PhProcessRecordStoreDays = PhGetIntegerSetting(L"ProcessRecordStoreDays");
     PhEnableCycleCpuUsage = !!PhGetIntegerSetting(L"EnableCycleCpuUsage");
     PhEnableServiceNonPoll = !!PhGetIntegerSetting(L"EnableServiceNonPoll");
+    PhEnableProcessNonPoll = !!PhGetIntegerSetting(L"EnableProcessNonPoll");
     PhEnableNetworkProviderResolve = !!PhGetIntegerSetting(L"EnableNetworkResolve");
+    PhSetProcessAlertRules(&PhaGetStringSetting(L"ProcessAlertRules")->sr);
 
     PhNfLoadStage1();
 
@@ -2734,6 +2877,25 @@ VOID PhMwpSymInitHandler(
 {
     PPH_STRING dbghelpPath;
 
+    if (PhGetIntegerSetting(L"FirstRun"))
+    {
+        PPH_STRING autoDbghelpPath;
+
+        // Try to set up the dbghelp path automatically if this is the first run. This is done
+        // here rather than during startup because searching for the Debugging Tools is slow and
+        // nothing needs the path until the first symbol provider is created.
+
+        autoDbghelpPath = PhMwpFindDbghelpPath();
+
+        if (autoDbghelpPath)
+        {
+            PhSetStringSetting2(L"DbgHelpPath", &autoDbghelpPath->sr);
+            PhDereferenceObject(autoDbghelpPath);
+        }
+
+        PhSetIntegerSetting(L"FirstRun", FALSE);
+    }
+
     dbghelpPath = PhGetStringSetting(L"DbgHelpPath");
     PhLoadDbgHelpFromPath(dbghelpPath->Buffer);
     PhDereferenceObject(dbghelpPath);
@@ -3413,6 +3575,12 @@ VOID PhMwpSelectionChangedTabControl(
     {
         PhMwpNeedNetworkTreeList();
 
+        if (!NetworkConsumerReferenced)
+        {
+            PhReferenceConsumerProvider(&NetworkProviderRegistration);
+            NetworkConsumerReferenced = TRUE;
+        }
+
         PhSetEnabledProvider(&NetworkProviderRegistration, UpdateAutomatically);
 
         if (UpdateAutomatically || NetworkFirstTime)
@@ -3421,9 +3589,12 @@ VOID PhMwpSelectionChangedTabControl(
             NetworkFirstTime = FALSE;
         }
     }
-    else
+    else if (NetworkConsumerReferenced)
     {
-        PhSetEnabledProvider(&NetworkProviderRegistration, FALSE);
+        // The provider stays enabled once the network list has been shown, and drops to a
+        // slow cadence while the list is hidden.
+        PhDereferenceConsumerProvider(&NetworkProviderRegistration);
+        NetworkConsumerReferenced = FALSE;
     }
 
     ShowWindow(ProcessTreeListHandle, selectedIndex == ProcessesTabIndex ? SW_SHOW : SW_HIDE);
@@ -3530,17 +3701,6 @@ INT PhMwpFindTabPageIndex(
     return -1;
 }
 
-static int __cdecl IconProcessesCpuUsageCompare(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    PPH_PROCESS_ITEM processItem1 = *(PPH_PROCESS_ITEM *)elem1;
-    PPH_PROCESS_ITEM processItem2 = *(PPH_PROCESS_ITEM *)elem2;
-
-    return -singlecmp(processItem1->CpuUsage, processItem2->CpuUsage);
-}
-
 static int __cdecl IconProcessesNameCompare(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -3703,49 +3863,35 @@ VOID PhMwpAddIconProcesses(
     )
 {
     ULONG i;
-    PPH_PROCESS_ITEM *processItems;
+    PPH_PROCESS_ITEM processItems[PH_PROCESS_TOP_COUNT];
     ULONG numberOfProcessItems;
     PPH_LIST processList;
     PPH_PROCESS_ITEM processItem;
 
-    PhEnumProcessItems(&processItems, &numberOfProcessItems);
-    processList = PhCreateList(numberOfProcessItems);
-    PhAddItemsList(processList, processItems, numberOfProcessItems);
+    // The process provider already keeps the processes with the highest CPU usage, in order.
+    numberOfProcessItems = PhGetTopProcessItems(PhProcessTopCpu, processItems, PH_PROCESS_TOP_COUNT);
+    processList = PhCreateList(NumberOfProcesses);
 
-    // Remove non-real processes.
-    for (i = 0; i < processList->Count; i++)
+    // Prefer processes with non-zero CPU usage that are running as the current user.
+    for (i = 0; i < numberOfProcessItems && processList->Count < NumberOfProcesses; i++)
     {
-        processItem = processList->Items[i];
-
-        if (!PH_IS_REAL_PROCESS_ID(processItem->ProcessId))
-        {
-            PhRemoveItemList(processList, i);
-            i--;
-        }
-    }
-
-    // Remove processes with zero CPU usage and those running as other users.
-    for (i = 0; i < processList->Count && processList->Count > NumberOfProcesses; i++)
-    {
-        processItem = processList->Items[i];
+        processItem = processItems[i];
 
         if (
-            processItem->CpuUsage == 0 ||
-            !processItem->UserName ||
-            (PhCurrentUserName && !PhEqualString(processItem->UserName, PhCurrentUserName, TRUE))
+            processItem->CpuUsage != 0 &&
+            processItem->UserName &&
+            (!PhCurrentUserName || PhEqualString(processItem->UserName, PhCurrentUserName, TRUE))
             )
         {
-            PhRemoveItemList(processList, i);
-            i--;
+            PhAddItemList(processList, processItem);
         }
     }
 
-    // Sort the processes by CPU usage and remove the extra processes at the end of the list.
-    qsort(processList->Items, processList->Count, sizeof(PVOID), IconProcessesCpuUsageCompare);
-
-    if (processList->Count > NumberOfProcesses)
+    // Fill the remaining slots with the other processes.
+    for (i = 0; i < numberOfProcessItems && processList->Count < NumberOfProcesses; i++)
     {
-        PhRemoveItemsList(processList, NumberOfProcesses, processList->Count - NumberOfProcesses);
+        if (PhFindItemList(processList, processItems[i]) == -1)
+            PhAddItemList(processList, processItems[i]);
     }
 
     // Lastly, sort by name.
@@ -3805,7 +3951,6 @@ VOID PhMwpAddIconProcesses(
 
     PhDereferenceObject(processList);
     PhDereferenceObjects(processItems, numberOfProcessItems);
-    PhFree(processItems);
 }
 
 VOID PhShowIconContextMenu(
@@ -3853,6 +3998,9 @@ VOID PhShowIconContextMenu(
             case PH_NOTIFY_SERVICE_STOP:
                 id = ID_NOTIFICATIONS_STOPPEDSERVICES;
                 break;
+            case PH_NOTIFY_PROCESS_ALERT:
+                id = ID_NOTIFICATIONS_PROCESSALERTS;
+                break;
             }
 
             PhSetFlagsEMenuItem(menu, id, PH_EMENU_CHECKED, PH_EMENU_CHECKED);
@@ -3923,6 +4071,7 @@ VOID PhShowIconContextMenu(
             case ID_NOTIFICATIONS_STARTEDSERVICES:
             case ID_NOTIFICATIONS_STOPPEDSERVICES:
             case ID_NOTIFICATIONS_DELETEDSERVICES:
+            case ID_NOTIFICATIONS_PROCESSALERTS:
                 {
                     ULONG bit;
 
@@ -3946,6 +4095,9 @@ VOID PhShowIconContextMenu(
                     case ID_NOTIFICATIONS_DELETEDSERVICES:
                         bit = PH_NOTIFY_SERVICE_DELETE;
                         break;
+                    case ID_NOTIFICATIONS_PROCESSALERTS:
+                        bit = PH_NOTIFY_PROCESS_ALERT;
+                        break;
                     }
 
                     NotifyIconNotifyMask ^= bit;
@@ -3977,6 +4129,7 @@ VOID PhShowDetailsForIconNotification(
     switch (LastNotificationType)
     {
     case PH_NOTIFY_PROCESS_CREATE:
+    case PH_NOTIFY_PROCESS_ALERT:
         {
             PPH_PROCESS_NODE processNode;
 
@@ -4331,6 +4484,7 @@ VOID PhMwpInitializeProcessMenu(
             ID_PROCESS_SUSPEND,
             ID_PROCESS_RESUME,
             ID_MISCELLANEOUS_REDUCEWORKINGSET,
+            ID_PROCESS_CREATEDUMPFILE,
             ID_PROCESS_COPY
         };
         ULONG i;
@@ -4608,9 +4762,6 @@ VOID PhMwpOnProcessModified(
     )
 {
     PhUpdateProcessNode(PhFindProcessNode(ProcessItem->ProcessId));
-
-    if (SignedFilterEntry)
-        PhApplyTreeNewFilters(PhGetFilterSupportProcessTreeList());
 }
 
 VOID PhMwpOnProcessRemoved(
@@ -4650,14 +4801,53 @@ VOID PhMwpOnProcessRemoved(
         ProcessToScrollTo = NULL;
 }
 
+VOID PhMwpOnProcessAlert(
+    _In_ _Assume_refs_(1) PPH_PROCESS_ALERT Alert
+    )
+{
+    PhLogMessageEntry(PH_LOG_ENTRY_MESSAGE, Alert->Message);
+
+    if (NotifyIconNotifyMask & PH_NOTIFY_PROCESS_ALERT)
+    {
+        if (!PhPluginsEnabled || !PhMwpPluginNotifyEvent(PH_NOTIFY_PROCESS_ALERT, Alert))
+        {
+            PhMwpClearLastNotificationDetails();
+            LastNotificationType = PH_NOTIFY_PROCESS_ALERT;
+            LastNotificationDetails.ProcessId = Alert->ProcessItem->ProcessId;
+
+            PhShowIconNotification(L"Process Alert", Alert->Message->Buffer, NIIF_WARNING);
+        }
+    }
+
+    PhDereferenceObject(Alert);
+}
+
+VOID NTAPI PhMwpOnShortLivedProcess(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_STRING message = Parameter;
+
+    PhLogMessageEntry(PH_LOG_ENTRY_MESSAGE, message);
+    PhDereferenceObject(message);
+}
+
 VOID PhMwpOnProcessesUpdated(
     VOID
     )
 {
+    static BOOLEAN firstUpdate = TRUE;
+
     // The modified notification is only sent for special cases.
     // We have to invalidate the text on each update.
     PhTickProcessNodes();
 
+    if (firstUpdate)
+    {
+        PhCompleteStartupPhases();
+        firstUpdate = FALSE;
+    }
+
     if (PhPluginsEnabled)
     {
         PhInvokeCallback(PhGetGeneralCallback(GeneralCallbackProcessesUpdated), NULL);
@@ -4687,6 +4877,52 @@ VOID PhMwpOnProcessesUpdated(
     }
 }
 
+VOID PhMwpFlushProcessEvents(
+    VOID
+    )
+{
+    PPH_MWP_ITEM_EVENT events;
+    ULONG count;
+    ULONG i;
+    BOOLEAN modified = FALSE;
+
+    if (!PhMwpTakeItemEvents(&ProcessEventQueue, &events, &count))
+        return;
+
+    // PhMwpOnProcessesUpdated turns redraw back on once the whole batch has been applied.
+    if (!ProcessesNeedsRedraw)
+    {
+        TreeNew_SetRedraw(ProcessTreeListHandle, FALSE);
+        ProcessesNeedsRedraw = TRUE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        switch (events[i].Type)
+        {
+        case PH_MWP_ITEM_ADDED:
+            PhMwpOnProcessAdded(events[i].Item, events[i].RunId);
+            break;
+        case PH_MWP_ITEM_MODIFIED:
+            PhMwpOnProcessModified(events[i].Item);
+            modified = TRUE;
+            break;
+        case PH_MWP_ITEM_REMOVED:
+            PhMwpOnProcessRemoved(events[i].Item);
+            break;
+        case PH_MWP_ITEM_ALERT:
+            PhMwpOnProcessAlert(events[i].Item);
+            break;
+        }
+    }
+
+    PhFree(events);
+
+    // The signature filter depends on verification results, which arrive as modifications.
+    if (modified && SignedFilterEntry)
+        PhApplyTreeNewFilters(PhGetFilterSupportProcessTreeList());
+}
+
 VOID PhMwpNeedServiceTreeList(
     VOID
     )
@@ -4936,9 +5172,6 @@ VOID PhMwpOnServiceModified(
         //}
 
         PhUpdateServiceNode(PhFindServiceNode(ServiceModifiedData->Service));
-
-        if (DriverFilterEntry)
-            PhApplyTreeNewFilters(PhGetFilterSupportServiceTreeList());
     }
 
     serviceChange = PhGetServiceChange(ServiceModifiedData);
@@ -5072,6 +5305,48 @@ VOID PhMwpOnServicesUpdated(
     }
 }
 
+VOID PhMwpFlushServiceEvents(
+    VOID
+    )
+{
+    PPH_MWP_ITEM_EVENT events;
+    ULONG count;
+    ULONG i;
+    BOOLEAN modified = FALSE;
+
+    if (!PhMwpTakeItemEvents(&ServiceEventQueue, &events, &count))
+        return;
+
+    if (ServiceTreeListLoaded && !ServicesNeedsRedraw)
+    {
+        TreeNew_SetRedraw(ServiceTreeListHandle, FALSE);
+        ServicesNeedsRedraw = TRUE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        switch (events[i].Type)
+        {
+        case PH_MWP_ITEM_ADDED:
+            PhMwpOnServiceAdded(events[i].Item, events[i].RunId);
+            break;
+        case PH_MWP_ITEM_MODIFIED:
+            PhMwpOnServiceModified(events[i].Item);
+            PhFree(events[i].Item);
+            modified = TRUE;
+            break;
+        case PH_MWP_ITEM_REMOVED:
+            PhMwpOnServiceRemoved(events[i].Item);
+            break;
+        }
+    }
+
+    PhFree(events);
+
+    if (modified && ServiceTreeListLoaded && DriverFilterEntry)
+        PhApplyTreeNewFilters(PhGetFilterSupportServiceTreeList());
+}
+
 VOID PhMwpNeedNetworkTreeList(
     VOID
     )
@@ -5285,6 +5560,42 @@ VOID PhMwpOnNetworkItemsUpdated(
     }
 }
 
+VOID PhMwpFlushNetworkEvents(
+    VOID
+    )
+{
+    PPH_MWP_ITEM_EVENT events;
+    ULONG count;
+    ULONG i;
+
+    if (!PhMwpTakeItemEvents(&NetworkEventQueue, &events, &count))
+        return;
+
+    if (!NetworkNeedsRedraw)
+    {
+        TreeNew_SetRedraw(NetworkTreeListHandle, FALSE);
+        NetworkNeedsRedraw = TRUE;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        switch (events[i].Type)
+        {
+        case PH_MWP_ITEM_ADDED:
+            PhMwpOnNetworkItemAdded(events[i].RunId, events[i].Item);
+            break;
+        case PH_MWP_ITEM_MODIFIED:
+            PhMwpOnNetworkItemModified(events[i].Item);
+            break;
+        case PH_MWP_ITEM_REMOVED:
+            PhMwpOnNetworkItemRemoved(events[i].Item);
+            break;
+        }
+    }
+
+    PhFree(events);
+}
+
 VOID PhMwpUpdateUsersMenu(
     VOID
     )
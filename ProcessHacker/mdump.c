@@ -30,6 +30,7 @@
 #include <symprv.h>
 #include <settings.h>
 #include <phsvccl.h>
+#include <processsnapshot.h>
 
 #define WM_PH_MINIDUMP_STATUS_UPDATE (WM_APP + 301)
 
@@ -53,8 +54,64 @@ typedef struct _PROCESS_MINIDUMP_CONTEXT
     BOOLEAN Succeeded;
 
     ULONG LastTickCount;
+
+    BOOLEAN IsSnapshot;
+    ULONG FreezeTime;
 } PROCESS_MINIDUMP_CONTEXT, *PPROCESS_MINIDUMP_CONTEXT;
 
+// task manager uses these flags
+#define PH_DUMP_BATCH_DUMP_TYPE (MiniDumpWithFullMemory | MiniDumpWithHandleData | \
+    MiniDumpWithUnloadedModules | MiniDumpWithFullMemoryInfo | MiniDumpWithThreadInfo)
+
+#define PH_DUMP_SNAPSHOT_CAPTURE_FLAGS (PSS_CAPTURE_VA_CLONE | PSS_CAPTURE_HANDLES | \
+    PSS_CAPTURE_HANDLE_NAME_INFORMATION | PSS_CAPTURE_HANDLE_BASIC_INFORMATION | \
+    PSS_CAPTURE_HANDLE_TYPE_SPECIFIC_INFORMATION | PSS_CAPTURE_HANDLE_TRACE | \
+    PSS_CAPTURE_THREADS | PSS_CAPTURE_THREAD_CONTEXT | PSS_CAPTURE_THREAD_CONTEXT_EXTENDED | \
+    PSS_CREATE_BREAKAWAY_OPTIONAL | PSS_CREATE_BREAKAWAY | PSS_CREATE_USE_VM_ALLOCATIONS | \
+    PSS_CREATE_RELEASE_SECTION)
+
+typedef DWORD (WINAPI *_PssCaptureSnapshot)(
+    _In_ HANDLE ProcessHandle,
+    _In_ PSS_CAPTURE_FLAGS CaptureFlags,
+    _In_opt_ DWORD ThreadContextFlags,
+    _Out_ HPSS *SnapshotHandle
+    );
+
+typedef DWORD (WINAPI *_PssFreeSnapshot)(
+    _In_ HANDLE ProcessHandle,
+    _In_ HPSS SnapshotHandle
+    );
+
+// Cloning the address space needs more access than a plain dump.
+#define PH_DUMP_SNAPSHOT_PROCESS_ACCESS (PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | \
+    PROCESS_VM_OPERATION | PROCESS_DUP_HANDLE | PROCESS_CREATE_PROCESS)
+
+typedef struct _PH_DUMP_BATCH_CONTEXT
+{
+    PHANDLE ProcessIds;
+    ULONG NumberOfProcesses;
+    PPH_STRINGREF DirectoryName;
+    ULONG MaximumConcurrentDumps;
+    ULONG Flags;
+    MINIDUMP_TYPE DumpType;
+    PNTSTATUS Statuses;
+    NTSTATUS Status;
+
+    HWND WindowHandle;
+    HANDLE ThreadHandle;
+    volatile LONG NumberOfCompleted;
+    BOOLEAN Stop;
+} PH_DUMP_BATCH_CONTEXT, *PPH_DUMP_BATCH_CONTEXT;
+
+typedef struct _PH_DUMP_BATCH_ITEM
+{
+    PPH_DUMP_BATCH_CONTEXT Batch;
+    HANDLE ProcessId;
+    PPH_STRING FileName;
+    NTSTATUS Status;
+    BOOLEAN IsSnapshot;
+} PH_DUMP_BATCH_ITEM, *PPH_DUMP_BATCH_ITEM;
+
 BOOLEAN PhpCreateProcessMiniDumpWithProgress(
     _In_ HWND hWnd,
     _In_ HANDLE ProcessId,
@@ -62,6 +119,9 @@ BOOLEAN PhpCreateProcessMiniDumpWithProgress(
     _In_ MINIDUMP_TYPE DumpType
     );
 
+static _PssCaptureSnapshot PssCaptureSnapshot_I = NULL;
+static _PssFreeSnapshot PssFreeSnapshot_I = NULL;
+
 INT_PTR CALLBACK PhpProcessMiniDumpDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -69,6 +129,13 @@ INT_PTR CALLBACK PhpProcessMiniDumpDlgProc(
     _In_ LPARAM lParam
     );
 
+INT_PTR CALLBACK PhpDumpBatchDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
 BOOLEAN PhUiCreateDumpFileProcess(
     _In_ HWND hWnd,
     _In_ PPH_PROCESS_ITEM Process
@@ -123,14 +190,23 @@ BOOLEAN PhpCreateProcessMiniDumpWithProgress(
     context.FileName = FileName;
     context.DumpType = DumpType;
 
-    if (!NT_SUCCESS(status = PhOpenProcess(
+    if (!(PhGetIntegerSetting(L"MiniDumpUseSnapshot") && PhpIsProcessSnapshotSupported() && NT_SUCCESS(PhOpenProcess(
         &context.ProcessHandle,
-        PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+        PH_DUMP_SNAPSHOT_PROCESS_ACCESS,
         ProcessId
-        )))
+        ))))
     {
-        PhShowStatus(hWnd, L"Unable to open the process", status, 0);
-        return FALSE;
+        context.ProcessHandle = NULL;
+
+        if (!NT_SUCCESS(status = PhOpenProcess(
+            &context.ProcessHandle,
+            PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+            ProcessId
+            )))
+        {
+            PhShowStatus(hWnd, L"Unable to open the process", status, 0);
+            return FALSE;
+        }
     }
 
 #ifdef _WIN64
@@ -168,6 +244,71 @@ BOOLEAN PhpCreateProcessMiniDumpWithProgress(
     return context.Succeeded;
 }
 
+static BOOLEAN PhpIsProcessSnapshotSupported(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PVOID kernel32 = GetModuleHandle(L"kernel32.dll");
+
+        // Process snapshots are only available on Windows 8.1 and above.
+        PssCaptureSnapshot_I = PhGetProcedureAddress(kernel32, "PssCaptureSnapshot", 0);
+        PssFreeSnapshot_I = PhGetProcedureAddress(kernel32, "PssFreeSnapshot", 0);
+
+        PhEndInitOnce(&initOnce);
+    }
+
+    return PssCaptureSnapshot_I && PssFreeSnapshot_I;
+}
+
+/**
+ * Clones a process so that a dump can be written without keeping the process suspended.
+ *
+ * \param ProcessHandle A handle to the process. The handle must have
+ * PH_DUMP_SNAPSHOT_PROCESS_ACCESS access.
+ * \param FreezeTime A variable which receives the time in milliseconds that the process
+ * was suspended for.
+ *
+ * \return A snapshot handle which must be freed using PssFreeSnapshot, or NULL on failure.
+ */
+static HPSS PhpCaptureProcessSnapshot(
+    _In_ HANDLE ProcessHandle,
+    _Out_opt_ PULONG FreezeTime
+    )
+{
+    HPSS snapshotHandle;
+    LARGE_INTEGER startCounter;
+    LARGE_INTEGER endCounter;
+    LARGE_INTEGER frequency;
+
+    if (!PhpIsProcessSnapshotSupported())
+        return NULL;
+
+    // The process is suspended only while its address space is cloned. The clone shares pages
+    // copy-on-write, so this takes far less time than writing the dump.
+    NtQueryPerformanceCounter(&startCounter, &frequency);
+
+    if (PssCaptureSnapshot_I(
+        ProcessHandle,
+        PH_DUMP_SNAPSHOT_CAPTURE_FLAGS,
+        CONTEXT_ALL,
+        &snapshotHandle
+        ) != ERROR_SUCCESS)
+    {
+        return NULL;
+    }
+
+    NtQueryPerformanceCounter(&endCounter, NULL);
+
+    if (FreezeTime)
+        *FreezeTime = (ULONG)((endCounter.QuadPart - startCounter.QuadPart) * 1000 / frequency.QuadPart);
+
+    return snapshotHandle;
+}
+
 static BOOL CALLBACK PhpProcessMiniDumpCallback(
     _In_ PVOID CallbackParam,
     _In_ const PMINIDUMP_CALLBACK_INPUT CallbackInput,
@@ -177,6 +318,15 @@ static BOOL CALLBACK PhpProcessMiniDumpCallback(
     PPROCESS_MINIDUMP_CONTEXT context = CallbackParam;
     PPH_STRING message = NULL;
 
+    if (CallbackInput->CallbackType == IsProcessSnapshotCallback)
+    {
+        // S_FALSE tells dbghelp that the handle is a PSS snapshot rather than a process.
+        if (context->IsSnapshot)
+            CallbackOutput->Status = S_FALSE;
+
+        return TRUE;
+    }
+
     // Don't try to send status updates if we're creating a dump of the current process.
     if (context->ProcessId == NtCurrentProcessId())
         return TRUE;
@@ -225,6 +375,8 @@ NTSTATUS PhpProcessMiniDumpThreadStart(
 {
     PPROCESS_MINIDUMP_CONTEXT context = Parameter;
     MINIDUMP_CALLBACK_INFORMATION callbackInfo;
+    HPSS snapshotHandle = NULL;
+    HANDLE dumpHandle;
 
     callbackInfo.CallbackRoutine = PhpProcessMiniDumpCallback;
     callbackInfo.CallbackParam = context;
@@ -304,8 +456,31 @@ NTSTATUS PhpProcessMiniDumpThreadStart(
     }
 #endif
 
+    dumpHandle = context->ProcessHandle;
+
+    if (PhGetIntegerSetting(L"MiniDumpUseSnapshot") &&
+        (snapshotHandle = PhpCaptureProcessSnapshot(context->ProcessHandle, &context->FreezeTime)))
+    {
+        PPH_STRING message;
+
+        dumpHandle = (HANDLE)snapshotHandle;
+        context->IsSnapshot = TRUE;
+
+        message = PhFormatString(
+            L"Creating the dump file (process suspended for %u ms)...",
+            context->FreezeTime
+            );
+        SendMessage(
+            context->WindowHandle,
+            WM_PH_MINIDUMP_STATUS_UPDATE,
+            PH_MINIDUMP_STATUS_UPDATE,
+            (LPARAM)message->Buffer
+            );
+        PhDereferenceObject(message);
+    }
+
     if (PhWriteMiniDumpProcess(
-        context->ProcessHandle,
+        dumpHandle,
         context->ProcessId,
         context->FileHandle,
         context->DumpType,
@@ -320,7 +495,7 @@ NTSTATUS PhpProcessMiniDumpThreadStart(
     {
         // We may have an old version of dbghelp - in that case, try using minimal dump flags.
         if (GetLastError() == HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER) && PhWriteMiniDumpProcess(
-            context->ProcessHandle,
+            dumpHandle,
             context->ProcessId,
             context->FileHandle,
             MiniDumpWithFullMemory | MiniDumpWithHandleData,
@@ -342,6 +517,9 @@ NTSTATUS PhpProcessMiniDumpThreadStart(
         }
     }
 
+    if (snapshotHandle)
+        PssFreeSnapshot_I(NtCurrentProcess(), snapshotHandle);
+
 #ifdef _WIN64
 Completed:
 #endif
@@ -429,8 +607,19 @@ INT_PTR CALLBACK PhpProcessMiniDumpDlgProc(
                 {
                     // No status message update for 2 seconds.
 
-                    SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT,
-                        (PWSTR)L"Creating the dump file...");
+                    if (context->IsSnapshot)
+                    {
+                        SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, PhaFormatString(
+                            L"Creating the dump file (process suspended for %u ms)...",
+                            context->FreezeTime
+                            )->Buffer);
+                    }
+                    else
+                    {
+                        SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT,
+                            (PWSTR)L"Creating the dump file...");
+                    }
+
                     InvalidateRect(GetDlgItem(hwndDlg, IDC_PROGRESSTEXT), NULL, FALSE);
 
                     context->LastTickCount = currentTickCount;
@@ -464,3 +653,500 @@ INT_PTR CALLBACK PhpProcessMiniDumpDlgProc(
 
     return FALSE;
 }
+
+static BOOL CALLBACK PhpDumpBatchMiniDumpCallback(
+    _In_ PVOID CallbackParam,
+    _In_ const PMINIDUMP_CALLBACK_INPUT CallbackInput,
+    _Inout_ PMINIDUMP_CALLBACK_OUTPUT CallbackOutput
+    )
+{
+    PPH_DUMP_BATCH_ITEM item = CallbackParam;
+
+    switch (CallbackInput->CallbackType)
+    {
+    case IsProcessSnapshotCallback:
+        {
+            // S_FALSE tells dbghelp that the handle is a PSS snapshot rather than a process.
+            if (item->IsSnapshot)
+                CallbackOutput->Status = S_FALSE;
+        }
+        break;
+    case CancelCallback:
+        {
+            if (item->Batch->Stop)
+                CallbackOutput->Cancel = TRUE;
+        }
+        break;
+    }
+
+    return TRUE;
+}
+
+static NTSTATUS PhpMiniDumpErrorToNtStatus(
+    _In_ ULONG Error
+    )
+{
+    // dbghelp reports most errors as HRESULTs.
+    if (HRESULT_FACILITY(Error) == FACILITY_WIN32)
+        Error = HRESULT_CODE(Error);
+
+    return PhDosErrorToNtStatus(Error);
+}
+
+static NTSTATUS PhpDumpBatchItemWorker(
+    _In_ PVOID Parameter
+    )
+{
+    NTSTATUS status;
+    PPH_DUMP_BATCH_ITEM item = Parameter;
+    PPH_DUMP_BATCH_CONTEXT batch = item->Batch;
+    HANDLE processHandle = NULL;
+    HANDLE fileHandle = NULL;
+    HPSS snapshotHandle = NULL;
+    BOOLEAN useSnapshot;
+    MINIDUMP_CALLBACK_INFORMATION callbackInfo;
+    IO_STATUS_BLOCK isb;
+
+    if (batch->Stop)
+    {
+        status = STATUS_CANCELLED;
+        goto CleanupExit;
+    }
+
+    useSnapshot = (batch->Flags & PH_DUMP_BATCH_USE_SNAPSHOT) && PhpIsProcessSnapshotSupported();
+
+    if (useSnapshot)
+    {
+        if (!NT_SUCCESS(PhOpenProcess(
+            &processHandle,
+            PH_DUMP_SNAPSHOT_PROCESS_ACCESS,
+            item->ProcessId
+            )))
+        {
+            processHandle = NULL;
+            useSnapshot = FALSE;
+        }
+    }
+
+    if (!processHandle)
+    {
+        if (!NT_SUCCESS(status = PhOpenProcess(
+            &processHandle,
+            PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+            item->ProcessId
+            )))
+            goto CleanupExit;
+    }
+
+    status = PhCreateFileWin32(
+        &fileHandle,
+        item->FileName->Buffer,
+        FILE_GENERIC_WRITE | DELETE,
+        0,
+        0,
+        FILE_OVERWRITE_IF,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+        goto CleanupExit;
+
+    if (batch->Flags & PH_DUMP_BATCH_COMPRESS)
+    {
+        USHORT compressionFormat = COMPRESSION_FORMAT_DEFAULT;
+
+        // Ignore failures; not every file system supports compression.
+        NtFsControlFile(
+            fileHandle,
+            NULL,
+            NULL,
+            NULL,
+            &isb,
+            FSCTL_SET_COMPRESSION,
+            &compressionFormat,
+            sizeof(USHORT),
+            NULL,
+            0
+            );
+    }
+
+    if (useSnapshot)
+        snapshotHandle = PhpCaptureProcessSnapshot(processHandle, NULL);
+
+    item->IsSnapshot = !!snapshotHandle;
+
+    callbackInfo.CallbackRoutine = PhpDumpBatchMiniDumpCallback;
+    callbackInfo.CallbackParam = item;
+
+    if (PhWriteMiniDumpProcess(
+        snapshotHandle ? (HANDLE)snapshotHandle : processHandle,
+        item->ProcessId,
+        fileHandle,
+        batch->DumpType,
+        NULL,
+        NULL,
+        &callbackInfo
+        ))
+    {
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        // We may have an old version of dbghelp - in that case, try using minimal dump flags.
+        if (GetLastError() == HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER) && PhWriteMiniDumpProcess(
+            snapshotHandle ? (HANDLE)snapshotHandle : processHandle,
+            item->ProcessId,
+            fileHandle,
+            MiniDumpWithFullMemory | MiniDumpWithHandleData,
+            NULL,
+            NULL,
+            &callbackInfo
+            ))
+        {
+            status = STATUS_SUCCESS;
+        }
+        else
+        {
+            status = batch->Stop ? STATUS_CANCELLED : PhpMiniDumpErrorToNtStatus(GetLastError());
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        FILE_DISPOSITION_INFORMATION dispositionInfo;
+
+        dispositionInfo.DeleteFile = TRUE;
+        NtSetInformationFile(
+            fileHandle,
+            &isb,
+            &dispositionInfo,
+            sizeof(FILE_DISPOSITION_INFORMATION),
+            FileDispositionInformation
+            );
+    }
+
+CleanupExit:
+    if (snapshotHandle)
+        PssFreeSnapshot_I(NtCurrentProcess(), snapshotHandle);
+    if (fileHandle)
+        NtClose(fileHandle);
+    if (processHandle)
+        NtClose(processHandle);
+
+    item->Status = status;
+    _InterlockedIncrement(&batch->NumberOfCompleted);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS PhpCreateDumpFilesBatch(
+    _Inout_ PPH_DUMP_BATCH_CONTEXT Batch
+    )
+{
+    NTSTATUS status;
+    PPH_DUMP_BATCH_ITEM items;
+    PVOID processes;
+    PSYSTEM_PROCESS_INFORMATION process;
+    LARGE_INTEGER currentTime;
+    SYSTEMTIME systemTime;
+    PPH_STRING timeString;
+    PH_STRINGREF directoryName;
+    PH_WORK_QUEUE workQueue;
+    ULONG i;
+
+    if (Batch->NumberOfProcesses == 0)
+        return STATUS_SUCCESS;
+
+    directoryName = *Batch->DirectoryName;
+
+    if (directoryName.Length != 0 && directoryName.Buffer[directoryName.Length / 2 - 1] == '\\')
+        directoryName.Length -= sizeof(WCHAR);
+
+    if (!NT_SUCCESS(PhEnumProcesses(&processes)))
+        processes = NULL;
+
+    // Use a single timestamp so that every dump from one batch sorts together.
+    PhQuerySystemTime(&currentTime);
+    PhLargeIntegerToLocalSystemTime(&systemTime, &currentTime);
+    timeString = PhFormatString(
+        L"%04u%02u%02u-%02u%02u%02u",
+        systemTime.wYear,
+        systemTime.wMonth,
+        systemTime.wDay,
+        systemTime.wHour,
+        systemTime.wMinute,
+        systemTime.wSecond
+        );
+
+    items = PhAllocate(sizeof(PH_DUMP_BATCH_ITEM) * Batch->NumberOfProcesses);
+    memset(items, 0, sizeof(PH_DUMP_BATCH_ITEM) * Batch->NumberOfProcesses);
+
+    for (i = 0; i < Batch->NumberOfProcesses; i++)
+    {
+        PH_STRINGREF imageName;
+
+        PhInitializeStringRef(&imageName, L"process");
+
+        if (processes && (process = PhFindProcessInformation(processes, Batch->ProcessIds[i])) && process->ImageName.Buffer)
+            PhUnicodeStringToStringRef(&process->ImageName, &imageName);
+
+        items[i].Batch = Batch;
+        items[i].ProcessId = Batch->ProcessIds[i];
+        items[i].FileName = PhFormatString(
+            L"%.*s\\%.*s_%u_%s.dmp",
+            (ULONG)(directoryName.Length / 2),
+            directoryName.Buffer,
+            (ULONG)(imageName.Length / 2),
+            imageName.Buffer,
+            HandleToUlong(Batch->ProcessIds[i]),
+            timeString->Buffer
+            );
+    }
+
+    if (processes)
+        PhFree(processes);
+
+    // Full memory dumps are limited by disk throughput, so only a few are written at a time.
+    PhInitializeWorkQueue(&workQueue, 0, max(Batch->MaximumConcurrentDumps, 1), 1000);
+
+    for (i = 0; i < Batch->NumberOfProcesses; i++)
+        PhQueueItemWorkQueue(&workQueue, PhpDumpBatchItemWorker, &items[i]);
+
+    PhWaitForWorkQueue(&workQueue);
+    PhDeleteWorkQueue(&workQueue);
+
+    status = STATUS_SUCCESS;
+
+    for (i = 0; i < Batch->NumberOfProcesses; i++)
+    {
+        if (Batch->Statuses)
+            Batch->Statuses[i] = items[i].Status;
+
+        if (NT_SUCCESS(status) && !NT_SUCCESS(items[i].Status))
+            status = items[i].Status;
+
+        PhDereferenceObject(items[i].FileName);
+    }
+
+    PhFree(items);
+    PhDereferenceObject(timeString);
+
+    return status;
+}
+
+/**
+ * Creates dump files for multiple processes concurrently.
+ *
+ * \param ProcessIds The processes to dump.
+ * \param NumberOfProcesses The number of elements in \a ProcessIds.
+ * \param DirectoryName The directory for the dump files. Each file is named
+ * <image name>_<process ID>_<timestamp>.dmp.
+ * \param MaximumConcurrentDumps The maximum number of dumps written at the same time.
+ * \param Flags A combination of the following:
+ * \li \c PH_DUMP_BATCH_USE_SNAPSHOT Dump a PSS snapshot of each process, if supported.
+ * \li \c PH_DUMP_BATCH_COMPRESS Enable NTFS compression on each dump file.
+ * \param Statuses An array which receives the status of each dump.
+ *
+ * \return The first failure, or STATUS_SUCCESS if every dump succeeded.
+ */
+NTSTATUS PhCreateDumpFilesProcesses(
+    _In_reads_(NumberOfProcesses) PHANDLE ProcessIds,
+    _In_ ULONG NumberOfProcesses,
+    _In_ PPH_STRINGREF DirectoryName,
+    _In_ ULONG MaximumConcurrentDumps,
+    _In_ ULONG Flags,
+    _Out_writes_opt_(NumberOfProcesses) PNTSTATUS Statuses
+    )
+{
+    PH_DUMP_BATCH_CONTEXT batch;
+
+    memset(&batch, 0, sizeof(PH_DUMP_BATCH_CONTEXT));
+    batch.ProcessIds = ProcessIds;
+    batch.NumberOfProcesses = NumberOfProcesses;
+    batch.DirectoryName = DirectoryName;
+    batch.MaximumConcurrentDumps = MaximumConcurrentDumps;
+    batch.Flags = Flags;
+    batch.DumpType = PH_DUMP_BATCH_DUMP_TYPE;
+    batch.Statuses = Statuses;
+
+    return PhpCreateDumpFilesBatch(&batch);
+}
+
+NTSTATUS PhpDumpBatchThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_DUMP_BATCH_CONTEXT context = Parameter;
+
+    context->Status = PhpCreateDumpFilesBatch(context);
+
+    SendMessage(
+        context->WindowHandle,
+        WM_PH_MINIDUMP_STATUS_UPDATE,
+        PH_MINIDUMP_COMPLETED,
+        0
+        );
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN PhUiCreateDumpFileProcesses(
+    _In_ HWND hWnd,
+    _In_ PPH_PROCESS_ITEM *Processes,
+    _In_ ULONG NumberOfProcesses
+    )
+{
+    PVOID fileDialog;
+    PPH_STRING directoryName;
+    PH_DUMP_BATCH_CONTEXT context;
+    ULONG i;
+
+    fileDialog = PhCreateOpenFileDialog();
+    PhSetFileDialogOptions(fileDialog, PH_FILEDIALOG_PICKFOLDERS | PH_FILEDIALOG_PATHMUSTEXIST);
+
+    if (!PhShowFileDialog(hWnd, fileDialog))
+    {
+        PhFreeFileDialog(fileDialog);
+        return FALSE;
+    }
+
+    directoryName = PhAutoDereferenceObject(PhGetFileDialogFileName(fileDialog));
+    PhFreeFileDialog(fileDialog);
+
+    memset(&context, 0, sizeof(PH_DUMP_BATCH_CONTEXT));
+    context.ProcessIds = PhAllocate(sizeof(HANDLE) * NumberOfProcesses);
+    context.NumberOfProcesses = NumberOfProcesses;
+    context.DirectoryName = &directoryName->sr;
+    context.MaximumConcurrentDumps = PH_DUMP_BATCH_DEFAULT_CONCURRENCY;
+    context.Flags = PH_DUMP_BATCH_USE_SNAPSHOT | PH_DUMP_BATCH_COMPRESS;
+    context.DumpType = PH_DUMP_BATCH_DUMP_TYPE;
+    context.Statuses = PhAllocate(sizeof(NTSTATUS) * NumberOfProcesses);
+    memset(context.Statuses, 0, sizeof(NTSTATUS) * NumberOfProcesses);
+
+    for (i = 0; i < NumberOfProcesses; i++)
+        context.ProcessIds[i] = Processes[i]->ProcessId;
+
+    DialogBoxParam(
+        PhInstanceHandle,
+        MAKEINTRESOURCE(IDD_PROGRESS),
+        hWnd,
+        PhpDumpBatchDlgProc,
+        (LPARAM)&context
+        );
+
+    for (i = 0; i < NumberOfProcesses; i++)
+    {
+        if (!NT_SUCCESS(context.Statuses[i]) && context.Statuses[i] != STATUS_CANCELLED)
+        {
+            if (!PhShowContinueStatus(
+                hWnd,
+                PhaFormatString(
+                    L"Unable to create a dump file for %s (%u)",
+                    Processes[i]->ProcessName->Buffer,
+                    HandleToUlong(Processes[i]->ProcessId)
+                    )->Buffer,
+                context.Statuses[i],
+                0
+                ))
+                break;
+        }
+    }
+
+    PhFree(context.Statuses);
+    PhFree(context.ProcessIds);
+
+    return NT_SUCCESS(context.Status);
+}
+
+INT_PTR CALLBACK PhpDumpBatchDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            PPH_DUMP_BATCH_CONTEXT context = (PPH_DUMP_BATCH_CONTEXT)lParam;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+            SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)context);
+
+            SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, L"Creating the dump files...");
+            SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETRANGE32, 0, context->NumberOfProcesses);
+
+            context->WindowHandle = hwndDlg;
+            context->ThreadHandle = PhCreateThread(0, PhpDumpBatchThreadStart, context);
+
+            if (!context->ThreadHandle)
+            {
+                PhShowStatus(hwndDlg, L"Unable to create the minidump thread", 0, GetLastError());
+                EndDialog(hwndDlg, IDCANCEL);
+            }
+
+            SetTimer(hwndDlg, 1, 500, NULL);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PPH_DUMP_BATCH_CONTEXT context;
+
+            context = (PPH_DUMP_BATCH_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+
+            if (context->ThreadHandle)
+                NtClose(context->ThreadHandle);
+
+            RemoveProp(hwndDlg, PhMakeContextAtom());
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+                {
+                    PPH_DUMP_BATCH_CONTEXT context =
+                        (PPH_DUMP_BATCH_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+
+                    EnableWindow(GetDlgItem(hwndDlg, IDCANCEL), FALSE);
+                    context->Stop = TRUE;
+                }
+                break;
+            }
+        }
+        break;
+    case WM_TIMER:
+        {
+            if (wParam == 1)
+            {
+                PPH_DUMP_BATCH_CONTEXT context =
+                    (PPH_DUMP_BATCH_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+                ULONG numberOfCompleted;
+
+                numberOfCompleted = context->NumberOfCompleted;
+
+                SetDlgItemText(hwndDlg, IDC_PROGRESSTEXT, PhaFormatString(
+                    L"Created %u of %u dump files...",
+                    numberOfCompleted,
+                    context->NumberOfProcesses
+                    )->Buffer);
+                SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETPOS, numberOfCompleted, 0);
+            }
+        }
+        break;
+    case WM_PH_MINIDUMP_STATUS_UPDATE:
+        {
+            switch (wParam)
+            {
+            case PH_MINIDUMP_COMPLETED:
+                EndDialog(hwndDlg, IDOK);
+                break;
+            }
+        }
+        break;
+    }
+
+    return FALSE;
+}
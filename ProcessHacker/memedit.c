@@ -44,11 +44,15 @@ typedef struct _MEMORY_EDITOR_CONTEXT
     HWND WindowHandle;
     PH_LAYOUT_MANAGER LayoutManager;
     HWND HexEditHandle;
-    PUCHAR Buffer;
     ULONG SelectOffset;
     PPH_STRING Title;
     ULONG Flags;
 
+    PPH_BYTES FindPattern;
+    PPH_BYTES FindMask;
+    ULONG FindOffset;
+    BOOLEAN FindMatchCase;
+
     BOOLEAN LoadCompleted;
 } MEMORY_EDITOR_CONTEXT, *PMEMORY_EDITOR_CONTEXT;
 
@@ -64,6 +68,20 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
     _In_ LPARAM lParam
     );
 
+NTSTATUS NTAPI PhpMemoryEditorReadCallback(
+    _In_ ULONG Offset,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    );
+
+NTSTATUS NTAPI PhpMemoryEditorWriteCallback(
+    _In_ ULONG Offset,
+    _In_reads_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    );
+
 PH_AVL_TREE PhMemoryEditorSet = PH_AVL_TREE_INIT(PhpMemoryEditorCompareFunction);
 static RECT MinimumSize = { -1, -1, -1, -1 };
 
@@ -150,6 +168,209 @@ INT NTAPI PhpMemoryEditorCompareFunction(
     return memcmp(context1->Key, context2->Key, sizeof(context1->Key));
 }
 
+NTSTATUS NTAPI PhpMemoryEditorReadCallback(
+    _In_ ULONG Offset,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    )
+{
+    PMEMORY_EDITOR_CONTEXT context = Context;
+
+    return PhReadVirtualMemory(
+        context->ProcessHandle,
+        PTR_ADD_OFFSET(context->BaseAddress, Offset),
+        Buffer,
+        Length,
+        NULL
+        );
+}
+
+NTSTATUS NTAPI PhpMemoryEditorWriteCallback(
+    _In_ ULONG Offset,
+    _In_reads_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    )
+{
+    PMEMORY_EDITOR_CONTEXT context = Context;
+
+    return PhWriteVirtualMemory(
+        context->ProcessHandle,
+        PTR_ADD_OFFSET(context->BaseAddress, Offset),
+        Buffer,
+        Length,
+        NULL
+        );
+}
+
+/**
+ * Parses a search pattern entered by the user.
+ *
+ * \param String The pattern. This is either a sequence of hex bytes in which \c ? stands for
+ * any nibble (e.g. "4d 5a ?? 00"), text in double quotes to search for ANSI text, or text in
+ * double quotes prefixed with \c u to search for UTF-16 text.
+ * \param MatchCase FALSE to match ASCII letters in text regardless of case, otherwise TRUE.
+ * \param Pattern A variable which receives the bytes to search for.
+ * \param Mask A variable which receives the mask for PhFindBytePattern.
+ *
+ * \return TRUE if the pattern is valid, otherwise FALSE.
+ */
+static BOOLEAN PhpParseMemoryEditorPattern(
+    _In_ PPH_STRINGREF String,
+    _In_ BOOLEAN MatchCase,
+    _Out_ PPH_BYTES *Pattern,
+    _Out_ PPH_BYTES *Mask
+    )
+{
+    static PH_STRINGREF whitespace = PH_STRINGREF_INIT(L" \t");
+    PH_STRINGREF string = *String;
+    PPH_BYTES pattern;
+    PPH_BYTES mask;
+    BOOLEAN unicode = FALSE;
+    SIZE_T i;
+
+    PhTrimStringRef(&string, &whitespace, 0);
+
+    if (string.Length >= 2 * sizeof(WCHAR) && (string.Buffer[0] == 'u' || string.Buffer[0] == 'U') && string.Buffer[1] == '"')
+    {
+        unicode = TRUE;
+        PhSkipStringRef(&string, sizeof(WCHAR));
+    }
+
+    if (string.Length != 0 && string.Buffer[0] == '"')
+    {
+        PhSkipStringRef(&string, sizeof(WCHAR));
+
+        if (string.Length != 0 && string.Buffer[string.Length / sizeof(WCHAR) - 1] == '"')
+            string.Length -= sizeof(WCHAR);
+        if (string.Length == 0)
+            return FALSE;
+
+        if (unicode)
+            pattern = PhCreateBytesEx((PCHAR)string.Buffer, string.Length);
+        else if (!(pattern = PhConvertUtf16ToMultiByteEx(string.Buffer, string.Length)))
+            return FALSE;
+
+        mask = PhCreateBytesEx(NULL, pattern->Length);
+
+        // Clearing bit 5 folds the case of ASCII letters and of nothing else.
+        for (i = 0; i < pattern->Length; i++)
+        {
+            CHAR c = pattern->Buffer[i];
+
+            if (!MatchCase && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+                mask->Buffer[i] = (CHAR)0xdf;
+            else
+                mask->Buffer[i] = (CHAR)0xff;
+        }
+
+        if (unicode)
+        {
+            // Only the low byte of a UTF-16 character can be an ASCII letter.
+            for (i = 1; i < pattern->Length; i += 2)
+                mask->Buffer[i] = (CHAR)0xff;
+        }
+    }
+    else
+    {
+        SIZE_T numberOfDigits = 0;
+
+        pattern = PhCreateBytesEx(NULL, (string.Length / sizeof(WCHAR) + 1) / 2);
+        mask = PhCreateBytesEx(NULL, (string.Length / sizeof(WCHAR) + 1) / 2);
+
+        for (i = 0; i < string.Length / sizeof(WCHAR); i++)
+        {
+            WCHAR c = string.Buffer[i];
+            UCHAR value;
+            UCHAR digitMask;
+
+            if (c == ' ' || c == '\t')
+                continue;
+
+            if (c == '?')
+            {
+                value = 0;
+                digitMask = 0;
+            }
+            else if (c < 0x80 && PhCharToInteger[c] < 16)
+            {
+                value = (UCHAR)PhCharToInteger[c];
+                digitMask = 0xf;
+            }
+            else
+            {
+                PhDereferenceObject(pattern);
+                PhDereferenceObject(mask);
+                return FALSE;
+            }
+
+            if (numberOfDigits % 2 == 0)
+            {
+                pattern->Buffer[numberOfDigits / 2] = value << 4;
+                mask->Buffer[numberOfDigits / 2] = digitMask << 4;
+            }
+            else
+            {
+                pattern->Buffer[numberOfDigits / 2] |= value;
+                mask->Buffer[numberOfDigits / 2] |= digitMask;
+            }
+
+            numberOfDigits++;
+        }
+
+        if (numberOfDigits == 0 || numberOfDigits % 2 != 0)
+        {
+            PhDereferenceObject(pattern);
+            PhDereferenceObject(mask);
+            return FALSE;
+        }
+
+        pattern->Length = numberOfDigits / 2;
+        mask->Length = numberOfDigits / 2;
+    }
+
+    *Pattern = pattern;
+    *Mask = mask;
+
+    return TRUE;
+}
+
+static VOID PhpMemoryEditorFindNext(
+    _In_ HWND hwndDlg,
+    _In_ PMEMORY_EDITOR_CONTEXT Context
+    )
+{
+    PH_HEXEDIT_FIND find;
+    HCURSOR oldCursor;
+    BOOLEAN found;
+
+    find.Pattern = Context->FindPattern->Buffer;
+    find.Mask = Context->FindMask->Buffer;
+    find.Length = (ULONG)Context->FindPattern->Length;
+    find.StartOffset = Context->FindOffset;
+
+    oldCursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+    found = HexEdit_Find(Context->HexEditHandle, &find);
+    SetCursor(oldCursor);
+
+    if (found)
+    {
+        // The next search starts just after the start of this match.
+        Context->FindOffset = find.Offset + 1;
+
+        SendMessage(hwndDlg, WM_NEXTDLGCTL, (WPARAM)Context->HexEditHandle, TRUE);
+        HexEdit_SetSel(Context->HexEditHandle, (LONG)find.Offset, (LONG)(find.Offset + find.Length));
+    }
+    else
+    {
+        // Wrap around on the next search.
+        Context->FindOffset = 0;
+
+        PhShowInformation(hwndDlg, L"The pattern was not found.");
+    }
+}
+
 INT_PTR CALLBACK PhpMemoryEditorDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -177,6 +398,8 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
     case WM_INITDIALOG:
         {
             NTSTATUS status;
+            UCHAR firstByte;
+            PH_HEXEDIT_PROVIDER provider;
 
             if (context->Title)
             {
@@ -197,7 +420,8 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
 
             PhInitializeLayoutManager(&context->LayoutManager, hwndDlg);
 
-            if (context->RegionSize > 1024 * 1024 * 1024) // 1 GB
+            // Pages are read on demand, so only the hex editor's LONG offsets limit the size.
+            if (context->RegionSize > MAXLONG)
             {
                 PhShowError(NULL, L"Unable to edit the memory region because it is too large.");
                 return TRUE;
@@ -220,19 +444,11 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
                 }
             }
 
-            context->Buffer = PhAllocatePage(context->RegionSize, NULL);
-
-            if (!context->Buffer)
-            {
-                PhShowError(NULL, L"Unable to allocate memory for the buffer.");
-                return TRUE;
-            }
-
             if (!NT_SUCCESS(status = PhReadVirtualMemory(
                 context->ProcessHandle,
                 context->BaseAddress,
-                context->Buffer,
-                context->RegionSize,
+                &firstByte,
+                sizeof(UCHAR),
                 NULL
                 )))
             {
@@ -248,6 +464,10 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
                 PH_ANCHOR_BOTTOM | PH_ANCHOR_LEFT);
             PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_GOTO), NULL,
                 PH_ANCHOR_BOTTOM | PH_ANCHOR_LEFT);
+            PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_FIND), NULL,
+                PH_ANCHOR_BOTTOM | PH_ANCHOR_LEFT);
+            PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_FINDNEXT), NULL,
+                PH_ANCHOR_BOTTOM | PH_ANCHOR_LEFT);
             PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_WRITE), NULL,
                 PH_ANCHOR_BOTTOM | PH_ANCHOR_LEFT);
             PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_REREAD), NULL,
@@ -268,7 +488,10 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
 
             context->HexEditHandle = GetDlgItem(hwndDlg, IDC_MEMORY);
             PhAddLayoutItem(&context->LayoutManager, context->HexEditHandle, NULL, PH_ANCHOR_ALL);
-            HexEdit_SetBuffer(context->HexEditHandle, context->Buffer, (ULONG)context->RegionSize);
+            provider.Read = PhpMemoryEditorReadCallback;
+            provider.Write = PhpMemoryEditorWriteCallback;
+            provider.Context = context;
+            HexEdit_SetProvider(context->HexEditHandle, &provider, (ULONG)context->RegionSize);
 
             {
                 PH_RECTANGLE windowRectangle;
@@ -325,9 +548,13 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
 
             PhDeleteLayoutManager(&context->LayoutManager);
 
-            if (context->Buffer) PhFreePage(context->Buffer);
+            // Detach the provider before closing the process handle, since pages may still be
+            // prefetched.
+            if (context->HexEditHandle) HexEdit_SetProvider(context->HexEditHandle, NULL, 0);
             if (context->ProcessHandle) NtClose(context->ProcessHandle);
             PhClearReference(&context->Title);
+            PhClearReference(&context->FindPattern);
+            PhClearReference(&context->FindMask);
 
             if ((context->Flags & PH_MEMORY_EDITOR_UNMAP_VIEW_OF_SECTION) && context->ProcessId == NtCurrentProcessId())
                 NtUnmapViewOfSection(NtCurrentProcess(), context->BaseAddress);
@@ -389,10 +616,34 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
                             FILE_GENERIC_WRITE,
                             FILE_SHARE_READ,
                             FILE_OVERWRITE_IF,
-                            0
+                            PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING
                             )))
                         {
-                            status = PhWriteFileStream(fileStream, context->Buffer, (ULONG)context->RegionSize);
+                            PH_HEXEDIT_DATA data;
+                            PUCHAR buffer;
+
+                            // Go through the hex editor so that unwritten changes are saved too.
+                            buffer = PhAllocatePage(PAGE_SIZE * 16, NULL);
+                            data.Buffer = buffer;
+
+                            if (buffer)
+                            {
+                                for (data.Offset = 0; data.Offset < (ULONG)context->RegionSize; data.Offset += data.Length)
+                                {
+                                    data.Length = min((ULONG)context->RegionSize - data.Offset, PAGE_SIZE * 16);
+                                    HexEdit_ReadData(context->HexEditHandle, &data);
+
+                                    if (!NT_SUCCESS(status = PhWriteFileStream(fileStream, buffer, data.Length)))
+                                        break;
+                                }
+
+                                PhFreePage(buffer);
+                            }
+                            else
+                            {
+                                status = STATUS_NO_MEMORY;
+                            }
+
                             PhDereferenceObject(fileStream);
                         }
 
@@ -440,38 +691,64 @@ INT_PTR CALLBACK PhpMemoryEditorDlgProc(
                     }
                 }
                 break;
-            case IDC_WRITE:
+            case IDC_FIND:
                 {
-                    NTSTATUS status;
+                    PPH_STRING selectedChoice = NULL;
 
-                    if (!NT_SUCCESS(status = PhWriteVirtualMemory(
-                        context->ProcessHandle,
-                        context->BaseAddress,
-                        context->Buffer,
-                        context->RegionSize,
-                        NULL
-                        )))
+                    while (PhaChoiceDialog(
+                        hwndDlg,
+                        L"Find",
+                        L"Enter hex bytes (use ? for any digit), \"ANSI text\" or u\"UTF-16 text\":",
+                        NULL,
+                        0,
+                        L"Match case",
+                        PH_CHOICE_DIALOG_USER_CHOICE,
+                        &selectedChoice,
+                        &context->FindMatchCase,
+                        L"MemEditFindChoices"
+                        ))
                     {
-                        PhShowStatus(hwndDlg, L"Unable to write memory", status, 0);
+                        PPH_BYTES pattern;
+                        PPH_BYTES mask;
+
+                        if (selectedChoice->Length == 0)
+                            continue;
+
+                        if (PhpParseMemoryEditorPattern(&selectedChoice->sr, context->FindMatchCase, &pattern, &mask))
+                        {
+                            PhMoveReference(&context->FindPattern, pattern);
+                            PhMoveReference(&context->FindMask, mask);
+                            context->FindOffset = 0;
+                            PhpMemoryEditorFindNext(hwndDlg, context);
+                            break;
+                        }
+
+                        PhShowError(hwndDlg, L"The pattern is invalid.");
                     }
                 }
                 break;
-            case IDC_REREAD:
+            case IDC_FINDNEXT:
+                {
+                    if (context->FindPattern)
+                        PhpMemoryEditorFindNext(hwndDlg, context);
+                    else
+                        SendMessage(hwndDlg, WM_COMMAND, IDC_FIND, 0);
+                }
+                break;
+            case IDC_WRITE:
                 {
                     NTSTATUS status;
 
-                    if (!NT_SUCCESS(status = PhReadVirtualMemory(
-                        context->ProcessHandle,
-                        context->BaseAddress,
-                        context->Buffer,
-                        context->RegionSize,
-                        NULL
-                        )))
+                    if (!NT_SUCCESS(status = HexEdit_Flush(context->HexEditHandle)))
                     {
-                        PhShowStatus(hwndDlg, L"Unable to read memory", status, 0);
+                        PhShowStatus(hwndDlg, L"Unable to write memory", status, 0);
                     }
-
-                    InvalidateRect(context->HexEditHandle, NULL, TRUE);
+                }
+                break;
+            case IDC_REREAD:
+                {
+                    // Discards unwritten changes; pages are read again as they are shown.
+                    HexEdit_Discard(context->HexEditHandle);
                 }
                 break;
             case IDC_BYTESPERROW:
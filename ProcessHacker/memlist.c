@@ -220,11 +220,10 @@ VOID PhpDestroyMemoryNode(
 
 PPH_MEMORY_NODE PhpAddAllocationBaseNode(
     _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
-    _In_ PVOID AllocationBase
+    _In_ PPH_MEMORY_ITEM MemoryItem
     )
 {
     PPH_MEMORY_NODE memoryNode;
-    PPH_MEMORY_ITEM memoryItem;
 
     memoryNode = PhAllocate(PhEmGetObjectSize(EmMemoryNodeType, sizeof(PH_MEMORY_NODE)));
     memset(memoryNode, 0, sizeof(PH_MEMORY_NODE));
@@ -232,11 +231,7 @@ PPH_MEMORY_NODE PhpAddAllocationBaseNode(
     memoryNode->Node.Expanded = FALSE;
 
     memoryNode->IsAllocationBase = TRUE;
-    memoryItem = PhCreateMemoryItem();
-    memoryNode->MemoryItem = memoryItem;
-
-    memoryItem->BaseAddress = AllocationBase;
-    memoryItem->AllocationBase = AllocationBase;
+    memoryNode->MemoryItem = MemoryItem; // Takes ownership of the item
 
     memoryNode->Children = PhCreateList(1);
 
@@ -296,81 +291,353 @@ VOID PhpCopyMemoryRegionTypeInfo(
         PhReferenceObject(Destination->u.MappedFile.FileName);
 }
 
-VOID PhReplaceMemoryList(
+static int __cdecl PhpMemoryNodeBaseAddressCompareFunction(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_MEMORY_NODE node1 = *(PPH_MEMORY_NODE *)elem1;
+    PPH_MEMORY_NODE node2 = *(PPH_MEMORY_NODE *)elem2;
+
+    return uintptrcmp((ULONG_PTR)node1->MemoryItem->BaseAddress, (ULONG_PTR)node2->MemoryItem->BaseAddress);
+}
+
+BOOLEAN PhpIsMemoryItemEqual(
+    _In_ PPH_MEMORY_ITEM MemoryItem1,
+    _In_ PPH_MEMORY_ITEM MemoryItem2
+    )
+{
+    if (MemoryItem1->BaseAddress != MemoryItem2->BaseAddress ||
+        MemoryItem1->AllocationBase != MemoryItem2->AllocationBase ||
+        MemoryItem1->AllocationProtect != MemoryItem2->AllocationProtect ||
+        MemoryItem1->RegionSize != MemoryItem2->RegionSize ||
+        MemoryItem1->State != MemoryItem2->State ||
+        MemoryItem1->Protect != MemoryItem2->Protect ||
+        MemoryItem1->Type != MemoryItem2->Type ||
+        MemoryItem1->CommittedSize != MemoryItem2->CommittedSize ||
+        MemoryItem1->PrivateSize != MemoryItem2->PrivateSize ||
+        MemoryItem1->TotalWorkingSetPages != MemoryItem2->TotalWorkingSetPages ||
+        MemoryItem1->PrivateWorkingSetPages != MemoryItem2->PrivateWorkingSetPages ||
+        MemoryItem1->SharedWorkingSetPages != MemoryItem2->SharedWorkingSetPages ||
+        MemoryItem1->ShareableWorkingSetPages != MemoryItem2->ShareableWorkingSetPages ||
+        MemoryItem1->LockedWorkingSetPages != MemoryItem2->LockedWorkingSetPages ||
+        MemoryItem1->RegionType != MemoryItem2->RegionType)
+    {
+        return FALSE;
+    }
+
+    switch (MemoryItem1->RegionType)
+    {
+    case CustomRegion:
+        return MemoryItem1->u.Custom.PropertyOfAllocationBase == MemoryItem2->u.Custom.PropertyOfAllocationBase &&
+            PhEqualString(MemoryItem1->u.Custom.Text, MemoryItem2->u.Custom.Text, FALSE);
+    case MappedFileRegion:
+        return PhEqualString(MemoryItem1->u.MappedFile.FileName, MemoryItem2->u.MappedFile.FileName, FALSE);
+    case TebRegion:
+    case Teb32Region:
+        return MemoryItem1->u.Teb.ThreadId == MemoryItem2->u.Teb.ThreadId;
+    case StackRegion:
+    case Stack32Region:
+        return MemoryItem1->u.Stack.ThreadId == MemoryItem2->u.Stack.ThreadId;
+    case HeapRegion:
+    case Heap32Region:
+        return MemoryItem1->u.Heap.Index == MemoryItem2->u.Heap.Index;
+    case HeapSegmentRegion:
+    case HeapSegment32Region:
+        return MemoryItem1->u.HeapSegment.HeapItem->u.Heap.Index == MemoryItem2->u.HeapSegment.HeapItem->u.Heap.Index;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN PhpSetMemoryNodeItem(
+    _Inout_ PPH_MEMORY_NODE MemoryNode,
+    _In_ PPH_MEMORY_ITEM MemoryItem,
+    _Inout_ PPH_LIST OldMemoryItems
+    )
+{
+    BOOLEAN changed;
+
+    if (MemoryNode->MemoryItem == MemoryItem)
+        return FALSE;
+
+    changed = !PhpIsMemoryItemEqual(MemoryNode->MemoryItem, MemoryItem);
+
+    // The old item may still be pointed to by other old items (e.g. heap segments), so we
+    // only release it once the whole list has been merged.
+    PhAddItemList(OldMemoryItems, MemoryNode->MemoryItem);
+    MemoryNode->MemoryItem = MemoryItem;
+
+    // Allocation base nodes own their (private) item; region nodes share theirs with the list.
+    if (!MemoryNode->IsAllocationBase)
+        PhReferenceObject(MemoryItem);
+
+    if (changed)
+        PhClearReference(&MemoryNode->UseText);
+
+    return changed;
+}
+
+BOOLEAN PhpSetMemoryNodeVisible(
+    _In_ PPH_MEMORY_LIST_CONTEXT Context,
+    _Inout_ PPH_MEMORY_NODE MemoryNode
+    )
+{
+    BOOLEAN visible;
+
+    visible = !(Context->HideFreeRegions && (MemoryNode->MemoryItem->State & MEM_FREE));
+
+    if (MemoryNode->Node.Visible == visible)
+        return FALSE;
+
+    MemoryNode->Node.Visible = visible;
+
+    if (!visible)
+        MemoryNode->Node.Selected = FALSE;
+
+    return TRUE;
+}
+
+BOOLEAN PhpCompleteAllocationBaseNode(
+    _In_ PPH_MEMORY_LIST_CONTEXT Context,
+    _Inout_ PPH_MEMORY_NODE AllocationBaseNode,
+    _In_ PPH_MEMORY_ITEM AllocationBaseItem,
+    _Inout_ PPH_LIST OldMemoryItems,
+    _Inout_ PBOOLEAN StructureChanged
+    )
+{
+    BOOLEAN changed;
+
+    changed = PhpSetMemoryNodeItem(AllocationBaseNode, AllocationBaseItem, OldMemoryItems);
+
+    if (PhpSetMemoryNodeVisible(Context, AllocationBaseNode))
+        *StructureChanged = TRUE;
+
+    if (changed)
+        PhUpdateMemoryNode(Context, AllocationBaseNode);
+    else
+        PhGetMemoryProtectionString(AllocationBaseItem->Protect, AllocationBaseNode->ProtectionText);
+
+    return changed;
+}
+
+/**
+ * Merges a new memory item list into the tree.
+ *
+ * \param Context The memory list context.
+ * \param List The new memory item list, in address order.
+ * \param ContentsChanged A variable which receives whether the contents of any existing node
+ * changed.
+ *
+ * \return TRUE if nodes were added, removed, moved or hidden and the tree must be restructured,
+ * otherwise FALSE.
+ *
+ * \remarks Existing nodes are matched to the new items by base address and kept, along with their
+ * selection and expansion state. Nodes that did not change are not invalidated.
+ */
+BOOLEAN PhpMergeMemoryList(
     _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
-    _In_opt_ PPH_MEMORY_ITEM_LIST List
+    _In_ PPH_MEMORY_ITEM_LIST List,
+    _Out_ PBOOLEAN ContentsChanged
     )
 {
+    PPH_LIST oldAllocationBaseNodes;
+    PPH_LIST oldRegionNodes;
+    PPH_LIST removedNodes;
+    PPH_LIST oldMemoryItems;
+    ULONG allocationBaseIndex = 0;
+    ULONG regionIndex = 0;
+    ULONG i;
     PLIST_ENTRY listEntry;
     PPH_MEMORY_NODE allocationBaseNode = NULL;
+    PPH_MEMORY_ITEM allocationBaseItem = NULL;
+    BOOLEAN structureChanged = FALSE;
+    BOOLEAN contentsChanged = FALSE;
 
-    PhpClearMemoryList(Context);
+    oldAllocationBaseNodes = Context->AllocationBaseNodeList;
+    oldRegionNodes = Context->RegionNodeList;
+    Context->AllocationBaseNodeList = PhCreateList(max(oldAllocationBaseNodes->Count, 100));
+    Context->RegionNodeList = PhCreateList(max(oldRegionNodes->Count, 400));
+    removedNodes = PhCreateList(16);
+    oldMemoryItems = PhCreateList(oldAllocationBaseNodes->Count + oldRegionNodes->Count);
 
-    if (!List)
-    {
-        TreeNew_NodesStructured(Context->TreeNewHandle);
-        return;
-    }
+    // The region node list is re-ordered whenever the tree is sorted.
+    qsort(oldRegionNodes->Items, oldRegionNodes->Count, sizeof(PVOID), PhpMemoryNodeBaseAddressCompareFunction);
 
     for (listEntry = List->ListHead.Flink; listEntry != &List->ListHead; listEntry = listEntry->Flink)
     {
         PPH_MEMORY_ITEM memoryItem = CONTAINING_RECORD(listEntry, PH_MEMORY_ITEM, ListEntry);
         PPH_MEMORY_NODE memoryNode;
+        PPH_MEMORY_NODE parentNode;
+        BOOLEAN changed;
 
         if (memoryItem->AllocationBaseItem == memoryItem)
-            allocationBaseNode = PhpAddAllocationBaseNode(Context, memoryItem->AllocationBase);
+        {
+            if (allocationBaseNode)
+                contentsChanged |= PhpCompleteAllocationBaseNode(Context, allocationBaseNode, allocationBaseItem, oldMemoryItems, &structureChanged);
+
+            while (allocationBaseIndex < oldAllocationBaseNodes->Count &&
+                (ULONG_PTR)((PPH_MEMORY_NODE)oldAllocationBaseNodes->Items[allocationBaseIndex])->MemoryItem->BaseAddress <
+                (ULONG_PTR)memoryItem->AllocationBase)
+            {
+                PhAddItemList(removedNodes, oldAllocationBaseNodes->Items[allocationBaseIndex++]);
+                structureChanged = TRUE;
+            }
+
+            allocationBaseItem = PhCreateMemoryItem();
+            allocationBaseItem->BaseAddress = memoryItem->AllocationBase;
+            allocationBaseItem->AllocationBase = memoryItem->AllocationBase;
+
+            if (allocationBaseIndex < oldAllocationBaseNodes->Count &&
+                ((PPH_MEMORY_NODE)oldAllocationBaseNodes->Items[allocationBaseIndex])->MemoryItem->BaseAddress == memoryItem->AllocationBase)
+            {
+                allocationBaseNode = oldAllocationBaseNodes->Items[allocationBaseIndex++];
+                PhClearList(allocationBaseNode->Children);
+                PhAddItemList(Context->AllocationBaseNodeList, allocationBaseNode);
+            }
+            else
+            {
+                allocationBaseNode = PhpAddAllocationBaseNode(Context, allocationBaseItem);
+                structureChanged = TRUE;
+            }
+        }
+
+        while (regionIndex < oldRegionNodes->Count &&
+            (ULONG_PTR)((PPH_MEMORY_NODE)oldRegionNodes->Items[regionIndex])->MemoryItem->BaseAddress <
+            (ULONG_PTR)memoryItem->BaseAddress)
+        {
+            PhAddItemList(removedNodes, oldRegionNodes->Items[regionIndex++]);
+            structureChanged = TRUE;
+        }
 
-        memoryNode = PhpAddRegionNode(Context, memoryItem);
+        if (regionIndex < oldRegionNodes->Count &&
+            ((PPH_MEMORY_NODE)oldRegionNodes->Items[regionIndex])->MemoryItem->BaseAddress == memoryItem->BaseAddress)
+        {
+            memoryNode = oldRegionNodes->Items[regionIndex++];
+            PhAddItemList(Context->RegionNodeList, memoryNode);
+        }
+        else
+        {
+            memoryNode = PhpAddRegionNode(Context, memoryItem);
+            structureChanged = TRUE;
+        }
 
-        if (Context->HideFreeRegions && (memoryItem->State & MEM_FREE))
-            memoryNode->Node.Visible = FALSE;
+        parentNode = NULL;
 
-        if (allocationBaseNode && memoryItem->AllocationBase == allocationBaseNode->MemoryItem->BaseAddress)
+        if (allocationBaseNode && memoryItem->AllocationBase == allocationBaseItem->BaseAddress)
         {
             if (!(memoryItem->State & MEM_FREE))
             {
-                memoryNode->Parent = allocationBaseNode;
+                parentNode = allocationBaseNode;
                 PhAddItemList(allocationBaseNode->Children, memoryNode);
             }
 
             // Aggregate various statistics.
-            allocationBaseNode->MemoryItem->RegionSize += memoryItem->RegionSize;
-            allocationBaseNode->MemoryItem->CommittedSize += memoryItem->CommittedSize;
-            allocationBaseNode->MemoryItem->PrivateSize += memoryItem->PrivateSize;
-            allocationBaseNode->MemoryItem->TotalWorkingSetPages += memoryItem->TotalWorkingSetPages;
-            allocationBaseNode->MemoryItem->PrivateWorkingSetPages += memoryItem->PrivateWorkingSetPages;
-            allocationBaseNode->MemoryItem->SharedWorkingSetPages += memoryItem->SharedWorkingSetPages;
-            allocationBaseNode->MemoryItem->ShareableWorkingSetPages += memoryItem->ShareableWorkingSetPages;
-            allocationBaseNode->MemoryItem->LockedWorkingSetPages += memoryItem->LockedWorkingSetPages;
+            allocationBaseItem->RegionSize += memoryItem->RegionSize;
+            allocationBaseItem->CommittedSize += memoryItem->CommittedSize;
+            allocationBaseItem->PrivateSize += memoryItem->PrivateSize;
+            allocationBaseItem->TotalWorkingSetPages += memoryItem->TotalWorkingSetPages;
+            allocationBaseItem->PrivateWorkingSetPages += memoryItem->PrivateWorkingSetPages;
+            allocationBaseItem->SharedWorkingSetPages += memoryItem->SharedWorkingSetPages;
+            allocationBaseItem->ShareableWorkingSetPages += memoryItem->ShareableWorkingSetPages;
+            allocationBaseItem->LockedWorkingSetPages += memoryItem->LockedWorkingSetPages;
 
             if (memoryItem->AllocationBaseItem == memoryItem)
             {
                 if (memoryItem->State & MEM_FREE)
-                    allocationBaseNode->MemoryItem->State = MEM_FREE;
+                    allocationBaseItem->State = MEM_FREE;
 
-                allocationBaseNode->MemoryItem->Protect = memoryItem->AllocationProtect;
-                PhGetMemoryProtectionString(allocationBaseNode->MemoryItem->Protect, allocationBaseNode->ProtectionText);
-                allocationBaseNode->MemoryItem->Type = memoryItem->Type;
+                allocationBaseItem->Protect = memoryItem->AllocationProtect;
+                allocationBaseItem->Type = memoryItem->Type;
 
                 if (memoryItem->RegionType != CustomRegion || memoryItem->u.Custom.PropertyOfAllocationBase)
-                    PhpCopyMemoryRegionTypeInfo(memoryItem, allocationBaseNode->MemoryItem);
-
-                if (Context->HideFreeRegions && (allocationBaseNode->MemoryItem->State & MEM_FREE))
-                    allocationBaseNode->Node.Visible = FALSE;
+                    PhpCopyMemoryRegionTypeInfo(memoryItem, allocationBaseItem);
             }
             else
             {
                 if (memoryItem->RegionType == UnknownRegion)
-                    PhpCopyMemoryRegionTypeInfo(allocationBaseNode->MemoryItem, memoryItem);
+                    PhpCopyMemoryRegionTypeInfo(allocationBaseItem, memoryItem);
             }
         }
 
-        PhGetMemoryProtectionString(memoryItem->Protect, memoryNode->ProtectionText);
+        if (memoryNode->Parent != parentNode)
+        {
+            memoryNode->Parent = parentNode;
+            structureChanged = TRUE;
+        }
+
+        changed = PhpSetMemoryNodeItem(memoryNode, memoryItem, oldMemoryItems);
+
+        if (PhpSetMemoryNodeVisible(Context, memoryNode))
+            structureChanged = TRUE;
+
+        if (changed)
+        {
+            PhUpdateMemoryNode(Context, memoryNode);
+            contentsChanged = TRUE;
+        }
+        else
+        {
+            PhGetMemoryProtectionString(memoryItem->Protect, memoryNode->ProtectionText);
+        }
     }
 
+    if (allocationBaseNode)
+        contentsChanged |= PhpCompleteAllocationBaseNode(Context, allocationBaseNode, allocationBaseItem, oldMemoryItems, &structureChanged);
+
+    if (allocationBaseIndex < oldAllocationBaseNodes->Count || regionIndex < oldRegionNodes->Count)
+        structureChanged = TRUE;
+
+    for (i = allocationBaseIndex; i < oldAllocationBaseNodes->Count; i++)
+        PhAddItemList(removedNodes, oldAllocationBaseNodes->Items[i]);
+    for (i = regionIndex; i < oldRegionNodes->Count; i++)
+        PhAddItemList(removedNodes, oldRegionNodes->Items[i]);
+
+    for (i = 0; i < removedNodes->Count; i++)
+        PhpDestroyMemoryNode(removedNodes->Items[i]);
+    for (i = 0; i < oldMemoryItems->Count; i++)
+        PhDereferenceObject(oldMemoryItems->Items[i]);
+
+    PhDereferenceObject(removedNodes);
+    PhDereferenceObject(oldMemoryItems);
+    PhDereferenceObject(oldAllocationBaseNodes);
+    PhDereferenceObject(oldRegionNodes);
+
+    *ContentsChanged = contentsChanged;
+
+    return structureChanged;
+}
+
+VOID PhReplaceMemoryList(
+    _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
+    _In_opt_ PPH_MEMORY_ITEM_LIST List
+    )
+{
+    BOOLEAN contentsChanged;
+
+    PhpClearMemoryList(Context);
+
+    if (List)
+        PhpMergeMemoryList(Context, List, &contentsChanged);
+
     TreeNew_NodesStructured(Context->TreeNewHandle);
 }
 
+VOID PhUpdateMemoryList(
+    _Inout_ PPH_MEMORY_LIST_CONTEXT Context,
+    _In_ PPH_MEMORY_ITEM_LIST List
+    )
+{
+    BOOLEAN structureChanged;
+    BOOLEAN contentsChanged;
+
+    structureChanged = PhpMergeMemoryList(Context, List, &contentsChanged);
+
+    // Changed values can move nodes around when the tree is sorted.
+    if (structureChanged || (contentsChanged && Context->TreeNewSortOrder != NoSortOrder))
+        TreeNew_NodesStructured(Context->TreeNewHandle);
+}
+
 VOID PhUpdateMemoryNode(
     _In_ PPH_MEMORY_LIST_CONTEXT Context,
     _In_ PPH_MEMORY_NODE MemoryNode
@@ -24,20 +24,29 @@
 #include <heapstruct.h>
 
 #define MAX_HEAPS 1000
-#define WS_REQUEST_COUNT (PAGE_SIZE / sizeof(MEMORY_WORKING_SET_EX_INFORMATION))
+#define WS_BATCH_COUNT (64 * PAGE_SIZE / sizeof(MEMORY_WORKING_SET_EX_INFORMATION))
+#define MEMORY_SNAPSHOT_CHUNK_SIZE (64 * 1024)
+#define MEMORY_SNAPSHOT_BATCH_COUNT 16
 
 VOID PhpMemoryItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
     );
 
+VOID PhpMemorySnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
 PPH_OBJECT_TYPE PhMemoryItemType;
+static PPH_OBJECT_TYPE PhpMemorySnapshotType;
 
 BOOLEAN PhMemoryProviderInitialization(
     VOID
     )
 {
     PhMemoryItemType = PhCreateObjectType(L"MemoryItem", 0, PhpMemoryItemDeleteProcedure);
+    PhpMemorySnapshotType = PhCreateObjectType(L"MemorySnapshot", 0, PhpMemorySnapshotDeleteProcedure);
 
     return TRUE;
 }
@@ -368,63 +377,120 @@ NTSTATUS PhpUpdateMemoryRegionTypes(
     }
 
     // TEB, stack
-    for (i = 0; i < process->NumberOfThreads; i++)
+    if (process->NumberOfThreads != 0)
     {
-        PSYSTEM_EXTENDED_THREAD_INFORMATION thread = (PSYSTEM_EXTENDED_THREAD_INFORMATION)process->Threads + i;
+        PPH_VIRTUAL_MEMORY_READ_ENTRY entries;
+        PSYSTEM_EXTENDED_THREAD_INFORMATION *threads;
+        NT_TIB *ntTibs;
+        ULONG numberOfEntries;
+#ifdef _WIN64
+        PSYSTEM_EXTENDED_THREAD_INFORMATION *threads32;
+        NT_TIB32 *ntTibs32;
+        ULONG numberOfEntries32;
+#endif
 
-        if (WindowsVersion < WINDOWS_VISTA)
+        // Read the TIB of every thread at once instead of one thread at a time.
+        entries = PhAllocate(sizeof(PH_VIRTUAL_MEMORY_READ_ENTRY) * process->NumberOfThreads);
+        threads = PhAllocate(sizeof(PSYSTEM_EXTENDED_THREAD_INFORMATION) * process->NumberOfThreads);
+        ntTibs = PhAllocate(sizeof(NT_TIB) * process->NumberOfThreads);
+        numberOfEntries = 0;
+
+        for (i = 0; i < process->NumberOfThreads; i++)
         {
-            HANDLE threadHandle;
-            THREAD_BASIC_INFORMATION basicInfo;
+            PSYSTEM_EXTENDED_THREAD_INFORMATION thread = (PSYSTEM_EXTENDED_THREAD_INFORMATION)process->Threads + i;
 
-            if (NT_SUCCESS(PhOpenThread(&threadHandle, ThreadQueryAccess, thread->ThreadInfo.ClientId.UniqueThread)))
+            if (WindowsVersion < WINDOWS_VISTA)
             {
-                if (NT_SUCCESS(PhGetThreadBasicInformation(threadHandle, &basicInfo)))
-                    thread->TebBase = basicInfo.TebBaseAddress;
+                HANDLE threadHandle;
+                THREAD_BASIC_INFORMATION basicInfo;
+
+                if (NT_SUCCESS(PhOpenThread(&threadHandle, ThreadQueryAccess, thread->ThreadInfo.ClientId.UniqueThread)))
+                {
+                    if (NT_SUCCESS(PhGetThreadBasicInformation(threadHandle, &basicInfo)))
+                        thread->TebBase = basicInfo.TebBaseAddress;
+
+                    NtClose(threadHandle);
+                }
+            }
 
-                NtClose(threadHandle);
+            if (thread->TebBase)
+            {
+                if (memoryItem = PhpSetMemoryRegionType(List, thread->TebBase, TRUE, TebRegion))
+                    memoryItem->u.Teb.ThreadId = thread->ThreadInfo.ClientId.UniqueThread;
+
+                entries[numberOfEntries].BaseAddress = thread->TebBase;
+                entries[numberOfEntries].Buffer = &ntTibs[numberOfEntries];
+                entries[numberOfEntries].BufferSize = sizeof(NT_TIB);
+                threads[numberOfEntries] = thread;
+                numberOfEntries++;
             }
         }
 
-        if (thread->TebBase)
-        {
-            NT_TIB ntTib;
-            SIZE_T bytesRead;
+        if (numberOfEntries != 0)
+            PhReadVirtualMemoryBatch(ProcessHandle, entries, numberOfEntries);
+
+#ifdef _WIN64
+        threads32 = PhAllocate(sizeof(PSYSTEM_EXTENDED_THREAD_INFORMATION) * process->NumberOfThreads);
+        ntTibs32 = PhAllocate(sizeof(NT_TIB32) * process->NumberOfThreads);
+        numberOfEntries32 = 0;
+#endif
 
-            if (memoryItem = PhpSetMemoryRegionType(List, thread->TebBase, TRUE, TebRegion))
-                memoryItem->u.Teb.ThreadId = thread->ThreadInfo.ClientId.UniqueThread;
+        for (i = 0; i < numberOfEntries; i++)
+        {
+            PSYSTEM_EXTENDED_THREAD_INFORMATION thread = threads[i];
+            NT_TIB *ntTib = &ntTibs[i];
 
-            if (NT_SUCCESS(PhReadVirtualMemory(ProcessHandle, thread->TebBase, &ntTib, sizeof(NT_TIB), &bytesRead)) &&
-                bytesRead == sizeof(NT_TIB))
+            if (NT_SUCCESS(entries[i].Status) && entries[i].NumberOfBytesRead == sizeof(NT_TIB))
             {
-                if ((ULONG_PTR)ntTib.StackLimit < (ULONG_PTR)ntTib.StackBase)
+                if ((ULONG_PTR)ntTib->StackLimit < (ULONG_PTR)ntTib->StackBase)
                 {
-                    if (memoryItem = PhpSetMemoryRegionType(List, ntTib.StackLimit, TRUE, StackRegion))
+                    if (memoryItem = PhpSetMemoryRegionType(List, ntTib->StackLimit, TRUE, StackRegion))
                         memoryItem->u.Stack.ThreadId = thread->ThreadInfo.ClientId.UniqueThread;
                 }
 #ifdef _WIN64
 
-                if (isWow64 && ntTib.ExceptionList)
+                if (isWow64 && ntTib->ExceptionList)
                 {
-                    ULONG teb32 = PtrToUlong(ntTib.ExceptionList);
-                    NT_TIB32 ntTib32;
+                    // Queue the 32-bit TIB for the second batch. The entries of the first batch have
+                    // already been consumed up to this index, so they can be reused.
+                    entries[numberOfEntries32].BaseAddress = UlongToPtr(PtrToUlong(ntTib->ExceptionList));
+                    entries[numberOfEntries32].Buffer = &ntTibs32[numberOfEntries32];
+                    entries[numberOfEntries32].BufferSize = sizeof(NT_TIB32);
+                    threads32[numberOfEntries32] = thread;
+                    numberOfEntries32++;
+                }
+#endif
+            }
+        }
 
-                    // 64-bit and 32-bit TEBs usually share the same memory region, so don't do anything for the 32-bit
-                    // TEB.
+#ifdef _WIN64
+        // 64-bit and 32-bit TEBs usually share the same memory region, so don't do anything for the 32-bit
+        // TEB.
 
-                    if (NT_SUCCESS(PhReadVirtualMemory(ProcessHandle, UlongToPtr(teb32), &ntTib32, sizeof(NT_TIB32), &bytesRead)) &&
-                        bytesRead == sizeof(NT_TIB32))
-                    {
-                        if (ntTib32.StackLimit < ntTib32.StackBase)
-                        {
-                            if (memoryItem = PhpSetMemoryRegionType(List, UlongToPtr(ntTib32.StackLimit), TRUE, Stack32Region))
-                                memoryItem->u.Stack.ThreadId = thread->ThreadInfo.ClientId.UniqueThread;
-                        }
-                    }
+        if (numberOfEntries32 != 0)
+            PhReadVirtualMemoryBatch(ProcessHandle, entries, numberOfEntries32);
+
+        for (i = 0; i < numberOfEntries32; i++)
+        {
+            NT_TIB32 *ntTib32 = &ntTibs32[i];
+
+            if (NT_SUCCESS(entries[i].Status) && entries[i].NumberOfBytesRead == sizeof(NT_TIB32))
+            {
+                if (ntTib32->StackLimit < ntTib32->StackBase)
+                {
+                    if (memoryItem = PhpSetMemoryRegionType(List, UlongToPtr(ntTib32->StackLimit), TRUE, Stack32Region))
+                        memoryItem->u.Stack.ThreadId = threads32[i]->ThreadInfo.ClientId.UniqueThread;
                 }
-#endif
             }
         }
+
+        PhFree(ntTibs32);
+        PhFree(threads32);
+#endif
+
+        PhFree(ntTibs);
+        PhFree(threads);
+        PhFree(entries);
     }
 
     // Mapped file, heap segment, unusable
@@ -517,6 +583,46 @@ NTSTATUS PhpUpdateMemoryRegionTypes(
     return STATUS_SUCCESS;
 }
 
+VOID PhpQueryMemoryWsBatch(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(Count) PMEMORY_WORKING_SET_EX_INFORMATION Info,
+    _In_reads_(Count) PPH_MEMORY_ITEM *Items,
+    _In_ SIZE_T Count
+    )
+{
+    SIZE_T i;
+
+    if (!NT_SUCCESS(NtQueryVirtualMemory(
+        ProcessHandle,
+        NULL,
+        MemoryWorkingSetExInformation,
+        Info,
+        Count * sizeof(MEMORY_WORKING_SET_EX_INFORMATION),
+        NULL
+        )))
+        return;
+
+    for (i = 0; i < Count; i++)
+    {
+        PMEMORY_WORKING_SET_EX_BLOCK block = &Info[i].u1.VirtualAttributes;
+        PPH_MEMORY_ITEM memoryItem = Items[i];
+
+        if (block->Valid)
+        {
+            memoryItem->TotalWorkingSetPages++;
+
+            if (block->ShareCount > 1)
+                memoryItem->SharedWorkingSetPages++;
+            if (block->ShareCount == 0)
+                memoryItem->PrivateWorkingSetPages++;
+            if (block->Shared)
+                memoryItem->ShareableWorkingSetPages++;
+            if (block->Locked)
+                memoryItem->LockedWorkingSetPages++;
+        }
+    }
+}
+
 NTSTATUS PhpUpdateMemoryWsCounters(
     _In_ PPH_MEMORY_ITEM_LIST List,
     _In_ HANDLE ProcessHandle
@@ -524,12 +630,26 @@ NTSTATUS PhpUpdateMemoryWsCounters(
 {
     PLIST_ENTRY listEntry;
     PMEMORY_WORKING_SET_EX_INFORMATION info;
+    PPH_MEMORY_ITEM *items;
+    SIZE_T count;
 
-    info = PhAllocatePage(WS_REQUEST_COUNT * sizeof(MEMORY_WORKING_SET_EX_INFORMATION), NULL);
+    // Pages of consecutive committed regions are packed into the same request, so processes with
+    // many small regions don't need a system call for each region.
+    info = PhAllocatePage(WS_BATCH_COUNT * sizeof(MEMORY_WORKING_SET_EX_INFORMATION), NULL);
 
     if (!info)
         return STATUS_NO_MEMORY;
 
+    items = PhAllocatePage(WS_BATCH_COUNT * sizeof(PPH_MEMORY_ITEM), NULL);
+
+    if (!items)
+    {
+        PhFreePage(info);
+        return STATUS_NO_MEMORY;
+    }
+
+    count = 0;
+
     for (listEntry = List->ListHead.Flink; listEntry != &List->ListHead; listEntry = listEntry->Flink)
     {
         PPH_MEMORY_ITEM memoryItem = CONTAINING_RECORD(listEntry, PH_MEMORY_ITEM, ListEntry);
@@ -546,52 +666,54 @@ NTSTATUS PhpUpdateMemoryWsCounters(
 
         while (remainingPages != 0)
         {
-            requestPages = min(remainingPages, WS_REQUEST_COUNT);
+            requestPages = min(remainingPages, WS_BATCH_COUNT - count);
 
             for (i = 0; i < requestPages; i++)
             {
-                info[i].VirtualAddress = (PVOID)virtualAddress;
+                info[count].VirtualAddress = (PVOID)virtualAddress;
+                items[count] = memoryItem;
                 virtualAddress += PAGE_SIZE;
+                count++;
             }
 
-            if (NT_SUCCESS(NtQueryVirtualMemory(
-                ProcessHandle,
-                NULL,
-                MemoryWorkingSetExInformation,
-                info,
-                requestPages * sizeof(MEMORY_WORKING_SET_EX_INFORMATION),
-                NULL
-                )))
-            {
-                for (i = 0; i < requestPages; i++)
-                {
-                    PMEMORY_WORKING_SET_EX_BLOCK block = &info[i].u1.VirtualAttributes;
+            remainingPages -= requestPages;
 
-                    if (block->Valid)
-                    {
-                        memoryItem->TotalWorkingSetPages++;
-
-                        if (block->ShareCount > 1)
-                            memoryItem->SharedWorkingSetPages++;
-                        if (block->ShareCount == 0)
-                            memoryItem->PrivateWorkingSetPages++;
-                        if (block->Shared)
-                            memoryItem->ShareableWorkingSetPages++;
-                        if (block->Locked)
-                            memoryItem->LockedWorkingSetPages++;
-                    }
-                }
+            if (count == WS_BATCH_COUNT)
+            {
+                PhpQueryMemoryWsBatch(ProcessHandle, info, items, count);
+                count = 0;
             }
-
-            remainingPages -= requestPages;
         }
     }
 
+    if (count != 0)
+        PhpQueryMemoryWsBatch(ProcessHandle, info, items, count);
+
+    PhFreePage(items);
     PhFreePage(info);
 
     return STATUS_SUCCESS;
 }
 
+typedef struct _PHP_MEMORY_WS_COUNTERS_CONTEXT
+{
+    PPH_MEMORY_ITEM_LIST List;
+    HANDLE ProcessHandle;
+    PH_EVENT CompletedEvent;
+} PHP_MEMORY_WS_COUNTERS_CONTEXT, *PPHP_MEMORY_WS_COUNTERS_CONTEXT;
+
+NTSTATUS NTAPI PhpUpdateMemoryWsCountersWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_MEMORY_WS_COUNTERS_CONTEXT context = Parameter;
+
+    PhpUpdateMemoryWsCounters(context->List, context->ProcessHandle);
+    PhSetEvent(&context->CompletedEvent);
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS PhpUpdateMemoryWsCountersOld(
     _In_ PPH_MEMORY_ITEM_LIST List,
     _In_ HANDLE ProcessHandle
@@ -754,18 +876,426 @@ ContinueLoop:
         baseAddress = PTR_ADD_OFFSET(baseAddress, basicInfo.RegionSize);
     }
 
-    if (Flags & PH_QUERY_MEMORY_REGION_TYPE)
+    if ((Flags & PH_QUERY_MEMORY_REGION_TYPE) && (Flags & PH_QUERY_MEMORY_WS_COUNTERS) &&
+        WindowsVersion >= WINDOWS_SERVER_2003)
+    {
+        PHP_MEMORY_WS_COUNTERS_CONTEXT wsCountersContext;
+
+        // Both walk the region list without changing it and set different fields of each item, so
+        // count the working set on another thread while the region types are determined.
+        wsCountersContext.List = List;
+        wsCountersContext.ProcessHandle = processHandle;
+        PhInitializeEvent(&wsCountersContext.CompletedEvent);
+        PhQueueItemGlobalWorkQueue(PhpUpdateMemoryWsCountersWorker, &wsCountersContext);
+
         PhpUpdateMemoryRegionTypes(List, processHandle);
+        PhWaitForEvent(&wsCountersContext.CompletedEvent, NULL);
+    }
+    else
+    {
+        if (Flags & PH_QUERY_MEMORY_REGION_TYPE)
+            PhpUpdateMemoryRegionTypes(List, processHandle);
+
+        if (Flags & PH_QUERY_MEMORY_WS_COUNTERS)
+        {
+            if (WindowsVersion >= WINDOWS_SERVER_2003)
+                PhpUpdateMemoryWsCounters(List, processHandle);
+            else
+                PhpUpdateMemoryWsCountersOld(List, processHandle);
+        }
+    }
+
+    NtClose(processHandle);
 
-    if (Flags & PH_QUERY_MEMORY_WS_COUNTERS)
+    return STATUS_SUCCESS;
+}
+
+VOID PhpMemorySnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_MEMORY_SNAPSHOT snapshot = Object;
+
+    if (snapshot->Regions)
+        PhFree(snapshot->Regions);
+    if (snapshot->PageHashes)
+        PhFree(snapshot->PageHashes);
+}
+
+typedef struct _PHP_MEMORY_SNAPSHOT_BATCH
+{
+    PH_VIRTUAL_MEMORY_READ_ENTRY Entries[MEMORY_SNAPSHOT_BATCH_COUNT];
+    ULONG FirstPages[MEMORY_SNAPSHOT_BATCH_COUNT];
+    ULONG NumberOfEntries;
+    PUCHAR Buffer;
+} PHP_MEMORY_SNAPSHOT_BATCH, *PPHP_MEMORY_SNAPSHOT_BATCH;
+
+static VOID PhpHashMemorySnapshotBatch(
+    _In_ HANDLE ProcessHandle,
+    _In_ PPH_MEMORY_SNAPSHOT Snapshot,
+    _Inout_ PPHP_MEMORY_SNAPSHOT_BATCH Batch
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    PhReadVirtualMemoryBatch(ProcessHandle, Batch->Entries, Batch->NumberOfEntries);
+
+    for (i = 0; i < Batch->NumberOfEntries; i++)
     {
-        if (WindowsVersion >= WINDOWS_SERVER_2003)
-            PhpUpdateMemoryWsCounters(List, processHandle);
-        else
-            PhpUpdateMemoryWsCountersOld(List, processHandle);
+        PPH_VIRTUAL_MEMORY_READ_ENTRY entry = &Batch->Entries[i];
+        PULONG64 hashes = &Snapshot->PageHashes[Batch->FirstPages[i]];
+        ULONG numberOfPages = (ULONG)(entry->BufferSize / PAGE_SIZE);
+        SIZE_T bytesRead;
+
+        bytesRead = NT_SUCCESS(entry->Status) ? entry->BufferSize : entry->NumberOfBytesRead;
+
+        for (j = 0; j < numberOfPages; j++)
+        {
+            if ((j + 1) * PAGE_SIZE <= bytesRead)
+            {
+                hashes[j] = PhHashBytes64((PUCHAR)entry->Buffer + j * PAGE_SIZE, PAGE_SIZE);
+
+                if (hashes[j] == PH_MEMORY_SNAPSHOT_UNREADABLE)
+                    hashes[j]++;
+            }
+            else
+            {
+                hashes[j] = PH_MEMORY_SNAPSHOT_UNREADABLE;
+            }
+        }
+    }
+
+    Batch->NumberOfEntries = 0;
+}
+
+/**
+ * Records the committed regions of a process and the contents of their pages.
+ *
+ * \param ProcessId The ID of the process.
+ * \param Snapshot A variable which receives the snapshot object.
+ *
+ * \remarks Only a 64-bit hash is stored for each page, so a snapshot takes 8 bytes for every
+ * 4 kB of committed memory.
+ */
+NTSTATUS PhCreateMemorySnapshot(
+    _In_ HANDLE ProcessId,
+    _Out_ PPH_MEMORY_SNAPSHOT *Snapshot
+    )
+{
+    NTSTATUS status;
+    HANDLE processHandle;
+    PPH_MEMORY_SNAPSHOT snapshot;
+    ULONG allocatedRegions;
+    PVOID baseAddress = (PVOID)0;
+    MEMORY_BASIC_INFORMATION basicInfo;
+    PHP_MEMORY_SNAPSHOT_BATCH batch;
+    ULONG i;
+    ULONG j;
+
+    if (!NT_SUCCESS(status = PhOpenProcess(
+        &processHandle,
+        PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+        ProcessId
+        )))
+        return status;
+
+    snapshot = PhCreateObject(sizeof(PH_MEMORY_SNAPSHOT), PhpMemorySnapshotType);
+    memset(snapshot, 0, sizeof(PH_MEMORY_SNAPSHOT));
+    snapshot->ProcessId = ProcessId;
+    PhQuerySystemTime(&snapshot->Time);
+
+    allocatedRegions = 64;
+    snapshot->Regions = PhAllocate(allocatedRegions * sizeof(PH_MEMORY_SNAPSHOT_REGION));
+
+    while (NT_SUCCESS(NtQueryVirtualMemory(
+        processHandle,
+        baseAddress,
+        MemoryBasicInformation,
+        &basicInfo,
+        sizeof(MEMORY_BASIC_INFORMATION),
+        NULL
+        )))
+    {
+        if (basicInfo.State & MEM_COMMIT)
+        {
+            PPH_MEMORY_SNAPSHOT_REGION region;
+
+            if (snapshot->NumberOfRegions == allocatedRegions)
+            {
+                allocatedRegions *= 2;
+                snapshot->Regions = PhReAllocate(snapshot->Regions, allocatedRegions * sizeof(PH_MEMORY_SNAPSHOT_REGION));
+            }
+
+            region = &snapshot->Regions[snapshot->NumberOfRegions++];
+            region->BaseAddress = basicInfo.BaseAddress;
+            region->RegionSize = basicInfo.RegionSize;
+            region->Protect = basicInfo.Protect;
+            region->Type = basicInfo.Type;
+            region->FirstPage = snapshot->NumberOfPages;
+            snapshot->NumberOfPages += (ULONG)(basicInfo.RegionSize / PAGE_SIZE);
+        }
+
+        baseAddress = PTR_ADD_OFFSET(baseAddress, basicInfo.RegionSize);
+    }
+
+    snapshot->PageHashes = PhAllocateSafe(max(snapshot->NumberOfPages, 1) * sizeof(ULONG64));
+    batch.Buffer = PhAllocatePage(MEMORY_SNAPSHOT_BATCH_COUNT * MEMORY_SNAPSHOT_CHUNK_SIZE, NULL);
+    batch.NumberOfEntries = 0;
+
+    if (!snapshot->PageHashes || !batch.Buffer)
+    {
+        if (batch.Buffer)
+            PhFreePage(batch.Buffer);
+
+        PhDereferenceObject(snapshot);
+        NtClose(processHandle);
+
+        return STATUS_NO_MEMORY;
+    }
+
+    // Read the regions in chunks, several chunks per request. Reading a guard page would clear
+    // the guard, so such regions are not read at all.
+
+    for (i = 0; i < snapshot->NumberOfRegions; i++)
+    {
+        PPH_MEMORY_SNAPSHOT_REGION region = &snapshot->Regions[i];
+        SIZE_T offset;
+
+        if (region->Protect == 0 || (region->Protect & (PAGE_NOACCESS | PAGE_GUARD)))
+        {
+            for (j = 0; j < (ULONG)(region->RegionSize / PAGE_SIZE); j++)
+                snapshot->PageHashes[region->FirstPage + j] = PH_MEMORY_SNAPSHOT_UNREADABLE;
+
+            continue;
+        }
+
+        for (offset = 0; offset < region->RegionSize; offset += MEMORY_SNAPSHOT_CHUNK_SIZE)
+        {
+            PPH_VIRTUAL_MEMORY_READ_ENTRY entry = &batch.Entries[batch.NumberOfEntries];
+
+            entry->BaseAddress = PTR_ADD_OFFSET(region->BaseAddress, offset);
+            entry->Buffer = &batch.Buffer[batch.NumberOfEntries * MEMORY_SNAPSHOT_CHUNK_SIZE];
+            entry->BufferSize = min(region->RegionSize - offset, MEMORY_SNAPSHOT_CHUNK_SIZE);
+            batch.FirstPages[batch.NumberOfEntries] = region->FirstPage + (ULONG)(offset / PAGE_SIZE);
+
+            if (++batch.NumberOfEntries == MEMORY_SNAPSHOT_BATCH_COUNT)
+                PhpHashMemorySnapshotBatch(processHandle, snapshot, &batch);
+        }
     }
 
+    if (batch.NumberOfEntries != 0)
+        PhpHashMemorySnapshotBatch(processHandle, snapshot, &batch);
+
+    PhFreePage(batch.Buffer);
     NtClose(processHandle);
 
+    *Snapshot = snapshot;
+
     return STATUS_SUCCESS;
 }
+
+static ULONG PhpFindMemorySnapshotRegion(
+    _In_ PPH_MEMORY_SNAPSHOT Snapshot,
+    _In_ ULONG_PTR Address
+    )
+{
+    ULONG low;
+    ULONG high;
+
+    // Find the first region that ends after the address.
+
+    low = 0;
+    high = Snapshot->NumberOfRegions;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+        PPH_MEMORY_SNAPSHOT_REGION region = &Snapshot->Regions[mid];
+
+        if ((ULONG_PTR)region->BaseAddress + region->RegionSize <= Address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+static VOID PhpCompareMemorySnapshotRegion(
+    _In_ PPH_MEMORY_SNAPSHOT Snapshot,
+    _In_ PPH_MEMORY_SNAPSHOT_REGION Region,
+    _In_ PPH_MEMORY_SNAPSHOT OtherSnapshot,
+    _Out_ PULONG CommonPages,
+    _Out_ PULONG ModifiedPages
+    )
+{
+    ULONG_PTR start;
+    ULONG_PTR end;
+    ULONG commonPages;
+    ULONG modifiedPages;
+    ULONG i;
+
+    start = (ULONG_PTR)Region->BaseAddress;
+    end = start + Region->RegionSize;
+    commonPages = 0;
+    modifiedPages = 0;
+
+    // Regions can be split or merged when their protection changes, so pages are matched by
+    // address rather than by region.
+
+    for (i = PhpFindMemorySnapshotRegion(OtherSnapshot, start); i < OtherSnapshot->NumberOfRegions; i++)
+    {
+        PPH_MEMORY_SNAPSHOT_REGION otherRegion = &OtherSnapshot->Regions[i];
+        ULONG_PTR otherStart = (ULONG_PTR)otherRegion->BaseAddress;
+        ULONG_PTR overlapStart;
+        ULONG_PTR overlapEnd;
+        PULONG64 hashes;
+        PULONG64 otherHashes;
+        ULONG count;
+        ULONG j;
+
+        if (otherStart >= end)
+            break;
+
+        overlapStart = max(start, otherStart);
+        overlapEnd = min(end, otherStart + otherRegion->RegionSize);
+        count = (ULONG)((overlapEnd - overlapStart) / PAGE_SIZE);
+        hashes = &Snapshot->PageHashes[Region->FirstPage + (overlapStart - start) / PAGE_SIZE];
+        otherHashes = &OtherSnapshot->PageHashes[otherRegion->FirstPage + (overlapStart - otherStart) / PAGE_SIZE];
+
+        for (j = 0; j < count; j++)
+        {
+            if (hashes[j] != otherHashes[j])
+                modifiedPages++;
+        }
+
+        commonPages += count;
+    }
+
+    *CommonPages = commonPages;
+    *ModifiedPages = modifiedPages;
+}
+
+static VOID PhpAddMemorySnapshotChange(
+    _Inout_ PPH_MEMORY_SNAPSHOT_CHANGE *Changes,
+    _Inout_ PULONG NumberOfChanges,
+    _Inout_ PULONG AllocatedChanges,
+    _In_ PH_MEMORY_SNAPSHOT_CHANGE_TYPE ChangeType,
+    _In_ PPH_MEMORY_SNAPSHOT_REGION Region,
+    _In_ ULONG AddedPages,
+    _In_ ULONG RemovedPages,
+    _In_ ULONG ModifiedPages
+    )
+{
+    PPH_MEMORY_SNAPSHOT_CHANGE change;
+
+    if (*NumberOfChanges == *AllocatedChanges)
+    {
+        *AllocatedChanges *= 2;
+        *Changes = PhReAllocate(*Changes, *AllocatedChanges * sizeof(PH_MEMORY_SNAPSHOT_CHANGE));
+    }
+
+    change = &(*Changes)[(*NumberOfChanges)++];
+    change->ChangeType = ChangeType;
+    change->BaseAddress = Region->BaseAddress;
+    change->RegionSize = Region->RegionSize;
+    change->Type = Region->Type;
+    change->AddedPages = AddedPages;
+    change->RemovedPages = RemovedPages;
+    change->ModifiedPages = ModifiedPages;
+}
+
+static int __cdecl PhpMemorySnapshotChangeCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_MEMORY_SNAPSHOT_CHANGE change1 = (PPH_MEMORY_SNAPSHOT_CHANGE)elem1;
+    PPH_MEMORY_SNAPSHOT_CHANGE change2 = (PPH_MEMORY_SNAPSHOT_CHANGE)elem2;
+
+    return uintptrcmp((ULONG_PTR)change1->BaseAddress, (ULONG_PTR)change2->BaseAddress);
+}
+
+/**
+ * Determines how the memory of a process changed between two snapshots.
+ *
+ * \param OldSnapshot The earlier snapshot.
+ * \param NewSnapshot The later snapshot.
+ * \param Changes A variable which receives an array of changes sorted by address. You must
+ * free the array using PhFree() when you no longer need it.
+ * \param NumberOfChanges A variable which receives the number of changes.
+ *
+ * \remarks Regions of the new snapshot are reported as new, grown or modified; regions of the
+ * old snapshot are reported as freed or shrunk.
+ */
+VOID PhCompareMemorySnapshots(
+    _In_ PPH_MEMORY_SNAPSHOT OldSnapshot,
+    _In_ PPH_MEMORY_SNAPSHOT NewSnapshot,
+    _Out_ PPH_MEMORY_SNAPSHOT_CHANGE *Changes,
+    _Out_ PULONG NumberOfChanges
+    )
+{
+    PPH_MEMORY_SNAPSHOT_CHANGE changes;
+    ULONG numberOfChanges;
+    ULONG allocatedChanges;
+    ULONG i;
+
+    allocatedChanges = 16;
+    changes = PhAllocate(allocatedChanges * sizeof(PH_MEMORY_SNAPSHOT_CHANGE));
+    numberOfChanges = 0;
+
+    for (i = 0; i < NewSnapshot->NumberOfRegions; i++)
+    {
+        PPH_MEMORY_SNAPSHOT_REGION region = &NewSnapshot->Regions[i];
+        ULONG numberOfPages = (ULONG)(region->RegionSize / PAGE_SIZE);
+        ULONG commonPages;
+        ULONG modifiedPages;
+
+        PhpCompareMemorySnapshotRegion(NewSnapshot, region, OldSnapshot, &commonPages, &modifiedPages);
+
+        if (commonPages == 0)
+        {
+            PhpAddMemorySnapshotChange(&changes, &numberOfChanges, &allocatedChanges,
+                MemorySnapshotRegionNew, region, numberOfPages, 0, 0);
+        }
+        else if (commonPages < numberOfPages)
+        {
+            PhpAddMemorySnapshotChange(&changes, &numberOfChanges, &allocatedChanges,
+                MemorySnapshotRegionGrown, region, numberOfPages - commonPages, 0, modifiedPages);
+        }
+        else if (modifiedPages != 0)
+        {
+            PhpAddMemorySnapshotChange(&changes, &numberOfChanges, &allocatedChanges,
+                MemorySnapshotRegionModified, region, 0, 0, modifiedPages);
+        }
+    }
+
+    for (i = 0; i < OldSnapshot->NumberOfRegions; i++)
+    {
+        PPH_MEMORY_SNAPSHOT_REGION region = &OldSnapshot->Regions[i];
+        ULONG numberOfPages = (ULONG)(region->RegionSize / PAGE_SIZE);
+        ULONG commonPages;
+        ULONG modifiedPages;
+
+        PhpCompareMemorySnapshotRegion(OldSnapshot, region, NewSnapshot, &commonPages, &modifiedPages);
+
+        // Modified pages have already been counted for the new region.
+        if (commonPages == 0)
+        {
+            PhpAddMemorySnapshotChange(&changes, &numberOfChanges, &allocatedChanges,
+                MemorySnapshotRegionFreed, region, 0, numberOfPages, 0);
+        }
+        else if (commonPages < numberOfPages)
+        {
+            PhpAddMemorySnapshotChange(&changes, &numberOfChanges, &allocatedChanges,
+                MemorySnapshotRegionShrunk, region, 0, numberOfPages - commonPages, 0);
+        }
+    }
+
+    qsort(changes, numberOfChanges, sizeof(PH_MEMORY_SNAPSHOT_CHANGE), PhpMemorySnapshotChangeCompare);
+
+    *Changes = changes;
+    *NumberOfChanges = numberOfChanges;
+}
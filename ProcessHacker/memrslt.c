@@ -24,7 +24,7 @@
 #include <emenu.h>
 #include <settings.h>
 #include <memsrch.h>
-#include "pcre/pcre2.h"
+#include <regexsup.h>
 #include <windowsx.h>
 
 #define FILTER_CONTAINS 1
@@ -35,7 +35,10 @@
 typedef struct _MEMORY_RESULTS_CONTEXT
 {
     HANDLE ProcessId;
-    PPH_LIST Results;
+    PPH_MEMORY_RESULTS Results;
+    PULONG Indices; // results in the current view
+    ULONG NumberOfIndices;
+    PWSTR TextBuffer; // PH_DISPLAY_BUFFER_COUNT + 1 characters
 
     PH_LAYOUT_MANAGER LayoutManager;
 } MEMORY_RESULTS_CONTEXT, *PMEMORY_RESULTS_CONTEXT;
@@ -51,7 +54,7 @@ static RECT MinimumSize = { -1, -1, -1, -1 };
 
 VOID PhShowMemoryResultsDialog(
     _In_ HANDLE ProcessId,
-    _In_ PPH_LIST Results
+    _In_ PPH_MEMORY_RESULTS Results
     )
 {
     HWND windowHandle;
@@ -61,11 +64,14 @@ VOID PhShowMemoryResultsDialog(
     context = PhAllocate(sizeof(MEMORY_RESULTS_CONTEXT));
     context->ProcessId = ProcessId;
     context->Results = Results;
+    context->Indices = PhAllocate(max(Results->Count, 1) * sizeof(ULONG));
+    context->NumberOfIndices = Results->Count;
+    context->TextBuffer = PhAllocate((PH_DISPLAY_BUFFER_COUNT + 1) * sizeof(WCHAR));
 
     PhReferenceObject(Results);
 
     for (i = 0; i < Results->Count; i++)
-        PhReferenceMemoryResult(Results->Items[i]);
+        context->Indices[i] = i;
 
     windowHandle = CreateDialogParam(
         PhInstanceHandle,
@@ -79,7 +85,7 @@ VOID PhShowMemoryResultsDialog(
 
 static PPH_STRING PhpGetStringForSelectedResults(
     _In_ HWND ListViewHandle,
-    _In_ PPH_LIST Results,
+    _In_ PMEMORY_RESULTS_CONTEXT Context,
     _In_ BOOLEAN All
     )
 {
@@ -88,9 +94,9 @@ static PPH_STRING PhpGetStringForSelectedResults(
 
     PhInitializeStringBuilder(&stringBuilder, 0x100);
 
-    for (i = 0; i < Results->Count; i++)
+    for (i = 0; i < Context->NumberOfIndices; i++)
     {
-        PPH_MEMORY_RESULT result;
+        ULONG index;
 
         if (!All)
         {
@@ -98,15 +104,43 @@ static PPH_STRING PhpGetStringForSelectedResults(
                 continue;
         }
 
-        result = Results->Items[i];
+        index = Context->Indices[i];
+        PhGetMemoryResultText(Context->Results, index, Context->TextBuffer);
 
-        PhAppendFormatStringBuilder(&stringBuilder, L"0x%Ix (%u): %s\r\n", result->Address, result->Length,
-            result->Display.Buffer ? result->Display.Buffer : L"");
+        PhAppendFormatStringBuilder(&stringBuilder, L"0x%Ix (%u): %s\r\n",
+            PhGetMemoryResultAddress(Context->Results, index),
+            PhGetMemoryResultLength(Context->Results, index),
+            Context->TextBuffer
+            );
     }
 
     return PhFinalStringBuilderString(&stringBuilder);
 }
 
+static VOID PhpUpdateMemoryResultsView(
+    _In_ HWND hwndDlg,
+    _In_ PMEMORY_RESULTS_CONTEXT Context
+    )
+{
+    HWND lvHandle = GetDlgItem(hwndDlg, IDC_LIST);
+
+    ListView_SetItemState(lvHandle, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+    ListView_SetItemCount(lvHandle, Context->NumberOfIndices);
+    InvalidateRect(lvHandle, NULL, FALSE);
+
+    if (Context->NumberOfIndices == Context->Results->Count)
+    {
+        SetDlgItemText(hwndDlg, IDC_INTRO, PhaFormatString(L"%s results.",
+            PhaFormatUInt64(Context->Results->Count, TRUE)->Buffer)->Buffer);
+    }
+    else
+    {
+        SetDlgItemText(hwndDlg, IDC_INTRO, PhaFormatString(L"%s of %s results.",
+            PhaFormatUInt64(Context->NumberOfIndices, TRUE)->Buffer,
+            PhaFormatUInt64(Context->Results->Count, TRUE)->Buffer)->Buffer);
+    }
+}
+
 static VOID FilterResults(
     _In_ HWND hwndDlg,
     _In_ PMEMORY_RESULTS_CONTEXT Context,
@@ -114,11 +148,11 @@ static VOID FilterResults(
     )
 {
     PPH_STRING selectedChoice = NULL;
-    PPH_LIST results;
-    pcre2_code *compiledExpression;
-    pcre2_match_data *matchData;
+    PPH_MEMORY_RESULTS results;
+    PWSTR textBuffer;
 
     results = Context->Results;
+    textBuffer = Context->TextBuffer;
 
     SetCursor(LoadCursor(NULL, IDC_WAIT));
 
@@ -135,68 +169,58 @@ static VOID FilterResults(
         L"MemFilterChoices"
         ))
     {
-        PPH_LIST newResults = NULL;
+        PULONG newIndices = NULL;
+        ULONG numberOfNewIndices = 0;
         ULONG i;
 
+        // The filter narrows the current view, so the matches always fit in an array of the
+        // same size.
+
         if (Type == FILTER_CONTAINS || Type == FILTER_CONTAINS_IGNORECASE)
         {
-            newResults = PhCreateList(1024);
+            PPH_STRING upperChoice = NULL;
 
-            if (Type == FILTER_CONTAINS)
-            {
-                for (i = 0; i < results->Count; i++)
-                {
-                    PPH_MEMORY_RESULT result = results->Items[i];
-
-                    if (wcsstr(result->Display.Buffer, selectedChoice->Buffer))
-                    {
-                        PhReferenceMemoryResult(result);
-                        PhAddItemList(newResults, result);
-                    }
-                }
-            }
-            else
-            {
-                PPH_STRING upperChoice;
+            newIndices = PhAllocate(max(Context->NumberOfIndices, 1) * sizeof(ULONG));
 
+            if (Type == FILTER_CONTAINS_IGNORECASE)
                 upperChoice = PhaUpperString(selectedChoice);
 
-                for (i = 0; i < results->Count; i++)
-                {
-                    PPH_MEMORY_RESULT result = results->Items[i];
-                    PWSTR upperDisplay;
-
-                    upperDisplay = PhAllocateForMemorySearch(result->Display.Length + sizeof(WCHAR));
-                    // Copy the null terminator as well.
-                    memcpy(upperDisplay, result->Display.Buffer, result->Display.Length + sizeof(WCHAR));
+            for (i = 0; i < Context->NumberOfIndices; i++)
+            {
+                ULONG index = Context->Indices[i];
 
-                    _wcsupr(upperDisplay);
+                PhGetMemoryResultText(results, index, textBuffer);
 
-                    if (wcsstr(upperDisplay, upperChoice->Buffer))
-                    {
-                        PhReferenceMemoryResult(result);
-                        PhAddItemList(newResults, result);
-                    }
+                if (upperChoice)
+                {
+                    _wcsupr(textBuffer);
 
-                    PhFreeForMemorySearch(upperDisplay);
+                    if (!wcsstr(textBuffer, upperChoice->Buffer))
+                        continue;
                 }
+                else
+                {
+                    if (!wcsstr(textBuffer, selectedChoice->Buffer))
+                        continue;
+                }
+
+                newIndices[numberOfNewIndices++] = index;
             }
         }
         else if (Type == FILTER_REGEX || Type == FILTER_REGEX_IGNORECASE)
         {
-            int errorCode;
-            PCRE2_SIZE errorOffset;
+            PPH_REGEX regex;
+            INT errorCode;
+            SIZE_T errorOffset;
 
-            compiledExpression = pcre2_compile(
-                selectedChoice->Buffer,
-                selectedChoice->Length / sizeof(WCHAR),
-                (Type == FILTER_REGEX_IGNORECASE ? PCRE2_CASELESS : 0) | PCRE2_DOTALL,
+            regex = PhCompileRegex(
+                &selectedChoice->sr,
+                Type == FILTER_REGEX_IGNORECASE ? PH_REGEX_IGNORE_CASE : 0,
                 &errorCode,
-                &errorOffset,
-                NULL
+                &errorOffset
                 );
 
-            if (!compiledExpression)
+            if (!regex)
             {
                 PhShowError(hwndDlg, L"Unable to compile the regular expression: \"%s\" at position %zu.",
                     PhGetStringOrDefault(PhAutoDereferenceObject(PhPcre2GetErrorMessage(errorCode)), L"Unknown error"),
@@ -205,38 +229,30 @@ static VOID FilterResults(
                 continue;
             }
 
-            matchData = pcre2_match_data_create_from_pattern(compiledExpression, NULL);
-
-            newResults = PhCreateList(1024);
+            newIndices = PhAllocate(max(Context->NumberOfIndices, 1) * sizeof(ULONG));
 
-            for (i = 0; i < results->Count; i++)
+            for (i = 0; i < Context->NumberOfIndices; i++)
             {
-                PPH_MEMORY_RESULT result = results->Items[i];
-
-                if (pcre2_match(
-                    compiledExpression,
-                    result->Display.Buffer,
-                    result->Display.Length / sizeof(WCHAR),
-                    0,
-                    0,
-                    matchData,
-                    NULL
-                    ) >= 0)
-                {
-                    PhReferenceMemoryResult(result);
-                    PhAddItemList(newResults, result);
-                }
+                ULONG index = Context->Indices[i];
+                PH_STRINGREF text;
+
+                text.Buffer = textBuffer;
+                text.Length = PhGetMemoryResultText(results, index, textBuffer) * sizeof(WCHAR);
+
+                if (PhMatchRegex(regex, &text))
+                    newIndices[numberOfNewIndices++] = index;
             }
 
-            pcre2_match_data_free(matchData);
-            pcre2_code_free(compiledExpression);
+            PhDereferenceObject(regex);
         }
 
-        if (newResults)
+        if (newIndices)
         {
-            PhShowMemoryResultsDialog(Context->ProcessId, newResults);
-            PhDereferenceMemoryResults((PPH_MEMORY_RESULT *)newResults->Items, newResults->Count);
-            PhDereferenceObject(newResults);
+            PhFree(Context->Indices);
+            Context->Indices = newIndices;
+            Context->NumberOfIndices = numberOfNewIndices;
+
+            PhpUpdateMemoryResultsView(hwndDlg, Context);
             break;
         }
     }
@@ -319,10 +335,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                 MinimumSize.left = 0;
             }
 
-            ListView_SetItemCount(lvHandle, context->Results->Count);
-
-            SetDlgItemText(hwndDlg, IDC_INTRO, PhaFormatString(L"%s results.",
-                PhaFormatUInt64(context->Results->Count, TRUE)->Buffer)->Buffer);
+            PhpUpdateMemoryResultsView(hwndDlg, context);
 
             {
                 PH_RECTANGLE windowRectangle;
@@ -352,8 +365,9 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
             PhUnregisterDialog(hwndDlg);
             RemoveProp(hwndDlg, PhMakeContextAtom());
 
-            PhDereferenceMemoryResults((PPH_MEMORY_RESULT *)context->Results->Items, context->Results->Count);
             PhDereferenceObject(context->Results);
+            PhFree(context->TextBuffer);
+            PhFree(context->Indices);
             PhFree(context);
         }
         break;
@@ -377,12 +391,12 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                     if (selectedCount == 0)
                     {
                         // User didn't select anything, so copy all items.
-                        string = PhpGetStringForSelectedResults(lvHandle, context->Results, TRUE);
+                        string = PhpGetStringForSelectedResults(lvHandle, context, TRUE);
                         PhSetStateAllListViewItems(lvHandle, LVIS_SELECTED, LVIS_SELECTED);
                     }
                     else
                     {
-                        string = PhpGetStringForSelectedResults(lvHandle, context->Results, FALSE);
+                        string = PhpGetStringForSelectedResults(lvHandle, context, FALSE);
                     }
 
                     PhSetClipboardString(hwndDlg, &string->sr);
@@ -427,7 +441,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             PhWriteStringAsUtf8FileStream(fileStream, &PhUnicodeByteOrderMark);
                             PhWritePhTextHeader(fileStream);
 
-                            string = PhpGetStringForSelectedResults(GetDlgItem(hwndDlg, IDC_LIST), context->Results, TRUE);
+                            string = PhpGetStringForSelectedResults(GetDlgItem(hwndDlg, IDC_LIST), context, TRUE);
                             PhWriteStringAsUtf8FileStreamEx(fileStream, string->Buffer, string->Length);
                             PhDereferenceObject(string);
 
@@ -504,7 +518,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
 
                     if (dispInfo->item.mask & LVIF_TEXT)
                     {
-                        PPH_MEMORY_RESULT result = context->Results->Items[dispInfo->item.iItem];
+                        ULONG index = context->Indices[dispInfo->item.iItem];
 
                         switch (dispInfo->item.iSubItem)
                         {
@@ -512,7 +526,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             {
                                 WCHAR addressString[PH_PTR_STR_LEN_1];
 
-                                PhPrintPointer(addressString, result->Address);
+                                PhPrintPointer(addressString, PhGetMemoryResultAddress(context->Results, index));
                                 wcsncpy_s(
                                     dispInfo->item.pszText,
                                     dispInfo->item.cchTextMax,
@@ -525,7 +539,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             {
                                 WCHAR lengthString[PH_INT32_STR_LEN_1];
 
-                                PhPrintUInt32(lengthString, (ULONG)result->Length);
+                                PhPrintUInt32(lengthString, PhGetMemoryResultLength(context->Results, index));
                                 wcsncpy_s(
                                     dispInfo->item.pszText,
                                     dispInfo->item.cchTextMax,
@@ -535,10 +549,13 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             }
                             break;
                         case 2:
+                            // Only visible rows are asked for, so the text is decoded here
+                            // rather than kept around for every result.
+                            PhGetMemoryResultText(context->Results, index, context->TextBuffer);
                             wcsncpy_s(
                                 dispInfo->item.pszText,
                                 dispInfo->item.cchTextMax,
-                                result->Display.Buffer,
+                                context->TextBuffer,
                                 _TRUNCATE
                                 );
                             break;
@@ -559,7 +576,8 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             )) != -1)
                         {
                             NTSTATUS status;
-                            PPH_MEMORY_RESULT result = context->Results->Items[index];
+                            PVOID address = PhGetMemoryResultAddress(context->Results, context->Indices[index]);
+                            ULONG length = PhGetMemoryResultLength(context->Results, context->Indices[index]);
                             HANDLE processHandle;
                             MEMORY_BASIC_INFORMATION basicInfo;
                             PPH_SHOWMEMORYEDITOR showMemoryEditor;
@@ -572,7 +590,7 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                             {
                                 if (NT_SUCCESS(status = NtQueryVirtualMemory(
                                     processHandle,
-                                    result->Address,
+                                    address,
                                     MemoryBasicInformation,
                                     &basicInfo,
                                     sizeof(MEMORY_BASIC_INFORMATION),
@@ -584,8 +602,8 @@ INT_PTR CALLBACK PhpMemoryResultsDlgProc(
                                     showMemoryEditor->ProcessId = context->ProcessId;
                                     showMemoryEditor->BaseAddress = basicInfo.BaseAddress;
                                     showMemoryEditor->RegionSize = basicInfo.RegionSize;
-                                    showMemoryEditor->SelectOffset = (ULONG)((ULONG_PTR)result->Address - (ULONG_PTR)basicInfo.BaseAddress);
-                                    showMemoryEditor->SelectLength = (ULONG)result->Length;
+                                    showMemoryEditor->SelectOffset = (ULONG)((ULONG_PTR)address - (ULONG_PTR)basicInfo.BaseAddress);
+                                    showMemoryEditor->SelectLength = length;
                                     ProcessHacker_ShowMemoryEditor(PhMainWndHandle, showMemoryEditor);
                                 }
 
@@ -42,7 +42,7 @@ typedef struct _MEMORY_STRING_CONTEXT
     HWND WindowHandle;
     HANDLE ThreadHandle;
     PH_MEMORY_STRING_OPTIONS Options;
-    PPH_LIST Results;
+    PPH_MEMORY_RESULTS Results;
 } MEMORY_STRING_CONTEXT, *PMEMORY_STRING_CONTEXT;
 
 INT_PTR CALLBACK PhpMemoryStringDlgProc(
@@ -119,56 +119,520 @@ VOID PhFreeForMemorySearch(
     PhReleaseQueuedLockExclusive(&PhMemorySearchHeapLock);
 }
 
-PVOID PhCreateMemoryResult(
+static PPH_OBJECT_TYPE PhpMemoryResultsType;
+
+VOID NTAPI PhpMemoryResultsDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_MEMORY_RESULTS results = Object;
+    ULONG i;
+
+    for (i = 0; i < results->Chunks->Count; i++)
+        PhFreeForMemorySearch(results->Chunks->Items[i]);
+    for (i = 0; i < results->TextBlocks->Count; i++)
+        PhFreeForMemorySearch(results->TextBlocks->Items[i]);
+
+    PhDereferenceObject(results->Chunks);
+    PhDereferenceObject(results->TextBlocks);
+}
+
+/**
+ * Creates an empty set of memory search results.
+ */
+PPH_MEMORY_RESULTS PhCreateMemoryResults(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PPH_MEMORY_RESULTS results;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpMemoryResultsType = PhCreateObjectType(L"MemoryResults", 0, PhpMemoryResultsDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    results = PhCreateObject(sizeof(PH_MEMORY_RESULTS), PhpMemoryResultsType);
+    results->Count = 0;
+    results->Chunks = PhCreateList(16);
+    results->TextBlocks = PhCreateList(16);
+    results->TextBlockUsed = PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE;
+
+    return results;
+}
+
+/**
+ * Adds a result to a set of memory search results.
+ *
+ * \param Results The result set. Calls must be serialized by the caller.
+ * \param Address The address of the match.
+ * \param Length The length of the match, in bytes.
+ * \param Text The display text, one byte per character.
+ * \param TextLength The number of characters in \a Text. This is truncated to
+ * PH_DISPLAY_BUFFER_COUNT.
+ *
+ * \return TRUE if the result was added, otherwise FALSE if there was not enough memory.
+ */
+BOOLEAN PhAddMemoryResult(
+    _Inout_ PPH_MEMORY_RESULTS Results,
     _In_ PVOID Address,
-    _In_ SIZE_T Length
+    _In_ SIZE_T Length,
+    _In_reads_(TextLength) PUCHAR Text,
+    _In_ ULONG TextLength
     )
 {
-    PPH_MEMORY_RESULT result;
+    PPH_MEMORY_RESULTS_CHUNK chunk;
+    PUCHAR textBlock;
+    ULONG index;
 
-    result = PhAllocateForMemorySearch(sizeof(PH_MEMORY_RESULT));
+    TextLength = min(TextLength, PH_DISPLAY_BUFFER_COUNT);
+    index = Results->Count % PH_MEMORY_RESULTS_CHUNK_COUNT;
+
+    if (index == 0)
+    {
+        if (!(chunk = PhAllocateForMemorySearch(sizeof(PH_MEMORY_RESULTS_CHUNK))))
+            return FALSE;
+
+        PhAddItemList(Results->Chunks, chunk);
+    }
+    else
+    {
+        chunk = Results->Chunks->Items[Results->Chunks->Count - 1];
+    }
 
-    if (!result)
-        return NULL;
+    // Text never spans blocks, so it can be decoded from a single pointer.
+    if (Results->TextBlockUsed + TextLength > PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE)
+    {
+        if (!(textBlock = PhAllocateForMemorySearch(PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE)))
+            return FALSE;
 
-    result->RefCount = 1;
-    result->Address = Address;
-    result->Length = Length;
-    result->Display.Length = 0;
-    result->Display.Buffer = NULL;
+        PhAddItemList(Results->TextBlocks, textBlock);
+        Results->TextBlockUsed = 0;
+    }
+    else
+    {
+        textBlock = Results->TextBlocks->Items[Results->TextBlocks->Count - 1];
+    }
 
-    return result;
+    memcpy(textBlock + Results->TextBlockUsed, Text, TextLength);
+
+    chunk->Address[index] = Address;
+    chunk->TextOffset[index] = (ULONG64)(Results->TextBlocks->Count - 1) * PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE + Results->TextBlockUsed;
+    chunk->Length[index] = (ULONG)Length;
+    chunk->TextLength[index] = (USHORT)TextLength;
+
+    Results->TextBlockUsed += TextLength;
+    Results->Count++;
+
+    return TRUE;
 }
 
-VOID PhReferenceMemoryResult(
-    _In_ PPH_MEMORY_RESULT Result
+static int __cdecl PhpMemoryResultIndexCompareByAddress(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
     )
 {
-    _InterlockedIncrement(&Result->RefCount);
+    PPH_MEMORY_RESULTS results = context;
+
+    return uintptrcmp(
+        (ULONG_PTR)PhGetMemoryResultAddress(results, *(PULONG)elem1),
+        (ULONG_PTR)PhGetMemoryResultAddress(results, *(PULONG)elem2)
+        );
 }
 
-VOID PhDereferenceMemoryResult(
-    _In_ PPH_MEMORY_RESULT Result
+/**
+ * Sorts a set of memory search results by address.
+ *
+ * \remarks The text arena is not touched; only the per-result columns are rewritten.
+ */
+VOID PhSortMemoryResultsByAddress(
+    _Inout_ PPH_MEMORY_RESULTS Results
     )
 {
-    if (_InterlockedDecrement(&Result->RefCount) == 0)
+    PULONG order;
+    PPH_LIST newChunks;
+    ULONG i;
+
+    if (Results->Count < 2)
+        return;
+
+    if (!(order = PhAllocateSafe(Results->Count * sizeof(ULONG))))
+        return;
+
+    for (i = 0; i < Results->Count; i++)
+        order[i] = i;
+
+    qsort_s(order, Results->Count, sizeof(ULONG), PhpMemoryResultIndexCompareByAddress, Results);
+
+    newChunks = PhCreateList(Results->Chunks->Count);
+
+    for (i = 0; i < Results->Chunks->Count; i++)
+    {
+        PPH_MEMORY_RESULTS_CHUNK chunk;
+
+        if (!(chunk = PhAllocateForMemorySearch(sizeof(PH_MEMORY_RESULTS_CHUNK))))
+            break;
+
+        PhAddItemList(newChunks, chunk);
+    }
+
+    if (i == Results->Chunks->Count)
+    {
+        for (i = 0; i < Results->Count; i++)
+        {
+            PPH_MEMORY_RESULTS_CHUNK source = Results->Chunks->Items[order[i] / PH_MEMORY_RESULTS_CHUNK_COUNT];
+            PPH_MEMORY_RESULTS_CHUNK target = newChunks->Items[i / PH_MEMORY_RESULTS_CHUNK_COUNT];
+            ULONG sourceIndex = order[i] % PH_MEMORY_RESULTS_CHUNK_COUNT;
+            ULONG targetIndex = i % PH_MEMORY_RESULTS_CHUNK_COUNT;
+
+            target->Address[targetIndex] = source->Address[sourceIndex];
+            target->TextOffset[targetIndex] = source->TextOffset[sourceIndex];
+            target->Length[targetIndex] = source->Length[sourceIndex];
+            target->TextLength[targetIndex] = source->TextLength[sourceIndex];
+        }
+
+        for (i = 0; i < Results->Chunks->Count; i++)
+            PhFreeForMemorySearch(Results->Chunks->Items[i]);
+
+        PhMoveReference(&Results->Chunks, newChunks);
+    }
+    else
     {
-        if (Result->Display.Buffer)
-            PhFreeForMemorySearch(Result->Display.Buffer);
+        // Not enough memory; leave the results in the order they were found.
+        for (i = 0; i < newChunks->Count; i++)
+            PhFreeForMemorySearch(newChunks->Items[i]);
 
-        PhFreeForMemorySearch(Result);
+        PhDereferenceObject(newChunks);
     }
+
+    PhFree(order);
 }
 
-VOID PhDereferenceMemoryResults(
-    _In_reads_(NumberOfResults) PPH_MEMORY_RESULT *Results,
-    _In_ ULONG NumberOfResults
+/**
+ * Decodes the display text of a memory search result.
+ *
+ * \param Results The result set.
+ * \param Index The index of the result.
+ * \param Buffer A buffer which receives the null-terminated text.
+ *
+ * \return The number of characters in the text, not including the null terminator.
+ */
+ULONG PhGetMemoryResultText(
+    _In_ PPH_MEMORY_RESULTS Results,
+    _In_ ULONG Index,
+    _Out_writes_(PH_DISPLAY_BUFFER_COUNT + 1) PWSTR Buffer
     )
 {
+    PPH_MEMORY_RESULTS_CHUNK chunk = Results->Chunks->Items[Index / PH_MEMORY_RESULTS_CHUNK_COUNT];
+    ULONG64 textOffset = chunk->TextOffset[Index % PH_MEMORY_RESULTS_CHUNK_COUNT];
+    ULONG textLength = chunk->TextLength[Index % PH_MEMORY_RESULTS_CHUNK_COUNT];
+    PUCHAR text;
     ULONG i;
 
-    for (i = 0; i < NumberOfResults; i++)
-        PhDereferenceMemoryResult(Results[i]);
+    text = (PUCHAR)Results->TextBlocks->Items[textOffset / PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE] +
+        textOffset % PH_MEMORY_RESULTS_TEXT_BLOCK_SIZE;
+
+    for (i = 0; i < textLength; i++)
+        Buffer[i] = text[i];
+
+    Buffer[textLength] = 0;
+
+    return textLength;
+}
+
+typedef struct _PHP_MEMORY_STRING_BUFFER
+{
+    SLIST_ENTRY ListEntry;
+    PUCHAR Buffer;
+    PUCHAR DisplayBuffer;
+} PHP_MEMORY_STRING_BUFFER, *PPHP_MEMORY_STRING_BUFFER;
+
+typedef struct _PHP_MEMORY_STRING_SEARCH
+{
+    HANDLE ProcessHandle;
+    PPH_MEMORY_STRING_OPTIONS Options;
+    PH_QUEUED_LOCK CallbackLock;
+    SLIST_HEADER BufferListHead;
+} PHP_MEMORY_STRING_SEARCH, *PPHP_MEMORY_STRING_SEARCH;
+
+typedef struct _PHP_MEMORY_STRING_CHUNK
+{
+    PPHP_MEMORY_STRING_SEARCH Search;
+    PVOID BaseAddress;
+    SIZE_T Size;
+} PHP_MEMORY_STRING_CHUNK, *PPHP_MEMORY_STRING_CHUNK;
+
+VOID PhpSearchMemoryStringChunk(
+    _In_ PPHP_MEMORY_STRING_SEARCH Search,
+    _In_ PVOID BaseAddress,
+    _In_reads_(Size) PUCHAR Buffer,
+    _In_ SIZE_T Size,
+    _Out_writes_(PH_DISPLAY_BUFFER_COUNT + 1) PUCHAR DisplayBuffer
+    )
+{
+    PPH_MEMORY_STRING_OPTIONS Options = Search->Options;
+    PUCHAR buffer = Buffer;
+    PUCHAR displayBuffer = DisplayBuffer;
+    ULONG minimumLength = Options->MinimumLength;
+    BOOLEAN detectUnicode = Options->DetectUnicode;
+    SIZE_T displayBufferCount = PH_DISPLAY_BUFFER_COUNT;
+    ULONG_PTR i;
+    UCHAR byte; // current byte
+    UCHAR byte1; // previous byte
+    UCHAR byte2; // byte before previous byte
+    BOOLEAN printable;
+    BOOLEAN printable1;
+    BOOLEAN printable2;
+    ULONG length;
+
+    byte1 = 0;
+    byte2 = 0;
+    printable1 = FALSE;
+    printable2 = FALSE;
+    length = 0;
+
+    for (i = 0; i < Size; i++)
+    {
+        // Most of the address space contains no strings at all. While we're not inside a
+        // sequence (state 8 below), skip ahead to the next printable byte using vector
+        // instructions.
+        if (!printable2 && !printable1)
+        {
+            SIZE_T skip;
+
+            skip = PhCountNonPrintableBytes(&buffer[i], Size - i);
+
+            if (skip >= 2)
+            {
+                i += skip;
+
+                if (i >= Size)
+                    break;
+
+                byte2 = buffer[i - 2];
+                byte1 = buffer[i - 1];
+            }
+        }
+
+        byte = buffer[i];
+        printable = PhCharIsPrintable[byte];
+
+        // To find strings Process Hacker uses a state table.
+        // * byte2 - byte before previous byte
+        // * byte1 - previous byte
+        // * byte - current byte
+        // * length - length of current string run
+        //
+        // The states are described below.
+        //
+        //    [byte2] [byte1] [byte] ...
+        //    [char] means printable, [oth] means non-printable.
+        //
+        // 1. [char] [char] [char] ...
+        //      (we're in a non-wide sequence)
+        //      -> append char.
+        // 2. [char] [char] [oth] ...
+        //      (we reached the end of a non-wide sequence, or we need to start a wide sequence)
+        //      -> if current string is big enough, create result (non-wide).
+        //         otherwise if byte = null, reset to new string with byte1 as first character.
+        //         otherwise if byte != null, reset to new string.
+        // 3. [char] [oth] [char] ...
+        //      (we're in a wide sequence)
+        //      -> (byte1 should = null) append char.
+        // 4. [char] [oth] [oth] ...
+        //      (we reached the end of a wide sequence)
+        //      -> (byte1 should = null) if the current string is big enough, create result (wide).
+        //         otherwise, reset to new string.
+        // 5. [oth] [char] [char] ...
+        //      (we reached the end of a wide sequence, or we need to start a non-wide sequence)
+        //      -> (excluding byte1) if the current string is big enough, create result (wide).
+        //         otherwise, reset to new string with byte1 as first character and byte as
+        //         second character.
+        // 6. [oth] [char] [oth] ...
+        //      (we're in a wide sequence)
+        //      -> (byte2 and byte should = null) do nothing.
+        // 7. [oth] [oth] [char] ...
+        //      (we're starting a sequence, but we don't know if it's a wide or non-wide sequence)
+        //      -> append char.
+        // 8. [oth] [oth] [oth] ...
+        //      (nothing)
+        //      -> do nothing.
+
+        if (printable2 && printable1 && printable)
+        {
+            if (length < displayBufferCount)
+                displayBuffer[length] = byte;
+
+            length++;
+        }
+        else if (printable2 && printable1 && !printable)
+        {
+            if (length >= minimumLength)
+            {
+                goto CreateResult;
+            }
+            else if (byte == 0)
+            {
+                length = 1;
+                displayBuffer[0] = byte1;
+            }
+            else
+            {
+                length = 0;
+            }
+        }
+        else if (printable2 && !printable1 && printable)
+        {
+            if (byte1 == 0)
+            {
+                if (length < displayBufferCount)
+                    displayBuffer[length] = byte;
+
+                length++;
+            }
+        }
+        else if (printable2 && !printable1 && !printable)
+        {
+            if (length >= minimumLength)
+            {
+                goto CreateResult;
+            }
+            else
+            {
+                length = 0;
+            }
+        }
+        else if (!printable2 && printable1 && printable)
+        {
+            if (length >= minimumLength + 1) // length - 1 >= minimumLength but avoiding underflow
+            {
+                length--; // exclude byte1
+                goto CreateResult;
+            }
+            else
+            {
+                length = 2;
+                displayBuffer[0] = byte1;
+                displayBuffer[1] = byte;
+            }
+        }
+        else if (!printable2 && printable1 && !printable)
+        {
+            // Nothing
+        }
+        else if (!printable2 && !printable1 && printable)
+        {
+            if (length < displayBufferCount)
+                displayBuffer[length] = byte;
+
+            length++;
+        }
+        else if (!printable2 && !printable1 && !printable)
+        {
+            // Nothing
+        }
+
+        goto AfterCreateResult;
+
+CreateResult:
+        {
+            ULONG lengthInBytes;
+            ULONG bias;
+            BOOLEAN isWide;
+
+            lengthInBytes = length;
+            bias = 0;
+            isWide = FALSE;
+
+            if (printable1 == printable) // determine if string was wide (refer to state table, 4 and 5)
+            {
+                isWide = TRUE;
+                lengthInBytes *= 2;
+            }
+
+            if (printable) // byte1 excluded (refer to state table, 5)
+            {
+                bias = 1;
+            }
+
+            if (!(isWide && !detectUnicode))
+            {
+                PhAcquireQueuedLockExclusive(&Search->CallbackLock);
+                Options->Header.Callback(
+                    PTR_ADD_OFFSET(BaseAddress, i - bias - lengthInBytes),
+                    lengthInBytes,
+                    displayBuffer,
+                    (ULONG)min(length, displayBufferCount),
+                    Options->Header.Context
+                    );
+                PhReleaseQueuedLockExclusive(&Search->CallbackLock);
+            }
+
+            length = 0;
+        }
+AfterCreateResult:
+
+        byte2 = byte1;
+        byte1 = byte;
+        printable2 = printable1;
+        printable1 = printable;
+    }
+}
+
+NTSTATUS NTAPI PhpSearchMemoryStringChunkFunction(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_MEMORY_STRING_CHUNK chunk = Parameter;
+    PPHP_MEMORY_STRING_SEARCH search = chunk->Search;
+    PSLIST_ENTRY listEntry;
+    PPHP_MEMORY_STRING_BUFFER buffer;
+
+    if (search->Options->Header.Cancel)
+        goto CleanupExit;
+
+    if (listEntry = RtlInterlockedPopEntrySList(&search->BufferListHead))
+    {
+        buffer = CONTAINING_RECORD(listEntry, PHP_MEMORY_STRING_BUFFER, ListEntry);
+    }
+    else
+    {
+        buffer = PhAllocate(sizeof(PHP_MEMORY_STRING_BUFFER));
+        buffer->Buffer = PhAllocatePage(PH_MEMORY_STRING_CHUNK_SIZE, NULL);
+        buffer->DisplayBuffer = PhAllocatePage(PH_DISPLAY_BUFFER_COUNT + 1, NULL);
+
+        if (!buffer->Buffer || !buffer->DisplayBuffer)
+        {
+            if (buffer->Buffer)
+                PhFreePage(buffer->Buffer);
+            if (buffer->DisplayBuffer)
+                PhFreePage(buffer->DisplayBuffer);
+
+            PhFree(buffer);
+            goto CleanupExit;
+        }
+    }
+
+    if (NT_SUCCESS(PhReadVirtualMemory(
+        search->ProcessHandle,
+        chunk->BaseAddress,
+        buffer->Buffer,
+        chunk->Size,
+        NULL
+        )))
+    {
+        PhpSearchMemoryStringChunk(search, chunk->BaseAddress, buffer->Buffer, chunk->Size, buffer->DisplayBuffer);
+    }
+
+    RtlInterlockedPushEntrySList(&search->BufferListHead, &buffer->ListEntry);
+
+CleanupExit:
+    PhFree(chunk);
+
+    return STATUS_SUCCESS;
 }
 
 VOID PhSearchMemoryString(
@@ -176,39 +640,29 @@ VOID PhSearchMemoryString(
     _In_ PPH_MEMORY_STRING_OPTIONS Options
     )
 {
-    ULONG minimumLength;
-    BOOLEAN detectUnicode;
-    ULONG memoryTypeMask;
+    PHP_MEMORY_STRING_SEARCH search;
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH workQueueBatch;
+    ULONG numberOfThreads;
     PVOID baseAddress;
     MEMORY_BASIC_INFORMATION basicInfo;
-    PUCHAR buffer;
-    SIZE_T bufferSize;
-    PWSTR displayBuffer;
-    SIZE_T displayBufferCount;
-
-    minimumLength = Options->MinimumLength;
-    detectUnicode = Options->DetectUnicode;
-    memoryTypeMask = Options->MemoryTypeMask;
+    PSLIST_ENTRY listEntry;
 
-    if (minimumLength < 4)
+    if (Options->MinimumLength < 4)
         return;
 
-    baseAddress = (PVOID)0;
-
-    bufferSize = PAGE_SIZE * 64;
-    buffer = PhAllocatePage(bufferSize, NULL);
+    search.ProcessHandle = ProcessHandle;
+    search.Options = Options;
+    PhInitializeQueuedLock(&search.CallbackLock);
+    RtlInitializeSListHead(&search.BufferListHead);
 
-    if (!buffer)
-        return;
-
-    displayBufferCount = PH_DISPLAY_BUFFER_COUNT;
-    displayBuffer = PhAllocatePage((displayBufferCount + 1) * sizeof(WCHAR), NULL);
+    // Regions are split into chunks which are read and scanned in parallel. Each thread keeps
+    // a chunk-sized buffer, so the number of threads is capped.
+    numberOfThreads = min((ULONG)PhSystemBasicInformation.NumberOfProcessors, PH_MEMORY_STRING_MAXIMUM_THREADS);
+    PhInitializeWorkQueueEx(&workQueue, 0, numberOfThreads, 1000, PH_WORK_QUEUE_LOCK_FREE);
+    PhInitializeWorkQueueBatch(&workQueueBatch);
 
-    if (!displayBuffer)
-    {
-        PhFreePage(buffer);
-        return;
-    }
+    baseAddress = (PVOID)0;
 
     while (NT_SUCCESS(NtQueryVirtualMemory(
         ProcessHandle,
@@ -220,247 +674,45 @@ VOID PhSearchMemoryString(
         )))
     {
         ULONG_PTR offset;
-        SIZE_T readSize;
 
         if (Options->Header.Cancel)
             break;
         if (basicInfo.State != MEM_COMMIT)
             goto ContinueLoop;
-        if ((basicInfo.Type & memoryTypeMask) == 0)
+        if ((basicInfo.Type & Options->MemoryTypeMask) == 0)
             goto ContinueLoop;
         if (basicInfo.Protect == PAGE_NOACCESS)
             goto ContinueLoop;
         if (basicInfo.Protect & PAGE_GUARD)
             goto ContinueLoop;
 
-        readSize = basicInfo.RegionSize;
-
-        if (basicInfo.RegionSize > bufferSize)
-        {
-            // Don't allocate a huge buffer though.
-            if (basicInfo.RegionSize <= 16 * 1024 * 1024) // 16 MB
-            {
-                PhFreePage(buffer);
-                bufferSize = basicInfo.RegionSize;
-                buffer = PhAllocatePage(bufferSize, NULL);
-
-                if (!buffer)
-                    break;
-            }
-            else
-            {
-                readSize = bufferSize;
-            }
-        }
-
-        for (offset = 0; offset < basicInfo.RegionSize; offset += readSize)
+        for (offset = 0; offset < basicInfo.RegionSize; offset += PH_MEMORY_STRING_CHUNK_SIZE)
         {
-            ULONG_PTR i;
-            UCHAR byte; // current byte
-            UCHAR byte1; // previous byte
-            UCHAR byte2; // byte before previous byte
-            BOOLEAN printable;
-            BOOLEAN printable1;
-            BOOLEAN printable2;
-            ULONG length;
-
-            if (!NT_SUCCESS(PhReadVirtualMemory(
-                ProcessHandle,
-                PTR_ADD_OFFSET(baseAddress, offset),
-                buffer,
-                readSize,
-                NULL
-                )))
-                continue;
-
-            byte1 = 0;
-            byte2 = 0;
-            printable1 = FALSE;
-            printable2 = FALSE;
-            length = 0;
-
-            for (i = 0; i < readSize; i++)
-            {
-                byte = buffer[i];
-                printable = PhCharIsPrintable[byte];
-
-                // To find strings Process Hacker uses a state table.
-                // * byte2 - byte before previous byte
-                // * byte1 - previous byte
-                // * byte - current byte
-                // * length - length of current string run
-                //
-                // The states are described below.
-                //
-                //    [byte2] [byte1] [byte] ...
-                //    [char] means printable, [oth] means non-printable.
-                //
-                // 1. [char] [char] [char] ...
-                //      (we're in a non-wide sequence)
-                //      -> append char.
-                // 2. [char] [char] [oth] ...
-                //      (we reached the end of a non-wide sequence, or we need to start a wide sequence)
-                //      -> if current string is big enough, create result (non-wide).
-                //         otherwise if byte = null, reset to new string with byte1 as first character.
-                //         otherwise if byte != null, reset to new string.
-                // 3. [char] [oth] [char] ...
-                //      (we're in a wide sequence)
-                //      -> (byte1 should = null) append char.
-                // 4. [char] [oth] [oth] ...
-                //      (we reached the end of a wide sequence)
-                //      -> (byte1 should = null) if the current string is big enough, create result (wide).
-                //         otherwise, reset to new string.
-                // 5. [oth] [char] [char] ...
-                //      (we reached the end of a wide sequence, or we need to start a non-wide sequence)
-                //      -> (excluding byte1) if the current string is big enough, create result (wide).
-                //         otherwise, reset to new string with byte1 as first character and byte as
-                //         second character.
-                // 6. [oth] [char] [oth] ...
-                //      (we're in a wide sequence)
-                //      -> (byte2 and byte should = null) do nothing.
-                // 7. [oth] [oth] [char] ...
-                //      (we're starting a sequence, but we don't know if it's a wide or non-wide sequence)
-                //      -> append char.
-                // 8. [oth] [oth] [oth] ...
-                //      (nothing)
-                //      -> do nothing.
-
-                if (printable2 && printable1 && printable)
-                {
-                    if (length < displayBufferCount)
-                        displayBuffer[length] = byte;
-
-                    length++;
-                }
-                else if (printable2 && printable1 && !printable)
-                {
-                    if (length >= minimumLength)
-                    {
-                        goto CreateResult;
-                    }
-                    else if (byte == 0)
-                    {
-                        length = 1;
-                        displayBuffer[0] = byte1;
-                    }
-                    else
-                    {
-                        length = 0;
-                    }
-                }
-                else if (printable2 && !printable1 && printable)
-                {
-                    if (byte1 == 0)
-                    {
-                        if (length < displayBufferCount)
-                            displayBuffer[length] = byte;
-
-                        length++;
-                    }
-                }
-                else if (printable2 && !printable1 && !printable)
-                {
-                    if (length >= minimumLength)
-                    {
-                        goto CreateResult;
-                    }
-                    else
-                    {
-                        length = 0;
-                    }
-                }
-                else if (!printable2 && printable1 && printable)
-                {
-                    if (length >= minimumLength + 1) // length - 1 >= minimumLength but avoiding underflow
-                    {
-                        length--; // exclude byte1
-                        goto CreateResult;
-                    }
-                    else
-                    {
-                        length = 2;
-                        displayBuffer[0] = byte1;
-                        displayBuffer[1] = byte;
-                    }
-                }
-                else if (!printable2 && printable1 && !printable)
-                {
-                    // Nothing
-                }
-                else if (!printable2 && !printable1 && printable)
-                {
-                    if (length < displayBufferCount)
-                        displayBuffer[length] = byte;
-
-                    length++;
-                }
-                else if (!printable2 && !printable1 && !printable)
-                {
-                    // Nothing
-                }
-
-                goto AfterCreateResult;
-
-CreateResult:
-                {
-                    PPH_MEMORY_RESULT result;
-                    ULONG lengthInBytes;
-                    ULONG bias;
-                    BOOLEAN isWide;
-                    ULONG displayLength;
-
-                    lengthInBytes = length;
-                    bias = 0;
-                    isWide = FALSE;
-
-                    if (printable1 == printable) // determine if string was wide (refer to state table, 4 and 5)
-                    {
-                        isWide = TRUE;
-                        lengthInBytes *= 2;
-                    }
-
-                    if (printable) // byte1 excluded (refer to state table, 5)
-                    {
-                        bias = 1;
-                    }
-
-                    if (!(isWide && !detectUnicode) && (result = PhCreateMemoryResult(
-                        PTR_ADD_OFFSET(baseAddress, i - bias - lengthInBytes),
-                        lengthInBytes
-                        )))
-                    {
-                        displayLength = (ULONG)(min(length, displayBufferCount) * sizeof(WCHAR));
-
-                        if (result->Display.Buffer = PhAllocateForMemorySearch(displayLength + sizeof(WCHAR)))
-                        {
-                            memcpy(result->Display.Buffer, displayBuffer, displayLength);
-                            result->Display.Buffer[displayLength / sizeof(WCHAR)] = 0;
-                            result->Display.Length = displayLength;
-                        }
-
-                        Options->Header.Callback(
-                            result,
-                            Options->Header.Context
-                            );
-                    }
+            PPHP_MEMORY_STRING_CHUNK chunk;
 
-                    length = 0;
-                }
-AfterCreateResult:
+            chunk = PhAllocate(sizeof(PHP_MEMORY_STRING_CHUNK));
+            chunk->Search = &search;
+            chunk->BaseAddress = PTR_ADD_OFFSET(baseAddress, offset);
+            chunk->Size = min(basicInfo.RegionSize - offset, PH_MEMORY_STRING_CHUNK_SIZE);
 
-                byte2 = byte1;
-                byte1 = byte;
-                printable2 = printable1;
-                printable1 = printable;
-            }
+            PhQueueItemsWorkQueueEx(&workQueue, PhpSearchMemoryStringChunkFunction, &chunk, 1, &workQueueBatch);
         }
 
 ContinueLoop:
         baseAddress = PTR_ADD_OFFSET(baseAddress, basicInfo.RegionSize);
     }
 
-    if (buffer)
-        PhFreePage(buffer);
+    PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+    PhDeleteWorkQueue(&workQueue);
+
+    while (listEntry = RtlInterlockedPopEntrySList(&search.BufferListHead))
+    {
+        PPHP_MEMORY_STRING_BUFFER buffer = CONTAINING_RECORD(listEntry, PHP_MEMORY_STRING_BUFFER, ListEntry);
+
+        PhFreePage(buffer->Buffer);
+        PhFreePage(buffer->DisplayBuffer);
+        PhFree(buffer);
+    }
 }
 
 VOID PhShowMemoryStringDialog(
@@ -499,7 +751,7 @@ VOID PhShowMemoryStringDialog(
         return;
     }
 
-    context.Results = PhCreateList(1024);
+    context.Results = PhCreateMemoryResults();
 
     if (DialogBoxParam(
         PhInstanceHandle,
@@ -583,16 +835,17 @@ INT_PTR CALLBACK PhpMemoryStringDlgProc(
     return FALSE;
 }
 
-static BOOL NTAPI PhpMemoryStringResultCallback(
-    _In_ _Assume_refs_(1) PPH_MEMORY_RESULT Result,
+static VOID NTAPI PhpMemoryStringResultCallback(
+    _In_ PVOID Address,
+    _In_ SIZE_T Length,
+    _In_reads_(TextLength) PUCHAR Text,
+    _In_ ULONG TextLength,
     _In_opt_ PVOID Context
     )
 {
     PMEMORY_STRING_CONTEXT context = Context;
 
-    PhAddItemList(context->Results, Result);
-
-    return TRUE;
+    PhAddMemoryResult(context->Results, Address, Length, Text, TextLength);
 }
 
 NTSTATUS PhpMemoryStringThreadStart(
@@ -615,6 +868,9 @@ NTSTATUS PhpMemoryStringThreadStart(
 
     PhSearchMemoryString(context->ProcessHandle, &context->Options);
 
+    // Chunks are scanned in parallel, so restore the address order.
+    PhSortMemoryResultsByAddress(context->Results);
+
     SendMessage(
         context->WindowHandle,
         WM_PH_MEMORY_STATUS_UPDATE,
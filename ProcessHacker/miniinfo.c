@@ -1316,6 +1316,75 @@ VOID PhMipListSectionSortFunction(
     listSection->Callback(listSection, MiListSectionSortProcessList, &sortList, NULL);
 }
 
+static int __cdecl PhMipProcessNodePointerCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    return uintptrcmp(*(ULONG_PTR *)elem1, *(ULONG_PTR *)elem2);
+}
+
+/**
+ * Moves the highest ranked processes to the front of a process node list.
+ *
+ * \param List A list of PPH_PROCESS_NODE.
+ * \param Type The ranking to use, as maintained by the process provider.
+ *
+ * \remarks Only the top PH_PROCESS_TOP_COUNT processes are ordered. The rest
+ * keep their relative order, which is enough because the group list only walks
+ * past the top processes when they collapse into fewer than
+ * MIP_MAX_PROCESS_GROUPS groups.
+ */
+VOID PhMipSortProcessListByTopItems(
+    _Inout_ PPH_LIST List,
+    _In_ PH_PROCESS_TOP_TYPE Type
+    )
+{
+    PPH_PROCESS_ITEM topItems[PH_PROCESS_TOP_COUNT];
+    PPH_PROCESS_NODE topNodes[PH_PROCESS_TOP_COUNT];
+    PPH_PROCESS_NODE sortedTopNodes[PH_PROCESS_TOP_COUNT];
+    ULONG numberOfTopItems;
+    ULONG numberOfTopNodes = 0;
+    PPH_PROCESS_NODE *items;
+    ULONG count;
+    ULONG i;
+
+    numberOfTopItems = PhGetTopProcessItems(Type, topItems, PH_PROCESS_TOP_COUNT);
+
+    for (i = 0; i < numberOfTopItems; i++)
+    {
+        PPH_PROCESS_NODE node;
+
+        if ((node = PhFindProcessNode(topItems[i]->ProcessId)) && node->ProcessItem == topItems[i])
+            topNodes[numberOfTopNodes++] = node;
+
+        PhDereferenceObject(topItems[i]);
+    }
+
+    if (numberOfTopNodes == 0)
+        return;
+
+    memcpy(sortedTopNodes, topNodes, numberOfTopNodes * sizeof(PPH_PROCESS_NODE));
+    qsort(sortedTopNodes, numberOfTopNodes, sizeof(PPH_PROCESS_NODE), PhMipProcessNodePointerCompare);
+
+    items = PhAllocate((List->Count + numberOfTopNodes) * sizeof(PPH_PROCESS_NODE));
+    memcpy(items, topNodes, numberOfTopNodes * sizeof(PPH_PROCESS_NODE));
+    count = numberOfTopNodes;
+
+    for (i = 0; i < List->Count; i++)
+    {
+        if (!bsearch(&List->Items[i], sortedTopNodes, numberOfTopNodes, sizeof(PPH_PROCESS_NODE), PhMipProcessNodePointerCompare))
+            items[count++] = List->Items[i];
+    }
+
+    // The list and PhFindProcessNode both come from the process tree, so every top node
+    // should have been found exactly once. Leave the list alone if that is not the case.
+    if (count == List->Count)
+        memcpy(List->Items, items, count * sizeof(PPH_PROCESS_NODE));
+
+    PhFree(items);
+}
+
 VOID PhMipTickListSection(
     _In_ PPH_MINIINFO_LIST_SECTION ListSection
     )
@@ -1863,8 +1932,7 @@ BOOLEAN PhMipCpuListSectionCallback(
         {
             PPH_MINIINFO_LIST_SECTION_SORT_LIST sortList = Parameter1;
 
-            qsort(sortList->List->Items, sortList->List->Count,
-                sizeof(PPH_PROCESS_NODE), PhMipCpuListSectionProcessCompareFunction);
+            PhMipSortProcessListByTopItems(sortList->List, PhProcessTopCpu);
         }
         return TRUE;
     case MiListSectionAssignSortData:
@@ -1910,23 +1978,6 @@ BOOLEAN PhMipCpuListSectionCallback(
     return FALSE;
 }
 
-int __cdecl PhMipCpuListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    int result;
-    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)elem1;
-    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)elem2;
-
-    result = singlecmp(node2->ProcessItem->CpuUsage, node1->ProcessItem->CpuUsage);
-
-    if (result == 0)
-        result = uint64cmp(node2->ProcessItem->UserTime.QuadPart, node1->ProcessItem->UserTime.QuadPart);
-
-    return result;
-}
-
 int __cdecl PhMipCpuListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -1965,8 +2016,7 @@ BOOLEAN PhMipCommitListSectionCallback(
         {
             PPH_MINIINFO_LIST_SECTION_SORT_LIST sortList = Parameter1;
 
-            qsort(sortList->List->Items, sortList->List->Count,
-                sizeof(PPH_PROCESS_NODE), PhMipCommitListSectionProcessCompareFunction);
+            PhMipSortProcessListByTopItems(sortList->List, PhProcessTopPrivateBytes);
         }
         return TRUE;
     case MiListSectionAssignSortData:
@@ -2006,17 +2056,6 @@ BOOLEAN PhMipCommitListSectionCallback(
     return FALSE;
 }
 
-int __cdecl PhMipCommitListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)elem1;
-    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)elem2;
-
-    return uintptrcmp(node2->ProcessItem->VmCounters.PagefileUsage, node1->ProcessItem->VmCounters.PagefileUsage);
-}
-
 int __cdecl PhMipCommitListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -2056,8 +2095,7 @@ BOOLEAN PhMipPhysicalListSectionCallback(
         {
             PPH_MINIINFO_LIST_SECTION_SORT_LIST sortList = Parameter1;
 
-            qsort(sortList->List->Items, sortList->List->Count,
-                sizeof(PPH_PROCESS_NODE), PhMipPhysicalListSectionProcessCompareFunction);
+            PhMipSortProcessListByTopItems(sortList->List, PhProcessTopWorkingSet);
         }
         return TRUE;
     case MiListSectionAssignSortData:
@@ -2097,17 +2135,6 @@ BOOLEAN PhMipPhysicalListSectionCallback(
     return FALSE;
 }
 
-int __cdecl PhMipPhysicalListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)elem1;
-    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)elem2;
-
-    return uintptrcmp(node2->ProcessItem->VmCounters.WorkingSetSize, node1->ProcessItem->VmCounters.WorkingSetSize);
-}
-
 int __cdecl PhMipPhysicalListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -2152,8 +2179,7 @@ BOOLEAN PhMipIoListSectionCallback(
         {
             PPH_MINIINFO_LIST_SECTION_SORT_LIST sortList = Parameter1;
 
-            qsort(sortList->List->Items, sortList->List->Count,
-                sizeof(PPH_PROCESS_NODE), PhMipIoListSectionProcessCompareFunction);
+            PhMipSortProcessListByTopItems(sortList->List, PhProcessTopIo);
         }
         return TRUE;
     case MiListSectionAssignSortData:
@@ -2201,27 +2227,6 @@ BOOLEAN PhMipIoListSectionCallback(
     return FALSE;
 }
 
-int __cdecl PhMipIoListSectionProcessCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    int result;
-    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)elem1;
-    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)elem2;
-    ULONG64 delta1 = node1->ProcessItem->IoReadDelta.Delta + node1->ProcessItem->IoWriteDelta.Delta + node1->ProcessItem->IoOtherDelta.Delta;
-    ULONG64 delta2 = node2->ProcessItem->IoReadDelta.Delta + node2->ProcessItem->IoWriteDelta.Delta + node2->ProcessItem->IoOtherDelta.Delta;
-    ULONG64 value1 = node1->ProcessItem->IoReadDelta.Value + node1->ProcessItem->IoWriteDelta.Value + node1->ProcessItem->IoOtherDelta.Value;
-    ULONG64 value2 = node2->ProcessItem->IoReadDelta.Value + node2->ProcessItem->IoWriteDelta.Value + node2->ProcessItem->IoOtherDelta.Value;
-
-    result = uint64cmp(delta2, delta1);
-
-    if (result == 0)
-        result = uint64cmp(value2, value1);
-
-    return result;
-}
-
 int __cdecl PhMipIoListSectionNodeCompareFunction(
     _In_ const void *elem1,
     _In_ const void *elem2
@@ -27,14 +27,14 @@
 #include <emenu.h>
 #include <verify.h>
 
-BOOLEAN PhpModuleNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    );
-
-ULONG PhpModuleNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    );
+#undef T
+#undef K
+#define T PPH_MODULE_NODE
+#define K PPH_MODULE_ITEM
+#define PH_OPEN_HASHTABLE_KEY(Entry) ((Entry)->ModuleItem)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_POINTER
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_SCALAR
+#include <ohashtbl_i.h>
 
 VOID PhpDestroyModuleNode(
     _In_ PPH_MODULE_NODE ModuleNode
@@ -71,13 +71,8 @@ VOID PhInitializeModuleList(
     memset(Context, 0, sizeof(PH_MODULE_LIST_CONTEXT));
     Context->EnableStateHighlighting = TRUE;
 
-    Context->NodeHashtable = PhCreateHashtable(
-        sizeof(PPH_MODULE_NODE),
-        PhpModuleNodeHashtableCompareFunction,
-        PhpModuleNodeHashtableHashFunction,
-        100
-        );
-    Context->NodeList = PhCreateList(100);
+    PhInitializeOpenHashtable_PPH_MODULE_NODE(&Context->NodeHashtable, 100);
+    PhInitializeArray_PPH_MODULE_NODE(&Context->NodeList, 100);
 
     Context->ParentWindowHandle = ParentWindowHandle;
     Context->TreeNewHandle = TreeNewHandle;
@@ -127,29 +122,11 @@ VOID PhDeleteModuleList(
 
     PhCmDeleteManager(&Context->Cm);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
-        PhpDestroyModuleNode(Context->NodeList->Items[i]);
-
-    PhDereferenceObject(Context->NodeHashtable);
-    PhDereferenceObject(Context->NodeList);
-}
-
-BOOLEAN PhpModuleNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    )
-{
-    PPH_MODULE_NODE moduleNode1 = *(PPH_MODULE_NODE *)Entry1;
-    PPH_MODULE_NODE moduleNode2 = *(PPH_MODULE_NODE *)Entry2;
+    for (i = 0; i < Context->NodeList.Count; i++)
+        PhpDestroyModuleNode(Context->NodeList.Items[i]);
 
-    return moduleNode1->ModuleItem == moduleNode2->ModuleItem;
-}
-
-ULONG PhpModuleNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    )
-{
-    return PhHashIntPtr((ULONG_PTR)(*(PPH_MODULE_NODE *)Entry)->ModuleItem);
+    PhDeleteOpenHashtable_PPH_MODULE_NODE(&Context->NodeHashtable);
+    PhDeleteArray_PPH_MODULE_NODE(&Context->NodeList);
 }
 
 VOID PhLoadSettingsModuleList(
@@ -211,8 +188,8 @@ PPH_MODULE_NODE PhAddModuleNode(
     moduleNode->Node.TextCache = moduleNode->TextCache;
     moduleNode->Node.TextCacheSize = PHMOTLC_MAXIMUM;
 
-    PhAddEntryHashtable(Context->NodeHashtable, &moduleNode);
-    PhAddItemList(Context->NodeList, moduleNode);
+    PhAddEntryOpenHashtable_PPH_MODULE_NODE(&Context->NodeHashtable, moduleNode, NULL);
+    PhAddItemArray_PPH_MODULE_NODE(&Context->NodeList, moduleNode);
 
     PhEmCallObjectOperation(EmModuleNodeType, moduleNode, EmObjectCreate);
 
@@ -226,16 +203,9 @@ PPH_MODULE_NODE PhFindModuleNode(
     _In_ PPH_MODULE_ITEM ModuleItem
     )
 {
-    PH_MODULE_NODE lookupModuleNode;
-    PPH_MODULE_NODE lookupModuleNodePtr = &lookupModuleNode;
     PPH_MODULE_NODE *moduleNode;
 
-    lookupModuleNode.ModuleItem = ModuleItem;
-
-    moduleNode = (PPH_MODULE_NODE *)PhFindEntryHashtable(
-        Context->NodeHashtable,
-        &lookupModuleNodePtr
-        );
+    moduleNode = PhFindEntryOpenHashtable_PPH_MODULE_NODE(&Context->NodeHashtable, ModuleItem);
 
     if (moduleNode)
         return *moduleNode;
@@ -249,7 +219,7 @@ VOID PhRemoveModuleNode(
     )
 {
     // Remove from the hashtable here to avoid problems in case the key is re-used.
-    PhRemoveEntryHashtable(Context->NodeHashtable, &ModuleNode);
+    PhRemoveEntryOpenHashtable_PPH_MODULE_NODE(&Context->NodeHashtable, ModuleNode->ModuleItem);
 
     if (Context->EnableStateHighlighting)
     {
@@ -294,8 +264,8 @@ VOID PhpRemoveModuleNode(
 
     // Remove from list and cleanup.
 
-    if ((index = PhFindItemList(Context->NodeList, ModuleNode)) != -1)
-        PhRemoveItemList(Context->NodeList, index);
+    if ((index = PhFindItemArray_PPH_MODULE_NODE(&Context->NodeList, ModuleNode)) != -1)
+        PhRemoveItemArray_PPH_MODULE_NODE(&Context->NodeList, index);
 
     PhpDestroyModuleNode(ModuleNode);
 
@@ -531,8 +501,8 @@ BOOLEAN NTAPI PhpModuleTreeNewCallback(
                 else
                 {
                     if (!PhCmForwardSort(
-                        (PPH_TREENEW_NODE *)context->NodeList->Items,
-                        context->NodeList->Count,
+                        (PPH_TREENEW_NODE *)context->NodeList.Items,
+                        context->NodeList.Count,
                         context->TreeNewSortColumn,
                         context->TreeNewSortOrder,
                         &context->Cm
@@ -551,11 +521,11 @@ BOOLEAN NTAPI PhpModuleTreeNewCallback(
 
                 if (sortFunction)
                 {
-                    qsort_s(context->NodeList->Items, context->NodeList->Count, sizeof(PVOID), sortFunction, context);
+                    qsort_s(context->NodeList.Items, context->NodeList.Count, sizeof(PPH_MODULE_NODE), sortFunction, context);
                 }
 
-                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList->Items;
-                getChildren->NumberOfChildren = context->NodeList->Count;
+                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList.Items;
+                getChildren->NumberOfChildren = context->NodeList.Count;
             }
         }
         return TRUE;
@@ -653,6 +623,10 @@ BOOLEAN NTAPI PhpModuleTreeNewCallback(
                 {
                     PhInitializeStringRef(&getCellText->Text,
                         moduleItem->VerifyResult == VrTrusted ? L"Trusted" : L"Not Trusted");
+
+                    // The row is visible, so verify it before the hidden ones.
+                    if (moduleItem->VerifyResult == VrUnknown)
+                        PhPrioritizeVerifyFile(&moduleItem->VerifyRequest);
                 }
                 else
                 {
@@ -661,6 +635,9 @@ BOOLEAN NTAPI PhpModuleTreeNewCallback(
                 break;
             case PHMOTLC_VERIFIEDSIGNER:
                 getCellText->Text = PhGetStringRef(moduleItem->VerifySignerName);
+
+                if (moduleItem->VerifyResult == VrUnknown)
+                    PhPrioritizeVerifyFile(&moduleItem->VerifyRequest);
                 break;
             case PHMOTLC_ASLR:
                 if (WindowsVersion >= WINDOWS_VISTA)
@@ -928,9 +905,9 @@ PPH_MODULE_ITEM PhGetSelectedModuleItem(
     PPH_MODULE_ITEM moduleItem = NULL;
     ULONG i;
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_MODULE_NODE node = Context->NodeList->Items[i];
+        PPH_MODULE_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
@@ -953,9 +930,9 @@ VOID PhGetSelectedModuleItems(
 
     list = PhCreateList(2);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_MODULE_NODE node = Context->NodeList->Items[i];
+        PPH_MODULE_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
@@ -24,6 +24,9 @@
 #include <verify.h>
 #include <extmgri.h>
 
+// The number of updates after which the module list is enumerated even if no change was detected.
+#define PH_MODULE_PROVIDER_FULL_SCAN_INTERVAL 10
+
 typedef struct _PH_MODULE_QUERY_DATA
 {
     SLIST_ENTRY ListEntry;
@@ -44,15 +47,6 @@ VOID NTAPI PhpModuleItemDeleteProcedure(
     _In_ ULONG Flags
     );
 
-BOOLEAN NTAPI PhpModuleHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    );
-
-ULONG NTAPI PhpModuleHashtableHashFunction(
-    _In_ PVOID Entry
-    );
-
 PPH_OBJECT_TYPE PhModuleProviderType;
 PPH_OBJECT_TYPE PhModuleItemType;
 
@@ -78,12 +72,7 @@ PPH_MODULE_PROVIDER PhCreateModuleProvider(
         PhModuleProviderType
         );
 
-    moduleProvider->ModuleHashtable = PhCreateHashtable(
-        sizeof(PPH_MODULE_ITEM),
-        PhpModuleHashtableCompareFunction,
-        PhpModuleHashtableHashFunction,
-        20
-        );
+    PhInitializeOpenHashtable_PPH_MODULE_ITEM(&moduleProvider->ModuleHashtable, 20);
     PhInitializeFastLock(&moduleProvider->ModuleHashtableLock);
 
     PhInitializeCallback(&moduleProvider->ModuleAddedEvent);
@@ -141,7 +130,7 @@ VOID PhpModuleProviderDeleteProcedure(
     // when we added them to the hashtable).
     PhDereferenceAllModuleItems(moduleProvider);
 
-    PhDereferenceObject(moduleProvider->ModuleHashtable);
+    PhDeleteOpenHashtable_PPH_MODULE_ITEM(&moduleProvider->ModuleHashtable);
     PhDeleteFastLock(&moduleProvider->ModuleHashtableLock);
     PhDeleteCallback(&moduleProvider->ModuleAddedEvent);
     PhDeleteCallback(&moduleProvider->ModuleModifiedEvent);
@@ -201,43 +190,26 @@ VOID PhpModuleItemDeleteProcedure(
     PhDeleteImageVersionInfo(&moduleItem->VersionInfo);
 }
 
-BOOLEAN NTAPI PhpModuleHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    )
-{
-    return
-        (*(PPH_MODULE_ITEM *)Entry1)->BaseAddress ==
-        (*(PPH_MODULE_ITEM *)Entry2)->BaseAddress;
-}
-
-ULONG NTAPI PhpModuleHashtableHashFunction(
-    _In_ PVOID Entry
-    )
-{
-    PVOID baseAddress = (*(PPH_MODULE_ITEM *)Entry)->BaseAddress;
-
-    return PhHashIntPtr((ULONG_PTR)baseAddress);
-}
+#undef T
+#undef K
+#define T PPH_MODULE_ITEM
+#define K PVOID
+#define PH_OPEN_HASHTABLE_KEY(Entry) ((Entry)->BaseAddress)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_POINTER
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_SCALAR
+#include <ohashtbl_i.h>
 
 PPH_MODULE_ITEM PhReferenceModuleItem(
     _In_ PPH_MODULE_PROVIDER ModuleProvider,
     _In_ PVOID BaseAddress
     )
 {
-    PH_MODULE_ITEM lookupModuleItem;
-    PPH_MODULE_ITEM lookupModuleItemPtr = &lookupModuleItem;
     PPH_MODULE_ITEM *moduleItemPtr;
     PPH_MODULE_ITEM moduleItem;
 
-    lookupModuleItem.BaseAddress = BaseAddress;
-
     PhAcquireFastLockShared(&ModuleProvider->ModuleHashtableLock);
 
-    moduleItemPtr = (PPH_MODULE_ITEM *)PhFindEntryHashtable(
-        ModuleProvider->ModuleHashtable,
-        &lookupModuleItemPtr
-        );
+    moduleItemPtr = PhFindEntryOpenHashtable_PPH_MODULE_ITEM(&ModuleProvider->ModuleHashtable, BaseAddress);
 
     if (moduleItemPtr)
     {
@@ -263,7 +235,7 @@ VOID PhDereferenceAllModuleItems(
 
     PhAcquireFastLockExclusive(&ModuleProvider->ModuleHashtableLock);
 
-    while (PhEnumHashtable(ModuleProvider->ModuleHashtable, (PVOID *)&moduleItem, &enumerationKey))
+    while (PhEnumOpenHashtable_PPH_MODULE_ITEM(&ModuleProvider->ModuleHashtable, &moduleItem, &enumerationKey))
     {
         PhDereferenceObject(*moduleItem);
     }
@@ -276,28 +248,24 @@ VOID PhpRemoveModuleItem(
     _In_ PPH_MODULE_ITEM ModuleItem
     )
 {
-    PhRemoveEntryHashtable(ModuleProvider->ModuleHashtable, &ModuleItem);
+    PhRemoveEntryOpenHashtable_PPH_MODULE_ITEM(&ModuleProvider->ModuleHashtable, ModuleItem->BaseAddress);
     PhDereferenceObject(ModuleItem);
 }
 
-NTSTATUS PhpModuleQueryWorker(
-    _In_ PVOID Parameter
+VOID NTAPI PhpModuleVerifyCallback(
+    _In_ VERIFY_RESULT VerifyResult,
+    _In_opt_ _Assume_refs_(1) PPH_STRING SignerName,
+    _In_opt_ PVOID Context
     )
 {
-    PPH_MODULE_QUERY_DATA data = (PPH_MODULE_QUERY_DATA)Parameter;
+    PPH_MODULE_QUERY_DATA data = (PPH_MODULE_QUERY_DATA)Context;
 
-    data->VerifyResult = PhVerifyFileCached(
-        data->ModuleItem->FileName,
-        PhGetString(data->ModuleProvider->PackageFullName),
-        &data->VerifySignerName,
-        FALSE
-        );
+    data->VerifyResult = VerifyResult;
+    data->VerifySignerName = SignerName;
 
     RtlInterlockedPushEntrySList(&data->ModuleProvider->QueryListHead, &data->ListEntry);
 
     PhDereferenceObject(data->ModuleProvider);
-
-    return STATUS_SUCCESS;
 }
 
 VOID PhpQueueModuleQuery(
@@ -317,7 +285,13 @@ VOID PhpQueueModuleQuery(
 
     PhReferenceObject(ModuleProvider);
     PhReferenceObject(ModuleItem);
-    PhQueueItemGlobalWorkQueue(PhpModuleQueryWorker, data);
+    PhQueueVerifyFile(
+        ModuleItem->FileName,
+        ModuleProvider->PackageFullName,
+        PhpModuleVerifyCallback,
+        data,
+        &ModuleItem->VerifyRequest
+        );
 }
 
 static BOOLEAN NTAPI EnumModulesCallback(
@@ -336,6 +310,113 @@ static BOOLEAN NTAPI EnumModulesCallback(
     return TRUE;
 }
 
+/**
+ * Determines whether the modules of a process may have changed since the last update.
+ *
+ * \param ModuleProvider The module provider.
+ *
+ * \return TRUE if the module list needs to be enumerated again, otherwise FALSE.
+ *
+ * \remarks Loading or unloading a module changes the head of the loader's module list
+ * or the size of the address space, and mapping or unmapping an image also changes the
+ * size of the address space. Both can be queried with a couple of system calls, which
+ * is much cheaper than walking the loader lists and the address space. Since other
+ * allocations can hide a change in size, the full enumeration is still done every
+ * PH_MODULE_PROVIDER_FULL_SCAN_INTERVAL updates.
+ */
+static BOOLEAN PhpModuleProviderHasChanged(
+    _Inout_ PPH_MODULE_PROVIDER ModuleProvider
+    )
+{
+    VM_COUNTERS vmCounters;
+    LIST_ENTRY loaderListHead;
+    BOOLEAN changed;
+
+    if (ModuleProvider->ProcessId == SYSTEM_PROCESS_ID || !ModuleProvider->ProcessHandle)
+        return TRUE;
+
+    if (!ModuleProvider->LoaderListHeadAddress)
+    {
+        PROCESS_BASIC_INFORMATION basicInfo;
+        PPEB_LDR_DATA ldr;
+
+        if (!NT_SUCCESS(PhGetProcessBasicInformation(ModuleProvider->ProcessHandle, &basicInfo)))
+            return TRUE;
+
+        // The loader data may not exist yet if the process is still starting.
+        if (!NT_SUCCESS(PhReadVirtualMemory(
+            ModuleProvider->ProcessHandle,
+            PTR_ADD_OFFSET(basicInfo.PebBaseAddress, FIELD_OFFSET(PEB, Ldr)),
+            &ldr,
+            sizeof(PVOID),
+            NULL
+            )) || !ldr)
+        {
+            return TRUE;
+        }
+
+        ModuleProvider->LoaderListHeadAddress = PTR_ADD_OFFSET(ldr, FIELD_OFFSET(PEB_LDR_DATA, InLoadOrderModuleList));
+    }
+
+    if (!NT_SUCCESS(NtQueryInformationProcess(
+        ModuleProvider->ProcessHandle,
+        ProcessVmCounters,
+        &vmCounters,
+        sizeof(VM_COUNTERS),
+        NULL
+        )))
+    {
+        return TRUE;
+    }
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        ModuleProvider->ProcessHandle,
+        ModuleProvider->LoaderListHeadAddress,
+        &loaderListHead,
+        sizeof(LIST_ENTRY),
+        NULL
+        )))
+    {
+        return TRUE;
+    }
+
+    changed =
+        vmCounters.VirtualSize != ModuleProvider->LastVirtualSize ||
+        loaderListHead.Flink != ModuleProvider->LastLoaderListHead.Flink ||
+        loaderListHead.Blink != ModuleProvider->LastLoaderListHead.Blink;
+
+    ModuleProvider->LastVirtualSize = vmCounters.VirtualSize;
+    ModuleProvider->LastLoaderListHead = loaderListHead;
+
+    if (++ModuleProvider->UpdatesSinceFullScan >= PH_MODULE_PROVIDER_FULL_SCAN_INTERVAL)
+        changed = TRUE;
+
+    return changed;
+}
+
+static VOID PhpFlushModuleQueryData(
+    _In_ PPH_MODULE_PROVIDER ModuleProvider
+    )
+{
+    PSLIST_ENTRY entry;
+    PPH_MODULE_QUERY_DATA data;
+
+    entry = RtlInterlockedFlushSList(&ModuleProvider->QueryListHead);
+
+    while (entry)
+    {
+        data = CONTAINING_RECORD(entry, PH_MODULE_QUERY_DATA, ListEntry);
+        entry = entry->Next;
+
+        data->ModuleItem->VerifyResult = data->VerifyResult;
+        data->ModuleItem->VerifySignerName = data->VerifySignerName;
+        data->ModuleItem->JustProcessed = TRUE;
+
+        PhDereferenceObject(data->ModuleItem);
+        PhFree(data);
+    }
+}
+
 VOID PhModuleProviderUpdate(
     _In_ PVOID Object
     )
@@ -350,6 +431,27 @@ VOID PhModuleProviderUpdate(
     if (!moduleProvider->ProcessHandle && moduleProvider->ProcessId != SYSTEM_PROCESS_ID)
         goto UpdateExit;
 
+    // If nothing changed, only report the modules that have finished verifying.
+    if (!PhpModuleProviderHasChanged(moduleProvider))
+    {
+        ULONG enumerationKey = 0;
+        PPH_MODULE_ITEM *moduleItem;
+
+        PhpFlushModuleQueryData(moduleProvider);
+
+        while (PhEnumOpenHashtable_PPH_MODULE_ITEM(&moduleProvider->ModuleHashtable, &moduleItem, &enumerationKey))
+        {
+            if ((*moduleItem)->JustProcessed)
+            {
+                (*moduleItem)->JustProcessed = FALSE;
+                PhInvokeCallback(&moduleProvider->ModuleModifiedEvent, *moduleItem);
+            }
+        }
+
+        goto UpdateExit;
+    }
+
+    moduleProvider->UpdatesSinceFullScan = 0;
     modules = PhCreateList(20);
 
     moduleProvider->RunStatus = PhEnumGenericModules(
@@ -360,13 +462,17 @@ VOID PhModuleProviderUpdate(
         modules
         );
 
+    // Don't trust the change detection until we have a complete list.
+    if (!NT_SUCCESS(moduleProvider->RunStatus))
+        moduleProvider->UpdatesSinceFullScan = PH_MODULE_PROVIDER_FULL_SCAN_INTERVAL;
+
     // Look for removed modules.
     {
         PPH_LIST modulesToRemove = NULL;
         ULONG enumerationKey = 0;
         PPH_MODULE_ITEM *moduleItem;
 
-        while (PhEnumHashtable(moduleProvider->ModuleHashtable, (PVOID *)&moduleItem, &enumerationKey))
+        while (PhEnumOpenHashtable_PPH_MODULE_ITEM(&moduleProvider->ModuleHashtable, &moduleItem, &enumerationKey))
         {
             BOOLEAN found = FALSE;
 
@@ -411,26 +517,8 @@ VOID PhModuleProviderUpdate(
         }
     }
 
-    // Go through the queued thread query data.
-    {
-        PSLIST_ENTRY entry;
-        PPH_MODULE_QUERY_DATA data;
-
-        entry = RtlInterlockedFlushSList(&moduleProvider->QueryListHead);
-
-        while (entry)
-        {
-            data = CONTAINING_RECORD(entry, PH_MODULE_QUERY_DATA, ListEntry);
-            entry = entry->Next;
-
-            data->ModuleItem->VerifyResult = data->VerifyResult;
-            data->ModuleItem->VerifySignerName = data->VerifySignerName;
-            data->ModuleItem->JustProcessed = TRUE;
-
-            PhDereferenceObject(data->ModuleItem);
-            PhFree(data);
-        }
-    }
+    // Go through the queued module query data.
+    PhpFlushModuleQueryData(moduleProvider);
 
     // Look for new modules.
     for (i = 0; i < modules->Count; i++)
@@ -455,13 +543,10 @@ VOID PhModuleProviderUpdate(
 
             moduleItem->Name = module->Name;
             PhReferenceObject(moduleItem->Name);
-            moduleItem->FileName = module->FileName;
-            PhReferenceObject(moduleItem->FileName);
+            // The same DLLs are loaded into most processes.
+            moduleItem->FileName = PhInternString(module->FileName);
 
-            PhInitializeImageVersionInfo(
-                &moduleItem->VersionInfo,
-                PhGetString(moduleItem->FileName)
-                );
+            PhInitializeImageVersionInfoCached(&moduleItem->VersionInfo, moduleItem->FileName);
 
             moduleItem->IsFirst = i == 0;
 
@@ -526,7 +611,7 @@ VOID PhModuleProviderUpdate(
 
             // Add the module item to the hashtable.
             PhAcquireFastLockExclusive(&moduleProvider->ModuleHashtableLock);
-            PhAddEntryHashtable(moduleProvider->ModuleHashtable, &moduleItem);
+            PhAddEntryOpenHashtable_PPH_MODULE_ITEM(&moduleProvider->ModuleHashtable, moduleItem, NULL);
             PhReleaseFastLockExclusive(&moduleProvider->ModuleHashtableLock);
 
             // Raise the module added event.
@@ -0,0 +1,888 @@
+/*
+ * Process Hacker -
+ *   headless monitoring mode
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The monitor runs the provider engine without any windows and writes one sample per provider
+ * run:
+ *
+ * -c -ctype monitor -caction json|binary|delta [-cobject <output>] [-cvalue <fields>]
+ *
+ * The output is stdout by default. It can also be a file name or a named pipe
+ * (\\.\pipe\<name>). For a pipe, the monitor creates the pipe and waits for a reader. The field
+ * list is comma-separated; see PhpMonitorFieldNames. The monitor exits when the output can no
+ * longer be written to.
+ *
+ * JSON output has one line per sample:
+ *
+ * {"time":<FILETIME>,"processes":[{"pid":4,<fields>},...]}
+ *
+ * Binary output starts with a PH_MONITOR_HEADER. Each sample is a PH_MONITOR_SAMPLE_HEADER
+ * followed by one record per process: the process ID as a ULONG, then each selected field in
+ * order. "name" is a USHORT byte count followed by UTF-16 characters, "cpu" is a ULONG in
+ * hundredths of a percent, and every other field is a ULONG64.
+ *
+ * Delta output is meant for a remote viewer and only carries what has changed since the previous
+ * sample. It starts with a PH_MONITOR_HEADER with the PH_MONITOR_DELTA_MAGIC magic. All integers
+ * are LEB128 varints; signed values are zigzag-encoded first. Each sample is its length in bytes,
+ * then the time elapsed since the previous sample (in 100ns units), then a list of records ended
+ * by a 0 tag:
+ *
+ * 1 (added), process ID, field mask, values
+ * 2 (removed), process ID
+ * 3 (changed), process ID, field mask, values
+ *
+ * Removals come before any other record in a sample. The field mask has one bit per
+ * PH_MONITOR_FIELD and the values follow in field order. Numeric values are the signed difference
+ * from the last value sent for the process (so an added record carries the value itself), and
+ * "name" is a byte count followed by UTF-16 characters, sent only when a process is added. When the output is a pipe, the reader subscribes by writing the
+ * byte count and the ASCII field list (in -cvalue syntax) as soon as it connects; an empty list
+ * keeps the fields given on the command line.
+ */
+
+#include <phapp.h>
+#include <monitor.h>
+
+#include <settings.h>
+
+typedef enum _PH_MONITOR_FORMAT
+{
+    PhMonitorFormatJson,
+    PhMonitorFormatBinary,
+    PhMonitorFormatDelta
+} PH_MONITOR_FORMAT;
+
+// The values last sent for a process in delta mode.
+typedef struct _PH_MONITOR_DELTA_ENTRY
+{
+    PPH_PROCESS_ITEM ProcessItem;
+    ULONG RunId;
+    ULONG64 Values[PhMonitorFieldMaximum];
+} PH_MONITOR_DELTA_ENTRY, *PPH_MONITOR_DELTA_ENTRY;
+
+static PH_STRINGREF PhpMonitorFieldNames[] =
+{
+    PH_STRINGREF_INIT(L"name"),
+    PH_STRINGREF_INIT(L"cpu"),
+    PH_STRINGREF_INIT(L"private"),
+    PH_STRINGREF_INIT(L"ws"),
+    PH_STRINGREF_INIT(L"ioread"),
+    PH_STRINGREF_INIT(L"iowrite"),
+    PH_STRINGREF_INIT(L"ioother"),
+    PH_STRINGREF_INIT(L"threads"),
+    PH_STRINGREF_INIT(L"handles"),
+    PH_STRINGREF_INIT(L"services"),
+    PH_STRINGREF_INIT(L"connections")
+};
+
+C_ASSERT(RTL_NUMBER_OF(PhpMonitorFieldNames) == PhMonitorFieldMaximum);
+
+static PH_MONITOR_FORMAT PhpMonitorFormat;
+static UCHAR PhpMonitorFields[PhMonitorFieldMaximum];
+static ULONG PhpMonitorNumberOfFields;
+static PPH_FILE_STREAM PhpMonitorStream;
+static PH_BYTES_BUILDER PhpMonitorBuffer;
+static PH_EVENT PhpMonitorStopEvent = PH_EVENT_INIT;
+static NTSTATUS PhpMonitorStatus = STATUS_SUCCESS;
+
+static PPH_HASHTABLE PhpMonitorDeltaEntries;
+static PPH_LIST PhpMonitorDeltaRemovedList;
+static LARGE_INTEGER PhpMonitorDeltaLastTime;
+
+// Process ID to connection count, maintained from the network provider.
+static PPH_HASHTABLE PhpMonitorConnectionCounts;
+static PH_QUEUED_LOCK PhpMonitorConnectionCountsLock = PH_QUEUED_LOCK_INIT;
+
+static PH_CALLBACK_REGISTRATION PhpMonitorProcessesUpdatedRegistration;
+static PH_CALLBACK_REGISTRATION PhpMonitorNetworkItemAddedRegistration;
+static PH_CALLBACK_REGISTRATION PhpMonitorNetworkItemRemovedRegistration;
+static PH_PROVIDER_REGISTRATION PhpMonitorProcessProviderRegistration;
+static PH_PROVIDER_REGISTRATION PhpMonitorServiceProviderRegistration;
+static PH_PROVIDER_REGISTRATION PhpMonitorNetworkProviderRegistration;
+
+static BOOLEAN PhpMonitorHasField(
+    _In_ PH_MONITOR_FIELD Field
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PhpMonitorNumberOfFields; i++)
+    {
+        if (PhpMonitorFields[i] == Field)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static BOOLEAN PhpMonitorParseFields(
+    _In_opt_ PPH_STRINGREF FieldList
+    )
+{
+    static PH_STRINGREF defaultFields = PH_STRINGREF_INIT(L"name,cpu,private,ws,ioread,iowrite");
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+    ULONG i;
+
+    remainingPart = FieldList ? *FieldList : defaultFields;
+    PhpMonitorNumberOfFields = 0;
+
+    while (remainingPart.Length != 0)
+    {
+        PhSplitStringRefAtChar(&remainingPart, ',', &part, &remainingPart);
+
+        if (part.Length == 0)
+            continue;
+
+        for (i = 0; i < PhMonitorFieldMaximum; i++)
+        {
+            if (PhEqualStringRef(&part, &PhpMonitorFieldNames[i], TRUE))
+                break;
+        }
+
+        if (i == PhMonitorFieldMaximum)
+            return FALSE;
+
+        if (!PhpMonitorHasField(i))
+            PhpMonitorFields[PhpMonitorNumberOfFields++] = (UCHAR)i;
+    }
+
+    return TRUE;
+}
+
+static ULONG PhpMonitorGetConnectionCount(
+    _In_ HANDLE ProcessId
+    )
+{
+    PULONG_PTR count;
+    ULONG result = 0;
+
+    PhAcquireQueuedLockShared(&PhpMonitorConnectionCountsLock);
+
+    if (count = (PULONG_PTR)PhFindItemSimpleHashtable(PhpMonitorConnectionCounts, ProcessId))
+        result = (ULONG)*count;
+
+    PhReleaseQueuedLockShared(&PhpMonitorConnectionCountsLock);
+
+    return result;
+}
+
+static ULONG64 PhpMonitorGetIntegerField(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PH_MONITOR_FIELD Field
+    )
+{
+    ULONG64 value = 0;
+
+    switch (Field)
+    {
+    case PhMonitorFieldPrivateBytes:
+        return ProcessItem->VmCounters.PagefileUsage;
+    case PhMonitorFieldWorkingSet:
+        return ProcessItem->VmCounters.WorkingSetSize;
+    case PhMonitorFieldIoRead:
+        return ProcessItem->IoReadDelta.Delta;
+    case PhMonitorFieldIoWrite:
+        return ProcessItem->IoWriteDelta.Delta;
+    case PhMonitorFieldIoOther:
+        return ProcessItem->IoOtherDelta.Delta;
+    case PhMonitorFieldThreads:
+        return ProcessItem->NumberOfThreads;
+    case PhMonitorFieldHandles:
+        return ProcessItem->NumberOfHandles;
+    case PhMonitorFieldServices:
+        PhAcquireQueuedLockShared(&ProcessItem->ServiceListLock);
+        value = ProcessItem->ServiceList->Count;
+        PhReleaseQueuedLockShared(&ProcessItem->ServiceListLock);
+        return value;
+    case PhMonitorFieldConnections:
+        return PhpMonitorGetConnectionCount(ProcessItem->ProcessId);
+    }
+
+    return value;
+}
+
+static VOID PhpMonitorAppendJsonProcess(
+    _Inout_ PPH_STRING_BUILDER StringBuilder,
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    ULONG i;
+    PH_STRINGREF name;
+
+    PhAppendFormatStringBuilder(StringBuilder, L"{\"pid\":%lu", HandleToUlong(ProcessItem->ProcessId));
+
+    for (i = 0; i < PhpMonitorNumberOfFields; i++)
+    {
+        PH_MONITOR_FIELD field = PhpMonitorFields[i];
+
+        PhAppendStringBuilder2(StringBuilder, L",\"");
+        PhAppendStringBuilder(StringBuilder, &PhpMonitorFieldNames[field]);
+        PhAppendStringBuilder2(StringBuilder, L"\":");
+
+        switch (field)
+        {
+        case PhMonitorFieldName:
+            {
+                SIZE_T j;
+
+                if (ProcessItem->ProcessName)
+                    name = ProcessItem->ProcessName->sr;
+                else
+                    PhInitializeEmptyStringRef(&name);
+
+                PhAppendCharStringBuilder(StringBuilder, '"');
+
+                for (j = 0; j < name.Length / sizeof(WCHAR); j++)
+                {
+                    WCHAR c = name.Buffer[j];
+
+                    if (c == '"' || c == '\\')
+                        PhAppendCharStringBuilder(StringBuilder, '\\');
+
+                    if (c < ' ')
+                        PhAppendFormatStringBuilder(StringBuilder, L"\\u%04x", c);
+                    else
+                        PhAppendCharStringBuilder(StringBuilder, c);
+                }
+
+                PhAppendCharStringBuilder(StringBuilder, '"');
+            }
+            break;
+        case PhMonitorFieldCpu:
+            PhAppendFormatStringBuilder(StringBuilder, L"%.2f", ProcessItem->CpuUsage * 100);
+            break;
+        default:
+            PhAppendFormatStringBuilder(StringBuilder, L"%I64u", PhpMonitorGetIntegerField(ProcessItem, field));
+            break;
+        }
+    }
+
+    PhAppendCharStringBuilder(StringBuilder, '}');
+}
+
+static VOID PhpMonitorAppendBinaryProcess(
+    _Inout_ PPH_BYTES_BUILDER BytesBuilder,
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    ULONG i;
+    ULONG processId;
+
+    processId = HandleToUlong(ProcessItem->ProcessId);
+    PhAppendBytesBuilderEx(BytesBuilder, &processId, sizeof(ULONG), 0, NULL);
+
+    for (i = 0; i < PhpMonitorNumberOfFields; i++)
+    {
+        PH_MONITOR_FIELD field = PhpMonitorFields[i];
+
+        switch (field)
+        {
+        case PhMonitorFieldName:
+            {
+                USHORT length;
+
+                length = ProcessItem->ProcessName ? (USHORT)ProcessItem->ProcessName->Length : 0;
+                PhAppendBytesBuilderEx(BytesBuilder, &length, sizeof(USHORT), 0, NULL);
+
+                if (length != 0)
+                    PhAppendBytesBuilderEx(BytesBuilder, ProcessItem->ProcessName->Buffer, length, 0, NULL);
+            }
+            break;
+        case PhMonitorFieldCpu:
+            {
+                ULONG cpu;
+
+                cpu = (ULONG)(ProcessItem->CpuUsage * 10000);
+                PhAppendBytesBuilderEx(BytesBuilder, &cpu, sizeof(ULONG), 0, NULL);
+            }
+            break;
+        default:
+            {
+                ULONG64 value;
+
+                value = PhpMonitorGetIntegerField(ProcessItem, field);
+                PhAppendBytesBuilderEx(BytesBuilder, &value, sizeof(ULONG64), 0, NULL);
+            }
+            break;
+        }
+    }
+}
+
+static ULONG PhpMonitorEncodeVarint(
+    _Out_writes_(10) PUCHAR Buffer,
+    _In_ ULONG64 Value
+    )
+{
+    ULONG length = 0;
+
+    do
+    {
+        Buffer[length] = (UCHAR)(Value & 0x7f);
+        Value >>= 7;
+
+        if (Value != 0)
+            Buffer[length] |= 0x80;
+
+        length++;
+    } while (Value != 0);
+
+    return length;
+}
+
+static VOID PhpMonitorAppendVarint(
+    _Inout_ PPH_BYTES_BUILDER BytesBuilder,
+    _In_ ULONG64 Value
+    )
+{
+    UCHAR buffer[10];
+
+    PhAppendBytesBuilderEx(BytesBuilder, buffer, PhpMonitorEncodeVarint(buffer, Value), 0, NULL);
+}
+
+static VOID PhpMonitorAppendSignedVarint(
+    _Inout_ PPH_BYTES_BUILDER BytesBuilder,
+    _In_ LONG64 Value
+    )
+{
+    PhpMonitorAppendVarint(BytesBuilder, ((ULONG64)Value << 1) ^ (ULONG64)(Value >> 63));
+}
+
+static BOOLEAN NTAPI PhpMonitorDeltaEntryEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PPH_MONITOR_DELTA_ENTRY)Entry1)->ProcessItem == ((PPH_MONITOR_DELTA_ENTRY)Entry2)->ProcessItem;
+}
+
+static ULONG NTAPI PhpMonitorDeltaEntryHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashIntPtr((ULONG_PTR)((PPH_MONITOR_DELTA_ENTRY)Entry)->ProcessItem);
+}
+
+static VOID PhpMonitorAppendDeltaProcess(
+    _Inout_ PPH_BYTES_BUILDER BytesBuilder,
+    _Inout_ PPH_MONITOR_DELTA_ENTRY Entry,
+    _In_ BOOLEAN Added
+    )
+{
+    ULONG64 values[PhMonitorFieldMaximum];
+    ULONG mask;
+    ULONG i;
+    PH_MONITOR_FIELD field;
+
+    mask = 0;
+
+    for (i = 0; i < PhpMonitorNumberOfFields; i++)
+    {
+        field = PhpMonitorFields[i];
+
+        if (field == PhMonitorFieldName)
+        {
+            if (Added)
+                mask |= 1 << field;
+
+            continue;
+        }
+
+        if (field == PhMonitorFieldCpu)
+            values[field] = (ULONG64)(Entry->ProcessItem->CpuUsage * 10000);
+        else
+            values[field] = PhpMonitorGetIntegerField(Entry->ProcessItem, field);
+
+        if (Added || values[field] != Entry->Values[field])
+            mask |= 1 << field;
+    }
+
+    // Nothing the reader subscribed to has changed.
+    if (mask == 0)
+        return;
+
+    PhpMonitorAppendVarint(BytesBuilder, Added ? PH_MONITOR_DELTA_ADDED : PH_MONITOR_DELTA_CHANGED);
+    PhpMonitorAppendVarint(BytesBuilder, HandleToUlong(Entry->ProcessItem->ProcessId));
+    PhpMonitorAppendVarint(BytesBuilder, mask);
+
+    for (field = 0; field < PhMonitorFieldMaximum; field++)
+    {
+        if (!(mask & (1 << field)))
+            continue;
+
+        if (field == PhMonitorFieldName)
+        {
+            PPH_STRING processName = Entry->ProcessItem->ProcessName;
+
+            PhpMonitorAppendVarint(BytesBuilder, processName ? processName->Length : 0);
+
+            if (processName && processName->Length != 0)
+                PhAppendBytesBuilderEx(BytesBuilder, processName->Buffer, processName->Length, 0, NULL);
+        }
+        else
+        {
+            PhpMonitorAppendSignedVarint(BytesBuilder, (LONG64)(values[field] - (Added ? 0 : Entry->Values[field])));
+            Entry->Values[field] = values[field];
+        }
+    }
+}
+
+static NTSTATUS PhpMonitorWriteDeltaSample(
+    _In_ PPH_PROCESS_ITEM *ProcessItems,
+    _In_ ULONG NumberOfProcessItems,
+    _In_ LARGE_INTEGER Time
+    )
+{
+    static ULONG runId = 0;
+
+    NTSTATUS status;
+    UCHAR lengthBuffer[10];
+    PH_MONITOR_DELTA_ENTRY lookupEntry;
+    PPH_MONITOR_DELTA_ENTRY entry;
+    ULONG enumerationKey;
+    BOOLEAN added;
+    ULONG i;
+
+    runId++;
+
+    // The buffer is reused between samples, so there is no allocation in the steady state.
+    PhpMonitorBuffer.Bytes->Length = 0;
+
+    PhpMonitorAppendVarint(&PhpMonitorBuffer, PhpMonitorDeltaLastTime.QuadPart != 0 ? Time.QuadPart - PhpMonitorDeltaLastTime.QuadPart : 0);
+    PhpMonitorDeltaLastTime = Time;
+
+    // Removals are sent first, so a process ID that has already been reused by a new process
+    // always refers to the new process once the reader gets to the additions.
+
+    for (i = 0; i < NumberOfProcessItems; i++)
+    {
+        lookupEntry.ProcessItem = ProcessItems[i];
+
+        if (entry = PhFindEntryHashtable(PhpMonitorDeltaEntries, &lookupEntry))
+            entry->RunId = runId;
+    }
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpMonitorDeltaEntries, &entry, &enumerationKey))
+    {
+        if (entry->RunId != runId)
+            PhAddItemList(PhpMonitorDeltaRemovedList, entry->ProcessItem);
+    }
+
+    for (i = 0; i < PhpMonitorDeltaRemovedList->Count; i++)
+    {
+        lookupEntry.ProcessItem = PhpMonitorDeltaRemovedList->Items[i];
+
+        PhpMonitorAppendVarint(&PhpMonitorBuffer, PH_MONITOR_DELTA_REMOVED);
+        PhpMonitorAppendVarint(&PhpMonitorBuffer, HandleToUlong(lookupEntry.ProcessItem->ProcessId));
+
+        PhRemoveEntryHashtable(PhpMonitorDeltaEntries, &lookupEntry);
+        PhDereferenceObject(lookupEntry.ProcessItem);
+    }
+
+    PhClearList(PhpMonitorDeltaRemovedList);
+
+    for (i = 0; i < NumberOfProcessItems; i++)
+    {
+        lookupEntry.ProcessItem = ProcessItems[i];
+
+        if (!(entry = PhFindEntryHashtable(PhpMonitorDeltaEntries, &lookupEntry)))
+        {
+            memset(&lookupEntry.Values, 0, sizeof(lookupEntry.Values));
+            lookupEntry.RunId = runId;
+            entry = PhAddEntryHashtableEx(PhpMonitorDeltaEntries, &lookupEntry, NULL);
+            PhReferenceObject(entry->ProcessItem); // keep the address from being reused until the removal is sent
+            added = TRUE;
+        }
+        else
+        {
+            added = FALSE;
+        }
+
+        PhpMonitorAppendDeltaProcess(&PhpMonitorBuffer, entry, added);
+    }
+
+    PhpMonitorAppendVarint(&PhpMonitorBuffer, 0);
+
+    status = PhWriteFileStream(
+        PhpMonitorStream,
+        lengthBuffer,
+        PhpMonitorEncodeVarint(lengthBuffer, PhpMonitorBuffer.Bytes->Length)
+        );
+
+    if (NT_SUCCESS(status))
+        status = PhWriteFileStream(PhpMonitorStream, PhpMonitorBuffer.Bytes->Buffer, (ULONG)PhpMonitorBuffer.Bytes->Length);
+
+    return status;
+}
+
+static NTSTATUS PhpMonitorReadSubscription(
+    _In_ HANDLE PipeHandle
+    )
+{
+    UCHAR byte;
+    ULONG length;
+    ULONG shift;
+    ULONG bytesRead;
+    PSTR buffer;
+    PPH_STRING fieldList;
+    BOOLEAN result;
+
+    // The field list is preceded by its length as a varint.
+
+    length = 0;
+    shift = 0;
+
+    do
+    {
+        if (!ReadFile(PipeHandle, &byte, 1, &bytesRead, NULL) || bytesRead != 1)
+            return PhGetLastWin32ErrorAsNtStatus();
+
+        length |= (ULONG)(byte & 0x7f) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 32);
+
+    if (length == 0)
+        return STATUS_SUCCESS;
+    if (length > 0x1000)
+        return STATUS_INVALID_PARAMETER;
+
+    buffer = PhAllocate(length);
+
+    if (!ReadFile(PipeHandle, buffer, length, &bytesRead, NULL) || bytesRead != length)
+    {
+        PhFree(buffer);
+        return PhGetLastWin32ErrorAsNtStatus();
+    }
+
+    fieldList = PhZeroExtendToUtf16Ex(buffer, length);
+    PhFree(buffer);
+    result = PhpMonitorParseFields(&fieldList->sr);
+    PhDereferenceObject(fieldList);
+
+    return result ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+}
+
+static VOID PhpMonitorStop(
+    _In_ NTSTATUS Status
+    )
+{
+    PhpMonitorStatus = Status;
+    PhSetEvent(&PhpMonitorStopEvent);
+}
+
+static VOID NTAPI PhpMonitorProcessesUpdatedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    static ULONG runCount = 0;
+
+    NTSTATUS status;
+    PPH_PROCESS_ITEM *processItems;
+    ULONG numberOfProcessItems;
+    LARGE_INTEGER time;
+    ULONG i;
+
+    if (PhTestEvent(&PhpMonitorStopEvent))
+        return;
+
+    // Skip the first run; the deltas are not valid yet.
+    if (runCount++ == 0)
+        return;
+
+    PhEnumProcessItems(&processItems, &numberOfProcessItems);
+    PhQuerySystemTime(&time);
+
+    if (PhpMonitorFormat == PhMonitorFormatDelta)
+    {
+        status = PhpMonitorWriteDeltaSample(processItems, numberOfProcessItems, time);
+    }
+    else if (PhpMonitorFormat == PhMonitorFormatBinary)
+    {
+        PH_MONITOR_SAMPLE_HEADER header;
+
+        // The buffer is reused between samples, so there is no allocation in the steady state.
+        PhpMonitorBuffer.Bytes->Length = 0;
+
+        header.Length = 0;
+        header.Time = time;
+        header.NumberOfProcesses = numberOfProcessItems;
+        PhAppendBytesBuilderEx(&PhpMonitorBuffer, &header, sizeof(PH_MONITOR_SAMPLE_HEADER), 0, NULL);
+
+        for (i = 0; i < numberOfProcessItems; i++)
+            PhpMonitorAppendBinaryProcess(&PhpMonitorBuffer, processItems[i]);
+
+        ((PPH_MONITOR_SAMPLE_HEADER)PhpMonitorBuffer.Bytes->Buffer)->Length = (ULONG)PhpMonitorBuffer.Bytes->Length;
+
+        status = PhWriteFileStream(PhpMonitorStream, PhpMonitorBuffer.Bytes->Buffer, (ULONG)PhpMonitorBuffer.Bytes->Length);
+    }
+    else
+    {
+        PH_STRING_BUILDER stringBuilder;
+
+        PhInitializeStringBuilder(&stringBuilder, 256 + numberOfProcessItems * 100);
+        PhAppendFormatStringBuilder(&stringBuilder, L"{\"time\":%I64u,\"processes\":[", time.QuadPart);
+
+        for (i = 0; i < numberOfProcessItems; i++)
+        {
+            if (i != 0)
+                PhAppendCharStringBuilder(&stringBuilder, ',');
+
+            PhpMonitorAppendJsonProcess(&stringBuilder, processItems[i]);
+        }
+
+        PhAppendStringBuilder2(&stringBuilder, L"]}\n");
+        status = PhWriteStringAsUtf8FileStream(PhpMonitorStream, &stringBuilder.String->sr);
+        PhDeleteStringBuilder(&stringBuilder);
+    }
+
+    if (NT_SUCCESS(status))
+        status = PhFlushFileStream(PhpMonitorStream, FALSE);
+
+    PhDereferenceObjects(processItems, numberOfProcessItems);
+    PhFree(processItems);
+
+    // The reader went away.
+    if (!NT_SUCCESS(status))
+        PhpMonitorStop(status == STATUS_PIPE_CLOSING || status == STATUS_PIPE_BROKEN ? STATUS_SUCCESS : status);
+}
+
+static VOID NTAPI PhpMonitorNetworkItemAddedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_NETWORK_ITEM networkItem = Parameter;
+    PULONG_PTR count;
+
+    PhAcquireQueuedLockExclusive(&PhpMonitorConnectionCountsLock);
+
+    if (count = (PULONG_PTR)PhFindItemSimpleHashtable(PhpMonitorConnectionCounts, networkItem->ProcessId))
+        (*count)++;
+    else
+        PhAddItemSimpleHashtable(PhpMonitorConnectionCounts, networkItem->ProcessId, (PVOID)1);
+
+    PhReleaseQueuedLockExclusive(&PhpMonitorConnectionCountsLock);
+}
+
+static VOID NTAPI PhpMonitorNetworkItemRemovedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_NETWORK_ITEM networkItem = Parameter;
+    PULONG_PTR count;
+
+    PhAcquireQueuedLockExclusive(&PhpMonitorConnectionCountsLock);
+
+    if (count = (PULONG_PTR)PhFindItemSimpleHashtable(PhpMonitorConnectionCounts, networkItem->ProcessId))
+    {
+        if (--(*count) == 0)
+            PhRemoveItemSimpleHashtable(PhpMonitorConnectionCounts, networkItem->ProcessId);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpMonitorConnectionCountsLock);
+}
+
+static NTSTATUS PhpMonitorOpenOutput(
+    _In_opt_ PPH_STRING Output,
+    _Out_ PHANDLE OutputHandle,
+    _Out_ PBOOLEAN IsPipe
+    )
+{
+    static PH_STRINGREF pipePrefix = PH_STRINGREF_INIT(L"\\\\.\\pipe\\");
+    NTSTATUS status;
+    HANDLE outputHandle;
+
+    *IsPipe = FALSE;
+
+    if (!Output || PhEqualString2(Output, L"stdout", TRUE))
+    {
+        outputHandle = NtCurrentPeb()->ProcessParameters->StandardOutput;
+
+        // We are a GUI application, so stdout is only set when it has been redirected. Otherwise
+        // write to the console of the parent process.
+        if (!outputHandle || outputHandle == INVALID_HANDLE_VALUE)
+        {
+            if (!AttachConsole(ATTACH_PARENT_PROCESS))
+                return PhGetLastWin32ErrorAsNtStatus();
+
+            return PhCreateFileWin32(
+                OutputHandle,
+                L"CONOUT$",
+                FILE_GENERIC_WRITE,
+                0,
+                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                FILE_OPEN,
+                FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+                );
+        }
+
+        *OutputHandle = outputHandle;
+        return STATUS_SUCCESS;
+    }
+
+    if (PhStartsWithStringRef(&Output->sr, &pipePrefix, TRUE))
+    {
+        // In delta mode the reader also writes its subscription to the pipe.
+        outputHandle = CreateNamedPipe(
+            Output->Buffer,
+            PhpMonitorFormat == PhMonitorFormatDelta ? PIPE_ACCESS_DUPLEX : PIPE_ACCESS_OUTBOUND,
+            PIPE_TYPE_BYTE | PIPE_WAIT,
+            1,
+            0x10000,
+            0,
+            0,
+            NULL
+            );
+
+        if (outputHandle == INVALID_HANDLE_VALUE)
+            return PhGetLastWin32ErrorAsNtStatus();
+
+        // Wait for the reader.
+        if (!ConnectNamedPipe(outputHandle, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+            status = PhGetLastWin32ErrorAsNtStatus();
+            NtClose(outputHandle);
+            return status;
+        }
+
+        *OutputHandle = outputHandle;
+        *IsPipe = TRUE;
+        return STATUS_SUCCESS;
+    }
+
+    return PhCreateFileWin32(
+        OutputHandle,
+        Output->Buffer,
+        FILE_GENERIC_WRITE,
+        0,
+        FILE_SHARE_READ,
+        FILE_OVERWRITE_IF,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+}
+
+/**
+ * Runs the providers without a user interface and streams process samples until the output is
+ * closed.
+ */
+NTSTATUS PhCommandModeMonitor(
+    VOID
+    )
+{
+    NTSTATUS status;
+    HANDLE outputHandle;
+    BOOLEAN isPipe;
+    ULONG interval;
+    ULONG i;
+
+    if (PhEqualString2(PhStartupParameters.CommandAction, L"binary", TRUE))
+        PhpMonitorFormat = PhMonitorFormatBinary;
+    else if (PhEqualString2(PhStartupParameters.CommandAction, L"delta", TRUE))
+        PhpMonitorFormat = PhMonitorFormatDelta;
+    else if (PhEqualString2(PhStartupParameters.CommandAction, L"json", TRUE))
+        PhpMonitorFormat = PhMonitorFormatJson;
+    else
+        return STATUS_INVALID_PARAMETER;
+
+    if (!PhpMonitorParseFields(PhStartupParameters.CommandValue ? &PhStartupParameters.CommandValue->sr : NULL))
+        return STATUS_INVALID_PARAMETER;
+
+    if (!NT_SUCCESS(status = PhpMonitorOpenOutput(PhStartupParameters.CommandObject, &outputHandle, &isPipe)))
+        return status;
+
+    if (PhpMonitorFormat == PhMonitorFormatDelta)
+    {
+        if (isPipe && !NT_SUCCESS(status = PhpMonitorReadSubscription(outputHandle)))
+            return status;
+
+        PhpMonitorDeltaEntries = PhCreateHashtable(
+            sizeof(PH_MONITOR_DELTA_ENTRY),
+            PhpMonitorDeltaEntryEqualFunction,
+            PhpMonitorDeltaEntryHashFunction,
+            256
+            );
+        PhpMonitorDeltaRemovedList = PhCreateList(16);
+    }
+
+    // The stream does not own the handle; stdout belongs to our parent.
+    if (!NT_SUCCESS(status = PhCreateFileStream2(&PhpMonitorStream, outputHandle, PH_FILE_STREAM_HANDLE_UNOWNED, PAGE_SIZE * 4)))
+        return status;
+
+    PhInitializeBytesBuilder(&PhpMonitorBuffer, 0x4000);
+
+    if (PhpMonitorFormat != PhMonitorFormatJson)
+    {
+        PH_MONITOR_HEADER header;
+
+        memset(&header, 0, sizeof(PH_MONITOR_HEADER));
+        header.Magic = PhpMonitorFormat == PhMonitorFormatDelta ? PH_MONITOR_DELTA_MAGIC : PH_MONITOR_MAGIC;
+        header.Version = PH_MONITOR_VERSION;
+        header.NumberOfFields = (USHORT)PhpMonitorNumberOfFields;
+
+        for (i = 0; i < PhpMonitorNumberOfFields; i++)
+            header.Fields[i] = PhpMonitorFields[i];
+
+        if (!NT_SUCCESS(status = PhWriteFileStream(PhpMonitorStream, &header, sizeof(PH_MONITOR_HEADER))))
+            return status;
+    }
+
+    interval = PhGetIntegerSetting(L"UpdateInterval");
+
+    if (interval == 0)
+        interval = 1000;
+
+    PhInitializeProviderThread(&PhPrimaryProviderThread, interval);
+    PhRegisterProvider(&PhPrimaryProviderThread, PhProcessProviderUpdate, NULL, &PhpMonitorProcessProviderRegistration);
+    PhSetEnabledProvider(&PhpMonitorProcessProviderRegistration, TRUE);
+    PhRegisterCallback(&PhProcessesUpdatedEvent, PhpMonitorProcessesUpdatedHandler, NULL, &PhpMonitorProcessesUpdatedRegistration);
+
+    // Only run the other providers if their data has been requested.
+    if (PhpMonitorHasField(PhMonitorFieldServices))
+    {
+        PhInitializeProviderThread(&PhServiceProviderThread, interval);
+        PhRegisterProvider(&PhServiceProviderThread, PhServiceProviderUpdate, NULL, &PhpMonitorServiceProviderRegistration);
+        PhSetEnabledProvider(&PhpMonitorServiceProviderRegistration, TRUE);
+        PhStartProviderThread(&PhServiceProviderThread);
+    }
+
+    if (PhpMonitorHasField(PhMonitorFieldConnections))
+    {
+        PhpMonitorConnectionCounts = PhCreateSimpleHashtable(64);
+        PhRegisterCallback(&PhNetworkItemAddedEvent, PhpMonitorNetworkItemAddedHandler, NULL, &PhpMonitorNetworkItemAddedRegistration);
+        PhRegisterCallback(&PhNetworkItemRemovedEvent, PhpMonitorNetworkItemRemovedHandler, NULL, &PhpMonitorNetworkItemRemovedRegistration);
+
+        // Host names are never written, so don't resolve them.
+        PhEnableNetworkProviderResolve = FALSE;
+
+        PhInitializeProviderThread(&PhNetworkProviderThread, interval);
+        PhRegisterProvider(&PhNetworkProviderThread, PhNetworkProviderUpdate, NULL, &PhpMonitorNetworkProviderRegistration);
+        PhSetEnabledProvider(&PhpMonitorNetworkProviderRegistration, TRUE);
+        PhStartProviderThread(&PhNetworkProviderThread);
+    }
+
+    PhStartProviderThread(&PhPrimaryProviderThread);
+
+    PhWaitForEvent(&PhpMonitorStopEvent, NULL);
+
+    return PhpMonitorStatus;
+}
@@ -463,7 +463,7 @@ BOOLEAN NTAPI PhpNetworkTreeNewCallback(
 
                     if (sortFunction)
                     {
-                        qsort(NetworkNodeList->Items, NetworkNodeList->Count, sizeof(PVOID), sortFunction);
+                        PhSortTreeNewNodes((PPH_TREENEW_NODE *)NetworkNodeList->Items, NetworkNodeList->Count, sortFunction);
                     }
                 }
 
@@ -774,20 +774,5 @@ VOID PhWriteNetworkList(
     _In_ ULONG Mode
     )
 {
-    PPH_LIST lines;
-    ULONG i;
-
-    lines = PhGetGenericTreeNewLines(NetworkTreeListHandle, Mode);
-
-    for (i = 0; i < lines->Count; i++)
-    {
-        PPH_STRING line;
-
-        line = lines->Items[i];
-        PhWriteStringAsUtf8FileStream(FileStream, &line->sr);
-        PhDereferenceObject(line);
-        PhWriteStringAsUtf8FileStream2(FileStream, L"\r\n");
-    }
-
-    PhDereferenceObject(lines);
+    PhWriteGenericTreeNewFileStream(FileStream, NetworkTreeListHandle, Mode);
 }
@@ -25,6 +25,7 @@
 #include <ws2tcpip.h>
 #include <ws2ipdef.h>
 #include <iphlpapi.h>
+#include <windns.h>
 #include <extmgri.h>
 
 typedef struct _PH_NETWORK_CONNECTION
@@ -51,9 +52,17 @@ typedef struct _PH_NETWORK_ITEM_QUERY_DATA
 typedef struct _PHP_RESOLVE_CACHE_ITEM
 {
     PH_IP_ADDRESS Address;
-    PPH_STRING HostString;
+    PPH_STRING HostString; // NULL if the address has no host name
+    ULONG64 ExpiryTime;
+    LIST_ENTRY ListEntry;
 } PHP_RESOLVE_CACHE_ITEM, *PPHP_RESOLVE_CACHE_ITEM;
 
+typedef struct _PHP_RESOLVE_PENDING_ITEM
+{
+    PH_IP_ADDRESS Address;
+    PPH_LIST Waiters; // PPH_NETWORK_ITEM_QUERY_DATA
+} PHP_RESOLVE_PENDING_ITEM, *PPHP_RESOLVE_PENDING_ITEM;
+
 typedef DWORD (WINAPI *_GetExtendedTcpTable)(
     _Out_writes_bytes_opt_(*pdwSize) PVOID pTcpTable,
     _Inout_ PDWORD pdwSize,
@@ -95,26 +104,45 @@ typedef struct hostent *(WSAAPI *_gethostbyaddr)(
     _In_ int type
     );
 
+typedef DNS_STATUS (WINAPI *_DnsQuery_W)(
+    _In_ PCWSTR pszName,
+    _In_ WORD wType,
+    _In_ DWORD Options,
+    _Inout_opt_ PVOID pExtra,
+    _Outptr_result_maybenull_ PDNS_RECORD *ppQueryResults,
+    _Outptr_opt_result_maybenull_ PVOID *pReserved
+    );
+
+typedef VOID (WINAPI *_DnsRecordListFree)(
+    _Inout_opt_ PDNS_RECORD pRecordList,
+    _In_ DNS_FREE_TYPE FreeType
+    );
+
 VOID NTAPI PhpNetworkItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
     );
 
-BOOLEAN PhpNetworkHashtableCompareFunction(
+VOID NTAPI PhpNetworkHashtableVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
+BOOLEAN PhpResolveCacheHashtableCompareFunction(
     _In_ PVOID Entry1,
     _In_ PVOID Entry2
     );
 
-ULONG NTAPI PhpNetworkHashtableHashFunction(
+ULONG NTAPI PhpResolveCacheHashtableHashFunction(
     _In_ PVOID Entry
     );
 
-BOOLEAN PhpResolveCacheHashtableCompareFunction(
+BOOLEAN PhpResolvePendingHashtableCompareFunction(
     _In_ PVOID Entry1,
     _In_ PVOID Entry2
     );
 
-ULONG NTAPI PhpResolveCacheHashtableHashFunction(
+ULONG NTAPI PhpResolvePendingHashtableHashFunction(
     _In_ PVOID Entry
     );
 
@@ -125,8 +153,44 @@ BOOLEAN PhGetNetworkConnections(
 
 PPH_OBJECT_TYPE PhNetworkItemType;
 
-PPH_HASHTABLE PhNetworkHashtable;
+#undef T
+#undef K
+#define T PPH_NETWORK_ITEM
+#define K PPH_NETWORK_ITEM
+#include <ohashtbl_h.h>
+
+#undef T
+#undef K
+#define T PPH_NETWORK_CONNECTION
+#define K PPH_NETWORK_CONNECTION
+#include <ohashtbl_h.h>
+
+// A read-only copy of the network hashtable which readers can use without locking. Each version
+// holds a reference to every network item in it.
+typedef struct _PHP_NETWORK_HASHTABLE_VERSION
+{
+    PH_OPEN_HASHTABLE_PPH_NETWORK_ITEM Hashtable;
+} PHP_NETWORK_HASHTABLE_VERSION, *PPHP_NETWORK_HASHTABLE_VERSION;
+
+// When change notifications are enabled, the connection tables are only
+// enumerated after a change was reported, and every this many updates to pick
+// up changes that are never reported (e.g. UDP endpoints and listeners).
+#define PH_NETWORK_RECONCILE_INTERVAL 10
+
+// Host names are cached for their DNS TTL, clamped to these limits. Addresses
+// without a host name are cached for a short time so they are not re-queried
+// every time a new connection to them appears.
+#define PH_RESOLVE_CACHE_MINIMUM_TTL 30 // seconds
+#define PH_RESOLVE_CACHE_MAXIMUM_TTL (24 * 60 * 60)
+#define PH_RESOLVE_CACHE_DEFAULT_TTL (5 * 60)
+#define PH_RESOLVE_CACHE_NEGATIVE_TTL 60
+#define PH_RESOLVE_CACHE_MAXIMUM_ENTRIES 4096
+
+PH_OPEN_HASHTABLE_PPH_NETWORK_ITEM PhNetworkHashtable;
 PH_QUEUED_LOCK PhNetworkHashtableLock = PH_QUEUED_LOCK_INIT;
+static PPH_OBJECT_TYPE PhpNetworkHashtableVersionType;
+static PPHP_NETWORK_HASHTABLE_VERSION volatile PhpNetworkHashtableVersion = NULL; // read inside an object epoch
+static BOOLEAN PhpNetworkHashtableChanged = FALSE;
 
 PHAPPAPI PH_CALLBACK_DECLARE(PhNetworkItemAddedEvent);
 PHAPPAPI PH_CALLBACK_DECLARE(PhNetworkItemModifiedEvent);
@@ -135,11 +199,16 @@ PHAPPAPI PH_CALLBACK_DECLARE(PhNetworkItemsUpdatedEvent);
 
 BOOLEAN PhEnableNetworkProviderResolve = TRUE;
 
+static BOOLEAN PhpNetworkChangeNotificationsEnabled = FALSE;
+static LONG PhpNetworkConnectionsChanged = TRUE;
+
 PH_INITONCE PhNetworkProviderWorkQueueInitOnce = PH_INITONCE_INIT;
 PH_WORK_QUEUE PhNetworkProviderWorkQueue;
 SLIST_HEADER PhNetworkItemQueryListHead;
 
 static PPH_HASHTABLE PhpResolveCacheHashtable;
+static LIST_ENTRY PhpResolveCacheListHead; // most recently used first
+static PPH_HASHTABLE PhpResolvePendingHashtable;
 static PH_QUEUED_LOCK PhpResolveCacheHashtableLock = PH_QUEUED_LOCK_INIT;
 
 static BOOLEAN NetworkImportDone = FALSE;
@@ -149,27 +218,32 @@ static _WSAStartup WSAStartup_I;
 static _WSAGetLastError WSAGetLastError_I;
 static _GetNameInfoW GetNameInfoW_I;
 static _gethostbyaddr gethostbyaddr_I;
+static _DnsQuery_W DnsQuery_W_I;
+static _DnsRecordListFree DnsRecordListFree_I;
 
 BOOLEAN PhNetworkProviderInitialization(
     VOID
     )
 {
     PhNetworkItemType = PhCreateObjectType(L"NetworkItem", 0, PhpNetworkItemDeleteProcedure);
-    PhNetworkHashtable = PhCreateHashtable(
-        sizeof(PPH_NETWORK_ITEM),
-        PhpNetworkHashtableCompareFunction,
-        PhpNetworkHashtableHashFunction,
-        40
-        );
+    PhpNetworkHashtableVersionType = PhCreateObjectType(L"NetworkHashtableVersion", 0, PhpNetworkHashtableVersionDeleteProcedure);
+    PhInitializeOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, 40);
 
     RtlInitializeSListHead(&PhNetworkItemQueryListHead);
 
     PhpResolveCacheHashtable = PhCreateHashtable(
-        sizeof(PHP_RESOLVE_CACHE_ITEM),
+        sizeof(PPHP_RESOLVE_CACHE_ITEM),
         PhpResolveCacheHashtableCompareFunction,
         PhpResolveCacheHashtableHashFunction,
         20
         );
+    InitializeListHead(&PhpResolveCacheListHead);
+    PhpResolvePendingHashtable = PhCreateHashtable(
+        sizeof(PPHP_RESOLVE_PENDING_ITEM),
+        PhpResolvePendingHashtableCompareFunction,
+        PhpResolvePendingHashtableHashFunction,
+        8
+        );
 
     return TRUE;
 }
@@ -209,32 +283,121 @@ VOID NTAPI PhpNetworkItemDeleteProcedure(
         PhDereferenceObject(networkItem->RemoteHostString);
 }
 
-BOOLEAN PhpNetworkHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
+FORCEINLINE BOOLEAN PhpEqualNetworkItem(
+    _In_ PPH_NETWORK_ITEM NetworkItem1,
+    _In_ PPH_NETWORK_ITEM NetworkItem2
     )
 {
-    PPH_NETWORK_ITEM networkItem1 = *(PPH_NETWORK_ITEM *)Entry1;
-    PPH_NETWORK_ITEM networkItem2 = *(PPH_NETWORK_ITEM *)Entry2;
+    return
+        NetworkItem1->ProtocolType == NetworkItem2->ProtocolType &&
+        PhEqualIpEndpoint(&NetworkItem1->LocalEndpoint, &NetworkItem2->LocalEndpoint) &&
+        PhEqualIpEndpoint(&NetworkItem1->RemoteEndpoint, &NetworkItem2->RemoteEndpoint) &&
+        NetworkItem1->ProcessId == NetworkItem2->ProcessId;
+}
 
+FORCEINLINE ULONG PhpHashNetworkItem(
+    _In_ PPH_NETWORK_ITEM NetworkItem
+    )
+{
     return
-        networkItem1->ProtocolType == networkItem2->ProtocolType &&
-        PhEqualIpEndpoint(&networkItem1->LocalEndpoint, &networkItem2->LocalEndpoint) &&
-        PhEqualIpEndpoint(&networkItem1->RemoteEndpoint, &networkItem2->RemoteEndpoint) &&
-        networkItem1->ProcessId == networkItem2->ProcessId;
+        NetworkItem->ProtocolType ^
+        PhHashIpEndpoint(&NetworkItem->LocalEndpoint) ^
+        PhHashIpEndpoint(&NetworkItem->RemoteEndpoint) ^
+        HandleToUlong(NetworkItem->ProcessId);
 }
 
-ULONG NTAPI PhpNetworkHashtableHashFunction(
-    _In_ PVOID Entry
+#undef T
+#undef K
+#define T PPH_NETWORK_ITEM
+#define K PPH_NETWORK_ITEM
+#define PH_OPEN_HASHTABLE_KEY(Entry) (Entry)
+#define PH_OPEN_HASHTABLE_HASH(Key) PhpHashNetworkItem(Key)
+#define PH_OPEN_HASHTABLE_EQUAL(Key1, Key2) PhpEqualNetworkItem(Key1, Key2)
+#include <ohashtbl_i.h>
+
+FORCEINLINE BOOLEAN PhpEqualNetworkConnection(
+    _In_ PPH_NETWORK_CONNECTION Connection1,
+    _In_ PPH_NETWORK_CONNECTION Connection2
     )
 {
-    PPH_NETWORK_ITEM networkItem = *(PPH_NETWORK_ITEM *)Entry;
+    return
+        Connection1->ProtocolType == Connection2->ProtocolType &&
+        PhEqualIpEndpoint(&Connection1->LocalEndpoint, &Connection2->LocalEndpoint) &&
+        PhEqualIpEndpoint(&Connection1->RemoteEndpoint, &Connection2->RemoteEndpoint) &&
+        Connection1->ProcessId == Connection2->ProcessId;
+}
 
+FORCEINLINE ULONG PhpHashNetworkConnection(
+    _In_ PPH_NETWORK_CONNECTION Connection
+    )
+{
     return
-        networkItem->ProtocolType ^
-        PhHashIpEndpoint(&networkItem->LocalEndpoint) ^
-        PhHashIpEndpoint(&networkItem->RemoteEndpoint) ^
-        HandleToUlong(networkItem->ProcessId);
+        Connection->ProtocolType ^
+        PhHashIpEndpoint(&Connection->LocalEndpoint) ^
+        PhHashIpEndpoint(&Connection->RemoteEndpoint) ^
+        HandleToUlong(Connection->ProcessId);
+}
+
+#undef PH_OPEN_HASHTABLE_KEY
+#undef PH_OPEN_HASHTABLE_HASH
+#undef PH_OPEN_HASHTABLE_EQUAL
+#undef T
+#undef K
+#define T PPH_NETWORK_CONNECTION
+#define K PPH_NETWORK_CONNECTION
+#define PH_OPEN_HASHTABLE_KEY(Entry) (Entry)
+#define PH_OPEN_HASHTABLE_HASH(Key) PhpHashNetworkConnection(Key)
+#define PH_OPEN_HASHTABLE_EQUAL(Key1, Key2) PhpEqualNetworkConnection(Key1, Key2)
+#include <ohashtbl_i.h>
+
+VOID PhpNetworkHashtableVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPHP_NETWORK_HASHTABLE_VERSION version = (PPHP_NETWORK_HASHTABLE_VERSION)Object;
+    ULONG enumerationKey = 0;
+    PPH_NETWORK_ITEM *networkItem;
+
+    while (PhEnumOpenHashtable_PPH_NETWORK_ITEM(&version->Hashtable, &networkItem, &enumerationKey))
+        PhDereferenceObject(*networkItem);
+
+    PhDeleteOpenHashtable_PPH_NETWORK_ITEM(&version->Hashtable);
+}
+
+/**
+ * Publishes a copy of the network hashtable for lock-free readers.
+ *
+ * \remarks This function must be called from the provider thread.
+ */
+VOID PhpPublishNetworkHashtableVersion(
+    VOID
+    )
+{
+    PPHP_NETWORK_HASHTABLE_VERSION version;
+    PPHP_NETWORK_HASHTABLE_VERSION oldVersion;
+    ULONG enumerationKey = 0;
+    PPH_NETWORK_ITEM *networkItem;
+
+    if (!PhpNetworkHashtableChanged)
+        return;
+
+    PhpNetworkHashtableChanged = FALSE;
+
+    version = PhCreateObject(sizeof(PHP_NETWORK_HASHTABLE_VERSION), PhpNetworkHashtableVersionType);
+    PhInitializeOpenHashtable_PPH_NETWORK_ITEM(&version->Hashtable, PhNetworkHashtable.Count);
+
+    // We are the only writer, so the hashtable can be read without the lock.
+    while (PhEnumOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, &networkItem, &enumerationKey))
+    {
+        PhReferenceObject(*networkItem);
+        PhAddEntryOpenHashtable_PPH_NETWORK_ITEM(&version->Hashtable, *networkItem, NULL);
+    }
+
+    oldVersion = _InterlockedExchangePointer((PVOID *)&PhpNetworkHashtableVersion, version);
+
+    if (oldVersion)
+        PhDereferenceObjectDeferDelete(oldVersion);
 }
 
 PPH_NETWORK_ITEM PhReferenceNetworkItem(
@@ -245,21 +408,37 @@ PPH_NETWORK_ITEM PhReferenceNetworkItem(
     )
 {
     PH_NETWORK_ITEM lookupNetworkItem;
-    PPH_NETWORK_ITEM lookupNetworkItemPtr = &lookupNetworkItem;
     PPH_NETWORK_ITEM *networkItemPtr;
-    PPH_NETWORK_ITEM networkItem;
+    PPH_NETWORK_ITEM networkItem = NULL;
+    ULONG epoch;
+    PPHP_NETWORK_HASHTABLE_VERSION version;
 
     lookupNetworkItem.ProtocolType = ProtocolType;
     lookupNetworkItem.LocalEndpoint = *LocalEndpoint;
     lookupNetworkItem.RemoteEndpoint = *RemoteEndpoint;
     lookupNetworkItem.ProcessId = ProcessId;
 
+    epoch = PhEnterObjectEpoch();
+
+    if (version = PhpNetworkHashtableVersion)
+    {
+        if (networkItemPtr = PhFindEntryOpenHashtable_PPH_NETWORK_ITEM(&version->Hashtable, &lookupNetworkItem))
+        {
+            networkItem = *networkItemPtr;
+            PhReferenceObject(networkItem);
+        }
+    }
+
+    PhLeaveObjectEpoch(epoch);
+
+    if (networkItem)
+        return networkItem;
+
+    // The item may have been added after the hashtable was last published.
+
     PhAcquireQueuedLockShared(&PhNetworkHashtableLock);
 
-    networkItemPtr = (PPH_NETWORK_ITEM *)PhFindEntryHashtable(
-        PhNetworkHashtable,
-        &lookupNetworkItemPtr
-        );
+    networkItemPtr = PhFindEntryOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, &lookupNetworkItem);
 
     if (networkItemPtr)
     {
@@ -280,7 +459,8 @@ VOID PhpRemoveNetworkItem(
     _In_ PPH_NETWORK_ITEM NetworkItem
     )
 {
-    PhRemoveEntryHashtable(PhNetworkHashtable, &NetworkItem);
+    PhRemoveEntryOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, NetworkItem);
+    PhpNetworkHashtableChanged = TRUE;
     PhDereferenceObject(NetworkItem);
 }
 
@@ -326,6 +506,124 @@ PPHP_RESOLVE_CACHE_ITEM PhpLookupResolveCacheItem(
         return NULL;
 }
 
+VOID PhpRemoveResolveCacheItem(
+    _In_ PPHP_RESOLVE_CACHE_ITEM CacheItem
+    )
+{
+    PhRemoveEntryHashtable(PhpResolveCacheHashtable, &CacheItem);
+    RemoveEntryList(&CacheItem->ListEntry);
+
+    if (CacheItem->HostString)
+        PhDereferenceObject(CacheItem->HostString);
+
+    PhFree(CacheItem);
+}
+
+/**
+ * Looks up an address in the resolve cache.
+ *
+ * \param Address The address to look up.
+ * \param HostString A variable which receives a reference to the cached host name,
+ * or NULL if the address is known to have no host name.
+ *
+ * \return TRUE if an unexpired entry was found, otherwise FALSE.
+ *
+ * \remarks The resolve cache lock must be held exclusively.
+ */
+BOOLEAN PhpReferenceResolveCacheHostString(
+    _In_ PPH_IP_ADDRESS Address,
+    _Out_ PPH_STRING *HostString
+    )
+{
+    PPHP_RESOLVE_CACHE_ITEM cacheItem;
+    LARGE_INTEGER currentTime;
+
+    cacheItem = PhpLookupResolveCacheItem(Address);
+
+    if (!cacheItem)
+        return FALSE;
+
+    PhQuerySystemTime(&currentTime);
+
+    if ((ULONG64)currentTime.QuadPart >= cacheItem->ExpiryTime)
+    {
+        PhpRemoveResolveCacheItem(cacheItem);
+        return FALSE;
+    }
+
+    // Move the entry to the front of the LRU list.
+    RemoveEntryList(&cacheItem->ListEntry);
+    InsertHeadList(&PhpResolveCacheListHead, &cacheItem->ListEntry);
+
+    if (cacheItem->HostString)
+        PhReferenceObject(cacheItem->HostString);
+
+    *HostString = cacheItem->HostString;
+
+    return TRUE;
+}
+
+/**
+ * Adds or replaces an entry in the resolve cache.
+ *
+ * \param Address The address.
+ * \param HostString The host name, or NULL if the address has no host name.
+ * \param TimeToLive The number of seconds the entry is valid for.
+ *
+ * \remarks The resolve cache lock must be held exclusively.
+ */
+VOID PhpAddResolveCacheItem(
+    _In_ PPH_IP_ADDRESS Address,
+    _In_opt_ PPH_STRING HostString,
+    _In_ ULONG TimeToLive
+    )
+{
+    PPHP_RESOLVE_CACHE_ITEM cacheItem;
+    LARGE_INTEGER currentTime;
+
+    if (cacheItem = PhpLookupResolveCacheItem(Address))
+        PhpRemoveResolveCacheItem(cacheItem);
+
+    // Evict the least recently used entries.
+    while (PhpResolveCacheHashtable->Count >= PH_RESOLVE_CACHE_MAXIMUM_ENTRIES)
+    {
+        PhpRemoveResolveCacheItem(CONTAINING_RECORD(PhpResolveCacheListHead.Blink, PHP_RESOLVE_CACHE_ITEM, ListEntry));
+    }
+
+    PhQuerySystemTime(&currentTime);
+
+    cacheItem = PhAllocate(sizeof(PHP_RESOLVE_CACHE_ITEM));
+    cacheItem->Address = *Address;
+    cacheItem->HostString = HostString;
+    cacheItem->ExpiryTime = currentTime.QuadPart + (ULONG64)TimeToLive * PH_TICKS_PER_SEC;
+
+    if (HostString)
+        PhReferenceObject(HostString);
+
+    PhAddEntryHashtable(PhpResolveCacheHashtable, &cacheItem);
+    InsertHeadList(&PhpResolveCacheListHead, &cacheItem->ListEntry);
+}
+
+BOOLEAN PhpResolvePendingHashtableCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPHP_RESOLVE_PENDING_ITEM pendingItem1 = *(PPHP_RESOLVE_PENDING_ITEM *)Entry1;
+    PPHP_RESOLVE_PENDING_ITEM pendingItem2 = *(PPHP_RESOLVE_PENDING_ITEM *)Entry2;
+
+    return PhEqualIpAddress(&pendingItem1->Address, &pendingItem2->Address);
+}
+
+ULONG NTAPI PhpResolvePendingHashtableHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPHP_RESOLVE_PENDING_ITEM pendingItem = *(PPHP_RESOLVE_PENDING_ITEM *)Entry;
+
+    return PhHashIpAddress(&pendingItem->Address);
+}
+
 PPH_STRING PhGetHostNameFromAddress(
     _In_ PPH_IP_ADDRESS Address
     )
@@ -399,58 +697,141 @@ PPH_STRING PhGetHostNameFromAddress(
     return hostName;
 }
 
-NTSTATUS PhpNetworkItemQueryWorker(
-    _In_ PVOID Parameter
+PPH_STRING PhpFormatReverseLookupName(
+    _In_ PPH_IP_ADDRESS Address
     )
 {
-    PPH_NETWORK_ITEM_QUERY_DATA data = (PPH_NETWORK_ITEM_QUERY_DATA)Parameter;
-    PPH_STRING hostString;
-    PPHP_RESOLVE_CACHE_ITEM cacheItem;
+    if (Address->Type == PH_IPV4_NETWORK_TYPE)
+    {
+        return PhFormatString(
+            L"%u.%u.%u.%u.in-addr.arpa",
+            Address->InAddr.s_impno,
+            Address->InAddr.s_lh,
+            Address->InAddr.s_host,
+            Address->InAddr.s_net
+            );
+    }
+    else if (Address->Type == PH_IPV6_NETWORK_TYPE)
+    {
+        PH_STRING_BUILDER stringBuilder;
+        LONG i;
 
-    // Last minute check of the cache.
+        PhInitializeStringBuilder(&stringBuilder, 80);
 
-    PhAcquireQueuedLockShared(&PhpResolveCacheHashtableLock);
-    cacheItem = PhpLookupResolveCacheItem(&data->Address);
-    PhReleaseQueuedLockShared(&PhpResolveCacheHashtableLock);
+        for (i = 15; i >= 0; i--)
+        {
+            UCHAR byte = Address->In6Addr.s6_addr[i];
 
-    if (!cacheItem)
-    {
-        hostString = PhGetHostNameFromAddress(&data->Address);
+            PhAppendFormatStringBuilder(&stringBuilder, L"%x.%x.", byte & 0xf, byte >> 4);
+        }
 
-        if (hostString)
-        {
-            data->HostString = hostString;
+        PhAppendStringBuilder2(&stringBuilder, L"ip6.arpa");
 
-            // Update the cache.
+        return PhFinalStringBuilderString(&stringBuilder);
+    }
 
-            PhAcquireQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+    return NULL;
+}
 
-            cacheItem = PhpLookupResolveCacheItem(&data->Address);
+/**
+ * Resolves the host name of an address.
+ *
+ * \param Address The address.
+ * \param TimeToLive A variable which receives the number of seconds the result
+ * may be cached for.
+ *
+ * \return The host name, or NULL if the address has no host name.
+ */
+PPH_STRING PhpResolveHostNameFromAddress(
+    _In_ PPH_IP_ADDRESS Address,
+    _Out_ PULONG TimeToLive
+    )
+{
+    PPH_STRING hostName = NULL;
+
+    // Query the PTR record directly so that we get its TTL.
+    if (DnsQuery_W_I && DnsRecordListFree_I)
+    {
+        PPH_STRING lookupName;
+        PDNS_RECORD records;
+        PDNS_RECORD record;
 
-            if (!cacheItem)
+        if (lookupName = PhpFormatReverseLookupName(Address))
+        {
+            if (DnsQuery_W_I(lookupName->Buffer, DNS_TYPE_PTR, DNS_QUERY_STANDARD, NULL, &records, NULL) == ERROR_SUCCESS)
             {
-                cacheItem = PhAllocate(sizeof(PHP_RESOLVE_CACHE_ITEM));
-                cacheItem->Address = data->Address;
-                cacheItem->HostString = hostString;
-                PhReferenceObject(hostString);
+                for (record = records; record; record = record->pNext)
+                {
+                    if (record->wType == DNS_TYPE_PTR && record->Data.PTR.pNameHost)
+                    {
+                        hostName = PhCreateString(record->Data.PTR.pNameHost);
+                        *TimeToLive = record->dwTtl;
+                        break;
+                    }
+                }
 
-                PhAddEntryHashtable(PhpResolveCacheHashtable, &cacheItem);
+                DnsRecordListFree_I(records, DnsFreeRecordList);
             }
 
-            PhReleaseQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+            PhDereferenceObject(lookupName);
         }
+    }
+
+    // Fall back to the name service providers (hosts file, NetBIOS, etc.).
+    if (!hostName)
+    {
+        if (hostName = PhGetHostNameFromAddress(Address))
+            *TimeToLive = PH_RESOLVE_CACHE_DEFAULT_TTL;
         else
-        {
-            dprintf("resolve failed, error %u\n", WSAGetLastError_I());
-        }
+            *TimeToLive = PH_RESOLVE_CACHE_NEGATIVE_TTL;
     }
-    else
+
+    if (*TimeToLive < PH_RESOLVE_CACHE_MINIMUM_TTL)
+        *TimeToLive = PH_RESOLVE_CACHE_MINIMUM_TTL;
+    if (*TimeToLive > PH_RESOLVE_CACHE_MAXIMUM_TTL)
+        *TimeToLive = PH_RESOLVE_CACHE_MAXIMUM_TTL;
+
+    return hostName;
+}
+
+NTSTATUS PhpNetworkItemQueryWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_RESOLVE_PENDING_ITEM pendingItem = (PPHP_RESOLVE_PENDING_ITEM)Parameter;
+    PPH_STRING hostString;
+    ULONG timeToLive;
+    ULONG i;
+
+    hostString = PhpResolveHostNameFromAddress(&pendingItem->Address, &timeToLive);
+
+    if (!hostString)
+        dprintf("resolve failed, error %u\n", WSAGetLastError_I());
+
+    // Update the cache and stop accepting waiters. Once the pending item is removed
+    // no other thread can add to its waiter list.
+
+    PhAcquireQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+    PhpAddResolveCacheItem(&pendingItem->Address, hostString, timeToLive);
+    PhRemoveEntryHashtable(PhpResolvePendingHashtable, &pendingItem);
+    PhReleaseQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+
+    for (i = 0; i < pendingItem->Waiters->Count; i++)
     {
-        PhReferenceObject(cacheItem->HostString);
-        data->HostString = cacheItem->HostString;
+        PPH_NETWORK_ITEM_QUERY_DATA data = pendingItem->Waiters->Items[i];
+
+        if (hostString)
+            PhReferenceObject(hostString);
+
+        data->HostString = hostString;
+        RtlInterlockedPushEntrySList(&PhNetworkItemQueryListHead, &data->ListEntry);
     }
 
-    RtlInterlockedPushEntrySList(&PhNetworkItemQueryListHead, &data->ListEntry);
+    if (hostString)
+        PhDereferenceObject(hostString);
+
+    PhDereferenceObject(pendingItem->Waiters);
+    PhFree(pendingItem);
 
     return STATUS_SUCCESS;
 }
@@ -461,6 +842,10 @@ VOID PhpQueueNetworkItemQuery(
     )
 {
     PPH_NETWORK_ITEM_QUERY_DATA data;
+    PHP_RESOLVE_PENDING_ITEM lookupPendingItem;
+    PPHP_RESOLVE_PENDING_ITEM lookupPendingItemPtr = &lookupPendingItem;
+    PPHP_RESOLVE_PENDING_ITEM *pendingItemPtr;
+    PPHP_RESOLVE_PENDING_ITEM pendingItem;
 
     if (!PhEnableNetworkProviderResolve)
         return;
@@ -477,13 +862,46 @@ VOID PhpQueueNetworkItemQuery(
 
     PhReferenceObject(NetworkItem);
 
+    // Only one query is issued per address. Connections to an address that is
+    // already being resolved wait for that query instead. The work queue limits
+    // the number of queries that are in flight at once.
+
+    lookupPendingItem.Address = data->Address;
+
+    PhAcquireQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+
+    pendingItemPtr = (PPHP_RESOLVE_PENDING_ITEM *)PhFindEntryHashtable(
+        PhpResolvePendingHashtable,
+        &lookupPendingItemPtr
+        );
+
+    if (pendingItemPtr)
+    {
+        PhAddItemList((*pendingItemPtr)->Waiters, data);
+        pendingItem = NULL;
+    }
+    else
+    {
+        pendingItem = PhAllocate(sizeof(PHP_RESOLVE_PENDING_ITEM));
+        pendingItem->Address = data->Address;
+        pendingItem->Waiters = PhCreateList(2);
+        PhAddItemList(pendingItem->Waiters, data);
+
+        PhAddEntryHashtable(PhpResolvePendingHashtable, &pendingItem);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+
+    if (!pendingItem)
+        return;
+
     if (PhBeginInitOnce(&PhNetworkProviderWorkQueueInitOnce))
     {
         PhInitializeWorkQueue(&PhNetworkProviderWorkQueue, 0, 3, 500);
         PhEndInitOnce(&PhNetworkProviderWorkQueueInitOnce);
     }
 
-    PhQueueItemWorkQueue(&PhNetworkProviderWorkQueue, PhpNetworkItemQueryWorker, data);
+    PhQueueItemWorkQueue(&PhNetworkProviderWorkQueue, PhpNetworkItemQueryWorker, pendingItem);
 }
 
 VOID PhpUpdateNetworkItemOwner(
@@ -505,10 +923,73 @@ VOID PhpUpdateNetworkItemOwner(
     }
 }
 
+/**
+ * Enables or disables change notifications for the network provider.
+ *
+ * \param Enable TRUE if a plugin will call PhNotifyNetworkConnectionsChanged whenever
+ * connections are created or closed, otherwise FALSE.
+ *
+ * \remarks While notifications are enabled, the connection tables are only enumerated
+ * after a change was reported and at a slow periodic interval.
+ */
+VOID PhSetNetworkProviderChangeNotifications(
+    _In_ BOOLEAN Enable
+    )
+{
+    PhpNetworkChangeNotificationsEnabled = Enable;
+    _InterlockedExchange(&PhpNetworkConnectionsChanged, TRUE);
+}
+
+/**
+ * Reports that network connections were created or closed.
+ */
+VOID PhNotifyNetworkConnectionsChanged(
+    VOID
+    )
+{
+    if (!PhpNetworkConnectionsChanged)
+        _InterlockedExchange(&PhpNetworkConnectionsChanged, TRUE);
+}
+
+VOID PhpFlushNetworkItemQueryData(
+    _In_ BOOLEAN RaiseModified
+    )
+{
+    PSLIST_ENTRY entry;
+    PPH_NETWORK_ITEM_QUERY_DATA data;
+
+    entry = RtlInterlockedFlushSList(&PhNetworkItemQueryListHead);
+
+    while (entry)
+    {
+        data = CONTAINING_RECORD(entry, PH_NETWORK_ITEM_QUERY_DATA, ListEntry);
+        entry = entry->Next;
+
+        if (data->Remote)
+            PhMoveReference(&data->NetworkItem->RemoteHostString, data->HostString);
+        else
+            PhMoveReference(&data->NetworkItem->LocalHostString, data->HostString);
+
+        if (RaiseModified)
+        {
+            PhInvokeCallback(&PhNetworkItemModifiedEvent, data->NetworkItem);
+        }
+        else
+        {
+            data->NetworkItem->JustResolved = TRUE;
+        }
+
+        PhDereferenceObject(data->NetworkItem);
+        PhFree(data);
+    }
+}
+
 VOID PhNetworkProviderUpdate(
     _In_ PVOID Object
     )
 {
+    static ULONG runCount = 0;
+
     PPH_NETWORK_CONNECTION connections;
     ULONG numberOfConnections;
     ULONG i;
@@ -518,6 +999,7 @@ VOID PhNetworkProviderUpdate(
         WSADATA wsaData;
         HMODULE iphlpapi;
         HMODULE ws2_32;
+        HMODULE dnsapi;
 
         iphlpapi = LoadLibrary(L"iphlpapi.dll");
         GetExtendedTcpTable_I = (PVOID)GetProcAddress(iphlpapi, "GetExtendedTcpTable");
@@ -527,6 +1009,9 @@ VOID PhNetworkProviderUpdate(
         WSAGetLastError_I = (PVOID)GetProcAddress(ws2_32, "WSAGetLastError");
         GetNameInfoW_I = (PVOID)GetProcAddress(ws2_32, "GetNameInfoW");
         gethostbyaddr_I = (PVOID)GetProcAddress(ws2_32, "gethostbyaddr");
+        dnsapi = LoadLibrary(L"dnsapi.dll");
+        DnsQuery_W_I = (PVOID)GetProcAddress(dnsapi, "DnsQuery_W");
+        DnsRecordListFree_I = (PVOID)GetProcAddress(dnsapi, "DnsRecordListFree");
 
         // Make sure WSA is initialized.
         if (WSAStartup_I)
@@ -537,35 +1022,46 @@ VOID PhNetworkProviderUpdate(
         NetworkImportDone = TRUE;
     }
 
+    runCount++;
+
+    if (
+        PhpNetworkChangeNotificationsEnabled &&
+        !_InterlockedExchange(&PhpNetworkConnectionsChanged, FALSE) &&
+        runCount % PH_NETWORK_RECONCILE_INTERVAL != 0
+        )
+    {
+        // Nothing was reported as changed, so there is no need to enumerate the connections.
+        PhpFlushNetworkItemQueryData(TRUE);
+        PhEmCallObjectBulkUpdate(EmNetworkItemType);
+        PhInvokeCallback(&PhNetworkItemsUpdatedEvent, NULL);
+        return;
+    }
+
     if (!PhGetNetworkConnections(&connections, &numberOfConnections))
         return;
 
     {
+        PH_OPEN_HASHTABLE_PPH_NETWORK_CONNECTION connectionHashtable;
         PPH_LIST connectionsToRemove = NULL;
-        PH_HASHTABLE_ENUM_CONTEXT enumContext;
+        ULONG enumerationKey = 0;
         PPH_NETWORK_ITEM *networkItem;
 
-        PhBeginEnumHashtable(PhNetworkHashtable, &enumContext);
+        // Index the new connections so that each network item can be checked in constant time.
+        PhInitializeOpenHashtable_PPH_NETWORK_CONNECTION(&connectionHashtable, numberOfConnections);
 
-        while (networkItem = PhNextEnumHashtable(&enumContext))
+        for (i = 0; i < numberOfConnections; i++)
+            PhAddEntryOpenHashtable_PPH_NETWORK_CONNECTION(&connectionHashtable, &connections[i], NULL);
+
+        while (PhEnumOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, &networkItem, &enumerationKey))
         {
-            BOOLEAN found = FALSE;
+            PH_NETWORK_CONNECTION lookupConnection;
 
-            for (i = 0; i < numberOfConnections; i++)
-            {
-                if (
-                    (*networkItem)->ProtocolType == connections[i].ProtocolType &&
-                    PhEqualIpEndpoint(&(*networkItem)->LocalEndpoint, &connections[i].LocalEndpoint) &&
-                    PhEqualIpEndpoint(&(*networkItem)->RemoteEndpoint, &connections[i].RemoteEndpoint) &&
-                    (*networkItem)->ProcessId == connections[i].ProcessId
-                    )
-                {
-                    found = TRUE;
-                    break;
-                }
-            }
+            lookupConnection.ProtocolType = (*networkItem)->ProtocolType;
+            lookupConnection.LocalEndpoint = (*networkItem)->LocalEndpoint;
+            lookupConnection.RemoteEndpoint = (*networkItem)->RemoteEndpoint;
+            lookupConnection.ProcessId = (*networkItem)->ProcessId;
 
-            if (!found)
+            if (!PhFindEntryOpenHashtable_PPH_NETWORK_CONNECTION(&connectionHashtable, &lookupConnection))
             {
                 PhInvokeCallback(&PhNetworkItemRemovedEvent, *networkItem);
 
@@ -586,33 +1082,15 @@ VOID PhNetworkProviderUpdate(
             }
 
             PhReleaseQueuedLockExclusive(&PhNetworkHashtableLock);
+            PhpPublishNetworkHashtableVersion();
             PhDereferenceObject(connectionsToRemove);
         }
+
+        PhDeleteOpenHashtable_PPH_NETWORK_CONNECTION(&connectionHashtable);
     }
 
     // Go through the queued network item query data.
-    {
-        PSLIST_ENTRY entry;
-        PPH_NETWORK_ITEM_QUERY_DATA data;
-
-        entry = RtlInterlockedFlushSList(&PhNetworkItemQueryListHead);
-
-        while (entry)
-        {
-            data = CONTAINING_RECORD(entry, PH_NETWORK_ITEM_QUERY_DATA, ListEntry);
-            entry = entry->Next;
-
-            if (data->Remote)
-                PhMoveReference(&data->NetworkItem->RemoteHostString, data->HostString);
-            else
-                PhMoveReference(&data->NetworkItem->LocalHostString, data->HostString);
-
-            data->NetworkItem->JustResolved = TRUE;
-
-            PhDereferenceObject(data->NetworkItem);
-            PhFree(data);
-        }
-    }
+    PhpFlushNetworkItemQueryData(FALSE);
 
     for (i = 0; i < numberOfConnections; i++)
     {
@@ -628,7 +1106,7 @@ VOID PhNetworkProviderUpdate(
 
         if (!networkItem)
         {
-            PPHP_RESOLVE_CACHE_ITEM cacheItem;
+            BOOLEAN cached;
             PPH_PROCESS_ITEM processItem;
 
             // Network item not found, create it.
@@ -675,37 +1153,23 @@ VOID PhNetworkProviderUpdate(
 
             // Local
             {
-                PhAcquireQueuedLockShared(&PhpResolveCacheHashtableLock);
-                cacheItem = PhpLookupResolveCacheItem(&networkItem->LocalEndpoint.Address);
-                PhReleaseQueuedLockShared(&PhpResolveCacheHashtableLock);
+                PhAcquireQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+                cached = PhpReferenceResolveCacheHostString(&networkItem->LocalEndpoint.Address, &networkItem->LocalHostString);
+                PhReleaseQueuedLockExclusive(&PhpResolveCacheHashtableLock);
 
-                if (cacheItem)
-                {
-                    PhReferenceObject(cacheItem->HostString);
-                    networkItem->LocalHostString = cacheItem->HostString;
-                }
-                else
-                {
+                if (!cached)
                     PhpQueueNetworkItemQuery(networkItem, FALSE);
-                }
             }
 
             // Remote
             if (!PhIsNullIpAddress(&networkItem->RemoteEndpoint.Address))
             {
-                PhAcquireQueuedLockShared(&PhpResolveCacheHashtableLock);
-                cacheItem = PhpLookupResolveCacheItem(&networkItem->RemoteEndpoint.Address);
-                PhReleaseQueuedLockShared(&PhpResolveCacheHashtableLock);
+                PhAcquireQueuedLockExclusive(&PhpResolveCacheHashtableLock);
+                cached = PhpReferenceResolveCacheHostString(&networkItem->RemoteEndpoint.Address, &networkItem->RemoteHostString);
+                PhReleaseQueuedLockExclusive(&PhpResolveCacheHashtableLock);
 
-                if (cacheItem)
-                {
-                    PhReferenceObject(cacheItem->HostString);
-                    networkItem->RemoteHostString = cacheItem->HostString;
-                }
-                else
-                {
+                if (!cached)
                     PhpQueueNetworkItemQuery(networkItem, TRUE);
-                }
             }
 
             // Get process information.
@@ -726,7 +1190,8 @@ VOID PhNetworkProviderUpdate(
 
             // Add the network item to the hashtable.
             PhAcquireQueuedLockExclusive(&PhNetworkHashtableLock);
-            PhAddEntryHashtable(PhNetworkHashtable, &networkItem);
+            PhAddEntryOpenHashtable_PPH_NETWORK_ITEM(&PhNetworkHashtable, networkItem, NULL);
+            PhpNetworkHashtableChanged = TRUE;
             PhReleaseQueuedLockExclusive(&PhNetworkHashtableLock);
 
             // Raise the network item added event.
@@ -783,6 +1248,9 @@ VOID PhNetworkProviderUpdate(
 
     PhFree(connections);
 
+    PhpPublishNetworkHashtableVersion();
+
+    PhEmCallObjectBulkUpdate(EmNetworkItemType);
     PhInvokeCallback(&PhNetworkItemsUpdatedEvent, NULL);
 }
 
@@ -104,6 +104,18 @@ VOID PhNfpUpdateIconCpuUsage(
     VOID
     );
 
+VOID PhNfpUpdateIconFromBitmap(
+    _In_ ULONG Id,
+    _In_ PPH_STRING Text,
+    _In_ HBITMAP Bitmap
+    );
+
+typedef struct _PH_NF_ICON_CACHE
+{
+    PVOID Bits;
+    ULONG BitsLength;
+} PH_NF_ICON_CACHE, *PPH_NF_ICON_CACHE;
+
 BOOLEAN PhNfTerminating = FALSE;
 ULONG PhNfIconMask;
 ULONG PhNfIconNotifyMask;
@@ -120,6 +132,13 @@ PH_NF_BITMAP PhNfpBlackBitmapContext = { 0 };
 HBITMAP PhNfpBlackBitmap = NULL;
 HICON PhNfpBlackIcon = NULL;
 
+// The last pixels sent to explorer for each icon. These are only accessed on the
+// provider thread; other threads set bits in PhNfpIconCacheInvalidMask instead.
+PH_NF_ICON_CACHE PhNfpIconCache[32] = { 0 };
+volatile LONG PhNfpIconCacheInvalidMask = 0;
+HWND PhNfpTrayWindow = NULL;
+BOOLEAN PhNfpSessionDisconnected = FALSE;
+
 VOID PhNfLoadStage1(
     VOID
     )
@@ -524,6 +543,13 @@ PPH_NF_ICON PhNfFindIcon(
     return NULL;
 }
 
+VOID PhNfNotifySessionConnected(
+    _In_ BOOLEAN Connected
+    )
+{
+    PhNfpSessionDisconnected = !Connected;
+}
+
 VOID PhNfNotifyMiniInfoPinned(
     _In_ BOOLEAN Pinned
     )
@@ -596,6 +622,9 @@ BOOLEAN PhNfpAddNotifyIcon(
     if (!_BitScanForward(&Id, Id))
         return FALSE;
 
+    // The icon starts out black, so the next update must send the real icon.
+    _InterlockedOr(&PhNfpIconCacheInvalidMask, 1 << Id);
+
     notifyIcon.hWnd = PhMainWndHandle;
     notifyIcon.uID = Id;
     notifyIcon.uFlags = NIF_ICON | NIF_MESSAGE | NIF_TIP;
@@ -638,6 +667,7 @@ BOOLEAN PhNfpRemoveNotifyIcon(
     notifyIcon.uID = Id;
 
     Shell_NotifyIcon(NIM_DELETE, &notifyIcon);
+    _InterlockedOr(&PhNfpIconCacheInvalidMask, 1 << Id);
 
     return TRUE;
 }
@@ -686,6 +716,7 @@ BOOLEAN PhNfpModifyNotifyIcon(
         // Explorer probably died and we lost our icon. Try to add the icon, and try again.
         PhNfpAddNotifyIcon(Id);
         Shell_NotifyIcon(NIM_MODIFY, &notifyIcon);
+        _InterlockedOr(&PhNfpIconCacheInvalidMask, 1 << notifyId);
     }
 
     return TRUE;
@@ -697,10 +728,44 @@ VOID PhNfpProcessesUpdatedHandler(
     )
 {
     ULONG registeredIconMask;
+    ULONG invalidMask;
+    HWND trayWindow;
+    ULONG i;
 
     // We do icon updating on the provider thread so we don't block the main GUI when
     // explorer is not responding.
 
+    // Nobody can see the icons while the session is disconnected.
+    if (PhNfpSessionDisconnected)
+        return;
+
+    // If explorer was restarted, our icons are gone and have to be sent again in full.
+    trayWindow = FindWindow(L"Shell_TrayWnd", NULL);
+
+    if (trayWindow != PhNfpTrayWindow)
+    {
+        PhNfpTrayWindow = trayWindow;
+        _InterlockedOr(&PhNfpIconCacheInvalidMask, -1);
+    }
+
+    invalidMask = _InterlockedExchange(&PhNfpIconCacheInvalidMask, 0);
+
+    if (invalidMask != 0)
+    {
+        for (i = 0; i < RTL_NUMBER_OF(PhNfpIconCache); i++)
+        {
+            if ((invalidMask & (1 << i)) && PhNfpIconCache[i].Bits)
+            {
+                PhFree(PhNfpIconCache[i].Bits);
+                memset(&PhNfpIconCache[i], 0, sizeof(PH_NF_ICON_CACHE));
+            }
+        }
+    }
+
+    // There is no notification area to draw into.
+    if (!trayWindow)
+        return;
+
     if (PhNfIconMask & PH_ICON_CPU_HISTORY)
         PhNfpUpdateIconCpuHistory();
     if (PhNfIconMask & PH_ICON_IO_HISTORY)
@@ -716,8 +781,6 @@ VOID PhNfpProcessesUpdatedHandler(
 
     if (registeredIconMask != 0)
     {
-        ULONG i;
-
         for (i = 0; i < sizeof(PhNfRegisteredIcons) / sizeof(PPH_NF_ICON); i++)
         {
             if (PhNfRegisteredIcons[i] && (registeredIconMask & PhNfRegisteredIcons[i]->IconId))
@@ -754,24 +817,32 @@ VOID PhNfpUpdateRegisteredIcon(
         Icon->Context
         );
 
-    if (newIconOrBitmap)
+    if (newIconOrBitmap && newText && (updateFlags & PH_NF_UPDATE_IS_BITMAP))
     {
-        if (updateFlags & PH_NF_UPDATE_IS_BITMAP)
-            newIcon = PhNfBitmapToIcon(newIconOrBitmap);
-        else
-            newIcon = newIconOrBitmap;
-
-        flags |= NIF_ICON;
+        // This is the common case, and we can skip the update if nothing has changed.
+        PhNfpUpdateIconFromBitmap(Icon->IconId, newText, newIconOrBitmap);
     }
+    else
+    {
+        if (newIconOrBitmap)
+        {
+            if (updateFlags & PH_NF_UPDATE_IS_BITMAP)
+                newIcon = PhNfBitmapToIcon(newIconOrBitmap);
+            else
+                newIcon = newIconOrBitmap;
 
-    if (newText)
-        flags |= NIF_TIP;
+            flags |= NIF_ICON;
+        }
 
-    if (flags != 0)
-        PhNfpModifyNotifyIcon(Icon->IconId, flags, newText, newIcon);
+        if (newText)
+            flags |= NIF_TIP;
 
-    if (newIcon && (updateFlags & PH_NF_UPDATE_IS_BITMAP))
-        DestroyIcon(newIcon);
+        if (flags != 0)
+            PhNfpModifyNotifyIcon(Icon->IconId, flags, newText, newIcon);
+
+        if (newIcon && (updateFlags & PH_NF_UPDATE_IS_BITMAP))
+            DestroyIcon(newIcon);
+    }
 
     if (newIconOrBitmap && (updateFlags & PH_NF_UPDATE_DESTROY_RESOURCE))
     {
@@ -785,6 +856,74 @@ VOID PhNfpUpdateRegisteredIcon(
         PhDereferenceObject(newText);
 }
 
+/**
+ * Updates an icon from a bitmap.
+ *
+ * \param Id The ID of the icon.
+ * \param Text The new tooltip text.
+ * \param Bitmap A DIB section containing the new icon image.
+ *
+ * \remarks An icon is only created when the pixels differ from the last update,
+ * and explorer is only called when either the icon or the text changed.
+ * This function must be called on the provider thread.
+ */
+VOID PhNfpUpdateIconFromBitmap(
+    _In_ ULONG Id,
+    _In_ PPH_STRING Text,
+    _In_ HBITMAP Bitmap
+    )
+{
+    ULONG notifyId;
+    PPH_NF_ICON_CACHE cache;
+    DIBSECTION dib;
+    ULONG bitsLength;
+    HICON newIcon;
+    ULONG flags;
+
+    if (!_BitScanForward(&notifyId, Id))
+        return;
+
+    cache = &PhNfpIconCache[notifyId];
+    newIcon = NULL;
+    flags = 0;
+
+    if (GetObject(Bitmap, sizeof(DIBSECTION), &dib) == sizeof(DIBSECTION) && dib.dsBm.bmBits)
+    {
+        bitsLength = dib.dsBm.bmWidthBytes * dib.dsBm.bmHeight;
+
+        if (!cache->Bits || cache->BitsLength != bitsLength || memcmp(cache->Bits, dib.dsBm.bmBits, bitsLength) != 0)
+        {
+            newIcon = PhNfBitmapToIcon(Bitmap);
+
+            if (cache->BitsLength != bitsLength)
+            {
+                if (cache->Bits)
+                    PhFree(cache->Bits);
+
+                cache->Bits = PhAllocate(bitsLength);
+                cache->BitsLength = bitsLength;
+            }
+
+            memcpy(cache->Bits, dib.dsBm.bmBits, bitsLength);
+        }
+    }
+    else
+    {
+        newIcon = PhNfBitmapToIcon(Bitmap);
+    }
+
+    if (newIcon)
+        flags |= NIF_ICON;
+    if (!PhNfIconTextCache[notifyId] || !PhEqualString(PhNfIconTextCache[notifyId], Text, FALSE))
+        flags |= NIF_TIP;
+
+    if (flags != 0)
+        PhNfpModifyNotifyIcon(Id, flags, Text, newIcon);
+
+    if (newIcon)
+        DestroyIcon(newIcon);
+}
+
 VOID PhNfpBeginBitmap(
     _Out_ PULONG Width,
     _Out_ PULONG Height,
@@ -863,7 +1002,6 @@ VOID PhNfpUpdateIconCpuHistory(
     PVOID bits;
     HDC hdc;
     HBITMAP oldBitmap;
-    HICON icon;
     HANDLE maxCpuProcessId;
     PPH_PROCESS_ITEM maxCpuProcessItem;
     PH_FORMAT format[8];
@@ -877,8 +1015,8 @@ VOID PhNfpUpdateIconCpuHistory(
     lineData2 = _alloca(maxDataCount * sizeof(FLOAT));
 
     lineDataCount = min(maxDataCount, PhCpuKernelHistory.Count);
-    PhCopyCircularBuffer_FLOAT(&PhCpuKernelHistory, lineData1, lineDataCount);
-    PhCopyCircularBuffer_FLOAT(&PhCpuUserHistory, lineData2, lineDataCount);
+    PhCopySystemGraphSamples(SystemGraphCpuKernel, lineDataCount, lineData1);
+    PhCopySystemGraphSamples(SystemGraphCpuUser, lineDataCount, lineData2);
 
     drawInfo.LineDataCount = lineDataCount;
     drawInfo.LineData1 = lineData1;
@@ -892,7 +1030,6 @@ VOID PhNfpUpdateIconCpuHistory(
         PhDrawGraphDirect(hdc, bits, &drawInfo);
 
     SelectObject(hdc, oldBitmap);
-    icon = PhNfBitmapToIcon(bitmap);
 
     // Text
 
@@ -922,9 +1059,8 @@ VOID PhNfpUpdateIconCpuHistory(
     text = PhFormat(format, maxCpuProcessItem ? 8 : 3, 128);
     if (maxCpuProcessItem) PhDereferenceObject(maxCpuProcessItem);
 
-    PhNfpModifyNotifyIcon(PH_ICON_CPU_HISTORY, NIF_TIP | NIF_ICON, text, icon);
+    PhNfpUpdateIconFromBitmap(PH_ICON_CPU_HISTORY, text, bitmap);
 
-    DestroyIcon(icon);
     PhDereferenceObject(text);
 }
 
@@ -953,12 +1089,10 @@ VOID PhNfpUpdateIconIoHistory(
     PFLOAT lineData1;
     PFLOAT lineData2;
     FLOAT max;
-    ULONG i;
     HBITMAP bitmap;
     PVOID bits;
     HDC hdc;
     HBITMAP oldBitmap;
-    HICON icon;
     HANDLE maxIoProcessId;
     PPH_PROCESS_ITEM maxIoProcessItem;
     PH_FORMAT format[8];
@@ -972,19 +1106,12 @@ VOID PhNfpUpdateIconIoHistory(
     lineData2 = _alloca(maxDataCount * sizeof(FLOAT));
 
     lineDataCount = min(maxDataCount, PhIoReadHistory.Count);
-    max = 1024 * 1024; // minimum scaling of 1 MB.
+    PhCopySystemGraphSamples(SystemGraphIoReadOther, lineDataCount, lineData1);
+    PhCopySystemGraphSamples(SystemGraphIoWrite, lineDataCount, lineData2);
+    max = PhGetSystemIoGraphMaximum(lineDataCount);
 
-    for (i = 0; i < lineDataCount; i++)
-    {
-        lineData1[i] =
-            (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoReadHistory, i) +
-            (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoOtherHistory, i);
-        lineData2[i] =
-            (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoWriteHistory, i);
-
-        if (max < lineData1[i] + lineData2[i])
-            max = lineData1[i] + lineData2[i];
-    }
+    if (max < 1024 * 1024)
+        max = 1024 * 1024; // minimum scaling of 1 MB.
 
     PhDivideSinglesBySingle(lineData1, max, lineDataCount);
     PhDivideSinglesBySingle(lineData2, max, lineDataCount);
@@ -1001,7 +1128,6 @@ VOID PhNfpUpdateIconIoHistory(
         PhDrawGraphDirect(hdc, bits, &drawInfo);
 
     SelectObject(hdc, oldBitmap);
-    icon = PhNfBitmapToIcon(bitmap);
 
     // Text
 
@@ -1031,9 +1157,8 @@ VOID PhNfpUpdateIconIoHistory(
     text = PhFormat(format, maxIoProcessItem ? 8 : 6, 128);
     if (maxIoProcessItem) PhDereferenceObject(maxIoProcessItem);
 
-    PhNfpModifyNotifyIcon(PH_ICON_IO_HISTORY, NIF_TIP | NIF_ICON, text, icon);
+    PhNfpUpdateIconFromBitmap(PH_ICON_IO_HISTORY, text, bitmap);
 
-    DestroyIcon(icon);
     PhDereferenceObject(text);
 }
 
@@ -1060,12 +1185,10 @@ VOID PhNfpUpdateIconCommitHistory(
     ULONG maxDataCount;
     ULONG lineDataCount;
     PFLOAT lineData1;
-    ULONG i;
     HBITMAP bitmap;
     PVOID bits;
     HDC hdc;
     HBITMAP oldBitmap;
-    HICON icon;
     DOUBLE commitFraction;
     PH_FORMAT format[5];
     PPH_STRING text;
@@ -1077,11 +1200,7 @@ VOID PhNfpUpdateIconCommitHistory(
     lineData1 = _alloca(maxDataCount * sizeof(FLOAT));
 
     lineDataCount = min(maxDataCount, PhCommitHistory.Count);
-
-    for (i = 0; i < lineDataCount; i++)
-        lineData1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhCommitHistory, i);
-
-    PhDivideSinglesBySingle(lineData1, (FLOAT)PhPerfInformation.CommitLimit, lineDataCount);
+    PhCopySystemGraphSamples(SystemGraphCommit, lineDataCount, lineData1);
 
     drawInfo.LineDataCount = lineDataCount;
     drawInfo.LineData1 = lineData1;
@@ -1092,7 +1211,6 @@ VOID PhNfpUpdateIconCommitHistory(
         PhDrawGraphDirect(hdc, bits, &drawInfo);
 
     SelectObject(hdc, oldBitmap);
-    icon = PhNfBitmapToIcon(bitmap);
 
     // Text
 
@@ -1106,9 +1224,8 @@ VOID PhNfpUpdateIconCommitHistory(
 
     text = PhFormat(format, 5, 96);
 
-    PhNfpModifyNotifyIcon(PH_ICON_COMMIT_HISTORY, NIF_TIP | NIF_ICON, text, icon);
+    PhNfpUpdateIconFromBitmap(PH_ICON_COMMIT_HISTORY, text, bitmap);
 
-    DestroyIcon(icon);
     PhDereferenceObject(text);
 }
 
@@ -1135,12 +1252,10 @@ VOID PhNfpUpdateIconPhysicalHistory(
     ULONG maxDataCount;
     ULONG lineDataCount;
     PFLOAT lineData1;
-    ULONG i;
     HBITMAP bitmap;
     PVOID bits;
     HDC hdc;
     HBITMAP oldBitmap;
-    HICON icon;
     ULONG physicalUsage;
     FLOAT physicalFraction;
     PH_FORMAT format[5];
@@ -1152,12 +1267,8 @@ VOID PhNfpUpdateIconPhysicalHistory(
     maxDataCount = drawInfo.Width / 2 + 1;
     lineData1 = _alloca(maxDataCount * sizeof(FLOAT));
 
-    lineDataCount = min(maxDataCount, PhCommitHistory.Count);
-
-    for (i = 0; i < lineDataCount; i++)
-        lineData1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhPhysicalHistory, i);
-
-    PhDivideSinglesBySingle(lineData1, (FLOAT)PhSystemBasicInformation.NumberOfPhysicalPages, lineDataCount);
+    lineDataCount = min(maxDataCount, PhPhysicalHistory.Count);
+    PhCopySystemGraphSamples(SystemGraphPhysical, lineDataCount, lineData1);
 
     drawInfo.LineDataCount = lineDataCount;
     drawInfo.LineData1 = lineData1;
@@ -1168,7 +1279,6 @@ VOID PhNfpUpdateIconPhysicalHistory(
         PhDrawGraphDirect(hdc, bits, &drawInfo);
 
     SelectObject(hdc, oldBitmap);
-    icon = PhNfBitmapToIcon(bitmap);
 
     // Text
 
@@ -1183,9 +1293,8 @@ VOID PhNfpUpdateIconPhysicalHistory(
 
     text = PhFormat(format, 5, 96);
 
-    PhNfpModifyNotifyIcon(PH_ICON_PHYSICAL_HISTORY, NIF_TIP | NIF_ICON, text, icon);
+    PhNfpUpdateIconFromBitmap(PH_ICON_PHYSICAL_HISTORY, text, bitmap);
 
-    DestroyIcon(icon);
     PhDereferenceObject(text);
 }
 
@@ -1198,7 +1307,6 @@ VOID PhNfpUpdateIconCpuUsage(
     HBITMAP bitmap;
     HDC hdc;
     HBITMAP oldBitmap;
-    HICON icon;
     HANDLE maxCpuProcessId;
     PPH_PROCESS_ITEM maxCpuProcessItem;
     PPH_STRING maxCpuText = NULL;
@@ -1283,7 +1391,6 @@ VOID PhNfpUpdateIconCpuUsage(
     }
 
     SelectObject(hdc, oldBitmap);
-    icon = PhNfBitmapToIcon(bitmap);
 
     // Text
 
@@ -1308,8 +1415,7 @@ VOID PhNfpUpdateIconCpuUsage(
     text = PhFormatString(L"CPU Usage: %.2f%%%s", (PhCpuKernelUsage + PhCpuUserUsage) * 100, PhGetStringOrEmpty(maxCpuText));
     if (maxCpuText) PhDereferenceObject(maxCpuText);
 
-    PhNfpModifyNotifyIcon(PH_ICON_CPU_USAGE, NIF_TIP | NIF_ICON, text, icon);
+    PhNfpUpdateIconFromBitmap(PH_ICON_CPU_USAGE, text, bitmap);
 
-    DestroyIcon(icon);
     PhDereferenceObject(text);
 }
@@ -1215,3 +1215,237 @@ CleanupExit:
 
     return status;
 }
+
+/**
+ * Sends a number of API calls to the server in a single request.
+ *
+ * \param Calls An array of call payloads. Strings referenced by the calls must be created using
+ * PhSvcpCreateString. On return, each processed call contains its return status and output.
+ * \param NumberOfCalls The number of elements in \a Calls.
+ * \param Flags A combination of flags.
+ * \li \c PHSVC_API_BATCH_STOP_ON_FAILURE Stop processing calls after the first failure.
+ * \param NumberOfCallsProcessed A variable which receives the number of calls that were
+ * processed.
+ *
+ * \return The status of the request itself. The results of individual calls are stored in
+ * their ReturnStatus fields.
+ *
+ * \remarks If the calls do not fit in the port section, they are passed in a separate section
+ * created for this request.
+ */
+NTSTATUS PhSvcCallBatch(
+    _Inout_updates_(NumberOfCalls) PPHSVC_API_PAYLOAD Calls,
+    _In_ ULONG NumberOfCalls,
+    _In_ ULONG Flags,
+    _Out_opt_ PULONG NumberOfCallsProcessed
+    )
+{
+    NTSTATUS status;
+    PHSVC_API_MSG m;
+    ULONG64 callsLength;
+    PVOID calls = NULL;
+    HANDLE sectionHandle = NULL;
+    PVOID viewBase = NULL;
+    HANDLE serverHandle = NULL;
+    HANDLE remoteSectionHandle = NULL;
+
+    memset(&m, 0, sizeof(PHSVC_API_MSG));
+
+    if (NumberOfCallsProcessed)
+        *NumberOfCallsProcessed = 0;
+
+    if (!PhSvcClPortHandle)
+        return STATUS_PORT_DISCONNECTED;
+    if (NumberOfCalls == 0)
+        return STATUS_SUCCESS;
+
+    callsLength = (ULONG64)NumberOfCalls * sizeof(PHSVC_API_PAYLOAD);
+
+    if (callsLength > MAXULONG32)
+        return STATUS_INVALID_PARAMETER_2;
+
+    m.p.ApiNumber = PhSvcBatchApiNumber;
+    m.p.u.Batch.i.Calls.Length = (ULONG)callsLength;
+    m.p.u.Batch.i.Flags = Flags;
+
+    if (calls = PhSvcpAllocateHeap((SIZE_T)callsLength, &m.p.u.Batch.i.Calls.Offset))
+    {
+        memcpy(calls, Calls, (SIZE_T)callsLength);
+    }
+    else
+    {
+        LARGE_INTEGER sectionSize;
+        SIZE_T viewSize;
+
+        // The calls don't fit in the port section, so give the server a section of its own.
+        // As with PhSvcCallWriteMiniDumpProcess, we duplicate the handle into the server.
+
+        sectionSize.QuadPart = callsLength;
+        status = NtCreateSection(
+            &sectionHandle,
+            SECTION_ALL_ACCESS,
+            NULL,
+            &sectionSize,
+            PAGE_READWRITE,
+            SEC_COMMIT,
+            NULL
+            );
+
+        if (!NT_SUCCESS(status))
+            goto CleanupExit;
+
+        viewSize = 0;
+        status = NtMapViewOfSection(
+            sectionHandle,
+            NtCurrentProcess(),
+            &viewBase,
+            0,
+            0,
+            NULL,
+            &viewSize,
+            ViewUnmap,
+            0,
+            PAGE_READWRITE
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            viewBase = NULL;
+            goto CleanupExit;
+        }
+
+        if (!NT_SUCCESS(status = PhOpenProcess(&serverHandle, PROCESS_DUP_HANDLE, PhSvcClServerProcessId)))
+            goto CleanupExit;
+
+        if (!NT_SUCCESS(status = PhDuplicateObject(NtCurrentProcess(), sectionHandle, serverHandle, &remoteSectionHandle,
+            SECTION_QUERY | SECTION_MAP_READ | SECTION_MAP_WRITE, 0, 0)))
+        {
+            goto CleanupExit;
+        }
+
+        memcpy(viewBase, Calls, (SIZE_T)callsLength);
+        m.p.u.Batch.i.Calls.Offset = 0;
+        m.p.u.Batch.i.SectionHandle = HandleToUlong(remoteSectionHandle);
+    }
+
+    status = PhSvcpCallServer(&m);
+
+    if (NT_SUCCESS(status))
+    {
+        memcpy(Calls, viewBase ? viewBase : calls, (SIZE_T)callsLength);
+
+        if (NumberOfCallsProcessed)
+            *NumberOfCallsProcessed = m.p.u.Batch.o.NumberOfCalls;
+    }
+
+CleanupExit:
+    if (serverHandle)
+    {
+        if (remoteSectionHandle)
+            PhDuplicateObject(serverHandle, remoteSectionHandle, NULL, NULL, 0, 0, DUPLICATE_CLOSE_SOURCE);
+
+        NtClose(serverHandle);
+    }
+
+    if (viewBase)
+        NtUnmapViewOfSection(NtCurrentProcess(), viewBase);
+    if (sectionHandle)
+        NtClose(sectionHandle);
+    if (calls)
+        PhSvcpFreeHeap(calls);
+
+    return status;
+}
+
+NTSTATUS PhSvcCallControlProcessBatch(
+    _In_reads_(NumberOfProcesses) PHANDLE ProcessIds,
+    _In_ ULONG NumberOfProcesses,
+    _In_ PHSVC_API_CONTROLPROCESS_COMMAND Command,
+    _In_ ULONG Argument,
+    _Out_writes_(NumberOfProcesses) PNTSTATUS Statuses
+    )
+{
+    NTSTATUS status;
+    PPHSVC_API_PAYLOAD calls;
+    ULONG i;
+
+    calls = PhAllocate(NumberOfProcesses * sizeof(PHSVC_API_PAYLOAD));
+    memset(calls, 0, NumberOfProcesses * sizeof(PHSVC_API_PAYLOAD));
+
+    for (i = 0; i < NumberOfProcesses; i++)
+    {
+        calls[i].ApiNumber = PhSvcControlProcessApiNumber;
+        calls[i].u.ControlProcess.i.ProcessId = ProcessIds[i];
+        calls[i].u.ControlProcess.i.Command = Command;
+        calls[i].u.ControlProcess.i.Argument = Argument;
+    }
+
+    status = PhSvcCallBatch(calls, NumberOfProcesses, 0, NULL);
+
+    for (i = 0; i < NumberOfProcesses; i++)
+        Statuses[i] = NT_SUCCESS(status) ? calls[i].ReturnStatus : status;
+
+    PhFree(calls);
+
+    return status;
+}
+
+NTSTATUS PhSvcCallControlServiceBatch(
+    _In_reads_(NumberOfServices) PWSTR *ServiceNames,
+    _In_ ULONG NumberOfServices,
+    _In_ PHSVC_API_CONTROLSERVICE_COMMAND Command,
+    _Out_writes_(NumberOfServices) PNTSTATUS Statuses
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PPHSVC_API_PAYLOAD calls;
+    PVOID *serviceNames;
+    ULONG start;
+    ULONG count;
+    ULONG i;
+
+    calls = PhAllocate(NumberOfServices * sizeof(PHSVC_API_PAYLOAD));
+    memset(calls, 0, NumberOfServices * sizeof(PHSVC_API_PAYLOAD));
+    serviceNames = PhAllocate(NumberOfServices * sizeof(PVOID));
+    start = 0;
+
+    while (start < NumberOfServices)
+    {
+        // Send as many calls as the port heap has room for the service names.
+        for (count = 0; start + count < NumberOfServices; count++)
+        {
+            i = start + count;
+            calls[i].ApiNumber = PhSvcControlServiceApiNumber;
+            calls[i].u.ControlService.i.Command = Command;
+
+            if (!(serviceNames[i] = PhSvcpCreateString(ServiceNames[i], -1, &calls[i].u.ControlService.i.ServiceName)))
+                break;
+        }
+
+        if (count == 0)
+            status = STATUS_NO_MEMORY;
+        else
+            status = PhSvcCallBatch(&calls[start], count, 0, NULL);
+
+        for (i = start; i < start + count; i++)
+        {
+            Statuses[i] = NT_SUCCESS(status) ? calls[i].ReturnStatus : status;
+            PhSvcpFreeHeap(serviceNames[i]);
+        }
+
+        if (!NT_SUCCESS(status))
+        {
+            for (i = start + count; i < NumberOfServices; i++)
+                Statuses[i] = status;
+
+            break;
+        }
+
+        start += count;
+    }
+
+    PhFree(serviceNames);
+    PhFree(calls);
+
+    return status;
+}
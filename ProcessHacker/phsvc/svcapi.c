@@ -59,7 +59,8 @@ PPHSVC_API_PROCEDURE PhSvcApiCallTable[] =
     PhSvcApiCreateProcessIgnoreIfeoDebugger,
     PhSvcApiSetServiceSecurity,
     PhSvcApiLoadDbgHelp,
-    PhSvcApiWriteMiniDumpProcess
+    PhSvcApiWriteMiniDumpProcess,
+    PhSvcApiBatch
 };
 C_ASSERT(sizeof(PhSvcApiCallTable) / sizeof(PPHSVC_API_PROCEDURE) == PhSvcMaximumApiNumber - 1);
 
@@ -70,31 +71,58 @@ NTSTATUS PhSvcApiInitialization(
     return STATUS_SUCCESS;
 }
 
-VOID PhSvcDispatchApiCall(
+NTSTATUS PhSvcpCallApi(
     _In_ PPHSVC_CLIENT Client,
-    _Inout_ PPHSVC_API_PAYLOAD Payload,
-    _Out_ PHANDLE ReplyPortHandle
+    _Inout_ PPHSVC_API_PAYLOAD Payload
     )
 {
-    NTSTATUS status;
-
     if (
         Payload->ApiNumber == 0 ||
         (ULONG)Payload->ApiNumber >= (ULONG)PhSvcMaximumApiNumber ||
         !PhSvcApiCallTable[Payload->ApiNumber - 1]
         )
     {
-        Payload->ReturnStatus = STATUS_INVALID_SYSTEM_SERVICE;
-        *ReplyPortHandle = Client->PortHandle;
-        return;
+        return STATUS_INVALID_SYSTEM_SERVICE;
     }
 
-    status = PhSvcApiCallTable[Payload->ApiNumber - 1](Client, Payload);
-    Payload->ReturnStatus = status;
+    return PhSvcApiCallTable[Payload->ApiNumber - 1](Client, Payload);
+}
 
+VOID PhSvcDispatchApiCall(
+    _In_ PPHSVC_CLIENT Client,
+    _Inout_ PPHSVC_API_PAYLOAD Payload,
+    _Out_ PHANDLE ReplyPortHandle
+    )
+{
+    Payload->ReturnStatus = PhSvcpCallApi(Client, Payload);
     *ReplyPortHandle = Client->PortHandle;
 }
 
+/**
+ * Determines whether a call may take a long time to complete. These calls are processed on
+ * worker threads so that they don't hold up other requests.
+ */
+BOOLEAN PhSvcIsLongRunningApiCall(
+    _In_ PPHSVC_API_PAYLOAD Payload
+    )
+{
+    switch (Payload->ApiNumber)
+    {
+    case PhSvcPluginApiNumber:
+    case PhSvcExecuteRunAsCommandApiNumber:
+    case PhSvcControlServiceApiNumber:
+    case PhSvcInvokeRunAsServiceApiNumber:
+    case PhSvcSendMessageApiNumber:
+    case PhSvcCreateProcessIgnoreIfeoDebuggerApiNumber:
+    case PhSvcLoadDbgHelpApiNumber:
+    case PhSvcWriteMiniDumpProcessApiNumber:
+    case PhSvcBatchApiNumber:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
 PVOID PhSvcValidateString(
     _In_ PPH_RELATIVE_STRINGREF String,
     _In_ ULONG Alignment
@@ -1424,3 +1452,98 @@ NTSTATUS PhSvcApiWriteMiniDumpProcess(
             return STATUS_UNSUCCESSFUL;
     }
 }
+
+NTSTATUS PhSvcApiBatch(
+    _In_ PPHSVC_CLIENT Client,
+    _Inout_ PPHSVC_API_PAYLOAD Payload
+    )
+{
+    NTSTATUS status;
+    PH_RELATIVE_STRINGREF callsRef;
+    HANDLE sectionHandle;
+    ULONG flags;
+    PVOID viewBase = NULL;
+    SIZE_T viewSize = 0;
+    PPHSVC_API_PAYLOAD calls;
+    ULONG numberOfCalls;
+    ULONG numberOfFailures;
+    ULONG i;
+    PHSVC_API_PAYLOAD call;
+
+    callsRef = Payload->u.Batch.i.Calls;
+    sectionHandle = UlongToHandle(Payload->u.Batch.i.SectionHandle);
+    flags = Payload->u.Batch.i.Flags;
+
+    if (callsRef.Length % sizeof(PHSVC_API_PAYLOAD) != 0)
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    if (sectionHandle)
+    {
+        status = NtMapViewOfSection(
+            sectionHandle,
+            NtCurrentProcess(),
+            &viewBase,
+            0,
+            0,
+            NULL,
+            &viewSize,
+            ViewUnmap,
+            0,
+            PAGE_READWRITE
+            );
+
+        if (!NT_SUCCESS(status))
+            return status;
+
+        if (callsRef.Offset > viewSize || callsRef.Length > viewSize - callsRef.Offset ||
+            (callsRef.Offset & (sizeof(ULONG_PTR) - 1)))
+        {
+            status = STATUS_ACCESS_VIOLATION;
+            goto CleanupExit;
+        }
+
+        calls = PTR_ADD_OFFSET(viewBase, callsRef.Offset);
+    }
+    else
+    {
+        if (!NT_SUCCESS(status = PhSvcProbeBuffer(&callsRef, sizeof(ULONG_PTR), FALSE, &calls)))
+            return status;
+    }
+
+    numberOfCalls = callsRef.Length / sizeof(PHSVC_API_PAYLOAD);
+    numberOfFailures = 0;
+
+    for (i = 0; i < numberOfCalls; i++)
+    {
+        // Work on a copy so the client can't change the call while it is being processed.
+        memcpy(&call, &calls[i], sizeof(PHSVC_API_PAYLOAD));
+
+        if (call.ApiNumber != PhSvcBatchApiNumber)
+            call.ReturnStatus = PhSvcpCallApi(Client, &call);
+        else
+            call.ReturnStatus = STATUS_INVALID_SYSTEM_SERVICE;
+
+        memcpy(&calls[i], &call, sizeof(PHSVC_API_PAYLOAD));
+
+        if (!NT_SUCCESS(call.ReturnStatus))
+        {
+            numberOfFailures++;
+
+            if (flags & PHSVC_API_BATCH_STOP_ON_FAILURE)
+            {
+                i++;
+                break;
+            }
+        }
+    }
+
+    Payload->u.Batch.o.NumberOfCalls = i;
+    Payload->u.Batch.o.NumberOfFailures = numberOfFailures;
+    status = STATUS_SUCCESS;
+
+CleanupExit:
+    if (viewBase)
+        NtUnmapViewOfSection(NtCurrentProcess(), viewBase);
+
+    return status;
+}
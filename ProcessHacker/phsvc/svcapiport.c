@@ -23,6 +23,14 @@
 #include <phapp.h>
 #include <phsvc.h>
 
+#define PHSVC_MAXIMUM_PENDING_CALLS_PER_CLIENT 4
+
+typedef struct _PHSVC_QUEUED_CALL
+{
+    PPHSVC_CLIENT Client;
+    UCHAR Message[1];
+} PHSVC_QUEUED_CALL, *PPHSVC_QUEUED_CALL;
+
 NTSTATUS PhSvcApiRequestThreadStart(
     _In_ PVOID Parameter
     );
@@ -33,6 +41,7 @@ extern HANDLE PhSvcTimeoutCancelEventHandle;
 ULONG PhSvcApiThreadContextTlsIndex;
 HANDLE PhSvcApiPortHandle;
 ULONG PhSvcApiNumberOfClients = 0;
+PH_WORK_QUEUE PhSvcApiWorkQueue;
 
 NTSTATUS PhSvcApiPortInitialization(
     _In_ PUNICODE_STRING PortName
@@ -93,9 +102,11 @@ NTSTATUS PhSvcApiPortInitialization(
     if (!NT_SUCCESS(status))
         return status;
 
-    // Start the API threads.
+    // Start the API threads. Long-running calls are handed off to the work queue so that the
+    // request threads stay available.
 
     PhSvcApiThreadContextTlsIndex = TlsAlloc();
+    PhInitializeWorkQueue(&PhSvcApiWorkQueue, 0, 8, 5000);
 
     for (i = 0; i < 2; i++)
     {
@@ -115,6 +126,78 @@ PPHSVC_THREAD_CONTEXT PhSvcGetCurrentThreadContext(
     return (PPHSVC_THREAD_CONTEXT)TlsGetValue(PhSvcApiThreadContextTlsIndex);
 }
 
+PPHSVC_API_PAYLOAD PhSvcpGetMessagePayload(
+    _In_ PPORT_MESSAGE PortMessage
+    )
+{
+    if (PhIsExecutingInWow64())
+        return &((PPHSVC_API_MSG64)PortMessage)->p;
+    else
+        return &((PPHSVC_API_MSG)PortMessage)->p;
+}
+
+NTSTATUS PhSvcApiCallWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPHSVC_QUEUED_CALL queuedCall = Parameter;
+    PHSVC_THREAD_CONTEXT threadContext;
+    HANDLE portHandle;
+
+    threadContext.CurrentClient = queuedCall->Client;
+    threadContext.OldClient = NULL;
+    TlsSetValue(PhSvcApiThreadContextTlsIndex, &threadContext);
+
+    PhSvcDispatchApiCall(queuedCall->Client, PhSvcpGetMessagePayload((PPORT_MESSAGE)queuedCall->Message), &portHandle);
+
+    // The client is still waiting in NtRequestWaitReplyPort, and the message header identifies the
+    // request being replied to. If the client has gone away the reply simply fails.
+    NtReplyPort(portHandle, (PPORT_MESSAGE)queuedCall->Message);
+
+    assert(!threadContext.OldClient);
+    TlsSetValue(PhSvcApiThreadContextTlsIndex, NULL);
+
+    _InterlockedDecrement(&queuedCall->Client->PendingCalls);
+    PhDereferenceObject(queuedCall->Client);
+    PhFree(queuedCall);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Queues a request to be processed and replied to on a worker thread.
+ *
+ * \param Client The client that sent the request.
+ * \param PortMessage The request message.
+ * \param MessageSize The size of the request message.
+ *
+ * \return TRUE if the request was queued, or FALSE if the client already has too many requests
+ * in progress, in which case the caller should process the request itself.
+ */
+BOOLEAN PhSvcpQueueApiCall(
+    _In_ PPHSVC_CLIENT Client,
+    _In_ PPORT_MESSAGE PortMessage,
+    _In_ SIZE_T MessageSize
+    )
+{
+    PPHSVC_QUEUED_CALL queuedCall;
+
+    if (_InterlockedIncrement(&Client->PendingCalls) > PHSVC_MAXIMUM_PENDING_CALLS_PER_CLIENT)
+    {
+        _InterlockedDecrement(&Client->PendingCalls);
+        return FALSE;
+    }
+
+    queuedCall = PhAllocate(FIELD_OFFSET(PHSVC_QUEUED_CALL, Message) + MessageSize);
+    PhReferenceObject(Client);
+    queuedCall->Client = Client;
+    memcpy(queuedCall->Message, PortMessage, MessageSize);
+
+    PhQueueItemWorkQueue(&PhSvcApiWorkQueue, PhSvcApiCallWorker, queuedCall);
+
+    return TRUE;
+}
+
 NTSTATUS PhSvcApiRequestThreadStart(
     _In_ PVOID Parameter
     )
@@ -175,13 +258,13 @@ NTSTATUS PhSvcApiRequestThreadStart(
 
         if (messageType == LPC_REQUEST)
         {
-            if (PhIsExecutingInWow64())
-                payload = &((PPHSVC_API_MSG64)receiveMessage)->p;
-            else
-                payload = &((PPHSVC_API_MSG)receiveMessage)->p;
+            payload = PhSvcpGetMessagePayload(receiveMessage);
 
-            PhSvcDispatchApiCall(client, payload, &portHandle);
-            replyMessage = receiveMessage;
+            if (!PhSvcIsLongRunningApiCall(payload) || !PhSvcpQueueApiCall(client, receiveMessage, messageSize))
+            {
+                PhSvcDispatchApiCall(client, payload, &portHandle);
+                replyMessage = receiveMessage;
+            }
         }
         else if (messageType == LPC_PORT_CLOSED)
         {
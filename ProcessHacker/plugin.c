@@ -27,6 +27,7 @@
 #include <extmgri.h>
 #include <notifico.h>
 #include <phsvccl.h>
+#include <verify.h>
 
 typedef struct _PHP_PLUGIN_LOAD_ERROR
 {
@@ -59,6 +60,7 @@ PH_AVL_TREE PhPluginsByName = PH_AVL_TREE_INIT(PhpPluginsCompareFunction);
 static PH_CALLBACK GeneralCallbacks[GeneralCallbackMaximum];
 static PPH_STRING PluginsDirectory;
 static PPH_LIST LoadErrors;
+static PH_QUEUED_LOCK LoadErrorsLock = PH_QUEUED_LOCK_INIT;
 static ULONG NextPluginId = IDPLUGINS + 1;
 
 VOID PhPluginsInitialization(
@@ -216,15 +218,30 @@ static BOOLEAN EnumPluginsDirectoryCallback(
             memcpy(fileName->Buffer, PluginsDirectory->Buffer, PluginsDirectory->Length);
             memcpy(&fileName->Buffer[PluginsDirectory->Length / 2], Information->FileName, Information->FileNameLength);
 
-            PhLoadPlugin(fileName);
-
-            PhDereferenceObject(fileName);
+            PhAddItemList((PPH_LIST)Context, fileName);
         }
     }
 
     return TRUE;
 }
 
+static NTSTATUS PhpLoadPluginFunction(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_STRING fileName = Parameter;
+    PH_AUTO_POOL autoPool;
+
+    // Plugins may create auto-dereferenced objects while they are initialized.
+    PhInitializeAutoPool(&autoPool);
+    PhLoadPlugin(fileName);
+    PhDeleteAutoPool(&autoPool);
+
+    PhDereferenceObject(fileName);
+
+    return STATUS_SUCCESS;
+}
+
 /**
  * Loads plugins from the default plugins directory.
  */
@@ -234,6 +251,8 @@ VOID PhLoadPlugins(
 {
     HANDLE pluginsDirectoryHandle;
     PPH_STRING pluginsDirectory;
+    PPH_LIST fileNames;
+    ULONG i;
 
     pluginsDirectory = PhGetStringSetting(L"PluginsDirectory");
 
@@ -248,6 +267,8 @@ VOID PhLoadPlugins(
         PluginsDirectory = pluginsDirectory;
     }
 
+    fileNames = PhCreateList(10);
+
     if (NT_SUCCESS(PhCreateFileWin32(
         &pluginsDirectoryHandle,
         PluginsDirectory->Buffer,
@@ -260,10 +281,31 @@ VOID PhLoadPlugins(
     {
         UNICODE_STRING pattern = RTL_CONSTANT_STRING(L"*.dll");
 
-        PhEnumDirectoryFile(pluginsDirectoryHandle, &pattern, EnumPluginsDirectoryCallback, NULL);
+        PhEnumDirectoryFile(pluginsDirectoryHandle, &pattern, EnumPluginsDirectoryCallback, fileNames);
         NtClose(pluginsDirectoryHandle);
     }
 
+    if (fileNames->Count > 1)
+    {
+        PH_WORK_QUEUE workQueue;
+        PH_WORK_QUEUE_BATCH workQueueBatch;
+
+        // Mapping and resolving imports for each plugin happens in parallel. The loader still
+        // runs DllMain (and so PhRegisterPlugin) for one plugin at a time.
+        PhInitializeWorkQueueEx(&workQueue, 0, min(fileNames->Count, (ULONG)PhSystemBasicInformation.NumberOfProcessors), 1000, 0);
+        PhInitializeWorkQueueBatch(&workQueueBatch);
+        PhQueueItemsWorkQueueEx(&workQueue, PhpLoadPluginFunction, fileNames->Items, fileNames->Count, &workQueueBatch);
+        PhWaitForWorkQueueBatch(&workQueueBatch, NULL);
+        PhDeleteWorkQueue(&workQueue);
+    }
+    else
+    {
+        for (i = 0; i < fileNames->Count; i++)
+            PhpLoadPluginFunction(fileNames->Items[i]);
+    }
+
+    PhDereferenceObject(fileNames);
+
     // Handle load errors.
     // In certain startup modes we want to ignore all plugin load errors.
     if (LoadErrors && LoadErrors->Count != 0 && !PhStartupParameters.PhSvc)
@@ -346,8 +388,16 @@ BOOLEAN PhLoadPlugin(
         PhSetReference(&fileName, FileName);
 
     success = TRUE;
+    errorMessage = NULL;
 
-    if (!LoadLibrary(fileName->Buffer))
+    // This runs on a work queue thread for each plugin, so the signature checks happen in
+    // parallel as well.
+    if (PhGetIntegerSetting(L"VerifyPluginSignatures") && PhVerifyFile(fileName->Buffer, NULL) != VrTrusted)
+    {
+        success = FALSE;
+        errorMessage = PhCreateString(L"The plugin is not signed by a trusted publisher.");
+    }
+    else if (!LoadLibrary(fileName->Buffer))
     {
         success = FALSE;
         errorMessage = PhGetWin32Message(GetLastError());
@@ -361,11 +411,15 @@ BOOLEAN PhLoadPlugin(
         PhSetReference(&loadError->FileName, fileName);
         PhSetReference(&loadError->ErrorMessage, errorMessage);
 
+        PhAcquireQueuedLockExclusive(&LoadErrorsLock);
+
         if (!LoadErrors)
             LoadErrors = PhCreateList(2);
 
         PhAddItemList(LoadErrors, loadError);
 
+        PhReleaseQueuedLockExclusive(&LoadErrorsLock);
+
         if (errorMessage)
             PhDereferenceObject(errorMessage);
     }
@@ -501,6 +555,7 @@ PPH_PLUGIN PhRegisterPlugin(
         PhInitializeCallback(&plugin->Callbacks[i]);
 
     PhEmInitializeAppContext(&plugin->AppContext, &pluginName);
+    PhInitializeInitOnce(&plugin->InitializeOnce);
 
     if (Information)
         *Information = &plugin->Information;
@@ -583,6 +638,33 @@ PPH_CALLBACK PhGetPluginCallback(
     return &Plugin->Callbacks[Callback];
 }
 
+/**
+ * Performs the deferred initialization of a plugin.
+ *
+ * \param Plugin A plugin instance structure.
+ *
+ * \remarks If the plugin set LazyInitialization in its information block,
+ * the \ref PluginCallbackInitialize callback is invoked the first time this
+ * function is called. Later calls (and calls from other threads while the
+ * callback is running) wait for it to complete and then return. The program
+ * calls this function before it dispatches menu items, tree new messages for
+ * the plugin's columns and the options dialog to the plugin. Plugins should
+ * call it themselves before using anything set up by the callback.
+ */
+VOID PhPluginEnsureInitialized(
+    _In_ PPH_PLUGIN Plugin
+    )
+{
+    if (!Plugin->Information.LazyInitialization)
+        return;
+
+    if (PhBeginInitOnce(&Plugin->InitializeOnce))
+    {
+        PhInvokeCallback(PhGetPluginCallback(Plugin, PluginCallbackInitialize), NULL);
+        PhEndInitOnce(&Plugin->InitializeOnce);
+    }
+}
+
 /**
  * Retrieves a pointer to a general callback.
  *
@@ -877,6 +959,7 @@ BOOLEAN PhPluginTriggerEMenuItem(
 
     pluginMenuItem->OwnerWindow = MenuInfo->OwnerWindow;
 
+    PhPluginEnsureInitialized(pluginMenuItem->Plugin);
     PhInvokeCallback(PhGetPluginCallback(pluginMenuItem->Plugin, PluginCallbackMenuItem), pluginMenuItem);
 
     return TRUE;
@@ -913,6 +996,34 @@ BOOLEAN PhPluginAddTreeNewColumn(
         );
 }
 
+/**
+ * Sets a sort key function for a column added using PhPluginAddTreeNewColumn().
+ *
+ * \param Plugin A plugin instance structure.
+ * \param CmData The CmData value from the \ref PH_PLUGIN_TREENEW_INFORMATION
+ * structure.
+ * \param SubId The identifier of the column.
+ * \param SortKeyFunction A function which returns a key for a node. Nodes are
+ * sorted by key, and the sort function of the column is only used for nodes
+ * with equal keys. The keys must be in the same order as the sort function.
+ */
+BOOLEAN PhPluginSetTreeNewColumnSortKey(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PVOID CmData,
+    _In_ ULONG SubId,
+    _In_ PPH_PLUGIN_TREENEW_SORT_KEY_FUNCTION SortKeyFunction
+    )
+{
+    PPH_CM_COLUMN column;
+
+    if (!(column = PhCmFindColumn(CmData, &Plugin->AppContext.AppName, SubId)))
+        return FALSE;
+
+    column->SortKeyFunction = SortKeyFunction;
+
+    return TRUE;
+}
+
 /**
  * Sets the object extension size and callbacks for an object type.
  *
@@ -959,6 +1070,70 @@ PVOID PhPluginGetObjectExtension(
         );
 }
 
+/**
+ * Adds a column to the columnar extension store of an object type.
+ *
+ * \param Plugin A plugin instance structure.
+ * \param ObjectType The type of object for which the column is being registered.
+ * \param ElementSize The size of each element, in bytes.
+ *
+ * \remarks Use this instead of an object extension for fields that are refreshed for every
+ * object on each update; see PhPluginSetObjectBulkCallback().
+ */
+PPH_EM_OBJECT_COLUMN PhPluginAddObjectColumn(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ ULONG ElementSize
+    )
+{
+    return PhEmAddObjectColumn(&Plugin->AppContext, ObjectType, ElementSize);
+}
+
+/**
+ * Gets the column element for an object.
+ *
+ * \param Column The column returned by PhPluginAddObjectColumn().
+ * \param Object The object.
+ */
+PVOID PhPluginGetObjectColumnElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ PVOID Object
+    )
+{
+    return PhEmGetObjectColumnElement(Column, PhEmGetObjectSlot(Column->ObjectType, Object));
+}
+
+/**
+ * Gets the column element for a slot.
+ *
+ * \param Column The column returned by PhPluginAddObjectColumn().
+ * \param Slot An index into the object array passed to a bulk update callback.
+ */
+PVOID PhPluginGetObjectColumnSlotElement(
+    _In_ PPH_EM_OBJECT_COLUMN Column,
+    _In_ ULONG Slot
+    )
+{
+    return PhEmGetObjectColumnElement(Column, Slot);
+}
+
+/**
+ * Sets the bulk update callback for an object type.
+ *
+ * \param Plugin A plugin instance structure.
+ * \param ObjectType The object type. Bulk updates are raised for process, service and network
+ * items, just before the corresponding "updated" event.
+ * \param BulkCallback The callback function.
+ */
+VOID PhPluginSetObjectBulkCallback(
+    _In_ PPH_PLUGIN Plugin,
+    _In_ PH_EM_OBJECT_TYPE ObjectType,
+    _In_ PPH_EM_OBJECT_BULK_CALLBACK BulkCallback
+    )
+{
+    PhEmSetObjectBulkCallback(&Plugin->AppContext, ObjectType, BulkCallback);
+}
+
 /**
  * Creates a notification icon.
  *
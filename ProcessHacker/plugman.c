@@ -373,6 +373,7 @@ INT_PTR CALLBACK PhpPluginsDlgProc(
                 {
                     if (SelectedPlugin && IS_PLUGIN_LOADED(SelectedPlugin))
                     {
+                        PhPluginEnsureInitialized(SelectedPlugin);
                         PhInvokeCallback(PhGetPluginCallback(SelectedPlugin, PluginCallbackShowOptions), hwndDlg);
                     }
                 }
@@ -428,6 +429,7 @@ INT_PTR CALLBACK PhpPluginsDlgProc(
                     {
                         if (SelectedPlugin && IS_PLUGIN_LOADED(SelectedPlugin))
                         {
+                            PhPluginEnsureInitialized(SelectedPlugin);
                             PhInvokeCallback(PhGetPluginCallback(SelectedPlugin, PluginCallbackShowOptions), hwndDlg);
                         }
                     }
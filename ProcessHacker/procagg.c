@@ -0,0 +1,364 @@
+/*
+ * Process Hacker -
+ *   session, user and job rollups
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The process provider feeds each process item into the aggregates of its session, user and
+ * (named) job as it updates the item, so views never have to scan the process list. Each
+ * process item keeps a reference to its aggregates, so the hashtable is only searched when a
+ * process is first seen or when its job name becomes known.
+ *
+ * Totals for the current period are collected in Pending by the provider thread without
+ * locking, and are copied to Values (under PhpProcessAggregateLock) once per update, when
+ * history samples are added and aggregates without processes are removed.
+ */
+
+#include <phapp.h>
+#include <procagg.h>
+
+static PPH_OBJECT_TYPE PhpProcessAggregateType = NULL;
+static PH_QUEUED_LOCK PhpProcessAggregateLock = PH_QUEUED_LOCK_INIT;
+static PPH_HASHTABLE PhpProcessAggregateHashtable = NULL; // provider thread only
+static PPH_LIST PhpProcessAggregateList = NULL; // protected by PhpProcessAggregateLock
+
+static VOID NTAPI PhpProcessAggregateDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_PROCESS_AGGREGATE aggregate = Object;
+
+    if (aggregate->Name)
+        PhDereferenceObject(aggregate->Name);
+
+    PhDeleteCircularBuffer_FLOAT(&aggregate->CpuHistory);
+    PhDeleteCircularBuffer_SIZE_T(&aggregate->PrivateBytesHistory);
+    PhDeleteCircularBuffer_ULONG64(&aggregate->IoReadOtherHistory);
+    PhDeleteCircularBuffer_ULONG64(&aggregate->IoWriteHistory);
+}
+
+static BOOLEAN NTAPI PhpProcessAggregateEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_PROCESS_AGGREGATE aggregate1 = *(PPH_PROCESS_AGGREGATE *)Entry1;
+    PPH_PROCESS_AGGREGATE aggregate2 = *(PPH_PROCESS_AGGREGATE *)Entry2;
+
+    return
+        aggregate1->Type == aggregate2->Type &&
+        aggregate1->SessionId == aggregate2->SessionId &&
+        PhEqualStringZ(PhGetStringOrEmpty(aggregate1->Name), PhGetStringOrEmpty(aggregate2->Name), TRUE);
+}
+
+static ULONG NTAPI PhpProcessAggregateHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_PROCESS_AGGREGATE aggregate = *(PPH_PROCESS_AGGREGATE *)Entry;
+    ULONG hash;
+
+    hash = aggregate->Type ^ (aggregate->SessionId * 31);
+
+    if (aggregate->Name)
+        hash ^= PhHashStringRef(&aggregate->Name->sr, TRUE);
+
+    return hash;
+}
+
+static PPH_PROCESS_AGGREGATE PhpReferenceProcessAggregate(
+    _In_ PH_PROCESS_AGGREGATE_TYPE Type,
+    _In_ ULONG SessionId,
+    _In_opt_ PPH_STRING Name
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PH_PROCESS_AGGREGATE lookupAggregate;
+    PPH_PROCESS_AGGREGATE lookupAggregatePointer = &lookupAggregate;
+    PPH_PROCESS_AGGREGATE *entry;
+    PPH_PROCESS_AGGREGATE aggregate;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpProcessAggregateType = PhCreateObjectType(L"ProcessAggregate", 0, PhpProcessAggregateDeleteProcedure);
+        PhpProcessAggregateHashtable = PhCreateHashtable(
+            sizeof(PPH_PROCESS_AGGREGATE),
+            PhpProcessAggregateEqualFunction,
+            PhpProcessAggregateHashFunction,
+            16
+            );
+        PhpProcessAggregateList = PhCreateList(16);
+        PhEndInitOnce(&initOnce);
+    }
+
+    lookupAggregate.Type = Type;
+    lookupAggregate.SessionId = SessionId;
+    lookupAggregate.Name = Name;
+
+    if (entry = PhFindEntryHashtable(PhpProcessAggregateHashtable, &lookupAggregatePointer))
+    {
+        PhReferenceObject(*entry);
+        return *entry;
+    }
+
+    aggregate = PhCreateObject(sizeof(PH_PROCESS_AGGREGATE), PhpProcessAggregateType);
+    memset(aggregate, 0, sizeof(PH_PROCESS_AGGREGATE));
+    aggregate->Type = Type;
+    aggregate->SessionId = SessionId;
+    PhSetReference(&aggregate->Name, Name);
+    PhInitializeCircularBuffer_FLOAT(&aggregate->CpuHistory, PhStatisticsSampleCount);
+    PhInitializeCircularBuffer_SIZE_T(&aggregate->PrivateBytesHistory, PhStatisticsSampleCount);
+    PhInitializeCircularBuffer_ULONG64(&aggregate->IoReadOtherHistory, PhStatisticsSampleCount);
+    PhInitializeCircularBuffer_ULONG64(&aggregate->IoWriteHistory, PhStatisticsSampleCount);
+
+    // The hashtable and the list share one reference, and the caller gets another.
+    PhAddEntryHashtable(PhpProcessAggregateHashtable, &aggregate);
+
+    PhAcquireQueuedLockExclusive(&PhpProcessAggregateLock);
+    PhAddItemList(PhpProcessAggregateList, aggregate);
+    PhReleaseQueuedLockExclusive(&PhpProcessAggregateLock);
+
+    PhReferenceObject(aggregate);
+
+    return aggregate;
+}
+
+/**
+ * Adds the statistics of a process item to its aggregates for the current update period.
+ *
+ * \param ProcessItem The process item. Its deltas must already be updated.
+ * \param NewProcess TRUE if the process item was created during this update, in which case its
+ * deltas contain the accumulated values and are not added to the running totals.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+VOID PhUpdateProcessItemAggregates(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ BOOLEAN NewProcess
+    )
+{
+    ULONG i;
+
+    if (!PH_IS_REAL_PROCESS_ID(ProcessItem->ProcessId))
+        return;
+
+    if (!ProcessItem->Aggregates[PhProcessAggregateSession])
+    {
+        ProcessItem->Aggregates[PhProcessAggregateSession] = PhpReferenceProcessAggregate(
+            PhProcessAggregateSession, ProcessItem->SessionId, NULL);
+    }
+
+    if (!ProcessItem->Aggregates[PhProcessAggregateUser] && ProcessItem->UserName)
+    {
+        ProcessItem->Aggregates[PhProcessAggregateUser] = PhpReferenceProcessAggregate(
+            PhProcessAggregateUser, 0, ProcessItem->UserName);
+    }
+
+    // The job name is filled in by the stage 1 query, which may complete after the process
+    // item has been added. Jobs without names cannot be told apart and are not tracked.
+    if (!ProcessItem->Aggregates[PhProcessAggregateJob] && ProcessItem->IsInJob && !PhIsNullOrEmptyString(ProcessItem->JobName))
+    {
+        ProcessItem->Aggregates[PhProcessAggregateJob] = PhpReferenceProcessAggregate(
+            PhProcessAggregateJob, 0, ProcessItem->JobName);
+    }
+
+    for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+    {
+        PPH_PROCESS_AGGREGATE_VALUES pending;
+
+        if (!ProcessItem->Aggregates[i])
+            continue;
+
+        pending = &ProcessItem->Aggregates[i]->Pending;
+        pending->NumberOfProcesses++;
+        pending->PrivateBytes += ProcessItem->VmCounters.PagefileUsage;
+        pending->WorkingSetSize += ProcessItem->VmCounters.WorkingSetSize;
+
+        if (!NewProcess)
+        {
+            pending->CpuUsage += ProcessItem->CpuUsage;
+            pending->IoReadOtherDelta += ProcessItem->IoReadDelta.Delta + ProcessItem->IoOtherDelta.Delta;
+            pending->IoWriteDelta += ProcessItem->IoWriteDelta.Delta;
+            pending->CpuTime += ProcessItem->CpuKernelDelta.Delta + ProcessItem->CpuUserDelta.Delta;
+            pending->IoReadOtherBytes += ProcessItem->IoReadDelta.Delta + ProcessItem->IoOtherDelta.Delta;
+            pending->IoWriteBytes += ProcessItem->IoWriteDelta.Delta;
+        }
+    }
+}
+
+/**
+ * Releases the aggregates of a process item which has terminated.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+VOID PhRemoveProcessItemAggregates(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PhProcessAggregateTypeMaximum; i++)
+    {
+        if (ProcessItem->Aggregates[i])
+        {
+            PhDereferenceObject(ProcessItem->Aggregates[i]);
+            ProcessItem->Aggregates[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Publishes the totals collected during the current update period.
+ *
+ * \param AddHistory TRUE to add the totals to the history buffers.
+ *
+ * \remarks This function must only be called by the process provider, after every process item
+ * has been passed to PhUpdateProcessItemAggregates().
+ */
+VOID PhPublishProcessAggregates(
+    _In_ BOOLEAN AddHistory
+    )
+{
+    PPH_LIST aggregatesToRemove = NULL;
+    ULONG i;
+
+    if (!PhpProcessAggregateList)
+        return;
+
+    PhAcquireQueuedLockExclusive(&PhpProcessAggregateLock);
+
+    for (i = 0; i < PhpProcessAggregateList->Count; i++)
+    {
+        PPH_PROCESS_AGGREGATE aggregate = PhpProcessAggregateList->Items[i];
+
+        aggregate->Values = aggregate->Pending;
+
+        if (AddHistory)
+        {
+            PhAddItemCircularBuffer_FLOAT(&aggregate->CpuHistory, aggregate->Values.CpuUsage);
+            PhAddItemCircularBuffer_SIZE_T(&aggregate->PrivateBytesHistory, aggregate->Values.PrivateBytes);
+            PhAddItemCircularBuffer_ULONG64(&aggregate->IoReadOtherHistory, aggregate->Values.IoReadOtherDelta);
+            PhAddItemCircularBuffer_ULONG64(&aggregate->IoWriteHistory, aggregate->Values.IoWriteDelta);
+        }
+
+        // Only the running totals carry over to the next period.
+        aggregate->Pending.NumberOfProcesses = 0;
+        aggregate->Pending.CpuUsage = 0;
+        aggregate->Pending.PrivateBytes = 0;
+        aggregate->Pending.WorkingSetSize = 0;
+        aggregate->Pending.IoReadOtherDelta = 0;
+        aggregate->Pending.IoWriteDelta = 0;
+
+        if (aggregate->Values.NumberOfProcesses == 0)
+        {
+            if (!aggregatesToRemove)
+                aggregatesToRemove = PhCreateList(4);
+
+            PhAddItemList(aggregatesToRemove, aggregate);
+            PhRemoveItemList(PhpProcessAggregateList, i);
+            i--;
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpProcessAggregateLock);
+
+    if (aggregatesToRemove)
+    {
+        for (i = 0; i < aggregatesToRemove->Count; i++)
+        {
+            PPH_PROCESS_AGGREGATE aggregate = aggregatesToRemove->Items[i];
+
+            PhRemoveEntryHashtable(PhpProcessAggregateHashtable, &aggregate);
+            PhDereferenceObject(aggregate);
+        }
+
+        PhDereferenceObject(aggregatesToRemove);
+    }
+}
+
+/**
+ * Enumerates the current aggregates.
+ *
+ * \param Aggregates A variable which receives an array of aggregates. You must dereference
+ * each aggregate and free the array using PhFree() when you no longer need them.
+ * \param NumberOfAggregates A variable which receives the number of aggregates.
+ */
+VOID PhEnumProcessAggregates(
+    _Out_ PPH_PROCESS_AGGREGATE **Aggregates,
+    _Out_ PULONG NumberOfAggregates
+    )
+{
+    PPH_PROCESS_AGGREGATE *aggregates;
+    ULONG count;
+    ULONG i;
+
+    PhAcquireQueuedLockShared(&PhpProcessAggregateLock);
+
+    count = PhpProcessAggregateList ? PhpProcessAggregateList->Count : 0;
+    aggregates = PhAllocate(sizeof(PPH_PROCESS_AGGREGATE) * max(count, 1));
+
+    for (i = 0; i < count; i++)
+    {
+        aggregates[i] = PhpProcessAggregateList->Items[i];
+        PhReferenceObject(aggregates[i]);
+    }
+
+    PhReleaseQueuedLockShared(&PhpProcessAggregateLock);
+
+    *Aggregates = aggregates;
+    *NumberOfAggregates = count;
+}
+
+VOID PhGetProcessAggregateValues(
+    _In_ PPH_PROCESS_AGGREGATE Aggregate,
+    _Out_ PPH_PROCESS_AGGREGATE_VALUES Values
+    )
+{
+    PhAcquireQueuedLockShared(&PhpProcessAggregateLock);
+    *Values = Aggregate->Values;
+    PhReleaseQueuedLockShared(&PhpProcessAggregateLock);
+}
+
+/**
+ * Copies the history of an aggregate, newest sample first.
+ *
+ * \param Aggregate The aggregate.
+ * \param History On input, Count specifies the size of the arrays, and any of the arrays may be
+ * NULL. On output, Count contains the number of samples copied.
+ */
+VOID PhCopyProcessAggregateHistory(
+    _In_ PPH_PROCESS_AGGREGATE Aggregate,
+    _Inout_ PPH_PROCESS_AGGREGATE_HISTORY History
+    )
+{
+    PhAcquireQueuedLockShared(&PhpProcessAggregateLock);
+
+    History->Count = min(History->Count, Aggregate->CpuHistory.Count);
+
+    if (History->CpuUsage)
+        PhCopyCircularBuffer_FLOAT(&Aggregate->CpuHistory, History->CpuUsage, History->Count);
+    if (History->PrivateBytes)
+        PhCopyCircularBuffer_SIZE_T(&Aggregate->PrivateBytesHistory, History->PrivateBytes, History->Count);
+    if (History->IoReadOther)
+        PhCopyCircularBuffer_ULONG64(&Aggregate->IoReadOtherHistory, History->IoReadOther, History->Count);
+    if (History->IoWrite)
+        PhCopyCircularBuffer_ULONG64(&Aggregate->IoWriteHistory, History->IoWrite, History->Count);
+
+    PhReleaseQueuedLockShared(&PhpProcessAggregateLock);
+}
@@ -0,0 +1,584 @@
+/*
+ * Process Hacker -
+ *   process threshold alerts
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Alert rules are read from the ProcessAlertRules setting, which is a list of rules separated
+ * by semicolons. Each rule has the form "metric>threshold" or "metric>threshold:seconds", for
+ * example "cpu>90:30;privategrowth>1G". Thresholds may use the K, M and G suffixes.
+ *
+ * The rules are compiled into a rule set sorted by metric, so the process provider reads each
+ * metric of a process item at most once and compares it with the lowest rearm threshold of the
+ * rules for that metric before looking at any rule. A state is only kept for a (process, rule)
+ * pair while the value is above the rearm threshold of the rule, which is a little below the
+ * threshold itself. The alert fires once the value has been above the threshold for the
+ * duration of the rule, and cannot fire again until the state has been removed.
+ *
+ * Alerts are collected during the update and delivered through PhProcessAlertEvent when the
+ * provider publishes its results.
+ */
+
+#include <phapp.h>
+#include <procalrt.h>
+#include <settings.h>
+
+// The value has to fall below this fraction of the threshold before the rule can fire again.
+#define PH_ALERT_REARM_FACTOR 0.9
+
+typedef enum _PH_ALERT_METRIC
+{
+    PhAlertMetricCpu, // percent
+    PhAlertMetricPrivateBytes,
+    PhAlertMetricPrivateBytesGrowth, // bytes per minute
+    PhAlertMetricWorkingSet,
+    PhAlertMetricIo, // bytes per second
+    PhAlertMetricHandles,
+    PhAlertMetricThreads,
+    PhAlertMetricMaximum
+} PH_ALERT_METRIC;
+
+typedef struct _PH_ALERT_RULE
+{
+    PH_ALERT_METRIC Metric;
+    DOUBLE Threshold;
+    DOUBLE RearmThreshold;
+    ULONG Duration; // in seconds
+    ULONG64 RawThreshold; // as written, with the suffix applied
+    PPH_STRING Text;
+} PH_ALERT_RULE, *PPH_ALERT_RULE;
+
+typedef struct _PH_ALERT_RULE_SET
+{
+    ULONG NumberOfRules;
+    PPH_ALERT_RULE Rules; // sorted by metric
+    // The rules for metric m are Rules[MetricStart[m]] to Rules[MetricStart[m + 1] - 1].
+    ULONG MetricStart[PhAlertMetricMaximum + 1];
+    DOUBLE MetricRearmThreshold[PhAlertMetricMaximum];
+} PH_ALERT_RULE_SET, *PPH_ALERT_RULE_SET;
+
+typedef struct _PH_ALERT_STATE
+{
+    PPH_PROCESS_ITEM ProcessItem;
+    ULONG RuleIndex;
+
+    ULONG RunId;
+    BOOLEAN Fired;
+    LARGE_INTEGER ExceededTime; // zero if the value is not above the threshold
+} PH_ALERT_STATE, *PPH_ALERT_STATE;
+
+typedef struct _PH_ALERT_METRIC_INFO
+{
+    PWSTR Name;
+    PWSTR DisplayName;
+} PH_ALERT_METRIC_INFO, *PPH_ALERT_METRIC_INFO;
+
+static PH_ALERT_METRIC_INFO PhpAlertMetrics[PhAlertMetricMaximum] =
+{
+    { L"cpu", L"CPU usage" },
+    { L"private", L"Private bytes" },
+    { L"privategrowth", L"Private bytes growth" },
+    { L"ws", L"Working set" },
+    { L"io", L"I/O" },
+    { L"handles", L"Handle count" },
+    { L"threads", L"Thread count" }
+};
+
+PHAPPAPI PH_CALLBACK_DECLARE(PhProcessAlertEvent);
+
+static PPH_OBJECT_TYPE PhpProcessAlertType = NULL;
+static PPH_OBJECT_TYPE PhpAlertRuleSetType = NULL;
+static PPH_ALERT_RULE_SET PhpPendingAlertRuleSet = NULL; // swapped in by PhPublishProcessAlerts
+static PPH_ALERT_RULE_SET PhpAlertRuleSet = NULL; // provider thread only; NULL if there are no rules
+static PPH_HASHTABLE PhpAlertStateHashtable = NULL; // provider thread only
+static PPH_LIST PhpPendingAlertList = NULL; // provider thread only
+static ULONG PhpAlertRunId = 1;
+static LARGE_INTEGER PhpAlertRunTime; // zero until first needed in each update
+
+static VOID NTAPI PhpProcessAlertDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_PROCESS_ALERT alert = Object;
+
+    PhDereferenceObject(alert->ProcessItem);
+    PhDereferenceObject(alert->Rule);
+    PhDereferenceObject(alert->Message);
+}
+
+static VOID NTAPI PhpAlertRuleSetDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_ALERT_RULE_SET ruleSet = Object;
+    ULONG i;
+
+    for (i = 0; i < ruleSet->NumberOfRules; i++)
+        PhDereferenceObject(ruleSet->Rules[i].Text);
+
+    if (ruleSet->Rules)
+        PhFree(ruleSet->Rules);
+}
+
+static BOOLEAN NTAPI PhpAlertStateEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_ALERT_STATE state1 = Entry1;
+    PPH_ALERT_STATE state2 = Entry2;
+
+    return state1->ProcessItem == state2->ProcessItem && state1->RuleIndex == state2->RuleIndex;
+}
+
+static ULONG NTAPI PhpAlertStateHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_ALERT_STATE state = Entry;
+
+    return PhHashIntPtr((ULONG_PTR)state->ProcessItem) ^ state->RuleIndex;
+}
+
+static VOID PhpInitializeProcessAlerts(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpProcessAlertType = PhCreateObjectType(L"ProcessAlert", 0, PhpProcessAlertDeleteProcedure);
+        PhpAlertRuleSetType = PhCreateObjectType(L"ProcessAlertRuleSet", 0, PhpAlertRuleSetDeleteProcedure);
+        PhpAlertStateHashtable = PhCreateHashtable(
+            sizeof(PH_ALERT_STATE),
+            PhpAlertStateEqualFunction,
+            PhpAlertStateHashFunction,
+            16
+            );
+        PhpPendingAlertList = PhCreateList(4);
+        PhEndInitOnce(&initOnce);
+    }
+}
+
+static BOOLEAN PhpParseAlertRule(
+    _In_ PPH_STRINGREF Text,
+    _Out_ PPH_ALERT_RULE Rule
+    )
+{
+    static PH_STRINGREF whitespace = PH_STRINGREF_INIT(L" \t");
+    PH_STRINGREF metricPart;
+    PH_STRINGREF thresholdPart;
+    PH_STRINGREF durationPart;
+    ULONG64 multiplier;
+    LONG64 threshold;
+    LONG64 duration;
+    ULONG i;
+
+    if (!PhSplitStringRefAtChar(Text, '>', &metricPart, &thresholdPart))
+        return FALSE;
+
+    PhSplitStringRefAtChar(&thresholdPart, ':', &thresholdPart, &durationPart);
+    PhTrimStringRef(&metricPart, &whitespace, 0);
+    PhTrimStringRef(&thresholdPart, &whitespace, 0);
+    PhTrimStringRef(&durationPart, &whitespace, 0);
+
+    for (i = 0; i < PhAlertMetricMaximum; i++)
+    {
+        if (PhEqualStringRef2(&metricPart, PhpAlertMetrics[i].Name, TRUE))
+            break;
+    }
+
+    if (i == PhAlertMetricMaximum)
+        return FALSE;
+
+    multiplier = 1;
+
+    if (thresholdPart.Length != 0)
+    {
+        switch (thresholdPart.Buffer[thresholdPart.Length / sizeof(WCHAR) - 1])
+        {
+        case 'k':
+        case 'K':
+            multiplier = 1024;
+            break;
+        case 'm':
+        case 'M':
+            multiplier = 1024 * 1024;
+            break;
+        case 'g':
+        case 'G':
+            multiplier = 1024 * 1024 * 1024;
+            break;
+        }
+
+        if (multiplier != 1)
+            thresholdPart.Length -= sizeof(WCHAR);
+    }
+
+    if (!PhStringToInteger64(&thresholdPart, 10, &threshold) || threshold <= 0)
+        return FALSE;
+
+    duration = 0;
+
+    if (durationPart.Length != 0 && (!PhStringToInteger64(&durationPart, 10, &duration) || duration < 0 || duration > MAXLONG))
+        return FALSE;
+
+    Rule->Metric = i;
+    Rule->RawThreshold = (ULONG64)threshold * multiplier;
+    Rule->Threshold = (DOUBLE)Rule->RawThreshold;
+    Rule->RearmThreshold = Rule->Threshold * PH_ALERT_REARM_FACTOR;
+    Rule->Duration = (ULONG)duration;
+    Rule->Text = PhCreateString2(Text);
+
+    return TRUE;
+}
+
+/**
+ * Sets the alert rules used by the process provider.
+ *
+ * \param Rules The rules, in the format of the ProcessAlertRules setting. Rules that cannot be
+ * parsed are ignored.
+ *
+ * \remarks The new rules take effect at the end of the next update, and all alerts are rearmed.
+ */
+VOID PhSetProcessAlertRules(
+    _In_ PPH_STRINGREF Rules
+    )
+{
+    static PH_STRINGREF whitespace = PH_STRINGREF_INIT(L" \t");
+    PH_STRINGREF remaining;
+    PH_STRINGREF part;
+    PPH_ALERT_RULE parsedRules;
+    ULONG numberOfParsedRules;
+    PPH_ALERT_RULE_SET ruleSet;
+    ULONG metric;
+    ULONG i;
+    ULONG j;
+
+    PhpInitializeProcessAlerts();
+
+    // There are at most as many rules as there are separators plus one.
+    parsedRules = PhAllocate((Rules->Length / sizeof(WCHAR) + 1) * sizeof(PH_ALERT_RULE));
+    numberOfParsedRules = 0;
+    remaining = *Rules;
+
+    while (remaining.Length != 0)
+    {
+        PhSplitStringRefAtChar(&remaining, ';', &part, &remaining);
+        PhTrimStringRef(&part, &whitespace, 0);
+
+        if (part.Length != 0 && PhpParseAlertRule(&part, &parsedRules[numberOfParsedRules]))
+            numberOfParsedRules++;
+    }
+
+    ruleSet = PhCreateObject(sizeof(PH_ALERT_RULE_SET), PhpAlertRuleSetType);
+    memset(ruleSet, 0, sizeof(PH_ALERT_RULE_SET));
+    ruleSet->NumberOfRules = numberOfParsedRules;
+
+    if (numberOfParsedRules != 0)
+        ruleSet->Rules = PhAllocate(numberOfParsedRules * sizeof(PH_ALERT_RULE));
+
+    // Group the rules by metric, keeping the order of the rules within each group.
+
+    i = 0;
+
+    for (metric = 0; metric < PhAlertMetricMaximum; metric++)
+    {
+        ruleSet->MetricStart[metric] = i;
+
+        for (j = 0; j < numberOfParsedRules; j++)
+        {
+            if (parsedRules[j].Metric != metric)
+                continue;
+
+            if (i == ruleSet->MetricStart[metric] || ruleSet->MetricRearmThreshold[metric] > parsedRules[j].RearmThreshold)
+                ruleSet->MetricRearmThreshold[metric] = parsedRules[j].RearmThreshold;
+
+            ruleSet->Rules[i++] = parsedRules[j];
+        }
+    }
+
+    ruleSet->MetricStart[PhAlertMetricMaximum] = i;
+
+    PhFree(parsedRules);
+
+    if (ruleSet = InterlockedExchangePointer(&PhpPendingAlertRuleSet, ruleSet))
+        PhDereferenceObject(ruleSet);
+}
+
+static DOUBLE PhpGetProcessAlertMetric(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PH_ALERT_METRIC Metric
+    )
+{
+    switch (Metric)
+    {
+    case PhAlertMetricCpu:
+        return (DOUBLE)ProcessItem->CpuUsage * 100;
+    case PhAlertMetricPrivateBytes:
+        return (DOUBLE)ProcessItem->VmCounters.PagefileUsage;
+    case PhAlertMetricPrivateBytesGrowth:
+        return (DOUBLE)(LONG_PTR)ProcessItem->PrivateBytesDelta.Delta * 60000 / PhCsUpdateInterval;
+    case PhAlertMetricWorkingSet:
+        return (DOUBLE)ProcessItem->VmCounters.WorkingSetSize;
+    case PhAlertMetricIo:
+        return (DOUBLE)(ProcessItem->IoReadDelta.Delta + ProcessItem->IoWriteDelta.Delta +
+            ProcessItem->IoOtherDelta.Delta) * 1000 / PhCsUpdateInterval;
+    case PhAlertMetricHandles:
+        return (DOUBLE)ProcessItem->NumberOfHandles;
+    case PhAlertMetricThreads:
+        return (DOUBLE)ProcessItem->NumberOfThreads;
+    }
+
+    return 0;
+}
+
+static PPH_STRING PhpFormatProcessAlertMessage(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PPH_ALERT_RULE Rule
+    )
+{
+    PPH_STRING threshold;
+    PPH_STRING size;
+    PPH_STRING message;
+
+    switch (Rule->Metric)
+    {
+    case PhAlertMetricCpu:
+        threshold = PhFormatString(L"%I64u%%", Rule->RawThreshold);
+        break;
+    case PhAlertMetricPrivateBytes:
+    case PhAlertMetricWorkingSet:
+        threshold = PhFormatSize(Rule->RawThreshold, -1);
+        break;
+    case PhAlertMetricPrivateBytesGrowth:
+    case PhAlertMetricIo:
+        size = PhFormatSize(Rule->RawThreshold, -1);
+        threshold = PhConcatStrings2(size->Buffer, Rule->Metric == PhAlertMetricIo ? L"/s" : L"/min");
+        PhDereferenceObject(size);
+        break;
+    default:
+        threshold = PhFormatUInt64(Rule->RawThreshold, TRUE);
+        break;
+    }
+
+    if (Rule->Duration != 0)
+    {
+        message = PhFormatString(
+            L"%s of %s (%u) has been above %s for %u seconds.",
+            PhpAlertMetrics[Rule->Metric].DisplayName,
+            ProcessItem->ProcessName->Buffer,
+            HandleToUlong(ProcessItem->ProcessId),
+            threshold->Buffer,
+            Rule->Duration
+            );
+    }
+    else
+    {
+        message = PhFormatString(
+            L"%s of %s (%u) is above %s.",
+            PhpAlertMetrics[Rule->Metric].DisplayName,
+            ProcessItem->ProcessName->Buffer,
+            HandleToUlong(ProcessItem->ProcessId),
+            threshold->Buffer
+            );
+    }
+
+    PhDereferenceObject(threshold);
+
+    return message;
+}
+
+static VOID PhpUpdateProcessAlertState(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG RuleIndex,
+    _In_ PPH_ALERT_RULE Rule,
+    _In_ DOUBLE Value
+    )
+{
+    PH_ALERT_STATE lookupState;
+    PPH_ALERT_STATE state;
+    BOOLEAN added;
+    PPH_PROCESS_ALERT alert;
+
+    lookupState.ProcessItem = ProcessItem;
+    lookupState.RuleIndex = RuleIndex;
+    state = PhAddEntryHashtableEx(PhpAlertStateHashtable, &lookupState, &added);
+
+    if (added)
+    {
+        PhReferenceObject(ProcessItem);
+        state->Fired = FALSE;
+        state->ExceededTime.QuadPart = 0;
+    }
+
+    state->RunId = PhpAlertRunId;
+
+    if (Value <= Rule->Threshold)
+    {
+        // Between the rearm threshold and the threshold: an alert that has already fired stays
+        // fired, but the timer starts again.
+        state->ExceededTime.QuadPart = 0;
+        return;
+    }
+
+    if (state->Fired)
+        return;
+
+    if (PhpAlertRunTime.QuadPart == 0)
+        PhQuerySystemTime(&PhpAlertRunTime);
+
+    if (state->ExceededTime.QuadPart == 0)
+        state->ExceededTime = PhpAlertRunTime;
+
+    if (PhpAlertRunTime.QuadPart - state->ExceededTime.QuadPart < (LONG64)Rule->Duration * PH_TICKS_PER_SEC)
+        return;
+
+    state->Fired = TRUE;
+
+    alert = PhCreateObject(sizeof(PH_PROCESS_ALERT), PhpProcessAlertType);
+    PhReferenceObject(ProcessItem);
+    alert->ProcessItem = ProcessItem;
+    PhReferenceObject(Rule->Text);
+    alert->Rule = Rule->Text;
+    alert->Message = PhpFormatProcessAlertMessage(ProcessItem, Rule);
+    PhAddItemList(PhpPendingAlertList, alert);
+}
+
+/**
+ * Checks the alert rules against a process item.
+ *
+ * \param ProcessItem The process item. Its deltas must already be updated.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+VOID PhUpdateProcessItemAlerts(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    PPH_ALERT_RULE_SET ruleSet = PhpAlertRuleSet;
+    ULONG metric;
+    ULONG i;
+
+    if (!ruleSet)
+        return;
+    if (!PH_IS_REAL_PROCESS_ID(ProcessItem->ProcessId))
+        return;
+
+    for (metric = 0; metric < PhAlertMetricMaximum; metric++)
+    {
+        DOUBLE value;
+
+        if (ruleSet->MetricStart[metric] == ruleSet->MetricStart[metric + 1])
+            continue;
+
+        value = PhpGetProcessAlertMetric(ProcessItem, metric);
+
+        // This is the common case, and no state is kept.
+        if (value < ruleSet->MetricRearmThreshold[metric])
+            continue;
+
+        for (i = ruleSet->MetricStart[metric]; i < ruleSet->MetricStart[metric + 1]; i++)
+        {
+            if (value >= ruleSet->Rules[i].RearmThreshold)
+                PhpUpdateProcessAlertState(ProcessItem, i, &ruleSet->Rules[i], value);
+        }
+    }
+}
+
+static VOID PhpRemoveProcessAlertStates(
+    _In_ BOOLEAN All
+    )
+{
+    PPH_ALERT_STATE state;
+    PH_ALERT_STATE lookupState;
+    PPH_LIST statesToRemove;
+    ULONG enumerationKey;
+    ULONG i;
+
+    if (PhpAlertStateHashtable->Count == 0)
+        return;
+
+    statesToRemove = PhCreateList(4);
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpAlertStateHashtable, &state, &enumerationKey))
+    {
+        // States that were not updated belong to processes that have fallen below the rearm
+        // threshold or no longer exist.
+        if (All || state->RunId != PhpAlertRunId)
+            PhAddItemList(statesToRemove, state);
+    }
+
+    for (i = 0; i < statesToRemove->Count; i++)
+    {
+        lookupState = *(PPH_ALERT_STATE)statesToRemove->Items[i];
+
+        PhRemoveEntryHashtable(PhpAlertStateHashtable, &lookupState);
+        PhDereferenceObject(lookupState.ProcessItem);
+    }
+
+    PhDereferenceObject(statesToRemove);
+}
+
+/**
+ * Delivers the alerts found during the current update and rearms the rules of processes that
+ * have fallen below their thresholds.
+ *
+ * \remarks This function must only be called by the process provider.
+ */
+VOID PhPublishProcessAlerts(
+    VOID
+    )
+{
+    PPH_ALERT_RULE_SET newRuleSet;
+    ULONG i;
+
+    PhpInitializeProcessAlerts();
+
+    if (newRuleSet = InterlockedExchangePointer(&PhpPendingAlertRuleSet, NULL))
+    {
+        // Rule indices change with the rule set, so every state has to go.
+        PhpRemoveProcessAlertStates(TRUE);
+
+        if (newRuleSet->NumberOfRules == 0)
+            PhClearReference(&newRuleSet);
+
+        PhMoveReference(&PhpAlertRuleSet, newRuleSet);
+    }
+    else
+    {
+        PhpRemoveProcessAlertStates(FALSE);
+    }
+
+    for (i = 0; i < PhpPendingAlertList->Count; i++)
+    {
+        PPH_PROCESS_ALERT alert = PhpPendingAlertList->Items[i];
+
+        PhInvokeCallback(&PhProcessAlertEvent, alert);
+        PhDereferenceObject(alert);
+    }
+
+    PhClearList(PhpPendingAlertList);
+
+    PhpAlertRunId++;
+    PhpAlertRunTime.QuadPart = 0;
+}
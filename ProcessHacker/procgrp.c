@@ -26,18 +26,46 @@
 typedef struct _PHP_PROCESS_DATA
 {
     PPH_PROCESS_NODE Process;
-    LIST_ENTRY ListEntry;
+    PPH_STRING FileName;
+    PPH_STRING UserName;
+    ULONG GroupKey; // Hash of FileName and UserName
     BOOLEAN HasWindow;
+    BOOLEAN Grouped;
 } PHP_PROCESS_DATA, *PPHP_PROCESS_DATA;
 
-PPH_LIST PhpCreateProcessDataList(
-    _In_ PPH_LIST Processes
+// Groups computed since the last process tree update. The partition does not depend on
+// the sort order, so it is shared by every caller until PhInvalidateProcessGroups is called.
+static PPH_LIST PhpProcessGroupCache = NULL; // List of PPH_PROCESS_GROUP
+static PPH_HASHTABLE PhpProcessGroupCacheHashtable = NULL; // Process ID to (group index + 1)
+static ULONG PhpProcessGroupCacheFlags = 0;
+
+PPH_STRING PhpGetRelevantFileName(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Flags
     )
 {
-    PPH_LIST processDataList;
+    if (Flags & PH_GROUP_PROCESSES_FILE_PATH)
+        return ProcessItem->FileName;
+    else
+        return ProcessItem->ProcessName;
+}
+
+PPHP_PROCESS_DATA PhpCreateProcessDataArray(
+    _In_ PPH_LIST Processes,
+    _In_ ULONG Flags,
+    _Out_ PULONG NumberOfEntries,
+    _Out_ PPH_HASHTABLE *Hashtable
+    )
+{
+    PPHP_PROCESS_DATA processDataArray;
+    PPH_HASHTABLE hashtable;
+    ULONG count;
     ULONG i;
 
-    processDataList = PhCreateList(Processes->Count);
+    processDataArray = PhAllocate(max(Processes->Count, 1) * sizeof(PHP_PROCESS_DATA));
+    memset(processDataArray, 0, max(Processes->Count, 1) * sizeof(PHP_PROCESS_DATA));
+    hashtable = PhCreateSimpleHashtable(Processes->Count);
+    count = 0;
 
     for (i = 0; i < Processes->Count; i++)
     {
@@ -47,144 +75,86 @@ PPH_LIST PhpCreateProcessDataList(
         if (PH_IS_FAKE_PROCESS_ID(process->ProcessId) || process->ProcessId == SYSTEM_IDLE_PROCESS_ID)
             continue;
 
-        processData = PhAllocate(sizeof(PHP_PROCESS_DATA));
-        memset(processData, 0, sizeof(PHP_PROCESS_DATA));
+        processData = &processDataArray[count++];
         processData->Process = process;
-        PhAddItemList(processDataList, processData);
-    }
+        processData->FileName = PhpGetRelevantFileName(process->ProcessItem, Flags);
+        processData->UserName = process->ProcessItem->UserName;
 
-    return processDataList;
-}
-
-VOID PhpDestroyProcessDataList(
-    _In_ PPH_LIST List
-    )
-{
-    ULONG i;
+        if (processData->FileName && processData->UserName)
+        {
+            processData->GroupKey = PhHashStringRef(&processData->FileName->sr, TRUE) * 31 +
+                PhHashStringRef(&processData->UserName->sr, TRUE);
+        }
 
-    for (i = 0; i < List->Count; i++)
-    {
-        PPHP_PROCESS_DATA processData = List->Items[i];
-        PhFree(processData);
+        PhAddItemSimpleHashtable(hashtable, process->ProcessId, processData);
     }
 
-    PhDereferenceObject(List);
-}
-
-VOID PhpProcessDataListToLinkedList(
-    _In_ PPH_LIST List,
-    _Out_ PLIST_ENTRY ListHead
-    )
-{
-    ULONG i;
-
-    InitializeListHead(ListHead);
+    *NumberOfEntries = count;
+    *Hashtable = hashtable;
 
-    for (i = 0; i < List->Count; i++)
-    {
-        PPHP_PROCESS_DATA processData = List->Items[i];
-        InsertTailList(ListHead, &processData->ListEntry);
-    }
+    return processDataArray;
 }
 
-VOID PhpProcessDataListToHashtable(
-    _In_ PPH_LIST List,
-    _Out_ PPH_HASHTABLE *Hashtable
+VOID PhpQueryProcessWindows(
+    _In_ PPH_HASHTABLE ProcessDataHashtable
     )
 {
-    PPH_HASHTABLE hashtable;
+    PPH_WINDOW_SNAPSHOT snapshot;
     ULONG i;
 
-    hashtable = PhCreateSimpleHashtable(List->Count);
+    // Use the shared snapshot instead of enumerating the windows again.
+    snapshot = PhReferenceWindowSnapshot();
 
-    for (i = 0; i < List->Count; i++)
+    for (i = 0; i < snapshot->NumberOfWindows; i++)
     {
-        PPHP_PROCESS_DATA processData = List->Items[i];
-        PhAddItemSimpleHashtable(hashtable, processData->Process->ProcessId, processData);
-    }
-
-    *Hashtable = hashtable;
-}
-
-typedef struct _QUERY_WINDOWS_CONTEXT
-{
-    PPH_HASHTABLE ProcessDataHashtable;
-} QUERY_WINDOWS_CONTEXT, *PQUERY_WINDOWS_CONTEXT;
-
-BOOL CALLBACK PhpQueryWindowsEnumWindowsProc(
-    _In_ HWND hwnd,
-    _In_ LPARAM lParam
-    )
-{
-    PQUERY_WINDOWS_CONTEXT context = (PQUERY_WINDOWS_CONTEXT)lParam;
-    ULONG processId;
-    PPHP_PROCESS_DATA processData;
-    HWND parentWindow;
+        HWND hwnd = snapshot->Windows[i].WindowHandle;
+        PPHP_PROCESS_DATA processData;
+        HWND parentWindow;
 
-    if (!IsWindowVisible(hwnd))
-        return TRUE;
+        processData = PhFindItemSimpleHashtable2(ProcessDataHashtable, snapshot->Windows[i].ProcessId);
 
-    GetWindowThreadProcessId(hwnd, &processId);
-    processData = PhFindItemSimpleHashtable2(context->ProcessDataHashtable, UlongToHandle(processId));
+        if (!processData || processData->HasWindow)
+            continue;
 
-    if (!processData || processData->HasWindow)
-        return TRUE;
+        if (!IsWindowVisible(hwnd))
+            continue;
 
-    if (!((parentWindow = GetParent(hwnd)) && IsWindowVisible(parentWindow)) && // skip windows with a visible parent
-        PhGetWindowTextEx(hwnd, PH_GET_WINDOW_TEXT_INTERNAL | PH_GET_WINDOW_TEXT_LENGTH_ONLY, NULL) != 0) // skip windows with no title
-    {
-        processData->HasWindow = TRUE;
+        if (!((parentWindow = GetParent(hwnd)) && IsWindowVisible(parentWindow)) && // skip windows with a visible parent
+            PhGetWindowTextEx(hwnd, PH_GET_WINDOW_TEXT_INTERNAL | PH_GET_WINDOW_TEXT_LENGTH_ONLY, NULL) != 0) // skip windows with no title
+        {
+            processData->HasWindow = TRUE;
+        }
     }
 
-    return TRUE;
+    PhDereferenceObject(snapshot);
 }
 
-PPH_STRING PhpGetRelevantFileName(
-    _In_ PPH_PROCESS_ITEM ProcessItem,
-    _In_ ULONG Flags
-    )
-{
-    if (Flags & PH_GROUP_PROCESSES_FILE_PATH)
-        return ProcessItem->FileName;
-    else
-        return ProcessItem->ProcessName;
-}
-
-BOOLEAN PhpEqualFileNameAndUserName(
-    _In_ PPH_STRING FileName,
-    _In_ PPH_STRING UserName,
-    _In_ PPH_PROCESS_ITEM ProcessItem,
-    _In_ ULONG Flags
+BOOLEAN PhpEqualGroupKey(
+    _In_ PPHP_PROCESS_DATA ProcessData1,
+    _In_ PPHP_PROCESS_DATA ProcessData2
     )
 {
-    PPH_STRING otherFileName;
-    PPH_STRING otherUserName;
-
-    otherFileName = PhpGetRelevantFileName(ProcessItem, Flags);
-    otherUserName = ProcessItem->UserName;
-
-    return 
-        otherFileName && PhEqualString(otherFileName, FileName, TRUE) &&
-        otherUserName && PhEqualString(otherUserName, UserName, TRUE);
+    // The hash rules out almost every mismatch without comparing any strings.
+    return
+        ProcessData1->GroupKey == ProcessData2->GroupKey &&
+        ProcessData1->FileName && ProcessData1->UserName &&
+        ProcessData2->FileName && ProcessData2->UserName &&
+        PhEqualString(ProcessData1->FileName, ProcessData2->FileName, TRUE) &&
+        PhEqualString(ProcessData1->UserName, ProcessData2->UserName, TRUE);
 }
 
 PPHP_PROCESS_DATA PhpFindGroupRoot(
     _In_ PPHP_PROCESS_DATA ProcessData,
-    _In_ PPH_HASHTABLE ProcessDataHashtable,
-    _In_ ULONG Flags
+    _In_ PPH_HASHTABLE ProcessDataHashtable
     )
 {
     PPH_PROCESS_NODE root;
     PPHP_PROCESS_DATA rootProcessData;
     PPH_PROCESS_NODE parent;
     PPHP_PROCESS_DATA processData;
-    PPH_STRING fileName;
-    PPH_STRING userName;
 
     root = ProcessData->Process;
     rootProcessData = ProcessData;
-    fileName = PhpGetRelevantFileName(ProcessData->Process->ProcessItem, Flags);
-    userName = ProcessData->Process->ProcessItem->UserName;
 
     if (ProcessData->HasWindow)
         return rootProcessData;
@@ -192,7 +162,7 @@ PPHP_PROCESS_DATA PhpFindGroupRoot(
     while (parent = root->Parent)
     {
         if ((processData = PhFindItemSimpleHashtable2(ProcessDataHashtable, parent->ProcessId)) &&
-            PhpEqualFileNameAndUserName(fileName, userName, parent->ProcessItem, Flags))
+            PhpEqualGroupKey(ProcessData, processData))
         {
             root = parent;
             rootProcessData = processData;
@@ -216,23 +186,18 @@ VOID PhpAddGroupMember(
 {
     PhReferenceObject(ProcessData->Process->ProcessItem);
     PhAddItemList(List, ProcessData->Process->ProcessItem);
-    RemoveEntryList(&ProcessData->ListEntry);
+    ProcessData->Grouped = TRUE;
 }
 
 VOID PhpAddGroupMembersFromRoot(
     _In_ PPHP_PROCESS_DATA ProcessData,
     _Inout_ PPH_LIST List,
-    _In_ PPH_HASHTABLE ProcessDataHashtable,
-    _In_ ULONG Flags
+    _In_ PPH_HASHTABLE ProcessDataHashtable
     )
 {
-    PPH_STRING fileName;
-    PPH_STRING userName;
     ULONG i;
 
     PhpAddGroupMember(ProcessData, List);
-    fileName = PhpGetRelevantFileName(ProcessData->Process->ProcessItem, Flags);
-    userName = ProcessData->Process->ProcessItem->UserName;
 
     for (i = 0; i < ProcessData->Process->Children->Count; i++)
     {
@@ -240,28 +205,27 @@ VOID PhpAddGroupMembersFromRoot(
         PPHP_PROCESS_DATA processData;
 
         if ((processData = PhFindItemSimpleHashtable2(ProcessDataHashtable, node->ProcessId)) &&
-            PhpEqualFileNameAndUserName(fileName, userName, node->ProcessItem, Flags) &&
-            node->ProcessItem->UserName && PhEqualString(node->ProcessItem->UserName, userName, TRUE) &&
-            !processData->HasWindow)
+            !processData->Grouped &&
+            !processData->HasWindow &&
+            PhpEqualGroupKey(ProcessData, processData))
         {
-            PhpAddGroupMembersFromRoot(processData, List, ProcessDataHashtable, Flags);
+            PhpAddGroupMembersFromRoot(processData, List, ProcessDataHashtable);
         }
     }
 }
 
-PPH_LIST PhCreateProcessGroupList(
-    _In_opt_ PPH_SORT_LIST_FUNCTION SortListFunction,
-    _In_opt_ PVOID Context,
-    _In_ ULONG MaximumGroups,
+VOID PhpUpdateProcessGroupCache(
     _In_ ULONG Flags
     )
 {
     PPH_LIST processList;
-    PPH_LIST processDataList;
-    LIST_ENTRY processDataListHead; // We will be removing things from this list as we group processes together
+    PPHP_PROCESS_DATA processDataArray;
+    ULONG numberOfProcessData;
     PPH_HASHTABLE processDataHashtable; // Process ID to process data hashtable
-    QUERY_WINDOWS_CONTEXT queryWindowsContext;
     PPH_LIST processGroupList;
+    PPH_HASHTABLE groupHashtable;
+    ULONG i;
+    ULONG j;
 
     // We group together processes that share a common ancestor and have the same file name, where the ancestor must
     // have a visible window and all other processes in the group do not have a visible window. All processes in the
@@ -269,49 +233,131 @@ PPH_LIST PhCreateProcessGroupList(
     // and user name.
 
     processList = PhDuplicateProcessNodeList();
-
-    if (SortListFunction)
-        SortListFunction(processList, Context);
-
-    processDataList = PhpCreateProcessDataList(processList);
+    processDataArray = PhpCreateProcessDataArray(processList, Flags, &numberOfProcessData, &processDataHashtable);
     PhDereferenceObject(processList);
-    PhpProcessDataListToLinkedList(processDataList, &processDataListHead);
-    PhpProcessDataListToHashtable(processDataList, &processDataHashtable);
 
-    queryWindowsContext.ProcessDataHashtable = processDataHashtable;
-    PhEnumChildWindows(NULL, 0x800, PhpQueryWindowsEnumWindowsProc, (LPARAM)&queryWindowsContext);
+    PhpQueryProcessWindows(processDataHashtable);
 
-    processGroupList = PhCreateList(10);
+    processGroupList = PhCreateList(numberOfProcessData / 2 + 1);
+    groupHashtable = PhCreateSimpleHashtable(numberOfProcessData);
 
-    while (processDataListHead.Flink != &processDataListHead && processGroupList->Count < MaximumGroups)
+    for (i = 0; i < numberOfProcessData; i++)
     {
-        PPHP_PROCESS_DATA processData = CONTAINING_RECORD(processDataListHead.Flink, PHP_PROCESS_DATA, ListEntry);
+        PPHP_PROCESS_DATA processData = &processDataArray[i];
+        PPHP_PROCESS_DATA rootProcessData = NULL;
         PPH_PROCESS_GROUP processGroup;
-        PPH_STRING fileName;
-        PPH_STRING userName;
+
+        if (processData->Grouped)
+            continue;
 
         processGroup = PhAllocate(sizeof(PH_PROCESS_GROUP));
         processGroup->Processes = PhCreateList(4);
-        fileName = PhpGetRelevantFileName(processData->Process->ProcessItem, Flags);
-        userName = processData->Process->ProcessItem->UserName;
 
-        if (!fileName || !userName || (Flags & PH_GROUP_PROCESSES_DONT_GROUP))
+        if (processData->FileName && processData->UserName && !(Flags & PH_GROUP_PROCESSES_DONT_GROUP))
+            rootProcessData = PhpFindGroupRoot(processData, processDataHashtable);
+
+        if (rootProcessData && !rootProcessData->Grouped)
         {
-            processGroup->Representative = processData->Process->ProcessItem;
-            PhpAddGroupMember(processData, processGroup->Processes);
+            processGroup->Representative = rootProcessData->Process->ProcessItem;
+            PhpAddGroupMembersFromRoot(rootProcessData, processGroup->Processes, processDataHashtable);
         }
         else
         {
-            processData = PhpFindGroupRoot(processData, processDataHashtable, Flags);
             processGroup->Representative = processData->Process->ProcessItem;
-            PhpAddGroupMembersFromRoot(processData, processGroup->Processes, processDataHashtable, Flags);
+            PhpAddGroupMember(processData, processGroup->Processes);
+        }
+
+        for (j = 0; j < processGroup->Processes->Count; j++)
+        {
+            PPH_PROCESS_ITEM processItem = processGroup->Processes->Items[j];
+            PhAddItemSimpleHashtable(groupHashtable, processItem->ProcessId, UlongToPtr(processGroupList->Count + 1));
         }
 
         PhAddItemList(processGroupList, processGroup);
     }
 
     PhDereferenceObject(processDataHashtable);
-    PhpDestroyProcessDataList(processDataList);
+    PhFree(processDataArray);
+
+    PhInvalidateProcessGroups();
+    PhpProcessGroupCache = processGroupList;
+    PhpProcessGroupCacheHashtable = groupHashtable;
+    PhpProcessGroupCacheFlags = Flags;
+}
+
+PPH_LIST PhCreateProcessGroupList(
+    _In_opt_ PPH_SORT_LIST_FUNCTION SortListFunction,
+    _In_opt_ PVOID Context,
+    _In_ ULONG MaximumGroups,
+    _In_ ULONG Flags
+    )
+{
+    PPH_LIST processList;
+    PBOOLEAN groupAdded;
+    PPH_LIST processGroupList;
+    ULONG i;
+    ULONG j;
+
+    if (!PhpProcessGroupCache || PhpProcessGroupCacheFlags != Flags)
+        PhpUpdateProcessGroupCache(Flags);
+
+    processList = PhDuplicateProcessNodeList();
+
+    if (SortListFunction)
+        SortListFunction(processList, Context);
+
+    groupAdded = PhAllocate(max(PhpProcessGroupCache->Count, 1) * sizeof(BOOLEAN));
+    memset(groupAdded, 0, max(PhpProcessGroupCache->Count, 1) * sizeof(BOOLEAN));
+    processGroupList = PhCreateList(10);
+
+    // Groups are returned in the order of their first process in the sorted list.
+
+    for (i = 0; i < processList->Count && processGroupList->Count < MaximumGroups; i++)
+    {
+        PPH_PROCESS_NODE process = processList->Items[i];
+        PPH_PROCESS_GROUP cachedGroup = NULL;
+        PPH_PROCESS_GROUP processGroup;
+        ULONG index;
+
+        if (PH_IS_FAKE_PROCESS_ID(process->ProcessId) || process->ProcessId == SYSTEM_IDLE_PROCESS_ID)
+            continue;
+
+        if (index = PtrToUlong(PhFindItemSimpleHashtable2(PhpProcessGroupCacheHashtable, process->ProcessId)))
+        {
+            if (groupAdded[index - 1])
+                continue;
+
+            cachedGroup = PhpProcessGroupCache->Items[index - 1];
+            groupAdded[index - 1] = TRUE;
+        }
+
+        processGroup = PhAllocate(sizeof(PH_PROCESS_GROUP));
+
+        if (cachedGroup)
+        {
+            processGroup->Representative = cachedGroup->Representative;
+            processGroup->Processes = PhCreateList(cachedGroup->Processes->Count);
+
+            for (j = 0; j < cachedGroup->Processes->Count; j++)
+            {
+                PhReferenceObject(cachedGroup->Processes->Items[j]);
+                PhAddItemList(processGroup->Processes, cachedGroup->Processes->Items[j]);
+            }
+        }
+        else
+        {
+            // The process was added after the groups were computed.
+            processGroup->Representative = process->ProcessItem;
+            processGroup->Processes = PhCreateList(1);
+            PhReferenceObject(process->ProcessItem);
+            PhAddItemList(processGroup->Processes, process->ProcessItem);
+        }
+
+        PhAddItemList(processGroupList, processGroup);
+    }
+
+    PhFree(groupAdded);
+    PhDereferenceObject(processList);
 
     return processGroupList;
 }
@@ -333,3 +379,24 @@ VOID PhFreeProcessGroupList(
 
     PhDereferenceObject(List);
 }
+
+/**
+ * Discards the cached process groups. This is called on every process tree
+ * update.
+ */
+VOID PhInvalidateProcessGroups(
+    VOID
+    )
+{
+    if (PhpProcessGroupCache)
+    {
+        PhFreeProcessGroupList(PhpProcessGroupCache);
+        PhpProcessGroupCache = NULL;
+    }
+
+    if (PhpProcessGroupCacheHashtable)
+    {
+        PhDereferenceObject(PhpProcessGroupCacheHashtable);
+        PhpProcessGroupCacheHashtable = NULL;
+    }
+}
@@ -1226,7 +1226,8 @@ static VOID NTAPI StatisticsUpdateHandler(
 {
     PPH_STATISTICS_CONTEXT statisticsContext = (PPH_STATISTICS_CONTEXT)Context;
 
-    if (statisticsContext->Enabled)
+    // Only update the page while it is selected and the window is not minimized.
+    if (statisticsContext->Enabled && !IsIconic(GetParent(statisticsContext->WindowHandle)))
         PostMessage(statisticsContext->WindowHandle, WM_PH_STATISTICS_UPDATE, 0, 0);
 }
 
@@ -1279,6 +1280,8 @@ VOID PhpUpdateProcessStatistics(
         PhaFormatUInt64(ProcessItem->NumberOfHandles, TRUE)->Buffer); // handles
 
     // Optional information
+    // Values which the process provider already has from SystemProcessInformation are used
+    // directly; only the remaining values are queried here.
     if (!PH_IS_FAKE_PROCESS_ID(ProcessItem->ProcessId))
     {
         PPH_STRING peakHandles = NULL;
@@ -1316,7 +1319,8 @@ VOID PhpUpdateProcessStatistics(
             gdiHandles = PhaFormatUInt64(GetGuiResources(ProcessItem->QueryHandle, GR_GDIOBJECTS), TRUE); // GDI handles
             userHandles = PhaFormatUInt64(GetGuiResources(ProcessItem->QueryHandle, GR_USEROBJECTS), TRUE); // USER handles
 
-            if (WINDOWS_HAS_CYCLE_TIME &&
+            // Since Windows 7 the cycle time comes from the process provider (see below).
+            if (WINDOWS_HAS_CYCLE_TIME && WindowsVersion < WINDOWS_7 &&
                 NT_SUCCESS(PhGetProcessCycleTime(ProcessItem->QueryHandle, &cycleTime)))
             {
                 cycles = PhaFormatUInt64(cycleTime, TRUE);
@@ -1332,13 +1336,17 @@ VOID PhpUpdateProcessStatistics(
 
         if (Context->ProcessHandle)
         {
-            PH_PROCESS_WS_COUNTERS wsCounters;
+            if (!Context->WsCountersValid || Context->WsCountersWorkingSetSize != ProcessItem->VmCounters.WorkingSetSize)
+            {
+                Context->WsCountersValid = NT_SUCCESS(PhGetProcessWsCounters(Context->ProcessHandle, &Context->WsCounters));
+                Context->WsCountersWorkingSetSize = ProcessItem->VmCounters.WorkingSetSize;
+            }
 
-            if (NT_SUCCESS(PhGetProcessWsCounters(Context->ProcessHandle, &wsCounters)))
+            if (Context->WsCountersValid)
             {
-                privateWs = PhaFormatSize((ULONG64)wsCounters.NumberOfPrivatePages * PAGE_SIZE, -1);
-                shareableWs = PhaFormatSize((ULONG64)wsCounters.NumberOfShareablePages * PAGE_SIZE, -1);
-                sharedWs = PhaFormatSize((ULONG64)wsCounters.NumberOfSharedPages * PAGE_SIZE, -1);
+                privateWs = PhaFormatSize((ULONG64)Context->WsCounters.NumberOfPrivatePages * PAGE_SIZE, -1);
+                shareableWs = PhaFormatSize((ULONG64)Context->WsCounters.NumberOfShareablePages * PAGE_SIZE, -1);
+                sharedWs = PhaFormatSize((ULONG64)Context->WsCounters.NumberOfSharedPages * PAGE_SIZE, -1);
                 gotWsCounters = TRUE;
             }
         }
@@ -1426,6 +1434,7 @@ INT_PTR CALLBACK PhpProcessStatisticsDlgProc(
             statisticsContext = propPageContext->Context =
                 PhAllocate(sizeof(PH_STATISTICS_CONTEXT));
 
+            memset(statisticsContext, 0, sizeof(PH_STATISTICS_CONTEXT));
             statisticsContext->WindowHandle = hwndDlg;
             statisticsContext->Enabled = TRUE;
             statisticsContext->ProcessHandle = NULL;
@@ -1498,6 +1507,8 @@ INT_PTR CALLBACK PhpProcessStatisticsDlgProc(
             {
             case PSN_SETACTIVE:
                 statisticsContext->Enabled = TRUE;
+                // The page was not updated while it was hidden.
+                PhpUpdateProcessStatistics(hwndDlg, processItem, statisticsContext);
                 break;
             case PSN_KILLACTIVE:
                 statisticsContext->Enabled = FALSE;
@@ -1572,6 +1583,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
             PhInitializeGraphState(&performanceContext->CpuGraphState);
             PhInitializeGraphState(&performanceContext->PrivateGraphState);
             PhInitializeGraphState(&performanceContext->IoGraphState);
+            PhInitializeGraphState(&performanceContext->ThreadStatesGraphState);
 
             performanceContext->CpuGraphHandle = GetDlgItem(hwndDlg, IDC_CPU);
             PhSetWindowStyle(performanceContext->CpuGraphHandle, WS_BORDER, WS_BORDER);
@@ -1587,6 +1599,11 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
             PhSetWindowStyle(performanceContext->IoGraphHandle, WS_BORDER, WS_BORDER);
             Graph_SetTooltip(performanceContext->IoGraphHandle, TRUE);
             BringWindowToTop(performanceContext->IoGraphHandle);
+
+            performanceContext->ThreadStatesGraphHandle = GetDlgItem(hwndDlg, IDC_THREADSTATES);
+            PhSetWindowStyle(performanceContext->ThreadStatesGraphHandle, WS_BORDER, WS_BORDER);
+            Graph_SetTooltip(performanceContext->ThreadStatesGraphHandle, TRUE);
+            BringWindowToTop(performanceContext->ThreadStatesGraphHandle);
         }
         break;
     case WM_DESTROY:
@@ -1594,6 +1611,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
             PhDeleteGraphState(&performanceContext->CpuGraphState);
             PhDeleteGraphState(&performanceContext->PrivateGraphState);
             PhDeleteGraphState(&performanceContext->IoGraphState);
+            PhDeleteGraphState(&performanceContext->ThreadStatesGraphState);
 
             PhUnregisterCallback(
                 &PhProcessesUpdatedEvent,
@@ -1657,15 +1675,13 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                         PhGraphStateGetDrawInfo(
                             &performanceContext->CpuGraphState,
                             getDrawInfo,
-                            processItem->CpuKernelHistory.Count
+                            processItem->HistorySlot.Count
                             );
 
                         if (!performanceContext->CpuGraphState.Valid)
                         {
-                            PhCopyCircularBuffer_FLOAT(&processItem->CpuKernelHistory,
-                                performanceContext->CpuGraphState.Data1, drawInfo->LineDataCount);
-                            PhCopyCircularBuffer_FLOAT(&processItem->CpuUserHistory,
-                                performanceContext->CpuGraphState.Data2, drawInfo->LineDataCount);
+                            PhCopyProcessItemCpuHistory(processItem, drawInfo->LineDataCount,
+                                performanceContext->CpuGraphState.Data1, performanceContext->CpuGraphState.Data2);
                             performanceContext->CpuGraphState.Valid = TRUE;
                         }
                     }
@@ -1697,18 +1713,13 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                         PhGraphStateGetDrawInfo(
                             &performanceContext->PrivateGraphState,
                             getDrawInfo,
-                            processItem->PrivateBytesHistory.Count
+                            processItem->HistorySlot.Count
                             );
 
                         if (!performanceContext->PrivateGraphState.Valid)
                         {
-                            ULONG i;
-
-                            for (i = 0; i < drawInfo->LineDataCount; i++)
-                            {
-                                performanceContext->PrivateGraphState.Data1[i] =
-                                    (FLOAT)PhGetItemCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory, i);
-                            }
+                            PhCopyProcessItemPrivateBytesHistory(processItem, drawInfo->LineDataCount,
+                                performanceContext->PrivateGraphState.Data1);
 
                             if (processItem->VmCounters.PeakPagefileUsage != 0)
                             {
@@ -1752,28 +1763,21 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                         PhGraphStateGetDrawInfo(
                             &performanceContext->IoGraphState,
                             getDrawInfo,
-                            processItem->IoReadHistory.Count
+                            processItem->HistorySlot.Count
                             );
 
                         if (!performanceContext->IoGraphState.Valid)
                         {
-                            ULONG i;
-                            FLOAT max = 0;
-
-                            for (i = 0; i < drawInfo->LineDataCount; i++)
-                            {
-                                FLOAT data1;
-                                FLOAT data2;
+                            FLOAT max;
 
-                                performanceContext->IoGraphState.Data1[i] = data1 =
-                                    (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoReadHistory, i) +
-                                    (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoOtherHistory, i);
-                                performanceContext->IoGraphState.Data2[i] = data2 =
-                                    (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoWriteHistory, i);
+                            PhCopyProcessItemIoHistory(processItem, drawInfo->LineDataCount,
+                                performanceContext->IoGraphState.Data1, performanceContext->IoGraphState.Data2);
 
-                                if (max < data1 + data2)
-                                    max = data1 + data2;
-                            }
+                            max = PhMaximumSumSingles(
+                                performanceContext->IoGraphState.Data1,
+                                performanceContext->IoGraphState.Data2,
+                                drawInfo->LineDataCount
+                                );
 
                             if (max != 0)
                             {
@@ -1794,6 +1798,70 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                             performanceContext->IoGraphState.Valid = TRUE;
                         }
                     }
+                    else if (header->hwndFrom == performanceContext->ThreadStatesGraphHandle)
+                    {
+                        if (PhCsGraphShowText)
+                        {
+                            HDC hdc;
+
+                            PhMoveReference(&performanceContext->ThreadStatesGraphState.Text,
+                                PhFormatString(
+                                L"Running: %u, Ready: %u, Waiting: %u",
+                                processItem->RunningThreadCount,
+                                processItem->ReadyThreadCount,
+                                processItem->WaitingThreadCount
+                                ));
+
+                            hdc = Graph_GetBufferedContext(performanceContext->ThreadStatesGraphHandle);
+                            SelectObject(hdc, PhApplicationFont);
+                            PhSetGraphText(hdc, drawInfo, &performanceContext->ThreadStatesGraphState.Text->sr,
+                                &PhNormalGraphTextMargin, &PhNormalGraphTextPadding, PH_ALIGN_TOP | PH_ALIGN_LEFT);
+                        }
+                        else
+                        {
+                            drawInfo->Text.Buffer = NULL;
+                        }
+
+                        drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
+                        PhSiSetColorsGraphDrawInfo(drawInfo, PhCsColorCpuUser, PhCsColorCpuKernel);
+
+                        PhGraphStateGetDrawInfo(
+                            &performanceContext->ThreadStatesGraphState,
+                            getDrawInfo,
+                            processItem->HistorySlot.Count
+                            );
+
+                        if (!performanceContext->ThreadStatesGraphState.Valid)
+                        {
+                            FLOAT max;
+
+                            PhCopyProcessItemThreadStateHistory(processItem, drawInfo->LineDataCount,
+                                performanceContext->ThreadStatesGraphState.Data1, performanceContext->ThreadStatesGraphState.Data2);
+
+                            // Scale the data so that the busiest sample (running plus ready) fills the graph.
+                            max = PhMaximumSumSingles(
+                                performanceContext->ThreadStatesGraphState.Data1,
+                                performanceContext->ThreadStatesGraphState.Data2,
+                                drawInfo->LineDataCount
+                                );
+
+                            if (max != 0)
+                            {
+                                PhDivideSinglesBySingle(
+                                    performanceContext->ThreadStatesGraphState.Data1,
+                                    max,
+                                    drawInfo->LineDataCount
+                                    );
+                                PhDivideSinglesBySingle(
+                                    performanceContext->ThreadStatesGraphState.Data2,
+                                    max,
+                                    drawInfo->LineDataCount
+                                    );
+                            }
+
+                            performanceContext->ThreadStatesGraphState.Valid = TRUE;
+                        }
+                    }
                 }
                 break;
             case GCN_GETTOOLTIPTEXT:
@@ -1810,8 +1878,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                             FLOAT cpuKernel;
                             FLOAT cpuUser;
 
-                            cpuKernel = PhGetItemCircularBuffer_FLOAT(&processItem->CpuKernelHistory, getTooltipText->Index);
-                            cpuUser = PhGetItemCircularBuffer_FLOAT(&processItem->CpuUserHistory, getTooltipText->Index);
+                            PhGetProcessItemCpuHistory(processItem, getTooltipText->Index, &cpuKernel, &cpuUser);
 
                             PhMoveReference(&performanceContext->CpuGraphState.TooltipText, PhFormatString(
                                 L"%.2f%%\n%s",
@@ -1831,7 +1898,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                         {
                             SIZE_T privateBytes;
 
-                            privateBytes = PhGetItemCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory, getTooltipText->Index);
+                            privateBytes = PhGetProcessItemPrivateBytesHistory(processItem, getTooltipText->Index);
 
                             PhMoveReference(&performanceContext->PrivateGraphState.TooltipText, PhFormatString(
                                 L"Private Bytes: %s\n%s",
@@ -1853,9 +1920,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                             ULONG64 ioWrite;
                             ULONG64 ioOther;
 
-                            ioRead = PhGetItemCircularBuffer_ULONG64(&processItem->IoReadHistory, getTooltipText->Index);
-                            ioWrite = PhGetItemCircularBuffer_ULONG64(&processItem->IoWriteHistory, getTooltipText->Index);
-                            ioOther = PhGetItemCircularBuffer_ULONG64(&processItem->IoOtherHistory, getTooltipText->Index);
+                            PhGetProcessItemIoHistory(processItem, getTooltipText->Index, &ioRead, &ioWrite, &ioOther);
 
                             PhMoveReference(&performanceContext->IoGraphState.TooltipText, PhFormatString(
                                 L"R: %s\nW: %s\nO: %s\n%s",
@@ -1868,6 +1933,35 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
 
                         getTooltipText->Text = performanceContext->IoGraphState.TooltipText->sr;
                     }
+                    else if (
+                        header->hwndFrom == performanceContext->ThreadStatesGraphHandle &&
+                        getTooltipText->Index < getTooltipText->TotalCount
+                        )
+                    {
+                        if (performanceContext->ThreadStatesGraphState.TooltipIndex != getTooltipText->Index)
+                        {
+                            ULONG running;
+                            ULONG ready;
+                            ULONG waiting;
+                            KWAIT_REASON topWaitReason;
+
+                            PhGetProcessItemThreadStateHistory(processItem, getTooltipText->Index,
+                                &running, &ready, &waiting, &topWaitReason);
+
+                            PhMoveReference(&performanceContext->ThreadStatesGraphState.TooltipText, PhFormatString(
+                                L"Running: %u\nReady: %u\nWaiting: %u%s%s%s\n%s",
+                                running,
+                                ready,
+                                waiting,
+                                (ULONG)topWaitReason < MaximumWaitReason ? L" (mostly " : L"",
+                                (ULONG)topWaitReason < MaximumWaitReason ? PhKWaitReasonNames[topWaitReason] : L"",
+                                (ULONG)topWaitReason < MaximumWaitReason ? L")" : L"",
+                                ((PPH_STRING)PhAutoDereferenceObject(PhGetStatisticsTimeString(processItem, getTooltipText->Index)))->Buffer
+                                ));
+                        }
+
+                        getTooltipText->Text = performanceContext->ThreadStatesGraphState.TooltipText->sr;
+                    }
                 }
                 break;
             }
@@ -1879,6 +1973,7 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
             HWND cpuGroupBox = GetDlgItem(hwndDlg, IDC_GROUPCPU);
             HWND privateBytesGroupBox = GetDlgItem(hwndDlg, IDC_GROUPPRIVATEBYTES);
             HWND ioGroupBox = GetDlgItem(hwndDlg, IDC_GROUPIO);
+            HWND threadStatesGroupBox = GetDlgItem(hwndDlg, IDC_GROUPTHREADSTATES);
             RECT clientRect;
             RECT margin = { 13, 13, 13, 13 };
             RECT innerMargin = { 10, 20, 10, 10 };
@@ -1892,12 +1987,14 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
             performanceContext->PrivateGraphState.TooltipIndex = -1;
             performanceContext->IoGraphState.Valid = FALSE;
             performanceContext->IoGraphState.TooltipIndex = -1;
+            performanceContext->ThreadStatesGraphState.Valid = FALSE;
+            performanceContext->ThreadStatesGraphState.TooltipIndex = -1;
 
             GetClientRect(hwndDlg, &clientRect);
             width = clientRect.right - margin.left - margin.right;
-            height = (clientRect.bottom - margin.top - margin.bottom - between * 2) / 3;
+            height = (clientRect.bottom - margin.top - margin.bottom - between * 3) / 4;
 
-            deferHandle = BeginDeferWindowPos(6);
+            deferHandle = BeginDeferWindowPos(8);
 
             deferHandle = DeferWindowPos(deferHandle, cpuGroupBox, NULL, margin.left, margin.top,
                 width, height, SWP_NOACTIVATE | SWP_NOZORDER);
@@ -1938,6 +2035,19 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                 SWP_NOACTIVATE | SWP_NOZORDER
                 );
 
+            deferHandle = DeferWindowPos(deferHandle, threadStatesGroupBox, NULL, margin.left, margin.top + (height + between) * 3,
+                width, height, SWP_NOACTIVATE | SWP_NOZORDER);
+            deferHandle = DeferWindowPos(
+                deferHandle,
+                performanceContext->ThreadStatesGraphHandle,
+                NULL,
+                margin.left + innerMargin.left,
+                margin.top + (height + between) * 3 + innerMargin.top,
+                width - innerMargin.left - innerMargin.right,
+                height - innerMargin.top - innerMargin.bottom,
+                SWP_NOACTIVATE | SWP_NOZORDER
+                );
+
             EndDeferWindowPos(deferHandle);
         }
         break;
@@ -1962,6 +2072,12 @@ INT_PTR CALLBACK PhpProcessPerformanceDlgProc(
                 Graph_Draw(performanceContext->IoGraphHandle);
                 Graph_UpdateTooltip(performanceContext->IoGraphHandle);
                 InvalidateRect(performanceContext->IoGraphHandle, NULL, FALSE);
+
+                performanceContext->ThreadStatesGraphState.Valid = FALSE;
+                Graph_MoveGrid(performanceContext->ThreadStatesGraphHandle, 1);
+                Graph_Draw(performanceContext->ThreadStatesGraphHandle);
+                Graph_UpdateTooltip(performanceContext->ThreadStatesGraphHandle);
+                InvalidateRect(performanceContext->ThreadStatesGraphHandle, NULL, FALSE);
             }
         }
         break;
@@ -2058,6 +2174,8 @@ VOID PhpInitializeThreadMenu(
             ID_THREAD_FORCETERMINATE,
             ID_THREAD_SUSPEND,
             ID_THREAD_RESUME,
+            ID_ANALYZE_SAMPLESTACKS,
+            ID_ANALYZE_WAITCHAIN,
             ID_THREAD_COPY
         };
         ULONG i;
@@ -2882,6 +3000,49 @@ INT_PTR CALLBACK PhpProcessThreadsDlgProc(
                     }
                 }
                 break;
+            case ID_ANALYZE_WAITCHAIN:
+                {
+                    PhReferenceObject(threadsContext->Provider->SymbolProvider);
+                    PhUiAnalyzeWaitProcess(
+                        hwndDlg,
+                        processItem->ProcessId,
+                        threadsContext->Provider->SymbolProvider
+                        );
+                    PhDereferenceObject(threadsContext->Provider->SymbolProvider);
+                }
+                break;
+            case ID_ANALYZE_SAMPLESTACKS:
+                {
+                    PPH_THREAD_ITEM *threads;
+                    ULONG numberOfThreads;
+                    PHANDLE threadIds;
+                    ULONG i;
+
+                    PhGetSelectedThreadItems(&threadsContext->ListContext, &threads, &numberOfThreads);
+
+                    if (numberOfThreads != 0)
+                    {
+                        threadIds = PhAllocate(numberOfThreads * sizeof(HANDLE));
+
+                        for (i = 0; i < numberOfThreads; i++)
+                            threadIds[i] = threads[i]->ThreadId;
+
+                        PhReferenceObject(threadsContext->Provider);
+                        PhShowThreadStackSampleDialog(
+                            hwndDlg,
+                            processItem->ProcessId,
+                            threadIds,
+                            numberOfThreads,
+                            threadsContext->Provider
+                            );
+                        PhDereferenceObject(threadsContext->Provider);
+
+                        PhFree(threadIds);
+                    }
+
+                    PhFree(threads);
+                }
+                break;
             case ID_PRIORITY_TIMECRITICAL:
             case ID_PRIORITY_HIGHEST:
             case ID_PRIORITY_ABOVENORMAL:
@@ -3290,6 +3451,9 @@ VOID PhpInitializeModuleMenu(
         PhSetFlagsAllEMenuItems(Menu, PH_EMENU_DISABLED, PH_EMENU_DISABLED);
         PhEnableEMenuItem(Menu, ID_MODULE_COPY, TRUE);
     }
+
+    // This applies to all modules of the process, not just the selected ones.
+    PhEnableEMenuItem(Menu, ID_MODULE_CHECKMODIFIEDCODE, TRUE);
 }
 
 VOID PhShowModuleContextMenu(
@@ -3589,6 +3753,11 @@ INT_PTR CALLBACK PhpProcessModulesDlgProc(
                     PhDereferenceObject(text);
                 }
                 break;
+            case ID_MODULE_CHECKMODIFIEDCODE:
+                {
+                    PhShowModifiedImagePages(hwndDlg, processItem->ProcessId);
+                }
+                break;
             }
         }
         break;
@@ -3701,6 +3870,11 @@ VOID PhpRefreshProcessMemoryList(
     )
 {
     PPH_MEMORY_CONTEXT memoryContext = PropPageContext->Context;
+    BOOLEAN incremental;
+
+    // The nodes keep their own references to the old items, so the old list can be deleted
+    // before the new one is merged into the tree.
+    incremental = memoryContext->MemoryItemListValid;
 
     if (memoryContext->MemoryItemListValid)
     {
@@ -3728,7 +3902,11 @@ VOID PhpRefreshProcessMemoryList(
 
         memoryContext->MemoryItemListValid = TRUE;
         TreeNew_SetEmptyText(memoryContext->ListContext.TreeNewHandle, &EmptyMemoryText, 0);
-        PhReplaceMemoryList(&memoryContext->ListContext, &memoryContext->MemoryItemList);
+
+        if (incremental)
+            PhUpdateMemoryList(&memoryContext->ListContext, &memoryContext->MemoryItemList);
+        else
+            PhReplaceMemoryList(&memoryContext->ListContext, &memoryContext->MemoryItemList);
     }
     else
     {
@@ -3743,6 +3921,161 @@ VOID PhpRefreshProcessMemoryList(
     }
 }
 
+#define PH_MEMORY_SAVE_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * Appends the readable pages of a range of memory to a file.
+ *
+ * \param ProcessHandle A handle to the process. The handle must have PROCESS_QUERY_INFORMATION
+ * and PROCESS_VM_READ access.
+ * \param FileStream The file stream to write to.
+ * \param BaseAddress The start of the range.
+ * \param Size The size of the range.
+ * \param Buffer A buffer of PH_MEMORY_SAVE_CHUNK_SIZE bytes.
+ *
+ * \return The status of the last write. Pages that can't be read are skipped.
+ */
+static NTSTATUS PhpSaveMemoryRange(
+    _In_ HANDLE ProcessHandle,
+    _In_ PPH_FILE_STREAM FileStream,
+    _In_ PVOID BaseAddress,
+    _In_ SIZE_T Size,
+    _Out_writes_bytes_(PH_MEMORY_SAVE_CHUNK_SIZE) PVOID Buffer
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PVOID address;
+    PVOID endAddress;
+    MEMORY_BASIC_INFORMATION basicInfo;
+
+    address = BaseAddress;
+    endAddress = PTR_ADD_OFFSET(BaseAddress, Size);
+
+    while ((ULONG_PTR)address < (ULONG_PTR)endAddress)
+    {
+        PVOID regionEndAddress;
+
+        if (!NT_SUCCESS(NtQueryVirtualMemory(
+            ProcessHandle,
+            address,
+            MemoryBasicInformation,
+            &basicInfo,
+            sizeof(MEMORY_BASIC_INFORMATION),
+            NULL
+            )))
+            break;
+
+        regionEndAddress = PTR_ADD_OFFSET(basicInfo.BaseAddress, basicInfo.RegionSize);
+
+        if ((ULONG_PTR)regionEndAddress > (ULONG_PTR)endAddress)
+            regionEndAddress = endAddress;
+
+        // Uncommitted and no-access pages can't be read, and reading a guard page would clear
+        // its guard (e.g. on a thread stack), so skip these without trying.
+        if (basicInfo.State == MEM_COMMIT && !(basicInfo.Protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        {
+            while ((ULONG_PTR)address < (ULONG_PTR)regionEndAddress)
+            {
+                SIZE_T length;
+
+                length = min((ULONG_PTR)regionEndAddress - (ULONG_PTR)address, PH_MEMORY_SAVE_CHUNK_SIZE);
+
+                if (NT_SUCCESS(PhReadVirtualMemory(ProcessHandle, address, Buffer, length, NULL)))
+                {
+                    status = PhWriteFileStream(FileStream, Buffer, (ULONG)length);
+                }
+                else
+                {
+                    SIZE_T offset;
+
+                    // Some pages in the chunk are unreadable. Fall back to reading each page.
+                    for (offset = 0; offset < length; offset += PAGE_SIZE)
+                    {
+                        if (NT_SUCCESS(PhReadVirtualMemory(ProcessHandle, PTR_ADD_OFFSET(address, offset), Buffer, PAGE_SIZE, NULL)))
+                        {
+                            if (!NT_SUCCESS(status = PhWriteFileStream(FileStream, Buffer, PAGE_SIZE)))
+                                break;
+                        }
+                    }
+                }
+
+                if (!NT_SUCCESS(status))
+                    return status;
+
+                address = PTR_ADD_OFFSET(address, length);
+            }
+        }
+
+        address = regionEndAddress;
+    }
+
+    return status;
+}
+
+static VOID PhpShowMemorySnapshotChanges(
+    _In_ HWND hwndDlg,
+    _In_ PPH_MEMORY_SNAPSHOT Snapshot,
+    _In_ PPH_MEMORY_SNAPSHOT_CHANGE Changes,
+    _In_ ULONG NumberOfChanges
+    )
+{
+    static PWSTR changeTypeStrings[] = { L"New", L"Freed", L"Grown", L"Shrunk", L"Modified" };
+    PH_STRING_BUILDER stringBuilder;
+    SYSTEMTIME systemTime;
+    PPH_STRING timeString;
+    ULONG64 addedPages = 0;
+    ULONG64 removedPages = 0;
+    ULONG64 modifiedPages = 0;
+    ULONG i;
+
+    for (i = 0; i < NumberOfChanges; i++)
+    {
+        addedPages += Changes[i].AddedPages;
+        removedPages += Changes[i].RemovedPages;
+        modifiedPages += Changes[i].ModifiedPages;
+    }
+
+    PhLargeIntegerToLocalSystemTime(&systemTime, &Snapshot->Time);
+    timeString = PhFormatDateTime(&systemTime);
+
+    PhInitializeStringBuilder(&stringBuilder, 1000);
+    PhAppendFormatStringBuilder(&stringBuilder, L"Changes since the snapshot taken at %s\r\n\r\n", timeString->Buffer);
+    PhAppendFormatStringBuilder(&stringBuilder, L"Committed: %s\r\n", PhaFormatSize(addedPages * PAGE_SIZE, -1)->Buffer);
+    PhAppendFormatStringBuilder(&stringBuilder, L"Decommitted: %s\r\n", PhaFormatSize(removedPages * PAGE_SIZE, -1)->Buffer);
+    PhAppendFormatStringBuilder(&stringBuilder, L"Modified: %s\r\n\r\n", PhaFormatSize(modifiedPages * PAGE_SIZE, -1)->Buffer);
+
+    if (NumberOfChanges == 0)
+        PhAppendStringBuilder2(&stringBuilder, L"No regions have changed.\r\n");
+
+    for (i = 0; i < NumberOfChanges; i++)
+    {
+        PPH_MEMORY_SNAPSHOT_CHANGE change = &Changes[i];
+
+        PhAppendFormatStringBuilder(
+            &stringBuilder,
+            L"0x%Ix\t%s\t%s\t%s",
+            change->BaseAddress,
+            PhaFormatSize(change->RegionSize, -1)->Buffer,
+            PhGetMemoryTypeString(change->Type),
+            changeTypeStrings[change->ChangeType]
+            );
+
+        if (change->AddedPages != 0 && change->ChangeType != MemorySnapshotRegionNew)
+            PhAppendFormatStringBuilder(&stringBuilder, L", +%s", PhaFormatSize((ULONG64)change->AddedPages * PAGE_SIZE, -1)->Buffer);
+        if (change->RemovedPages != 0 && change->ChangeType != MemorySnapshotRegionFreed)
+            PhAppendFormatStringBuilder(&stringBuilder, L", -%s", PhaFormatSize((ULONG64)change->RemovedPages * PAGE_SIZE, -1)->Buffer);
+        if (change->ModifiedPages != 0)
+            PhAppendFormatStringBuilder(&stringBuilder, L", %s modified", PhaFormatSize((ULONG64)change->ModifiedPages * PAGE_SIZE, -1)->Buffer);
+
+        PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+    }
+
+    PhShowInformationDialog(hwndDlg, stringBuilder.String->Buffer);
+
+    PhDeleteStringBuilder(&stringBuilder);
+    PhDereferenceObject(timeString);
+}
+
 VOID PhpInitializeMemoryMenu(
     _In_ PPH_EMENU Menu,
     _In_ HANDLE ProcessId,
@@ -3786,6 +4119,9 @@ VOID PhpInitializeMemoryMenu(
     }
 
     PhEnableEMenuItem(Menu, ID_MEMORY_READWRITEADDRESS, TRUE);
+    PhEnableEMenuItem(Menu, ID_MEMORY_HEAPSTATISTICS, TRUE);
+    PhEnableEMenuItem(Menu, ID_MEMORY_TAKESNAPSHOT, TRUE);
+    PhEnableEMenuItem(Menu, ID_MEMORY_COMPARESNAPSHOT, TRUE);
 }
 
 VOID PhShowMemoryContextMenu(
@@ -3811,6 +4147,10 @@ VOID PhShowMemoryContextMenu(
         PhSetFlagsEMenuItem(menu, ID_MEMORY_READWRITEMEMORY, PH_EMENU_DEFAULT, PH_EMENU_DEFAULT);
 
         PhpInitializeMemoryMenu(menu, ProcessItem->ProcessId, memoryNodes, numberOfMemoryNodes);
+
+        if (!Context->Snapshot)
+            PhEnableEMenuItem(menu, ID_MEMORY_COMPARESNAPSHOT, FALSE);
+
         PhInsertCopyCellEMenuItem(menu, ID_MEMORY_COPY, Context->ListContext.TreeNewHandle, ContextMenu->Column);
 
         if (PhPluginsEnabled)
@@ -3934,6 +4274,7 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
                 PhDeleteMemoryItemList(&memoryContext->MemoryItemList);
 
             PhClearReference(&memoryContext->ErrorMessage);
+            PhClearReference(&memoryContext->Snapshot);
             PhFree(memoryContext);
 
             PhpPropPageDlgProcDestroy(hwndDlg);
@@ -4003,7 +4344,7 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
 
                     if (!NT_SUCCESS(status = PhOpenProcess(
                         &processHandle,
-                        PROCESS_VM_READ,
+                        PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
                         processItem->ProcessId
                         )))
                     {
@@ -4033,7 +4374,6 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
                             PPH_FILE_STREAM fileStream;
                             PVOID buffer;
                             ULONG i;
-                            ULONG_PTR offset;
 
                             fileName = PhGetFileDialogFileName(fileDialog);
                             PhAutoDereferenceObject(fileName);
@@ -4044,43 +4384,53 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
                                 FILE_GENERIC_WRITE,
                                 FILE_SHARE_READ,
                                 FILE_OVERWRITE_IF,
-                                0
+                                PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING
                                 )))
                             {
-                                buffer = PhAllocatePage(PAGE_SIZE, NULL);
+                                // Writes go out in the background while the next chunk is read.
+                                buffer = PhAllocatePage(PH_MEMORY_SAVE_CHUNK_SIZE, NULL);
 
-                                // Go through each selected memory item and append the region contents
-                                // to the file.
-                                for (i = 0; i < numberOfMemoryNodes; i++)
+                                if (buffer)
                                 {
-                                    PPH_MEMORY_NODE memoryNode = memoryNodes[i];
-                                    PPH_MEMORY_ITEM memoryItem = memoryNode->MemoryItem;
+                                    // Go through each selected memory item and append the region contents
+                                    // to the file.
+                                    for (i = 0; i < numberOfMemoryNodes; i++)
+                                    {
+                                        PPH_MEMORY_NODE memoryNode = memoryNodes[i];
+                                        PPH_MEMORY_ITEM memoryItem = memoryNode->MemoryItem;
 
-                                    if (!memoryNode->IsAllocationBase && !(memoryItem->State & MEM_COMMIT))
-                                        continue;
+                                        if (!memoryNode->IsAllocationBase && !(memoryItem->State & MEM_COMMIT))
+                                            continue;
 
-                                    for (offset = 0; offset < memoryItem->RegionSize; offset += PAGE_SIZE)
-                                    {
-                                        if (NT_SUCCESS(PhReadVirtualMemory(
+                                        if (!NT_SUCCESS(status = PhpSaveMemoryRange(
                                             processHandle,
-                                            PTR_ADD_OFFSET(memoryItem->BaseAddress, offset),
-                                            buffer,
-                                            PAGE_SIZE,
-                                            NULL
+                                            fileStream,
+                                            memoryItem->BaseAddress,
+                                            memoryItem->RegionSize,
+                                            buffer
                                             )))
-                                        {
-                                            PhWriteFileStream(fileStream, buffer, PAGE_SIZE);
-                                        }
+                                            break;
                                     }
+
+                                    PhFreePage(buffer);
+                                }
+                                else
+                                {
+                                    status = STATUS_NO_MEMORY;
                                 }
 
-                                PhFreePage(buffer);
+                                if (NT_SUCCESS(status))
+                                    status = PhFlushFileStream(fileStream, FALSE);
 
                                 PhDereferenceObject(fileStream);
-                            }
 
-                            if (!NT_SUCCESS(status))
+                                if (!NT_SUCCESS(status))
+                                    PhShowStatus(hwndDlg, L"Unable to save the memory", status, 0);
+                            }
+                            else
+                            {
                                 PhShowStatus(hwndDlg, L"Unable to create the file", status, 0);
+                            }
                         }
 
                         PhFreeFileDialog(fileDialog);
@@ -4130,6 +4480,11 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
                     }
                 }
                 break;
+            case ID_MEMORY_HEAPSTATISTICS:
+                {
+                    PhShowProcessHeapStatistics(hwndDlg, processItem);
+                }
+                break;
             case ID_MEMORY_READWRITEADDRESS:
                 {
                     PPH_STRING selectedChoice = NULL;
@@ -4184,6 +4539,41 @@ INT_PTR CALLBACK PhpProcessMemoryDlgProc(
                     }
                 }
                 break;
+            case ID_MEMORY_TAKESNAPSHOT:
+                {
+                    NTSTATUS status;
+                    PPH_MEMORY_SNAPSHOT snapshot;
+
+                    if (NT_SUCCESS(status = PhCreateMemorySnapshot(processItem->ProcessId, &snapshot)))
+                        PhMoveReference(&memoryContext->Snapshot, snapshot);
+                    else
+                        PhShowStatus(hwndDlg, L"Unable to take a snapshot of the memory", status, 0);
+                }
+                break;
+            case ID_MEMORY_COMPARESNAPSHOT:
+                {
+                    NTSTATUS status;
+                    PPH_MEMORY_SNAPSHOT snapshot;
+                    PPH_MEMORY_SNAPSHOT_CHANGE changes;
+                    ULONG numberOfChanges;
+
+                    if (!memoryContext->Snapshot)
+                        break;
+
+                    // The earlier snapshot is kept, so later comparisons are against the same point in time.
+                    if (NT_SUCCESS(status = PhCreateMemorySnapshot(processItem->ProcessId, &snapshot)))
+                    {
+                        PhCompareMemorySnapshots(memoryContext->Snapshot, snapshot, &changes, &numberOfChanges);
+                        PhpShowMemorySnapshotChanges(hwndDlg, memoryContext->Snapshot, changes, numberOfChanges);
+                        PhFree(changes);
+                        PhDereferenceObject(snapshot);
+                    }
+                    else
+                    {
+                        PhShowStatus(hwndDlg, L"Unable to take a snapshot of the memory", status, 0);
+                    }
+                }
+                break;
             case ID_MEMORY_COPY:
                 {
                     PPH_STRING text;
@@ -4896,6 +5286,7 @@ INT_PTR CALLBACK PhpProcessHandlesDlgProc(
             handlesContext->Provider = PhCreateHandleProvider(
                 processItem->ProcessId
                 );
+            handlesContext->Provider->LazyNames = !!PhGetIntegerSetting(L"EnableLazyHandleNames");
             PhRegisterProvider(
                 &PhSecondaryProviderThread,
                 PhHandleProviderUpdate,
@@ -4932,6 +5323,7 @@ INT_PTR CALLBACK PhpProcessHandlesDlgProc(
             tnHandle = GetDlgItem(hwndDlg, IDC_LIST);
             BringWindowToTop(tnHandle);
             PhInitializeHandleList(hwndDlg, tnHandle, &handlesContext->ListContext);
+            handlesContext->ListContext.Provider = handlesContext->Provider;
             TreeNew_SetEmptyText(tnHandle, &LoadingText, 0);
             handlesContext->NeedsRedraw = FALSE;
             handlesContext->LastRunStatus = -1;
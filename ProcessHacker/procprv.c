@@ -50,9 +50,28 @@
  * and then the list is traversed backwards until the process is found. Binary
  * search is similarly used for insertion and removal.
  *
+ * Each update keeps a snapshot of the process list sorted by PID. Since the
+ * previous process information snapshot is kept alive until the end of
+ * the next update, the new snapshot can be merged against the old one in a
+ * single linear pass. This gives us (in one go) the process item for each
+ * entry, the list of terminated processes and whether a process' counters have
+ * changed at all, without having to look up every process in the process index or
+ * walk the index looking for dead items.
+ *
  * On Windows 7 and above, CPU usage can be calculated from cycle time. However,
  * cycle time cannot be split into kernel/user components, and cycle time is not
  * available for DPCs and Interrupts separately (only a "system" cycle time).
+ *
+ * Signature verification results are cached in memory, and are also persisted
+ * in a file pool next to the settings file so that they survive restarts. A
+ * persisted result is only reused if the file still has the same file ID, size
+ * and last write time. The store is loaded the first time a file is verified.
+ *
+ * Process records are purged from memory once they fall out of the statistics
+ * history. Records of terminated processes are also appended to a second file
+ * pool (the record store) so that PhFindProcessRecord can still find them after
+ * they have been purged or after a restart. Records older than the configured
+ * number of days are removed when the store is opened.
  */
 
 #include <phapp.h>
@@ -61,9 +80,56 @@
 #include <phplug.h>
 #include <verify.h>
 #include <winsta.h>
+#include <filepool.h>
+#include <procagg.h>
+#include <procalrt.h>
+#include <tokcache.h>
+#include <srvcpu.h>
+#include <capture.h>
+#include <tracelog.h>
+
+typedef struct _PH_PROCESS_SNAPSHOT_ENTRY
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+    PSYSTEM_PROCESS_INFORMATION Process;
+    PSYSTEM_PROCESS_INFORMATION PreviousProcess; // same process in the previous snapshot, if any
+    PPH_PROCESS_ITEM ProcessItem;
+    UCHAR PriorityClass;
+    BOOLEAN PriorityClassValid; // PriorityClass was queried using KProcessHacker
+} PH_PROCESS_SNAPSHOT_ENTRY, *PPH_PROCESS_SNAPSHOT_ENTRY;
+
+typedef struct _PH_PROCESS_SNAPSHOT
+{
+    ULONG Count;
+    ULONG AllocatedCount;
+    PPH_PROCESS_SNAPSHOT_ENTRY Entries;
+} PH_PROCESS_SNAPSHOT, *PPH_PROCESS_SNAPSHOT;
+
+// A read-only copy of the process index which readers can use without locking. Each version
+// holds a reference to every process item in it.
+typedef struct _PH_PROCESS_INDEX_VERSION
+{
+    PH_HANDLE_INDEX Index;
+} PH_PROCESS_INDEX_VERSION, *PPH_PROCESS_INDEX_VERSION;
 
-#define PROCESS_ID_BUCKETS 64
-#define PROCESS_ID_TO_BUCKET_INDEX(ProcessId) ((HandleToUlong(ProcessId) / 4) & (PROCESS_ID_BUCKETS - 1))
+#define PH_PROCESS_HISTORY_CHUNK_SLOTS 256
+
+typedef struct _PH_PROCESS_HISTORY_CHUNK
+{
+    ULONG BaseSlot;
+    PH_CIRCULAR_BUFFER_SLAB_USHORT CpuKernelHistory; // fixed point, PH_PROCESS_HISTORY_CPU_SCALE is 100%
+    PH_CIRCULAR_BUFFER_SLAB_USHORT CpuUserHistory;
+    PH_CIRCULAR_BUFFER_SLAB_FLOAT IoReadHistory;
+    PH_CIRCULAR_BUFFER_SLAB_FLOAT IoWriteHistory;
+    PH_CIRCULAR_BUFFER_SLAB_FLOAT IoOtherHistory;
+    PH_CIRCULAR_BUFFER_SLAB_ULONG PrivatePagesHistory;
+    PH_CIRCULAR_BUFFER_SLAB_USHORT RunningThreadsHistory; // thread counts, saturated at USHRT_MAX
+    PH_CIRCULAR_BUFFER_SLAB_USHORT ReadyThreadsHistory;
+    PH_CIRCULAR_BUFFER_SLAB_USHORT WaitingThreadsHistory;
+    PH_CIRCULAR_BUFFER_SLAB_USHORT TopWaitReasonHistory; // KWAIT_REASON, MaximumWaitReason if none
+    PH_PROCESS_HOT_DATA HotData[PH_PROCESS_HISTORY_CHUNK_SLOTS];
+} PH_PROCESS_HISTORY_CHUNK, *PPH_PROCESS_HISTORY_CHUNK;
 
 typedef struct _PH_PROCESS_QUERY_DATA
 {
@@ -78,6 +144,7 @@ typedef struct _PH_PROCESS_QUERY_S1_DATA
 
     PPH_STRING CommandLine;
 
+    PPH_IMAGE_CACHE_ENTRY ImageCacheEntry;
     HICON SmallIcon;
     HICON LargeIcon;
     PH_IMAGE_VERSION_INFO VersionInfo;
@@ -112,6 +179,31 @@ typedef struct _PH_PROCESS_QUERY_S2_DATA
     ULONG ImportModules;
 } PH_PROCESS_QUERY_S2_DATA, *PPH_PROCESS_QUERY_S2_DATA;
 
+#define PH_PROCESS_QUERY_MAXIMUM_THREADS 8
+
+typedef struct _PH_PROCESS_QUERY_ITEM
+{
+    LIST_ENTRY ListEntry;
+    PPH_PROCESS_ITEM ProcessItem;
+    ULONG Stage;
+} PH_PROCESS_QUERY_ITEM, *PPH_PROCESS_QUERY_ITEM;
+
+typedef struct _PH_PROCESS_QUERY_DEQUE
+{
+    PH_QUEUED_LOCK Lock;
+    LIST_ENTRY PriorityListHead;
+    LIST_ENTRY ListHead;
+} PH_PROCESS_QUERY_DEQUE, *PPH_PROCESS_QUERY_DEQUE;
+
+typedef struct _PHP_SYSTEM_GRAPH_SAMPLES
+{
+    ULONG RunId; // value of PhpSystemGraphRunId when the samples were converted
+    ULONG RequestedCount; // largest number of samples requested so far
+    ULONG Count;
+    ULONG AllocatedCount;
+    PFLOAT Data;
+} PHP_SYSTEM_GRAPH_SAMPLES, *PPHP_SYSTEM_GRAPH_SAMPLES;
+
 typedef struct _PH_VERIFY_CACHE_ENTRY
 {
     PH_AVL_LINKS Links;
@@ -121,11 +213,93 @@ typedef struct _PH_VERIFY_CACHE_ENTRY
     PPH_STRING VerifySignerName;
 } PH_VERIFY_CACHE_ENTRY, *PPH_VERIFY_CACHE_ENTRY;
 
+// A file that is currently being verified. Other threads that need the same file wait for
+// CompletedEvent instead of verifying it again.
+typedef struct _PH_VERIFY_IN_FLIGHT_ENTRY
+{
+    PPH_STRING FileName;
+    LONG RefCount;
+    PH_EVENT CompletedEvent;
+    VERIFY_RESULT VerifyResult;
+    PPH_STRING VerifySignerName;
+} PH_VERIFY_IN_FLIGHT_ENTRY, *PPH_VERIFY_IN_FLIGHT_ENTRY;
+
+#define PH_VERIFY_MAXIMUM_THREADS 4
+
+typedef struct _PH_VERIFY_REQUEST
+{
+    LIST_ENTRY ListEntry;
+    PPH_STRING FileName;
+    PPH_STRING PackageFullName;
+    PPH_VERIFY_FILE_CALLBACK Callback;
+    PVOID Context;
+    PVOID *RequestHandle; // cleared when the request is dequeued
+    BOOLEAN Priority;
+} PH_VERIFY_REQUEST, *PPH_VERIFY_REQUEST;
+
+#define PH_VERIFY_STORE_MAGIC ('rvHP') // stored in the high part of the user context
+#define PH_VERIFY_STORE_MAXIMUM_AGE (7 * PH_TICKS_PER_DAY)
+
+// Records are kept in a singly-linked list. The RVA of the first record is stored in the low
+// part of the user context of the file pool.
+typedef struct _PH_VERIFY_STORE_RECORD
+{
+    ULONG NextRva;
+    ULONG Size;
+    PH_IMAGE_FILE_KEY Key;
+    LARGE_INTEGER VerifyTime;
+    ULONG VerifyResult;
+    USHORT FileNameLength; // in bytes
+    USHORT SignerNameLength; // in bytes
+    WCHAR Data[1]; // file name, followed by signer name
+} PH_VERIFY_STORE_RECORD, *PPH_VERIFY_STORE_RECORD;
+
+#define PH_RECORD_STORE_MAGIC ('rpHP') // stored in the high part of the user context
+// Processes are not always noticed as terminated in the order in which they exited.
+#define PH_RECORD_STORE_SEARCH_SLACK (PH_TICKS_PER_MIN)
+
+// Records are kept in a singly-linked list ordered from newest to oldest. The RVA of the
+// first record is stored in the low part of the user context of the file pool.
+typedef struct _PH_RECORD_STORE_RECORD
+{
+    ULONG NextRva;
+    ULONG Size;
+    ULONG ProcessId;
+    ULONG ParentProcessId;
+    ULONG SessionId;
+    ULONG Reserved;
+    LARGE_INTEGER CreateTime;
+    LARGE_INTEGER ExitTime;
+    USHORT ProcessNameLength; // in bytes
+    USHORT FileNameLength; // in bytes
+    USHORT CommandLineLength; // in bytes
+    USHORT Reserved2;
+    WCHAR Data[1]; // process name, followed by file name and command line
+} PH_RECORD_STORE_RECORD, *PPH_RECORD_STORE_RECORD;
+
 VOID NTAPI PhpProcessItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
     );
 
+VOID NTAPI PhpProcessInformationSnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
+VOID NTAPI PhpProcessIndexVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
+VOID PhpAllocateProcessHistory(
+    _Inout_ PPH_PROCESS_ITEM ProcessItem
+    );
+
+VOID PhpFreeProcessHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    );
+
 INT NTAPI PhpVerifyCacheCompareFunction(
     _In_ PPH_AVL_LINKS Links1,
     _In_ PPH_AVL_LINKS Links2
@@ -151,10 +325,18 @@ VOID PhpRemoveProcessRecord(
     _Inout_ PPH_PROCESS_RECORD ProcessRecord
     );
 
+VOID PhpAddRecordStoreRecord(
+    _In_ PPH_PROCESS_RECORD ProcessRecord
+    );
+
+PPH_PROCESS_RECORD PhpFindRecordStoreRecord(
+    _In_ HANDLE ProcessId,
+    _In_ PLARGE_INTEGER Time
+    );
+
 PPH_OBJECT_TYPE PhProcessItemType;
 
-PPH_HASH_ENTRY PhProcessHashSet[256] = PH_HASH_SET_INIT;
-ULONG PhProcessHashSetCount = 0;
+PH_HANDLE_INDEX PhProcessIndex;
 PH_QUEUED_LOCK PhProcessHashSetLock = PH_QUEUED_LOCK_INIT;
 
 SLIST_HEADER PhProcessQueryDataListHead;
@@ -163,19 +345,30 @@ PHAPPAPI PH_CALLBACK_DECLARE(PhProcessAddedEvent);
 PHAPPAPI PH_CALLBACK_DECLARE(PhProcessModifiedEvent);
 PHAPPAPI PH_CALLBACK_DECLARE(PhProcessRemovedEvent);
 PHAPPAPI PH_CALLBACK_DECLARE(PhProcessesUpdatedEvent);
+PHAPPAPI PH_CALLBACK_DECLARE(PhProcessNotificationEvent);
 
 PPH_LIST PhProcessRecordList;
 PH_QUEUED_LOCK PhProcessRecordListLock = PH_QUEUED_LOCK_INIT;
 
 ULONG PhStatisticsSampleCount = 512;
+ULONG PhStatisticsBucketSize = 10;
+ULONG PhStatisticsBucketCount = 0;
 BOOLEAN PhEnableProcessQueryStage2 = FALSE;
 BOOLEAN PhEnablePurgeProcessRecords = TRUE;
+ULONG PhProcessRecordStoreDays = 7;
 BOOLEAN PhEnableCycleCpuUsage = TRUE;
+BOOLEAN PhEnableProcessNonPoll = FALSE;
 
 PVOID PhProcessInformation; // only can be used if running on same thread as process provider
 SYSTEM_PERFORMANCE_INFORMATION PhPerfInformation;
 PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION PhCpuInformation;
 SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION PhCpuTotals;
+ULONG PhNumberOfProcessors; // active processors in all groups
+USHORT PhNumberOfProcessorGroups;
+PPH_PROCESSOR_LOCATION PhProcessorLocations; // ordered by group, then by number within the group
+ULONG PhNumberOfNumaNodes;
+PFLOAT PhNodesKernelUsage;
+PFLOAT PhNodesUserUsage;
 ULONG PhTotalProcesses;
 ULONG PhTotalThreads;
 ULONG PhTotalHandles;
@@ -210,6 +403,7 @@ PH_UINT64_DELTA PhIoOtherDelta;
 static BOOLEAN PhProcessStatisticsInitialized = FALSE;
 static ULONG PhTimeSequenceNumber = 0;
 static PH_CIRCULAR_BUFFER_ULONG PhTimeHistory;
+static PH_CIRCULAR_BUFFER_TIER_ULONG PhTimeHistoryTier;
 
 PH_CIRCULAR_BUFFER_FLOAT PhCpuKernelHistory;
 PH_CIRCULAR_BUFFER_FLOAT PhCpuUserHistory;
@@ -219,6 +413,13 @@ PPH_CIRCULAR_BUFFER_FLOAT PhCpusKernelHistory;
 PPH_CIRCULAR_BUFFER_FLOAT PhCpusUserHistory;
 //PPH_CIRCULAR_BUFFER_FLOAT PhCpusOtherHistory;
 
+// Long-term history. Samples that fall out of the buffers above are
+// downsampled into these tiers.
+PH_CIRCULAR_BUFFER_TIER_FLOAT PhCpuKernelHistoryTier;
+PH_CIRCULAR_BUFFER_TIER_FLOAT PhCpuUserHistoryTier;
+PPH_CIRCULAR_BUFFER_TIER_FLOAT PhCpusKernelHistoryTier;
+PPH_CIRCULAR_BUFFER_TIER_FLOAT PhCpusUserHistoryTier;
+
 PH_CIRCULAR_BUFFER_ULONG64 PhIoReadHistory;
 PH_CIRCULAR_BUFFER_ULONG64 PhIoWriteHistory;
 PH_CIRCULAR_BUFFER_ULONG64 PhIoOtherHistory;
@@ -234,14 +435,166 @@ PH_CIRCULAR_BUFFER_ULONG64 PhMaxIoReadOtherHistory;
 PH_CIRCULAR_BUFFER_ULONG64 PhMaxIoWriteHistory;
 #endif
 
+static PH_PROCESS_SNAPSHOT PhpProcessSnapshots[2];
+static ULONG PhpCurrentProcessSnapshot = 0;
+
+static PPH_OBJECT_TYPE PhpProcessInformationSnapshotType;
+static PH_QUEUED_LOCK PhpProcessInformationSnapshotLock = PH_QUEUED_LOCK_INIT;
+static PPH_PROCESS_INFORMATION_SNAPSHOT PhpProcessInformationSnapshot; // published after each update
+
+static PPH_OBJECT_TYPE PhpProcessIndexVersionType;
+static PPH_PROCESS_INDEX_VERSION volatile PhpProcessIndexVersion = NULL; // read inside an object epoch
+static volatile BOOLEAN PhpProcessIndexChanged = FALSE; // the published version is out of date
+static PVOID PhpSpareProcessInformationBuffer; // recycled from released snapshots
+static ULONG PhpSpareProcessInformationBufferSize;
+
+static PH_QUEUED_LOCK PhpProcessHistoryLock = PH_QUEUED_LOCK_INIT;
+static PPH_LIST PhpProcessHistoryChunks; // chunks are never freed
+static PPH_LIST PhpFreeProcessHistorySlots;
+static ULONG PhpProcessHistorySize;
+static LONG PhpProcessHistoryIndex = 0;
+// Odd while the provider is adding samples to the histories.
+static volatile ULONG PhpStatisticsGeneration = 0;
+
+static volatile ULONG PhpSystemGraphRunId = 1; // incremented whenever the system history is updated
+static PH_QUEUED_LOCK PhpSystemGraphSamplesLock = PH_QUEUED_LOCK_INIT;
+static PHP_SYSTEM_GRAPH_SAMPLES PhpSystemGraphSamples[SystemGraphSamplesMaximum];
+static PFLOAT PhpSystemIoGraphMaximum; // running maximum of read + other + write, sized like SystemGraphIoReadOther
+
+static PH_INITONCE PhpProcessQueryPoolInitOnce = PH_INITONCE_INIT;
+static PH_FREE_LIST PhpProcessQueryItemFreeList;
+static PH_PROCESS_QUERY_DEQUE PhpProcessQueryDeques[PH_PROCESS_QUERY_MAXIMUM_THREADS];
+static ULONG PhpProcessQueryNumberOfThreads;
+static LONG PhpProcessQueryNextDeque = 0;
+static HANDLE PhpProcessQuerySemaphoreHandle;
+
+static BOOLEAN PhpProcessNonPollInitialized = FALSE;
+
+static PH_QUEUED_LOCK PhpTopProcessLock = PH_QUEUED_LOCK_INIT;
+static PPH_PROCESS_ITEM PhpTopProcessItems[PhProcessTopMaximum][PH_PROCESS_TOP_COUNT]; // referenced
+static ULONG PhpTopProcessCount[PhProcessTopMaximum];
+
 static PTS_ALL_PROCESSES_INFO PhpTsProcesses = NULL;
 static ULONG PhpTsNumberOfProcesses;
 
 #ifdef PH_ENABLE_VERIFY_CACHE
 static PH_AVL_TREE PhpVerifyCacheSet = PH_AVL_TREE_INIT(PhpVerifyCacheCompareFunction);
 static PH_QUEUED_LOCK PhpVerifyCacheLock = PH_QUEUED_LOCK_INIT;
+static PH_INITONCE PhpVerifyStoreInitOnce = PH_INITONCE_INIT;
+static PPH_FILE_POOL PhpVerifyStore = NULL;
+static PH_QUEUED_LOCK PhpVerifyStoreLock = PH_QUEUED_LOCK_INIT;
+static PPH_HASHTABLE PhpVerifyInFlightHashtable;
+static PH_QUEUED_LOCK PhpVerifyInFlightLock = PH_QUEUED_LOCK_INIT;
 #endif
 
+static PH_INITONCE PhpVerifyPoolInitOnce = PH_INITONCE_INIT;
+static PH_FREE_LIST PhpVerifyRequestFreeList;
+static PH_QUEUED_LOCK PhpVerifyQueueLock = PH_QUEUED_LOCK_INIT;
+static LIST_ENTRY PhpVerifyPriorityListHead;
+static LIST_ENTRY PhpVerifyListHead;
+static HANDLE PhpVerifySemaphoreHandle;
+
+static PH_INITONCE PhpRecordStoreInitOnce = PH_INITONCE_INIT;
+static PPH_FILE_POOL PhpRecordStore = NULL;
+static PH_QUEUED_LOCK PhpRecordStoreLock = PH_QUEUED_LOCK_INIT;
+
+static PUSHORT PhpProcessorGroupCounts; // active processors in each group
+static PULONG64 PhpNodesDelta; // kernel, user and idle time for each node
+
+/**
+ * Finds the active processors in every processor group and the NUMA node of each one.
+ *
+ * \remarks Before Windows 7 there is a single group and all processors are placed in node 0.
+ */
+VOID PhpInitializeProcessorTopology(
+    VOID
+    )
+{
+    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX information;
+    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX entry;
+    ULONG length;
+    ULONG offset;
+    USHORT group;
+    ULONG i;
+    ULONG j;
+
+    information = NULL;
+
+    if (WindowsVersion >= WINDOWS_7 &&
+        NT_SUCCESS(PhGetSystemLogicalProcessorInformation(RelationGroup, &information, &length)) &&
+        information->Relationship == RelationGroup && information->Group.ActiveGroupCount != 0)
+    {
+        PhNumberOfProcessorGroups = information->Group.ActiveGroupCount;
+        PhpProcessorGroupCounts = PhAllocate(sizeof(USHORT) * PhNumberOfProcessorGroups);
+        PhNumberOfProcessors = 0;
+
+        for (group = 0; group < PhNumberOfProcessorGroups; group++)
+        {
+            PhpProcessorGroupCounts[group] = information->Group.GroupInfo[group].ActiveProcessorCount;
+            PhNumberOfProcessors += PhpProcessorGroupCounts[group];
+        }
+    }
+    else
+    {
+        PhNumberOfProcessorGroups = 1;
+        PhpProcessorGroupCounts = PhAllocate(sizeof(USHORT));
+        PhpProcessorGroupCounts[0] = PhSystemBasicInformation.NumberOfProcessors;
+        PhNumberOfProcessors = PhSystemBasicInformation.NumberOfProcessors;
+    }
+
+    if (information)
+        PhFree(information);
+
+    PhProcessorLocations = PhAllocate(sizeof(PH_PROCESSOR_LOCATION) * PhNumberOfProcessors);
+    memset(PhProcessorLocations, 0, sizeof(PH_PROCESSOR_LOCATION) * PhNumberOfProcessors);
+    i = 0;
+
+    for (group = 0; group < PhNumberOfProcessorGroups; group++)
+    {
+        for (j = 0; j < PhpProcessorGroupCounts[group]; j++)
+        {
+            PhProcessorLocations[i].Group = group;
+            PhProcessorLocations[i].Number = (UCHAR)j;
+            i++;
+        }
+    }
+
+    PhNumberOfNumaNodes = 1;
+
+    if (WindowsVersion >= WINDOWS_7 &&
+        NT_SUCCESS(PhGetSystemLogicalProcessorInformation(RelationNumaNode, &information, &length)))
+    {
+        for (offset = 0; offset < length; offset += entry->Size)
+        {
+            entry = PTR_ADD_OFFSET(information, offset);
+
+            if (entry->Size == 0)
+                break;
+            if (entry->Relationship != RelationNumaNode)
+                continue;
+
+            for (i = 0; i < PhNumberOfProcessors; i++)
+            {
+                if (PhProcessorLocations[i].Group == entry->NumaNode.GroupMask.Group &&
+                    (entry->NumaNode.GroupMask.Mask & ((KAFFINITY)1 << PhProcessorLocations[i].Number)))
+                {
+                    PhProcessorLocations[i].Node = entry->NumaNode.NodeNumber;
+
+                    if (PhNumberOfNumaNodes <= entry->NumaNode.NodeNumber)
+                        PhNumberOfNumaNodes = entry->NumaNode.NodeNumber + 1;
+                }
+            }
+        }
+
+        PhFree(information);
+    }
+
+    PhNodesKernelUsage = PhAllocate(sizeof(FLOAT) * PhNumberOfNumaNodes * 2);
+    PhNodesUserUsage = PhNodesKernelUsage + PhNumberOfNumaNodes;
+    memset(PhNodesKernelUsage, 0, sizeof(FLOAT) * PhNumberOfNumaNodes * 2);
+    PhpNodesDelta = PhAllocate(sizeof(ULONG64) * PhNumberOfNumaNodes * 3);
+}
+
 BOOLEAN PhProcessProviderInitialization(
     VOID
     )
@@ -250,12 +603,21 @@ BOOLEAN PhProcessProviderInitialization(
     PPH_UINT64_DELTA deltaBuffer;
     PPH_CIRCULAR_BUFFER_FLOAT historyBuffer;
 
+    PhpInitializeProcessorTopology();
+
     PhProcessItemType = PhCreateObjectType(L"ProcessItem", 0, PhpProcessItemDeleteProcedure);
+    PhpProcessInformationSnapshotType = PhCreateObjectType(L"ProcessInformationSnapshot", 0, PhpProcessInformationSnapshotDeleteProcedure);
+    PhpProcessIndexVersionType = PhCreateObjectType(L"ProcessIndexVersion", 0, PhpProcessIndexVersionDeleteProcedure);
 
+    PhInitializeHandleIndex(&PhProcessIndex, 256);
     RtlInitializeSListHead(&PhProcessQueryDataListHead);
 
     PhProcessRecordList = PhCreateList(40);
 
+    PhpProcessHistoryChunks = PhCreateList(4);
+    PhpFreeProcessHistorySlots = PhCreateList(PH_PROCESS_HISTORY_CHUNK_SLOTS);
+    PhpProcessHistorySize = PhRoundUpToPowerOfTwo(PhStatisticsSampleCount);
+
     RtlInitUnicodeString(
         &PhDpcsProcessInformation.ImageName,
         L"DPCs"
@@ -272,46 +634,46 @@ BOOLEAN PhProcessProviderInitialization(
 
     PhCpuInformation = PhAllocate(
         sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors
+        PhNumberOfProcessors
         );
 
     PhCpuIdleCycleTime = PhAllocate(
         sizeof(LARGE_INTEGER) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors
+        PhNumberOfProcessors
         );
     PhCpuSystemCycleTime = PhAllocate(
         sizeof(LARGE_INTEGER) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors
+        PhNumberOfProcessors
         );
 
     usageBuffer = PhAllocate(
         sizeof(FLOAT) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors *
+        PhNumberOfProcessors *
         2
         );
     deltaBuffer = PhAllocate(
         sizeof(PH_UINT64_DELTA) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors *
+        PhNumberOfProcessors *
         3 // 4 for PhCpusIdleCycleDelta
         );
     historyBuffer = PhAllocate(
         sizeof(PH_CIRCULAR_BUFFER_FLOAT) *
-        (ULONG)PhSystemBasicInformation.NumberOfProcessors *
+        PhNumberOfProcessors *
         2
         );
 
     PhCpusKernelUsage = usageBuffer;
-    PhCpusUserUsage = PhCpusKernelUsage + (ULONG)PhSystemBasicInformation.NumberOfProcessors;
+    PhCpusUserUsage = PhCpusKernelUsage + PhNumberOfProcessors;
 
     PhCpusKernelDelta = deltaBuffer;
-    PhCpusUserDelta = PhCpusKernelDelta + (ULONG)PhSystemBasicInformation.NumberOfProcessors;
-    PhCpusIdleDelta = PhCpusUserDelta + (ULONG)PhSystemBasicInformation.NumberOfProcessors;
-    //PhCpusIdleCycleDelta = PhCpusIdleDelta + (ULONG)PhSystemBasicInformation.NumberOfProcessors;
+    PhCpusUserDelta = PhCpusKernelDelta + PhNumberOfProcessors;
+    PhCpusIdleDelta = PhCpusUserDelta + PhNumberOfProcessors;
+    //PhCpusIdleCycleDelta = PhCpusIdleDelta + PhNumberOfProcessors;
 
     PhCpusKernelHistory = historyBuffer;
-    PhCpusUserHistory = PhCpusKernelHistory + (ULONG)PhSystemBasicInformation.NumberOfProcessors;
+    PhCpusUserHistory = PhCpusKernelHistory + PhNumberOfProcessors;
 
-    memset(deltaBuffer, 0, sizeof(PH_UINT64_DELTA) * (ULONG)PhSystemBasicInformation.NumberOfProcessors);
+    memset(deltaBuffer, 0, sizeof(PH_UINT64_DELTA) * PhNumberOfProcessors);
 
     return TRUE;
 }
@@ -415,6 +777,133 @@ PWSTR PhGetProcessPriorityClassString(
     }
 }
 
+VOID PhpProcessInformationSnapshotDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_PROCESS_INFORMATION_SNAPSHOT snapshot = (PPH_PROCESS_INFORMATION_SNAPSHOT)Object;
+    PVOID bufferToFree;
+
+    // Keep the largest buffer for the next query.
+
+    bufferToFree = snapshot->Processes;
+
+    PhAcquireQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+
+    if (snapshot->BufferSize > PhpSpareProcessInformationBufferSize)
+    {
+        bufferToFree = PhpSpareProcessInformationBuffer;
+        PhpSpareProcessInformationBuffer = snapshot->Processes;
+        PhpSpareProcessInformationBufferSize = snapshot->BufferSize;
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+
+    if (bufferToFree)
+        PhFree(bufferToFree);
+}
+
+/**
+ * Takes a new snapshot of the running processes.
+ *
+ * \param Snapshot A variable which receives the snapshot. You must dereference it when
+ * you no longer need it.
+ *
+ * \remarks The buffer of a released snapshot is reused, and it is grown with some
+ * slack so that a steady number of processes doesn't require repeated queries.
+ */
+NTSTATUS PhpQueryProcessInformationSnapshot(
+    _Out_ PPH_PROCESS_INFORMATION_SNAPSHOT *Snapshot
+    )
+{
+    static ULONG bufferSizeHint = 0x4000;
+
+    NTSTATUS status;
+    PVOID buffer;
+    ULONG bufferSize;
+    ULONG returnLength;
+    PPH_PROCESS_INFORMATION_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+    buffer = PhpSpareProcessInformationBuffer;
+    bufferSize = PhpSpareProcessInformationBufferSize;
+    PhpSpareProcessInformationBuffer = NULL;
+    PhpSpareProcessInformationBufferSize = 0;
+    PhReleaseQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+
+    if (bufferSize < bufferSizeHint)
+    {
+        if (buffer)
+            PhFree(buffer);
+
+        bufferSize = bufferSizeHint;
+        buffer = PhAllocate(bufferSize);
+    }
+
+    while (TRUE)
+    {
+        status = NtQuerySystemInformation(
+            SystemProcessInformation,
+            buffer,
+            bufferSize,
+            &returnLength
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL || status == STATUS_INFO_LENGTH_MISMATCH)
+        {
+            PhFree(buffer);
+            bufferSize = returnLength + returnLength / 8;
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    if (bufferSizeHint < bufferSize)
+        bufferSizeHint = bufferSize;
+
+    snapshot = PhCreateObject(sizeof(PH_PROCESS_INFORMATION_SNAPSHOT), PhpProcessInformationSnapshotType);
+    snapshot->Processes = buffer;
+    snapshot->BufferSize = bufferSize;
+    *Snapshot = snapshot;
+
+    return status;
+}
+
+/**
+ * References the process snapshot taken by the most recent process provider update.
+ *
+ * \return The snapshot, or NULL if the process provider hasn't run yet. You must
+ * dereference the snapshot when you no longer need it.
+ *
+ * \remarks Use this instead of enumerating processes again when information from the
+ * current update interval is sufficient.
+ */
+PPH_PROCESS_INFORMATION_SNAPSHOT PhReferenceProcessInformationSnapshot(
+    VOID
+    )
+{
+    PPH_PROCESS_INFORMATION_SNAPSHOT snapshot;
+
+    PhAcquireQueuedLockShared(&PhpProcessInformationSnapshotLock);
+
+    if (snapshot = PhpProcessInformationSnapshot)
+        PhReferenceObject(snapshot);
+
+    PhReleaseQueuedLockShared(&PhpProcessInformationSnapshotLock);
+
+    return snapshot;
+}
+
 /**
  * Creates a process item.
  */
@@ -437,14 +926,8 @@ PPH_PROCESS_ITEM PhCreateProcessItem(
     if (!PH_IS_FAKE_PROCESS_ID(ProcessId))
         PhPrintUInt32(processItem->ProcessIdString, HandleToUlong(ProcessId));
 
-    // Create the statistics buffers.
-    PhInitializeCircularBuffer_FLOAT(&processItem->CpuKernelHistory, PhStatisticsSampleCount);
-    PhInitializeCircularBuffer_FLOAT(&processItem->CpuUserHistory, PhStatisticsSampleCount);
-    PhInitializeCircularBuffer_ULONG64(&processItem->IoReadHistory, PhStatisticsSampleCount);
-    PhInitializeCircularBuffer_ULONG64(&processItem->IoWriteHistory, PhStatisticsSampleCount);
-    PhInitializeCircularBuffer_ULONG64(&processItem->IoOtherHistory, PhStatisticsSampleCount);
-    PhInitializeCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory, PhStatisticsSampleCount);
-    //PhInitializeCircularBuffer_SIZE_T(&processItem->WorkingSetHistory, PhStatisticsSampleCount);
+    // Allocate a slot in the statistics buffers.
+    PhpAllocateProcessHistory(processItem);
 
     PhEmCallObjectOperation(EmProcessItemType, processItem, EmObjectCreate);
 
@@ -461,13 +944,7 @@ VOID PhpProcessItemDeleteProcedure(
 
     PhEmCallObjectOperation(EmProcessItemType, processItem, EmObjectDelete);
 
-    PhDeleteCircularBuffer_FLOAT(&processItem->CpuKernelHistory);
-    PhDeleteCircularBuffer_FLOAT(&processItem->CpuUserHistory);
-    PhDeleteCircularBuffer_ULONG64(&processItem->IoReadHistory);
-    PhDeleteCircularBuffer_ULONG64(&processItem->IoWriteHistory);
-    PhDeleteCircularBuffer_ULONG64(&processItem->IoOtherHistory);
-    PhDeleteCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory);
-    //PhDeleteCircularBuffer_SIZE_T(&processItem->WorkingSetHistory);
+    PhpFreeProcessHistory(processItem);
 
     if (processItem->ServiceList)
     {
@@ -484,8 +961,7 @@ VOID PhpProcessItemDeleteProcedure(
     if (processItem->ProcessName) PhDereferenceObject(processItem->ProcessName);
     if (processItem->FileName) PhDereferenceObject(processItem->FileName);
     if (processItem->CommandLine) PhDereferenceObject(processItem->CommandLine);
-    if (processItem->SmallIcon) DestroyIcon(processItem->SmallIcon);
-    if (processItem->LargeIcon) DestroyIcon(processItem->LargeIcon);
+    if (processItem->ImageCacheEntry) PhDereferenceObject(processItem->ImageCacheEntry);
     PhDeleteImageVersionInfo(&processItem->VersionInfo);
     if (processItem->UserName) PhDereferenceObject(processItem->UserName);
     if (processItem->JobName) PhDereferenceObject(processItem->JobName);
@@ -497,54 +973,103 @@ VOID PhpProcessItemDeleteProcedure(
     if (processItem->Record) PhDereferenceProcessRecord(processItem->Record);
 }
 
-FORCEINLINE BOOLEAN PhCompareProcessItem(
-    _In_ PPH_PROCESS_ITEM Value1,
-    _In_ PPH_PROCESS_ITEM Value2
+/**
+ * Finds a process item in the process index.
+ *
+ * \param ProcessId The process ID of the process item.
+ *
+ * \remarks The process index must be locked before calling this
+ * function. The reference count of the found process item is
+ * not incremented.
+ */
+PPH_PROCESS_ITEM PhpLookupProcessItem(
+    _In_ HANDLE ProcessId
+    )
+{
+    return PhFindItemHandleIndex(&PhProcessIndex, ProcessId);
+}
+
+VOID PhpProcessIndexVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
     )
 {
-    return Value1->ProcessId == Value2->ProcessId;
+    PPH_PROCESS_INDEX_VERSION version = (PPH_PROCESS_INDEX_VERSION)Object;
+    ULONG enumerationKey = 0;
+    PPH_PROCESS_ITEM processItem;
+
+    while (PhEnumHandleIndex(&version->Index, &enumerationKey, NULL, &processItem))
+        PhDereferenceObject(processItem);
+
+    PhDeleteHandleIndex(&version->Index);
 }
 
-FORCEINLINE ULONG PhHashProcessItem(
-    _In_ PPH_PROCESS_ITEM Value
+/**
+ * Publishes a copy of the process index for lock-free readers.
+ *
+ * \remarks This function must be called from the provider thread.
+ */
+VOID PhpPublishProcessIndexVersion(
+    VOID
     )
 {
-    return HandleToUlong(Value->ProcessId) / 4;
+    PPH_PROCESS_INDEX_VERSION version;
+    PPH_PROCESS_INDEX_VERSION oldVersion;
+    ULONG enumerationKey = 0;
+    HANDLE processId;
+    PPH_PROCESS_ITEM processItem;
+
+    if (!PhpProcessIndexChanged)
+        return;
+
+    version = PhCreateObject(sizeof(PH_PROCESS_INDEX_VERSION), PhpProcessIndexVersionType);
+    PhInitializeHandleIndex(&version->Index, PhProcessIndex.Capacity);
+
+    // We are the only writer, so the index can be read without the lock.
+    while (PhEnumHandleIndex(&PhProcessIndex, &enumerationKey, &processId, &processItem))
+    {
+        PhReferenceObject(processItem);
+        PhAddItemHandleIndex(&version->Index, processId, processItem);
+    }
+
+    oldVersion = _InterlockedExchangePointer((PVOID *)&PhpProcessIndexVersion, version);
+    // Only clear the flag once the new version is visible, so that PhEnumProcessItems never
+    // sees a clear flag together with an out of date version.
+    PhpProcessIndexChanged = FALSE;
+
+    // Readers may still be using the old version; it is freed once they have left their epochs.
+    if (oldVersion)
+        PhDereferenceObjectDeferDelete(oldVersion);
 }
 
 /**
- * Finds a process item in the hash set.
+ * Finds and references a process item using the published version of the process index.
  *
  * \param ProcessId The process ID of the process item.
  *
- * \remarks The hash set must be locked before calling this
- * function. The reference count of the found process item is
- * not incremented.
+ * \return The found process item, or NULL if the process item was not found in the published
+ * version. Process items added since the last version was published will not be found.
  */
-PPH_PROCESS_ITEM PhpLookupProcessItem(
+PPH_PROCESS_ITEM PhpReferenceProcessItemLockFree(
     _In_ HANDLE ProcessId
     )
 {
-    PH_PROCESS_ITEM lookupProcessItem;
-    PPH_HASH_ENTRY entry;
-    PPH_PROCESS_ITEM processItem;
+    ULONG epoch;
+    PPH_PROCESS_INDEX_VERSION version;
+    PPH_PROCESS_ITEM processItem = NULL;
 
-    lookupProcessItem.ProcessId = ProcessId;
-    entry = PhFindEntryHashSet(
-        PhProcessHashSet,
-        PH_HASH_SET_SIZE(PhProcessHashSet),
-        PhHashProcessItem(&lookupProcessItem)
-        );
+    epoch = PhEnterObjectEpoch();
 
-    for (; entry; entry = entry->Next)
+    if (version = PhpProcessIndexVersion)
     {
-        processItem = CONTAINING_RECORD(entry, PH_PROCESS_ITEM, HashEntry);
-
-        if (PhCompareProcessItem(&lookupProcessItem, processItem))
-            return processItem;
+        // The version holds a reference to each of its items, so this reference is always safe.
+        if (processItem = PhFindItemHandleIndex(&version->Index, ProcessId))
+            PhReferenceObject(processItem);
     }
 
-    return NULL;
+    PhLeaveObjectEpoch(epoch);
+
+    return processItem;
 }
 
 /**
@@ -560,6 +1085,11 @@ PPH_PROCESS_ITEM PhReferenceProcessItem(
 {
     PPH_PROCESS_ITEM processItem;
 
+    if (processItem = PhpReferenceProcessItemLockFree(ProcessId))
+        return processItem;
+
+    // The item may have been added after the index was last published.
+
     PhAcquireQueuedLockShared(&PhProcessHashSetLock);
 
     processItem = PhpLookupProcessItem(ProcessId);
@@ -580,6 +1110,11 @@ PPH_PROCESS_ITEM PhReferenceProcessItem(
  * PhFree() when you no longer need it.
  * \param NumberOfProcessItems A variable which receives the
  * number of process items returned in \a ProcessItems.
+ *
+ * \remarks The published version of the process index is used when it is up to date.
+ * While the provider has added or removed items that are not yet published (for example
+ * in handlers of PhProcessAddedEvent), the process index is enumerated under its lock
+ * instead, so the result always includes items that have been announced as added.
  */
 VOID PhEnumProcessItems(
     _Out_opt_ PPH_PROCESS_ITEM **ProcessItems,
@@ -589,56 +1124,119 @@ VOID PhEnumProcessItems(
     PPH_PROCESS_ITEM *processItems;
     ULONG numberOfProcessItems;
     ULONG count = 0;
-    ULONG i;
-    PPH_HASH_ENTRY entry;
+    ULONG enumerationKey = 0;
     PPH_PROCESS_ITEM processItem;
+    ULONG epoch;
+    PPH_PROCESS_INDEX_VERSION version;
 
     if (!ProcessItems)
     {
-        *NumberOfProcessItems = PhProcessHashSetCount;
+        *NumberOfProcessItems = PhProcessIndex.Count;
         return;
     }
 
-    PhAcquireQueuedLockShared(&PhProcessHashSetLock);
+    version = NULL;
+    epoch = PhEnterObjectEpoch();
 
-    numberOfProcessItems = PhProcessHashSetCount;
-    processItems = PhAllocate(sizeof(PPH_PROCESS_ITEM) * numberOfProcessItems);
+    if (!PhpProcessIndexChanged)
+        version = PhpProcessIndexVersion;
 
-    for (i = 0; i < PH_HASH_SET_SIZE(PhProcessHashSet); i++)
+    if (version)
     {
-        for (entry = PhProcessHashSet[i]; entry; entry = entry->Next)
+        numberOfProcessItems = version->Index.Count;
+        processItems = PhAllocate(sizeof(PPH_PROCESS_ITEM) * numberOfProcessItems);
+
+        while (PhEnumHandleIndex(&version->Index, &enumerationKey, NULL, &processItem))
         {
-            processItem = CONTAINING_RECORD(entry, PH_PROCESS_ITEM, HashEntry);
             PhReferenceObject(processItem);
             processItems[count++] = processItem;
         }
     }
 
+    PhLeaveObjectEpoch(epoch);
+
+    if (version)
+    {
+        *ProcessItems = processItems;
+        *NumberOfProcessItems = numberOfProcessItems;
+        return;
+    }
+
+    // Nothing has been published yet, or the published version is out of date.
+
+    PhAcquireQueuedLockShared(&PhProcessHashSetLock);
+
+    numberOfProcessItems = PhProcessIndex.Count;
+    processItems = PhAllocate(sizeof(PPH_PROCESS_ITEM) * numberOfProcessItems);
+
+    while (PhEnumHandleIndex(&PhProcessIndex, &enumerationKey, NULL, &processItem))
+    {
+        PhReferenceObject(processItem);
+        processItems[count++] = processItem;
+    }
+
     PhReleaseQueuedLockShared(&PhProcessHashSetLock);
 
     *ProcessItems = processItems;
     *NumberOfProcessItems = numberOfProcessItems;
 }
 
+/**
+ * Gets the processes with the highest usage as of the last provider run.
+ *
+ * \param Type The kind of usage to rank processes by.
+ * \param ProcessItems An array which receives the process items, highest first.
+ * You must dereference each item when you no longer need it.
+ * \param Count The number of elements in \a ProcessItems. At most
+ * PH_PROCESS_TOP_COUNT items are returned.
+ *
+ * \return The number of process items copied into \a ProcessItems.
+ */
+ULONG PhGetTopProcessItems(
+    _In_ PH_PROCESS_TOP_TYPE Type,
+    _Out_writes_to_(Count, return) PPH_PROCESS_ITEM *ProcessItems,
+    _In_ ULONG Count
+    )
+{
+    ULONG i;
+
+    if (Type >= PhProcessTopMaximum)
+        return 0;
+
+    PhAcquireQueuedLockShared(&PhpTopProcessLock);
+
+    if (Count > PhpTopProcessCount[Type])
+        Count = PhpTopProcessCount[Type];
+
+    for (i = 0; i < Count; i++)
+    {
+        ProcessItems[i] = PhpTopProcessItems[Type][i];
+        PhReferenceObject(ProcessItems[i]);
+    }
+
+    PhReleaseQueuedLockShared(&PhpTopProcessLock);
+
+    return Count;
+}
+
 VOID PhpAddProcessItem(
     _In_ _Assume_refs_(1) PPH_PROCESS_ITEM ProcessItem
     )
 {
-    PhAddEntryHashSet(
-        PhProcessHashSet,
-        PH_HASH_SET_SIZE(PhProcessHashSet),
-        &ProcessItem->HashEntry,
-        PhHashProcessItem(ProcessItem)
-        );
-    PhProcessHashSetCount++;
+    PhAddItemHandleIndex(&PhProcessIndex, ProcessItem->ProcessId, ProcessItem);
+    PhpProcessIndexChanged = TRUE;
+
+    // Only items in the process index are visible to PhpSelectTopProcessItems.
+    ProcessItem->HotData->ProcessItem = ProcessItem;
 }
 
 VOID PhpRemoveProcessItem(
     _In_ PPH_PROCESS_ITEM ProcessItem
     )
 {
-    PhRemoveEntryHashSet(PhProcessHashSet, PH_HASH_SET_SIZE(PhProcessHashSet), &ProcessItem->HashEntry);
-    PhProcessHashSetCount--;
+    PhRemoveItemHandleIndex(&PhProcessIndex, ProcessItem->ProcessId);
+    PhpProcessIndexChanged = TRUE;
+    ProcessItem->HotData->ProcessItem = NULL;
     PhDereferenceObject(ProcessItem);
 }
 
@@ -653,20 +1251,270 @@ INT NTAPI PhpVerifyCacheCompareFunction(
     return PhCompareString(entry1->FileName, entry2->FileName, TRUE);
 }
 
-VERIFY_RESULT PhVerifyFileWithAdditionalCatalog(
-    _In_ PPH_VERIFY_FILE_INFO Information,
-    _In_opt_ PWSTR PackageFullName,
-    _Out_opt_ PPH_STRING *SignerName
+/**
+ * Opens or creates a file pool in the same directory as the settings file.
+ *
+ * \param Pool A variable which receives the file pool.
+ * \param FileName The file name of the store, beginning with a backslash.
+ * \param Magic A value which identifies the format of the store. If the high part of the user
+ * context does not match this value, the store is treated as empty.
+ * \param Parameters Parameters for the file pool, or NULL to use the defaults.
+ * \param UserContext A variable which receives the user context of the store.
+ */
+NTSTATUS PhCreateStoreFilePool(
+    _Out_ PPH_FILE_POOL *Pool,
+    _In_ PPH_STRINGREF FileName,
+    _In_ ULONG Magic,
+    _In_opt_ PPH_FILE_POOL_PARAMETERS Parameters,
+    _Out_ PULONGLONG UserContext
     )
 {
-    static PH_STRINGREF codeIntegrityFileName = PH_STRINGREF_INIT(L"\\AppxMetadata\\CodeIntegrity.cat");
+    NTSTATUS status;
+    PPH_FILE_POOL pool;
+    PH_STRINGREF directory;
+    PPH_STRING storeFileName;
+    ULONG_PTR indexOfBackslash;
+    ULONGLONG userContext;
+
+    if (!PhSettingsFileName)
+        return STATUS_NOT_FOUND;
+
+    indexOfBackslash = PhFindLastCharInStringRef(&PhSettingsFileName->sr, '\\', FALSE);
+
+    if (indexOfBackslash == -1)
+        return STATUS_OBJECT_PATH_INVALID;
+
+    directory.Buffer = PhSettingsFileName->Buffer;
+    directory.Length = indexOfBackslash * sizeof(WCHAR);
+    storeFileName = PhConcatStringRef2(&directory, FileName);
+
+    // Only one instance can use a store at a time. Other instances simply run without it.
+    status = PhCreateFilePool2(
+        &pool,
+        storeFileName->Buffer,
+        FALSE,
+        0,
+        FILE_OPEN_IF,
+        Parameters
+        );
+    PhDereferenceObject(storeFileName);
 
-    VERIFY_RESULT result;
-    PPH_STRING additionalCatalogFileName = NULL;
-    PCERT_CONTEXT *signatures;
-    ULONG numberOfSignatures;
+    if (!NT_SUCCESS(status))
+        return status;
 
-    if (PackageFullName)
+    PhGetUserContextFilePool(pool, &userContext);
+
+    if ((ULONG)(userContext >> 32) != Magic)
+    {
+        // New or incompatible store.
+        userContext = (ULONGLONG)Magic << 32;
+        PhSetUserContextFilePool(pool, &userContext);
+    }
+
+    *Pool = pool;
+    *UserContext = userContext;
+
+    return status;
+}
+
+#ifdef PH_ENABLE_VERIFY_CACHE
+
+/**
+ * Opens the verify store and adds all valid records to the verify cache. Records for files
+ * that have changed, no longer exist or are too old are removed from the store.
+ */
+VOID PhpLoadVerifyStore(
+    VOID
+    )
+{
+    static PH_STRINGREF storeFileName = PH_STRINGREF_INIT(L"\\verifycache.dat");
+
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+    LARGE_INTEGER currentTime;
+    PPH_VERIFY_STORE_RECORD previousRecord;
+    PPH_VERIFY_STORE_RECORD record;
+    ULONG rva;
+
+    if (!NT_SUCCESS(PhCreateStoreFilePool(&pool, &storeFileName, PH_VERIFY_STORE_MAGIC, NULL, &userContext)))
+        return;
+
+    PhQuerySystemTime(&currentTime);
+    previousRecord = NULL;
+    rva = (ULONG)userContext;
+
+    while (record = PhReferenceFilePoolByRva(pool, rva))
+    {
+        ULONG nextRva;
+        BOOLEAN valid;
+        PH_IMAGE_FILE_KEY key;
+
+        nextRva = record->NextRva;
+        valid = FALSE;
+
+        if (
+            record->Size == FIELD_OFFSET(PH_VERIFY_STORE_RECORD, Data) + record->FileNameLength + record->SignerNameLength &&
+            record->FileNameLength != 0 &&
+            !(record->FileNameLength & 1) &&
+            !(record->SignerNameLength & 1) &&
+            record->VerifyResult <= VrBadSignature &&
+            record->VerifyTime.QuadPart <= currentTime.QuadPart &&
+            currentTime.QuadPart - record->VerifyTime.QuadPart < PH_VERIFY_STORE_MAXIMUM_AGE
+            )
+        {
+            PPH_VERIFY_CACHE_ENTRY entry;
+
+            entry = PhAllocate(sizeof(PH_VERIFY_CACHE_ENTRY));
+            entry->FileName = PhCreateStringEx(record->Data, record->FileNameLength);
+
+            if (
+                NT_SUCCESS(PhQueryImageFileKey(entry->FileName->Buffer, &key)) &&
+                memcmp(&key, &record->Key, sizeof(PH_IMAGE_FILE_KEY)) == 0
+                )
+            {
+                entry->VerifyResult = record->VerifyResult;
+
+                if (record->SignerNameLength != 0)
+                {
+                    PH_STRINGREF signerName;
+
+                    signerName.Buffer = (PWCHAR)((PCHAR)record->Data + record->FileNameLength);
+                    signerName.Length = record->SignerNameLength;
+                    entry->VerifySignerName = PhInternStringRef(&signerName);
+                }
+                else
+                {
+                    entry->VerifySignerName = NULL;
+                }
+
+                PhAcquireQueuedLockExclusive(&PhpVerifyCacheLock);
+                valid = !PhAddElementAvlTree(&PhpVerifyCacheSet, &entry->Links);
+                PhReleaseQueuedLockExclusive(&PhpVerifyCacheLock);
+
+                if (!valid)
+                {
+                    // Duplicate record.
+                    PhClearReference(&entry->VerifySignerName);
+                }
+            }
+
+            if (!valid)
+            {
+                PhDereferenceObject(entry->FileName);
+                PhFree(entry);
+            }
+        }
+
+        if (valid)
+        {
+            if (previousRecord)
+                PhDereferenceFilePool(pool, previousRecord);
+
+            previousRecord = record;
+        }
+        else
+        {
+            // Unlink and free the record.
+
+            if (previousRecord)
+            {
+                previousRecord->NextRva = nextRva;
+            }
+            else
+            {
+                userContext = ((ULONGLONG)PH_VERIFY_STORE_MAGIC << 32) | nextRva;
+                PhSetUserContextFilePool(pool, &userContext);
+            }
+
+            PhFreeFilePool(pool, record);
+        }
+
+        rva = nextRva;
+    }
+
+    if (previousRecord)
+        PhDereferenceFilePool(pool, previousRecord);
+
+    PhpVerifyStore = pool;
+}
+
+/**
+ * Adds a verification result to the verify store.
+ *
+ * \param FileName The file name.
+ * \param VerifyResult The verification result.
+ * \param SignerName The signer name, if any.
+ */
+VOID PhpAddVerifyStoreRecord(
+    _In_ PPH_STRING FileName,
+    _In_ VERIFY_RESULT VerifyResult,
+    _In_opt_ PPH_STRING SignerName
+    )
+{
+    PH_IMAGE_FILE_KEY key;
+    SIZE_T signerNameLength;
+    ULONG size;
+    ULONGLONG userContext;
+    PPH_VERIFY_STORE_RECORD record;
+    ULONG rva;
+
+    if (!PhpVerifyStore)
+        return;
+
+    signerNameLength = SignerName ? SignerName->Length : 0;
+
+    if (FileName->Length > MAXUSHORT || signerNameLength > MAXUSHORT)
+        return;
+    if (!NT_SUCCESS(PhQueryImageFileKey(FileName->Buffer, &key)))
+        return;
+
+    size = FIELD_OFFSET(PH_VERIFY_STORE_RECORD, Data) + (ULONG)FileName->Length + (ULONG)signerNameLength;
+
+    PhAcquireQueuedLockExclusive(&PhpVerifyStoreLock);
+
+    record = PhAllocateFilePool(PhpVerifyStore, size, &rva);
+
+    if (record)
+    {
+        PhGetUserContextFilePool(PhpVerifyStore, &userContext);
+
+        record->NextRva = (ULONG)userContext;
+        record->Size = size;
+        record->Key = key;
+        PhQuerySystemTime(&record->VerifyTime);
+        record->VerifyResult = VerifyResult;
+        record->FileNameLength = (USHORT)FileName->Length;
+        record->SignerNameLength = (USHORT)signerNameLength;
+        memcpy(record->Data, FileName->Buffer, FileName->Length);
+
+        if (SignerName)
+            memcpy((PCHAR)record->Data + FileName->Length, SignerName->Buffer, signerNameLength);
+
+        PhDereferenceFilePool(PhpVerifyStore, record);
+
+        userContext = ((ULONGLONG)PH_VERIFY_STORE_MAGIC << 32) | rva;
+        PhSetUserContextFilePool(PhpVerifyStore, &userContext);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpVerifyStoreLock);
+}
+
+#endif
+
+VERIFY_RESULT PhVerifyFileWithAdditionalCatalog(
+    _In_ PPH_VERIFY_FILE_INFO Information,
+    _In_opt_ PWSTR PackageFullName,
+    _Out_opt_ PPH_STRING *SignerName
+    )
+{
+    static PH_STRINGREF codeIntegrityFileName = PH_STRINGREF_INIT(L"\\AppxMetadata\\CodeIntegrity.cat");
+
+    VERIFY_RESULT result;
+    PPH_STRING additionalCatalogFileName = NULL;
+    PCERT_CONTEXT *signatures;
+    ULONG numberOfSignatures;
+
+    if (PackageFullName)
     {
         PACKAGE_ID *packageId;
         PPH_STRING packagePath;
@@ -712,6 +1560,111 @@ VERIFY_RESULT PhVerifyFileWithAdditionalCatalog(
     return result;
 }
 
+#ifdef PH_ENABLE_VERIFY_CACHE
+
+BOOLEAN NTAPI PhpVerifyInFlightEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_VERIFY_IN_FLIGHT_ENTRY entry1 = *(PPH_VERIFY_IN_FLIGHT_ENTRY *)Entry1;
+    PPH_VERIFY_IN_FLIGHT_ENTRY entry2 = *(PPH_VERIFY_IN_FLIGHT_ENTRY *)Entry2;
+
+    return PhEqualString(entry1->FileName, entry2->FileName, TRUE);
+}
+
+ULONG NTAPI PhpVerifyInFlightHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_VERIFY_IN_FLIGHT_ENTRY entry = *(PPH_VERIFY_IN_FLIGHT_ENTRY *)Entry;
+
+    return PhHashStringRef(&entry->FileName->sr, TRUE);
+}
+
+/**
+ * Registers a file as being verified.
+ *
+ * \param FileName The file name.
+ * \param Entry A variable which receives the in-flight entry for the file.
+ *
+ * \return TRUE if the caller must verify the file and then call PhpEndVerifyInFlight(),
+ * or FALSE if another thread is verifying the file. In the latter case the caller must
+ * wait for the entry's event and then dereference the entry.
+ */
+BOOLEAN PhpBeginVerifyInFlight(
+    _In_ PPH_STRING FileName,
+    _Out_ PPH_VERIFY_IN_FLIGHT_ENTRY *Entry
+    )
+{
+    PH_VERIFY_IN_FLIGHT_ENTRY lookupEntry;
+    PPH_VERIFY_IN_FLIGHT_ENTRY lookupEntryPtr = &lookupEntry;
+    PPH_VERIFY_IN_FLIGHT_ENTRY *entryPtr;
+    PPH_VERIFY_IN_FLIGHT_ENTRY entry;
+
+    lookupEntry.FileName = FileName;
+
+    PhAcquireQueuedLockExclusive(&PhpVerifyInFlightLock);
+
+    entryPtr = PhFindEntryHashtable(PhpVerifyInFlightHashtable, &lookupEntryPtr);
+
+    if (entryPtr)
+    {
+        entry = *entryPtr;
+        _InterlockedIncrement(&entry->RefCount);
+        PhReleaseQueuedLockExclusive(&PhpVerifyInFlightLock);
+
+        *Entry = entry;
+
+        return FALSE;
+    }
+
+    entry = PhAllocate(sizeof(PH_VERIFY_IN_FLIGHT_ENTRY));
+    PhSetReference(&entry->FileName, FileName);
+    entry->RefCount = 1;
+    PhInitializeEvent(&entry->CompletedEvent);
+    entry->VerifyResult = VrUnknown;
+    entry->VerifySignerName = NULL;
+    PhAddEntryHashtable(PhpVerifyInFlightHashtable, &entry);
+
+    PhReleaseQueuedLockExclusive(&PhpVerifyInFlightLock);
+
+    *Entry = entry;
+
+    return TRUE;
+}
+
+VOID PhpDereferenceVerifyInFlight(
+    _In_ PPH_VERIFY_IN_FLIGHT_ENTRY Entry
+    )
+{
+    if (_InterlockedDecrement(&Entry->RefCount) == 0)
+    {
+        PhDereferenceObject(Entry->FileName);
+        PhClearReference(&Entry->VerifySignerName);
+        PhFree(Entry);
+    }
+}
+
+VOID PhpEndVerifyInFlight(
+    _In_ PPH_VERIFY_IN_FLIGHT_ENTRY Entry,
+    _In_ VERIFY_RESULT VerifyResult,
+    _In_opt_ PPH_STRING VerifySignerName
+    )
+{
+    Entry->VerifyResult = VerifyResult;
+    PhSetReference(&Entry->VerifySignerName, VerifySignerName);
+
+    PhAcquireQueuedLockExclusive(&PhpVerifyInFlightLock);
+    PhRemoveEntryHashtable(PhpVerifyInFlightHashtable, &Entry);
+    PhReleaseQueuedLockExclusive(&PhpVerifyInFlightLock);
+
+    PhSetEvent(&Entry->CompletedEvent);
+    PhpDereferenceVerifyInFlight(Entry);
+}
+
+#endif
+
 /**
  * Verifies a file's digital signature, using a cached
  * result if possible.
@@ -740,6 +1693,18 @@ VERIFY_RESULT PhVerifyFileCached(
     PPH_VERIFY_CACHE_ENTRY entry;
     PH_VERIFY_CACHE_ENTRY lookupEntry;
 
+    if (PhBeginInitOnce(&PhpVerifyStoreInitOnce))
+    {
+        PhpVerifyInFlightHashtable = PhCreateHashtable(
+            sizeof(PPH_VERIFY_IN_FLIGHT_ENTRY),
+            PhpVerifyInFlightEqualFunction,
+            PhpVerifyInFlightHashFunction,
+            16
+            );
+        PhpLoadVerifyStore();
+        PhEndInitOnce(&PhpVerifyStoreInitOnce);
+    }
+
     lookupEntry.FileName = FileName;
 
     PhAcquireQueuedLockShared(&PhpVerifyCacheLock);
@@ -759,8 +1724,18 @@ VERIFY_RESULT PhVerifyFileCached(
     {
         VERIFY_RESULT result;
         PPH_STRING signerName;
+        PPH_VERIFY_IN_FLIGHT_ENTRY inFlightEntry = NULL;
 
-        if (!CachedOnly)
+        if (!CachedOnly && !PhpBeginVerifyInFlight(FileName, &inFlightEntry))
+        {
+            // Another thread is verifying the same file.
+            PhWaitForEvent(&inFlightEntry->CompletedEvent, NULL);
+            result = inFlightEntry->VerifyResult;
+            PhSetReference(&signerName, inFlightEntry->VerifySignerName);
+            PhpDereferenceVerifyInFlight(inFlightEntry);
+            inFlightEntry = NULL;
+        }
+        else if (!CachedOnly)
         {
             PH_VERIFY_FILE_INFO info;
 
@@ -771,6 +1746,8 @@ VERIFY_RESULT PhVerifyFileCached(
 
             if (result != VrTrusted)
                 PhClearReference(&signerName);
+            else if (signerName)
+                PhMoveReference(&signerName, PhInternString(signerName));
         }
         else
         {
@@ -797,6 +1774,9 @@ VERIFY_RESULT PhVerifyFileCached(
 
                 if (entry->VerifySignerName)
                     PhReferenceObject(entry->VerifySignerName);
+
+                if (!CachedOnly)
+                    PhpAddVerifyStoreRecord(entry->FileName, entry->VerifyResult, entry->VerifySignerName);
             }
             else
             {
@@ -805,6 +1785,10 @@ VERIFY_RESULT PhVerifyFileCached(
             }
         }
 
+        // The result is in the cache now, so new callers won't wait for the entry anymore.
+        if (inFlightEntry)
+            PhpEndVerifyInFlight(inFlightEntry, result, signerName);
+
         if (SignerName)
         {
             *SignerName = signerName;
@@ -844,6 +1828,153 @@ VERIFY_RESULT PhVerifyFileCached(
 #endif
 }
 
+NTSTATUS PhpVerifyThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PLIST_ENTRY listEntry;
+    PPH_VERIFY_REQUEST request;
+    VERIFY_RESULT result;
+    PPH_STRING signerName;
+
+    while (TRUE)
+    {
+        // The semaphore is released once for every queued request.
+        if (NtWaitForSingleObject(PhpVerifySemaphoreHandle, FALSE, NULL) != STATUS_WAIT_0)
+            break;
+
+        PhAcquireQueuedLockExclusive(&PhpVerifyQueueLock);
+
+        if (!IsListEmpty(&PhpVerifyPriorityListHead))
+            listEntry = RemoveHeadList(&PhpVerifyPriorityListHead);
+        else if (!IsListEmpty(&PhpVerifyListHead))
+            listEntry = RemoveHeadList(&PhpVerifyListHead);
+        else
+            listEntry = NULL;
+
+        if (listEntry)
+        {
+            request = CONTAINING_RECORD(listEntry, PH_VERIFY_REQUEST, ListEntry);
+
+            if (request->RequestHandle)
+                *request->RequestHandle = NULL;
+        }
+
+        PhReleaseQueuedLockExclusive(&PhpVerifyQueueLock);
+
+        if (!listEntry)
+            continue;
+
+        result = PhVerifyFileCached(
+            request->FileName,
+            PhGetString(request->PackageFullName),
+            &signerName,
+            FALSE
+            );
+        request->Callback(result, signerName, request->Context);
+
+        PhDereferenceObject(request->FileName);
+        PhClearReference(&request->PackageFullName);
+        PhFreeToFreeList(&PhpVerifyRequestFreeList, request);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Queues a file for signature verification on the verification thread pool.
+ *
+ * \param FileName The file name.
+ * \param PackageFullName The full name of the package that the file belongs to, if any.
+ * \param Callback A function which receives the result. It is called on a pool thread,
+ * and the signer name reference is passed to it.
+ * \param Context A user-defined value to pass to the callback.
+ * \param RequestHandle A variable which receives a handle for PhPrioritizeVerifyFile().
+ * The variable is cleared when verification starts, so it must remain valid until the
+ * callback is called.
+ *
+ * \remarks Visible items should be prioritized instead of being queued separately.
+ * Requests for the same file are verified only once, even from different queues.
+ */
+VOID PhQueueVerifyFile(
+    _In_ PPH_STRING FileName,
+    _In_opt_ PPH_STRING PackageFullName,
+    _In_ PPH_VERIFY_FILE_CALLBACK Callback,
+    _In_opt_ PVOID Context,
+    _Out_opt_ PVOID *RequestHandle
+    )
+{
+    PPH_VERIFY_REQUEST request;
+
+    if (PhBeginInitOnce(&PhpVerifyPoolInitOnce))
+    {
+        ULONG numberOfThreads;
+        ULONG i;
+        HANDLE threadHandle;
+
+        PhInitializeFreeList(&PhpVerifyRequestFreeList, sizeof(PH_VERIFY_REQUEST), 64);
+        InitializeListHead(&PhpVerifyPriorityListHead);
+        InitializeListHead(&PhpVerifyListHead);
+        NtCreateSemaphore(&PhpVerifySemaphoreHandle, SEMAPHORE_ALL_ACCESS, NULL, 0, MAXLONG);
+
+        numberOfThreads = min((ULONG)PhSystemBasicInformation.NumberOfProcessors, PH_VERIFY_MAXIMUM_THREADS);
+
+        for (i = 0; i < numberOfThreads; i++)
+        {
+            if (threadHandle = PhCreateThread(0, PhpVerifyThreadStart, NULL))
+                NtClose(threadHandle);
+        }
+
+        PhEndInitOnce(&PhpVerifyPoolInitOnce);
+    }
+
+    request = PhAllocateFromFreeList(&PhpVerifyRequestFreeList);
+    PhSetReference(&request->FileName, FileName);
+    PhSetReference(&request->PackageFullName, PackageFullName);
+    request->Callback = Callback;
+    request->Context = Context;
+    request->RequestHandle = RequestHandle;
+    request->Priority = FALSE;
+
+    PhAcquireQueuedLockExclusive(&PhpVerifyQueueLock);
+    InsertTailList(&PhpVerifyListHead, &request->ListEntry);
+
+    if (RequestHandle)
+        *RequestHandle = request;
+
+    PhReleaseQueuedLockExclusive(&PhpVerifyQueueLock);
+
+    NtReleaseSemaphore(PhpVerifySemaphoreHandle, 1, NULL);
+}
+
+/**
+ * Moves a pending verification request ahead of the requests that are not visible to the
+ * user.
+ *
+ * \param RequestHandle The variable that was passed to PhQueueVerifyFile().
+ */
+VOID PhPrioritizeVerifyFile(
+    _Inout_ PVOID *RequestHandle
+    )
+{
+    PPH_VERIFY_REQUEST request;
+
+    if (!*RequestHandle)
+        return;
+
+    PhAcquireQueuedLockExclusive(&PhpVerifyQueueLock);
+
+    // Re-check now that we have the lock; verification may have started already.
+    if ((request = *RequestHandle) && !request->Priority)
+    {
+        RemoveEntryList(&request->ListEntry);
+        InsertTailList(&PhpVerifyPriorityListHead, &request->ListEntry);
+        request->Priority = TRUE;
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpVerifyQueueLock);
+}
+
 VOID PhpProcessQueryStage1(
     _Inout_ PPH_PROCESS_QUERY_S1_DATA Data
     )
@@ -857,44 +1988,23 @@ VOID PhpProcessQueryStage1(
 
     if (processItem->FileName)
     {
-        // Small icon, large icon.
-        if (ExtractIconEx(
-            processItem->FileName->Buffer,
-            0,
-            &Data->LargeIcon,
-            &Data->SmallIcon,
-            1
-            ) == 0)
+        // Small icon, large icon, version info. These are shared with other processes running
+        // the same image.
+        if (Data->ImageCacheEntry = PhReferenceImageCacheEntry(processItem->FileName))
         {
-            Data->LargeIcon = NULL;
-            Data->SmallIcon = NULL;
+            PhGetImageCacheEntryIcons(Data->ImageCacheEntry, &Data->SmallIcon, &Data->LargeIcon);
+            PhGetImageCacheEntryVersionInfo(Data->ImageCacheEntry, &Data->VersionInfo);
         }
-
-        // Version info.
-        PhInitializeImageVersionInfo(&Data->VersionInfo, processItem->FileName->Buffer);
-    }
-
-    // Use the default EXE icon if we didn't get the file's icon.
-    {
-        if (!Data->SmallIcon || !Data->LargeIcon)
+        else
         {
-            if (Data->SmallIcon)
-            {
-                DestroyIcon(Data->SmallIcon);
-                Data->SmallIcon = NULL;
-            }
-            else if (Data->LargeIcon)
-            {
-                DestroyIcon(Data->LargeIcon);
-                Data->LargeIcon = NULL;
-            }
-
-            PhGetStockApplicationIcon(&Data->SmallIcon, &Data->LargeIcon);
-            Data->SmallIcon = DuplicateIcon(NULL, Data->SmallIcon);
-            Data->LargeIcon = DuplicateIcon(NULL, Data->LargeIcon);
+            PhInitializeImageVersionInfo(&Data->VersionInfo, processItem->FileName->Buffer);
         }
     }
 
+    // Use the default EXE icon if we didn't get the file's icon.
+    if (!Data->SmallIcon || !Data->LargeIcon)
+        PhGetStockApplicationIcon(&Data->SmallIcon, &Data->LargeIcon);
+
 #ifdef _WIN64
     // WOW64
     if (processHandleLimited)
@@ -998,21 +2108,27 @@ VOID PhpProcessQueryStage1(
 
             if (NT_SUCCESS(status))
             {
-                // Elevation
-                if (NT_SUCCESS(PhGetTokenElevationType(
+                PH_TOKEN_CACHE_INFORMATION tokenInformation;
+
+                PhQueryTokenCache(
                     tokenHandle,
-                    &Data->ElevationType
-                    )))
+                    PH_TOKEN_CACHE_ELEVATION | PH_TOKEN_CACHE_INTEGRITY,
+                    &tokenInformation
+                    );
+
+                // Elevation
+                if (tokenInformation.ValidFields & PH_TOKEN_CACHE_ELEVATION)
                 {
+                    Data->ElevationType = tokenInformation.ElevationType;
                     Data->IsElevated = Data->ElevationType == TokenElevationTypeFull;
                 }
 
                 // Integrity
-                PhGetTokenIntegrityLevel(
-                    tokenHandle,
-                    &Data->IntegrityLevel,
-                    &Data->IntegrityString
-                    );
+                if (tokenInformation.ValidFields & PH_TOKEN_CACHE_INTEGRITY)
+                {
+                    Data->IntegrityLevel = tokenInformation.IntegrityLevel;
+                    Data->IntegrityString = tokenInformation.IntegrityString;
+                }
 
                 NtClose(tokenHandle);
             }
@@ -1147,7 +2263,10 @@ NTSTATUS PhpProcessQueryStage1Worker(
     data->Header.Stage = 1;
     data->Header.ProcessItem = processItem;
 
-    PhpProcessQueryStage1(data);
+    // Short-lived processes may have exited while the query was queued. Don't waste time
+    // querying them; the empty data is still posted so that Stage1Event gets set.
+    if (!(processItem->State & PH_PROCESS_ITEM_REMOVED))
+        PhpProcessQueryStage1(data);
 
     RtlInterlockedPushEntrySList(&PhProcessQueryDataListHead, &data->Header.ListEntry);
 
@@ -1166,22 +2285,164 @@ NTSTATUS PhpProcessQueryStage2Worker(
     data->Header.Stage = 2;
     data->Header.ProcessItem = processItem;
 
-    PhpProcessQueryStage2(data);
+    if (!(processItem->State & PH_PROCESS_ITEM_REMOVED))
+        PhpProcessQueryStage2(data);
 
     RtlInterlockedPushEntrySList(&PhProcessQueryDataListHead, &data->Header.ListEntry);
 
     return STATUS_SUCCESS;
 }
 
-VOID PhpQueueProcessQueryStage1(
-    _In_ PPH_PROCESS_ITEM ProcessItem
+PPH_PROCESS_QUERY_ITEM PhpStealProcessQueryItem(
+    _In_ ULONG DequeIndex,
+    _In_ BOOLEAN Priority
     )
 {
-    // Ref: dereferenced when the provider update function removes the item from
-    // the queue.
-    PhReferenceObject(ProcessItem);
-    PhQueueItemGlobalWorkQueue(PhpProcessQueryStage1Worker, ProcessItem);
-}
+    PPH_PROCESS_QUERY_DEQUE deque;
+    PLIST_ENTRY listHead;
+    PLIST_ENTRY listEntry;
+    ULONG i;
+
+    // Try our own deque first, taking from the head. Other deques are robbed from the tail so
+    // that we don't contend with their owners.
+
+    for (i = 0; i < PhpProcessQueryNumberOfThreads; i++)
+    {
+        deque = &PhpProcessQueryDeques[(DequeIndex + i) % PhpProcessQueryNumberOfThreads];
+        listHead = Priority ? &deque->PriorityListHead : &deque->ListHead;
+
+        if (IsListEmpty(listHead))
+            continue;
+
+        PhAcquireQueuedLockExclusive(&deque->Lock);
+
+        if (i == 0)
+            listEntry = RemoveHeadList(listHead);
+        else
+            listEntry = RemoveTailList(listHead);
+
+        if (listEntry != listHead)
+        {
+            PPH_PROCESS_QUERY_ITEM queryItem;
+
+            queryItem = CONTAINING_RECORD(listEntry, PH_PROCESS_QUERY_ITEM, ListEntry);
+
+            if (queryItem->ProcessItem->QueryItem == queryItem)
+                queryItem->ProcessItem->QueryItem = NULL;
+
+            PhReleaseQueuedLockExclusive(&deque->Lock);
+
+            return queryItem;
+        }
+
+        PhReleaseQueuedLockExclusive(&deque->Lock);
+    }
+
+    return NULL;
+}
+
+NTSTATUS PhpProcessQueryThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    ULONG dequeIndex = PtrToUlong(Parameter);
+    PPH_PROCESS_QUERY_ITEM queryItem;
+    PPH_PROCESS_ITEM processItem;
+    ULONG stage;
+
+    while (TRUE)
+    {
+        // The semaphore is released once for every queued item, so there is always at least
+        // one item for us in some deque.
+        if (NtWaitForSingleObject(PhpProcessQuerySemaphoreHandle, FALSE, NULL) != STATUS_WAIT_0)
+            break;
+
+        if (!(queryItem = PhpStealProcessQueryItem(dequeIndex, TRUE)))
+            queryItem = PhpStealProcessQueryItem(dequeIndex, FALSE);
+
+        if (!queryItem)
+            continue;
+
+        processItem = queryItem->ProcessItem;
+        stage = queryItem->Stage;
+        PhFreeToFreeList(&PhpProcessQueryItemFreeList, queryItem);
+
+        if (stage == 1)
+            PhpProcessQueryStage1Worker(processItem);
+        else
+            PhpProcessQueryStage2Worker(processItem);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID PhpQueueProcessQuery(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Stage
+    )
+{
+    PPH_PROCESS_QUERY_ITEM queryItem;
+    PPH_PROCESS_QUERY_DEQUE deque;
+    ULONG dequeIndex;
+
+    if (PhBeginInitOnce(&PhpProcessQueryPoolInitOnce))
+    {
+        ULONG i;
+        HANDLE threadHandle;
+
+        PhInitializeFreeList(&PhpProcessQueryItemFreeList, sizeof(PH_PROCESS_QUERY_ITEM), 64);
+        NtCreateSemaphore(&PhpProcessQuerySemaphoreHandle, SEMAPHORE_ALL_ACCESS, NULL, 0, MAXLONG);
+
+        PhpProcessQueryNumberOfThreads = min((ULONG)PhSystemBasicInformation.NumberOfProcessors, PH_PROCESS_QUERY_MAXIMUM_THREADS);
+
+        for (i = 0; i < PhpProcessQueryNumberOfThreads; i++)
+        {
+            PhInitializeQueuedLock(&PhpProcessQueryDeques[i].Lock);
+            InitializeListHead(&PhpProcessQueryDeques[i].PriorityListHead);
+            InitializeListHead(&PhpProcessQueryDeques[i].ListHead);
+        }
+
+        for (i = 0; i < PhpProcessQueryNumberOfThreads; i++)
+        {
+            if (threadHandle = PhCreateThread(0, PhpProcessQueryThreadStart, UlongToPtr(i)))
+                NtClose(threadHandle);
+        }
+
+        PhEndInitOnce(&PhpProcessQueryPoolInitOnce);
+    }
+
+    queryItem = PhAllocateFromFreeList(&PhpProcessQueryItemFreeList);
+    queryItem->ProcessItem = ProcessItem;
+    queryItem->Stage = Stage;
+
+    // Spread the items over the deques. Idle threads steal from the others.
+    dequeIndex = (ULONG)_InterlockedIncrement(&PhpProcessQueryNextDeque) % PhpProcessQueryNumberOfThreads;
+    deque = &PhpProcessQueryDeques[dequeIndex];
+
+    PhAcquireQueuedLockExclusive(&deque->Lock);
+
+    InsertTailList(&deque->ListHead, &queryItem->ListEntry);
+
+    if (Stage == 1)
+    {
+        ProcessItem->QueryDequeIndex = dequeIndex;
+        ProcessItem->QueryItem = queryItem;
+    }
+
+    PhReleaseQueuedLockExclusive(&deque->Lock);
+
+    NtReleaseSemaphore(PhpProcessQuerySemaphoreHandle, 1, NULL);
+}
+
+VOID PhpQueueProcessQueryStage1(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    // Ref: dereferenced when the provider update function removes the item from
+    // the queue.
+    PhReferenceObject(ProcessItem);
+    PhpQueueProcessQuery(ProcessItem, 1);
+}
 
 VOID PhpQueueProcessQueryStage2(
     _In_ PPH_PROCESS_ITEM ProcessItem
@@ -1190,8 +2451,39 @@ VOID PhpQueueProcessQueryStage2(
     if (PhEnableProcessQueryStage2)
     {
         PhReferenceObject(ProcessItem);
-        PhQueueItemGlobalWorkQueue(PhpProcessQueryStage2Worker, ProcessItem);
+        PhpQueueProcessQuery(ProcessItem, 2);
+    }
+}
+
+/**
+ * Moves a pending stage 1 query for a process item to the front of the queue. This is used for
+ * process items that are visible to the user.
+ *
+ * \param ProcessItem A process item.
+ */
+VOID PhPrioritizeProcessItemQuery(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    PPH_PROCESS_QUERY_DEQUE deque;
+    PPH_PROCESS_QUERY_ITEM queryItem;
+
+    if (!ProcessItem->QueryItem)
+        return;
+
+    deque = &PhpProcessQueryDeques[ProcessItem->QueryDequeIndex];
+
+    PhAcquireQueuedLockExclusive(&deque->Lock);
+
+    // Re-check now that we have the lock; the query may have started already.
+    if (queryItem = ProcessItem->QueryItem)
+    {
+        RemoveEntryList(&queryItem->ListEntry);
+        InsertTailList(&deque->PriorityListHead, &queryItem->ListEntry);
+        ProcessItem->QueryItem = NULL;
     }
+
+    PhReleaseQueuedLockExclusive(&deque->Lock);
 }
 
 VOID PhpFillProcessItemStage1(
@@ -1201,6 +2493,7 @@ VOID PhpFillProcessItemStage1(
     PPH_PROCESS_ITEM processItem = Data->Header.ProcessItem;
 
     processItem->CommandLine = Data->CommandLine;
+    processItem->ImageCacheEntry = Data->ImageCacheEntry;
     processItem->SmallIcon = Data->SmallIcon;
     processItem->LargeIcon = Data->LargeIcon;
     memcpy(&processItem->VersionInfo, &Data->VersionInfo, sizeof(PH_IMAGE_VERSION_INFO));
@@ -1254,6 +2547,10 @@ VOID PhpFillProcessItem(
     PhPrintUInt32(ProcessItem->ParentProcessIdString, HandleToUlong(ProcessItem->ParentProcessId));
     PhPrintUInt32(ProcessItem->SessionIdString, ProcessItem->SessionId);
 
+    // A replayed process ID may belong to an unrelated process on this system.
+    if (PhProviderReplayActive)
+        return;
+
     PhOpenProcess(&processHandle, ProcessQueryAccess, ProcessItem->ProcessId);
 
     // Process information
@@ -1301,6 +2598,10 @@ VOID PhpFillProcessItem(
                 PhDereferenceObject(fileName);
             }
         }
+
+        // Many processes share the same image (svchost.exe, conhost.exe, ...).
+        if (ProcessItem->FileName)
+            PhMoveReference(&ProcessItem->FileName, PhInternString(ProcessItem->FileName));
     }
 
     // Token-related information
@@ -1315,18 +2616,11 @@ VOID PhpFillProcessItem(
 
         if (NT_SUCCESS(status))
         {
-            // User name
-            {
-                PTOKEN_USER user;
-
-                status = PhGetTokenUser(tokenHandle, &user);
+            PH_TOKEN_CACHE_INFORMATION tokenInformation;
 
-                if (NT_SUCCESS(status))
-                {
-                    ProcessItem->UserName = PhGetSidFullName(user->User.Sid, TRUE, NULL);
-                    PhFree(user);
-                }
-            }
+            // User name
+            PhQueryTokenCache(tokenHandle, PH_TOKEN_CACHE_USER, &tokenInformation);
+            ProcessItem->UserName = tokenInformation.UserName;
 
             NtClose(tokenHandle);
         }
@@ -1371,17 +2665,84 @@ VOID PhpFillProcessItem(
         }
     }
 
+    if (ProcessItem->UserName)
+        PhMoveReference(&ProcessItem->UserName, PhInternString(ProcessItem->UserName));
+
     NtClose(processHandle);
 }
 
-FORCEINLINE VOID PhpUpdateDynamicInfoProcessItem(
+static VOID PhpUpdateThreadStatesProcessItem(
     _Inout_ PPH_PROCESS_ITEM ProcessItem,
     _In_ PSYSTEM_PROCESS_INFORMATION Process
     )
+{
+    ULONG waitReasonCounts[MaximumWaitReason];
+    ULONG running = 0;
+    ULONG ready = 0;
+    ULONG waiting = 0;
+    KWAIT_REASON topWaitReason = MaximumWaitReason;
+    ULONG topWaitReasonCount = 0;
+    ULONG i;
+
+    memset(waitReasonCounts, 0, sizeof(waitReasonCounts));
+
+    for (i = 0; i < Process->NumberOfThreads; i++)
+    {
+        PSYSTEM_THREAD_INFORMATION thread = &Process->Threads[i];
+
+        switch (thread->ThreadState)
+        {
+        case Running:
+            running++;
+            break;
+        case Ready:
+        case Standby:
+        case DeferredReady:
+            // The thread is runnable but is not on a processor.
+            ready++;
+            break;
+        case Waiting:
+            waiting++;
+
+            if ((ULONG)thread->WaitReason < MaximumWaitReason)
+                waitReasonCounts[thread->WaitReason]++;
+
+            break;
+        }
+    }
+
+    if (waiting != 0)
+    {
+        for (i = 0; i < MaximumWaitReason; i++)
+        {
+            if (topWaitReasonCount < waitReasonCounts[i])
+            {
+                topWaitReason = i;
+                topWaitReasonCount = waitReasonCounts[i];
+            }
+        }
+    }
+
+    ProcessItem->RunningThreadCount = running;
+    ProcessItem->ReadyThreadCount = ready;
+    ProcessItem->WaitingThreadCount = waiting;
+    ProcessItem->TopWaitReason = topWaitReason;
+    ProcessItem->TopWaitReasonCount = topWaitReasonCount;
+}
+
+FORCEINLINE VOID PhpUpdateDynamicInfoProcessItem(
+    _Inout_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PSYSTEM_PROCESS_INFORMATION Process,
+    _In_opt_ PPH_PROCESS_SNAPSHOT_ENTRY SnapshotEntry
+    )
 {
     ProcessItem->BasePriority = Process->BasePriority;
 
-    if (ProcessItem->QueryHandle)
+    if (SnapshotEntry && SnapshotEntry->PriorityClassValid)
+    {
+        ProcessItem->PriorityClass = SnapshotEntry->PriorityClass;
+    }
+    else if (ProcessItem->QueryHandle)
     {
         PROCESS_PRIORITY_CLASS priorityClass;
 
@@ -1412,24 +2773,135 @@ FORCEINLINE VOID PhpUpdateDynamicInfoProcessItem(
     // Update VM and I/O counters.
     ProcessItem->VmCounters = *(PVM_COUNTERS_EX)&Process->PeakVirtualSize;
     ProcessItem->IoCounters = *(PIO_COUNTERS)&Process->ReadOperationCount;
+
+    PhpUpdateThreadStatesProcessItem(ProcessItem, Process);
+}
+
+/**
+ * Copies the values used by the top process lists and the process tree sort keys into the hot
+ * record of a process item. This must be called after the deltas and CPU usage have been updated.
+ *
+ * \param ProcessItem The process item.
+ * \param RunId The current run of the process provider plus one, or zero if the values are not
+ * valid deltas yet and the item should be left out of the top process lists.
+ */
+FORCEINLINE VOID PhpUpdateHotDataProcessItem(
+    _Inout_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG RunId
+    )
+{
+    PPH_PROCESS_HOT_DATA hotData = ProcessItem->HotData;
+
+    hotData->RunId = RunId;
+    hotData->CpuUsage = ProcessItem->CpuUsage;
+    hotData->NumberOfHandles = ProcessItem->NumberOfHandles;
+    hotData->UserTime = ProcessItem->UserTime.QuadPart;
+    hotData->IoDelta = ProcessItem->IoReadDelta.Delta + ProcessItem->IoWriteDelta.Delta + ProcessItem->IoOtherDelta.Delta;
+    hotData->IoValue = ProcessItem->IoReadDelta.Value + ProcessItem->IoWriteDelta.Value + ProcessItem->IoOtherDelta.Value;
+    hotData->PagefileUsage = ProcessItem->VmCounters.PagefileUsage;
+    hotData->WorkingSetSize = ProcessItem->VmCounters.WorkingSetSize;
 }
 
 VOID PhpUpdatePerfInformation(
     VOID
     )
 {
-    NtQuerySystemInformation(
-        SystemPerformanceInformation,
-        &PhPerfInformation,
-        sizeof(SYSTEM_PERFORMANCE_INFORMATION),
-        NULL
-        );
+    // When replaying, PhPerfInformation has already been read from the capture.
+    if (!PhProviderReplayActive)
+    {
+        NtQuerySystemInformation(
+            SystemPerformanceInformation,
+            &PhPerfInformation,
+            sizeof(SYSTEM_PERFORMANCE_INFORMATION),
+            NULL
+            );
+    }
 
     PhUpdateDelta(&PhIoReadDelta, PhPerfInformation.IoReadTransferCount.QuadPart);
     PhUpdateDelta(&PhIoWriteDelta, PhPerfInformation.IoWriteTransferCount.QuadPart);
     PhUpdateDelta(&PhIoOtherDelta, PhPerfInformation.IoOtherTransferCount.QuadPart);
 }
 
+/**
+ * Queries per-processor information for every processor group.
+ *
+ * \param SystemInformationClass The information class.
+ * \param Buffer A buffer with room for PhNumberOfProcessors entries. The entries for each
+ * group are stored after those of the previous group, matching PhProcessorLocations.
+ * \param EntrySize The size of each entry.
+ */
+VOID PhpQueryProcessorInformation(
+    _In_ SYSTEM_INFORMATION_CLASS SystemInformationClass,
+    _Out_ PVOID Buffer,
+    _In_ ULONG EntrySize
+    )
+{
+    USHORT group;
+    ULONG offset;
+
+    if (PhNumberOfProcessorGroups == 1)
+    {
+        NtQuerySystemInformation(SystemInformationClass, Buffer, EntrySize * PhNumberOfProcessors, NULL);
+        return;
+    }
+
+    offset = 0;
+
+    for (group = 0; group < PhNumberOfProcessorGroups; group++)
+    {
+        if (!NT_SUCCESS(PhQuerySystemInformationForGroup(
+            SystemInformationClass,
+            group,
+            PTR_ADD_OFFSET(Buffer, EntrySize * offset),
+            EntrySize * PhpProcessorGroupCounts[group],
+            NULL
+            )))
+        {
+            memset(PTR_ADD_OFFSET(Buffer, EntrySize * offset), 0, EntrySize * PhpProcessorGroupCounts[group]);
+        }
+
+        offset += PhpProcessorGroupCounts[group];
+    }
+}
+
+/**
+ * Calculates the CPU usage of each NUMA node from the per-processor deltas.
+ */
+VOID PhpUpdateNodeCpuUsage(
+    VOID
+    )
+{
+    ULONG i;
+    ULONG node;
+    ULONG64 totalTime;
+
+    memset(PhpNodesDelta, 0, sizeof(ULONG64) * PhNumberOfNumaNodes * 3);
+
+    for (i = 0; i < PhNumberOfProcessors; i++)
+    {
+        node = PhProcessorLocations[i].Node;
+        PhpNodesDelta[node * 3] += PhCpusKernelDelta[i].Delta;
+        PhpNodesDelta[node * 3 + 1] += PhCpusUserDelta[i].Delta;
+        PhpNodesDelta[node * 3 + 2] += PhCpusIdleDelta[i].Delta;
+    }
+
+    for (node = 0; node < PhNumberOfNumaNodes; node++)
+    {
+        totalTime = PhpNodesDelta[node * 3] + PhpNodesDelta[node * 3 + 1] + PhpNodesDelta[node * 3 + 2];
+
+        if (totalTime != 0)
+        {
+            PhNodesKernelUsage[node] = (FLOAT)PhpNodesDelta[node * 3] / totalTime;
+            PhNodesUserUsage[node] = (FLOAT)PhpNodesDelta[node * 3 + 1] / totalTime;
+        }
+        else
+        {
+            PhNodesKernelUsage[node] = 0;
+            PhNodesUserUsage[node] = 0;
+        }
+    }
+}
+
 VOID PhpUpdateCpuInformation(
     _In_ BOOLEAN SetCpuUsage,
     _Out_ PULONG64 TotalTime
@@ -1438,17 +2910,23 @@ VOID PhpUpdateCpuInformation(
     ULONG i;
     ULONG64 totalTime;
 
-    NtQuerySystemInformation(
-        SystemProcessorPerformanceInformation,
-        PhCpuInformation,
-        sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION) * (ULONG)PhSystemBasicInformation.NumberOfProcessors,
-        NULL
-        );
+    // When replaying, PhCpuInformation has already been read from the capture.
+    if (!PhProviderReplayActive)
+    {
+        PhpQueryProcessorInformation(
+            SystemProcessorPerformanceInformation,
+            PhCpuInformation,
+            sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION)
+            );
+
+        if (PhProviderCaptureActive)
+            PhCaptureProcessorInformation(PhCpuInformation, PhNumberOfProcessors);
+    }
 
     // Zero the CPU totals.
     memset(&PhCpuTotals, 0, sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION));
 
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
         PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION cpuInfo =
             &PhCpuInformation[i];
@@ -1485,6 +2963,9 @@ VOID PhpUpdateCpuInformation(
         }
     }
 
+    if (SetCpuUsage)
+        PhpUpdateNodeCpuUsage();
+
     PhUpdateDelta(&PhCpuKernelDelta, PhCpuTotals.KernelTime.QuadPart);
     PhUpdateDelta(&PhCpuUserDelta, PhCpuTotals.UserTime.QuadPart);
     PhUpdateDelta(&PhCpuIdleDelta, PhCpuTotals.IdleTime.QuadPart);
@@ -1519,16 +3000,15 @@ VOID PhpUpdateCpuCycleInformation(
     // We need to query this separately because the idle cycle time in SYSTEM_PROCESS_INFORMATION
     // doesn't give us data for individual processors.
 
-    NtQuerySystemInformation(
+    PhpQueryProcessorInformation(
         SystemProcessorIdleCycleTimeInformation,
         PhCpuIdleCycleTime,
-        sizeof(LARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors,
-        NULL
+        sizeof(LARGE_INTEGER)
         );
 
     total = 0;
 
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
         //PhUpdateDelta(&PhCpusIdleCycleDelta[i], PhCpuIdleCycleTime[i].QuadPart);
         total += PhCpuIdleCycleTime[i].QuadPart;
@@ -1539,16 +3019,15 @@ VOID PhpUpdateCpuCycleInformation(
 
     // System
 
-    NtQuerySystemInformation(
+    PhpQueryProcessorInformation(
         SystemProcessorCycleTimeInformation,
         PhCpuSystemCycleTime,
-        sizeof(LARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors,
-        NULL
+        sizeof(LARGE_INTEGER)
         );
 
     total = 0;
 
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
         total += PhCpuSystemCycleTime[i].QuadPart;
     }
@@ -1610,7 +3089,7 @@ VOID PhpUpdateCpuCycleUsageInformation(
         PhCpuUserUsage = baseCpuUsage / 2;
     }
 
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
         totalTime = PhCpusKernelDelta[i].Delta + PhCpusUserDelta[i].Delta + PhCpusIdleDelta[i].Delta;
 
@@ -1632,6 +3111,7 @@ VOID PhpInitializeProcessStatistics(
     )
 {
     ULONG i;
+    PPH_CIRCULAR_BUFFER_TIER_FLOAT tierBuffer;
 
     PhInitializeCircularBuffer_ULONG(&PhTimeHistory, PhStatisticsSampleCount);
     PhInitializeCircularBuffer_FLOAT(&PhCpuKernelHistory, PhStatisticsSampleCount);
@@ -1649,11 +3129,29 @@ VOID PhpInitializeProcessStatistics(
     PhInitializeCircularBuffer_ULONG64(&PhMaxIoWriteHistory, PhStatisticsSampleCount);
 #endif
 
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
         PhInitializeCircularBuffer_FLOAT(&PhCpusKernelHistory[i], PhStatisticsSampleCount);
         PhInitializeCircularBuffer_FLOAT(&PhCpusUserHistory[i], PhStatisticsSampleCount);
     }
+
+    PhInitializeCircularBufferTier_ULONG(&PhTimeHistoryTier, PhStatisticsBucketSize, PhStatisticsBucketCount);
+    PhInitializeCircularBufferTier_FLOAT(&PhCpuKernelHistoryTier, PhStatisticsBucketSize, PhStatisticsBucketCount);
+    PhInitializeCircularBufferTier_FLOAT(&PhCpuUserHistoryTier, PhStatisticsBucketSize, PhStatisticsBucketCount);
+
+    tierBuffer = PhAllocate(
+        sizeof(PH_CIRCULAR_BUFFER_TIER_FLOAT) *
+        PhNumberOfProcessors *
+        2
+        );
+    PhCpusKernelHistoryTier = tierBuffer;
+    PhCpusUserHistoryTier = PhCpusKernelHistoryTier + PhNumberOfProcessors;
+
+    for (i = 0; i < PhNumberOfProcessors; i++)
+    {
+        PhInitializeCircularBufferTier_FLOAT(&PhCpusKernelHistoryTier[i], PhStatisticsBucketSize, PhStatisticsBucketCount);
+        PhInitializeCircularBufferTier_FLOAT(&PhCpusUserHistoryTier[i], PhStatisticsBucketSize, PhStatisticsBucketCount);
+    }
 }
 
 VOID PhpUpdateSystemHistory(
@@ -1665,14 +3163,14 @@ VOID PhpUpdateSystemHistory(
     ULONG secondsSince1980;
 
     // CPU
-    PhAddItemCircularBuffer_FLOAT(&PhCpuKernelHistory, PhCpuKernelUsage);
-    PhAddItemCircularBuffer_FLOAT(&PhCpuUserHistory, PhCpuUserUsage);
+    PhAddItemCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier, PhCpuKernelUsage);
+    PhAddItemCircularBufferTiered_FLOAT(&PhCpuUserHistory, &PhCpuUserHistoryTier, PhCpuUserUsage);
 
     // CPUs
-    for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+    for (i = 0; i < PhNumberOfProcessors; i++)
     {
-        PhAddItemCircularBuffer_FLOAT(&PhCpusKernelHistory[i], PhCpusKernelUsage[i]);
-        PhAddItemCircularBuffer_FLOAT(&PhCpusUserHistory[i], PhCpusUserUsage[i]);
+        PhAddItemCircularBufferTiered_FLOAT(&PhCpusKernelHistory[i], &PhCpusKernelHistoryTier[i], PhCpusKernelUsage[i]);
+        PhAddItemCircularBufferTiered_FLOAT(&PhCpusUserHistory[i], &PhCpusUserHistoryTier[i], PhCpusUserUsage[i]);
     }
 
     // I/O
@@ -1689,71 +3187,788 @@ VOID PhpUpdateSystemHistory(
     // Time
     PhQuerySystemTime(&systemTime);
     RtlTimeToSecondsSince1980(&systemTime, &secondsSince1980);
-    PhAddItemCircularBuffer_ULONG(&PhTimeHistory, secondsSince1980);
+    PhAddItemCircularBufferTiered_ULONG(&PhTimeHistory, &PhTimeHistoryTier, secondsSince1980);
+
+    // Any cached graph samples are now out of date.
+    PhpSystemGraphRunId++;
 }
 
-/**
- * Retrieves a time value recorded by the statistics system.
- *
- * \param ProcessItem A process item to synchronize with, or NULL if
- * no synchronization is necessary.
- * \param Index The history index.
- * \param Time A variable which receives the time at \a Index.
- *
- * \return TRUE if the function succeeded, otherwise FALSE if
- * \a ProcessItem was specified and \a Index is too far into the
- * past for that process item.
- */
-BOOLEAN PhGetStatisticsTime(
-    _In_opt_ PPH_PROCESS_ITEM ProcessItem,
-    _In_ ULONG Index,
-    _Out_ PLARGE_INTEGER Time
+VOID PhpAllocateProcessHistory(
+    _Inout_ PPH_PROCESS_ITEM ProcessItem
     )
 {
-    ULONG secondsSince1980;
-    ULONG index;
-    LARGE_INTEGER time;
+    ULONG slot;
 
-    if (ProcessItem)
-    {
-        // The sequence number is used to synchronize statistics when a process exits, since
-        // that process' history is not updated anymore.
-        index = PhTimeSequenceNumber - ProcessItem->SequenceNumber + Index;
+    PhAcquireQueuedLockExclusive(&PhpProcessHistoryLock);
 
-        if (index >= PhTimeHistory.Count)
-        {
-            // The data point is too far into the past.
-            return FALSE;
-        }
-    }
-    else
+    if (PhpFreeProcessHistorySlots->Count == 0)
     {
-        // Assume the index is valid.
-        index = Index;
+        PPH_PROCESS_HISTORY_CHUNK chunk;
+        ULONG i;
+
+        chunk = PhAllocate(sizeof(PH_PROCESS_HISTORY_CHUNK));
+        chunk->BaseSlot = PhpProcessHistoryChunks->Count * PH_PROCESS_HISTORY_CHUNK_SLOTS;
+        PhInitializeCircularBufferSlab_USHORT(&chunk->CpuKernelHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_USHORT(&chunk->CpuUserHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_FLOAT(&chunk->IoReadHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_FLOAT(&chunk->IoWriteHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_FLOAT(&chunk->IoOtherHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_ULONG(&chunk->PrivatePagesHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_USHORT(&chunk->RunningThreadsHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_USHORT(&chunk->ReadyThreadsHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_USHORT(&chunk->WaitingThreadsHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhInitializeCircularBufferSlab_USHORT(&chunk->TopWaitReasonHistory, PhpProcessHistorySize, PH_PROCESS_HISTORY_CHUNK_SLOTS);
+        PhAddItemList(PhpProcessHistoryChunks, chunk);
+
+        // Add the slots in reverse order so that they are handed out sequentially.
+        for (i = PH_PROCESS_HISTORY_CHUNK_SLOTS; i != 0; i--)
+            PhAddItemList(PhpFreeProcessHistorySlots, UlongToPtr(chunk->BaseSlot + i - 1));
     }
 
-    secondsSince1980 = PhGetItemCircularBuffer_ULONG(&PhTimeHistory, index);
-    RtlSecondsSince1980ToTime(secondsSince1980, &time);
+    slot = PtrToUlong(PhpFreeProcessHistorySlots->Items[PhpFreeProcessHistorySlots->Count - 1]);
+    PhpFreeProcessHistorySlots->Count--;
+    ProcessItem->HistoryChunk = PhpProcessHistoryChunks->Items[slot / PH_PROCESS_HISTORY_CHUNK_SLOTS];
 
-    *Time = time;
+    PhReleaseQueuedLockExclusive(&PhpProcessHistoryLock);
 
-    return TRUE;
+    ProcessItem->HistorySlot.Slot = slot % PH_PROCESS_HISTORY_CHUNK_SLOTS;
+    ProcessItem->HistorySlot.Count = 0;
+    ProcessItem->HistorySlot.Index = 0;
+
+    ProcessItem->HotData = &ProcessItem->HistoryChunk->HotData[ProcessItem->HistorySlot.Slot];
+    memset(ProcessItem->HotData, 0, sizeof(PH_PROCESS_HOT_DATA));
 }
 
-PPH_STRING PhGetStatisticsTimeString(
-    _In_opt_ PPH_PROCESS_ITEM ProcessItem,
-    _In_ ULONG Index
+VOID PhpFreeProcessHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem
     )
 {
-    LARGE_INTEGER time;
-    SYSTEMTIME systemTime;
+    PhAcquireQueuedLockExclusive(&PhpProcessHistoryLock);
+    PhAddItemList(PhpFreeProcessHistorySlots, UlongToPtr(ProcessItem->HistoryChunk->BaseSlot + ProcessItem->HistorySlot.Slot));
+    PhReleaseQueuedLockExclusive(&PhpProcessHistoryLock);
+}
 
-    if (PhGetStatisticsTime(ProcessItem, Index, &time))
-    {
-        PhLargeIntegerToLocalSystemTime(&systemTime, &time);
+FORCEINLINE USHORT PhpCpuUsageToHistory(
+    _In_ FLOAT Usage
+    )
+{
+    if (Usage <= 0)
+        return 0;
+    if (Usage >= 1)
+        return (USHORT)PH_PROCESS_HISTORY_CPU_SCALE;
 
-        return PhFormatDateTime(&systemTime);
-    }
+    return (USHORT)(Usage * PH_PROCESS_HISTORY_CPU_SCALE + 0.5f);
+}
+
+FORCEINLINE USHORT PhpThreadCountToHistory(
+    _In_ ULONG Count
+    )
+{
+    return Count < USHRT_MAX ? (USHORT)Count : USHRT_MAX;
+}
+
+VOID PhpAddProcessHistory(
+    _Inout_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    PPH_CIRCULAR_BUFFER_SLOT slot = &ProcessItem->HistorySlot;
+
+    PhAdvanceCircularBufferSlot(slot, PhpProcessHistorySize, PhpProcessHistoryIndex);
+
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->CpuKernelHistory, slot, PhpCpuUsageToHistory(ProcessItem->CpuKernelUsage));
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->CpuUserHistory, slot, PhpCpuUsageToHistory(ProcessItem->CpuUserUsage));
+    PhSetNewestItemCircularBufferSlab_FLOAT(&chunk->IoReadHistory, slot, (FLOAT)ProcessItem->IoReadDelta.Delta);
+    PhSetNewestItemCircularBufferSlab_FLOAT(&chunk->IoWriteHistory, slot, (FLOAT)ProcessItem->IoWriteDelta.Delta);
+    PhSetNewestItemCircularBufferSlab_FLOAT(&chunk->IoOtherHistory, slot, (FLOAT)ProcessItem->IoOtherDelta.Delta);
+    PhSetNewestItemCircularBufferSlab_ULONG(&chunk->PrivatePagesHistory, slot, (ULONG)(ProcessItem->VmCounters.PagefileUsage / PAGE_SIZE));
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->RunningThreadsHistory, slot, PhpThreadCountToHistory(ProcessItem->RunningThreadCount));
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->ReadyThreadsHistory, slot, PhpThreadCountToHistory(ProcessItem->ReadyThreadCount));
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->WaitingThreadsHistory, slot, PhpThreadCountToHistory(ProcessItem->WaitingThreadCount));
+    PhSetNewestItemCircularBufferSlab_USHORT(&chunk->TopWaitReasonHistory, slot, (USHORT)ProcessItem->TopWaitReason);
+}
+
+/**
+ * Retrieves a CPU usage value recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Index The history index.
+ * \param KernelUsage A variable which receives the kernel CPU usage.
+ * \param UserUsage A variable which receives the user CPU usage.
+ */
+VOID PhGetProcessItemCpuHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PFLOAT KernelUsage,
+    _Out_opt_ PFLOAT UserUsage
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+
+    if (KernelUsage)
+        *KernelUsage = PhGetItemCircularBufferSlab_USHORT(&chunk->CpuKernelHistory, &ProcessItem->HistorySlot, Index) / PH_PROCESS_HISTORY_CPU_SCALE;
+    if (UserUsage)
+        *UserUsage = PhGetItemCircularBufferSlab_USHORT(&chunk->CpuUserHistory, &ProcessItem->HistorySlot, Index) / PH_PROCESS_HISTORY_CPU_SCALE;
+}
+
+/**
+ * Retrieves I/O deltas recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Index The history index.
+ * \param ReadDelta A variable which receives the number of bytes read.
+ * \param WriteDelta A variable which receives the number of bytes written.
+ * \param OtherDelta A variable which receives the number of bytes transferred by other operations.
+ */
+VOID PhGetProcessItemIoHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PULONG64 ReadDelta,
+    _Out_opt_ PULONG64 WriteDelta,
+    _Out_opt_ PULONG64 OtherDelta
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+
+    if (ReadDelta)
+        *ReadDelta = (ULONG64)PhGetItemCircularBufferSlab_FLOAT(&chunk->IoReadHistory, &ProcessItem->HistorySlot, Index);
+    if (WriteDelta)
+        *WriteDelta = (ULONG64)PhGetItemCircularBufferSlab_FLOAT(&chunk->IoWriteHistory, &ProcessItem->HistorySlot, Index);
+    if (OtherDelta)
+        *OtherDelta = (ULONG64)PhGetItemCircularBufferSlab_FLOAT(&chunk->IoOtherHistory, &ProcessItem->HistorySlot, Index);
+}
+
+/**
+ * Retrieves a private bytes value recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Index The history index.
+ */
+SIZE_T PhGetProcessItemPrivateBytesHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index
+    )
+{
+    return (SIZE_T)PhGetItemCircularBufferSlab_ULONG(&ProcessItem->HistoryChunk->PrivatePagesHistory, &ProcessItem->HistorySlot, Index) * PAGE_SIZE;
+}
+
+/**
+ * Retrieves thread state counts recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Index The history index.
+ * \param Running A variable which receives the number of running threads.
+ * \param Ready A variable which receives the number of threads waiting for a processor.
+ * \param Waiting A variable which receives the number of waiting threads.
+ * \param TopWaitReason A variable which receives the most common wait reason of the waiting
+ * threads, or MaximumWaitReason if no threads were waiting.
+ */
+VOID PhGetProcessItemThreadStateHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_opt_ PULONG Running,
+    _Out_opt_ PULONG Ready,
+    _Out_opt_ PULONG Waiting,
+    _Out_opt_ PKWAIT_REASON TopWaitReason
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+
+    if (Running)
+        *Running = PhGetItemCircularBufferSlab_USHORT(&chunk->RunningThreadsHistory, &ProcessItem->HistorySlot, Index);
+    if (Ready)
+        *Ready = PhGetItemCircularBufferSlab_USHORT(&chunk->ReadyThreadsHistory, &ProcessItem->HistorySlot, Index);
+    if (Waiting)
+        *Waiting = PhGetItemCircularBufferSlab_USHORT(&chunk->WaitingThreadsHistory, &ProcessItem->HistorySlot, Index);
+    if (TopWaitReason)
+        *TopWaitReason = PhGetItemCircularBufferSlab_USHORT(&chunk->TopWaitReasonHistory, &ProcessItem->HistorySlot, Index);
+}
+
+/**
+ * Copies CPU usage values recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Count The number of values to copy.
+ * \param KernelUsage A buffer which receives the kernel CPU usage values.
+ * \param UserUsage A buffer which receives the user CPU usage values.
+ */
+VOID PhCopyProcessItemCpuHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT KernelUsage,
+    _Out_writes_(Count) PFLOAT UserUsage
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    PH_CIRCULAR_BUFFER_SLOT slot = ProcessItem->HistorySlot;
+    ULONG i;
+
+    if (Count > slot.Count)
+        Count = slot.Count;
+
+    for (i = 0; i < Count; i++)
+    {
+        KernelUsage[i] = PhGetItemCircularBufferSlab_USHORT(&chunk->CpuKernelHistory, &slot, i) / PH_PROCESS_HISTORY_CPU_SCALE;
+        UserUsage[i] = PhGetItemCircularBufferSlab_USHORT(&chunk->CpuUserHistory, &slot, i) / PH_PROCESS_HISTORY_CPU_SCALE;
+    }
+}
+
+/**
+ * Copies I/O deltas recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Count The number of values to copy.
+ * \param ReadOtherDelta A buffer which receives the sum of the read and other deltas.
+ * \param WriteDelta A buffer which receives the write deltas.
+ */
+VOID PhCopyProcessItemIoHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT ReadOtherDelta,
+    _Out_writes_(Count) PFLOAT WriteDelta
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    PH_CIRCULAR_BUFFER_SLOT slot = ProcessItem->HistorySlot;
+    ULONG i;
+
+    if (Count > slot.Count)
+        Count = slot.Count;
+
+    for (i = 0; i < Count; i++)
+    {
+        ReadOtherDelta[i] =
+            PhGetItemCircularBufferSlab_FLOAT(&chunk->IoReadHistory, &slot, i) +
+            PhGetItemCircularBufferSlab_FLOAT(&chunk->IoOtherHistory, &slot, i);
+        WriteDelta[i] = PhGetItemCircularBufferSlab_FLOAT(&chunk->IoWriteHistory, &slot, i);
+    }
+}
+
+/**
+ * Copies private bytes values recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Count The number of values to copy.
+ * \param PrivateBytes A buffer which receives the private bytes values.
+ */
+VOID PhCopyProcessItemPrivateBytesHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT PrivateBytes
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    PH_CIRCULAR_BUFFER_SLOT slot = ProcessItem->HistorySlot;
+    ULONG i;
+
+    if (Count > slot.Count)
+        Count = slot.Count;
+
+    for (i = 0; i < Count; i++)
+        PrivateBytes[i] = (FLOAT)PhGetItemCircularBufferSlab_ULONG(&chunk->PrivatePagesHistory, &slot, i) * PAGE_SIZE;
+}
+
+/**
+ * Copies thread state counts recorded by the statistics system.
+ *
+ * \param ProcessItem The process item.
+ * \param Count The number of values to copy.
+ * \param Running A buffer which receives the number of running threads.
+ * \param Ready A buffer which receives the number of threads waiting for a processor.
+ */
+VOID PhCopyProcessItemThreadStateHistory(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT Running,
+    _Out_writes_(Count) PFLOAT Ready
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    PH_CIRCULAR_BUFFER_SLOT slot = ProcessItem->HistorySlot;
+    ULONG i;
+
+    if (Count > slot.Count)
+        Count = slot.Count;
+
+    for (i = 0; i < Count; i++)
+    {
+        Running[i] = PhGetItemCircularBufferSlab_USHORT(&chunk->RunningThreadsHistory, &slot, i);
+        Ready[i] = PhGetItemCircularBufferSlab_USHORT(&chunk->ReadyThreadsHistory, &slot, i);
+    }
+}
+
+/**
+ * Gets the current generation of the statistics histories. The generation is odd while samples
+ * are being added.
+ */
+ULONG PhGetStatisticsGeneration(
+    VOID
+    )
+{
+    ULONG generation;
+
+    generation = PhpStatisticsGeneration;
+    MemoryBarrier();
+
+    return generation;
+}
+
+static VOID PhpInitializeHistoryView(
+    _Out_ PPH_HISTORY_VIEW View,
+    _In_ ULONG Generation,
+    _In_ PVOID Data,
+    _In_ ULONG SizeMinusOne,
+    _In_ ULONG Stride,
+    _In_ ULONG Count,
+    _In_ LONG Index
+    )
+{
+    View->Generation = Generation;
+    View->Count = Count;
+    View->SizeMinusOne = SizeMinusOne;
+    View->Index = Index;
+    View->Stride = Stride;
+    View->Data = Data;
+}
+
+#define PH_CIRCULAR_BUFFER_VIEW(View, Generation, Buffer) \
+    PhpInitializeHistoryView((View), (Generation), (Buffer)->Data, (Buffer)->SizeMinusOne, 1, (Buffer)->Count, (Buffer)->Index)
+
+/**
+ * Creates a read-only view of a system history without copying it.
+ *
+ * \param Type The history.
+ * \param Processor The processor number, for PhSystemCpusKernelHistoryView and
+ * PhSystemCpusUserHistoryView.
+ * \param View A variable which receives the view. Use PhGetItemHistoryView() to read samples,
+ * then PhIsHistoryViewCurrent() to check that the provider did not add samples in the meantime.
+ *
+ * \return TRUE if the view was created, FALSE if the history or processor does not exist.
+ */
+BOOLEAN PhGetSystemHistoryView(
+    _In_ PH_SYSTEM_HISTORY_VIEW_TYPE Type,
+    _In_ ULONG Processor,
+    _Out_ PPH_HISTORY_VIEW View
+    )
+{
+    ULONG generation;
+
+    // Wait for the provider to finish adding samples.
+    while ((generation = PhGetStatisticsGeneration()) & 1)
+        YieldProcessor();
+
+    switch (Type)
+    {
+    case PhSystemCpuKernelHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhCpuKernelHistory);
+        break;
+    case PhSystemCpuUserHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhCpuUserHistory);
+        break;
+    case PhSystemCpusKernelHistoryView:
+    case PhSystemCpusUserHistoryView:
+        if (Processor >= PhNumberOfProcessors)
+            return FALSE;
+
+        if (Type == PhSystemCpusKernelHistoryView)
+            PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhCpusKernelHistory[Processor]);
+        else
+            PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhCpusUserHistory[Processor]);
+
+        break;
+    case PhSystemIoReadHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhIoReadHistory);
+        break;
+    case PhSystemIoWriteHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhIoWriteHistory);
+        break;
+    case PhSystemIoOtherHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhIoOtherHistory);
+        break;
+    case PhSystemCommitHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhCommitHistory);
+        break;
+    case PhSystemPhysicalHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhPhysicalHistory);
+        break;
+    case PhSystemMaxCpuHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhMaxCpuHistory);
+        break;
+    case PhSystemMaxIoHistoryView:
+        PH_CIRCULAR_BUFFER_VIEW(View, generation, &PhMaxIoHistory);
+        break;
+    default:
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Creates a read-only view of a process history without copying it.
+ *
+ * \param ProcessItem The process item. The view is valid until the process item is
+ * dereferenced.
+ * \param Type The history.
+ * \param View A variable which receives the view. Use PhGetItemHistoryView() to read samples,
+ * then PhIsHistoryViewCurrent() to check that the provider did not add samples in the meantime.
+ *
+ * \return TRUE if the view was created, otherwise FALSE.
+ */
+BOOLEAN PhGetProcessItemHistoryView(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PH_PROCESS_HISTORY_VIEW_TYPE Type,
+    _Out_ PPH_HISTORY_VIEW View
+    )
+{
+    PPH_PROCESS_HISTORY_CHUNK chunk = ProcessItem->HistoryChunk;
+    ULONG generation;
+    PVOID data;
+    ULONG sizeMinusOne;
+    ULONG numberOfSlots;
+    PH_CIRCULAR_BUFFER_SLOT slot;
+
+    while ((generation = PhGetStatisticsGeneration()) & 1)
+        YieldProcessor();
+
+    slot = ProcessItem->HistorySlot;
+
+    // Every slab in a chunk has the same geometry.
+    sizeMinusOne = chunk->CpuKernelHistory.SizeMinusOne;
+    numberOfSlots = chunk->CpuKernelHistory.NumberOfSlots;
+
+    switch (Type)
+    {
+    case PhProcessCpuKernelHistoryView:
+        data = chunk->CpuKernelHistory.Data + slot.Slot;
+        break;
+    case PhProcessCpuUserHistoryView:
+        data = chunk->CpuUserHistory.Data + slot.Slot;
+        break;
+    case PhProcessIoReadHistoryView:
+        data = chunk->IoReadHistory.Data + slot.Slot;
+        break;
+    case PhProcessIoWriteHistoryView:
+        data = chunk->IoWriteHistory.Data + slot.Slot;
+        break;
+    case PhProcessIoOtherHistoryView:
+        data = chunk->IoOtherHistory.Data + slot.Slot;
+        break;
+    case PhProcessPrivatePagesHistoryView:
+        data = chunk->PrivatePagesHistory.Data + slot.Slot;
+        break;
+    case PhProcessRunningThreadsHistoryView:
+        data = chunk->RunningThreadsHistory.Data + slot.Slot;
+        break;
+    case PhProcessReadyThreadsHistoryView:
+        data = chunk->ReadyThreadsHistory.Data + slot.Slot;
+        break;
+    case PhProcessWaitingThreadsHistoryView:
+        data = chunk->WaitingThreadsHistory.Data + slot.Slot;
+        break;
+    default:
+        return FALSE;
+    }
+
+    PhpInitializeHistoryView(View, generation, data, sizeMinusOne, numberOfSlots, slot.Count, slot.Index);
+
+    return TRUE;
+}
+
+static ULONG PhpGetSystemGraphSampleCount(
+    _In_ PH_SYSTEM_GRAPH_SAMPLES Type
+    )
+{
+    switch (Type)
+    {
+    case SystemGraphCpuKernel:
+        return PhGetCountCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier);
+    case SystemGraphCpuUser:
+        return PhGetCountCircularBufferTiered_FLOAT(&PhCpuUserHistory, &PhCpuUserHistoryTier);
+    case SystemGraphIoReadOther:
+    case SystemGraphIoWrite:
+        return PhIoReadHistory.Count;
+    case SystemGraphCommit:
+        return PhCommitHistory.Count;
+    case SystemGraphPhysical:
+        return PhPhysicalHistory.Count;
+    default:
+        return 0;
+    }
+}
+
+static VOID PhpResizeSystemGraphSamples(
+    _Inout_ PPHP_SYSTEM_GRAPH_SAMPLES Samples,
+    _In_ ULONG Count
+    )
+{
+    if (Samples->AllocatedCount < Count)
+    {
+        if (Samples->Data)
+            PhFree(Samples->Data);
+
+        Samples->AllocatedCount = Count;
+        Samples->Data = PhAllocate(Count * sizeof(FLOAT));
+    }
+
+    Samples->Count = Count;
+}
+
+static VOID PhpConvertCircularBufferUlong64(
+    _In_ PPH_CIRCULAR_BUFFER_ULONG64 Buffer,
+    _Out_writes_(Count) PFLOAT Destination,
+    _In_ ULONG Count
+    )
+{
+    ULONG tailSize;
+
+    // Same layout as PhCopyCircularBuffer: the newest items are at Index, wrapping to the start.
+
+    if (Count > Buffer->Count)
+        Count = Buffer->Count;
+
+    tailSize = (ULONG)(Buffer->Size - Buffer->Index);
+
+    if (tailSize >= Count)
+    {
+        PhConvertUlong64sToSingles(Destination, &Buffer->Data[Buffer->Index], Count);
+    }
+    else
+    {
+        PhConvertUlong64sToSingles(Destination, &Buffer->Data[Buffer->Index], tailSize);
+        PhConvertUlong64sToSingles(&Destination[tailSize], Buffer->Data, Count - tailSize);
+    }
+}
+
+/**
+ * Updates the cached samples for a system history graph.
+ *
+ * \param Type The type of samples.
+ * \param Count The minimum number of samples required.
+ *
+ * \remarks The samples are only converted once per update of the system history, no matter how
+ * many graphs (system information window, tray icons, etc.) display them. The cache is always
+ * extended to the largest count that has been requested so far.
+ */
+static PPHP_SYSTEM_GRAPH_SAMPLES PhpReferenceSystemGraphSamples(
+    _In_ PH_SYSTEM_GRAPH_SAMPLES Type,
+    _In_ ULONG Count
+    )
+{
+    PPHP_SYSTEM_GRAPH_SAMPLES samples;
+    ULONG runId;
+    ULONG i;
+
+    samples = &PhpSystemGraphSamples[Type];
+    runId = PhpSystemGraphRunId;
+
+    if (samples->RunId == runId && samples->RequestedCount >= Count)
+        return samples;
+
+    if (samples->RequestedCount < Count)
+        samples->RequestedCount = Count;
+
+    Count = min(samples->RequestedCount, PhpGetSystemGraphSampleCount(Type));
+
+    switch (Type)
+    {
+    case SystemGraphCpuKernel:
+        PhpResizeSystemGraphSamples(samples, Count);
+        PhCopyCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier, samples->Data, Count);
+        break;
+    case SystemGraphCpuUser:
+        PhpResizeSystemGraphSamples(samples, Count);
+        PhCopyCircularBufferTiered_FLOAT(&PhCpuUserHistory, &PhCpuUserHistoryTier, samples->Data, Count);
+        break;
+    case SystemGraphIoReadOther:
+    case SystemGraphIoWrite:
+        {
+            PPHP_SYSTEM_GRAPH_SAMPLES readOther;
+            PPHP_SYSTEM_GRAPH_SAMPLES write;
+            ULONG oldAllocatedCount;
+
+            // Both I/O graphs are always converted together since they share the running maximum.
+
+            readOther = &PhpSystemGraphSamples[SystemGraphIoReadOther];
+            write = &PhpSystemGraphSamples[SystemGraphIoWrite];
+            readOther->RequestedCount = write->RequestedCount = samples->RequestedCount;
+            oldAllocatedCount = readOther->AllocatedCount;
+
+            PhpResizeSystemGraphSamples(readOther, Count);
+            PhpResizeSystemGraphSamples(write, Count);
+
+            if (readOther->AllocatedCount != oldAllocatedCount)
+            {
+                if (PhpSystemIoGraphMaximum)
+                    PhFree(PhpSystemIoGraphMaximum);
+
+                PhpSystemIoGraphMaximum = PhAllocate(readOther->AllocatedCount * sizeof(FLOAT));
+            }
+
+            // The other bytes are staged in the write buffer before it receives its own samples.
+            PhpConvertCircularBufferUlong64(&PhIoReadHistory, readOther->Data, Count);
+            PhpConvertCircularBufferUlong64(&PhIoOtherHistory, write->Data, Count);
+            PhAddSinglesToSingles(readOther->Data, write->Data, Count);
+            PhpConvertCircularBufferUlong64(&PhIoWriteHistory, write->Data, Count);
+            PhRunningMaximumSumSingles(PhpSystemIoGraphMaximum, readOther->Data, write->Data, Count);
+
+            readOther->RunId = runId;
+            write->RunId = runId;
+        }
+        break;
+    case SystemGraphCommit:
+        PhpResizeSystemGraphSamples(samples, Count);
+
+        for (i = 0; i < Count; i++)
+            samples->Data[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhCommitHistory, i);
+
+        if (PhPerfInformation.CommitLimit != 0)
+            PhDivideSinglesBySingle(samples->Data, (FLOAT)PhPerfInformation.CommitLimit, Count);
+
+        break;
+    case SystemGraphPhysical:
+        PhpResizeSystemGraphSamples(samples, Count);
+
+        for (i = 0; i < Count; i++)
+            samples->Data[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhPhysicalHistory, i);
+
+        if (PhSystemBasicInformation.NumberOfPhysicalPages != 0)
+            PhDivideSinglesBySingle(samples->Data, (FLOAT)PhSystemBasicInformation.NumberOfPhysicalPages, Count);
+
+        break;
+    }
+
+    samples->RunId = runId;
+
+    return samples;
+}
+
+/**
+ * Copies samples from the system history for use in a graph.
+ *
+ * \param Type The type of samples to copy.
+ * \param Count The number of samples to copy.
+ * \param Samples A buffer which receives the samples, most recent first.
+ *
+ * \return The number of samples copied, which may be less than \a Count if not enough history
+ * has been recorded.
+ */
+ULONG PhCopySystemGraphSamples(
+    _In_ PH_SYSTEM_GRAPH_SAMPLES Type,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PFLOAT Samples
+    )
+{
+    PPHP_SYSTEM_GRAPH_SAMPLES samples;
+
+    if (Type >= SystemGraphSamplesMaximum)
+        return 0;
+
+    PhAcquireQueuedLockExclusive(&PhpSystemGraphSamplesLock);
+
+    samples = PhpReferenceSystemGraphSamples(Type, Count);
+
+    if (Count > samples->Count)
+        Count = samples->Count;
+
+    memcpy(Samples, samples->Data, Count * sizeof(FLOAT));
+
+    PhReleaseQueuedLockExclusive(&PhpSystemGraphSamplesLock);
+
+    return Count;
+}
+
+/**
+ * Gets the largest total I/O delta in the most recent samples of the system history.
+ *
+ * \param Count The number of samples to consider.
+ *
+ * \return The largest sum of the \ref SystemGraphIoReadOther and \ref SystemGraphIoWrite
+ * samples, or 0 if there are no samples.
+ */
+FLOAT PhGetSystemIoGraphMaximum(
+    _In_ ULONG Count
+    )
+{
+    PPHP_SYSTEM_GRAPH_SAMPLES samples;
+    FLOAT max;
+
+    PhAcquireQueuedLockExclusive(&PhpSystemGraphSamplesLock);
+
+    samples = PhpReferenceSystemGraphSamples(SystemGraphIoReadOther, Count);
+
+    if (Count > samples->Count)
+        Count = samples->Count;
+
+    max = Count != 0 ? PhpSystemIoGraphMaximum[Count - 1] : 0;
+
+    PhReleaseQueuedLockExclusive(&PhpSystemGraphSamplesLock);
+
+    return max;
+}
+
+/**
+ * Retrieves a time value recorded by the statistics system.
+ *
+ * \param ProcessItem A process item to synchronize with, or NULL if
+ * no synchronization is necessary.
+ * \param Index The history index.
+ * \param Time A variable which receives the time at \a Index.
+ *
+ * \return TRUE if the function succeeded, otherwise FALSE if
+ * \a ProcessItem was specified and \a Index is too far into the
+ * past for that process item.
+ */
+BOOLEAN PhGetStatisticsTime(
+    _In_opt_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index,
+    _Out_ PLARGE_INTEGER Time
+    )
+{
+    ULONG secondsSince1980;
+    ULONG index;
+    LARGE_INTEGER time;
+
+    if (ProcessItem)
+    {
+        // The sequence number is used to synchronize statistics when a process exits, since
+        // that process' history is not updated anymore.
+        index = PhTimeSequenceNumber - ProcessItem->SequenceNumber + Index;
+
+        if (index >= PhTimeHistory.Count)
+        {
+            // The data point is too far into the past.
+            return FALSE;
+        }
+    }
+    else
+    {
+        // Assume the index is valid. It may refer to the long-term history.
+        index = Index;
+    }
+
+    secondsSince1980 = PhGetItemCircularBufferTiered_ULONG(&PhTimeHistory, &PhTimeHistoryTier, index, NULL, NULL);
+    RtlSecondsSince1980ToTime(secondsSince1980, &time);
+
+    *Time = time;
+
+    return TRUE;
+}
+
+PPH_STRING PhGetStatisticsTimeString(
+    _In_opt_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ ULONG Index
+    )
+{
+    LARGE_INTEGER time;
+    SYSTEMTIME systemTime;
+
+    if (PhGetStatisticsTime(ProcessItem, Index, &time))
+    {
+        PhLargeIntegerToLocalSystemTime(&systemTime, &time);
+
+        return PhFormatDateTime(&systemTime);
+    }
     else
     {
         return PhCreateString(L"Unknown time");
@@ -1855,22 +4070,430 @@ VOID PhpGetProcessThreadInformation(
         *ContextSwitches = contextSwitches;
 }
 
+static int __cdecl PhpProcessSnapshotEntryCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_PROCESS_SNAPSHOT_ENTRY entry1 = (PPH_PROCESS_SNAPSHOT_ENTRY)elem1;
+    PPH_PROCESS_SNAPSHOT_ENTRY entry2 = (PPH_PROCESS_SNAPSHOT_ENTRY)elem2;
+
+    return uintptrcmp((ULONG_PTR)entry1->ProcessId, (ULONG_PTR)entry2->ProcessId);
+}
+
+VOID PhpAddProcessSnapshotEntry(
+    _Inout_ PPH_PROCESS_SNAPSHOT Snapshot,
+    _In_ PSYSTEM_PROCESS_INFORMATION Process
+    )
+{
+    PPH_PROCESS_SNAPSHOT_ENTRY entry;
+
+    if (Snapshot->Count == Snapshot->AllocatedCount)
+    {
+        Snapshot->AllocatedCount = Snapshot->AllocatedCount ? Snapshot->AllocatedCount * 2 : 256;
+
+        if (Snapshot->Entries)
+            Snapshot->Entries = PhReAllocate(Snapshot->Entries, Snapshot->AllocatedCount * sizeof(PH_PROCESS_SNAPSHOT_ENTRY));
+        else
+            Snapshot->Entries = PhAllocate(Snapshot->AllocatedCount * sizeof(PH_PROCESS_SNAPSHOT_ENTRY));
+    }
+
+    entry = &Snapshot->Entries[Snapshot->Count++];
+    entry->ProcessId = Process->UniqueProcessId;
+    entry->CreateTime = Process->CreateTime;
+    entry->Process = Process;
+    entry->PreviousProcess = NULL;
+    entry->ProcessItem = NULL;
+    entry->PriorityClassValid = FALSE;
+}
+
+/**
+ * Queries information for all processes in a snapshot using KProcessHacker.
+ *
+ * \param Snapshot The process snapshot.
+ *
+ * \remarks One request covers up to KPH_MAXIMUM_PROCESS_BATCH_ENTRIES processes, instead of
+ * one query per process handle. This also works for processes which can't be opened.
+ */
+VOID PhpQueryProcessSnapshotBatchInformation(
+    _Inout_ PPH_PROCESS_SNAPSHOT Snapshot
+    )
+{
+    static PKPH_PROCESS_BATCH_ENTRY entries = NULL;
+    static ULONG allocatedEntries = 0;
+    static BOOLEAN unsupported = FALSE;
+
+    ULONG i;
+
+    // Older versions of the driver don't support the request.
+    if (unsupported || Snapshot->Count == 0)
+        return;
+
+    if (allocatedEntries < Snapshot->Count)
+    {
+        if (entries)
+            PhFree(entries);
+
+        allocatedEntries = Snapshot->Count * 2;
+        entries = PhAllocate(allocatedEntries * sizeof(KPH_PROCESS_BATCH_ENTRY));
+    }
+
+    for (i = 0; i < Snapshot->Count; i++)
+        entries[i].ProcessId = Snapshot->Entries[i].ProcessId;
+
+    for (i = 0; i < Snapshot->Count; i += KPH_MAXIMUM_PROCESS_BATCH_ENTRIES)
+    {
+        if (!NT_SUCCESS(KphQueryInformationProcesses(
+            &entries[i],
+            min(Snapshot->Count - i, KPH_MAXIMUM_PROCESS_BATCH_ENTRIES),
+            KPH_PROCESS_FIELD_PRIORITY_CLASS
+            )))
+        {
+            unsupported = TRUE;
+            return;
+        }
+    }
+
+    for (i = 0; i < Snapshot->Count; i++)
+    {
+        PPH_PROCESS_SNAPSHOT_ENTRY entry = &Snapshot->Entries[i];
+
+        // Processes are looked up by PID, so ignore processes which were replaced after the
+        // snapshot was taken.
+        if (NT_SUCCESS(entries[i].Status) &&
+            entries[i].CreateTime.QuadPart == entry->CreateTime.QuadPart &&
+            (entries[i].ValidFields & KPH_PROCESS_FIELD_PRIORITY_CLASS))
+        {
+            entry->PriorityClass = entries[i].PriorityClass;
+            entry->PriorityClassValid = TRUE;
+        }
+    }
+}
+
+/**
+ * Determines whether the counters of a process have changed between two snapshots.
+ *
+ * \param OldProcess The process information from the previous snapshot.
+ * \param NewProcess The process information from the current snapshot.
+ */
+FORCEINLINE BOOLEAN PhpIsProcessInformationChanged(
+    _In_ PSYSTEM_PROCESS_INFORMATION OldProcess,
+    _In_ PSYSTEM_PROCESS_INFORMATION NewProcess
+    )
+{
+    return
+        OldProcess->KernelTime.QuadPart != NewProcess->KernelTime.QuadPart ||
+        OldProcess->UserTime.QuadPart != NewProcess->UserTime.QuadPart ||
+        OldProcess->CycleTime != NewProcess->CycleTime ||
+        OldProcess->NumberOfThreads != NewProcess->NumberOfThreads ||
+        OldProcess->HandleCount != NewProcess->HandleCount ||
+        OldProcess->PageFaultCount != NewProcess->PageFaultCount ||
+        OldProcess->PagefileUsage != NewProcess->PagefileUsage ||
+        OldProcess->WorkingSetSize != NewProcess->WorkingSetSize ||
+        memcmp(&OldProcess->ReadOperationCount, &NewProcess->ReadOperationCount, sizeof(IO_COUNTERS)) != 0;
+}
+
+static int __cdecl PhpNotifyEventCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PKPH_NOTIFY_EVENT event1 = (PKPH_NOTIFY_EVENT)elem1;
+    PKPH_NOTIFY_EVENT event2 = (PKPH_NOTIFY_EVENT)elem2;
+
+    return int64cmp(event1->TimeStamp.QuadPart, event2->TimeStamp.QuadPart);
+}
+
+NTSTATUS PhpProcessNonPollThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    HANDLE eventHandle;
+    PKPH_NOTIFY_EVENT_INFORMATION buffer;
+    ULONG bufferSize;
+    LARGE_INTEGER interval;
+
+    if (!NT_SUCCESS(NtCreateEvent(&eventHandle, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE)))
+        return STATUS_UNSUCCESSFUL;
+
+    if (!NT_SUCCESS(KphSetNotifyEvent(eventHandle)))
+    {
+        NtClose(eventHandle);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    bufferSize = FIELD_OFFSET(KPH_NOTIFY_EVENT_INFORMATION, Events) + sizeof(KPH_NOTIFY_EVENT) * KPH_NOTIFY_RING_SIZE;
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        NtWaitForSingleObject(eventHandle, FALSE, NULL);
+
+        // Let bursts of events (e.g. a build starting many processes) collect so that
+        // they are handled together.
+        interval.QuadPart = -20 * PH_TIMEOUT_MS;
+        NtDelayExecution(FALSE, &interval);
+
+        while (TRUE)
+        {
+            if (!NT_SUCCESS(KphReadNotifyEvents(buffer, bufferSize, NULL)))
+                break;
+            if (buffer->EventCount == 0 && buffer->LostCount == 0)
+                break;
+
+            // Each processor has its own buffer in the driver, so the events are only
+            // ordered within each processor.
+            qsort(buffer->Events, buffer->EventCount, sizeof(KPH_NOTIFY_EVENT), PhpNotifyEventCompare);
+
+            PhInvokeCallback(&PhProcessNotificationEvent, buffer);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Compares the hot records of two process items for the top process lists.
+ *
+ * \return A positive value if \a HotData1 ranks higher than \a HotData2,
+ * a negative value if it ranks lower, or zero if they are equal.
+ */
+static int PhpCompareTopProcessItems(
+    _In_ PH_PROCESS_TOP_TYPE Type,
+    _In_ PPH_PROCESS_HOT_DATA HotData1,
+    _In_ PPH_PROCESS_HOT_DATA HotData2
+    )
+{
+    int result;
+
+    switch (Type)
+    {
+    case PhProcessTopCpu:
+        result = singlecmp(HotData1->CpuUsage, HotData2->CpuUsage);
+
+        if (result == 0)
+            result = uint64cmp(HotData1->UserTime, HotData2->UserTime);
+
+        return result;
+    case PhProcessTopPrivateBytes:
+        return uintptrcmp(HotData1->PagefileUsage, HotData2->PagefileUsage);
+    case PhProcessTopWorkingSet:
+        return uintptrcmp(HotData1->WorkingSetSize, HotData2->WorkingSetSize);
+    case PhProcessTopIo:
+        result = uint64cmp(HotData1->IoDelta, HotData2->IoDelta);
+
+        if (result == 0)
+            result = uint64cmp(HotData1->IoValue, HotData2->IoValue);
+
+        return result;
+    }
+
+    return 0;
+}
+
+static VOID PhpSiftDownTopProcessHeap(
+    _In_ PH_PROCESS_TOP_TYPE Type,
+    _Inout_updates_(Count) PPH_PROCESS_HOT_DATA *Heap,
+    _In_ ULONG Count,
+    _In_ ULONG Index
+    )
+{
+    while (TRUE)
+    {
+        ULONG lowest = Index;
+        ULONG left = Index * 2 + 1;
+        ULONG right = left + 1;
+        PPH_PROCESS_HOT_DATA item;
+
+        if (left < Count && PhpCompareTopProcessItems(Type, Heap[left], Heap[lowest]) < 0)
+            lowest = left;
+        if (right < Count && PhpCompareTopProcessItems(Type, Heap[right], Heap[lowest]) < 0)
+            lowest = right;
+
+        if (lowest == Index)
+            break;
+
+        item = Heap[Index];
+        Heap[Index] = Heap[lowest];
+        Heap[lowest] = item;
+        Index = lowest;
+    }
+}
+
+/**
+ * Offers a process item to a top process list.
+ *
+ * \remarks While the provider runs, each list is a min-heap whose root is the
+ * lowest ranked item kept so far, so most processes are rejected with a single
+ * comparison.
+ */
+static VOID PhpAddTopProcessItem(
+    _In_ PH_PROCESS_TOP_TYPE Type,
+    _Inout_updates_(PH_PROCESS_TOP_COUNT) PPH_PROCESS_HOT_DATA *Heap,
+    _Inout_ PULONG Count,
+    _In_ PPH_PROCESS_HOT_DATA HotData
+    )
+{
+    ULONG index;
+    ULONG parent;
+
+    if (*Count < PH_PROCESS_TOP_COUNT)
+    {
+        index = (*Count)++;
+        Heap[index] = HotData;
+
+        while (index != 0)
+        {
+            parent = (index - 1) / 2;
+
+            if (PhpCompareTopProcessItems(Type, Heap[index], Heap[parent]) >= 0)
+                break;
+
+            Heap[index] = Heap[parent];
+            Heap[parent] = HotData;
+            index = parent;
+        }
+    }
+    else if (PhpCompareTopProcessItems(Type, HotData, Heap[0]) > 0)
+    {
+        Heap[0] = HotData;
+        PhpSiftDownTopProcessHeap(Type, Heap, PH_PROCESS_TOP_COUNT, 0);
+    }
+}
+
+/**
+ * Fills the top process lists from the hot records of the process items that were
+ * updated in the current run.
+ *
+ * \param RunId The current run of the process provider plus one, as passed to
+ * PhpUpdateHotDataProcessItem().
+ * \param Heaps The top process lists.
+ * \param Counts The number of items in each list.
+ */
+static VOID PhpSelectTopProcessItems(
+    _In_ ULONG RunId,
+    _Inout_ PPH_PROCESS_HOT_DATA Heaps[PhProcessTopMaximum][PH_PROCESS_TOP_COUNT],
+    _Inout_ ULONG Counts[PhProcessTopMaximum]
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    // Other threads can allocate chunks (see hidnproc.c), so the chunk list needs to be locked.
+    PhAcquireQueuedLockShared(&PhpProcessHistoryLock);
+
+    for (i = 0; i < PhpProcessHistoryChunks->Count; i++)
+    {
+        PPH_PROCESS_HISTORY_CHUNK chunk = PhpProcessHistoryChunks->Items[i];
+
+        for (j = 0; j < PH_PROCESS_HISTORY_CHUNK_SLOTS; j++)
+        {
+            PPH_PROCESS_HOT_DATA hotData = &chunk->HotData[j];
+            PH_PROCESS_TOP_TYPE type;
+
+            if (!hotData->ProcessItem || hotData->RunId != RunId)
+                continue;
+            if (!PH_IS_REAL_PROCESS_ID(hotData->ProcessItem->ProcessId))
+                continue;
+
+            for (type = 0; type < PhProcessTopMaximum; type++)
+                PhpAddTopProcessItem(type, Heaps[type], &Counts[type], hotData);
+        }
+    }
+
+    PhReleaseQueuedLockShared(&PhpProcessHistoryLock);
+}
+
+/**
+ * Sorts the top process lists and publishes them for PhGetTopProcessItems().
+ */
+static VOID PhpPublishTopProcessItems(
+    _In_ PPH_PROCESS_HOT_DATA Heaps[PhProcessTopMaximum][PH_PROCESS_TOP_COUNT],
+    _In_ ULONG Counts[PhProcessTopMaximum]
+    )
+{
+    PPH_PROCESS_ITEM topProcessItems[PhProcessTopMaximum][PH_PROCESS_TOP_COUNT];
+    PH_PROCESS_TOP_TYPE type;
+    ULONG i;
+
+    for (type = 0; type < PhProcessTopMaximum; type++)
+    {
+        PPH_PROCESS_HOT_DATA *heap = Heaps[type];
+        PPH_PROCESS_HOT_DATA item;
+
+        // Repeatedly move the lowest ranked item to the end, leaving the list in
+        // descending order.
+        for (i = Counts[type]; i > 1; i--)
+        {
+            item = heap[0];
+            heap[0] = heap[i - 1];
+            heap[i - 1] = item;
+            PhpSiftDownTopProcessHeap(type, heap, i - 1, 0);
+        }
+
+        for (i = 0; i < Counts[type]; i++)
+        {
+            topProcessItems[type][i] = heap[i]->ProcessItem;
+            PhReferenceObject(topProcessItems[type][i]);
+        }
+    }
+
+    PhAcquireQueuedLockExclusive(&PhpTopProcessLock);
+
+    for (type = 0; type < PhProcessTopMaximum; type++)
+    {
+        for (i = 0; i < PhpTopProcessCount[type]; i++)
+            PhDereferenceObjectDeferDelete(PhpTopProcessItems[type][i]);
+
+        memcpy(PhpTopProcessItems[type], topProcessItems[type], Counts[type] * sizeof(PPH_PROCESS_ITEM));
+        PhpTopProcessCount[type] = Counts[type];
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpTopProcessLock);
+}
+
+PH_TRACE_EVENT_DECLARE(PhpProcessProviderPhaseTraceEvent, "ProcessProviderPhase", PH_TRACE_KEYWORD_PROVIDER, "Phase", PhTraceFieldAnsiString);
+
+/**
+ * Ends the current phase of a process provider update and begins the next one.
+ *
+ * \param Activity The activity of the current phase.
+ * \param Phase The name of the next phase, or NULL if the update has finished.
+ */
+FORCEINLINE VOID PhpTraceProcessProviderPhase(
+    _Inout_ PPH_TRACE_ACTIVITY Activity,
+    _In_opt_ PSTR Phase
+    )
+{
+    PhTraceStopEvent(&PhpProcessProviderPhaseTraceEvent, Activity);
+
+    if (Phase)
+        PhTraceStartEvent(&PhpProcessProviderPhaseTraceEvent, Activity, (ULONG_PTR)Phase);
+    else
+        Activity->Started = FALSE;
+}
+
 VOID PhProcessProviderUpdate(
     _In_ PVOID Object
     )
 {
     static ULONG runCount = 0;
-    static PSYSTEM_PROCESS_INFORMATION pidBuckets[PROCESS_ID_BUCKETS];
 
     // Note about locking:
     // Since this is the only function that is allowed to
-    // modify the process hashtable, locking is not needed
+    // modify the process index, locking is not needed
     // for shared accesses. However, exclusive accesses
     // need locking.
 
     PVOID processes;
+    PPH_PROCESS_INFORMATION_SNAPSHOT processInformationSnapshot;
+    PPH_PROCESS_INFORMATION_SNAPSHOT oldProcessInformationSnapshot;
     PSYSTEM_PROCESS_INFORMATION process;
-    ULONG bucketIndex;
+    PPH_PROCESS_SNAPSHOT snapshot;
+    PPH_PROCESS_SNAPSHOT previousSnapshot;
+    PPH_LIST processesToRemove = NULL;
+    PH_REPLAY_FRAME replayFrame;
+    BOOLEAN hasValidDeltas;
 
     BOOLEAN isCycleCpuUsageEnabled = FALSE;
 
@@ -1881,8 +4504,12 @@ VOID PhProcessProviderUpdate(
     PPH_PROCESS_ITEM maxCpuProcessItem = NULL;
     ULONG64 maxIoValue = 0;
     PPH_PROCESS_ITEM maxIoProcessItem = NULL;
+    PPH_PROCESS_HOT_DATA topProcessItems[PhProcessTopMaximum][PH_PROCESS_TOP_COUNT];
+    ULONG topProcessCount[PhProcessTopMaximum] = { 0 };
+    PH_TRACE_ACTIVITY traceActivity = { 0 };
 
     // Pre-update tasks
+    PhpTraceProcessProviderPhase(&traceActivity, "PreUpdate");
 
     if (runCount % 5 == 0)
     {
@@ -1895,7 +4522,23 @@ VOID PhProcessProviderUpdate(
             PhPurgeProcessRecords();
     }
 
-    isCycleCpuUsageEnabled = WindowsVersion >= WINDOWS_7 && PhEnableCycleCpuUsage;
+    // Kernel notifications are only started after the first run, so every process they
+    // report is either new or already known.
+    if (PhEnableProcessNonPoll && runCount != 0 && !PhpProcessNonPollInitialized && !PhProviderReplayActive)
+    {
+        HANDLE threadHandle;
+
+        if (KphIsConnected())
+        {
+            if (threadHandle = PhCreateThread(0, PhpProcessNonPollThreadStart, NULL))
+                NtClose(threadHandle);
+        }
+
+        PhpProcessNonPollInitialized = TRUE;
+    }
+
+    // The idle and interrupt cycle times are not part of a capture.
+    isCycleCpuUsageEnabled = WindowsVersion >= WINDOWS_7 && PhEnableCycleCpuUsage && !PhProviderReplayActive;
 
     if (!PhProcessStatisticsInitialized)
     {
@@ -1903,6 +4546,23 @@ VOID PhProcessProviderUpdate(
         PhProcessStatisticsInitialized = TRUE;
     }
 
+    if (PhProviderReplayActive)
+    {
+        // Nothing is updated while the replay is paused or finished.
+        if (!PhReadProviderReplayFrame(&PhPerfInformation, PhCpuInformation, PhNumberOfProcessors, &replayFrame))
+        {
+            PhpTraceProcessProviderPhase(&traceActivity, NULL);
+            return;
+        }
+
+        hasValidDeltas = runCount != 0 && !replayFrame.Discontinuity;
+    }
+    else
+    {
+        hasValidDeltas = runCount != 0;
+    }
+
+    PhpTraceProcessProviderPhase(&traceActivity, "SystemInformation");
     PhpUpdatePerfInformation();
 
     if (isCycleCpuUsageEnabled)
@@ -1920,14 +4580,39 @@ VOID PhProcessProviderUpdate(
         PhTimeSequenceNumber++;
     }
 
-    // Get the process list.
-
-    PhTotalProcesses = 0;
-    PhTotalThreads = 0;
-    PhTotalHandles = 0;
-
-    if (!NT_SUCCESS(PhEnumProcesses(&processes)))
-        return;
+    // Get the process list.
+    PhpTraceProcessProviderPhase(&traceActivity, "ProcessList");
+
+    PhTotalProcesses = 0;
+    PhTotalThreads = 0;
+    PhTotalHandles = 0;
+
+    if (PhProviderReplayActive)
+    {
+        processInformationSnapshot = PhCreateObject(sizeof(PH_PROCESS_INFORMATION_SNAPSHOT), PhpProcessInformationSnapshotType);
+        processInformationSnapshot->Processes = replayFrame.Processes;
+        processInformationSnapshot->BufferSize = replayFrame.ProcessesSize;
+    }
+    else
+    {
+        if (!NT_SUCCESS(PhpQueryProcessInformationSnapshot(&processInformationSnapshot)))
+        {
+            PhpTraceProcessProviderPhase(&traceActivity, NULL);
+            return;
+        }
+
+        // The buffer is modified below, so it has to be recorded now.
+        if (PhProviderCaptureActive)
+        {
+            PhWriteProviderCaptureFrame(
+                &PhPerfInformation,
+                processInformationSnapshot->Processes,
+                processInformationSnapshot->BufferSize
+                );
+        }
+    }
+
+    processes = processInformationSnapshot->Processes;
 
     // Notes on cycle-based CPU usage:
     //
@@ -1950,12 +4635,33 @@ VOID PhProcessProviderUpdate(
     // The second method is used here, but the adjustments must be done before the main new/modified
     // pass. We need take into account new, existing and terminated processes.
 
-    // Create the PID hash set. This contains the process information structures returned by
-    // PhEnumProcesses, distinct from the process item hash set.
-    // Note that we use the UniqueProcessKey field as the next node pointer to avoid having to
-    // allocate extra memory.
+    // Create the process snapshot. This contains the process information structures returned by
+    // NtQuerySystemInformation sorted by PID, distinct from the process item index. The previous
+    // snapshot still points into the previous buffer (PhProcessInformation), which is only released
+    // at the end of this function.
+    PhpTraceProcessProviderPhase(&traceActivity, "Snapshot");
+
+    previousSnapshot = &PhpProcessSnapshots[PhpCurrentProcessSnapshot];
+
+    // After the replay has been moved backwards, every process is removed and added again.
+    if (PhProviderReplayActive && replayFrame.Discontinuity)
+    {
+        ULONG i;
+
+        for (i = 0; i < previousSnapshot->Count; i++)
+        {
+            if (!processesToRemove)
+                processesToRemove = PhCreateList(previousSnapshot->Count);
+
+            PhAddItemList(processesToRemove, previousSnapshot->Entries[i].ProcessItem);
+        }
+
+        previousSnapshot->Count = 0;
+    }
 
-    memset(pidBuckets, 0, sizeof(pidBuckets));
+    PhpCurrentProcessSnapshot ^= 1;
+    snapshot = &PhpProcessSnapshots[PhpCurrentProcessSnapshot];
+    snapshot->Count = 0;
 
     process = PH_FIRST_PROCESS(processes);
 
@@ -1971,20 +4677,84 @@ VOID PhProcessProviderUpdate(
             process->KernelTime = PhCpuTotals.IdleTime;
         }
 
-        bucketIndex = PROCESS_ID_TO_BUCKET_INDEX(process->UniqueProcessId);
-        process->UniqueProcessKey = (ULONG_PTR)pidBuckets[bucketIndex];
-        pidBuckets[bucketIndex] = process;
+        PhpAddProcessSnapshotEntry(snapshot, process);
+    } while (process = PH_NEXT_PROCESS(process));
+
+    qsort(snapshot->Entries, snapshot->Count, sizeof(PH_PROCESS_SNAPSHOT_ENTRY), PhpProcessSnapshotEntryCompare);
 
-        if (isCycleCpuUsageEnabled)
+    // Merge the new snapshot with the previous one. Note that we take into account PID re-use by
+    // checking CreateTime as well. We use the UniqueProcessKey field to link each process
+    // information structure to its snapshot entry to avoid having to allocate extra memory.
+    {
+        ULONG i = 0;
+        ULONG j = 0;
+        PPH_PROCESS_SNAPSHOT_ENTRY entry;
+        PPH_PROCESS_SNAPSHOT_ENTRY previousEntry;
+
+        while (i < snapshot->Count && j < previousSnapshot->Count)
         {
-            PPH_PROCESS_ITEM processItem;
+            entry = &snapshot->Entries[i];
+            previousEntry = &previousSnapshot->Entries[j];
+
+            if (entry->ProcessId == previousEntry->ProcessId)
+            {
+                if (entry->CreateTime.QuadPart == previousEntry->CreateTime.QuadPart)
+                {
+                    // Existing process.
+                    entry->ProcessItem = previousEntry->ProcessItem;
+                    entry->PreviousProcess = previousEntry->Process;
+                }
+                else
+                {
+                    // The PID was re-used. The old process has terminated and the new entry is
+                    // treated as a new process.
+                    if (!processesToRemove)
+                        processesToRemove = PhCreateList(2);
+
+                    PhAddItemList(processesToRemove, previousEntry->ProcessItem);
+                }
 
-            if ((processItem = PhpLookupProcessItem(process->UniqueProcessId)) && processItem->CreateTime.QuadPart == process->CreateTime.QuadPart)
-                sysTotalCycleTime += process->CycleTime - processItem->CycleTimeDelta.Value; // existing process
+                i++;
+                j++;
+            }
+            else if ((ULONG_PTR)entry->ProcessId < (ULONG_PTR)previousEntry->ProcessId)
+            {
+                // New process.
+                i++;
+            }
             else
-                sysTotalCycleTime += process->CycleTime; // new process
+            {
+                // Terminated process.
+                if (!processesToRemove)
+                    processesToRemove = PhCreateList(2);
+
+                PhAddItemList(processesToRemove, previousEntry->ProcessItem);
+                j++;
+            }
         }
-    } while (process = PH_NEXT_PROCESS(process));
+
+        for (; j < previousSnapshot->Count; j++)
+        {
+            if (!processesToRemove)
+                processesToRemove = PhCreateList(2);
+
+            PhAddItemList(processesToRemove, previousSnapshot->Entries[j].ProcessItem);
+        }
+
+        for (i = 0; i < snapshot->Count; i++)
+        {
+            entry = &snapshot->Entries[i];
+            entry->Process->UniqueProcessKey = (ULONG_PTR)entry;
+
+            if (isCycleCpuUsageEnabled)
+            {
+                if (entry->ProcessItem)
+                    sysTotalCycleTime += entry->Process->CycleTime - entry->ProcessItem->CycleTimeDelta.Value; // existing process
+                else
+                    sysTotalCycleTime += entry->Process->CycleTime; // new process
+            }
+        }
+    }
 
     // Add the fake processes to the PID list.
     // On Windows 7 the two fake processes are merged into "Interrupts" since we can only get
@@ -2002,109 +4772,86 @@ VOID PhProcessProviderUpdate(
         PhInterruptsProcessInformation.KernelTime = PhCpuTotals.InterruptTime;
     }
 
-    // Look for dead processes.
+    // Process dead processes found while merging the snapshots.
+    PhpTraceProcessProviderPhase(&traceActivity, "DeadProcesses");
+
+    if (processesToRemove)
     {
-        PPH_LIST processesToRemove = NULL;
         ULONG i;
-        PPH_HASH_ENTRY entry;
         PPH_PROCESS_ITEM processItem;
-        PSYSTEM_PROCESS_INFORMATION processEntry;
 
-        for (i = 0; i < PH_HASH_SET_SIZE(PhProcessHashSet); i++)
+        for (i = 0; i < processesToRemove->Count; i++)
         {
-            for (entry = PhProcessHashSet[i]; entry; entry = entry->Next)
-            {
-                processItem = CONTAINING_RECORD(entry, PH_PROCESS_ITEM, HashEntry);
+            LARGE_INTEGER exitTime;
 
-                // Check if the process still exists. Note that we take into account PID re-use by
-                // checking CreateTime as well.
+            processItem = processesToRemove->Items[i];
+            processItem->State |= PH_PROCESS_ITEM_REMOVED;
+            exitTime.QuadPart = 0;
 
-                if (processItem->ProcessId == DPCS_PROCESS_ID)
-                {
-                    processEntry = &PhDpcsProcessInformation;
-                }
-                else if (processItem->ProcessId == INTERRUPTS_PROCESS_ID)
-                {
-                    processEntry = &PhInterruptsProcessInformation;
-                }
-                else
-                {
-                    processEntry = pidBuckets[PROCESS_ID_TO_BUCKET_INDEX(processItem->ProcessId)];
+            PhRemoveProcessItemAggregates(processItem);
 
-                    while (processEntry && processEntry->UniqueProcessId != processItem->ProcessId)
-                        processEntry = (PSYSTEM_PROCESS_INFORMATION)processEntry->UniqueProcessKey;
-                }
+            if (processItem->QueryHandle)
+            {
+                KERNEL_USER_TIMES times;
+                ULONG64 finalCycleTime;
 
-                if (!processEntry || processEntry->CreateTime.QuadPart != processItem->CreateTime.QuadPart)
+                if (NT_SUCCESS(PhGetProcessTimes(processItem->QueryHandle, &times)))
                 {
-                    LARGE_INTEGER exitTime;
-
-                    processItem->State |= PH_PROCESS_ITEM_REMOVED;
-                    exitTime.QuadPart = 0;
+                    exitTime = times.ExitTime;
+                }
 
-                    if (processItem->QueryHandle)
+                if (isCycleCpuUsageEnabled)
+                {
+                    if (NT_SUCCESS(PhGetProcessCycleTime(processItem->QueryHandle, &finalCycleTime)))
                     {
-                        KERNEL_USER_TIMES times;
-                        ULONG64 finalCycleTime;
-
-                        if (NT_SUCCESS(PhGetProcessTimes(processItem->QueryHandle, &times)))
-                        {
-                            exitTime = times.ExitTime;
-                        }
-
-                        if (isCycleCpuUsageEnabled)
-                        {
-                            if (NT_SUCCESS(PhGetProcessCycleTime(processItem->QueryHandle, &finalCycleTime)))
-                            {
-                                // Adjust deltas for the terminated process because this doesn't get
-                                // picked up anywhere else.
-                                //
-                                // Note that if we don't have sufficient access to the process, the worst
-                                // that will happen is that the CPU usages of other processes will get
-                                // inflated. (See above; if we were using the first technique, we could
-                                // get negative deltas, which is much worse.)
-                                sysTotalCycleTime += finalCycleTime - processItem->CycleTimeDelta.Value;
-                            }
-                        }
+                        // Adjust deltas for the terminated process because this doesn't get
+                        // picked up anywhere else.
+                        //
+                        // Note that if we don't have sufficient access to the process, the worst
+                        // that will happen is that the CPU usages of other processes will get
+                        // inflated. (See above; if we were using the first technique, we could
+                        // get negative deltas, which is much worse.)
+                        sysTotalCycleTime += finalCycleTime - processItem->CycleTimeDelta.Value;
                     }
+                }
+            }
 
-                    // If we don't have a valid exit time, use the current time.
-                    if (exitTime.QuadPart == 0)
-                        PhQuerySystemTime(&exitTime);
-
-                    processItem->Record->Flags |= PH_PROCESS_RECORD_DEAD;
-                    processItem->Record->ExitTime = exitTime;
+            // If we don't have a valid exit time, use the current time.
+            if (exitTime.QuadPart == 0)
+            {
+                if (PhProviderReplayActive)
+                    exitTime = replayFrame.Time;
+                else
+                    PhQuerySystemTime(&exitTime);
+            }
 
-                    // Raise the process removed event.
-                    // See PhFlushProcessQueryData for why we need to lock here.
-                    PhAcquireQueuedLockExclusive(&processItem->RemoveLock);
-                    PhInvokeCallback(&PhProcessRemovedEvent, processItem);
-                    PhReleaseQueuedLockExclusive(&processItem->RemoveLock);
+            processItem->Record->Flags |= PH_PROCESS_RECORD_DEAD;
+            processItem->Record->ExitTime = exitTime;
 
-                    if (!processesToRemove)
-                        processesToRemove = PhCreateList(2);
+            if (!PhProviderReplayActive)
+                PhpAddRecordStoreRecord(processItem->Record);
 
-                    PhAddItemList(processesToRemove, processItem);
-                }
-            }
+            // Raise the process removed event.
+            // See PhFlushProcessQueryData for why we need to lock here.
+            PhAcquireQueuedLockExclusive(&processItem->RemoveLock);
+            PhInvokeCallback(&PhProcessRemovedEvent, processItem);
+            PhReleaseQueuedLockExclusive(&processItem->RemoveLock);
         }
 
-        // Lock only if we have something to do.
-        if (processesToRemove)
-        {
-            PhAcquireQueuedLockExclusive(&PhProcessHashSetLock);
-
-            for (i = 0; i < processesToRemove->Count; i++)
-            {
-                PhpRemoveProcessItem((PPH_PROCESS_ITEM)processesToRemove->Items[i]);
-            }
+        PhAcquireQueuedLockExclusive(&PhProcessHashSetLock);
 
-            PhReleaseQueuedLockExclusive(&PhProcessHashSetLock);
-            PhDereferenceObject(processesToRemove);
+        for (i = 0; i < processesToRemove->Count; i++)
+        {
+            PhpRemoveProcessItem((PPH_PROCESS_ITEM)processesToRemove->Items[i]);
         }
+
+        PhReleaseQueuedLockExclusive(&PhProcessHashSetLock);
+        PhpPublishProcessIndexVersion();
+        PhDereferenceObject(processesToRemove);
     }
 
     // Go through the queued process query data.
+    PhpTraceProcessProviderPhase(&traceActivity, "QueryData");
     PhFlushProcessQueryData(FALSE);
 
     if (sysTotalTime == 0)
@@ -2114,14 +4861,36 @@ VOID PhProcessProviderUpdate(
 
     PhCpuTotalCycleDelta = sysTotalCycleTime;
 
+    // Readers of history views check the generation to detect samples added while they were reading.
+    PhpStatisticsGeneration++;
+    MemoryBarrier();
+
+    // All process items share the same row in the history slabs for this period.
+    PhpProcessHistoryIndex = PhAdvanceCircularBufferSlabIndex(PhpProcessHistoryIndex, PhpProcessHistorySize);
+
+    PhpTraceProcessProviderPhase(&traceActivity, "NewAndModified");
+
+    if (KphIsConnected() && !PhProviderReplayActive)
+        PhpQueryProcessSnapshotBatchInformation(snapshot);
+
     // Look for new processes and update existing ones.
     process = PH_FIRST_PROCESS(processes);
 
     while (process)
     {
+        PPH_PROCESS_SNAPSHOT_ENTRY snapshotEntry;
         PPH_PROCESS_ITEM processItem;
 
-        processItem = PhpLookupProcessItem(process->UniqueProcessId);
+        if (!PH_IS_FAKE_PROCESS_ID(process->UniqueProcessId))
+        {
+            snapshotEntry = (PPH_PROCESS_SNAPSHOT_ENTRY)process->UniqueProcessKey;
+            processItem = snapshotEntry->ProcessItem;
+        }
+        else
+        {
+            snapshotEntry = NULL;
+            processItem = PhpLookupProcessItem(process->UniqueProcessId);
+        }
 
         if (!processItem)
         {
@@ -2142,7 +4911,7 @@ VOID PhProcessProviderUpdate(
             // Open a handle to the process for later usage.
             // Don't try to do this if the process has no threads. On Windows 8.1, processes without threads are
             // probably reflected processes which will not terminate if we have a handle open.
-            if (process->NumberOfThreads != 0)
+            if (process->NumberOfThreads != 0 && !PhProviderReplayActive)
             {
                 PhOpenProcess(&processItem->QueryHandle, PROCESS_QUERY_INFORMATION, processItem->ProcessId);
 
@@ -2151,7 +4920,7 @@ VOID PhProcessProviderUpdate(
             }
 
             PhpGetProcessThreadInformation(process, &isSuspended, &isPartiallySuspended, &contextSwitches);
-            PhpUpdateDynamicInfoProcessItem(processItem, process);
+            PhpUpdateDynamicInfoProcessItem(processItem, process, snapshotEntry);
 
             // Initialize the deltas.
             PhUpdateDelta(&processItem->CpuKernelDelta, process->KernelTime.QuadPart);
@@ -2166,14 +4935,22 @@ VOID PhProcessProviderUpdate(
             PhUpdateDelta(&processItem->PageFaultsDelta, process->PageFaultCount);
             PhUpdateDelta(&processItem->CycleTimeDelta, process->CycleTime);
             PhUpdateDelta(&processItem->PrivateBytesDelta, process->PagefileUsage);
+            PhpUpdateHotDataProcessItem(processItem, 0);
 
             processItem->IsSuspended = isSuspended;
             processItem->IsPartiallySuspended = isPartiallySuspended;
 
+            PhUpdateProcessItemAggregates(processItem, TRUE);
+
             // If this is the first run of the provider, queue the
             // process query tasks. Otherwise, perform stage 1
             // processing now and queue stage 2 processing.
-            if (runCount > 0)
+            // Replayed processes can't be queried at all.
+            if (PhProviderReplayActive)
+            {
+                PhSetEvent(&processItem->Stage1Event);
+            }
+            else if (runCount > 0)
             {
                 PH_PROCESS_QUERY_S1_DATA data;
 
@@ -2189,25 +4966,32 @@ VOID PhProcessProviderUpdate(
                 PhpQueueProcessQueryStage1(processItem);
             }
 
-            // Add pending service items to the process item.
+            // Add pending service items to the process item. The service provider runs on
+            // its own thread, so this must be atomic with respect to adding the process item.
+            PhAcquireQueuedLockExclusive(&PhServiceProcessLinkLock);
             PhUpdateProcessItemServices(processItem);
 
-            // Add the process item to the hashtable.
+            // Add the process item to the process index.
             PhAcquireQueuedLockExclusive(&PhProcessHashSetLock);
             PhpAddProcessItem(processItem);
             PhReleaseQueuedLockExclusive(&PhProcessHashSetLock);
+            PhReleaseQueuedLockExclusive(&PhServiceProcessLinkLock);
+
+            if (snapshotEntry)
+                snapshotEntry->ProcessItem = processItem;
 
             // Raise the process added event.
             PhInvokeCallback(&PhProcessAddedEvent, processItem);
             processItem->AddedEventSent = TRUE;
 
-            // (Ref: for the process item being in the hashtable.)
+            // (Ref: for the process item being in the process index.)
             // Instead of referencing then dereferencing we simply don't do anything.
             // Dereferenced in PhpRemoveProcessItem.
         }
         else
         {
             BOOLEAN modified = FALSE;
+            BOOLEAN changed;
             BOOLEAN isSuspended;
             BOOLEAN isPartiallySuspended;
             ULONG contextSwitches;
@@ -2215,8 +4999,14 @@ VOID PhProcessProviderUpdate(
             FLOAT kernelCpuUsage;
             FLOAT userCpuUsage;
 
+            // If none of the counters have changed since the last snapshot, the process has not run
+            // during this period and there is no need to re-query state that can only change while
+            // the process is running.
+            changed = !snapshotEntry || !snapshotEntry->PreviousProcess ||
+                PhpIsProcessInformationChanged(snapshotEntry->PreviousProcess, process);
+
             PhpGetProcessThreadInformation(process, &isSuspended, &isPartiallySuspended, &contextSwitches);
-            PhpUpdateDynamicInfoProcessItem(processItem, process);
+            PhpUpdateDynamicInfoProcessItem(processItem, process, snapshotEntry);
 
             // Update the deltas.
             PhUpdateDelta(&processItem->CpuKernelDelta, process->KernelTime.QuadPart);
@@ -2233,12 +5023,6 @@ VOID PhProcessProviderUpdate(
             PhUpdateDelta(&processItem->PrivateBytesDelta, process->PagefileUsage);
 
             processItem->SequenceNumber++;
-            PhAddItemCircularBuffer_ULONG64(&processItem->IoReadHistory, processItem->IoReadDelta.Delta);
-            PhAddItemCircularBuffer_ULONG64(&processItem->IoWriteHistory, processItem->IoWriteDelta.Delta);
-            PhAddItemCircularBuffer_ULONG64(&processItem->IoOtherHistory, processItem->IoOtherDelta.Delta);
-
-            PhAddItemCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory, processItem->VmCounters.PagefileUsage);
-            //PhAddItemCircularBuffer_SIZE_T(&processItem->WorkingSetHistory, processItem->VmCounters.WorkingSetSize);
 
             if (InterlockedExchange(&processItem->JustProcessed, 0) != 0)
                 modified = TRUE;
@@ -2286,8 +5070,23 @@ VOID PhProcessProviderUpdate(
             processItem->CpuKernelUsage = kernelCpuUsage;
             processItem->CpuUserUsage = userCpuUsage;
 
-            PhAddItemCircularBuffer_FLOAT(&processItem->CpuKernelHistory, kernelCpuUsage);
-            PhAddItemCircularBuffer_FLOAT(&processItem->CpuUserHistory, userCpuUsage);
+            PhpUpdateHotDataProcessItem(processItem, runCount + 1);
+            PhpAddProcessHistory(processItem);
+            PhUpdateProcessItemAggregates(processItem, FALSE);
+
+            // Shared service hosts
+            if (WINDOWS_HAS_SERVICE_TAGS && !PhProviderReplayActive && processItem->ServiceList)
+            {
+                BOOLEAN sharedHost;
+
+                PhAcquireQueuedLockShared(&processItem->ServiceListLock);
+                sharedHost = processItem->ServiceList->Count > 1;
+                PhReleaseQueuedLockShared(&processItem->ServiceListLock);
+
+                if (sharedHost)
+                    PhUpdateServiceCpuUsage(processItem, process, sysTotalTime);
+            }
+            PhUpdateProcessItemAlerts(processItem);
 
             // Max. values
 
@@ -2308,7 +5107,7 @@ VOID PhProcessProviderUpdate(
             }
 
             // Debugged
-            if (processItem->QueryHandle)
+            if (changed && processItem->QueryHandle)
             {
                 BOOLEAN isBeingDebugged;
 
@@ -2346,7 +5145,7 @@ VOID PhProcessProviderUpdate(
             }
 
             // Immersive
-            if (processItem->QueryHandle && IsImmersiveProcess_I)
+            if (changed && processItem->QueryHandle && IsImmersiveProcess_I)
             {
                 BOOLEAN isImmersive;
 
@@ -2364,7 +5163,7 @@ VOID PhProcessProviderUpdate(
                 PhInvokeCallback(&PhProcessModifiedEvent, processItem);
             }
 
-            // No reference added by PhpLookupProcessItem.
+            // No reference added by the snapshot or PhpLookupProcessItem.
         }
 
         // Trick ourselves into thinking that the fake processes
@@ -2391,8 +5190,17 @@ VOID PhProcessProviderUpdate(
         }
     }
 
-    if (PhProcessInformation)
-        PhFree(PhProcessInformation);
+    // Publish the new snapshot. The previous one is released once every consumer that
+    // borrowed it is done, and its buffer is reused.
+    PhpTraceProcessProviderPhase(&traceActivity, "Publish");
+
+    PhAcquireQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+    oldProcessInformationSnapshot = PhpProcessInformationSnapshot;
+    PhpProcessInformationSnapshot = processInformationSnapshot;
+    PhReleaseQueuedLockExclusive(&PhpProcessInformationSnapshotLock);
+
+    if (oldProcessInformationSnapshot)
+        PhDereferenceObject(oldProcessInformationSnapshot);
 
     PhProcessInformation = processes;
 
@@ -2402,10 +5210,16 @@ VOID PhProcessProviderUpdate(
         PhpTsProcesses = NULL;
     }
 
+    // As with the system history, the first run has no valid deltas.
+    PhPublishProcessAggregates(hasValidDeltas);
+    PhPublishProcessAlerts();
+
     // History cannot be updated on the first run because the deltas are invalid.
     // For example, the I/O "deltas" will be huge because they are currently the
-    // raw accumulated values.
-    if (runCount != 0)
+    // raw accumulated values. The same applies after the replay has been moved backwards.
+    PhpTraceProcessProviderPhase(&traceActivity, "History");
+
+    if (hasValidDeltas)
     {
         if (isCycleCpuUsageEnabled)
             PhpUpdateCpuCycleUsageInformation(sysTotalCycleTime, sysIdleCycleTime);
@@ -2461,7 +5275,20 @@ VOID PhProcessProviderUpdate(
         }
     }
 
+    PhpTraceProcessProviderPhase(&traceActivity, "TopProcesses");
+    PhpSelectTopProcessItems(runCount + 1, topProcessItems, topProcessCount);
+    PhpPublishTopProcessItems(topProcessItems, topProcessCount);
+    PhFlushServiceCpuUsage();
+
+    MemoryBarrier();
+    PhpStatisticsGeneration++;
+
+    PhpPublishProcessIndexVersion();
+
+    PhpTraceProcessProviderPhase(&traceActivity, "Callbacks");
+    PhEmCallObjectBulkUpdate(EmProcessItemType);
     PhInvokeCallback(&PhProcessesUpdatedEvent, NULL);
+    PhpTraceProcessProviderPhase(&traceActivity, NULL);
     runCount++;
 }
 
@@ -2668,6 +5495,271 @@ PPH_PROCESS_RECORD PhpFindProcessRecord(
     return NULL;
 }
 
+BOOLEAN PhpIsValidRecordStoreRecord(
+    _In_ PPH_RECORD_STORE_RECORD Record
+    )
+{
+    return
+        Record->Size == FIELD_OFFSET(PH_RECORD_STORE_RECORD, Data) +
+        Record->ProcessNameLength + Record->FileNameLength + Record->CommandLineLength &&
+        Record->ProcessNameLength != 0 &&
+        !(Record->ProcessNameLength & 1) &&
+        !(Record->FileNameLength & 1) &&
+        !(Record->CommandLineLength & 1) &&
+        Record->CreateTime.QuadPart <= Record->ExitTime.QuadPart;
+}
+
+/**
+ * Opens the record store and removes records which are too old or malformed.
+ */
+VOID PhpLoadRecordStore(
+    VOID
+    )
+{
+    static PH_STRINGREF storeFileName = PH_STRINGREF_INIT(L"\\recordstore.dat");
+
+    PH_FILE_POOL_PARAMETERS parameters;
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+    LARGE_INTEGER threshold;
+    PPH_RECORD_STORE_RECORD previousRecord;
+    PPH_RECORD_STORE_RECORD record;
+    ULONG rva;
+
+    if (PhProcessRecordStoreDays == 0)
+        return;
+
+    // The store can cover a lot of processes, so only keep a few segments mapped.
+    parameters.SegmentShift = 18;
+    parameters.MaximumInactiveViews = 4;
+
+    if (!NT_SUCCESS(PhCreateStoreFilePool(&pool, &storeFileName, PH_RECORD_STORE_MAGIC, &parameters, &userContext)))
+        return;
+
+    PhQuerySystemTime(&threshold);
+    threshold.QuadPart -= (LONGLONG)PhProcessRecordStoreDays * PH_TICKS_PER_DAY;
+
+    // Find the first record which is too old or malformed. It is freed along with every record
+    // after it.
+
+    previousRecord = NULL;
+    rva = (ULONG)userContext;
+
+    while (record = PhReferenceFilePoolByRva(pool, rva))
+    {
+        if (!PhpIsValidRecordStoreRecord(record) || record->ExitTime.QuadPart < threshold.QuadPart)
+            break;
+
+        if (previousRecord)
+            PhDereferenceFilePool(pool, previousRecord);
+
+        previousRecord = record;
+        rva = record->NextRva;
+    }
+
+    if (record)
+    {
+        if (previousRecord)
+        {
+            previousRecord->NextRva = 0;
+        }
+        else
+        {
+            userContext = (ULONGLONG)PH_RECORD_STORE_MAGIC << 32;
+            PhSetUserContextFilePool(pool, &userContext);
+        }
+
+        while (record)
+        {
+            // Don't follow the link of a malformed record.
+            rva = PhpIsValidRecordStoreRecord(record) ? record->NextRva : 0;
+            PhFreeFilePool(pool, record);
+            record = PhReferenceFilePoolByRva(pool, rva);
+        }
+    }
+
+    if (previousRecord)
+        PhDereferenceFilePool(pool, previousRecord);
+
+    PhpRecordStore = pool;
+}
+
+/**
+ * Appends the record of a terminated process to the record store.
+ *
+ * \param ProcessRecord The process record.
+ */
+VOID PhpAddRecordStoreRecord(
+    _In_ PPH_PROCESS_RECORD ProcessRecord
+    )
+{
+    SIZE_T fileNameLength;
+    SIZE_T commandLineLength;
+    ULONG size;
+    ULONGLONG userContext;
+    PPH_RECORD_STORE_RECORD record;
+    ULONG rva;
+
+    if (PhBeginInitOnce(&PhpRecordStoreInitOnce))
+    {
+        PhpLoadRecordStore();
+        PhEndInitOnce(&PhpRecordStoreInitOnce);
+    }
+
+    if (!PhpRecordStore)
+        return;
+
+    fileNameLength = ProcessRecord->FileName ? ProcessRecord->FileName->Length : 0;
+    commandLineLength = ProcessRecord->CommandLine ? ProcessRecord->CommandLine->Length : 0;
+
+    if (ProcessRecord->ProcessName->Length == 0 || ProcessRecord->ProcessName->Length > MAXUSHORT)
+        return;
+    if (fileNameLength > MAXUSHORT || commandLineLength > MAXUSHORT)
+        return;
+
+    size = FIELD_OFFSET(PH_RECORD_STORE_RECORD, Data) + (ULONG)ProcessRecord->ProcessName->Length +
+        (ULONG)fileNameLength + (ULONG)commandLineLength;
+
+    PhAcquireQueuedLockExclusive(&PhpRecordStoreLock);
+
+    record = PhAllocateFilePool(PhpRecordStore, size, &rva);
+
+    if (record)
+    {
+        PCHAR data;
+
+        PhGetUserContextFilePool(PhpRecordStore, &userContext);
+
+        record->NextRva = (ULONG)userContext;
+        record->Size = size;
+        record->ProcessId = HandleToUlong(ProcessRecord->ProcessId);
+        record->ParentProcessId = HandleToUlong(ProcessRecord->ParentProcessId);
+        record->SessionId = ProcessRecord->SessionId;
+        record->Reserved = 0;
+        record->CreateTime = ProcessRecord->CreateTime;
+        record->ExitTime = ProcessRecord->ExitTime;
+        record->ProcessNameLength = (USHORT)ProcessRecord->ProcessName->Length;
+        record->FileNameLength = (USHORT)fileNameLength;
+        record->CommandLineLength = (USHORT)commandLineLength;
+        record->Reserved2 = 0;
+
+        data = (PCHAR)record->Data;
+        memcpy(data, ProcessRecord->ProcessName->Buffer, record->ProcessNameLength);
+        data += record->ProcessNameLength;
+
+        if (ProcessRecord->FileName)
+            memcpy(data, ProcessRecord->FileName->Buffer, fileNameLength);
+
+        data += fileNameLength;
+
+        if (ProcessRecord->CommandLine)
+            memcpy(data, ProcessRecord->CommandLine->Buffer, commandLineLength);
+
+        PhDereferenceFilePool(PhpRecordStore, record);
+
+        userContext = ((ULONGLONG)PH_RECORD_STORE_MAGIC << 32) | rva;
+        PhSetUserContextFilePool(PhpRecordStore, &userContext);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpRecordStoreLock);
+}
+
+/**
+ * Finds a process record in the record store.
+ *
+ * \param ProcessId The ID of the process.
+ * \param Time A time in which the process was active.
+ *
+ * \return A new process record which has been added to the process record list, or NULL if
+ * no record was found.
+ */
+PPH_PROCESS_RECORD PhpFindRecordStoreRecord(
+    _In_ HANDLE ProcessId,
+    _In_ PLARGE_INTEGER Time
+    )
+{
+    PPH_PROCESS_RECORD processRecord;
+    ULONGLONG userContext;
+    PPH_RECORD_STORE_RECORD record;
+    ULONG rva;
+
+    if (PhBeginInitOnce(&PhpRecordStoreInitOnce))
+    {
+        PhpLoadRecordStore();
+        PhEndInitOnce(&PhpRecordStoreInitOnce);
+    }
+
+    if (!PhpRecordStore)
+        return NULL;
+
+    processRecord = NULL;
+
+    // Referencing blocks may map or unmap views, so we need exclusive access.
+    PhAcquireQueuedLockExclusive(&PhpRecordStoreLock);
+
+    PhGetUserContextFilePool(PhpRecordStore, &userContext);
+    rva = (ULONG)userContext;
+
+    while (record = PhReferenceFilePoolByRva(PhpRecordStore, rva))
+    {
+        // Records are ordered by the time at which we noticed the process terminate, so there
+        // are no more matches once we reach a process that exited well before the given time.
+        if (record->ExitTime.QuadPart < Time->QuadPart - PH_RECORD_STORE_SEARCH_SLACK)
+        {
+            PhDereferenceFilePool(PhpRecordStore, record);
+            break;
+        }
+
+        if (
+            record->ProcessId == HandleToUlong(ProcessId) &&
+            record->CreateTime.QuadPart <= Time->QuadPart &&
+            record->ExitTime.QuadPart >= Time->QuadPart
+            )
+        {
+            PCHAR data;
+
+            processRecord = PhAllocate(sizeof(PH_PROCESS_RECORD));
+            memset(processRecord, 0, sizeof(PH_PROCESS_RECORD));
+
+            InitializeListHead(&processRecord->ListEntry);
+            processRecord->RefCount = 1;
+            processRecord->Flags = PH_PROCESS_RECORD_DEAD;
+
+            processRecord->ProcessId = UlongToHandle(record->ProcessId);
+            processRecord->ParentProcessId = UlongToHandle(record->ParentProcessId);
+            processRecord->SessionId = record->SessionId;
+            processRecord->CreateTime = record->CreateTime;
+            processRecord->ExitTime = record->ExitTime;
+
+            data = (PCHAR)record->Data;
+            processRecord->ProcessName = PhCreateStringEx((PWCHAR)data, record->ProcessNameLength);
+            data += record->ProcessNameLength;
+
+            if (record->FileNameLength != 0)
+                processRecord->FileName = PhCreateStringEx((PWCHAR)data, record->FileNameLength);
+
+            data += record->FileNameLength;
+
+            if (record->CommandLineLength != 0)
+                processRecord->CommandLine = PhCreateStringEx((PWCHAR)data, record->CommandLineLength);
+
+            PhDereferenceFilePool(PhpRecordStore, record);
+            break;
+        }
+
+        rva = record->NextRva;
+        PhDereferenceFilePool(PhpRecordStore, record);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpRecordStoreLock);
+
+    // The record is removed from the list again when the caller dereferences it.
+    if (processRecord)
+        PhpAddProcessRecord(processRecord);
+
+    return processRecord;
+}
+
 /**
  * Finds a process record.
  *
@@ -2689,7 +5781,7 @@ PPH_PROCESS_RECORD PhFindProcessRecord(
     BOOLEAN found;
 
     if (PhProcessRecordList->Count == 0)
-        return NULL;
+        return ProcessId ? PhpFindRecordStoreRecord(ProcessId, Time) : NULL;
 
     PhAcquireQueuedLockShared(&PhProcessRecordListLock);
 
@@ -2759,8 +5851,12 @@ PPH_PROCESS_RECORD PhFindProcessRecord(
 
     if (found)
         return processRecord;
-    else
-        return NULL;
+
+    // The record may have been purged, or may be from a previous session.
+    if (ProcessId)
+        return PhpFindRecordStoreRecord(ProcessId, Time);
+
+    return NULL;
 }
 
 /**
@@ -2841,19 +5937,16 @@ PPH_PROCESS_ITEM PhReferenceProcessItemForParent(
     if (ParentProcessId == ProcessId) // for cases where the parent PID = PID (e.g. System Idle Process)
         return NULL;
 
-    PhAcquireQueuedLockShared(&PhProcessHashSetLock);
-
-    processItem = PhpLookupProcessItem(ParentProcessId);
+    processItem = PhReferenceProcessItem(ParentProcessId);
 
     // We make sure that the process item we found is actually the parent
     // process - its start time must not be larger than the supplied
     // time.
-    if (processItem && processItem->CreateTime.QuadPart <= CreateTime->QuadPart)
-        PhReferenceObject(processItem);
-    else
+    if (processItem && processItem->CreateTime.QuadPart > CreateTime->QuadPart)
+    {
+        PhDereferenceObject(processItem);
         processItem = NULL;
-
-    PhReleaseQueuedLockShared(&PhProcessHashSetLock);
+    }
 
     return processItem;
 }
@@ -2864,16 +5957,13 @@ PPH_PROCESS_ITEM PhReferenceProcessItemForRecord(
 {
     PPH_PROCESS_ITEM processItem;
 
-    PhAcquireQueuedLockShared(&PhProcessHashSetLock);
-
-    processItem = PhpLookupProcessItem(Record->ProcessId);
+    processItem = PhReferenceProcessItem(Record->ProcessId);
 
-    if (processItem && processItem->CreateTime.QuadPart == Record->CreateTime.QuadPart)
-        PhReferenceObject(processItem);
-    else
+    if (processItem && processItem->CreateTime.QuadPart != Record->CreateTime.QuadPart)
+    {
+        PhDereferenceObject(processItem);
         processItem = NULL;
-
-    PhReleaseQueuedLockShared(&PhProcessHashSetLock);
+    }
 
     return processItem;
 }
@@ -35,6 +35,10 @@
 #include <cpysave.h>
 #include <emenu.h>
 #include <verify.h>
+#include <procgrp.h>
+#include <tokcache.h>
+#include <hndltrnd.h>
+#include <kphuser.h>
 
 typedef enum _PHP_AGGREGATE_TYPE
 {
@@ -44,20 +48,95 @@ typedef enum _PHP_AGGREGATE_TYPE
     AggregateTypeIntPtr
 } PHP_AGGREGATE_TYPE;
 
-typedef enum _PHP_AGGREGATE_LOCATION
+typedef enum _PHP_AGGREGATE_FIELD
 {
-    AggregateLocationProcessNode,
-    AggregateLocationProcessItem
-} PHP_AGGREGATE_LOCATION;
+    AggregateFieldCpuUsage,
+    AggregateFieldIoReadDelta,
+    AggregateFieldIoWriteDelta,
+    AggregateFieldIoOtherDelta,
+    AggregateFieldPagefileUsage,
+    AggregateFieldWorkingSetSize,
+    AggregateFieldNumberOfThreads,
+    AggregateFieldNumberOfHandles,
+    AggregateFieldCycleTime,
+    AggregateFieldCycleTimeDelta,
+    AggregateFieldMaximum
+} PHP_AGGREGATE_FIELD;
+
+C_ASSERT(AggregateFieldMaximum == PHPN_AGGREGATE_FIELD_COUNT);
+
+typedef struct _PHP_AGGREGATE_FIELD_INFO
+{
+    PHP_AGGREGATE_TYPE Type;
+    SIZE_T FieldOffset; // in PH_PROCESS_ITEM
+} PHP_AGGREGATE_FIELD_INFO, *PPHP_AGGREGATE_FIELD_INFO;
+
+#define PHP_REFRESH_EVERY_UPDATE 0 // invalidated on every update
+#define PHP_REFRESH_INTERVAL 1 // invalidated every RefreshInterval updates
+#define PHP_REFRESH_ON_CHANGE 2 // invalidated when the process item is modified
+#define PHP_REFRESH_ONCE 3 // never invalidated
+
+typedef struct _PHP_NODE_FIELD_POLICY
+{
+    UCHAR RefreshPolicy;
+    UCHAR RefreshInterval;
+} PHP_NODE_FIELD_POLICY, *PPHP_NODE_FIELD_POLICY;
+
+typedef struct _PHP_NODE_FIELD_COST
+{
+    ULONG NumberOfQueries;
+    ULONG64 QueryTime; // in performance counter ticks
+} PHP_NODE_FIELD_COST, *PPHP_NODE_FIELD_COST;
+
+typedef struct _PHP_PREFETCH_ITEM
+{
+    PPH_PROCESS_ITEM ProcessItem;
+    ULONG OldValidMask;
+
+    PH_PROCESS_WS_COUNTERS WsCounters;
+    ULONG GdiHandles;
+    ULONG UserHandles;
+    ULONG IoPriority;
+    ULONG PagePriority;
+    ULONG DepStatus;
+    BOOLEAN VirtualizationAllowed;
+    BOOLEAN VirtualizationEnabled;
+    SIZE_T MinimumWorkingSetSize;
+    SIZE_T MaximumWorkingSetSize;
+} PHP_PREFETCH_ITEM, *PPHP_PREFETCH_ITEM;
+
+typedef struct _PHP_PREFETCH_BATCH
+{
+    ULONG Mask; // PHPN_* values to query
+    PHP_NODE_FIELD_COST Costs[PHPN_FIELD_COUNT];
+    ULONG NumberOfItems;
+    PHP_PREFETCH_ITEM Items[1];
+} PHP_PREFETCH_BATCH, *PPHP_PREFETCH_BATCH;
 
 VOID PhpRemoveProcessNode(
     _In_ PPH_PROCESS_NODE ProcessNode
     );
 
+VOID PhpFlushRemovedProcessNodes(
+    VOID
+    );
+
 VOID PhpUpdateNeedCyclesInformation(
     VOID
     );
 
+VOID PhpUpdatePrefetchMask(
+    VOID
+    );
+
+PPHP_PREFETCH_BATCH PhpCreatePrefetchBatch(
+    _In_ ULONG RefreshMask
+    );
+
+VOID PhpQueuePrefetchBatch(
+    _In_ PPHP_PREFETCH_BATCH Batch
+    );
+
 VOID PhpUpdateProcessNodeCycles(
     _Inout_ PPH_PROCESS_NODE ProcessNode
     );
@@ -82,15 +161,87 @@ static ULONG ProcessTreeListSortColumn;
 static PH_SORT_ORDER ProcessTreeListSortOrder;
 static PH_CM_MANAGER ProcessTreeListCm;
 
-static PPH_HASH_ENTRY ProcessNodeHashSet[256] = PH_HASH_SET_INIT; // hashtable of all nodes
+PH_HANDLE_INDEX PhProcessNodeIndex; // index of all nodes
 static PPH_LIST ProcessNodeList; // list of all nodes, used when sorting is enabled
 static PPH_LIST ProcessNodeRootList; // list of root nodes
+static PPH_LIST ProcessNodeRemovedList; // removed nodes which are still present in the other lists
+static ULONG ProcessNodeAggregateRunId = 1; // incremented whenever the aggregated values may have changed
+static ULONG ProcessNodeAggregateValidRunId = 0; // value of ProcessNodeAggregateRunId when the values were computed
+
+static PHP_AGGREGATE_FIELD_INFO PhpAggregateFields[AggregateFieldMaximum] =
+{
+    { AggregateTypeFloat, FIELD_OFFSET(PH_PROCESS_ITEM, CpuUsage) },
+    { AggregateTypeInt64, FIELD_OFFSET(PH_PROCESS_ITEM, IoReadDelta.Delta) },
+    { AggregateTypeInt64, FIELD_OFFSET(PH_PROCESS_ITEM, IoWriteDelta.Delta) },
+    { AggregateTypeInt64, FIELD_OFFSET(PH_PROCESS_ITEM, IoOtherDelta.Delta) },
+    { AggregateTypeIntPtr, FIELD_OFFSET(PH_PROCESS_ITEM, VmCounters.PagefileUsage) },
+    { AggregateTypeIntPtr, FIELD_OFFSET(PH_PROCESS_ITEM, VmCounters.WorkingSetSize) },
+    { AggregateTypeInt32, FIELD_OFFSET(PH_PROCESS_ITEM, NumberOfThreads) },
+    { AggregateTypeInt32, FIELD_OFFSET(PH_PROCESS_ITEM, NumberOfHandles) },
+    { AggregateTypeInt64, FIELD_OFFSET(PH_PROCESS_ITEM, CycleTimeDelta.Value) },
+    { AggregateTypeInt64, FIELD_OFFSET(PH_PROCESS_ITEM, CycleTimeDelta.Delta) }
+};
 
 BOOLEAN PhProcessTreeListStateHighlighting = TRUE;
 static PPH_POINTER_LIST ProcessNodeStateList = NULL; // list of nodes which need to be processed
 
 static PH_TN_FILTER_SUPPORT FilterSupport;
 static BOOLEAN NeedCyclesInformation = FALSE;
+static ULONG VolatileTextMask[PH_TREENEW_TEXT_CACHE_MASK_SIZE(PHPRTLC_MAXIMUM)]; // columns which can change every update
+
+// How often each PHPN_* value is queried again (indexed by bit number), and how long the queries take.
+static PHP_NODE_FIELD_POLICY ProcessNodeFieldPolicies[PHPN_FIELD_COUNT] =
+{
+    { PHP_REFRESH_EVERY_UPDATE, 0 }, // PHPN_WSCOUNTERS
+    { PHP_REFRESH_EVERY_UPDATE, 0 }, // PHPN_GDIUSERHANDLES
+    { PHP_REFRESH_INTERVAL, 5 }, // PHPN_IOPAGEPRIORITY
+    { PHP_REFRESH_INTERVAL, 2 }, // PHPN_WINDOW
+    { PHP_REFRESH_ON_CHANGE, 0 }, // PHPN_DEPSTATUS
+    { PHP_REFRESH_INTERVAL, 5 }, // PHPN_TOKEN
+    { PHP_REFRESH_ONCE, 0 }, // PHPN_OSCONTEXT
+    { PHP_REFRESH_INTERVAL, 5 }, // PHPN_QUOTALIMITS
+    { PHP_REFRESH_ONCE, 0 }, // PHPN_IMAGE
+    { PHP_REFRESH_ONCE, 0 }, // PHPN_APPID
+    { PHP_REFRESH_ONCE, 0 } // PHPN_DPIAWARENESS
+};
+static PHP_NODE_FIELD_COST ProcessNodeFieldCosts[PHPN_FIELD_COUNT];
+static ULONG ProcessNodeUpdateCount = 0;
+
+// Columns which use a PHPN_* value.
+static ULONG ProcessNodeColumnFields[][2] =
+{
+    { PHPRTLC_PRIVATEWS, PHPN_WSCOUNTERS }, // before Windows 7 only
+    { PHPRTLC_SHAREDWS, PHPN_WSCOUNTERS },
+    { PHPRTLC_SHAREABLEWS, PHPN_WSCOUNTERS },
+    { PHPRTLC_GDIHANDLES, PHPN_GDIUSERHANDLES },
+    { PHPRTLC_USERHANDLES, PHPN_GDIUSERHANDLES },
+    { PHPRTLC_IOPRIORITY, PHPN_IOPAGEPRIORITY },
+    { PHPRTLC_PAGEPRIORITY, PHPN_IOPAGEPRIORITY },
+    { PHPRTLC_WINDOWTITLE, PHPN_WINDOW },
+    { PHPRTLC_WINDOWSTATUS, PHPN_WINDOW },
+    { PHPRTLC_DEPSTATUS, PHPN_DEPSTATUS },
+    { PHPRTLC_VIRTUALIZED, PHPN_TOKEN },
+    { PHPRTLC_OSCONTEXT, PHPN_OSCONTEXT },
+    { PHPRTLC_MINIMUMWORKINGSET, PHPN_QUOTALIMITS },
+    { PHPRTLC_MAXIMUMWORKINGSET, PHPN_QUOTALIMITS },
+    { PHPRTLC_ASLR, PHPN_IMAGE },
+    { PHPRTLC_SUBSYSTEM, PHPN_IMAGE },
+    { PHPRTLC_CFGUARD, PHPN_IMAGE },
+    { PHPRTLC_APPID, PHPN_APPID },
+    { PHPRTLC_DPIAWARENESS, PHPN_DPIAWARENESS }
+};
+
+// PHPN_* values which can be queried on the prefetch worker thread.
+#define PHPN_PREFETCH_MASK (PHPN_WSCOUNTERS | PHPN_GDIUSERHANDLES | PHPN_IOPAGEPRIORITY | PHPN_DEPSTATUS | \
+    PHPN_TOKEN | PHPN_QUOTALIMITS)
+
+// Optional column data is queried in bulk on a worker thread after each update, for the
+// visible nodes (or all nodes if the list is sorted by such a column).
+static ULONG PrefetchMask = 0; // PHPN_* values needed by the visible columns
+static ULONG PrefetchTextMask[PH_TREENEW_TEXT_CACHE_MASK_SIZE(PHPRTLC_MAXIMUM)]; // visible columns which use PrefetchMask
+static BOOLEAN PrefetchSortColumn = FALSE; // the list is sorted by one of those columns
+static BOOLEAN PrefetchPending = FALSE; // a batch is being queried
+static PH_WORK_QUEUE PrefetchWorkQueue;
 
 static HDC GraphContext = NULL;
 static ULONG GraphContextWidth = 0;
@@ -103,8 +254,29 @@ VOID PhProcessTreeListInitialization(
     VOID
     )
 {
+    static ULONG staticColumns[] =
+    {
+        PHPRTLC_NAME, PHPRTLC_PID, PHPRTLC_USERNAME, PHPRTLC_DESCRIPTION, PHPRTLC_COMPANYNAME,
+        PHPRTLC_VERSION, PHPRTLC_FILENAME, PHPRTLC_COMMANDLINE, PHPRTLC_SESSIONID, PHPRTLC_INTEGRITY,
+        PHPRTLC_STARTTIME, PHPRTLC_VERIFICATIONSTATUS, PHPRTLC_VERIFIEDSIGNER, PHPRTLC_ASLR, PHPRTLC_BITS,
+        PHPRTLC_ELEVATION, PHPRTLC_OSCONTEXT, PHPRTLC_SUBSYSTEM, PHPRTLC_PACKAGENAME, PHPRTLC_DPIAWARENESS,
+        PHPRTLC_CFGUARD
+    };
+    ULONG i;
+
+    PhInitializeHandleIndex(&PhProcessNodeIndex, 256);
     ProcessNodeList = PhCreateList(40);
     ProcessNodeRootList = PhCreateList(10);
+    ProcessNodeRemovedList = PhCreateList(10);
+
+    // The text of these columns only changes when the process item is modified (see
+    // PhUpdateProcessNode), so it doesn't need to be refreshed on every update.
+    memset(VolatileTextMask, 0xff, sizeof(VolatileTextMask));
+
+    for (i = 0; i < RTL_NUMBER_OF(staticColumns); i++)
+        VolatileTextMask[staticColumns[i] / 32] &= ~((ULONG)1 << (staticColumns[i] % 32));
+
+    PhInitializeWorkQueue(&PrefetchWorkQueue, 0, 1, 1000);
 }
 
 VOID PhInitializeProcessTreeList(
@@ -113,7 +285,7 @@ VOID PhInitializeProcessTreeList(
 {
     ProcessTreeListHandle = hwnd;
     PhSetControlTheme(ProcessTreeListHandle, L"explorer");
-    TreeNew_SetExtendedFlags(hwnd, TN_FLAG_ITEM_DRAG_SELECT, TN_FLAG_ITEM_DRAG_SELECT);
+    TreeNew_SetExtendedFlags(hwnd, TN_FLAG_ITEM_DRAG_SELECT | TN_FLAG_DAMAGE_TRACKING, TN_FLAG_ITEM_DRAG_SELECT | TN_FLAG_DAMAGE_TRACKING);
     SendMessage(TreeNew_GetTooltips(ProcessTreeListHandle), TTM_SETDELAYTIME, TTDT_AUTOPOP, MAXSHORT);
 
     TreeNew_SetCallback(hwnd, PhpProcessTreeNewCallback, NULL);
@@ -207,6 +379,12 @@ VOID PhInitializeProcessTreeList(
     PhAddTreeNewColumn(hwnd, PHPRTLC_APPID, FALSE, L"App ID", 160, PH_ALIGN_LEFT, -1, 0);
     PhAddTreeNewColumn(hwnd, PHPRTLC_DPIAWARENESS, FALSE, L"DPI Awareness", 110, PH_ALIGN_LEFT, -1, 0);
     PhAddTreeNewColumnEx(hwnd, PHPRTLC_CFGUARD, FALSE, L"CF Guard", 70, PH_ALIGN_LEFT, -1, 0, TRUE);
+    PhAddTreeNewColumnEx(hwnd, PHPRTLC_RUNNINGTHREADS, FALSE, L"Running Threads", 45, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumnEx(hwnd, PHPRTLC_READYTHREADS, FALSE, L"Ready Threads", 45, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumnEx(hwnd, PHPRTLC_WAITINGTHREADS, FALSE, L"Waiting Threads", 45, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumn(hwnd, PHPRTLC_TOPWAITREASON, FALSE, L"Top Wait Reason", 120, PH_ALIGN_LEFT, -1, 0);
+    PhAddTreeNewColumnEx(hwnd, PHPRTLC_HANDLEGROWTH, FALSE, L"Handle Growth", 70, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumnEx(hwnd, PHPRTLC_TOPHANDLEGROWTH, FALSE, L"Top Handle Growth", 140, PH_ALIGN_LEFT, -1, 0, TRUE);
 
     TreeNew_SetRedraw(hwnd, TRUE);
 
@@ -246,6 +424,7 @@ VOID PhLoadSettingsProcessTreeList(
     }
 
     PhpUpdateNeedCyclesInformation();
+    PhpUpdatePrefetchMask();
 }
 
 VOID PhSaveSettingsProcessTreeList(
@@ -277,21 +456,6 @@ struct _PH_TN_FILTER_SUPPORT *PhGetFilterSupportProcessTreeList(
     return &FilterSupport;
 }
 
-FORCEINLINE BOOLEAN PhCompareProcessNode(
-    _In_ PPH_PROCESS_NODE Value1,
-    _In_ PPH_PROCESS_NODE Value2
-    )
-{
-    return Value1->ProcessId == Value2->ProcessId;
-}
-
-FORCEINLINE ULONG PhHashProcessNode(
-    _In_ PPH_PROCESS_NODE Value
-    )
-{
-    return HandleToUlong(Value->ProcessId) / 4;
-}
-
 FORCEINLINE BOOLEAN PhpValidateParentCreateTime(
     _In_ PPH_PROCESS_NODE Child,
     _In_ PPH_PROCESS_NODE Parent
@@ -310,6 +474,7 @@ PPH_PROCESS_NODE PhAddProcessNode(
     PPH_PROCESS_NODE processNode;
     PPH_PROCESS_NODE parentNode;
     ULONG i;
+    ULONG j;
 
     processNode = PhAllocate(PhEmGetObjectSize(EmProcessNodeType, sizeof(PH_PROCESS_NODE)));
     memset(processNode, 0, sizeof(PH_PROCESS_NODE));
@@ -329,11 +494,14 @@ PPH_PROCESS_NODE PhAddProcessNode(
 
     processNode->ProcessId = ProcessItem->ProcessId;
     processNode->ProcessItem = ProcessItem;
+    processNode->HotData = ProcessItem->HotData;
     PhReferenceObject(ProcessItem);
 
     memset(processNode->TextCache, 0, sizeof(PH_STRINGREF) * PHPRTLC_MAXIMUM);
     processNode->Node.TextCache = processNode->TextCache;
     processNode->Node.TextCacheSize = PHPRTLC_MAXIMUM;
+    memset(processNode->TextCacheDirtyMask, 0, sizeof(processNode->TextCacheDirtyMask));
+    processNode->Node.TextCacheDirtyMask = processNode->TextCacheDirtyMask;
 
     processNode->Children = PhCreateList(1);
 
@@ -353,14 +521,16 @@ PPH_PROCESS_NODE PhAddProcessNode(
         PhAddItemList(ProcessNodeRootList, processNode);
     }
 
-    // Find this process' children and move them to this node.
+    // Find this process' children and move them to this node. The root list is compacted in the
+    // same pass.
 
-    for (i = 0; i < ProcessNodeRootList->Count; i++)
+    for (i = 0, j = 0; i < ProcessNodeRootList->Count; i++)
     {
         PPH_PROCESS_NODE node = ProcessNodeRootList->Items[i];
 
         if (
             node != processNode && // for cases where the parent PID = PID (e.g. System Idle Process)
+            !node->Removed &&
             node->ProcessItem->ParentProcessId == ProcessItem->ProcessId &&
             PhpValidateParentCreateTime(node, processNode)
             )
@@ -368,22 +538,19 @@ PPH_PROCESS_NODE PhAddProcessNode(
             node->Parent = processNode;
             PhAddItemList(processNode->Children, node);
         }
+        else
+        {
+            ProcessNodeRootList->Items[j++] = node;
+        }
     }
 
-    for (i = 0; i < processNode->Children->Count; i++)
-    {
-        PhRemoveItemList(
-            ProcessNodeRootList,
-            PhFindItemList(ProcessNodeRootList, processNode->Children->Items[i])
-            );
-    }
+    if (j != ProcessNodeRootList->Count)
+        PhRemoveItemsList(ProcessNodeRootList, j, ProcessNodeRootList->Count - j);
 
-    PhAddEntryHashSet(
-        ProcessNodeHashSet,
-        PH_HASH_SET_SIZE(ProcessNodeHashSet),
-        &processNode->HashEntry,
-        PhHashProcessNode(processNode)
-        );
+    // A node for a terminated process with the same PID may still be present. The new node takes
+    // precedence.
+    PhRemoveItemHandleIndex(&PhProcessNodeIndex, processNode->ProcessId);
+    PhAddItemHandleIndex(&PhProcessNodeIndex, processNode->ProcessId, processNode);
     PhAddItemList(ProcessNodeList, processNode);
 
     if (PhCsCollapseServicesOnStart)
@@ -425,6 +592,7 @@ PPH_PROCESS_NODE PhAddProcessNode(
 
     PhEmCallObjectOperation(EmProcessNodeType, processNode, EmObjectCreate);
 
+    ProcessNodeAggregateRunId++;
     TreeNew_NodesStructured(ProcessTreeListHandle);
 
     return processNode;
@@ -434,34 +602,16 @@ PPH_PROCESS_NODE PhFindProcessNode(
     _In_ HANDLE ProcessId
     )
 {
-    PH_PROCESS_NODE lookupNode;
-    PPH_HASH_ENTRY entry;
-    PPH_PROCESS_NODE node;
-
-    lookupNode.ProcessId = ProcessId;
-    entry = PhFindEntryHashSet(
-        ProcessNodeHashSet,
-        PH_HASH_SET_SIZE(ProcessNodeHashSet),
-        PhHashProcessNode(&lookupNode)
-        );
-
-    for (; entry; entry = entry->Next)
-    {
-        node = CONTAINING_RECORD(entry, PH_PROCESS_NODE, HashEntry);
-
-        if (PhCompareProcessNode(&lookupNode, node))
-            return node;
-    }
-
-    return NULL;
+    return PhFindItemHandleIndex(&PhProcessNodeIndex, ProcessId);
 }
 
 VOID PhRemoveProcessNode(
     _In_ PPH_PROCESS_NODE ProcessNode
     )
 {
-    // Remove from the hashtable here to avoid problems in case the key is re-used.
-    PhRemoveEntryHashSet(ProcessNodeHashSet, PH_HASH_SET_SIZE(ProcessNodeHashSet), &ProcessNode->HashEntry);
+    // Remove from the index here to avoid problems in case the key is re-used.
+    if (PhFindItemHandleIndex(&PhProcessNodeIndex, ProcessNode->ProcessId) == ProcessNode)
+        PhRemoveItemHandleIndex(&PhProcessNodeIndex, ProcessNode->ProcessId);
 
     if (PhProcessTreeListStateHighlighting)
     {
@@ -484,39 +634,56 @@ VOID PhpRemoveProcessNode(
     _In_ PPH_PROCESS_NODE ProcessNode
     )
 {
-    ULONG index;
     ULONG i;
 
     PhEmCallObjectOperation(EmProcessNodeType, ProcessNode, EmObjectDelete);
 
-    if (ProcessNode->Parent)
-    {
-        // Remove the node from its parent.
-
-        if ((index = PhFindItemList(ProcessNode->Parent->Children, ProcessNode)) != -1)
-            PhRemoveItemList(ProcessNode->Parent->Children, index);
-    }
-    else
-    {
-        // Remove the node from the root list.
-
-        if ((index = PhFindItemList(ProcessNodeRootList, ProcessNode)) != -1)
-            PhRemoveItemList(ProcessNodeRootList, index);
-    }
+    ProcessNodeAggregateRunId++;
 
     // Move the node's children to the root list.
     for (i = 0; i < ProcessNode->Children->Count; i++)
     {
         PPH_PROCESS_NODE node = ProcessNode->Children->Items[i];
 
+        if (node->Removed)
+            continue;
+
         node->Parent = NULL;
         PhAddItemList(ProcessNodeRootList, node);
     }
 
-    // Remove from list and cleanup.
+    // Searching the lists for each node is quadratic when many processes exit at once, so the node
+    // is only marked here. The lists are compacted in one pass by PhpFlushRemovedProcessNodes.
+    ProcessNode->Removed = TRUE;
+    PhAddItemList(ProcessNodeRemovedList, ProcessNode);
+
+    TreeNew_NodesStructured(ProcessTreeListHandle);
+}
+
+static VOID PhpCompactProcessNodeList(
+    _Inout_ PPH_LIST List
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    for (i = 0, j = 0; i < List->Count; i++)
+    {
+        PPH_PROCESS_NODE node = List->Items[i];
+
+        if (!node->Removed)
+            List->Items[j++] = node;
+    }
+
+    if (j != List->Count)
+        PhRemoveItemsList(List, j, List->Count - j);
+}
 
-    if ((index = PhFindItemList(ProcessNodeList, ProcessNode)) != -1)
-        PhRemoveItemList(ProcessNodeList, index);
+static VOID PhpDestroyProcessNode(
+    _In_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    ULONG i;
 
     PhDereferenceObject(ProcessNode->Children);
 
@@ -525,7 +692,6 @@ VOID PhpRemoveProcessNode(
 
     if (ProcessNode->TooltipText) PhDereferenceObject(ProcessNode->TooltipText);
 
-    if (ProcessNode->IoTotalRateText) PhDereferenceObject(ProcessNode->IoTotalRateText);
     if (ProcessNode->PrivateBytesText) PhDereferenceObject(ProcessNode->PrivateBytesText);
     if (ProcessNode->PeakPrivateBytesText) PhDereferenceObject(ProcessNode->PeakPrivateBytesText);
     if (ProcessNode->WorkingSetText) PhDereferenceObject(ProcessNode->WorkingSetText);
@@ -536,10 +702,7 @@ VOID PhpRemoveProcessNode(
     if (ProcessNode->VirtualSizeText) PhDereferenceObject(ProcessNode->VirtualSizeText);
     if (ProcessNode->PeakVirtualSizeText) PhDereferenceObject(ProcessNode->PeakVirtualSizeText);
     if (ProcessNode->PageFaultsText) PhDereferenceObject(ProcessNode->PageFaultsText);
-    if (ProcessNode->IoRoRateText) PhDereferenceObject(ProcessNode->IoRoRateText);
-    if (ProcessNode->IoWRateText) PhDereferenceObject(ProcessNode->IoWRateText);
     if (ProcessNode->StartTimeText) PhDereferenceObject(ProcessNode->StartTimeText);
-    if (ProcessNode->RelativeStartTimeText) PhDereferenceObject(ProcessNode->RelativeStartTimeText);
     if (ProcessNode->WindowTitleText) PhDereferenceObject(ProcessNode->WindowTitleText);
     if (ProcessNode->CyclesText) PhDereferenceObject(ProcessNode->CyclesText);
     if (ProcessNode->CyclesDeltaText) PhDereferenceObject(ProcessNode->CyclesDeltaText);
@@ -556,7 +719,6 @@ VOID PhpRemoveProcessNode(
     if (ProcessNode->PeakNonPagedPoolText) PhDereferenceObject(ProcessNode->PeakNonPagedPoolText);
     if (ProcessNode->MinimumWorkingSetText) PhDereferenceObject(ProcessNode->MinimumWorkingSetText);
     if (ProcessNode->MaximumWorkingSetText) PhDereferenceObject(ProcessNode->MaximumWorkingSetText);
-    if (ProcessNode->PrivateBytesDeltaText) PhDereferenceObject(ProcessNode->PrivateBytesDeltaText);
 
     PhDeleteGraphBuffers(&ProcessNode->CpuGraphBuffers);
     PhDeleteGraphBuffers(&ProcessNode->PrivateGraphBuffers);
@@ -565,15 +727,48 @@ VOID PhpRemoveProcessNode(
     PhDereferenceObject(ProcessNode->ProcessItem);
 
     PhFree(ProcessNode);
+}
 
-    TreeNew_NodesStructured(ProcessTreeListHandle);
+VOID PhpFlushRemovedProcessNodes(
+    VOID
+    )
+{
+    ULONG i;
+
+    if (ProcessNodeRemovedList->Count == 0)
+        return;
+
+    PhpCompactProcessNodeList(ProcessNodeList);
+    PhpCompactProcessNodeList(ProcessNodeRootList);
+
+    for (i = 0; i < ProcessNodeList->Count; i++)
+    {
+        PPH_PROCESS_NODE node = ProcessNodeList->Items[i];
+
+        if (node->Children->Count != 0)
+            PhpCompactProcessNodeList(node->Children);
+    }
+
+    for (i = 0; i < ProcessNodeRemovedList->Count; i++)
+        PhpDestroyProcessNode(ProcessNodeRemovedList->Items[i]);
+
+    PhClearList(ProcessNodeRemovedList);
 }
 
 VOID PhUpdateProcessNode(
     _In_ PPH_PROCESS_NODE ProcessNode
     )
 {
-    memset(ProcessNode->TextCache, 0, sizeof(PH_STRINGREF) * PHPRTLC_MAXIMUM);
+    ULONG i;
+
+    PhInvalidateTreeNewNodeText(&ProcessNode->Node, NULL);
+    ProcessNodeAggregateRunId++;
+
+    for (i = 0; i < PHPN_FIELD_COUNT; i++)
+    {
+        if (ProcessNodeFieldPolicies[i].RefreshPolicy == PHP_REFRESH_ON_CHANGE)
+            ProcessNode->ValidMask &= ~((ULONG)1 << i);
+    }
 
     if (ProcessNode->TooltipText)
     {
@@ -590,9 +785,42 @@ VOID PhTickProcessNodes(
     )
 {
     ULONG i;
-    PH_TREENEW_VIEW_PARTS viewParts;
     BOOLEAN fullyInvalidated;
-    RECT rect;
+    ULONG refreshMask;
+    PPHP_PREFETCH_BATCH prefetchBatch;
+
+    PhpFlushRemovedProcessNodes();
+
+    // The process items have new statistics.
+    ProcessNodeAggregateRunId++;
+    ProcessNodeUpdateCount++;
+
+    // Determine which values are due to be queried again.
+
+    refreshMask = 0;
+
+    for (i = 0; i < PHPN_FIELD_COUNT; i++)
+    {
+        switch (ProcessNodeFieldPolicies[i].RefreshPolicy)
+        {
+        case PHP_REFRESH_EVERY_UPDATE:
+            refreshMask |= (ULONG)1 << i;
+            break;
+        case PHP_REFRESH_INTERVAL:
+            if (ProcessNodeUpdateCount % ProcessNodeFieldPolicies[i].RefreshInterval == 0)
+                refreshMask |= (ULONG)1 << i;
+            break;
+        }
+    }
+
+    // Record the nodes whose optional column data should be queried on the worker thread.
+    prefetchBatch = PhpCreatePrefetchBatch(refreshMask);
+
+    // Window columns look up the main window of each process; enumerate the windows
+    // again at most once per update.
+    PhInvalidateWindowSnapshot();
+    PhInvalidateGdiHandleSnapshot();
+    PhInvalidateProcessGroups();
 
     // Text invalidation, node updates
 
@@ -600,9 +828,9 @@ VOID PhTickProcessNodes(
     {
         PPH_PROCESS_NODE node = ProcessNodeList->Items[i];
 
-        // The name and PID never change, so we don't invalidate that.
-        memset(&node->TextCache[2], 0, sizeof(PH_STRINGREF) * (PHPRTLC_MAXIMUM - 2));
-        node->ValidMask &= PHPN_OSCONTEXT | PHPN_IMAGE | PHPN_DPIAWARENESS; // Items that always remain valid
+        // Only invalidate columns which can change without the process item being modified.
+        PhInvalidateTreeNewNodeText(&node->Node, VolatileTextMask);
+        node->ValidMask &= ~refreshMask;
 
         // Invalidate graph buffers.
         node->CpuGraphBuffers.Valid = FALSE;
@@ -614,6 +842,9 @@ VOID PhTickProcessNodes(
             PhpUpdateProcessNodeCycles(node);
     }
 
+    if (prefetchBatch)
+        PhpQueuePrefetchBatch(prefetchBatch);
+
     fullyInvalidated = FALSE;
 
     if (ProcessTreeListSortOrder != NoSortOrder)
@@ -625,18 +856,13 @@ VOID PhTickProcessNodes(
 
     // State highlighting
     PH_TICK_SH_STATE_TN(PH_PROCESS_NODE, ShState, ProcessNodeStateList, PhpRemoveProcessNode, PhCsHighlightingDuration, ProcessTreeListHandle, TRUE, &fullyInvalidated);
+    PhpFlushRemovedProcessNodes();
 
     if (!fullyInvalidated)
     {
-        // The first column doesn't need to be invalidated because the process name never changes, and
-        // icon changes are handled by the modified event. This small optimization can save more than
-        // 10 million cycles per update (on my machine).
-        TreeNew_GetViewParts(ProcessTreeListHandle, &viewParts);
-        rect.left = viewParts.NormalLeft;
-        rect.top = viewParts.HeaderHeight;
-        rect.right = viewParts.ClientRect.right - viewParts.VScrollWidth;
-        rect.bottom = viewParts.ClientRect.bottom;
-        InvalidateRect(ProcessTreeListHandle, &rect, FALSE);
+        // Only repaint the cells whose text actually changed. Most columns of most processes stay
+        // the same between updates, so this avoids redrawing nearly the entire list every tick.
+        TreeNew_InvalidateChangedCells(ProcessTreeListHandle);
     }
 }
 
@@ -684,13 +910,9 @@ static BOOLEAN PhpFormatInt32GroupDigits(
     _Out_opt_ PPH_STRINGREF String
     )
 {
-    PH_FORMAT format;
     SIZE_T returnLength;
 
-    PhInitFormatU(&format, Value);
-    format.Type |= FormatGroupDigits;
-
-    if (PhFormatToBuffer(&format, 1, Buffer, BufferLength, &returnLength))
+    if (PhFormatUInt64ToBuffer(Value, TRUE, Buffer, BufferLength, &returnLength))
     {
         if (String)
         {
@@ -706,27 +928,44 @@ static BOOLEAN PhpFormatInt32GroupDigits(
     }
 }
 
-FORCEINLINE PVOID PhpFieldForAggregate(
-    _In_ PPH_PROCESS_NODE ProcessNode,
-    _In_ PHP_AGGREGATE_LOCATION Location,
-    _In_ SIZE_T FieldOffset
+static BOOLEAN PhpFormatSizeRate(
+    _In_ ULONG64 Value,
+    _Out_writes_bytes_(BufferLength) PWCHAR Buffer,
+    _In_ ULONG BufferLength,
+    _Out_opt_ PPH_STRINGREF String
     )
 {
-    PVOID object;
+    SIZE_T returnLength;
 
-    switch (Location)
+    if (PhFormatSizeToBuffer(Value, -1, Buffer, BufferLength, &returnLength) &&
+        returnLength + 2 * sizeof(WCHAR) <= BufferLength)
     {
-    case AggregateLocationProcessNode:
-        object = ProcessNode;
-        break;
-    case AggregateLocationProcessItem:
-        object = ProcessNode->ProcessItem;
-        break;
-    default:
-        PhRaiseStatus(STATUS_INVALID_PARAMETER);
+        PWCHAR end = Buffer + returnLength / sizeof(WCHAR) - 1;
+
+        end[0] = '/';
+        end[1] = 's';
+        end[2] = 0;
+
+        if (String)
+        {
+            String->Buffer = Buffer;
+            String->Length = returnLength + sizeof(WCHAR); // plus "/s", minus null terminator
+        }
+
+        return TRUE;
+    }
+    else
+    {
+        return FALSE;
     }
+}
 
-    return PTR_ADD_OFFSET(object, FieldOffset);
+FORCEINLINE PVOID PhpFieldForAggregate(
+    _In_ PPH_PROCESS_NODE ProcessNode,
+    _In_ PHP_AGGREGATE_FIELD Field
+    )
+{
+    return PTR_ADD_OFFSET(ProcessNode->ProcessItem, PhpAggregateFields[Field].FieldOffset);
 }
 
 FORCEINLINE VOID PhpAccumulateField(
@@ -752,172 +991,347 @@ FORCEINLINE VOID PhpAccumulateField(
     }
 }
 
-static VOID PhpAggregateField(
-    _In_ PPH_PROCESS_NODE ProcessNode,
-    _In_ PHP_AGGREGATE_TYPE Type,
-    _In_ PHP_AGGREGATE_LOCATION Location,
-    _In_ SIZE_T FieldOffset,
-    _Inout_ PVOID AggregatedValue
+static VOID PhpComputeAggregateValues(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
     )
 {
     ULONG i;
+    ULONG j;
 
-    PhpAccumulateField(AggregatedValue, PhpFieldForAggregate(ProcessNode, Location, FieldOffset), Type);
+    for (j = 0; j < AggregateFieldMaximum; j++)
+    {
+        ProcessNode->AggregateValues[j] = 0;
+        PhpAccumulateField(&ProcessNode->AggregateValues[j], PhpFieldForAggregate(ProcessNode, j), PhpAggregateFields[j].Type);
+    }
 
     for (i = 0; i < ProcessNode->Children->Count; i++)
     {
-        PhpAggregateField(ProcessNode->Children->Items[i], Type, Location, FieldOffset, AggregatedValue);
+        PPH_PROCESS_NODE childNode = ProcessNode->Children->Items[i];
+
+        PhpComputeAggregateValues(childNode);
+
+        for (j = 0; j < AggregateFieldMaximum; j++)
+            PhpAccumulateField(&ProcessNode->AggregateValues[j], &childNode->AggregateValues[j], PhpAggregateFields[j].Type);
     }
 }
 
+/**
+ * Makes sure that the aggregated values of all nodes are up to date.
+ *
+ * \remarks The sums for every subtree are computed bottom-up in a single pass over the
+ * tree, at most once per update, and only when a collapsed node actually needs them.
+ */
+static VOID PhpUpdateAggregateValues(
+    VOID
+    )
+{
+    ULONG i;
+
+    if (ProcessNodeAggregateValidRunId == ProcessNodeAggregateRunId)
+        return;
+
+    PhpFlushRemovedProcessNodes();
+
+    for (i = 0; i < ProcessNodeRootList->Count; i++)
+        PhpComputeAggregateValues(ProcessNodeRootList->Items[i]);
+
+    ProcessNodeAggregateValidRunId = ProcessNodeAggregateRunId;
+}
+
 static VOID PhpAggregateFieldIfNeeded(
     _In_ PPH_PROCESS_NODE ProcessNode,
-    _In_ PHP_AGGREGATE_TYPE Type,
-    _In_ PHP_AGGREGATE_LOCATION Location,
-    _In_ SIZE_T FieldOffset,
+    _In_ PHP_AGGREGATE_FIELD Field,
     _Inout_ PVOID AggregatedValue
     )
 {
     if (!PhCsPropagateCpuUsage || ProcessNode->Node.Expanded || ProcessTreeListSortOrder != NoSortOrder)
     {
-        PhpAccumulateField(AggregatedValue, PhpFieldForAggregate(ProcessNode, Location, FieldOffset), Type);
+        PhpAccumulateField(AggregatedValue, PhpFieldForAggregate(ProcessNode, Field), PhpAggregateFields[Field].Type);
     }
     else
     {
-        PhpAggregateField(ProcessNode, Type, Location, FieldOffset, AggregatedValue);
+        PhpUpdateAggregateValues();
+        PhpAccumulateField(AggregatedValue, &ProcessNode->AggregateValues[Field], PhpAggregateFields[Field].Type);
     }
 }
 
-static VOID PhpUpdateProcessNodeWsCounters(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static VOID PhpRecordNodeFieldQuery(
+    _Inout_updates_(PHPN_FIELD_COUNT) PPHP_NODE_FIELD_COST Costs,
+    _In_ ULONG Mask,
+    _In_ PLARGE_INTEGER StartCounter
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_WSCOUNTERS))
-    {
-        BOOLEAN success = FALSE;
-        HANDLE processHandle;
-
-        if (NT_SUCCESS(PhOpenProcess(
-            &processHandle,
-            PROCESS_QUERY_INFORMATION,
-            ProcessNode->ProcessItem->ProcessId
-            )))
-        {
-            if (NT_SUCCESS(PhGetProcessWsCounters(
-                processHandle,
-                &ProcessNode->WsCounters
-                )))
-                success = TRUE;
+    LARGE_INTEGER endCounter;
+    ULONG index;
 
-            NtClose(processHandle);
-        }
+    NtQueryPerformanceCounter(&endCounter, NULL);
+    _BitScanForward(&index, Mask);
 
-        if (!success)
-            memset(&ProcessNode->WsCounters, 0, sizeof(PH_PROCESS_WS_COUNTERS));
+    Costs[index].NumberOfQueries++;
+    Costs[index].QueryTime += endCounter.QuadPart - StartCounter->QuadPart;
+}
 
-        ProcessNode->ValidMask |= PHPN_WSCOUNTERS;
-    }
+static VOID PhpQueryProcessWsCounters(
+    _In_opt_ HANDLE ProcessHandle,
+    _Out_ PPH_PROCESS_WS_COUNTERS WsCounters
+    )
+{
+    if (!ProcessHandle || !NT_SUCCESS(PhGetProcessWsCounters(ProcessHandle, WsCounters)))
+        memset(WsCounters, 0, sizeof(PH_PROCESS_WS_COUNTERS));
 }
 
-static VOID PhpUpdateProcessNodeGdiUserHandles(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static VOID PhpQueryProcessGdiUserHandles(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _Out_ PULONG GdiHandles,
+    _Out_ PULONG UserHandles
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_GDIUSERHANDLES))
+    PPH_GDI_HANDLE_SNAPSHOT snapshot;
+    PULONG handles;
+    ULONG numberOfHandles;
+
+    if (ProcessItem->QueryHandle)
     {
-        if (ProcessNode->ProcessItem->QueryHandle)
-        {
-            ProcessNode->GdiHandles = GetGuiResources(ProcessNode->ProcessItem->QueryHandle, GR_GDIOBJECTS);
-            ProcessNode->UserHandles = GetGuiResources(ProcessNode->ProcessItem->QueryHandle, GR_USEROBJECTS);
-        }
+        // Processes in our session are counted from the shared GDI handle table, which is read
+        // once per update for all of them.
+        snapshot = PhReferenceGdiHandleSnapshot();
+
+        if (PhFindGdiHandlesSnapshot(snapshot, ProcessItem->ProcessId, ProcessItem->SessionId, &handles, &numberOfHandles))
+            *GdiHandles = numberOfHandles;
         else
-        {
-            ProcessNode->GdiHandles = 0;
-            ProcessNode->UserHandles = 0;
-        }
+            *GdiHandles = GetGuiResources(ProcessItem->QueryHandle, GR_GDIOBJECTS);
 
-        ProcessNode->ValidMask |= PHPN_GDIUSERHANDLES;
+        PhDereferenceObject(snapshot);
+
+        *UserHandles = GetGuiResources(ProcessItem->QueryHandle, GR_USEROBJECTS);
+    }
+    else
+    {
+        *GdiHandles = 0;
+        *UserHandles = 0;
     }
 }
 
-static VOID PhpUpdateProcessNodeIoPagePriority(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static VOID PhpQueryProcessIoPagePriority(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _Out_ PULONG IoPriority,
+    _Out_ PULONG PagePriority
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_IOPAGEPRIORITY))
+    if (ProcessItem->QueryHandle)
     {
-        if (ProcessNode->ProcessItem->QueryHandle)
-        {
-            if (!NT_SUCCESS(PhGetProcessIoPriority(ProcessNode->ProcessItem->QueryHandle, &ProcessNode->IoPriority)))
-                ProcessNode->IoPriority = -1;
-            if (!NT_SUCCESS(PhGetProcessPagePriority(ProcessNode->ProcessItem->QueryHandle, &ProcessNode->PagePriority)))
-                ProcessNode->PagePriority = -1;
-        }
-        else
-        {
-            ProcessNode->IoPriority = -1;
-            ProcessNode->PagePriority = -1;
-        }
-
-        ProcessNode->ValidMask |= PHPN_IOPAGEPRIORITY;
+        if (!NT_SUCCESS(PhGetProcessIoPriority(ProcessItem->QueryHandle, IoPriority)))
+            *IoPriority = -1;
+        if (!NT_SUCCESS(PhGetProcessPagePriority(ProcessItem->QueryHandle, PagePriority)))
+            *PagePriority = -1;
+    }
+    else
+    {
+        *IoPriority = -1;
+        *PagePriority = -1;
     }
 }
 
-static VOID PhpUpdateProcessNodeWindow(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+FORCEINLINE BOOLEAN PhpNeedsProcessHandleForDepStatus(
+    _In_ PPH_PROCESS_ITEM ProcessItem
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_WINDOW))
+#ifdef _WIN64
+    return !!ProcessItem->IsWow64;
+#else
+    return TRUE;
+#endif
+}
+
+static VOID PhpQueryProcessDepStatus(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_opt_ HANDLE ProcessHandle,
+    _Out_ PULONG DepStatus
+    )
+{
+    *DepStatus = 0;
+
+    if (PhpNeedsProcessHandleForDepStatus(ProcessItem))
     {
-        ProcessNode->WindowHandle = PhGetProcessMainWindow(ProcessNode->ProcessId, ProcessNode->ProcessItem->QueryHandle);
+        if (ProcessHandle)
+            PhGetProcessDepStatus(ProcessHandle, DepStatus);
+    }
+    else
+    {
+        if (ProcessItem->QueryHandle)
+            *DepStatus = PH_PROCESS_DEP_ENABLED | PH_PROCESS_DEP_PERMANENT;
+    }
+}
 
-        PhClearReference(&ProcessNode->WindowText);
+static VOID PhpQueryProcessTokenVirtualization(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _Out_ PBOOLEAN VirtualizationAllowed,
+    _Out_ PBOOLEAN VirtualizationEnabled
+    )
+{
+    HANDLE tokenHandle;
+    PH_TOKEN_CACHE_INFORMATION tokenInformation;
 
-        if (ProcessNode->WindowHandle)
+    *VirtualizationAllowed = FALSE;
+    *VirtualizationEnabled = FALSE;
+
+    if (WINDOWS_HAS_UAC && ProcessItem->QueryHandle)
+    {
+        if (NT_SUCCESS(PhOpenProcessToken(
+            &tokenHandle,
+            TOKEN_QUERY,
+            ProcessItem->QueryHandle
+            )))
         {
-            PhGetWindowTextEx(ProcessNode->WindowHandle, PH_GET_WINDOW_TEXT_INTERNAL, &ProcessNode->WindowText);
-            ProcessNode->WindowHung = !!IsHungAppWindow(ProcessNode->WindowHandle);
-        }
+            // Both are FALSE (N/A) on error.
+            PhQueryTokenCache(tokenHandle, PH_TOKEN_CACHE_VIRTUALIZATION, &tokenInformation);
+            *VirtualizationAllowed = tokenInformation.VirtualizationAllowed;
+            *VirtualizationEnabled = tokenInformation.VirtualizationEnabled;
 
-        ProcessNode->ValidMask |= PHPN_WINDOW;
+            NtClose(tokenHandle);
+        }
     }
 }
 
-static VOID PhpUpdateProcessNodeDepStatus(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static VOID PhpQueryProcessQuotaLimits(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _Out_ PSIZE_T MinimumWorkingSetSize,
+    _Out_ PSIZE_T MaximumWorkingSetSize
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_DEPSTATUS))
+    QUOTA_LIMITS quotaLimits;
+
+    if (ProcessItem->QueryHandle && NT_SUCCESS(NtQueryInformationProcess(
+        ProcessItem->QueryHandle,
+        ProcessQuotaLimits,
+        &quotaLimits,
+        sizeof(QUOTA_LIMITS),
+        NULL
+        )))
     {
-        HANDLE processHandle;
-        ULONG depStatus;
+        *MinimumWorkingSetSize = quotaLimits.MinimumWorkingSetSize;
+        *MaximumWorkingSetSize = quotaLimits.MaximumWorkingSetSize;
+    }
+    else
+    {
+        *MinimumWorkingSetSize = 0;
+        *MaximumWorkingSetSize = 0;
+    }
+}
 
-        depStatus = 0;
+static VOID PhpUpdateProcessNodeWsCounters(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_WSCOUNTERS))
+    {
+        LARGE_INTEGER startCounter;
+        HANDLE processHandle;
 
-#ifdef _WIN64
-        if (ProcessNode->ProcessItem->IsWow64)
-#else
-        if (TRUE)
-#endif
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        if (!NT_SUCCESS(PhOpenProcess(
+            &processHandle,
+            PROCESS_QUERY_INFORMATION,
+            ProcessNode->ProcessItem->ProcessId
+            )))
+            processHandle = NULL;
+
+        PhpQueryProcessWsCounters(processHandle, &ProcessNode->WsCounters);
+
+        if (processHandle)
+            NtClose(processHandle);
+
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_WSCOUNTERS, &startCounter);
+        ProcessNode->ValidMask |= PHPN_WSCOUNTERS;
+    }
+}
+
+static VOID PhpUpdateProcessNodeGdiUserHandles(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_GDIUSERHANDLES))
+    {
+        LARGE_INTEGER startCounter;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        PhpQueryProcessGdiUserHandles(ProcessNode->ProcessItem, &ProcessNode->GdiHandles, &ProcessNode->UserHandles);
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_GDIUSERHANDLES, &startCounter);
+        ProcessNode->ValidMask |= PHPN_GDIUSERHANDLES;
+    }
+}
+
+static VOID PhpUpdateProcessNodeIoPagePriority(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_IOPAGEPRIORITY))
+    {
+        LARGE_INTEGER startCounter;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        PhpQueryProcessIoPagePriority(ProcessNode->ProcessItem, &ProcessNode->IoPriority, &ProcessNode->PagePriority);
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_IOPAGEPRIORITY, &startCounter);
+        ProcessNode->ValidMask |= PHPN_IOPAGEPRIORITY;
+    }
+}
+
+static VOID PhpUpdateProcessNodeWindow(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_WINDOW))
+    {
+        LARGE_INTEGER startCounter;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        ProcessNode->WindowHandle = PhGetProcessMainWindow(ProcessNode->ProcessId, ProcessNode->ProcessItem->QueryHandle);
+
+        PhClearReference(&ProcessNode->WindowText);
+
+        if (ProcessNode->WindowHandle)
+        {
+            PhGetWindowTextEx(ProcessNode->WindowHandle, PH_GET_WINDOW_TEXT_INTERNAL, &ProcessNode->WindowText);
+            ProcessNode->WindowHung = !!IsHungAppWindow(ProcessNode->WindowHandle);
+        }
+
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_WINDOW, &startCounter);
+        ProcessNode->ValidMask |= PHPN_WINDOW;
+    }
+}
+
+static VOID PhpUpdateProcessNodeDepStatus(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_DEPSTATUS))
+    {
+        LARGE_INTEGER startCounter;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        HANDLE processHandle = NULL;
+
+        if (PhpNeedsProcessHandleForDepStatus(ProcessNode->ProcessItem))
         {
-            if (NT_SUCCESS(PhOpenProcess(
+            if (!NT_SUCCESS(PhOpenProcess(
                 &processHandle,
                 PROCESS_QUERY_INFORMATION,
                 ProcessNode->ProcessItem->ProcessId
                 )))
-            {
-                PhGetProcessDepStatus(processHandle, &depStatus);
-                NtClose(processHandle);
-            }
-        }
-        else
-        {
-            if (ProcessNode->ProcessItem->QueryHandle)
-                depStatus = PH_PROCESS_DEP_ENABLED | PH_PROCESS_DEP_PERMANENT;
+                processHandle = NULL;
         }
 
-        ProcessNode->DepStatus = depStatus;
+        PhpQueryProcessDepStatus(ProcessNode->ProcessItem, processHandle, &ProcessNode->DepStatus);
+
+        if (processHandle)
+            NtClose(processHandle);
 
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_DEPSTATUS, &startCounter);
         ProcessNode->ValidMask |= PHPN_DEPSTATUS;
     }
 }
@@ -928,32 +1342,16 @@ static VOID PhpUpdateProcessNodeToken(
 {
     if (!(ProcessNode->ValidMask & PHPN_TOKEN))
     {
-        HANDLE tokenHandle;
-
-        ProcessNode->VirtualizationAllowed = FALSE;
-        ProcessNode->VirtualizationEnabled = FALSE;
-
-        if (WINDOWS_HAS_UAC && ProcessNode->ProcessItem->QueryHandle)
-        {
-            if (NT_SUCCESS(PhOpenProcessToken(
-                &tokenHandle,
-                TOKEN_QUERY,
-                ProcessNode->ProcessItem->QueryHandle
-                )))
-            {
-                if (NT_SUCCESS(PhGetTokenIsVirtualizationAllowed(tokenHandle, &ProcessNode->VirtualizationAllowed)) &&
-                    ProcessNode->VirtualizationAllowed)
-                {
-                    if (!NT_SUCCESS(PhGetTokenIsVirtualizationEnabled(tokenHandle, &ProcessNode->VirtualizationEnabled)))
-                    {
-                        ProcessNode->VirtualizationAllowed = FALSE; // display N/A on error
-                    }
-                }
+        LARGE_INTEGER startCounter;
 
-                NtClose(tokenHandle);
-            }
-        }
+        NtQueryPerformanceCounter(&startCounter, NULL);
 
+        PhpQueryProcessTokenVirtualization(
+            ProcessNode->ProcessItem,
+            &ProcessNode->VirtualizationAllowed,
+            &ProcessNode->VirtualizationEnabled
+            );
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_TOKEN, &startCounter);
         ProcessNode->ValidMask |= PHPN_TOKEN;
     }
 }
@@ -964,8 +1362,11 @@ static VOID PhpUpdateProcessOsContext(
 {
     if (!(ProcessNode->ValidMask & PHPN_OSCONTEXT))
     {
+        LARGE_INTEGER startCounter;
         HANDLE processHandle;
 
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
         if (WindowsVersion >= WINDOWS_7)
         {
             if (NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess | PROCESS_VM_READ, ProcessNode->ProcessId)))
@@ -990,6 +1391,7 @@ static VOID PhpUpdateProcessOsContext(
             }
         }
 
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_OSCONTEXT, &startCounter);
         ProcessNode->ValidMask |= PHPN_OSCONTEXT;
     }
 }
@@ -1000,840 +1402,1546 @@ static VOID PhpUpdateProcessNodeQuotaLimits(
 {
     if (!(ProcessNode->ValidMask & PHPN_QUOTALIMITS))
     {
-        QUOTA_LIMITS quotaLimits;
+        LARGE_INTEGER startCounter;
 
-        if (ProcessNode->ProcessItem->QueryHandle && NT_SUCCESS(NtQueryInformationProcess(
-            ProcessNode->ProcessItem->QueryHandle,
-            ProcessQuotaLimits,
-            &quotaLimits,
-            sizeof(QUOTA_LIMITS),
-            NULL
-            )))
-        {
-            ProcessNode->MinimumWorkingSetSize = quotaLimits.MinimumWorkingSetSize;
-            ProcessNode->MaximumWorkingSetSize = quotaLimits.MaximumWorkingSetSize;
-        }
-        else
-        {
-            ProcessNode->MinimumWorkingSetSize = 0;
-            ProcessNode->MaximumWorkingSetSize = 0;
-        }
+        NtQueryPerformanceCounter(&startCounter, NULL);
 
+        PhpQueryProcessQuotaLimits(
+            ProcessNode->ProcessItem,
+            &ProcessNode->MinimumWorkingSetSize,
+            &ProcessNode->MaximumWorkingSetSize
+            );
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_QUOTALIMITS, &startCounter);
         ProcessNode->ValidMask |= PHPN_QUOTALIMITS;
     }
 }
 
-static VOID PhpUpdateProcessNodeImage(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static VOID PhpUpdatePrefetchMask(
+    VOID
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_IMAGE))
-    {
-        HANDLE processHandle;
-        PROCESS_BASIC_INFORMATION basicInfo;
-        PVOID imageBaseAddress;
-        PH_REMOTE_MAPPED_IMAGE mappedImage;
+    PH_TREENEW_COLUMN column;
+    ULONG i;
 
-        if (NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess | PROCESS_VM_READ, ProcessNode->ProcessId)))
-        {
-            if (NT_SUCCESS(PhGetProcessBasicInformation(processHandle, &basicInfo)))
-            {
-                if (NT_SUCCESS(PhReadVirtualMemory(
-                    processHandle,
-                    PTR_ADD_OFFSET(basicInfo.PebBaseAddress, FIELD_OFFSET(PEB, ImageBaseAddress)),
-                    &imageBaseAddress,
-                    sizeof(PVOID),
-                    NULL
-                    )))
-                {
-                    if (NT_SUCCESS(PhLoadRemoteMappedImage(processHandle, imageBaseAddress, &mappedImage)))
-                    {
-                        ProcessNode->ImageCharacteristics = mappedImage.NtHeaders->FileHeader.Characteristics;
+    PrefetchMask = 0;
+    PrefetchSortColumn = FALSE;
+    memset(PrefetchTextMask, 0, sizeof(PrefetchTextMask));
 
-                        if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-                        {
-                            ProcessNode->ImageSubsystem = ((PIMAGE_OPTIONAL_HEADER32)&mappedImage.NtHeaders->OptionalHeader)->Subsystem;
-                            ProcessNode->ImageDllCharacteristics = ((PIMAGE_OPTIONAL_HEADER32)&mappedImage.NtHeaders->OptionalHeader)->DllCharacteristics;
-                        }
-                        else if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
-                        {
-                            ProcessNode->ImageSubsystem = ((PIMAGE_OPTIONAL_HEADER64)&mappedImage.NtHeaders->OptionalHeader)->Subsystem;
-                            ProcessNode->ImageDllCharacteristics = ((PIMAGE_OPTIONAL_HEADER64)&mappedImage.NtHeaders->OptionalHeader)->DllCharacteristics;
-                        }
+    for (i = 0; i < RTL_NUMBER_OF(ProcessNodeColumnFields); i++)
+    {
+        ULONG id = ProcessNodeColumnFields[i][0];
+        ULONG mask = ProcessNodeColumnFields[i][1];
 
-                        PhUnloadRemoteMappedImage(&mappedImage);
-                    }
-                }
-            }
+        if (!(mask & PHPN_PREFETCH_MASK))
+            continue;
+        if (id == PHPRTLC_PRIVATEWS && WindowsVersion >= WINDOWS_7)
+            continue;
 
-            NtClose(processHandle);
-        }
+        if (!TreeNew_GetColumn(ProcessTreeListHandle, id, &column) || !column.Visible)
+            continue;
 
-        ProcessNode->ValidMask |= PHPN_IMAGE;
+        PrefetchMask |= mask;
+        PrefetchTextMask[id / 32] |= (ULONG)1 << (id % 32);
+
+        if (ProcessTreeListSortOrder != NoSortOrder && ProcessTreeListSortColumn == id)
+            PrefetchSortColumn = TRUE;
     }
 }
 
-static VOID PhpUpdateProcessNodeAppId(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
+static PPHP_PREFETCH_BATCH PhpCreatePrefetchBatch(
+    _In_ ULONG RefreshMask
     )
 {
-    if (!(ProcessNode->ValidMask & PHPN_APPID))
-    {
-        HANDLE processHandle;
-        ULONG windowFlags;
-        PPH_STRING windowTitle;
+    PPHP_PREFETCH_BATCH batch;
+    PPH_PROCESS_NODE *nodes;
+    ULONG numberOfNodes;
+    ULONG i;
 
-        PhClearReference(&ProcessNode->AppIdText);
+    if (!(PrefetchMask & RefreshMask))
+        return NULL;
 
-        if (!NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess | PROCESS_VM_READ, ProcessNode->ProcessId)))
-        {
-            if (WindowsVersion >= WINDOWS_7)
-            {
-                if (!NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess, ProcessNode->ProcessId)))
-                    goto Done;
-            }
-            else
-            {
-                goto Done;
-            }
-        }
+    if (PrefetchSortColumn)
+    {
+        // Sorting needs the values for every node.
+        nodes = (PPH_PROCESS_NODE *)ProcessNodeList->Items;
+        numberOfNodes = ProcessNodeList->Count;
+        batch = PhAllocate(FIELD_OFFSET(PHP_PREFETCH_BATCH, Items) + max(numberOfNodes, 1) * sizeof(PHP_PREFETCH_ITEM));
+        batch->NumberOfItems = 0;
 
-        if (NT_SUCCESS(PhGetProcessWindowTitle(
-            processHandle,
-            &windowFlags,
-            &windowTitle
-            )))
+        for (i = 0; i < numberOfNodes; i++)
         {
-            if (windowFlags & STARTF_TITLEISAPPID)
-                ProcessNode->AppIdText = windowTitle;
-            else
-                PhDereferenceObject(windowTitle);
+            batch->Items[batch->NumberOfItems].ProcessItem = nodes[i]->ProcessItem;
+            batch->Items[batch->NumberOfItems].OldValidMask = nodes[i]->ValidMask;
+            batch->NumberOfItems++;
         }
+    }
+    else
+    {
+        PH_TREENEW_VIEW_PARTS viewParts;
+        ULONG flatNodeCount;
+        ULONG first;
 
-        NtClose(processHandle);
+        TreeNew_GetViewParts(ProcessTreeListHandle, &viewParts);
 
-Done:
-        ProcessNode->ValidMask |= PHPN_APPID;
-    }
-}
+        if (viewParts.RowHeight <= 0)
+            return NULL;
 
-static VOID PhpUpdateProcessNodeDpiAwareness(
-    _Inout_ PPH_PROCESS_NODE ProcessNode
-    )
-{
-    static PH_INITONCE initOnce = PH_INITONCE_INIT;
-    static BOOL (WINAPI *getProcessDpiAwarenessInternal)(
-        _In_ HANDLE hprocess,
-        _Out_ ULONG *value
-        );
+        flatNodeCount = (ULONG)TreeNew_GetFlatNodeCount(ProcessTreeListHandle);
+        first = viewParts.VScrollPosition;
+        numberOfNodes = (viewParts.ClientRect.bottom - viewParts.HeaderHeight + viewParts.RowHeight - 1) / viewParts.RowHeight;
 
-    if (PhBeginInitOnce(&initOnce))
-    {
-        getProcessDpiAwarenessInternal = PhGetModuleProcAddress(L"user32.dll", "GetProcessDpiAwarenessInternal");
-        PhEndInitOnce(&initOnce);
-    }
+        if (first >= flatNodeCount)
+            return NULL;
+        if (numberOfNodes > flatNodeCount - first)
+            numberOfNodes = flatNodeCount - first;
 
-    if (!getProcessDpiAwarenessInternal)
-        return;
+        batch = PhAllocate(FIELD_OFFSET(PHP_PREFETCH_BATCH, Items) + max(numberOfNodes, 1) * sizeof(PHP_PREFETCH_ITEM));
+        batch->NumberOfItems = 0;
 
-    if (!(ProcessNode->ValidMask & PHPN_DPIAWARENESS))
-    {
-        if (ProcessNode->ProcessItem->QueryHandle)
+        for (i = 0; i < numberOfNodes; i++)
         {
-            ULONG dpiAwareness;
+            PPH_PROCESS_NODE node = (PPH_PROCESS_NODE)TreeNew_GetFlatNode(ProcessTreeListHandle, first + i);
 
-            if (getProcessDpiAwarenessInternal(ProcessNode->ProcessItem->QueryHandle, &dpiAwareness))
-                ProcessNode->DpiAwareness = dpiAwareness + 1;
-        }
+            if (!node)
+                break;
 
-        ProcessNode->ValidMask |= PHPN_DPIAWARENESS;
+            batch->Items[batch->NumberOfItems].ProcessItem = node->ProcessItem;
+            batch->Items[batch->NumberOfItems].OldValidMask = node->ValidMask;
+            batch->NumberOfItems++;
+        }
     }
+
+    batch->Mask = PrefetchMask & RefreshMask;
+    memset(batch->Costs, 0, sizeof(batch->Costs));
+
+    for (i = 0; i < batch->NumberOfItems; i++)
+        PhReferenceObject(batch->Items[i].ProcessItem);
+
+    return batch;
 }
 
-static VOID PhpUpdateNeedCyclesInformation(
-    VOID
+static VOID PhpFreePrefetchBatch(
+    _In_ PPHP_PREFETCH_BATCH Batch
     )
 {
-    PH_TREENEW_COLUMN column;
+    ULONG i;
 
-    NeedCyclesInformation = FALSE;
+    for (i = 0; i < Batch->NumberOfItems; i++)
+        PhDereferenceObject(Batch->Items[i].ProcessItem);
 
-    // Before Windows Vista, there is no cycle time measurement.
-    // On Windows 7 and above, cycle time information is available directly from the process item.
-    // We only need to query cycle time separately for Windows Vista.
-    if (WindowsVersion != WINDOWS_VISTA)
-        return;
+    PhFree(Batch);
+}
 
-    TreeNew_GetColumn(ProcessTreeListHandle, PHPRTLC_CYCLES, &column);
+static VOID NTAPI PhpApplyPrefetchBatch(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_PREFETCH_BATCH batch = Parameter;
+    ULONG i;
 
-    if (column.Visible)
+    PrefetchPending = FALSE;
+
+    for (i = 0; i < PHPN_FIELD_COUNT; i++)
     {
-        NeedCyclesInformation = TRUE;
-        return;
+        ProcessNodeFieldCosts[i].NumberOfQueries += batch->Costs[i].NumberOfQueries;
+        ProcessNodeFieldCosts[i].QueryTime += batch->Costs[i].QueryTime;
     }
 
-    TreeNew_GetColumn(ProcessTreeListHandle, PHPRTLC_CYCLESDELTA, &column);
+    // Ignore results for columns which have been hidden since the batch was created.
+    batch->Mask &= PrefetchMask;
 
-    if (column.Visible)
+    for (i = 0; i < batch->NumberOfItems; i++)
     {
-        NeedCyclesInformation = TRUE;
-        return;
-    }
-}
+        PPHP_PREFETCH_ITEM item = &batch->Items[i];
+        PPH_PROCESS_NODE node;
 
-static VOID PhpUpdateProcessNodeCycles(
+        if (!(node = PhFindProcessNode(item->ProcessItem->ProcessId)) || node->ProcessItem != item->ProcessItem)
+            continue;
+
+        if (batch->Mask & PHPN_WSCOUNTERS)
+            node->WsCounters = item->WsCounters;
+
+        if (batch->Mask & PHPN_GDIUSERHANDLES)
+        {
+            node->GdiHandles = item->GdiHandles;
+            node->UserHandles = item->UserHandles;
+        }
+
+        if (batch->Mask & PHPN_IOPAGEPRIORITY)
+        {
+            node->IoPriority = item->IoPriority;
+            node->PagePriority = item->PagePriority;
+        }
+
+        if (batch->Mask & PHPN_DEPSTATUS)
+            node->DepStatus = item->DepStatus;
+
+        if (batch->Mask & PHPN_TOKEN)
+        {
+            node->VirtualizationAllowed = item->VirtualizationAllowed;
+            node->VirtualizationEnabled = item->VirtualizationEnabled;
+        }
+
+        if (batch->Mask & PHPN_QUOTALIMITS)
+        {
+            node->MinimumWorkingSetSize = item->MinimumWorkingSetSize;
+            node->MaximumWorkingSetSize = item->MaximumWorkingSetSize;
+        }
+
+        node->ValidMask |= batch->Mask;
+        PhInvalidateTreeNewNodeText(&node->Node, PrefetchTextMask);
+    }
+
+    PhpFreePrefetchBatch(batch);
+
+    if (PrefetchSortColumn)
+        TreeNew_NodesStructured(ProcessTreeListHandle);
+    else
+        TreeNew_InvalidateChangedCells(ProcessTreeListHandle);
+}
+
+static ULONG PhpGetDepStatusFromExecuteFlags(
+    _In_ ULONG ExecuteFlags
+    )
+{
+    ULONG depStatus;
+
+    // See PhGetProcessDepStatus.
+    if (ExecuteFlags & MEM_EXECUTE_OPTION_ENABLE)
+        depStatus = 0;
+    else
+        depStatus = PH_PROCESS_DEP_ENABLED;
+
+    if (ExecuteFlags & MEM_EXECUTE_OPTION_DISABLE_THUNK_EMULATION)
+        depStatus |= PH_PROCESS_DEP_ATL_THUNK_EMULATION_DISABLED;
+    if (ExecuteFlags & MEM_EXECUTE_OPTION_PERMANENT)
+        depStatus |= PH_PROCESS_DEP_PERMANENT;
+
+    return depStatus;
+}
+
+/**
+ * Queries the values of a prefetch batch which KProcessHacker can return for all processes
+ * in one request.
+ *
+ * \param Batch The prefetch batch.
+ *
+ * \return An array with an entry for each item of the batch, or NULL if the driver could not
+ * be used. You must free the array using PhFree() when you no longer need it.
+ */
+static PKPH_PROCESS_BATCH_ENTRY PhpQueryPrefetchBatchKph(
+    _Inout_ PPHP_PREFETCH_BATCH Batch
+    )
+{
+    PKPH_PROCESS_BATCH_ENTRY entries;
+    LARGE_INTEGER startCounter;
+    ULONG fields;
+    ULONG i;
+
+    fields = 0;
+
+    if (Batch->Mask & PHPN_IOPAGEPRIORITY)
+        fields |= KPH_PROCESS_FIELD_IO_PRIORITY | KPH_PROCESS_FIELD_PAGE_PRIORITY;
+    if (Batch->Mask & PHPN_DEPSTATUS)
+        fields |= KPH_PROCESS_FIELD_EXECUTE_FLAGS;
+
+    if (fields == 0 || Batch->NumberOfItems == 0 || !KphIsConnected())
+        return NULL;
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+
+    entries = PhAllocate(Batch->NumberOfItems * sizeof(KPH_PROCESS_BATCH_ENTRY));
+
+    for (i = 0; i < Batch->NumberOfItems; i++)
+        entries[i].ProcessId = Batch->Items[i].ProcessItem->ProcessId;
+
+    for (i = 0; i < Batch->NumberOfItems; i += KPH_MAXIMUM_PROCESS_BATCH_ENTRIES)
+    {
+        // Older versions of the driver don't support the request.
+        if (!NT_SUCCESS(KphQueryInformationProcesses(
+            &entries[i],
+            min(Batch->NumberOfItems - i, KPH_MAXIMUM_PROCESS_BATCH_ENTRIES),
+            fields
+            )))
+        {
+            PhFree(entries);
+            return NULL;
+        }
+    }
+
+    // The request counts as a single query.
+    PhpRecordNodeFieldQuery(Batch->Costs, Batch->Mask & (PHPN_IOPAGEPRIORITY | PHPN_DEPSTATUS), &startCounter);
+
+    return entries;
+}
+
+static NTSTATUS PhpPrefetchWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_PREFETCH_BATCH batch = Parameter;
+    PKPH_PROCESS_BATCH_ENTRY kphEntries;
+    ULONG i;
+
+    kphEntries = PhpQueryPrefetchBatchKph(batch);
+
+    for (i = 0; i < batch->NumberOfItems; i++)
+    {
+        PPHP_PREFETCH_ITEM item = &batch->Items[i];
+        PPH_PROCESS_ITEM processItem = item->ProcessItem;
+        PKPH_PROCESS_BATCH_ENTRY kphEntry = NULL;
+        HANDLE processHandle = NULL;
+        LARGE_INTEGER startCounter;
+
+        // Processes are looked up by PID, so ignore processes which replaced this one.
+        if (kphEntries && NT_SUCCESS(kphEntries[i].Status) &&
+            kphEntries[i].CreateTime.QuadPart == processItem->CreateTime.QuadPart)
+        {
+            kphEntry = &kphEntries[i];
+        }
+
+        // Most values use the provider's query handle. Open one handle per process for the
+        // values which need PROCESS_QUERY_INFORMATION, and share it between them.
+        if ((batch->Mask & PHPN_WSCOUNTERS) ||
+            ((batch->Mask & PHPN_DEPSTATUS) && PhpNeedsProcessHandleForDepStatus(processItem) && !kphEntry))
+        {
+            if (!NT_SUCCESS(PhOpenProcess(&processHandle, PROCESS_QUERY_INFORMATION, processItem->ProcessId)))
+                processHandle = NULL;
+        }
+
+        if (batch->Mask & PHPN_WSCOUNTERS)
+        {
+            NtQueryPerformanceCounter(&startCounter, NULL);
+            PhpQueryProcessWsCounters(processHandle, &item->WsCounters);
+            PhpRecordNodeFieldQuery(batch->Costs, PHPN_WSCOUNTERS, &startCounter);
+        }
+
+        if (batch->Mask & PHPN_GDIUSERHANDLES)
+        {
+            NtQueryPerformanceCounter(&startCounter, NULL);
+            PhpQueryProcessGdiUserHandles(processItem, &item->GdiHandles, &item->UserHandles);
+            PhpRecordNodeFieldQuery(batch->Costs, PHPN_GDIUSERHANDLES, &startCounter);
+        }
+
+        if (batch->Mask & PHPN_IOPAGEPRIORITY)
+        {
+            if (kphEntry)
+            {
+                item->IoPriority = (kphEntry->ValidFields & KPH_PROCESS_FIELD_IO_PRIORITY) ? kphEntry->IoPriority : -1;
+                item->PagePriority = (kphEntry->ValidFields & KPH_PROCESS_FIELD_PAGE_PRIORITY) ? kphEntry->PagePriority : -1;
+            }
+            else
+            {
+                NtQueryPerformanceCounter(&startCounter, NULL);
+                PhpQueryProcessIoPagePriority(processItem, &item->IoPriority, &item->PagePriority);
+                PhpRecordNodeFieldQuery(batch->Costs, PHPN_IOPAGEPRIORITY, &startCounter);
+            }
+        }
+
+        if (batch->Mask & PHPN_DEPSTATUS)
+        {
+            if (kphEntry && PhpNeedsProcessHandleForDepStatus(processItem))
+            {
+                if (kphEntry->ValidFields & KPH_PROCESS_FIELD_EXECUTE_FLAGS)
+                    item->DepStatus = PhpGetDepStatusFromExecuteFlags(kphEntry->ExecuteFlags);
+                else
+                    item->DepStatus = 0;
+            }
+            else
+            {
+                NtQueryPerformanceCounter(&startCounter, NULL);
+                PhpQueryProcessDepStatus(processItem, processHandle, &item->DepStatus);
+                PhpRecordNodeFieldQuery(batch->Costs, PHPN_DEPSTATUS, &startCounter);
+            }
+        }
+
+        if (batch->Mask & PHPN_TOKEN)
+        {
+            NtQueryPerformanceCounter(&startCounter, NULL);
+            PhpQueryProcessTokenVirtualization(processItem, &item->VirtualizationAllowed, &item->VirtualizationEnabled);
+            PhpRecordNodeFieldQuery(batch->Costs, PHPN_TOKEN, &startCounter);
+        }
+
+        if (batch->Mask & PHPN_QUOTALIMITS)
+        {
+            NtQueryPerformanceCounter(&startCounter, NULL);
+            PhpQueryProcessQuotaLimits(processItem, &item->MinimumWorkingSetSize, &item->MaximumWorkingSetSize);
+            PhpRecordNodeFieldQuery(batch->Costs, PHPN_QUOTALIMITS, &startCounter);
+        }
+
+        if (processHandle)
+            NtClose(processHandle);
+    }
+
+    if (kphEntries)
+        PhFree(kphEntries);
+
+    // Hand all results to the GUI thread at once.
+    ProcessHacker_Invoke(PhMainWndHandle, PhpApplyPrefetchBatch, batch);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Queues a prefetch batch created before the nodes were invalidated.
+ */
+static VOID PhpQueuePrefetchBatch(
+    _In_ PPHP_PREFETCH_BATCH Batch
+    )
+{
+    ULONG i;
+
+    // Keep showing the previous values of these nodes until the new values arrive, instead
+    // of querying them on the GUI thread when the nodes are drawn.
+    for (i = 0; i < Batch->NumberOfItems; i++)
+    {
+        PPH_PROCESS_NODE node;
+
+        if ((node = PhFindProcessNode(Batch->Items[i].ProcessItem->ProcessId)) && node->ProcessItem == Batch->Items[i].ProcessItem)
+            node->ValidMask |= Batch->Items[i].OldValidMask & Batch->Mask;
+    }
+
+    if (PrefetchPending)
+    {
+        PhpFreePrefetchBatch(Batch);
+        return;
+    }
+
+    PrefetchPending = TRUE;
+    PhQueueItemWorkQueue(&PrefetchWorkQueue, PhpPrefetchWorker, Batch);
+}
+
+static VOID PhpUpdateProcessNodeImage(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_IMAGE))
+    {
+        LARGE_INTEGER startCounter;
+        HANDLE processHandle;
+        PROCESS_BASIC_INFORMATION basicInfo;
+        PVOID imageBaseAddress;
+        PH_REMOTE_MAPPED_IMAGE mappedImage;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        if (NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess | PROCESS_VM_READ, ProcessNode->ProcessId)))
+        {
+            if (NT_SUCCESS(PhGetProcessBasicInformation(processHandle, &basicInfo)))
+            {
+                if (NT_SUCCESS(PhReadVirtualMemory(
+                    processHandle,
+                    PTR_ADD_OFFSET(basicInfo.PebBaseAddress, FIELD_OFFSET(PEB, ImageBaseAddress)),
+                    &imageBaseAddress,
+                    sizeof(PVOID),
+                    NULL
+                    )))
+                {
+                    if (NT_SUCCESS(PhLoadRemoteMappedImage(processHandle, imageBaseAddress, &mappedImage)))
+                    {
+                        ProcessNode->ImageCharacteristics = mappedImage.NtHeaders->FileHeader.Characteristics;
+
+                        if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+                        {
+                            ProcessNode->ImageSubsystem = ((PIMAGE_OPTIONAL_HEADER32)&mappedImage.NtHeaders->OptionalHeader)->Subsystem;
+                            ProcessNode->ImageDllCharacteristics = ((PIMAGE_OPTIONAL_HEADER32)&mappedImage.NtHeaders->OptionalHeader)->DllCharacteristics;
+                        }
+                        else if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+                        {
+                            ProcessNode->ImageSubsystem = ((PIMAGE_OPTIONAL_HEADER64)&mappedImage.NtHeaders->OptionalHeader)->Subsystem;
+                            ProcessNode->ImageDllCharacteristics = ((PIMAGE_OPTIONAL_HEADER64)&mappedImage.NtHeaders->OptionalHeader)->DllCharacteristics;
+                        }
+
+                        PhUnloadRemoteMappedImage(&mappedImage);
+                    }
+                }
+            }
+
+            NtClose(processHandle);
+        }
+
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_IMAGE, &startCounter);
+        ProcessNode->ValidMask |= PHPN_IMAGE;
+    }
+}
+
+static VOID PhpUpdateProcessNodeAppId(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    if (!(ProcessNode->ValidMask & PHPN_APPID))
+    {
+        LARGE_INTEGER startCounter;
+        HANDLE processHandle;
+        ULONG windowFlags;
+        PPH_STRING windowTitle;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        PhClearReference(&ProcessNode->AppIdText);
+
+        if (!NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess | PROCESS_VM_READ, ProcessNode->ProcessId)))
+        {
+            if (WindowsVersion >= WINDOWS_7)
+            {
+                if (!NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess, ProcessNode->ProcessId)))
+                    goto Done;
+            }
+            else
+            {
+                goto Done;
+            }
+        }
+
+        if (NT_SUCCESS(PhGetProcessWindowTitle(
+            processHandle,
+            &windowFlags,
+            &windowTitle
+            )))
+        {
+            if (windowFlags & STARTF_TITLEISAPPID)
+                ProcessNode->AppIdText = windowTitle;
+            else
+                PhDereferenceObject(windowTitle);
+        }
+
+        NtClose(processHandle);
+
+Done:
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_APPID, &startCounter);
+        ProcessNode->ValidMask |= PHPN_APPID;
+    }
+}
+
+static VOID PhpUpdateProcessNodeDpiAwareness(
+    _Inout_ PPH_PROCESS_NODE ProcessNode
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    static BOOL (WINAPI *getProcessDpiAwarenessInternal)(
+        _In_ HANDLE hprocess,
+        _Out_ ULONG *value
+        );
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        getProcessDpiAwarenessInternal = PhGetModuleProcAddress(L"user32.dll", "GetProcessDpiAwarenessInternal");
+        PhEndInitOnce(&initOnce);
+    }
+
+    if (!getProcessDpiAwarenessInternal)
+        return;
+
+    if (!(ProcessNode->ValidMask & PHPN_DPIAWARENESS))
+    {
+        LARGE_INTEGER startCounter;
+
+        NtQueryPerformanceCounter(&startCounter, NULL);
+
+        if (ProcessNode->ProcessItem->QueryHandle)
+        {
+            ULONG dpiAwareness;
+
+            if (getProcessDpiAwarenessInternal(ProcessNode->ProcessItem->QueryHandle, &dpiAwareness))
+                ProcessNode->DpiAwareness = dpiAwareness + 1;
+        }
+
+        PhpRecordNodeFieldQuery(ProcessNodeFieldCosts, PHPN_DPIAWARENESS, &startCounter);
+        ProcessNode->ValidMask |= PHPN_DPIAWARENESS;
+    }
+}
+
+static VOID PhpUpdateNeedCyclesInformation(
+    VOID
+    )
+{
+    PH_TREENEW_COLUMN column;
+
+    NeedCyclesInformation = FALSE;
+
+    // Before Windows Vista, there is no cycle time measurement.
+    // On Windows 7 and above, cycle time information is available directly from the process item.
+    // We only need to query cycle time separately for Windows Vista.
+    if (WindowsVersion != WINDOWS_VISTA)
+        return;
+
+    TreeNew_GetColumn(ProcessTreeListHandle, PHPRTLC_CYCLES, &column);
+
+    if (column.Visible)
+    {
+        NeedCyclesInformation = TRUE;
+        return;
+    }
+
+    TreeNew_GetColumn(ProcessTreeListHandle, PHPRTLC_CYCLESDELTA, &column);
+
+    if (column.Visible)
+    {
+        NeedCyclesInformation = TRUE;
+        return;
+    }
+}
+
+static VOID PhpUpdateProcessNodeCycles(
     _Inout_ PPH_PROCESS_NODE ProcessNode
     )
 {
-    if (ProcessNode->ProcessId == SYSTEM_IDLE_PROCESS_ID)
-    {
-        PULARGE_INTEGER idleThreadCycleTimes;
-        ULONG64 cycleTime;
-        ULONG i;
+    if (ProcessNode->ProcessId == SYSTEM_IDLE_PROCESS_ID)
+    {
+        PULARGE_INTEGER idleThreadCycleTimes;
+        ULONG64 cycleTime;
+        ULONG i;
+
+        // System Idle Process requires special treatment.
+
+        idleThreadCycleTimes = PhAllocate(
+            sizeof(ULARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors
+            );
+
+        if (NT_SUCCESS(NtQuerySystemInformation(
+            SystemProcessorIdleCycleTimeInformation,
+            idleThreadCycleTimes,
+            sizeof(ULARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors,
+            NULL
+            )))
+        {
+            cycleTime = 0;
+
+            for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
+                cycleTime += idleThreadCycleTimes[i].QuadPart;
+
+            PhUpdateDelta(&ProcessNode->CyclesDelta, cycleTime);
+        }
+
+        PhFree(idleThreadCycleTimes);
+    }
+    else if (ProcessNode->ProcessItem->QueryHandle)
+    {
+        ULONG64 cycleTime;
+
+        if (NT_SUCCESS(PhGetProcessCycleTime(ProcessNode->ProcessItem->QueryHandle, &cycleTime)))
+        {
+            PhUpdateDelta(&ProcessNode->CyclesDelta, cycleTime);
+        }
+    }
+
+    if (ProcessNode->CyclesDelta.Value != 0)
+        PhMoveReference(&ProcessNode->CyclesText, PhFormatUInt64(ProcessNode->CyclesDelta.Value, TRUE));
+    else
+        PhClearReference(&ProcessNode->CyclesText);
+
+    if (ProcessNode->CyclesDelta.Delta != 0)
+        PhMoveReference(&ProcessNode->CyclesDeltaText, PhFormatUInt64(ProcessNode->CyclesDelta.Delta, TRUE));
+    else
+        PhClearReference(&ProcessNode->CyclesDeltaText);
+}
+
+#define SORT_FUNCTION(Column) PhpProcessTreeNewCompare##Column
+
+#define BEGIN_SORT_FUNCTION(Column) static int __cdecl PhpProcessTreeNewCompare##Column( \
+    _In_ const void *_elem1, \
+    _In_ const void *_elem2 \
+    ) \
+{ \
+    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)_elem1; \
+    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)_elem2; \
+    PPH_PROCESS_ITEM processItem1 = node1->ProcessItem; \
+    PPH_PROCESS_ITEM processItem2 = node2->ProcessItem; \
+    int sortResult = 0;
+
+#define END_SORT_FUNCTION \
+    if (sortResult == 0) \
+        sortResult = intptrcmp((LONG_PTR)processItem1->ProcessId, (LONG_PTR)processItem2->ProcessId); \
+    \
+    return PhModifySort(sortResult, ProcessTreeListSortOrder); \
+}
+
+LONG PhpProcessTreeNewPostSortFunction(
+    _In_ LONG Result,
+    _In_ PVOID Node1,
+    _In_ PVOID Node2,
+    _In_ PH_SORT_ORDER SortOrder
+    )
+{
+    if (Result == 0)
+        Result = intptrcmp((LONG_PTR)((PPH_PROCESS_NODE)Node1)->ProcessItem->ProcessId, (LONG_PTR)((PPH_PROCESS_NODE)Node2)->ProcessItem->ProcessId);
+
+    return PhModifySort(Result, SortOrder);
+}
+
+BEGIN_SORT_FUNCTION(Name)
+{
+    sortResult = PhCompareString(processItem1->ProcessName, processItem2->ProcessName, TRUE);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Pid)
+{
+    // Use signed int so DPCs and Interrupts are placed above System Idle Process.
+    sortResult = intptrcmp((LONG_PTR)processItem1->ProcessId, (LONG_PTR)processItem2->ProcessId);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Cpu)
+{
+    sortResult = singlecmp(processItem1->CpuUsage, processItem2->CpuUsage);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(IoTotalRate)
+{
+    sortResult = uint64cmp(
+        processItem1->IoReadDelta.Delta + processItem1->IoWriteDelta.Delta + processItem1->IoOtherDelta.Delta,
+        processItem2->IoReadDelta.Delta + processItem2->IoWriteDelta.Delta + processItem2->IoOtherDelta.Delta
+        );
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PrivateBytes)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.PagefileUsage, processItem2->VmCounters.PagefileUsage);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(UserName)
+{
+    sortResult = PhCompareStringWithNull(processItem1->UserName, processItem2->UserName, TRUE);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Description)
+{
+    PH_STRINGREF sr1;
+    PH_STRINGREF sr2;
+
+    sr1 = processItem1->VersionInfo.FileDescription ? processItem1->VersionInfo.FileDescription->sr : node1->DescriptionText;
+    sr2 = processItem2->VersionInfo.FileDescription ? processItem2->VersionInfo.FileDescription->sr : node2->DescriptionText;
+
+    sortResult = PhCompareStringRef(&sr1, &sr2, TRUE);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(CompanyName)
+{
+    sortResult = PhCompareStringWithNull(
+        processItem1->VersionInfo.CompanyName,
+        processItem2->VersionInfo.CompanyName,
+        TRUE
+        );
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Version)
+{
+    sortResult = PhCompareStringWithNull(
+        processItem1->VersionInfo.FileVersion,
+        processItem2->VersionInfo.FileVersion,
+        TRUE
+        );
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(FileName)
+{
+    sortResult = PhCompareStringWithNull(
+        processItem1->FileName,
+        processItem2->FileName,
+        TRUE
+        );
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(CommandLine)
+{
+    sortResult = PhCompareStringWithNull(
+        processItem1->CommandLine,
+        processItem2->CommandLine,
+        TRUE
+        );
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PeakPrivateBytes)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.PeakPagefileUsage, processItem2->VmCounters.PeakPagefileUsage);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(WorkingSet)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.WorkingSetSize, processItem2->VmCounters.WorkingSetSize);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PeakWorkingSet)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.PeakWorkingSetSize, processItem2->VmCounters.PeakWorkingSetSize);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PrivateWs)
+{
+    PhpUpdateProcessNodeWsCounters(node1);
+    PhpUpdateProcessNodeWsCounters(node2);
+    sortResult = uintptrcmp(node1->WsCounters.NumberOfPrivatePages, node2->WsCounters.NumberOfPrivatePages);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PrivateWsWin7)
+{
+    sortResult = uintptrcmp(processItem1->WorkingSetPrivateSize, processItem2->WorkingSetPrivateSize);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(SharedWs)
+{
+    PhpUpdateProcessNodeWsCounters(node1);
+    PhpUpdateProcessNodeWsCounters(node2);
+    sortResult = uintptrcmp(node1->WsCounters.NumberOfSharedPages, node2->WsCounters.NumberOfSharedPages);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(ShareableWs)
+{
+    PhpUpdateProcessNodeWsCounters(node1);
+    PhpUpdateProcessNodeWsCounters(node2);
+    sortResult = uintptrcmp(node1->WsCounters.NumberOfShareablePages, node2->WsCounters.NumberOfShareablePages);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(VirtualSize)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.VirtualSize, processItem2->VmCounters.VirtualSize);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PeakVirtualSize)
+{
+    sortResult = uintptrcmp(processItem1->VmCounters.PeakVirtualSize, processItem2->VmCounters.PeakVirtualSize);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(PageFaults)
+{
+    sortResult = uintcmp(processItem1->VmCounters.PageFaultCount, processItem2->VmCounters.PageFaultCount);
+}
+END_SORT_FUNCTION
 
-        // System Idle Process requires special treatment.
+BEGIN_SORT_FUNCTION(SessionId)
+{
+    sortResult = uintcmp(processItem1->SessionId, processItem2->SessionId);
+}
+END_SORT_FUNCTION
 
-        idleThreadCycleTimes = PhAllocate(
-            sizeof(ULARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors
-            );
+BEGIN_SORT_FUNCTION(BasePriority)
+{
+    sortResult = intcmp(processItem1->BasePriority, processItem2->BasePriority);
+}
+END_SORT_FUNCTION
 
-        if (NT_SUCCESS(NtQuerySystemInformation(
-            SystemProcessorIdleCycleTimeInformation,
-            idleThreadCycleTimes,
-            sizeof(ULARGE_INTEGER) * (ULONG)PhSystemBasicInformation.NumberOfProcessors,
-            NULL
-            )))
-        {
-            cycleTime = 0;
+BEGIN_SORT_FUNCTION(Threads)
+{
+    sortResult = uintcmp(processItem1->NumberOfThreads, processItem2->NumberOfThreads);
+}
+END_SORT_FUNCTION
 
-            for (i = 0; i < (ULONG)PhSystemBasicInformation.NumberOfProcessors; i++)
-                cycleTime += idleThreadCycleTimes[i].QuadPart;
+BEGIN_SORT_FUNCTION(Handles)
+{
+    sortResult = uintcmp(processItem1->NumberOfHandles, processItem2->NumberOfHandles);
+}
+END_SORT_FUNCTION
 
-            PhUpdateDelta(&ProcessNode->CyclesDelta, cycleTime);
-        }
+BEGIN_SORT_FUNCTION(GdiHandles)
+{
+    sortResult = uintcmp(node1->GdiHandles, node2->GdiHandles);
+}
+END_SORT_FUNCTION
 
-        PhFree(idleThreadCycleTimes);
-    }
-    else if (ProcessNode->ProcessItem->QueryHandle)
-    {
-        ULONG64 cycleTime;
+BEGIN_SORT_FUNCTION(UserHandles)
+{
+    sortResult = uintcmp(node1->UserHandles, node2->UserHandles);
+}
+END_SORT_FUNCTION
 
-        if (NT_SUCCESS(PhGetProcessCycleTime(ProcessNode->ProcessItem->QueryHandle, &cycleTime)))
-        {
-            PhUpdateDelta(&ProcessNode->CyclesDelta, cycleTime);
-        }
-    }
+BEGIN_SORT_FUNCTION(IoRoRate)
+{
+    sortResult = uint64cmp(
+        processItem1->IoReadDelta.Delta + processItem1->IoOtherDelta.Delta,
+        processItem2->IoReadDelta.Delta + processItem2->IoOtherDelta.Delta
+        );
+}
+END_SORT_FUNCTION
 
-    if (ProcessNode->CyclesDelta.Value != 0)
-        PhMoveReference(&ProcessNode->CyclesText, PhFormatUInt64(ProcessNode->CyclesDelta.Value, TRUE));
-    else
-        PhClearReference(&ProcessNode->CyclesText);
+BEGIN_SORT_FUNCTION(IoWRate)
+{
+    sortResult = uint64cmp(
+        processItem1->IoWriteDelta.Delta,
+        processItem2->IoWriteDelta.Delta
+        );
+}
+END_SORT_FUNCTION
 
-    if (ProcessNode->CyclesDelta.Delta != 0)
-        PhMoveReference(&ProcessNode->CyclesDeltaText, PhFormatUInt64(ProcessNode->CyclesDelta.Delta, TRUE));
-    else
-        PhClearReference(&ProcessNode->CyclesDeltaText);
+BEGIN_SORT_FUNCTION(Integrity)
+{
+    sortResult = uintcmp(processItem1->IntegrityLevel, processItem2->IntegrityLevel);
 }
+END_SORT_FUNCTION
 
-#define SORT_FUNCTION(Column) PhpProcessTreeNewCompare##Column
+BEGIN_SORT_FUNCTION(IoPriority)
+{
+    sortResult = uintcmp(node1->IoPriority, node2->IoPriority);
+}
+END_SORT_FUNCTION
 
-#define BEGIN_SORT_FUNCTION(Column) static int __cdecl PhpProcessTreeNewCompare##Column( \
-    _In_ const void *_elem1, \
-    _In_ const void *_elem2 \
-    ) \
-{ \
-    PPH_PROCESS_NODE node1 = *(PPH_PROCESS_NODE *)_elem1; \
-    PPH_PROCESS_NODE node2 = *(PPH_PROCESS_NODE *)_elem2; \
-    PPH_PROCESS_ITEM processItem1 = node1->ProcessItem; \
-    PPH_PROCESS_ITEM processItem2 = node2->ProcessItem; \
-    int sortResult = 0;
+BEGIN_SORT_FUNCTION(PagePriority)
+{
+    sortResult = uintcmp(node1->PagePriority, node2->PagePriority);
+}
+END_SORT_FUNCTION
 
-#define END_SORT_FUNCTION \
-    if (sortResult == 0) \
-        sortResult = intptrcmp((LONG_PTR)processItem1->ProcessId, (LONG_PTR)processItem2->ProcessId); \
-    \
-    return PhModifySort(sortResult, ProcessTreeListSortOrder); \
+BEGIN_SORT_FUNCTION(StartTime)
+{
+    sortResult = int64cmp(processItem1->CreateTime.QuadPart, processItem2->CreateTime.QuadPart);
 }
+END_SORT_FUNCTION
 
-LONG PhpProcessTreeNewPostSortFunction(
-    _In_ LONG Result,
-    _In_ PVOID Node1,
-    _In_ PVOID Node2,
-    _In_ PH_SORT_ORDER SortOrder
-    )
+BEGIN_SORT_FUNCTION(TotalCpuTime)
 {
-    if (Result == 0)
-        Result = intptrcmp((LONG_PTR)((PPH_PROCESS_NODE)Node1)->ProcessItem->ProcessId, (LONG_PTR)((PPH_PROCESS_NODE)Node2)->ProcessItem->ProcessId);
+    sortResult = uint64cmp(
+        processItem1->KernelTime.QuadPart + processItem1->UserTime.QuadPart,
+        processItem2->KernelTime.QuadPart + processItem2->UserTime.QuadPart
+        );
+}
+END_SORT_FUNCTION
 
-    return PhModifySort(Result, SortOrder);
+BEGIN_SORT_FUNCTION(KernelCpuTime)
+{
+    sortResult = uint64cmp(
+        processItem1->KernelTime.QuadPart,
+        processItem2->KernelTime.QuadPart
+        );
 }
+END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Name)
+BEGIN_SORT_FUNCTION(UserCpuTime)
 {
-    sortResult = PhCompareString(processItem1->ProcessName, processItem2->ProcessName, TRUE);
+    sortResult = uint64cmp(
+        processItem1->UserTime.QuadPart,
+        processItem2->UserTime.QuadPart
+        );
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Pid)
+BEGIN_SORT_FUNCTION(VerificationStatus)
 {
-    // Use signed int so DPCs and Interrupts are placed above System Idle Process.
-    sortResult = intptrcmp((LONG_PTR)processItem1->ProcessId, (LONG_PTR)processItem2->ProcessId);
+    sortResult = intcmp(processItem1->VerifyResult, processItem2->VerifyResult);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Cpu)
+BEGIN_SORT_FUNCTION(VerifiedSigner)
 {
-    sortResult = singlecmp(processItem1->CpuUsage, processItem2->CpuUsage);
+    sortResult = PhCompareStringWithNull(
+        processItem1->VerifySignerName,
+        processItem2->VerifySignerName,
+        TRUE
+        );
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoTotalRate)
+BEGIN_SORT_FUNCTION(Aslr)
 {
-    sortResult = uint64cmp(
-        processItem1->IoReadDelta.Delta + processItem1->IoWriteDelta.Delta + processItem1->IoOtherDelta.Delta,
-        processItem2->IoReadDelta.Delta + processItem2->IoWriteDelta.Delta + processItem2->IoOtherDelta.Delta
+    PhpUpdateProcessNodeImage(node1);
+    PhpUpdateProcessNodeImage(node2);
+    sortResult = intcmp(
+        node1->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE,
+        node2->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE
         );
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PrivateBytes)
+BEGIN_SORT_FUNCTION(RelativeStartTime)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.PagefileUsage, processItem2->VmCounters.PagefileUsage);
+    sortResult = -int64cmp(processItem1->CreateTime.QuadPart, processItem2->CreateTime.QuadPart);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Bits)
+{
+    sortResult = intcmp(processItem1->IsWow64Valid, processItem2->IsWow64Valid);
+
+    if (sortResult == 0)
+        sortResult = intcmp(processItem1->IsWow64, processItem2->IsWow64);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Elevation)
+{
+    ULONG key1;
+    ULONG key2;
+
+    switch (processItem1->ElevationType)
+    {
+    case TokenElevationTypeFull:
+        key1 = 2;
+        break;
+    case TokenElevationTypeLimited:
+        key1 = 1;
+        break;
+    default:
+        key1 = 0;
+        break;
+    }
+
+    switch (processItem2->ElevationType)
+    {
+    case TokenElevationTypeFull:
+        key2 = 2;
+        break;
+    case TokenElevationTypeLimited:
+        key2 = 1;
+        break;
+    default:
+        key2 = 0;
+        break;
+    }
+
+    sortResult = intcmp(key1, key2);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(WindowTitle)
+{
+    PhpUpdateProcessNodeWindow(node1);
+    PhpUpdateProcessNodeWindow(node2);
+    sortResult = PhCompareStringWithNull(node1->WindowText, node2->WindowText, TRUE);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(WindowStatus)
+{
+    PhpUpdateProcessNodeWindow(node1);
+    PhpUpdateProcessNodeWindow(node2);
+    sortResult = intcmp(node1->WindowHung, node2->WindowHung);
+
+    // Make sure all processes with windows get grouped together.
+    if (sortResult == 0)
+        sortResult = intcmp(!!node1->WindowHandle, !!node2->WindowHandle);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(Cycles)
+{
+    sortResult = uint64cmp(node1->CyclesDelta.Value, node2->CyclesDelta.Value);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(CyclesWin7)
+{
+    sortResult = uint64cmp(processItem1->CycleTimeDelta.Value, processItem2->CycleTimeDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(UserName)
+BEGIN_SORT_FUNCTION(CyclesDelta)
 {
-    sortResult = PhCompareStringWithNull(processItem1->UserName, processItem2->UserName, TRUE);
+    sortResult = uint64cmp(node1->CyclesDelta.Delta, node2->CyclesDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Description)
+BEGIN_SORT_FUNCTION(CyclesDeltaWin7)
 {
-    PH_STRINGREF sr1;
-    PH_STRINGREF sr2;
-
-    sr1 = processItem1->VersionInfo.FileDescription ? processItem1->VersionInfo.FileDescription->sr : node1->DescriptionText;
-    sr2 = processItem2->VersionInfo.FileDescription ? processItem2->VersionInfo.FileDescription->sr : node2->DescriptionText;
-
-    sortResult = PhCompareStringRef(&sr1, &sr2, TRUE);
+    sortResult = uint64cmp(processItem1->CycleTimeDelta.Delta, processItem2->CycleTimeDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(CompanyName)
+BEGIN_SORT_FUNCTION(DepStatus)
 {
-    sortResult = PhCompareStringWithNull(
-        processItem1->VersionInfo.CompanyName,
-        processItem2->VersionInfo.CompanyName,
-        TRUE
-        );
+    PhpUpdateProcessNodeDepStatus(node1);
+    PhpUpdateProcessNodeDepStatus(node2);
+    sortResult = uintcmp(node1->DepStatus, node2->DepStatus);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Version)
+BEGIN_SORT_FUNCTION(Virtualized)
 {
-    sortResult = PhCompareStringWithNull(
-        processItem1->VersionInfo.FileVersion,
-        processItem2->VersionInfo.FileVersion,
-        TRUE
-        );
+    PhpUpdateProcessNodeToken(node1);
+    PhpUpdateProcessNodeToken(node2);
+    sortResult = intcmp(node1->VirtualizationEnabled, node2->VirtualizationEnabled);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(FileName)
+BEGIN_SORT_FUNCTION(ContextSwitches)
 {
-    sortResult = PhCompareStringWithNull(
-        processItem1->FileName,
-        processItem2->FileName,
-        TRUE
-        );
+    sortResult = uintcmp(processItem1->ContextSwitchesDelta.Value, processItem2->ContextSwitchesDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(CommandLine)
+BEGIN_SORT_FUNCTION(ContextSwitchesDelta)
 {
-    sortResult = PhCompareStringWithNull(
-        processItem1->CommandLine,
-        processItem2->CommandLine,
-        TRUE
-        );
+    sortResult = intcmp((LONG)processItem1->ContextSwitchesDelta.Delta, (LONG)processItem2->ContextSwitchesDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PeakPrivateBytes)
+BEGIN_SORT_FUNCTION(PageFaultsDelta)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.PeakPagefileUsage, processItem2->VmCounters.PeakPagefileUsage);
+    sortResult = uintcmp(processItem1->PageFaultsDelta.Delta, processItem2->PageFaultsDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(WorkingSet)
+BEGIN_SORT_FUNCTION(IoReads)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.WorkingSetSize, processItem2->VmCounters.WorkingSetSize);
+    sortResult = uint64cmp(processItem1->IoReadCountDelta.Value, processItem2->IoReadCountDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PeakWorkingSet)
+BEGIN_SORT_FUNCTION(IoWrites)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.PeakWorkingSetSize, processItem2->VmCounters.PeakWorkingSetSize);
+    sortResult = uint64cmp(processItem1->IoWriteCountDelta.Value, processItem2->IoWriteCountDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PrivateWs)
+BEGIN_SORT_FUNCTION(IoOther)
 {
-    PhpUpdateProcessNodeWsCounters(node1);
-    PhpUpdateProcessNodeWsCounters(node2);
-    sortResult = uintptrcmp(node1->WsCounters.NumberOfPrivatePages, node2->WsCounters.NumberOfPrivatePages);
+    sortResult = uint64cmp(processItem1->IoOtherCountDelta.Value, processItem2->IoOtherCountDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PrivateWsWin7)
+BEGIN_SORT_FUNCTION(IoReadBytes)
 {
-    sortResult = uintptrcmp(processItem1->WorkingSetPrivateSize, processItem2->WorkingSetPrivateSize);
+    sortResult = uint64cmp(processItem1->IoReadDelta.Value, processItem2->IoReadDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(SharedWs)
+BEGIN_SORT_FUNCTION(IoWriteBytes)
 {
-    PhpUpdateProcessNodeWsCounters(node1);
-    PhpUpdateProcessNodeWsCounters(node2);
-    sortResult = uintptrcmp(node1->WsCounters.NumberOfSharedPages, node2->WsCounters.NumberOfSharedPages);
+    sortResult = uint64cmp(processItem1->IoWriteDelta.Value, processItem2->IoWriteDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(ShareableWs)
+BEGIN_SORT_FUNCTION(IoOtherBytes)
 {
-    PhpUpdateProcessNodeWsCounters(node1);
-    PhpUpdateProcessNodeWsCounters(node2);
-    sortResult = uintptrcmp(node1->WsCounters.NumberOfShareablePages, node2->WsCounters.NumberOfShareablePages);
+    sortResult = uint64cmp(processItem1->IoOtherDelta.Value, processItem2->IoOtherDelta.Value);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(VirtualSize)
+BEGIN_SORT_FUNCTION(IoReadsDelta)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.VirtualSize, processItem2->VmCounters.VirtualSize);
+    sortResult = uint64cmp(processItem1->IoReadCountDelta.Delta, processItem2->IoReadCountDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PeakVirtualSize)
+BEGIN_SORT_FUNCTION(IoWritesDelta)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.PeakVirtualSize, processItem2->VmCounters.PeakVirtualSize);
+    sortResult = uint64cmp(processItem1->IoWriteCountDelta.Delta, processItem2->IoWriteCountDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PageFaults)
+BEGIN_SORT_FUNCTION(IoOtherDelta)
 {
-    sortResult = uintcmp(processItem1->VmCounters.PageFaultCount, processItem2->VmCounters.PageFaultCount);
+    sortResult = uint64cmp(processItem1->IoOtherCountDelta.Delta, processItem2->IoOtherCountDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(SessionId)
+BEGIN_SORT_FUNCTION(OsContext)
 {
-    sortResult = uintcmp(processItem1->SessionId, processItem2->SessionId);
+    PhpUpdateProcessOsContext(node1);
+    PhpUpdateProcessOsContext(node2);
+    sortResult = uintcmp(node1->OsContextVersion, node2->OsContextVersion);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(BasePriority)
+BEGIN_SORT_FUNCTION(PagedPool)
 {
-    sortResult = intcmp(processItem1->BasePriority, processItem2->BasePriority);
+    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPagedPoolUsage, processItem2->VmCounters.QuotaPagedPoolUsage);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Threads)
+BEGIN_SORT_FUNCTION(PeakPagedPool)
 {
-    sortResult = uintcmp(processItem1->NumberOfThreads, processItem2->NumberOfThreads);
+    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPeakPagedPoolUsage, processItem2->VmCounters.QuotaPeakPagedPoolUsage);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Handles)
+BEGIN_SORT_FUNCTION(NonPagedPool)
 {
-    sortResult = uintcmp(processItem1->NumberOfHandles, processItem2->NumberOfHandles);
+    sortResult = uintptrcmp(processItem1->VmCounters.QuotaNonPagedPoolUsage, processItem2->VmCounters.QuotaNonPagedPoolUsage);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(GdiHandles)
+BEGIN_SORT_FUNCTION(PeakNonPagedPool)
 {
-    sortResult = uintcmp(node1->GdiHandles, node2->GdiHandles);
+    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPeakNonPagedPoolUsage, processItem2->VmCounters.QuotaPeakNonPagedPoolUsage);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(UserHandles)
+BEGIN_SORT_FUNCTION(MinimumWorkingSet)
 {
-    sortResult = uintcmp(node1->UserHandles, node2->UserHandles);
+    PhpUpdateProcessNodeQuotaLimits(node1);
+    PhpUpdateProcessNodeQuotaLimits(node2);
+    sortResult = uintptrcmp(node1->MinimumWorkingSetSize, node2->MinimumWorkingSetSize);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoRoRate)
+BEGIN_SORT_FUNCTION(MaximumWorkingSet)
 {
-    sortResult = uint64cmp(
-        processItem1->IoReadDelta.Delta + processItem1->IoOtherDelta.Delta,
-        processItem2->IoReadDelta.Delta + processItem2->IoOtherDelta.Delta
-        );
+    PhpUpdateProcessNodeQuotaLimits(node1);
+    PhpUpdateProcessNodeQuotaLimits(node2);
+    sortResult = uintptrcmp(node1->MaximumWorkingSetSize, node2->MaximumWorkingSetSize);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoWRate)
+BEGIN_SORT_FUNCTION(PrivateBytesDelta)
 {
-    sortResult = uint64cmp(
-        processItem1->IoWriteDelta.Delta,
-        processItem2->IoWriteDelta.Delta
-        );
+    sortResult = intptrcmp(processItem1->PrivateBytesDelta.Delta, processItem2->PrivateBytesDelta.Delta);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Integrity)
+BEGIN_SORT_FUNCTION(Subsystem)
 {
-    sortResult = uintcmp(processItem1->IntegrityLevel, processItem2->IntegrityLevel);
+    PhpUpdateProcessNodeImage(node1);
+    PhpUpdateProcessNodeImage(node2);
+    sortResult = intcmp(node1->ImageSubsystem, node2->ImageSubsystem);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoPriority)
+BEGIN_SORT_FUNCTION(PackageName)
 {
-    sortResult = uintcmp(node1->IoPriority, node2->IoPriority);
+    sortResult = PhCompareStringWithNull(processItem1->PackageFullName, processItem2->PackageFullName, TRUE);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(PagePriority)
+BEGIN_SORT_FUNCTION(AppId)
 {
-    sortResult = uintcmp(node1->PagePriority, node2->PagePriority);
+    PhpUpdateProcessNodeAppId(node1);
+    PhpUpdateProcessNodeAppId(node2);
+    sortResult = PhCompareStringWithNull(node1->AppIdText, node2->AppIdText, TRUE);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(StartTime)
+BEGIN_SORT_FUNCTION(DpiAwareness)
 {
-    sortResult = int64cmp(processItem1->CreateTime.QuadPart, processItem2->CreateTime.QuadPart);
+    PhpUpdateProcessNodeDpiAwareness(node1);
+    PhpUpdateProcessNodeDpiAwareness(node2);
+    sortResult = uintcmp(node1->DpiAwareness, node2->DpiAwareness);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(TotalCpuTime)
+BEGIN_SORT_FUNCTION(CfGuard)
 {
-    sortResult = uint64cmp(
-        processItem1->KernelTime.QuadPart + processItem1->UserTime.QuadPart,
-        processItem2->KernelTime.QuadPart + processItem2->UserTime.QuadPart
+    PhpUpdateProcessNodeImage(node1);
+    PhpUpdateProcessNodeImage(node2);
+    sortResult = intcmp(
+        node1->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_GUARD_CF,
+        node2->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_GUARD_CF
         );
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(KernelCpuTime)
+BEGIN_SORT_FUNCTION(RunningThreads)
 {
-    sortResult = uint64cmp(
-        processItem1->KernelTime.QuadPart,
-        processItem2->KernelTime.QuadPart
-        );
+    sortResult = uintcmp(processItem1->RunningThreadCount, processItem2->RunningThreadCount);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(UserCpuTime)
+BEGIN_SORT_FUNCTION(ReadyThreads)
 {
-    sortResult = uint64cmp(
-        processItem1->UserTime.QuadPart,
-        processItem2->UserTime.QuadPart
-        );
+    sortResult = uintcmp(processItem1->ReadyThreadCount, processItem2->ReadyThreadCount);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(VerificationStatus)
+BEGIN_SORT_FUNCTION(WaitingThreads)
 {
-    sortResult = intcmp(processItem1->VerifyResult, processItem2->VerifyResult);
+    sortResult = uintcmp(processItem1->WaitingThreadCount, processItem2->WaitingThreadCount);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(VerifiedSigner)
+BEGIN_SORT_FUNCTION(TopWaitReason)
 {
-    sortResult = PhCompareStringWithNull(
-        processItem1->VerifySignerName,
-        processItem2->VerifySignerName,
-        TRUE
-        );
+    sortResult = uintcmp(processItem1->TopWaitReason, processItem2->TopWaitReason);
+
+    if (sortResult == 0)
+        sortResult = uintcmp(processItem1->TopWaitReasonCount, processItem2->TopWaitReasonCount);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Aslr)
+BEGIN_SORT_FUNCTION(HandleGrowth)
 {
-    PhpUpdateProcessNodeImage(node1);
-    PhpUpdateProcessNodeImage(node2);
-    sortResult = intcmp(
-        node1->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE,
-        node2->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE
-        );
+    sortResult = singlecmp(processItem1->HandleGrowthRate, processItem2->HandleGrowthRate);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(RelativeStartTime)
+BEGIN_SORT_FUNCTION(TopHandleGrowth)
 {
-    sortResult = -int64cmp(processItem1->CreateTime.QuadPart, processItem2->CreateTime.QuadPart);
+    sortResult = singlecmp(processItem1->TopHandleTypeGrowthRate, processItem2->TopHandleTypeGrowthRate);
 }
 END_SORT_FUNCTION
 
-BEGIN_SORT_FUNCTION(Bits)
+// Sort keys for columns whose values change on every update. The keys must order the nodes in the
+// same way as the corresponding sort functions, which are still used to break ties. Keys for the
+// most commonly sorted columns are read from the hot records so that the process items themselves
+// are not touched.
+
+#define BEGIN_SORT_KEY_FUNCTION(Column) static ULONG64 NTAPI PhpProcessTreeNewSortKey##Column( \
+    _In_ PPH_TREENEW_NODE Node, \
+    _In_opt_ PVOID Context \
+    ) \
+{ \
+    PPH_PROCESS_HOT_DATA hotData = ((PPH_PROCESS_NODE)Node)->HotData; \
+    PPH_PROCESS_ITEM processItem = ((PPH_PROCESS_NODE)Node)->ProcessItem;
+
+#define END_SORT_KEY_FUNCTION }
+
+#define SORT_KEY_FUNCTION(Column) PhpProcessTreeNewSortKey##Column
+
+BEGIN_SORT_KEY_FUNCTION(Pid)
 {
-    sortResult = intcmp(processItem1->IsWow64Valid, processItem2->IsWow64Valid);
+    return PhSortKeyFromInt64((LONG_PTR)processItem->ProcessId);
+}
+END_SORT_KEY_FUNCTION
 
-    if (sortResult == 0)
-        sortResult = intcmp(processItem1->IsWow64, processItem2->IsWow64);
+BEGIN_SORT_KEY_FUNCTION(Cpu)
+{
+    return PhSortKeyFromSingle(hotData->CpuUsage);
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(Elevation)
+BEGIN_SORT_KEY_FUNCTION(IoTotalRate)
 {
-    ULONG key1;
-    ULONG key2;
+    return hotData->IoDelta;
+}
+END_SORT_KEY_FUNCTION
 
-    switch (processItem1->ElevationType)
-    {
-    case TokenElevationTypeFull:
-        key1 = 2;
-        break;
-    case TokenElevationTypeLimited:
-        key1 = 1;
-        break;
-    default:
-        key1 = 0;
-        break;
-    }
+BEGIN_SORT_KEY_FUNCTION(PrivateBytes)
+{
+    return hotData->PagefileUsage;
+}
+END_SORT_KEY_FUNCTION
 
-    switch (processItem2->ElevationType)
-    {
-    case TokenElevationTypeFull:
-        key2 = 2;
-        break;
-    case TokenElevationTypeLimited:
-        key2 = 1;
-        break;
-    default:
-        key2 = 0;
-        break;
-    }
+BEGIN_SORT_KEY_FUNCTION(PeakPrivateBytes)
+{
+    return processItem->VmCounters.PeakPagefileUsage;
+}
+END_SORT_KEY_FUNCTION
 
-    sortResult = intcmp(key1, key2);
+BEGIN_SORT_KEY_FUNCTION(WorkingSet)
+{
+    return hotData->WorkingSetSize;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(WindowTitle)
+BEGIN_SORT_KEY_FUNCTION(PeakWorkingSet)
 {
-    PhpUpdateProcessNodeWindow(node1);
-    PhpUpdateProcessNodeWindow(node2);
-    sortResult = PhCompareStringWithNull(node1->WindowText, node2->WindowText, TRUE);
+    return processItem->VmCounters.PeakWorkingSetSize;
+}
+END_SORT_KEY_FUNCTION
+
+BEGIN_SORT_KEY_FUNCTION(PrivateWsWin7)
+{
+    return processItem->WorkingSetPrivateSize;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(WindowStatus)
+BEGIN_SORT_KEY_FUNCTION(VirtualSize)
 {
-    PhpUpdateProcessNodeWindow(node1);
-    PhpUpdateProcessNodeWindow(node2);
-    sortResult = intcmp(node1->WindowHung, node2->WindowHung);
+    return processItem->VmCounters.VirtualSize;
+}
+END_SORT_KEY_FUNCTION
 
-    // Make sure all processes with windows get grouped together.
-    if (sortResult == 0)
-        sortResult = intcmp(!!node1->WindowHandle, !!node2->WindowHandle);
+BEGIN_SORT_KEY_FUNCTION(PeakVirtualSize)
+{
+    return processItem->VmCounters.PeakVirtualSize;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(Cycles)
+BEGIN_SORT_KEY_FUNCTION(PageFaults)
 {
-    sortResult = uint64cmp(node1->CyclesDelta.Value, node2->CyclesDelta.Value);
+    return processItem->VmCounters.PageFaultCount;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(CyclesWin7)
+BEGIN_SORT_KEY_FUNCTION(Threads)
 {
-    sortResult = uint64cmp(processItem1->CycleTimeDelta.Value, processItem2->CycleTimeDelta.Value);
+    return processItem->NumberOfThreads;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(CyclesDelta)
+BEGIN_SORT_KEY_FUNCTION(RunningThreads)
 {
-    sortResult = uint64cmp(node1->CyclesDelta.Delta, node2->CyclesDelta.Delta);
+    return processItem->RunningThreadCount;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(CyclesDeltaWin7)
+BEGIN_SORT_KEY_FUNCTION(ReadyThreads)
 {
-    sortResult = uint64cmp(processItem1->CycleTimeDelta.Delta, processItem2->CycleTimeDelta.Delta);
+    return processItem->ReadyThreadCount;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(DepStatus)
+BEGIN_SORT_KEY_FUNCTION(WaitingThreads)
 {
-    PhpUpdateProcessNodeDepStatus(node1);
-    PhpUpdateProcessNodeDepStatus(node2);
-    sortResult = uintcmp(node1->DepStatus, node2->DepStatus);
+    return processItem->WaitingThreadCount;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(Virtualized)
+BEGIN_SORT_KEY_FUNCTION(HandleGrowth)
 {
-    PhpUpdateProcessNodeToken(node1);
-    PhpUpdateProcessNodeToken(node2);
-    sortResult = intcmp(node1->VirtualizationEnabled, node2->VirtualizationEnabled);
+    return PhSortKeyFromSingle(processItem->HandleGrowthRate);
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(ContextSwitches)
+BEGIN_SORT_KEY_FUNCTION(TopHandleGrowth)
 {
-    sortResult = uintcmp(processItem1->ContextSwitchesDelta.Value, processItem2->ContextSwitchesDelta.Value);
+    return PhSortKeyFromSingle(processItem->TopHandleTypeGrowthRate);
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(ContextSwitchesDelta)
+BEGIN_SORT_KEY_FUNCTION(Handles)
 {
-    sortResult = intcmp((LONG)processItem1->ContextSwitchesDelta.Delta, (LONG)processItem2->ContextSwitchesDelta.Delta);
+    return hotData->NumberOfHandles;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PageFaultsDelta)
+BEGIN_SORT_KEY_FUNCTION(IoRoRate)
 {
-    sortResult = uintcmp(processItem1->PageFaultsDelta.Delta, processItem2->PageFaultsDelta.Delta);
+    return processItem->IoReadDelta.Delta + processItem->IoOtherDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoReads)
+BEGIN_SORT_KEY_FUNCTION(IoWRate)
 {
-    sortResult = uint64cmp(processItem1->IoReadCountDelta.Value, processItem2->IoReadCountDelta.Value);
+    return processItem->IoWriteDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoWrites)
+BEGIN_SORT_KEY_FUNCTION(TotalCpuTime)
 {
-    sortResult = uint64cmp(processItem1->IoWriteCountDelta.Value, processItem2->IoWriteCountDelta.Value);
+    return processItem->KernelTime.QuadPart + processItem->UserTime.QuadPart;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoOther)
+BEGIN_SORT_KEY_FUNCTION(KernelCpuTime)
 {
-    sortResult = uint64cmp(processItem1->IoOtherCountDelta.Value, processItem2->IoOtherCountDelta.Value);
+    return processItem->KernelTime.QuadPart;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoReadBytes)
+BEGIN_SORT_KEY_FUNCTION(UserCpuTime)
 {
-    sortResult = uint64cmp(processItem1->IoReadDelta.Value, processItem2->IoReadDelta.Value);
+    return processItem->UserTime.QuadPart;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoWriteBytes)
+BEGIN_SORT_KEY_FUNCTION(CyclesWin7)
 {
-    sortResult = uint64cmp(processItem1->IoWriteDelta.Value, processItem2->IoWriteDelta.Value);
+    return processItem->CycleTimeDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoOtherBytes)
+BEGIN_SORT_KEY_FUNCTION(CyclesDeltaWin7)
 {
-    sortResult = uint64cmp(processItem1->IoOtherDelta.Value, processItem2->IoOtherDelta.Value);
+    return processItem->CycleTimeDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoReadsDelta)
+BEGIN_SORT_KEY_FUNCTION(ContextSwitches)
 {
-    sortResult = uint64cmp(processItem1->IoReadCountDelta.Delta, processItem2->IoReadCountDelta.Delta);
+    return processItem->ContextSwitchesDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoWritesDelta)
+BEGIN_SORT_KEY_FUNCTION(ContextSwitchesDelta)
 {
-    sortResult = uint64cmp(processItem1->IoWriteCountDelta.Delta, processItem2->IoWriteCountDelta.Delta);
+    return PhSortKeyFromInt64((LONG)processItem->ContextSwitchesDelta.Delta);
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(IoOtherDelta)
+BEGIN_SORT_KEY_FUNCTION(PageFaultsDelta)
 {
-    sortResult = uint64cmp(processItem1->IoOtherCountDelta.Delta, processItem2->IoOtherCountDelta.Delta);
+    return processItem->PageFaultsDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(OsContext)
+BEGIN_SORT_KEY_FUNCTION(IoReads)
 {
-    PhpUpdateProcessOsContext(node1);
-    PhpUpdateProcessOsContext(node2);
-    sortResult = uintcmp(node1->OsContextVersion, node2->OsContextVersion);
+    return processItem->IoReadCountDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PagedPool)
+BEGIN_SORT_KEY_FUNCTION(IoWrites)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPagedPoolUsage, processItem2->VmCounters.QuotaPagedPoolUsage);
+    return processItem->IoWriteCountDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PeakPagedPool)
+BEGIN_SORT_KEY_FUNCTION(IoOther)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPeakPagedPoolUsage, processItem2->VmCounters.QuotaPeakPagedPoolUsage);
+    return processItem->IoOtherCountDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(NonPagedPool)
+BEGIN_SORT_KEY_FUNCTION(IoReadBytes)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.QuotaNonPagedPoolUsage, processItem2->VmCounters.QuotaNonPagedPoolUsage);
+    return processItem->IoReadDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PeakNonPagedPool)
+BEGIN_SORT_KEY_FUNCTION(IoWriteBytes)
 {
-    sortResult = uintptrcmp(processItem1->VmCounters.QuotaPeakNonPagedPoolUsage, processItem2->VmCounters.QuotaPeakNonPagedPoolUsage);
+    return processItem->IoWriteDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(MinimumWorkingSet)
+BEGIN_SORT_KEY_FUNCTION(IoOtherBytes)
 {
-    PhpUpdateProcessNodeQuotaLimits(node1);
-    PhpUpdateProcessNodeQuotaLimits(node2);
-    sortResult = uintptrcmp(node1->MinimumWorkingSetSize, node2->MinimumWorkingSetSize);
+    return processItem->IoOtherDelta.Value;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(MaximumWorkingSet)
+BEGIN_SORT_KEY_FUNCTION(IoReadsDelta)
 {
-    PhpUpdateProcessNodeQuotaLimits(node1);
-    PhpUpdateProcessNodeQuotaLimits(node2);
-    sortResult = uintptrcmp(node1->MaximumWorkingSetSize, node2->MaximumWorkingSetSize);
+    return processItem->IoReadCountDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PrivateBytesDelta)
+BEGIN_SORT_KEY_FUNCTION(IoWritesDelta)
 {
-    sortResult = intptrcmp(processItem1->PrivateBytesDelta.Delta, processItem2->PrivateBytesDelta.Delta);
+    return processItem->IoWriteCountDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(Subsystem)
+BEGIN_SORT_KEY_FUNCTION(IoOtherDelta)
 {
-    PhpUpdateProcessNodeImage(node1);
-    PhpUpdateProcessNodeImage(node2);
-    sortResult = intcmp(node1->ImageSubsystem, node2->ImageSubsystem);
+    return processItem->IoOtherCountDelta.Delta;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(PackageName)
+BEGIN_SORT_KEY_FUNCTION(PagedPool)
 {
-    sortResult = PhCompareStringWithNull(processItem1->PackageFullName, processItem2->PackageFullName, TRUE);
+    return processItem->VmCounters.QuotaPagedPoolUsage;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(AppId)
+BEGIN_SORT_KEY_FUNCTION(NonPagedPool)
 {
-    PhpUpdateProcessNodeAppId(node1);
-    PhpUpdateProcessNodeAppId(node2);
-    sortResult = PhCompareStringWithNull(node1->AppIdText, node2->AppIdText, TRUE);
+    return processItem->VmCounters.QuotaNonPagedPoolUsage;
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(DpiAwareness)
+BEGIN_SORT_KEY_FUNCTION(PrivateBytesDelta)
 {
-    PhpUpdateProcessNodeDpiAwareness(node1);
-    PhpUpdateProcessNodeDpiAwareness(node2);
-    sortResult = uintcmp(node1->DpiAwareness, node2->DpiAwareness);
+    return PhSortKeyFromInt64(processItem->PrivateBytesDelta.Delta);
 }
-END_SORT_FUNCTION
+END_SORT_KEY_FUNCTION
 
-BEGIN_SORT_FUNCTION(CfGuard)
+static int __cdecl PhpProcessTreeNewCompareEqualKeys(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
 {
-    PhpUpdateProcessNodeImage(node1);
-    PhpUpdateProcessNodeImage(node2);
-    sortResult = intcmp(
-        node1->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_GUARD_CF,
-        node2->ImageDllCharacteristics & IMAGE_DLLCHARACTERISTICS_GUARD_CF
-        );
+    int (__cdecl *sortFunction)(const void *, const void *) = context;
+
+    return sortFunction(elem1, elem2);
 }
-END_SORT_FUNCTION
 
 BOOLEAN NTAPI PhpProcessTreeNewCallback(
     _In_ HWND hwnd,
@@ -1856,6 +2964,11 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
 
             node = (PPH_PROCESS_NODE)getChildren->Node;
 
+            // The tree is restructured (at the latest) after nodes have been removed, so this is
+            // where the node lists are compacted.
+            if (!node)
+                PhpFlushRemovedProcessNodes();
+
             if (ProcessTreeListSortOrder == NoSortOrder)
             {
                 if (!node)
@@ -1950,18 +3063,69 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                         SORT_FUNCTION(PackageName),
                         SORT_FUNCTION(AppId),
                         SORT_FUNCTION(DpiAwareness),
-                        SORT_FUNCTION(CfGuard)
+                        SORT_FUNCTION(CfGuard),
+                        SORT_FUNCTION(RunningThreads),
+                        SORT_FUNCTION(ReadyThreads),
+                        SORT_FUNCTION(WaitingThreads),
+                        SORT_FUNCTION(TopWaitReason),
+                        SORT_FUNCTION(HandleGrowth),
+                        SORT_FUNCTION(TopHandleGrowth)
                     };
+                    static PPH_TREENEW_SORT_KEY_FUNCTION sortKeyFunctions[PHPRTLC_MAXIMUM];
                     static PH_INITONCE initOnce = PH_INITONCE_INIT;
                     int (__cdecl *sortFunction)(const void *, const void *);
 
                     if (PhBeginInitOnce(&initOnce))
                     {
+                        sortKeyFunctions[PHPRTLC_PID] = SORT_KEY_FUNCTION(Pid);
+                        sortKeyFunctions[PHPRTLC_CPU] = SORT_KEY_FUNCTION(Cpu);
+                        sortKeyFunctions[PHPRTLC_IOTOTALRATE] = SORT_KEY_FUNCTION(IoTotalRate);
+                        sortKeyFunctions[PHPRTLC_PRIVATEBYTES] = SORT_KEY_FUNCTION(PrivateBytes);
+                        sortKeyFunctions[PHPRTLC_PEAKPRIVATEBYTES] = SORT_KEY_FUNCTION(PeakPrivateBytes);
+                        sortKeyFunctions[PHPRTLC_WORKINGSET] = SORT_KEY_FUNCTION(WorkingSet);
+                        sortKeyFunctions[PHPRTLC_PEAKWORKINGSET] = SORT_KEY_FUNCTION(PeakWorkingSet);
+                        sortKeyFunctions[PHPRTLC_VIRTUALSIZE] = SORT_KEY_FUNCTION(VirtualSize);
+                        sortKeyFunctions[PHPRTLC_PEAKVIRTUALSIZE] = SORT_KEY_FUNCTION(PeakVirtualSize);
+                        sortKeyFunctions[PHPRTLC_PAGEFAULTS] = SORT_KEY_FUNCTION(PageFaults);
+                        sortKeyFunctions[PHPRTLC_THREADS] = SORT_KEY_FUNCTION(Threads);
+                        sortKeyFunctions[PHPRTLC_HANDLES] = SORT_KEY_FUNCTION(Handles);
+                        sortKeyFunctions[PHPRTLC_IORORATE] = SORT_KEY_FUNCTION(IoRoRate);
+                        sortKeyFunctions[PHPRTLC_IOWRATE] = SORT_KEY_FUNCTION(IoWRate);
+                        sortKeyFunctions[PHPRTLC_TOTALCPUTIME] = SORT_KEY_FUNCTION(TotalCpuTime);
+                        sortKeyFunctions[PHPRTLC_KERNELCPUTIME] = SORT_KEY_FUNCTION(KernelCpuTime);
+                        sortKeyFunctions[PHPRTLC_USERCPUTIME] = SORT_KEY_FUNCTION(UserCpuTime);
+                        sortKeyFunctions[PHPRTLC_CPUHISTORY] = SORT_KEY_FUNCTION(Cpu);
+                        sortKeyFunctions[PHPRTLC_PRIVATEBYTESHISTORY] = SORT_KEY_FUNCTION(PrivateBytes);
+                        sortKeyFunctions[PHPRTLC_IOHISTORY] = SORT_KEY_FUNCTION(IoTotalRate);
+                        sortKeyFunctions[PHPRTLC_CONTEXTSWITCHES] = SORT_KEY_FUNCTION(ContextSwitches);
+                        sortKeyFunctions[PHPRTLC_CONTEXTSWITCHESDELTA] = SORT_KEY_FUNCTION(ContextSwitchesDelta);
+                        sortKeyFunctions[PHPRTLC_PAGEFAULTSDELTA] = SORT_KEY_FUNCTION(PageFaultsDelta);
+                        sortKeyFunctions[PHPRTLC_IOREADS] = SORT_KEY_FUNCTION(IoReads);
+                        sortKeyFunctions[PHPRTLC_IOWRITES] = SORT_KEY_FUNCTION(IoWrites);
+                        sortKeyFunctions[PHPRTLC_IOOTHER] = SORT_KEY_FUNCTION(IoOther);
+                        sortKeyFunctions[PHPRTLC_IOREADBYTES] = SORT_KEY_FUNCTION(IoReadBytes);
+                        sortKeyFunctions[PHPRTLC_IOWRITEBYTES] = SORT_KEY_FUNCTION(IoWriteBytes);
+                        sortKeyFunctions[PHPRTLC_IOOTHERBYTES] = SORT_KEY_FUNCTION(IoOtherBytes);
+                        sortKeyFunctions[PHPRTLC_IOREADSDELTA] = SORT_KEY_FUNCTION(IoReadsDelta);
+                        sortKeyFunctions[PHPRTLC_IOWRITESDELTA] = SORT_KEY_FUNCTION(IoWritesDelta);
+                        sortKeyFunctions[PHPRTLC_IOOTHERDELTA] = SORT_KEY_FUNCTION(IoOtherDelta);
+                        sortKeyFunctions[PHPRTLC_PAGEDPOOL] = SORT_KEY_FUNCTION(PagedPool);
+                        sortKeyFunctions[PHPRTLC_NONPAGEDPOOL] = SORT_KEY_FUNCTION(NonPagedPool);
+                        sortKeyFunctions[PHPRTLC_PRIVATEBYTESDELTA] = SORT_KEY_FUNCTION(PrivateBytesDelta);
+                        sortKeyFunctions[PHPRTLC_RUNNINGTHREADS] = SORT_KEY_FUNCTION(RunningThreads);
+                        sortKeyFunctions[PHPRTLC_READYTHREADS] = SORT_KEY_FUNCTION(ReadyThreads);
+                        sortKeyFunctions[PHPRTLC_WAITINGTHREADS] = SORT_KEY_FUNCTION(WaitingThreads);
+                        sortKeyFunctions[PHPRTLC_HANDLEGROWTH] = SORT_KEY_FUNCTION(HandleGrowth);
+                        sortKeyFunctions[PHPRTLC_TOPHANDLEGROWTH] = SORT_KEY_FUNCTION(TopHandleGrowth);
+
                         if (WindowsVersion >= WINDOWS_7)
                         {
                             sortFunctions[PHPRTLC_PRIVATEWS] = SORT_FUNCTION(PrivateWsWin7);
                             sortFunctions[PHPRTLC_CYCLES] = SORT_FUNCTION(CyclesWin7);
                             sortFunctions[PHPRTLC_CYCLESDELTA] = SORT_FUNCTION(CyclesDeltaWin7);
+                            sortKeyFunctions[PHPRTLC_PRIVATEWS] = SORT_KEY_FUNCTION(PrivateWsWin7);
+                            sortKeyFunctions[PHPRTLC_CYCLES] = SORT_KEY_FUNCTION(CyclesWin7);
+                            sortKeyFunctions[PHPRTLC_CYCLESDELTA] = SORT_KEY_FUNCTION(CyclesDeltaWin7);
                         }
 
                         PhEndInitOnce(&initOnce);
@@ -1980,9 +3144,22 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                         else
                             sortFunction = NULL;
 
-                        if (sortFunction)
+                        if (sortFunction && sortKeyFunctions[ProcessTreeListSortColumn])
+                        {
+                            // Most nodes move between updates when sorting by these columns, so the
+                            // adaptive sort below would fall back to a full comparison sort.
+                            PhSortTreeNewNodesByKey(
+                                (PPH_TREENEW_NODE *)ProcessNodeList->Items,
+                                ProcessNodeList->Count,
+                                sortKeyFunctions[ProcessTreeListSortColumn],
+                                ProcessTreeListSortOrder,
+                                PhpProcessTreeNewCompareEqualKeys,
+                                sortFunction
+                                );
+                        }
+                        else if (sortFunction)
                         {
-                            qsort(ProcessNodeList->Items, ProcessNodeList->Count, sizeof(PVOID), sortFunction);
+                            PhSortTreeNewNodes((PPH_TREENEW_NODE *)ProcessNodeList->Items, ProcessNodeList->Count, sortFunction);
                         }
                     }
 
@@ -2024,17 +3201,14 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                 {
                     FLOAT cpuUsage = 0;
 
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeFloat, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, CpuUsage), &cpuUsage);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldCpuUsage, &cpuUsage);
                     cpuUsage *= 100;
 
                     if (cpuUsage >= 0.01)
                     {
-                        PH_FORMAT format;
                         SIZE_T returnLength;
 
-                        PhInitFormatF(&format, cpuUsage, 2);
-
-                        if (PhFormatToBuffer(&format, 1, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
+                        if (PhFormatFixedToBuffer(cpuUsage, 2, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
                         {
                             getCellText->Text.Buffer = node->CpuUsageText;
                             getCellText->Text.Length = returnLength - sizeof(WCHAR); // minus null terminator
@@ -2062,28 +3236,21 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
 
                     if (processItem->IoReadDelta.Delta != processItem->IoReadDelta.Value) // delta is wrong on first run of process provider
                     {
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoReadDelta.Delta), &number);
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoWriteDelta.Delta), &number);
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoOtherDelta.Delta), &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoReadDelta, &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoWriteDelta, &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoOtherDelta, &number);
                         number *= 1000;
                         number /= PhCsUpdateInterval;
                     }
 
                     if (number != 0)
-                    {
-                        PH_FORMAT format[2];
-
-                        PhInitFormatSize(&format[0], number);
-                        PhInitFormatS(&format[1], L"/s");
-                        PhMoveReference(&node->IoTotalRateText, PhFormat(format, 2, 0));
-                        getCellText->Text = node->IoTotalRateText->sr;
-                    }
+                        PhpFormatSizeRate(number, node->IoTotalRateText, sizeof(node->IoTotalRateText), &getCellText->Text);
                 }
                 break;
             case PHPRTLC_PRIVATEBYTES:
                 {
                     SIZE_T value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeIntPtr, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, VmCounters.PagefileUsage), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldPagefileUsage, &value);
                     PhMoveReference(&node->PrivateBytesText, PhFormatSize(value, -1));
                     getCellText->Text = node->PrivateBytesText->sr;
                 }
@@ -2116,7 +3283,7 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
             case PHPRTLC_WORKINGSET:
                 {
                     SIZE_T value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeIntPtr, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, VmCounters.WorkingSetSize), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldWorkingSetSize, &value);
                     PhMoveReference(&node->WorkingSetText, PhFormatSize(value, -1));
                     getCellText->Text = node->WorkingSetText->sr;
                 }
@@ -2172,14 +3339,14 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
             case PHPRTLC_THREADS:
                 {
                     ULONG value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeInt32, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, NumberOfThreads), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldNumberOfThreads, &value);
                     PhpFormatInt32GroupDigits(value, node->ThreadsText, sizeof(node->ThreadsText), &getCellText->Text);
                 }
                 break;
             case PHPRTLC_HANDLES:
                 {
                     ULONG value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeInt32, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, NumberOfHandles), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldNumberOfHandles, &value);
                     PhpFormatInt32GroupDigits(value, node->HandlesText, sizeof(node->HandlesText), &getCellText->Text);
                 }
                 break;
@@ -2197,21 +3364,14 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
 
                     if (processItem->IoReadDelta.Delta != processItem->IoReadDelta.Value)
                     {
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoReadDelta.Delta), &number);
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoOtherDelta.Delta), &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoReadDelta, &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoOtherDelta, &number);
                         number *= 1000;
                         number /= PhCsUpdateInterval;
                     }
 
                     if (number != 0)
-                    {
-                        PH_FORMAT format[2];
-
-                        PhInitFormatSize(&format[0], number);
-                        PhInitFormatS(&format[1], L"/s");
-                        PhMoveReference(&node->IoRoRateText, PhFormat(format, 2, 0));
-                        getCellText->Text = node->IoRoRateText->sr;
-                    }
+                        PhpFormatSizeRate(number, node->IoRoRateText, sizeof(node->IoRoRateText), &getCellText->Text);
                 }
                 break;
             case PHPRTLC_IOWRATE:
@@ -2220,20 +3380,13 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
 
                     if (processItem->IoReadDelta.Delta != processItem->IoReadDelta.Value)
                     {
-                        PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, IoWriteDelta.Delta), &number);
+                        PhpAggregateFieldIfNeeded(node, AggregateFieldIoWriteDelta, &number);
                         number *= 1000;
                         number /= PhCsUpdateInterval;
                     }
 
                     if (number != 0)
-                    {
-                        PH_FORMAT format[2];
-
-                        PhInitFormatSize(&format[0], number);
-                        PhInitFormatS(&format[1], L"/s");
-                        PhMoveReference(&node->IoWRateText, PhFormat(format, 2, 0));
-                        getCellText->Text = node->IoWRateText->sr;
-                    }
+                        PhpFormatSizeRate(number, node->IoWRateText, sizeof(node->IoWRateText), &getCellText->Text);
                 }
                 break;
             case PHPRTLC_INTEGRITY:
@@ -2311,13 +3464,14 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                     if (processItem->CreateTime.QuadPart != 0)
                     {
                         LARGE_INTEGER currentTime;
-                        PPH_STRING startTimeString;
+                        PH_FIXED_STRING_BUILDER stringBuilder;
 
+                        // This column changes on every refresh, so format it in place.
                         PhQuerySystemTime(&currentTime);
-                        startTimeString = PhFormatTimeSpanRelative(currentTime.QuadPart - processItem->CreateTime.QuadPart);
-                        PhMoveReference(&node->RelativeStartTimeText, PhConcatStrings2(startTimeString->Buffer, L" ago"));
-                        PhDereferenceObject(startTimeString);
-                        getCellText->Text = node->RelativeStartTimeText->sr;
+                        PhInitializeFixedStringBuilder(&stringBuilder, node->RelativeStartTimeText, sizeof(node->RelativeStartTimeText));
+                        PhFormatTimeSpanRelativeToBuilder(&stringBuilder, currentTime.QuadPart - processItem->CreateTime.QuadPart);
+                        PhAppendFixedStringBuilder2(&stringBuilder, L" ago");
+                        getCellText->Text = stringBuilder.String;
                     }
                 }
                 break;
@@ -2375,7 +3529,7 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                 if (WindowsVersion >= WINDOWS_7)
                 {
                     ULONG64 value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, CycleTimeDelta.Value), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldCycleTime, &value);
 
                     if (value != 0)
                     {
@@ -2392,7 +3546,7 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                 if (WindowsVersion >= WINDOWS_7)
                 {
                     ULONG64 value = 0;
-                    PhpAggregateFieldIfNeeded(node, AggregateTypeInt64, AggregateLocationProcessItem, FIELD_OFFSET(PH_PROCESS_ITEM, CycleTimeDelta.Delta), &value);
+                    PhpAggregateFieldIfNeeded(node, AggregateFieldCycleTimeDelta, &value);
 
                     if (value != 0)
                     {
@@ -2574,24 +3728,23 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
 
                     if (delta != 0)
                     {
-                        PH_FORMAT format[2];
+                        SIZE_T returnLength;
 
                         if (delta > 0)
                         {
-                            PhInitFormatC(&format[0], '+');
+                            node->PrivateBytesDeltaText[0] = '+';
                         }
                         else
                         {
-                            PhInitFormatC(&format[0], '-');
+                            node->PrivateBytesDeltaText[0] = '-';
                             delta = -delta;
                         }
 
-                        format[1].Type = SizeFormatType | FormatUseRadix;
-                        format[1].Radix = (UCHAR)PhMaxSizeUnit;
-                        format[1].u.Size = delta;
-
-                        PhMoveReference(&node->PrivateBytesDeltaText, PhFormat(format, 2, 0));
-                        getCellText->Text = node->PrivateBytesDeltaText->sr;
+                        if (PhFormatSizeToBuffer(delta, -1, node->PrivateBytesDeltaText + 1, sizeof(node->PrivateBytesDeltaText) - sizeof(WCHAR), &returnLength))
+                        {
+                            getCellText->Text.Buffer = node->PrivateBytesDeltaText;
+                            getCellText->Text.Length = returnLength; // sign plus text, minus null terminator
+                        }
                     }
                 }
                 break;
@@ -2660,6 +3813,78 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                     PhInitializeStringRef(&getCellText->Text, L"N/A");
                 }
                 break;
+            case PHPRTLC_RUNNINGTHREADS:
+                PhpFormatInt32GroupDigits(processItem->RunningThreadCount, node->RunningThreadsText, sizeof(node->RunningThreadsText), &getCellText->Text);
+                break;
+            case PHPRTLC_READYTHREADS:
+                PhpFormatInt32GroupDigits(processItem->ReadyThreadCount, node->ReadyThreadsText, sizeof(node->ReadyThreadsText), &getCellText->Text);
+                break;
+            case PHPRTLC_WAITINGTHREADS:
+                PhpFormatInt32GroupDigits(processItem->WaitingThreadCount, node->WaitingThreadsText, sizeof(node->WaitingThreadsText), &getCellText->Text);
+                break;
+            case PHPRTLC_TOPWAITREASON:
+                if ((ULONG)processItem->TopWaitReason < MaximumWaitReason)
+                {
+                    PH_FORMAT format[4];
+                    SIZE_T returnLength;
+
+                    PhInitFormatS(&format[0], PhKWaitReasonNames[processItem->TopWaitReason]);
+                    PhInitFormatS(&format[1], L" (");
+                    PhInitFormatU(&format[2], processItem->TopWaitReasonCount);
+                    PhInitFormatC(&format[3], ')');
+
+                    if (PhFormatToBuffer(format, 4, node->TopWaitReasonText, sizeof(node->TopWaitReasonText), &returnLength))
+                    {
+                        getCellText->Text.Buffer = node->TopWaitReasonText;
+                        getCellText->Text.Length = returnLength - sizeof(WCHAR);
+                    }
+                }
+                break;
+            case PHPRTLC_HANDLEGROWTH:
+                if (processItem->HandleGrowthRate >= 0.01 || processItem->HandleGrowthRate <= -0.01)
+                {
+                    PH_FORMAT format;
+                    SIZE_T returnLength;
+
+                    PhInitFormatF(&format, processItem->HandleGrowthRate, 2);
+                    format.Type |= FormatPrefixSign;
+
+                    if (PhFormatToBuffer(&format, 1, node->HandleGrowthText, sizeof(node->HandleGrowthText), &returnLength))
+                    {
+                        getCellText->Text.Buffer = node->HandleGrowthText;
+                        getCellText->Text.Length = returnLength - sizeof(WCHAR);
+                    }
+                }
+                break;
+            case PHPRTLC_TOPHANDLEGROWTH:
+                if (processItem->TopHandleTypeGrowthRate >= 0.01)
+                {
+                    PPH_STRING typeName;
+                    PH_FORMAT format[4];
+                    SIZE_T returnLength;
+
+                    typeName = PhGetHandleTrendTypeName(processItem->TopHandleTypeIndex);
+
+                    if (typeName)
+                        PhInitFormatSR(&format[0], typeName->sr);
+                    else
+                        PhInitFormatS(&format[0], L"Unknown");
+
+                    PhInitFormatS(&format[1], L" (");
+                    PhInitFormatF(&format[2], processItem->TopHandleTypeGrowthRate, 2);
+                    format[2].Type |= FormatPrefixSign;
+                    PhInitFormatS(&format[3], L"/min)");
+
+                    if (PhFormatToBuffer(format, 4, node->TopHandleGrowthText, sizeof(node->TopHandleGrowthText), &returnLength))
+                    {
+                        getCellText->Text.Buffer = node->TopHandleGrowthText;
+                        getCellText->Text.Length = returnLength - sizeof(WCHAR);
+                    }
+
+                    if (typeName)
+                        PhDereferenceObject(typeName);
+                }
+                break;
             default:
                 return FALSE;
             }
@@ -2750,6 +3975,9 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
             else
             {
                 PhGetStockApplicationIcon(&getNodeIcon->Icon, NULL);
+
+                // The row is being drawn, so get its details before those of hidden rows.
+                PhPrioritizeProcessItemQuery(node->ProcessItem);
             }
 
             getNodeIcon->Flags = TN_CACHE;
@@ -2826,15 +4054,13 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                     PhGetDrawInfoGraphBuffers(
                         &node->CpuGraphBuffers,
                         &drawInfo,
-                        processItem->CpuKernelHistory.Count
+                        processItem->HistorySlot.Count
                         );
 
                     if (!node->CpuGraphBuffers.Valid)
                     {
-                        PhCopyCircularBuffer_FLOAT(&processItem->CpuKernelHistory,
-                            node->CpuGraphBuffers.Data1, drawInfo.LineDataCount);
-                        PhCopyCircularBuffer_FLOAT(&processItem->CpuUserHistory,
-                            node->CpuGraphBuffers.Data2, drawInfo.LineDataCount);
+                        PhCopyProcessItemCpuHistory(processItem, drawInfo.LineDataCount,
+                            node->CpuGraphBuffers.Data1, node->CpuGraphBuffers.Data2);
                         node->CpuGraphBuffers.Valid = TRUE;
                     }
                 }
@@ -2848,20 +4074,16 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                     PhGetDrawInfoGraphBuffers(
                         &node->PrivateGraphBuffers,
                         &drawInfo,
-                        processItem->PrivateBytesHistory.Count
+                        processItem->HistorySlot.Count
                         );
 
                     if (!node->PrivateGraphBuffers.Valid)
                     {
-                        ULONG i;
                         FLOAT total;
                         FLOAT max;
 
-                        for (i = 0; i < drawInfo.LineDataCount; i++)
-                        {
-                            node->PrivateGraphBuffers.Data1[i] =
-                                (FLOAT)PhGetItemCircularBuffer_SIZE_T(&processItem->PrivateBytesHistory, i);
-                        }
+                        PhCopyProcessItemPrivateBytesHistory(processItem, drawInfo.LineDataCount,
+                            node->PrivateGraphBuffers.Data1);
 
                         // This makes it easier for the user to see what processes are hogging memory.
                         // Scaling is still *not* consistent across all graphs.
@@ -2896,29 +4118,18 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
                     PhGetDrawInfoGraphBuffers(
                         &node->IoGraphBuffers,
                         &drawInfo,
-                        processItem->IoReadHistory.Count
+                        processItem->HistorySlot.Count
                         );
 
                     if (!node->IoGraphBuffers.Valid)
                     {
-                        ULONG i;
                         FLOAT total;
-                        FLOAT max = 0;
-
-                        for (i = 0; i < drawInfo.LineDataCount; i++)
-                        {
-                            FLOAT data1;
-                            FLOAT data2;
+                        FLOAT max;
 
-                            node->IoGraphBuffers.Data1[i] = data1 =
-                                (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoReadHistory, i) +
-                                (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoOtherHistory, i);
-                            node->IoGraphBuffers.Data2[i] = data2 =
-                                (FLOAT)PhGetItemCircularBuffer_ULONG64(&processItem->IoWriteHistory, i);
+                        PhCopyProcessItemIoHistory(processItem, drawInfo.LineDataCount,
+                            node->IoGraphBuffers.Data1, node->IoGraphBuffers.Data2);
 
-                            if (max < data1 + data2)
-                                max = data1 + data2;
-                        }
+                        max = PhMaximumSumSingles(node->IoGraphBuffers.Data1, node->IoGraphBuffers.Data2, drawInfo.LineDataCount);
 
                         // Make the scaling a bit more consistent across the processes.
                         // It does *not* scale all graphs using the same maximum.
@@ -3001,6 +4212,7 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
     case TreeNewSortChanged:
         {
             TreeNew_GetSort(hwnd, &ProcessTreeListSortColumn, &ProcessTreeListSortOrder);
+            PhpUpdatePrefetchMask();
             // Force a rebuild to sort the items.
             TreeNew_NodesStructured(hwnd);
         }
@@ -3049,7 +4261,10 @@ BOOLEAN NTAPI PhpProcessTreeNewCallback(
             PhHandleTreeNewColumnMenu(&data);
 
             if (data.ProcessedId == PH_TN_COLUMN_MENU_HIDE_COLUMN_ID || data.ProcessedId == PH_TN_COLUMN_MENU_CHOOSE_COLUMNS_ID)
+            {
                 PhpUpdateNeedCyclesInformation();
+                PhpUpdatePrefetchMask();
+            }
 
             PhDeleteTreeNewColumnMenu(&data);
         }
@@ -3086,6 +4301,8 @@ PPH_PROCESS_ITEM PhGetSelectedProcessItem(
     PPH_PROCESS_ITEM processItem = NULL;
     ULONG i;
 
+    PhpFlushRemovedProcessNodes();
+
     for (i = 0; i < ProcessNodeList->Count; i++)
     {
         PPH_PROCESS_NODE node = ProcessNodeList->Items[i];
@@ -3108,6 +4325,8 @@ VOID PhGetSelectedProcessItems(
     PPH_LIST list;
     ULONG i;
 
+    PhpFlushRemovedProcessNodes();
+
     list = PhCreateList(2);
 
     for (i = 0; i < ProcessNodeList->Count; i++)
@@ -3140,6 +4359,8 @@ VOID PhExpandAllProcessNodes(
     ULONG i;
     BOOLEAN needsRestructure = FALSE;
 
+    PhpFlushRemovedProcessNodes();
+
     for (i = 0; i < ProcessNodeList->Count; i++)
     {
         PPH_PROCESS_NODE node = ProcessNodeList->Items[i];
@@ -3165,7 +4386,7 @@ VOID PhInvalidateAllProcessNodes(
     {
         PPH_PROCESS_NODE node = ProcessNodeList->Items[i];
 
-        memset(node->TextCache, 0, sizeof(PH_STRINGREF) * PHPRTLC_MAXIMUM);
+        PhInvalidateTreeNewNodeText(&node->Node, NULL);
         PhInvalidateTreeNewNode(&node->Node, TN_CACHE_COLOR);
         node->ValidMask = 0;
 
@@ -3361,6 +4582,68 @@ PPH_LIST PhGetProcessTreeListLines(
     return lines;
 }
 
+typedef struct _PH_PROCESS_TREE_EXPORT_ROW
+{
+    PPH_PROCESS_NODE Node;
+    ULONG Level;
+} PH_PROCESS_TREE_EXPORT_ROW, *PPH_PROCESS_TREE_EXPORT_ROW;
+
+typedef struct _PH_PROCESS_TREE_EXPORT_CONTEXT
+{
+    HWND TreeListHandle;
+    PULONG DisplayToId;
+    PWSTR *DisplayToText;
+    PPH_PROCESS_TREE_EXPORT_ROW Rows;
+    ULONG NumberOfRows;
+} PH_PROCESS_TREE_EXPORT_CONTEXT, *PPH_PROCESS_TREE_EXPORT_CONTEXT;
+
+static VOID PhpAddProcessTreeExportRows(
+    _Inout_ PPH_PROCESS_TREE_EXPORT_CONTEXT Context,
+    _In_ PPH_PROCESS_NODE Node,
+    _In_ ULONG Level
+    )
+{
+    ULONG i;
+
+    Context->Rows[Context->NumberOfRows].Node = Node;
+    Context->Rows[Context->NumberOfRows].Level = Level;
+    Context->NumberOfRows++;
+
+    for (i = 0; i < Node->Children->Count; i++)
+        PhpAddProcessTreeExportRows(Context, Node->Children->Items[i], Level + 1);
+}
+
+static VOID NTAPI PhpGetProcessTreeExportCell(
+    _In_ ULONG Row,
+    _In_ ULONG Column,
+    _Out_ PPH_STRINGREF Text,
+    _Out_ PULONG Indent,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_PROCESS_TREE_EXPORT_CONTEXT context = Context;
+    PPH_PROCESS_TREE_EXPORT_ROW row;
+    PH_TREENEW_GET_CELL_TEXT getCellText;
+
+    if (Row == 0)
+    {
+        PhInitializeStringRef(Text, context->DisplayToText[Column]);
+        *Indent = 0;
+        return;
+    }
+
+    row = &context->Rows[Row - 1];
+
+    getCellText.Node = &row->Node->Node;
+    getCellText.Id = context->DisplayToId[Column];
+    PhInitializeEmptyStringRef(&getCellText.Text);
+    TreeNew_GetCellText(context->TreeListHandle, &getCellText);
+
+    *Text = getCellText.Text;
+    // Indent the first column to show the tree structure.
+    *Indent = Column == 0 ? row->Level * 2 : 0;
+}
+
 VOID PhCopyProcessTree(
     VOID
     )
@@ -3377,27 +4660,32 @@ VOID PhWriteProcessTree(
     _In_ ULONG Mode
     )
 {
-    PPH_LIST lines;
+    PH_PROCESS_TREE_EXPORT_CONTEXT context;
+    ULONG columns;
     ULONG i;
 
-    lines = PhGetProcessTreeListLines(
-        ProcessTreeListHandle,
-        ProcessNodeList->Count,
-        ProcessNodeRootList,
-        Mode
-        );
+    PhpFlushRemovedProcessNodes();
 
-    for (i = 0; i < lines->Count; i++)
-    {
-        PPH_STRING line;
+    context.TreeListHandle = ProcessTreeListHandle;
+    context.Rows = PhAllocate(sizeof(PH_PROCESS_TREE_EXPORT_ROW) * ProcessNodeList->Count);
+    context.NumberOfRows = 0;
+    PhMapDisplayIndexTreeNew(ProcessTreeListHandle, &context.DisplayToId, &context.DisplayToText, &columns);
 
-        line = lines->Items[i];
-        PhWriteStringAsUtf8FileStream(FileStream, &line->sr);
-        PhDereferenceObject(line);
-        PhWriteStringAsUtf8FileStream2(FileStream, L"\r\n");
-    }
+    for (i = 0; i < ProcessNodeRootList->Count; i++)
+        PhpAddProcessTreeExportRows(&context, ProcessNodeRootList->Items[i], 0);
+
+    PhWriteTextTableFileStream(
+        FileStream,
+        context.NumberOfRows + 1,
+        columns,
+        Mode,
+        PhpGetProcessTreeExportCell,
+        &context
+        );
 
-    PhDereferenceObject(lines);
+    PhFree(context.DisplayToText);
+    PhFree(context.DisplayToId);
+    PhFree(context.Rows);
 }
 
 PPH_LIST PhDuplicateProcessNodeList(
@@ -3406,8 +4694,89 @@ PPH_LIST PhDuplicateProcessNodeList(
 {
     PPH_LIST newList;
 
+    PhpFlushRemovedProcessNodes();
+
     newList = PhCreateList(ProcessNodeList->Count);
     PhInsertItemsList(newList, 0, ProcessNodeList->Items, ProcessNodeList->Count);
 
     return newList;
 }
+
+/**
+ * Describes how often a process tree column is refreshed and how long the queries for it
+ * have taken so far.
+ *
+ * \param TreeNewHandle The tree new control being customized.
+ * \param Id The column ID.
+ *
+ * \return A string describing the column, or NULL if \a TreeNewHandle is not the process
+ * tree list.
+ */
+PPH_STRING PhGetProcessTreeListColumnInfo(
+    _In_ HWND TreeNewHandle,
+    _In_ ULONG Id
+    )
+{
+    PH_FORMAT format[8];
+    ULONG count = 0;
+    ULONG mask = 0;
+    ULONG index;
+    ULONG i;
+    PPHP_NODE_FIELD_POLICY policy;
+    PPHP_NODE_FIELD_COST cost;
+    LARGE_INTEGER frequency;
+
+    if (TreeNewHandle != ProcessTreeListHandle)
+        return NULL;
+
+    for (i = 0; i < RTL_NUMBER_OF(ProcessNodeColumnFields); i++)
+    {
+        if (ProcessNodeColumnFields[i][0] == Id)
+        {
+            mask = ProcessNodeColumnFields[i][1];
+            break;
+        }
+    }
+
+    if (!mask || (Id == PHPRTLC_PRIVATEWS && WindowsVersion >= WINDOWS_7))
+        return PhCreateString(L"Refreshed on every update from data the process provider already has.");
+
+    _BitScanForward(&index, mask);
+    policy = &ProcessNodeFieldPolicies[index];
+    cost = &ProcessNodeFieldCosts[index];
+
+    switch (policy->RefreshPolicy)
+    {
+    case PHP_REFRESH_EVERY_UPDATE:
+        PhInitFormatS(&format[count++], L"Refreshed on every update");
+        break;
+    case PHP_REFRESH_INTERVAL:
+        PhInitFormatS(&format[count++], L"Refreshed every ");
+        PhInitFormatU(&format[count++], policy->RefreshInterval);
+        PhInitFormatS(&format[count++], L" updates");
+        break;
+    case PHP_REFRESH_ON_CHANGE:
+        PhInitFormatS(&format[count++], L"Refreshed when the process changes");
+        break;
+    case PHP_REFRESH_ONCE:
+        PhInitFormatS(&format[count++], L"Queried once per process");
+        break;
+    }
+
+    if (cost->NumberOfQueries != 0)
+    {
+        NtQueryPerformanceCounter(&frequency, &frequency);
+
+        PhInitFormatS(&format[count++], L"; ");
+        PhInitFormatF(&format[count++], (DOUBLE)cost->QueryTime * 1000 / cost->NumberOfQueries / frequency.QuadPart, 3);
+        PhInitFormatS(&format[count++], L" ms per process (");
+        PhInitFormatU(&format[count++], cost->NumberOfQueries);
+        PhInitFormatS(&format[count++], L" queries).");
+    }
+    else
+    {
+        PhInitFormatS(&format[count++], L"; not measured yet.");
+    }
+
+    return PhFormat(format, count, 96);
+}
@@ -0,0 +1,871 @@
+/*
+ * Process Hacker -
+ *   synthetic provider benchmark
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The provider benchmark measures how the process provider, the process tree, the thread
+ * provider and handle snapshots scale, using synthetic system information so that a system with
+ * tens of thousands of processes can be simulated on any computer:
+ *
+ * -c -ctype benchmark -caction providers [-cobject <output>] [-cvalue <parameters>]
+ *
+ * The parameters are comma-separated name=value pairs:
+ *
+ * processes    the number of processes (default 10000)
+ * threads      the number of threads in each process (default 10)
+ * busythreads  the number of threads in the process watched by the thread provider (default 2000)
+ * handles      the number of handles in each process (default 100)
+ * churn        the number of processes replaced in each update (default 1% of the processes)
+ * updates      the number of measured updates (default 20)
+ *
+ * The process provider reads the synthetic buffers through the replay path (see capture.c), so
+ * it never opens the synthetic processes. Synthetic process and thread IDs start at
+ * PH_BENCH_FIRST_ID so that they can't refer to real processes; the thread provider still tries
+ * to open the synthetic threads, and those calls fail quickly. The handle provider itself isn't
+ * measured because it duplicates every handle; instead each update creates a handle snapshot
+ * and looks up the handles of every process and of a sample of objects.
+ *
+ * The output is CSV, stdout by default:
+ *
+ * phase,processes,threads,handles,updates,initial_ms,min_ms,p50_ms,max_ms,objects,private_kb
+ *
+ * initial_ms is the first update, in which every item and node is new, and is not included in
+ * the other times. objects is the mean number of objects created in each measured update and
+ * private_kb is the growth of the private bytes of this process across all measured updates.
+ */
+
+#include <phapp.h>
+#include <capture.h>
+
+#define PH_BENCH_FIRST_ID 0x40000000
+#define PH_BENCH_TREE_PARENTS 8 // each process is the parent of the next 8
+#define PH_BENCH_NAME_SIZE 64
+#define PH_BENCH_OBJECT_SEARCHES 1000
+
+typedef enum _PH_BENCH_PHASE_TYPE
+{
+    PhBenchProcessProvider,
+    PhBenchProcessTree,
+    PhBenchThreadProvider,
+    PhBenchHandleSnapshot,
+    PhBenchMaximum
+} PH_BENCH_PHASE_TYPE;
+
+typedef struct _PH_BENCH_PHASE
+{
+    PWSTR Name;
+    DOUBLE InitialTime;
+    PDOUBLE Times;
+    ULONG64 Objects;
+    LONG64 PrivateBytes;
+
+    LARGE_INTEGER StartCounter;
+    ULONG64 StartObjects;
+    LONG64 StartPrivateBytes;
+} PH_BENCH_PHASE, *PPH_BENCH_PHASE;
+
+typedef struct _PH_BENCH_PROCESS
+{
+    HANDLE ProcessId;
+    HANDLE ParentProcessId;
+    LARGE_INTEGER CreateTime;
+    ULONG FirstThreadId;
+    ULONG NumberOfThreads;
+    ULONG64 CpuTime;
+    ULONG64 CycleTime;
+    ULONG64 ReadOperations;
+    ULONG64 WriteOperations;
+    ULONG64 OtherOperations;
+    SIZE_T PrivateBytes;
+    ULONG PageFaults;
+    ULONG ContextSwitches;
+} PH_BENCH_PROCESS, *PPH_BENCH_PROCESS;
+
+static ULONG PhpBenchNumberOfProcesses = 10000;
+static ULONG PhpBenchThreads = 10;
+static ULONG PhpBenchBusyThreads = 2000;
+static ULONG PhpBenchHandles = 100;
+static ULONG PhpBenchChurn = MAXULONG; // 1% of the processes unless specified
+static ULONG PhpBenchUpdates = 20;
+
+// Index 0 is the System Idle Process and index 1 is the process watched by the thread provider.
+// Neither is ever replaced.
+static PPH_BENCH_PROCESS PhpBenchProcesses;
+static ULONG PhpBenchNextId = PH_BENCH_FIRST_ID;
+static ULONG PhpBenchRandomState = 1;
+static LARGE_INTEGER PhpBenchTime;
+static ULONG PhpBenchTicks = 0;
+
+// The next frame, built before the process provider runs. The provider takes ownership of it.
+static PVOID PhpBenchFrameBuffer;
+static ULONG PhpBenchFrameSize;
+
+static HWND PhpBenchTreeNewHandle;
+static ULONG PhpBenchColumnIds[PHPRTLC_MAXIMUM];
+static ULONG PhpBenchNumberOfColumns;
+static PPH_LIST PhpBenchAddedList;
+static PPH_LIST PhpBenchModifiedList;
+static PPH_LIST PhpBenchRemovedList;
+static PH_CALLBACK_REGISTRATION PhpBenchProcessAddedRegistration;
+static PH_CALLBACK_REGISTRATION PhpBenchProcessModifiedRegistration;
+static PH_CALLBACK_REGISTRATION PhpBenchProcessRemovedRegistration;
+
+static ULONG PhpBenchRandom(
+    VOID
+    )
+{
+    // xorshift32; the numbers only need to be repeatable between runs.
+    PhpBenchRandomState ^= PhpBenchRandomState << 13;
+    PhpBenchRandomState ^= PhpBenchRandomState >> 17;
+    PhpBenchRandomState ^= PhpBenchRandomState << 5;
+
+    return PhpBenchRandomState;
+}
+
+static BOOLEAN PhpBenchParseParameters(
+    _In_opt_ PPH_STRINGREF Parameters
+    )
+{
+    static PH_STRINGREF names[] =
+    {
+        PH_STRINGREF_INIT(L"processes"),
+        PH_STRINGREF_INIT(L"threads"),
+        PH_STRINGREF_INIT(L"busythreads"),
+        PH_STRINGREF_INIT(L"handles"),
+        PH_STRINGREF_INIT(L"churn"),
+        PH_STRINGREF_INIT(L"updates")
+    };
+    static PULONG values[] =
+    {
+        &PhpBenchNumberOfProcesses,
+        &PhpBenchThreads,
+        &PhpBenchBusyThreads,
+        &PhpBenchHandles,
+        &PhpBenchChurn,
+        &PhpBenchUpdates
+    };
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+    PH_STRINGREF namePart;
+    PH_STRINGREF valuePart;
+    LONG64 integer;
+    ULONG i;
+
+    if (Parameters)
+    {
+        remainingPart = *Parameters;
+
+        while (remainingPart.Length != 0)
+        {
+            PhSplitStringRefAtChar(&remainingPart, ',', &part, &remainingPart);
+
+            if (part.Length == 0)
+                continue;
+
+            if (!PhSplitStringRefAtChar(&part, '=', &namePart, &valuePart))
+                return FALSE;
+            if (!PhStringToInteger64(&valuePart, 10, &integer) || integer < 0 || integer > MAXLONG)
+                return FALSE;
+
+            for (i = 0; i < RTL_NUMBER_OF(names); i++)
+            {
+                if (PhEqualStringRef(&namePart, &names[i], TRUE))
+                    break;
+            }
+
+            if (i == RTL_NUMBER_OF(names))
+                return FALSE;
+
+            *values[i] = (ULONG)integer;
+        }
+    }
+
+    if (PhpBenchNumberOfProcesses < 2 || PhpBenchUpdates == 0)
+        return FALSE;
+
+    if (PhpBenchChurn == MAXULONG)
+        PhpBenchChurn = PhpBenchNumberOfProcesses / 100;
+
+    return TRUE;
+}
+
+static VOID PhpBenchInitializeProcess(
+    _In_ ULONG Index
+    )
+{
+    PPH_BENCH_PROCESS process = &PhpBenchProcesses[Index];
+
+    memset(process, 0, sizeof(PH_BENCH_PROCESS));
+    process->ProcessId = UlongToHandle(PhpBenchNextId);
+    PhpBenchNextId += 4;
+    process->ParentProcessId = PhpBenchProcesses[(Index - 1) / PH_BENCH_TREE_PARENTS].ProcessId;
+    process->CreateTime = PhpBenchTime;
+    process->NumberOfThreads = Index == 1 ? PhpBenchBusyThreads : PhpBenchThreads;
+    process->FirstThreadId = PhpBenchNextId;
+    PhpBenchNextId += process->NumberOfThreads * 4;
+    process->PrivateBytes = (1 + PhpBenchRandom() % 256) * PAGE_SIZE * 16;
+}
+
+static VOID PhpBenchAdvance(
+    VOID
+    )
+{
+    ULONG i;
+
+    PhpBenchTime.QuadPart += PH_TICKS_PER_SEC;
+    PhpBenchTicks++;
+
+    // Most processes are idle most of the time.
+    for (i = 1; i < PhpBenchNumberOfProcesses; i++)
+    {
+        PPH_BENCH_PROCESS process = &PhpBenchProcesses[i];
+
+        if (PhpBenchRandom() % 4 != 0)
+            continue;
+
+        process->CpuTime += PhpBenchRandom() % (PH_TICKS_PER_SEC / 100);
+        process->CycleTime += PhpBenchRandom() % 10000000;
+        process->ReadOperations += PhpBenchRandom() % 16;
+        process->WriteOperations += PhpBenchRandom() % 16;
+        process->OtherOperations += PhpBenchRandom() % 64;
+        process->PageFaults += PhpBenchRandom() % 32;
+        process->ContextSwitches += PhpBenchRandom() % 256;
+
+        if (PhpBenchRandom() % 2)
+            process->PrivateBytes += PAGE_SIZE;
+        else if (process->PrivateBytes > PAGE_SIZE)
+            process->PrivateBytes -= PAGE_SIZE;
+    }
+
+    if (PhpBenchNumberOfProcesses > 2)
+    {
+        for (i = 0; i < PhpBenchChurn; i++)
+            PhpBenchInitializeProcess(2 + PhpBenchRandom() % (PhpBenchNumberOfProcesses - 2));
+    }
+}
+
+static ULONG PhpBenchGetProcessEntrySize(
+    _In_ PPH_BENCH_PROCESS Process
+    )
+{
+    return FIELD_OFFSET(SYSTEM_PROCESS_INFORMATION, Threads) +
+        Process->NumberOfThreads * sizeof(SYSTEM_THREAD_INFORMATION) +
+        PH_BENCH_NAME_SIZE;
+}
+
+static VOID PhpBenchBuildProcesses(
+    VOID
+    )
+{
+    PSYSTEM_PROCESS_INFORMATION process;
+    ULONG entrySize;
+    ULONG i;
+    ULONG j;
+
+    PhpBenchFrameSize = 0;
+
+    for (i = 0; i < PhpBenchNumberOfProcesses; i++)
+        PhpBenchFrameSize += PhpBenchGetProcessEntrySize(&PhpBenchProcesses[i]);
+
+    PhpBenchFrameBuffer = PhAllocate(PhpBenchFrameSize);
+    memset(PhpBenchFrameBuffer, 0, PhpBenchFrameSize);
+    process = PhpBenchFrameBuffer;
+
+    for (i = 0; i < PhpBenchNumberOfProcesses; i++)
+    {
+        PPH_BENCH_PROCESS benchProcess = &PhpBenchProcesses[i];
+        PSYSTEM_THREAD_INFORMATION thread;
+
+        entrySize = PhpBenchGetProcessEntrySize(benchProcess);
+
+        if (i != PhpBenchNumberOfProcesses - 1)
+            process->NextEntryOffset = entrySize;
+
+        process->NumberOfThreads = benchProcess->NumberOfThreads;
+        process->NumberOfThreadsHighWatermark = benchProcess->NumberOfThreads;
+        process->CycleTime = benchProcess->CycleTime;
+        process->CreateTime = benchProcess->CreateTime;
+        process->UserTime.QuadPart = benchProcess->CpuTime / 2;
+        process->KernelTime.QuadPart = benchProcess->CpuTime - process->UserTime.QuadPart;
+        process->BasePriority = 8;
+        process->UniqueProcessId = benchProcess->ProcessId;
+        process->InheritedFromUniqueProcessId = benchProcess->ParentProcessId;
+        process->HandleCount = i != 0 ? PhpBenchHandles : 0;
+        process->SessionId = 1;
+        process->UniqueProcessKey = (ULONG_PTR)benchProcess->ProcessId;
+        process->VirtualSize = benchProcess->PrivateBytes * 4;
+        process->PeakVirtualSize = process->VirtualSize;
+        process->PageFaultCount = benchProcess->PageFaults;
+        process->WorkingSetSize = benchProcess->PrivateBytes / 2;
+        process->PeakWorkingSetSize = process->WorkingSetSize;
+        process->WorkingSetPrivateSize.QuadPart = process->WorkingSetSize / 2;
+        process->PagefileUsage = benchProcess->PrivateBytes;
+        process->PeakPagefileUsage = benchProcess->PrivateBytes;
+        process->PrivatePageCount = benchProcess->PrivateBytes;
+        process->ReadOperationCount.QuadPart = benchProcess->ReadOperations;
+        process->WriteOperationCount.QuadPart = benchProcess->WriteOperations;
+        process->OtherOperationCount.QuadPart = benchProcess->OtherOperations;
+        process->ReadTransferCount.QuadPart = benchProcess->ReadOperations * PAGE_SIZE;
+        process->WriteTransferCount.QuadPart = benchProcess->WriteOperations * PAGE_SIZE;
+        process->OtherTransferCount.QuadPart = benchProcess->OtherOperations * 64;
+
+        for (j = 0; j < benchProcess->NumberOfThreads; j++)
+        {
+            thread = &process->Threads[j];
+            thread->KernelTime.QuadPart = process->KernelTime.QuadPart / benchProcess->NumberOfThreads;
+            thread->UserTime.QuadPart = process->UserTime.QuadPart / benchProcess->NumberOfThreads;
+            thread->CreateTime = benchProcess->CreateTime;
+            thread->StartAddress = (PVOID)(ULONG_PTR)(0x10000 + j * 0x10);
+            thread->ClientId.UniqueProcess = benchProcess->ProcessId;
+            thread->ClientId.UniqueThread = UlongToHandle(benchProcess->FirstThreadId + j * 4);
+            thread->Priority = 8;
+            thread->BasePriority = 8;
+            thread->ContextSwitches = benchProcess->ContextSwitches + j;
+            thread->ThreadState = Waiting;
+            thread->WaitReason = UserRequest;
+        }
+
+        if (i != 0)
+        {
+            PH_FORMAT format[3];
+            SIZE_T returnLength;
+
+            PhInitFormatS(&format[0], L"bench");
+            PhInitFormatU(&format[1], HandleToUlong(benchProcess->ProcessId));
+            PhInitFormatS(&format[2], L".exe");
+
+            process->ImageName.Buffer = (PWSTR)PTR_ADD_OFFSET(process, entrySize - PH_BENCH_NAME_SIZE);
+            PhFormatToBuffer(format, 3, process->ImageName.Buffer, PH_BENCH_NAME_SIZE, &returnLength);
+            process->ImageName.Length = (USHORT)(returnLength - sizeof(WCHAR));
+            process->ImageName.MaximumLength = (USHORT)returnLength;
+        }
+
+        process = PTR_ADD_OFFSET(process, entrySize);
+    }
+}
+
+static PSYSTEM_HANDLE_INFORMATION_EX PhpBenchBuildHandles(
+    VOID
+    )
+{
+    PSYSTEM_HANDLE_INFORMATION_EX information;
+    PSYSTEM_HANDLE_TABLE_ENTRY_INFO_EX handle;
+    ULONG_PTR numberOfHandles;
+    ULONG numberOfObjects;
+    ULONG i;
+    ULONG j;
+
+    numberOfHandles = (ULONG_PTR)(PhpBenchNumberOfProcesses - 1) * PhpBenchHandles;
+    information = PhAllocate(FIELD_OFFSET(SYSTEM_HANDLE_INFORMATION_EX, Handles) +
+        max(numberOfHandles, 1) * sizeof(SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX));
+    information->NumberOfHandles = numberOfHandles;
+    information->Reserved = 0;
+
+    // Objects are shared between handles, as they are between real processes.
+    numberOfObjects = (ULONG)max(numberOfHandles / 4, 1);
+    handle = information->Handles;
+
+    for (i = 1; i < PhpBenchNumberOfProcesses; i++)
+    {
+        for (j = 0; j < PhpBenchHandles; j++)
+        {
+            handle->Object = (PVOID)((ULONG_PTR)0x80000000 + ((ULONG_PTR)(PhpBenchRandom() % numberOfObjects) << 6));
+            handle->UniqueProcessId = (ULONG_PTR)PhpBenchProcesses[i].ProcessId;
+            handle->HandleValue = (j + 1) * 4;
+            handle->GrantedAccess = 0x1f0003;
+            handle->CreatorBackTraceIndex = 0;
+            handle->ObjectTypeIndex = (USHORT)(2 + PhpBenchRandom() % 40);
+            handle->HandleAttributes = 0;
+            handle->Reserved = 0;
+            handle++;
+        }
+    }
+
+    return information;
+}
+
+static BOOLEAN NTAPI PhpBenchFrameSource(
+    _Out_ PSYSTEM_PERFORMANCE_INFORMATION PerfInformation,
+    _Out_writes_(NumberOfProcessors) PSYSTEM_PROCESSOR_PERFORMANCE_INFORMATION CpuInformation,
+    _In_ ULONG NumberOfProcessors,
+    _Out_ PPH_REPLAY_FRAME Frame
+    )
+{
+    ULONG i;
+
+    if (!PhpBenchFrameBuffer)
+        return FALSE;
+
+    memset(PerfInformation, 0, sizeof(SYSTEM_PERFORMANCE_INFORMATION));
+    PerfInformation->IoReadOperationCount = PhpBenchTicks * 1000;
+    PerfInformation->IoWriteOperationCount = PhpBenchTicks * 1000;
+    PerfInformation->IoOtherOperationCount = PhpBenchTicks * 4000;
+    PerfInformation->AvailablePages = 0x100000;
+    PerfInformation->CommittedPages = 0x100000;
+    PerfInformation->CommitLimit = 0x400000;
+    PerfInformation->PeakCommitment = 0x200000;
+
+    // 70% idle, 10% kernel and 20% user time on every processor. The kernel time includes the
+    // idle time.
+    for (i = 0; i < NumberOfProcessors; i++)
+    {
+        memset(&CpuInformation[i], 0, sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION));
+        CpuInformation[i].IdleTime.QuadPart = (LONG64)PhpBenchTicks * PH_TICKS_PER_SEC * 7 / 10;
+        CpuInformation[i].KernelTime.QuadPart = (LONG64)PhpBenchTicks * PH_TICKS_PER_SEC * 8 / 10;
+        CpuInformation[i].UserTime.QuadPart = (LONG64)PhpBenchTicks * PH_TICKS_PER_SEC * 2 / 10;
+    }
+
+    Frame->Time = PhpBenchTime;
+    Frame->Processes = PhpBenchFrameBuffer;
+    Frame->ProcessesSize = PhpBenchFrameSize;
+    Frame->Discontinuity = FALSE;
+
+    PhpBenchFrameBuffer = NULL;
+
+    return TRUE;
+}
+
+static ULONG64 PhpBenchGetObjectCount(
+    VOID
+    )
+{
+    PPH_OBJECT_TYPE types[] =
+    {
+        PhStringType,
+        PhBytesType,
+        PhListType,
+        PhPointerListType,
+        PhHashtableType,
+        PhProcessItemType,
+        PhThreadItemType
+    };
+    PH_OBJECT_TYPE_INFORMATION info;
+    ULONG64 count;
+    ULONG i;
+
+    // Objects that come from a type free list aren't counted by the object manager.
+    count = 0;
+
+    for (i = 0; i < RTL_NUMBER_OF(types); i++)
+    {
+        PhGetObjectTypeInformation(types[i], &info);
+        count += (ULONG64)info.NumberOfCacheHits + info.NumberOfCacheMisses;
+    }
+
+    return count;
+}
+
+static LONG64 PhpBenchGetPrivateBytes(
+    VOID
+    )
+{
+    VM_COUNTERS vmCounters;
+
+    if (!NT_SUCCESS(NtQueryInformationProcess(
+        NtCurrentProcess(),
+        ProcessVmCounters,
+        &vmCounters,
+        sizeof(VM_COUNTERS),
+        NULL
+        )))
+        return 0;
+
+    return vmCounters.PagefileUsage;
+}
+
+static VOID PhpBenchBeginPhase(
+    _Inout_ PPH_BENCH_PHASE Phase
+    )
+{
+    Phase->StartObjects = PhpBenchGetObjectCount();
+    Phase->StartPrivateBytes = PhpBenchGetPrivateBytes();
+    NtQueryPerformanceCounter(&Phase->StartCounter, NULL);
+}
+
+static VOID PhpBenchEndPhase(
+    _Inout_ PPH_BENCH_PHASE Phase,
+    _In_ ULONG Update
+    )
+{
+    LARGE_INTEGER endCounter;
+    LARGE_INTEGER frequency;
+    DOUBLE time;
+
+    NtQueryPerformanceCounter(&endCounter, &frequency);
+    time = (DOUBLE)(endCounter.QuadPart - Phase->StartCounter.QuadPart) * 1000 / frequency.QuadPart;
+
+    if (Update == 0)
+    {
+        Phase->InitialTime = time;
+        return;
+    }
+
+    Phase->Times[Update - 1] = time;
+    Phase->Objects += PhpBenchGetObjectCount() - Phase->StartObjects;
+    Phase->PrivateBytes += PhpBenchGetPrivateBytes() - Phase->StartPrivateBytes;
+}
+
+static VOID NTAPI PhpBenchProcessAddedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    // The reference is given to the process node.
+    PhReferenceObject(Parameter);
+    PhAddItemList(PhpBenchAddedList, Parameter);
+}
+
+static VOID NTAPI PhpBenchProcessModifiedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PhAddItemList(PhpBenchModifiedList, Parameter);
+}
+
+static VOID NTAPI PhpBenchProcessRemovedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    // The process node still has a reference to the process item.
+    PhAddItemList(PhpBenchRemovedList, Parameter);
+}
+
+static BOOLEAN PhpBenchCreateProcessTree(
+    VOID
+    )
+{
+    PH_TREENEW_COLUMN column;
+    ULONG i;
+
+    PhGuiSupportInitialization();
+    PhTreeNewInitialization();
+
+    // The window is never shown, so nothing is painted; PhpBenchUpdateProcessTree gets the text
+    // of every cell instead.
+    PhpBenchTreeNewHandle = CreateWindow(
+        PH_TREENEW_CLASSNAME,
+        NULL,
+        WS_POPUP | WS_CLIPCHILDREN | WS_CLIPSIBLINGS | TN_STYLE_ICONS | TN_STYLE_DOUBLE_BUFFERED,
+        0,
+        0,
+        800,
+        600,
+        NULL,
+        NULL,
+        PhLibImageBase,
+        NULL
+        );
+
+    if (!PhpBenchTreeNewHandle)
+        return FALSE;
+
+    PhProcessTreeListInitialization();
+    PhInitializeProcessTreeList(PhpBenchTreeNewHandle);
+    PhLoadSettingsProcessTreeList();
+
+    PhpBenchNumberOfColumns = 0;
+
+    for (i = 0; i < PHPRTLC_MAXIMUM; i++)
+    {
+        if (TreeNew_GetColumn(PhpBenchTreeNewHandle, i, &column) && column.Visible)
+            PhpBenchColumnIds[PhpBenchNumberOfColumns++] = i;
+    }
+
+    PhpBenchAddedList = PhCreateList(PhpBenchNumberOfProcesses);
+    PhpBenchModifiedList = PhCreateList(PhpBenchNumberOfProcesses);
+    PhpBenchRemovedList = PhCreateList(max(PhpBenchChurn, 1));
+
+    PhRegisterCallback(&PhProcessAddedEvent, PhpBenchProcessAddedHandler, NULL, &PhpBenchProcessAddedRegistration);
+    PhRegisterCallback(&PhProcessModifiedEvent, PhpBenchProcessModifiedHandler, NULL, &PhpBenchProcessModifiedRegistration);
+    PhRegisterCallback(&PhProcessRemovedEvent, PhpBenchProcessRemovedHandler, NULL, &PhpBenchProcessRemovedRegistration);
+
+    return TRUE;
+}
+
+static VOID PhpBenchUpdateProcessTree(
+    _In_ ULONG RunId
+    )
+{
+    PH_TREENEW_GET_CELL_TEXT getCellText;
+    PPH_PROCESS_ITEM processItem;
+    ULONG numberOfNodes;
+    ULONG i;
+    ULONG j;
+
+    // This is what the main window does for each update.
+
+    TreeNew_SetRedraw(PhpBenchTreeNewHandle, FALSE);
+
+    for (i = 0; i < PhpBenchAddedList->Count; i++)
+    {
+        processItem = PhpBenchAddedList->Items[i];
+        PhAddProcessNode(processItem, RunId);
+        PhDereferenceObject(processItem);
+    }
+
+    for (i = 0; i < PhpBenchModifiedList->Count; i++)
+    {
+        processItem = PhpBenchModifiedList->Items[i];
+        PhUpdateProcessNode(PhFindProcessNode(processItem->ProcessId));
+    }
+
+    for (i = 0; i < PhpBenchRemovedList->Count; i++)
+    {
+        processItem = PhpBenchRemovedList->Items[i];
+        PhRemoveProcessNode(PhFindProcessNode(processItem->ProcessId));
+    }
+
+    PhClearList(PhpBenchAddedList);
+    PhClearList(PhpBenchModifiedList);
+    PhClearList(PhpBenchRemovedList);
+
+    PhTickProcessNodes();
+    TreeNew_SetRedraw(PhpBenchTreeNewHandle, TRUE);
+
+    numberOfNodes = TreeNew_GetFlatNodeCount(PhpBenchTreeNewHandle);
+
+    for (i = 0; i < numberOfNodes; i++)
+    {
+        memset(&getCellText, 0, sizeof(PH_TREENEW_GET_CELL_TEXT));
+        getCellText.Node = TreeNew_GetFlatNode(PhpBenchTreeNewHandle, i);
+
+        for (j = 0; j < PhpBenchNumberOfColumns; j++)
+        {
+            getCellText.Id = PhpBenchColumnIds[j];
+            TreeNew_GetCellText(PhpBenchTreeNewHandle, &getCellText);
+        }
+    }
+}
+
+static VOID PhpBenchPumpMessages(
+    VOID
+    )
+{
+    MSG message;
+
+    while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
+    {
+        TranslateMessage(&message);
+        DispatchMessage(&message);
+    }
+}
+
+static VOID PhpBenchSearchHandles(
+    _In_ PSYSTEM_HANDLE_INFORMATION_EX Information
+    )
+{
+    PPH_HANDLE_SNAPSHOT snapshot;
+    PULONG indices;
+    ULONG i;
+
+    // This is the work done by handle searches and handle providers after enumerating the
+    // handles.
+
+    PhCreateHandleSnapshot(Information, &snapshot);
+
+    for (i = 1; i < PhpBenchNumberOfProcesses; i++)
+        PhFindProcessHandlesSnapshot(snapshot, PhpBenchProcesses[i].ProcessId, &indices);
+
+    // The first search builds the object index.
+    if (snapshot->NumberOfHandles != 0)
+    {
+        for (i = 0; i < PH_BENCH_OBJECT_SEARCHES; i++)
+        {
+            PhFindObjectHandlesSnapshot(
+                snapshot,
+                snapshot->Information->Handles[PhpBenchRandom() % snapshot->NumberOfHandles].Object,
+                &indices
+                );
+        }
+    }
+
+    PhDereferenceObject(snapshot);
+}
+
+static int __cdecl PhpBenchCompareTimes(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    DOUBLE time1 = *(PDOUBLE)elem1;
+    DOUBLE time2 = *(PDOUBLE)elem2;
+
+    if (time1 < time2)
+        return -1;
+    else if (time1 > time2)
+        return 1;
+    else
+        return 0;
+}
+
+static NTSTATUS PhpBenchWriteResults(
+    _In_ PPH_FILE_STREAM Stream,
+    _In_ PPH_BENCH_PHASE Phases
+    )
+{
+    NTSTATUS status;
+    PPH_STRING line;
+    ULONG i;
+
+    status = PhWriteStringAsUtf8FileStream2(Stream, L"phase,processes,threads,handles,updates,initial_ms,min_ms,p50_ms,max_ms,objects,private_kb\r\n");
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    for (i = 0; i < PhBenchMaximum; i++)
+    {
+        PPH_BENCH_PHASE phase = &Phases[i];
+
+        qsort(phase->Times, PhpBenchUpdates, sizeof(DOUBLE), PhpBenchCompareTimes);
+
+        line = PhFormatString(
+            L"%s,%u,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%I64u,%I64d\r\n",
+            phase->Name,
+            PhpBenchNumberOfProcesses,
+            PhpBenchThreads,
+            PhpBenchHandles,
+            PhpBenchUpdates,
+            phase->InitialTime,
+            phase->Times[0],
+            phase->Times[(PhpBenchUpdates - 1) / 2],
+            phase->Times[PhpBenchUpdates - 1],
+            phase->Objects / PhpBenchUpdates,
+            phase->PrivateBytes / 1024
+            );
+        status = PhWriteStringAsUtf8FileStream(Stream, &line->sr);
+        PhDereferenceObject(line);
+
+        if (!NT_SUCCESS(status))
+            return status;
+    }
+
+    return PhFlushFileStream(Stream, FALSE);
+}
+
+/**
+ * Runs the providers and the process tree on synthetic information and writes the time taken by
+ * each of them.
+ */
+NTSTATUS PhCommandModeBenchmark(
+    VOID
+    )
+{
+    NTSTATUS status;
+    PPH_FILE_STREAM stream;
+    PH_BENCH_PHASE phases[PhBenchMaximum];
+    PPH_THREAD_PROVIDER threadProvider;
+    PSYSTEM_HANDLE_INFORMATION_EX handleInformation;
+    ULONG update;
+    ULONG i;
+
+    if (!PhEqualString2(PhStartupParameters.CommandAction, L"providers", TRUE))
+        return STATUS_INVALID_PARAMETER;
+
+    if (!PhpBenchParseParameters(PhStartupParameters.CommandValue ? &PhStartupParameters.CommandValue->sr : NULL))
+        return STATUS_INVALID_PARAMETER;
+
+    if (PhStartupParameters.CommandObject)
+    {
+        status = PhCreateFileStream(
+            &stream,
+            PhStartupParameters.CommandObject->Buffer,
+            FILE_GENERIC_WRITE,
+            FILE_SHARE_READ,
+            FILE_OVERWRITE_IF,
+            0
+            );
+    }
+    else
+    {
+        HANDLE outputHandle = NtCurrentPeb()->ProcessParameters->StandardOutput;
+
+        // We are a GUI application, so stdout is only set when it has been redirected.
+        if (!outputHandle || outputHandle == INVALID_HANDLE_VALUE)
+            return STATUS_INVALID_HANDLE;
+
+        status = PhCreateFileStream2(&stream, outputHandle, PH_FILE_STREAM_HANDLE_UNOWNED, PAGE_SIZE);
+    }
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    memset(phases, 0, sizeof(phases));
+    phases[PhBenchProcessProvider].Name = L"process_provider";
+    phases[PhBenchProcessTree].Name = L"process_tree";
+    phases[PhBenchThreadProvider].Name = L"thread_provider";
+    phases[PhBenchHandleSnapshot].Name = L"handle_snapshot";
+
+    for (i = 0; i < PhBenchMaximum; i++)
+        phases[i].Times = PhAllocate(PhpBenchUpdates * sizeof(DOUBLE));
+
+    // Synthesize the initial system.
+
+    PhQuerySystemTime(&PhpBenchTime);
+    PhpBenchProcesses = PhAllocate(PhpBenchNumberOfProcesses * sizeof(PH_BENCH_PROCESS));
+    memset(&PhpBenchProcesses[0], 0, sizeof(PH_BENCH_PROCESS)); // System Idle Process
+
+    for (i = 1; i < PhpBenchNumberOfProcesses; i++)
+        PhpBenchInitializeProcess(i);
+
+    PhSetProviderReplaySource(PhpBenchFrameSource);
+
+    if (!PhpBenchCreateProcessTree())
+    {
+        status = PhGetLastWin32ErrorAsNtStatus();
+        PhDereferenceObject(stream);
+        return status;
+    }
+
+    threadProvider = PhCreateThreadProvider(PhpBenchProcesses[1].ProcessId);
+
+    for (update = 0; update <= PhpBenchUpdates; update++)
+    {
+        // Building the information isn't measured.
+        if (update != 0)
+            PhpBenchAdvance();
+
+        PhpBenchBuildProcesses();
+        handleInformation = PhpBenchBuildHandles();
+
+        PhpBenchBeginPhase(&phases[PhBenchProcessProvider]);
+        PhProcessProviderUpdate(NULL);
+        PhpBenchEndPhase(&phases[PhBenchProcessProvider], update);
+
+        PhpBenchBeginPhase(&phases[PhBenchProcessTree]);
+        PhpBenchUpdateProcessTree(update + 1);
+        PhpBenchEndPhase(&phases[PhBenchProcessTree], update);
+
+        PhpBenchPumpMessages();
+
+        PhpBenchBeginPhase(&phases[PhBenchThreadProvider]);
+        PhThreadProviderInitialUpdate(threadProvider);
+        PhpBenchEndPhase(&phases[PhBenchThreadProvider], update);
+
+        PhpBenchBeginPhase(&phases[PhBenchHandleSnapshot]);
+        PhpBenchSearchHandles(handleInformation);
+        PhpBenchEndPhase(&phases[PhBenchHandleSnapshot], update);
+    }
+
+    status = PhpBenchWriteResults(stream, phases);
+    PhDereferenceObject(stream);
+
+    return status;
+}
@@ -0,0 +1,316 @@
+/*
+ * Process Hacker -
+ *   regular expression support
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Regular expressions typed by the user are matched against very large sets of strings: every
+ * handle and module name in the system, every memory search result, every node of a filtered
+ * tree. This module compiles patterns once with the JIT compiler (when PCRE2 was built with it)
+ * and keeps the compiled patterns in a small cache keyed by the pattern string, so re-running a
+ * search or re-applying a filter doesn't compile the pattern again.
+ *
+ * Compiled patterns can be shared between threads but match data can't. Every match takes a
+ * match block (match data, match context and JIT stack) from a lock-free list and returns it
+ * afterwards, so each thread effectively reuses its own block without any per-match allocation.
+ * Match data with a single pair of offsets is enough for any pattern because only the success of
+ * the match is needed.
+ */
+
+#include <phapp.h>
+#include <regexsup.h>
+#include "pcre/pcre2.h"
+
+#define PH_REGEX_CACHE_SIZE 32
+#define PH_REGEX_JIT_STACK_START (32 * 1024)
+#define PH_REGEX_JIT_STACK_MAXIMUM (512 * 1024)
+
+typedef struct _PH_REGEX
+{
+    PPH_STRING Pattern;
+    ULONG Flags;
+    pcre2_code *Code;
+    BOOLEAN Jit; // the pattern was compiled to machine code
+} PH_REGEX;
+
+typedef struct _PHP_REGEX_CACHE_ENTRY
+{
+    PH_STRINGREF Pattern; // points into Regex->Pattern
+    ULONG Flags;
+    PPH_REGEX Regex;
+} PHP_REGEX_CACHE_ENTRY, *PPHP_REGEX_CACHE_ENTRY;
+
+typedef struct _PHP_REGEX_MATCH_BLOCK
+{
+    SLIST_ENTRY ListEntry;
+    pcre2_match_data *MatchData;
+    pcre2_match_context *MatchContext;
+    pcre2_jit_stack *JitStack;
+} PHP_REGEX_MATCH_BLOCK, *PPHP_REGEX_MATCH_BLOCK;
+
+static PPH_OBJECT_TYPE PhpRegexType;
+static PPH_HASHTABLE PhpRegexCacheHashtable;
+static PH_QUEUED_LOCK PhpRegexCacheLock = PH_QUEUED_LOCK_INIT;
+// Match blocks are never freed; there are at most as many as threads that matched concurrently.
+static SLIST_HEADER PhpRegexMatchBlockListHead;
+
+VOID NTAPI PhpRegexDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPH_REGEX regex = Object;
+
+    pcre2_code_free(regex->Code);
+    PhDereferenceObject(regex->Pattern);
+}
+
+BOOLEAN NTAPI PhpRegexCacheEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPHP_REGEX_CACHE_ENTRY entry1 = Entry1;
+    PPHP_REGEX_CACHE_ENTRY entry2 = Entry2;
+
+    return entry1->Flags == entry2->Flags && PhEqualStringRef(&entry1->Pattern, &entry2->Pattern, FALSE);
+}
+
+ULONG NTAPI PhpRegexCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPHP_REGEX_CACHE_ENTRY entry = Entry;
+
+    return PhHashStringRef(&entry->Pattern, FALSE) ^ entry->Flags;
+}
+
+static VOID PhpRegexInitialization(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpRegexType = PhCreateObjectType(L"Regex", 0, PhpRegexDeleteProcedure);
+        PhpRegexCacheHashtable = PhCreateHashtable(
+            sizeof(PHP_REGEX_CACHE_ENTRY),
+            PhpRegexCacheEqualFunction,
+            PhpRegexCacheHashFunction,
+            PH_REGEX_CACHE_SIZE
+            );
+        RtlInitializeSListHead(&PhpRegexMatchBlockListHead);
+
+        PhEndInitOnce(&initOnce);
+    }
+}
+
+static VOID PhpClearRegexCache(
+    VOID
+    )
+{
+    ULONG enumerationKey = 0;
+    PPHP_REGEX_CACHE_ENTRY entry;
+
+    while (PhEnumHashtable(PhpRegexCacheHashtable, &entry, &enumerationKey))
+        PhDereferenceObject(entry->Regex);
+
+    PhClearHashtable(PhpRegexCacheHashtable);
+}
+
+/**
+ * Compiles a regular expression.
+ *
+ * \param Pattern The pattern.
+ * \param Flags A combination of flags.
+ * \li \c PH_REGEX_IGNORE_CASE The pattern is case-insensitive.
+ * \param ErrorCode A variable which receives the PCRE2 error code if the pattern could not be
+ * compiled. Use PhPcre2GetErrorMessage to get a description of the error.
+ * \param ErrorOffset A variable which receives the position of the error in the pattern.
+ *
+ * \return A referenced regular expression object, or NULL if the pattern could not be
+ * compiled. Patterns are always compiled with PCRE2_DOTALL.
+ */
+PPH_REGEX PhCompileRegex(
+    _In_ PPH_STRINGREF Pattern,
+    _In_ ULONG Flags,
+    _Out_opt_ PINT ErrorCode,
+    _Out_opt_ PSIZE_T ErrorOffset
+    )
+{
+    PHP_REGEX_CACHE_ENTRY lookupEntry;
+    PPHP_REGEX_CACHE_ENTRY entry;
+    PPH_REGEX regex;
+    pcre2_code *code;
+    int errorCode;
+    PCRE2_SIZE errorOffset;
+
+    PhpRegexInitialization();
+
+    lookupEntry.Pattern = *Pattern;
+    lookupEntry.Flags = Flags;
+
+    PhAcquireQueuedLockShared(&PhpRegexCacheLock);
+
+    if (entry = PhFindEntryHashtable(PhpRegexCacheHashtable, &lookupEntry))
+    {
+        regex = entry->Regex;
+        PhReferenceObject(regex);
+    }
+    else
+    {
+        regex = NULL;
+    }
+
+    PhReleaseQueuedLockShared(&PhpRegexCacheLock);
+
+    if (regex)
+        return regex;
+
+    code = pcre2_compile(
+        Pattern->Buffer,
+        Pattern->Length / sizeof(WCHAR),
+        ((Flags & PH_REGEX_IGNORE_CASE) ? PCRE2_CASELESS : 0) | PCRE2_DOTALL,
+        &errorCode,
+        &errorOffset,
+        NULL
+        );
+
+    if (!code)
+    {
+        if (ErrorCode)
+            *ErrorCode = errorCode;
+        if (ErrorOffset)
+            *ErrorOffset = errorOffset;
+
+        return NULL;
+    }
+
+    regex = PhCreateObject(sizeof(PH_REGEX), PhpRegexType);
+    regex->Pattern = PhCreateString2(Pattern);
+    regex->Flags = Flags;
+    regex->Code = code;
+    // This fails with PCRE2_ERROR_JIT_BADOPTION if PCRE2 was built without JIT support; the
+    // interpreter is used in that case.
+    regex->Jit = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) == 0;
+
+    lookupEntry.Pattern = regex->Pattern->sr;
+    lookupEntry.Regex = regex;
+
+    PhAcquireQueuedLockExclusive(&PhpRegexCacheLock);
+
+    // The cache only has to cover the patterns in use at the same time, so it is simply emptied
+    // when it fills up.
+    if (PhpRegexCacheHashtable->Count >= PH_REGEX_CACHE_SIZE)
+        PhpClearRegexCache();
+
+    if (PhAddEntryHashtable(PhpRegexCacheHashtable, &lookupEntry))
+        PhReferenceObject(regex);
+
+    PhReleaseQueuedLockExclusive(&PhpRegexCacheLock);
+
+    return regex;
+}
+
+static PPHP_REGEX_MATCH_BLOCK PhpCreateRegexMatchBlock(
+    VOID
+    )
+{
+    PPHP_REGEX_MATCH_BLOCK block;
+
+    block = PhAllocate(sizeof(PHP_REGEX_MATCH_BLOCK));
+    block->MatchData = pcre2_match_data_create(1, NULL);
+    block->MatchContext = pcre2_match_context_create(NULL);
+    block->JitStack = pcre2_jit_stack_create(PH_REGEX_JIT_STACK_START, PH_REGEX_JIT_STACK_MAXIMUM, NULL);
+
+    if (!block->MatchData || !block->MatchContext)
+    {
+        if (block->MatchData)
+            pcre2_match_data_free(block->MatchData);
+        if (block->MatchContext)
+            pcre2_match_context_free(block->MatchContext);
+        if (block->JitStack)
+            pcre2_jit_stack_free(block->JitStack);
+
+        PhFree(block);
+
+        return NULL;
+    }
+
+    // Without a JIT stack (or JIT support), the default 32 kB machine stack area is used.
+    if (block->JitStack)
+        pcre2_jit_stack_assign(block->MatchContext, NULL, block->JitStack);
+
+    return block;
+}
+
+/**
+ * Determines whether a regular expression matches a string.
+ *
+ * \param Regex A regular expression.
+ * \param Text The string to search.
+ *
+ * \return TRUE if the pattern matches any part of the string, otherwise FALSE.
+ *
+ * \remarks This function can be called from any number of threads at the same time.
+ */
+BOOLEAN PhMatchRegex(
+    _In_ PPH_REGEX Regex,
+    _In_ PPH_STRINGREF Text
+    )
+{
+    PSLIST_ENTRY listEntry;
+    PPHP_REGEX_MATCH_BLOCK block;
+    int result;
+
+    if (listEntry = RtlInterlockedPopEntrySList(&PhpRegexMatchBlockListHead))
+        block = CONTAINING_RECORD(listEntry, PHP_REGEX_MATCH_BLOCK, ListEntry);
+    else if (!(block = PhpCreateRegexMatchBlock()))
+        return FALSE;
+
+    if (Regex->Jit)
+    {
+        // Skips the option checks of pcre2_match; the pattern is known to be JIT compiled.
+        result = pcre2_jit_match(
+            Regex->Code,
+            Text->Buffer,
+            Text->Length / sizeof(WCHAR),
+            0,
+            0,
+            block->MatchData,
+            block->MatchContext
+            );
+    }
+    else
+    {
+        result = pcre2_match(
+            Regex->Code,
+            Text->Buffer,
+            Text->Length / sizeof(WCHAR),
+            0,
+            0,
+            block->MatchData,
+            block->MatchContext
+            );
+    }
+
+    RtlInterlockedPushEntrySList(&PhpRegexMatchBlockListHead, &block->ListEntry);
+
+    return result >= 0;
+}
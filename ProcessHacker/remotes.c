@@ -0,0 +1,1125 @@
+/*
+ * Process Hacker -
+ *   remote hosts
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This window shows the processes of several machines in one list. Each machine runs the
+ * headless monitor in delta mode on a named pipe:
+ *
+ * ProcessHacker.exe -c -ctype monitor -caction delta -cobject \\.\pipe\ProcessHackerMonitor
+ *
+ * Every host has a reader thread which applies the delta samples to a compact array of
+ * processes. The UI thread only looks at the processes marked as added or changed since its last
+ * update, so the cost of an update depends on what has changed rather than on the number of
+ * hosts.
+ */
+
+#include <phapp.h>
+#include <monitor.h>
+#include <settings.h>
+
+#define WM_PH_REMOTES_UPDATED (WM_APP + 321)
+
+#define PHP_REMOTE_RECONNECT_DELAY 5000
+#define PHP_REMOTE_MAX_SAMPLE_LENGTH (16 * 1024 * 1024)
+
+typedef enum _PHP_REMOTE_COLUMN
+{
+    PhpRemoteHostColumn,
+    PhpRemoteNameColumn,
+    PhpRemotePidColumn,
+    PhpRemoteCpuColumn,
+    PhpRemotePrivateBytesColumn,
+    PhpRemoteWorkingSetColumn,
+    PhpRemoteIoReadColumn,
+    PhpRemoteIoWriteColumn,
+    PhpRemoteThreadsColumn,
+    PhpRemoteHandlesColumn,
+    PhpRemoteMaximumColumn
+} PHP_REMOTE_COLUMN;
+
+struct _PHP_REMOTE_NODE;
+
+#define PHP_REMOTE_PROCESS_ADDED 0x1
+#define PHP_REMOTE_PROCESS_CHANGED 0x2
+
+typedef struct _PHP_REMOTE_PROCESS
+{
+    ULONG ProcessId;
+    ULONG Flags;
+    struct _PHP_REMOTE_NODE *Node; // set by the UI thread
+    PPH_STRING Name;
+    ULONG64 Values[PhMonitorFieldMaximum];
+} PHP_REMOTE_PROCESS, *PPHP_REMOTE_PROCESS;
+
+typedef struct _PHP_REMOTE_HOST
+{
+    PPH_STRING PipeName;
+    PPH_STRING HostName;
+    BOOLEAN Stop;
+    LONG UpdatePosted;
+
+    // Everything below is protected by the lock.
+    PH_QUEUED_LOCK Lock;
+    HWND WindowHandle; // NULL once the window no longer wants updates
+    BOOLEAN Connected;
+    NTSTATUS Status;
+    ULONG64 Interval; // between the last two samples, in 100ns units
+
+    PPHP_REMOTE_PROCESS Processes;
+    ULONG NumberOfProcesses;
+    ULONG AllocatedProcesses;
+    PPH_HASHTABLE ProcessIndexes; // process ID -> index in Processes
+    PPH_LIST RemovedNodes;
+} PHP_REMOTE_HOST, *PPHP_REMOTE_HOST;
+
+typedef struct _PHP_REMOTE_NODE
+{
+    PH_TREENEW_NODE Node;
+
+    PPHP_REMOTE_HOST Host;
+    ULONG ProcessId;
+    BOOLEAN Removed;
+    PPH_STRING Name;
+    ULONG64 Values[PhMonitorFieldMaximum];
+
+    PH_STRINGREF TextCache[PhpRemoteMaximumColumn];
+    PPH_STRING Text[PhpRemoteMaximumColumn];
+} PHP_REMOTE_NODE, *PPHP_REMOTE_NODE;
+
+typedef struct _PHP_REMOTES_CONTEXT
+{
+    HWND TreeNewHandle;
+    PPH_LIST HostList;
+    PPH_LIST NodeList;
+
+    ULONG SortColumn;
+    PH_SORT_ORDER SortOrder;
+} PHP_REMOTES_CONTEXT, *PPHP_REMOTES_CONTEXT;
+
+typedef struct _PHP_REMOTE_READER
+{
+    PUCHAR Position;
+    PUCHAR End;
+} PHP_REMOTE_READER, *PPHP_REMOTE_READER;
+
+INT_PTR CALLBACK PhpRemoteHostsDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
+static PPH_OBJECT_TYPE PhpRemoteHostType;
+
+VOID PhShowRemoteHostsDialog(
+    _In_ HWND ParentWindowHandle
+    )
+{
+    DialogBox(
+        PhInstanceHandle,
+        MAKEINTRESOURCE(IDD_REMOTEHOSTS),
+        ParentWindowHandle,
+        PhpRemoteHostsDlgProc
+        );
+}
+
+static VOID PhpRemoteHostDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPHP_REMOTE_HOST host = Object;
+    ULONG i;
+
+    for (i = 0; i < host->NumberOfProcesses; i++)
+        PhClearReference(&host->Processes[i].Name);
+
+    PhFree(host->Processes);
+    PhDereferenceObject(host->ProcessIndexes);
+    PhDereferenceObject(host->RemovedNodes);
+    PhDereferenceObject(host->PipeName);
+    PhDereferenceObject(host->HostName);
+}
+
+static PPHP_REMOTE_HOST PhpCreateRemoteHost(
+    _In_ PPH_STRINGREF Name,
+    _In_ HWND WindowHandle
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    static PH_STRINGREF uncPrefix = PH_STRINGREF_INIT(L"\\\\");
+    PPHP_REMOTE_HOST host;
+    PH_STRINGREF hostPart;
+    PH_STRINGREF remainingPart;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpRemoteHostType = PhCreateObjectType(L"RemoteHost", 0, PhpRemoteHostDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    host = PhCreateObject(sizeof(PHP_REMOTE_HOST), PhpRemoteHostType);
+    memset(host, 0, sizeof(PHP_REMOTE_HOST));
+
+    // A host can be given as a full pipe name (\\host\pipe\name) or just as a machine name, in
+    // which case the default pipe name is used.
+    if (PhStartsWithStringRef(Name, &uncPrefix, FALSE))
+    {
+        remainingPart = *Name;
+        PhSkipStringRef(&remainingPart, uncPrefix.Length);
+        PhSplitStringRefAtChar(&remainingPart, '\\', &hostPart, &remainingPart);
+        host->PipeName = PhCreateString2(Name);
+    }
+    else
+    {
+        hostPart = *Name;
+        host->PipeName = PhConcatStrings(
+            4,
+            L"\\\\",
+            PhaCreateStringEx(Name->Buffer, Name->Length)->Buffer,
+            L"\\pipe\\",
+            PH_MONITOR_DEFAULT_PIPE_NAME
+            );
+    }
+
+    host->HostName = PhCreateString2(&hostPart);
+    PhInitializeQueuedLock(&host->Lock);
+    host->WindowHandle = WindowHandle;
+    host->Status = STATUS_PENDING;
+    host->AllocatedProcesses = 256;
+    host->Processes = PhAllocate(host->AllocatedProcesses * sizeof(PHP_REMOTE_PROCESS));
+    host->ProcessIndexes = PhCreateSimpleHashtable(64);
+    host->RemovedNodes = PhCreateList(16);
+
+    return host;
+}
+
+static VOID PhpNotifyRemoteHost(
+    _In_ PPHP_REMOTE_HOST Host
+    )
+{
+    // Updates are coalesced; the UI thread picks up everything that has happened since the
+    // message was posted.
+    if (Host->WindowHandle && !_InterlockedExchange(&Host->UpdatePosted, TRUE))
+        PostMessage(Host->WindowHandle, WM_PH_REMOTES_UPDATED, 0, 0);
+}
+
+static PPHP_REMOTE_PROCESS PhpFindRemoteProcess(
+    _In_ PPHP_REMOTE_HOST Host,
+    _In_ ULONG ProcessId
+    )
+{
+    PVOID *entry;
+
+    if (entry = PhFindItemSimpleHashtable(Host->ProcessIndexes, UlongToHandle(ProcessId)))
+        return &Host->Processes[PtrToUlong(*entry)];
+    else
+        return NULL;
+}
+
+static PPHP_REMOTE_PROCESS PhpAddRemoteProcess(
+    _In_ PPHP_REMOTE_HOST Host,
+    _In_ ULONG ProcessId
+    )
+{
+    PPHP_REMOTE_PROCESS process;
+
+    if (Host->NumberOfProcesses == Host->AllocatedProcesses)
+    {
+        Host->AllocatedProcesses *= 2;
+        Host->Processes = PhReAllocate(Host->Processes, Host->AllocatedProcesses * sizeof(PHP_REMOTE_PROCESS));
+    }
+
+    process = &Host->Processes[Host->NumberOfProcesses];
+    memset(process, 0, sizeof(PHP_REMOTE_PROCESS));
+    process->ProcessId = ProcessId;
+    process->Flags = PHP_REMOTE_PROCESS_ADDED;
+
+    PhAddItemSimpleHashtable(Host->ProcessIndexes, UlongToHandle(ProcessId), UlongToPtr(Host->NumberOfProcesses));
+    Host->NumberOfProcesses++;
+
+    return process;
+}
+
+static VOID PhpRemoveRemoteProcess(
+    _In_ PPHP_REMOTE_HOST Host,
+    _In_ PPHP_REMOTE_PROCESS Process
+    )
+{
+    ULONG index;
+    PPHP_REMOTE_PROCESS lastProcess;
+
+    if (Process->Node)
+        PhAddItemList(Host->RemovedNodes, Process->Node);
+
+    PhClearReference(&Process->Name);
+    PhRemoveItemSimpleHashtable(Host->ProcessIndexes, UlongToHandle(Process->ProcessId));
+
+    // Keep the array compact by moving the last process into the hole.
+
+    index = (ULONG)(Process - Host->Processes);
+    lastProcess = &Host->Processes[Host->NumberOfProcesses - 1];
+
+    if (Process != lastProcess)
+    {
+        *Process = *lastProcess;
+        *(PVOID *)PhFindItemSimpleHashtable(Host->ProcessIndexes, UlongToHandle(Process->ProcessId)) = UlongToPtr(index);
+    }
+
+    Host->NumberOfProcesses--;
+}
+
+static VOID PhpClearRemoteProcesses(
+    _In_ PPHP_REMOTE_HOST Host
+    )
+{
+    while (Host->NumberOfProcesses != 0)
+        PhpRemoveRemoteProcess(Host, &Host->Processes[Host->NumberOfProcesses - 1]);
+}
+
+static BOOLEAN PhpDecodeRemoteVarint(
+    _Inout_ PPHP_REMOTE_READER Reader,
+    _Out_ PULONG64 Value
+    )
+{
+    ULONG64 value;
+    ULONG shift;
+    UCHAR byte;
+
+    value = 0;
+    shift = 0;
+
+    do
+    {
+        if (Reader->Position == Reader->End || shift >= 64)
+            return FALSE;
+
+        byte = *Reader->Position++;
+        value |= (ULONG64)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *Value = value;
+
+    return TRUE;
+}
+
+static BOOLEAN PhpDecodeRemoteValues(
+    _Inout_ PPHP_REMOTE_READER Reader,
+    _Inout_ PPHP_REMOTE_PROCESS Process
+    )
+{
+    ULONG64 mask;
+    ULONG64 value;
+    PH_MONITOR_FIELD field;
+
+    if (!PhpDecodeRemoteVarint(Reader, &mask))
+        return FALSE;
+    if (mask >> PhMonitorFieldMaximum)
+        return FALSE;
+
+    for (field = 0; field < PhMonitorFieldMaximum; field++)
+    {
+        if (!(mask & (1 << field)))
+            continue;
+
+        if (!PhpDecodeRemoteVarint(Reader, &value))
+            return FALSE;
+
+        if (field == PhMonitorFieldName)
+        {
+            if (value > (ULONG64)(Reader->End - Reader->Position) || (value & 1))
+                return FALSE;
+
+            PhMoveReference(&Process->Name, PhCreateStringEx((PWCHAR)Reader->Position, (SIZE_T)value));
+            Reader->Position += value;
+        }
+        else
+        {
+            // Zigzag-encoded difference from the previous value.
+            Process->Values[field] += (ULONG64)((value >> 1) ^ (0 - (value & 1)));
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN PhpApplyRemoteSample(
+    _Inout_ PPHP_REMOTE_HOST Host,
+    _In_ PUCHAR Buffer,
+    _In_ ULONG Length
+    )
+{
+    PHP_REMOTE_READER reader;
+    ULONG64 interval;
+    ULONG64 tag;
+    ULONG64 processId;
+    PPHP_REMOTE_PROCESS process;
+
+    reader.Position = Buffer;
+    reader.End = Buffer + Length;
+
+    if (!PhpDecodeRemoteVarint(&reader, &interval))
+        return FALSE;
+
+    if (interval != 0)
+        Host->Interval = interval;
+
+    while (TRUE)
+    {
+        if (!PhpDecodeRemoteVarint(&reader, &tag))
+            return FALSE;
+        if (tag == 0)
+            break;
+        if (!PhpDecodeRemoteVarint(&reader, &processId) || processId > MAXULONG)
+            return FALSE;
+
+        process = PhpFindRemoteProcess(Host, (ULONG)processId);
+
+        switch (tag)
+        {
+        case PH_MONITOR_DELTA_ADDED:
+            if (process)
+                return FALSE;
+
+            process = PhpAddRemoteProcess(Host, (ULONG)processId);
+
+            if (!PhpDecodeRemoteValues(&reader, process))
+                return FALSE;
+
+            break;
+        case PH_MONITOR_DELTA_REMOVED:
+            if (!process)
+                return FALSE;
+
+            PhpRemoveRemoteProcess(Host, process);
+            break;
+        case PH_MONITOR_DELTA_CHANGED:
+            if (!process)
+                return FALSE;
+
+            process->Flags |= PHP_REMOTE_PROCESS_CHANGED;
+
+            if (!PhpDecodeRemoteValues(&reader, process))
+                return FALSE;
+
+            break;
+        default:
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static NTSTATUS PhpReadRemoteHost(
+    _In_ HANDLE PipeHandle,
+    _Out_writes_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Length
+    )
+{
+    NTSTATUS status;
+    IO_STATUS_BLOCK isb;
+    PUCHAR buffer = Buffer;
+
+    // A sample can arrive in several pieces.
+    while (Length != 0)
+    {
+        status = NtReadFile(PipeHandle, NULL, NULL, NULL, &isb, buffer, Length, NULL, NULL);
+
+        if (!NT_SUCCESS(status))
+            return status;
+        if (isb.Information == 0)
+            return STATUS_PIPE_BROKEN;
+
+        buffer += isb.Information;
+        Length -= (ULONG)isb.Information;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS PhpReadRemoteHostVarint(
+    _In_ HANDLE PipeHandle,
+    _Out_ PULONG64 Value
+    )
+{
+    NTSTATUS status;
+    ULONG64 value;
+    ULONG shift;
+    UCHAR byte;
+
+    value = 0;
+    shift = 0;
+
+    do
+    {
+        if (shift >= 64)
+            return STATUS_INVALID_NETWORK_RESPONSE;
+        if (!NT_SUCCESS(status = PhpReadRemoteHost(PipeHandle, &byte, 1)))
+            return status;
+
+        value |= (ULONG64)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *Value = value;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS PhpReceiveRemoteHost(
+    _In_ PPHP_REMOTE_HOST Host
+    )
+{
+    static UCHAR subscription[] = "\x32" "name,cpu,private,ws,ioread,iowrite,threads,handles";
+    NTSTATUS status;
+    HANDLE pipeHandle;
+    IO_STATUS_BLOCK isb;
+    PH_MONITOR_HEADER header;
+    ULONG64 length;
+    PUCHAR buffer;
+    ULONG bufferSize;
+    BOOLEAN valid;
+
+    C_ASSERT(sizeof(subscription) - 2 == 0x32); // the field list is preceded by its length
+
+    status = PhCreateFileWin32(
+        &pipeHandle,
+        Host->PipeName->Buffer,
+        FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+        0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        FILE_OPEN,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    status = NtWriteFile(pipeHandle, NULL, NULL, NULL, &isb, subscription, sizeof(subscription) - 1, NULL, NULL);
+
+    if (NT_SUCCESS(status))
+        status = PhpReadRemoteHost(pipeHandle, &header, sizeof(PH_MONITOR_HEADER));
+
+    if (NT_SUCCESS(status) && (header.Magic != PH_MONITOR_DELTA_MAGIC || header.Version != PH_MONITOR_VERSION))
+        status = STATUS_UNKNOWN_REVISION;
+
+    if (!NT_SUCCESS(status))
+    {
+        NtClose(pipeHandle);
+        return status;
+    }
+
+    PhAcquireQueuedLockExclusive(&Host->Lock);
+    Host->Connected = TRUE;
+    Host->Status = STATUS_SUCCESS;
+    PhpNotifyRemoteHost(Host);
+    PhReleaseQueuedLockExclusive(&Host->Lock);
+
+    bufferSize = 0x4000;
+    buffer = PhAllocate(bufferSize);
+
+    while (!Host->Stop)
+    {
+        if (!NT_SUCCESS(status = PhpReadRemoteHostVarint(pipeHandle, &length)))
+            break;
+
+        if (length > PHP_REMOTE_MAX_SAMPLE_LENGTH)
+        {
+            status = STATUS_INVALID_NETWORK_RESPONSE;
+            break;
+        }
+
+        if (bufferSize < (ULONG)length)
+        {
+            bufferSize = (ULONG)length;
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+
+        if (!NT_SUCCESS(status = PhpReadRemoteHost(pipeHandle, buffer, (ULONG)length)))
+            break;
+
+        PhAcquireQueuedLockExclusive(&Host->Lock);
+        valid = PhpApplyRemoteSample(Host, buffer, (ULONG)length);
+        PhpNotifyRemoteHost(Host);
+        PhReleaseQueuedLockExclusive(&Host->Lock);
+
+        if (!valid)
+        {
+            status = STATUS_INVALID_NETWORK_RESPONSE;
+            break;
+        }
+    }
+
+    PhFree(buffer);
+    NtClose(pipeHandle);
+
+    return status;
+}
+
+static NTSTATUS PhpRemoteHostThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_REMOTE_HOST host = Parameter;
+    NTSTATUS status;
+    LARGE_INTEGER interval;
+
+    while (!host->Stop)
+    {
+        status = PhpReceiveRemoteHost(host);
+
+        // The processes of a host that has gone away are removed from the list; they come back
+        // with the first sample after reconnecting.
+        PhAcquireQueuedLockExclusive(&host->Lock);
+        host->Connected = FALSE;
+        host->Status = status;
+        PhpClearRemoteProcesses(host);
+        PhpNotifyRemoteHost(host);
+        PhReleaseQueuedLockExclusive(&host->Lock);
+
+        if (host->Stop)
+            break;
+
+        interval.QuadPart = -PHP_REMOTE_RECONNECT_DELAY * PH_TIMEOUT_MS;
+        NtDelayExecution(FALSE, &interval);
+    }
+
+    PhDereferenceObject(host);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID PhpDestroyRemoteNode(
+    _In_ PPHP_REMOTE_NODE Node
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PhpRemoteMaximumColumn; i++)
+        PhClearReference(&Node->Text[i]);
+
+    PhClearReference(&Node->Name);
+    PhFree(Node);
+}
+
+static int __cdecl PhpRemoteNodeCompare(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPHP_REMOTES_CONTEXT remotesContext = context;
+    PPHP_REMOTE_NODE node1 = *(PPHP_REMOTE_NODE *)elem1;
+    PPHP_REMOTE_NODE node2 = *(PPHP_REMOTE_NODE *)elem2;
+    int result = 0;
+
+    switch (remotesContext->SortColumn)
+    {
+    case PhpRemoteHostColumn:
+        result = PhCompareString(node1->Host->HostName, node2->Host->HostName, TRUE);
+        break;
+    case PhpRemoteNameColumn:
+        result = PhCompareStringWithNull(node1->Name, node2->Name, TRUE);
+        break;
+    case PhpRemotePidColumn:
+        result = uintcmp(node1->ProcessId, node2->ProcessId);
+        break;
+    case PhpRemoteCpuColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldCpu], node2->Values[PhMonitorFieldCpu]);
+        break;
+    case PhpRemotePrivateBytesColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldPrivateBytes], node2->Values[PhMonitorFieldPrivateBytes]);
+        break;
+    case PhpRemoteWorkingSetColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldWorkingSet], node2->Values[PhMonitorFieldWorkingSet]);
+        break;
+    case PhpRemoteIoReadColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldIoRead], node2->Values[PhMonitorFieldIoRead]);
+        break;
+    case PhpRemoteIoWriteColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldIoWrite], node2->Values[PhMonitorFieldIoWrite]);
+        break;
+    case PhpRemoteThreadsColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldThreads], node2->Values[PhMonitorFieldThreads]);
+        break;
+    case PhpRemoteHandlesColumn:
+        result = uint64cmp(node1->Values[PhMonitorFieldHandles], node2->Values[PhMonitorFieldHandles]);
+        break;
+    }
+
+    // Keep the processes of each host together when the values are equal.
+    if (result == 0 && remotesContext->SortColumn != PhpRemoteHostColumn)
+        result = PhCompareString(node1->Host->HostName, node2->Host->HostName, TRUE);
+    if (result == 0)
+        result = uintcmp(node1->ProcessId, node2->ProcessId);
+
+    return PhModifySort(result, remotesContext->SortOrder);
+}
+
+static VOID PhpSortRemoteNodes(
+    _In_ PPHP_REMOTES_CONTEXT Context
+    )
+{
+    if (Context->SortOrder == NoSortOrder)
+        return;
+
+    qsort_s(Context->NodeList->Items, Context->NodeList->Count, sizeof(PVOID), PhpRemoteNodeCompare, Context);
+}
+
+static VOID PhpUpdateRemoteNodeText(
+    _In_ PPHP_REMOTE_NODE Node,
+    _In_ ULONG64 Interval
+    )
+{
+    ULONG64 ioRead;
+    ULONG64 ioWrite;
+
+    // The I/O values are per sample; turn them into rates using the host's own interval.
+    ioRead = Interval ? Node->Values[PhMonitorFieldIoRead] * PH_TICKS_PER_SEC / Interval : 0;
+    ioWrite = Interval ? Node->Values[PhMonitorFieldIoWrite] * PH_TICKS_PER_SEC / Interval : 0;
+
+    PhSetReference(&Node->Text[PhpRemoteHostColumn], Node->Host->HostName);
+    PhSetReference(&Node->Text[PhpRemoteNameColumn], Node->Name);
+    PhMoveReference(&Node->Text[PhpRemotePidColumn], PhFormatUInt64(Node->ProcessId, FALSE));
+    PhMoveReference(&Node->Text[PhpRemoteCpuColumn], PhFormatString(L"%.2f", (DOUBLE)Node->Values[PhMonitorFieldCpu] / 100));
+    PhMoveReference(&Node->Text[PhpRemotePrivateBytesColumn], PhFormatSize(Node->Values[PhMonitorFieldPrivateBytes], -1));
+    PhMoveReference(&Node->Text[PhpRemoteWorkingSetColumn], PhFormatSize(Node->Values[PhMonitorFieldWorkingSet], -1));
+    PhMoveReference(&Node->Text[PhpRemoteIoReadColumn], PhFormatString(L"%s/s", PhaFormatSize(ioRead, -1)->Buffer));
+    PhMoveReference(&Node->Text[PhpRemoteIoWriteColumn], PhFormatString(L"%s/s", PhaFormatSize(ioWrite, -1)->Buffer));
+    PhMoveReference(&Node->Text[PhpRemoteThreadsColumn], PhFormatUInt64(Node->Values[PhMonitorFieldThreads], TRUE));
+    PhMoveReference(&Node->Text[PhpRemoteHandlesColumn], PhFormatUInt64(Node->Values[PhMonitorFieldHandles], TRUE));
+}
+
+static VOID PhpUpdateRemoteHostsStatus(
+    _In_ HWND hwndDlg,
+    _In_ PPHP_REMOTES_CONTEXT Context
+    )
+{
+    PPHP_REMOTE_HOST failedHost;
+    NTSTATUS failedStatus;
+    ULONG connected;
+    ULONG i;
+
+    failedHost = NULL;
+    failedStatus = STATUS_SUCCESS;
+    connected = 0;
+
+    for (i = 0; i < Context->HostList->Count; i++)
+    {
+        PPHP_REMOTE_HOST host = Context->HostList->Items[i];
+
+        if (host->Connected)
+        {
+            connected++;
+        }
+        else if (!failedHost && host->Status != STATUS_PENDING)
+        {
+            failedHost = host;
+            failedStatus = host->Status;
+        }
+    }
+
+    if (failedHost)
+    {
+        PPH_STRING message;
+
+        message = PhGetStatusMessage(failedStatus, 0);
+        SetDlgItemText(hwndDlg, IDC_MESSAGE, PhaFormatString(
+            L"%u of %u hosts connected, %u processes. %s: %s",
+            connected,
+            Context->HostList->Count,
+            Context->NodeList->Count,
+            failedHost->HostName->Buffer,
+            PhGetStringOrDefault(message, L"Unable to connect")
+            )->Buffer);
+        PhClearReference(&message);
+    }
+    else
+    {
+        SetDlgItemText(hwndDlg, IDC_MESSAGE, PhaFormatString(
+            L"%u of %u hosts connected, %u processes.",
+            connected,
+            Context->HostList->Count,
+            Context->NodeList->Count
+            )->Buffer);
+    }
+}
+
+static VOID PhpRefreshRemoteNodes(
+    _In_ PPHP_REMOTES_CONTEXT Context
+    )
+{
+    BOOLEAN changed;
+    BOOLEAN removed;
+    ULONG i;
+    ULONG j;
+
+    changed = FALSE;
+    removed = FALSE;
+
+    for (i = 0; i < Context->HostList->Count; i++)
+    {
+        PPHP_REMOTE_HOST host = Context->HostList->Items[i];
+
+        _InterlockedExchange(&host->UpdatePosted, FALSE);
+
+        PhAcquireQueuedLockExclusive(&host->Lock);
+
+        for (j = 0; j < host->RemovedNodes->Count; j++)
+        {
+            PPHP_REMOTE_NODE node = host->RemovedNodes->Items[j];
+
+            node->Removed = TRUE;
+            removed = TRUE;
+        }
+
+        PhClearList(host->RemovedNodes);
+
+        for (j = 0; j < host->NumberOfProcesses; j++)
+        {
+            PPHP_REMOTE_PROCESS process = &host->Processes[j];
+            PPHP_REMOTE_NODE node;
+
+            if (!process->Flags)
+                continue;
+
+            if (!(node = process->Node))
+            {
+                node = PhAllocate(sizeof(PHP_REMOTE_NODE));
+                memset(node, 0, sizeof(PHP_REMOTE_NODE));
+                PhInitializeTreeNewNode(&node->Node);
+                node->Node.TextCache = node->TextCache;
+                node->Node.TextCacheSize = PhpRemoteMaximumColumn;
+                node->Host = host;
+                node->ProcessId = process->ProcessId;
+
+                process->Node = node;
+                PhAddItemList(Context->NodeList, node);
+            }
+
+            PhSetReference(&node->Name, process->Name);
+            memcpy(node->Values, process->Values, sizeof(node->Values));
+            PhpUpdateRemoteNodeText(node, host->Interval);
+            PhInvalidateTreeNewNodeText(&node->Node, NULL);
+
+            process->Flags = 0;
+            changed = TRUE;
+        }
+
+        PhReleaseQueuedLockExclusive(&host->Lock);
+    }
+
+    if (removed)
+    {
+        for (i = 0, j = 0; i < Context->NodeList->Count; i++)
+        {
+            PPHP_REMOTE_NODE node = Context->NodeList->Items[i];
+
+            if (node->Removed)
+                PhpDestroyRemoteNode(node);
+            else
+                Context->NodeList->Items[j++] = node;
+        }
+
+        Context->NodeList->Count = j;
+    }
+
+    if (changed || removed)
+    {
+        PhpSortRemoteNodes(Context);
+        TreeNew_NodesStructured(Context->TreeNewHandle);
+    }
+
+    PhpUpdateRemoteHostsStatus(GetParent(Context->TreeNewHandle), Context);
+}
+
+static VOID PhpDisconnectRemoteHosts(
+    _In_ PPHP_REMOTES_CONTEXT Context
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    for (i = 0; i < Context->HostList->Count; i++)
+    {
+        PPHP_REMOTE_HOST host = Context->HostList->Items[i];
+
+        // The thread may be waiting for the next sample, so it is not waited for. It owns its
+        // own reference and exits as soon as it sees the stop flag.
+        PhAcquireQueuedLockExclusive(&host->Lock);
+        host->Stop = TRUE;
+        host->WindowHandle = NULL;
+
+        for (j = 0; j < host->NumberOfProcesses; j++)
+            host->Processes[j].Node = NULL;
+
+        PhClearList(host->RemovedNodes);
+        PhReleaseQueuedLockExclusive(&host->Lock);
+
+        PhDereferenceObject(host);
+    }
+
+    PhClearList(Context->HostList);
+
+    for (i = 0; i < Context->NodeList->Count; i++)
+        PhpDestroyRemoteNode(Context->NodeList->Items[i]);
+
+    PhClearList(Context->NodeList);
+}
+
+static VOID PhpConnectRemoteHosts(
+    _In_ HWND hwndDlg,
+    _In_ PPHP_REMOTES_CONTEXT Context,
+    _In_ PPH_STRINGREF HostNames
+    )
+{
+    static PH_STRINGREF whitespace = PH_STRINGREF_INIT(L" \t");
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+    PPHP_REMOTE_HOST host;
+    HANDLE threadHandle;
+    ULONG i;
+
+    PhpDisconnectRemoteHosts(Context);
+
+    remainingPart = *HostNames;
+
+    while (remainingPart.Length != 0)
+    {
+        PhSplitStringRefAtChar(&remainingPart, ';', &part, &remainingPart);
+        PhTrimStringRef(&part, &whitespace, 0);
+
+        if (part.Length == 0)
+            continue;
+
+        // Skip duplicates.
+        for (i = 0; i < Context->HostList->Count; i++)
+        {
+            if (PhEqualStringRef(&((PPHP_REMOTE_HOST)Context->HostList->Items[i])->PipeName->sr, &part, TRUE))
+                break;
+        }
+
+        if (i != Context->HostList->Count)
+            continue;
+
+        host = PhpCreateRemoteHost(&part, hwndDlg);
+        PhReferenceObject(host);
+
+        if (threadHandle = PhCreateThread(0, PhpRemoteHostThreadStart, host))
+        {
+            NtClose(threadHandle);
+        }
+        else
+        {
+            host->Status = PhGetLastWin32ErrorAsNtStatus();
+            PhDereferenceObject(host);
+        }
+
+        PhAddItemList(Context->HostList, host);
+    }
+
+    TreeNew_NodesStructured(Context->TreeNewHandle);
+    PhpUpdateRemoteHostsStatus(hwndDlg, Context);
+}
+
+static BOOLEAN NTAPI PhpRemoteTreeNewCallback(
+    _In_ HWND hwnd,
+    _In_ PH_TREENEW_MESSAGE Message,
+    _In_opt_ PVOID Parameter1,
+    _In_opt_ PVOID Parameter2,
+    _In_opt_ PVOID Context
+    )
+{
+    PPHP_REMOTES_CONTEXT context = Context;
+    PPHP_REMOTE_NODE node;
+
+    switch (Message)
+    {
+    case TreeNewGetChildren:
+        {
+            PPH_TREENEW_GET_CHILDREN getChildren = Parameter1;
+
+            if (!getChildren->Node)
+            {
+                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList->Items;
+                getChildren->NumberOfChildren = context->NodeList->Count;
+            }
+        }
+        return TRUE;
+    case TreeNewIsLeaf:
+        {
+            PPH_TREENEW_IS_LEAF isLeaf = Parameter1;
+
+            isLeaf->IsLeaf = TRUE;
+        }
+        return TRUE;
+    case TreeNewGetCellText:
+        {
+            PPH_TREENEW_GET_CELL_TEXT getCellText = Parameter1;
+
+            node = (PPHP_REMOTE_NODE)getCellText->Node;
+
+            if (getCellText->Id >= PhpRemoteMaximumColumn)
+                return FALSE;
+
+            getCellText->Text = PhGetStringRef(node->Text[getCellText->Id]);
+            getCellText->Flags = TN_CACHE;
+        }
+        return TRUE;
+    case TreeNewSortChanged:
+        {
+            TreeNew_GetSort(hwnd, &context->SortColumn, &context->SortOrder);
+            PhpSortRemoteNodes(context);
+            TreeNew_NodesStructured(hwnd);
+        }
+        return TRUE;
+    case TreeNewKeyDown:
+        {
+            PPH_TREENEW_KEY_EVENT keyEvent = Parameter1;
+
+            switch (keyEvent->VirtualKey)
+            {
+            case 'C':
+                if (GetKeyState(VK_CONTROL) < 0)
+                {
+                    PPH_STRING text;
+
+                    text = PhGetTreeNewText(hwnd, 0);
+                    PhSetClipboardString(hwnd, &text->sr);
+                    PhDereferenceObject(text);
+                }
+                break;
+            }
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+INT_PTR CALLBACK PhpRemoteHostsDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    PPHP_REMOTES_CONTEXT context = NULL;
+
+    if (uMsg == WM_INITDIALOG)
+    {
+        context = PhAllocate(sizeof(PHP_REMOTES_CONTEXT));
+        memset(context, 0, sizeof(PHP_REMOTES_CONTEXT));
+        SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)context);
+    }
+    else
+    {
+        context = (PPHP_REMOTES_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
+    }
+
+    if (!context)
+        return FALSE;
+
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            HWND tnHandle;
+            PPH_STRING hostNames;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+
+            context->TreeNewHandle = tnHandle = GetDlgItem(hwndDlg, IDC_LIST);
+            context->HostList = PhCreateList(16);
+            context->NodeList = PhCreateList(256);
+            context->SortColumn = PhpRemoteCpuColumn;
+            context->SortOrder = DescendingSortOrder;
+
+            PhSetControlTheme(tnHandle, L"explorer");
+            TreeNew_SetCallback(tnHandle, PhpRemoteTreeNewCallback, context);
+
+            PhAddTreeNewColumn(tnHandle, PhpRemoteHostColumn, TRUE, L"Host", 90, PH_ALIGN_LEFT, -2, 0);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteNameColumn, TRUE, L"Name", 140, PH_ALIGN_LEFT, 0, 0);
+            PhAddTreeNewColumn(tnHandle, PhpRemotePidColumn, TRUE, L"PID", 50, PH_ALIGN_RIGHT, 1, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteCpuColumn, TRUE, L"CPU", 45, PH_ALIGN_RIGHT, 2, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemotePrivateBytesColumn, TRUE, L"Private bytes", 80, PH_ALIGN_RIGHT, 3, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteWorkingSetColumn, TRUE, L"Working set", 80, PH_ALIGN_RIGHT, 4, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteIoReadColumn, TRUE, L"I/O read", 70, PH_ALIGN_RIGHT, 5, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteIoWriteColumn, TRUE, L"I/O write", 70, PH_ALIGN_RIGHT, 6, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteThreadsColumn, TRUE, L"Threads", 50, PH_ALIGN_RIGHT, 7, DT_RIGHT);
+            PhAddTreeNewColumn(tnHandle, PhpRemoteHandlesColumn, TRUE, L"Handles", 50, PH_ALIGN_RIGHT, 8, DT_RIGHT);
+
+            TreeNew_SetTriState(tnHandle, TRUE);
+            TreeNew_SetSort(tnHandle, context->SortColumn, context->SortOrder);
+
+            hostNames = PhGetStringSetting(L"RemoteHosts");
+            SetDlgItemText(hwndDlg, IDC_HOSTS, hostNames->Buffer);
+
+            if (hostNames->Length != 0)
+                PhpConnectRemoteHosts(hwndDlg, context, &hostNames->sr);
+            else
+                SetDlgItemText(hwndDlg, IDC_MESSAGE, L"Enter host names separated by semicolons.");
+
+            PhDereferenceObject(hostNames);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PhpDisconnectRemoteHosts(context);
+            PhDereferenceObject(context->HostList);
+            PhDereferenceObject(context->NodeList);
+
+            RemoveProp(hwndDlg, PhMakeContextAtom());
+            PhFree(context);
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+            case IDOK:
+                EndDialog(hwndDlg, IDOK);
+                break;
+            case IDC_CONNECT:
+                {
+                    PPH_STRING hostNames;
+
+                    hostNames = PhGetWindowText(GetDlgItem(hwndDlg, IDC_HOSTS));
+                    PhSetStringSetting2(L"RemoteHosts", &hostNames->sr);
+                    PhpConnectRemoteHosts(hwndDlg, context, &hostNames->sr);
+                    PhDereferenceObject(hostNames);
+                }
+                break;
+            }
+        }
+        break;
+    case WM_PH_REMOTES_UPDATED:
+        {
+            PhpRefreshRemoteNodes(context);
+        }
+        break;
+    }
+
+    return FALSE;
+}
@@ -120,6 +120,9 @@
 #define IDD_MINIINFO_LIST               210
 #define IDR_MINIINFO                    211
 #define IDR_MINIINFO_PROCESS            212
+#define IDD_PROCESSAGGREGATES           214
+#define IDD_REMOTEHOSTS                 215
+#define IDD_REPLAY                      216
 #define IDC_TERMINATE                   1003
 #define IDC_FILEICON                    1005
 #define IDC_FILE                        1006
@@ -527,6 +530,15 @@
 #define IDC_ZLISTMODIFIEDPAGEFILE_V     1373
 #define IDC_SECTION                     1375
 #define IDC_REGEX                       1377
+#define IDC_COLUMNINFO                  1378
+#define IDC_HOSTS                       1379
+#define IDC_CONNECT                     1380
+#define IDC_POSITION                    1381
+#define IDC_TIME                        1382
+#define IDC_GROUPTHREADSTATES           1383
+#define IDC_THREADSTATES                1384
+#define IDC_FIND                        1385
+#define IDC_FINDNEXT                    1386
 #define ID_MAINWND_PROCESSTL            2001
 #define ID_MAINWND_SERVICETL            2002
 #define ID_MAINWND_NETWORKTL            2003
@@ -728,6 +740,16 @@
 #define ID_PROCESS_GOTOPROCESS          40287
 #define ID_MINIINFO_REFRESH             40288
 #define ID_MINIINFO_REFRESHAUTOMATICALLY 40289
+#define ID_ANALYZE_SAMPLESTACKS         40290
+#define ID_MEMORY_HEAPSTATISTICS        40291
+#define ID_ANALYZE_WAITCHAIN            40292
+#define ID_TOOLS_PROCESSAGGREGATES      40293
+#define ID_TOOLS_REMOTEHOSTS            40294
+#define ID_NOTIFICATIONS_PROCESSALERTS  40295
+#define ID_TOOLS_REPLAY                 40296
+#define ID_MEMORY_TAKESNAPSHOT          40297
+#define ID_MEMORY_COMPARESNAPSHOT       40298
+#define ID_MODULE_CHECKMODIFIEDCODE     40299
 #define IDDYNAMIC                       50000
 #define IDPLUGINS                       55000
 
@@ -735,9 +757,9 @@
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        214
-#define _APS_NEXT_COMMAND_VALUE         40290
-#define _APS_NEXT_CONTROL_VALUE         1378
+#define _APS_NEXT_RESOURCE_VALUE        217
+#define _APS_NEXT_COMMAND_VALUE         40300
+#define _APS_NEXT_CONTROL_VALUE         1387
 #define _APS_NEXT_SYMED_VALUE           169
 #endif
 #endif
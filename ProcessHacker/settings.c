@@ -32,6 +32,13 @@
  * The get/set functions are very strict. If the wrong function is used
  * (the get-integer-setting function is used on a string setting) or
  * the setting does not exist, an exception will be raised.
+ *
+ * A binary copy of the settings is kept in a file pool next to the XML
+ * file (the settings store). Each entry is hashed by setting name, so
+ * saving only needs to rewrite the entries whose values have changed.
+ * The store remembers the XML file's last write time and size; if the
+ * XML file has been changed by someone else, it is imported instead.
+ * The XML file is only rewritten when a setting has actually changed.
  */
 
 #define PH_SETTINGS_PRIVATE
@@ -45,6 +52,11 @@ PH_QUEUED_LOCK PhSettingsLock = PH_QUEUED_LOCK_INIT;
 
 PPH_LIST PhIgnoredSettings;
 
+PH_CALLBACK_DECLARE(PhSettingChangedEvent);
+
+static PPH_FILE_POOL PhpSettingsStore = NULL;
+static ULONG PhpSettingsStoreHeaderRva;
+
 // These macros make sure the C strings can be seamlessly converted into
 // PH_STRINGREFs at compile time, for a small speed boost.
 
@@ -64,7 +76,7 @@ VOID PhSettingsInitialization(
     )
 {
     PhSettingsHashtable = PhCreateHashtable(
-        sizeof(PH_SETTING),
+        sizeof(PPH_SETTING),
         PhpSettingsHashtableCompareFunction,
         PhpSettingsHashtableHashFunction,
         256
@@ -82,8 +94,10 @@ VOID PhSettingsInitialization(
     PhpAddIntegerSetting(L"EnableCycleCpuUsage", L"1");
     PhpAddIntegerSetting(L"EnableInstantTooltips", L"0");
     PhpAddIntegerSetting(L"EnableKph", L"1");
+    PhpAddIntegerSetting(L"EnableLazyHandleNames", L"0");
     PhpAddIntegerSetting(L"EnableNetworkResolve", L"1");
     PhpAddIntegerSetting(L"EnablePlugins", L"1");
+    PhpAddIntegerSetting(L"EnableProcessNonPoll", L"0");
     PhpAddIntegerSetting(L"EnableServiceNonPoll", L"0");
     PhpAddIntegerSetting(L"EnableStage2", L"1");
     PhpAddIntegerSetting(L"EnableWarnings", L"1");
@@ -97,6 +111,7 @@ VOID PhSettingsInitialization(
     PhpAddIntegerSetting(L"ForceNoParent", L"0");
     PhpAddStringSetting(L"HandleTreeListColumns", L"");
     PhpAddStringSetting(L"HandleTreeListSort", L"0,1"); // 0, AscendingSortOrder
+    PhpAddIntegerSetting(L"HandleTrendInterval", L"1e"); // 30 updates, 0 to disable
     PhpAddStringSetting(L"HiddenProcessesListViewColumns", L"");
     PhpAddIntegerPairSetting(L"HiddenProcessesWindowPosition", L"400,400");
     PhpAddIntegerPairSetting(L"HiddenProcessesWindowSize", L"520,400");
@@ -109,12 +124,15 @@ VOID PhSettingsInitialization(
     PhpAddIntegerSetting(L"HighlightingDuration", L"3e8"); // 1000ms
     PhpAddIntegerSetting(L"IconMask", L"1"); // PH_ICON_CPU_HISTORY
     PhpAddStringSetting(L"IconMaskList", L"");
-    PhpAddIntegerSetting(L"IconNotifyMask", L"c"); // PH_NOTIFY_SERVICE_CREATE | PH_NOTIFY_SERVICE_DELETE
+    PhpAddIntegerSetting(L"IconNotifyMask", L"4c"); // PH_NOTIFY_SERVICE_CREATE | PH_NOTIFY_SERVICE_DELETE | PH_NOTIFY_PROCESS_ALERT
     PhpAddIntegerSetting(L"IconProcesses", L"f"); // 15
     PhpAddIntegerSetting(L"IconSingleClick", L"0");
     PhpAddIntegerSetting(L"IconTogglesVisibility", L"1");
     PhpAddIntegerSetting(L"LogEntries", L"200"); // 512
+    PhpAddIntegerSetting(L"LogFileMaximumRecords", L"100000"); // 1048576
+    PhpAddStringSetting(L"LogFileName", L"");
     PhpAddStringSetting(L"LogListViewColumns", L"");
+    PhpAddIntegerSetting(L"LogStartupPhases", L"0");
     PhpAddIntegerPairSetting(L"LogWindowPosition", L"300,300");
     PhpAddIntegerPairSetting(L"LogWindowSize", L"450,500");
     PhpAddIntegerSetting(L"MainWindowAlwaysOnTop", L"0");
@@ -124,6 +142,7 @@ VOID PhSettingsInitialization(
     PhpAddIntegerSetting(L"MainWindowState", L"1");
     PhpAddIntegerSetting(L"MaxSizeUnit", L"6");
     PhpAddIntegerSetting(L"MemEditBytesPerRow", L"10"); // 16
+    PhpAddStringSetting(L"MemEditFindChoices", L"");
     PhpAddStringSetting(L"MemEditGotoChoices", L"");
     PhpAddIntegerPairSetting(L"MemEditPosition", L"450,450");
     PhpAddIntegerPairSetting(L"MemEditSize", L"600,500");
@@ -135,6 +154,7 @@ VOID PhSettingsInitialization(
     PhpAddStringSetting(L"MemoryTreeListSort", L"0,0"); // 0, NoSortOrder
     PhpAddIntegerPairSetting(L"MemoryListsWindowPosition", L"400,400");
     PhpAddStringSetting(L"MemoryReadWriteAddressChoices", L"");
+    PhpAddIntegerSetting(L"MiniDumpUseSnapshot", L"1");
     PhpAddIntegerSetting(L"MiniInfoWindowEnabled", L"1");
     PhpAddIntegerSetting(L"MiniInfoWindowOpacity", L"0"); // means 100%
     PhpAddIntegerSetting(L"MiniInfoWindowPinned", L"0");
@@ -147,6 +167,8 @@ VOID PhSettingsInitialization(
     PhpAddStringSetting(L"NetworkTreeListSort", L"0,1"); // 0, AscendingSortOrder
     PhpAddIntegerSetting(L"NoPurgeProcessRecords", L"0");
     PhpAddStringSetting(L"PluginsDirectory", L"plugins");
+    PhpAddStringSetting(L"ProcessAlertRules", L"");
+    PhpAddIntegerSetting(L"ProcessRecordStoreDays", L"7");
     PhpAddStringSetting(L"ProcessServiceListViewColumns", L"");
     PhpAddStringSetting(L"ProcessTreeListColumns", L"");
     PhpAddStringSetting(L"ProcessTreeListSort", L"0,0"); // 0, NoSortOrder
@@ -155,8 +177,11 @@ VOID PhSettingsInitialization(
     PhpAddIntegerPairSetting(L"ProcPropSize", L"460,580");
     PhpAddStringSetting(L"ProgramInspectExecutables", L"peview.exe \"%s\"");
     PhpAddIntegerSetting(L"PropagateCpuUsage", L"0");
+    PhpAddStringSetting(L"RemoteHosts", L"");
     PhpAddStringSetting(L"RunAsProgram", L"");
     PhpAddStringSetting(L"RunAsUserName", L"");
+    PhpAddIntegerSetting(L"SampleBucketCount", L"168"); // 360
+    PhpAddIntegerSetting(L"SampleBucketSize", L"a"); // 10
     PhpAddIntegerSetting(L"SampleCount", L"200"); // 512
     PhpAddIntegerSetting(L"SampleCountAutomatic", L"1");
     PhpAddIntegerSetting(L"ScrollToNewProcesses", L"0");
@@ -169,6 +194,8 @@ VOID PhSettingsInitialization(
     PhpAddIntegerSetting(L"ShowCpuBelow001", L"0");
     PhpAddIntegerSetting(L"StartHidden", L"0");
     PhpAddIntegerSetting(L"SysInfoWindowAlwaysOnTop", L"0");
+    PhpAddIntegerSetting(L"SysInfoWindowCpuFrequencyInterval", L"3"); // ticks
+    PhpAddIntegerSetting(L"SysInfoWindowCpuHeatmapThreshold", L"20"); // 32 processors
     PhpAddIntegerSetting(L"SysInfoWindowOneGraphPerCpu", L"0");
     PhpAddIntegerPairSetting(L"SysInfoWindowPosition", L"200,200");
     PhpAddStringSetting(L"SysInfoWindowSection", L"");
@@ -179,6 +206,7 @@ VOID PhSettingsInitialization(
     PhpAddStringSetting(L"ThreadStackListViewColumns", L"");
     PhpAddIntegerPairSetting(L"ThreadStackWindowSize", L"420,380");
     PhpAddIntegerSetting(L"UpdateInterval", L"3e8"); // 1000ms
+    PhpAddIntegerSetting(L"VerifyPluginSignatures", L"0");
 
     // Colors are specified with R in the lowest byte, then G, then B.
     // So: bbggrr.
@@ -292,8 +320,8 @@ BOOLEAN NTAPI PhpSettingsHashtableCompareFunction(
     _In_ PVOID Entry2
     )
 {
-    PPH_SETTING setting1 = (PPH_SETTING)Entry1;
-    PPH_SETTING setting2 = (PPH_SETTING)Entry2;
+    PPH_SETTING setting1 = *(PPH_SETTING *)Entry1;
+    PPH_SETTING setting2 = *(PPH_SETTING *)Entry2;
 
     return PhEqualStringRef(&setting1->Name, &setting2->Name, FALSE);
 }
@@ -302,7 +330,7 @@ ULONG NTAPI PhpSettingsHashtableHashFunction(
     _In_ PVOID Entry
     )
 {
-    PPH_SETTING setting = (PPH_SETTING)Entry;
+    PPH_SETTING setting = *(PPH_SETTING *)Entry;
 
     return PhHashBytes((PUCHAR)setting->Name.Buffer, setting->Name.Length);
 }
@@ -313,16 +341,24 @@ static VOID PhpAddSetting(
     _In_ PPH_STRINGREF DefaultValue
     )
 {
-    PH_SETTING setting;
+    PPH_SETTING setting;
 
-    setting.Type = Type;
-    setting.Name = *Name;
-    setting.DefaultValue = *DefaultValue;
-    memset(&setting.u, 0, sizeof(setting.u));
+    // Settings are allocated separately so that pointers to them remain valid when the
+    // hashtable is resized. These pointers are used as setting handles.
+    setting = PhAllocate(sizeof(PH_SETTING));
+    setting->Type = Type;
+    setting->Name = *Name;
+    setting->DefaultValue = *DefaultValue;
+    memset(&setting->u, 0, sizeof(setting->u));
 
-    PhpSettingFromString(Type, &setting.DefaultValue, NULL, &setting);
+    PhpSettingFromString(Type, &setting->DefaultValue, NULL, setting);
 
-    PhAddEntryHashtable(PhSettingsHashtable, &setting);
+    if (!PhAddEntryHashtable(PhSettingsHashtable, &setting))
+    {
+        // The setting already exists.
+        PhpFreeSettingValue(Type, setting);
+        PhFree(setting);
+    }
 }
 
 static PPH_STRING PhpSettingToString(
@@ -437,15 +473,19 @@ static PVOID PhpLookupSetting(
     )
 {
     PH_SETTING lookupSetting;
-    PPH_SETTING setting;
+    PPH_SETTING lookupSettingPtr = &lookupSetting;
+    PPH_SETTING *setting;
 
     lookupSetting.Name = *Name;
-    setting = (PPH_SETTING)PhFindEntryHashtable(
+    setting = (PPH_SETTING *)PhFindEntryHashtable(
         PhSettingsHashtable,
-        &lookupSetting
+        &lookupSettingPtr
         );
 
-    return setting;
+    if (setting)
+        return *setting;
+    else
+        return NULL;
 }
 
 _May_raise_ ULONG PhGetIntegerSetting(
@@ -576,6 +616,8 @@ _May_raise_ VOID PhSetIntegerSetting(
 
     if (!setting)
         PhRaiseStatus(STATUS_NOT_FOUND);
+
+    PhInvokeCallback(&PhSettingChangedEvent, setting);
 }
 
 _May_raise_ VOID PhSetIntegerPairSetting(
@@ -601,6 +643,8 @@ _May_raise_ VOID PhSetIntegerPairSetting(
 
     if (!setting)
         PhRaiseStatus(STATUS_NOT_FOUND);
+
+    PhInvokeCallback(&PhSettingChangedEvent, setting);
 }
 
 _May_raise_ VOID PhSetStringSetting(
@@ -627,6 +671,8 @@ _May_raise_ VOID PhSetStringSetting(
 
     if (!setting)
         PhRaiseStatus(STATUS_NOT_FOUND);
+
+    PhInvokeCallback(&PhSettingChangedEvent, setting);
 }
 
 _May_raise_ VOID PhSetStringSetting2(
@@ -653,6 +699,87 @@ _May_raise_ VOID PhSetStringSetting2(
 
     if (!setting)
         PhRaiseStatus(STATUS_NOT_FOUND);
+
+    PhInvokeCallback(&PhSettingChangedEvent, setting);
+}
+
+/**
+ * Gets a handle to a setting. The handle remains valid for the lifetime of the program, so it
+ * can be looked up once and used to read the setting without a name lookup.
+ *
+ * \param Name The name of the setting.
+ *
+ * \remarks Register for \ref PhSettingChangedEvent to find out when the value of a setting
+ * changes.
+ */
+_May_raise_ PPH_SETTING PhGetSettingHandle(
+    _In_ PWSTR Name
+    )
+{
+    PPH_SETTING setting;
+    PH_STRINGREF name;
+
+    PhInitializeStringRef(&name, Name);
+
+    PhAcquireQueuedLockShared(&PhSettingsLock);
+    setting = PhpLookupSetting(&name);
+    PhReleaseQueuedLockShared(&PhSettingsLock);
+
+    if (!setting)
+        PhRaiseStatus(STATUS_NOT_FOUND);
+
+    return setting;
+}
+
+_May_raise_ ULONG PhGetIntegerSettingValue(
+    _In_ PPH_SETTING Setting
+    )
+{
+    if (Setting->Type != IntegerSettingType)
+        PhRaiseStatus(STATUS_OBJECT_TYPE_MISMATCH);
+
+    // A ULONG can be read atomically, so we don't need to acquire the lock.
+    return *(volatile ULONG *)&Setting->u.Integer;
+}
+
+_May_raise_ PH_INTEGER_PAIR PhGetIntegerPairSettingValue(
+    _In_ PPH_SETTING Setting
+    )
+{
+    PH_INTEGER_PAIR value;
+
+    if (Setting->Type != IntegerPairSettingType)
+        PhRaiseStatus(STATUS_OBJECT_TYPE_MISMATCH);
+
+    PhAcquireQueuedLockShared(&PhSettingsLock);
+    value = Setting->u.IntegerPair;
+    PhReleaseQueuedLockShared(&PhSettingsLock);
+
+    return value;
+}
+
+_May_raise_ PPH_STRING PhGetStringSettingValue(
+    _In_ PPH_SETTING Setting
+    )
+{
+    PPH_STRING value;
+
+    if (Setting->Type != StringSettingType)
+        PhRaiseStatus(STATUS_OBJECT_TYPE_MISMATCH);
+
+    PhAcquireQueuedLockShared(&PhSettingsLock);
+
+    if (Setting->u.Pointer)
+        PhSetReference(&value, Setting->u.Pointer);
+    else
+        value = NULL;
+
+    PhReleaseQueuedLockShared(&PhSettingsLock);
+
+    if (!value)
+        value = PhReferenceEmptyString();
+
+    return value;
 }
 
 VOID PhpFreeIgnoredSetting(
@@ -732,6 +859,451 @@ VOID PhConvertIgnoredSettings(
     }
 
     PhReleaseQueuedLockExclusive(&PhSettingsLock);
+
+    PhInvokeCallback(&PhSettingChangedEvent, NULL);
+}
+
+PPH_SETTING PhpFindIgnoredSetting(
+    _In_ PPH_STRINGREF Name
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PhIgnoredSettings->Count; i++)
+    {
+        PPH_SETTING setting = PhIgnoredSettings->Items[i];
+
+        if (PhEqualStringRef(&setting->Name, Name, FALSE))
+            return setting;
+    }
+
+    return NULL;
+}
+
+/**
+ * Opens the settings store for a settings file.
+ *
+ * \param FileName The file name of the XML settings file.
+ * \param Overwrite TRUE to discard the contents of the store.
+ */
+NTSTATUS PhpOpenSettingsStore(
+    _In_ PWSTR FileName,
+    _In_ BOOLEAN Overwrite
+    )
+{
+    static PH_STRINGREF xmlSuffix = PH_STRINGREF_INIT(L".xml");
+    static PH_STRINGREF storeSuffix = PH_STRINGREF_INIT(L".bin");
+
+    NTSTATUS status;
+    PH_STRINGREF fileName;
+    PPH_STRING storeFileName;
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+    PPH_SETTINGS_STORE_HEADER header;
+    ULONG headerRva;
+
+    if (PhpSettingsStore)
+    {
+        if (!Overwrite)
+            return STATUS_SUCCESS;
+
+        PhDestroyFilePool(PhpSettingsStore);
+        PhpSettingsStore = NULL;
+    }
+
+    PhInitializeStringRef(&fileName, FileName);
+
+    if (PhEndsWithStringRef(&fileName, &xmlSuffix, TRUE))
+        fileName.Length -= xmlSuffix.Length;
+
+    storeFileName = PhConcatStringRef2(&fileName, &storeSuffix);
+
+    // Only one instance can use the store at a time. Other instances only use the XML file.
+    status = PhCreateFilePool2(
+        &pool,
+        storeFileName->Buffer,
+        FALSE,
+        0,
+        Overwrite ? FILE_OVERWRITE_IF : FILE_OPEN_IF,
+        NULL
+        );
+
+    if (status == STATUS_BAD_FILE_TYPE && !Overwrite)
+    {
+        status = PhCreateFilePool2(
+            &pool,
+            storeFileName->Buffer,
+            FALSE,
+            0,
+            FILE_OVERWRITE_IF,
+            NULL
+            );
+    }
+
+    PhDereferenceObject(storeFileName);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    PhGetUserContextFilePool(pool, &userContext);
+
+    if (
+        (ULONG)(userContext >> 32) != PH_SETTINGS_STORE_MAGIC ||
+        !(header = PhReferenceFilePoolByRva(pool, (ULONG)userContext))
+        )
+    {
+        // New or incompatible store.
+
+        header = PhAllocateFilePool(pool, sizeof(PH_SETTINGS_STORE_HEADER), &headerRva);
+
+        if (!header)
+        {
+            PhDestroyFilePool(pool);
+            return STATUS_NO_MEMORY;
+        }
+
+        memset(header, 0, sizeof(PH_SETTINGS_STORE_HEADER));
+
+        userContext = ((ULONGLONG)PH_SETTINGS_STORE_MAGIC << 32) | headerRva;
+        PhSetUserContextFilePool(pool, &userContext);
+    }
+
+    PhDereferenceFilePool(pool, header);
+
+    PhpSettingsStore = pool;
+    PhpSettingsStoreHeaderRva = (ULONG)userContext;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Determines whether the settings store was last synchronized with the current version of
+ * the XML settings file.
+ *
+ * \param FileName The file name of the XML settings file.
+ */
+BOOLEAN PhpIsSettingsStoreCurrent(
+    _In_ PWSTR FileName
+    )
+{
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+    PPH_SETTINGS_STORE_HEADER header;
+    BOOLEAN current;
+
+    // A missing XML file matches a store which has never been synchronized.
+    if (!NT_SUCCESS(PhQueryFullAttributesFileWin32(FileName, &networkOpenInfo)))
+        memset(&networkOpenInfo, 0, sizeof(FILE_NETWORK_OPEN_INFORMATION));
+
+    if (!(header = PhReferenceFilePoolByRva(PhpSettingsStore, PhpSettingsStoreHeaderRva)))
+        return FALSE;
+
+    current =
+        header->XmlLastWriteTime.QuadPart == networkOpenInfo.LastWriteTime.QuadPart &&
+        header->XmlEndOfFile.QuadPart == networkOpenInfo.EndOfFile.QuadPart;
+
+    PhDereferenceFilePool(PhpSettingsStore, header);
+
+    return current;
+}
+
+/**
+ * Loads settings from the settings store. Entries which do not belong to a known setting are
+ * added to the list of ignored settings.
+ *
+ * \return FALSE if the store is corrupt, otherwise TRUE.
+ */
+BOOLEAN PhpLoadSettingsStore(
+    VOID
+    )
+{
+    PPH_SETTINGS_STORE_HEADER header;
+    PPH_SETTINGS_STORE_ENTRY entry;
+    ULONG numberOfEntries;
+    BOOLEAN valid;
+    ULONG rva;
+    ULONG i;
+
+    if (!(header = PhReferenceFilePoolByRva(PhpSettingsStore, PhpSettingsStoreHeaderRva)))
+        return FALSE;
+
+    numberOfEntries = 0;
+    valid = TRUE;
+
+    PhAcquireQueuedLockExclusive(&PhSettingsLock);
+
+    for (i = 0; valid && i < PH_SETTINGS_STORE_BUCKET_COUNT; i++)
+    {
+        rva = header->Buckets[i];
+
+        while (entry = PhReferenceFilePoolByRva(PhpSettingsStore, rva))
+        {
+            PH_STRINGREF name;
+            PH_STRINGREF value;
+            PPH_SETTING setting;
+
+            if (
+                ++numberOfEntries > PH_SETTINGS_STORE_MAXIMUM_ENTRIES ||
+                entry->Size != FIELD_OFFSET(PH_SETTINGS_STORE_ENTRY, Data) + entry->NameLength + entry->ValueLength ||
+                entry->NameLength == 0 ||
+                (entry->NameLength & 1) ||
+                (entry->ValueLength & 1) ||
+                (entry->Hash & (PH_SETTINGS_STORE_BUCKET_COUNT - 1)) != i
+                )
+            {
+                PhDereferenceFilePool(PhpSettingsStore, entry);
+                valid = FALSE;
+                break;
+            }
+
+            name.Buffer = entry->Data;
+            name.Length = entry->NameLength;
+            value.Buffer = (PWCHAR)((PCHAR)entry->Data + entry->NameLength);
+            value.Length = entry->ValueLength;
+
+            setting = PhpLookupSetting(&name);
+
+            if (setting)
+            {
+                PhpFreeSettingValue(setting->Type, setting);
+
+                if (!PhpSettingFromString(setting->Type, &value, NULL, setting))
+                    PhpSettingFromString(setting->Type, &setting->DefaultValue, NULL, setting);
+            }
+            else
+            {
+                setting = PhAllocate(sizeof(PH_SETTING));
+                setting->Name.Buffer = PhAllocate(name.Length + sizeof(WCHAR));
+                memcpy(setting->Name.Buffer, name.Buffer, name.Length);
+                setting->Name.Buffer[name.Length / sizeof(WCHAR)] = 0;
+                setting->Name.Length = name.Length;
+                setting->u.Pointer = PhCreateString2(&value);
+
+                PhAddItemList(PhIgnoredSettings, setting);
+            }
+
+            rva = entry->NextRva;
+            PhDereferenceFilePool(PhpSettingsStore, entry);
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&PhSettingsLock);
+
+    PhDereferenceFilePool(PhpSettingsStore, header);
+
+    return valid;
+}
+
+/**
+ * Writes a setting to the settings store.
+ *
+ * \param Header The header of the store.
+ * \param Name The name of the setting.
+ * \param Value The value of the setting.
+ *
+ * \return TRUE if the store was modified, FALSE if the stored value was already up to date.
+ */
+BOOLEAN PhpWriteSettingsStoreEntry(
+    _Inout_ PPH_SETTINGS_STORE_HEADER Header,
+    _In_ PPH_STRINGREF Name,
+    _In_ PPH_STRINGREF Value
+    )
+{
+    ULONG hash;
+    PULONG bucket;
+    PPH_SETTINGS_STORE_ENTRY previousEntry;
+    PPH_SETTINGS_STORE_ENTRY entry;
+    ULONG size;
+    ULONG rva;
+
+    if (Name->Length > MAXUSHORT || Value->Length > MAXLONG)
+        return FALSE;
+
+    hash = PhHashBytes((PUCHAR)Name->Buffer, Name->Length);
+    bucket = &Header->Buckets[hash & (PH_SETTINGS_STORE_BUCKET_COUNT - 1)];
+    previousEntry = NULL;
+    rva = *bucket;
+
+    while (entry = PhReferenceFilePoolByRva(PhpSettingsStore, rva))
+    {
+        if (
+            entry->Hash == hash &&
+            entry->NameLength == Name->Length &&
+            memcmp(entry->Data, Name->Buffer, Name->Length) == 0
+            )
+        {
+            PWCHAR value = (PWCHAR)((PCHAR)entry->Data + entry->NameLength);
+
+            if (entry->ValueLength == Value->Length)
+            {
+                BOOLEAN modified;
+
+                // Overwrite the value in place.
+                modified = memcmp(value, Value->Buffer, Value->Length) != 0;
+
+                if (modified)
+                    memcpy(value, Value->Buffer, Value->Length);
+
+                PhDereferenceFilePool(PhpSettingsStore, entry);
+
+                if (previousEntry)
+                    PhDereferenceFilePool(PhpSettingsStore, previousEntry);
+
+                return modified;
+            }
+
+            // Unlink the entry and create a new one.
+
+            if (previousEntry)
+                previousEntry->NextRva = entry->NextRva;
+            else
+                *bucket = entry->NextRva;
+
+            PhFreeFilePool(PhpSettingsStore, entry);
+            break;
+        }
+
+        if (previousEntry)
+            PhDereferenceFilePool(PhpSettingsStore, previousEntry);
+
+        previousEntry = entry;
+        rva = entry->NextRva;
+    }
+
+    if (previousEntry)
+        PhDereferenceFilePool(PhpSettingsStore, previousEntry);
+
+    size = FIELD_OFFSET(PH_SETTINGS_STORE_ENTRY, Data) + (ULONG)Name->Length + (ULONG)Value->Length;
+
+    if (entry = PhAllocateFilePool(PhpSettingsStore, size, &rva))
+    {
+        entry->NextRva = *bucket;
+        entry->Size = size;
+        entry->Hash = hash;
+        entry->NameLength = (USHORT)Name->Length;
+        entry->Reserved = 0;
+        entry->ValueLength = (ULONG)Value->Length;
+        memcpy(entry->Data, Name->Buffer, Name->Length);
+        memcpy((PCHAR)entry->Data + Name->Length, Value->Buffer, Value->Length);
+
+        PhDereferenceFilePool(PhpSettingsStore, entry);
+
+        *bucket = rva;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes all changed settings to the settings store and removes entries for settings which no
+ * longer exist.
+ *
+ * \return TRUE if the store was modified, otherwise FALSE.
+ */
+BOOLEAN PhpUpdateSettingsStore(
+    VOID
+    )
+{
+    BOOLEAN modified;
+    PPH_SETTINGS_STORE_HEADER header;
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PPH_SETTING *settingEntry;
+    PPH_SETTING setting;
+    PPH_SETTINGS_STORE_ENTRY previousEntry;
+    PPH_SETTINGS_STORE_ENTRY entry;
+    ULONG rva;
+    ULONG i;
+
+    if (!(header = PhReferenceFilePoolByRva(PhpSettingsStore, PhpSettingsStoreHeaderRva)))
+        return TRUE;
+
+    modified = FALSE;
+
+    PhAcquireQueuedLockExclusive(&PhSettingsLock);
+
+    PhBeginEnumHashtable(PhSettingsHashtable, &enumContext);
+
+    while (settingEntry = PhNextEnumHashtable(&enumContext))
+    {
+        PPH_STRING settingValue;
+
+        setting = *settingEntry;
+        settingValue = PhpSettingToString(setting->Type, setting);
+        modified |= PhpWriteSettingsStoreEntry(header, &setting->Name, &settingValue->sr);
+        PhDereferenceObject(settingValue);
+    }
+
+    for (i = 0; i < PhIgnoredSettings->Count; i++)
+    {
+        setting = PhIgnoredSettings->Items[i];
+        modified |= PhpWriteSettingsStoreEntry(header, &setting->Name, &((PPH_STRING)setting->u.Pointer)->sr);
+    }
+
+    // Remove entries for settings which no longer exist, e.g. after the ignored settings have
+    // been cleared.
+    for (i = 0; i < PH_SETTINGS_STORE_BUCKET_COUNT; i++)
+    {
+        previousEntry = NULL;
+        rva = header->Buckets[i];
+
+        while (entry = PhReferenceFilePoolByRva(PhpSettingsStore, rva))
+        {
+            PH_STRINGREF name;
+
+            rva = entry->NextRva;
+            name.Buffer = entry->Data;
+            name.Length = entry->NameLength;
+
+            if (PhpLookupSetting(&name) || PhpFindIgnoredSetting(&name))
+            {
+                if (previousEntry)
+                    PhDereferenceFilePool(PhpSettingsStore, previousEntry);
+
+                previousEntry = entry;
+            }
+            else
+            {
+                if (previousEntry)
+                    previousEntry->NextRva = rva;
+                else
+                    header->Buckets[i] = rva;
+
+                PhFreeFilePool(PhpSettingsStore, entry);
+                modified = TRUE;
+            }
+        }
+
+        if (previousEntry)
+            PhDereferenceFilePool(PhpSettingsStore, previousEntry);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhSettingsLock);
+
+    PhDereferenceFilePool(PhpSettingsStore, header);
+
+    return modified;
+}
+
+/**
+ * Records the current last write time and size of the XML settings file in the settings store.
+ *
+ * \param FileName The file name of the XML settings file.
+ */
+VOID PhpUpdateSettingsStoreXmlTime(
+    _In_ PWSTR FileName
+    )
+{
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+    PPH_SETTINGS_STORE_HEADER header;
+
+    if (!NT_SUCCESS(PhQueryFullAttributesFileWin32(FileName, &networkOpenInfo)))
+        memset(&networkOpenInfo, 0, sizeof(FILE_NETWORK_OPEN_INFORMATION));
+
+    if (header = PhReferenceFilePoolByRva(PhpSettingsStore, PhpSettingsStoreHeaderRva))
+    {
+        header->XmlLastWriteTime = networkOpenInfo.LastWriteTime;
+        header->XmlEndOfFile = networkOpenInfo.EndOfFile;
+        PhDereferenceFilePool(PhpSettingsStore, header);
+    }
 }
 
 mxml_type_t PhpSettingsLoadCallback(
@@ -741,7 +1313,7 @@ mxml_type_t PhpSettingsLoadCallback(
     return MXML_OPAQUE;
 }
 
-NTSTATUS PhLoadSettings(
+NTSTATUS PhpImportSettingsXml(
     _In_ PWSTR FileName
     )
 {
@@ -751,8 +1323,6 @@ NTSTATUS PhLoadSettings(
     mxml_node_t *topNode;
     mxml_node_t *currentNode;
 
-    PhpClearIgnoredSettings();
-
     status = PhCreateFileWin32(
         &fileHandle,
         FileName,
@@ -855,11 +1425,46 @@ NTSTATUS PhLoadSettings(
 
     mxmlDelete(topNode);
 
-    PhUpdateCachedSettings();
-
     return STATUS_SUCCESS;
 }
 
+NTSTATUS PhLoadSettings(
+    _In_ PWSTR FileName
+    )
+{
+    NTSTATUS status;
+
+    PhpClearIgnoredSettings();
+
+    if (
+        NT_SUCCESS(PhpOpenSettingsStore(FileName, FALSE)) &&
+        PhpIsSettingsStoreCurrent(FileName)
+        )
+    {
+        if (PhpLoadSettingsStore())
+        {
+            PhUpdateCachedSettings();
+            PhInvokeCallback(&PhSettingChangedEvent, NULL);
+            return STATUS_SUCCESS;
+        }
+
+        // The store is corrupt. Discard it and import the XML file instead.
+        PhpClearIgnoredSettings();
+        PhResetSettings();
+        PhpOpenSettingsStore(FileName, TRUE);
+    }
+
+    status = PhpImportSettingsXml(FileName);
+
+    if (NT_SUCCESS(status))
+    {
+        PhUpdateCachedSettings();
+        PhInvokeCallback(&PhSettingChangedEvent, NULL);
+    }
+
+    return status;
+}
+
 char *PhpSettingsSaveCallback(
     _In_ mxml_node_t *node,
     _In_ int position
@@ -909,7 +1514,7 @@ mxml_node_t *PhpCreateSettingElement(
     return settingNode;
 }
 
-NTSTATUS PhSaveSettings(
+NTSTATUS PhpExportSettingsXml(
     _In_ PWSTR FileName
     )
 {
@@ -917,6 +1522,7 @@ NTSTATUS PhSaveSettings(
     HANDLE fileHandle;
     mxml_node_t *topNode;
     PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PPH_SETTING *entry;
     PPH_SETTING setting;
 
     topNode = mxmlNewElement(MXML_NO_PARENT, "settings");
@@ -925,10 +1531,11 @@ NTSTATUS PhSaveSettings(
 
     PhBeginEnumHashtable(PhSettingsHashtable, &enumContext);
 
-    while (setting = PhNextEnumHashtable(&enumContext))
+    while (entry = PhNextEnumHashtable(&enumContext))
     {
         PPH_STRING settingValue;
 
+        setting = *entry;
         settingValue = PhpSettingToString(setting->Type, setting);
         PhpCreateSettingElement(topNode, &setting->Name, &settingValue->sr);
         PhDereferenceObject(settingValue);
@@ -950,6 +1557,35 @@ NTSTATUS PhSaveSettings(
 
     PhReleaseQueuedLockShared(&PhSettingsLock);
 
+    status = PhCreateFileWin32(
+        &fileHandle,
+        FileName,
+        FILE_GENERIC_WRITE,
+        0,
+        FILE_SHARE_READ,
+        FILE_OVERWRITE_IF,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        mxmlDelete(topNode);
+        return status;
+    }
+
+    mxmlSaveFd(topNode, fileHandle, PhpSettingsSaveCallback);
+    mxmlDelete(topNode);
+    NtClose(fileHandle);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS PhSaveSettings(
+    _In_ PWSTR FileName
+    )
+{
+    NTSTATUS status;
+
     // Create the directory if it does not exist.
     {
         PPH_STRING fullPath;
@@ -971,27 +1607,22 @@ NTSTATUS PhSaveSettings(
         }
     }
 
-    status = PhCreateFileWin32(
-        &fileHandle,
-        FileName,
-        FILE_GENERIC_WRITE,
-        0,
-        FILE_SHARE_READ,
-        FILE_OVERWRITE_IF,
-        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
-        );
+    if (NT_SUCCESS(PhpOpenSettingsStore(FileName, FALSE)))
+    {
+        // If nothing has changed and nobody else has written to the XML file, there is nothing
+        // else to do.
+        if (!PhpUpdateSettingsStore() && PhpIsSettingsStoreCurrent(FileName))
+            return STATUS_SUCCESS;
 
-    if (!NT_SUCCESS(status))
+        status = PhpExportSettingsXml(FileName);
+        PhpUpdateSettingsStoreXmlTime(FileName);
+    }
+    else
     {
-        mxmlDelete(topNode);
-        return status;
+        status = PhpExportSettingsXml(FileName);
     }
 
-    mxmlSaveFd(topNode, fileHandle, PhpSettingsSaveCallback);
-    mxmlDelete(topNode);
-    NtClose(fileHandle);
-
-    return STATUS_SUCCESS;
+    return status;
 }
 
 VOID PhResetSettings(
@@ -999,19 +1630,23 @@ VOID PhResetSettings(
     )
 {
     PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PPH_SETTING *entry;
     PPH_SETTING setting;
 
     PhAcquireQueuedLockExclusive(&PhSettingsLock);
 
     PhBeginEnumHashtable(PhSettingsHashtable, &enumContext);
 
-    while (setting = PhNextEnumHashtable(&enumContext))
+    while (entry = PhNextEnumHashtable(&enumContext))
     {
+        setting = *entry;
         PhpFreeSettingValue(setting->Type, setting);
         PhpSettingFromString(setting->Type, &setting->DefaultValue, NULL, setting);
     }
 
     PhReleaseQueuedLockExclusive(&PhSettingsLock);
+
+    PhInvokeCallback(&PhSettingChangedEvent, NULL);
 }
 
 VOID PhAddSettings(
@@ -0,0 +1,425 @@
+/*
+ * Process Hacker -
+ *   service CPU attribution
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A shared service host (svchost) runs many services in one process, so its CPU usage says
+ * nothing about which service is busy. While a thread runs code for a service, the service tag
+ * in its TEB (SubProcessTag) identifies that service. On each process provider update the CPU
+ * time delta of every thread that ran in a shared host is read from the process snapshot and
+ * charged to the service named by the thread's current tag.
+ *
+ * Only threads that used CPU time are inspected, and only in processes hosting more than one
+ * service (a process hosting a single service already shows that service's usage). Thread pool
+ * threads change their tag as they pick up work for different services, so the tag is read
+ * again each time, but the TEB address of each thread and the name of each tag are cached.
+ */
+
+#include <phapp.h>
+#include <srvcpu.h>
+
+typedef struct _PH_SERVICE_CPU_THREAD
+{
+    HANDLE ThreadId;
+    LARGE_INTEGER CreateTime;
+    ULONG64 CpuTime;
+    PVOID TebBaseAddress;
+    ULONG RunId;
+} PH_SERVICE_CPU_THREAD, *PPH_SERVICE_CPU_THREAD;
+
+typedef struct _PH_SERVICE_CPU_TAG
+{
+    ULONG Tag;
+    PPH_SERVICE_ITEM ServiceItem; // NULL if the tag could not be resolved
+    ULONG64 CpuTime; // charged during this update
+} PH_SERVICE_CPU_TAG, *PPH_SERVICE_CPU_TAG;
+
+typedef struct _PH_SERVICE_CPU_HOST
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+    ULONG RunId;
+    PPH_HASHTABLE ThreadHashtable; // PH_SERVICE_CPU_THREAD
+    PPH_HASHTABLE TagHashtable; // PH_SERVICE_CPU_TAG
+} PH_SERVICE_CPU_HOST, *PPH_SERVICE_CPU_HOST;
+
+static PPH_HASHTABLE PhpServiceCpuHostHashtable = NULL;
+static PPH_LIST PhpServiceCpuServiceList = NULL; // services that have been charged at least once
+static ULONG PhpServiceCpuRunId = 1;
+
+static BOOLEAN NTAPI PhpServiceCpuHandleEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    // ProcessId and ThreadId are both the first field of their entries.
+    return *(PHANDLE)Entry1 == *(PHANDLE)Entry2;
+}
+
+static ULONG NTAPI PhpServiceCpuHandleHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashIntPtr((ULONG_PTR)*(PHANDLE)Entry);
+}
+
+static BOOLEAN NTAPI PhpServiceCpuTagEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PPH_SERVICE_CPU_TAG)Entry1)->Tag == ((PPH_SERVICE_CPU_TAG)Entry2)->Tag;
+}
+
+static ULONG NTAPI PhpServiceCpuTagHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashInt32(((PPH_SERVICE_CPU_TAG)Entry)->Tag);
+}
+
+static VOID PhpDeleteServiceCpuHost(
+    _In_ PPH_SERVICE_CPU_HOST Host
+    )
+{
+    PPH_SERVICE_CPU_TAG tagEntry;
+    ULONG enumerationKey;
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(Host->TagHashtable, &tagEntry, &enumerationKey))
+    {
+        if (tagEntry->ServiceItem)
+            PhDereferenceObject(tagEntry->ServiceItem);
+    }
+
+    PhDereferenceObject(Host->TagHashtable);
+    PhDereferenceObject(Host->ThreadHashtable);
+}
+
+static PPH_SERVICE_CPU_HOST PhpGetServiceCpuHost(
+    _In_ PPH_PROCESS_ITEM ProcessItem
+    )
+{
+    PH_SERVICE_CPU_HOST lookupHost;
+    PPH_SERVICE_CPU_HOST host;
+
+    if (!PhpServiceCpuHostHashtable)
+    {
+        PhpServiceCpuHostHashtable = PhCreateHashtable(
+            sizeof(PH_SERVICE_CPU_HOST),
+            PhpServiceCpuHandleEqualFunction,
+            PhpServiceCpuHandleHashFunction,
+            8
+            );
+        PhpServiceCpuServiceList = PhCreateList(32);
+    }
+
+    lookupHost.ProcessId = ProcessItem->ProcessId;
+
+    if (host = PhFindEntryHashtable(PhpServiceCpuHostHashtable, &lookupHost))
+    {
+        if (host->CreateTime.QuadPart == ProcessItem->CreateTime.QuadPart)
+            return host;
+
+        // The process ID has been reused.
+        PhpDeleteServiceCpuHost(host);
+        PhRemoveEntryHashtable(PhpServiceCpuHostHashtable, &lookupHost);
+    }
+
+    lookupHost.CreateTime = ProcessItem->CreateTime;
+    lookupHost.RunId = 0;
+    lookupHost.ThreadHashtable = PhCreateHashtable(
+        sizeof(PH_SERVICE_CPU_THREAD),
+        PhpServiceCpuHandleEqualFunction,
+        PhpServiceCpuHandleHashFunction,
+        64
+        );
+    lookupHost.TagHashtable = PhCreateHashtable(
+        sizeof(PH_SERVICE_CPU_TAG),
+        PhpServiceCpuTagEqualFunction,
+        PhpServiceCpuTagHashFunction,
+        16
+        );
+
+    return PhAddEntryHashtableEx(PhpServiceCpuHostHashtable, &lookupHost, NULL);
+}
+
+static PPH_SERVICE_CPU_TAG PhpGetServiceCpuTag(
+    _In_ PPH_SERVICE_CPU_HOST Host,
+    _In_ ULONG Tag
+    )
+{
+    PH_SERVICE_CPU_TAG lookupTag;
+    PPH_SERVICE_CPU_TAG tagEntry;
+    PPH_STRING serviceName;
+
+    lookupTag.Tag = Tag;
+
+    if (tagEntry = PhFindEntryHashtable(Host->TagHashtable, &lookupTag))
+        return tagEntry;
+
+    lookupTag.ServiceItem = NULL;
+    lookupTag.CpuTime = 0;
+
+    // Tags are assigned by the SCM for the lifetime of the host process, so a tag that can't be
+    // resolved now is not looked up again.
+    if (serviceName = PhGetServiceNameFromTag(Host->ProcessId, UlongToPtr(Tag)))
+    {
+        lookupTag.ServiceItem = PhReferenceServiceItem(serviceName->Buffer);
+        PhDereferenceObject(serviceName);
+    }
+
+    return PhAddEntryHashtableEx(Host->TagHashtable, &lookupTag, NULL);
+}
+
+static ULONG PhpReadThreadServiceTag(
+    _In_ HANDLE ProcessHandle,
+    _Inout_ PPH_SERVICE_CPU_THREAD Thread
+    )
+{
+    PVOID serviceTag;
+
+    if (!Thread->TebBaseAddress)
+    {
+        HANDLE threadHandle;
+        THREAD_BASIC_INFORMATION basicInfo;
+
+        if (!NT_SUCCESS(PhOpenThread(&threadHandle, THREAD_QUERY_LIMITED_INFORMATION, Thread->ThreadId)))
+            return 0;
+
+        if (NT_SUCCESS(PhGetThreadBasicInformation(threadHandle, &basicInfo)))
+            Thread->TebBaseAddress = basicInfo.TebBaseAddress;
+
+        NtClose(threadHandle);
+
+        if (!Thread->TebBaseAddress)
+            return 0;
+    }
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        ProcessHandle,
+        PTR_ADD_OFFSET(Thread->TebBaseAddress, FIELD_OFFSET(TEB, SubProcessTag)),
+        &serviceTag,
+        sizeof(PVOID),
+        NULL
+        )))
+        return 0;
+
+    return PtrToUlong(serviceTag);
+}
+
+static VOID PhpChargeServiceCpuUsage(
+    _In_ PPH_SERVICE_ITEM ServiceItem,
+    _In_ FLOAT CpuUsage
+    )
+{
+    if (!ServiceItem->CpuHistoryValid)
+    {
+        PhInitializeCircularBuffer_FLOAT(&ServiceItem->CpuHistory, PhStatisticsSampleCount);
+        ServiceItem->CpuHistoryValid = TRUE;
+
+        PhReferenceObject(ServiceItem);
+        PhAddItemList(PhpServiceCpuServiceList, ServiceItem);
+    }
+
+    // A service may have been charged by an earlier host process in this update.
+    if (ServiceItem->CpuRunId == PhpServiceCpuRunId)
+    {
+        ServiceItem->CpuUsage += CpuUsage;
+    }
+    else
+    {
+        ServiceItem->CpuUsage = CpuUsage;
+        ServiceItem->CpuRunId = PhpServiceCpuRunId;
+    }
+}
+
+/**
+ * Charges the CPU time used by the threads of a shared service host to the services they ran.
+ *
+ * \param ProcessItem The process item of the service host.
+ * \param Process The snapshot information for the process, including its threads.
+ * \param SysTotalTime The total CPU time for this update period.
+ */
+VOID PhUpdateServiceCpuUsage(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ PSYSTEM_PROCESS_INFORMATION Process,
+    _In_ ULONG64 SysTotalTime
+    )
+{
+    PPH_SERVICE_CPU_HOST host;
+    HANDLE processHandle;
+    PPH_SERVICE_CPU_THREAD thread;
+    PPH_SERVICE_CPU_TAG tagEntry;
+    PH_SERVICE_CPU_THREAD lookupThread;
+    PPH_LIST staleThreads;
+    ULONG enumerationKey;
+    ULONG i;
+
+    host = PhpGetServiceCpuHost(ProcessItem);
+    host->RunId = PhpServiceCpuRunId;
+    processHandle = NULL;
+
+    for (i = 0; i < Process->NumberOfThreads; i++)
+    {
+        PSYSTEM_THREAD_INFORMATION threadInfo = &Process->Threads[i];
+        ULONG64 cpuTime;
+        ULONG64 cpuDelta;
+        ULONG tag;
+        BOOLEAN added;
+
+        cpuTime = threadInfo->KernelTime.QuadPart + threadInfo->UserTime.QuadPart;
+        lookupThread.ThreadId = threadInfo->ClientId.UniqueThread;
+        thread = PhAddEntryHashtableEx(host->ThreadHashtable, &lookupThread, &added);
+
+        if (added || thread->CreateTime.QuadPart != threadInfo->CreateTime.QuadPart)
+        {
+            // New thread (or a reused thread ID); its CPU time so far is not counted.
+            thread->CreateTime = threadInfo->CreateTime;
+            thread->CpuTime = cpuTime;
+            thread->TebBaseAddress = NULL;
+            thread->RunId = PhpServiceCpuRunId;
+            continue;
+        }
+
+        cpuDelta = cpuTime - thread->CpuTime;
+        thread->CpuTime = cpuTime;
+        thread->RunId = PhpServiceCpuRunId;
+
+        if (cpuDelta == 0)
+            continue;
+
+        if (!processHandle)
+        {
+            if (!NT_SUCCESS(PhOpenProcess(&processHandle, PROCESS_VM_READ, ProcessItem->ProcessId)))
+                break;
+        }
+
+        // A tag of 0 means the thread isn't running code for any particular service.
+        if (tag = PhpReadThreadServiceTag(processHandle, thread))
+        {
+            tagEntry = PhpGetServiceCpuTag(host, tag);
+            tagEntry->CpuTime += cpuDelta;
+        }
+    }
+
+    if (processHandle)
+        NtClose(processHandle);
+
+    // Remove threads which have exited.
+
+    staleThreads = NULL;
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(host->ThreadHashtable, &thread, &enumerationKey))
+    {
+        if (thread->RunId != PhpServiceCpuRunId)
+        {
+            if (!staleThreads)
+                staleThreads = PhCreateList(4);
+
+            PhAddItemList(staleThreads, thread->ThreadId);
+        }
+    }
+
+    if (staleThreads)
+    {
+        for (i = 0; i < staleThreads->Count; i++)
+        {
+            lookupThread.ThreadId = staleThreads->Items[i];
+            PhRemoveEntryHashtable(host->ThreadHashtable, &lookupThread);
+        }
+
+        PhDereferenceObject(staleThreads);
+    }
+
+    // Convert the charged time to CPU usage.
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(host->TagHashtable, &tagEntry, &enumerationKey))
+    {
+        if (tagEntry->ServiceItem && tagEntry->CpuTime != 0)
+            PhpChargeServiceCpuUsage(tagEntry->ServiceItem, (FLOAT)tagEntry->CpuTime / SysTotalTime);
+
+        tagEntry->CpuTime = 0;
+    }
+}
+
+/**
+ * Completes an update of service CPU usage. This must be called after PhUpdateServiceCpuUsage
+ * has been called for each shared service host in the update.
+ */
+VOID PhFlushServiceCpuUsage(
+    VOID
+    )
+{
+    PPH_SERVICE_CPU_HOST host;
+    PPH_LIST staleHosts;
+    PH_SERVICE_CPU_HOST lookupHost;
+    ULONG enumerationKey;
+    ULONG i;
+
+    if (!PhpServiceCpuHostHashtable)
+        return;
+
+    // Add a sample for each service. Services which weren't charged in this update (because they
+    // were idle, or their host has exited or now hosts only one service) get a zero sample.
+
+    for (i = 0; i < PhpServiceCpuServiceList->Count; i++)
+    {
+        PPH_SERVICE_ITEM serviceItem = PhpServiceCpuServiceList->Items[i];
+
+        if (serviceItem->CpuRunId != PhpServiceCpuRunId)
+            serviceItem->CpuUsage = 0;
+
+        PhAddItemCircularBuffer_FLOAT(&serviceItem->CpuHistory, serviceItem->CpuUsage);
+    }
+
+    // Remove hosts which weren't updated.
+
+    staleHosts = NULL;
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpServiceCpuHostHashtable, &host, &enumerationKey))
+    {
+        if (host->RunId != PhpServiceCpuRunId)
+        {
+            if (!staleHosts)
+                staleHosts = PhCreateList(2);
+
+            PhpDeleteServiceCpuHost(host);
+            PhAddItemList(staleHosts, host->ProcessId);
+        }
+    }
+
+    if (staleHosts)
+    {
+        for (i = 0; i < staleHosts->Count; i++)
+        {
+            lookupHost.ProcessId = staleHosts->Items[i];
+            PhRemoveEntryHashtable(PhpServiceCpuHostHashtable, &lookupHost);
+        }
+
+        PhDereferenceObject(staleHosts);
+    }
+
+    PhpServiceCpuRunId++;
+}
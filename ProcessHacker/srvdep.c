@@ -0,0 +1,334 @@
+/*
+ * Process Hacker -
+ *   service dependency graph
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The dependency graph of all services is built from the configuration that the service provider
+ * already queries (or loads from the service config store), so looking up the dependencies or
+ * dependents of a service never has to call the service manager. The service provider updates the
+ * graph whenever it reads the configuration of a service and when a service is deleted.
+ *
+ * Nodes are keyed by service name. A node can exist before the service it names (a dependency on
+ * a service that isn't installed, or hasn't been processed yet); such nodes are deleted once
+ * nothing depends on them. Dependencies on load order groups are ignored.
+ */
+
+#include <phapp.h>
+
+typedef struct _PH_SERVICE_DEPENDENCY_NODE
+{
+    PH_STRINGREF Key; // points to Name
+    PPH_STRING Name;
+    PPH_LIST Dependencies; // nodes of the services this service depends on
+    PPH_LIST Dependents; // nodes of the services that depend on this service
+    BOOLEAN Configured; // the dependencies of the service are known
+} PH_SERVICE_DEPENDENCY_NODE, *PPH_SERVICE_DEPENDENCY_NODE;
+
+static PPH_HASHTABLE PhpServiceDependencyHashtable = NULL;
+static PH_QUEUED_LOCK PhpServiceDependencyLock = PH_QUEUED_LOCK_INIT;
+
+static BOOLEAN NTAPI PhpServiceDependencyEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node1 = *(PPH_SERVICE_DEPENDENCY_NODE *)Entry1;
+    PPH_SERVICE_DEPENDENCY_NODE node2 = *(PPH_SERVICE_DEPENDENCY_NODE *)Entry2;
+
+    return PhEqualStringRef(&node1->Key, &node2->Key, TRUE);
+}
+
+static ULONG NTAPI PhpServiceDependencyHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node = *(PPH_SERVICE_DEPENDENCY_NODE *)Entry;
+
+    return PhHashStringRef(&node->Key, TRUE);
+}
+
+static PPH_SERVICE_DEPENDENCY_NODE PhpLookupServiceDependencyNode(
+    _In_ PPH_STRINGREF Name
+    )
+{
+    PH_SERVICE_DEPENDENCY_NODE lookupNode;
+    PPH_SERVICE_DEPENDENCY_NODE lookupNodePtr = &lookupNode;
+    PPH_SERVICE_DEPENDENCY_NODE *node;
+
+    if (!PhpServiceDependencyHashtable)
+        return NULL;
+
+    lookupNode.Key = *Name;
+    node = PhFindEntryHashtable(PhpServiceDependencyHashtable, &lookupNodePtr);
+
+    return node ? *node : NULL;
+}
+
+static PPH_SERVICE_DEPENDENCY_NODE PhpCreateServiceDependencyNode(
+    _In_ PPH_STRINGREF Name
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node;
+
+    if (node = PhpLookupServiceDependencyNode(Name))
+        return node;
+
+    if (!PhpServiceDependencyHashtable)
+    {
+        PhpServiceDependencyHashtable = PhCreateHashtable(
+            sizeof(PPH_SERVICE_DEPENDENCY_NODE),
+            PhpServiceDependencyEqualFunction,
+            PhpServiceDependencyHashFunction,
+            256
+            );
+    }
+
+    node = PhAllocate(sizeof(PH_SERVICE_DEPENDENCY_NODE));
+    node->Name = PhCreateString2(Name);
+    node->Key = node->Name->sr;
+    node->Dependencies = PhCreateList(4);
+    node->Dependents = PhCreateList(4);
+    node->Configured = FALSE;
+
+    PhAddEntryHashtable(PhpServiceDependencyHashtable, &node);
+
+    return node;
+}
+
+static VOID PhpDeleteServiceDependencyNodeIfUnused(
+    _In_ PPH_SERVICE_DEPENDENCY_NODE Node
+    )
+{
+    if (Node->Configured || Node->Dependents->Count != 0)
+        return;
+
+    PhRemoveEntryHashtable(PhpServiceDependencyHashtable, &Node);
+    PhDereferenceObject(Node->Name);
+    PhDereferenceObject(Node->Dependencies);
+    PhDereferenceObject(Node->Dependents);
+    PhFree(Node);
+}
+
+static VOID PhpClearServiceDependencies(
+    _In_ PPH_SERVICE_DEPENDENCY_NODE Node
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Node->Dependencies->Count; i++)
+    {
+        PPH_SERVICE_DEPENDENCY_NODE dependency = Node->Dependencies->Items[i];
+        ULONG index;
+
+        if ((index = PhFindItemList(dependency->Dependents, Node)) != -1)
+            PhRemoveItemList(dependency->Dependents, index);
+
+        // The node may depend on itself, in which case it is still configured here.
+        if (dependency != Node)
+            PhpDeleteServiceDependencyNodeIfUnused(dependency);
+    }
+
+    PhClearList(Node->Dependencies);
+}
+
+/**
+ * Sets the dependencies of a service in the dependency graph.
+ *
+ * \param ServiceName The name of the service.
+ * \param Dependencies The dependencies of the service in the format of
+ * QUERY_SERVICE_CONFIG.lpDependencies: a sequence of null-terminated names, terminated by an empty
+ * string. Names of load order groups begin with SC_GROUP_IDENTIFIER. NULL if the service has no
+ * dependencies.
+ */
+VOID PhSetServiceDependencies(
+    _In_ PPH_STRINGREF ServiceName,
+    _In_opt_ PWSTR Dependencies
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node;
+
+    PhAcquireQueuedLockExclusive(&PhpServiceDependencyLock);
+
+    node = PhpCreateServiceDependencyNode(ServiceName);
+    PhpClearServiceDependencies(node);
+    node->Configured = TRUE;
+
+    if (Dependencies)
+    {
+        PWSTR dependency;
+        PH_STRINGREF dependencyName;
+
+        for (dependency = Dependencies; *dependency; dependency += dependencyName.Length / sizeof(WCHAR) + 1)
+        {
+            PPH_SERVICE_DEPENDENCY_NODE dependencyNode;
+
+            PhInitializeStringRefLongHint(&dependencyName, dependency);
+
+            if (dependency[0] == SC_GROUP_IDENTIFIER)
+                continue;
+
+            dependencyNode = PhpCreateServiceDependencyNode(&dependencyName);
+
+            // Ignore duplicate names.
+            if (PhFindItemList(node->Dependencies, dependencyNode) != -1)
+                continue;
+
+            PhAddItemList(node->Dependencies, dependencyNode);
+            PhAddItemList(dependencyNode->Dependents, node);
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpServiceDependencyLock);
+}
+
+/**
+ * Removes a deleted service from the dependency graph. Services that still depend on it keep
+ * their edges.
+ *
+ * \param ServiceName The name of the service.
+ */
+VOID PhRemoveServiceDependencies(
+    _In_ PPH_STRINGREF ServiceName
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node;
+
+    PhAcquireQueuedLockExclusive(&PhpServiceDependencyLock);
+
+    if (node = PhpLookupServiceDependencyNode(ServiceName))
+    {
+        PhpClearServiceDependencies(node);
+        node->Configured = FALSE;
+        PhpDeleteServiceDependencyNodeIfUnused(node);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpServiceDependencyLock);
+}
+
+/**
+ * Gets the services that a service depends on, or the services that depend on it.
+ *
+ * \param ServiceItem The service item.
+ * \param Flags A combination of flags.
+ * \li \c PH_SERVICE_DEPENDENCIES_DEPENDENTS Get the services that depend on the service instead of the
+ * services it depends on.
+ * \li \c PH_SERVICE_DEPENDENCIES_TRANSITIVE Include indirect dependencies (or dependents). The
+ * services are returned in breadth-first order, so every service appears after the service
+ * through which it was reached.
+ * \param NumberOfServices A variable which receives the number of services returned.
+ *
+ * \return An array of referenced service items, which must be freed with PhFree() after the
+ * service items have been dereferenced. Services that are not installed are not included, and the
+ * service itself is never included.
+ */
+PPH_SERVICE_ITEM *PhGetServiceDependencies(
+    _In_ PPH_SERVICE_ITEM ServiceItem,
+    _In_ ULONG Flags,
+    _Out_ PULONG NumberOfServices
+    )
+{
+    PPH_SERVICE_DEPENDENCY_NODE node;
+    PPH_LIST nameList;
+    PPH_LIST serviceList;
+    PPH_SERVICE_ITEM *services;
+    ULONG i;
+
+    nameList = PhCreateList(8);
+
+    PhAcquireQueuedLockShared(&PhpServiceDependencyLock);
+
+    if (node = PhpLookupServiceDependencyNode(&ServiceItem->Name->sr))
+    {
+        PPH_LIST nodeList;
+        PPH_HASHTABLE visitedHashtable = NULL;
+
+        // The list of nodes doubles as the breadth-first queue.
+        nodeList = PhCreateList(8);
+        PhAddItemList(nodeList, node);
+
+        if (Flags & PH_SERVICE_DEPENDENCIES_TRANSITIVE)
+        {
+            visitedHashtable = PhCreateSimpleHashtable(16);
+            PhAddItemSimpleHashtable(visitedHashtable, node, NULL);
+        }
+
+        for (i = 0; i < nodeList->Count; i++)
+        {
+            PPH_LIST edges;
+            ULONG j;
+
+            node = nodeList->Items[i];
+            edges = (Flags & PH_SERVICE_DEPENDENCIES_DEPENDENTS) ? node->Dependents : node->Dependencies;
+
+            for (j = 0; j < edges->Count; j++)
+            {
+                PPH_SERVICE_DEPENDENCY_NODE edgeNode = edges->Items[j];
+
+                if (visitedHashtable)
+                {
+                    if (!PhAddItemSimpleHashtable(visitedHashtable, edgeNode, NULL))
+                        continue;
+
+                    PhAddItemList(nodeList, edgeNode);
+                }
+                else if (edgeNode == nodeList->Items[0])
+                {
+                    continue;
+                }
+
+                PhReferenceObject(edgeNode->Name);
+                PhAddItemList(nameList, edgeNode->Name);
+            }
+
+            if (!visitedHashtable)
+                break;
+        }
+
+        if (visitedHashtable)
+            PhDereferenceObject(visitedHashtable);
+
+        PhDereferenceObject(nodeList);
+    }
+
+    PhReleaseQueuedLockShared(&PhpServiceDependencyLock);
+
+    // Resolve the names after releasing the lock so that the service provider isn't blocked while
+    // the service items are looked up.
+
+    serviceList = PhCreateList(nameList->Count);
+
+    for (i = 0; i < nameList->Count; i++)
+    {
+        PPH_STRING name = nameList->Items[i];
+        PPH_SERVICE_ITEM serviceItem;
+
+        if (serviceItem = PhReferenceServiceItem(name->Buffer))
+            PhAddItemList(serviceList, serviceItem);
+
+        PhDereferenceObject(name);
+    }
+
+    PhDereferenceObject(nameList);
+
+    *NumberOfServices = serviceList->Count;
+    services = PhAllocateCopy(serviceList->Items, sizeof(PPH_SERVICE_ITEM) * serviceList->Count);
+    PhDereferenceObject(serviceList);
+
+    return services;
+}
@@ -40,6 +40,10 @@ VOID PhpRemoveServiceNode(
     _In_ PPH_SERVICE_NODE ServiceNode
     );
 
+VOID PhpFlushRemovedServiceNodes(
+    VOID
+    );
+
 LONG PhpServiceTreeNewPostSortFunction(
     _In_ LONG Result,
     _In_ PVOID Node1,
@@ -62,6 +66,7 @@ static PH_CM_MANAGER ServiceTreeListCm;
 
 static PPH_HASHTABLE ServiceNodeHashtable; // hashtable of all nodes
 static PPH_LIST ServiceNodeList; // list of all nodes
+static PPH_LIST ServiceNodeRemovedList; // removed nodes which are still present in ServiceNodeList
 
 static PH_TN_FILTER_SUPPORT FilterSupport;
 
@@ -84,6 +89,7 @@ VOID PhServiceTreeListInitialization(
         100
         );
     ServiceNodeList = PhCreateList(100);
+    ServiceNodeRemovedList = PhCreateList(10);
 }
 
 BOOLEAN PhpServiceNodeHashtableCompareFunction(
@@ -133,6 +139,7 @@ VOID PhInitializeServiceTreeList(
     PhAddTreeNewColumn(hwnd, PHSVTLC_ERRORCONTROL, FALSE, L"Error Control", 70, PH_ALIGN_LEFT, -1, 0);
     PhAddTreeNewColumn(hwnd, PHSVTLC_GROUP, FALSE, L"Group", 100, PH_ALIGN_LEFT, -1, 0);
     PhAddTreeNewColumn(hwnd, PHSVTLC_DESCRIPTION, FALSE, L"Description", 200, PH_ALIGN_LEFT, -1, 0);
+    PhAddTreeNewColumnEx(hwnd, PHSVTLC_CPU, FALSE, L"CPU", 45, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
 
     TreeNew_SetRedraw(hwnd, TRUE);
 
@@ -279,15 +286,20 @@ VOID PhpRemoveServiceNode(
     _In_ PPH_SERVICE_NODE ServiceNode
     )
 {
-    ULONG index;
-
     PhEmCallObjectOperation(EmServiceNodeType, ServiceNode, EmObjectDelete);
 
-    // Remove from list and cleanup.
+    // The node is only marked here; ServiceNodeList is compacted in one pass by
+    // PhpFlushRemovedServiceNodes instead of being searched for every removed node.
+    ServiceNode->Removed = TRUE;
+    PhAddItemList(ServiceNodeRemovedList, ServiceNode);
 
-    if ((index = PhFindItemList(ServiceNodeList, ServiceNode)) != -1)
-        PhRemoveItemList(ServiceNodeList, index);
+    TreeNew_NodesStructured(ServiceTreeListHandle);
+}
 
+static VOID PhpDestroyServiceNode(
+    _In_ PPH_SERVICE_NODE ServiceNode
+    )
+{
     if (ServiceNode->BinaryPath) PhDereferenceObject(ServiceNode->BinaryPath);
     if (ServiceNode->LoadOrderGroup) PhDereferenceObject(ServiceNode->LoadOrderGroup);
     if (ServiceNode->Description) PhDereferenceObject(ServiceNode->Description);
@@ -297,8 +309,33 @@ VOID PhpRemoveServiceNode(
     PhDereferenceObject(ServiceNode->ServiceItem);
 
     PhFree(ServiceNode);
+}
 
-    TreeNew_NodesStructured(ServiceTreeListHandle);
+VOID PhpFlushRemovedServiceNodes(
+    VOID
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    if (ServiceNodeRemovedList->Count == 0)
+        return;
+
+    for (i = 0, j = 0; i < ServiceNodeList->Count; i++)
+    {
+        PPH_SERVICE_NODE node = ServiceNodeList->Items[i];
+
+        if (!node->Removed)
+            ServiceNodeList->Items[j++] = node;
+    }
+
+    if (j != ServiceNodeList->Count)
+        PhRemoveItemsList(ServiceNodeList, j, ServiceNodeList->Count - j);
+
+    for (i = 0; i < ServiceNodeRemovedList->Count; i++)
+        PhpDestroyServiceNode(ServiceNodeRemovedList->Items[i]);
+
+    PhClearList(ServiceNodeRemovedList);
 }
 
 VOID PhUpdateServiceNode(
@@ -317,7 +354,26 @@ VOID PhTickServiceNodes(
     VOID
     )
 {
-    if (ServiceTreeListSortOrder != NoSortOrder && ServiceTreeListSortColumn >= PHSVTLC_MAXIMUM)
+    static ULONG cpuTextMask[PH_TREENEW_TEXT_CACHE_MASK_SIZE(PHSVTLC_MAXIMUM)] = { 0 };
+    ULONG i;
+
+    // CPU usage changes without the service item being modified.
+
+    cpuTextMask[PHSVTLC_CPU / 32] = (ULONG)1 << (PHSVTLC_CPU % 32);
+
+    for (i = 0; i < ServiceNodeList->Count; i++)
+    {
+        PPH_SERVICE_NODE node = ServiceNodeList->Items[i];
+
+        if (node->ServiceItem->CpuHistoryValid)
+            PhInvalidateTreeNewNodeText(&node->Node, cpuTextMask);
+    }
+
+    if (ServiceTreeListSortOrder != NoSortOrder && ServiceTreeListSortColumn == PHSVTLC_CPU)
+    {
+        TreeNew_NodesStructured(ServiceTreeListHandle);
+    }
+    else if (ServiceTreeListSortOrder != NoSortOrder && ServiceTreeListSortColumn >= PHSVTLC_MAXIMUM)
     {
         // Sorting is on, but it's not one of our columns. Force a rebuild. (If it was one of our
         // columns, the restructure would have been handled in PhUpdateServiceNode.)
@@ -325,6 +381,8 @@ VOID PhTickServiceNodes(
     }
 
     PH_TICK_SH_STATE_TN(PH_SERVICE_NODE, ShState, ServiceNodeStateList, PhpRemoveServiceNode, PhCsHighlightingDuration, ServiceTreeListHandle, TRUE, NULL);
+    PhpFlushRemovedServiceNodes();
+    TreeNew_InvalidateChangedCells(ServiceTreeListHandle);
 }
 
 static VOID PhpUpdateServiceNodeConfig(
@@ -475,6 +533,12 @@ BEGIN_SORT_FUNCTION(Description)
 }
 END_SORT_FUNCTION
 
+BEGIN_SORT_FUNCTION(Cpu)
+{
+    sortResult = singlecmp(serviceItem1->CpuUsage, serviceItem2->CpuUsage);
+}
+END_SORT_FUNCTION
+
 BOOLEAN NTAPI PhpServiceTreeNewCallback(
     _In_ HWND hwnd,
     _In_ PH_TREENEW_MESSAGE Message,
@@ -507,10 +571,13 @@ BOOLEAN NTAPI PhpServiceTreeNewCallback(
                     SORT_FUNCTION(BinaryPath),
                     SORT_FUNCTION(ErrorControl),
                     SORT_FUNCTION(Group),
-                    SORT_FUNCTION(Description)
+                    SORT_FUNCTION(Description),
+                    SORT_FUNCTION(Cpu)
                 };
                 int (__cdecl *sortFunction)(const void *, const void *);
 
+                PhpFlushRemovedServiceNodes();
+
                 if (!PhCmForwardSort(
                     (PPH_TREENEW_NODE *)ServiceNodeList->Items,
                     ServiceNodeList->Count,
@@ -526,7 +593,7 @@ BOOLEAN NTAPI PhpServiceTreeNewCallback(
 
                     if (sortFunction)
                     {
-                        qsort(ServiceNodeList->Items, ServiceNodeList->Count, sizeof(PVOID), sortFunction);
+                        PhSortTreeNewNodes((PPH_TREENEW_NODE *)ServiceNodeList->Items, ServiceNodeList->Count, sortFunction);
                     }
                 }
 
@@ -608,6 +675,38 @@ BOOLEAN NTAPI PhpServiceTreeNewCallback(
                 PhpUpdateServiceNodeDescription(node);
                 getCellText->Text = PhGetStringRef(node->Description);
                 break;
+            case PHSVTLC_CPU:
+                {
+                    FLOAT cpuUsage;
+
+                    cpuUsage = serviceItem->CpuUsage * 100;
+
+                    if (cpuUsage >= 0.01)
+                    {
+                        SIZE_T returnLength;
+
+                        if (PhFormatFixedToBuffer(cpuUsage, 2, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
+                        {
+                            getCellText->Text.Buffer = node->CpuUsageText;
+                            getCellText->Text.Length = returnLength - sizeof(WCHAR); // minus null terminator
+                        }
+                    }
+                    else if (cpuUsage != 0 && PhCsShowCpuBelow001)
+                    {
+                        PH_FORMAT format[2];
+                        SIZE_T returnLength;
+
+                        PhInitFormatS(&format[0], L"< ");
+                        PhInitFormatF(&format[1], 0.01, 2);
+
+                        if (PhFormatToBuffer(format, 2, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
+                        {
+                            getCellText->Text.Buffer = node->CpuUsageText;
+                            getCellText->Text.Length = returnLength - sizeof(WCHAR);
+                        }
+                    }
+                }
+                break;
             default:
                 return FALSE;
             }
@@ -736,6 +835,8 @@ PPH_SERVICE_ITEM PhGetSelectedServiceItem(
     PPH_SERVICE_ITEM serviceItem = NULL;
     ULONG i;
 
+    PhpFlushRemovedServiceNodes();
+
     for (i = 0; i < ServiceNodeList->Count; i++)
     {
         PPH_SERVICE_NODE node = ServiceNodeList->Items[i];
@@ -758,6 +859,8 @@ VOID PhGetSelectedServiceItems(
     PPH_LIST list;
     ULONG i;
 
+    PhpFlushRemovedServiceNodes();
+
     list = PhCreateList(2);
 
     for (i = 0; i < ServiceNodeList->Count; i++)
@@ -814,20 +917,5 @@ VOID PhWriteServiceList(
     _In_ ULONG Mode
     )
 {
-    PPH_LIST lines;
-    ULONG i;
-
-    lines = PhGetGenericTreeNewLines(ServiceTreeListHandle, Mode);
-
-    for (i = 0; i < lines->Count; i++)
-    {
-        PPH_STRING line;
-
-        line = lines->Items[i];
-        PhWriteStringAsUtf8FileStream(FileStream, &line->sr);
-        PhDereferenceObject(line);
-        PhWriteStringAsUtf8FileStream2(FileStream, L"\r\n");
-    }
-
-    PhDereferenceObject(lines);
+    PhWriteGenericTreeNewFileStream(FileStream, ServiceTreeListHandle, Mode);
 }
@@ -23,6 +23,7 @@
 #include <phapp.h>
 #include <winevt.h>
 #include <extmgri.h>
+#include <filepool.h>
 
 typedef DWORD (WINAPI *_NotifyServiceStatusChangeW)(
     _In_ SC_HANDLE hService,
@@ -49,17 +50,58 @@ typedef struct _PHP_SERVICE_NOTIFY_CONTEXT
 {
     LIST_ENTRY ListEntry;
     SC_HANDLE ServiceHandle;
-    PPH_STRING ServiceName; // Valid only when adding
+    PPH_STRING ServiceName; // NULL for the service manager
     BOOLEAN IsServiceManager;
     PHP_SERVICE_NOTIFY_STATE State;
     SERVICE_NOTIFY Buffer;
 } PHP_SERVICE_NOTIFY_CONTEXT, *PPHP_SERVICE_NOTIFY_CONTEXT;
 
+// A read-only copy of the service hashtable which readers can use without locking. Each version
+// holds a reference to every service item in it.
+typedef struct _PHP_SERVICE_HASHTABLE_VERSION
+{
+    PPH_HASHTABLE Hashtable;
+} PHP_SERVICE_HASHTABLE_VERSION, *PPHP_SERVICE_HASHTABLE_VERSION;
+
+#define PH_SERVICE_CONFIG_STORE_MAGIC ('csHP') // stored in the high part of the user context
+
+// The configuration of every service (including its dependencies, for the dependency graph) is
+// kept on disk so that the first update doesn't need to query the service manager for each
+// service. A record is valid as long as the last write time of
+// the service's registry key hasn't changed. Records are kept in a singly-linked list; the RVA of
+// the first record is stored in the low part of the user context of the file pool.
+typedef struct _PH_SERVICE_CONFIG_STORE_RECORD
+{
+    ULONG NextRva;
+    ULONG Size;
+    LARGE_INTEGER KeyLastWriteTime;
+    ULONG StartType;
+    ULONG ErrorControl;
+    BOOLEAN DelayedStart;
+    BOOLEAN HasTriggers;
+    USHORT NameLength; // in bytes
+    USHORT DependenciesLength; // in bytes, including the empty string at the end
+    WCHAR Data[1]; // name, followed by dependencies
+} PH_SERVICE_CONFIG_STORE_RECORD, *PPH_SERVICE_CONFIG_STORE_RECORD;
+
+typedef struct _PHP_SERVICE_CONFIG_STORE_ENTRY
+{
+    PH_STRINGREF Key; // points to Name
+    PPH_STRING Name;
+    ULONG Rva;
+    BOOLEAN Seen; // the service still exists
+} PHP_SERVICE_CONFIG_STORE_ENTRY, *PPHP_SERVICE_CONFIG_STORE_ENTRY;
+
 VOID NTAPI PhpServiceItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
     );
 
+VOID NTAPI PhpServiceHashtableVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    );
+
 BOOLEAN NTAPI PhpServiceHashtableCompareFunction(
     _In_ PVOID Entry1,
     _In_ PVOID Entry2
@@ -83,10 +125,24 @@ VOID PhpInitializeServiceNonPoll(
     VOID
     );
 
+VOID PhpQueueServiceNonPollChange(
+    _In_ PPH_STRING ServiceName
+    );
+
+// When non-polling is active, services are only re-queried after a notification and all
+// services are enumerated every this many updates to pick up anything that was missed.
+#define PH_SERVICE_RECONCILE_INTERVAL 60
+
 PPH_OBJECT_TYPE PhServiceItemType;
 
 PPH_HASHTABLE PhServiceHashtable;
 PH_QUEUED_LOCK PhServiceHashtableLock = PH_QUEUED_LOCK_INIT;
+static PPH_OBJECT_TYPE PhpServiceHashtableVersionType;
+static PPHP_SERVICE_HASHTABLE_VERSION volatile PhpServiceHashtableVersion = NULL; // read inside an object epoch
+static BOOLEAN PhpServiceHashtableChanged = FALSE;
+// Serializes linking services to their processes with the process provider adding new processes,
+// since the two providers run on different threads.
+PH_QUEUED_LOCK PhServiceProcessLinkLock = PH_QUEUED_LOCK_INIT;
 
 PHAPPAPI PH_CALLBACK_DECLARE(PhServiceAddedEvent);
 PHAPPAPI PH_CALLBACK_DECLARE(PhServiceModifiedEvent);
@@ -96,19 +152,26 @@ PHAPPAPI PH_CALLBACK_DECLARE(PhServicesUpdatedEvent);
 BOOLEAN PhEnableServiceNonPoll = FALSE;
 static BOOLEAN PhpNonPollInitialized = FALSE;
 static BOOLEAN PhpNonPollActive = FALSE;
+static BOOLEAN PhpNonPollReconcile = FALSE;
 static HANDLE PhpNonPollThreadHandle;
-static ULONG PhpNonPollGate;
 static _NotifyServiceStatusChangeW NotifyServiceStatusChangeW_I;
 static HANDLE PhpNonPollEventHandle;
 static PH_QUEUED_LOCK PhpNonPollServiceListLock = PH_QUEUED_LOCK_INIT;
 static LIST_ENTRY PhpNonPollServiceListHead;
 static LIST_ENTRY PhpNonPollServicePendingListHead;
+static PH_QUEUED_LOCK PhpNonPollChangeListLock = PH_QUEUED_LOCK_INIT;
+static PPH_LIST PhpNonPollChangeList = NULL; // names of services that need to be re-queried
+
+// The service config store is only accessed by the service provider.
+static PPH_FILE_POOL PhpServiceConfigStore = NULL;
+static PPH_HASHTABLE PhpServiceConfigStoreHashtable;
 
 BOOLEAN PhServiceProviderInitialization(
     VOID
     )
 {
     PhServiceItemType = PhCreateObjectType(L"ServiceItem", 0, PhpServiceItemDeleteProcedure);
+    PhpServiceHashtableVersionType = PhCreateObjectType(L"ServiceHashtableVersion", 0, PhpServiceHashtableVersionDeleteProcedure);
     PhServiceHashtable = PhCreateHashtable(
         sizeof(PPH_SERVICE_ITEM),
         PhpServiceHashtableCompareFunction,
@@ -133,7 +196,11 @@ PPH_SERVICE_ITEM PhCreateServiceItem(
 
     if (Information)
     {
-        serviceItem->Name = PhCreateString(Information->lpServiceName);
+        PH_STRINGREF serviceName;
+
+        // The service name is also held by the non-poll notification contexts.
+        PhInitializeStringRefLongHint(&serviceName, Information->lpServiceName);
+        serviceItem->Name = PhInternStringRef(&serviceName);
         serviceItem->Key = serviceItem->Name->sr;
         serviceItem->DisplayName = PhCreateString(Information->lpDisplayName);
         serviceItem->Type = Information->ServiceStatusProcess.dwServiceType;
@@ -162,6 +229,9 @@ VOID PhpServiceItemDeleteProcedure(
 
     if (serviceItem->Name) PhDereferenceObject(serviceItem->Name);
     if (serviceItem->DisplayName) PhDereferenceObject(serviceItem->DisplayName);
+
+    if (serviceItem->CpuHistoryValid)
+        PhDeleteCircularBuffer_FLOAT(&serviceItem->CpuHistory);
 }
 
 BOOLEAN PhpServiceHashtableCompareFunction(
@@ -205,16 +275,97 @@ PPH_SERVICE_ITEM PhpLookupServiceItem(
         return NULL;
 }
 
+VOID PhpServiceHashtableVersionDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PPHP_SERVICE_HASHTABLE_VERSION version = (PPHP_SERVICE_HASHTABLE_VERSION)Object;
+    ULONG enumerationKey = 0;
+    PPH_SERVICE_ITEM *serviceItem;
+
+    while (PhEnumHashtable(version->Hashtable, &serviceItem, &enumerationKey))
+        PhDereferenceObject(*serviceItem);
+
+    PhDereferenceObject(version->Hashtable);
+}
+
+/**
+ * Publishes a copy of the service hashtable for lock-free readers.
+ *
+ * \remarks This function must be called from the provider thread.
+ */
+VOID PhpPublishServiceHashtableVersion(
+    VOID
+    )
+{
+    PPHP_SERVICE_HASHTABLE_VERSION version;
+    PPHP_SERVICE_HASHTABLE_VERSION oldVersion;
+    ULONG enumerationKey = 0;
+    PPH_SERVICE_ITEM *serviceItem;
+
+    if (!PhpServiceHashtableChanged)
+        return;
+
+    PhpServiceHashtableChanged = FALSE;
+
+    version = PhCreateObject(sizeof(PHP_SERVICE_HASHTABLE_VERSION), PhpServiceHashtableVersionType);
+    version->Hashtable = PhCreateHashtable(
+        sizeof(PPH_SERVICE_ITEM),
+        PhpServiceHashtableCompareFunction,
+        PhpServiceHashtableHashFunction,
+        PhServiceHashtable->Count + 1
+        );
+
+    // We are the only writer, so the hashtable can be read without the lock.
+    while (PhEnumHashtable(PhServiceHashtable, &serviceItem, &enumerationKey))
+    {
+        PhReferenceObject(*serviceItem);
+        PhAddEntryHashtable(version->Hashtable, serviceItem);
+    }
+
+    oldVersion = _InterlockedExchangePointer((PVOID *)&PhpServiceHashtableVersion, version);
+
+    if (oldVersion)
+        PhDereferenceObjectDeferDelete(oldVersion);
+}
+
 PPH_SERVICE_ITEM PhReferenceServiceItem(
     _In_ PWSTR Name
     )
 {
-    PPH_SERVICE_ITEM serviceItem;
+    PPH_SERVICE_ITEM serviceItem = NULL;
     PH_STRINGREF key;
+    ULONG epoch;
+    PPHP_SERVICE_HASHTABLE_VERSION version;
 
     // Construct a temporary service item for the lookup.
     PhInitializeStringRef(&key, Name);
 
+    epoch = PhEnterObjectEpoch();
+
+    if (version = PhpServiceHashtableVersion)
+    {
+        PH_SERVICE_ITEM lookupServiceItem;
+        PPH_SERVICE_ITEM lookupServiceItemPtr = &lookupServiceItem;
+        PPH_SERVICE_ITEM *entry;
+
+        lookupServiceItem.Key = key;
+
+        if (entry = PhFindEntryHashtable(version->Hashtable, &lookupServiceItemPtr))
+        {
+            serviceItem = *entry;
+            PhReferenceObject(serviceItem);
+        }
+    }
+
+    PhLeaveObjectEpoch(epoch);
+
+    if (serviceItem)
+        return serviceItem;
+
+    // The item may have been added after the hashtable was last published.
+
     PhAcquireQueuedLockShared(&PhServiceHashtableLock);
 
     serviceItem = PhpLookupServiceItem(&key);
@@ -232,6 +383,10 @@ VOID PhMarkNeedsConfigUpdateServiceItem(
     )
 {
     ServiceItem->NeedsConfigUpdate = TRUE;
+
+    // Configuration changes don't raise status notifications.
+    if (PhpNonPollActive)
+        PhpQueueServiceNonPollChange(ServiceItem->Name);
 }
 
 VOID PhpRemoveServiceItem(
@@ -239,6 +394,7 @@ VOID PhpRemoveServiceItem(
     )
 {
     PhRemoveEntryHashtable(PhServiceHashtable, &ServiceItem);
+    PhpServiceHashtableChanged = TRUE;
     PhDereferenceObject(ServiceItem);
 }
 
@@ -300,9 +456,11 @@ VOID PhUpdateProcessItemServices(
     PH_HASHTABLE_ENUM_CONTEXT enumContext;
     PPH_SERVICE_ITEM *serviceItem;
 
-    // We don't need to lock as long as the service provider
-    // never runs concurrently with the process provider. This
-    // is currently true.
+    // The caller must hold PhServiceProcessLinkLock. The service
+    // provider runs concurrently with the process provider, so we
+    // also need to lock the hashtable.
+
+    PhAcquireQueuedLockShared(&PhServiceHashtableLock);
 
     PhBeginEnumHashtable(PhServiceHashtable, &enumContext);
 
@@ -316,6 +474,8 @@ VOID PhUpdateProcessItemServices(
             PhpAddProcessItemService(ProcessItem, *serviceItem);
         }
     }
+
+    PhReleaseQueuedLockShared(&PhServiceHashtableLock);
 }
 
 VOID PhpAddProcessItemService(
@@ -363,13 +523,441 @@ VOID PhpRemoveProcessItemService(
     ProcessItem->JustProcessed = 1;
 }
 
+static BOOLEAN NTAPI PhpServiceConfigStoreEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPHP_SERVICE_CONFIG_STORE_ENTRY entry1 = Entry1;
+    PPHP_SERVICE_CONFIG_STORE_ENTRY entry2 = Entry2;
+
+    return PhEqualStringRef(&entry1->Key, &entry2->Key, TRUE);
+}
+
+static ULONG NTAPI PhpServiceConfigStoreHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPHP_SERVICE_CONFIG_STORE_ENTRY entry = Entry;
+
+    return PhHashStringRef(&entry->Key, TRUE);
+}
+
+/**
+ * Gets the last write time of the registry key of a service. The service manager writes to the
+ * key whenever the configuration of the service is changed.
+ *
+ * \param ServiceName The name of the service.
+ * \param LastWriteTime A variable which receives the last write time.
+ */
+static NTSTATUS PhpQueryServiceKeyLastWriteTime(
+    _In_ PPH_STRINGREF ServiceName,
+    _Out_ PLARGE_INTEGER LastWriteTime
+    )
+{
+    static PH_STRINGREF servicesKeyName = PH_STRINGREF_INIT(L"System\\CurrentControlSet\\Services\\");
+
+    NTSTATUS status;
+    HANDLE keyHandle;
+    PPH_STRING keyName;
+    UCHAR buffer[FIELD_OFFSET(KEY_BASIC_INFORMATION, Name) + 256 * sizeof(WCHAR)];
+    ULONG returnLength;
+
+    keyName = PhConcatStringRef2(&servicesKeyName, ServiceName);
+    status = PhOpenKey(
+        &keyHandle,
+        KEY_QUERY_VALUE,
+        PH_KEY_LOCAL_MACHINE,
+        &keyName->sr,
+        0
+        );
+    PhDereferenceObject(keyName);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    // Key names are at most 255 characters long, but we only need the fixed part anyway.
+    status = NtQueryKey(
+        keyHandle,
+        KeyBasicInformation,
+        buffer,
+        sizeof(buffer),
+        &returnLength
+        );
+    NtClose(keyHandle);
+
+    if (status == STATUS_BUFFER_OVERFLOW)
+        status = STATUS_SUCCESS;
+
+    if (NT_SUCCESS(status))
+        *LastWriteTime = ((PKEY_BASIC_INFORMATION)buffer)->LastWriteTime;
+
+    return status;
+}
+
+static PWSTR PhpGetServiceConfigStoreDependencies(
+    _In_ PPH_SERVICE_CONFIG_STORE_RECORD Record
+    )
+{
+    if (Record->DependenciesLength == 0)
+        return NULL;
+
+    return (PWSTR)((PCHAR)Record->Data + Record->NameLength);
+}
+
+static BOOLEAN PhpValidateServiceConfigStoreDependencies(
+    _In_ PPH_SERVICE_CONFIG_STORE_RECORD Record
+    )
+{
+    PWSTR dependencies;
+    ULONG count;
+
+    if (!(dependencies = PhpGetServiceConfigStoreDependencies(Record)))
+        return TRUE;
+    if (Record->DependenciesLength & 1)
+        return FALSE;
+
+    // The dependencies must end with an empty string, i.e. a single null character or two null
+    // characters after the last name.
+    count = Record->DependenciesLength / sizeof(WCHAR);
+
+    if (dependencies[count - 1] != 0)
+        return FALSE;
+
+    return count == 1 || dependencies[count - 2] == 0;
+}
+
+/**
+ * Opens the service config store and indexes its records by service name. Invalid and duplicate
+ * records are removed from the store.
+ */
+VOID PhpLoadServiceConfigStore(
+    VOID
+    )
+{
+    static PH_STRINGREF storeFileName = PH_STRINGREF_INIT(L"\\servicecache.dat");
+
+    PPH_FILE_POOL pool;
+    ULONGLONG userContext;
+    PPH_SERVICE_CONFIG_STORE_RECORD previousRecord;
+    PPH_SERVICE_CONFIG_STORE_RECORD record;
+    ULONG rva;
+
+    if (!NT_SUCCESS(PhCreateStoreFilePool(&pool, &storeFileName, PH_SERVICE_CONFIG_STORE_MAGIC, NULL, &userContext)))
+        return;
+
+    PhpServiceConfigStoreHashtable = PhCreateHashtable(
+        sizeof(PHP_SERVICE_CONFIG_STORE_ENTRY),
+        PhpServiceConfigStoreEqualFunction,
+        PhpServiceConfigStoreHashFunction,
+        256
+        );
+
+    previousRecord = NULL;
+    rva = (ULONG)userContext;
+
+    while (record = PhReferenceFilePoolByRva(pool, rva))
+    {
+        ULONG nextRva;
+        BOOLEAN valid;
+
+        nextRva = record->NextRva;
+        valid = FALSE;
+
+        if (
+            record->Size == FIELD_OFFSET(PH_SERVICE_CONFIG_STORE_RECORD, Data) + record->NameLength + record->DependenciesLength &&
+            record->NameLength != 0 &&
+            !(record->NameLength & 1) &&
+            PhpValidateServiceConfigStoreDependencies(record)
+            )
+        {
+            PH_STRINGREF name;
+            PHP_SERVICE_CONFIG_STORE_ENTRY entry;
+
+            name.Buffer = record->Data;
+            name.Length = record->NameLength;
+            entry.Name = PhCreateString2(&name);
+            entry.Key = entry.Name->sr;
+            entry.Rva = rva;
+            entry.Seen = FALSE;
+
+            valid = !!PhAddEntryHashtable(PhpServiceConfigStoreHashtable, &entry);
+
+            if (!valid)
+            {
+                // Duplicate record.
+                PhDereferenceObject(entry.Name);
+            }
+        }
+
+        if (valid)
+        {
+            if (previousRecord)
+                PhDereferenceFilePool(pool, previousRecord);
+
+            previousRecord = record;
+        }
+        else
+        {
+            // Unlink and free the record.
+
+            if (previousRecord)
+            {
+                previousRecord->NextRva = nextRva;
+            }
+            else
+            {
+                userContext = ((ULONGLONG)PH_SERVICE_CONFIG_STORE_MAGIC << 32) | nextRva;
+                PhSetUserContextFilePool(pool, &userContext);
+            }
+
+            PhFreeFilePool(pool, record);
+        }
+
+        rva = nextRva;
+    }
+
+    if (previousRecord)
+        PhDereferenceFilePool(pool, previousRecord);
+
+    PhpServiceConfigStore = pool;
+}
+
+/**
+ * Removes records for services that no longer exist from the service config store. This must be
+ * called after all services have been processed once.
+ */
+VOID PhpPruneServiceConfigStore(
+    VOID
+    )
+{
+    ULONGLONG userContext;
+    PPH_SERVICE_CONFIG_STORE_RECORD previousRecord;
+    PPH_SERVICE_CONFIG_STORE_RECORD record;
+    ULONG rva;
+
+    if (!PhpServiceConfigStore)
+        return;
+
+    PhGetUserContextFilePool(PhpServiceConfigStore, &userContext);
+    previousRecord = NULL;
+    rva = (ULONG)userContext;
+
+    while (record = PhReferenceFilePoolByRva(PhpServiceConfigStore, rva))
+    {
+        ULONG nextRva;
+        PHP_SERVICE_CONFIG_STORE_ENTRY lookupEntry;
+        PPHP_SERVICE_CONFIG_STORE_ENTRY entry;
+
+        nextRva = record->NextRva;
+        lookupEntry.Key.Buffer = record->Data;
+        lookupEntry.Key.Length = record->NameLength;
+        entry = PhFindEntryHashtable(PhpServiceConfigStoreHashtable, &lookupEntry);
+
+        if (entry && entry->Seen)
+        {
+            if (previousRecord)
+                PhDereferenceFilePool(PhpServiceConfigStore, previousRecord);
+
+            previousRecord = record;
+        }
+        else
+        {
+            if (entry)
+            {
+                PPH_STRING name;
+
+                name = entry->Name;
+                PhRemoveEntryHashtable(PhpServiceConfigStoreHashtable, &lookupEntry);
+                PhDereferenceObject(name);
+            }
+
+            if (previousRecord)
+            {
+                previousRecord->NextRva = nextRva;
+            }
+            else
+            {
+                userContext = ((ULONGLONG)PH_SERVICE_CONFIG_STORE_MAGIC << 32) | nextRva;
+                PhSetUserContextFilePool(PhpServiceConfigStore, &userContext);
+            }
+
+            PhFreeFilePool(PhpServiceConfigStore, record);
+        }
+
+        rva = nextRva;
+    }
+
+    if (previousRecord)
+        PhDereferenceFilePool(PhpServiceConfigStore, previousRecord);
+}
+
+/**
+ * Fills in the configuration of a new service item from the service config store.
+ *
+ * \param ServiceItem The service item.
+ *
+ * \return TRUE if the store contained a record for the service, otherwise FALSE. If the registry
+ * key of the service has changed since the record was written, the service item is marked so that
+ * its configuration is queried again on the next update.
+ */
+BOOLEAN PhpLoadServiceItemConfigFromStore(
+    _In_ PPH_SERVICE_ITEM ServiceItem
+    )
+{
+    PHP_SERVICE_CONFIG_STORE_ENTRY lookupEntry;
+    PPHP_SERVICE_CONFIG_STORE_ENTRY entry;
+    PPH_SERVICE_CONFIG_STORE_RECORD record;
+    LARGE_INTEGER recordLastWriteTime;
+    LARGE_INTEGER lastWriteTime;
+
+    if (!PhpServiceConfigStore)
+        return FALSE;
+
+    lookupEntry.Key = ServiceItem->Name->sr;
+
+    if (!(entry = PhFindEntryHashtable(PhpServiceConfigStoreHashtable, &lookupEntry)))
+        return FALSE;
+    if (!(record = PhReferenceFilePoolByRva(PhpServiceConfigStore, entry->Rva)))
+        return FALSE;
+
+    entry->Seen = TRUE;
+
+    ServiceItem->StartType = record->StartType;
+    ServiceItem->ErrorControl = record->ErrorControl;
+    ServiceItem->DelayedStart = record->DelayedStart;
+    ServiceItem->HasTriggers = record->HasTriggers;
+    recordLastWriteTime = record->KeyLastWriteTime;
+    PhSetServiceDependencies(&ServiceItem->Name->sr, PhpGetServiceConfigStoreDependencies(record));
+
+    PhDereferenceFilePool(PhpServiceConfigStore, record);
+
+    // If the service has been reconfigured, the stored configuration is shown until the next
+    // update queries the service manager and raises the modified event.
+    if (
+        !NT_SUCCESS(PhpQueryServiceKeyLastWriteTime(&ServiceItem->Name->sr, &lastWriteTime)) ||
+        lastWriteTime.QuadPart != recordLastWriteTime.QuadPart
+        )
+    {
+        ServiceItem->NeedsConfigUpdate = TRUE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Writes the configuration of a service item to the service config store.
+ *
+ * \param ServiceItem The service item.
+ * \param KeyLastWriteTime The last write time of the registry key of the service, queried before
+ * the configuration was.
+ * \param Dependencies The dependencies of the service, in the format of
+ * QUERY_SERVICE_CONFIG.lpDependencies.
+ */
+VOID PhpUpdateServiceConfigStoreRecord(
+    _In_ PPH_SERVICE_ITEM ServiceItem,
+    _In_ PLARGE_INTEGER KeyLastWriteTime,
+    _In_opt_ PWSTR Dependencies
+    )
+{
+    PHP_SERVICE_CONFIG_STORE_ENTRY lookupEntry;
+    PPHP_SERVICE_CONFIG_STORE_ENTRY entry;
+    PPH_SERVICE_CONFIG_STORE_RECORD record;
+    SIZE_T dependenciesLength;
+    ULONG size;
+    ULONG rva;
+    ULONGLONG userContext;
+
+    if (!PhpServiceConfigStore)
+        return;
+
+    dependenciesLength = 0;
+
+    if (Dependencies && *Dependencies)
+    {
+        PWSTR dependency;
+
+        for (dependency = Dependencies; *dependency; dependency += PhCountStringZ(dependency) + 1)
+            NOTHING;
+
+        dependenciesLength = ((PCHAR)dependency - (PCHAR)Dependencies) + sizeof(WCHAR);
+    }
+
+    if (ServiceItem->Name->Length > MAXUSHORT || dependenciesLength > MAXUSHORT)
+        return;
+
+    size = FIELD_OFFSET(PH_SERVICE_CONFIG_STORE_RECORD, Data) + (ULONG)ServiceItem->Name->Length + (ULONG)dependenciesLength;
+    lookupEntry.Key = ServiceItem->Name->sr;
+    record = NULL;
+
+    if (entry = PhFindEntryHashtable(PhpServiceConfigStoreHashtable, &lookupEntry))
+    {
+        entry->Seen = TRUE;
+
+        // The record can be updated in place unless its dependencies have changed. Unlinking the
+        // record would require a walk of the list, so it is invalidated instead and freed when the
+        // store is next loaded.
+        if ((record = PhReferenceFilePoolByRva(PhpServiceConfigStore, entry->Rva)) && record->Size != size)
+        {
+            record->NameLength = 0;
+            PhDereferenceFilePool(PhpServiceConfigStore, record);
+            record = NULL;
+        }
+    }
+
+    if (!record)
+    {
+        if (!(record = PhAllocateFilePool(PhpServiceConfigStore, size, &rva)))
+            return;
+
+        PhGetUserContextFilePool(PhpServiceConfigStore, &userContext);
+
+        record->NextRva = (ULONG)userContext;
+        record->Size = size;
+        record->NameLength = (USHORT)ServiceItem->Name->Length;
+        record->DependenciesLength = (USHORT)dependenciesLength;
+        memcpy(record->Data, ServiceItem->Name->Buffer, ServiceItem->Name->Length);
+
+        userContext = ((ULONGLONG)PH_SERVICE_CONFIG_STORE_MAGIC << 32) | rva;
+        PhSetUserContextFilePool(PhpServiceConfigStore, &userContext);
+
+        if (entry)
+        {
+            entry->Rva = rva;
+        }
+        else
+        {
+            PhReferenceObject(ServiceItem->Name);
+            lookupEntry.Name = ServiceItem->Name;
+            lookupEntry.Rva = rva;
+            lookupEntry.Seen = TRUE;
+            PhAddEntryHashtable(PhpServiceConfigStoreHashtable, &lookupEntry);
+        }
+    }
+
+    record->KeyLastWriteTime = *KeyLastWriteTime;
+    record->StartType = ServiceItem->StartType;
+    record->ErrorControl = ServiceItem->ErrorControl;
+    record->DelayedStart = ServiceItem->DelayedStart;
+    record->HasTriggers = ServiceItem->HasTriggers;
+
+    if (dependenciesLength != 0)
+        memcpy((PCHAR)record->Data + record->NameLength, Dependencies, dependenciesLength);
+
+    PhDereferenceFilePool(PhpServiceConfigStore, record);
+}
+
 VOID PhpUpdateServiceItemConfig(
     _In_ SC_HANDLE ScManagerHandle,
     _In_ PPH_SERVICE_ITEM ServiceItem
     )
 {
     SC_HANDLE serviceHandle;
+    LARGE_INTEGER keyLastWriteTime;
+    BOOLEAN keyLastWriteTimeValid;
 
+    // Query the last write time first so that a concurrent change invalidates the record.
+    keyLastWriteTimeValid = NT_SUCCESS(PhpQueryServiceKeyLastWriteTime(&ServiceItem->Name->sr, &keyLastWriteTime));
     serviceHandle = OpenService(ScManagerHandle, ServiceItem->Name->Buffer, SERVICE_QUERY_CONFIG);
 
     if (serviceHandle)
@@ -385,8 +973,7 @@ VOID PhpUpdateServiceItemConfig(
         {
             ServiceItem->StartType = config->dwStartType;
             ServiceItem->ErrorControl = config->dwErrorControl;
-
-            PhFree(config);
+            PhSetServiceDependencies(&ServiceItem->Name->sr, config->lpDependencies);
         }
 
         if (QueryServiceConfig2(
@@ -415,7 +1002,268 @@ VOID PhpUpdateServiceItemConfig(
         }
 
         CloseServiceHandle(serviceHandle);
+
+        if (config)
+        {
+            if (keyLastWriteTimeValid)
+                PhpUpdateServiceConfigStoreRecord(ServiceItem, &keyLastWriteTime, config->lpDependencies);
+
+            PhFree(config);
+        }
+    }
+}
+
+VOID PhpRaiseServiceRemoved(
+    _In_ PPH_SERVICE_ITEM ServiceItem
+    )
+{
+    PhRemoveServiceDependencies(&ServiceItem->Name->sr);
+
+    // Remove the service from its process.
+    if (ServiceItem->ProcessId)
+    {
+        PPH_PROCESS_ITEM processItem;
+
+        processItem = PhReferenceProcessItem((HANDLE)ServiceItem->ProcessId);
+
+        if (processItem)
+        {
+            PhpRemoveProcessItemService(processItem, ServiceItem);
+            PhDereferenceObject(processItem);
+        }
+    }
+
+    // Raise the service removed event.
+    PhInvokeCallback(&PhServiceRemovedEvent, ServiceItem);
+}
+
+VOID PhpProcessServiceEntry(
+    _In_ SC_HANDLE ScManagerHandle,
+    _In_ LPENUM_SERVICE_STATUS_PROCESS ServiceEntry
+    )
+{
+    PPH_SERVICE_ITEM serviceItem;
+    PH_STRINGREF serviceName;
+
+    PhInitializeStringRefLongHint(&serviceName, ServiceEntry->lpServiceName);
+    serviceItem = PhpLookupServiceItem(&serviceName);
+
+    if (!serviceItem)
+    {
+        // Create the service item and fill in basic information.
+
+        serviceItem = PhCreateServiceItem(ServiceEntry);
+
+        if (!PhpLoadServiceItemConfigFromStore(serviceItem))
+            PhpUpdateServiceItemConfig(ScManagerHandle, serviceItem);
+
+        // The service must be in the hashtable before the lock is released, otherwise
+        // its process may be added without it.
+        PhAcquireQueuedLockExclusive(&PhServiceProcessLinkLock);
+
+        // Add the service to its process, if appropriate.
+        if (
+            (
+            serviceItem->State == SERVICE_RUNNING ||
+            serviceItem->State == SERVICE_PAUSED
+            ) &&
+            serviceItem->ProcessId
+            )
+        {
+            PPH_PROCESS_ITEM processItem;
+
+            if (processItem = PhReferenceProcessItem(serviceItem->ProcessId))
+            {
+                PhpAddProcessItemService(processItem, serviceItem);
+                PhDereferenceObject(processItem);
+            }
+            else
+            {
+                // The process doesn't exist yet (to us). Set the pending
+                // flag and when the process is added this will be
+                // fixed.
+                serviceItem->PendingProcess = TRUE;
+            }
+        }
+
+        // Add the service item to the hashtable.
+        PhAcquireQueuedLockExclusive(&PhServiceHashtableLock);
+        PhAddEntryHashtable(PhServiceHashtable, &serviceItem);
+        PhpServiceHashtableChanged = TRUE;
+        PhReleaseQueuedLockExclusive(&PhServiceHashtableLock);
+
+        PhReleaseQueuedLockExclusive(&PhServiceProcessLinkLock);
+
+        // Raise the service added event.
+        PhInvokeCallback(&PhServiceAddedEvent, serviceItem);
+    }
+    else
+    {
+        if (
+            serviceItem->Type != ServiceEntry->ServiceStatusProcess.dwServiceType ||
+            serviceItem->State != ServiceEntry->ServiceStatusProcess.dwCurrentState ||
+            serviceItem->ControlsAccepted != ServiceEntry->ServiceStatusProcess.dwControlsAccepted ||
+            serviceItem->ProcessId != UlongToHandle(ServiceEntry->ServiceStatusProcess.dwProcessId) ||
+            serviceItem->NeedsConfigUpdate
+            )
+        {
+            PH_SERVICE_MODIFIED_DATA serviceModifiedData;
+            PH_SERVICE_CHANGE serviceChange;
+
+            // The service has been "modified".
+
+            serviceModifiedData.Service = serviceItem;
+            memset(&serviceModifiedData.OldService, 0, sizeof(PH_SERVICE_ITEM));
+            serviceModifiedData.OldService.Type = serviceItem->Type;
+            serviceModifiedData.OldService.State = serviceItem->State;
+            serviceModifiedData.OldService.ControlsAccepted = serviceItem->ControlsAccepted;
+            serviceModifiedData.OldService.ProcessId = serviceItem->ProcessId;
+
+            // Update the service item.
+            serviceItem->Type = ServiceEntry->ServiceStatusProcess.dwServiceType;
+            serviceItem->State = ServiceEntry->ServiceStatusProcess.dwCurrentState;
+            serviceItem->ControlsAccepted = ServiceEntry->ServiceStatusProcess.dwControlsAccepted;
+            serviceItem->ProcessId = UlongToHandle(ServiceEntry->ServiceStatusProcess.dwProcessId);
+
+            if (serviceItem->ProcessId)
+                PhPrintUInt32(serviceItem->ProcessIdString, HandleToUlong(serviceItem->ProcessId));
+            else
+                serviceItem->ProcessIdString[0] = 0;
+
+            // Add/remove the service from its process.
+
+            serviceChange = PhGetServiceChange(&serviceModifiedData);
+
+            PhAcquireQueuedLockExclusive(&PhServiceProcessLinkLock);
+
+            if (
+                (serviceChange == ServiceStarted && serviceItem->ProcessId) ||
+                (serviceChange == ServiceStopped && serviceModifiedData.OldService.ProcessId)
+                )
+            {
+                PPH_PROCESS_ITEM processItem;
+
+                if (serviceChange == ServiceStarted)
+                    processItem = PhReferenceProcessItem(serviceItem->ProcessId);
+                else
+                    processItem = PhReferenceProcessItem(serviceModifiedData.OldService.ProcessId);
+
+                if (processItem)
+                {
+                    if (serviceChange == ServiceStarted)
+                        PhpAddProcessItemService(processItem, serviceItem);
+                    else
+                        PhpRemoveProcessItemService(processItem, serviceItem);
+
+                    PhDereferenceObject(processItem);
+                }
+                else
+                {
+                    if (serviceChange == ServiceStarted)
+                        serviceItem->PendingProcess = TRUE;
+                    else
+                        serviceItem->PendingProcess = FALSE;
+                }
+            }
+            else if (
+                serviceItem->State == SERVICE_RUNNING &&
+                serviceItem->ProcessId != serviceModifiedData.OldService.ProcessId &&
+                serviceItem->ProcessId
+                )
+            {
+                PPH_PROCESS_ITEM processItem;
+
+                // The service stopped and started, and the only change we have detected
+                // is in the process ID.
+
+                if (processItem = PhReferenceProcessItem(serviceModifiedData.OldService.ProcessId))
+                {
+                    PhpRemoveProcessItemService(processItem, serviceItem);
+                    PhDereferenceObject(processItem);
+                }
+
+                if (processItem = PhReferenceProcessItem(serviceItem->ProcessId))
+                {
+                    PhpAddProcessItemService(processItem, serviceItem);
+                    PhDereferenceObject(processItem);
+                }
+                else
+                {
+                    serviceItem->PendingProcess = TRUE;
+                }
+            }
+
+            PhReleaseQueuedLockExclusive(&PhServiceProcessLinkLock);
+
+            // Do a config update if necessary.
+            if (serviceItem->NeedsConfigUpdate)
+            {
+                PhpUpdateServiceItemConfig(ScManagerHandle, serviceItem);
+                serviceItem->NeedsConfigUpdate = FALSE;
+            }
+
+            // Raise the service modified event.
+            PhInvokeCallback(&PhServiceModifiedEvent, &serviceModifiedData);
+        }
+    }
+}
+
+/**
+ * Refreshes a single service after a change notification.
+ *
+ * \param ScManagerHandle A handle to the service control manager.
+ * \param ServiceName The name of the service.
+ */
+VOID PhpUpdateServiceByName(
+    _In_ SC_HANDLE ScManagerHandle,
+    _In_ PPH_STRING ServiceName
+    )
+{
+    SC_HANDLE serviceHandle;
+    PPH_SERVICE_ITEM serviceItem;
+    ENUM_SERVICE_STATUS_PROCESS serviceEntry;
+    LPQUERY_SERVICE_CONFIG config = NULL;
+    ULONG returnLength;
+
+    serviceItem = PhpLookupServiceItem(&ServiceName->sr);
+    serviceHandle = OpenService(ScManagerHandle, ServiceName->Buffer, SERVICE_QUERY_STATUS | SERVICE_QUERY_CONFIG);
+
+    if (!serviceHandle)
+    {
+        if (GetLastError() == ERROR_SERVICE_DOES_NOT_EXIST && serviceItem)
+        {
+            PhpRaiseServiceRemoved(serviceItem);
+
+            PhAcquireQueuedLockExclusive(&PhServiceHashtableLock);
+            PhpRemoveServiceItem(serviceItem);
+            PhReleaseQueuedLockExclusive(&PhServiceHashtableLock);
+        }
+
+        return;
+    }
+
+    if (QueryServiceStatusEx(
+        serviceHandle,
+        SC_STATUS_PROCESS_INFO,
+        (PBYTE)&serviceEntry.ServiceStatusProcess,
+        sizeof(SERVICE_STATUS_PROCESS),
+        &returnLength
+        ))
+    {
+        serviceEntry.lpServiceName = ServiceName->Buffer;
+        serviceEntry.lpDisplayName = ServiceName->Buffer;
+
+        // The display name is only needed when creating the service item.
+        if (!serviceItem && (config = PhGetServiceConfig(serviceHandle)) && config->lpDisplayName)
+            serviceEntry.lpDisplayName = config->lpDisplayName;
+
+        PhpProcessServiceEntry(ScManagerHandle, &serviceEntry);
+
+        if (config)
+            PhFree(config);
     }
+
+    CloseServiceHandle(serviceHandle);
 }
 
 static BOOLEAN PhpCompareServiceNameEntry(
@@ -450,6 +1298,16 @@ VOID PhServiceProviderUpdate(
     ULONG i;
     PPH_HASH_ENTRY hashEntry;
 
+    if (!scManagerHandle)
+    {
+        scManagerHandle = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE);
+
+        if (!scManagerHandle)
+            return;
+
+        PhpLoadServiceConfigStore();
+    }
+
     // We always execute the first run, and we only initialize non-polling after the first run.
     if (PhEnableServiceNonPoll && runCount != 0)
     {
@@ -465,20 +1323,36 @@ VOID PhServiceProviderUpdate(
 
         if (PhpNonPollActive)
         {
-            if (InterlockedExchange(&PhpNonPollGate, 0) == 0)
+            PPH_LIST changeList;
+
+            PhAcquireQueuedLockExclusive(&PhpNonPollChangeListLock);
+            changeList = PhpNonPollChangeList;
+            PhpNonPollChangeList = NULL;
+            PhReleaseQueuedLockExclusive(&PhpNonPollChangeListLock);
+
+            if (!PhpNonPollReconcile && runCount % PH_SERVICE_RECONCILE_INTERVAL != 0)
             {
-                // Non-poll gate is closed; skip all processing.
-                goto UpdateEnd;
+                // Only refresh the services we were notified about.
+                if (changeList)
+                {
+                    for (i = 0; i < changeList->Count; i++)
+                        PhpUpdateServiceByName(scManagerHandle, changeList->Items[i]);
+                }
             }
-        }
-    }
 
-    if (!scManagerHandle)
-    {
-        scManagerHandle = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE);
+            if (changeList)
+            {
+                PhDereferenceObjects(changeList->Items, changeList->Count);
+                PhDereferenceObject(changeList);
+            }
 
-        if (!scManagerHandle)
-            return;
+            if (!PhpNonPollReconcile && runCount % PH_SERVICE_RECONCILE_INTERVAL != 0)
+                goto UpdateEnd;
+
+            // Changes that arrive from now on are picked up by the next update, so the
+            // full enumeration below can't miss any of them.
+            PhpNonPollReconcile = FALSE;
+        }
     }
 
     services = PhEnumServices(scManagerHandle, 0, 0, &numberOfServices);
@@ -556,22 +1430,7 @@ VOID PhServiceProviderUpdate(
 
             if (!found)
             {
-                // Remove the service from its process.
-                if ((*serviceItem)->ProcessId)
-                {
-                    PPH_PROCESS_ITEM processItem;
-
-                    processItem = PhReferenceProcessItem((HANDLE)(*serviceItem)->ProcessId);
-
-                    if (processItem)
-                    {
-                        PhpRemoveProcessItemService(processItem, *serviceItem);
-                        PhDereferenceObject(processItem);
-                    }
-                }
-
-                // Raise the service removed event.
-                PhInvokeCallback(&PhServiceRemovedEvent, *serviceItem);
+                PhpRaiseServiceRemoved(*serviceItem);
 
                 if (!servicesToRemove)
                     servicesToRemove = PhCreateList(2);
@@ -599,166 +1458,22 @@ VOID PhServiceProviderUpdate(
     {
         for (hashEntry = nameHashSet[i]; hashEntry; hashEntry = hashEntry->Next)
         {
-            PPH_SERVICE_ITEM serviceItem;
             PPHP_SERVICE_NAME_ENTRY nameEntry;
-            ENUM_SERVICE_STATUS_PROCESS *serviceEntry;
 
             nameEntry = CONTAINING_RECORD(hashEntry, PHP_SERVICE_NAME_ENTRY, HashEntry);
-            serviceEntry = nameEntry->ServiceEntry;
-            serviceItem = PhpLookupServiceItem(&nameEntry->Name);
-
-            if (!serviceItem)
-            {
-                // Create the service item and fill in basic information.
-
-                serviceItem = PhCreateServiceItem(serviceEntry);
-
-                PhpUpdateServiceItemConfig(scManagerHandle, serviceItem);
-
-                // Add the service to its process, if appropriate.
-                if (
-                    (
-                    serviceItem->State == SERVICE_RUNNING ||
-                    serviceItem->State == SERVICE_PAUSED
-                    ) &&
-                    serviceItem->ProcessId
-                    )
-                {
-                    PPH_PROCESS_ITEM processItem;
-
-                    if (processItem = PhReferenceProcessItem(serviceItem->ProcessId))
-                    {
-                        PhpAddProcessItemService(processItem, serviceItem);
-                        PhDereferenceObject(processItem);
-                    }
-                    else
-                    {
-                        // The process doesn't exist yet (to us). Set the pending
-                        // flag and when the process is added this will be
-                        // fixed.
-                        serviceItem->PendingProcess = TRUE;
-                    }
-                }
-
-                // Add the service item to the hashtable.
-                PhAcquireQueuedLockExclusive(&PhServiceHashtableLock);
-                PhAddEntryHashtable(PhServiceHashtable, &serviceItem);
-                PhReleaseQueuedLockExclusive(&PhServiceHashtableLock);
-
-                // Raise the service added event.
-                PhInvokeCallback(&PhServiceAddedEvent, serviceItem);
-            }
-            else
-            {
-                if (
-                    serviceItem->Type != serviceEntry->ServiceStatusProcess.dwServiceType ||
-                    serviceItem->State != serviceEntry->ServiceStatusProcess.dwCurrentState ||
-                    serviceItem->ControlsAccepted != serviceEntry->ServiceStatusProcess.dwControlsAccepted ||
-                    serviceItem->ProcessId != UlongToHandle(serviceEntry->ServiceStatusProcess.dwProcessId) ||
-                    serviceItem->NeedsConfigUpdate
-                    )
-                {
-                    PH_SERVICE_MODIFIED_DATA serviceModifiedData;
-                    PH_SERVICE_CHANGE serviceChange;
-
-                    // The service has been "modified".
-
-                    serviceModifiedData.Service = serviceItem;
-                    memset(&serviceModifiedData.OldService, 0, sizeof(PH_SERVICE_ITEM));
-                    serviceModifiedData.OldService.Type = serviceItem->Type;
-                    serviceModifiedData.OldService.State = serviceItem->State;
-                    serviceModifiedData.OldService.ControlsAccepted = serviceItem->ControlsAccepted;
-                    serviceModifiedData.OldService.ProcessId = serviceItem->ProcessId;
-
-                    // Update the service item.
-                    serviceItem->Type = serviceEntry->ServiceStatusProcess.dwServiceType;
-                    serviceItem->State = serviceEntry->ServiceStatusProcess.dwCurrentState;
-                    serviceItem->ControlsAccepted = serviceEntry->ServiceStatusProcess.dwControlsAccepted;
-                    serviceItem->ProcessId = UlongToHandle(serviceEntry->ServiceStatusProcess.dwProcessId);
-
-                    if (serviceItem->ProcessId)
-                        PhPrintUInt32(serviceItem->ProcessIdString, HandleToUlong(serviceItem->ProcessId));
-                    else
-                        serviceItem->ProcessIdString[0] = 0;
-
-                    // Add/remove the service from its process.
-
-                    serviceChange = PhGetServiceChange(&serviceModifiedData);
-
-                    if (
-                        (serviceChange == ServiceStarted && serviceItem->ProcessId) ||
-                        (serviceChange == ServiceStopped && serviceModifiedData.OldService.ProcessId)
-                        )
-                    {
-                        PPH_PROCESS_ITEM processItem;
-
-                        if (serviceChange == ServiceStarted)
-                            processItem = PhReferenceProcessItem(serviceItem->ProcessId);
-                        else
-                            processItem = PhReferenceProcessItem(serviceModifiedData.OldService.ProcessId);
-
-                        if (processItem)
-                        {
-                            if (serviceChange == ServiceStarted)
-                                PhpAddProcessItemService(processItem, serviceItem);
-                            else
-                                PhpRemoveProcessItemService(processItem, serviceItem);
-
-                            PhDereferenceObject(processItem);
-                        }
-                        else
-                        {
-                            if (serviceChange == ServiceStarted)
-                                serviceItem->PendingProcess = TRUE;
-                            else
-                                serviceItem->PendingProcess = FALSE;
-                        }
-                    }
-                    else if (
-                        serviceItem->State == SERVICE_RUNNING &&
-                        serviceItem->ProcessId != serviceModifiedData.OldService.ProcessId &&
-                        serviceItem->ProcessId
-                        )
-                    {
-                        PPH_PROCESS_ITEM processItem;
-
-                        // The service stopped and started, and the only change we have detected
-                        // is in the process ID.
-
-                        if (processItem = PhReferenceProcessItem(serviceModifiedData.OldService.ProcessId))
-                        {
-                            PhpRemoveProcessItemService(processItem, serviceItem);
-                            PhDereferenceObject(processItem);
-                        }
-
-                        if (processItem = PhReferenceProcessItem(serviceItem->ProcessId))
-                        {
-                            PhpAddProcessItemService(processItem, serviceItem);
-                            PhDereferenceObject(processItem);
-                        }
-                        else
-                        {
-                            serviceItem->PendingProcess = TRUE;
-                        }
-                    }
-
-                    // Do a config update if necessary.
-                    if (serviceItem->NeedsConfigUpdate)
-                    {
-                        PhpUpdateServiceItemConfig(scManagerHandle, serviceItem);
-                        serviceItem->NeedsConfigUpdate = FALSE;
-                    }
-
-                    // Raise the service modified event.
-                    PhInvokeCallback(&PhServiceModifiedEvent, &serviceModifiedData);
-                }
-            }
+            PhpProcessServiceEntry(scManagerHandle, nameEntry->ServiceEntry);
         }
     }
 
+    if (runCount == 0)
+        PhpPruneServiceConfigStore();
+
     PhFree(services);
 
 UpdateEnd:
+    PhpPublishServiceHashtableVersion();
+
+    PhEmCallObjectBulkUpdate(EmServiceItemType);
     PhInvokeCallback(&PhServicesUpdatedEvent, NULL);
     runCount++;
 }
@@ -797,6 +1512,16 @@ VOID CALLBACK PhpServiceNonPollScNotifyCallback(
                     newNotifyContext->State = SnAdding;
                     newNotifyContext->ServiceName = PhCreateString(name + 1);
                     InsertTailList(&PhpNonPollServicePendingListHead, &newNotifyContext->ListEntry);
+                    PhpQueueServiceNonPollChange(newNotifyContext->ServiceName);
+                }
+                else if (name[0] == '\\')
+                {
+                    PPH_STRING serviceName;
+
+                    // Service deletion
+                    serviceName = PhCreateString(name + 1);
+                    PhpQueueServiceNonPollChange(serviceName);
+                    PhDereferenceObject(serviceName);
                 }
 
                 name += nameLength + 1;
@@ -805,6 +1530,9 @@ VOID CALLBACK PhpServiceNonPollScNotifyCallback(
             LocalFree(notifyBuffer->pszServiceNames);
         }
 
+        if (notifyContext->ServiceName)
+            PhpQueueServiceNonPollChange(notifyContext->ServiceName);
+
         notifyContext->State = SnNotify;
         RemoveEntryList(&notifyContext->ListEntry);
         InsertTailList(&PhpNonPollServicePendingListHead, &notifyContext->ListEntry);
@@ -813,6 +1541,7 @@ VOID CALLBACK PhpServiceNonPollScNotifyCallback(
     {
         if (!notifyContext->IsServiceManager)
         {
+            PhpQueueServiceNonPollChange(notifyContext->ServiceName);
             notifyContext->State = SnRemoving;
             RemoveEntryList(&notifyContext->ListEntry);
             InsertTailList(&PhpNonPollServicePendingListHead, &notifyContext->ListEntry);
@@ -820,15 +1549,32 @@ VOID CALLBACK PhpServiceNonPollScNotifyCallback(
     }
     else
     {
+        // The notification failed, so we don't know what changed.
+        PhpNonPollReconcile = TRUE;
+
         notifyContext->State = SnNotify;
         RemoveEntryList(&notifyContext->ListEntry);
         InsertTailList(&PhpNonPollServicePendingListHead, &notifyContext->ListEntry);
     }
 
-    PhpNonPollGate = 1;
     NtSetEvent(PhpNonPollEventHandle, NULL);
 }
 
+VOID PhpQueueServiceNonPollChange(
+    _In_ PPH_STRING ServiceName
+    )
+{
+    PhAcquireQueuedLockExclusive(&PhpNonPollChangeListLock);
+
+    if (!PhpNonPollChangeList)
+        PhpNonPollChangeList = PhCreateList(8);
+
+    PhReferenceObject(ServiceName);
+    PhAddItemList(PhpNonPollChangeList, ServiceName);
+
+    PhReleaseQueuedLockExclusive(&PhpNonPollChangeListLock);
+}
+
 VOID PhpDestroyServiceNotifyContext(
     _In_ PPHP_SERVICE_NOTIFY_CONTEXT NotifyContext
     )
@@ -852,11 +1598,11 @@ NTSTATUS PhpServiceNonPollThreadStart(
     ULONG i;
     PLIST_ENTRY listEntry;
     PPHP_SERVICE_NOTIFY_CONTEXT notifyContext;
+    PH_STRINGREF serviceName;
 
     if (!NT_SUCCESS(NtCreateEvent(&PhpNonPollEventHandle, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE)))
     {
         PhpNonPollActive = FALSE;
-        PhpNonPollGate = 1;
         return STATUS_UNSUCCESSFUL;
     }
 
@@ -882,6 +1628,8 @@ NTSTATUS PhpServiceNonPollThreadStart(
                 notifyContext = PhAllocate(sizeof(PHP_SERVICE_NOTIFY_CONTEXT));
                 memset(notifyContext, 0, sizeof(PHP_SERVICE_NOTIFY_CONTEXT));
                 notifyContext->ServiceHandle = serviceHandle;
+                PhInitializeStringRefLongHint(&serviceName, services[i].lpServiceName);
+                notifyContext->ServiceName = PhInternStringRef(&serviceName);
                 notifyContext->State = SnNotify;
                 InsertTailList(&PhpNonPollServicePendingListHead, &notifyContext->ListEntry);
             }
@@ -922,7 +1670,6 @@ NTSTATUS PhpServiceNonPollThreadStart(
                         continue;
                     }
 
-                    PhClearReference(&notifyContext->ServiceName);
                     notifyContext->State = SnNotify;
                     goto NotifyCase;
                 case SnRemoving:
@@ -996,6 +1743,9 @@ NotifyCase:
         }
 
         CloseServiceHandle(scManagerHandle);
+
+        // Notifications may have been lost while we were lagging.
+        PhpNonPollReconcile = TRUE;
     }
 
     NtClose(PhpNonPollEventHandle);
@@ -1004,7 +1754,6 @@ NotifyCase:
 
 ErrorExit:
     PhpNonPollActive = FALSE;
-    PhpNonPollGate = 1;
     NtClose(PhpNonPollEventHandle);
     return STATUS_UNSUCCESSFUL;
 }
@@ -1021,7 +1770,7 @@ VOID PhpInitializeServiceNonPoll(
         return;
 
     PhpNonPollActive = TRUE;
-    PhpNonPollGate = 1; // initially the gate should be open since we only just initialized everything
+    PhpNonPollReconcile = TRUE; // enumerate once more since we only just initialized everything
 
     PhpNonPollThreadHandle = PhCreateThread(0, PhpServiceNonPollThreadStart, NULL);
 
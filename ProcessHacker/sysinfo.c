@@ -99,19 +99,33 @@ static PH_GRAPH_STATE CpuGraphState;
 static HWND *CpusGraphHandle;
 static PPH_GRAPH_STATE CpusGraphState;
 static BOOLEAN OneGraphPerCpu;
+static BOOLEAN CpuHeatmapEnabled; // one graph per CPU is drawn as a single heatmap
+static HWND CpuHeatmapHandle;
+static PULONG CpuHeatmapBits; // top-down 32bpp, one column per sample
+static ULONG CpuHeatmapWidth;
+static ULONG CpuHeatmapHeight;
+static PULONG CpuHeatmapRows; // processor number for each row, or -1 for a separator
 static HWND CpuPanel;
 static ULONG CpuTicked;
-static ULONG NumberOfProcessors;
+static ULONG NumberOfProcessors; // in all groups
+static ULONG NumberOfGroupProcessors; // in the current group, for queries that are not group-aware
 static PSYSTEM_INTERRUPT_INFORMATION InterruptInformation;
 static PPROCESSOR_POWER_INFORMATION PowerInformation;
-static PSYSTEM_PROCESSOR_PERFORMANCE_DISTRIBUTION CurrentPerformanceDistribution;
-static PSYSTEM_PROCESSOR_PERFORMANCE_DISTRIBUTION PreviousPerformanceDistribution;
+static ULONG CpuFrequencyInterval; // ticks between frequency samples
+static ULONG CpuFrequencyTicks;
+static BOOLEAN CpuFrequencyBaseline; // CpuFrequencyHits holds a previous sample
+static BOOLEAN CpuFrequencyValid;
+static DOUBLE CpuFrequencyFraction; // average effective frequency as a fraction of the maximum
+static PULONG64 CpuFrequencyHits; // hit counts from the previous sample, two states per processor
+static PFLOAT CpuFrequencyFractions;
+static PPH_CIRCULAR_BUFFER_FLOAT CpusFrequencyHistory; // MHz, one item per frequency sample
 static PH_UINT32_DELTA ContextSwitchesDelta;
 static PH_UINT32_DELTA InterruptsDelta;
 static PH_UINT64_DELTA DpcsDelta;
 static PH_UINT32_DELTA SystemCallsDelta;
 
 static PPH_SYSINFO_SECTION MemorySection;
+static PPH_SETTING ShowCommitInSummarySetting;
 static HWND MemoryDialog;
 static PH_LAYOUT_MANAGER MemoryLayoutManager;
 static RECT MemoryGraphMargin;
@@ -430,6 +444,7 @@ VOID PhSipOnShowWindow(
 
     CpuSection = PhSipCreateInternalSection(L"CPU", 0, PhSipCpuSectionCallback);
     MemorySection = PhSipCreateInternalSection(L"Memory", 0, PhSipMemorySectionCallback);
+    ShowCommitInSummarySetting = PhGetSettingHandle(L"ShowCommitInSummary");
     IoSection = PhSipCreateInternalSection(L"I/O", 0, PhSipIoSectionCallback);
 
     if (PhPluginsEnabled)
@@ -1989,12 +2004,13 @@ BOOLEAN PhSipCpuSectionCallback(
 
             drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
             Section->Parameters->ColorSetupFunction(drawInfo, PhCsColorCpuKernel, PhCsColorCpuUser);
-            PhGetDrawInfoGraphBuffers(&Section->GraphState.Buffers, drawInfo, PhCpuKernelHistory.Count);
+            PhGetDrawInfoGraphBuffers(&Section->GraphState.Buffers, drawInfo,
+                PhGetCountCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier));
 
             if (!Section->GraphState.Valid)
             {
-                PhCopyCircularBuffer_FLOAT(&PhCpuKernelHistory, Section->GraphState.Data1, drawInfo->LineDataCount);
-                PhCopyCircularBuffer_FLOAT(&PhCpuUserHistory, Section->GraphState.Data2, drawInfo->LineDataCount);
+                PhCopySystemGraphSamples(SystemGraphCpuKernel, drawInfo->LineDataCount, Section->GraphState.Data1);
+                PhCopySystemGraphSamples(SystemGraphCpuUser, drawInfo->LineDataCount, Section->GraphState.Data2);
                 Section->GraphState.Valid = TRUE;
             }
         }
@@ -2005,8 +2021,8 @@ BOOLEAN PhSipCpuSectionCallback(
             FLOAT cpuKernel;
             FLOAT cpuUser;
 
-            cpuKernel = PhGetItemCircularBuffer_FLOAT(&PhCpuKernelHistory, getTooltipText->Index);
-            cpuUser = PhGetItemCircularBuffer_FLOAT(&PhCpuUserHistory, getTooltipText->Index);
+            cpuKernel = PhGetItemCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier, getTooltipText->Index, NULL, NULL);
+            cpuUser = PhGetItemCircularBufferTiered_FLOAT(&PhCpuUserHistory, &PhCpuUserHistoryTier, getTooltipText->Index, NULL, NULL);
 
             PhMoveReference(&Section->GraphState.TooltipText, PhFormatString(
                 L"%.2f%%%s\n%s",
@@ -2041,11 +2057,12 @@ VOID PhSipInitializeCpuDialog(
     PhInitializeDelta(&DpcsDelta);
     PhInitializeDelta(&SystemCallsDelta);
 
-    NumberOfProcessors = (ULONG)PhSystemBasicInformation.NumberOfProcessors;
+    NumberOfProcessors = PhNumberOfProcessors;
+    NumberOfGroupProcessors = (ULONG)PhSystemBasicInformation.NumberOfProcessors;
     CpusGraphHandle = PhAllocate(sizeof(HWND) * NumberOfProcessors);
     CpusGraphState = PhAllocate(sizeof(PH_GRAPH_STATE) * NumberOfProcessors);
-    InterruptInformation = PhAllocate(sizeof(SYSTEM_INTERRUPT_INFORMATION) * NumberOfProcessors);
-    PowerInformation = PhAllocate(sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfProcessors);
+    InterruptInformation = PhAllocate(sizeof(SYSTEM_INTERRUPT_INFORMATION) * NumberOfGroupProcessors);
+    PowerInformation = PhAllocate(sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfGroupProcessors);
 
     PhInitializeGraphState(&CpuGraphState);
 
@@ -2054,22 +2071,23 @@ VOID PhSipInitializeCpuDialog(
 
     CpuTicked = 0;
 
-    if (!NT_SUCCESS(NtPowerInformation(
-        ProcessorInformation,
-        NULL,
-        0,
-        PowerInformation,
-        sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfProcessors
-        )))
-    {
-        memset(PowerInformation, 0, sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfProcessors);
-    }
+    CpuFrequencyInterval = PhGetIntegerSetting(L"SysInfoWindowCpuFrequencyInterval");
 
-    CurrentPerformanceDistribution = NULL;
-    PreviousPerformanceDistribution = NULL;
+    if (CpuFrequencyInterval == 0)
+        CpuFrequencyInterval = 1;
 
-    if (WindowsVersion >= WINDOWS_7)
-        PhSipQueryProcessorPerformanceDistribution(&CurrentPerformanceDistribution);
+    CpuFrequencyTicks = 0;
+    CpuFrequencyBaseline = FALSE;
+    CpuFrequencyValid = FALSE;
+    CpuFrequencyHits = PhAllocate(sizeof(ULONG64) * 2 * NumberOfGroupProcessors);
+    CpuFrequencyFractions = PhAllocate(sizeof(FLOAT) * NumberOfGroupProcessors);
+    CpusFrequencyHistory = PhAllocate(sizeof(PH_CIRCULAR_BUFFER_FLOAT) * NumberOfGroupProcessors);
+    memset(CpuFrequencyFractions, 0, sizeof(FLOAT) * NumberOfGroupProcessors);
+
+    for (i = 0; i < NumberOfGroupProcessors; i++)
+        PhInitializeCircularBuffer_FLOAT(&CpusFrequencyHistory[i], PhStatisticsSampleCount);
+
+    PhSipSampleCpuFrequency();
 }
 
 VOID PhSipUninitializeCpuDialog(
@@ -2088,10 +2106,20 @@ VOID PhSipUninitializeCpuDialog(
     PhFree(InterruptInformation);
     PhFree(PowerInformation);
 
-    if (CurrentPerformanceDistribution)
-        PhFree(CurrentPerformanceDistribution);
-    if (PreviousPerformanceDistribution)
-        PhFree(PreviousPerformanceDistribution);
+    if (CpuHeatmapBits)
+    {
+        PhFree(CpuHeatmapBits);
+        PhFree(CpuHeatmapRows);
+        CpuHeatmapBits = NULL;
+        CpuHeatmapRows = NULL;
+    }
+
+    for (i = 0; i < NumberOfGroupProcessors; i++)
+        PhDeleteCircularBuffer_FLOAT(&CpusFrequencyHistory[i]);
+
+    PhFree(CpusFrequencyHistory);
+    PhFree(CpuFrequencyFractions);
+    PhFree(CpuFrequencyHits);
 
     PhSetIntegerSetting(L"SysInfoWindowOneGraphPerCpu", OneGraphPerCpu);
 }
@@ -2108,11 +2136,11 @@ VOID PhSipTickCpuDialog(
     if (NT_SUCCESS(NtQuerySystemInformation(
         SystemInterruptInformation,
         InterruptInformation,
-        sizeof(SYSTEM_INTERRUPT_INFORMATION) * NumberOfProcessors,
+        sizeof(SYSTEM_INTERRUPT_INFORMATION) * NumberOfGroupProcessors,
         NULL
         )))
     {
-        for (i = 0; i < NumberOfProcessors; i++)
+        for (i = 0; i < NumberOfGroupProcessors; i++)
             dpcCount += InterruptInformation[i].DpcCount;
     }
 
@@ -2121,25 +2149,10 @@ VOID PhSipTickCpuDialog(
     PhUpdateDelta(&DpcsDelta, dpcCount);
     PhUpdateDelta(&SystemCallsDelta, PhPerfInformation.SystemCalls);
 
-    if (!NT_SUCCESS(NtPowerInformation(
-        ProcessorInformation,
-        NULL,
-        0,
-        PowerInformation,
-        sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfProcessors
-        )))
-    {
-        memset(PowerInformation, 0, sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfProcessors);
-    }
-
-    if (WindowsVersion >= WINDOWS_7)
+    if (++CpuFrequencyTicks >= CpuFrequencyInterval)
     {
-        if (PreviousPerformanceDistribution)
-            PhFree(PreviousPerformanceDistribution);
-
-        PreviousPerformanceDistribution = CurrentPerformanceDistribution;
-        CurrentPerformanceDistribution = NULL;
-        PhSipQueryProcessorPerformanceDistribution(&CurrentPerformanceDistribution);
+        PhSipSampleCpuFrequency();
+        CpuFrequencyTicks = 0;
     }
 
     CpuTicked++;
@@ -2147,6 +2160,9 @@ VOID PhSipTickCpuDialog(
     if (CpuTicked > 2)
         CpuTicked = 2;
 
+    if (CpuHeatmapBits)
+        PhSipAddCpuHeatmapColumn();
+
     PhSipUpdateCpuGraphs();
     PhSipUpdateCpuPanel();
 }
@@ -2297,6 +2313,15 @@ VOID PhSipCreateCpuGraphs(
         );
     Graph_SetTooltip(CpuGraphHandle, TRUE);
 
+    memset(CpusGraphHandle, 0, sizeof(HWND) * NumberOfProcessors);
+    CpuHeatmapEnabled = NumberOfProcessors >= PhGetIntegerSetting(L"SysInfoWindowCpuHeatmapThreshold");
+
+    if (CpuHeatmapEnabled)
+    {
+        PhSipCreateCpuHeatmap();
+        return;
+    }
+
     for (i = 0; i < NumberOfProcessors; i++)
     {
         CpusGraphHandle[i] = CreateWindow(
@@ -2324,13 +2349,13 @@ VOID PhSipLayoutCpuGraphs(
     HDWP deferHandle;
 
     GetClientRect(CpuDialog, &clientRect);
-    deferHandle = BeginDeferWindowPos(OneGraphPerCpu ? NumberOfProcessors : 1);
+    deferHandle = BeginDeferWindowPos(OneGraphPerCpu && !CpuHeatmapEnabled ? NumberOfProcessors : 1);
 
-    if (!OneGraphPerCpu)
+    if (!OneGraphPerCpu || CpuHeatmapEnabled)
     {
         deferHandle = DeferWindowPos(
             deferHandle,
-            CpuGraphHandle,
+            !OneGraphPerCpu ? CpuGraphHandle : CpuHeatmapHandle,
             NULL,
             CpuGraphMargin.left,
             CpuGraphMargin.top,
@@ -2418,12 +2443,264 @@ VOID PhSipSetOneGraphPerCpu(
 
     ShowWindow(CpuGraphHandle, !OneGraphPerCpu ? SW_SHOW : SW_HIDE);
 
+    if (CpuHeatmapEnabled)
+    {
+        ShowWindow(CpuHeatmapHandle, OneGraphPerCpu ? SW_SHOW : SW_HIDE);
+        return;
+    }
+
     for (i = 0; i < NumberOfProcessors; i++)
     {
         ShowWindow(CpusGraphHandle[i], OneGraphPerCpu ? SW_SHOW : SW_HIDE);
     }
 }
 
+/**
+ * Creates the heatmap which replaces the per-CPU graphs on systems with many processors.
+ *
+ * \remarks Each processor is a row and each sample is a column, with the newest sample on
+ * the right. Processors are grouped by NUMA node and processor group.
+ */
+VOID PhSipCreateCpuHeatmap(
+    VOID
+    )
+{
+    static BOOLEAN classRegistered = FALSE;
+    ULONG node;
+    ULONG previous;
+    PFLOAT kernelData;
+    PFLOAT userData;
+    ULONG row;
+    ULONG i;
+    ULONG j;
+
+    if (!classRegistered)
+    {
+        WNDCLASSEX wcex;
+
+        memset(&wcex, 0, sizeof(WNDCLASSEX));
+        wcex.cbSize = sizeof(WNDCLASSEX);
+        wcex.style = 0;
+        wcex.lpfnWndProc = PhSipCpuHeatmapWndProc;
+        wcex.hInstance = PhInstanceHandle;
+        wcex.hCursor = LoadCursor(NULL, IDC_ARROW);
+        wcex.lpszClassName = PH_SYSINFO_CPU_HEATMAP_CLASSNAME;
+        RegisterClassEx(&wcex);
+
+        classRegistered = TRUE;
+    }
+
+    // Order the processors by NUMA node, then by group. A separator row is placed wherever
+    // the node or the group changes.
+
+    CpuHeatmapRows = PhAllocate(sizeof(ULONG) * NumberOfProcessors * 2);
+    CpuHeatmapHeight = 0;
+    previous = -1;
+
+    for (node = 0; node < PhNumberOfNumaNodes; node++)
+    {
+        for (i = 0; i < NumberOfProcessors; i++)
+        {
+            if (PhProcessorLocations[i].Node != node)
+                continue;
+
+            if (previous != -1 && (
+                PhProcessorLocations[previous].Node != node ||
+                PhProcessorLocations[previous].Group != PhProcessorLocations[i].Group
+                ))
+            {
+                CpuHeatmapRows[CpuHeatmapHeight++] = -1;
+            }
+
+            CpuHeatmapRows[CpuHeatmapHeight++] = i;
+            previous = i;
+        }
+    }
+
+    // Fill the bitmap from the existing history.
+
+    CpuHeatmapWidth = PhStatisticsSampleCount;
+    CpuHeatmapBits = PhAllocate(sizeof(ULONG) * CpuHeatmapWidth * CpuHeatmapHeight);
+    kernelData = PhAllocate(sizeof(FLOAT) * CpuHeatmapWidth);
+    userData = PhAllocate(sizeof(FLOAT) * CpuHeatmapWidth);
+
+    for (row = 0; row < CpuHeatmapHeight; row++)
+    {
+        PULONG rowBits = CpuHeatmapBits + row * CpuHeatmapWidth;
+
+        i = CpuHeatmapRows[row];
+
+        if (i == -1)
+        {
+            for (j = 0; j < CpuHeatmapWidth; j++)
+                rowBits[j] = PhSipGetCpuHeatmapPixel(-1, 0);
+
+            continue;
+        }
+
+        memset(kernelData, 0, sizeof(FLOAT) * CpuHeatmapWidth);
+        memset(userData, 0, sizeof(FLOAT) * CpuHeatmapWidth);
+        PhCopyCircularBufferTiered_FLOAT(&PhCpusKernelHistory[i], &PhCpusKernelHistoryTier[i], kernelData, CpuHeatmapWidth);
+        PhCopyCircularBufferTiered_FLOAT(&PhCpusUserHistory[i], &PhCpusUserHistoryTier[i], userData, CpuHeatmapWidth);
+
+        // The history is newest first, but the newest column is on the right.
+        for (j = 0; j < CpuHeatmapWidth; j++)
+            rowBits[CpuHeatmapWidth - j - 1] = PhSipGetCpuHeatmapPixel(kernelData[j], userData[j]);
+    }
+
+    PhFree(kernelData);
+    PhFree(userData);
+
+    CpuHeatmapHandle = CreateWindow(
+        PH_SYSINFO_CPU_HEATMAP_CLASSNAME,
+        NULL,
+        WS_CHILD | WS_BORDER,
+        0,
+        0,
+        3,
+        3,
+        CpuDialog,
+        NULL,
+        PhInstanceHandle,
+        NULL
+        );
+}
+
+/**
+ * Scrolls the heatmap left by one column and writes the latest sample for each processor.
+ */
+VOID PhSipAddCpuHeatmapColumn(
+    VOID
+    )
+{
+    ULONG row;
+
+    for (row = 0; row < CpuHeatmapHeight; row++)
+    {
+        PULONG rowBits = CpuHeatmapBits + row * CpuHeatmapWidth;
+        ULONG i = CpuHeatmapRows[row];
+
+        memmove(rowBits, rowBits + 1, sizeof(ULONG) * (CpuHeatmapWidth - 1));
+
+        if (i != -1)
+            rowBits[CpuHeatmapWidth - 1] = PhSipGetCpuHeatmapPixel(PhCpusKernelUsage[i], PhCpusUserUsage[i]);
+        else
+            rowBits[CpuHeatmapWidth - 1] = PhSipGetCpuHeatmapPixel(-1, 0);
+    }
+}
+
+/**
+ * Gets the heatmap pixel for a sample.
+ *
+ * \param Kernel The kernel CPU usage, or -1 for a separator pixel.
+ * \param User The user CPU usage.
+ *
+ * \return A pixel in the 0x00RRGGBB format used by 32bpp DIBs. The brightness follows the
+ * total usage and the hue moves from the user color to the kernel color as the kernel share
+ * grows.
+ */
+ULONG PhSipGetCpuHeatmapPixel(
+    _In_ FLOAT Kernel,
+    _In_ FLOAT User
+    )
+{
+    FLOAT total;
+    FLOAT kernelShare;
+    ULONG color;
+    ULONG r;
+    ULONG g;
+    ULONG b;
+
+    if (Kernel < 0)
+        return 0x808080;
+
+    total = Kernel + User;
+
+    if (total <= 0)
+        return 0;
+    if (total > 1)
+        total = 1;
+
+    kernelShare = Kernel / (Kernel + User);
+
+    color = PhCsColorCpuKernel;
+    r = (ULONG)(GetRValue(color) * kernelShare);
+    g = (ULONG)(GetGValue(color) * kernelShare);
+    b = (ULONG)(GetBValue(color) * kernelShare);
+
+    color = PhCsColorCpuUser;
+    r += (ULONG)(GetRValue(color) * (1 - kernelShare));
+    g += (ULONG)(GetGValue(color) * (1 - kernelShare));
+    b += (ULONG)(GetBValue(color) * (1 - kernelShare));
+
+    r = (ULONG)(r * total);
+    g = (ULONG)(g * total);
+    b = (ULONG)(b * total);
+
+    return (min(r, 0xff) << 16) | (min(g, 0xff) << 8) | min(b, 0xff);
+}
+
+LRESULT CALLBACK PhSipCpuHeatmapWndProc(
+    _In_ HWND hwnd,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    switch (uMsg)
+    {
+    case WM_ERASEBKGND:
+        return 1;
+    case WM_PAINT:
+        {
+            PAINTSTRUCT paintStruct;
+            RECT clientRect;
+            BITMAPINFO bitmapInfo;
+            HDC hdc;
+
+            hdc = BeginPaint(hwnd, &paintStruct);
+            GetClientRect(hwnd, &clientRect);
+
+            if (CpuHeatmapBits)
+            {
+                memset(&bitmapInfo, 0, sizeof(BITMAPINFO));
+                bitmapInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+                bitmapInfo.bmiHeader.biWidth = CpuHeatmapWidth;
+                bitmapInfo.bmiHeader.biHeight = -(LONG)CpuHeatmapHeight;
+                bitmapInfo.bmiHeader.biPlanes = 1;
+                bitmapInfo.bmiHeader.biBitCount = 32;
+                bitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+                SetStretchBltMode(hdc, COLORONCOLOR);
+                StretchDIBits(
+                    hdc,
+                    0,
+                    0,
+                    clientRect.right,
+                    clientRect.bottom,
+                    0,
+                    0,
+                    CpuHeatmapWidth,
+                    CpuHeatmapHeight,
+                    CpuHeatmapBits,
+                    &bitmapInfo,
+                    DIB_RGB_COLORS,
+                    SRCCOPY
+                    );
+            }
+            else
+            {
+                FillRect(hdc, &clientRect, GetStockObject(BLACK_BRUSH));
+            }
+
+            EndPaint(hwnd, &paintStruct);
+        }
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
 VOID PhSipNotifyCpuGraph(
     _In_ ULONG Index,
     _In_ NMHDR *Header
@@ -2444,13 +2721,13 @@ VOID PhSipNotifyCpuGraph(
                 PhGraphStateGetDrawInfo(
                     &CpuGraphState,
                     getDrawInfo,
-                    PhCpuKernelHistory.Count
+                    PhGetCountCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier)
                     );
 
                 if (!CpuGraphState.Valid)
                 {
-                    PhCopyCircularBuffer_FLOAT(&PhCpuKernelHistory, CpuGraphState.Data1, drawInfo->LineDataCount);
-                    PhCopyCircularBuffer_FLOAT(&PhCpuUserHistory, CpuGraphState.Data2, drawInfo->LineDataCount);
+                    PhCopySystemGraphSamples(SystemGraphCpuKernel, drawInfo->LineDataCount, CpuGraphState.Data1);
+                    PhCopySystemGraphSamples(SystemGraphCpuUser, drawInfo->LineDataCount, CpuGraphState.Data2);
                     CpuGraphState.Valid = TRUE;
                 }
             }
@@ -2459,13 +2736,13 @@ VOID PhSipNotifyCpuGraph(
                 PhGraphStateGetDrawInfo(
                     &CpusGraphState[Index],
                     getDrawInfo,
-                    PhCpuKernelHistory.Count
+                    PhGetCountCircularBufferTiered_FLOAT(&PhCpusKernelHistory[Index], &PhCpusKernelHistoryTier[Index])
                     );
 
                 if (!CpusGraphState[Index].Valid)
                 {
-                    PhCopyCircularBuffer_FLOAT(&PhCpusKernelHistory[Index], CpusGraphState[Index].Data1, drawInfo->LineDataCount);
-                    PhCopyCircularBuffer_FLOAT(&PhCpusUserHistory[Index], CpusGraphState[Index].Data2, drawInfo->LineDataCount);
+                    PhCopyCircularBufferTiered_FLOAT(&PhCpusKernelHistory[Index], &PhCpusKernelHistoryTier[Index], CpusGraphState[Index].Data1, drawInfo->LineDataCount);
+                    PhCopyCircularBufferTiered_FLOAT(&PhCpusUserHistory[Index], &PhCpusUserHistoryTier[Index], CpusGraphState[Index].Data2, drawInfo->LineDataCount);
                     CpusGraphState[Index].Valid = TRUE;
                 }
             }
@@ -2484,8 +2761,8 @@ VOID PhSipNotifyCpuGraph(
                         FLOAT cpuKernel;
                         FLOAT cpuUser;
 
-                        cpuKernel = PhGetItemCircularBuffer_FLOAT(&PhCpuKernelHistory, getTooltipText->Index);
-                        cpuUser = PhGetItemCircularBuffer_FLOAT(&PhCpuUserHistory, getTooltipText->Index);
+                        cpuKernel = PhGetItemCircularBufferTiered_FLOAT(&PhCpuKernelHistory, &PhCpuKernelHistoryTier, getTooltipText->Index, NULL, NULL);
+                        cpuUser = PhGetItemCircularBufferTiered_FLOAT(&PhCpuUserHistory, &PhCpuUserHistoryTier, getTooltipText->Index, NULL, NULL);
 
                         PhMoveReference(&CpuGraphState.TooltipText, PhFormatString(
                             L"%.2f%%%s\n%s",
@@ -2504,8 +2781,8 @@ VOID PhSipNotifyCpuGraph(
                         FLOAT cpuKernel;
                         FLOAT cpuUser;
 
-                        cpuKernel = PhGetItemCircularBuffer_FLOAT(&PhCpusKernelHistory[Index], getTooltipText->Index);
-                        cpuUser = PhGetItemCircularBuffer_FLOAT(&PhCpusUserHistory[Index], getTooltipText->Index);
+                        cpuKernel = PhGetItemCircularBufferTiered_FLOAT(&PhCpusKernelHistory[Index], &PhCpusKernelHistoryTier[Index], getTooltipText->Index, NULL, NULL);
+                        cpuUser = PhGetItemCircularBufferTiered_FLOAT(&PhCpusUserHistory[Index], &PhCpusUserHistoryTier[Index], getTooltipText->Index, NULL, NULL);
 
                         PhMoveReference(&CpusGraphState[Index].TooltipText, PhFormatString(
                             L"%.2f%% (K: %.2f%%, U: %.2f%%)%s\n%s",
@@ -2515,6 +2792,31 @@ VOID PhSipNotifyCpuGraph(
                             PhGetStringOrEmpty(PhSipGetMaxCpuString(getTooltipText->Index)),
                             ((PPH_STRING)PhAutoDereferenceObject(PhGetStatisticsTimeString(NULL, getTooltipText->Index)))->Buffer
                             ));
+
+                        // Frequency samples are taken every CpuFrequencyInterval ticks.
+                        if (PhNumberOfProcessorGroups == 1 && Index < NumberOfGroupProcessors &&
+                            getTooltipText->Index / CpuFrequencyInterval < CpusFrequencyHistory[Index].Count)
+                        {
+                            PhMoveReference(&CpusGraphState[Index].TooltipText, PhFormatString(
+                                L"%s\n%.2f GHz",
+                                CpusGraphState[Index].TooltipText->Buffer,
+                                PhGetItemCircularBuffer_FLOAT(&CpusFrequencyHistory[Index], getTooltipText->Index / CpuFrequencyInterval) / 1000
+                                ));
+                        }
+
+                        if (PhNumberOfProcessorGroups > 1 || PhNumberOfNumaNodes > 1)
+                        {
+                            PPH_PROCESSOR_LOCATION location = &PhProcessorLocations[Index];
+
+                            PhMoveReference(&CpusGraphState[Index].TooltipText, PhFormatString(
+                                L"%s\nGroup %u, CPU %u, node %u (node now %.2f%%)",
+                                CpusGraphState[Index].TooltipText->Buffer,
+                                location->Group,
+                                location->Number,
+                                location->Node,
+                                (PhNodesKernelUsage[location->Node] + PhNodesUserUsage[location->Node]) * 100
+                                ));
+                        }
                     }
 
                     getTooltipText->Text = CpusGraphState[Index].TooltipText->sr;
@@ -2557,6 +2859,12 @@ VOID PhSipUpdateCpuGraphs(
     Graph_UpdateTooltip(CpuGraphHandle);
     InvalidateRect(CpuGraphHandle, NULL, FALSE);
 
+    if (CpuHeatmapEnabled)
+    {
+        InvalidateRect(CpuHeatmapHandle, NULL, FALSE);
+        return;
+    }
+
     for (i = 0; i < NumberOfProcessors; i++)
     {
         CpusGraphState[i].Valid = FALSE;
@@ -2573,27 +2881,15 @@ VOID PhSipUpdateCpuPanel(
     )
 {
     HWND hwnd = CpuPanel;
-    DOUBLE cpuFraction;
     DOUBLE cpuGhz;
-    BOOLEAN distributionSucceeded;
     SYSTEM_TIMEOFDAY_INFORMATION timeOfDayInfo;
     WCHAR uptimeString[PH_TIMESPAN_STR_LEN_1] = L"Unknown";
 
     SetDlgItemText(hwnd, IDC_UTILIZATION, PhaFormatString(L"%.2f%%", (PhCpuUserUsage + PhCpuKernelUsage) * 100)->Buffer);
 
-    cpuGhz = 0;
-    distributionSucceeded = FALSE;
-
-    if (WindowsVersion >= WINDOWS_7 && CurrentPerformanceDistribution && PreviousPerformanceDistribution)
-    {
-        if (PhSipGetCpuFrequencyFromDistribution(&cpuFraction))
-        {
-            cpuGhz = (DOUBLE)PowerInformation[0].MaxMhz * cpuFraction / 1000;
-            distributionSucceeded = TRUE;
-        }
-    }
-
-    if (!distributionSucceeded)
+    if (CpuFrequencyValid)
+        cpuGhz = (DOUBLE)PowerInformation[0].MaxMhz * CpuFrequencyFraction / 1000;
+    else
         cpuGhz = (DOUBLE)PowerInformation[0].CurrentMhz / 1000;
 
     SetDlgItemText(hwnd, IDC_SPEED, PhaFormatString(L"%.2f / %.2f GHz", cpuGhz, (DOUBLE)PowerInformation[0].MaxMhz / 1000)->Buffer);
@@ -2644,6 +2940,10 @@ PPH_PROCESS_RECORD PhSipReferenceMaxCpuRecord(
 
     // Find the process record for the max. CPU process for the particular time.
 
+    // The max. CPU process is not recorded in the long-term history.
+    if ((ULONG)Index >= PhMaxCpuHistory.Count)
+        return NULL;
+
     maxProcessId = PhGetItemCircularBuffer_ULONG(&PhMaxCpuHistory, Index);
 
     if (!maxProcessId)
@@ -2725,117 +3025,125 @@ VOID PhSipGetCpuBrandString(
     BrandString[48] = 0;
 }
 
-BOOLEAN PhSipGetCpuFrequencyFromDistribution(
-    _Out_ DOUBLE *Fraction
+/**
+ * Samples the power information and the effective frequency of each processor.
+ *
+ * \remarks This runs every SysInfoWindowCpuFrequencyInterval ticks. Hit counts from the
+ * previous sample are kept so that only the current distribution needs to be queried.
+ */
+VOID PhSipSampleCpuFrequency(
+    VOID
     )
 {
-    ULONG stateSize;
-    PVOID differences;
+    PSYSTEM_PROCESSOR_PERFORMANCE_DISTRIBUTION distribution;
     PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION stateDistribution;
-    PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION stateDifference;
     PSYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT_WIN8 hitcountOld;
+    ULONG64 hits;
+    ULONG percentFrequency;
     ULONG i;
     ULONG j;
     DOUBLE count;
     DOUBLE total;
+    DOUBLE processorCount;
+    DOUBLE processorTotal;
 
-    // Calculate the differences from the last performance distribution.
+    if (!NT_SUCCESS(NtPowerInformation(
+        ProcessorInformation,
+        NULL,
+        0,
+        PowerInformation,
+        sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfGroupProcessors
+        )))
+    {
+        memset(PowerInformation, 0, sizeof(PROCESSOR_POWER_INFORMATION) * NumberOfGroupProcessors);
+    }
 
-    if (CurrentPerformanceDistribution->ProcessorCount != NumberOfProcessors || PreviousPerformanceDistribution->ProcessorCount != NumberOfProcessors)
-        return FALSE;
+    CpuFrequencyValid = FALSE;
 
-    stateSize = FIELD_OFFSET(SYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION, States) + sizeof(SYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT) * 2;
-    differences = PhAllocate(stateSize * NumberOfProcessors);
+    if (WindowsVersion < WINDOWS_7)
+        return;
+    if (!NT_SUCCESS(PhSipQueryProcessorPerformanceDistribution(&distribution)))
+        return;
 
-    for (i = 0; i < NumberOfProcessors; i++)
+    if (distribution->ProcessorCount != NumberOfGroupProcessors)
     {
-        stateDistribution = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)CurrentPerformanceDistribution + CurrentPerformanceDistribution->Offsets[i]);
-        stateDifference = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)differences + stateSize * i);
-
-        if (stateDistribution->StateCount != 2)
-        {
-            PhFree(differences);
-            return FALSE;
-        }
-
-        for (j = 0; j < stateDistribution->StateCount; j++)
-        {
-            if (WindowsVersion >= WINDOWS_8_1)
-            {
-                stateDifference->States[j] = stateDistribution->States[j];
-            }
-            else
-            {
-                hitcountOld = (PSYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT_WIN8)((PCHAR)stateDistribution->States + sizeof(SYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT_WIN8) * j);
-                stateDifference->States[j].Hits.QuadPart = hitcountOld->Hits;
-                stateDifference->States[j].PercentFrequency = hitcountOld->PercentFrequency;
-            }
-        }
+        CpuFrequencyBaseline = FALSE;
+        PhFree(distribution);
+        return;
     }
 
-    for (i = 0; i < NumberOfProcessors; i++)
+    count = 0;
+    total = 0;
+
+    for (i = 0; i < NumberOfGroupProcessors; i++)
     {
-        stateDistribution = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)PreviousPerformanceDistribution + PreviousPerformanceDistribution->Offsets[i]);
-        stateDifference = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)differences + stateSize * i);
+        stateDistribution = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)distribution + distribution->Offsets[i]);
 
         if (stateDistribution->StateCount != 2)
         {
-            PhFree(differences);
-            return FALSE;
+            CpuFrequencyBaseline = FALSE;
+            PhFree(distribution);
+            return;
         }
 
-        for (j = 0; j < stateDistribution->StateCount; j++)
+        processorCount = 0;
+        processorTotal = 0;
+
+        for (j = 0; j < 2; j++)
         {
             if (WindowsVersion >= WINDOWS_8_1)
             {
-                stateDifference->States[j].Hits.QuadPart -= stateDistribution->States[j].Hits.QuadPart;
+                hits = stateDistribution->States[j].Hits.QuadPart;
+                percentFrequency = stateDistribution->States[j].PercentFrequency;
             }
             else
             {
                 hitcountOld = (PSYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT_WIN8)((PCHAR)stateDistribution->States + sizeof(SYSTEM_PROCESSOR_PERFORMANCE_HITCOUNT_WIN8) * j);
-                stateDifference->States[j].Hits.QuadPart -= hitcountOld->Hits;
+                hits = hitcountOld->Hits;
+                percentFrequency = hitcountOld->PercentFrequency;
             }
-        }
-    }
 
-    // Calculate the frequency.
+            if (CpuFrequencyBaseline)
+            {
+                processorCount += (DOUBLE)(hits - CpuFrequencyHits[i * 2 + j]);
+                processorTotal += (DOUBLE)(hits - CpuFrequencyHits[i * 2 + j]) * percentFrequency;
+            }
 
-    count = 0;
-    total = 0;
+            CpuFrequencyHits[i * 2 + j] = hits;
+        }
 
-    for (i = 0; i < NumberOfProcessors; i++)
-    {
-        stateDifference = (PSYSTEM_PROCESSOR_PERFORMANCE_STATE_DISTRIBUTION)((PCHAR)differences + stateSize * i);
+        if (processorCount != 0)
+            CpuFrequencyFractions[i] = (FLOAT)(processorTotal / processorCount / 100);
 
-        for (j = 0; j < 2; j++)
-        {
-            count += (ULONGLONG)stateDifference->States[j].Hits.QuadPart;
-            total += (ULONGLONG)stateDifference->States[j].Hits.QuadPart * stateDifference->States[j].PercentFrequency;
-        }
-    }
+        if (CpuFrequencyBaseline)
+            PhAddItemCircularBuffer_FLOAT(&CpusFrequencyHistory[i], CpuFrequencyFractions[i] * PowerInformation[i].MaxMhz);
 
-    PhFree(differences);
+        count += processorCount;
+        total += processorTotal;
+    }
 
-    if (count == 0)
-        return FALSE;
+    PhFree(distribution);
 
-    total /= count;
-    total /= 100;
-    *Fraction = total;
+    if (CpuFrequencyBaseline && count != 0)
+    {
+        CpuFrequencyFraction = total / count / 100;
+        CpuFrequencyValid = TRUE;
+    }
 
-    return TRUE;
+    CpuFrequencyBaseline = TRUE;
 }
 
 NTSTATUS PhSipQueryProcessorPerformanceDistribution(
     _Out_ PVOID *Buffer
     )
 {
+    static ULONG initialBufferSize = 0x100;
     NTSTATUS status;
     PVOID buffer;
     ULONG bufferSize;
     ULONG attempts;
 
-    bufferSize = 0x100;
+    bufferSize = initialBufferSize;
     buffer = PhAllocate(bufferSize);
 
     status = NtQuerySystemInformation(
@@ -2861,9 +3169,15 @@ NTSTATUS PhSipQueryProcessorPerformanceDistribution(
     }
 
     if (NT_SUCCESS(status))
+    {
+        // Remember the size so that the next sample doesn't need to retry the query.
+        initialBufferSize = bufferSize;
         *Buffer = buffer;
+    }
     else
+    {
         PhFree(buffer);
+    }
 
     return status;
 }
@@ -2906,9 +3220,8 @@ BOOLEAN PhSipMemorySectionCallback(
     case SysInfoGraphGetDrawInfo:
         {
             PPH_GRAPH_DRAW_INFO drawInfo = Parameter1;
-            ULONG i;
 
-            if (PhGetIntegerSetting(L"ShowCommitInSummary"))
+            if (PhGetIntegerSettingValue(ShowCommitInSummarySetting))
             {
                 drawInfo->Flags = PH_GRAPH_USE_GRID;
                 Section->Parameters->ColorSetupFunction(drawInfo, PhCsColorPrivate, 0);
@@ -2916,21 +3229,7 @@ BOOLEAN PhSipMemorySectionCallback(
 
                 if (!Section->GraphState.Valid)
                 {
-                    for (i = 0; i < drawInfo->LineDataCount; i++)
-                    {
-                        Section->GraphState.Data1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhCommitHistory, i);
-                    }
-
-                    if (PhPerfInformation.CommitLimit != 0)
-                    {
-                        // Scale the data.
-                        PhDivideSinglesBySingle(
-                            Section->GraphState.Data1,
-                            (FLOAT)PhPerfInformation.CommitLimit,
-                            drawInfo->LineDataCount
-                            );
-                    }
-
+                    PhCopySystemGraphSamples(SystemGraphCommit, drawInfo->LineDataCount, Section->GraphState.Data1);
                     Section->GraphState.Valid = TRUE;
                 }
             }
@@ -2942,21 +3241,7 @@ BOOLEAN PhSipMemorySectionCallback(
 
                 if (!Section->GraphState.Valid)
                 {
-                    for (i = 0; i < drawInfo->LineDataCount; i++)
-                    {
-                        Section->GraphState.Data1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhPhysicalHistory, i);
-                    }
-
-                    if (PhSystemBasicInformation.NumberOfPhysicalPages != 0)
-                    {
-                        // Scale the data.
-                        PhDivideSinglesBySingle(
-                            Section->GraphState.Data1,
-                            (FLOAT)PhSystemBasicInformation.NumberOfPhysicalPages,
-                            drawInfo->LineDataCount
-                            );
-                    }
-
+                    PhCopySystemGraphSamples(SystemGraphPhysical, drawInfo->LineDataCount, Section->GraphState.Data1);
                     Section->GraphState.Valid = TRUE;
                 }
             }
@@ -2967,7 +3252,7 @@ BOOLEAN PhSipMemorySectionCallback(
             PPH_SYSINFO_GRAPH_GET_TOOLTIP_TEXT getTooltipText = Parameter1;
             ULONG usedPages;
 
-            if (PhGetIntegerSetting(L"ShowCommitInSummary"))
+            if (PhGetIntegerSettingValue(ShowCommitInSummarySetting))
             {
                 usedPages = PhGetItemCircularBuffer_ULONG(&PhCommitHistory, getTooltipText->Index);
 
@@ -2997,7 +3282,7 @@ BOOLEAN PhSipMemorySectionCallback(
             ULONG totalPages;
             ULONG usedPages;
 
-            if (PhGetIntegerSetting(L"ShowCommitInSummary"))
+            if (PhGetIntegerSettingValue(ShowCommitInSummarySetting))
             {
                 totalPages = PhPerfInformation.CommitLimit;
                 usedPages = PhPerfInformation.CommittedPages;
@@ -3309,7 +3594,6 @@ VOID PhSipNotifyCommitGraph(
         {
             PPH_GRAPH_GETDRAWINFO getDrawInfo = (PPH_GRAPH_GETDRAWINFO)Header;
             PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
-            ULONG i;
 
             drawInfo->Flags = PH_GRAPH_USE_GRID;
             PhSiSetColorsGraphDrawInfo(drawInfo, PhCsColorPrivate, 0);
@@ -3322,21 +3606,7 @@ VOID PhSipNotifyCommitGraph(
 
             if (!CommitGraphState.Valid)
             {
-                for (i = 0; i < drawInfo->LineDataCount; i++)
-                {
-                    CommitGraphState.Data1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhCommitHistory, i);
-                }
-
-                if (PhPerfInformation.CommitLimit != 0)
-                {
-                    // Scale the data.
-                    PhDivideSinglesBySingle(
-                        CommitGraphState.Data1,
-                        (FLOAT)PhPerfInformation.CommitLimit,
-                        drawInfo->LineDataCount
-                        );
-                }
-
+                PhCopySystemGraphSamples(SystemGraphCommit, drawInfo->LineDataCount, CommitGraphState.Data1);
                 CommitGraphState.Valid = TRUE;
             }
         }
@@ -3377,7 +3647,6 @@ VOID PhSipNotifyPhysicalGraph(
         {
             PPH_GRAPH_GETDRAWINFO getDrawInfo = (PPH_GRAPH_GETDRAWINFO)Header;
             PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
-            ULONG i;
 
             drawInfo->Flags = PH_GRAPH_USE_GRID;
             PhSiSetColorsGraphDrawInfo(drawInfo, PhCsColorPhysical, 0);
@@ -3390,21 +3659,7 @@ VOID PhSipNotifyPhysicalGraph(
 
             if (!PhysicalGraphState.Valid)
             {
-                for (i = 0; i < drawInfo->LineDataCount; i++)
-                {
-                    PhysicalGraphState.Data1[i] = (FLOAT)PhGetItemCircularBuffer_ULONG(&PhPhysicalHistory, i);
-                }
-
-                if (PhSystemBasicInformation.NumberOfPhysicalPages != 0)
-                {
-                    // Scale the data.
-                    PhDivideSinglesBySingle(
-                        PhysicalGraphState.Data1,
-                        (FLOAT)PhSystemBasicInformation.NumberOfPhysicalPages,
-                        drawInfo->LineDataCount
-                        );
-                }
-
+                PhCopySystemGraphSamples(SystemGraphPhysical, drawInfo->LineDataCount, PhysicalGraphState.Data1);
                 PhysicalGraphState.Valid = TRUE;
             }
         }
@@ -3766,7 +4021,6 @@ BOOLEAN PhSipIoSectionCallback(
     case SysInfoGraphGetDrawInfo:
         {
             PPH_GRAPH_DRAW_INFO drawInfo = Parameter1;
-            ULONG i;
             FLOAT max;
 
             drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
@@ -3775,22 +4029,9 @@ BOOLEAN PhSipIoSectionCallback(
 
             if (!Section->GraphState.Valid)
             {
-                max = 0;
-
-                for (i = 0; i < drawInfo->LineDataCount; i++)
-                {
-                    FLOAT data1;
-                    FLOAT data2;
-
-                    Section->GraphState.Data1[i] = data1 =
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoReadHistory, i) +
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoOtherHistory, i);
-                    Section->GraphState.Data2[i] = data2 =
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoWriteHistory, i);
-
-                    if (max < data1 + data2)
-                        max = data1 + data2;
-                }
+                PhCopySystemGraphSamples(SystemGraphIoReadOther, drawInfo->LineDataCount, Section->GraphState.Data1);
+                PhCopySystemGraphSamples(SystemGraphIoWrite, drawInfo->LineDataCount, Section->GraphState.Data2);
+                max = PhGetSystemIoGraphMaximum(drawInfo->LineDataCount);
 
                 // Minimum scaling of 1 MB.
                 if (max < 1024 * 1024)
@@ -3991,7 +4232,6 @@ VOID PhSipNotifyIoGraph(
         {
             PPH_GRAPH_GETDRAWINFO getDrawInfo = (PPH_GRAPH_GETDRAWINFO)Header;
             PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
-            ULONG i;
 
             drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
             PhSiSetColorsGraphDrawInfo(drawInfo, PhCsColorIoReadOther, PhCsColorIoWrite);
@@ -4004,22 +4244,11 @@ VOID PhSipNotifyIoGraph(
 
             if (!IoGraphState.Valid)
             {
-                FLOAT max = 0;
+                FLOAT max;
 
-                for (i = 0; i < drawInfo->LineDataCount; i++)
-                {
-                    FLOAT data1;
-                    FLOAT data2;
-
-                    IoGraphState.Data1[i] = data1 =
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoReadHistory, i) +
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoOtherHistory, i);
-                    IoGraphState.Data2[i] = data2 =
-                        (FLOAT)PhGetItemCircularBuffer_ULONG64(&PhIoWriteHistory, i);
-
-                    if (max < data1 + data2)
-                        max = data1 + data2;
-                }
+                PhCopySystemGraphSamples(SystemGraphIoReadOther, drawInfo->LineDataCount, IoGraphState.Data1);
+                PhCopySystemGraphSamples(SystemGraphIoWrite, drawInfo->LineDataCount, IoGraphState.Data2);
+                max = PhGetSystemIoGraphMaximum(drawInfo->LineDataCount);
 
                 // Minimum scaling of 1 MB.
                 if (max < 1024 * 1024)
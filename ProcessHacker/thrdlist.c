@@ -27,14 +27,14 @@
 #include <emenu.h>
 #include <procprpp.h>
 
-BOOLEAN PhpThreadNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    );
-
-ULONG PhpThreadNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    );
+#undef T
+#undef K
+#define T PPH_THREAD_NODE
+#define K HANDLE
+#define PH_OPEN_HASHTABLE_KEY(Entry) ((Entry)->ThreadId)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_HANDLE
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_SCALAR
+#include <ohashtbl_i.h>
 
 VOID PhpDestroyThreadNode(
     _In_ PPH_THREAD_NODE ThreadNode
@@ -71,13 +71,8 @@ VOID PhInitializeThreadList(
     memset(Context, 0, sizeof(PH_THREAD_LIST_CONTEXT));
     Context->EnableStateHighlighting = TRUE;
 
-    Context->NodeHashtable = PhCreateHashtable(
-        sizeof(PPH_THREAD_NODE),
-        PhpThreadNodeHashtableCompareFunction,
-        PhpThreadNodeHashtableHashFunction,
-        100
-        );
-    Context->NodeList = PhCreateList(100);
+    PhInitializeOpenHashtable_PPH_THREAD_NODE(&Context->NodeHashtable, 100);
+    PhInitializeArray_PPH_THREAD_NODE(&Context->NodeList, 100);
 
     Context->ParentWindowHandle = ParentWindowHandle;
     Context->TreeNewHandle = TreeNewHandle;
@@ -111,29 +106,11 @@ VOID PhDeleteThreadList(
 
     PhCmDeleteManager(&Context->Cm);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
-        PhpDestroyThreadNode(Context->NodeList->Items[i]);
+    for (i = 0; i < Context->NodeList.Count; i++)
+        PhpDestroyThreadNode(Context->NodeList.Items[i]);
 
-    PhDereferenceObject(Context->NodeHashtable);
-    PhDereferenceObject(Context->NodeList);
-}
-
-BOOLEAN PhpThreadNodeHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    )
-{
-    PPH_THREAD_NODE threadNode1 = *(PPH_THREAD_NODE *)Entry1;
-    PPH_THREAD_NODE threadNode2 = *(PPH_THREAD_NODE *)Entry2;
-
-    return threadNode1->ThreadId == threadNode2->ThreadId;
-}
-
-ULONG PhpThreadNodeHashtableHashFunction(
-    _In_ PVOID Entry
-    )
-{
-    return HandleToUlong((*(PPH_THREAD_NODE *)Entry)->ThreadId) / 4;
+    PhDeleteOpenHashtable_PPH_THREAD_NODE(&Context->NodeHashtable);
+    PhDeleteArray_PPH_THREAD_NODE(&Context->NodeList);
 }
 
 VOID PhLoadSettingsThreadList(
@@ -221,8 +198,8 @@ PPH_THREAD_NODE PhAddThreadNode(
     threadNode->Node.TextCache = threadNode->TextCache;
     threadNode->Node.TextCacheSize = PHTHTLC_MAXIMUM;
 
-    PhAddEntryHashtable(Context->NodeHashtable, &threadNode);
-    PhAddItemList(Context->NodeList, threadNode);
+    PhAddEntryOpenHashtable_PPH_THREAD_NODE(&Context->NodeHashtable, threadNode, NULL);
+    PhAddItemArray_PPH_THREAD_NODE(&Context->NodeList, threadNode);
 
     PhEmCallObjectOperation(EmThreadNodeType, threadNode, EmObjectCreate);
 
@@ -236,16 +213,9 @@ PPH_THREAD_NODE PhFindThreadNode(
     _In_ HANDLE ThreadId
     )
 {
-    PH_THREAD_NODE lookupThreadNode;
-    PPH_THREAD_NODE lookupThreadNodePtr = &lookupThreadNode;
     PPH_THREAD_NODE *threadNode;
 
-    lookupThreadNode.ThreadId = ThreadId;
-
-    threadNode = (PPH_THREAD_NODE *)PhFindEntryHashtable(
-        Context->NodeHashtable,
-        &lookupThreadNodePtr
-        );
+    threadNode = PhFindEntryOpenHashtable_PPH_THREAD_NODE(&Context->NodeHashtable, ThreadId);
 
     if (threadNode)
         return *threadNode;
@@ -259,7 +229,7 @@ VOID PhRemoveThreadNode(
     )
 {
     // Remove from the hashtable here to avoid problems in case the key is re-used.
-    PhRemoveEntryHashtable(Context->NodeHashtable, &ThreadNode);
+    PhRemoveEntryOpenHashtable_PPH_THREAD_NODE(&Context->NodeHashtable, ThreadNode->ThreadId);
 
     if (Context->EnableStateHighlighting)
     {
@@ -302,8 +272,8 @@ VOID PhpRemoveThreadNode(
 
     // Remove from list and cleanup.
 
-    if ((index = PhFindItemList(Context->NodeList, ThreadNode)) != -1)
-        PhRemoveItemList(Context->NodeList, index);
+    if ((index = PhFindItemArray_PPH_THREAD_NODE(&Context->NodeList, ThreadNode)) != -1)
+        PhRemoveItemArray_PPH_THREAD_NODE(&Context->NodeList, index);
 
     PhpDestroyThreadNode(ThreadNode);
 
@@ -447,8 +417,8 @@ BOOLEAN NTAPI PhpThreadTreeNewCallback(
                 int (__cdecl *sortFunction)(void *, const void *, const void *);
 
                 if (!PhCmForwardSort(
-                    (PPH_TREENEW_NODE *)context->NodeList->Items,
-                    context->NodeList->Count,
+                    (PPH_TREENEW_NODE *)context->NodeList.Items,
+                    context->NodeList.Count,
                     context->TreeNewSortColumn,
                     context->TreeNewSortOrder,
                     &context->Cm
@@ -466,11 +436,11 @@ BOOLEAN NTAPI PhpThreadTreeNewCallback(
 
                 if (sortFunction)
                 {
-                    qsort_s(context->NodeList->Items, context->NodeList->Count, sizeof(PVOID), sortFunction, context);
+                    qsort_s(context->NodeList.Items, context->NodeList.Count, sizeof(PPH_THREAD_NODE), sortFunction, context);
                 }
 
-                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList->Items;
-                getChildren->NumberOfChildren = context->NodeList->Count;
+                getChildren->Children = (PPH_TREENEW_NODE *)context->NodeList.Items;
+                getChildren->NumberOfChildren = context->NodeList.Count;
             }
         }
         return TRUE;
@@ -502,12 +472,9 @@ BOOLEAN NTAPI PhpThreadTreeNewCallback(
 
                     if (cpuUsage >= 0.01)
                     {
-                        PH_FORMAT format;
                         SIZE_T returnLength;
 
-                        PhInitFormatF(&format, cpuUsage, 2);
-
-                        if (PhFormatToBuffer(&format, 1, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
+                        if (PhFormatFixedToBuffer(cpuUsage, 2, node->CpuUsageText, sizeof(node->CpuUsageText), &returnLength))
                         {
                             getCellText->Text.Buffer = node->CpuUsageText;
                             getCellText->Text.Length = returnLength - sizeof(WCHAR); // minus null terminator
@@ -552,7 +519,13 @@ BOOLEAN NTAPI PhpThreadTreeNewCallback(
                 getCellText->Text = PhGetStringRef(node->StartAddressText);
                 break;
             case PHTHTLC_PRIORITY:
-                PhMoveReference(&node->PriorityText, PhGetThreadPriorityWin32String(threadItem->PriorityWin32));
+                // Only visible rows get here, and the string only needs to change with the priority.
+                if (!node->PriorityText || node->PriorityTextWin32 != threadItem->PriorityWin32)
+                {
+                    PhMoveReference(&node->PriorityText, PhGetThreadPriorityWin32String(threadItem->PriorityWin32));
+                    node->PriorityTextWin32 = threadItem->PriorityWin32;
+                }
+
                 getCellText->Text = PhGetStringRef(node->PriorityText);
                 break;
             case PHTHTLC_SERVICE:
@@ -673,9 +646,9 @@ PPH_THREAD_ITEM PhGetSelectedThreadItem(
     PPH_THREAD_ITEM threadItem = NULL;
     ULONG i;
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_THREAD_NODE node = Context->NodeList->Items[i];
+        PPH_THREAD_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
@@ -698,9 +671,9 @@ VOID PhGetSelectedThreadItems(
 
     list = PhCreateList(2);
 
-    for (i = 0; i < Context->NodeList->Count; i++)
+    for (i = 0; i < Context->NodeList.Count; i++)
     {
-        PPH_THREAD_NODE node = Context->NodeList->Items[i];
+        PPH_THREAD_NODE node = Context->NodeList.Items[i];
 
         if (node->Node.Selected)
         {
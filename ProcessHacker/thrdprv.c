@@ -51,6 +51,7 @@ typedef struct _PH_THREAD_SYMBOL_LOAD_CONTEXT
     HANDLE ProcessId;
     PPH_THREAD_PROVIDER ThreadProvider;
     PPH_SYMBOL_PROVIDER SymbolProvider;
+    ULONG64 Address;
 } PH_THREAD_SYMBOL_LOAD_CONTEXT, *PPH_THREAD_SYMBOL_LOAD_CONTEXT;
 
 VOID NTAPI PhpThreadProviderDeleteProcedure(
@@ -63,15 +64,6 @@ VOID NTAPI PhpThreadItemDeleteProcedure(
     _In_ ULONG Flags
     );
 
-BOOLEAN NTAPI PhpThreadHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    );
-
-ULONG NTAPI PhpThreadHashtableHashFunction(
-    _In_ PVOID Entry
-    );
-
 VOID PhpThreadProviderCallbackHandler(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -124,12 +116,7 @@ PPH_THREAD_PROVIDER PhCreateThreadProvider(
         );
     memset(threadProvider, 0, sizeof(PH_THREAD_PROVIDER));
 
-    threadProvider->ThreadHashtable = PhCreateHashtable(
-        sizeof(PPH_THREAD_ITEM),
-        PhpThreadHashtableCompareFunction,
-        PhpThreadHashtableHashFunction,
-        20
-        );
+    PhInitializeOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable, 20);
     PhInitializeFastLock(&threadProvider->ThreadHashtableLock);
 
     PhInitializeCallback(&threadProvider->ThreadAddedEvent);
@@ -145,6 +132,9 @@ PPH_THREAD_PROVIDER PhCreateThreadProvider(
     {
         if (threadProvider->SymbolProvider->IsRealHandle)
             threadProvider->ProcessHandle = threadProvider->SymbolProvider->ProcessHandle;
+
+        // Start addresses are resolved from several query workers at once.
+        threadProvider->SymbolProvider->Flags |= PH_SYMBOL_PROVIDER_SYMBOL_TABLES;
     }
 
     RtlInitializeSListHead(&threadProvider->QueryListHead);
@@ -152,6 +142,7 @@ PPH_THREAD_PROVIDER PhCreateThreadProvider(
 
     threadProvider->RunId = 1;
     threadProvider->SymbolsLoadedRunId = 0; // Force symbols to be loaded the first time we try to resolve an address
+    PhInitializeInitOnce(&threadProvider->SymbolsPriorityInitOnce);
 
     PhEmCallObjectOperation(EmThreadProviderType, threadProvider, EmObjectCreate);
 
@@ -171,7 +162,7 @@ VOID PhpThreadProviderDeleteProcedure(
     // when we added them to the hashtable).
     PhDereferenceAllThreadItems(threadProvider);
 
-    PhDereferenceObject(threadProvider->ThreadHashtable);
+    PhDeleteOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable);
     PhDeleteFastLock(&threadProvider->ThreadHashtableLock);
     PhDeleteCallback(&threadProvider->ThreadAddedEvent);
     PhDeleteCallback(&threadProvider->ThreadModifiedEvent);
@@ -375,6 +366,123 @@ VOID PhLoadSymbolsThreadProvider(
     PhReleaseQueuedLockExclusive(&ThreadProvider->LoadSymbolsLock);
 }
 
+static BOOLEAN LoadPrioritySymbolsEnumGenericModulesCallback(
+    _In_ PPH_MODULE_INFO Module,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_THREAD_SYMBOL_LOAD_CONTEXT context = Context;
+
+    if (context->ThreadProvider->Terminating)
+        return FALSE;
+
+    if (context->Address >= (ULONG64)Module->BaseAddress &&
+        context->Address < (ULONG64)Module->BaseAddress + Module->Size)
+    {
+        PhLoadModuleSymbolProvider(
+            context->SymbolProvider,
+            Module->FileName->Buffer,
+            (ULONG64)Module->BaseAddress,
+            Module->Size
+            );
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+NTSTATUS PhpThreadSymbolsLoadWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_THREAD_PROVIDER threadProvider = Parameter;
+
+    if (_InterlockedIncrement(&threadProvider->SymbolsLoading) == 1)
+        PhInvokeCallback(&threadProvider->LoadingStateChangedEvent, (PVOID)TRUE);
+
+    PhLoadSymbolsThreadProvider(threadProvider);
+
+    // Start addresses are resolved one at a time, so download their PDBs in parallel first.
+    if (!threadProvider->Terminating)
+        PhPrefetchSymbolProvider(threadProvider->SymbolProvider, PH_SYMBOL_PREFETCH_DEFAULT_CONCURRENCY, NULL, NULL);
+
+    if (_InterlockedDecrement(&threadProvider->SymbolsLoading) == 0)
+        PhInvokeCallback(&threadProvider->LoadingStateChangedEvent, (PVOID)FALSE);
+
+    // Start addresses resolved before their module was loaded are queried again on the next
+    // update.
+    threadProvider->SymbolsRequeryPending = TRUE;
+    PhDereferenceObject(threadProvider);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Loads symbols for the module containing an address, and queues the loading of symbols for
+ * all other modules in the background.
+ *
+ * \param ThreadProvider The thread provider.
+ * \param Address The address being resolved.
+ */
+VOID PhpLoadPrioritySymbolsThreadProvider(
+    _In_ PPH_THREAD_PROVIDER ThreadProvider,
+    _In_ ULONG64 Address
+    )
+{
+    PH_THREAD_SYMBOL_LOAD_CONTEXT loadContext;
+
+    if (ThreadProvider->ProcessId == SYSTEM_IDLE_PROCESS_ID ||
+        !(ThreadProvider->SymbolProvider->IsRealHandle || ThreadProvider->ProcessId == SYSTEM_PROCESS_ID))
+    {
+        // Only a few modules are loaded in these cases.
+        PhLoadSymbolsThreadProvider(ThreadProvider);
+        return;
+    }
+
+    if (PhBeginInitOnce(&ThreadProvider->SymbolsPriorityInitOnce))
+    {
+        PhLoadSymbolProviderOptions(ThreadProvider->SymbolProvider);
+
+        PhReferenceObject(ThreadProvider);
+        PhQueueItemGlobalWorkQueue(PhpThreadSymbolsLoadWorker, ThreadProvider);
+
+        PhEndInitOnce(&ThreadProvider->SymbolsPriorityInitOnce);
+    }
+
+    // Don't wait on LoadSymbolsLock here; the background load holds it until every module is
+    // loaded. PhLoadModuleSymbolProvider ignores modules that are already loaded.
+    if (ThreadProvider->SymbolsLoadedRunId != 0 || PhGetModuleFromAddress(ThreadProvider->SymbolProvider, Address, NULL))
+        return;
+
+    loadContext.ThreadProvider = ThreadProvider;
+    loadContext.SymbolProvider = ThreadProvider->SymbolProvider;
+    loadContext.Address = Address;
+
+    if (ThreadProvider->ProcessId != SYSTEM_PROCESS_ID && Address > PhSystemBasicInformation.MaximumUserModeAddress)
+    {
+        loadContext.ProcessId = SYSTEM_PROCESS_ID;
+        PhEnumGenericModules(
+            SYSTEM_PROCESS_ID,
+            NULL,
+            0,
+            LoadPrioritySymbolsEnumGenericModulesCallback,
+            &loadContext
+            );
+    }
+    else
+    {
+        loadContext.ProcessId = ThreadProvider->ProcessId;
+        PhEnumGenericModules(
+            ThreadProvider->ProcessId,
+            ThreadProvider->SymbolProvider->ProcessHandle,
+            0,
+            LoadPrioritySymbolsEnumGenericModulesCallback,
+            &loadContext
+            );
+    }
+}
+
 PPH_THREAD_ITEM PhCreateThreadItem(
     _In_ HANDLE ThreadId
     )
@@ -409,41 +517,26 @@ VOID PhpThreadItemDeleteProcedure(
     if (threadItem->ServiceName) PhDereferenceObject(threadItem->ServiceName);
 }
 
-BOOLEAN PhpThreadHashtableCompareFunction(
-    _In_ PVOID Entry1,
-    _In_ PVOID Entry2
-    )
-{
-    return
-        (*(PPH_THREAD_ITEM *)Entry1)->ThreadId ==
-        (*(PPH_THREAD_ITEM *)Entry2)->ThreadId;
-}
-
-ULONG PhpThreadHashtableHashFunction(
-    _In_ PVOID Entry
-    )
-{
-    return HandleToUlong((*(PPH_THREAD_ITEM *)Entry)->ThreadId) / 4;
-}
+#undef T
+#undef K
+#define T PPH_THREAD_ITEM
+#define K HANDLE
+#define PH_OPEN_HASHTABLE_KEY(Entry) ((Entry)->ThreadId)
+#define PH_OPEN_HASHTABLE_HASH PH_OPEN_HASHTABLE_HASH_HANDLE
+#define PH_OPEN_HASHTABLE_EQUAL PH_OPEN_HASHTABLE_EQUAL_SCALAR
+#include <ohashtbl_i.h>
 
 PPH_THREAD_ITEM PhReferenceThreadItem(
     _In_ PPH_THREAD_PROVIDER ThreadProvider,
     _In_ HANDLE ThreadId
     )
 {
-    PH_THREAD_ITEM lookupThreadItem;
-    PPH_THREAD_ITEM lookupThreadItemPtr = &lookupThreadItem;
     PPH_THREAD_ITEM *threadItemPtr;
     PPH_THREAD_ITEM threadItem;
 
-    lookupThreadItem.ThreadId = ThreadId;
-
     PhAcquireFastLockShared(&ThreadProvider->ThreadHashtableLock);
 
-    threadItemPtr = (PPH_THREAD_ITEM *)PhFindEntryHashtable(
-        ThreadProvider->ThreadHashtable,
-        &lookupThreadItemPtr
-        );
+    threadItemPtr = PhFindEntryOpenHashtable_PPH_THREAD_ITEM(&ThreadProvider->ThreadHashtable, ThreadId);
 
     if (threadItemPtr)
     {
@@ -469,7 +562,7 @@ VOID PhDereferenceAllThreadItems(
 
     PhAcquireFastLockExclusive(&ThreadProvider->ThreadHashtableLock);
 
-    while (PhEnumHashtable(ThreadProvider->ThreadHashtable, (PVOID *)&threadItem, &enumerationKey))
+    while (PhEnumOpenHashtable_PPH_THREAD_ITEM(&ThreadProvider->ThreadHashtable, &threadItem, &enumerationKey))
     {
         PhDereferenceObject(*threadItem);
     }
@@ -482,7 +575,7 @@ VOID PhpRemoveThreadItem(
     _In_ PPH_THREAD_ITEM ThreadItem
     )
 {
-    PhRemoveEntryHashtable(ThreadProvider->ThreadHashtable, &ThreadItem);
+    PhRemoveEntryOpenHashtable_PPH_THREAD_ITEM(&ThreadProvider->ThreadHashtable, ThreadItem->ThreadId);
     PhDereferenceObject(ThreadItem);
 }
 
@@ -502,8 +595,9 @@ NTSTATUS PhpThreadQueryWorker(
         PhInvokeCallback(&data->ThreadProvider->LoadingStateChangedEvent, (PVOID)TRUE);
 
     if (data->ThreadProvider->SymbolsLoadedRunId == 0)
-        PhLoadSymbolsThreadProvider(data->ThreadProvider);
+        PhpLoadPrioritySymbolsThreadProvider(data->ThreadProvider, data->ThreadItem->StartAddress);
 
+    PhClearReference(&data->ThreadItem->StartAddressFileName);
     data->StartAddressString = PhGetSymbolFromAddress(
         data->ThreadProvider->SymbolProvider,
         data->ThreadItem->StartAddress,
@@ -513,7 +607,9 @@ NTSTATUS PhpThreadQueryWorker(
         NULL
         );
 
-    if (data->StartAddressResolveLevel == PhsrlAddress && data->ThreadProvider->SymbolsLoadedRunId < data->RunId)
+    if (data->StartAddressResolveLevel == PhsrlAddress &&
+        data->ThreadProvider->SymbolsLoadedRunId != 0 && // Otherwise the background load will re-query
+        data->ThreadProvider->SymbolsLoadedRunId < data->RunId)
     {
         // The process may have loaded new modules, so load symbols for those and try again.
 
@@ -694,9 +790,16 @@ VOID PhThreadProviderInitialUpdate(
     _In_ PPH_THREAD_PROVIDER ThreadProvider
     )
 {
+    PPH_PROCESS_INFORMATION_SNAPSHOT snapshot;
     PVOID processes;
 
-    if (NT_SUCCESS(PhEnumProcesses(&processes)))
+    // Borrow the process provider's snapshot if it has run at least once.
+    if (snapshot = PhReferenceProcessInformationSnapshot())
+    {
+        PhpThreadProviderUpdate(ThreadProvider, snapshot->Processes);
+        PhDereferenceObject(snapshot);
+    }
+    else if (NT_SUCCESS(PhEnumProcesses(&processes)))
     {
         PhpThreadProviderUpdate(ThreadProvider, processes);
         PhFree(processes);
@@ -724,6 +827,8 @@ VOID PhpThreadProviderUpdate(
     SYSTEM_PROCESS_INFORMATION localProcess;
     PSYSTEM_THREAD_INFORMATION threads;
     ULONG numberOfThreads;
+    PPH_THREAD_ITEM *existingThreadItems;
+    ULONG numberOfExistingThreads;
     ULONG i;
 
     process = PhFindProcessInformation(ProcessInformation, threadProvider->ProcessId);
@@ -750,29 +855,40 @@ VOID PhpThreadProviderUpdate(
         }
     }
 
-    // Look for dead threads.
+    // Match the snapshot against the existing thread items. Only this function modifies the
+    // hashtable, so the items found here stay valid until the main pass below, and the main pass
+    // doesn't need to look them up again.
+    existingThreadItems = numberOfThreads != 0 ? PhAllocate(sizeof(PPH_THREAD_ITEM) * numberOfThreads) : NULL;
+    numberOfExistingThreads = 0;
+
+    for (i = 0; i < numberOfThreads; i++)
+    {
+        PPH_THREAD_ITEM *threadItemPtr;
+
+        threadItemPtr = PhFindEntryOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable, threads[i].ClientId.UniqueThread);
+
+        if (threadItemPtr)
+        {
+            existingThreadItems[i] = *threadItemPtr;
+            existingThreadItems[i]->LastSeenRunId = threadProvider->RunId;
+            numberOfExistingThreads++;
+        }
+        else
+        {
+            existingThreadItems[i] = NULL;
+        }
+    }
+
+    // Look for dead threads. These are the items which weren't matched above.
+    if (numberOfExistingThreads != threadProvider->ThreadHashtable.Count)
     {
         PPH_LIST threadsToRemove = NULL;
         ULONG enumerationKey = 0;
         PPH_THREAD_ITEM *threadItem;
 
-        while (PhEnumHashtable(threadProvider->ThreadHashtable, (PVOID *)&threadItem, &enumerationKey))
+        while (PhEnumOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable, &threadItem, &enumerationKey))
         {
-            BOOLEAN found = FALSE;
-
-            // Check if the thread still exists.
-            for (i = 0; i < numberOfThreads; i++)
-            {
-                PSYSTEM_THREAD_INFORMATION thread = &threads[i];
-
-                if ((*threadItem)->ThreadId == thread->ClientId.UniqueThread)
-                {
-                    found = TRUE;
-                    break;
-                }
-            }
-
-            if (!found)
+            if ((*threadItem)->LastSeenRunId != threadProvider->RunId)
             {
                 // Raise the thread removed event.
                 PhInvokeCallback(&threadProvider->ThreadRemovedEvent, *threadItem);
@@ -829,19 +945,36 @@ VOID PhpThreadProviderUpdate(
         }
     }
 
+    // Re-query start addresses that were resolved while symbols were still loading in the
+    // background.
+    if (threadProvider->SymbolsRequeryPending)
+    {
+        ULONG enumerationKey = 0;
+        PPH_THREAD_ITEM *threadItem;
+
+        threadProvider->SymbolsRequeryPending = FALSE;
+
+        while (PhEnumOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable, &threadItem, &enumerationKey))
+        {
+            if ((*threadItem)->StartAddressResolveLevel != PhsrlFunction)
+                PhpQueueThreadQuery(threadProvider, *threadItem);
+        }
+    }
+
     // Look for new threads and update existing ones.
     for (i = 0; i < numberOfThreads; i++)
     {
         PSYSTEM_THREAD_INFORMATION thread = &threads[i];
         PPH_THREAD_ITEM threadItem;
 
-        threadItem = PhReferenceThreadItem(threadProvider, thread->ClientId.UniqueThread);
+        threadItem = existingThreadItems[i];
 
         if (!threadItem)
         {
             PVOID startAddress = NULL;
 
             threadItem = PhCreateThreadItem(thread->ClientId.UniqueThread);
+            threadItem->LastSeenRunId = threadProvider->RunId;
 
             threadItem->CreateTime = thread->CreateTime;
             threadItem->KernelTime = thread->KernelTime;
@@ -955,7 +1088,7 @@ VOID PhpThreadProviderUpdate(
 
             // Add the thread item to the hashtable.
             PhAcquireFastLockExclusive(&threadProvider->ThreadHashtableLock);
-            PhAddEntryHashtable(threadProvider->ThreadHashtable, &threadItem);
+            PhAddEntryOpenHashtable_PPH_THREAD_ITEM(&threadProvider->ThreadHashtable, threadItem, NULL);
             PhReleaseFastLockExclusive(&threadProvider->ThreadHashtableLock);
 
             // Raise the thread added event.
@@ -964,10 +1097,19 @@ VOID PhpThreadProviderUpdate(
         else
         {
             BOOLEAN modified = FALSE;
+            BOOLEAN ran;
+            BOOLEAN basePriorityChanged;
 
             if (threadItem->JustResolved)
                 modified = TRUE;
 
+            // If none of the thread's counters moved, it hasn't run since the last update, so its
+            // cycle count and GUI state can't have changed either and we can skip those queries.
+            ran = threadItem->KernelTime.QuadPart != thread->KernelTime.QuadPart ||
+                threadItem->UserTime.QuadPart != thread->UserTime.QuadPart ||
+                threadItem->ContextSwitchesDelta.Value != thread->ContextSwitches;
+            basePriorityChanged = threadItem->BasePriority != thread->BasePriority;
+
             threadItem->KernelTime = thread->KernelTime;
             threadItem->UserTime = thread->UserTime;
 
@@ -1043,7 +1185,16 @@ VOID PhpThreadProviderUpdate(
 
                 oldDelta = threadItem->CyclesDelta.Delta;
 
-                if (NT_SUCCESS(PhpGetThreadCycleTime(
+                if (!ran)
+                {
+                    PhUpdateDelta(&threadItem->CyclesDelta, threadItem->CyclesDelta.Value);
+
+                    if (threadItem->CyclesDelta.Delta != oldDelta)
+                    {
+                        modified = TRUE;
+                    }
+                }
+                else if (NT_SUCCESS(PhpGetThreadCycleTime(
                     threadProvider,
                     threadItem,
                     &cycles
@@ -1074,7 +1225,9 @@ VOID PhpThreadProviderUpdate(
                     (PhCpuKernelDelta.Delta + PhCpuUserDelta.Delta + PhCpuIdleDelta.Delta);
             }
 
-            // Update the Win32 priority.
+            // Update the Win32 priority. Changing it also changes the base priority, except when
+            // the value is clamped, which only happens to threads that then have to run.
+            if (ran || basePriorityChanged)
             {
                 LONG oldPriorityWin32 = threadItem->PriorityWin32;
 
@@ -1086,9 +1239,13 @@ VOID PhpThreadProviderUpdate(
                 }
             }
 
-            // Update the GUI thread status.
+            // Update the GUI thread status. A thread has to run to become a GUI thread.
 
-            if (threadItem->ThreadHandle && KphIsConnected())
+            if (!ran)
+            {
+                NOTHING;
+            }
+            else if (threadItem->ThreadHandle && KphIsConnected())
             {
                 PVOID win32Thread;
 
@@ -1126,11 +1283,12 @@ VOID PhpThreadProviderUpdate(
                 // Raise the thread modified event.
                 PhInvokeCallback(&threadProvider->ThreadModifiedEvent, threadItem);
             }
-
-            PhDereferenceObject(threadItem);
         }
     }
 
+    if (existingThreadItems)
+        PhFree(existingThreadItems);
+
     PhInvokeCallback(&threadProvider->UpdatedEvent, NULL);
     threadProvider->RunId++;
 }
@@ -29,6 +29,11 @@
 #define WM_PH_COMPLETED (WM_APP + 301)
 #define WM_PH_STATUS_UPDATE (WM_APP + 302)
 
+#define PH_STACK_SAMPLE_COUNT 500
+#define PH_STACK_SAMPLE_INTERVAL 10 // ms
+#define PH_STACK_SAMPLE_FRAMES 64
+#define PH_STACK_SAMPLE_MAXIMUM_NODES 16384
+
 typedef struct _THREAD_STACK_CONTEXT
 {
     HANDLE ProcessId;
@@ -38,8 +43,13 @@ typedef struct _THREAD_STACK_CONTEXT
     PPH_THREAD_PROVIDER ThreadProvider;
     PPH_SYMBOL_PROVIDER SymbolProvider;
     BOOLEAN CustomWalk;
+    BOOLEAN SampleStacks;
+    HANDLE ProcessHandle;
+    PHANDLE SampleThreadIds;
+    ULONG NumberOfSampleThreads;
 
     BOOLEAN StopWalk;
+    BOOLEAN StopSampling;
     PPH_LIST List;
     PPH_LIST NewList;
     HWND ProgressWindowHandle;
@@ -51,10 +61,33 @@ typedef struct _THREAD_STACK_CONTEXT
 typedef struct _THREAD_STACK_ITEM
 {
     PH_THREAD_STACK_FRAME StackFrame;
-    ULONG Index;
+    ULONG Index; // inclusive hits when sampling
     PPH_STRING Symbol;
+    ULONG ExclusiveHits;
 } THREAD_STACK_ITEM, *PTHREAD_STACK_ITEM;
 
+typedef struct _PH_STACK_SAMPLE_NODE
+{
+    struct _PH_STACK_SAMPLE_NODE *Parent;
+    PVOID Address;
+    ULONG InclusiveHits;
+    ULONG ExclusiveHits;
+    PPH_LIST Children;
+} PH_STACK_SAMPLE_NODE, *PPH_STACK_SAMPLE_NODE;
+
+typedef struct _PH_STACK_SAMPLE_TREE
+{
+    PH_STACK_SAMPLE_NODE Root;
+    PPH_HASHTABLE NodeHashtable; // key: Parent and Address
+    BOOLEAN Truncated;
+} PH_STACK_SAMPLE_TREE, *PPH_STACK_SAMPLE_TREE;
+
+typedef struct _PH_STACK_SAMPLE_WALK_CONTEXT
+{
+    PVOID *Frames;
+    ULONG NumberOfFrames;
+} PH_STACK_SAMPLE_WALK_CONTEXT, *PPH_STACK_SAMPLE_WALK_CONTEXT;
+
 INT_PTR CALLBACK PhpThreadStackDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -148,6 +181,78 @@ VOID PhShowThreadStackDialog(
         NtClose(threadStackContext.ThreadHandle);
 }
 
+/**
+ * Samples the stacks of threads in a process and shows the
+ * results as a call tree.
+ *
+ * \param ParentWindowHandle The parent window.
+ * \param ProcessId The ID of the process.
+ * \param ThreadIds An array of thread IDs to sample. If NULL,
+ * all threads in the process are sampled.
+ * \param NumberOfThreadIds The number of elements in \a ThreadIds.
+ * \param ThreadProvider The thread provider for the process.
+ */
+VOID PhShowThreadStackSampleDialog(
+    _In_ HWND ParentWindowHandle,
+    _In_ HANDLE ProcessId,
+    _In_reads_opt_(NumberOfThreadIds) PHANDLE ThreadIds,
+    _In_ ULONG NumberOfThreadIds,
+    _In_ PPH_THREAD_PROVIDER ThreadProvider
+    )
+{
+    NTSTATUS status;
+    THREAD_STACK_CONTEXT threadStackContext;
+    HANDLE processHandle = NULL;
+
+    if (ProcessId == SYSTEM_PROCESS_ID && !KphIsConnected())
+    {
+        PhShowError(ParentWindowHandle, KPH_ERROR_MESSAGE);
+        return;
+    }
+
+    // KProcessHacker captures all of the stacks in a single request;
+    // otherwise each thread is walked separately.
+    if (KphIsConnected())
+    {
+        if (!NT_SUCCESS(status = PhOpenProcess(
+            &processHandle,
+            ProcessQueryAccess,
+            ProcessId
+            )))
+        {
+            PhShowStatus(ParentWindowHandle, L"Unable to open the process", status, 0);
+            return;
+        }
+    }
+
+    memset(&threadStackContext, 0, sizeof(THREAD_STACK_CONTEXT));
+    threadStackContext.ProcessId = ProcessId;
+    threadStackContext.ThreadProvider = ThreadProvider;
+    threadStackContext.SymbolProvider = ThreadProvider->SymbolProvider;
+    threadStackContext.SampleStacks = TRUE;
+    threadStackContext.ProcessHandle = processHandle;
+    threadStackContext.SampleThreadIds = ThreadIds;
+    threadStackContext.NumberOfSampleThreads = ThreadIds ? NumberOfThreadIds : 0;
+    threadStackContext.List = PhCreateList(10);
+    threadStackContext.NewList = PhCreateList(10);
+    PhInitializeQueuedLock(&threadStackContext.StatusLock);
+
+    DialogBoxParam(
+        PhInstanceHandle,
+        MAKEINTRESOURCE(IDD_THRDSTACK),
+        ParentWindowHandle,
+        PhpThreadStackDlgProc,
+        (LPARAM)&threadStackContext
+        );
+
+    PhClearReference(&threadStackContext.StatusMessage);
+    PhDereferenceObject(threadStackContext.NewList);
+    PhDereferenceObject(threadStackContext.List);
+
+    if (processHandle)
+        NtClose(processHandle);
+}
+
 static INT_PTR CALLBACK PhpThreadStackDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -168,16 +273,33 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
             threadStackContext = (PTHREAD_STACK_CONTEXT)lParam;
             SetProp(hwndDlg, PhMakeContextAtom(), (HANDLE)threadStackContext);
 
-            title = PhFormatString(L"Stack - thread %u", HandleToUlong(threadStackContext->ThreadId));
+            if (threadStackContext->SampleStacks)
+                title = PhFormatString(L"Stack samples - process %u", HandleToUlong(threadStackContext->ProcessId));
+            else
+                title = PhFormatString(L"Stack - thread %u", HandleToUlong(threadStackContext->ThreadId));
+
             SetWindowText(hwndDlg, title->Buffer);
             PhDereferenceObject(title);
 
             lvHandle = GetDlgItem(hwndDlg, IDC_LIST);
-            PhAddListViewColumn(lvHandle, 0, 0, 0, LVCFMT_LEFT, 30, L" ");
-            PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_LEFT, 300, L"Name");
+
+            if (threadStackContext->SampleStacks)
+            {
+                PhAddListViewColumn(lvHandle, 0, 0, 0, LVCFMT_RIGHT, 60, L"Inclusive");
+                PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_RIGHT, 60, L"Exclusive");
+                PhAddListViewColumn(lvHandle, 2, 2, 2, LVCFMT_LEFT, 400, L"Name");
+            }
+            else
+            {
+                PhAddListViewColumn(lvHandle, 0, 0, 0, LVCFMT_LEFT, 30, L" ");
+                PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_LEFT, 300, L"Name");
+            }
+
             PhSetListViewStyle(lvHandle, FALSE, TRUE);
             PhSetControlTheme(lvHandle, L"explorer");
-            PhLoadListViewColumnsFromSetting(L"ThreadStackListViewColumns", lvHandle);
+
+            if (!threadStackContext->SampleStacks)
+                PhLoadListViewColumnsFromSetting(L"ThreadStackListViewColumns", lvHandle);
 
             threadStackContext->ListViewHandle = lvHandle;
 
@@ -210,7 +332,7 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
             PhLoadWindowPlacementFromSetting(NULL, L"ThreadStackWindowSize", hwndDlg);
             PhCenterWindow(hwndDlg, GetParent(hwndDlg));
 
-            if (PhPluginsEnabled)
+            if (PhPluginsEnabled && !threadStackContext->SampleStacks)
             {
                 PH_PLUGIN_THREAD_STACK_CONTROL control;
 
@@ -246,7 +368,7 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
 
             threadStackContext = (PTHREAD_STACK_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
 
-            if (PhPluginsEnabled)
+            if (PhPluginsEnabled && !threadStackContext->SampleStacks)
             {
                 PH_PLUGIN_THREAD_STACK_CONTROL control;
 
@@ -258,7 +380,8 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
             for (i = 0; i < threadStackContext->List->Count; i++)
                 PhpFreeThreadStackItem(threadStackContext->List->Items[i]);
 
-            PhSaveListViewColumnsToSetting(L"ThreadStackListViewColumns", GetDlgItem(hwndDlg, IDC_LIST));
+            if (!threadStackContext->SampleStacks)
+                PhSaveListViewColumnsToSetting(L"ThreadStackListViewColumns", GetDlgItem(hwndDlg, IDC_LIST));
             PhSaveWindowPlacementToSetting(NULL, L"ThreadStackWindowSize", hwndDlg);
 
             RemoveProp(hwndDlg, PhMakeContextAtom());
@@ -333,15 +456,20 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
                             stackFrame = &stackItem->StackFrame;
                             PhInitializeStringBuilder(&stringBuilder, 40);
 
-                            PhAppendFormatStringBuilder(
-                                &stringBuilder,
-                                L"Stack: 0x%Ix, Frame: 0x%Ix\n",
-                                stackFrame->StackAddress,
-                                stackFrame->FrameAddress
-                                );
+                            // Samples only record return addresses.
+                            if (!threadStackContext->SampleStacks)
+                            {
+                                PhAppendFormatStringBuilder(
+                                    &stringBuilder,
+                                    L"Stack: 0x%Ix, Frame: 0x%Ix\n",
+                                    stackFrame->StackAddress,
+                                    stackFrame->FrameAddress
+                                    );
+                            }
 
                             // There are no params for kernel-mode stack traces.
-                            if ((ULONG_PTR)stackFrame->PcAddress <= PhSystemBasicInformation.MaximumUserModeAddress)
+                            if (!threadStackContext->SampleStacks &&
+                                (ULONG_PTR)stackFrame->PcAddress <= PhSystemBasicInformation.MaximumUserModeAddress)
                             {
                                 PhAppendFormatStringBuilder(
                                     &stringBuilder,
@@ -373,7 +501,7 @@ static INT_PTR CALLBACK PhpThreadStackDlgProc(
                             if (stringBuilder.String->Length != 0)
                                 PhRemoveEndStringBuilder(&stringBuilder, 1);
 
-                            if (PhPluginsEnabled)
+                            if (PhPluginsEnabled && !threadStackContext->SampleStacks)
                             {
                                 PH_PLUGIN_THREAD_STACK_CONTROL control;
 
@@ -427,7 +555,9 @@ static NTSTATUS PhpRefreshThreadStack(
     ULONG i;
 
     ThreadStackContext->StopWalk = FALSE;
-    PhMoveReference(&ThreadStackContext->StatusMessage, PhCreateString(L"Loading stack..."));
+    ThreadStackContext->StopSampling = FALSE;
+    PhMoveReference(&ThreadStackContext->StatusMessage,
+        PhCreateString(ThreadStackContext->SampleStacks ? L"Sampling stacks..." : L"Loading stack..."));
 
     DialogBoxParam(
         PhInstanceHandle,
@@ -457,7 +587,17 @@ static NTSTATUS PhpRefreshThreadStack(
 
             PhPrintUInt32(integerString, item->Index);
             lvItemIndex = PhAddListViewItem(ThreadStackContext->ListViewHandle, MAXINT, integerString, item);
-            PhSetListViewSubItem(ThreadStackContext->ListViewHandle, lvItemIndex, 1, PhGetStringOrDefault(item->Symbol, L"???"));
+
+            if (ThreadStackContext->SampleStacks)
+            {
+                PhPrintUInt32(integerString, item->ExclusiveHits);
+                PhSetListViewSubItem(ThreadStackContext->ListViewHandle, lvItemIndex, 1, integerString);
+                PhSetListViewSubItem(ThreadStackContext->ListViewHandle, lvItemIndex, 2, PhGetStringOrDefault(item->Symbol, L"???"));
+            }
+            else
+            {
+                PhSetListViewSubItem(ThreadStackContext->ListViewHandle, lvItemIndex, 1, PhGetStringOrDefault(item->Symbol, L"???"));
+            }
         }
 
         SendMessage(ThreadStackContext->ListViewHandle, WM_SETREDRAW, TRUE, 0);
@@ -534,6 +674,437 @@ static BOOLEAN NTAPI PhpWalkThreadStackCallback(
     return TRUE;
 }
 
+static BOOLEAN NTAPI PhpStackSampleNodeEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_STACK_SAMPLE_NODE node1 = *(PPH_STACK_SAMPLE_NODE *)Entry1;
+    PPH_STACK_SAMPLE_NODE node2 = *(PPH_STACK_SAMPLE_NODE *)Entry2;
+
+    return node1->Parent == node2->Parent && node1->Address == node2->Address;
+}
+
+static ULONG NTAPI PhpStackSampleNodeHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_STACK_SAMPLE_NODE node = *(PPH_STACK_SAMPLE_NODE *)Entry;
+
+    return PhHashIntPtr((ULONG_PTR)node->Parent) ^ PhHashIntPtr((ULONG_PTR)node->Address);
+}
+
+static VOID PhpInitializeStackSampleTree(
+    _Out_ PPH_STACK_SAMPLE_TREE Tree
+    )
+{
+    memset(Tree, 0, sizeof(PH_STACK_SAMPLE_TREE));
+    Tree->Root.Children = PhCreateList(16);
+    Tree->NodeHashtable = PhCreateHashtable(
+        sizeof(PPH_STACK_SAMPLE_NODE),
+        PhpStackSampleNodeEqualFunction,
+        PhpStackSampleNodeHashFunction,
+        256
+        );
+}
+
+static VOID PhpDeleteStackSampleTree(
+    _Inout_ PPH_STACK_SAMPLE_TREE Tree
+    )
+{
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PPH_STACK_SAMPLE_NODE *entry;
+
+    PhBeginEnumHashtable(Tree->NodeHashtable, &enumContext);
+
+    while (entry = PhNextEnumHashtable(&enumContext))
+    {
+        PhDereferenceObject((*entry)->Children);
+        PhFree(*entry);
+    }
+
+    PhDereferenceObject(Tree->NodeHashtable);
+    PhDereferenceObject(Tree->Root.Children);
+}
+
+/**
+ * Adds a stack sample to a call tree.
+ *
+ * \param Tree The call tree.
+ * \param Frames The return addresses of the sample, innermost first.
+ * \param NumberOfFrames The number of elements in \a Frames.
+ */
+static VOID PhpAddStackSampleTree(
+    _Inout_ PPH_STACK_SAMPLE_TREE Tree,
+    _In_reads_(NumberOfFrames) PVOID *Frames,
+    _In_ ULONG NumberOfFrames
+    )
+{
+    PPH_STACK_SAMPLE_NODE node;
+    ULONG i;
+
+    node = &Tree->Root;
+    node->InclusiveHits++;
+
+    for (i = NumberOfFrames; i != 0; i--)
+    {
+        PH_STACK_SAMPLE_NODE lookupNode;
+        PPH_STACK_SAMPLE_NODE lookupNodePtr = &lookupNode;
+        PPH_STACK_SAMPLE_NODE *entry;
+        PPH_STACK_SAMPLE_NODE child;
+
+        lookupNode.Parent = node;
+        lookupNode.Address = Frames[i - 1];
+        entry = PhFindEntryHashtable(Tree->NodeHashtable, &lookupNodePtr);
+
+        if (entry)
+        {
+            child = *entry;
+        }
+        else
+        {
+            // Once the tree is full, the rest of the stack is
+            // attributed to the deepest node that already exists.
+            if (Tree->NodeHashtable->Count >= PH_STACK_SAMPLE_MAXIMUM_NODES)
+            {
+                Tree->Truncated = TRUE;
+                break;
+            }
+
+            child = PhAllocate(sizeof(PH_STACK_SAMPLE_NODE));
+            child->Parent = node;
+            child->Address = Frames[i - 1];
+            child->InclusiveHits = 0;
+            child->ExclusiveHits = 0;
+            child->Children = PhCreateList(2);
+            PhAddEntryHashtable(Tree->NodeHashtable, &child);
+            PhAddItemList(node->Children, child);
+        }
+
+        node = child;
+        node->InclusiveHits++;
+    }
+
+    node->ExclusiveHits++;
+}
+
+static int __cdecl PhpStackSampleNodeCompareFunction(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_STACK_SAMPLE_NODE node1 = *(PPH_STACK_SAMPLE_NODE *)elem1;
+    PPH_STACK_SAMPLE_NODE node2 = *(PPH_STACK_SAMPLE_NODE *)elem2;
+
+    // Most hits first.
+    return -uintcmp(node1->InclusiveHits, node2->InclusiveHits);
+}
+
+static VOID PhpFlattenStackSampleNode(
+    _In_ PTHREAD_STACK_CONTEXT ThreadStackContext,
+    _In_ PPH_STACK_SAMPLE_NODE Node,
+    _In_ ULONG Depth
+    )
+{
+    ULONG i;
+
+    qsort(Node->Children->Items, Node->Children->Count, sizeof(PVOID), PhpStackSampleNodeCompareFunction);
+
+    for (i = 0; i < Node->Children->Count; i++)
+    {
+        PPH_STACK_SAMPLE_NODE child = Node->Children->Items[i];
+        PTHREAD_STACK_ITEM item;
+        PPH_STRING symbol;
+        SIZE_T indent;
+
+        if (ThreadStackContext->StopWalk)
+            return;
+
+        symbol = PhGetSymbolFromAddress(
+            ThreadStackContext->SymbolProvider,
+            (ULONG64)child->Address,
+            NULL,
+            NULL,
+            NULL,
+            NULL
+            );
+
+        item = PhAllocate(sizeof(THREAD_STACK_ITEM));
+        memset(&item->StackFrame, 0, sizeof(PH_THREAD_STACK_FRAME));
+        item->StackFrame.PcAddress = child->Address;
+        item->Index = child->InclusiveHits;
+        item->ExclusiveHits = child->ExclusiveHits;
+
+        // Indent the name to show the shape of the tree.
+        indent = Depth * 2;
+        item->Symbol = PhCreateStringEx(NULL, (indent + (symbol ? symbol->Length / sizeof(WCHAR) : 3)) * sizeof(WCHAR));
+        wmemset(item->Symbol->Buffer, ' ', indent);
+
+        if (symbol)
+        {
+            memcpy(&item->Symbol->Buffer[indent], symbol->Buffer, symbol->Length);
+            PhDereferenceObject(symbol);
+        }
+        else
+        {
+            memcpy(&item->Symbol->Buffer[indent], L"???", 3 * sizeof(WCHAR));
+        }
+
+        PhAddItemList(ThreadStackContext->NewList, item);
+
+        PhpFlattenStackSampleNode(ThreadStackContext, child, Depth + 1);
+    }
+}
+
+static BOOLEAN NTAPI PhpWalkStackSampleCallback(
+    _In_ PPH_THREAD_STACK_FRAME StackFrame,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_STACK_SAMPLE_WALK_CONTEXT context = Context;
+
+    context->Frames[context->NumberOfFrames++] = StackFrame->PcAddress;
+
+    return context->NumberOfFrames < PH_STACK_SAMPLE_FRAMES * 2;
+}
+
+static NTSTATUS PhpSampleThreadStacks(
+    _In_ PTHREAD_STACK_CONTEXT ThreadStackContext
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PKPH_STACK_BACK_TRACE_ENTRY entries;
+    PKPH_STACK_BACK_TRACE_ENTRY userEntries = NULL;
+    ULONG numberOfEntries;
+    PHANDLE threadHandles = NULL;
+    PVOID *kernelBackTraces;
+    PVOID *userBackTraces = NULL;
+    PVOID frames[PH_STACK_SAMPLE_FRAMES * 2];
+    PH_STACK_SAMPLE_TREE tree;
+    LARGE_INTEGER interval;
+    ULONG sample;
+    ULONG i;
+
+    if (ThreadStackContext->NumberOfSampleThreads != 0)
+    {
+        numberOfEntries = min(ThreadStackContext->NumberOfSampleThreads, KPH_MAXIMUM_STACK_BACK_TRACE_BATCH_ENTRIES);
+        entries = PhAllocate(numberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY));
+        memset(entries, 0, numberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY));
+
+        for (i = 0; i < numberOfEntries; i++)
+            entries[i].ThreadId = ThreadStackContext->SampleThreadIds[i];
+    }
+    else
+    {
+        PVOID processes;
+        PSYSTEM_PROCESS_INFORMATION process;
+
+        if (!NT_SUCCESS(status = PhEnumProcesses(&processes)))
+            return status;
+
+        if (!(process = PhFindProcessInformation(processes, ThreadStackContext->ProcessId)))
+        {
+            PhFree(processes);
+            return STATUS_INVALID_CID;
+        }
+
+        numberOfEntries = min(process->NumberOfThreads, KPH_MAXIMUM_STACK_BACK_TRACE_BATCH_ENTRIES);
+
+        if (numberOfEntries == 0)
+        {
+            PhFree(processes);
+            return STATUS_NO_MORE_ENTRIES;
+        }
+
+        entries = PhAllocate(numberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY));
+        memset(entries, 0, numberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY));
+
+        for (i = 0; i < numberOfEntries; i++)
+            entries[i].ThreadId = process->Threads[i].ClientId.UniqueThread;
+
+        PhFree(processes);
+    }
+
+    if (ThreadStackContext->ProcessHandle)
+    {
+        kernelBackTraces = PhAllocate(numberOfEntries * PH_STACK_SAMPLE_FRAMES * sizeof(PVOID));
+
+        // System threads have no user-mode stack.
+        if (ThreadStackContext->ProcessId != SYSTEM_PROCESS_ID)
+        {
+            userEntries = PhAllocateCopy(entries, numberOfEntries * sizeof(KPH_STACK_BACK_TRACE_ENTRY));
+            userBackTraces = PhAllocate(numberOfEntries * PH_STACK_SAMPLE_FRAMES * sizeof(PVOID));
+        }
+    }
+    else
+    {
+        kernelBackTraces = NULL;
+        threadHandles = PhAllocate(numberOfEntries * sizeof(HANDLE));
+
+        for (i = 0; i < numberOfEntries; i++)
+        {
+            if (!NT_SUCCESS(PhOpenThread(
+                &threadHandles[i],
+                ThreadQueryAccess | THREAD_GET_CONTEXT | THREAD_SUSPEND_RESUME,
+                entries[i].ThreadId
+                )))
+            {
+                threadHandles[i] = NULL;
+            }
+        }
+    }
+
+    PhpInitializeStackSampleTree(&tree);
+
+    for (sample = 0; sample < PH_STACK_SAMPLE_COUNT; sample++)
+    {
+        if (ThreadStackContext->StopWalk || ThreadStackContext->StopSampling)
+            break;
+
+        PhAcquireQueuedLockExclusive(&ThreadStackContext->StatusLock);
+        PhMoveReference(&ThreadStackContext->StatusMessage,
+            PhFormatString(L"Taking sample %u of %u...", sample + 1, PH_STACK_SAMPLE_COUNT));
+        PhReleaseQueuedLockExclusive(&ThreadStackContext->StatusLock);
+        PostMessage(ThreadStackContext->ProgressWindowHandle, WM_PH_STATUS_UPDATE, 0, 0);
+
+        if (kernelBackTraces)
+        {
+            if (!NT_SUCCESS(status = KphCaptureStackBackTraceThreads(
+                ThreadStackContext->ProcessHandle,
+                entries,
+                numberOfEntries,
+                0,
+                PH_STACK_SAMPLE_FRAMES,
+                0,
+                kernelBackTraces
+                )))
+                break;
+
+            // The user-mode stacks are captured by a second request, so they
+            // come from a slightly later point in time than the kernel-mode stacks.
+            if (userEntries && !NT_SUCCESS(status = KphCaptureStackBackTraceThreads(
+                ThreadStackContext->ProcessHandle,
+                userEntries,
+                numberOfEntries,
+                0,
+                PH_STACK_SAMPLE_FRAMES,
+                KPH_STACK_BACK_TRACE_USER_MODE,
+                userBackTraces
+                )))
+                break;
+
+            for (i = 0; i < numberOfEntries; i++)
+            {
+                ULONG numberOfFrames = 0;
+
+                if (NT_SUCCESS(entries[i].Status))
+                {
+                    memcpy(frames, &kernelBackTraces[i * PH_STACK_SAMPLE_FRAMES], entries[i].CapturedFrames * sizeof(PVOID));
+                    numberOfFrames = entries[i].CapturedFrames;
+                }
+
+                // The innermost frames are kernel-mode frames, followed by user-mode frames.
+                if (userEntries && NT_SUCCESS(userEntries[i].Status))
+                {
+                    memcpy(&frames[numberOfFrames], &userBackTraces[i * PH_STACK_SAMPLE_FRAMES], userEntries[i].CapturedFrames * sizeof(PVOID));
+                    numberOfFrames += userEntries[i].CapturedFrames;
+                }
+
+                if (numberOfFrames != 0)
+                    PhpAddStackSampleTree(&tree, frames, numberOfFrames);
+            }
+        }
+        else
+        {
+            for (i = 0; i < numberOfEntries; i++)
+            {
+                PH_STACK_SAMPLE_WALK_CONTEXT walkContext;
+                CLIENT_ID clientId;
+
+                if (!threadHandles[i])
+                    continue;
+
+                walkContext.Frames = frames;
+                walkContext.NumberOfFrames = 0;
+                clientId.UniqueProcess = ThreadStackContext->ProcessId;
+                clientId.UniqueThread = entries[i].ThreadId;
+
+                PhWalkThreadStack(
+                    threadHandles[i],
+                    ThreadStackContext->SymbolProvider->ProcessHandle,
+                    &clientId,
+                    ThreadStackContext->SymbolProvider,
+                    PH_WALK_I386_STACK | PH_WALK_AMD64_STACK,
+                    PhpWalkStackSampleCallback,
+                    &walkContext
+                    );
+
+                if (walkContext.NumberOfFrames != 0)
+                    PhpAddStackSampleTree(&tree, frames, walkContext.NumberOfFrames);
+            }
+        }
+
+        NtDelayExecution(FALSE, PhTimeoutFromMilliseconds(&interval, PH_STACK_SAMPLE_INTERVAL));
+    }
+
+    if (threadHandles)
+    {
+        for (i = 0; i < numberOfEntries; i++)
+        {
+            if (threadHandles[i])
+                NtClose(threadHandles[i]);
+        }
+
+        PhFree(threadHandles);
+    }
+
+    if (userEntries)
+        PhFree(userEntries);
+    if (userBackTraces)
+        PhFree(userBackTraces);
+    if (kernelBackTraces)
+        PhFree(kernelBackTraces);
+
+    PhFree(entries);
+
+    if (NT_SUCCESS(status) && !ThreadStackContext->StopWalk)
+    {
+        PhAcquireQueuedLockExclusive(&ThreadStackContext->StatusLock);
+        PhMoveReference(&ThreadStackContext->StatusMessage, PhFormatString(
+            L"Resolving symbols for %u samples%s...",
+            tree.Root.InclusiveHits,
+            tree.Truncated ? L" (call tree truncated)" : L""
+            ));
+        PhReleaseQueuedLockExclusive(&ThreadStackContext->StatusLock);
+        PostMessage(ThreadStackContext->ProgressWindowHandle, WM_PH_STATUS_UPDATE, 0, 0);
+
+        PhpFlattenStackSampleNode(ThreadStackContext, &tree.Root, 0);
+
+        if (tree.Root.InclusiveHits == 0)
+            status = STATUS_UNSUCCESSFUL;
+    }
+
+    PhpDeleteStackSampleTree(&tree);
+
+    return status;
+}
+
+static BOOLEAN NTAPI PhpSymbolPrefetchCallback(
+    _In_ PPH_SYMBOL_PREFETCH_PROGRESS Progress,
+    _In_opt_ PVOID Context
+    )
+{
+    PTHREAD_STACK_CONTEXT threadStackContext = Context;
+
+    PhAcquireQueuedLockExclusive(&threadStackContext->StatusLock);
+    PhMoveReference(&threadStackContext->StatusMessage,
+        PhFormatString(L"Downloading symbols (%u of %u)...", Progress->CompletedCount, Progress->TotalCount));
+    PhReleaseQueuedLockExclusive(&threadStackContext->StatusLock);
+    PostMessage(threadStackContext->ProgressWindowHandle, WM_PH_STATUS_UPDATE, 0, 0);
+
+    return !threadStackContext->StopWalk;
+}
+
 static NTSTATUS PhpRefreshThreadStackThreadStart(
     _In_ PVOID Parameter
     )
@@ -545,6 +1116,23 @@ static NTSTATUS PhpRefreshThreadStackThreadStart(
 
     PhLoadSymbolsThreadProvider(threadStackContext->ThreadProvider);
 
+    // Download the PDBs of all modules in parallel before the walk resolves addresses, which
+    // would download them one at a time.
+    PhPrefetchSymbolProvider(
+        threadStackContext->SymbolProvider,
+        PH_SYMBOL_PREFETCH_DEFAULT_CONCURRENCY,
+        PhpSymbolPrefetchCallback,
+        threadStackContext
+        );
+
+    if (threadStackContext->SampleStacks)
+    {
+        threadStackContext->WalkStatus = PhpSampleThreadStacks(threadStackContext);
+        PostMessage(threadStackContext->ProgressWindowHandle, WM_PH_COMPLETED, 0, 0);
+
+        return STATUS_SUCCESS;
+    }
+
     clientId.UniqueProcess = threadStackContext->ProcessId;
     clientId.UniqueThread = threadStackContext->ThreadId;
     defaultWalk = TRUE;
@@ -640,7 +1228,7 @@ static INT_PTR CALLBACK PhpThreadStackProgressDlgProc(
 
             PhSetWindowStyle(GetDlgItem(hwndDlg, IDC_PROGRESS), PBS_MARQUEE, PBS_MARQUEE);
             SendMessage(GetDlgItem(hwndDlg, IDC_PROGRESS), PBM_SETMARQUEE, TRUE, 75);
-            SetWindowText(hwndDlg, L"Loading stack...");
+            SetWindowText(hwndDlg, threadStackContext->SampleStacks ? L"Sampling stacks..." : L"Loading stack...");
         }
         break;
     case WM_DESTROY:
@@ -656,6 +1244,13 @@ static INT_PTR CALLBACK PhpThreadStackProgressDlgProc(
                 {
                     PTHREAD_STACK_CONTEXT threadStackContext = (PTHREAD_STACK_CONTEXT)GetProp(hwndDlg, PhMakeContextAtom());
 
+                    // The first cancel stops sampling and keeps the samples taken so far.
+                    if (threadStackContext->SampleStacks && !threadStackContext->StopSampling)
+                    {
+                        threadStackContext->StopSampling = TRUE;
+                        break;
+                    }
+
                     EnableWindow(GetDlgItem(hwndDlg, IDCANCEL), FALSE);
                     threadStackContext->StopWalk = TRUE;
                 }
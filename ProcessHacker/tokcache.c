@@ -0,0 +1,240 @@
+/*
+ * Process Hacker -
+ *   token information cache
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Most processes run with one of a few distinct tokens: a new process gets a copy of its parent's
+ * token, which keeps the authentication ID and modified ID of the original until the copy is
+ * changed. Information derived from a token is cached by these two IDs so that the user name
+ * lookup (which goes through LSA) and the other token queries are done once for each distinct
+ * token state instead of once for each process. Changing a token (for example enabling
+ * virtualization or lowering its integrity level) gives it a new modified ID, so a cached entry
+ * never describes a token that has changed since.
+ */
+
+#include <phapp.h>
+#include <tokcache.h>
+
+#define PH_TOKEN_CACHE_MAXIMUM_ENTRIES 512
+
+typedef struct _PH_TOKEN_CACHE_ENTRY
+{
+    LUID AuthenticationId;
+    LUID ModifiedId;
+    PH_TOKEN_CACHE_INFORMATION Information;
+} PH_TOKEN_CACHE_ENTRY, *PPH_TOKEN_CACHE_ENTRY;
+
+static PPH_HASHTABLE PhpTokenCacheHashtable = NULL;
+static PH_QUEUED_LOCK PhpTokenCacheLock = PH_QUEUED_LOCK_INIT;
+
+static BOOLEAN NTAPI PhpTokenCacheEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_TOKEN_CACHE_ENTRY entry1 = Entry1;
+    PPH_TOKEN_CACHE_ENTRY entry2 = Entry2;
+
+    return
+        RtlIsEqualLuid(&entry1->AuthenticationId, &entry2->AuthenticationId) &&
+        RtlIsEqualLuid(&entry1->ModifiedId, &entry2->ModifiedId);
+}
+
+static ULONG NTAPI PhpTokenCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_TOKEN_CACHE_ENTRY entry = Entry;
+
+    return PhHashInt32(entry->ModifiedId.LowPart) ^ entry->AuthenticationId.LowPart;
+}
+
+static VOID PhpCopyTokenCacheInformation(
+    _Inout_ PPH_TOKEN_CACHE_INFORMATION Destination,
+    _In_ PPH_TOKEN_CACHE_INFORMATION Source,
+    _In_ ULONG Fields
+    )
+{
+    Fields &= Source->ValidFields;
+
+    if (Fields & PH_TOKEN_CACHE_USER)
+        PhSetReference(&Destination->UserName, Source->UserName);
+
+    if (Fields & PH_TOKEN_CACHE_ELEVATION)
+        Destination->ElevationType = Source->ElevationType;
+
+    if (Fields & PH_TOKEN_CACHE_INTEGRITY)
+    {
+        Destination->IntegrityLevel = Source->IntegrityLevel;
+        Destination->IntegrityString = Source->IntegrityString;
+    }
+
+    if (Fields & PH_TOKEN_CACHE_VIRTUALIZATION)
+    {
+        Destination->VirtualizationAllowed = Source->VirtualizationAllowed;
+        Destination->VirtualizationEnabled = Source->VirtualizationEnabled;
+    }
+
+    Destination->ValidFields |= Fields;
+}
+
+static VOID PhpQueryTokenInformation(
+    _In_ HANDLE TokenHandle,
+    _In_ ULONG Fields,
+    _Inout_ PPH_TOKEN_CACHE_INFORMATION Information
+    )
+{
+    if (Fields & PH_TOKEN_CACHE_USER)
+    {
+        PTOKEN_USER user;
+
+        if (NT_SUCCESS(PhGetTokenUser(TokenHandle, &user)))
+        {
+            if (Information->UserName = PhGetSidFullName(user->User.Sid, TRUE, NULL))
+                Information->ValidFields |= PH_TOKEN_CACHE_USER;
+
+            PhFree(user);
+        }
+    }
+
+    if (Fields & PH_TOKEN_CACHE_ELEVATION)
+    {
+        if (NT_SUCCESS(PhGetTokenElevationType(TokenHandle, &Information->ElevationType)))
+            Information->ValidFields |= PH_TOKEN_CACHE_ELEVATION;
+    }
+
+    if (Fields & PH_TOKEN_CACHE_INTEGRITY)
+    {
+        if (NT_SUCCESS(PhGetTokenIntegrityLevel(TokenHandle, &Information->IntegrityLevel, &Information->IntegrityString)))
+            Information->ValidFields |= PH_TOKEN_CACHE_INTEGRITY;
+    }
+
+    if (Fields & PH_TOKEN_CACHE_VIRTUALIZATION)
+    {
+        BOOLEAN allowed;
+        BOOLEAN enabled;
+
+        if (NT_SUCCESS(PhGetTokenIsVirtualizationAllowed(TokenHandle, &allowed)))
+        {
+            if (!allowed)
+            {
+                Information->ValidFields |= PH_TOKEN_CACHE_VIRTUALIZATION;
+            }
+            else if (NT_SUCCESS(PhGetTokenIsVirtualizationEnabled(TokenHandle, &enabled)))
+            {
+                Information->VirtualizationAllowed = TRUE;
+                Information->VirtualizationEnabled = enabled;
+                Information->ValidFields |= PH_TOKEN_CACHE_VIRTUALIZATION;
+            }
+        }
+    }
+}
+
+static VOID PhpClearTokenCache(
+    VOID
+    )
+{
+    PPH_TOKEN_CACHE_ENTRY entry;
+    ULONG enumerationKey;
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpTokenCacheHashtable, &entry, &enumerationKey))
+        PhClearReference(&entry->Information.UserName);
+
+    PhClearHashtable(PhpTokenCacheHashtable);
+}
+
+/**
+ * Gets information about a token, using the token cache where possible.
+ *
+ * \param TokenHandle A handle to a token. The handle must have TOKEN_QUERY access.
+ * \param Fields The information to get (PH_TOKEN_CACHE_*).
+ * \param Information A variable which receives the information. ValidFields specifies which
+ * fields could be queried. If PH_TOKEN_CACHE_USER is valid, you must dereference UserName when
+ * you no longer need it.
+ */
+VOID PhQueryTokenCache(
+    _In_ HANDLE TokenHandle,
+    _In_ ULONG Fields,
+    _Out_ PPH_TOKEN_CACHE_INFORMATION Information
+    )
+{
+    TOKEN_STATISTICS statistics;
+    PH_TOKEN_CACHE_ENTRY lookupEntry;
+    PPH_TOKEN_CACHE_ENTRY entry;
+    ULONG missingFields;
+
+    memset(Information, 0, sizeof(PH_TOKEN_CACHE_INFORMATION));
+
+    if (!NT_SUCCESS(PhGetTokenStatistics(TokenHandle, &statistics)))
+    {
+        PhpQueryTokenInformation(TokenHandle, Fields, Information);
+        return;
+    }
+
+    lookupEntry.AuthenticationId = statistics.AuthenticationId;
+    lookupEntry.ModifiedId = statistics.ModifiedId;
+
+    PhAcquireQueuedLockShared(&PhpTokenCacheLock);
+
+    if (PhpTokenCacheHashtable && (entry = PhFindEntryHashtable(PhpTokenCacheHashtable, &lookupEntry)))
+        PhpCopyTokenCacheInformation(Information, &entry->Information, Fields);
+
+    PhReleaseQueuedLockShared(&PhpTokenCacheLock);
+
+    missingFields = Fields & ~Information->ValidFields;
+
+    if (missingFields == 0)
+        return;
+
+    // Fields that can't be queried are tried again next time, since this may be caused by the
+    // access we have to the token rather than by the token itself.
+    PhpQueryTokenInformation(TokenHandle, missingFields, Information);
+
+    if (!(missingFields & Information->ValidFields))
+        return;
+
+    PhAcquireQueuedLockExclusive(&PhpTokenCacheLock);
+
+    if (!PhpTokenCacheHashtable)
+    {
+        PhpTokenCacheHashtable = PhCreateHashtable(
+            sizeof(PH_TOKEN_CACHE_ENTRY),
+            PhpTokenCacheEqualFunction,
+            PhpTokenCacheHashFunction,
+            32
+            );
+    }
+
+    if (!(entry = PhFindEntryHashtable(PhpTokenCacheHashtable, &lookupEntry)))
+    {
+        // Tokens that were changed leave their old entries behind, so start again once there
+        // are too many.
+        if (PhpTokenCacheHashtable->Count >= PH_TOKEN_CACHE_MAXIMUM_ENTRIES)
+            PhpClearTokenCache();
+
+        memset(&lookupEntry.Information, 0, sizeof(PH_TOKEN_CACHE_INFORMATION));
+        entry = PhAddEntryHashtableEx(PhpTokenCacheHashtable, &lookupEntry, NULL);
+    }
+
+    PhpCopyTokenCacheInformation(&entry->Information, Information, missingFields & ~entry->Information.ValidFields);
+
+    PhReleaseQueuedLockExclusive(&PhpTokenCacheLock);
+}
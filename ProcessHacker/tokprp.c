@@ -25,6 +25,8 @@
 #include <emenu.h>
 #include <cpysave.h>
 
+#define WM_PH_SID_NAMES_RESOLVED (WM_APP + 101)
+
 typedef struct _ATTRIBUTE_NODE
 {
     PH_TREENEW_NODE Node;
@@ -46,6 +48,7 @@ typedef struct _TOKEN_PAGE_CONTEXT
 
     HWND GroupsListViewHandle;
     HWND PrivilegesListViewHandle;
+    PH_CALLBACK_REGISTRATION SidFullNamesResolvedRegistration;
 
     PTOKEN_GROUPS Groups;
     PTOKEN_PRIVILEGES Privileges;
@@ -347,7 +350,8 @@ BOOLEAN PhpUpdateTokenGroups(
         PPH_STRING fullName;
         PPH_STRING attributesString;
 
-        if (!(fullName = PhGetSidFullName(groups->Groups[i].Sid, TRUE, NULL)))
+        // Names that aren't cached are looked up in the background (see WM_PH_SID_NAMES_RESOLVED).
+        if (!PhGetSidFullNameAsync(groups->Groups[i].Sid, TRUE, &fullName) || !fullName)
             fullName = PhSidToStringSid(groups->Groups[i].Sid);
 
         if (fullName)
@@ -373,6 +377,45 @@ BOOLEAN PhpUpdateTokenGroups(
     return TRUE;
 }
 
+static VOID NTAPI PhpSidFullNamesResolvedHandler(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PostMessage((HWND)Context, WM_PH_SID_NAMES_RESOLVED, 0, 0);
+}
+
+VOID PhpUpdateTokenGroupNames(
+    _In_ HWND GroupsLv
+    )
+{
+    INT count;
+    INT i;
+    BOOLEAN changed;
+
+    count = ListView_GetItemCount(GroupsLv);
+    changed = FALSE;
+
+    for (i = 0; i < count; i++)
+    {
+        PSID_AND_ATTRIBUTES group;
+        PPH_STRING fullName;
+
+        if (!PhGetListViewItemParam(GroupsLv, i, &group))
+            continue;
+
+        if (PhGetSidFullNameAsync(group->Sid, TRUE, &fullName) && fullName)
+        {
+            PhSetListViewSubItem(GroupsLv, i, 0, fullName->Buffer);
+            PhDereferenceObject(fullName);
+            changed = TRUE;
+        }
+    }
+
+    if (changed)
+        ExtendedListView_SortItems(GroupsLv);
+}
+
 FORCEINLINE PTOKEN_PAGE_CONTEXT PhpTokenPageHeader(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -412,6 +455,13 @@ INT_PTR CALLBACK PhpTokenPageProc(
             HWND privilegesLv;
             HANDLE tokenHandle;
 
+            PhRegisterCallback(
+                &PhSidFullNamesResolvedEvent,
+                PhpSidFullNamesResolvedHandler,
+                hwndDlg,
+                &tokenPageContext->SidFullNamesResolvedRegistration
+                );
+
             tokenPageContext->GroupsListViewHandle = groupsLv = GetDlgItem(hwndDlg, IDC_GROUPS);
             tokenPageContext->PrivilegesListViewHandle = privilegesLv = GetDlgItem(hwndDlg, IDC_PRIVILEGES);
             PhSetListViewStyle(groupsLv, FALSE, TRUE);
@@ -578,6 +628,8 @@ INT_PTR CALLBACK PhpTokenPageProc(
         break;
     case WM_DESTROY:
         {
+            PhUnregisterCallback(&PhSidFullNamesResolvedEvent, &tokenPageContext->SidFullNamesResolvedRegistration);
+
             if (tokenPageContext->Groups) PhFree(tokenPageContext->Groups);
             if (tokenPageContext->Privileges) PhFree(tokenPageContext->Privileges);
         }
@@ -913,6 +965,11 @@ INT_PTR CALLBACK PhpTokenPageProc(
             }
         }
         break;
+    case WM_PH_SID_NAMES_RESOLVED:
+        {
+            PhpUpdateTokenGroupNames(tokenPageContext->GroupsListViewHandle);
+        }
+        break;
     }
 
     REFLECT_MESSAGE_DLG(hwndDlg, tokenPageContext->GroupsListViewHandle, uMsg, wParam, lParam);
@@ -17,6 +17,7 @@ copy ..\..\ProcessHacker\sdk\readme.txt ..\..\sdk\
 rem Header files
 
 for %%a in (
+    allocprof.h
     circbuf.h
     circbuf_h.h
     cpysave.h
@@ -28,6 +29,7 @@ for %%a in (
     hexedit.h
     kphapi.h
     kphuser.h
+    lockprof.h
     ntbasic.h
     ntcm.h
     ntdbg.h
@@ -58,6 +60,7 @@ for %%a in (
     ntwow64.h
     ntxcapi.h
     ntzwapi.h
+    ohashtbl_h.h
     ph.h
     phbase.h
     phgui.h
@@ -70,6 +73,7 @@ for %%a in (
     ref.h
     secedit.h
     symprv.h
+    tarray_h.h
     templ.h
     treenew.h
     verify.h
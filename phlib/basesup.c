@@ -25,7 +25,9 @@
  *
  * Memory allocation. PhAllocate is a wrapper around RtlAllocateHeap, and always allocates
  * from the phlib heap. PhAllocatePage is a wrapper around NtAllocateVirtualMemory and allocates
- * pages.
+ * pages. In builds with PH_ALLOCATION_PROFILING, allocations and object creations are counted
+ * per call site in a table with open addressing whose entries are claimed with a compare-exchange
+ * and never released, so recording an allocation doesn't need a lock or an allocation of its own.
  *
  * Null-terminated strings. The Ph*StringZ functions manipulate null-terminated strings. The
  * copying functions provide a simple way to copy strings which may not be null-terminated, but
@@ -64,11 +66,11 @@
 
 #include <phbase.h>
 #include <phintrnl.h>
+#include <refp.h>
 #include <math.h>
 
-#define PH_VECTOR_LEVEL_NONE 0
-#define PH_VECTOR_LEVEL_SSE2 1
-#define PH_VECTOR_LEVEL_AVX 2
+#define PH_STRING_INTERN_SHARD_COUNT 16
+#define PH_ALLOCATION_SITE_MAXIMUM_PROBES 32
 
 typedef struct _PHP_BASE_THREAD_CONTEXT
 {
@@ -76,6 +78,21 @@ typedef struct _PHP_BASE_THREAD_CONTEXT
     PVOID Parameter;
 } PHP_BASE_THREAD_CONTEXT, *PPHP_BASE_THREAD_CONTEXT;
 
+typedef struct _PHP_STRING_INTERN_SHARD
+{
+    PH_QUEUED_LOCK Lock;
+    PPH_HASHTABLE Hashtable; // PPH_STRINGREF entries pointing into interned strings
+} PHP_STRING_INTERN_SHARD, *PPHP_STRING_INTERN_SHARD;
+
+#ifdef PH_ALLOCATION_PROFILING
+typedef struct _PHP_ALLOCATION_SITE_ENTRY
+{
+    volatile LONG64 Key; // type index in the upper 16 bits, caller address in the rest
+    volatile LONG64 Count;
+    volatile LONG64 Bytes;
+} PHP_ALLOCATION_SITE_ENTRY, *PPHP_ALLOCATION_SITE_ENTRY;
+#endif
+
 VOID NTAPI PhpListDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
@@ -96,6 +113,15 @@ VOID NTAPI PhpHashtableDeleteProcedure(
     _In_ ULONG Flags
     );
 
+BOOLEAN NTAPI PhpStringInternCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    );
+
+ULONG NTAPI PhpStringInternHashFunction(
+    _In_ PVOID Entry
+    );
+
 // Types
 
 PPH_OBJECT_TYPE PhStringType;
@@ -106,9 +132,65 @@ PPH_OBJECT_TYPE PhHashtableType;
 
 // Misc.
 
-static BOOLEAN PhpVectorLevel = PH_VECTOR_LEVEL_NONE;
+BOOLEAN PhpVectorLevel = PH_VECTOR_LEVEL_NONE;
 static PPH_STRING PhSharedEmptyString = NULL;
 
+// String interning
+
+static PHP_STRING_INTERN_SHARD PhpStringInternShards[PH_STRING_INTERN_SHARD_COUNT];
+
+// Allocation profiling
+
+#ifdef PH_ALLOCATION_PROFILING
+static PHP_ALLOCATION_SITE_ENTRY PhpAllocationSites[PH_ALLOCATION_SITE_COUNT];
+static PHP_ALLOCATION_SITE_ENTRY PhpAllocationSiteOverflow; // sites that could not be added to the table
+#endif
+
+// Vector helpers
+
+/**
+ * Determines whether a block of 8 UTF-16 code units contains only ASCII characters.
+ */
+FORCEINLINE BOOLEAN PhpIsAsciiBlock(
+    _In_ __m128i Block
+    )
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(Block, _mm_set1_epi16((SHORT)0xff80)), _mm_setzero_si128())) == 0xffff;
+}
+
+/**
+ * Converts 'a'-'z' to 'A'-'Z' in a block of 8 UTF-16 code units. For blocks of ASCII
+ * characters this gives the same result as RtlUpcaseUnicodeChar.
+ */
+FORCEINLINE __m128i PhpUpcaseAsciiBlock(
+    _In_ __m128i Block
+    )
+{
+    __m128i lower;
+
+    lower = _mm_and_si128(_mm_cmpgt_epi16(Block, _mm_set1_epi16('a' - 1)), _mm_cmplt_epi16(Block, _mm_set1_epi16('z' + 1)));
+
+    return _mm_sub_epi16(Block, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+}
+
+FORCEINLINE BOOLEAN PhpIsAsciiBlock256(
+    _In_ __m256i Block
+    )
+{
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(Block, _mm256_set1_epi16((SHORT)0xff80)), _mm256_setzero_si256())) == 0xffffffff;
+}
+
+FORCEINLINE __m256i PhpUpcaseAsciiBlock256(
+    _In_ __m256i Block
+    )
+{
+    __m256i lower;
+
+    lower = _mm256_and_si256(_mm256_cmpgt_epi16(Block, _mm256_set1_epi16('a' - 1)), _mm256_cmpgt_epi16(_mm256_set1_epi16('z' + 1), Block));
+
+    return _mm256_sub_epi16(Block, _mm256_and_si256(lower, _mm256_set1_epi16(0x20)));
+}
+
 // Threads
 
 static PH_FREE_LIST PhpBaseThreadContextFreeList;
@@ -140,14 +222,31 @@ BOOLEAN PhInitializeBase(
     )
 {
     PH_OBJECT_TYPE_PARAMETERS parameters;
+    ULONG i;
 
-    // The following relies on the (technically undefined) value of XState being zero before Windows 7 SP1.
-    // NOTE: This is unused for now.
-    /*if (USER_SHARED_DATA->XState.EnabledFeatures & XSTATE_MASK_AVX)
-        PhpVectorLevel = PH_VECTOR_LEVEL_AVX;
-    else*/ if (USER_SHARED_DATA->ProcessorFeatures[PF_XMMI64_INSTRUCTIONS_AVAILABLE])
+    if (USER_SHARED_DATA->ProcessorFeatures[PF_XMMI64_INSTRUCTIONS_AVAILABLE])
         PhpVectorLevel = PH_VECTOR_LEVEL_SSE2;
 
+    // The following relies on the (technically undefined) value of XState being zero before Windows 7 SP1.
+    // The OS must save the YMM state (XSTATE_MASK_AVX) before we can use AVX2 (CPUID.7.0:EBX[5]).
+    if (
+        PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2 &&
+        (USER_SHARED_DATA->XState.EnabledFeatures & XSTATE_MASK_AVX)
+        )
+    {
+        INT cpuInfo[4];
+
+        __cpuid(cpuInfo, 0);
+
+        if (cpuInfo[0] >= 7)
+        {
+            __cpuidex(cpuInfo, 7, 0);
+
+            if (cpuInfo[1] & 0x20)
+                PhpVectorLevel = PH_VECTOR_LEVEL_AVX2;
+        }
+    }
+
     PhStringType = PhCreateObjectType(L"String", 0, NULL);
     PhBytesType = PhCreateObjectType(L"Bytes", 0, NULL);
 
@@ -162,6 +261,17 @@ BOOLEAN PhInitializeBase(
 
     PhHashtableType = PhCreateObjectTypeEx(L"Hashtable", PH_OBJECT_TYPE_USE_FREE_LIST, PhpHashtableDeleteProcedure, &parameters);
 
+    for (i = 0; i < PH_STRING_INTERN_SHARD_COUNT; i++)
+    {
+        PhInitializeQueuedLock(&PhpStringInternShards[i].Lock);
+        PhpStringInternShards[i].Hashtable = PhCreateHashtable(
+            sizeof(PPH_STRINGREF),
+            PhpStringInternCompareFunction,
+            PhpStringInternHashFunction,
+            64
+            );
+    }
+
     PhInitializeFreeList(&PhpBaseThreadContextFreeList, sizeof(PHP_BASE_THREAD_CONTEXT), 16);
 
 #ifdef DEBUG
@@ -217,6 +327,8 @@ NTSTATUS PhpBaseThreadStart(
     if (result == S_OK || result == S_FALSE)
         CoUninitialize();
 
+    PhFlushObjectThreadCache();
+
 #ifdef DEBUG
     PhAcquireQueuedLockExclusive(&PhDbgThreadListLock);
     RemoveEntryList(&dbg.ListEntry);
@@ -362,6 +474,10 @@ PVOID PhAllocate(
     _In_ SIZE_T Size
     )
 {
+#ifdef PH_ALLOCATION_PROFILING
+    PhfRecordAllocation(_ReturnAddress(), PH_ALLOCATION_SITE_NO_TYPE, Size);
+#endif
+
     return RtlAllocateHeap(PhHeapHandle, HEAP_GENERATE_EXCEPTIONS, Size);
 }
 
@@ -377,6 +493,10 @@ PVOID PhAllocateSafe(
     _In_ SIZE_T Size
     )
 {
+#ifdef PH_ALLOCATION_PROFILING
+    PhfRecordAllocation(_ReturnAddress(), PH_ALLOCATION_SITE_NO_TYPE, Size);
+#endif
+
     return RtlAllocateHeap(PhHeapHandle, 0, Size);
 }
 
@@ -394,6 +514,10 @@ PVOID PhAllocateExSafe(
     _In_ ULONG Flags
     )
 {
+#ifdef PH_ALLOCATION_PROFILING
+    PhfRecordAllocation(_ReturnAddress(), PH_ALLOCATION_SITE_NO_TYPE, Size);
+#endif
+
     return RtlAllocateHeap(PhHeapHandle, Flags, Size);
 }
 
@@ -456,6 +580,106 @@ PVOID PhReAllocateSafe(
     return RtlReAllocateHeap(PhHeapHandle, 0, Memory, Size);
 }
 
+#ifdef PH_ALLOCATION_PROFILING
+
+/**
+ * Records an allocation.
+ *
+ * \param CallerAddress The return address of the call that made the allocation.
+ * \param TypeIndex The index of the type of the allocated object, or PH_ALLOCATION_SITE_NO_TYPE
+ * for a heap allocation.
+ * \param Size The size of the allocation, in bytes.
+ */
+VOID FASTCALL PhfRecordAllocation(
+    _In_ PVOID CallerAddress,
+    _In_ USHORT TypeIndex,
+    _In_ SIZE_T Size
+    )
+{
+    LONG64 key;
+    ULONG index;
+    ULONG i;
+    PPHP_ALLOCATION_SITE_ENTRY entry;
+
+    // User-mode addresses never use the upper 16 bits.
+    key = (LONG64)(((ULONG64)TypeIndex << 48) | (ULONG_PTR)CallerAddress);
+    index = PhHashInt64(key);
+    entry = &PhpAllocationSiteOverflow;
+
+    for (i = 0; i < PH_ALLOCATION_SITE_MAXIMUM_PROBES; i++)
+    {
+        PPHP_ALLOCATION_SITE_ENTRY site;
+        LONG64 siteKey;
+
+        site = &PhpAllocationSites[(index + i) & (PH_ALLOCATION_SITE_COUNT - 1)];
+        siteKey = site->Key;
+
+        if (siteKey == 0 && (siteKey = _InterlockedCompareExchange64(&site->Key, key, 0)) == 0)
+            siteKey = key; // we claimed the entry
+
+        if (siteKey == key)
+        {
+            entry = site;
+            break;
+        }
+    }
+
+    _InterlockedIncrement64(&entry->Count);
+    _InterlockedExchangeAdd64(&entry->Bytes, Size);
+}
+
+/**
+ * Copies the allocation sites that have been recorded.
+ *
+ * \param Sites An array which receives the allocation sites.
+ * \param Count The number of elements in \a Sites. Specify PH_ALLOCATION_SITE_COUNT + 1 to
+ * receive all sites.
+ *
+ * \return The number of allocation sites copied.
+ *
+ * \remarks Sites are always returned in the same order, and a site never disappears once it
+ * has been recorded. Allocations from sites that did not fit in the table are returned last,
+ * as a site with a NULL caller address.
+ */
+ULONG NTAPI PhGetAllocationSites(
+    _Out_writes_to_(Count, return) PPH_ALLOCATION_SITE Sites,
+    _In_ ULONG Count
+    )
+{
+    ULONG count = 0;
+    ULONG i;
+
+    for (i = 0; i < PH_ALLOCATION_SITE_COUNT && count < Count; i++)
+    {
+        ULONG64 key;
+
+        // Read the key atomically, even on 32-bit systems.
+        key = _InterlockedCompareExchange64(&PhpAllocationSites[i].Key, 0, 0);
+
+        if (key == 0)
+            continue;
+
+        Sites[count].CallerAddress = (PVOID)(ULONG_PTR)(key & 0xffffffffffff);
+        Sites[count].TypeIndex = (USHORT)(key >> 48);
+        Sites[count].Count = PhpAllocationSites[i].Count;
+        Sites[count].Bytes = PhpAllocationSites[i].Bytes;
+        count++;
+    }
+
+    if (count < Count && PhpAllocationSiteOverflow.Count != 0)
+    {
+        Sites[count].CallerAddress = NULL;
+        Sites[count].TypeIndex = PH_ALLOCATION_SITE_NO_TYPE;
+        Sites[count].Count = PhpAllocationSiteOverflow.Count;
+        Sites[count].Bytes = PhpAllocationSiteOverflow.Bytes;
+        count++;
+    }
+
+    return count;
+}
+
+#endif
+
 /**
  * Allocates pages of memory.
  *
@@ -1134,6 +1358,94 @@ LONG PhCompareStringZNatural(
         return PhpCompareStringZNatural(A, B, TRUE);
 }
 
+/**
+ * Creates a key for sorting a string in natural order.
+ *
+ * \param String The string.
+ * \param IgnoreCase Whether to ignore character cases.
+ *
+ * \return A key which can be compared with other keys using PhCompareNaturalSortKey(). Runs of
+ * digits are ordered by their numeric value and spaces are ignored. Creating keys once and
+ * comparing them is much faster than calling PhCompareStringZNatural() repeatedly, which parses
+ * the digit runs and folds the case of each character on every comparison.
+ */
+PPH_BYTES PhCreateNaturalSortKey(
+    _In_ PPH_STRINGREF String,
+    _In_ BOOLEAN IgnoreCase
+    )
+{
+    PWCHAR buffer;
+    SIZE_T count;
+    PUCHAR key;
+    SIZE_T length;
+    SIZE_T i;
+    PPH_BYTES bytes;
+
+    buffer = String->Buffer;
+    count = String->Length / sizeof(WCHAR);
+    i = 0;
+    length = 0;
+
+    // A character takes 2 bytes, and a run of digits takes 6 bytes plus 1 byte for each
+    // significant digit.
+    key = PhAllocate(count * 7 + 1);
+
+    while (i < count)
+    {
+        WCHAR c = buffer[i];
+
+        if (c == ' ')
+        {
+            i++;
+            continue;
+        }
+
+        if (PhIsDigitCharacter(c))
+        {
+            SIZE_T zeros = 0;
+            SIZE_T digits = 0;
+
+            while (i < count && buffer[i] == '0')
+            {
+                zeros++;
+                i++;
+            }
+
+            while (i + digits < count && PhIsDigitCharacter(buffer[i + digits]))
+                digits++;
+
+            // The number is placed where the '0' character would be. Numbers are ordered by
+            // the number of significant digits and then by the digits themselves. Leading zeros
+            // only break ties.
+
+            key[length++] = 0;
+            key[length++] = '0';
+            key[length++] = (UCHAR)(min(digits, 0xffff) >> 8);
+            key[length++] = (UCHAR)min(digits, 0xffff);
+
+            for (; digits != 0; digits--)
+                key[length++] = (UCHAR)buffer[i++];
+
+            key[length++] = (UCHAR)(min(zeros, 0xffff) >> 8);
+            key[length++] = (UCHAR)min(zeros, 0xffff);
+        }
+        else
+        {
+            if (IgnoreCase)
+                c = RtlUpcaseUnicodeChar(c);
+
+            key[length++] = (UCHAR)(c >> 8);
+            key[length++] = (UCHAR)c;
+            i++;
+        }
+    }
+
+    bytes = PhCreateBytesEx((PCHAR)key, length);
+    PhFree(key);
+
+    return bytes;
+}
+
 /**
  * Compares two strings.
  *
@@ -1168,6 +1480,53 @@ LONG PhCompareStringRef(
 
     end = (PWCHAR)((PCHAR)s1 + (l1 <= l2 ? l1 : l2));
 
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        SIZE_T length16;
+        __m128i b1;
+        __m128i b2;
+        ULONG mask;
+        ULONG index;
+
+        length16 = (l1 <= l2 ? l1 : l2) / 16;
+
+        while (length16 != 0)
+        {
+            b1 = _mm_loadu_si128((__m128i *)s1);
+            b2 = _mm_loadu_si128((__m128i *)s2);
+            mask = _mm_movemask_epi8(_mm_cmpeq_epi16(b1, b2));
+
+            if (mask != 0xffff)
+            {
+                if (!IgnoreCase)
+                {
+                    _BitScanForward(&index, ~mask);
+                    index /= sizeof(WCHAR);
+
+                    return (LONG)s1[index] - (LONG)s2[index];
+                }
+
+                // Only ASCII blocks can be case-folded here; compare the rest character-by-character.
+                if (!PhpIsAsciiBlock(_mm_or_si128(b1, b2)))
+                    break;
+
+                mask = _mm_movemask_epi8(_mm_cmpeq_epi16(PhpUpcaseAsciiBlock(b1), PhpUpcaseAsciiBlock(b2)));
+
+                if (mask != 0xffff)
+                {
+                    _BitScanForward(&index, ~mask);
+                    index /= sizeof(WCHAR);
+
+                    return (LONG)RtlUpcaseUnicodeChar(s1[index]) - (LONG)RtlUpcaseUnicodeChar(s2[index]);
+                }
+            }
+
+            s1 += 16 / sizeof(WCHAR);
+            s2 += 16 / sizeof(WCHAR);
+            length16--;
+        }
+    }
+
     if (!IgnoreCase)
     {
         while (s1 != end)
@@ -1252,14 +1611,18 @@ BOOLEAN PhEqualStringRef(
             {
                 b1 = _mm_loadu_si128((__m128i *)s1);
                 b2 = _mm_loadu_si128((__m128i *)s2);
-                b1 = _mm_cmpeq_epi32(b1, b2);
 
-                if (_mm_movemask_epi8(b1) != 0xffff)
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(b1, b2)) != 0xffff)
                 {
                     if (!IgnoreCase)
                     {
                         return FALSE;
                     }
+                    else if (PhpIsAsciiBlock(_mm_or_si128(b1, b2)))
+                    {
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi16(PhpUpcaseAsciiBlock(b1), PhpUpcaseAsciiBlock(b2))) != 0xffff)
+                            return FALSE;
+                    }
                     else
                     {
                         // Compare character-by-character to ignore case.
@@ -1420,12 +1783,50 @@ ULONG_PTR PhFindCharInStringRef(
     }
     else
     {
-        if (length != 0)
+        WCHAR c;
+
+        c = RtlUpcaseUnicodeChar(Character);
+
+        if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2 && length >= 8)
         {
-            WCHAR c;
+            __m128i upperPattern;
+            __m128i lowerPattern;
+            __m128i block;
+            ULONG mask;
+            ULONG index;
 
-            c = RtlUpcaseUnicodeChar(Character);
+            // An ASCII character can only match c or its lowercase form. Blocks with other
+            // characters are searched character-by-character.
+            upperPattern = _mm_set1_epi16(c);
+            lowerPattern = _mm_set1_epi16(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+
+            do
+            {
+                block = _mm_loadu_si128((__m128i *)buffer);
 
+                if (PhpIsAsciiBlock(block))
+                {
+                    mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(block, upperPattern), _mm_cmpeq_epi16(block, lowerPattern)));
+
+                    if (_BitScanForward(&index, mask))
+                        return buffer - String->Buffer + index / 2;
+                }
+                else
+                {
+                    for (index = 0; index < 8; index++)
+                    {
+                        if (RtlUpcaseUnicodeChar(buffer[index]) == c)
+                            return buffer - String->Buffer + index;
+                    }
+                }
+
+                buffer += 8;
+                length -= 8;
+            } while (length >= 8);
+        }
+
+        if (length != 0)
+        {
             do
             {
                 if (RtlUpcaseUnicodeChar(*buffer) == c)
@@ -1532,69 +1933,232 @@ ULONG_PTR PhFindLastCharInStringRef(
 }
 
 /**
- * Locates a string in a string.
+ * Locates a string in a string using first and last character filtering.
  *
  * \param String The string to search.
- * \param SubString The string to search for.
- * \param IgnoreCase TRUE to perform a case-insensitive search, otherwise
- * FALSE.
+ * \param SubString The string to search for. This must not be empty or longer than \a String.
+ * \param IgnoreCase TRUE to perform a case-insensitive search, otherwise FALSE.
+ * \param Index A variable which receives the index of the match, or the index of the first
+ * position which was not examined if no match was found.
  *
- * \return The index, in characters, of the first occurrence of
- * \a SubString in \a String. If \a SubString was not found, -1 is returned.
+ * \return TRUE if \a SubString was found, otherwise FALSE.
  */
-ULONG_PTR PhFindStringInStringRef(
+static BOOLEAN PhpFindStringInStringRefVector(
     _In_ PPH_STRINGREF String,
     _In_ PPH_STRINGREF SubString,
-    _In_ BOOLEAN IgnoreCase
+    _In_ BOOLEAN IgnoreCase,
+    _Out_ PSIZE_T Index
     )
 {
-    SIZE_T length1;
-    SIZE_T length2;
-    PH_STRINGREF sr1;
-    PH_STRINGREF sr2;
-    WCHAR c;
+    PWCHAR buffer;
+    SIZE_T last;
+    SIZE_T count;
     SIZE_T i;
+    WCHAR firstChar;
+    WCHAR lastChar;
+    ULONG mask;
+    ULONG index;
+    PH_STRINGREF candidate;
 
-    length1 = String->Length / sizeof(WCHAR);
-    length2 = SubString->Length / sizeof(WCHAR);
+    buffer = String->Buffer;
+    last = SubString->Length / sizeof(WCHAR) - 1;
+    count = String->Length / sizeof(WCHAR) - last; // number of possible positions
+    firstChar = SubString->Buffer[0];
+    lastChar = SubString->Buffer[last];
+    candidate.Length = SubString->Length;
+    i = 0;
 
-    // Can't be a substring if it's bigger than the first string.
-    if (length2 > length1)
-        return -1;
-    // We always get a match if the substring is zero-length.
-    if (length2 == 0)
-        return 0;
+    if (IgnoreCase)
+    {
+        firstChar = RtlUpcaseUnicodeChar(firstChar);
+        lastChar = RtlUpcaseUnicodeChar(lastChar);
+    }
 
-    sr1.Buffer = String->Buffer;
-    sr1.Length = SubString->Length - sizeof(WCHAR);
-    sr2.Buffer = SubString->Buffer;
-    sr2.Length = SubString->Length - sizeof(WCHAR);
+    // For each block of positions, find those where both the first and the last character of
+    // the substring match and only compare the whole substring there. Blocks with non-ASCII
+    // characters can't be case-folded here, so every position in them is compared.
 
-    if (!IgnoreCase)
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2 && count >= 16)
     {
-        c = *sr2.Buffer++;
+        __m256i firstPattern;
+        __m256i lastPattern;
+        __m256i firstBlock;
+        __m256i lastBlock;
 
-        for (i = length1 - length2 + 1; i != 0; i--)
+        firstPattern = _mm256_set1_epi16(firstChar);
+        lastPattern = _mm256_set1_epi16(lastChar);
+
+        for (; i + 16 <= count; i += 16)
         {
-            if (*sr1.Buffer++ == c && PhEqualStringRef(&sr1, &sr2, FALSE))
+            firstBlock = _mm256_loadu_si256((__m256i *)&buffer[i]);
+            lastBlock = _mm256_loadu_si256((__m256i *)&buffer[i + last]);
+
+            if (!IgnoreCase)
             {
-                goto FoundUString;
+                mask = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi16(firstBlock, firstPattern),
+                    _mm256_cmpeq_epi16(lastBlock, lastPattern)
+                    ));
             }
-        }
-    }
-    else
-    {
-        c = RtlUpcaseUnicodeChar(*sr2.Buffer++);
-
-        for (i = length1 - length2 + 1; i != 0; i--)
-        {
-            if (RtlUpcaseUnicodeChar(*sr1.Buffer++) == c && PhEqualStringRef(&sr1, &sr2, TRUE))
+            else if (PhpIsAsciiBlock256(_mm256_or_si256(firstBlock, lastBlock)))
             {
-                goto FoundUString;
+                mask = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi16(PhpUpcaseAsciiBlock256(firstBlock), firstPattern),
+                    _mm256_cmpeq_epi16(PhpUpcaseAsciiBlock256(lastBlock), lastPattern)
+                    ));
             }
-        }
-    }
-
+            else
+            {
+                mask = 0xffffffff;
+            }
+
+            while (_BitScanForward(&index, mask))
+            {
+                candidate.Buffer = &buffer[i + index / 2];
+
+                if (PhEqualStringRef(&candidate, SubString, IgnoreCase))
+                {
+                    _mm256_zeroupper();
+                    *Index = i + index / 2;
+                    return TRUE;
+                }
+
+                mask &= ~(3UL << index);
+            }
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (count >= 8)
+    {
+        __m128i firstPattern;
+        __m128i lastPattern;
+        __m128i firstBlock;
+        __m128i lastBlock;
+
+        firstPattern = _mm_set1_epi16(firstChar);
+        lastPattern = _mm_set1_epi16(lastChar);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            firstBlock = _mm_loadu_si128((__m128i *)&buffer[i]);
+            lastBlock = _mm_loadu_si128((__m128i *)&buffer[i + last]);
+
+            if (!IgnoreCase)
+            {
+                mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi16(firstBlock, firstPattern),
+                    _mm_cmpeq_epi16(lastBlock, lastPattern)
+                    ));
+            }
+            else if (PhpIsAsciiBlock(_mm_or_si128(firstBlock, lastBlock)))
+            {
+                mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi16(PhpUpcaseAsciiBlock(firstBlock), firstPattern),
+                    _mm_cmpeq_epi16(PhpUpcaseAsciiBlock(lastBlock), lastPattern)
+                    ));
+            }
+            else
+            {
+                mask = 0xffff;
+            }
+
+            while (_BitScanForward(&index, mask))
+            {
+                candidate.Buffer = &buffer[i + index / 2];
+
+                if (PhEqualStringRef(&candidate, SubString, IgnoreCase))
+                {
+                    *Index = i + index / 2;
+                    return TRUE;
+                }
+
+                mask &= ~(3UL << index);
+            }
+        }
+    }
+
+    *Index = i;
+
+    return FALSE;
+}
+
+/**
+ * Locates a string in a string.
+ *
+ * \param String The string to search.
+ * \param SubString The string to search for.
+ * \param IgnoreCase TRUE to perform a case-insensitive search, otherwise
+ * FALSE.
+ *
+ * \return The index, in characters, of the first occurrence of
+ * \a SubString in \a String. If \a SubString was not found, -1 is returned.
+ */
+ULONG_PTR PhFindStringInStringRef(
+    _In_ PPH_STRINGREF String,
+    _In_ PPH_STRINGREF SubString,
+    _In_ BOOLEAN IgnoreCase
+    )
+{
+    SIZE_T length1;
+    SIZE_T length2;
+    PH_STRINGREF sr1;
+    PH_STRINGREF sr2;
+    WCHAR c;
+    SIZE_T i;
+    SIZE_T start;
+
+    length1 = String->Length / sizeof(WCHAR);
+    length2 = SubString->Length / sizeof(WCHAR);
+
+    // Can't be a substring if it's bigger than the first string.
+    if (length2 > length1)
+        return -1;
+    // We always get a match if the substring is zero-length.
+    if (length2 == 0)
+        return 0;
+
+    start = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        // The vector search examines most positions; only the last few are left for the
+        // loops below.
+        if (PhpFindStringInStringRefVector(String, SubString, IgnoreCase, &start))
+            return start;
+    }
+
+    sr1.Buffer = String->Buffer + start;
+    sr1.Length = SubString->Length - sizeof(WCHAR);
+    sr2.Buffer = SubString->Buffer;
+    sr2.Length = SubString->Length - sizeof(WCHAR);
+
+    if (!IgnoreCase)
+    {
+        c = *sr2.Buffer++;
+
+        for (i = length1 - length2 + 1 - start; i != 0; i--)
+        {
+            if (*sr1.Buffer++ == c && PhEqualStringRef(&sr1, &sr2, FALSE))
+            {
+                goto FoundUString;
+            }
+        }
+    }
+    else
+    {
+        c = RtlUpcaseUnicodeChar(*sr2.Buffer++);
+
+        for (i = length1 - length2 + 1 - start; i != 0; i--)
+        {
+            if (RtlUpcaseUnicodeChar(*sr1.Buffer++) == c && PhEqualStringRef(&sr1, &sr2, TRUE))
+            {
+                goto FoundUString;
+            }
+        }
+    }
+
     return -1;
 FoundUString:
     return (ULONG_PTR)(sr1.Buffer - String->Buffer - 1);
@@ -2224,6 +2788,153 @@ PPH_STRING PhReferenceEmptyString(
     return PhReferenceObject(string);
 }
 
+BOOLEAN NTAPI PhpStringInternCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return PhEqualStringRef(*(PPH_STRINGREF *)Entry1, *(PPH_STRINGREF *)Entry2, FALSE);
+}
+
+ULONG NTAPI PhpStringInternHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashStringRef(*(PPH_STRINGREF *)Entry, FALSE);
+}
+
+FORCEINLINE PPHP_STRING_INTERN_SHARD PhpGetStringInternShard(
+    _In_ PPH_STRINGREF String
+    )
+{
+    // Use the high bits so entries within a shard still spread across its buckets.
+    return &PhpStringInternShards[(PhHashStringRef(String, FALSE) >> 24) % PH_STRING_INTERN_SHARD_COUNT];
+}
+
+static PPH_STRING PhpInternString(
+    _In_ PPH_STRINGREF String,
+    _In_opt_ PPH_STRING Candidate
+    )
+{
+    PPHP_STRING_INTERN_SHARD shard;
+    PPH_STRINGREF key;
+    PPH_STRINGREF *entry;
+    PPH_STRING string = NULL;
+    PPH_STRING existingString = NULL;
+    BOOLEAN added;
+
+    shard = PhpGetStringInternShard(String);
+    key = String;
+
+    PhAcquireQueuedLockShared(&shard->Lock);
+
+    if (entry = PhFindEntryHashtable(shard->Hashtable, &key))
+    {
+        string = CONTAINING_RECORD(*entry, PH_STRING, sr);
+
+        // The entry may belong to a string that is being deleted.
+        if (!PhReferenceObjectSafe(string))
+            string = NULL;
+    }
+
+    PhReleaseQueuedLockShared(&shard->Lock);
+
+    if (string)
+        return string;
+
+    if (Candidate && !(PhObjectToObjectHeader(Candidate)->Flags & PH_OBJECT_INTERNED))
+        string = PhReferenceObject(Candidate);
+    else
+        string = PhCreateString2(String);
+
+    key = &string->sr;
+
+    PhAcquireQueuedLockExclusive(&shard->Lock);
+
+    entry = PhAddEntryHashtableEx(shard->Hashtable, &key, &added);
+
+    if (!added)
+    {
+        existingString = CONTAINING_RECORD(*entry, PH_STRING, sr);
+
+        if (PhReferenceObjectSafe(existingString))
+        {
+            // Someone else interned the string first.
+        }
+        else
+        {
+            // Take over the entry of the dying string. PhpRemoveInternedString will
+            // see that the entry no longer belongs to it.
+            *entry = key;
+            existingString = NULL;
+        }
+    }
+
+    if (!existingString)
+        PhObjectToObjectHeader(string)->Flags |= PH_OBJECT_INTERNED;
+
+    PhReleaseQueuedLockExclusive(&shard->Lock);
+
+    if (existingString)
+    {
+        PhDereferenceObject(string);
+        return existingString;
+    }
+
+    return string;
+}
+
+/**
+ * Gets a shared string with the same contents as the specified string.
+ *
+ * \param String The string to intern. If no equal string has been
+ * interned yet, this string becomes the shared instance.
+ *
+ * \return A referenced string equal to \a String. Interned strings
+ * are weakly referenced by the intern table and are removed from it
+ * when their last reference is released.
+ */
+PPH_STRING PhInternString(
+    _In_ PPH_STRING String
+    )
+{
+    return PhpInternString(&String->sr, String);
+}
+
+/**
+ * Gets a shared string with the specified contents.
+ *
+ * \param String The contents of the string.
+ *
+ * \return A referenced string equal to \a String.
+ */
+PPH_STRING PhInternStringRef(
+    _In_ PPH_STRINGREF String
+    )
+{
+    return PhpInternString(String, NULL);
+}
+
+VOID PhpRemoveInternedString(
+    _In_ PPH_STRING String
+    )
+{
+    PPHP_STRING_INTERN_SHARD shard;
+    PPH_STRINGREF key;
+    PPH_STRINGREF *entry;
+
+    shard = PhpGetStringInternShard(&String->sr);
+    key = &String->sr;
+
+    PhAcquireQueuedLockExclusive(&shard->Lock);
+
+    // Only remove the entry if it hasn't been taken over by a newer string.
+    if ((entry = PhFindEntryHashtable(shard->Hashtable, &key)) && *entry == key)
+        PhRemoveEntryHashtable(shard->Hashtable, &key);
+
+    PhReleaseQueuedLockExclusive(&shard->Lock);
+}
+
 /**
  * Concatenates multiple strings.
  *
@@ -3104,6 +3815,96 @@ PPH_BYTES PhConvertUtf16ToMultiByteEx(
     return bytes;
 }
 
+/**
+ * Copies the run of ASCII characters at the start of a UTF-8 string to a UTF-16 string.
+ *
+ * \param Utf16String The output buffer. Specify NULL to only count the characters.
+ * \param Utf8String The input string.
+ * \param Count The maximum number of characters to copy.
+ *
+ * \return The number of characters copied.
+ */
+static SIZE_T PhpCopyAsciiUtf8ToUtf16(
+    _Out_writes_opt_(Count) PWCH Utf16String,
+    _In_reads_(Count) PCH Utf8String,
+    _In_ SIZE_T Count
+    )
+{
+    SIZE_T i = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128i block;
+        __m128i zero;
+
+        zero = _mm_setzero_si128();
+
+        for (; i + 16 <= Count; i += 16)
+        {
+            block = _mm_loadu_si128((__m128i *)&Utf8String[i]);
+
+            if (_mm_movemask_epi8(block) != 0)
+                break;
+
+            if (Utf16String)
+            {
+                _mm_storeu_si128((__m128i *)&Utf16String[i], _mm_unpacklo_epi8(block, zero));
+                _mm_storeu_si128((__m128i *)&Utf16String[i + 8], _mm_unpackhi_epi8(block, zero));
+            }
+        }
+    }
+
+    for (; i < Count && (UCHAR)Utf8String[i] < 0x80; i++)
+    {
+        if (Utf16String)
+            Utf16String[i] = Utf8String[i];
+    }
+
+    return i;
+}
+
+/**
+ * Copies the run of ASCII characters at the start of a UTF-16 string to a UTF-8 string.
+ *
+ * \param Utf8String The output buffer. Specify NULL to only count the characters.
+ * \param Utf16String The input string.
+ * \param Count The maximum number of characters to copy.
+ *
+ * \return The number of characters copied.
+ */
+static SIZE_T PhpCopyAsciiUtf16ToUtf8(
+    _Out_writes_opt_(Count) PCH Utf8String,
+    _In_reads_(Count) PWCH Utf16String,
+    _In_ SIZE_T Count
+    )
+{
+    SIZE_T i = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128i block;
+
+        for (; i + 8 <= Count; i += 8)
+        {
+            block = _mm_loadu_si128((__m128i *)&Utf16String[i]);
+
+            if (!PhpIsAsciiBlock(block))
+                break;
+
+            if (Utf8String)
+                _mm_storel_epi64((__m128i *)&Utf8String[i], _mm_packus_epi16(block, block));
+        }
+    }
+
+    for (; i < Count && Utf16String[i] < 0x80; i++)
+    {
+        if (Utf8String)
+            Utf8String[i] = (CHAR)Utf16String[i];
+    }
+
+    return i;
+}
+
 BOOLEAN PhConvertUtf8ToUtf16Size(
     _Out_ PSIZE_T BytesInUtf16String,
     _In_reads_bytes_(BytesInUtf8String) PCH Utf8String,
@@ -3126,6 +3927,20 @@ BOOLEAN PhConvertUtf8ToUtf16Size(
 
     while (inRemaining != 0)
     {
+        // Runs of ASCII characters don't need to go through the decoder.
+        if (decoder.State == 0 && decoder.InputCount == 0)
+        {
+            SIZE_T count;
+
+            count = PhpCopyAsciiUtf8ToUtf16(NULL, in, inRemaining);
+            in += count;
+            inRemaining -= count;
+            bytesInUtf16String += count * sizeof(WCHAR);
+
+            if (inRemaining == 0)
+                break;
+        }
+
         PhWriteUnicodeDecoder(&decoder, (UCHAR)*in);
         in++;
         inRemaining--;
@@ -3173,6 +3988,22 @@ BOOLEAN PhConvertUtf8ToUtf16Buffer(
 
     while (inRemaining != 0)
     {
+        // Runs of ASCII characters don't need to go through the decoder.
+        if (decoder.State == 0 && decoder.InputCount == 0)
+        {
+            SIZE_T count;
+
+            count = PhpCopyAsciiUtf8ToUtf16(out, in, min(inRemaining, outRemaining));
+            in += count;
+            inRemaining -= count;
+            out += count;
+            outRemaining -= count;
+            bytesInUtf16String += count * sizeof(WCHAR);
+
+            if (inRemaining == 0)
+                break;
+        }
+
         PhWriteUnicodeDecoder(&decoder, (UCHAR)*in);
         in++;
         inRemaining--;
@@ -3276,6 +4107,20 @@ BOOLEAN PhConvertUtf16ToUtf8Size(
 
     while (inRemaining != 0)
     {
+        // Runs of ASCII characters don't need to go through the decoder.
+        if (decoder.State == 0 && decoder.InputCount == 0)
+        {
+            SIZE_T count;
+
+            count = PhpCopyAsciiUtf16ToUtf8(NULL, in, inRemaining);
+            in += count;
+            inRemaining -= count;
+            bytesInUtf8String += count;
+
+            if (inRemaining == 0)
+                break;
+        }
+
         PhWriteUnicodeDecoder(&decoder, (USHORT)*in);
         in++;
         inRemaining--;
@@ -3323,9 +4168,25 @@ BOOLEAN PhConvertUtf16ToUtf8Buffer(
 
     while (inRemaining != 0)
     {
-        PhWriteUnicodeDecoder(&decoder, (USHORT)*in);
-        in++;
-        inRemaining--;
+        // Runs of ASCII characters don't need to go through the decoder.
+        if (decoder.State == 0 && decoder.InputCount == 0)
+        {
+            SIZE_T count;
+
+            count = PhpCopyAsciiUtf16ToUtf8(out, in, min(inRemaining, outRemaining));
+            in += count;
+            inRemaining -= count;
+            out += count;
+            outRemaining -= count;
+            bytesInUtf8String += count;
+
+            if (inRemaining == 0)
+                break;
+        }
+
+        PhWriteUnicodeDecoder(&decoder, (USHORT)*in);
+        in++;
+        inRemaining--;
 
         while (PhDecodeUnicodeDecoder(&decoder, &codePoint))
         {
@@ -3811,6 +4672,115 @@ VOID PhRemoveStringBuilder(
     PhpWriteNullTerminatorStringBuilder(StringBuilder);
 }
 
+/**
+ * Initializes a fixed string builder object.
+ *
+ * \param StringBuilder A fixed string builder object.
+ * \param Buffer The buffer that receives the string. It must remain valid for as
+ * long as the string builder and the string it constructs are used.
+ * \param BufferLength The size of \a Buffer in bytes, including space for the null
+ * terminator. This must be at least sizeof(WCHAR).
+ */
+VOID PhInitializeFixedStringBuilder(
+    _Out_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _Out_writes_bytes_(BufferLength) PWCHAR Buffer,
+    _In_ SIZE_T BufferLength
+    )
+{
+    assert(BufferLength >= sizeof(WCHAR));
+
+    StringBuilder->String.Buffer = Buffer;
+    StringBuilder->String.Length = 0;
+    StringBuilder->BufferLength = BufferLength;
+    StringBuilder->Overflow = FALSE;
+    Buffer[0] = 0;
+}
+
+/**
+ * Appends a string to the end of a fixed string builder string.
+ *
+ * \param StringBuilder A fixed string builder object.
+ * \param String The string to append.
+ *
+ * \return TRUE if the string was appended, or FALSE if it did not fit in the buffer.
+ */
+BOOLEAN PhAppendFixedStringBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ PPH_STRINGREF String
+    )
+{
+    if (StringBuilder->BufferLength - sizeof(WCHAR) - StringBuilder->String.Length < String->Length)
+    {
+        StringBuilder->Overflow = TRUE;
+        return FALSE;
+    }
+
+    memcpy(
+        (PCHAR)StringBuilder->String.Buffer + StringBuilder->String.Length,
+        String->Buffer,
+        String->Length
+        );
+    StringBuilder->String.Length += String->Length;
+    StringBuilder->String.Buffer[StringBuilder->String.Length / sizeof(WCHAR)] = 0;
+
+    return TRUE;
+}
+
+/**
+ * Appends a string to the end of a fixed string builder string.
+ *
+ * \param StringBuilder A fixed string builder object.
+ * \param String The string to append.
+ *
+ * \return TRUE if the string was appended, or FALSE if it did not fit in the buffer.
+ */
+BOOLEAN PhAppendFixedStringBuilder2(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ PWSTR String
+    )
+{
+    PH_STRINGREF string;
+
+    PhInitializeStringRef(&string, String);
+
+    return PhAppendFixedStringBuilder(StringBuilder, &string);
+}
+
+/**
+ * Appends a formatted string to the end of a fixed string builder string.
+ *
+ * \param StringBuilder A fixed string builder object.
+ * \param Format An array of format structures.
+ * \param Count The number of structures supplied in \a Format.
+ *
+ * \return TRUE if the string was appended, or FALSE if it did not fit in the buffer.
+ */
+BOOLEAN PhAppendFormatFixedStringBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_reads_(Count) PPH_FORMAT Format,
+    _In_ ULONG Count
+    )
+{
+    SIZE_T returnLength;
+
+    if (!PhFormatToBuffer(
+        Format,
+        Count,
+        (PWCHAR)((PCHAR)StringBuilder->String.Buffer + StringBuilder->String.Length),
+        StringBuilder->BufferLength - StringBuilder->String.Length,
+        &returnLength
+        ))
+    {
+        // PhFormatToBuffer wrote a null terminator at the end of our string.
+        StringBuilder->Overflow = TRUE;
+        return FALSE;
+    }
+
+    StringBuilder->String.Length += returnLength - sizeof(WCHAR);
+
+    return TRUE;
+}
+
 /**
  * Initializes a byte string builder object.
  *
@@ -4900,6 +5870,243 @@ ULONG PhHashBytes(
     return hash;
 }
 
+#define PHP_HASH64_PRIME32_1 0x9e3779b1UL
+#define PHP_HASH64_PRIME32_2 0x85ebca77UL
+#define PHP_HASH64_PRIME32_3 0xc2b2ae3dUL
+#define PHP_HASH64_PRIME64_1 0x9e3779b185ebca87ULL
+#define PHP_HASH64_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define PHP_HASH64_PRIME64_3 0x165667b19e3779f9ULL
+#define PHP_HASH64_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define PHP_HASH64_PRIME64_5 0x27d4eb2f165667c5ULL
+#define PHP_HASH64_STRIPE_SIZE 64
+#define PHP_HASH64_STRIPES_PER_BLOCK 16
+
+// Stripe n of a block is keyed with PhpHashBytes64Keys[n] to [n + 7], so the hash depends on
+// the order of the stripes; the last 8 keys are used to scramble the accumulators after each
+// block.
+static CONST ULONG64 PhpHashBytes64Keys[PHP_HASH64_STRIPES_PER_BLOCK + 8] =
+{
+    0x3013b306f3a812b3ULL, 0xf23ce31283e22613ULL, 0x2db9b3d576a91b9bULL, 0x61b087d500f58a10ULL,
+    0x9a3909870ce28491ULL, 0x0782f9d71af39186ULL, 0x5d7ac387f41fe1c5ULL, 0xc248a0fa3a94ff87ULL,
+    0x6645b5fe1fbbee89ULL, 0xedca2f430b8ae1e8ULL, 0xd3dc069218e2ed97ULL, 0x8429785faa30958eULL,
+    0x38f5d8b2c88ee0e9ULL, 0x92b6fe370889b217ULL, 0xf521530a186feb26ULL, 0x8e226e27e7d9b9a5ULL,
+    0x4737911741aaef1bULL, 0x5a9f768f98fefb66ULL, 0xed4422c73a10249cULL, 0x09720c27ae33b417ULL,
+    0x03fad058d7dfbff9ULL, 0xef1d65915a70e85fULL, 0x3d84018d84d5c64fULL, 0x5b86d57945d6ee7aULL
+};
+
+// Each accumulator lane adds the product of the low and high halves of a keyed data word, plus
+// the unkeyed data word of its neighbouring lane. The vector versions compute exactly the same
+// values as the scalar one.
+
+static VOID PhpHashBytes64Accumulate(
+    _Inout_updates_(8) PULONG64 Accumulators,
+    _In_reads_bytes_(NumberOfStripes * PHP_HASH64_STRIPE_SIZE) PUCHAR Data,
+    _In_ SIZE_T NumberOfStripes,
+    _Inout_ PULONG StripeIndex
+    )
+{
+    SIZE_T i;
+    ULONG j;
+
+    for (i = 0; i < NumberOfStripes; i++)
+    {
+        for (j = 0; j < 8; j++)
+        {
+            ULONG64 value = *(PULONG64)&Data[j * sizeof(ULONG64)];
+            ULONG64 keyed = value ^ PhpHashBytes64Keys[*StripeIndex + j];
+
+            Accumulators[j ^ 1] += value;
+            Accumulators[j] += (keyed & 0xffffffff) * (keyed >> 32);
+        }
+
+        Data += PHP_HASH64_STRIPE_SIZE;
+
+        if (++*StripeIndex == PHP_HASH64_STRIPES_PER_BLOCK)
+        {
+            for (j = 0; j < 8; j++)
+            {
+                ULONG64 value = Accumulators[j];
+
+                value ^= value >> 47;
+                value ^= PhpHashBytes64Keys[PHP_HASH64_STRIPES_PER_BLOCK + j];
+                Accumulators[j] = value * PHP_HASH64_PRIME32_1;
+            }
+
+            *StripeIndex = 0;
+        }
+    }
+}
+
+static VOID PhpHashBytes64AccumulateSse2(
+    _Inout_updates_(8) PULONG64 Accumulators,
+    _In_reads_bytes_(NumberOfStripes * PHP_HASH64_STRIPE_SIZE) PUCHAR Data,
+    _In_ SIZE_T NumberOfStripes,
+    _Inout_ PULONG StripeIndex
+    )
+{
+    __m128i accumulators[4];
+    __m128i prime = _mm_set1_epi32((INT)PHP_HASH64_PRIME32_1);
+    SIZE_T i;
+    ULONG j;
+
+    for (j = 0; j < 4; j++)
+        accumulators[j] = _mm_loadu_si128((__m128i *)&Accumulators[j * 2]);
+
+    for (i = 0; i < NumberOfStripes; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            __m128i value = _mm_loadu_si128((__m128i *)&Data[j * 16]);
+            __m128i keyed = _mm_xor_si128(value, _mm_loadu_si128((__m128i *)&PhpHashBytes64Keys[*StripeIndex + j * 2]));
+            __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+
+            accumulators[j] = _mm_add_epi64(accumulators[j], _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+            accumulators[j] = _mm_add_epi64(accumulators[j], product);
+        }
+
+        Data += PHP_HASH64_STRIPE_SIZE;
+
+        if (++*StripeIndex == PHP_HASH64_STRIPES_PER_BLOCK)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                __m128i value = accumulators[j];
+
+                value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+                value = _mm_xor_si128(value, _mm_loadu_si128((__m128i *)&PhpHashBytes64Keys[PHP_HASH64_STRIPES_PER_BLOCK + j * 2]));
+                accumulators[j] = _mm_add_epi64(
+                    _mm_mul_epu32(value, prime),
+                    _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(value, 32), prime), 32)
+                    );
+            }
+
+            *StripeIndex = 0;
+        }
+    }
+
+    for (j = 0; j < 4; j++)
+        _mm_storeu_si128((__m128i *)&Accumulators[j * 2], accumulators[j]);
+}
+
+static VOID PhpHashBytes64AccumulateAvx2(
+    _Inout_updates_(8) PULONG64 Accumulators,
+    _In_reads_bytes_(NumberOfStripes * PHP_HASH64_STRIPE_SIZE) PUCHAR Data,
+    _In_ SIZE_T NumberOfStripes,
+    _Inout_ PULONG StripeIndex
+    )
+{
+    __m256i accumulators[2];
+    __m256i prime = _mm256_set1_epi32((INT)PHP_HASH64_PRIME32_1);
+    SIZE_T i;
+    ULONG j;
+
+    for (j = 0; j < 2; j++)
+        accumulators[j] = _mm256_loadu_si256((__m256i *)&Accumulators[j * 4]);
+
+    for (i = 0; i < NumberOfStripes; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            __m256i value = _mm256_loadu_si256((__m256i *)&Data[j * 32]);
+            __m256i keyed = _mm256_xor_si256(value, _mm256_loadu_si256((__m256i *)&PhpHashBytes64Keys[*StripeIndex + j * 4]));
+            __m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+
+            accumulators[j] = _mm256_add_epi64(accumulators[j], _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+            accumulators[j] = _mm256_add_epi64(accumulators[j], product);
+        }
+
+        Data += PHP_HASH64_STRIPE_SIZE;
+
+        if (++*StripeIndex == PHP_HASH64_STRIPES_PER_BLOCK)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                __m256i value = accumulators[j];
+
+                value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+                value = _mm256_xor_si256(value, _mm256_loadu_si256((__m256i *)&PhpHashBytes64Keys[PHP_HASH64_STRIPES_PER_BLOCK + j * 4]));
+                accumulators[j] = _mm256_add_epi64(
+                    _mm256_mul_epu32(value, prime),
+                    _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime), 32)
+                    );
+            }
+
+            *StripeIndex = 0;
+        }
+    }
+
+    for (j = 0; j < 2; j++)
+        _mm256_storeu_si256((__m256i *)&Accumulators[j * 4], accumulators[j]);
+
+    _mm256_zeroupper();
+}
+
+/**
+ * Generates a 64-bit hash code for a sequence of bytes.
+ *
+ * \param Bytes A pointer to a byte array.
+ * \param Length The number of bytes to hash.
+ *
+ * \remarks This is a wide hash in the style of XXH3, suitable for detecting changes in large
+ * buffers such as memory pages. The result does not depend on the instruction set used.
+ */
+ULONG64 PhHashBytes64(
+    _In_reads_(Length) PUCHAR Bytes,
+    _In_ SIZE_T Length
+    )
+{
+    ULONG64 accumulators[8] =
+    {
+        PHP_HASH64_PRIME32_3, PHP_HASH64_PRIME64_1, PHP_HASH64_PRIME64_2, PHP_HASH64_PRIME64_3,
+        PHP_HASH64_PRIME64_4, PHP_HASH64_PRIME32_2, PHP_HASH64_PRIME64_5, PHP_HASH64_PRIME32_1
+    };
+    UCHAR lastStripe[PHP_HASH64_STRIPE_SIZE];
+    SIZE_T numberOfStripes;
+    SIZE_T remaining;
+    ULONG stripeIndex;
+    ULONG64 hash;
+    ULONG i;
+
+    numberOfStripes = Length / PHP_HASH64_STRIPE_SIZE;
+    remaining = Length % PHP_HASH64_STRIPE_SIZE;
+    stripeIndex = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+        PhpHashBytes64AccumulateAvx2(accumulators, Bytes, numberOfStripes, &stripeIndex);
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+        PhpHashBytes64AccumulateSse2(accumulators, Bytes, numberOfStripes, &stripeIndex);
+    else
+        PhpHashBytes64Accumulate(accumulators, Bytes, numberOfStripes, &stripeIndex);
+
+    if (remaining != 0)
+    {
+        // The length is mixed in below, so padding with zeros is unambiguous.
+        memcpy(lastStripe, &Bytes[numberOfStripes * PHP_HASH64_STRIPE_SIZE], remaining);
+        memset(&lastStripe[remaining], 0, PHP_HASH64_STRIPE_SIZE - remaining);
+        PhpHashBytes64Accumulate(accumulators, lastStripe, 1, &stripeIndex);
+    }
+
+    hash = (ULONG64)Length * PHP_HASH64_PRIME64_1;
+
+    for (i = 0; i < 8; i++)
+    {
+        ULONG64 value = accumulators[i];
+
+        value *= PHP_HASH64_PRIME64_2;
+        value = _rotl64(value, 31);
+        value *= PHP_HASH64_PRIME64_1;
+        hash = (hash ^ value) * PHP_HASH64_PRIME64_1 + PHP_HASH64_PRIME64_4;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PHP_HASH64_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PHP_HASH64_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
 /**
  * Generates a hash code for a string.
  *
@@ -5015,135 +6222,367 @@ BOOLEAN PhRemoveItemSimpleHashtable(
     return PhRemoveEntryHashtable(SimpleHashtable, &lookupEntry);
 }
 
-/**
- * Initializes a free list object.
- *
- * \param FreeList A pointer to the free list object.
- * \param Size The number of bytes in each allocation.
- * \param MaximumCount The number of unused allocations
- * to store.
- */
-VOID PhInitializeFreeList(
-    _Out_ PPH_FREE_LIST FreeList,
-    _In_ SIZE_T Size,
-    _In_ ULONG MaximumCount
+FORCEINLINE ULONG PhpHashHandleIndexKey(
+    _In_opt_ HANDLE Key
     )
 {
-    RtlInitializeSListHead(&FreeList->ListHead);
-    FreeList->Count = 0;
-    FreeList->MaximumCount = MaximumCount;
-    FreeList->Size = Size;
+    // Process IDs, thread IDs and handle values are all multiples of 4.
+    return PhHashIntPtr((ULONG_PTR)Key / 4);
 }
 
-/**
- * Frees resources used by a free list object.
- *
- * \param FreeList A pointer to the free list object.
- */
-VOID PhDeleteFreeList(
-    _Inout_ PPH_FREE_LIST FreeList
+static VOID PhpResizeHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index,
+    _In_ ULONG NewCapacity
     )
 {
-    PPH_FREE_LIST_ENTRY entry;
-    PSLIST_ENTRY listEntry;
+    PPH_HANDLE_INDEX_ENTRY oldEntries;
+    ULONG oldCapacity;
+    ULONG mask;
+    ULONG i;
+    ULONG j;
 
-    listEntry = RtlInterlockedFlushSList(&FreeList->ListHead);
+    oldEntries = Index->Entries;
+    oldCapacity = Index->Capacity;
 
-    while (listEntry)
+    Index->Capacity = NewCapacity;
+    Index->Entries = PhAllocate(sizeof(PH_HANDLE_INDEX_ENTRY) * NewCapacity);
+    memset(Index->Entries, 0, sizeof(PH_HANDLE_INDEX_ENTRY) * NewCapacity);
+    mask = NewCapacity - 1;
+
+    for (i = 0; i < oldCapacity; i++)
     {
-        entry = CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry);
-        listEntry = listEntry->Next;
-        PhFree(entry);
-    }
-}
+        if (!oldEntries[i].Value)
+            continue;
 
-/**
- * Allocates a block of memory from a free list.
- *
- * \param FreeList A pointer to a free list object.
- *
- * \return A pointer to the allocated block of
- * memory. The memory must be freed using
- * PhFreeToFreeList(). The block is guaranteed to be
- * aligned at MEMORY_ALLOCATION_ALIGNMENT bytes.
- */
-PVOID PhAllocateFromFreeList(
-    _Inout_ PPH_FREE_LIST FreeList
-    )
-{
-    PPH_FREE_LIST_ENTRY entry;
-    PSLIST_ENTRY listEntry;
+        j = PhpHashHandleIndexKey(oldEntries[i].Key) & mask;
 
-    listEntry = RtlInterlockedPopEntrySList(&FreeList->ListHead);
+        while (Index->Entries[j].Value)
+            j = (j + 1) & mask;
 
-    if (listEntry)
-    {
-        _InterlockedDecrement((PLONG)&FreeList->Count);
-        entry = CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry);
-    }
-    else
-    {
-        entry = PhAllocate(FIELD_OFFSET(PH_FREE_LIST_ENTRY, Body) + FreeList->Size);
+        Index->Entries[j] = oldEntries[i];
     }
 
-    return &entry->Body;
+    PhFree(oldEntries);
 }
 
 /**
- * Frees a block of memory to a free list.
+ * Initializes a handle index.
  *
- * \param FreeList A pointer to a free list object.
- * \param Memory A pointer to a block of memory.
+ * \param Index The handle index.
+ * \param InitialCapacity The expected number of entries.
  */
-VOID PhFreeToFreeList(
-    _Inout_ PPH_FREE_LIST FreeList,
-    _In_ PVOID Memory
+VOID PhInitializeHandleIndex(
+    _Out_ PPH_HANDLE_INDEX Index,
+    _In_ ULONG InitialCapacity
     )
 {
-    PPH_FREE_LIST_ENTRY entry;
+    ULONG capacity;
 
-    entry = CONTAINING_RECORD(Memory, PH_FREE_LIST_ENTRY, Body);
+    // Keep the load factor at or below 1/2.
+    capacity = PhRoundUpToPowerOfTwo(max(InitialCapacity, 8) * 2);
 
-    // We don't enforce Count <= MaximumCount (that would require locking),
-    // but we do check it.
-    if (FreeList->Count < FreeList->MaximumCount)
-    {
-        RtlInterlockedPushEntrySList(&FreeList->ListHead, &entry->ListEntry);
-        _InterlockedIncrement((PLONG)&FreeList->Count);
-    }
-    else
-    {
-        PhFree(entry);
-    }
+    Index->Capacity = capacity;
+    Index->Count = 0;
+    Index->Entries = PhAllocate(sizeof(PH_HANDLE_INDEX_ENTRY) * capacity);
+    memset(Index->Entries, 0, sizeof(PH_HANDLE_INDEX_ENTRY) * capacity);
+    Index->NumberOfLookups = 0;
+    Index->NumberOfProbes = 0;
 }
 
 /**
- * Initializes a callback object.
+ * Frees resources used by a handle index.
  *
- * \param Callback A pointer to a callback object.
+ * \param Index The handle index.
  */
-VOID PhInitializeCallback(
-    _Out_ PPH_CALLBACK Callback
+VOID PhDeleteHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index
     )
 {
-    InitializeListHead(&Callback->ListHead);
-    PhInitializeQueuedLock(&Callback->ListLock);
-    PhInitializeQueuedLock(&Callback->BusyCondition);
+    PhFree(Index->Entries);
 }
 
 /**
- * Frees resources used by a callback object.
+ * Adds an entry to a handle index.
  *
- * \param Callback A pointer to a callback object.
+ * \param Index The handle index.
+ * \param Key The key of the entry.
+ * \param Value The value of the entry. This must not be NULL.
+ *
+ * \return TRUE if the entry was added, or FALSE if an entry with the same key already exists.
  */
-VOID PhDeleteCallback(
-    _Inout_ PPH_CALLBACK Callback
+BOOLEAN PhAddItemHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key,
+    _In_ PVOID Value
     )
 {
-    // Nothing for now
-}
+    ULONG mask;
+    ULONG i;
 
-/**
+    if ((Index->Count + 1) * 2 > Index->Capacity)
+        PhpResizeHandleIndex(Index, Index->Capacity * 2);
+
+    mask = Index->Capacity - 1;
+    i = PhpHashHandleIndexKey(Key) & mask;
+
+    while (Index->Entries[i].Value)
+    {
+        if (Index->Entries[i].Key == Key)
+            return FALSE;
+
+        i = (i + 1) & mask;
+    }
+
+    Index->Entries[i].Key = Key;
+    Index->Entries[i].Value = Value;
+    Index->Count++;
+
+    return TRUE;
+}
+
+/**
+ * Locates an entry in a handle index.
+ *
+ * \param Index The handle index.
+ * \param Key The key of the entry.
+ *
+ * \return The value of the entry, or NULL if the entry could not be found.
+ */
+PVOID PhFindItemHandleIndex(
+    _In_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key
+    )
+{
+    ULONG mask;
+    ULONG i;
+    ULONG probes;
+    PVOID value;
+
+    mask = Index->Capacity - 1;
+    i = PhpHashHandleIndexKey(Key) & mask;
+    probes = 1;
+
+    while (value = Index->Entries[i].Value)
+    {
+        if (Index->Entries[i].Key == Key)
+            break;
+
+        i = (i + 1) & mask;
+        probes++;
+    }
+
+#ifdef DEBUG
+    // Lookups run concurrently, some without any lock. The counters are only kept in debug
+    // builds so that release lookups don't write to the shared index.
+    _InterlockedIncrement64((PLONG64)&Index->NumberOfLookups);
+    _InterlockedExchangeAdd64((PLONG64)&Index->NumberOfProbes, probes);
+#endif
+
+    return value;
+}
+
+/**
+ * Removes an entry from a handle index.
+ *
+ * \param Index The handle index.
+ * \param Key The key of the entry.
+ *
+ * \return TRUE if the entry was removed, otherwise FALSE.
+ */
+BOOLEAN PhRemoveItemHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key
+    )
+{
+    ULONG mask;
+    ULONG i;
+    ULONG j;
+    ULONG k;
+
+    mask = Index->Capacity - 1;
+    i = PhpHashHandleIndexKey(Key) & mask;
+
+    while (TRUE)
+    {
+        if (!Index->Entries[i].Value)
+            return FALSE;
+        if (Index->Entries[i].Key == Key)
+            break;
+
+        i = (i + 1) & mask;
+    }
+
+    // Shift back any following entries that would otherwise become unreachable. This avoids the
+    // need for tombstones.
+
+    j = i;
+
+    while (TRUE)
+    {
+        j = (j + 1) & mask;
+
+        if (!Index->Entries[j].Value)
+            break;
+
+        k = PhpHashHandleIndexKey(Index->Entries[j].Key) & mask;
+
+        // Move the entry at j if its home slot k does not lie cyclically within (i, j].
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        Index->Entries[i] = Index->Entries[j];
+        i = j;
+    }
+
+    Index->Entries[i].Key = NULL;
+    Index->Entries[i].Value = NULL;
+    Index->Count--;
+
+    return TRUE;
+}
+
+/**
+ * Removes all entries from a handle index.
+ *
+ * \param Index The handle index.
+ */
+VOID PhClearHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index
+    )
+{
+    memset(Index->Entries, 0, sizeof(PH_HANDLE_INDEX_ENTRY) * Index->Capacity);
+    Index->Count = 0;
+}
+
+/**
+ * Initializes a free list object.
+ *
+ * \param FreeList A pointer to the free list object.
+ * \param Size The number of bytes in each allocation.
+ * \param MaximumCount The number of unused allocations
+ * to store.
+ */
+VOID PhInitializeFreeList(
+    _Out_ PPH_FREE_LIST FreeList,
+    _In_ SIZE_T Size,
+    _In_ ULONG MaximumCount
+    )
+{
+    RtlInitializeSListHead(&FreeList->ListHead);
+    FreeList->Count = 0;
+    FreeList->MaximumCount = MaximumCount;
+    FreeList->Size = Size;
+}
+
+/**
+ * Frees resources used by a free list object.
+ *
+ * \param FreeList A pointer to the free list object.
+ */
+VOID PhDeleteFreeList(
+    _Inout_ PPH_FREE_LIST FreeList
+    )
+{
+    PPH_FREE_LIST_ENTRY entry;
+    PSLIST_ENTRY listEntry;
+
+    listEntry = RtlInterlockedFlushSList(&FreeList->ListHead);
+
+    while (listEntry)
+    {
+        entry = CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry);
+        listEntry = listEntry->Next;
+        PhFree(entry);
+    }
+}
+
+/**
+ * Allocates a block of memory from a free list.
+ *
+ * \param FreeList A pointer to a free list object.
+ *
+ * \return A pointer to the allocated block of
+ * memory. The memory must be freed using
+ * PhFreeToFreeList(). The block is guaranteed to be
+ * aligned at MEMORY_ALLOCATION_ALIGNMENT bytes.
+ */
+PVOID PhAllocateFromFreeList(
+    _Inout_ PPH_FREE_LIST FreeList
+    )
+{
+    PPH_FREE_LIST_ENTRY entry;
+    PSLIST_ENTRY listEntry;
+
+    listEntry = RtlInterlockedPopEntrySList(&FreeList->ListHead);
+
+    if (listEntry)
+    {
+        _InterlockedDecrement((PLONG)&FreeList->Count);
+        entry = CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry);
+    }
+    else
+    {
+        entry = PhAllocate(FIELD_OFFSET(PH_FREE_LIST_ENTRY, Body) + FreeList->Size);
+    }
+
+    return &entry->Body;
+}
+
+/**
+ * Frees a block of memory to a free list.
+ *
+ * \param FreeList A pointer to a free list object.
+ * \param Memory A pointer to a block of memory.
+ */
+VOID PhFreeToFreeList(
+    _Inout_ PPH_FREE_LIST FreeList,
+    _In_ PVOID Memory
+    )
+{
+    PPH_FREE_LIST_ENTRY entry;
+
+    entry = CONTAINING_RECORD(Memory, PH_FREE_LIST_ENTRY, Body);
+
+    // We don't enforce Count <= MaximumCount (that would require locking),
+    // but we do check it.
+    if (FreeList->Count < FreeList->MaximumCount)
+    {
+        RtlInterlockedPushEntrySList(&FreeList->ListHead, &entry->ListEntry);
+        _InterlockedIncrement((PLONG)&FreeList->Count);
+    }
+    else
+    {
+        PhFree(entry);
+    }
+}
+
+/**
+ * Initializes a callback object.
+ *
+ * \param Callback A pointer to a callback object.
+ */
+VOID PhInitializeCallback(
+    _Out_ PPH_CALLBACK Callback
+    )
+{
+    InitializeListHead(&Callback->ListHead);
+    PhInitializeQueuedLock(&Callback->ListLock);
+    PhInitializeQueuedLock(&Callback->BusyCondition);
+}
+
+/**
+ * Frees resources used by a callback object.
+ *
+ * \param Callback A pointer to a callback object.
+ */
+VOID PhDeleteCallback(
+    _Inout_ PPH_CALLBACK Callback
+    )
+{
+    // Nothing for now
+}
+
+/**
  * Registers a callback function to be notified.
  *
  * \param Callback A pointer to a callback object.
@@ -5180,12 +6619,22 @@ VOID PhRegisterCallback(
  * \param Context A user-defined value to pass to the
  * callback function.
  * \param Flags A combination of flags controlling the
- * callback. Set this parameter to 0.
+ * callback.
+ * \li \c PH_CALLBACK_ASYNCHRONOUS The callback function
+ * is executed on a worker thread. See the remarks.
  * \param Registration A variable which receives
  * registration information for the callback. Do not
  * modify the contents of this structure and do not
  * free the storage for this structure until you have
  * unregistered the callback.
+ *
+ * \remarks Asynchronous delivery keeps slow handlers from
+ * stalling the thread that invokes the callback. Deliveries
+ * for one registration never overlap; notifications that
+ * arrive in the meantime are coalesced into a single call
+ * with the most recent parameter. Only use this mode for
+ * callbacks whose parameter is NULL or outlives the
+ * invocation.
  */
 VOID PhRegisterCallbackEx(
     _Inout_ PPH_CALLBACK Callback,
@@ -5200,6 +6649,13 @@ VOID PhRegisterCallbackEx(
     Registration->Busy = 0;
     Registration->Unregistering = FALSE;
     Registration->Flags = Flags;
+    Registration->InvocationCount = 0;
+    Registration->CoalescedCount = 0;
+    Registration->TotalTime = 0;
+    Registration->MaximumTime = 0;
+    Registration->Callback = Callback;
+    Registration->AsyncRequests = 0;
+    Registration->AsyncParameter = NULL;
 
     PhAcquireQueuedLockExclusive(&Callback->ListLock);
     InsertTailList(&Callback->ListHead, &Registration->ListEntry);
@@ -5236,6 +6692,65 @@ VOID PhUnregisterCallback(
     PhReleaseQueuedLockExclusive(&Callback->ListLock);
 }
 
+static VOID PhpExecuteCallbackRegistration(
+    _Inout_ PPH_CALLBACK_REGISTRATION Registration,
+    _In_opt_ PVOID Parameter
+    )
+{
+    LARGE_INTEGER startCounter;
+    LARGE_INTEGER endCounter;
+    ULONG64 time;
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+    Registration->Function(
+        Parameter,
+        Registration->Context
+        );
+    NtQueryPerformanceCounter(&endCounter, NULL);
+
+    // The statistics are only used for diagnostics, so concurrent invocations may lose an update.
+    time = endCounter.QuadPart - startCounter.QuadPart;
+    _InterlockedIncrement((PLONG)&Registration->InvocationCount);
+    Registration->TotalTime += time;
+
+    if (Registration->MaximumTime < time)
+        Registration->MaximumTime = time;
+}
+
+static NTSTATUS NTAPI PhpAsyncCallbackWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_CALLBACK_REGISTRATION registration = Parameter;
+    PPH_CALLBACK callback = registration->Callback;
+    LONG requests;
+    LONG busy;
+
+    // Deliver until no notification arrived while the callback function was executing. The
+    // registration stays busy throughout, so it cannot be unregistered under us.
+    do
+    {
+        requests = registration->AsyncRequests;
+
+        if (requests > 1)
+            registration->CoalescedCount += requests - 1;
+
+        if (!registration->Unregistering)
+            PhpExecuteCallbackRegistration(registration, registration->AsyncParameter);
+    } while (_InterlockedExchangeAdd(&registration->AsyncRequests, -requests) != requests);
+
+    PhAcquireQueuedLockShared(&callback->ListLock);
+
+    busy = _InterlockedDecrement(&registration->Busy);
+
+    if (registration->Unregistering && busy == 0)
+        PhPulseAllCondition(&callback->BusyCondition);
+
+    PhReleaseQueuedLockShared(&callback->ListLock);
+
+    return STATUS_SUCCESS;
+}
+
 /**
  * Notifies all registered callback functions.
  *
@@ -5264,17 +6779,33 @@ VOID PhInvokeCallback(
         // Don't bother executing the callback function if
         // it is being unregistered.
         if (registration->Unregistering)
+        {
+            listEntry = listEntry->Flink;
             continue;
+        }
+
+        if (registration->Flags & PH_CALLBACK_ASYNCHRONOUS)
+        {
+            registration->AsyncParameter = Parameter;
+
+            // Only the first pending notification queues a delivery; the worker picks up the
+            // rest. The delivery keeps the registration busy until it completes.
+            if (_InterlockedIncrement(&registration->AsyncRequests) == 1)
+            {
+                _InterlockedIncrement(&registration->Busy);
+                PhQueueItemGlobalWorkQueue(PhpAsyncCallbackWorker, registration);
+            }
+
+            listEntry = listEntry->Flink;
+            continue;
+        }
 
         _InterlockedIncrement(&registration->Busy);
 
         // Execute the callback function.
 
         PhReleaseQueuedLockShared(&Callback->ListLock);
-        registration->Function(
-            Parameter,
-            registration->Context
-            );
+        PhpExecuteCallbackRegistration(registration, Parameter);
         PhAcquireQueuedLockShared(&Callback->ListLock);
 
         busy = _InterlockedDecrement(&registration->Busy);
@@ -5736,6 +7267,34 @@ VOID PhFillMemoryUlong(
         return;
     }
 
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256i pattern256;
+
+        // Unaligned stores are as fast as aligned ones on AVX2 hardware when the data happens to
+        // be aligned, so we don't bother with a prologue here.
+
+        pattern256 = _mm256_set1_epi32(Value);
+        count = Count / 8;
+
+        if (count != 0)
+        {
+            do
+            {
+                _mm256_storeu_si256((__m256i *)Memory, pattern256);
+                Memory += 8;
+            } while (--count != 0);
+        }
+
+        _mm256_zeroupper();
+        Count &= 0x7;
+
+        while (Count--)
+            *Memory++ = Value;
+
+        return;
+    }
+
     if ((ULONG_PTR)Memory & 0xf)
     {
         switch ((ULONG_PTR)Memory & 0xf)
@@ -5796,14 +7355,348 @@ VOID FASTCALL PhxfFillMemoryUlong(PULONG Memory, ULONG Value, ULONG Count)
 }
 
 /**
- * Divides an array of numbers by a number.
+ * Counts the number of non-printable bytes at the start of a buffer.
  *
- * \param A The destination array, divided by \a B.
- * \param B The number.
- * \param Count The number of elements.
+ * \param Buffer The buffer.
+ * \param Length The number of bytes in \a Buffer.
+ *
+ * \return The index of the first byte for which PhCharIsPrintable is
+ * TRUE, or \a Length if there is no such byte.
  */
-VOID PhDivideSinglesBySingle(
-    _Inout_updates_(Count) PFLOAT A,
+SIZE_T PhCountNonPrintableBytes(
+    _In_reads_(Length) PUCHAR Buffer,
+    _In_ SIZE_T Length
+    )
+{
+    SIZE_T i = 0;
+    ULONG index;
+
+    // A byte is printable if it is in the range 0x20 to 0x7e (adding 0x60 maps this range
+    // to 0x80 to 0xde, the only bytes that compare less than 0xdf as signed values), or if
+    // it is TAB, LF or CR.
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256i bias = _mm256_set1_epi8(0x60);
+        __m256i limit = _mm256_set1_epi8((CHAR)0xdf);
+        __m256i tab = _mm256_set1_epi8('\t');
+        __m256i lf = _mm256_set1_epi8('\n');
+        __m256i cr = _mm256_set1_epi8('\r');
+
+        for (; i + 32 <= Length; i += 32)
+        {
+            __m256i block;
+            __m256i mask;
+            ULONG bits;
+
+            block = _mm256_loadu_si256((__m256i *)&Buffer[i]);
+            mask = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(block, bias));
+            mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(block, tab));
+            mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(block, lf));
+            mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(block, cr));
+            bits = _mm256_movemask_epi8(mask);
+
+            if (bits != 0)
+            {
+                _mm256_zeroupper();
+                _BitScanForward(&index, bits);
+                return i + index;
+            }
+        }
+
+        _mm256_zeroupper();
+    }
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128i bias = _mm_set1_epi8(0x60);
+        __m128i limit = _mm_set1_epi8((CHAR)0xdf);
+        __m128i tab = _mm_set1_epi8('\t');
+        __m128i lf = _mm_set1_epi8('\n');
+        __m128i cr = _mm_set1_epi8('\r');
+
+        for (; i + 16 <= Length; i += 16)
+        {
+            __m128i block;
+            __m128i mask;
+            ULONG bits;
+
+            block = _mm_loadu_si128((__m128i *)&Buffer[i]);
+            mask = _mm_cmplt_epi8(_mm_add_epi8(block, bias), limit);
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(block, tab));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(block, lf));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(block, cr));
+            bits = _mm_movemask_epi8(mask);
+
+            if (bits != 0)
+            {
+                _BitScanForward(&index, bits);
+                return i + index;
+            }
+        }
+    }
+
+    for (; i < Length; i++)
+    {
+        if (PhCharIsPrintable[Buffer[i]])
+            break;
+    }
+
+    return i;
+}
+
+static BOOLEAN PhpEqualBytePattern(
+    _In_reads_(PatternLength) PUCHAR Buffer,
+    _In_reads_(PatternLength) PUCHAR Pattern,
+    _In_reads_opt_(PatternLength) PUCHAR Mask,
+    _In_ SIZE_T PatternLength
+    )
+{
+    SIZE_T i;
+
+    if (!Mask)
+        return memcmp(Buffer, Pattern, PatternLength) == 0;
+
+    for (i = 0; i < PatternLength; i++)
+    {
+        if (((Buffer[i] ^ Pattern[i]) & Mask[i]) != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Locates a byte pattern in a buffer.
+ *
+ * \param Buffer The buffer to search.
+ * \param Length The number of bytes in \a Buffer.
+ * \param Pattern The bytes to search for.
+ * \param Mask An optional array with a mask for each byte of \a Pattern. Only the bits that
+ * are set in the mask are compared, so 0x00 matches any byte, 0xf0 matches any byte with the
+ * same high nibble and 0xdf matches an ASCII letter in either case.
+ * \param PatternLength The number of bytes in \a Pattern. This must not be zero.
+ * \param Index A variable which receives the index of the first match.
+ *
+ * \return TRUE if the pattern was found, otherwise FALSE.
+ */
+BOOLEAN PhFindBytePattern(
+    _In_reads_(Length) PUCHAR Buffer,
+    _In_ SIZE_T Length,
+    _In_reads_(PatternLength) PUCHAR Pattern,
+    _In_reads_opt_(PatternLength) PUCHAR Mask,
+    _In_ SIZE_T PatternLength,
+    _Out_ PSIZE_T Index
+    )
+{
+    SIZE_T first;
+    SIZE_T last;
+    SIZE_T count;
+    SIZE_T i;
+    UCHAR firstByte;
+    UCHAR lastByte;
+    UCHAR firstMask;
+    UCHAR lastMask;
+    ULONG bits;
+    ULONG index;
+
+    if (PatternLength == 0 || PatternLength > Length)
+        return FALSE;
+
+    count = Length - PatternLength + 1; // number of possible positions
+    first = 0;
+    last = PatternLength - 1;
+
+    // Filter on the first and last bytes that aren't wildcards. A pattern that consists only
+    // of wildcards matches at the start of the buffer.
+
+    if (Mask)
+    {
+        while (first < PatternLength && Mask[first] == 0)
+            first++;
+
+        if (first == PatternLength)
+        {
+            *Index = 0;
+            return TRUE;
+        }
+
+        while (Mask[last] == 0)
+            last--;
+
+        firstMask = Mask[first];
+        lastMask = Mask[last];
+    }
+    else
+    {
+        firstMask = 0xff;
+        lastMask = 0xff;
+    }
+
+    firstByte = Pattern[first] & firstMask;
+    lastByte = Pattern[last] & lastMask;
+    i = 0;
+
+    // For each block of positions, find those where both filter bytes match and only compare
+    // the whole pattern there.
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2 && count >= 32)
+    {
+        __m256i firstPattern = _mm256_set1_epi8(firstByte);
+        __m256i lastPattern = _mm256_set1_epi8(lastByte);
+        __m256i firstPatternMask = _mm256_set1_epi8(firstMask);
+        __m256i lastPatternMask = _mm256_set1_epi8(lastMask);
+
+        for (; i + 32 <= count; i += 32)
+        {
+            __m256i firstBlock;
+            __m256i lastBlock;
+
+            firstBlock = _mm256_and_si256(_mm256_loadu_si256((__m256i *)&Buffer[i + first]), firstPatternMask);
+            lastBlock = _mm256_and_si256(_mm256_loadu_si256((__m256i *)&Buffer[i + last]), lastPatternMask);
+            bits = _mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(firstBlock, firstPattern),
+                _mm256_cmpeq_epi8(lastBlock, lastPattern)
+                ));
+
+            while (_BitScanForward(&index, bits))
+            {
+                if (PhpEqualBytePattern(&Buffer[i + index], Pattern, Mask, PatternLength))
+                {
+                    _mm256_zeroupper();
+                    *Index = i + index;
+                    return TRUE;
+                }
+
+                bits &= bits - 1;
+            }
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2 && count >= 16)
+    {
+        __m128i firstPattern = _mm_set1_epi8(firstByte);
+        __m128i lastPattern = _mm_set1_epi8(lastByte);
+        __m128i firstPatternMask = _mm_set1_epi8(firstMask);
+        __m128i lastPatternMask = _mm_set1_epi8(lastMask);
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i firstBlock;
+            __m128i lastBlock;
+
+            firstBlock = _mm_and_si128(_mm_loadu_si128((__m128i *)&Buffer[i + first]), firstPatternMask);
+            lastBlock = _mm_and_si128(_mm_loadu_si128((__m128i *)&Buffer[i + last]), lastPatternMask);
+            bits = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(firstBlock, firstPattern),
+                _mm_cmpeq_epi8(lastBlock, lastPattern)
+                ));
+
+            while (_BitScanForward(&index, bits))
+            {
+                if (PhpEqualBytePattern(&Buffer[i + index], Pattern, Mask, PatternLength))
+                {
+                    *Index = i + index;
+                    return TRUE;
+                }
+
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        if ((Buffer[i + first] & firstMask) == firstByte &&
+            (Buffer[i + last] & lastMask) == lastByte &&
+            PhpEqualBytePattern(&Buffer[i], Pattern, Mask, PatternLength))
+        {
+            *Index = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Compares two buffers.
+ *
+ * \param Buffer1 The first buffer.
+ * \param Buffer2 The second buffer.
+ * \param Length The number of bytes to compare.
+ *
+ * \return The number of bytes at the start of the buffers that are equal. This is \a Length
+ * if the buffers are identical, otherwise it is the index of the first difference.
+ */
+SIZE_T PhCountEqualBytes(
+    _In_reads_(Length) PUCHAR Buffer1,
+    _In_reads_(Length) PUCHAR Buffer2,
+    _In_ SIZE_T Length
+    )
+{
+    SIZE_T i;
+    ULONG bits;
+    ULONG index;
+
+    i = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        for (; i + 32 <= Length; i += 32)
+        {
+            bits = ~(ULONG)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256((__m256i *)&Buffer1[i]),
+                _mm256_loadu_si256((__m256i *)&Buffer2[i])
+                ));
+
+            if (bits != 0)
+            {
+                _mm256_zeroupper();
+                _BitScanForward(&index, bits);
+                return i + index;
+            }
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        for (; i + 16 <= Length; i += 16)
+        {
+            bits = ~(ULONG)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((__m128i *)&Buffer1[i]),
+                _mm_loadu_si128((__m128i *)&Buffer2[i])
+                )) & 0xffff;
+
+            if (bits != 0)
+            {
+                _BitScanForward(&index, bits);
+                return i + index;
+            }
+        }
+    }
+
+    for (; i < Length; i++)
+    {
+        if (Buffer1[i] != Buffer2[i])
+            break;
+    }
+
+    return i;
+}
+
+/**
+ * Divides an array of numbers by a number.
+ *
+ * \param A The destination array, divided by \a B.
+ * \param B The number.
+ * \param Count The number of elements.
+ */
+VOID PhDivideSinglesBySingle(
+    _Inout_updates_(Count) PFLOAT A,
     _In_ FLOAT B,
     _In_ SIZE_T Count
     )
@@ -5819,6 +7712,26 @@ VOID PhDivideSinglesBySingle(
         return;
     }
 
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256 b256;
+
+        b256 = _mm256_set1_ps(B);
+
+        for (; Count >= 8; Count -= 8)
+        {
+            _mm256_storeu_ps(A, _mm256_div_ps(_mm256_loadu_ps(A), b256));
+            A += 8;
+        }
+
+        _mm256_zeroupper();
+
+        while (Count--)
+            *A++ /= B;
+
+        return;
+    }
+
     if ((ULONG_PTR)A & 0xf)
     {
         switch ((ULONG_PTR)A & 0xf)
@@ -5883,3 +7796,307 @@ VOID FASTCALL PhxfDivideSingle2U(PFLOAT A, FLOAT B, ULONG Count)
 {
     PhDivideSinglesBySingle(A, B, Count);
 }
+
+// 2^52 and 2^84 + 2^52, used to convert 32-bit halves of a ULONG64 to doubles.
+#define PH_DOUBLE_MAGIC_LOW 0x43300000
+#define PH_DOUBLE_MAGIC_HIGH 0x45300000
+#define PH_DOUBLE_MAGIC_BIAS 19342813118337666422669312.0
+
+/**
+ * Converts an array of ULONG64 values to single-precision floating-point values.
+ *
+ * \param Destination The destination array.
+ * \param Source The source array.
+ * \param Count The number of elements.
+ *
+ * \remarks Values larger than 2^53 may be rounded differently to a plain (FLOAT) cast, but are
+ * always within one unit of the correct result.
+ */
+VOID PhConvertUlong64sToSingles(
+    _Out_writes_(Count) PFLOAT Destination,
+    _In_reads_(Count) PULONG64 Source,
+    _In_ SIZE_T Count
+    )
+{
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256i lowMask;
+        __m256i magicLow;
+        __m256i magicHigh;
+        __m256d bias;
+
+        lowMask = _mm256_set1_epi64x(0xffffffff);
+        magicLow = _mm256_set1_epi64x((LONG64)PH_DOUBLE_MAGIC_LOW << 32);
+        magicHigh = _mm256_set1_epi64x((LONG64)PH_DOUBLE_MAGIC_HIGH << 32);
+        bias = _mm256_set1_pd(PH_DOUBLE_MAGIC_BIAS);
+
+        for (; Count >= 8; Count -= 8)
+        {
+            __m256i x;
+            __m128 lo;
+            __m128 hi;
+
+            x = _mm256_loadu_si256((__m256i *)Source);
+            lo = _mm256_cvtpd_ps(_mm256_add_pd(
+                _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(x, 32), magicHigh)), bias),
+                _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(x, lowMask), magicLow))
+                ));
+            x = _mm256_loadu_si256((__m256i *)(Source + 4));
+            hi = _mm256_cvtpd_ps(_mm256_add_pd(
+                _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(x, 32), magicHigh)), bias),
+                _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(x, lowMask), magicLow))
+                ));
+            _mm256_storeu_ps(Destination, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+
+            Destination += 8;
+            Source += 8;
+        }
+
+        _mm256_zeroupper();
+    }
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128i lowMask;
+        __m128i magicLow;
+        __m128i magicHigh;
+        __m128d bias;
+
+        lowMask = _mm_set_epi32(0, 0xffffffff, 0, 0xffffffff);
+        magicLow = _mm_set_epi32(PH_DOUBLE_MAGIC_LOW, 0, PH_DOUBLE_MAGIC_LOW, 0);
+        magicHigh = _mm_set_epi32(PH_DOUBLE_MAGIC_HIGH, 0, PH_DOUBLE_MAGIC_HIGH, 0);
+        bias = _mm_set1_pd(PH_DOUBLE_MAGIC_BIAS);
+
+        for (; Count >= 4; Count -= 4)
+        {
+            __m128i x;
+            __m128 lo;
+            __m128 hi;
+
+            x = _mm_loadu_si128((__m128i *)Source);
+            lo = _mm_cvtpd_ps(_mm_add_pd(
+                _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(x, 32), magicHigh)), bias),
+                _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(x, lowMask), magicLow))
+                ));
+            x = _mm_loadu_si128((__m128i *)(Source + 2));
+            hi = _mm_cvtpd_ps(_mm_add_pd(
+                _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(x, 32), magicHigh)), bias),
+                _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(x, lowMask), magicLow))
+                ));
+            _mm_storeu_ps(Destination, _mm_movelh_ps(lo, hi));
+
+            Destination += 4;
+            Source += 4;
+        }
+    }
+
+    while (Count--)
+        *Destination++ = (FLOAT)*Source++;
+}
+
+/**
+ * Adds an array of numbers to another array of numbers.
+ *
+ * \param A The destination array, incremented by the corresponding elements of \a B.
+ * \param B The source array.
+ * \param Count The number of elements.
+ */
+VOID PhAddSinglesToSingles(
+    _Inout_updates_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    )
+{
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        for (; Count >= 8; Count -= 8)
+        {
+            _mm256_storeu_ps(A, _mm256_add_ps(_mm256_loadu_ps(A), _mm256_loadu_ps(B)));
+            A += 8;
+            B += 8;
+        }
+
+        _mm256_zeroupper();
+    }
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        for (; Count >= 4; Count -= 4)
+        {
+            _mm_storeu_ps(A, _mm_add_ps(_mm_loadu_ps(A), _mm_loadu_ps(B)));
+            A += 4;
+            B += 4;
+        }
+    }
+
+    while (Count--)
+        *A++ += *B++;
+}
+
+/**
+ * Finds the largest sum of corresponding elements in two arrays.
+ *
+ * \param A The first array.
+ * \param B The second array.
+ * \param Count The number of elements.
+ *
+ * \return The largest value of A[i] + B[i], or 0 if there is no positive sum. NaN sums are
+ * ignored.
+ */
+FLOAT PhMaximumSumSingles(
+    _In_reads_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    )
+{
+    FLOAT max = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256 max256;
+        __m128 max128;
+
+        max256 = _mm256_setzero_ps();
+
+        for (; Count >= 8; Count -= 8)
+        {
+            // The first operand is returned when either is NaN, so NaN sums are dropped.
+            max256 = _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(A), _mm256_loadu_ps(B)), max256);
+            A += 8;
+            B += 8;
+        }
+
+        max128 = _mm_max_ps(_mm256_castps256_ps128(max256), _mm256_extractf128_ps(max256, 1));
+        _mm256_zeroupper();
+        max128 = _mm_max_ps(max128, _mm_movehl_ps(max128, max128));
+        max128 = _mm_max_ss(max128, _mm_shuffle_ps(max128, max128, _MM_SHUFFLE(1, 1, 1, 1)));
+        max = _mm_cvtss_f32(max128);
+    }
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128 max128;
+
+        max128 = _mm_setzero_ps();
+
+        for (; Count >= 4; Count -= 4)
+        {
+            max128 = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(A), _mm_loadu_ps(B)), max128);
+            A += 4;
+            B += 4;
+        }
+
+        max128 = _mm_max_ps(max128, _mm_movehl_ps(max128, max128));
+        max128 = _mm_max_ss(max128, _mm_shuffle_ps(max128, max128, _MM_SHUFFLE(1, 1, 1, 1)));
+        max = _mm_cvtss_f32(max128);
+    }
+
+    while (Count--)
+    {
+        FLOAT data = *A++ + *B++;
+
+        if (max < data)
+            max = data;
+    }
+
+    return max;
+}
+
+/**
+ * Computes the running maximum of the sums of corresponding elements in two arrays.
+ *
+ * \param Maximums The destination array. Each element receives the largest value of
+ * A[j] + B[j] for all j up to and including its index, or 0 if there is no positive sum.
+ * \param A The first array.
+ * \param B The second array.
+ * \param Count The number of elements.
+ *
+ * \return The last element of \a Maximums, i.e. the result of PhMaximumSumSingles().
+ *
+ * \remarks This is used by stacked graphs that are scaled by the maximum of a variable number of
+ * leading samples.
+ */
+FLOAT PhRunningMaximumSumSingles(
+    _Out_writes_(Count) PFLOAT Maximums,
+    _In_reads_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    )
+{
+    FLOAT max = 0;
+
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+    {
+        __m256 zero;
+        __m256 carry;
+
+        zero = _mm256_setzero_ps();
+        carry = zero;
+
+        for (; Count >= 8; Count -= 8)
+        {
+            __m256 x;
+
+            // Clamp to 0 first (dropping NaNs), so that the zeros shifted in below are neutral.
+            x = _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(A), _mm256_loadu_ps(B)), zero);
+            // Scan within each 128-bit lane...
+            x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+            x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+            // ...then propagate the low lane into the high lane.
+            carry = _mm256_max_ps(carry, _mm256_permute2f128_ps(
+                _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)),
+                _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)),
+                0x08
+                ));
+            x = _mm256_max_ps(x, carry);
+            _mm256_storeu_ps(Maximums, x);
+            carry = _mm256_permute2f128_ps(
+                _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)),
+                _mm256_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)),
+                0x11
+                );
+
+            Maximums += 8;
+            A += 8;
+            B += 8;
+        }
+
+        max = _mm_cvtss_f32(_mm256_castps256_ps128(carry));
+        _mm256_zeroupper();
+    }
+    else if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2)
+    {
+        __m128 zero;
+        __m128 carry;
+
+        zero = _mm_setzero_ps();
+        carry = zero;
+
+        for (; Count >= 4; Count -= 4)
+        {
+            __m128 x;
+
+            x = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(A), _mm_loadu_ps(B)), zero);
+            x = _mm_max_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_max_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+            x = _mm_max_ps(x, carry);
+            _mm_storeu_ps(Maximums, x);
+            carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+
+            Maximums += 4;
+            A += 4;
+            B += 4;
+        }
+
+        max = _mm_cvtss_f32(carry);
+    }
+
+    while (Count--)
+    {
+        FLOAT data = *A++ + *B++;
+
+        if (max < data)
+            max = data;
+
+        *Maximums++ = max;
+    }
+
+    return max;
+}
@@ -22,11 +22,21 @@
 
 #include <phbase.h>
 
+// Strings created by these functions are allocated from the arena of the current
+// auto-dereference pool, if it has one. See PhInitializeAutoPoolEx().
+
 PPH_STRING PhaCreateString(
     _In_ PWSTR Buffer
     )
 {
-    return PhAutoDereferenceObject(PhCreateString(Buffer));
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
+
+    autoPool = PhBeginAutoPoolArena();
+    string = PhCreateString(Buffer);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaCreateStringEx(
@@ -34,14 +44,28 @@ PPH_STRING PhaCreateStringEx(
     _In_ SIZE_T Length
     )
 {
-    return PhAutoDereferenceObject(PhCreateStringEx(Buffer, Length));
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
+
+    autoPool = PhBeginAutoPoolArena();
+    string = PhCreateStringEx(Buffer, Length);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaDuplicateString(
     _In_ PPH_STRING String
     )
 {
-    return PhAutoDereferenceObject(PhDuplicateString(String));
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
+
+    autoPool = PhBeginAutoPoolArena();
+    string = PhDuplicateString(String);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaConcatStrings(
@@ -50,10 +74,16 @@ PPH_STRING PhaConcatStrings(
     )
 {
     va_list argptr;
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
 
     va_start(argptr, Count);
 
-    return PhAutoDereferenceObject(PhConcatStrings_V(Count, argptr));
+    autoPool = PhBeginAutoPoolArena();
+    string = PhConcatStrings_V(Count, argptr);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaConcatStrings2(
@@ -61,7 +91,14 @@ PPH_STRING PhaConcatStrings2(
     _In_ PWSTR String2
     )
 {
-    return PhAutoDereferenceObject(PhConcatStrings2(String1, String2));
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
+
+    autoPool = PhBeginAutoPoolArena();
+    string = PhConcatStrings2(String1, String2);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaFormatString(
@@ -70,10 +107,16 @@ PPH_STRING PhaFormatString(
     )
 {
     va_list argptr;
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
 
     va_start(argptr, Format);
 
-    return PhAutoDereferenceObject(PhFormatString_V(Format, argptr));
+    autoPool = PhBeginAutoPoolArena();
+    string = PhFormatString_V(Format, argptr);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
 
 PPH_STRING PhaLowerString(
@@ -106,5 +149,12 @@ PPH_STRING PhaSubstring(
     _In_ SIZE_T Count
     )
 {
-    return PhAutoDereferenceObject(PhSubstring(String, StartIndex, Count));
+    PPH_AUTO_POOL autoPool;
+    PPH_STRING string;
+
+    autoPool = PhBeginAutoPoolArena();
+    string = PhSubstring(String, StartIndex, Count);
+    PhEndAutoPoolArena(autoPool);
+
+    return PhAutoDereferenceObject(string);
 }
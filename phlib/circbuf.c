@@ -9,9 +9,15 @@
 #define T ULONG64
 #include "circbuf_i.h"
 
+#undef T
+#define T USHORT
+#include "circbuf_i.h"
+
+#define PH_CIRCULAR_BUFFER_NO_TIER
 #undef T
 #define T PVOID
 #include "circbuf_i.h"
+#undef PH_CIRCULAR_BUFFER_NO_TIER
 
 #undef T
 #define T SIZE_T
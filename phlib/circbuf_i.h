@@ -118,4 +118,232 @@ VOID T___(PhCopyCircularBuffer, T)(
     }
 }
 
+VOID T___(PhInitializeCircularBufferSlab, T)(
+    _Out_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ ULONG Size,
+    _In_ ULONG NumberOfSlots
+    )
+{
+    Slab->Size = PhRoundUpToPowerOfTwo(Size);
+    Slab->SizeMinusOne = Slab->Size - 1;
+    Slab->NumberOfSlots = NumberOfSlots;
+    Slab->Data = PhAllocate(sizeof(T) * Slab->Size * NumberOfSlots);
+}
+
+VOID T___(PhDeleteCircularBufferSlab, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab
+    )
+{
+    PhFree(Slab->Data);
+}
+
+VOID T___(PhCopyCircularBufferSlab, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ PPH_CIRCULAR_BUFFER_SLOT Slot,
+    _Out_writes_(Count) T *Destination,
+    _In_ ULONG Count
+    )
+{
+    ULONG i;
+    ULONG index;
+    T *data;
+
+    if (Count > Slot->Count)
+        Count = Slot->Count;
+
+    index = Slot->Index;
+    data = Slab->Data + Slot->Slot;
+
+    for (i = 0; i < Count; i++)
+    {
+        Destination[i] = data[index * Slab->NumberOfSlots];
+        index = (index + 1) & Slab->SizeMinusOne;
+    }
+}
+
+#ifndef PH_CIRCULAR_BUFFER_NO_TIER
+
+VOID T___(PhInitializeCircularBufferTier, T)(
+    _Out_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ ULONG BucketSize,
+    _In_ ULONG NumberOfBuckets
+    )
+{
+    memset(Tier, 0, sizeof(T___(PH_CIRCULAR_BUFFER_TIER, T)));
+
+    if (BucketSize == 0 || NumberOfBuckets == 0)
+        return;
+
+    Tier->BucketSize = BucketSize;
+    T___(PhInitializeCircularBuffer, T)(&Tier->Minimum, NumberOfBuckets);
+    T___(PhInitializeCircularBuffer, T)(&Tier->Maximum, NumberOfBuckets);
+    T___(PhInitializeCircularBuffer, T)(&Tier->Average, NumberOfBuckets);
+}
+
+VOID T___(PhDeleteCircularBufferTier, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier
+    )
+{
+    if (Tier->BucketSize == 0)
+        return;
+
+    T___(PhDeleteCircularBuffer, T)(&Tier->Minimum);
+    T___(PhDeleteCircularBuffer, T)(&Tier->Maximum);
+    T___(PhDeleteCircularBuffer, T)(&Tier->Average);
+}
+
+/**
+ * Adds an item to a circular buffer. If the buffer is full, the oldest item is moved into the
+ * tier.
+ *
+ * \param Buffer The circular buffer which stores recent items.
+ * \param Tier The tier which stores older items.
+ * \param Value The new item.
+ */
+VOID T___(PhAddItemCircularBufferTiered, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ T Value
+    )
+{
+    BOOLEAN full;
+    T oldValue;
+
+    full = Buffer->Count == Buffer->Size;
+    oldValue = T___(PhAddItemCircularBuffer2, T)(Buffer, Value);
+
+    if (!full || Tier->BucketSize == 0)
+        return;
+
+    if (Tier->PendingCount == 0)
+    {
+        Tier->PendingMinimum = oldValue;
+        Tier->PendingMaximum = oldValue;
+        Tier->PendingSum = 0;
+    }
+    else
+    {
+        if (Tier->PendingMinimum > oldValue)
+            Tier->PendingMinimum = oldValue;
+        if (Tier->PendingMaximum < oldValue)
+            Tier->PendingMaximum = oldValue;
+    }
+
+    Tier->PendingSum += (DOUBLE)oldValue;
+
+    if (++Tier->PendingCount == Tier->BucketSize)
+    {
+        T___(PhAddItemCircularBuffer, T)(&Tier->Minimum, Tier->PendingMinimum);
+        T___(PhAddItemCircularBuffer, T)(&Tier->Maximum, Tier->PendingMaximum);
+        T___(PhAddItemCircularBuffer, T)(&Tier->Average, (T)(Tier->PendingSum / Tier->BucketSize));
+        Tier->PendingCount = 0;
+    }
+}
+
+/**
+ * Gets an item from a circular buffer and its tier.
+ *
+ * \param Buffer The circular buffer which stores recent items.
+ * \param Tier The tier which stores older items.
+ * \param Index The index of the item, where items that are part of a bucket are counted
+ * individually.
+ * \param Minimum A variable which receives the minimum of the bucket containing the item.
+ * \param Maximum A variable which receives the maximum of the bucket containing the item.
+ *
+ * \return The item, or the average of the bucket containing the item.
+ */
+T T___(PhGetItemCircularBufferTiered, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _In_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ ULONG Index,
+    _Out_opt_ T *Minimum,
+    _Out_opt_ T *Maximum
+    )
+{
+    T value;
+    LONG bucket;
+
+    if (Index < Buffer->Count || Tier->BucketSize == 0)
+    {
+        value = T___(PhGetItemCircularBuffer, T)(Buffer, Index);
+
+        if (Minimum)
+            *Minimum = value;
+        if (Maximum)
+            *Maximum = value;
+
+        return value;
+    }
+
+    Index -= Buffer->Count;
+
+    if (Index < Tier->PendingCount)
+    {
+        if (Minimum)
+            *Minimum = Tier->PendingMinimum;
+        if (Maximum)
+            *Maximum = Tier->PendingMaximum;
+
+        return (T)(Tier->PendingSum / Tier->PendingCount);
+    }
+
+    bucket = (Index - Tier->PendingCount) / Tier->BucketSize;
+
+    if (Minimum)
+        *Minimum = T___(PhGetItemCircularBuffer, T)(&Tier->Minimum, bucket);
+    if (Maximum)
+        *Maximum = T___(PhGetItemCircularBuffer, T)(&Tier->Maximum, bucket);
+
+    return T___(PhGetItemCircularBuffer, T)(&Tier->Average, bucket);
+}
+
+/**
+ * Copies items from a circular buffer and its tier. Each bucket in the tier is expanded to
+ * \a BucketSize copies of its average, so the destination has one item per period.
+ *
+ * \param Buffer The circular buffer which stores recent items.
+ * \param Tier The tier which stores older items.
+ * \param Destination The destination buffer.
+ * \param Count The number of items to copy.
+ */
+VOID T___(PhCopyCircularBufferTiered, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _In_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _Out_writes_(Count) T *Destination,
+    _In_ ULONG Count
+    )
+{
+    ULONG totalCount;
+    ULONG i;
+    ULONG bucket;
+    ULONG j;
+    T value;
+
+    totalCount = T___(PhGetCountCircularBufferTiered, T)(Buffer, Tier);
+
+    if (Count > totalCount)
+        Count = totalCount;
+
+    i = min(Count, Buffer->Count);
+    T___(PhCopyCircularBuffer, T)(Buffer, Destination, i);
+
+    if (i < Count && Tier->PendingCount != 0)
+    {
+        value = (T)(Tier->PendingSum / Tier->PendingCount);
+
+        for (j = 0; j < Tier->PendingCount && i < Count; j++)
+            Destination[i++] = value;
+    }
+
+    for (bucket = 0; i < Count; bucket++)
+    {
+        value = T___(PhGetItemCircularBuffer, T)(&Tier->Average, bucket);
+
+        for (j = 0; j < Tier->BucketSize && i < Count; j++)
+            Destination[i++] = value;
+    }
+}
+
+#endif
+
 #endif
@@ -28,7 +28,7 @@
 
 VOID PhpEscapeStringForCsv(
     _Inout_ PPH_STRING_BUILDER StringBuilder,
-    _In_ PPH_STRING String
+    _In_ PPH_STRINGREF String
     )
 {
     SIZE_T i;
@@ -215,7 +215,7 @@ PPH_LIST PhaFormatTextTable(
 
                     if (Table[i][j])
                     {
-                        PhpEscapeStringForCsv(&stringBuilder, Table[i][j]);
+                        PhpEscapeStringForCsv(&stringBuilder, &Table[i][j]->sr);
                     }
 
                     PhAppendCharStringBuilder(&stringBuilder, '\"');
@@ -233,6 +233,120 @@ PPH_LIST PhaFormatTextTable(
     return lines;
 }
 
+/**
+ * Writes a table to a file stream without storing the formatted cells.
+ *
+ * \param FileStream The file stream.
+ * \param Rows The number of rows in the table, including any header row.
+ * \param Columns The number of columns in the table.
+ * \param Mode The export formatting mode.
+ * \param GetCell A callback which retrieves the text of a cell. In the tabular modes the callback
+ * is called twice for each cell: once to compute the column widths and once to write the cell.
+ * \param Context A user-defined value to pass to the callback.
+ */
+NTSTATUS PhWriteTextTableFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Rows,
+    _In_ ULONG Columns,
+    _In_ ULONG Mode,
+    _In_ PPH_TEXT_TABLE_GET_CELL GetCell,
+    _In_opt_ PVOID Context
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PULONG tabCount = NULL;
+    PH_STRING_BUILDER stringBuilder;
+    PH_STRINGREF text;
+    ULONG indent;
+    ULONG length;
+    ULONG i;
+    ULONG j;
+
+    if (Mode == PH_EXPORT_MODE_TABS || Mode == PH_EXPORT_MODE_SPACES)
+    {
+        // Only the lengths are needed to align the columns, so nothing is kept from this pass.
+
+        tabCount = PhAllocate(sizeof(ULONG) * Columns);
+        memset(tabCount, 0, sizeof(ULONG) * Columns);
+
+        for (i = 0; i < Rows; i++)
+        {
+            for (j = 0; j < Columns; j++)
+            {
+                ULONG newCount;
+
+                GetCell(i, j, &text, &indent, Context);
+                newCount = (indent + (ULONG)(text.Length / sizeof(WCHAR))) / TAB_SIZE;
+
+                if (tabCount[j] < newCount)
+                    tabCount[j] = newCount;
+            }
+        }
+    }
+
+    // Each line is formatted into the same buffer and written to the stream straight away.
+    PhInitializeStringBuilder(&stringBuilder, 0x100);
+
+    for (i = 0; i < Rows; i++)
+    {
+        PhRemoveEndStringBuilder(&stringBuilder, stringBuilder.String->Length / sizeof(WCHAR));
+
+        for (j = 0; j < Columns; j++)
+        {
+            GetCell(i, j, &text, &indent, Context);
+            length = indent + (ULONG)(text.Length / sizeof(WCHAR));
+
+            switch (Mode)
+            {
+            case PH_EXPORT_MODE_TABS:
+                {
+                    if (indent != 0)
+                        PhAppendCharStringBuilder2(&stringBuilder, ' ', indent);
+
+                    PhAppendStringBuilder(&stringBuilder, &text);
+                    PhAppendCharStringBuilder2(&stringBuilder, '\t', tabCount[j] + 1 - length / TAB_SIZE);
+                }
+                break;
+            case PH_EXPORT_MODE_SPACES:
+                {
+                    if (indent != 0)
+                        PhAppendCharStringBuilder2(&stringBuilder, ' ', indent);
+
+                    PhAppendStringBuilder(&stringBuilder, &text);
+                    PhAppendCharStringBuilder2(&stringBuilder, ' ', (tabCount[j] + 1) * TAB_SIZE - length);
+                }
+                break;
+            case PH_EXPORT_MODE_CSV:
+                {
+                    PhAppendCharStringBuilder(&stringBuilder, '\"');
+
+                    if (indent != 0)
+                        PhAppendCharStringBuilder2(&stringBuilder, ' ', indent);
+
+                    PhpEscapeStringForCsv(&stringBuilder, &text);
+                    PhAppendCharStringBuilder(&stringBuilder, '\"');
+
+                    if (j != Columns - 1)
+                        PhAppendCharStringBuilder(&stringBuilder, ',');
+                }
+                break;
+            }
+        }
+
+        PhAppendStringBuilder2(&stringBuilder, L"\r\n");
+
+        if (!NT_SUCCESS(status = PhWriteStringAsUtf8FileStream(FileStream, &stringBuilder.String->sr)))
+            break;
+    }
+
+    PhDeleteStringBuilder(&stringBuilder);
+
+    if (tabCount)
+        PhFree(tabCount);
+
+    return status;
+}
+
 VOID PhMapDisplayIndexTreeNew(
     _In_ HWND TreeNewHandle,
     _Out_opt_ PULONG *DisplayToId,
@@ -401,6 +515,79 @@ PPH_LIST PhGetGenericTreeNewLines(
     return lines;
 }
 
+typedef struct _PH_GENERIC_TREENEW_EXPORT_CONTEXT
+{
+    HWND TreeNewHandle;
+    PULONG DisplayToId;
+    PWSTR *DisplayToText;
+} PH_GENERIC_TREENEW_EXPORT_CONTEXT, *PPH_GENERIC_TREENEW_EXPORT_CONTEXT;
+
+static VOID NTAPI PhpGetGenericTreeNewCell(
+    _In_ ULONG Row,
+    _In_ ULONG Column,
+    _Out_ PPH_STRINGREF Text,
+    _Out_ PULONG Indent,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_GENERIC_TREENEW_EXPORT_CONTEXT context = Context;
+    PH_TREENEW_GET_CELL_TEXT getCellText;
+
+    *Indent = 0;
+
+    if (Row == 0)
+    {
+        PhInitializeStringRef(Text, context->DisplayToText[Column]);
+        return;
+    }
+
+    PhInitializeEmptyStringRef(Text);
+
+    if (getCellText.Node = TreeNew_GetFlatNode(context->TreeNewHandle, Row - 1))
+    {
+        getCellText.Id = context->DisplayToId[Column];
+        PhInitializeEmptyStringRef(&getCellText.Text);
+        TreeNew_GetCellText(context->TreeNewHandle, &getCellText);
+        *Text = getCellText.Text;
+    }
+}
+
+/**
+ * Writes the contents of a tree list to a file stream. This is equivalent to writing the lines
+ * returned by PhGetGenericTreeNewLines(), but the text is not copied.
+ *
+ * \param FileStream The file stream.
+ * \param TreeNewHandle A handle to the tree list.
+ * \param Mode The export formatting mode.
+ */
+NTSTATUS PhWriteGenericTreeNewFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ HWND TreeNewHandle,
+    _In_ ULONG Mode
+    )
+{
+    NTSTATUS status;
+    PH_GENERIC_TREENEW_EXPORT_CONTEXT context;
+    ULONG columns;
+
+    context.TreeNewHandle = TreeNewHandle;
+    PhMapDisplayIndexTreeNew(TreeNewHandle, &context.DisplayToId, &context.DisplayToText, &columns);
+
+    status = PhWriteTextTableFileStream(
+        FileStream,
+        TreeNew_GetFlatNodeCount(TreeNewHandle) + 1,
+        columns,
+        Mode,
+        PhpGetGenericTreeNewCell,
+        &context
+        );
+
+    PhFree(context.DisplayToText);
+    PhFree(context.DisplayToId);
+
+    return status;
+}
+
 VOID PhaMapDisplayIndexListView(
     _In_ HWND ListViewHandle,
     _Out_writes_(Count) PULONG DisplayToId,
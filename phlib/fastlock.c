@@ -376,3 +376,43 @@ BOOLEAN FASTCALL PhfTryAcquireFastLockShared(
         return FALSE;
     }
 }
+
+#ifdef PH_LOCK_PROFILING
+
+VOID FASTCALL PhfProfileAcquireFastLockExclusive(
+    _Inout_ PPH_FAST_LOCK FastLock,
+    _Inout_ PPH_LOCK_SITE Site
+    )
+{
+    LARGE_INTEGER startCounter;
+
+    if (PhfTryAcquireFastLockExclusive(FastLock))
+    {
+        PhfRecordLockSite(Site, NULL);
+        return;
+    }
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+    PhfAcquireFastLockExclusive(FastLock);
+    PhfRecordLockSite(Site, &startCounter);
+}
+
+VOID FASTCALL PhfProfileAcquireFastLockShared(
+    _Inout_ PPH_FAST_LOCK FastLock,
+    _Inout_ PPH_LOCK_SITE Site
+    )
+{
+    LARGE_INTEGER startCounter;
+
+    if (PhfTryAcquireFastLockShared(FastLock))
+    {
+        PhfRecordLockSite(Site, NULL);
+        return;
+    }
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+    PhfAcquireFastLockShared(FastLock);
+    PhfRecordLockSite(Site, &startCounter);
+}
+
+#endif
@@ -66,6 +66,14 @@ static WCHAR PhpFormatDecimalSeparator = '.';
 static WCHAR PhpFormatThousandSeparator = ',';
 static _locale_t PhpFormatUserLocale = NULL;
 
+// Two characters per value, for converting integers two digits at a time.
+static CHAR PhpFormatDigitPairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
 #if (_MSC_VER >= 1900)
 
 // See Source\10.0.10150.0\ucrt\convert\cvt.cpp in SDK v10.
@@ -95,6 +103,33 @@ static errno_t __cdecl _cfltcvt_l(double *arg, char *buffer, size_t sizeInBytes,
 
 #endif
 
+static VOID PhpInitializeFormatSeparators(
+    VOID
+    )
+{
+    if (PhBeginInitOnce(&PhpFormatInitOnce))
+    {
+        WCHAR localeBuffer[4];
+
+        if (GetLocaleInfo(LOCALE_USER_DEFAULT, LOCALE_SDECIMAL, localeBuffer, 4) &&
+            (localeBuffer[0] != 0 && localeBuffer[1] == 0))
+        {
+            PhpFormatDecimalSeparator = localeBuffer[0];
+        }
+
+        if (GetLocaleInfo(LOCALE_USER_DEFAULT, LOCALE_STHOUSAND, localeBuffer, 4) &&
+            (localeBuffer[0] != 0 && localeBuffer[1] == 0))
+        {
+            PhpFormatThousandSeparator = localeBuffer[0];
+        }
+
+        if (PhpFormatDecimalSeparator != '.')
+            PhpFormatUserLocale = _create_locale(LC_ALL, "");
+
+        PhEndInitOnce(&PhpFormatInitOnce);
+    }
+}
+
 // From Source\10.0.10150.0\ucrt\inc\corecrt_internal_stdio_output.h in SDK v10.
 VOID PhpCropZeros(
     _Inout_ PCHAR Buffer,
@@ -277,3 +312,325 @@ BOOLEAN PhFormatToBuffer(
 
     return OK_BUFFER;
 }
+
+/*
+ * The functions below are specialized versions of PhFormatToBuffer for the number types
+ * that dominate list and tree cell text. They avoid the format structure interpreter and
+ * the CRT floating-point conversion, but produce the same text (using the same cached
+ * locale separators) as the equivalent PH_FORMAT.
+ */
+
+#define PHP_FAST_FORMAT_BUFFER_COUNT 40
+
+/**
+ * Writes the decimal representation of an integer backwards.
+ *
+ * \param Value The integer.
+ * \param GroupDigits TRUE to insert thousand separators.
+ * \param BufferEnd The position after the last character to write.
+ *
+ * \return The position of the first character written.
+ */
+static PWSTR PhpFormatUInt64Reverse(
+    _In_ ULONG64 Value,
+    _In_ BOOLEAN GroupDigits,
+    _In_ PWSTR BufferEnd
+    )
+{
+    PWSTR buffer = BufferEnd;
+    ULONG pair;
+
+    if (GroupDigits)
+    {
+        while (Value >= 1000)
+        {
+            ULONG group = (ULONG)(Value % 1000);
+
+            Value /= 1000;
+            pair = (group / 10) * 2;
+            *--buffer = (WCHAR)('0' + group % 10);
+            *--buffer = PhpFormatDigitPairs[pair + 1];
+            *--buffer = PhpFormatDigitPairs[pair];
+            *--buffer = PhpFormatThousandSeparator;
+        }
+    }
+    else
+    {
+        while (Value >= 100)
+        {
+            pair = (ULONG)(Value % 100) * 2;
+            Value /= 100;
+            *--buffer = PhpFormatDigitPairs[pair + 1];
+            *--buffer = PhpFormatDigitPairs[pair];
+        }
+    }
+
+    // At most three digits are left.
+
+    if (Value >= 100)
+    {
+        pair = (ULONG)(Value % 100) * 2;
+        *--buffer = PhpFormatDigitPairs[pair + 1];
+        *--buffer = PhpFormatDigitPairs[pair];
+        *--buffer = (WCHAR)('0' + Value / 100);
+    }
+    else if (Value >= 10)
+    {
+        pair = (ULONG)Value * 2;
+        *--buffer = PhpFormatDigitPairs[pair + 1];
+        *--buffer = PhpFormatDigitPairs[pair];
+    }
+    else
+    {
+        *--buffer = (WCHAR)('0' + Value);
+    }
+
+    return buffer;
+}
+
+static BOOLEAN PhpCopyFastFormatBuffer(
+    _In_reads_(Count) PWSTR String,
+    _In_ SIZE_T Count,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    )
+{
+    SIZE_T length = (Count + 1) * sizeof(WCHAR);
+
+    if (ReturnLength)
+        *ReturnLength = length;
+
+    if (!Buffer || BufferLength < length)
+    {
+        if (Buffer && BufferLength != 0)
+            *Buffer = 0;
+
+        return FALSE;
+    }
+
+    memcpy(Buffer, String, Count * sizeof(WCHAR));
+    Buffer[Count] = 0;
+
+    return TRUE;
+}
+
+/**
+ * Writes an unsigned integer to a buffer.
+ *
+ * \param Value The integer.
+ * \param GroupDigits TRUE to insert thousand separators.
+ * \param Buffer A buffer. If NULL, no data is written.
+ * \param BufferLength The number of bytes available in \a Buffer,
+ * including space for the null terminator.
+ * \param ReturnLength The number of bytes required to hold the
+ * string, including the null terminator.
+ *
+ * \return TRUE if the buffer was large enough and the string was
+ * written, otherwise FALSE.
+ *
+ * \remarks This produces the same text as PhFormatToBuffer with
+ * UInt64FormatType (and FormatGroupDigits).
+ */
+BOOLEAN PhFormatUInt64ToBuffer(
+    _In_ ULONG64 Value,
+    _In_ BOOLEAN GroupDigits,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    )
+{
+    WCHAR temp[PHP_FAST_FORMAT_BUFFER_COUNT];
+    PWSTR end;
+    PWSTR start;
+
+    if (GroupDigits)
+        PhpInitializeFormatSeparators();
+
+    end = temp + PHP_FAST_FORMAT_BUFFER_COUNT;
+    start = PhpFormatUInt64Reverse(Value, GroupDigits, end);
+
+    return PhpCopyFastFormatBuffer(start, end - start, Buffer, BufferLength, ReturnLength);
+}
+
+/**
+ * Writes a size to a buffer.
+ *
+ * \param Size The size value.
+ * \param MaxSizeUnit The largest unit of size to use, -1 to use
+ * PhMaxSizeUnit, or -2 for no limit.
+ * \param Buffer A buffer. If NULL, no data is written.
+ * \param BufferLength The number of bytes available in \a Buffer,
+ * including space for the null terminator.
+ * \param ReturnLength The number of bytes required to hold the
+ * string, including the null terminator.
+ *
+ * \return TRUE if the buffer was large enough and the string was
+ * written, otherwise FALSE.
+ *
+ * \remarks This produces the same text as PhFormatToBuffer with
+ * SizeFormatType, using integer arithmetic for the two fractional
+ * digits. Values exactly halfway between two hundredths are always
+ * rounded up.
+ */
+BOOLEAN PhFormatSizeToBuffer(
+    _In_ ULONG64 Size,
+    _In_ ULONG MaxSizeUnit,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    )
+{
+    WCHAR temp[PHP_FAST_FORMAT_BUFFER_COUNT];
+    PWSTR end;
+    PWSTR buffer;
+    ULONG i;
+    ULONG shift;
+    ULONG64 whole;
+    ULONG fraction;
+
+    if (Size == 0)
+        return PhpCopyFastFormatBuffer(L"0", 1, Buffer, BufferLength, ReturnLength);
+
+    PhpInitializeFormatSeparators();
+
+    if (MaxSizeUnit == -1)
+        MaxSizeUnit = PhMaxSizeUnit;
+
+    i = 0;
+
+    while (
+        (Size >> (i * 10)) >= 1000 &&
+        i < sizeof(PhpSizeUnitNamesCounted) / sizeof(PH_STRINGREF) - 1 &&
+        i < MaxSizeUnit
+        )
+    {
+        i++;
+    }
+
+    // Split the scaled value into whole and hundredths, rounding to nearest. Only the top 32
+    // bits of the remainder are needed for two fractional digits.
+
+    shift = i * 10;
+    whole = Size >> shift;
+    fraction = 0;
+
+    if (shift != 0)
+    {
+        ULONG64 remainder;
+
+        remainder = Size & ((1ULL << shift) - 1);
+
+        if (shift > 32)
+        {
+            remainder >>= shift - 32;
+            shift = 32;
+        }
+
+        fraction = (ULONG)((remainder * 100 + (1ULL << (shift - 1))) >> shift);
+
+        if (fraction == 100)
+        {
+            whole++;
+            fraction = 0;
+        }
+    }
+
+    end = temp + PHP_FAST_FORMAT_BUFFER_COUNT;
+    buffer = end - PhpSizeUnitNamesCounted[i].Length / sizeof(WCHAR);
+    memcpy(buffer, PhpSizeUnitNamesCounted[i].Buffer, PhpSizeUnitNamesCounted[i].Length);
+    *--buffer = ' ';
+
+    if (fraction != 0) // trailing zeros are cropped
+    {
+        if (fraction % 10 != 0)
+            *--buffer = (WCHAR)('0' + fraction % 10);
+
+        *--buffer = (WCHAR)('0' + fraction / 10);
+        *--buffer = PhpFormatDecimalSeparator;
+    }
+
+    buffer = PhpFormatUInt64Reverse(whole, TRUE, buffer);
+
+    return PhpCopyFastFormatBuffer(buffer, end - buffer, Buffer, BufferLength, ReturnLength);
+}
+
+/**
+ * Writes a floating-point number with a fixed number of fractional
+ * digits to a buffer.
+ *
+ * \param Value The number.
+ * \param Precision The number of fractional digits.
+ * \param Buffer A buffer. If NULL, no data is written.
+ * \param BufferLength The number of bytes available in \a Buffer,
+ * including space for the null terminator.
+ * \param ReturnLength The number of bytes required to hold the
+ * string, including the null terminator.
+ *
+ * \return TRUE if the buffer was large enough and the string was
+ * written, otherwise FALSE.
+ *
+ * \remarks This produces the same text as PhFormatToBuffer with
+ * PhInitFormatF. Values that are too large and precisions above 4
+ * are passed on to PhFormatToBuffer.
+ */
+BOOLEAN PhFormatFixedToBuffer(
+    _In_ DOUBLE Value,
+    _In_ ULONG Precision,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    )
+{
+    static ULONG PhpFixedScale[] = { 1, 10, 100, 1000, 10000 };
+
+    WCHAR temp[PHP_FAST_FORMAT_BUFFER_COUNT];
+    PWSTR end;
+    PWSTR buffer;
+    BOOLEAN negative;
+    ULONG64 scaled;
+    ULONG64 whole;
+    ULONG fraction;
+    ULONG i;
+
+    if (Precision >= sizeof(PhpFixedScale) / sizeof(ULONG) || !(Value > -1e15 && Value < 1e15))
+    {
+        PH_FORMAT format;
+
+        PhInitFormatF(&format, Value, Precision);
+
+        return PhFormatToBuffer(&format, 1, Buffer, BufferLength, ReturnLength);
+    }
+
+    PhpInitializeFormatSeparators();
+
+    negative = Value < 0;
+
+    if (negative)
+        Value = -Value;
+
+    scaled = (ULONG64)(Value * PhpFixedScale[Precision] + 0.5);
+    whole = scaled / PhpFixedScale[Precision];
+    fraction = (ULONG)(scaled % PhpFixedScale[Precision]);
+
+    end = temp + PHP_FAST_FORMAT_BUFFER_COUNT;
+    buffer = end;
+
+    if (Precision != 0)
+    {
+        for (i = 0; i < Precision; i++)
+        {
+            *--buffer = (WCHAR)('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        *--buffer = PhpFormatDecimalSeparator;
+    }
+
+    buffer = PhpFormatUInt64Reverse(whole, FALSE, buffer);
+
+    if (negative)
+        *--buffer = '-';
+
+    return PhpCopyFastFormatBuffer(buffer, end - buffer, Buffer, BufferLength, ReturnLength);
+}
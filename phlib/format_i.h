@@ -20,27 +20,7 @@
  */
 
 {
-    if (PhBeginInitOnce(&PhpFormatInitOnce))
-    {
-        WCHAR localeBuffer[4];
-
-        if (GetLocaleInfo(LOCALE_USER_DEFAULT, LOCALE_SDECIMAL, localeBuffer, 4) &&
-            (localeBuffer[0] != 0 && localeBuffer[1] == 0))
-        {
-            PhpFormatDecimalSeparator = localeBuffer[0];
-        }
-
-        if (GetLocaleInfo(LOCALE_USER_DEFAULT, LOCALE_STHOUSAND, localeBuffer, 4) &&
-            (localeBuffer[0] != 0 && localeBuffer[1] == 0))
-        {
-            PhpFormatThousandSeparator = localeBuffer[0];
-        }
-
-        if (PhpFormatDecimalSeparator != '.')
-            PhpFormatUserLocale = _create_locale(LC_ALL, "");
-
-        PhEndInitOnce(&PhpFormatInitOnce);
-    }
+    PhpInitializeFormatSeparators();
 
     while (Count--)
     {
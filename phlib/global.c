@@ -23,6 +23,7 @@
 #include <ph.h>
 #include <phintrnl.h>
 #include <symprv.h>
+#include <tracelog.h>
 
 VOID PhInitializeSecurity(
     _In_ ULONG Flags
@@ -177,6 +178,12 @@ static BOOLEAN PhInitializeSystem(
             return FALSE;
     }
 
+    if (Flags & PHLIB_INIT_MODULE_TRACE_LOGGING)
+    {
+        if (!PhTraceInitialization())
+            return FALSE;
+    }
+
     return TRUE;
 }
 
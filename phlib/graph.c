@@ -26,6 +26,8 @@
 
 #define COLORREF_TO_BITS(Color) (_byteswap_ulong(Color) >> 8)
 
+#define PH_GRAPH_STACK_POINTS 512
+
 typedef struct _PHP_GRAPH_CONTEXT
 {
     HWND Handle;
@@ -62,6 +64,7 @@ LRESULT CALLBACK PhpGraphWndProc(
 
 RECT PhNormalGraphTextMargin = { 5, 5, 5, 5 };
 RECT PhNormalGraphTextPadding = { 3, 3, 3, 3 };
+static BOOLEAN PhpGraphUseSse2 = FALSE;
 
 BOOLEAN PhGraphControlInitialization(
     VOID
@@ -84,6 +87,9 @@ BOOLEAN PhGraphControlInitialization(
     if (!RegisterClassEx(&c))
         return FALSE;
 
+    if (USER_SHARED_DATA->ProcessorFeatures[PF_XMMI64_INSTRUCTIONS_AVAILABLE])
+        PhpGraphUseSse2 = TRUE;
+
     return TRUE;
 }
 
@@ -356,43 +362,93 @@ VOID PhDrawGraph(
     }
 }
 
-FORCEINLINE VOID PhpGetGraphPoint(
+/**
+ * Converts graph data to pixel heights.
+ *
+ * \param DrawInfo A structure which contains graphing information.
+ * \param Count The number of data points to convert. Points beyond the end of the data are set
+ * to 0.
+ * \param H1 An array which receives the line 1 height values.
+ * \param H2 An array which receives the line 1 + line 2 height values. This is only written to
+ * if \ref PH_GRAPH_USE_LINE_2 is specified.
+ */
+static VOID PhpGetGraphPoints(
     _In_ PPH_GRAPH_DRAW_INFO DrawInfo,
-    _In_ ULONG Index,
-    _Out_ PULONG H1,
-    _Out_ PULONG H2
+    _In_ ULONG Count,
+    _Out_writes_(Count) PULONG H1,
+    _Out_writes_(Count) PULONG H2
     )
 {
-    if (Index < DrawInfo->LineDataCount)
+    BOOLEAN useLine2;
+    FLOAT scale;
+    ULONG dataCount;
+    ULONG i;
+
+    useLine2 = !!(DrawInfo->Flags & PH_GRAPH_USE_LINE_2);
+    scale = (FLOAT)(DrawInfo->Height - 1);
+    dataCount = min(Count, DrawInfo->LineDataCount);
+    i = 0;
+
+    if (PhpGraphUseSse2)
+    {
+        __m128 zero;
+        __m128 one;
+        __m128 s;
+        __m128 f1;
+        __m128 f2;
+
+        zero = _mm_setzero_ps();
+        one = _mm_set1_ps(1);
+        s = _mm_set1_ps(scale);
+
+        for (; i + 4 <= dataCount; i += 4)
+        {
+            f1 = _mm_loadu_ps(&DrawInfo->LineData1[i]);
+            f1 = _mm_min_ps(_mm_max_ps(f1, zero), one);
+            _mm_storeu_si128((__m128i *)&H1[i], _mm_cvttps_epi32(_mm_mul_ps(f1, s)));
+
+            if (useLine2)
+            {
+                f2 = _mm_add_ps(f1, _mm_loadu_ps(&DrawInfo->LineData2[i]));
+                f2 = _mm_min_ps(_mm_max_ps(f2, zero), one);
+                _mm_storeu_si128((__m128i *)&H2[i], _mm_cvttps_epi32(_mm_mul_ps(f2, s)));
+            }
+        }
+    }
+
+    for (; i < dataCount; i++)
     {
         FLOAT f1;
         FLOAT f2;
 
-        f1 = DrawInfo->LineData1[Index];
+        f1 = DrawInfo->LineData1[i];
 
-        if (f1 < 0)
+        if (!(f1 > 0)) // also handles NaN
             f1 = 0;
         if (f1 > 1)
             f1 = 1;
 
-        *H1 = (ULONG)(f1 * (DrawInfo->Height - 1));
+        H1[i] = (ULONG)(f1 * scale);
 
-        if (DrawInfo->Flags & PH_GRAPH_USE_LINE_2)
+        if (useLine2)
         {
-            f2 = f1 + DrawInfo->LineData2[Index];
+            f2 = f1 + DrawInfo->LineData2[i];
 
-            if (f2 < 0)
+            if (!(f2 > 0))
                 f2 = 0;
             if (f2 > 1)
                 f2 = 1;
 
-            *H2 = (ULONG)(f2 * (DrawInfo->Height - 1));
+            H2[i] = (ULONG)(f2 * scale);
         }
     }
-    else
+
+    if (dataCount < Count)
     {
-        *H1 = 0;
-        *H2 = 0;
+        memset(&H1[dataCount], 0, (Count - dataCount) * sizeof(ULONG));
+
+        if (useLine2)
+            memset(&H2[dataCount], 0, (Count - dataCount) * sizeof(ULONG));
     }
 }
 
@@ -455,6 +511,11 @@ VOID PhDrawGraphDirect(
     ULONG gridXIncrement;
     ULONG gridColor;
 
+    ULONG numberOfPoints;
+    ULONG stackPoints[PH_GRAPH_STACK_POINTS * 2];
+    PULONG points1;
+    PULONG points2;
+
     bits = Bits;
     width = DrawInfo->Width;
     height = DrawInfo->Height;
@@ -482,7 +543,21 @@ VOID PhDrawGraphDirect(
     h2_low2 = MAXLONG;
     h2_high2 = 0;
 
-    PhpGetGraphPoint(DrawInfo, 0, &h1_i, &h2_i);
+    // Convert all the data points we need up front. There is one data point for every two columns,
+    // plus one for the start of the graph and one more for the left edge.
+
+    numberOfPoints = width / 2 + 2;
+
+    if (numberOfPoints <= PH_GRAPH_STACK_POINTS)
+        points1 = stackPoints;
+    else
+        points1 = PhAllocate(numberOfPoints * 2 * sizeof(ULONG));
+
+    points2 = points1 + numberOfPoints;
+    PhpGetGraphPoints(DrawInfo, numberOfPoints, points1, points2);
+
+    h1_i = points1[0];
+    h2_i = points2[0];
 
     if (flags & PH_GRAPH_USE_GRID)
     {
@@ -502,7 +577,8 @@ VOID PhDrawGraphDirect(
 
             // Pull in new data.
             dataIndex++;
-            PhpGetGraphPoint(DrawInfo, dataIndex, &h1_i, &h2_i);
+            h1_i = points1[dataIndex];
+            h2_i = points2[dataIndex];
 
             h1 = h1_o;
             h1_left = (h1_i + h1_o) / 2;
@@ -675,6 +751,9 @@ VOID PhDrawGraphDirect(
         x--;
     }
 
+    if (points1 != stackPoints)
+        PhFree(points1);
+
     if (DrawInfo->Text.Buffer)
     {
         // Fill in the text box.
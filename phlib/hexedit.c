@@ -87,6 +87,9 @@ VOID PhpCreateHexEditContext(
     context->SelStart = -1;
     context->SelEnd = -1;
 
+    InitializeListHead(&context->PageListHead);
+    PhInitializeRundownProtection(&context->PrefetchRundown);
+
     *Context = context;
 }
 
@@ -94,6 +97,7 @@ VOID PhpFreeHexEditContext(
     _In_ _Post_invalid_ PPHP_HEXEDIT_CONTEXT Context
     )
 {
+    PhpHexEditFreePages(Context);
     if (!Context->UserBuffer && Context->Data) PhFree(Context->Data);
     if (Context->CharBuffer) PhFree(Context->CharBuffer);
     if (Context->Font) DeleteObject(Context->Font);
@@ -146,7 +150,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
         break;
     case WM_SETFOCUS:
         {
-            if (context->Data && !PhpHexEditHasSelected(context))
+            if (PhpHexEditHasData(context) && !PhpHexEditHasSelected(context))
             {
                 if (context->EditPosition.x == 0 && context->ShowAddress)
                     PhpHexEditCreateAddressCaret(hwnd, context);
@@ -176,7 +180,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
             GetScrollInfo(hwnd, SB_VERT, &scrollInfo);
             currentPosition = scrollInfo.nTrackPos;
 
-            if (context->Data)
+            if (PhpHexEditHasData(context))
             {
                 LONG mult;
 
@@ -239,7 +243,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
         {
             SHORT wheelDelta = GET_WHEEL_DELTA_WPARAM(wParam);
 
-            if (context->Data)
+            if (PhpHexEditHasData(context))
             {
                 ULONG wheelScrollLines;
 
@@ -281,7 +285,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
 
             SetFocus(hwnd);
 
-            if (context->Data)
+            if (PhpHexEditHasData(context))
             {
                 POINT point;
 
@@ -359,7 +363,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
             cursorPos.y = (LONG)(SHORT)HIWORD(lParam);
 
             if (
-                context->Data &&
+                PhpHexEditHasData(context) &&
                 context->HasCapture &&
                 context->SelStart != -1
                 )
@@ -409,7 +413,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
         {
             ULONG c = (ULONG)wParam;
 
-            if (!context->Data)
+            if (!PhpHexEditHasData(context))
                 goto DefaultHandler;
             if (c == '\t')
                 goto DefaultHandler;
@@ -463,26 +467,27 @@ LRESULT CALLBACK PhpHexEditWndProc(
                 if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
                 {
                     ULONG b = c - '0';
+                    UCHAR byte = PhpHexEditGetByte(hwnd, context, context->CurrentAddress);
 
                     if (b > 9)
                         b = 10 + c - 'a';
 
                     if (context->CurrentMode == EDIT_HIGH)
                     {
-                        context->Data[context->CurrentAddress] =
-                            (UCHAR)((context->Data[context->CurrentAddress] & 0x0f) | (b << 4));
+                        PhpHexEditSetByte(hwnd, context, context->CurrentAddress,
+                            (UCHAR)((byte & 0x0f) | (b << 4)));
                     }
                     else
                     {
-                        context->Data[context->CurrentAddress] =
-                            (UCHAR)((context->Data[context->CurrentAddress] & 0xf0) | b);
+                        PhpHexEditSetByte(hwnd, context, context->CurrentAddress,
+                            (UCHAR)((byte & 0xf0) | b));
                     }
 
                     PhpHexEditMove(hwnd, context, 1, 0);
                 }
                 break;
             case EDIT_ASCII:
-                context->Data[context->CurrentAddress] = (UCHAR)c;
+                PhpHexEditSetByte(hwnd, context, context->CurrentAddress, (UCHAR)c);
                 PhpHexEditMove(hwnd, context, 1, 0);
                 break;
             }
@@ -817,6 +822,39 @@ LRESULT CALLBACK PhpHexEditWndProc(
             PhpHexEditSetData(hwnd, context, (PUCHAR)lParam, (ULONG)wParam);
         }
         return TRUE;
+    case HEM_SETPROVIDER:
+        {
+            PhpHexEditSetProvider(hwnd, context, (PPH_HEXEDIT_PROVIDER)lParam, (ULONG)wParam);
+        }
+        return TRUE;
+    case HEM_READDATA:
+        {
+            PPH_HEXEDIT_DATA data = (PPH_HEXEDIT_DATA)lParam;
+
+            if (data->Offset > (ULONG)context->Length || data->Length > (ULONG)context->Length - data->Offset)
+                return FALSE;
+
+            PhpHexEditReadData(hwnd, context, data->Offset, data->Buffer, data->Length);
+        }
+        return TRUE;
+    case HEM_FIND:
+        return PhpHexEditFind(hwnd, context, (PPH_HEXEDIT_FIND)lParam);
+    case HEM_FLUSH:
+        return PhpHexEditFlush(hwnd, context);
+    case HEM_DISCARD:
+        {
+            if (context->HasProvider)
+            {
+                PhpHexEditFreePages(context);
+                REDRAW_WINDOW(hwnd);
+            }
+        }
+        return TRUE;
+    case WM_PHP_HEXEDIT_PREFETCH_COMPLETE:
+        {
+            PhpHexEditCompletePrefetches(hwnd, context);
+        }
+        return TRUE;
     case HEM_GETBUFFER:
         {
             PULONG length = (PULONG)wParam;
@@ -831,7 +869,7 @@ LRESULT CALLBACK PhpHexEditWndProc(
             LONG selStart = (LONG)wParam;
             LONG selEnd = (LONG)lParam;
 
-            if (selStart <= 0)
+            if (selStart < 0)
                 return FALSE;
             if (selEnd > context->Length)
                 return FALSE;
@@ -1037,7 +1075,7 @@ VOID PhpHexEditOnPaint(
 
     buffer = Context->CharBuffer;
 
-    if (Context->Data)
+    if (PhpHexEditHasData(Context))
     {
         // Get character dimensions.
         if (Context->Update)
@@ -1117,7 +1155,7 @@ VOID PhpHexEditOnPaint(
 
                 for (i = Context->TopIndex; i < selStart && y < height; i++)
                 {
-                    PhpPrintHex(bufferDc, Context, buffer, Context->Data[i], &x, &y, &n);
+                    PhpPrintHex(bufferDc, Context, buffer, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
 
                 // Bytes in the selection
@@ -1127,7 +1165,7 @@ VOID PhpHexEditOnPaint(
 
                 for (; i < selEnd && i < Context->Length && y < height; i++)
                 {
-                    PhpPrintHex(bufferDc, Context, buffer, Context->Data[i], &x, &y, &n);
+                    PhpPrintHex(bufferDc, Context, buffer, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
 
                 // Bytes after the selection
@@ -1137,7 +1175,7 @@ VOID PhpHexEditOnPaint(
 
                 for (; i < Context->Length && y < height; i++)
                 {
-                    PhpPrintHex(bufferDc, Context, buffer, Context->Data[i], &x, &y, &n);
+                    PhpPrintHex(bufferDc, Context, buffer, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
             }
             else
@@ -1150,7 +1188,9 @@ VOID PhpHexEditOnPaint(
 
                     for (n = 0; n < Context->BytesPerRow && i < Context->Length; n++)
                     {
-                        TO_HEX(p, Context->Data[i]);
+                        UCHAR byte = PhpHexEditGetByte(hwnd, Context, i);
+
+                        TO_HEX(p, byte);
                         *p++ = ' ';
                         i++;
                     }
@@ -1213,7 +1253,7 @@ VOID PhpHexEditOnPaint(
 
                 for (i = Context->TopIndex; i < selStart && y < height; i++)
                 {
-                    PhpPrintAscii(bufferDc, Context, Context->Data[i], &x, &y, &n);
+                    PhpPrintAscii(bufferDc, Context, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
 
                 // Bytes in the selection
@@ -1223,7 +1263,7 @@ VOID PhpHexEditOnPaint(
 
                 for (; i < selEnd && i < Context->Length && y < height; i++)
                 {
-                    PhpPrintAscii(bufferDc, Context, Context->Data[i], &x, &y, &n);
+                    PhpPrintAscii(bufferDc, Context, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
 
                 // Bytes after the selection
@@ -1233,7 +1273,7 @@ VOID PhpHexEditOnPaint(
 
                 for (; i < Context->Length && y < height; i++)
                 {
-                    PhpPrintAscii(bufferDc, Context, Context->Data[i], &x, &y, &n);
+                    PhpPrintAscii(bufferDc, Context, PhpHexEditGetByte(hwnd, Context, i), &x, &y, &n);
                 }
             }
             else
@@ -1246,7 +1286,9 @@ VOID PhpHexEditOnPaint(
 
                     for (n = 0; n < Context->BytesPerRow && i < Context->Length; n++)
                     {
-                        *p++ = IS_PRINTABLE(Context->Data[i]) ? Context->Data[i] : '.'; // 1
+                        UCHAR byte = PhpHexEditGetByte(hwnd, Context, i);
+
+                        *p++ = IS_PRINTABLE(byte) ? byte : '.'; // 1
                         i++;
                     }
 
@@ -1261,6 +1303,9 @@ VOID PhpHexEditOnPaint(
     SelectObject(bufferDc, oldBufferBitmap);
     DeleteObject(bufferBitmap);
     DeleteDC(bufferDc);
+
+    if (Context->HasProvider)
+        PhpHexEditPrefetchPages(hwnd, Context);
 }
 
 VOID PhpHexEditUpdateScrollbars(
@@ -1573,7 +1618,7 @@ VOID PhpHexEditCopyEdit(
             if (binaryMemory)
             {
                 PUCHAR p = GlobalLock(binaryMemory);
-                memcpy(p, &Context->Data[Context->SelStart], length);
+                PhpHexEditReadData(hwnd, Context, Context->SelStart, p, length);
                 GlobalUnlock(binaryMemory);
 
                 hexMemory = GlobalAlloc(GMEM_MOVEABLE | GMEM_ZEROINIT, (length * 3 + 1) * sizeof(WCHAR));
@@ -1587,7 +1632,9 @@ VOID PhpHexEditCopyEdit(
 
                     for (i = 0; i < length; i++)
                     {
-                        TO_HEX(pw, Context->Data[Context->SelStart + i]);
+                        UCHAR byte = PhpHexEditGetByte(hwnd, Context, Context->SelStart + i);
+
+                        TO_HEX(pw, byte);
                         *pw++ = ' ';
                     }
                     *pw = 0;
@@ -1612,7 +1659,7 @@ VOID PhpHexEditCopyEdit(
             if (binaryMemory)
             {
                 PUCHAR p = GlobalLock(binaryMemory);
-                memcpy(p, &Context->Data[Context->SelStart], length);
+                PhpHexEditReadData(hwnd, Context, Context->SelStart, p, length);
                 GlobalUnlock(binaryMemory);
 
                 if (asciiMemory)
@@ -1620,7 +1667,7 @@ VOID PhpHexEditCopyEdit(
                     ULONG i;
 
                     p = GlobalLock(asciiMemory);
-                    memcpy(p, &Context->Data[Context->SelStart], length);
+                    PhpHexEditReadData(hwnd, Context, Context->SelStart, p, length);
 
                     for (i = 0; i < length; i++)
                     {
@@ -1715,7 +1762,7 @@ VOID PhpHexEditPasteEdit(
                     length = Context->Length - paste;
             }
 
-            memcpy(&Context->Data[paste], p, length);
+            PhpHexEditWriteData(hwnd, Context, paste, p, length);
             GlobalUnlock(memory);
 
             Context->CurrentAddress = oldCurrentAddress;
@@ -1822,6 +1869,13 @@ VOID PhpHexEditSetBuffer(
     _In_ ULONG Length
     )
 {
+    if (Context->HasProvider)
+    {
+        PhpHexEditFreePages(Context);
+        memset(&Context->Provider, 0, sizeof(PH_HEXEDIT_PROVIDER));
+        Context->HasProvider = FALSE;
+    }
+
     Context->Data = Data;
     PhpHexEditSetSel(hwnd, Context, -1, -1);
     Context->Length = Length;
@@ -1849,3 +1903,525 @@ VOID PhpHexEditSetData(
     Context->UserBuffer = FALSE;
     Context->AllowLengthChange = TRUE;
 }
+
+VOID PhpHexEditSetProvider(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_opt_ PPH_HEXEDIT_PROVIDER Provider,
+    _In_ ULONG Length
+    )
+{
+    PhpHexEditFreePages(Context);
+
+    if (!Context->UserBuffer && Context->Data) PhFree(Context->Data);
+    Context->Data = NULL;
+
+    if (Provider)
+    {
+        Context->Provider = *Provider;
+        Context->HasProvider = TRUE;
+    }
+    else
+    {
+        memset(&Context->Provider, 0, sizeof(PH_HEXEDIT_PROVIDER));
+        Context->HasProvider = FALSE;
+        Length = 0;
+    }
+
+    PhpHexEditSetSel(hwnd, Context, -1, -1);
+    Context->Length = Length;
+    Context->CurrentAddress = 0;
+    Context->EditPosition.x = Context->EditPosition.y = 0;
+    Context->CurrentMode = EDIT_HIGH;
+    Context->TopIndex = 0;
+    Context->Update = TRUE;
+
+    Context->UserBuffer = TRUE;
+    Context->AllowLengthChange = FALSE;
+}
+
+static VOID PhpHexEditReadPage(
+    _In_ PPH_HEXEDIT_PROVIDER Provider,
+    _In_ ULONG Length,
+    _Inout_ PPHP_HEXEDIT_PAGE Page
+    )
+{
+    ULONG offset;
+
+    offset = Page->Index * PAGE_SIZE;
+
+    // Pages that can't be read are shown as zeros.
+    if (!NT_SUCCESS(Provider->Read(offset, Page->Data, min(Length - offset, PAGE_SIZE), Provider->Context)))
+        memset(Page->Data, 0, PAGE_SIZE);
+}
+
+static PPHP_HEXEDIT_PAGE PhpHexEditFindPage(
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Index
+    )
+{
+    PLIST_ENTRY listEntry;
+
+    for (listEntry = Context->PageListHead.Flink; listEntry != &Context->PageListHead; listEntry = listEntry->Flink)
+    {
+        PPHP_HEXEDIT_PAGE page = CONTAINING_RECORD(listEntry, PHP_HEXEDIT_PAGE, ListEntry);
+
+        if (page->Index == Index)
+            return page;
+    }
+
+    return NULL;
+}
+
+static PPHP_HEXEDIT_PAGE PhpHexEditRemoveLeastRecentlyUsedPage(
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    PLIST_ENTRY listEntry;
+
+    // Pages with unwritten changes are kept until they are flushed or discarded.
+    for (listEntry = Context->PageListHead.Blink; listEntry != &Context->PageListHead; listEntry = listEntry->Blink)
+    {
+        PPHP_HEXEDIT_PAGE page = CONTAINING_RECORD(listEntry, PHP_HEXEDIT_PAGE, ListEntry);
+
+        if (!page->Dirty)
+        {
+            RemoveEntryList(&page->ListEntry);
+
+            if (Context->LastPage == page)
+                Context->LastPage = NULL;
+
+            return page;
+        }
+    }
+
+    return NULL;
+}
+
+PPHP_HEXEDIT_PAGE PhpHexEditGetPage(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Index
+    )
+{
+    PPHP_HEXEDIT_PAGE page;
+
+    if (page = PhpHexEditFindPage(Context, Index))
+    {
+        RemoveEntryList(&page->ListEntry);
+    }
+    else
+    {
+        page = NULL;
+
+        if (Context->NumberOfPages >= PHP_HEXEDIT_MAXIMUM_CACHED_PAGES)
+            page = PhpHexEditRemoveLeastRecentlyUsedPage(Context);
+
+        if (!page)
+        {
+            page = PhAllocate(sizeof(PHP_HEXEDIT_PAGE));
+            Context->NumberOfPages++;
+        }
+
+        page->Index = Index;
+        page->Dirty = FALSE;
+        PhpHexEditReadPage(&Context->Provider, Context->Length, page);
+    }
+
+    InsertHeadList(&Context->PageListHead, &page->ListEntry);
+    Context->LastPage = page;
+
+    return page;
+}
+
+VOID PhpHexEditSetByte(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _In_ UCHAR Byte
+    )
+{
+    PPHP_HEXEDIT_PAGE page;
+
+    if (Context->Data)
+    {
+        Context->Data[Position] = Byte;
+        return;
+    }
+
+    page = PhpHexEditGetPage(hwnd, Context, Position / PAGE_SIZE);
+    page->Data[Position % PAGE_SIZE] = Byte;
+    page->Dirty = TRUE;
+}
+
+VOID PhpHexEditReadData(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length
+    )
+{
+    if (Context->Data)
+    {
+        memcpy(Buffer, &Context->Data[Position], Length);
+        return;
+    }
+
+    while (Length != 0)
+    {
+        PPHP_HEXEDIT_PAGE page = PhpHexEditGetPage(hwnd, Context, Position / PAGE_SIZE);
+        ULONG offset = Position % PAGE_SIZE;
+        ULONG length = min(Length, PAGE_SIZE - offset);
+
+        memcpy(Buffer, &page->Data[offset], length);
+        Buffer += length;
+        Position += length;
+        Length -= length;
+    }
+}
+
+VOID PhpHexEditWriteData(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _In_reads_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length
+    )
+{
+    if (Context->Data)
+    {
+        memcpy(&Context->Data[Position], Buffer, Length);
+        return;
+    }
+
+    while (Length != 0)
+    {
+        PPHP_HEXEDIT_PAGE page = PhpHexEditGetPage(hwnd, Context, Position / PAGE_SIZE);
+        ULONG offset = Position % PAGE_SIZE;
+        ULONG length = min(Length, PAGE_SIZE - offset);
+
+        memcpy(&page->Data[offset], Buffer, length);
+        page->Dirty = TRUE;
+        Buffer += length;
+        Position += length;
+        Length -= length;
+    }
+}
+
+static VOID PhpHexEditReadWindow(
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ ULONG Offset,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length
+    )
+{
+    PLIST_ENTRY listEntry;
+
+    // Read the whole window at once. If that fails, read it page by page so that only the
+    // unreadable pages are zeroed, like they are on screen.
+    if (!NT_SUCCESS(Context->Provider.Read(Offset, Buffer, Length, Context->Provider.Context)))
+    {
+        ULONG offset = Offset;
+
+        while (offset < Offset + Length)
+        {
+            ULONG length = min(Offset + Length - offset, PAGE_SIZE - offset % PAGE_SIZE);
+
+            if (!NT_SUCCESS(Context->Provider.Read(offset, &Buffer[offset - Offset], length, Context->Provider.Context)))
+                memset(&Buffer[offset - Offset], 0, length);
+
+            offset += length;
+        }
+    }
+
+    // Unwritten changes take precedence over the provider's data.
+    for (listEntry = Context->PageListHead.Flink; listEntry != &Context->PageListHead; listEntry = listEntry->Flink)
+    {
+        PPHP_HEXEDIT_PAGE page = CONTAINING_RECORD(listEntry, PHP_HEXEDIT_PAGE, ListEntry);
+        ULONG pageStart;
+        ULONG start;
+        ULONG end;
+
+        if (!page->Dirty)
+            continue;
+
+        pageStart = page->Index * PAGE_SIZE;
+        start = max(pageStart, Offset);
+        end = min(pageStart + PAGE_SIZE, Offset + Length);
+
+        if (start < end)
+            memcpy(&Buffer[start - Offset], &page->Data[start - pageStart], end - start);
+    }
+}
+
+BOOLEAN PhpHexEditFind(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _Inout_ PPH_HEXEDIT_FIND Find
+    )
+{
+    PUCHAR buffer;
+    ULONG position;
+    ULONG carry;
+    SIZE_T index;
+    BOOLEAN found;
+
+    if (Find->Length == 0 || Find->StartOffset >= (ULONG)Context->Length)
+        return FALSE;
+
+    if (Context->Data)
+    {
+        if (!PhFindBytePattern(
+            &Context->Data[Find->StartOffset],
+            Context->Length - Find->StartOffset,
+            Find->Pattern,
+            Find->Mask,
+            Find->Length,
+            &index
+            ))
+            return FALSE;
+
+        Find->Offset = Find->StartOffset + (ULONG)index;
+
+        return TRUE;
+    }
+
+    if (!Context->HasProvider)
+        return FALSE;
+
+    // Read large windows straight from the provider instead of going through the page cache,
+    // which would otherwise be flushed of the visible pages. Consecutive windows overlap by one
+    // byte less than the pattern so that matches spanning two windows are found.
+
+    buffer = PhAllocatePage(PHP_HEXEDIT_FIND_WINDOW_SIZE + Find->Length, NULL);
+
+    if (!buffer)
+        return FALSE;
+
+    position = Find->StartOffset;
+    carry = 0;
+    found = FALSE;
+
+    while (position < (ULONG)Context->Length)
+    {
+        ULONG length = min((ULONG)Context->Length - position, PHP_HEXEDIT_FIND_WINDOW_SIZE);
+
+        PhpHexEditReadWindow(Context, position, &buffer[carry], length);
+
+        if (PhFindBytePattern(buffer, carry + length, Find->Pattern, Find->Mask, Find->Length, &index))
+        {
+            Find->Offset = position - carry + (ULONG)index;
+            found = TRUE;
+            break;
+        }
+
+        position += length;
+        length += carry;
+        carry = min(Find->Length - 1, length);
+        memmove(buffer, &buffer[length - carry], carry);
+    }
+
+    PhFreePage(buffer);
+
+    return found;
+}
+
+static NTSTATUS NTAPI PhpHexEditPrefetchWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPHP_HEXEDIT_PREFETCH prefetch = Parameter;
+    PPH_RUNDOWN_PROTECT rundown = prefetch->Rundown;
+
+    PhpHexEditReadPage(&prefetch->Provider, prefetch->Length, prefetch->Page);
+
+    MemoryBarrier();
+    prefetch->Completed = TRUE;
+
+    // If the message can't be posted, the page is picked up the next time pages are prefetched.
+    PostMessage(prefetch->WindowHandle, WM_PHP_HEXEDIT_PREFETCH_COMPLETE, 0, 0);
+
+    PhReleaseRundownProtection(rundown);
+
+    return STATUS_SUCCESS;
+}
+
+VOID PhpHexEditPrefetchPages(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    LONG candidates[2];
+    LONG lastVisible;
+    ULONG i;
+    ULONG j;
+
+    if (Context->Length == 0)
+        return;
+
+    PhpHexEditCompletePrefetches(hwnd, Context);
+
+    // Fetch the pages just above and below the visible ones in the background so that scrolling
+    // doesn't have to wait for them.
+
+    lastVisible = min(Context->TopIndex + Context->LinesPerPage * Context->BytesPerRow, Context->Length) - 1;
+    candidates[0] = Context->TopIndex / PAGE_SIZE - 1;
+    candidates[1] = lastVisible / PAGE_SIZE + 1;
+
+    for (i = 0; i < sizeof(candidates) / sizeof(LONG); i++)
+    {
+        LONG index = candidates[i];
+        PPHP_HEXEDIT_PREFETCH prefetch;
+        ULONG freeSlot = -1;
+
+        if (index < 0 || index > (Context->Length - 1) / (LONG)PAGE_SIZE)
+            continue;
+        if (PhpHexEditFindPage(Context, index))
+            continue;
+
+        for (j = 0; j < PHP_HEXEDIT_NUMBER_OF_PREFETCHES; j++)
+        {
+            if (!Context->Prefetches[j])
+            {
+                if (freeSlot == -1)
+                    freeSlot = j;
+            }
+            else if (Context->Prefetches[j]->Page->Index == index)
+            {
+                break;
+            }
+        }
+
+        if (j != PHP_HEXEDIT_NUMBER_OF_PREFETCHES || freeSlot == -1)
+            continue;
+
+        if (!PhAcquireRundownProtection(&Context->PrefetchRundown))
+            return;
+
+        prefetch = PhAllocate(sizeof(PHP_HEXEDIT_PREFETCH));
+        prefetch->WindowHandle = hwnd;
+        prefetch->Provider = Context->Provider;
+        prefetch->Rundown = &Context->PrefetchRundown;
+        prefetch->Length = Context->Length;
+        prefetch->Page = PhAllocate(sizeof(PHP_HEXEDIT_PAGE));
+        prefetch->Page->Index = index;
+        prefetch->Page->Dirty = FALSE;
+        prefetch->Completed = FALSE;
+        Context->Prefetches[freeSlot] = prefetch;
+
+        PhQueueItemGlobalWorkQueue(PhpHexEditPrefetchWorker, prefetch);
+    }
+}
+
+VOID PhpHexEditCompletePrefetches(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < PHP_HEXEDIT_NUMBER_OF_PREFETCHES; i++)
+    {
+        PPHP_HEXEDIT_PREFETCH prefetch = Context->Prefetches[i];
+        PPHP_HEXEDIT_PAGE page;
+
+        if (!prefetch || !prefetch->Completed)
+            continue;
+
+        MemoryBarrier();
+        page = prefetch->Page;
+
+        if (!PhpHexEditFindPage(Context, page->Index))
+        {
+            PPHP_HEXEDIT_PAGE oldPage = NULL;
+
+            if (Context->NumberOfPages >= PHP_HEXEDIT_MAXIMUM_CACHED_PAGES)
+                oldPage = PhpHexEditRemoveLeastRecentlyUsedPage(Context);
+
+            if (oldPage)
+                PhFree(oldPage);
+            else
+                Context->NumberOfPages++;
+
+            InsertHeadList(&Context->PageListHead, &page->ListEntry);
+        }
+        else
+        {
+            PhFree(page);
+        }
+
+        PhFree(prefetch);
+        Context->Prefetches[i] = NULL;
+    }
+}
+
+NTSTATUS PhpHexEditFlush(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PLIST_ENTRY listEntry;
+
+    if (!Context->HasProvider)
+        return STATUS_SUCCESS;
+    if (!Context->Provider.Write)
+        return STATUS_NOT_SUPPORTED;
+
+    for (listEntry = Context->PageListHead.Flink; listEntry != &Context->PageListHead; listEntry = listEntry->Flink)
+    {
+        PPHP_HEXEDIT_PAGE page = CONTAINING_RECORD(listEntry, PHP_HEXEDIT_PAGE, ListEntry);
+        NTSTATUS writeStatus;
+        ULONG offset;
+
+        if (!page->Dirty)
+            continue;
+
+        offset = page->Index * PAGE_SIZE;
+        writeStatus = Context->Provider.Write(
+            offset,
+            page->Data,
+            min((ULONG)Context->Length - offset, PAGE_SIZE),
+            Context->Provider.Context
+            );
+
+        if (NT_SUCCESS(writeStatus))
+            page->Dirty = FALSE;
+        else
+            status = writeStatus;
+    }
+
+    return status;
+}
+
+VOID PhpHexEditFreePages(
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    // Wait for outstanding prefetches; they use the provider.
+    PhWaitForRundownProtection(&Context->PrefetchRundown);
+
+    for (i = 0; i < PHP_HEXEDIT_NUMBER_OF_PREFETCHES; i++)
+    {
+        if (Context->Prefetches[i])
+        {
+            PhFree(Context->Prefetches[i]->Page);
+            PhFree(Context->Prefetches[i]);
+            Context->Prefetches[i] = NULL;
+        }
+    }
+
+    while (!IsListEmpty(&Context->PageListHead))
+    {
+        PLIST_ENTRY listEntry = RemoveHeadList(&Context->PageListHead);
+
+        PhFree(CONTAINING_RECORD(listEntry, PHP_HEXEDIT_PAGE, ListEntry));
+    }
+
+    Context->NumberOfPages = 0;
+    Context->LastPage = NULL;
+    PhInitializeRundownProtection(&Context->PrefetchRundown);
+}
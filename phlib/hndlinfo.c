@@ -23,7 +23,10 @@
 #include <ph.h>
 #include <kphuser.h>
 
-#define PH_QUERY_HACK_MAX_THREADS 20
+#define PH_QUERY_HACK_MIN_THREADS 20
+#define PH_QUERY_HACK_THREADS_PER_PROCESSOR 4
+#define PH_QUERY_HACK_MAX_THREADS 128
+#define PH_QUERY_HACK_CANCEL_TIMEOUT (100 * PH_TIMEOUT_MS)
 
 typedef struct _PHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT
 {
@@ -111,6 +114,13 @@ static PPH_GET_CLIENT_ID_NAME PhHandleGetClientIdName = PhStdGetClientIdName;
 
 static SLIST_HEADER PhpCallWithTimeoutThreadListHead;
 static PH_QUEUED_LOCK PhpCallWithTimeoutThreadReleaseEvent = PH_QUEUED_LOCK_INIT;
+static ULONG PhpCallWithTimeoutNumberOfThreads;
+static ULONG PhpCallWithTimeoutNumberOfTimeouts;
+static NTSTATUS (NTAPI *NtCancelSynchronousIoFile_I)(
+    _In_ HANDLE ThreadHandle,
+    _In_opt_ PIO_STATUS_BLOCK IoRequestToCancel,
+    _Out_ PIO_STATUS_BLOCK IoStatusBlock
+    );
 
 PPH_GET_CLIENT_ID_NAME PhSetHandleClientIdFunction(
     _In_ PPH_GET_CLIENT_ID_NAME GetClientIdName
@@ -1415,6 +1425,96 @@ CleanupExit:
     return status;
 }
 
+/**
+ * Gets information for a handle whose object name is already known.
+ *
+ * \param ProcessHandle A handle to the process in which the
+ * handle resides.
+ * \param Handle The handle value.
+ * \param ObjectTypeNumber The object type number of the handle.
+ * You can specify -1 for this parameter if the object type number
+ * is not known.
+ * \param ObjectName The object name, for example from
+ * KphEnumerateProcessHandleNames(). Specify NULL if the name could
+ * not be queried.
+ * \param TypeName A variable which receives the object type name.
+ * \param BestObjectName A variable which receives the formatted
+ * object name.
+ *
+ * \remarks This function fails in the same cases as
+ * PhGetHandleInformation(), but does not query the object name.
+ * KProcessHacker must be connected.
+ */
+NTSTATUS PhGetHandleInformationFromName(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE Handle,
+    _In_ ULONG ObjectTypeNumber,
+    _In_opt_ PPH_STRINGREF ObjectName,
+    _Out_opt_ PPH_STRING *TypeName,
+    _Out_opt_ PPH_STRING *BestObjectName
+    )
+{
+    NTSTATUS status;
+    PPH_STRING typeName;
+    PPH_STRING objectName;
+    PPH_STRING bestObjectName = NULL;
+
+    if (Handle == NULL || Handle == NtCurrentProcess() || Handle == NtCurrentThread())
+        return STATUS_INVALID_HANDLE;
+    if (ObjectTypeNumber != -1 && ObjectTypeNumber >= MAX_OBJECT_TYPE_NUMBER)
+        return STATUS_INVALID_PARAMETER_3;
+
+    status = PhpGetObjectTypeName(
+        ProcessHandle,
+        Handle,
+        ObjectTypeNumber,
+        &typeName
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    if (ObjectName)
+    {
+        objectName = PhCreateString2(ObjectName);
+    }
+    else if (PhEqualString2(typeName, L"File", TRUE))
+    {
+        // PhpGetBestObjectName can provide us with a name.
+        objectName = PhReferenceEmptyString();
+    }
+    else
+    {
+        PhDereferenceObject(typeName);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    if (BestObjectName)
+    {
+        status = PhpGetBestObjectName(
+            ProcessHandle,
+            Handle,
+            objectName,
+            typeName,
+            &bestObjectName
+            );
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        if (TypeName)
+            PhSetReference(TypeName, typeName);
+        if (BestObjectName)
+            PhSetReference(BestObjectName, bestObjectName);
+    }
+
+    PhDereferenceObject(typeName);
+    PhDereferenceObject(objectName);
+    PhClearReference(&bestObjectName);
+
+    return status;
+}
+
 NTSTATUS PhEnumObjectTypes(
     _Out_ POBJECT_TYPES_INFORMATION *ObjectTypes
     )
@@ -1488,29 +1588,51 @@ ULONG PhGetObjectTypeNumber(
     return -1;
 }
 
-PPHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT PhpAcquireCallWithTimeoutThread(
-    _In_opt_ PLARGE_INTEGER Timeout
+VOID PhpInitializeCallWithTimeout(
+    VOID
     )
 {
     static PH_INITONCE initOnce = PH_INITONCE_INIT;
 
-    PPHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT threadContext;
-    PSLIST_ENTRY listEntry;
-    PH_QUEUED_WAIT_BLOCK waitBlock;
-
     if (PhBeginInitOnce(&initOnce))
     {
+        PPHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT threadContext;
+        ULONG numberOfThreads;
         ULONG i;
 
-        for (i = 0; i < PH_QUERY_HACK_MAX_THREADS; i++)
+        // Hung calls each hold on to a thread until they time out, so the pool is sized by the
+        // number of processors to let batches of queries proceed in parallel.
+        numberOfThreads = (ULONG)PhSystemBasicInformation.NumberOfProcessors * PH_QUERY_HACK_THREADS_PER_PROCESSOR;
+
+        if (numberOfThreads < PH_QUERY_HACK_MIN_THREADS)
+            numberOfThreads = PH_QUERY_HACK_MIN_THREADS;
+        if (numberOfThreads > PH_QUERY_HACK_MAX_THREADS)
+            numberOfThreads = PH_QUERY_HACK_MAX_THREADS;
+
+        for (i = 0; i < numberOfThreads; i++)
         {
             threadContext = PhAllocate(sizeof(PHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT));
             memset(threadContext, 0, sizeof(PHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT));
             RtlInterlockedPushEntrySList(&PhpCallWithTimeoutThreadListHead, &threadContext->ListEntry);
         }
 
+        PhpCallWithTimeoutNumberOfThreads = numberOfThreads;
+
+        if (WindowsVersion >= WINDOWS_VISTA)
+            NtCancelSynchronousIoFile_I = PhGetModuleProcAddress(L"ntdll.dll", "NtCancelSynchronousIoFile");
+
         PhEndInitOnce(&initOnce);
     }
+}
+
+PPHP_CALL_WITH_TIMEOUT_THREAD_CONTEXT PhpAcquireCallWithTimeoutThread(
+    _In_opt_ PLARGE_INTEGER Timeout
+    )
+{
+    PSLIST_ENTRY listEntry;
+    PH_QUEUED_WAIT_BLOCK waitBlock;
+
+    PhpInitializeCallWithTimeout();
 
     while (TRUE)
     {
@@ -1605,18 +1727,39 @@ NTSTATUS PhpCallWithTimeout(
     NtSetEvent(ThreadContext->StartEventHandle, NULL);
     status = NtWaitForSingleObject(ThreadContext->CompletedEventHandle, FALSE, Timeout);
 
+    if (status == STATUS_TIMEOUT && NtCancelSynchronousIoFile_I)
+    {
+        IO_STATUS_BLOCK isb;
+        LARGE_INTEGER cancelTimeout;
+
+        // Most hangs are synchronous I/O on pipes, which can be cancelled. This keeps the thread
+        // (and its stack) around for the next call.
+        if (NT_SUCCESS(NtCancelSynchronousIoFile_I(ThreadContext->ThreadHandle, NULL, &isb)))
+        {
+            cancelTimeout.QuadPart = -PH_QUERY_HACK_CANCEL_TIMEOUT;
+
+            if (NtWaitForSingleObject(ThreadContext->CompletedEventHandle, FALSE, &cancelTimeout) == STATUS_WAIT_0)
+                status = STATUS_CANCELLED;
+        }
+    }
+
     ThreadContext->Routine = NULL;
     MemoryBarrier();
     ThreadContext->Context = NULL;
 
     if (status != STATUS_WAIT_0)
     {
-        // The operation timed out, or there was an error. Kill the thread.
-        // On Vista and above, the thread stack is freed automatically.
-        NtTerminateThread(ThreadContext->ThreadHandle, STATUS_UNSUCCESSFUL);
-        status = NtWaitForSingleObject(ThreadContext->ThreadHandle, FALSE, NULL);
-        NtClose(ThreadContext->ThreadHandle);
-        ThreadContext->ThreadHandle = NULL;
+        _InterlockedIncrement((PLONG)&PhpCallWithTimeoutNumberOfTimeouts);
+
+        if (status != STATUS_CANCELLED)
+        {
+            // The operation timed out, or there was an error. Kill the thread.
+            // On Vista and above, the thread stack is freed automatically.
+            NtTerminateThread(ThreadContext->ThreadHandle, STATUS_UNSUCCESSFUL);
+            status = NtWaitForSingleObject(ThreadContext->ThreadHandle, FALSE, NULL);
+            NtClose(ThreadContext->ThreadHandle);
+            ThreadContext->ThreadHandle = NULL;
+        }
 
         status = STATUS_UNSUCCESSFUL;
     }
@@ -1669,6 +1812,29 @@ NTSTATUS PhCallWithTimeout(
     return status;
 }
 
+/**
+ * Gets information about the threads used by PhCallWithTimeout().
+ *
+ * \param NumberOfThreads A variable which receives the maximum
+ * number of calls that can run concurrently. Callers dispatching
+ * batches of calls from a work queue should not use more threads
+ * than this.
+ * \param NumberOfTimeouts A variable which receives the number of
+ * calls that have timed out since the process started.
+ */
+VOID PhGetCallWithTimeoutStatistics(
+    _Out_opt_ PULONG NumberOfThreads,
+    _Out_opt_ PULONG NumberOfTimeouts
+    )
+{
+    PhpInitializeCallWithTimeout();
+
+    if (NumberOfThreads)
+        *NumberOfThreads = PhpCallWithTimeoutNumberOfThreads;
+    if (NumberOfTimeouts)
+        *NumberOfTimeouts = PhpCallWithTimeoutNumberOfTimeouts;
+}
+
 NTSTATUS PhpCommonQueryObjectRoutine(
     _In_ PVOID Parameter
     )
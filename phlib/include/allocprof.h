@@ -0,0 +1,55 @@
+#ifndef _PH_ALLOCPROF_H
+#define _PH_ALLOCPROF_H
+
+// Allocation profiling. When PH_ALLOCATION_PROFILING is defined, PhAllocate records every heap
+// allocation under the address it was called from, and PhCreateObject records every object under
+// its caller and the object type. The counts are kept in a fixed-size table that is updated
+// without locks and can be copied at any time using PhGetAllocationSites.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef PH_ALLOCATION_PROFILING
+
+/** The number of allocation sites that can be recorded. Must be a power of two. */
+#define PH_ALLOCATION_SITE_COUNT 4096
+/** The type index of a site that records heap allocations instead of objects. */
+#define PH_ALLOCATION_SITE_NO_TYPE 0xffff
+
+typedef struct _PH_ALLOCATION_SITE
+{
+    /** The return address of the allocation call, or NULL for allocations that did not fit in the table. */
+    PVOID CallerAddress;
+    /** The index of the object type, or PH_ALLOCATION_SITE_NO_TYPE. */
+    USHORT TypeIndex;
+    /** The number of allocations. */
+    ULONG64 Count;
+    /** The total number of bytes allocated. */
+    ULONG64 Bytes;
+} PH_ALLOCATION_SITE, *PPH_ALLOCATION_SITE;
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfRecordAllocation(
+    _In_ PVOID CallerAddress,
+    _In_ USHORT TypeIndex,
+    _In_ SIZE_T Size
+    );
+
+PHLIBAPI
+ULONG
+NTAPI
+PhGetAllocationSites(
+    _Out_writes_to_(Count, return) PPH_ALLOCATION_SITE Sites,
+    _In_ ULONG Count
+    );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
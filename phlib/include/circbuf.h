@@ -3,6 +3,51 @@
 
 #define PH_CIRCULAR_BUFFER_POWER_OF_TWO_SIZE
 
+/**
+ * The position and count of a buffer in one or more circular buffer slabs.
+ */
+typedef struct _PH_CIRCULAR_BUFFER_SLOT
+{
+    /** The column of the buffer in the slab. */
+    ULONG Slot;
+    ULONG Count;
+    LONG Index;
+} PH_CIRCULAR_BUFFER_SLOT, *PPH_CIRCULAR_BUFFER_SLOT;
+
+/**
+ * Adds a new item to a buffer in a slab.
+ *
+ * \param Slot The slot of the buffer.
+ * \param Size The size of the slab.
+ * \param Index The row of the new item, as returned by PhAdvanceCircularBufferSlabIndex(). All
+ * buffers that are updated in the same period should use the same row.
+ */
+FORCEINLINE VOID PhAdvanceCircularBufferSlot(
+    _Inout_ PPH_CIRCULAR_BUFFER_SLOT Slot,
+    _In_ ULONG Size,
+    _In_ LONG Index
+    )
+{
+    Slot->Index = Index;
+
+    if (Slot->Count < Size)
+        Slot->Count++;
+}
+
+/**
+ * Gets the row for the next period in a circular buffer slab.
+ *
+ * \param Index The current row.
+ * \param Size The size of the slab. This must be a power of two.
+ */
+FORCEINLINE LONG PhAdvanceCircularBufferSlabIndex(
+    _In_ LONG Index,
+    _In_ ULONG Size
+    )
+{
+    return (Index - 1) & (Size - 1);
+}
+
 #undef T
 #define T ULONG
 #include "circbuf_h.h"
@@ -11,9 +56,16 @@
 #define T ULONG64
 #include "circbuf_h.h"
 
+#undef T
+#define T USHORT
+#include "circbuf_h.h"
+
+// Tiers need arithmetic on T.
+#define PH_CIRCULAR_BUFFER_NO_TIER
 #undef T
 #define T PVOID
 #include "circbuf_h.h"
+#undef PH_CIRCULAR_BUFFER_NO_TIER
 
 #undef T
 #define T SIZE_T
@@ -129,4 +129,152 @@ FORCEINLINE T T___(PhAddItemCircularBuffer2, T)(
     return oldValue;
 }
 
+// Slab
+
+/**
+ * A set of circular buffers of the same size stored in a single allocation.
+ * Item \a Index of every buffer in the set is stored in the same row, so adding an item to every
+ * buffer for the same period is a sequential write. The position and count of each buffer is
+ * stored separately in a PH_CIRCULAR_BUFFER_SLOT, which may be shared by several slabs.
+ */
+typedef struct T___(_PH_CIRCULAR_BUFFER_SLAB, T)
+{
+    ULONG Size;
+    ULONG SizeMinusOne;
+    ULONG NumberOfSlots;
+    T *Data;
+} T___(PH_CIRCULAR_BUFFER_SLAB, T), *T___(PPH_CIRCULAR_BUFFER_SLAB, T);
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhInitializeCircularBufferSlab, T)(
+    _Out_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ ULONG Size,
+    _In_ ULONG NumberOfSlots
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhDeleteCircularBufferSlab, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhCopyCircularBufferSlab, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ PPH_CIRCULAR_BUFFER_SLOT Slot,
+    _Out_writes_(Count) T *Destination,
+    _In_ ULONG Count
+    );
+
+FORCEINLINE T T___(PhGetItemCircularBufferSlab, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ PPH_CIRCULAR_BUFFER_SLOT Slot,
+    _In_ LONG Index
+    )
+{
+    return Slab->Data[((Slot->Index + Index) & Slab->SizeMinusOne) * Slab->NumberOfSlots + Slot->Slot];
+}
+
+/**
+ * Sets the newest item of a buffer in a slab. Call PhAdvanceCircularBufferSlot() first to add a
+ * new item.
+ */
+FORCEINLINE VOID T___(PhSetNewestItemCircularBufferSlab, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_SLAB, T) Slab,
+    _In_ PPH_CIRCULAR_BUFFER_SLOT Slot,
+    _In_ T Value
+    )
+{
+    Slab->Data[Slot->Index * Slab->NumberOfSlots + Slot->Slot] = Value;
+}
+
+#ifndef PH_CIRCULAR_BUFFER_NO_TIER
+
+// Tier
+
+/**
+ * Long-term storage for items that fall out of a circular buffer. Each group of \a BucketSize
+ * items is combined into a bucket which records the minimum, maximum and average of the group.
+ * Items that have not yet filled a bucket are kept in the pending fields.
+ */
+typedef struct T___(_PH_CIRCULAR_BUFFER_TIER, T)
+{
+    ULONG BucketSize; // 0 if the tier is disabled
+    ULONG PendingCount;
+    T PendingMinimum;
+    T PendingMaximum;
+    DOUBLE PendingSum;
+    T___(PH_CIRCULAR_BUFFER, T) Minimum;
+    T___(PH_CIRCULAR_BUFFER, T) Maximum;
+    T___(PH_CIRCULAR_BUFFER, T) Average;
+} T___(PH_CIRCULAR_BUFFER_TIER, T), *T___(PPH_CIRCULAR_BUFFER_TIER, T);
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhInitializeCircularBufferTier, T)(
+    _Out_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ ULONG BucketSize,
+    _In_ ULONG NumberOfBuckets
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhDeleteCircularBufferTier, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhAddItemCircularBufferTiered, T)(
+    _Inout_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _Inout_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ T Value
+    );
+
+PHLIBAPI
+T
+NTAPI
+T___(PhGetItemCircularBufferTiered, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _In_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _In_ ULONG Index,
+    _Out_opt_ T *Minimum,
+    _Out_opt_ T *Maximum
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+T___(PhCopyCircularBufferTiered, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _In_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier,
+    _Out_writes_(Count) T *Destination,
+    _In_ ULONG Count
+    );
+
+/**
+ * Gets the number of items in a circular buffer and its tier, counting each bucket as
+ * \a BucketSize items.
+ */
+FORCEINLINE ULONG T___(PhGetCountCircularBufferTiered, T)(
+    _In_ T___(PPH_CIRCULAR_BUFFER, T) Buffer,
+    _In_ T___(PPH_CIRCULAR_BUFFER_TIER, T) Tier
+    )
+{
+    if (Tier->BucketSize == 0)
+        return Buffer->Count;
+
+    return Buffer->Count + Tier->PendingCount + Tier->Average.Count * Tier->BucketSize;
+}
+
+#endif
+
 #endif
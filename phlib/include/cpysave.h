@@ -18,6 +18,24 @@ PPH_LIST PhaFormatTextTable(
     _In_ ULONG Mode
     );
 
+typedef VOID (NTAPI *PPH_TEXT_TABLE_GET_CELL)(
+    _In_ ULONG Row,
+    _In_ ULONG Column,
+    _Out_ PPH_STRINGREF Text,
+    _Out_ PULONG Indent, // number of spaces to write before the text
+    _In_opt_ PVOID Context
+    );
+
+PHLIBAPI
+NTSTATUS PhWriteTextTableFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Rows,
+    _In_ ULONG Columns,
+    _In_ ULONG Mode,
+    _In_ PPH_TEXT_TABLE_GET_CELL GetCell,
+    _In_opt_ PVOID Context
+    );
+
 VOID PhMapDisplayIndexTreeNew(
     _In_ HWND TreeNewHandle,
     _Out_opt_ PULONG *DisplayToId,
@@ -37,6 +55,13 @@ PPH_LIST PhGetGenericTreeNewLines(
     _In_ ULONG Mode
     );
 
+PHLIBAPI
+NTSTATUS PhWriteGenericTreeNewFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ HWND TreeNewHandle,
+    _In_ ULONG Mode
+    );
+
 VOID PhaMapDisplayIndexListView(
     _In_ HWND ListViewHandle,
     _Out_writes_(Count) PULONG DisplayToId,
@@ -86,6 +86,40 @@ PhfTryAcquireFastLockShared(
     _Inout_ PPH_FAST_LOCK FastLock
     );
 
+#ifdef PH_LOCK_PROFILING
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfProfileAcquireFastLockExclusive(
+    _Inout_ PPH_FAST_LOCK FastLock,
+    _Inout_ PPH_LOCK_SITE Site
+    );
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfProfileAcquireFastLockShared(
+    _Inout_ PPH_FAST_LOCK FastLock,
+    _Inout_ PPH_LOCK_SITE Site
+    );
+
+#undef PhAcquireFastLockExclusive
+#define PhAcquireFastLockExclusive(FastLock) \
+    do { \
+        PH_LOCK_SITE_DECLARE(phLockSite_, TRUE, TRUE); \
+        PhfProfileAcquireFastLockExclusive((FastLock), &phLockSite_); \
+    } while (0)
+
+#undef PhAcquireFastLockShared
+#define PhAcquireFastLockShared(FastLock) \
+    do { \
+        PH_LOCK_SITE_DECLARE(phLockSite_, FALSE, TRUE); \
+        PhfProfileAcquireFastLockShared((FastLock), &phLockSite_); \
+    } while (0)
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,12 +12,63 @@ BOOLEAN PhHexEditInitialization(
     VOID
     );
 
+typedef NTSTATUS (NTAPI *PPH_HEXEDIT_READ_CALLBACK)(
+    _In_ ULONG Offset,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    );
+
+typedef NTSTATUS (NTAPI *PPH_HEXEDIT_WRITE_CALLBACK)(
+    _In_ ULONG Offset,
+    _In_reads_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length,
+    _In_opt_ PVOID Context
+    );
+
+/**
+ * Supplies data to the hex editor one page at a time. The read
+ * callback may be invoked from a worker thread to prefetch pages
+ * adjacent to the visible ones.
+ */
+typedef struct _PH_HEXEDIT_PROVIDER
+{
+    PPH_HEXEDIT_READ_CALLBACK Read;
+    PPH_HEXEDIT_WRITE_CALLBACK Write; // optional
+    PVOID Context;
+} PH_HEXEDIT_PROVIDER, *PPH_HEXEDIT_PROVIDER;
+
+typedef struct _PH_HEXEDIT_DATA
+{
+    ULONG Offset;
+    ULONG Length;
+    PUCHAR Buffer;
+} PH_HEXEDIT_DATA, *PPH_HEXEDIT_DATA;
+
+/**
+ * Describes a byte pattern to search for. See PhFindBytePattern
+ * for the meaning of the mask.
+ */
+typedef struct _PH_HEXEDIT_FIND
+{
+    PUCHAR Pattern;
+    PUCHAR Mask; // optional
+    ULONG Length;
+    ULONG StartOffset;
+    ULONG Offset; // receives the offset of the match
+} PH_HEXEDIT_FIND, *PPH_HEXEDIT_FIND;
+
 #define HEM_SETBUFFER (WM_USER + 1)
 #define HEM_SETDATA (WM_USER + 2)
 #define HEM_GETBUFFER (WM_USER + 3)
 #define HEM_SETSEL (WM_USER + 4)
 #define HEM_SETEDITMODE (WM_USER + 5)
 #define HEM_SETBYTESPERROW (WM_USER + 6)
+#define HEM_SETPROVIDER (WM_USER + 7)
+#define HEM_READDATA (WM_USER + 8)
+#define HEM_FLUSH (WM_USER + 9)
+#define HEM_DISCARD (WM_USER + 10)
+#define HEM_FIND (WM_USER + 11)
 
 #define HexEdit_SetBuffer(hWnd, Buffer, Length) \
     SendMessage((hWnd), HEM_SETBUFFER, (WPARAM)(Length), (LPARAM)(Buffer))
@@ -37,4 +88,19 @@ BOOLEAN PhHexEditInitialization(
 #define HexEdit_SetBytesPerRow(hWnd, BytesPerRow) \
     SendMessage((hWnd), HEM_SETBYTESPERROW, (WPARAM)(BytesPerRow), 0)
 
+#define HexEdit_SetProvider(hWnd, Provider, Length) \
+    SendMessage((hWnd), HEM_SETPROVIDER, (WPARAM)(Length), (LPARAM)(Provider))
+
+#define HexEdit_ReadData(hWnd, Data) \
+    ((BOOLEAN)SendMessage((hWnd), HEM_READDATA, 0, (LPARAM)(Data)))
+
+#define HexEdit_Flush(hWnd) \
+    ((NTSTATUS)SendMessage((hWnd), HEM_FLUSH, 0, 0))
+
+#define HexEdit_Discard(hWnd) \
+    SendMessage((hWnd), HEM_DISCARD, 0, 0)
+
+#define HexEdit_Find(hWnd, Find) \
+    ((BOOLEAN)SendMessage((hWnd), HEM_FIND, 0, (LPARAM)(Find)))
+
 #endif
@@ -1,11 +1,45 @@
 #ifndef _PH_HEXEDITP_H
 #define _PH_HEXEDITP_H
 
+#define PHP_HEXEDIT_MAXIMUM_CACHED_PAGES 64
+#define PHP_HEXEDIT_NUMBER_OF_PREFETCHES 2
+#define PHP_HEXEDIT_FIND_WINDOW_SIZE (1024 * 1024)
+
+#define WM_PHP_HEXEDIT_PREFETCH_COMPLETE (WM_USER + 100)
+
+typedef struct _PHP_HEXEDIT_PAGE
+{
+    LIST_ENTRY ListEntry;
+    LONG Index;
+    BOOLEAN Dirty;
+    UCHAR Data[PAGE_SIZE];
+} PHP_HEXEDIT_PAGE, *PPHP_HEXEDIT_PAGE;
+
+typedef struct _PHP_HEXEDIT_PREFETCH
+{
+    HWND WindowHandle;
+    PH_HEXEDIT_PROVIDER Provider;
+    PPH_RUNDOWN_PROTECT Rundown;
+    ULONG Length;
+    PPHP_HEXEDIT_PAGE Page;
+    volatile BOOLEAN Completed;
+} PHP_HEXEDIT_PREFETCH, *PPHP_HEXEDIT_PREFETCH;
+
 typedef struct _PHP_HEXEDIT_CONTEXT
 {
     PUCHAR Data;
     LONG Length;
     BOOLEAN UserBuffer;
+
+    // Provider mode (Data is NULL)
+    BOOLEAN HasProvider;
+    PH_HEXEDIT_PROVIDER Provider;
+    LIST_ENTRY PageListHead; // most recently used first
+    ULONG NumberOfPages;
+    PPHP_HEXEDIT_PAGE LastPage;
+    PH_RUNDOWN_PROTECT PrefetchRundown;
+    PPHP_HEXEDIT_PREFETCH Prefetches[PHP_HEXEDIT_NUMBER_OF_PREFETCHES];
+
     LONG TopIndex; // index of first visible byte on screen
 
     LONG CurrentAddress;
@@ -90,6 +124,86 @@ FORCEINLINE BOOLEAN PhpHexEditHasSelected(
     return Context->SelStart != -1;
 }
 
+FORCEINLINE BOOLEAN PhpHexEditHasData(
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    )
+{
+    return Context->Data || Context->HasProvider;
+}
+
+PPHP_HEXEDIT_PAGE PhpHexEditGetPage(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Index
+    );
+
+FORCEINLINE UCHAR PhpHexEditGetByte(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position
+    )
+{
+    PPHP_HEXEDIT_PAGE page;
+
+    if (Context->Data)
+        return Context->Data[Position];
+
+    page = Context->LastPage;
+
+    if (!page || page->Index != Position / PAGE_SIZE)
+        page = PhpHexEditGetPage(hwnd, Context, Position / PAGE_SIZE);
+
+    return page->Data[Position % PAGE_SIZE];
+}
+
+VOID PhpHexEditSetByte(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _In_ UCHAR Byte
+    );
+
+VOID PhpHexEditReadData(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length
+    );
+
+VOID PhpHexEditWriteData(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_ LONG Position,
+    _In_reads_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length
+    );
+
+BOOLEAN PhpHexEditFind(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _Inout_ PPH_HEXEDIT_FIND Find
+    );
+
+VOID PhpHexEditPrefetchPages(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    );
+
+VOID PhpHexEditCompletePrefetches(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    );
+
+NTSTATUS PhpHexEditFlush(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    );
+
+VOID PhpHexEditFreePages(
+    _In_ PPHP_HEXEDIT_CONTEXT Context
+    );
+
 VOID PhpHexEditCreateAddressCaret(
     _In_ HWND hwnd,
     _In_ PPHP_HEXEDIT_CONTEXT Context
@@ -197,4 +311,11 @@ VOID PhpHexEditSetData(
     _In_ ULONG Length
     );
 
+VOID PhpHexEditSetProvider(
+    _In_ HWND hwnd,
+    _In_ PPHP_HEXEDIT_CONTEXT Context,
+    _In_opt_ PPH_HEXEDIT_PROVIDER Provider,
+    _In_ ULONG Length
+    );
+
 #endif
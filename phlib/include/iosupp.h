@@ -23,6 +23,21 @@ NTSTATUS PhpWriteFileStream(
     _In_ ULONG Length
     );
 
+NTSTATUS PhpWaitWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream
+    );
+
+NTSTATUS PhpIssueWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Length
+    );
+
+NTSTATUS PhpWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_reads_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Length
+    );
+
 NTSTATUS PhpFlushReadFileStream(
     _Inout_ PPH_FILE_STREAM FileStream
     );
@@ -19,6 +19,64 @@ typedef struct _KPH_PROCESS_PROTECTION_INFORMATION
     BOOLEAN IsProtectedProcess;
 } KPH_PROCESS_PROTECTION_INFORMATION, *PKPH_PROCESS_PROTECTION_INFORMATION;
 
+// Process identifiers
+
+#define KPH_PROCESS_ID_EXITED 0x1 // the process has exited but its object is still referenced
+
+typedef struct _KPH_PROCESS_ID_ENTRY
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+    ULONG Flags;
+    NTSTATUS ExitStatus;
+} KPH_PROCESS_ID_ENTRY, *PKPH_PROCESS_ID_ENTRY;
+
+typedef struct _KPH_PROCESS_ID_INFORMATION
+{
+    ULONG NumberOfProcesses;
+    KPH_PROCESS_ID_ENTRY Processes[1];
+} KPH_PROCESS_ID_INFORMATION, *PKPH_PROCESS_ID_INFORMATION;
+
+// Process information batches
+
+#define KPH_MAXIMUM_PROCESS_BATCH_ENTRIES 1024
+
+#define KPH_PROCESS_FIELD_PRIORITY_CLASS 0x1
+#define KPH_PROCESS_FIELD_IO_PRIORITY 0x2
+#define KPH_PROCESS_FIELD_PAGE_PRIORITY 0x4
+#define KPH_PROCESS_FIELD_EXECUTE_FLAGS 0x8
+#define KPH_PROCESS_FIELD_PROTECTION 0x10
+#define KPH_PROCESS_FIELD_HANDLE_COUNT 0x20
+#define KPH_PROCESS_FIELD_ALL 0x3f
+
+typedef struct _KPH_PROCESS_BATCH_ENTRY
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime; // out: identifies the process if the PID is re-used
+    NTSTATUS Status; // out: the result of looking up the process
+    ULONG ValidFields; // out: KPH_PROCESS_FIELD_* values which were queried successfully
+    UCHAR PriorityClass; // out
+    BOOLEAN IsProtectedProcess; // out
+    USHORT Reserved;
+    ULONG IoPriority; // out
+    ULONG PagePriority; // out
+    ULONG ExecuteFlags; // out
+    ULONG HandleCount; // out
+} KPH_PROCESS_BATCH_ENTRY, *PKPH_PROCESS_BATCH_ENTRY;
+
+// Virtual memory
+
+#define KPH_MAXIMUM_READ_BATCH_ENTRIES 1024
+
+typedef struct _KPH_VIRTUAL_MEMORY_READ_ENTRY
+{
+    PVOID BaseAddress;
+    PVOID Buffer;
+    SIZE_T BufferSize;
+    SIZE_T NumberOfBytesRead; // out
+    NTSTATUS Status; // out
+} KPH_VIRTUAL_MEMORY_READ_ENTRY, *PKPH_VIRTUAL_MEMORY_READ_ENTRY;
+
 // Thread information
 
 typedef enum _KPH_THREAD_INFORMATION_CLASS
@@ -29,6 +87,20 @@ typedef enum _KPH_THREAD_INFORMATION_CLASS
     MaxKphThreadInfoClass
 } KPH_THREAD_INFORMATION_CLASS;
 
+// Thread stack back-traces
+
+#define KPH_MAXIMUM_STACK_BACK_TRACE_BATCH_ENTRIES 1024
+
+#define KPH_STACK_BACK_TRACE_USER_MODE 0x1 // capture the user-mode stack instead of the kernel-mode stack
+
+typedef struct _KPH_STACK_BACK_TRACE_ENTRY
+{
+    HANDLE ThreadId;
+    ULONG CapturedFrames; // out
+    ULONG BackTraceHash; // out
+    NTSTATUS Status; // out
+} KPH_STACK_BACK_TRACE_ENTRY, *PKPH_STACK_BACK_TRACE_ENTRY;
+
 // Process handle information
 
 typedef struct _KPH_PROCESS_HANDLE
@@ -48,6 +120,55 @@ typedef struct _KPH_PROCESS_HANDLE_INFORMATION
     KPH_PROCESS_HANDLE Handles[1];
 } KPH_PROCESS_HANDLE_INFORMATION, *PKPH_PROCESS_HANDLE_INFORMATION;
 
+// Process handle digest
+
+// Each range covers 1024 handles (a span of 4096 handle values).
+#define KPH_HANDLE_RANGE_SHIFT 12
+#define KPH_HANDLE_RANGE_SIZE (1 << KPH_HANDLE_RANGE_SHIFT)
+
+typedef struct _KPH_PROCESS_HANDLE_RANGE
+{
+    ULONG HandleCount;
+    ULONG Digest; // hash of the handle value, object, granted access and attributes of each handle
+} KPH_PROCESS_HANDLE_RANGE, *PKPH_PROCESS_HANDLE_RANGE;
+
+typedef struct _KPH_PROCESS_HANDLE_DIGEST
+{
+    ULONG HandleCount;
+    ULONG NumberOfRanges;
+    KPH_PROCESS_HANDLE_RANGE Ranges[1];
+} KPH_PROCESS_HANDLE_DIGEST, *PKPH_PROCESS_HANDLE_DIGEST;
+
+// Process handle names
+
+// A set of object type indices. Type indices are always less than 256.
+typedef struct _KPH_OBJECT_TYPE_MASK
+{
+    ULONG Bits[8];
+} KPH_OBJECT_TYPE_MASK, *PKPH_OBJECT_TYPE_MASK;
+
+#define KPH_TEST_OBJECT_TYPE_MASK(Mask, Index) (((Index) < 256) && ((Mask)->Bits[(Index) / 32] & (1 << ((Index) % 32))))
+#define KPH_SET_OBJECT_TYPE_MASK(Mask, Index) ((Mask)->Bits[(Index) / 32] |= (1 << ((Index) % 32)))
+
+// At most this many handles are returned by each request.
+#define KPH_MAXIMUM_HANDLE_NAMES 512
+
+typedef struct _KPH_PROCESS_HANDLE_NAME
+{
+    ULONG NextEntryOffset; // 0 for the last entry
+    NTSTATUS NameStatus; // the status of the name query; ObjectName is empty if it failed
+    KPH_PROCESS_HANDLE Handle;
+    UNICODE_STRING ObjectName; // points into the same buffer, null-terminated
+} KPH_PROCESS_HANDLE_NAME, *PKPH_PROCESS_HANDLE_NAME;
+
+typedef struct _KPH_PROCESS_HANDLE_NAME_INFORMATION
+{
+    ULONG HandleCount;
+    ULONG Reserved;
+    HANDLE NextHandle; // pass as StartHandle to continue the enumeration; NULL if there are no more handles
+    KPH_PROCESS_HANDLE_NAME Handles[1];
+} KPH_PROCESS_HANDLE_NAME_INFORMATION, *PKPH_PROCESS_HANDLE_NAME_INFORMATION;
+
 // Object information
 
 typedef enum _KPH_OBJECT_INFORMATION_CLASS
@@ -118,6 +239,65 @@ typedef struct _ETWREG_BASIC_INFORMATION
     ULONG_PTR SessionId;
 } ETWREG_BASIC_INFORMATION, *PETWREG_BASIC_INFORMATION;
 
+// Notifications
+
+typedef enum _KPH_NOTIFY_EVENT_TYPE
+{
+    KphNotifyProcessCreate = 1,
+    KphNotifyProcessExit,
+    KphNotifyThreadCreate,
+    KphNotifyThreadExit,
+    KphNotifyImageLoad
+} KPH_NOTIFY_EVENT_TYPE;
+
+typedef struct _KPH_NOTIFY_EVENT
+{
+    USHORT Type; // KPH_NOTIFY_EVENT_TYPE
+    USHORT Processor;
+    ULONG Sequence; // per processor
+    LARGE_INTEGER TimeStamp; // interrupt time
+    HANDLE ProcessId;
+    union
+    {
+        HANDLE ParentProcessId; // KphNotifyProcessCreate
+        NTSTATUS ExitStatus; // KphNotifyProcessExit
+        HANDLE ThreadId; // KphNotifyThreadCreate, KphNotifyThreadExit
+        PVOID ImageBase; // KphNotifyImageLoad
+    };
+    SIZE_T ImageSize; // KphNotifyImageLoad
+    CHAR ImageFileName[16]; // KphNotifyProcessCreate, KphNotifyProcessExit
+} KPH_NOTIFY_EVENT, *PKPH_NOTIFY_EVENT;
+
+#define KPH_NOTIFY_RING_SIZE 1024 // events buffered for each processor
+
+typedef struct _KPH_NOTIFY_EVENT_INFORMATION
+{
+    ULONG EventCount;
+    ULONG LostCount; // events discarded because a buffer was full
+    KPH_NOTIFY_EVENT Events[1];
+} KPH_NOTIFY_EVENT_INFORMATION, *PKPH_NOTIFY_EVENT_INFORMATION;
+
+// Control statistics
+
+#define KPH_MAXIMUM_CONTROL_FUNCTIONS 256
+
+typedef struct _KPH_CONTROL_STATISTICS_ENTRY
+{
+    ULONG ControlCode;
+    ULONG Reserved;
+    ULONG64 Calls;
+    ULONG64 TotalTime; // performance counter ticks
+    ULONG64 MaximumTime; // performance counter ticks
+} KPH_CONTROL_STATISTICS_ENTRY, *PKPH_CONTROL_STATISTICS_ENTRY;
+
+typedef struct _KPH_CONTROL_STATISTICS
+{
+    ULONG NumberOfEntries; // only control codes that have been called are included
+    ULONG Reserved;
+    LARGE_INTEGER Frequency;
+    KPH_CONTROL_STATISTICS_ENTRY Entries[1];
+} KPH_CONTROL_STATISTICS, *PKPH_CONTROL_STATISTICS;
+
 // Device
 
 #define KPH_DEVICE_SHORT_NAME L"KProcessHacker2"
@@ -178,6 +358,7 @@ typedef struct _KPH_DYN_CONFIGURATION
 
 // General
 #define KPH_GETFEATURES KPH_CTL_CODE(0)
+#define KPH_QUERYCONTROLSTATISTICS KPH_CTL_CODE(1)
 
 // Processes
 #define KPH_OPENPROCESS KPH_CTL_CODE(50)
@@ -191,6 +372,9 @@ typedef struct _KPH_DYN_CONFIGURATION
 #define KPH_READVIRTUALMEMORYUNSAFE KPH_CTL_CODE(58)
 #define KPH_QUERYINFORMATIONPROCESS KPH_CTL_CODE(59)
 #define KPH_SETINFORMATIONPROCESS KPH_CTL_CODE(60)
+#define KPH_READVIRTUALMEMORYBATCH KPH_CTL_CODE(61)
+#define KPH_ENUMERATEPROCESSIDS KPH_CTL_CODE(62)
+#define KPH_QUERYINFORMATIONPROCESSES KPH_CTL_CODE(63)
 
 // Threads
 #define KPH_OPENTHREAD KPH_CTL_CODE(100)
@@ -202,12 +386,20 @@ typedef struct _KPH_DYN_CONFIGURATION
 #define KPH_CAPTURESTACKBACKTRACETHREAD KPH_CTL_CODE(106)
 #define KPH_QUERYINFORMATIONTHREAD KPH_CTL_CODE(107)
 #define KPH_SETINFORMATIONTHREAD KPH_CTL_CODE(108)
+#define KPH_CAPTURESTACKBACKTRACETHREADS KPH_CTL_CODE(109)
 
 // Handles
 #define KPH_ENUMERATEPROCESSHANDLES KPH_CTL_CODE(150)
 #define KPH_QUERYINFORMATIONOBJECT KPH_CTL_CODE(151)
 #define KPH_SETINFORMATIONOBJECT KPH_CTL_CODE(152)
 #define KPH_DUPLICATEOBJECT KPH_CTL_CODE(153)
+#define KPH_QUERYPROCESSHANDLEDIGEST KPH_CTL_CODE(154)
+#define KPH_ENUMERATEPROCESSHANDLERANGE KPH_CTL_CODE(155)
+#define KPH_ENUMERATEPROCESSHANDLENAMES KPH_CTL_CODE(156)
+
+// Notifications
+#define KPH_SETNOTIFYEVENT KPH_CTL_CODE(175)
+#define KPH_READNOTIFYEVENTS KPH_CTL_CODE(176)
 
 // Misc.
 #define KPH_OPENDRIVER KPH_CTL_CODE(200)
@@ -76,6 +76,20 @@ KphGetFeatures(
     _Out_ PULONG Features
     );
 
+NTSTATUS
+NTAPI
+KphQueryControlStatistics(
+    _Out_writes_bytes_(BufferLength) PKPH_CONTROL_STATISTICS Buffer,
+    _In_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+NTSTATUS
+NTAPI
+KphQueryControlStatistics2(
+    _Out_ PKPH_CONTROL_STATISTICS *Statistics
+    );
+
 NTSTATUS
 NTAPI
 KphOpenProcess(
@@ -129,6 +143,14 @@ KphReadVirtualMemory(
     _Out_opt_ PSIZE_T NumberOfBytesRead
     );
 
+NTSTATUS
+NTAPI
+KphReadVirtualMemoryBatch(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    _In_ ULONG NumberOfEntries
+    );
+
 NTSTATUS
 NTAPI
 KphWriteVirtualMemory(
@@ -168,6 +190,32 @@ KphSetInformationProcess(
     _In_ ULONG ProcessInformationLength
     );
 
+NTSTATUS
+NTAPI
+KphEnumerateProcessIds(
+    _In_ HANDLE StartProcessId,
+    _In_ HANDLE EndProcessId,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+NTSTATUS
+NTAPI
+KphEnumerateProcessIds2(
+    _In_ HANDLE StartProcessId,
+    _In_ HANDLE EndProcessId,
+    _Out_ PKPH_PROCESS_ID_INFORMATION *ProcessIds
+    );
+
+NTSTATUS
+NTAPI
+KphQueryInformationProcesses(
+    _Inout_updates_(NumberOfEntries) PKPH_PROCESS_BATCH_ENTRY Entries,
+    _In_ ULONG NumberOfEntries,
+    _In_ ULONG Fields
+    );
+
 NTSTATUS
 NTAPI
 KphOpenThread(
@@ -223,6 +271,18 @@ KphCaptureStackBackTraceThread(
     _Out_opt_ PULONG BackTraceHash
     );
 
+NTSTATUS
+NTAPI
+KphCaptureStackBackTraceThreads(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PKPH_STACK_BACK_TRACE_ENTRY Entries,
+    _In_ ULONG NumberOfEntries,
+    _In_ ULONG FramesToSkip,
+    _In_ ULONG FramesToCapture,
+    _In_ ULONG Flags,
+    _Out_writes_(NumberOfEntries * FramesToCapture) PVOID *BackTraces
+    );
+
 NTSTATUS
 NTAPI
 KphQueryInformationThread(
@@ -258,6 +318,53 @@ KphEnumerateProcessHandles2(
     _Out_ PKPH_PROCESS_HANDLE_INFORMATION *Handles
     );
 
+NTSTATUS
+NTAPI
+KphEnumerateProcessHandleRange(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE StartHandle,
+    _In_ HANDLE EndHandle,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+NTSTATUS
+NTAPI
+KphEnumerateProcessHandleRange2(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE StartHandle,
+    _In_ HANDLE EndHandle,
+    _Out_ PKPH_PROCESS_HANDLE_INFORMATION *Handles
+    );
+
+NTSTATUS
+NTAPI
+KphEnumerateProcessHandleNames(
+    _In_ HANDLE ProcessHandle,
+    _In_opt_ HANDLE StartHandle,
+    _In_opt_ PKPH_OBJECT_TYPE_MASK TypeMask,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+NTSTATUS
+NTAPI
+KphQueryProcessHandleDigest(
+    _In_ HANDLE ProcessHandle,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+NTSTATUS
+NTAPI
+KphQueryProcessHandleDigest2(
+    _In_ HANDLE ProcessHandle,
+    _Out_ PKPH_PROCESS_HANDLE_DIGEST *Digest
+    );
+
 NTSTATUS
 NTAPI
 KphQueryInformationObject(
@@ -308,6 +415,20 @@ KphQueryInformationDriver(
     _Out_opt_ PULONG ReturnLength
     );
 
+NTSTATUS
+NTAPI
+KphSetNotifyEvent(
+    _In_opt_ HANDLE EventHandle
+    );
+
+NTSTATUS
+NTAPI
+KphReadNotifyEvents(
+    _Out_writes_bytes_(BufferLength) PKPH_NOTIFY_EVENT_INFORMATION Buffer,
+    _In_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
 // kphdata
 
 NTSTATUS
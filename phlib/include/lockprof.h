@@ -0,0 +1,53 @@
+#ifndef _PH_LOCKPROF_H
+#define _PH_LOCKPROF_H
+
+// Lock contention profiling. When PH_LOCK_PROFILING is defined, every call site of the queued
+// lock and fast lock acquire functions gets a static PH_LOCK_SITE that records how often the site
+// acquires its lock, how often it had to wait, and for how long. Sites register themselves on
+// first use and can be enumerated through PhLockSiteListHead.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef PH_LOCK_PROFILING
+
+typedef struct _PH_LOCK_SITE
+{
+    struct _PH_LOCK_SITE *Next;
+    PSTR FileName;
+    ULONG Line;
+    BOOLEAN Exclusive;
+    BOOLEAN FastLock;
+    volatile LONG Registered;
+    /** The number of acquisitions. */
+    volatile LONG64 Acquisitions;
+    /** The number of acquisitions that could not take the fast path. */
+    volatile LONG64 Contentions;
+    /** The total time spent spinning and waiting, in performance counter ticks. */
+    volatile LONG64 WaitTime;
+    /** The longest single wait, in performance counter ticks. */
+    volatile LONG64 MaximumWaitTime;
+} PH_LOCK_SITE, *PPH_LOCK_SITE;
+
+#define PH_LOCK_SITE_INIT(Exclusive, FastLock) { NULL, __FILE__, __LINE__, (Exclusive), (FastLock) }
+#define PH_LOCK_SITE_DECLARE(Name, Exclusive, FastLock) \
+    static PH_LOCK_SITE Name = PH_LOCK_SITE_INIT(Exclusive, FastLock)
+
+PHLIBAPI extern PPH_LOCK_SITE volatile PhLockSiteListHead;
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfRecordLockSite(
+    _Inout_ PPH_LOCK_SITE Site,
+    _In_opt_ PLARGE_INTEGER WaitStartCounter
+    );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
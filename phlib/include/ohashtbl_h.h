@@ -0,0 +1,136 @@
+/*
+ * Open addressing hashtable template.
+ *
+ * Unlike PH_HASHTABLE, entries are stored directly in the slot array together with their hash
+ * codes, and the hash and comparison functions are macros that are inlined into each
+ * specialization. Collisions are resolved using linear probing with Robin Hood insertion and
+ * backward shift deletion, so lookups touch very few cache lines even at high load factors.
+ *
+ * To declare a specialization, define T as the entry type and K as the key type, then include
+ * this file. To define the functions of the specialization, define T and K again, together with:
+ *
+ * \li PH_OPEN_HASHTABLE_KEY(Entry): the key of an entry.
+ * \li PH_OPEN_HASHTABLE_HASH(Key): the ULONG hash code of a key.
+ * \li PH_OPEN_HASHTABLE_EQUAL(Key1, Key2): whether two keys are equal.
+ *
+ * and include ohashtbl_i.h in exactly one source file. Helpers for common key types are defined
+ * below.
+ */
+
+#ifdef T
+
+#include <templ.h>
+
+#ifndef _PH_OHASHTBL_H_COMMON
+#define _PH_OHASHTBL_H_COMMON
+
+/** The hash code of an empty slot. Stored hash codes always have their high bit set. */
+#define PH_OPEN_HASHTABLE_EMPTY 0
+#define PH_OPEN_HASHTABLE_HASH_CODE(Hash) ((ULONG)(Hash) | 0x80000000)
+
+// Handles and IDs are multiples of 4.
+#define PH_OPEN_HASHTABLE_HASH_HANDLE(Key) (HandleToUlong(Key) / 4)
+#define PH_OPEN_HASHTABLE_HASH_POINTER(Key) PhHashIntPtr((ULONG_PTR)(Key))
+#define PH_OPEN_HASHTABLE_HASH_ULONG64(Key) PhHashInt64(Key)
+#define PH_OPEN_HASHTABLE_EQUAL_SCALAR(Key1, Key2) ((Key1) == (Key2))
+
+// For PPH_STRINGREF keys.
+#define PH_OPEN_HASHTABLE_HASH_STRINGREF(Key) PhHashStringRef((Key), FALSE)
+#define PH_OPEN_HASHTABLE_EQUAL_STRINGREF(Key1, Key2) PhEqualStringRef((Key1), (Key2), FALSE)
+#define PH_OPEN_HASHTABLE_HASH_STRINGREF_IGNORECASE(Key) PhHashStringRef((Key), TRUE)
+#define PH_OPEN_HASHTABLE_EQUAL_STRINGREF_IGNORECASE(Key1, Key2) PhEqualStringRef((Key1), (Key2), TRUE)
+
+#endif
+
+typedef struct T___(_PH_OPEN_HASHTABLE_SLOT, T)
+{
+    ULONG HashCode;
+    T Entry;
+} T___(PH_OPEN_HASHTABLE_SLOT, T), *T___(PPH_OPEN_HASHTABLE_SLOT, T);
+
+typedef struct T___(_PH_OPEN_HASHTABLE, T)
+{
+    /** The number of entries in the hashtable. */
+    ULONG Count;
+    /** The number of slots. This is always a power of two. */
+    ULONG Size;
+    ULONG SizeMinusOne;
+    T___(PPH_OPEN_HASHTABLE_SLOT, T) Slots;
+} T___(PH_OPEN_HASHTABLE, T), *T___(PPH_OPEN_HASHTABLE, T);
+
+VOID
+NTAPI
+T___(PhInitializeOpenHashtable, T)(
+    _Out_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ ULONG InitialCapacity
+    );
+
+VOID
+NTAPI
+T___(PhDeleteOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable
+    );
+
+T *
+NTAPI
+T___(PhAddEntryOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ T Entry,
+    _Out_opt_ PBOOLEAN Added
+    );
+
+VOID
+NTAPI
+T___(PhClearOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable
+    );
+
+T *
+NTAPI
+T___(PhFindEntryOpenHashtable, T)(
+    _In_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ K Key
+    );
+
+BOOLEAN
+NTAPI
+T___(PhRemoveEntryOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ K Key
+    );
+
+/**
+ * Enumerates the entries in a hashtable.
+ *
+ * \param Hashtable A hashtable.
+ * \param Entry A variable which receives a pointer to the entry. The pointer is valid until the
+ * hashtable is modified.
+ * \param EnumerationKey A variable which is initialized to 0 before first calling this function.
+ *
+ * \return TRUE if an entry pointer was stored in \a Entry, FALSE if there are no more entries.
+ *
+ * \remarks Do not modify the hashtable while it is being enumerated.
+ */
+FORCEINLINE BOOLEAN T___(PhEnumOpenHashtable, T)(
+    _In_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _Out_ T **Entry,
+    _Inout_ PULONG EnumerationKey
+    )
+{
+    while (*EnumerationKey < Hashtable->Size)
+    {
+        T___(PPH_OPEN_HASHTABLE_SLOT, T) slot = &Hashtable->Slots[*EnumerationKey];
+
+        (*EnumerationKey)++;
+
+        if (slot->HashCode != PH_OPEN_HASHTABLE_EMPTY)
+        {
+            *Entry = &slot->Entry;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+#endif
@@ -0,0 +1,282 @@
+#ifdef T
+
+#include <templ.h>
+
+#if !defined(PH_OPEN_HASHTABLE_KEY) || !defined(PH_OPEN_HASHTABLE_HASH) || !defined(PH_OPEN_HASHTABLE_EQUAL)
+#error PH_OPEN_HASHTABLE_KEY, PH_OPEN_HASHTABLE_HASH and PH_OPEN_HASHTABLE_EQUAL must be defined.
+#endif
+
+/**
+ * Stores an entry that is known not to be present in a hashtable.
+ *
+ * \return A pointer to the entry as stored in the hashtable.
+ */
+static T *T___(PhpInsertOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ ULONG HashCode,
+    _In_ T Entry
+    )
+{
+    T *result = NULL;
+    ULONG index;
+    ULONG distance;
+
+    index = HashCode & Hashtable->SizeMinusOne;
+    distance = 0;
+
+    while (TRUE)
+    {
+        T___(PPH_OPEN_HASHTABLE_SLOT, T) slot = &Hashtable->Slots[index];
+        ULONG slotDistance;
+
+        if (slot->HashCode == PH_OPEN_HASHTABLE_EMPTY)
+        {
+            slot->HashCode = HashCode;
+            slot->Entry = Entry;
+
+            if (!result)
+                result = &slot->Entry;
+
+            break;
+        }
+
+        slotDistance = (index - slot->HashCode) & Hashtable->SizeMinusOne;
+
+        if (slotDistance < distance)
+        {
+            ULONG hashCode;
+            T entry;
+
+            // Take the slot from the entry that is closer to its ideal position, and continue
+            // with that entry instead.
+
+            hashCode = slot->HashCode;
+            entry = slot->Entry;
+            slot->HashCode = HashCode;
+            slot->Entry = Entry;
+            HashCode = hashCode;
+            Entry = entry;
+            distance = slotDistance;
+
+            if (!result)
+                result = &slot->Entry;
+        }
+
+        index = (index + 1) & Hashtable->SizeMinusOne;
+        distance++;
+    }
+
+    Hashtable->Count++;
+
+    return result;
+}
+
+static VOID T___(PhpResizeOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ ULONG NewSize
+    )
+{
+    T___(PPH_OPEN_HASHTABLE_SLOT, T) oldSlots;
+    ULONG oldSize;
+    ULONG i;
+
+    oldSlots = Hashtable->Slots;
+    oldSize = Hashtable->Size;
+
+    Hashtable->Size = NewSize;
+    Hashtable->SizeMinusOne = NewSize - 1;
+    Hashtable->Slots = PhAllocate(sizeof(T___(PH_OPEN_HASHTABLE_SLOT, T)) * NewSize);
+    memset(Hashtable->Slots, 0, sizeof(T___(PH_OPEN_HASHTABLE_SLOT, T)) * NewSize);
+    Hashtable->Count = 0;
+
+    for (i = 0; i < oldSize; i++)
+    {
+        if (oldSlots[i].HashCode != PH_OPEN_HASHTABLE_EMPTY)
+            T___(PhpInsertOpenHashtable, T)(Hashtable, oldSlots[i].HashCode, oldSlots[i].Entry);
+    }
+
+    if (oldSlots)
+        PhFree(oldSlots);
+}
+
+/**
+ * Initializes a hashtable.
+ *
+ * \param Hashtable The hashtable.
+ * \param InitialCapacity The number of entries to allocate storage for initially.
+ */
+VOID T___(PhInitializeOpenHashtable, T)(
+    _Out_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ ULONG InitialCapacity
+    )
+{
+    if (InitialCapacity < 8)
+        InitialCapacity = 8;
+
+    Hashtable->Count = 0;
+    Hashtable->Size = 0;
+    Hashtable->Slots = NULL;
+
+    // Keep the load factor below 7/8.
+    T___(PhpResizeOpenHashtable, T)(Hashtable, PhRoundUpToPowerOfTwo(InitialCapacity + InitialCapacity / 4));
+}
+
+/**
+ * Frees the storage used by a hashtable.
+ *
+ * \param Hashtable The hashtable.
+ */
+VOID T___(PhDeleteOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable
+    )
+{
+    PhFree(Hashtable->Slots);
+}
+
+/**
+ * Adds an entry to a hashtable or returns an existing one.
+ *
+ * \param Hashtable The hashtable.
+ * \param Entry The entry to add.
+ * \param Added A variable which receives TRUE if a new entry was created, and FALSE if an
+ * existing entry was returned.
+ *
+ * \return A pointer to the entry as stored in the hashtable. This pointer is valid until the
+ * hashtable is modified. If the hashtable already contained an entry with the same key, the
+ * existing entry is returned.
+ */
+T *T___(PhAddEntryOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ T Entry,
+    _Out_opt_ PBOOLEAN Added
+    )
+{
+    T *existing;
+    ULONG hashCode;
+
+    existing = T___(PhFindEntryOpenHashtable, T)(Hashtable, PH_OPEN_HASHTABLE_KEY(Entry));
+
+    if (existing)
+    {
+        if (Added)
+            *Added = FALSE;
+
+        return existing;
+    }
+
+    if ((Hashtable->Count + 1) * 8 > Hashtable->Size * 7)
+        T___(PhpResizeOpenHashtable, T)(Hashtable, Hashtable->Size * 2);
+
+    hashCode = PH_OPEN_HASHTABLE_HASH_CODE(PH_OPEN_HASHTABLE_HASH(PH_OPEN_HASHTABLE_KEY(Entry)));
+
+    if (Added)
+        *Added = TRUE;
+
+    return T___(PhpInsertOpenHashtable, T)(Hashtable, hashCode, Entry);
+}
+
+/**
+ * Removes all entries from a hashtable.
+ *
+ * \param Hashtable The hashtable.
+ */
+VOID T___(PhClearOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable
+    )
+{
+    if (Hashtable->Count != 0)
+    {
+        memset(Hashtable->Slots, 0, sizeof(T___(PH_OPEN_HASHTABLE_SLOT, T)) * Hashtable->Size);
+        Hashtable->Count = 0;
+    }
+}
+
+/**
+ * Locates an entry in a hashtable.
+ *
+ * \param Hashtable The hashtable.
+ * \param Key The key of the entry.
+ *
+ * \return A pointer to the entry as stored in the hashtable. This pointer is valid until the
+ * hashtable is modified. If the entry could not be found, NULL is returned.
+ */
+T *T___(PhFindEntryOpenHashtable, T)(
+    _In_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ K Key
+    )
+{
+    ULONG hashCode;
+    ULONG index;
+    ULONG distance;
+
+    hashCode = PH_OPEN_HASHTABLE_HASH_CODE(PH_OPEN_HASHTABLE_HASH(Key));
+    index = hashCode & Hashtable->SizeMinusOne;
+    distance = 0;
+
+    while (TRUE)
+    {
+        T___(PPH_OPEN_HASHTABLE_SLOT, T) slot = &Hashtable->Slots[index];
+
+        if (slot->HashCode == PH_OPEN_HASHTABLE_EMPTY)
+            return NULL;
+
+        // The key would have displaced any entry that is closer to its ideal position.
+        if (((index - slot->HashCode) & Hashtable->SizeMinusOne) < distance)
+            return NULL;
+
+        if (slot->HashCode == hashCode && PH_OPEN_HASHTABLE_EQUAL(PH_OPEN_HASHTABLE_KEY(slot->Entry), Key))
+            return &slot->Entry;
+
+        index = (index + 1) & Hashtable->SizeMinusOne;
+        distance++;
+    }
+}
+
+/**
+ * Removes an entry from a hashtable.
+ *
+ * \param Hashtable The hashtable.
+ * \param Key The key of the entry.
+ *
+ * \return TRUE if the entry was removed, FALSE if the entry could not be found.
+ */
+BOOLEAN T___(PhRemoveEntryOpenHashtable, T)(
+    _Inout_ T___(PPH_OPEN_HASHTABLE, T) Hashtable,
+    _In_ K Key
+    )
+{
+    T *entry;
+    ULONG index;
+    ULONG next;
+
+    entry = T___(PhFindEntryOpenHashtable, T)(Hashtable, Key);
+
+    if (!entry)
+        return FALSE;
+
+    index = (ULONG)(CONTAINING_RECORD(entry, T___(PH_OPEN_HASHTABLE_SLOT, T), Entry) - Hashtable->Slots);
+    next = (index + 1) & Hashtable->SizeMinusOne;
+
+    // Shift the following entries back until we reach an empty slot or an entry that is already
+    // in its ideal position. This keeps the probe sequences intact without tombstones.
+    while (
+        Hashtable->Slots[next].HashCode != PH_OPEN_HASHTABLE_EMPTY &&
+        (Hashtable->Slots[next].HashCode & Hashtable->SizeMinusOne) != next
+        )
+    {
+        Hashtable->Slots[index] = Hashtable->Slots[next];
+        index = next;
+        next = (next + 1) & Hashtable->SizeMinusOne;
+    }
+
+    Hashtable->Slots[index].HashCode = PH_OPEN_HASHTABLE_EMPTY;
+    Hashtable->Count--;
+
+    return TRUE;
+}
+
+#undef PH_OPEN_HASHTABLE_KEY
+#undef PH_OPEN_HASHTABLE_HASH
+#undef PH_OPEN_HASHTABLE_EQUAL
+
+#endif
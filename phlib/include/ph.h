@@ -177,6 +177,25 @@ PhReadVirtualMemory(
     _Out_opt_ PSIZE_T NumberOfBytesRead
     );
 
+// Same layout as KPH_VIRTUAL_MEMORY_READ_ENTRY.
+typedef struct _PH_VIRTUAL_MEMORY_READ_ENTRY
+{
+    PVOID BaseAddress;
+    PVOID Buffer;
+    SIZE_T BufferSize;
+    SIZE_T NumberOfBytesRead; // out
+    NTSTATUS Status; // out
+} PH_VIRTUAL_MEMORY_READ_ENTRY, *PPH_VIRTUAL_MEMORY_READ_ENTRY;
+
+PHLIBAPI
+VOID
+NTAPI
+PhReadVirtualMemoryBatch(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    _In_ ULONG NumberOfEntries
+    );
+
 PHLIBAPI
 NTSTATUS
 NTAPI
@@ -773,6 +792,26 @@ PhEnumProcessesForSession(
     _In_ ULONG SessionId
     );
 
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhQuerySystemInformationForGroup(
+    _In_ SYSTEM_INFORMATION_CLASS SystemInformationClass,
+    _In_ USHORT ProcessorGroup,
+    _Out_writes_bytes_(SystemInformationLength) PVOID SystemInformation,
+    _In_ ULONG SystemInformationLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhGetSystemLogicalProcessorInformation(
+    _In_ LOGICAL_PROCESSOR_RELATIONSHIP RelationshipType,
+    _Out_ PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *Buffer,
+    _Out_ PULONG BufferLength
+    );
+
 PHLIBAPI
 PSYSTEM_PROCESS_INFORMATION
 NTAPI
@@ -1114,6 +1153,17 @@ PhGetSidFullName(
     _Out_opt_ PSID_NAME_USE NameUse
     );
 
+PHLIBAPI extern PH_CALLBACK PhSidFullNamesResolvedEvent;
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhGetSidFullNameAsync(
+    _In_ PSID Sid,
+    _In_ BOOLEAN IncludeDomain,
+    _Out_ PPH_STRING *FullName
+    );
+
 PHLIBAPI
 PPH_STRING
 NTAPI
@@ -1185,6 +1235,18 @@ PhGetHandleInformationEx(
     _Reserved_ PVOID *ExtraInformation
     );
 
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhGetHandleInformationFromName(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE Handle,
+    _In_ ULONG ObjectTypeNumber,
+    _In_opt_ PPH_STRINGREF ObjectName,
+    _Out_opt_ PPH_STRING *TypeName,
+    _Out_opt_ PPH_STRING *BestObjectName
+    );
+
 #define PH_FIRST_OBJECT_TYPE(ObjectTypes) \
     (POBJECT_TYPE_INFORMATION)((PCHAR)(ObjectTypes) + ALIGN_UP(sizeof(OBJECT_TYPES_INFORMATION), ULONG_PTR))
 
@@ -1214,6 +1276,13 @@ PhCallWithTimeout(
     _In_ PLARGE_INTEGER CallTimeout
     );
 
+VOID
+NTAPI
+PhGetCallWithTimeoutStatistics(
+    _Out_opt_ PULONG NumberOfThreads,
+    _Out_opt_ PULONG NumberOfTimeouts
+    );
+
 NTSTATUS
 NTAPI
 PhCallNtQueryObjectWithTimeout(
@@ -1356,6 +1425,16 @@ PhGetMappedImageLoadConfig64(
     _Out_ PIMAGE_LOAD_CONFIG_DIRECTORY64 *LoadConfig
     );
 
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhGetMappedImagePdbInfo(
+    _In_ PPH_MAPPED_IMAGE MappedImage,
+    _Out_ PGUID Guid,
+    _Out_ PULONG Age,
+    _Out_ PPH_STRING *PdbFileName
+    );
+
 typedef struct _PH_REMOTE_MAPPED_IMAGE
 {
     PVOID ViewBase;
@@ -1760,9 +1839,19 @@ PhImpersonateClientOfNamedPipe(
 /** Indicates that the file stream object should maintain the file position
  * and not use the file object's own file position. */
 #define PH_FILE_STREAM_OWN_POSITION 0x8
+/** Indicates that a full buffer should be written in the background while
+ * the next buffer is filled. Requires PH_FILE_STREAM_ASYNCHRONOUS and
+ * PH_FILE_STREAM_OWN_POSITION. Errors from a background write are returned
+ * by the next write, flush or seek. */
+#define PH_FILE_STREAM_WRITE_BEHIND 0x10
 
 // Higher-level flags (PhCreateFileStream)
 #define PH_FILE_STREAM_APPEND 0x00010000
+/** Opens the file with FILE_NO_INTERMEDIATE_BUFFERING and writes it
+ * behind with large aligned buffers. This is intended for very large
+ * sequential outputs written from the start of the file. The stream is
+ * write-only, and only the final flush may end on a partial buffer. */
+#define PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING 0x00020000
 
 // Internal flags
 /** Indicates that at least one write has been issued to the file handle. */
@@ -1788,6 +1877,13 @@ typedef struct _PH_FILE_STREAM
     ULONG ReadPosition; // read position in buffer
     ULONG ReadLength; // how much available to read from buffer
     ULONG WritePosition; // write position in buffer
+
+    // PH_FILE_STREAM_WRITE_BEHIND
+    PVOID PendingBuffer; // buffer being written, or the spare buffer
+    ULONG PendingLength; // 0 if no write is in progress
+    NTSTATUS PendingStatus;
+    HANDLE PendingEvent;
+    IO_STATUS_BLOCK PendingIoStatusBlock;
 } PH_FILE_STREAM, *PPH_FILE_STREAM;
 
 PHLIBAPI
@@ -1947,6 +2043,20 @@ typedef VOID (NTAPI *PPH_PROVIDER_FUNCTION)(
 struct _PH_PROVIDER_THREAD;
 typedef struct _PH_PROVIDER_THREAD *PPH_PROVIDER_THREAD;
 
+// Bucket i of a run time histogram counts runs which took less than 2^(i + 1) microseconds. The
+// last bucket also counts all longer runs.
+#define PH_PROVIDER_HISTOGRAM_SIZE 24
+
+#define PH_PROVIDER_NO_IDEAL_PROCESSOR MAXULONG
+
+// Schedule flags
+#define PH_PROVIDER_TRACK_CONSUMERS 0x1 // run at PH_PROVIDER_IDLE_FACTOR times the interval when there are no consumers
+
+// An idle provider runs at this multiple of its normal interval.
+#define PH_PROVIDER_IDLE_FACTOR 10
+// A provider which exceeds its budget is deferred by at most this multiple of its normal interval.
+#define PH_PROVIDER_MAXIMUM_DEFER_FACTOR 8
+
 typedef struct _PH_PROVIDER_REGISTRATION
 {
     LIST_ENTRY ListEntry;
@@ -1957,6 +2067,22 @@ typedef struct _PH_PROVIDER_REGISTRATION
     BOOLEAN Enabled;
     BOOLEAN Unregistering;
     BOOLEAN Boosting;
+
+    // Statistics (times are in microseconds)
+    ULONG RunCount;
+    ULONG OverrunCount; // runs which took longer than the interval of the provider thread
+    ULONG64 LastRunTime;
+    ULONG64 TotalRunTime;
+    ULONG64 MaximumRunTime;
+    ULONG RunTimeHistogram[PH_PROVIDER_HISTOGRAM_SIZE];
+
+    // Schedule
+    ULONG TargetInterval; // in milliseconds, 0 to run at the interval of the provider thread
+    ULONG Budget; // in microseconds, 0 for no budget
+    ULONG ScheduleFlags;
+    volatile LONG ConsumerCount;
+    ULONG64 NextRunTime; // performance counter value
+    ULONG SkipCount; // ticks skipped because the provider was not due
 } PH_PROVIDER_REGISTRATION, *PPH_PROVIDER_REGISTRATION;
 
 typedef struct _PH_PROVIDER_THREAD
@@ -1969,8 +2095,32 @@ typedef struct _PH_PROVIDER_THREAD
     PH_QUEUED_LOCK Lock;
     LIST_ENTRY ListHead;
     ULONG BoostCount;
+    ULONG IdealProcessor; // PH_PROVIDER_NO_IDEAL_PROCESSOR if none
+
+    LARGE_INTEGER PerformanceFrequency;
+    ULONG OverrunCount; // passes over all providers which took longer than the interval
+    PH_CALLBACK RunCompletedEvent; // PPH_PROVIDER_RUN_INFORMATION [provider thread]
 } PH_PROVIDER_THREAD, *PPH_PROVIDER_THREAD;
 
+typedef struct _PH_PROVIDER_STATISTICS
+{
+    ULONG RunCount;
+    ULONG OverrunCount;
+    ULONG SkipCount;
+    ULONG64 LastRunTime;
+    ULONG64 AverageRunTime;
+    ULONG64 Percentile99RunTime; // upper bound of the histogram bucket containing the 99th percentile
+    ULONG64 MaximumRunTime;
+} PH_PROVIDER_STATISTICS, *PPH_PROVIDER_STATISTICS;
+
+typedef struct _PH_PROVIDER_RUN_INFORMATION
+{
+    PPH_PROVIDER_REGISTRATION Registration;
+    PPH_PROVIDER_FUNCTION Function;
+    ULONG64 RunTime; // in microseconds
+    BOOLEAN Overrun;
+} PH_PROVIDER_RUN_INFORMATION, *PPH_PROVIDER_RUN_INFORMATION;
+
 PHLIBAPI
 VOID
 NTAPI
@@ -2008,6 +2158,14 @@ PhSetIntervalProviderThread(
     _In_ ULONG Interval
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhSetIdealProcessorProviderThread(
+    _Inout_ PPH_PROVIDER_THREAD ProviderThread,
+    _In_ ULONG IdealProcessor
+    );
+
 PHLIBAPI
 VOID
 NTAPI
@@ -2055,6 +2213,38 @@ PhSetEnabledProvider(
     _In_ BOOLEAN Enabled
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhSetScheduleProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration,
+    _In_ ULONG TargetInterval,
+    _In_ ULONG Budget,
+    _In_ ULONG Flags
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhReferenceConsumerProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhDereferenceConsumerProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhGetStatisticsProvider(
+    _In_ PPH_PROVIDER_REGISTRATION Registration,
+    _Out_ PPH_PROVIDER_STATISTICS Statistics
+    );
+
 // svcsup
 
 extern WCHAR *PhServiceTypeStrings[10];
@@ -2603,6 +2793,17 @@ PhFormatDateTime(
 #define PhaFormatDateTime(DateTime) \
     ((PPH_STRING)PhAutoDereferenceObject(PhFormatDateTime(DateTime)))
 
+#define PH_TIMESPAN_RELATIVE_STR_LEN 48
+#define PH_TIMESPAN_RELATIVE_STR_LEN_1 (PH_TIMESPAN_RELATIVE_STR_LEN + 1)
+
+PHLIBAPI
+VOID
+NTAPI
+PhFormatTimeSpanRelativeToBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ ULONG64 TimeSpan
+    );
+
 PHLIBAPI
 PPH_STRING
 NTAPI
@@ -3117,7 +3318,8 @@ typedef enum _PH_HASH_ALGORITHM
 {
     Md5HashAlgorithm,
     Sha1HashAlgorithm,
-    Crc32HashAlgorithm
+    Crc32HashAlgorithm,
+    Sha256HashAlgorithm
 } PH_HASH_ALGORITHM;
 
 typedef struct _PH_HASH_CONTEXT
@@ -3153,6 +3355,60 @@ PhFinalHash(
     _Out_opt_ PULONG ReturnLength
     );
 
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhHashFile(
+    _In_ HANDLE FileHandle,
+    _Inout_updates_(NumberOfContexts) PPH_HASH_CONTEXT Contexts,
+    _In_ ULONG NumberOfContexts
+    );
+
+// File hash cache kinds other than PH_HASH_ALGORITHM values
+#define PH_FILE_HASH_CATALOG_SHA1 0x100 // Catalog (Authenticode) hash using SHA-1
+#define PH_FILE_HASH_CATALOG_SHA256 0x101 // Catalog (Authenticode) hash using SHA-256
+
+#define PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH 64
+#define PH_FILE_HASH_CACHE_STORE_MAGIC ('hfHP') // stored in the high part of the user context
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhFindFileHashCache(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Kind,
+    _Out_writes_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhAddFileHashCache(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Kind,
+    _In_reads_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength
+    );
+
+VOID
+NTAPI
+PhSetFileHashCacheStore(
+    _In_ struct _PH_FILE_POOL *Pool
+    );
+
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhHashFileCached(
+    _In_ HANDLE FileHandle,
+    _In_ PH_HASH_ALGORITHM Algorithm,
+    _Out_writes_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength,
+    _Out_opt_ PULONG ReturnLength
+    );
+
 typedef enum _PH_COMMAND_LINE_OPTION_TYPE
 {
     NoArgumentType,
@@ -38,6 +38,8 @@
 #include <phnt.h>
 #include <phsup.h>
 #include <ref.h>
+#include <lockprof.h>
+#include <allocprof.h>
 #include <fastlock.h>
 #include <queuedlock.h>
 
@@ -121,6 +123,8 @@ PHLIBAPI extern ACCESS_MASK ThreadAllAccess;
 /** Needed to use symbol providers. */
 #define PHLIB_INIT_MODULE_SYMBOL_PROVIDER 0x20
 #define PHLIB_INIT_MODULE_RESERVED3 0x40
+/** Needed to write trace events (see tracelog.h). Events are discarded otherwise. */
+#define PHLIB_INIT_MODULE_TRACE_LOGGING 0x80
 
 // Misc.
 /** Retrieves token information (e.g. elevation status). */
@@ -1288,6 +1292,20 @@ PhReferenceEmptyString(
     VOID
     );
 
+PHLIBAPI
+PPH_STRING
+NTAPI
+PhInternString(
+    _In_ PPH_STRING String
+    );
+
+PHLIBAPI
+PPH_STRING
+NTAPI
+PhInternStringRef(
+    _In_ PPH_STRINGREF String
+    );
+
 PHLIBAPI
 PPH_STRING
 NTAPI
@@ -1911,6 +1929,36 @@ PhCreateBytes2(
     return PhCreateBytesEx(Bytes->Buffer, Bytes->Length);
 }
 
+PHLIBAPI
+PPH_BYTES
+NTAPI
+PhCreateNaturalSortKey(
+    _In_ PPH_STRINGREF String,
+    _In_ BOOLEAN IgnoreCase
+    );
+
+FORCEINLINE
+LONG
+PhCompareNaturalSortKey(
+    _In_ PPH_BYTES Key1,
+    _In_ PPH_BYTES Key2
+    )
+{
+    LONG result;
+
+    result = memcmp(Key1->Buffer, Key2->Buffer, min(Key1->Length, Key2->Length));
+
+    if (result == 0)
+    {
+        if (Key1->Length < Key2->Length)
+            result = -1;
+        else if (Key1->Length > Key2->Length)
+            result = 1;
+    }
+
+    return result;
+}
+
 // Unicode
 
 #define PH_UNICODE_BYTE_ORDER_MARK 0xfeff
@@ -2307,6 +2355,48 @@ PhRemoveEndStringBuilder(
         );
 }
 
+// Fixed string builder
+
+/**
+ * A fixed string builder structure.
+ * This is similar to string builder, but writes into a caller-supplied buffer (e.g. on the
+ * stack or inside a tree node) and never allocates. Appends which do not fit are discarded.
+ */
+typedef struct _PH_FIXED_STRING_BUILDER
+{
+    /** The string constructed so far. The buffer is always null-terminated. */
+    PH_STRINGREF String;
+    /** The size of the buffer in bytes, including space for the null terminator. */
+    SIZE_T BufferLength;
+    /** Whether any append did not fit in the buffer. */
+    BOOLEAN Overflow;
+} PH_FIXED_STRING_BUILDER, *PPH_FIXED_STRING_BUILDER;
+
+PHLIBAPI
+VOID
+NTAPI
+PhInitializeFixedStringBuilder(
+    _Out_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _Out_writes_bytes_(BufferLength) PWCHAR Buffer,
+    _In_ SIZE_T BufferLength
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhAppendFixedStringBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ PPH_STRINGREF String
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhAppendFixedStringBuilder2(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ PWSTR String
+    );
+
 // Byte string builder
 
 /**
@@ -3039,6 +3129,14 @@ PhHashBytes(
     _In_ SIZE_T Length
     );
 
+PHLIBAPI
+ULONG64
+NTAPI
+PhHashBytes64(
+    _In_reads_(Length) PUCHAR Bytes,
+    _In_ SIZE_T Length
+    );
+
 PHLIBAPI
 ULONG
 NTAPI
@@ -3147,6 +3245,143 @@ PhRemoveItemSimpleHashtable(
     _In_opt_ PVOID Key
     );
 
+// Handle index
+
+/**
+ * An open-addressing index which maps handle-sized keys (e.g. process IDs, thread IDs or handle
+ * values) to pointers. The index uses linear probing and grows automatically to keep the load
+ * factor at or below 1/2.
+ */
+typedef struct _PH_HANDLE_INDEX_ENTRY
+{
+    HANDLE Key;
+    /** The value associated with the key, or NULL if the slot is unused. */
+    PVOID Value;
+} PH_HANDLE_INDEX_ENTRY, *PPH_HANDLE_INDEX_ENTRY;
+
+typedef struct _PH_HANDLE_INDEX
+{
+    /** The number of slots. This is always a power of two. */
+    ULONG Capacity;
+    /** The number of entries in the index. */
+    ULONG Count;
+    /** The slot array. */
+    PPH_HANDLE_INDEX_ENTRY Entries;
+
+    /** The number of lookups performed. This is only counted in debug builds of phlib. */
+    ULONG64 NumberOfLookups;
+    /** The total number of slots examined by lookups. This is only counted in debug builds of phlib. */
+    ULONG64 NumberOfProbes;
+} PH_HANDLE_INDEX, *PPH_HANDLE_INDEX;
+
+PHLIBAPI
+VOID
+NTAPI
+PhInitializeHandleIndex(
+    _Out_ PPH_HANDLE_INDEX Index,
+    _In_ ULONG InitialCapacity
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhDeleteHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhAddItemHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key,
+    _In_ PVOID Value
+    );
+
+PHLIBAPI
+PVOID
+NTAPI
+PhFindItemHandleIndex(
+    _In_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhRemoveItemHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index,
+    _In_opt_ HANDLE Key
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhClearHandleIndex(
+    _Inout_ PPH_HANDLE_INDEX Index
+    );
+
+/**
+ * Enumerates the entries in a handle index.
+ *
+ * \param Index The handle index.
+ * \param EnumerationKey A variable which is initialized to 0 before first calling this function.
+ * \param Key A variable which receives the key of the next entry.
+ * \param Value A variable which receives the value of the next entry.
+ *
+ * \return TRUE if an entry pointer was stored in \a Key and \a Value, FALSE if there are no more
+ * entries.
+ *
+ * \remarks Do not modify the index while an enumeration is in progress.
+ */
+FORCEINLINE
+BOOLEAN
+PhEnumHandleIndex(
+    _In_ PPH_HANDLE_INDEX Index,
+    _Inout_ PULONG EnumerationKey,
+    _Out_opt_ PHANDLE Key,
+    _Out_ PVOID *Value
+    )
+{
+    while (*EnumerationKey < Index->Capacity)
+    {
+        PPH_HANDLE_INDEX_ENTRY entry = &Index->Entries[*EnumerationKey];
+
+        (*EnumerationKey)++;
+
+        if (entry->Value)
+        {
+            if (Key)
+                *Key = entry->Key;
+
+            *Value = entry->Value;
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Gets the average number of slots examined per lookup in a handle index, multiplied by 100.
+ *
+ * \param Index The handle index.
+ *
+ * \remarks This is always 0 in release builds of phlib.
+ */
+FORCEINLINE
+ULONG
+PhGetAverageProbeLengthHandleIndex(
+    _In_ PPH_HANDLE_INDEX Index
+    )
+{
+    if (Index->NumberOfLookups == 0)
+        return 0;
+
+    return (ULONG)(Index->NumberOfProbes * 100 / Index->NumberOfLookups);
+}
+
 // Free list
 
 typedef struct _PH_FREE_LIST
@@ -3218,6 +3453,15 @@ typedef VOID (NTAPI *PPH_CALLBACK_FUNCTION)(
     _In_opt_ PVOID Context
     );
 
+/**
+ * The callback function is executed on a worker thread
+ * instead of the thread invoking the callback. Notifications
+ * that arrive while a delivery is pending are coalesced and
+ * only the most recent parameter is passed, so the parameter
+ * must remain valid after PhInvokeCallback() returns.
+ */
+#define PH_CALLBACK_ASYNCHRONOUS 0x1
+
 /**
  * A callback registration structure.
  */
@@ -3239,6 +3483,27 @@ typedef struct _PH_CALLBACK_REGISTRATION
     BOOLEAN Reserved;
     /** Flags controlling the callback. */
     USHORT Flags;
+
+    /** The number of times the callback function has
+     * been executed. */
+    ULONG InvocationCount;
+    /** The number of asynchronous notifications that
+     * were merged into a pending delivery. */
+    ULONG CoalescedCount;
+    /** The total time spent in the callback function,
+     * in performance counter ticks. */
+    ULONG64 TotalTime;
+    /** The longest single execution of the callback
+     * function, in performance counter ticks. */
+    ULONG64 MaximumTime;
+
+    /** The callback object the registration belongs to. */
+    struct _PH_CALLBACK *Callback;
+    /** The number of asynchronous notifications not yet
+     * delivered. */
+    volatile LONG AsyncRequests;
+    /** The parameter for the next asynchronous delivery. */
+    PVOID AsyncParameter;
 } PH_CALLBACK_REGISTRATION, *PPH_CALLBACK_REGISTRATION;
 
 /**
@@ -3412,6 +3677,35 @@ PhFillMemoryUlong(
 /** Deprecated. Use PhFillMemoryUlong instead. */
 PHLIBAPI VOID FASTCALL PhxfFillMemoryUlong(PULONG Memory, ULONG Value, ULONG Count);
 
+PHLIBAPI
+SIZE_T
+NTAPI
+PhCountNonPrintableBytes(
+    _In_reads_(Length) PUCHAR Buffer,
+    _In_ SIZE_T Length
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhFindBytePattern(
+    _In_reads_(Length) PUCHAR Buffer,
+    _In_ SIZE_T Length,
+    _In_reads_(PatternLength) PUCHAR Pattern,
+    _In_reads_opt_(PatternLength) PUCHAR Mask,
+    _In_ SIZE_T PatternLength,
+    _Out_ PSIZE_T Index
+    );
+
+PHLIBAPI
+SIZE_T
+NTAPI
+PhCountEqualBytes(
+    _In_reads_(Length) PUCHAR Buffer1,
+    _In_reads_(Length) PUCHAR Buffer2,
+    _In_ SIZE_T Length
+    );
+
 PHLIBAPI
 VOID
 NTAPI
@@ -3424,6 +3718,43 @@ PhDivideSinglesBySingle(
 /** Deprecated. Use PhDivideSinglesBySingle instead. */
 PHLIBAPI VOID FASTCALL PhxfDivideSingle2U(PFLOAT A, FLOAT B, ULONG Count);
 
+PHLIBAPI
+VOID
+NTAPI
+PhConvertUlong64sToSingles(
+    _Out_writes_(Count) PFLOAT Destination,
+    _In_reads_(Count) PULONG64 Source,
+    _In_ SIZE_T Count
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhAddSinglesToSingles(
+    _Inout_updates_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    );
+
+PHLIBAPI
+FLOAT
+NTAPI
+PhMaximumSumSingles(
+    _In_reads_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    );
+
+PHLIBAPI
+FLOAT
+NTAPI
+PhRunningMaximumSumSingles(
+    _Out_writes_(Count) PFLOAT Maximums,
+    _In_reads_(Count) PFLOAT A,
+    _In_reads_(Count) PFLOAT B,
+    _In_ SIZE_T Count
+    );
+
 // Format
 
 typedef enum _PH_FORMAT_TYPE
@@ -3562,6 +3893,48 @@ PhFormatToBuffer(
     _Out_opt_ PSIZE_T ReturnLength
     );
 
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhFormatUInt64ToBuffer(
+    _In_ ULONG64 Value,
+    _In_ BOOLEAN GroupDigits,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhFormatSizeToBuffer(
+    _In_ ULONG64 Size,
+    _In_ ULONG MaxSizeUnit,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhFormatFixedToBuffer(
+    _In_ DOUBLE Value,
+    _In_ ULONG Precision,
+    _Out_writes_bytes_opt_(BufferLength) PWSTR Buffer,
+    _In_opt_ SIZE_T BufferLength,
+    _Out_opt_ PSIZE_T ReturnLength
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhAppendFormatFixedStringBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_reads_(Count) PPH_FORMAT Format,
+    _In_ ULONG Count
+    );
+
 // basesupa
 
 PHLIBAPI
@@ -3942,6 +4315,17 @@ extern PPH_LIST PhDbgWorkQueueList;
 extern PH_QUEUED_LOCK PhDbgWorkQueueListLock;
 #endif
 
+/** Queue items through a lock-free ring instead of the locked list. */
+#define PH_WORK_QUEUE_LOCK_FREE 0x1
+
+#define PH_WORK_QUEUE_RING_SIZE 1024 // must be a power of two
+
+typedef struct _PH_WORK_QUEUE_CELL
+{
+    volatile LONG Sequence;
+    struct _PH_WORK_QUEUE_ITEM *Item;
+} PH_WORK_QUEUE_CELL, *PPH_WORK_QUEUE_CELL;
+
 typedef struct _PH_WORK_QUEUE
 {
     PH_RUNDOWN_PROTECT RundownProtect;
@@ -3959,19 +4343,60 @@ typedef struct _PH_WORK_QUEUE
     HANDLE SemaphoreHandle;
     ULONG CurrentThreads;
     ULONG BusyCount;
+
+    ULONG Flags;
+
+    // Lock-free mode. Items go to the locked list only when the ring is full.
+    PPH_WORK_QUEUE_CELL Cells;
+    volatile LONG EnqueuePosition;
+    volatile LONG DequeuePosition;
+
+    // Statistics. These are not synchronized and may be slightly inaccurate.
+    LONG Depth;
+    LONG MaximumDepth;
+    ULONG NumberOfItemsQueued;
+    ULONG NumberOfItemsDequeued;
+    ULONG64 EnqueueCycles;
+    ULONG64 WaitCycles;
+    ULONG64 MaximumWaitCycles;
 } PH_WORK_QUEUE, *PPH_WORK_QUEUE;
 
+typedef struct _PH_WORK_QUEUE_STATISTICS
+{
+    ULONG Depth;
+    ULONG MaximumDepth;
+    ULONG NumberOfItemsQueued;
+    ULONG NumberOfItemsDequeued;
+    ULONG64 AverageEnqueueCycles; // time spent in the enqueue functions, per item
+    ULONG64 AverageWaitCycles; // time between an item being queued and being dequeued
+    ULONG64 MaximumWaitCycles;
+} PH_WORK_QUEUE_STATISTICS, *PPH_WORK_QUEUE_STATISTICS;
+
 typedef VOID (NTAPI *PPH_WORK_QUEUE_ITEM_DELETE_FUNCTION)(
     _In_ PUSER_THREAD_START_ROUTINE Function,
     _In_ PVOID Context
     );
 
+/**
+ * Tracks the completion of a set of work items, independently of the other work items in a
+ * work queue.
+ */
+typedef struct _PH_WORK_QUEUE_BATCH
+{
+    volatile LONG PendingCount; // includes one reference held until PhWaitForWorkQueueBatch()
+    BOOLEAN Released;
+    volatile LONG Completed; // set after the last access by a worker thread
+    PH_EVENT CompletedEvent;
+} PH_WORK_QUEUE_BATCH, *PPH_WORK_QUEUE_BATCH;
+
 typedef struct _PH_WORK_QUEUE_ITEM
 {
     LIST_ENTRY ListEntry;
     PUSER_THREAD_START_ROUTINE Function;
     PVOID Context;
     PPH_WORK_QUEUE_ITEM_DELETE_FUNCTION DeleteFunction;
+    ULONG64 QueueTime;
+    PPH_WORK_QUEUE_BATCH Batch;
 } PH_WORK_QUEUE_ITEM, *PPH_WORK_QUEUE_ITEM;
 
 VOID
@@ -3989,6 +4414,17 @@ PhInitializeWorkQueue(
     _In_ ULONG NoWorkTimeout
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhInitializeWorkQueueEx(
+    _Out_ PPH_WORK_QUEUE WorkQueue,
+    _In_ ULONG MinimumThreads,
+    _In_ ULONG MaximumThreads,
+    _In_ ULONG NoWorkTimeout,
+    _In_ ULONG Flags
+    );
+
 PHLIBAPI
 VOID
 NTAPI
@@ -4020,6 +4456,50 @@ PhQueueItemWorkQueueEx(
     _In_opt_ PPH_WORK_QUEUE_ITEM_DELETE_FUNCTION DeleteFunction
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhQueueItemsWorkQueue(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_ PUSER_THREAD_START_ROUTINE Function,
+    _In_reads_(Count) PVOID *Contexts,
+    _In_ ULONG Count
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhQueueItemsWorkQueueEx(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_ PUSER_THREAD_START_ROUTINE Function,
+    _In_reads_(Count) PVOID *Contexts,
+    _In_ ULONG Count,
+    _Inout_opt_ PPH_WORK_QUEUE_BATCH Batch
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhInitializeWorkQueueBatch(
+    _Out_ PPH_WORK_QUEUE_BATCH Batch
+    );
+
+PHLIBAPI
+BOOLEAN
+NTAPI
+PhWaitForWorkQueueBatch(
+    _Inout_ PPH_WORK_QUEUE_BATCH Batch,
+    _In_opt_ PLARGE_INTEGER Timeout
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhGetStatisticsWorkQueue(
+    _In_ PPH_WORK_QUEUE WorkQueue,
+    _Out_ PPH_WORK_QUEUE_STATISTICS Statistics
+    );
+
 PHLIBAPI
 VOID
 NTAPI
@@ -14,8 +14,10 @@ typedef struct _PHLIB_STATISTICS_BLOCK
     ULONG RefObjectsDestroyed;
     ULONG RefObjectsAllocated;
     ULONG RefObjectsFreed;
-    ULONG RefObjectsAllocatedFromSmallFreeList;
-    ULONG RefObjectsFreedToSmallFreeList;
+    ULONG RefObjectsAllocatedFromSizeClassFreeList;
+    ULONG RefObjectsFreedToSizeClassFreeList;
+    ULONG RefObjectsAllocatedFromThreadCache;
+    ULONG RefObjectsFreedToThreadCache;
     ULONG RefObjectsAllocatedFromTypeFreeList;
     ULONG RefObjectsFreedToTypeFreeList;
     ULONG RefObjectsDeleteDeferred;
@@ -42,8 +44,23 @@ extern PHLIB_STATISTICS_BLOCK PhLibStatisticsBlock;
 
 #ifdef DEBUG
 #define PHLIB_INC_STATISTIC(Name) (_InterlockedIncrement(&PhLibStatisticsBlock.Name))
+#define PHLIB_ADD_STATISTIC(Name, Value) (_InterlockedExchangeAdd(&PhLibStatisticsBlock.Name, (Value)))
 #else
 #define PHLIB_INC_STATISTIC(Name)
+#define PHLIB_ADD_STATISTIC(Name, Value)
 #endif
 
+// basesup
+
+#define PH_VECTOR_LEVEL_NONE 0
+#define PH_VECTOR_LEVEL_SSE2 1
+#define PH_VECTOR_LEVEL_AVX 2
+#define PH_VECTOR_LEVEL_AVX2 3
+
+extern BOOLEAN PhpVectorLevel;
+
+VOID PhpRemoveInternedString(
+    _In_ PPH_STRING String
+    );
+
 #endif
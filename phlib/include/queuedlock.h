@@ -304,6 +304,41 @@ FORCEINLINE VOID PhSetWakeEvent(
         PhfSetWakeEvent(WakeEvent, WaitBlock);
 }
 
+#ifdef PH_LOCK_PROFILING
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfProfileAcquireQueuedLockExclusive(
+    _Inout_ PPH_QUEUED_LOCK QueuedLock,
+    _Inout_ PPH_LOCK_SITE Site
+    );
+
+PHLIBAPI
+VOID
+FASTCALL
+PhfProfileAcquireQueuedLockShared(
+    _Inout_ PPH_QUEUED_LOCK QueuedLock,
+    _Inout_ PPH_LOCK_SITE Site
+    );
+
+// The inline functions above keep using the unprofiled versions; only call sites that follow
+// this point are recorded.
+
+#define PhAcquireQueuedLockExclusive(QueuedLock) \
+    do { \
+        PH_LOCK_SITE_DECLARE(phLockSite_, TRUE, FALSE); \
+        PhfProfileAcquireQueuedLockExclusive((QueuedLock), &phLockSite_); \
+    } while (0)
+
+#define PhAcquireQueuedLockShared(QueuedLock) \
+    do { \
+        PH_LOCK_SITE_DECLARE(phLockSite_, FALSE, FALSE); \
+        PhfProfileAcquireQueuedLockShared((QueuedLock), &phLockSite_); \
+    } while (0)
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,9 @@ extern "C" {
 
 #define PH_OBJECT_SMALL_OBJECT_SIZE 48
 #define PH_OBJECT_SMALL_OBJECT_COUNT 512
+#define PH_OBJECT_SIZE_CLASS_COUNT 8
+#define PH_OBJECT_SIZE_CLASS_MAXIMUM_SIZE 512
+#define PH_OBJECT_THREAD_CACHE_MAXIMUM_COUNT 64
 
 // Object type flags
 #define PH_OBJECT_TYPE_USE_FREE_LIST 0x00000001
@@ -89,6 +92,10 @@ typedef struct _PH_OBJECT_TYPE_INFORMATION
     USHORT Flags;
     UCHAR TypeIndex;
     UCHAR Reserved;
+    /** The number of allocations satisfied by a per-thread cache. */
+    ULONG NumberOfCacheHits;
+    /** The number of allocations that were not satisfied by a per-thread cache. */
+    ULONG NumberOfCacheMisses;
 } PH_OBJECT_TYPE_INFORMATION, *PPH_OBJECT_TYPE_INFORMATION;
 
 NTSTATUS PhInitializeRef(
@@ -151,6 +158,20 @@ PhDereferenceObjectEx(
     _In_ BOOLEAN DeferDelete
     );
 
+PHLIBAPI
+ULONG
+NTAPI
+PhEnterObjectEpoch(
+    VOID
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhLeaveObjectEpoch(
+    _In_ ULONG Epoch
+    );
+
 PHLIBAPI
 PPH_OBJECT_TYPE
 NTAPI
@@ -185,6 +206,13 @@ PhGetObjectTypeInformation(
     _Out_ PPH_OBJECT_TYPE_INFORMATION Information
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhFlushObjectThreadCache(
+    VOID
+    );
+
 PHLIBAPI
 PVOID
 NTAPI
@@ -253,6 +281,20 @@ PhClearReference(
 /** The maximum size of the dynamic array for it to be
  * kept after the auto-release pool is drained. */
 #define PH_AUTO_POOL_DYNAMIC_BIG_SIZE 256
+/** The number of objects that can have local references
+ * in an auto-release pool. This must be a power of two. */
+#define PH_AUTO_POOL_LOCAL_SIZE 32
+
+/** Objects created by Pha* functions are allocated from
+ * an arena owned by the pool. */
+#define PH_AUTO_POOL_USE_ARENA 0x1
+
+typedef struct _PH_AUTO_POOL_LOCAL_REFERENCE
+{
+    PVOID Object;
+    /** The number of local references. This is not synchronized. */
+    LONG Count;
+} PH_AUTO_POOL_LOCAL_REFERENCE, *PPH_AUTO_POOL_LOCAL_REFERENCE;
 
 /**
  * An auto-dereference pool can be used for
@@ -272,6 +314,13 @@ typedef struct _PH_AUTO_POOL
     ULONG DynamicAllocated;
     PVOID *DynamicObjects;
 
+    ULONG LocalCount;
+    PH_AUTO_POOL_LOCAL_REFERENCE LocalReferences[PH_AUTO_POOL_LOCAL_SIZE];
+
+    ULONG Flags;
+    ULONG ArenaDepth;
+    struct _PH_AUTO_POOL_ARENA_CHUNK *ArenaChunk;
+
     struct _PH_AUTO_POOL *NextPool;
 } PH_AUTO_POOL, *PPH_AUTO_POOL;
 
@@ -282,6 +331,14 @@ PhInitializeAutoPool(
     _Out_ PPH_AUTO_POOL AutoPool
     );
 
+PHLIBAPI
+VOID
+NTAPI
+PhInitializeAutoPoolEx(
+    _Out_ PPH_AUTO_POOL AutoPool,
+    _In_ ULONG Flags
+    );
+
 _May_raise_
 PHLIBAPI
 VOID
@@ -308,6 +365,34 @@ PhAutoDereferenceObject(
 /** Deprecated. Use PhAutoDereferenceObject instead. */
 PHLIBAPI VOID NTAPI PhaDereferenceObject(PVOID Object);
 
+PHLIBAPI
+PPH_AUTO_POOL
+NTAPI
+PhBeginAutoPoolArena(
+    VOID
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhEndAutoPoolArena(
+    _In_opt_ PPH_AUTO_POOL AutoPool
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhReferenceObjectLocal(
+    _In_ PVOID Object
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhDereferenceObjectLocal(
+    _In_ PVOID Object
+    );
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,10 +25,14 @@
 
 #define PH_OBJECT_TYPE_TABLE_SIZE 256
 
-/** The object was allocated from the small free list. */
-#define PH_OBJECT_FROM_SMALL_FREE_LIST 0x1
+/** The object was allocated from a size class. */
+#define PH_OBJECT_FROM_SIZE_CLASS 0x1
 /** The object was allocated from the type free list. */
 #define PH_OBJECT_FROM_TYPE_FREE_LIST 0x2
+/** The object is a string referenced weakly by the string intern table. */
+#define PH_OBJECT_INTERNED 0x4
+/** The object was allocated from an auto-dereference pool arena. */
+#define PH_OBJECT_FROM_ARENA 0x8
 
 /**
  * The object header contains object manager information
@@ -47,7 +51,7 @@ typedef struct _PH_OBJECT_HEADER
             };
             USHORT TypeIndex;
             UCHAR Flags;
-            UCHAR Reserved1;
+            UCHAR SizeClass;
 #ifdef _WIN64
             ULONG Reserved2;
 #endif
@@ -71,7 +75,7 @@ C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, RefCount) == 0x0);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, DeferDeleteListEntry) == 0x0);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, TypeIndex) == 0x8);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Flags) == 0xa);
-C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Reserved1) == 0xb);
+C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, SizeClass) == 0xb);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Reserved2) == 0xc);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Body) == 0x10);
 #else
@@ -79,7 +83,7 @@ C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, RefCount) == 0x0);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, DeferDeleteListEntry) == 0x0);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, TypeIndex) == 0x4);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Flags) == 0x6);
-C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Reserved1) == 0x7);
+C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, SizeClass) == 0x7);
 C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Body) == 0x8);
 #endif
 #endif
@@ -111,6 +115,26 @@ C_ASSERT(FIELD_OFFSET(PH_OBJECT_HEADER, Body) == 0x8);
  */
 #define PhAddObjectHeaderSize(Size) ((Size) + FIELD_OFFSET(PH_OBJECT_HEADER, Body))
 
+#define PH_AUTO_POOL_ARENA_CHUNK_SIZE (16 * 1024)
+#define PH_AUTO_POOL_ARENA_MAXIMUM_OBJECT_SIZE 1024
+
+/**
+ * A block of memory from which an auto-dereference pool allocates objects. Each object is
+ * preceded by a pointer to its chunk. The chunk is reset when the pool is drained and all of
+ * its objects have been freed; if some objects are still alive, the chunk is detached from the
+ * pool and freed together with the last of them.
+ */
+typedef struct _PH_AUTO_POOL_ARENA_CHUNK
+{
+    /** The number of live objects in the chunk, plus one while the chunk is owned by a pool. */
+    volatile LONG LiveCount;
+    /** The number of bytes used at the start of the chunk data. */
+    ULONG Used;
+} PH_AUTO_POOL_ARENA_CHUNK, *PPH_AUTO_POOL_ARENA_CHUNK;
+
+#define PH_AUTO_POOL_ARENA_DATA_OFFSET ALIGN_UP_BY(sizeof(PH_AUTO_POOL_ARENA_CHUNK), MEMORY_ALLOCATION_ALIGNMENT)
+#define PH_AUTO_POOL_ARENA_DATA_SIZE (PH_AUTO_POOL_ARENA_CHUNK_SIZE - PH_AUTO_POOL_ARENA_DATA_OFFSET)
+
 /**
  * An object type specifies a kind of object and
  * its delete procedure.
@@ -129,8 +153,26 @@ typedef struct _PH_OBJECT_TYPE
     PWSTR Name;
     /** A free list to use when allocating for this type. */
     PH_FREE_LIST FreeList;
+    /** The number of allocations satisfied by a per-thread cache. */
+    ULONG NumberOfCacheHits;
+    /** The number of allocations that were not satisfied by a per-thread cache. */
+    ULONG NumberOfCacheMisses;
 } PH_OBJECT_TYPE, *PPH_OBJECT_TYPE;
 
+/**
+ * A per-thread cache of free blocks for each size class. Blocks freed by any thread are
+ * added to the cache of that thread; when a list is full, half of it is moved to the
+ * size class free list, where other threads can pick the blocks up.
+ */
+typedef struct _PH_OBJECT_THREAD_CACHE
+{
+    struct
+    {
+        PSLIST_ENTRY ListHead;
+        ULONG Count;
+    } Lists[PH_OBJECT_SIZE_CLASS_COUNT];
+} PH_OBJECT_THREAD_CACHE, *PPH_OBJECT_THREAD_CACHE;
+
 /**
  * Increments a reference count, but will never increment
  * from 0 to 1.
@@ -158,10 +200,27 @@ VOID PhpFreeObject(
     _In_ PPH_OBJECT_HEADER ObjectHeader
     );
 
+VOID PhpFreeToSizeClass(
+    _In_ ULONG SizeClass,
+    _In_ PVOID Memory
+    );
+
 VOID PhpDeferDeleteObject(
     _In_ PPH_OBJECT_HEADER ObjectHeader
     );
 
+VOID PhpSynchronizeObjectEpoch(
+    VOID
+    );
+
+PPH_OBJECT_HEADER PhpAllocateFromAutoPoolArena(
+    _In_ SIZE_T ObjectSize
+    );
+
+VOID PhpFreeToAutoPoolArena(
+    _In_ PPH_OBJECT_HEADER ObjectHeader
+    );
+
 NTSTATUS PhpDeferDeleteObjectRoutine(
     _In_ PVOID Parameter
     );
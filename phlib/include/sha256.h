@@ -0,0 +1,26 @@
+#ifndef _SHA256_H
+#define _SHA256_H
+
+typedef struct
+{
+    ULONG state[8];
+    ULONG count[2];
+    UCHAR buffer[64];
+} SHA256_CTX;
+
+VOID SHA256Init(
+    _Out_ SHA256_CTX *Context
+    );
+
+VOID SHA256Update(
+    _Inout_ SHA256_CTX *Context,
+    _In_reads_bytes_(Length) UCHAR *Input,
+    _In_ ULONG Length
+    );
+
+VOID SHA256Final(
+    _Inout_ SHA256_CTX *Context,
+    _Out_writes_bytes_(32) UCHAR *Hash
+    );
+
+#endif
@@ -5,6 +5,11 @@ extern PPH_OBJECT_TYPE PhSymbolProviderType;
 extern PH_CALLBACK PhSymInitCallback;
 
 #define PH_MAX_SYMBOL_NAME_LEN 128
+#define PH_SYMBOL_CACHE_MAXIMUM_ENTRIES 8192
+
+// Resolve addresses using per-module symbol tables built once from dbghelp, instead of calling
+// into dbghelp (under the global symbol lock) for every lookup.
+#define PH_SYMBOL_PROVIDER_SYMBOL_TABLES 0x1
 
 typedef struct _PH_SYMBOL_PROVIDER
 {
@@ -13,10 +18,17 @@ typedef struct _PH_SYMBOL_PROVIDER
     HANDLE ProcessHandle;
     BOOLEAN IsRealHandle;
     BOOLEAN IsRegistered;
+    ULONG Flags; // PH_SYMBOL_PROVIDER_*
 
     PH_INITONCE InitOnce;
     PH_AVL_TREE ModulesSet;
     PH_CALLBACK EventCallback;
+
+    PH_QUEUED_LOCK SymbolCacheLock;
+    PPH_HASHTABLE SymbolCache; // Address to symbol results from PhGetSymbolFromAddress
+    ULONG SymbolCacheGeneration; // Incremented whenever cached results may have become stale
+    ULONG SymbolCacheHits;
+    ULONG SymbolCacheMisses;
 } PH_SYMBOL_PROVIDER, *PPH_SYMBOL_PROVIDER;
 
 typedef enum _PH_SYMBOL_RESOLVE_LEVEL
@@ -147,6 +159,43 @@ PhSetSearchPathSymbolProvider(
     _In_ PWSTR Path
     );
 
+#define PH_SYMBOL_PREFETCH_DEFAULT_CONCURRENCY 4
+
+typedef struct _PH_SYMBOL_PREFETCH_PROGRESS
+{
+    ULONG TotalCount;
+    ULONG CompletedCount;
+    ULONG FoundCount; // in the local cache or downloaded
+    ULONG FailedCount;
+    PPH_STRING FileName; // the module that was just completed
+} PH_SYMBOL_PREFETCH_PROGRESS, *PPH_SYMBOL_PREFETCH_PROGRESS;
+
+/**
+ * A callback function passed to PhPrefetchSymbolProvider()
+ * and called each time a module has been completed.
+ *
+ * \param Progress The progress of the prefetch.
+ * \param Context A user-defined value passed to
+ * PhPrefetchSymbolProvider().
+ *
+ * \return TRUE to continue, FALSE to cancel the
+ * remaining downloads.
+ */
+typedef BOOLEAN (NTAPI *PPH_SYMBOL_PREFETCH_CALLBACK)(
+    _In_ PPH_SYMBOL_PREFETCH_PROGRESS Progress,
+    _In_opt_ PVOID Context
+    );
+
+PHLIBAPI
+NTSTATUS
+NTAPI
+PhPrefetchSymbolProvider(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG MaximumConcurrency,
+    _In_opt_ PPH_SYMBOL_PREFETCH_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    );
+
 #ifdef _WIN64
 NTSTATUS
 NTAPI
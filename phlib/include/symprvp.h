@@ -167,4 +167,13 @@ typedef BOOL (CALLBACK *_SymbolServerSetOptions)(
     _In_ ULONG64 data
     );
 
+typedef BOOL (CALLBACK *_SymbolServerW)(
+    _In_ PCWSTR params,
+    _In_ PCWSTR filename,
+    _In_ PVOID id,
+    _In_ DWORD two,
+    _In_ DWORD three,
+    _Out_writes_(MAX_PATH + 1) PWSTR path
+    );
+
 #endif
\ No newline at end of file
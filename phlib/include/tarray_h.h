@@ -0,0 +1,126 @@
+/*
+ * Typed dynamic array template.
+ *
+ * This is a replacement for PH_LIST when all items have the same type, so that callers do not
+ * need to cast items to and from PVOID. To declare a specialization, define T as the item type
+ * and include this file. All functions are inline.
+ */
+
+#ifdef T
+
+#include <templ.h>
+
+typedef struct T___(_PH_ARRAY, T)
+{
+    /** The number of items in the array. */
+    ULONG Count;
+    /** The number of items for which storage is allocated. */
+    ULONG AllocatedCount;
+    /** The array of items. */
+    T *Items;
+} T___(PH_ARRAY, T), *T___(PPH_ARRAY, T);
+
+/**
+ * Initializes an array.
+ *
+ * \param Array The array.
+ * \param InitialCapacity The number of items to allocate storage for initially.
+ */
+FORCEINLINE VOID T___(PhInitializeArray, T)(
+    _Out_ T___(PPH_ARRAY, T) Array,
+    _In_ ULONG InitialCapacity
+    )
+{
+    if (InitialCapacity == 0)
+        InitialCapacity = 1;
+
+    Array->Count = 0;
+    Array->AllocatedCount = InitialCapacity;
+    Array->Items = PhAllocate(sizeof(T) * InitialCapacity);
+}
+
+/**
+ * Frees the storage used by an array.
+ *
+ * \param Array The array.
+ */
+FORCEINLINE VOID T___(PhDeleteArray, T)(
+    _Inout_ T___(PPH_ARRAY, T) Array
+    )
+{
+    PhFree(Array->Items);
+}
+
+/**
+ * Adds an item to the end of an array.
+ *
+ * \param Array The array.
+ * \param Item The item to add.
+ */
+FORCEINLINE VOID T___(PhAddItemArray, T)(
+    _Inout_ T___(PPH_ARRAY, T) Array,
+    _In_ T Item
+    )
+{
+    if (Array->Count == Array->AllocatedCount)
+    {
+        Array->AllocatedCount *= 2;
+        Array->Items = PhReAllocate(Array->Items, sizeof(T) * Array->AllocatedCount);
+    }
+
+    Array->Items[Array->Count++] = Item;
+}
+
+/**
+ * Locates an item in an array.
+ *
+ * \param Array The array.
+ * \param Item The item to search for. Items are compared using the == operator, so this
+ * function can only be used with scalar and pointer types.
+ *
+ * \return The index of the item. If the item was not found, -1 is returned.
+ */
+FORCEINLINE ULONG T___(PhFindItemArray, T)(
+    _In_ T___(PPH_ARRAY, T) Array,
+    _In_ T Item
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Array->Count; i++)
+    {
+        if (Array->Items[i] == Item)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Removes an item from an array, preserving the order of the remaining items.
+ *
+ * \param Array The array.
+ * \param Index The index of the item.
+ */
+FORCEINLINE VOID T___(PhRemoveItemArray, T)(
+    _Inout_ T___(PPH_ARRAY, T) Array,
+    _In_ ULONG Index
+    )
+{
+    memmove(&Array->Items[Index], &Array->Items[Index + 1], (Array->Count - Index - 1) * sizeof(T));
+    Array->Count--;
+}
+
+/**
+ * Removes all items from an array.
+ *
+ * \param Array The array.
+ */
+FORCEINLINE VOID T___(PhClearArray, T)(
+    _Inout_ T___(PPH_ARRAY, T) Array
+    )
+{
+    Array->Count = 0;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _PH_TRACELOG_H
+#define _PH_TRACELOG_H
+
+// Self-instrumentation. Start/stop events are written to the "ProcessHacker" TraceLogging
+// provider ({62134317-8f4c-5c63-a9ad-52661cfd4eaa}) so that they show up in WPA next to system
+// activity. The GUID is derived from the name in the usual way, so tools that accept
+// "*ProcessHacker" in place of a GUID can enable the provider by name. When no session has
+// enabled a keyword, starting an event only tests PhTraceKeywords.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keywords
+
+#define PH_TRACE_KEYWORD_PROVIDER 0x1 // provider runs, process provider phases
+#define PH_TRACE_KEYWORD_WORK_QUEUE 0x2 // work queue items
+#define PH_TRACE_KEYWORD_TREENEW 0x4 // tree list painting and sorting
+#define PH_TRACE_KEYWORD_SYMBOLS 0x8 // symbol loading
+#define PH_TRACE_KEYWORD_KPH 0x10 // KProcessHacker requests
+
+typedef enum _PH_TRACE_FIELD_TYPE
+{
+    PhTraceFieldNone,
+    PhTraceFieldUInt32,
+    PhTraceFieldPointer,
+    PhTraceFieldAnsiString, // null-terminated
+    PhTraceFieldUnicodeString // null-terminated
+} PH_TRACE_FIELD_TYPE;
+
+typedef struct _PH_TRACE_EVENT
+{
+    PSTR Name;
+    ULONGLONG Keyword;
+    PSTR FieldName; // the start event carries one field, the stop event none
+    PH_TRACE_FIELD_TYPE FieldType;
+
+    // Event metadata, created on first use
+    PH_INITONCE InitOnce;
+    PUCHAR StartMetadata;
+    PUCHAR StopMetadata;
+} PH_TRACE_EVENT, *PPH_TRACE_EVENT;
+
+#define PH_TRACE_EVENT_INIT(Name, Keyword, FieldName, FieldType) \
+    { (Name), (Keyword), (FieldName), (FieldType), PH_INITONCE_INIT }
+#define PH_TRACE_EVENT_DECLARE(Variable, Name, Keyword, FieldName, FieldType) \
+    static PH_TRACE_EVENT Variable = PH_TRACE_EVENT_INIT(Name, Keyword, FieldName, FieldType)
+
+typedef struct _PH_TRACE_ACTIVITY
+{
+    GUID ActivityId;
+    BOOLEAN Started;
+} PH_TRACE_ACTIVITY, *PPH_TRACE_ACTIVITY;
+
+PHLIBAPI extern ULONGLONG volatile PhTraceKeywords; // keywords enabled by any session
+
+BOOLEAN PhTraceInitialization(
+    VOID
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhTraceStart(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _Out_ PPH_TRACE_ACTIVITY Activity,
+    _In_ ULONG64 Value
+    );
+
+PHLIBAPI
+VOID
+NTAPI
+PhTraceStop(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _In_ PPH_TRACE_ACTIVITY Activity
+    );
+
+/**
+ * Writes a start event if a session is listening.
+ *
+ * \param Event The event.
+ * \param Activity A variable which receives the activity to pass to PhTraceStopEvent().
+ * \param Value The value of the field of the event, or 0 if the event has no field. Pointers to
+ * strings must be cast to ULONG_PTR.
+ */
+FORCEINLINE
+VOID
+PhTraceStartEvent(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _Out_ PPH_TRACE_ACTIVITY Activity,
+    _In_ ULONG64 Value
+    )
+{
+    Activity->Started = FALSE;
+
+    if (PhTraceKeywords & Event->Keyword)
+        PhTraceStart(Event, Activity, Value);
+}
+
+/**
+ * Writes the stop event of an activity, if its start event was written.
+ *
+ * \param Event The event passed to PhTraceStartEvent().
+ * \param Activity The activity.
+ */
+FORCEINLINE
+VOID
+PhTraceStopEvent(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _In_ PPH_TRACE_ACTIVITY Activity
+    )
+{
+    if (Activity->Started)
+        PhTraceStop(Event, Activity);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -61,6 +61,7 @@ typedef struct _PH_TREENEW_NODE
 
     PPH_STRINGREF TextCache;
     ULONG TextCacheSize;
+    PULONG TextCacheDirtyMask; // optional bitmap of TextCache entries which need to be refreshed
 
     ULONG Index; // index within the flat list
     ULONG Level; // 0 for root, 1, 2, ...
@@ -100,6 +101,7 @@ typedef struct _PH_TREENEW_NODE
 // Extended flags
 #define TN_FLAG_ITEM_DRAG_SELECT 0x1
 #define TN_FLAG_NO_UNFOLDING_TOOLTIPS 0x2
+#define TN_FLAG_DAMAGE_TRACKING 0x4 // only repaint cells whose contents changed when nodes are structured
 
 // Callback flags
 #define TN_CACHE 0x1
@@ -213,6 +215,8 @@ typedef enum _PH_TREENEW_MESSAGE
     TreeNewDestroying,
     TreeNewGetDialogCode, // ULONG Parameter1, PULONG Parameter2
 
+    TreeNewGetVirtualNode, // PPH_TREENEW_GET_VIRTUAL_NODE Parameter1
+
     MaxTreeNewMessage
 } PH_TREENEW_MESSAGE;
 
@@ -344,6 +348,23 @@ typedef struct _PH_TREENEW_SEARCH_EVENT
     PH_STRINGREF String;
 } PH_TREENEW_SEARCH_EVENT, *PPH_TREENEW_SEARCH_EVENT;
 
+// Virtual mode. After TreeNew_SetVirtualCount the control stops sending TreeNewGetChildren and
+// TreeNewIsLeaf and only asks for the nodes of the rows it needs. The rows are flat, and sorting
+// and filtering are done by the model: it reorders its rows in response to TreeNewSortChanged
+// and calls TreeNew_NodesStructured, or calls TreeNew_SetVirtualCount when the row count changes.
+// A returned node must stay valid until the next restructure and must keep its selection state
+// for as long as it exists.
+
+#define TN_VIRTUAL_NODE_EXISTING_ONLY 0x1 // the model may return NULL if it has not created a node for the row
+
+typedef struct _PH_TREENEW_GET_VIRTUAL_NODE
+{
+    ULONG Flags;
+    ULONG Index;
+
+    PPH_TREENEW_NODE Node;
+} PH_TREENEW_GET_VIRTUAL_NODE, *PPH_TREENEW_GET_VIRTUAL_NODE;
+
 #define TNM_FIRST (WM_USER + 1)
 #define TNM_SETCALLBACK (WM_USER + 1)
 #define TNM_NODESADDED (WM_USER + 2) // unimplemented
@@ -390,7 +411,9 @@ typedef struct _PH_TREENEW_SEARCH_EVENT
 #define TNM_SETEMPTYTEXT (WM_USER + 43)
 #define TNM_SETROWHEIGHT (WM_USER + 44)
 #define TNM_ISFLATNODEVALID (WM_USER + 45)
-#define TNM_LAST (WM_USER + 45)
+#define TNM_INVALIDATECHANGEDCELLS (WM_USER + 46)
+#define TNM_SETVIRTUALCOUNT (WM_USER + 47)
+#define TNM_LAST (WM_USER + 47)
 
 #define TreeNew_SetCallback(hWnd, Callback, Context) \
     SendMessage((hWnd), TNM_SETCALLBACK, (WPARAM)(Context), (LPARAM)(Callback))
@@ -521,6 +544,12 @@ typedef struct _PH_TREENEW_SEARCH_EVENT
 #define TreeNew_IsFlatNodeValid(hWnd) \
     ((BOOLEAN)SendMessage((hWnd), TNM_ISFLATNODEVALID, 0, 0))
 
+#define TreeNew_InvalidateChangedCells(hWnd) \
+    SendMessage((hWnd), TNM_INVALIDATECHANGEDCELLS, 0, 0)
+
+#define TreeNew_SetVirtualCount(hWnd, Count) \
+    SendMessage((hWnd), TNM_SETVIRTUALCOUNT, (WPARAM)(Count), 0)
+
 typedef struct _PH_TREENEW_VIEW_PARTS
 {
     RECT ClientRect;
@@ -539,6 +568,64 @@ BOOLEAN PhTreeNewInitialization(
     VOID
     );
 
+typedef int (__cdecl *PPH_TREENEW_SORT_FUNCTION)(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    );
+
+typedef int (__cdecl *PPH_TREENEW_SORT_FUNCTION_EX)(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    );
+
+VOID PhSortTreeNewNodes(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_FUNCTION SortFunction
+    );
+
+VOID PhSortTreeNewNodesEx(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_FUNCTION_EX SortFunction,
+    _In_opt_ PVOID Context
+    );
+
+typedef ULONG64 (NTAPI *PPH_TREENEW_SORT_KEY_FUNCTION)(
+    _In_ PPH_TREENEW_NODE Node,
+    _In_opt_ PVOID Context
+    );
+
+VOID PhSortTreeNewNodesByKey(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_KEY_FUNCTION KeyFunction,
+    _In_ PH_SORT_ORDER SortOrder,
+    _In_opt_ PPH_TREENEW_SORT_FUNCTION_EX SortFunction,
+    _In_opt_ PVOID Context
+    );
+
+FORCEINLINE ULONG64 PhSortKeyFromInt64(
+    _In_ LONG64 Value
+    )
+{
+    return (ULONG64)Value ^ 0x8000000000000000;
+}
+
+FORCEINLINE ULONG64 PhSortKeyFromSingle(
+    _In_ FLOAT Value
+    )
+{
+    ULONG bits = *(PULONG)&Value;
+
+    // Negative numbers are ordered by magnitude in reverse.
+    if (bits & 0x80000000)
+        return ~bits;
+    else
+        return bits | 0x80000000;
+}
+
 FORCEINLINE VOID PhInitializeTreeNewNode(
     _In_ PPH_TREENEW_NODE Node
     )
@@ -562,6 +649,41 @@ FORCEINLINE VOID PhInvalidateTreeNewNode(
         Node->s.CachedIconValid = FALSE;
 }
 
+#define PH_TREENEW_TEXT_CACHE_MASK_SIZE(TextCacheSize) (((TextCacheSize) + 31) / 32) // in ULONGs
+
+/**
+ * Invalidates cached cell text for a node.
+ *
+ * \param Node The node.
+ * \param Mask A bitmap with a bit set for each column whose text should be
+ * refreshed, or NULL to refresh all columns. The bitmap must contain at least
+ * PH_TREENEW_TEXT_CACHE_MASK_SIZE(Node->TextCacheSize) ULONGs.
+ *
+ * \remarks If the node has a dirty mask, this only sets bits in the mask and
+ * the text is refreshed the next time it is needed.
+ */
+FORCEINLINE VOID PhInvalidateTreeNewNodeText(
+    _Inout_ PPH_TREENEW_NODE Node,
+    _In_opt_ PULONG Mask
+    )
+{
+    ULONG i;
+
+    if (Node->TextCacheDirtyMask)
+    {
+        for (i = 0; i < PH_TREENEW_TEXT_CACHE_MASK_SIZE(Node->TextCacheSize); i++)
+            Node->TextCacheDirtyMask[i] |= Mask ? Mask[i] : MAXULONG;
+    }
+    else
+    {
+        for (i = 0; i < Node->TextCacheSize; i++)
+        {
+            if (!Mask || (Mask[i / 32] & ((ULONG)1 << (i % 32))))
+                PhInitializeEmptyStringRef(&Node->TextCache[i]);
+        }
+    }
+}
+
 FORCEINLINE BOOLEAN PhAddTreeNewColumn(
     _In_ HWND hwnd,
     _In_ ULONG Id,
@@ -59,7 +59,8 @@ typedef struct _PH_TREENEW_CONTEXT
             ULONG DragSelectionActive : 1;
             ULONG SelectionRectangleAlpha : 1; // use alpha blending for the selection rectangle
             ULONG CustomRowHeight : 1;
-            ULONG Spare : 4;
+            ULONG VirtualMode : 1; // rows are supplied by the model through TreeNewGetVirtualNode
+            ULONG Spare : 3;
         };
         ULONG Flags;
     };
@@ -111,7 +112,8 @@ typedef struct _PH_TREENEW_CONTEXT
     LONG TrackOldFixedWidth;
     ULONG DividerHot; // 0 for un-hot, 100 for completely hot
 
-    PPH_LIST FlatList;
+    PPH_LIST FlatList; // not used in virtual mode
+    ULONG VirtualCount;
 
     ULONG SortColumn; // ID of the column to sort by
     PH_SORT_ORDER SortOrder;
@@ -146,6 +148,11 @@ typedef struct _PH_TREENEW_CONTEXT
     HBITMAP BufferedBitmap;
     RECT BufferedContextRect;
 
+    PULONG DamageCellHashes; // hashes of the visible cells, indexed by view row and display column
+    ULONG DamageRows;
+    ULONG DamageColumns;
+    ULONG DamageGeometryHash;
+
     LONG SystemDragX;
     LONG SystemDragY;
     RECT DragRect;
@@ -480,6 +487,10 @@ BOOLEAN PhTnpSetColumnHeaderSortIcon(
     _In_opt_ PPH_TREENEW_COLUMN SortColumnPointer
     );
 
+VOID PhTnpNotifySortChanged(
+    _In_ PPH_TREENEW_CONTEXT Context
+    );
+
 VOID PhTnpAutoSizeColumnHeader(
     _In_ PPH_TREENEW_CONTEXT Context,
     _In_ HWND HeaderHandle,
@@ -512,12 +523,55 @@ VOID PhTnpRestructureNodes(
     _In_ PPH_TREENEW_CONTEXT Context
     );
 
+FORCEINLINE ULONG PhTnpGetFlatNodeCount(
+    _In_ PPH_TREENEW_CONTEXT Context
+    )
+{
+    return Context->VirtualMode ? Context->VirtualCount : Context->FlatList->Count;
+}
+
+PPH_TREENEW_NODE PhTnpGetVirtualNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ ULONG Index,
+    _In_ BOOLEAN ExistingOnly
+    );
+
+FORCEINLINE PPH_TREENEW_NODE PhTnpGetFlatNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ ULONG Index
+    )
+{
+    if (Context->VirtualMode)
+        return PhTnpGetVirtualNode(Context, Index, FALSE);
+
+    return Context->FlatList->Items[Index];
+}
+
+// Returns NULL in virtual mode if the model has not created a node for the row. Such rows are
+// never selected, so this is used by operations that would otherwise visit every row.
+FORCEINLINE PPH_TREENEW_NODE PhTnpGetExistingFlatNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ ULONG Index
+    )
+{
+    if (Context->VirtualMode)
+        return PhTnpGetVirtualNode(Context, Index, TRUE);
+
+    return Context->FlatList->Items[Index];
+}
+
 VOID PhTnpInsertNodeChildren(
     _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PPH_LIST List,
     _In_ PPH_TREENEW_NODE Node,
     _In_ ULONG Level
     );
 
+BOOLEAN PhTnpSpliceExpandedNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PPH_TREENEW_NODE Node
+    );
+
 VOID PhTnpSetExpandedNode(
     _In_ PPH_TREENEW_CONTEXT Context,
     _In_ PPH_TREENEW_NODE Node,
@@ -650,7 +704,7 @@ VOID PhTnpPaint(
 
 VOID PhTnpPrepareRowForDraw(
     _In_ PPH_TREENEW_CONTEXT Context,
-    _In_ HDC hdc,
+    _In_opt_ HDC hdc,
     _Inout_ PPH_TREENEW_NODE Node
     );
 
@@ -686,6 +740,35 @@ VOID PhTnpDrawThemedBorder(
     _In_ HDC hdc
     );
 
+VOID PhTnpInvalidateChangedCells(
+    _In_ PPH_TREENEW_CONTEXT Context
+    );
+
+VOID PhTnpRecordPaintedCells(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PRECT PaintRect
+    );
+
+BOOLEAN PhTnpUpdateDamageGeometry(
+    _In_ PPH_TREENEW_CONTEXT Context
+    );
+
+ULONG PhTnpGetRowDamageHash(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ LONG Index
+    );
+
+ULONG PhTnpGetCellDamageHash(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ LONG Index,
+    _In_ PPH_TREENEW_COLUMN Column,
+    _In_ ULONG RowHash
+    );
+
+VOID PhTnpResetDamageTracking(
+    _In_ PPH_TREENEW_CONTEXT Context
+    );
+
 // Tooltips
 
 VOID PhTnpInitializeTooltips(
@@ -796,6 +879,8 @@ VOID PhTnpGetMessagePos(
 #define TNP_ANIMATE_DIVIDER_INCREMENT 17
 #define TNP_ANIMATE_DIVIDER_DECREMENT 2
 
+#define TNP_MAXIMUM_PAINT_RECTS 32
+
 #define TNP_HIT_TEST_FIXED_DIVIDER(X, Context) \
     ((Context)->FixedDividerVisible && (X) >= (Context)->FixedWidth - 8 && (X) < (Context)->FixedWidth + 8)
 #define TNP_HIT_TEST_PLUS_MINUS_GLYPH(X, NodeLevel) \
@@ -24,6 +24,9 @@
 #include <ph.h>
 #include <iosupp.h>
 
+#define PH_FILE_STREAM_WRITE_BEHIND_BUFFER_SIZE (64 * 1024)
+#define PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING_BUFFER_SIZE (1024 * 1024)
+
 PPH_OBJECT_TYPE PhFileStreamType;
 
 BOOLEAN PhIoSupportInitialization(
@@ -516,12 +519,34 @@ NTSTATUS PhCreateFileStream(
     PPH_FILE_STREAM fileStream;
     HANDLE fileHandle;
     ULONG createOptions;
+    ULONG bufferLength;
+
+    bufferLength = PAGE_SIZE;
+
+    if (Flags & PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING)
+    {
+        // Every write except the last must be a whole number of sectors, so only full (page
+        // aligned) buffers are written.
+        Flags |= PH_FILE_STREAM_WRITE_BEHIND;
+        Flags &= ~PH_FILE_STREAM_UNBUFFERED;
+        bufferLength = PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING_BUFFER_SIZE;
+    }
+    else if (Flags & PH_FILE_STREAM_WRITE_BEHIND)
+    {
+        bufferLength = PH_FILE_STREAM_WRITE_BEHIND_BUFFER_SIZE;
+    }
+
+    if (Flags & PH_FILE_STREAM_WRITE_BEHIND)
+        Flags |= PH_FILE_STREAM_ASYNCHRONOUS | PH_FILE_STREAM_OWN_POSITION;
 
     if (Flags & PH_FILE_STREAM_ASYNCHRONOUS)
         createOptions = FILE_NON_DIRECTORY_FILE;
     else
         createOptions = FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT;
 
+    if (Flags & PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING)
+        createOptions |= FILE_NO_INTERMEDIATE_BUFFERING | FILE_SEQUENTIAL_ONLY;
+
     if (!NT_SUCCESS(status = PhCreateFileWin32(
         &fileHandle,
         FileName,
@@ -537,7 +562,7 @@ NTSTATUS PhCreateFileStream(
         &fileStream,
         fileHandle,
         Flags,
-        PAGE_SIZE
+        bufferLength
         )))
     {
         NtClose(fileHandle);
@@ -595,6 +620,11 @@ NTSTATUS PhCreateFileStream2(
     fileStream->ReadLength = 0;
     fileStream->WritePosition = 0;
 
+    fileStream->PendingBuffer = NULL;
+    fileStream->PendingLength = 0;
+    fileStream->PendingStatus = STATUS_SUCCESS;
+    fileStream->PendingEvent = NULL;
+
     *FileStream = fileStream;
 
     return STATUS_SUCCESS;
@@ -614,6 +644,10 @@ VOID NTAPI PhpFileStreamDeleteProcedure(
 
     if (fileStream->Buffer)
         PhFreePage(fileStream->Buffer);
+    if (fileStream->PendingBuffer)
+        PhFreePage(fileStream->PendingBuffer);
+    if (fileStream->PendingEvent)
+        NtClose(fileStream->PendingEvent);
 }
 
 /**
@@ -722,6 +756,12 @@ NTSTATUS PhReadFileStream(
     ULONG availableLength;
     ULONG readLength;
 
+    if (FileStream->PendingLength != 0)
+    {
+        if (!NT_SUCCESS(status = PhpWaitWriteBehindFileStream(FileStream)))
+            return status;
+    }
+
     if (FileStream->Flags & PH_FILE_STREAM_UNBUFFERED)
     {
         return PhpReadFileStream(
@@ -881,6 +921,136 @@ NTSTATUS PhpWriteFileStream(
     return status;
 }
 
+/**
+ * Waits for the background write of a write-behind file stream to complete.
+ */
+NTSTATUS PhpWaitWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream
+    )
+{
+    NTSTATUS status;
+
+    if (FileStream->PendingLength == 0)
+        return STATUS_SUCCESS;
+
+    status = FileStream->PendingStatus;
+
+    if (status == STATUS_PENDING)
+    {
+        status = NtWaitForSingleObject(FileStream->PendingEvent, FALSE, NULL);
+
+        if (NT_SUCCESS(status))
+            status = FileStream->PendingIoStatusBlock.Status;
+    }
+
+    FileStream->PendingLength = 0;
+
+    return status;
+}
+
+/**
+ * Starts writing the current buffer of a write-behind file stream in the background,
+ * and switches to the spare buffer.
+ *
+ * \param FileStream A file stream object.
+ * \param Length The number of bytes to write from the buffer. This may be larger than
+ * the amount of data in the buffer if the write needs padding.
+ */
+NTSTATUS PhpIssueWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_ ULONG Length
+    )
+{
+    NTSTATUS status;
+    PVOID buffer;
+
+    if (!NT_SUCCESS(status = PhpWaitWriteBehindFileStream(FileStream)))
+        return status;
+
+    if (!FileStream->PendingEvent)
+    {
+        if (!NT_SUCCESS(status = NtCreateEvent(
+            &FileStream->PendingEvent,
+            EVENT_ALL_ACCESS,
+            NULL,
+            NotificationEvent,
+            FALSE
+            )))
+            return status;
+    }
+
+    status = NtWriteFile(
+        FileStream->FileHandle,
+        FileStream->PendingEvent,
+        NULL,
+        NULL,
+        &FileStream->PendingIoStatusBlock,
+        FileStream->Buffer,
+        Length,
+        &FileStream->Position,
+        NULL
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    FileStream->PendingStatus = status;
+    FileStream->PendingLength = Length;
+    FileStream->Position.QuadPart += FileStream->WritePosition;
+    FileStream->Flags |= PH_FILE_STREAM_WRITTEN;
+
+    // The buffer belongs to the write until it completes.
+    buffer = FileStream->PendingBuffer;
+    FileStream->PendingBuffer = FileStream->Buffer;
+    FileStream->Buffer = buffer;
+    FileStream->WritePosition = 0;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS PhpWriteBehindFileStream(
+    _Inout_ PPH_FILE_STREAM FileStream,
+    _In_reads_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Length
+    )
+{
+    NTSTATUS status;
+    ULONG writtenLength;
+
+    // Large writes are copied too, so that every write to the file is a full buffer and the
+    // caller's buffer is free to be reused as soon as we return.
+    while (Length != 0)
+    {
+        if (!FileStream->Buffer)
+        {
+            if (!NT_SUCCESS(status = PhpAllocateBufferFileStream(FileStream)))
+                return status;
+        }
+
+        writtenLength = FileStream->BufferLength - FileStream->WritePosition;
+
+        if (writtenLength > Length)
+            writtenLength = Length;
+
+        memcpy(
+            (PCHAR)FileStream->Buffer + FileStream->WritePosition,
+            Buffer,
+            writtenLength
+            );
+        FileStream->WritePosition += writtenLength;
+        Buffer = (PCHAR)Buffer + writtenLength;
+        Length -= writtenLength;
+
+        if (FileStream->WritePosition == FileStream->BufferLength)
+        {
+            if (!NT_SUCCESS(status = PhpIssueWriteBehindFileStream(FileStream, FileStream->BufferLength)))
+                return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS PhWriteFileStream(
     _Inout_ PPH_FILE_STREAM FileStream,
     _In_reads_bytes_(Length) PVOID Buffer,
@@ -907,6 +1077,15 @@ NTSTATUS PhWriteFileStream(
             return status;
     }
 
+    if (FileStream->Flags & PH_FILE_STREAM_WRITE_BEHIND)
+    {
+        return PhpWriteBehindFileStream(
+            FileStream,
+            Buffer,
+            Length
+            );
+    }
+
     if (FileStream->WritePosition != 0)
     {
         availableLength = FileStream->BufferLength - FileStream->WritePosition;
@@ -1013,6 +1192,47 @@ NTSTATUS PhpFlushWriteFileStream(
 {
     NTSTATUS status = STATUS_SUCCESS;
 
+    if (FileStream->Flags & PH_FILE_STREAM_WRITE_BEHIND)
+    {
+        ULONG writeLength;
+
+        writeLength = FileStream->WritePosition;
+
+        if (FileStream->Flags & PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING)
+        {
+            // Pad the last write to a whole number of sectors and cut the file back afterwards.
+            writeLength = (ULONG)ALIGN_UP_BY(writeLength, PAGE_SIZE);
+            memset(
+                (PCHAR)FileStream->Buffer + FileStream->WritePosition,
+                0,
+                writeLength - FileStream->WritePosition
+                );
+        }
+
+        if (!NT_SUCCESS(status = PhpIssueWriteBehindFileStream(FileStream, writeLength)))
+            return status;
+        if (!NT_SUCCESS(status = PhpWaitWriteBehindFileStream(FileStream)))
+            return status;
+
+        if (FileStream->Flags & PH_FILE_STREAM_NO_INTERMEDIATE_BUFFERING)
+        {
+            FILE_END_OF_FILE_INFORMATION endOfFileInfo;
+            IO_STATUS_BLOCK isb;
+
+            endOfFileInfo.EndOfFile = FileStream->Position;
+
+            status = NtSetInformationFile(
+                FileStream->FileHandle,
+                &isb,
+                &endOfFileInfo,
+                sizeof(FILE_END_OF_FILE_INFORMATION),
+                FileEndOfFileInformation
+                );
+        }
+
+        return status;
+    }
+
     if (!NT_SUCCESS(status = PhpWriteFileStream(
         FileStream,
         FileStream->Buffer,
@@ -1046,6 +1266,9 @@ NTSTATUS PhFlushFileStream(
             return status;
     }
 
+    if (!NT_SUCCESS(status = PhpWaitWriteBehindFileStream(FileStream)))
+        return status;
+
     if (FileStream->ReadPosition != 0)
     {
         if (!NT_SUCCESS(status = PhpFlushReadFileStream(FileStream)))
@@ -1141,6 +1364,9 @@ NTSTATUS PhSeekFileStream(
 
     offset = *Offset;
 
+    if (!NT_SUCCESS(status = PhpWaitWriteBehindFileStream(FileStream)))
+        return status;
+
     if (FileStream->WritePosition != 0)
     {
         if (!NT_SUCCESS(status = PhpFlushWriteFileStream(FileStream)))
@@ -22,6 +22,7 @@
 
 #include <ph.h>
 #include <kphuser.h>
+#include <tracelog.h>
 
 NTSTATUS KphpDeviceIoControl(
     _In_ ULONG KphControlCode,
@@ -31,6 +32,8 @@ NTSTATUS KphpDeviceIoControl(
 
 HANDLE PhKphHandle = NULL;
 
+PH_TRACE_EVENT_DECLARE(PhpKphRequestTraceEvent, "KphRequest", PH_TRACE_KEYWORD_KPH, "ControlCode", PhTraceFieldUInt32);
+
 NTSTATUS KphConnect(
     _In_opt_ PWSTR DeviceName
     )
@@ -450,9 +453,12 @@ NTSTATUS KphpDeviceIoControl(
     _In_ ULONG InBufferLength
     )
 {
+    NTSTATUS status;
     IO_STATUS_BLOCK isb;
+    PH_TRACE_ACTIVITY traceActivity;
 
-    return NtDeviceIoControlFile(
+    PhTraceStartEvent(&PhpKphRequestTraceEvent, &traceActivity, KphControlCode);
+    status = NtDeviceIoControlFile(
         PhKphHandle,
         NULL,
         NULL,
@@ -464,6 +470,9 @@ NTSTATUS KphpDeviceIoControl(
         NULL,
         0
         );
+    PhTraceStopEvent(&PhpKphRequestTraceEvent, &traceActivity);
+
+    return status;
 }
 
 NTSTATUS KphGetFeatures(
@@ -482,6 +491,66 @@ NTSTATUS KphGetFeatures(
         );
 }
 
+NTSTATUS KphQueryControlStatistics(
+    _Out_writes_bytes_(BufferLength) PKPH_CONTROL_STATISTICS Buffer,
+    _In_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        PKPH_CONTROL_STATISTICS Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_QUERYCONTROLSTATISTICS,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphQueryControlStatistics2(
+    _Out_ PKPH_CONTROL_STATISTICS *Statistics
+    )
+{
+    NTSTATUS status;
+    PVOID buffer;
+    ULONG bufferSize = 1024;
+
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        status = KphQueryControlStatistics(
+            buffer,
+            bufferSize,
+            &bufferSize
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL)
+        {
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    *Statistics = buffer;
+
+    return status;
+}
+
 NTSTATUS KphOpenProcess(
     _Out_ PHANDLE ProcessHandle,
     _In_ ACCESS_MASK DesiredAccess,
@@ -626,6 +695,26 @@ NTSTATUS KphReadVirtualMemory(
         );
 }
 
+NTSTATUS KphReadVirtualMemoryBatch(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    _In_ ULONG NumberOfEntries
+    )
+{
+    struct
+    {
+        HANDLE ProcessHandle;
+        PKPH_VIRTUAL_MEMORY_READ_ENTRY Entries;
+        ULONG NumberOfEntries;
+    } input = { ProcessHandle, Entries, NumberOfEntries };
+
+    return KphpDeviceIoControl(
+        KPH_READVIRTUALMEMORYBATCH,
+        &input,
+        sizeof(input)
+        );
+}
+
 NTSTATUS KphWriteVirtualMemory(
     _In_ HANDLE ProcessHandle,
     _In_opt_ PVOID BaseAddress,
@@ -720,6 +809,94 @@ NTSTATUS KphSetInformationProcess(
         );
 }
 
+NTSTATUS KphEnumerateProcessIds(
+    _In_ HANDLE StartProcessId,
+    _In_ HANDLE EndProcessId,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        HANDLE StartProcessId;
+        HANDLE EndProcessId;
+        PVOID Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { StartProcessId, EndProcessId, Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_ENUMERATEPROCESSIDS,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphEnumerateProcessIds2(
+    _In_ HANDLE StartProcessId,
+    _In_ HANDLE EndProcessId,
+    _Out_ PKPH_PROCESS_ID_INFORMATION *ProcessIds
+    )
+{
+    NTSTATUS status;
+    PVOID buffer;
+    ULONG bufferSize = 0x1000;
+
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        status = KphEnumerateProcessIds(
+            StartProcessId,
+            EndProcessId,
+            buffer,
+            bufferSize,
+            &bufferSize
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL)
+        {
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    *ProcessIds = buffer;
+
+    return status;
+}
+
+NTSTATUS KphQueryInformationProcesses(
+    _Inout_updates_(NumberOfEntries) PKPH_PROCESS_BATCH_ENTRY Entries,
+    _In_ ULONG NumberOfEntries,
+    _In_ ULONG Fields
+    )
+{
+    struct
+    {
+        PKPH_PROCESS_BATCH_ENTRY Entries;
+        ULONG NumberOfEntries;
+        ULONG Fields;
+    } input = { Entries, NumberOfEntries, Fields };
+
+    return KphpDeviceIoControl(
+        KPH_QUERYINFORMATIONPROCESSES,
+        &input,
+        sizeof(input)
+        );
+}
+
 NTSTATUS KphOpenThread(
     _Out_ PHANDLE ThreadHandle,
     _In_ ACCESS_MASK DesiredAccess,
@@ -866,6 +1043,34 @@ NTSTATUS KphCaptureStackBackTraceThread(
         );
 }
 
+NTSTATUS KphCaptureStackBackTraceThreads(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PKPH_STACK_BACK_TRACE_ENTRY Entries,
+    _In_ ULONG NumberOfEntries,
+    _In_ ULONG FramesToSkip,
+    _In_ ULONG FramesToCapture,
+    _In_ ULONG Flags,
+    _Out_writes_(NumberOfEntries * FramesToCapture) PVOID *BackTraces
+    )
+{
+    struct
+    {
+        HANDLE ProcessHandle;
+        PKPH_STACK_BACK_TRACE_ENTRY Entries;
+        ULONG NumberOfEntries;
+        ULONG FramesToSkip;
+        ULONG FramesToCapture;
+        ULONG Flags;
+        PVOID *BackTraces;
+    } input = { ProcessHandle, Entries, NumberOfEntries, FramesToSkip, FramesToCapture, Flags, BackTraces };
+
+    return KphpDeviceIoControl(
+        KPH_CAPTURESTACKBACKTRACETHREADS,
+        &input,
+        sizeof(input)
+        );
+}
+
 NTSTATUS KphQueryInformationThread(
     _In_ HANDLE ThreadHandle,
     _In_ KPH_THREAD_INFORMATION_CLASS ThreadInformationClass,
@@ -976,6 +1181,168 @@ NTSTATUS KphEnumerateProcessHandles2(
     return status;
 }
 
+NTSTATUS KphEnumerateProcessHandleRange(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE StartHandle,
+    _In_ HANDLE EndHandle,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        HANDLE ProcessHandle;
+        HANDLE StartHandle;
+        HANDLE EndHandle;
+        PVOID Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { ProcessHandle, StartHandle, EndHandle, Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_ENUMERATEPROCESSHANDLERANGE,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphEnumerateProcessHandleRange2(
+    _In_ HANDLE ProcessHandle,
+    _In_ HANDLE StartHandle,
+    _In_ HANDLE EndHandle,
+    _Out_ PKPH_PROCESS_HANDLE_INFORMATION *Handles
+    )
+{
+    NTSTATUS status;
+    PVOID buffer;
+    ULONG bufferSize = 2048;
+
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        status = KphEnumerateProcessHandleRange(
+            ProcessHandle,
+            StartHandle,
+            EndHandle,
+            buffer,
+            bufferSize,
+            &bufferSize
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL)
+        {
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    *Handles = buffer;
+
+    return status;
+}
+
+NTSTATUS KphEnumerateProcessHandleNames(
+    _In_ HANDLE ProcessHandle,
+    _In_opt_ HANDLE StartHandle,
+    _In_opt_ PKPH_OBJECT_TYPE_MASK TypeMask,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        HANDLE ProcessHandle;
+        HANDLE StartHandle;
+        PKPH_OBJECT_TYPE_MASK TypeMask;
+        PVOID Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { ProcessHandle, StartHandle, TypeMask, Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_ENUMERATEPROCESSHANDLENAMES,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphQueryProcessHandleDigest(
+    _In_ HANDLE ProcessHandle,
+    _Out_writes_bytes_(BufferLength) PVOID Buffer,
+    _In_opt_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        HANDLE ProcessHandle;
+        PVOID Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { ProcessHandle, Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_QUERYPROCESSHANDLEDIGEST,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphQueryProcessHandleDigest2(
+    _In_ HANDLE ProcessHandle,
+    _Out_ PKPH_PROCESS_HANDLE_DIGEST *Digest
+    )
+{
+    NTSTATUS status;
+    PVOID buffer;
+    ULONG bufferSize = 256;
+
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        status = KphQueryProcessHandleDigest(
+            ProcessHandle,
+            buffer,
+            bufferSize,
+            &bufferSize
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL)
+        {
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    *Digest = buffer;
+
+    return status;
+}
+
 NTSTATUS KphQueryInformationObject(
     _In_ HANDLE ProcessHandle,
     _In_ HANDLE Handle,
@@ -1105,3 +1472,39 @@ NTSTATUS KphQueryInformationDriver(
         sizeof(input)
         );
 }
+
+NTSTATUS KphSetNotifyEvent(
+    _In_opt_ HANDLE EventHandle
+    )
+{
+    struct
+    {
+        HANDLE EventHandle;
+    } input = { EventHandle };
+
+    return KphpDeviceIoControl(
+        KPH_SETNOTIFYEVENT,
+        &input,
+        sizeof(input)
+        );
+}
+
+NTSTATUS KphReadNotifyEvents(
+    _Out_writes_bytes_(BufferLength) PKPH_NOTIFY_EVENT_INFORMATION Buffer,
+    _In_ ULONG BufferLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    struct
+    {
+        PKPH_NOTIFY_EVENT_INFORMATION Buffer;
+        ULONG BufferLength;
+        PULONG ReturnLength;
+    } input = { Buffer, BufferLength, ReturnLength };
+
+    return KphpDeviceIoControl(
+        KPH_READNOTIFYEVENTS,
+        &input,
+        sizeof(input)
+        );
+}
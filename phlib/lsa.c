@@ -33,6 +33,257 @@
 
 static LSA_HANDLE PhLookupPolicyHandle = NULL;
 
+// SID name cache
+
+#define PH_SID_NAME_CACHE_TTL (10 * 60 * 1000) // 10 minutes
+#define PH_SID_NAME_CACHE_NEGATIVE_TTL (60 * 1000) // 1 minute
+#define PH_SID_NAME_CACHE_MAXIMUM_ENTRIES 4096
+#define PH_SID_LOOKUP_BATCH_SIZE 1000
+
+typedef struct _PH_SID_NAME_CACHE_ENTRY
+{
+    PSID Sid;
+    PPH_STRING FullName; // NULL if the SID could not be resolved
+    ULONG DomainLength; // in bytes, including the backslash
+    SID_NAME_USE NameUse;
+    BOOLEAN Pending; // queued for PhpSidLookupWorker
+    ULONG ExpiryTime; // tick count
+} PH_SID_NAME_CACHE_ENTRY, *PPH_SID_NAME_CACHE_ENTRY;
+
+DECLSPEC_SELECTANY PH_CALLBACK_DECLARE(PhSidFullNamesResolvedEvent);
+
+static PPH_HASHTABLE PhpSidNameCacheHashtable;
+static PH_QUEUED_LOCK PhpSidNameCacheLock = PH_QUEUED_LOCK_INIT;
+static PH_INITONCE PhpSidNameCacheInitOnce = PH_INITONCE_INIT;
+static PPH_LIST PhpSidLookupQueue; // protected by PhpSidNameCacheLock
+static BOOLEAN PhpSidLookupWorkerActive = FALSE; // protected by PhpSidNameCacheLock
+
+static BOOLEAN NTAPI PhpSidNameCacheEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return RtlEqualSid(((PPH_SID_NAME_CACHE_ENTRY)Entry1)->Sid, ((PPH_SID_NAME_CACHE_ENTRY)Entry2)->Sid);
+}
+
+static ULONG NTAPI PhpSidNameCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PSID sid = ((PPH_SID_NAME_CACHE_ENTRY)Entry)->Sid;
+
+    return PhHashBytes((PUCHAR)sid, RtlLengthSid(sid));
+}
+
+static VOID PhpInitializeSidNameCache(
+    VOID
+    )
+{
+    if (PhBeginInitOnce(&PhpSidNameCacheInitOnce))
+    {
+        PhpSidNameCacheHashtable = PhCreateHashtable(
+            sizeof(PH_SID_NAME_CACHE_ENTRY),
+            PhpSidNameCacheEqualFunction,
+            PhpSidNameCacheHashFunction,
+            64
+            );
+        PhpSidLookupQueue = PhCreateList(16);
+
+        PhEndInitOnce(&PhpSidNameCacheInitOnce);
+    }
+}
+
+static BOOLEAN PhpIsSidNameCacheEntryExpired(
+    _In_ PPH_SID_NAME_CACHE_ENTRY Entry
+    )
+{
+    return (LONG)(NtGetTickCount() - Entry->ExpiryTime) >= 0;
+}
+
+static PPH_SID_NAME_CACHE_ENTRY PhpFindSidNameCacheEntry(
+    _In_ PSID Sid
+    )
+{
+    PH_SID_NAME_CACHE_ENTRY lookupEntry;
+
+    lookupEntry.Sid = Sid;
+
+    return PhFindEntryHashtable(PhpSidNameCacheHashtable, &lookupEntry);
+}
+
+static PPH_SID_NAME_CACHE_ENTRY PhpAddSidNameCacheEntry(
+    _In_ PPH_SID_NAME_CACHE_ENTRY Entry
+    )
+{
+    PPH_SID_NAME_CACHE_ENTRY entry;
+    ULONG enumerationKey;
+
+    // Start again when the cache gets too big. Pending entries are kept so that their
+    // lookups are not queued twice.
+    if (PhpSidNameCacheHashtable->Count >= PH_SID_NAME_CACHE_MAXIMUM_ENTRIES)
+    {
+        PPH_LIST pendingList;
+
+        pendingList = PhCreateList(16);
+        enumerationKey = 0;
+
+        while (PhEnumHashtable(PhpSidNameCacheHashtable, &entry, &enumerationKey))
+        {
+            if (entry->Pending)
+            {
+                PhAddItemList(pendingList, entry->Sid);
+            }
+            else
+            {
+                PhFree(entry->Sid);
+                PhClearReference(&entry->FullName);
+            }
+        }
+
+        PhClearHashtable(PhpSidNameCacheHashtable);
+
+        for (enumerationKey = 0; enumerationKey < pendingList->Count; enumerationKey++)
+        {
+            PH_SID_NAME_CACHE_ENTRY pendingEntry;
+
+            memset(&pendingEntry, 0, sizeof(PH_SID_NAME_CACHE_ENTRY));
+            pendingEntry.Sid = pendingList->Items[enumerationKey];
+            pendingEntry.Pending = TRUE;
+            pendingEntry.ExpiryTime = NtGetTickCount() + PH_SID_NAME_CACHE_NEGATIVE_TTL;
+            PhAddEntryHashtable(PhpSidNameCacheHashtable, &pendingEntry);
+        }
+
+        PhDereferenceObject(pendingList);
+    }
+
+    return PhAddEntryHashtableEx(PhpSidNameCacheHashtable, Entry, NULL);
+}
+
+static BOOLEAN PhpGetCachedSidFullName(
+    _In_ PSID Sid,
+    _In_ BOOLEAN IncludeDomain,
+    _Out_ PPH_STRING *FullName,
+    _Out_opt_ PSID_NAME_USE NameUse
+    )
+{
+    PPH_SID_NAME_CACHE_ENTRY entry;
+    PPH_STRING fullName;
+
+    PhpInitializeSidNameCache();
+
+    PhAcquireQueuedLockShared(&PhpSidNameCacheLock);
+
+    entry = PhpFindSidNameCacheEntry(Sid);
+
+    if (!entry || entry->Pending || PhpIsSidNameCacheEntryExpired(entry))
+    {
+        PhReleaseQueuedLockShared(&PhpSidNameCacheLock);
+        return FALSE;
+    }
+
+    if (!(fullName = entry->FullName))
+    {
+        NOTHING;
+    }
+    else if (IncludeDomain || entry->DomainLength == 0)
+    {
+        PhReferenceObject(fullName);
+    }
+    else
+    {
+        fullName = PhCreateStringEx(
+            &fullName->Buffer[entry->DomainLength / sizeof(WCHAR)],
+            fullName->Length - entry->DomainLength
+            );
+    }
+
+    if (fullName && NameUse)
+        *NameUse = entry->NameUse;
+
+    PhReleaseQueuedLockShared(&PhpSidNameCacheLock);
+
+    *FullName = fullName;
+
+    return TRUE;
+}
+
+static VOID PhpLookupSidsIntoCache(
+    _In_ ULONG Count,
+    _In_reads_(Count) PSID *Sids
+    )
+{
+    NTSTATUS status;
+    PLSA_REFERENCED_DOMAIN_LIST referencedDomains;
+    PLSA_TRANSLATED_NAME names;
+    PPH_SID_NAME_CACHE_ENTRY entry;
+    PH_SID_NAME_CACHE_ENTRY newEntry;
+    PPH_STRING fullName;
+    ULONG domainLength;
+    ULONG i;
+
+    referencedDomains = NULL;
+    names = NULL;
+
+    // Names that can't be resolved, including when LSA itself fails, are cached for
+    // a shorter time.
+    status = LsaLookupSids(
+        PhGetLookupPolicyHandle(),
+        Count,
+        Sids,
+        &referencedDomains,
+        &names
+        );
+
+    PhAcquireQueuedLockExclusive(&PhpSidNameCacheLock);
+
+    for (i = 0; i < Count; i++)
+    {
+        fullName = NULL;
+        domainLength = 0;
+
+        if (NT_SUCCESS(status) && names[i].Use != SidTypeInvalid && names[i].Use != SidTypeUnknown)
+        {
+            if (names[i].DomainIndex >= 0 && referencedDomains->Domains[names[i].DomainIndex].Name.Length != 0)
+            {
+                PUNICODE_STRING domainName;
+
+                domainName = &referencedDomains->Domains[names[i].DomainIndex].Name;
+                domainLength = domainName->Length + sizeof(WCHAR);
+
+                fullName = PhCreateStringEx(NULL, domainLength + names[i].Name.Length);
+                memcpy(&fullName->Buffer[0], domainName->Buffer, domainName->Length);
+                fullName->Buffer[domainName->Length / sizeof(WCHAR)] = '\\';
+                memcpy(&fullName->Buffer[domainLength / sizeof(WCHAR)], names[i].Name.Buffer, names[i].Name.Length);
+            }
+            else
+            {
+                fullName = PhCreateStringFromUnicodeString(&names[i].Name);
+            }
+        }
+
+        if (!(entry = PhpFindSidNameCacheEntry(Sids[i])))
+        {
+            memset(&newEntry, 0, sizeof(PH_SID_NAME_CACHE_ENTRY));
+            newEntry.Sid = PhAllocateCopy(Sids[i], RtlLengthSid(Sids[i]));
+            entry = PhpAddSidNameCacheEntry(&newEntry);
+        }
+
+        PhMoveReference(&entry->FullName, fullName);
+        entry->DomainLength = domainLength;
+        entry->NameUse = fullName ? names[i].Use : SidTypeUnknown;
+        entry->Pending = FALSE;
+        entry->ExpiryTime = NtGetTickCount() + (fullName ? PH_SID_NAME_CACHE_TTL : PH_SID_NAME_CACHE_NEGATIVE_TTL);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpSidNameCacheLock);
+
+    // LsaLookupSids allocates memory even if it returns STATUS_NONE_MAPPED.
+    if (referencedDomains)
+        LsaFreeMemory(referencedDomains);
+    if (names)
+        LsaFreeMemory(names);
+}
+
 NTSTATUS PhOpenLsaPolicy(
     _Out_ PLSA_HANDLE PolicyHandle,
     _In_ ACCESS_MASK DesiredAccess,
@@ -383,6 +634,9 @@ NTSTATUS PhLookupName(
  * using PhDereferenceObject() when you no longer
  * need it. If an error occurs, the function
  * returns NULL.
+ *
+ * \remarks Names are cached, so LSA is only asked again
+ * for a SID once its cache entry has expired.
  */
 PPH_STRING PhGetSidFullName(
     _In_ PSID Sid,
@@ -390,77 +644,118 @@ PPH_STRING PhGetSidFullName(
     _Out_opt_ PSID_NAME_USE NameUse
     )
 {
-    NTSTATUS status;
     PPH_STRING fullName;
-    LSA_HANDLE policyHandle;
-    PLSA_REFERENCED_DOMAIN_LIST referencedDomains;
-    PLSA_TRANSLATED_NAME names;
 
-    policyHandle = PhGetLookupPolicyHandle();
+    if (PhpGetCachedSidFullName(Sid, IncludeDomain, &fullName, NameUse))
+        return fullName;
 
-    referencedDomains = NULL;
-    names = NULL;
+    PhpLookupSidsIntoCache(1, &Sid);
 
-    if (NT_SUCCESS(status = LsaLookupSids(
-        policyHandle,
-        1,
-        &Sid,
-        &referencedDomains,
-        &names
-        )))
+    if (PhpGetCachedSidFullName(Sid, IncludeDomain, &fullName, NameUse))
+        return fullName;
+
+    return NULL;
+}
+
+static NTSTATUS PhpSidLookupWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_LIST list;
+    ULONG i;
+
+    while (TRUE)
     {
-        if (names[0].Use != SidTypeInvalid && names[0].Use != SidTypeUnknown)
+        PhAcquireQueuedLockExclusive(&PhpSidNameCacheLock);
+
+        if (PhpSidLookupQueue->Count == 0)
         {
-            PWSTR domainNameBuffer;
-            ULONG domainNameLength;
+            PhpSidLookupWorkerActive = FALSE;
+            PhReleaseQueuedLockExclusive(&PhpSidNameCacheLock);
+            break;
+        }
 
-            if (IncludeDomain && names[0].DomainIndex >= 0)
-            {
-                PLSA_TRUST_INFORMATION trustInfo;
+        // SIDs queued while LSA is busy with this batch make up the next one.
+        list = PhpSidLookupQueue;
+        PhpSidLookupQueue = PhCreateList(16);
 
-                trustInfo = &referencedDomains->Domains[names[0].DomainIndex];
-                domainNameBuffer = trustInfo->Name.Buffer;
-                domainNameLength = trustInfo->Name.Length;
-            }
-            else
-            {
-                domainNameBuffer = NULL;
-                domainNameLength = 0;
-            }
+        PhReleaseQueuedLockExclusive(&PhpSidNameCacheLock);
 
-            if (domainNameBuffer && domainNameLength != 0)
-            {
-                fullName = PhCreateStringEx(NULL, domainNameLength + sizeof(WCHAR) + names[0].Name.Length);
-                memcpy(&fullName->Buffer[0], domainNameBuffer, domainNameLength);
-                fullName->Buffer[domainNameLength / sizeof(WCHAR)] = '\\';
-                memcpy(&fullName->Buffer[domainNameLength / sizeof(WCHAR) + 1], names[0].Name.Buffer, names[0].Name.Length);
-            }
-            else
-            {
-                fullName = PhCreateStringFromUnicodeString(&names[0].Name);
-            }
+        for (i = 0; i < list->Count; i += PH_SID_LOOKUP_BATCH_SIZE)
+            PhpLookupSidsIntoCache(min(list->Count - i, PH_SID_LOOKUP_BATCH_SIZE), (PSID *)&list->Items[i]);
 
-            if (NameUse)
-            {
-                *NameUse = names[0].Use;
-            }
+        for (i = 0; i < list->Count; i++)
+            PhFree(list->Items[i]);
+
+        PhDereferenceObject(list);
+
+        PhInvokeCallback(&PhSidFullNamesResolvedEvent, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Gets the name of a SID without waiting for LSA.
+ *
+ * \param Sid A SID to query.
+ * \param IncludeDomain TRUE to include the domain name,
+ * otherwise FALSE.
+ * \param FullName A variable which receives the name of
+ * the SID, or NULL if the SID could not be resolved. You
+ * must free the string using PhDereferenceObject() when
+ * you no longer need it.
+ *
+ * \return TRUE if the name was known, or FALSE if the SID
+ * has been queued to be looked up. Queued SIDs are looked
+ * up together in the background and
+ * PhSidFullNamesResolvedEvent is invoked after each batch.
+ */
+BOOLEAN PhGetSidFullNameAsync(
+    _In_ PSID Sid,
+    _In_ BOOLEAN IncludeDomain,
+    _Out_ PPH_STRING *FullName
+    )
+{
+    PPH_SID_NAME_CACHE_ENTRY entry;
+    PH_SID_NAME_CACHE_ENTRY newEntry;
+    BOOLEAN startWorker;
+
+    if (PhpGetCachedSidFullName(Sid, IncludeDomain, FullName, NULL))
+        return TRUE;
+
+    startWorker = FALSE;
+
+    PhAcquireQueuedLockExclusive(&PhpSidNameCacheLock);
+
+    // Don't queue a SID twice. A pending entry that has expired was lost along with its batch.
+    if (!(entry = PhpFindSidNameCacheEntry(Sid)) || !entry->Pending || PhpIsSidNameCacheEntryExpired(entry))
+    {
+        if (!entry)
+        {
+            memset(&newEntry, 0, sizeof(PH_SID_NAME_CACHE_ENTRY));
+            newEntry.Sid = PhAllocateCopy(Sid, RtlLengthSid(Sid));
+            entry = PhpAddSidNameCacheEntry(&newEntry);
         }
-        else
+
+        entry->Pending = TRUE;
+        entry->ExpiryTime = NtGetTickCount() + PH_SID_NAME_CACHE_NEGATIVE_TTL;
+
+        PhAddItemList(PhpSidLookupQueue, PhAllocateCopy(Sid, RtlLengthSid(Sid)));
+
+        if (!PhpSidLookupWorkerActive)
         {
-            fullName = NULL;
+            PhpSidLookupWorkerActive = TRUE;
+            startWorker = TRUE;
         }
     }
-    else
-    {
-        fullName = NULL;
-    }
 
-    if (referencedDomains)
-        LsaFreeMemory(referencedDomains);
-    if (names)
-        LsaFreeMemory(names);
+    PhReleaseQueuedLockExclusive(&PhpSidNameCacheLock);
+
+    if (startWorker)
+        PhQueueItemGlobalWorkQueue(PhpSidLookupWorker, NULL);
 
-    return fullName;
+    return FALSE;
 }
 
 /**
@@ -29,6 +29,7 @@
  */
 
 #include <ph.h>
+#include <phintrnl.h>
 #include <delayimp.h>
 
 VOID PhpMappedImageProbe(
@@ -438,6 +439,87 @@ NTSTATUS PhGetMappedImageLoadConfig64(
         );
 }
 
+#define PH_CODEVIEW_RSDS_SIGNATURE ('SDSR')
+
+typedef struct _PH_CODEVIEW_RSDS
+{
+    ULONG Signature;
+    GUID Guid;
+    ULONG Age;
+    CHAR PdbFileName[1];
+} PH_CODEVIEW_RSDS, *PPH_CODEVIEW_RSDS;
+
+/**
+ * Gets the PDB signature of an image from its CodeView debug information.
+ *
+ * \param MappedImage A mapped image.
+ * \param Guid A variable which receives the PDB GUID.
+ * \param Age A variable which receives the PDB age.
+ * \param PdbFileName A variable which receives the PDB file name recorded
+ * by the linker.
+ */
+NTSTATUS PhGetMappedImagePdbInfo(
+    _In_ PPH_MAPPED_IMAGE MappedImage,
+    _Out_ PGUID Guid,
+    _Out_ PULONG Age,
+    _Out_ PPH_STRING *PdbFileName
+    )
+{
+    NTSTATUS status;
+    PIMAGE_DATA_DIRECTORY entry;
+    PIMAGE_DEBUG_DIRECTORY debugDirectory;
+    PPH_CODEVIEW_RSDS codeView;
+    ULONG numberOfEntries;
+    ULONG i;
+
+    status = PhGetMappedImageDataEntry(MappedImage, IMAGE_DIRECTORY_ENTRY_DEBUG, &entry);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    debugDirectory = PhMappedImageRvaToVa(MappedImage, entry->VirtualAddress, NULL);
+
+    if (!debugDirectory)
+        return STATUS_INVALID_PARAMETER;
+
+    numberOfEntries = entry->Size / sizeof(IMAGE_DEBUG_DIRECTORY);
+
+    __try
+    {
+        PhpMappedImageProbe(MappedImage, debugDirectory, numberOfEntries * sizeof(IMAGE_DEBUG_DIRECTORY));
+
+        for (i = 0; i < numberOfEntries; i++)
+        {
+            if (debugDirectory[i].Type != IMAGE_DEBUG_TYPE_CODEVIEW)
+                continue;
+            if (debugDirectory[i].SizeOfData <= FIELD_OFFSET(PH_CODEVIEW_RSDS, PdbFileName))
+                continue;
+
+            // The debug data isn't always in a section, so use the file offset.
+            codeView = PTR_ADD_OFFSET(MappedImage->ViewBase, debugDirectory[i].PointerToRawData);
+            PhpMappedImageProbe(MappedImage, codeView, debugDirectory[i].SizeOfData);
+
+            if (codeView->Signature != PH_CODEVIEW_RSDS_SIGNATURE)
+                continue;
+
+            *Guid = codeView->Guid;
+            *Age = codeView->Age;
+            *PdbFileName = PhConvertUtf8ToUtf16Ex(
+                codeView->PdbFileName,
+                strnlen(codeView->PdbFileName, debugDirectory[i].SizeOfData - FIELD_OFFSET(PH_CODEVIEW_RSDS, PdbFileName))
+                );
+
+            return STATUS_SUCCESS;
+        }
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        return GetExceptionCode();
+    }
+
+    return STATUS_NOT_FOUND;
+}
+
 NTSTATUS PhLoadRemoteMappedImage(
     _In_ HANDLE ProcessHandle,
     _In_ PVOID ViewBase,
@@ -445,46 +527,59 @@ NTSTATUS PhLoadRemoteMappedImage(
     )
 {
     NTSTATUS status;
-    IMAGE_DOS_HEADER dosHeader;
+    UCHAR headerPage[PAGE_SIZE];
+    PIMAGE_DOS_HEADER dosHeader;
     ULONG ntHeadersOffset;
     IMAGE_NT_HEADERS32 ntHeaders;
     ULONG ntHeadersSize;
 
     RemoteMappedImage->ViewBase = ViewBase;
 
+    // The headers of an image view occupy at least one whole page, and almost always fit in
+    // it. Read the page once and only go back to the process for headers that extend past it.
+
     status = PhReadVirtualMemory(
         ProcessHandle,
         ViewBase,
-        &dosHeader,
-        sizeof(IMAGE_DOS_HEADER),
+        headerPage,
+        PAGE_SIZE,
         NULL
         );
 
     if (!NT_SUCCESS(status))
         return status;
 
+    dosHeader = (PIMAGE_DOS_HEADER)headerPage;
+
     // Check the initial MZ.
 
-    if (dosHeader.e_magic != IMAGE_DOS_SIGNATURE)
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
         return STATUS_INVALID_IMAGE_NOT_MZ;
 
     // Get a pointer to the NT headers and read it in for some basic information.
 
-    ntHeadersOffset = (ULONG)dosHeader.e_lfanew;
+    ntHeadersOffset = (ULONG)dosHeader->e_lfanew;
 
     if (ntHeadersOffset == 0 || ntHeadersOffset >= 0x10000000)
         return STATUS_INVALID_IMAGE_FORMAT;
 
-    status = PhReadVirtualMemory(
-        ProcessHandle,
-        PTR_ADD_OFFSET(ViewBase, ntHeadersOffset),
-        &ntHeaders,
-        sizeof(IMAGE_NT_HEADERS32),
-        NULL
-        );
+    if (ntHeadersOffset + sizeof(IMAGE_NT_HEADERS32) <= PAGE_SIZE)
+    {
+        memcpy(&ntHeaders, PTR_ADD_OFFSET(headerPage, ntHeadersOffset), sizeof(IMAGE_NT_HEADERS32));
+    }
+    else
+    {
+        status = PhReadVirtualMemory(
+            ProcessHandle,
+            PTR_ADD_OFFSET(ViewBase, ntHeadersOffset),
+            &ntHeaders,
+            sizeof(IMAGE_NT_HEADERS32),
+            NULL
+            );
 
-    if (!NT_SUCCESS(status))
-        return status;
+        if (!NT_SUCCESS(status))
+            return status;
+    }
 
     // Check the signature and verify the magic.
 
@@ -511,18 +606,25 @@ NTSTATUS PhLoadRemoteMappedImage(
 
     RemoteMappedImage->NtHeaders = PhAllocate(ntHeadersSize);
 
-    status = PhReadVirtualMemory(
-        ProcessHandle,
-        PTR_ADD_OFFSET(ViewBase, ntHeadersOffset),
-        RemoteMappedImage->NtHeaders,
-        ntHeadersSize,
-        NULL
-        );
-
-    if (!NT_SUCCESS(status))
+    if (ntHeadersOffset + ntHeadersSize <= PAGE_SIZE)
     {
-        PhFree(RemoteMappedImage->NtHeaders);
-        return status;
+        memcpy(RemoteMappedImage->NtHeaders, PTR_ADD_OFFSET(headerPage, ntHeadersOffset), ntHeadersSize);
+    }
+    else
+    {
+        status = PhReadVirtualMemory(
+            ProcessHandle,
+            PTR_ADD_OFFSET(ViewBase, ntHeadersOffset),
+            RemoteMappedImage->NtHeaders,
+            ntHeadersSize,
+            NULL
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            PhFree(RemoteMappedImage->NtHeaders);
+            return status;
+        }
     }
 
     RemoteMappedImage->Sections = (PIMAGE_SECTION_HEADER)(
@@ -788,6 +890,8 @@ ULONG PhpLookupMappedImageExportName(
     _In_ PSTR Name
     )
 {
+    PVOID viewEnd;
+    SIZE_T nameLength;
     LONG low;
     LONG high;
     LONG i;
@@ -795,12 +899,16 @@ ULONG PhpLookupMappedImageExportName(
     if (Exports->ExportDirectory->NumberOfNames == 0)
         return -1;
 
+    viewEnd = PTR_ADD_OFFSET(Exports->MappedImage->ViewBase, Exports->MappedImage->Size);
+    nameLength = strlen(Name);
+
     low = 0;
     high = Exports->ExportDirectory->NumberOfNames - 1;
 
     do
     {
         PSTR name;
+        SIZE_T maximumLength;
         INT comparison;
 
         i = (low + high) / 2;
@@ -814,9 +922,12 @@ ULONG PhpLookupMappedImageExportName(
         if (!name)
             return -1;
 
-        // TODO: Probe the name.
+        // The name may not be null-terminated within the view, so never read past its end.
+        maximumLength = (ULONG_PTR)viewEnd - (ULONG_PTR)name;
+        comparison = strncmp(Name, name, min(maximumLength, nameLength + 1));
 
-        comparison = strcmp(Name, name);
+        if (comparison == 0 && maximumLength <= nameLength)
+            return -1;
 
         if (comparison == 0)
             return i;
@@ -1176,12 +1287,122 @@ NTSTATUS PhGetMappedImageDelayImports(
     return STATUS_SUCCESS;
 }
 
+// Each 32-bit lane grows by at most 2 * 0xffff per iteration, so this many iterations can't
+// overflow it.
+#define PH_CHECKSUM_VECTOR_MAXIMUM_ITERATIONS 0x8000
+
+static ULONG64 PhpCheckSumSse2(
+    _Inout_ PUSHORT *Buffer,
+    _Inout_ PULONG Count
+    )
+{
+    PUSHORT buffer = *Buffer;
+    ULONG count = *Count;
+    ULONG64 total = 0;
+    __m128i zero = _mm_setzero_si128();
+
+    while (count >= 8)
+    {
+        __m128i accumulator;
+        ULONG lanes[4];
+        ULONG blockCount;
+        ULONG i;
+
+        accumulator = zero;
+        blockCount = min(count / 8, PH_CHECKSUM_VECTOR_MAXIMUM_ITERATIONS);
+
+        for (i = 0; i < blockCount; i++)
+        {
+            __m128i words;
+
+            words = _mm_loadu_si128((__m128i *)buffer);
+            accumulator = _mm_add_epi32(accumulator, _mm_unpacklo_epi16(words, zero));
+            accumulator = _mm_add_epi32(accumulator, _mm_unpackhi_epi16(words, zero));
+            buffer += 8;
+        }
+
+        count -= blockCount * 8;
+
+        _mm_storeu_si128((__m128i *)lanes, accumulator);
+        total += (ULONG64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    *Buffer = buffer;
+    *Count = count;
+
+    return total;
+}
+
+static ULONG64 PhpCheckSumAvx2(
+    _Inout_ PUSHORT *Buffer,
+    _Inout_ PULONG Count
+    )
+{
+    PUSHORT buffer = *Buffer;
+    ULONG count = *Count;
+    ULONG64 total = 0;
+    __m256i zero = _mm256_setzero_si256();
+
+    while (count >= 16)
+    {
+        __m256i accumulator;
+        ULONG lanes[8];
+        ULONG blockCount;
+        ULONG i;
+
+        accumulator = zero;
+        blockCount = min(count / 16, PH_CHECKSUM_VECTOR_MAXIMUM_ITERATIONS);
+
+        for (i = 0; i < blockCount; i++)
+        {
+            __m256i words;
+
+            // The unpacks work within each 128-bit half, which doesn't matter for a sum.
+            words = _mm256_loadu_si256((__m256i *)buffer);
+            accumulator = _mm256_add_epi32(accumulator, _mm256_unpacklo_epi16(words, zero));
+            accumulator = _mm256_add_epi32(accumulator, _mm256_unpackhi_epi16(words, zero));
+            buffer += 16;
+        }
+
+        count -= blockCount * 16;
+
+        _mm256_storeu_si256((__m256i *)lanes, accumulator);
+        total += (ULONG64)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+            lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    *Buffer = buffer;
+    *Count = count;
+
+    return total;
+}
+
 USHORT PhCheckSum(
     _In_ ULONG Sum,
     _In_reads_(Count) PUSHORT Buffer,
     _In_ ULONG Count
     )
 {
+    if (PhpVectorLevel >= PH_VECTOR_LEVEL_SSE2 && Count >= 8)
+    {
+        ULONG64 total = 0;
+
+        // The end-around carry sum is the same as the plain sum modulo 0xffff (with 0xffff
+        // standing in for a non-zero multiple), so accumulate words in 32-bit lanes and
+        // reduce once at the end.
+
+        if (PhpVectorLevel >= PH_VECTOR_LEVEL_AVX2)
+            total = PhpCheckSumAvx2(&Buffer, &Count);
+
+        total += PhpCheckSumSse2(&Buffer, &Count);
+
+        if (total != 0)
+        {
+            Sum += (ULONG)((total - 1) % 0xffff) + 1;
+            Sum = (Sum >> 16) + (Sum & 0xffff);
+        }
+    }
+
     while (Count--)
     {
         Sum += *Buffer++;
@@ -522,6 +522,66 @@ NTSTATUS PhReadVirtualMemory(
     return status;
 }
 
+C_ASSERT(sizeof(PH_VIRTUAL_MEMORY_READ_ENTRY) == sizeof(KPH_VIRTUAL_MEMORY_READ_ENTRY));
+C_ASSERT(FIELD_OFFSET(PH_VIRTUAL_MEMORY_READ_ENTRY, Status) == FIELD_OFFSET(KPH_VIRTUAL_MEMORY_READ_ENTRY, Status));
+
+/**
+ * Copies several ranges of memory from another process into the
+ * current process.
+ *
+ * \param ProcessHandle A handle to a process. The handle must
+ * have PROCESS_VM_READ access.
+ * \param Entries An array of entries, each describing a range to copy.
+ * The Status and NumberOfBytesRead fields of each entry receive the
+ * result for that range.
+ * \param NumberOfEntries The number of entries in \a Entries.
+ *
+ * \remarks When KProcessHacker is connected, the ranges are copied
+ * using one request for up to KPH_MAXIMUM_READ_BATCH_ENTRIES entries
+ * instead of one system call per range.
+ */
+VOID PhReadVirtualMemoryBatch(
+    _In_ HANDLE ProcessHandle,
+    _Inout_updates_(NumberOfEntries) PPH_VIRTUAL_MEMORY_READ_ENTRY Entries,
+    _In_ ULONG NumberOfEntries
+    )
+{
+    ULONG i;
+
+    i = 0;
+
+    if (NumberOfEntries > 1 && KphIsConnected())
+    {
+        while (i < NumberOfEntries)
+        {
+            ULONG count = min(NumberOfEntries - i, KPH_MAXIMUM_READ_BATCH_ENTRIES);
+
+            // Older versions of the driver don't support batched reads, so fall back to reading
+            // each range on failure.
+            if (!NT_SUCCESS(KphReadVirtualMemoryBatch(
+                ProcessHandle,
+                (PKPH_VIRTUAL_MEMORY_READ_ENTRY)&Entries[i],
+                count
+                )))
+                break;
+
+            i += count;
+        }
+    }
+
+    for (; i < NumberOfEntries; i++)
+    {
+        Entries[i].NumberOfBytesRead = 0;
+        Entries[i].Status = PhReadVirtualMemory(
+            ProcessHandle,
+            Entries[i].BaseAddress,
+            Entries[i].Buffer,
+            Entries[i].BufferSize,
+            &Entries[i].NumberOfBytesRead
+            );
+    }
+}
+
 /**
  * Copies memory from the current process into another process.
  *
@@ -4088,6 +4148,196 @@ typedef struct _GET_PROCEDURE_ADDRESS_REMOTE_CONTEXT
     PVOID DllBase;
 } GET_PROCEDURE_ADDRESS_REMOTE_CONTEXT, *PGET_PROCEDURE_ADDRESS_REMOTE_CONTEXT;
 
+#define PH_PROCEDURE_ADDRESS_CACHE_MAXIMUM 256
+
+typedef struct _PH_PROCEDURE_ADDRESS_CACHE_ENTRY
+{
+    PH_STRINGREF FileName;
+    PSTR ProcedureName; // NULL for lookups by ordinal
+    USHORT ProcedureNumber;
+    USHORT Magic;
+    ULONG Rva;
+    LARGE_INTEGER LastWriteTime;
+    LARGE_INTEGER EndOfFile;
+
+    PPH_STRING FileNameString;
+    PPH_BYTES ProcedureNameBytes;
+} PH_PROCEDURE_ADDRESS_CACHE_ENTRY, *PPH_PROCEDURE_ADDRESS_CACHE_ENTRY;
+
+static PPH_HASHTABLE PhpProcedureAddressCacheHashtable = NULL;
+static PH_QUEUED_LOCK PhpProcedureAddressCacheLock = PH_QUEUED_LOCK_INIT;
+
+static BOOLEAN NTAPI PhpProcedureAddressCacheCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_PROCEDURE_ADDRESS_CACHE_ENTRY entry1 = Entry1;
+    PPH_PROCEDURE_ADDRESS_CACHE_ENTRY entry2 = Entry2;
+
+    if (!PhEqualStringRef(&entry1->FileName, &entry2->FileName, TRUE))
+        return FALSE;
+
+    if (entry1->ProcedureName && entry2->ProcedureName)
+        return strcmp(entry1->ProcedureName, entry2->ProcedureName) == 0;
+    else if (!entry1->ProcedureName && !entry2->ProcedureName)
+        return entry1->ProcedureNumber == entry2->ProcedureNumber;
+    else
+        return FALSE;
+}
+
+static ULONG NTAPI PhpProcedureAddressCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_PROCEDURE_ADDRESS_CACHE_ENTRY entry = Entry;
+    ULONG hash;
+
+    hash = PhHashStringRef(&entry->FileName, TRUE);
+
+    if (entry->ProcedureName)
+        hash ^= PhHashBytes((PUCHAR)entry->ProcedureName, strlen(entry->ProcedureName));
+    else
+        hash ^= entry->ProcedureNumber;
+
+    return hash;
+}
+
+static VOID PhpClearProcedureAddressCache(
+    VOID
+    )
+{
+    PPH_PROCEDURE_ADDRESS_CACHE_ENTRY entry;
+    ULONG enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpProcedureAddressCacheHashtable, (PVOID *)&entry, &enumerationKey))
+    {
+        PhDereferenceObject(entry->FileNameString);
+        PhClearReference(&entry->ProcedureNameBytes);
+    }
+
+    PhClearHashtable(PhpProcedureAddressCacheHashtable);
+}
+
+/**
+ * Resolves the RVA of an exported procedure, caching the result per file so that
+ * lookups for the same DLL in other processes don't map and parse the image again.
+ */
+static NTSTATUS PhpGetCachedProcedureRva(
+    _In_ PWSTR FileName,
+    _In_opt_ PSTR ProcedureName,
+    _In_opt_ ULONG ProcedureNumber,
+    _Out_ PUSHORT Magic,
+    _Out_ PULONG Rva
+    )
+{
+    NTSTATUS status;
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+    PH_PROCEDURE_ADDRESS_CACHE_ENTRY lookupEntry;
+    PPH_PROCEDURE_ADDRESS_CACHE_ENTRY entry;
+    PH_MAPPED_IMAGE mappedImage;
+    PH_MAPPED_IMAGE_EXPORTS exports;
+    PVOID function;
+
+    if (!NT_SUCCESS(status = PhQueryFullAttributesFileWin32(FileName, &networkOpenInfo)))
+        return status;
+
+    PhInitializeStringRef(&lookupEntry.FileName, FileName);
+    lookupEntry.ProcedureName = ProcedureName;
+    lookupEntry.ProcedureNumber = (USHORT)ProcedureNumber;
+
+    PhAcquireQueuedLockShared(&PhpProcedureAddressCacheLock);
+
+    if (PhpProcedureAddressCacheHashtable)
+    {
+        entry = PhFindEntryHashtable(PhpProcedureAddressCacheHashtable, &lookupEntry);
+
+        // The file may have been replaced since we cached it (e.g. by an update).
+        if (
+            entry &&
+            entry->LastWriteTime.QuadPart == networkOpenInfo.LastWriteTime.QuadPart &&
+            entry->EndOfFile.QuadPart == networkOpenInfo.EndOfFile.QuadPart
+            )
+        {
+            *Magic = entry->Magic;
+            *Rva = entry->Rva;
+            PhReleaseQueuedLockShared(&PhpProcedureAddressCacheLock);
+
+            return STATUS_SUCCESS;
+        }
+    }
+
+    PhReleaseQueuedLockShared(&PhpProcedureAddressCacheLock);
+
+    if (!NT_SUCCESS(status = PhLoadMappedImage(FileName, NULL, TRUE, &mappedImage)))
+        return status;
+
+    if (NT_SUCCESS(status = PhGetMappedImageExports(&exports, &mappedImage)))
+    {
+        status = PhGetMappedImageExportFunctionRemote(
+            &exports,
+            ProcedureName,
+            (USHORT)ProcedureNumber,
+            NULL,
+            &function
+            );
+    }
+
+    lookupEntry.Magic = mappedImage.Magic;
+    PhUnloadMappedImage(&mappedImage);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    lookupEntry.Rva = PtrToUlong(function);
+    lookupEntry.LastWriteTime = networkOpenInfo.LastWriteTime;
+    lookupEntry.EndOfFile = networkOpenInfo.EndOfFile;
+
+    *Magic = lookupEntry.Magic;
+    *Rva = lookupEntry.Rva;
+
+    PhAcquireQueuedLockExclusive(&PhpProcedureAddressCacheLock);
+
+    if (!PhpProcedureAddressCacheHashtable)
+    {
+        PhpProcedureAddressCacheHashtable = PhCreateHashtable(
+            sizeof(PH_PROCEDURE_ADDRESS_CACHE_ENTRY),
+            PhpProcedureAddressCacheCompareFunction,
+            PhpProcedureAddressCacheHashFunction,
+            16
+            );
+    }
+
+    if (entry = PhFindEntryHashtable(PhpProcedureAddressCacheHashtable, &lookupEntry))
+    {
+        entry->Magic = lookupEntry.Magic;
+        entry->Rva = lookupEntry.Rva;
+        entry->LastWriteTime = lookupEntry.LastWriteTime;
+        entry->EndOfFile = lookupEntry.EndOfFile;
+    }
+    else
+    {
+        if (PhpProcedureAddressCacheHashtable->Count >= PH_PROCEDURE_ADDRESS_CACHE_MAXIMUM)
+            PhpClearProcedureAddressCache();
+
+        lookupEntry.FileNameString = PhCreateString(FileName);
+        lookupEntry.FileName = lookupEntry.FileNameString->sr;
+        lookupEntry.ProcedureNameBytes = NULL;
+
+        if (ProcedureName)
+        {
+            lookupEntry.ProcedureNameBytes = PhCreateBytes(ProcedureName);
+            lookupEntry.ProcedureName = lookupEntry.ProcedureNameBytes->Buffer;
+        }
+
+        PhAddEntryHashtable(PhpProcedureAddressCacheHashtable, &lookupEntry);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpProcedureAddressCacheLock);
+
+    return STATUS_SUCCESS;
+}
+
 static BOOLEAN PhpGetProcedureAddressRemoteCallback(
     _In_ PLDR_DATA_TABLE_ENTRY Module,
     _In_opt_ PVOID Context
@@ -4133,17 +4383,17 @@ NTSTATUS PhGetProcedureAddressRemote(
     )
 {
     NTSTATUS status;
-    PH_MAPPED_IMAGE mappedImage;
-    PH_MAPPED_IMAGE_EXPORTS exports;
+    USHORT magic;
+    ULONG rva;
     GET_PROCEDURE_ADDRESS_REMOTE_CONTEXT context;
 
-    if (!NT_SUCCESS(status = PhLoadMappedImage(FileName, NULL, TRUE, &mappedImage)))
+    if (!NT_SUCCESS(status = PhpGetCachedProcedureRva(FileName, ProcedureName, ProcedureNumber, &magic, &rva)))
         return status;
 
     PhInitializeStringRef(&context.FileName, FileName);
     context.DllBase = NULL;
 
-    if (mappedImage.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    if (magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
     {
 #ifdef _WIN64
         status = PhEnumProcessModules32(ProcessHandle, PhpGetProcedureAddressRemoteCallback, &context);
@@ -4161,29 +4411,14 @@ NTSTATUS PhGetProcedureAddressRemote(
     }
 
     if (!NT_SUCCESS(status))
-        goto CleanupExit;
-
-    if (!NT_SUCCESS(status = PhGetMappedImageExports(&exports, &mappedImage)))
-        goto CleanupExit;
-
-    status = PhGetMappedImageExportFunctionRemote(
-        &exports,
-        ProcedureName,
-        (USHORT)ProcedureNumber,
-        context.DllBase,
-        ProcedureAddress
-        );
+        return status;
 
-    if (NT_SUCCESS(status))
-    {
-        if (DllBase)
-            *DllBase = context.DllBase;
-    }
+    *ProcedureAddress = PTR_ADD_OFFSET(context.DllBase, rva);
 
-CleanupExit:
-    PhUnloadMappedImage(&mappedImage);
+    if (DllBase)
+        *DllBase = context.DllBase;
 
-    return status;
+    return STATUS_SUCCESS;
 }
 
 /**
@@ -4392,7 +4627,8 @@ NTSTATUS PhEnumProcessesEx(
         return status;
     }
 
-    if (bufferSize <= 0x40000) initialBufferSize[classIndex] = bufferSize;
+    // Remember the size so that the next call doesn't need to retry the query.
+    if (bufferSize > initialBufferSize[classIndex]) initialBufferSize[classIndex] = bufferSize;
     *Processes = buffer;
 
     return status;
@@ -4462,6 +4698,118 @@ NTSTATUS PhEnumProcessesForSession(
     return status;
 }
 
+/**
+ * Queries per-processor system information for a processor group.
+ *
+ * \param SystemInformationClass The information class, for example
+ * SystemProcessorPerformanceInformation.
+ * \param ProcessorGroup The processor group to query.
+ * \param SystemInformation A buffer which receives one entry for each
+ * active processor in the group.
+ * \param SystemInformationLength The size of \a SystemInformation.
+ * \param ReturnLength A variable which receives the number of bytes
+ * written.
+ *
+ * \remarks Before Windows 7 only group 0 exists, and it is queried
+ * without the group input.
+ */
+NTSTATUS PhQuerySystemInformationForGroup(
+    _In_ SYSTEM_INFORMATION_CLASS SystemInformationClass,
+    _In_ USHORT ProcessorGroup,
+    _Out_writes_bytes_(SystemInformationLength) PVOID SystemInformation,
+    _In_ ULONG SystemInformationLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    if (!NtQuerySystemInformationEx_Import())
+    {
+        if (ProcessorGroup != 0)
+            return STATUS_NOT_SUPPORTED;
+
+        return NtQuerySystemInformation(
+            SystemInformationClass,
+            SystemInformation,
+            SystemInformationLength,
+            ReturnLength
+            );
+    }
+
+    return NtQuerySystemInformationEx_Import()(
+        SystemInformationClass,
+        &ProcessorGroup,
+        sizeof(USHORT),
+        SystemInformation,
+        SystemInformationLength,
+        ReturnLength
+        );
+}
+
+/**
+ * Gets information about the relationships between logical processors.
+ *
+ * \param RelationshipType The relationship to query, for example
+ * RelationGroup or RelationNumaNode.
+ * \param Buffer A variable which receives a pointer to a buffer
+ * containing a sequence of SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX
+ * structures. You must free the buffer using PhFree() when you no
+ * longer need it.
+ * \param BufferLength A variable which receives the size of the
+ * buffer, in bytes.
+ *
+ * \remarks This function requires Windows 7 or above.
+ */
+NTSTATUS PhGetSystemLogicalProcessorInformation(
+    _In_ LOGICAL_PROCESSOR_RELATIONSHIP RelationshipType,
+    _Out_ PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *Buffer,
+    _Out_ PULONG BufferLength
+    )
+{
+    NTSTATUS status;
+    ULONG relationshipType;
+    PVOID buffer;
+    ULONG bufferSize;
+
+    if (!NtQuerySystemInformationEx_Import())
+        return STATUS_NOT_SUPPORTED;
+
+    relationshipType = RelationshipType;
+    bufferSize = 0x400;
+    buffer = PhAllocate(bufferSize);
+
+    while (TRUE)
+    {
+        status = NtQuerySystemInformationEx_Import()(
+            SystemLogicalProcessorAndGroupInformation,
+            &relationshipType,
+            sizeof(ULONG),
+            buffer,
+            bufferSize,
+            &bufferSize
+            );
+
+        if (status == STATUS_BUFFER_TOO_SMALL || status == STATUS_INFO_LENGTH_MISMATCH)
+        {
+            PhFree(buffer);
+            buffer = PhAllocate(bufferSize);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        PhFree(buffer);
+        return status;
+    }
+
+    *Buffer = buffer;
+    *BufferLength = bufferSize;
+
+    return status;
+}
+
 /**
  * Finds the process information structure for a
  * specific process.
@@ -41,15 +41,35 @@
  * when boosted, always run on the same provider thread. The other option
  * would be to have the boosting thread run the provider function
  * directly, which would involve unnecessary blocking and synchronization.
+ *
+ * The run time of each provider is recorded in its registration, along
+ * with a histogram of run times and the number of runs which took longer
+ * than the interval of the provider thread. The RunCompletedEvent callback
+ * of the provider thread is invoked after each run so that slow providers
+ * can be detected as they happen.
+ *
+ * Each provider can also have its own schedule. A provider with a target
+ * interval longer than the interval of the provider thread is skipped
+ * until it is due, a provider which takes longer than its budget is
+ * deferred in proportion to how much it went over, and a provider which
+ * tracks consumers drops to a slow cadence while nobody is consuming its
+ * results. Boosted runs ignore the schedule.
+ *
+ * Provider threads are independent of each other, so providers which
+ * should not delay each other can be registered with different provider
+ * threads. Each provider thread can be given an ideal processor.
  */
 
 #include <ph.h>
+#include <tracelog.h>
 
 #ifdef DEBUG
 PPH_LIST PhDbgProviderList;
 PH_QUEUED_LOCK PhDbgProviderListLock = PH_QUEUED_LOCK_INIT;
 #endif
 
+PH_TRACE_EVENT_DECLARE(PhpProviderRunTraceEvent, "ProviderRun", PH_TRACE_KEYWORD_PROVIDER, "Function", PhTraceFieldPointer);
+
 /**
  * Initializes a provider thread.
  *
@@ -69,6 +89,11 @@ VOID PhInitializeProviderThread(
     PhInitializeQueuedLock(&ProviderThread->Lock);
     InitializeListHead(&ProviderThread->ListHead);
     ProviderThread->BoostCount = 0;
+    ProviderThread->IdealProcessor = PH_PROVIDER_NO_IDEAL_PROCESSOR;
+
+    ProviderThread->PerformanceFrequency.QuadPart = 0;
+    ProviderThread->OverrunCount = 0;
+    PhInitializeCallback(&ProviderThread->RunCompletedEvent);
 
 #ifdef DEBUG
     PhAcquireQueuedLockExclusive(&PhDbgProviderListLock);
@@ -91,7 +116,8 @@ VOID PhDeleteProviderThread(
 #ifdef DEBUG
     ULONG index;
 #endif
-    // Nothing
+
+    PhDeleteCallback(&ProviderThread->RunCompletedEvent);
 
 #ifdef DEBUG
     PhAcquireQueuedLockExclusive(&PhDbgProviderListLock);
@@ -101,6 +127,95 @@ VOID PhDeleteProviderThread(
 #endif
 }
 
+static ULONG64 PhpGetElapsedProviderTime(
+    _In_ PPH_PROVIDER_THREAD ProviderThread,
+    _In_ PLARGE_INTEGER StartCounter,
+    _In_ PLARGE_INTEGER EndCounter
+    )
+{
+    ULONG64 elapsed;
+    ULONG64 frequency;
+
+    elapsed = EndCounter->QuadPart - StartCounter->QuadPart;
+    frequency = ProviderThread->PerformanceFrequency.QuadPart;
+
+    // Convert to microseconds without overflowing for long runs.
+    return elapsed / frequency * 1000000 + elapsed % frequency * 1000000 / frequency;
+}
+
+static VOID PhpUpdateStatisticsProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration,
+    _In_ ULONG64 RunTime,
+    _In_ BOOLEAN Overrun
+    )
+{
+    ULONG bucket;
+    ULONG64 limit;
+
+    Registration->RunCount++;
+    Registration->LastRunTime = RunTime;
+    Registration->TotalRunTime += RunTime;
+
+    if (Registration->MaximumRunTime < RunTime)
+        Registration->MaximumRunTime = RunTime;
+    if (Overrun)
+        Registration->OverrunCount++;
+
+    bucket = 0;
+    limit = 2;
+
+    while (RunTime >= limit && bucket < PH_PROVIDER_HISTOGRAM_SIZE - 1)
+    {
+        bucket++;
+        limit <<= 1;
+    }
+
+    Registration->RunTimeHistogram[bucket]++;
+}
+
+static BOOLEAN PhpIsDueProvider(
+    _In_ PPH_PROVIDER_THREAD ProviderThread,
+    _In_ PPH_PROVIDER_REGISTRATION Registration,
+    _In_ PLARGE_INTEGER Now
+    )
+{
+    ULONG64 slack;
+
+    // Allow for the timer firing slightly early, otherwise a provider due every second tick
+    // would often run every third tick.
+    slack = (ULONG64)ProviderThread->Interval * ProviderThread->PerformanceFrequency.QuadPart / 2000;
+
+    return (ULONG64)Now->QuadPart + slack >= Registration->NextRunTime;
+}
+
+static VOID PhpScheduleProvider(
+    _In_ PPH_PROVIDER_THREAD ProviderThread,
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration,
+    _In_ PLARGE_INTEGER Now,
+    _In_ ULONG64 RunTime
+    )
+{
+    ULONG64 interval;
+    ULONG64 factor;
+
+    interval = max(Registration->TargetInterval, ProviderThread->Interval);
+
+    if ((Registration->ScheduleFlags & PH_PROVIDER_TRACK_CONSUMERS) && Registration->ConsumerCount == 0)
+        interval *= PH_PROVIDER_IDLE_FACTOR;
+
+    if (Registration->Budget != 0 && RunTime > Registration->Budget)
+    {
+        factor = (RunTime + Registration->Budget - 1) / Registration->Budget;
+
+        if (factor > PH_PROVIDER_MAXIMUM_DEFER_FACTOR)
+            factor = PH_PROVIDER_MAXIMUM_DEFER_FACTOR;
+
+        interval *= factor;
+    }
+
+    Registration->NextRunTime = Now->QuadPart + interval * ProviderThread->PerformanceFrequency.QuadPart / 1000;
+}
+
 NTSTATUS NTAPI PhpProviderThreadStart(
     _In_ PVOID Parameter
     )
@@ -112,6 +227,20 @@ NTSTATUS NTAPI PhpProviderThreadStart(
     PPH_PROVIDER_FUNCTION providerFunction;
     PVOID object;
     LIST_ENTRY tempListHead;
+    LARGE_INTEGER passStartCounter;
+    LARGE_INTEGER startCounter;
+    LARGE_INTEGER endCounter;
+    PH_PROVIDER_RUN_INFORMATION runInformation;
+    PH_TRACE_ACTIVITY traceActivity;
+
+    NtQueryPerformanceCounter(&passStartCounter, &providerThread->PerformanceFrequency);
+
+    if (providerThread->IdealProcessor != PH_PROVIDER_NO_IDEAL_PROCESSOR)
+    {
+        ULONG idealProcessor = providerThread->IdealProcessor;
+
+        NtSetInformationThread(NtCurrentThread(), ThreadIdealProcessor, &idealProcessor, sizeof(ULONG));
+    }
 
     while (providerThread->State != ProviderThreadStopping)
     {
@@ -128,6 +257,9 @@ NTSTATUS NTAPI PhpProviderThreadStart(
 
         InitializeListHead(&tempListHead);
 
+        if (status != STATUS_ALERTED)
+            NtQueryPerformanceCounter(&passStartCounter, NULL);
+
         PhAcquireQueuedLockExclusive(&providerThread->Lock);
 
         // Main loop.
@@ -166,6 +298,12 @@ NTSTATUS NTAPI PhpProviderThreadStart(
             {
                 if (!registration->Enabled || registration->Unregistering)
                     continue;
+
+                if (!PhpIsDueProvider(providerThread, registration, &passStartCounter))
+                {
+                    registration->SkipCount++;
+                    continue;
+                }
             }
             else
             {
@@ -199,9 +337,33 @@ NTSTATUS NTAPI PhpProviderThreadStart(
             registration->RunId++;
 
             PhReleaseQueuedLockExclusive(&providerThread->Lock);
+
+            PhTraceStartEvent(&PhpProviderRunTraceEvent, &traceActivity, (ULONG_PTR)providerFunction);
+            NtQueryPerformanceCounter(&startCounter, NULL);
             providerFunction(object);
+            NtQueryPerformanceCounter(&endCounter, NULL);
+            PhTraceStopEvent(&PhpProviderRunTraceEvent, &traceActivity);
+
+            runInformation.Registration = registration;
+            runInformation.Function = providerFunction;
+            runInformation.RunTime = PhpGetElapsedProviderTime(providerThread, &startCounter, &endCounter);
+            runInformation.Overrun = runInformation.RunTime > (ULONG64)providerThread->Interval * 1000;
+            PhInvokeCallback(&providerThread->RunCompletedEvent, &runInformation);
+
             PhAcquireQueuedLockExclusive(&providerThread->Lock);
 
+            // The provider may have been unregistered (and its registration freed) while it was
+            // running. The registration is still valid if it is still the last entry in the
+            // temp list, or it was boosted and moved to the front of the main list.
+            if ((tempListHead.Blink == listEntry || providerThread->ListHead.Flink == listEntry) &&
+                !registration->Unregistering)
+            {
+                PhpUpdateStatisticsProvider(registration, runInformation.RunTime, runInformation.Overrun);
+
+                if (status != STATUS_ALERTED)
+                    PhpScheduleProvider(providerThread, registration, &passStartCounter, runInformation.RunTime);
+            }
+
             if (object)
                 PhDereferenceObject(object);
         }
@@ -224,6 +386,18 @@ NTSTATUS NTAPI PhpProviderThreadStart(
 
         PhReleaseQueuedLockExclusive(&providerThread->Lock);
 
+        // Boosts don't count towards the time taken by a full pass over the providers.
+        if (status != STATUS_ALERTED)
+        {
+            NtQueryPerformanceCounter(&endCounter, NULL);
+
+            if (PhpGetElapsedProviderTime(providerThread, &passStartCounter, &endCounter) >
+                (ULONG64)providerThread->Interval * 1000)
+            {
+                providerThread->OverrunCount++;
+            }
+        }
+
         // Perform an alertable wait so we can be woken up by
         // someone telling us to boost providers, or to terminate.
         status = NtWaitForSingleObject(
@@ -311,6 +485,37 @@ VOID PhSetIntervalProviderThread(
     }
 }
 
+/**
+ * Sets the ideal processor for a provider thread.
+ *
+ * \param ProviderThread A pointer to a provider thread object.
+ * \param IdealProcessor The zero-based number of the processor the
+ * thread should preferably run on, or PH_PROVIDER_NO_IDEAL_PROCESSOR to
+ * leave the choice to the system. The processor is in the current
+ * processor group.
+ *
+ * \remarks If the thread is not running, the ideal processor is set
+ * when the thread is started. Removing the ideal processor of a running
+ * thread has no effect until the thread is restarted.
+ */
+VOID PhSetIdealProcessorProviderThread(
+    _Inout_ PPH_PROVIDER_THREAD ProviderThread,
+    _In_ ULONG IdealProcessor
+    )
+{
+    ProviderThread->IdealProcessor = IdealProcessor;
+
+    if (ProviderThread->ThreadHandle && IdealProcessor != PH_PROVIDER_NO_IDEAL_PROCESSOR)
+    {
+        NtSetInformationThread(
+            ProviderThread->ThreadHandle,
+            ThreadIdealProcessor,
+            &IdealProcessor,
+            sizeof(ULONG)
+            );
+    }
+}
+
 /**
  * Registers a provider with a provider thread.
  *
@@ -340,6 +545,20 @@ VOID PhRegisterProvider(
     Registration->Unregistering = FALSE;
     Registration->Boosting = FALSE;
 
+    Registration->RunCount = 0;
+    Registration->OverrunCount = 0;
+    Registration->LastRunTime = 0;
+    Registration->TotalRunTime = 0;
+    Registration->MaximumRunTime = 0;
+    memset(Registration->RunTimeHistogram, 0, sizeof(Registration->RunTimeHistogram));
+
+    Registration->TargetInterval = 0;
+    Registration->Budget = 0;
+    Registration->ScheduleFlags = 0;
+    Registration->ConsumerCount = 0;
+    Registration->NextRunTime = 0;
+    Registration->SkipCount = 0;
+
     if (Object)
         PhReferenceObject(Object);
 
@@ -493,3 +712,133 @@ VOID PhSetEnabledProvider(
 {
     Registration->Enabled = Enabled;
 }
+
+/**
+ * Sets the schedule of a provider.
+ *
+ * \param Registration A pointer to the registration object for
+ * a provider.
+ * \param TargetInterval The interval between each run of the provider,
+ * in milliseconds. The provider never runs more often than its provider
+ * thread. Specify 0 to run the provider at the interval of the provider
+ * thread.
+ * \param Budget The maximum time the provider should take to run, in
+ * microseconds. If a run takes longer, the next run is deferred by the
+ * same proportion, up to PH_PROVIDER_MAXIMUM_DEFER_FACTOR times the
+ * interval. Specify 0 for no budget.
+ * \param Flags A combination of flags.
+ * \li \c PH_PROVIDER_TRACK_CONSUMERS The provider runs at
+ * PH_PROVIDER_IDLE_FACTOR times its interval while it has no consumers.
+ * See PhReferenceConsumerProvider().
+ */
+VOID PhSetScheduleProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration,
+    _In_ ULONG TargetInterval,
+    _In_ ULONG Budget,
+    _In_ ULONG Flags
+    )
+{
+    PPH_PROVIDER_THREAD providerThread;
+
+    providerThread = Registration->ProviderThread;
+
+    PhAcquireQueuedLockExclusive(&providerThread->Lock);
+    Registration->TargetInterval = TargetInterval;
+    Registration->Budget = Budget;
+    Registration->ScheduleFlags = Flags;
+    Registration->NextRunTime = 0;
+    PhReleaseQueuedLockExclusive(&providerThread->Lock);
+}
+
+/**
+ * Indicates that the results of a provider are being consumed, for
+ * example because they are visible to the user.
+ *
+ * \param Registration A pointer to the registration object for
+ * a provider.
+ *
+ * \remarks This only affects providers with the
+ * PH_PROVIDER_TRACK_CONSUMERS schedule flag. A provider which leaves its
+ * slow cadence is run at the next tick of its provider thread.
+ */
+VOID PhReferenceConsumerProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration
+    )
+{
+    PPH_PROVIDER_THREAD providerThread;
+
+    if (_InterlockedIncrement(&Registration->ConsumerCount) == 1)
+    {
+        providerThread = Registration->ProviderThread;
+
+        PhAcquireQueuedLockExclusive(&providerThread->Lock);
+        Registration->NextRunTime = 0;
+        PhReleaseQueuedLockExclusive(&providerThread->Lock);
+    }
+}
+
+/**
+ * Indicates that a consumer of a provider no longer needs its results.
+ *
+ * \param Registration A pointer to the registration object for
+ * a provider.
+ */
+VOID PhDereferenceConsumerProvider(
+    _Inout_ PPH_PROVIDER_REGISTRATION Registration
+    )
+{
+    LONG consumerCount;
+
+    consumerCount = _InterlockedDecrement(&Registration->ConsumerCount);
+    assert(consumerCount >= 0);
+}
+
+/**
+ * Gets run time statistics for a provider.
+ *
+ * \param Registration A pointer to the registration object for
+ * a provider.
+ * \param Statistics A variable which receives the statistics. All
+ * times are in microseconds.
+ *
+ * \remarks The statistics are updated by the provider thread without
+ * any synchronization with this function, so the values may be
+ * slightly inconsistent with each other.
+ */
+VOID PhGetStatisticsProvider(
+    _In_ PPH_PROVIDER_REGISTRATION Registration,
+    _Out_ PPH_PROVIDER_STATISTICS Statistics
+    )
+{
+    ULONG rank;
+    ULONG count;
+    ULONG i;
+
+    Statistics->RunCount = Registration->RunCount;
+    Statistics->OverrunCount = Registration->OverrunCount;
+    Statistics->SkipCount = Registration->SkipCount;
+    Statistics->LastRunTime = Registration->LastRunTime;
+    Statistics->AverageRunTime = Registration->RunCount != 0 ? Registration->TotalRunTime / Registration->RunCount : 0;
+    Statistics->Percentile99RunTime = 0;
+    Statistics->MaximumRunTime = Registration->MaximumRunTime;
+
+    if (Registration->RunCount != 0)
+    {
+        // Find the bucket containing the run ranked ceil(0.99 * RunCount).
+        rank = (ULONG)(((ULONG64)Registration->RunCount * 99 + 99) / 100);
+        count = 0;
+
+        for (i = 0; i < PH_PROVIDER_HISTOGRAM_SIZE; i++)
+        {
+            count += Registration->RunTimeHistogram[i];
+
+            if (count >= rank)
+                break;
+        }
+
+        if (i < PH_PROVIDER_HISTOGRAM_SIZE - 1)
+            Statistics->Percentile99RunTime = min((ULONG64)2 << i, Registration->MaximumRunTime);
+        else
+            Statistics->Percentile99RunTime = Registration->MaximumRunTime;
+    }
+}
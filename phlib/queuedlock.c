@@ -107,6 +107,10 @@ VOID FASTCALL PhpfWakeQueuedLockEx(
 static HANDLE PhQueuedLockKeyedEventHandle;
 static ULONG PhQueuedLockSpinCount = 2000;
 
+#ifdef PH_LOCK_PROFILING
+PPH_LOCK_SITE volatile PhLockSiteListHead = NULL;
+#endif
+
 BOOLEAN PhQueuedLockInitialization(
     VOID
     )
@@ -1291,3 +1295,123 @@ NTSTATUS FASTCALL PhfWaitForWakeEvent(
 
     return status;
 }
+
+#ifdef PH_LOCK_PROFILING
+
+/**
+ * Records an acquisition at a lock site.
+ *
+ * \param Site The lock site.
+ * \param WaitStartCounter The performance counter value
+ * when the thread started waiting for the lock, or NULL
+ * if the lock was acquired without contention.
+ */
+VOID FASTCALL PhfRecordLockSite(
+    _Inout_ PPH_LOCK_SITE Site,
+    _In_opt_ PLARGE_INTEGER WaitStartCounter
+    )
+{
+    if (!Site->Registered && _InterlockedExchange(&Site->Registered, TRUE) == FALSE)
+    {
+        PPH_LOCK_SITE head;
+
+        // Push the site onto the list. Sites are never removed, so this is safe without a lock.
+        do
+        {
+            head = PhLockSiteListHead;
+            Site->Next = head;
+        } while (_InterlockedCompareExchangePointer(
+            (PVOID *)&PhLockSiteListHead,
+            Site,
+            head
+            ) != head);
+    }
+
+    _InterlockedIncrement64(&Site->Acquisitions);
+
+    if (WaitStartCounter)
+    {
+        LARGE_INTEGER counter;
+        LONG64 waitTime;
+        LONG64 maximumWaitTime;
+
+        NtQueryPerformanceCounter(&counter, NULL);
+        waitTime = counter.QuadPart - WaitStartCounter->QuadPart;
+
+        _InterlockedIncrement64(&Site->Contentions);
+        _InterlockedExchangeAdd64(&Site->WaitTime, waitTime);
+
+        while (waitTime > (maximumWaitTime = Site->MaximumWaitTime))
+        {
+            if (_InterlockedCompareExchange64(&Site->MaximumWaitTime, waitTime, maximumWaitTime) == maximumWaitTime)
+                break;
+        }
+    }
+}
+
+/**
+ * Acquires a queued lock in exclusive mode and records
+ * the acquisition at the specified lock site.
+ *
+ * \param QueuedLock A queued lock.
+ * \param Site The lock site.
+ */
+VOID FASTCALL PhfProfileAcquireQueuedLockExclusive(
+    _Inout_ PPH_QUEUED_LOCK QueuedLock,
+    _Inout_ PPH_LOCK_SITE Site
+    )
+{
+    LARGE_INTEGER startCounter;
+
+    if (!_InterlockedBitTestAndSetPointer((PLONG_PTR)&QueuedLock->Value, PH_QUEUED_LOCK_OWNED_SHIFT))
+    {
+        PhfRecordLockSite(Site, NULL);
+        return;
+    }
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+    PhfAcquireQueuedLockExclusive(QueuedLock);
+    PhfRecordLockSite(Site, &startCounter);
+}
+
+/**
+ * Acquires a queued lock in shared mode and records
+ * the acquisition at the specified lock site.
+ *
+ * \param QueuedLock A queued lock.
+ * \param Site The lock site.
+ *
+ * \remarks An acquisition is only counted as contended
+ * if the lock has waiters or an exclusive owner; joining
+ * other shared owners is not contention.
+ */
+VOID FASTCALL PhfProfileAcquireQueuedLockShared(
+    _Inout_ PPH_QUEUED_LOCK QueuedLock,
+    _Inout_ PPH_LOCK_SITE Site
+    )
+{
+    ULONG_PTR value;
+    LARGE_INTEGER startCounter;
+
+    value = QueuedLock->Value;
+
+    if (!(value & PH_QUEUED_LOCK_WAITERS) &&
+        (!(value & PH_QUEUED_LOCK_OWNED) || (value >> PH_QUEUED_LOCK_SHARED_SHIFT) != 0))
+    {
+        if ((ULONG_PTR)_InterlockedCompareExchangePointer(
+            (PVOID *)&QueuedLock->Value,
+            (PVOID)((value + PH_QUEUED_LOCK_SHARED_INC) | PH_QUEUED_LOCK_OWNED),
+            (PVOID)value
+            ) == value)
+        {
+            PhfRecordLockSite(Site, NULL);
+            return;
+        }
+    }
+
+    NtQueryPerformanceCounter(&startCounter, NULL);
+    PhfAcquireQueuedLockShared(QueuedLock);
+    PhfRecordLockSite(Site, &startCounter);
+}
+
+#endif
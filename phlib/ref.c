@@ -27,13 +27,24 @@
 
 PPH_OBJECT_TYPE PhObjectTypeObject = NULL;
 SLIST_HEADER PhObjectDeferDeleteListHead;
-PH_FREE_LIST PhObjectSmallFreeList;
+PH_FREE_LIST PhObjectSizeClassFreeLists[PH_OBJECT_SIZE_CLASS_COUNT];
 PPH_OBJECT_TYPE PhAllocType = NULL;
 
 ULONG PhObjectTypeCount = 0;
 PPH_OBJECT_TYPE PhObjectTypeTable[PH_OBJECT_TYPE_TABLE_SIZE];
 
 static ULONG PhpAutoPoolTlsIndex;
+static ULONG PhpObjectThreadCacheTlsIndex;
+
+static volatile LONG PhpObjectEpoch = 0;
+static volatile LONG PhpObjectEpochReaders[2] = { 0, 0 };
+static PH_QUEUED_LOCK PhpObjectEpochLock = PH_QUEUED_LOCK_INIT;
+
+static ULONG PhpObjectSizeClassSizes[PH_OBJECT_SIZE_CLASS_COUNT] =
+{
+    PH_OBJECT_SMALL_OBJECT_SIZE, 64, 96, 128, 192, 256, 384, PH_OBJECT_SIZE_CLASS_MAXIMUM_SIZE
+};
+static UCHAR PhpObjectSizeClassIndex[PH_OBJECT_SIZE_CLASS_MAXIMUM_SIZE / 16 + 1]; // indexed by size in 16 byte units, rounded up
 
 #ifdef DEBUG
 LIST_ENTRY PhDbgObjectListHead;
@@ -51,17 +62,36 @@ NTSTATUS PhInitializeRef(
     )
 {
     PH_OBJECT_TYPE dummyObjectType;
+    ULONG i;
+    ULONG sizeClass;
 
 #ifdef DEBUG
     InitializeListHead(&PhDbgObjectListHead);
 #endif
 
     RtlInitializeSListHead(&PhObjectDeferDeleteListHead);
-    PhInitializeFreeList(
-        &PhObjectSmallFreeList,
-        PhAddObjectHeaderSize(PH_OBJECT_SMALL_OBJECT_SIZE),
-        PH_OBJECT_SMALL_OBJECT_COUNT
-        );
+
+    // Initialize the size classes. The maximum count of each free list is chosen so that
+    // each free list caches roughly the same amount of memory.
+
+    for (i = 0; i < PH_OBJECT_SIZE_CLASS_COUNT; i++)
+    {
+        PhInitializeFreeList(
+            &PhObjectSizeClassFreeLists[i],
+            PhAddObjectHeaderSize(PhpObjectSizeClassSizes[i]),
+            PH_OBJECT_SMALL_OBJECT_COUNT * PH_OBJECT_SMALL_OBJECT_SIZE / PhpObjectSizeClassSizes[i]
+            );
+    }
+
+    sizeClass = 0;
+
+    for (i = 0; i < RTL_NUMBER_OF(PhpObjectSizeClassIndex); i++)
+    {
+        while (PhpObjectSizeClassSizes[sizeClass] < i * 16)
+            sizeClass++;
+
+        PhpObjectSizeClassIndex[i] = (UCHAR)sizeClass;
+    }
 
     // Create the fundamental object type.
 
@@ -83,6 +113,17 @@ NTSTATUS PhInitializeRef(
     if (PhpAutoPoolTlsIndex == TLS_OUT_OF_INDEXES)
         return STATUS_INSUFFICIENT_RESOURCES;
 
+    // Reserve a slot for the object thread caches. The slot is read directly from the TEB
+    // because TlsGetValue clears the last error value, so the thread caches are disabled if
+    // we don't get one of the slots in the TEB.
+    PhpObjectThreadCacheTlsIndex = TlsAlloc();
+
+    if (PhpObjectThreadCacheTlsIndex != TLS_OUT_OF_INDEXES && PhpObjectThreadCacheTlsIndex >= TLS_MINIMUM_AVAILABLE)
+    {
+        TlsFree(PhpObjectThreadCacheTlsIndex);
+        PhpObjectThreadCacheTlsIndex = TLS_OUT_OF_INDEXES;
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -108,6 +149,12 @@ _May_raise_ PVOID PhCreateObject(
     // Object type statistics.
     _InterlockedIncrement((PLONG)&ObjectType->NumberOfObjects);
 
+#ifdef PH_ALLOCATION_PROFILING
+    // Objects large enough to bypass the free lists are also recorded by PhAllocate, as an
+    // allocation made by PhpAllocateObject.
+    PhfRecordAllocation(_ReturnAddress(), ObjectType->TypeIndex, ObjectSize);
+#endif
+
     // Initialize the object header.
     objectHeader->RefCount = 1;
     objectHeader->TypeIndex = ObjectType->TypeIndex;
@@ -318,6 +365,80 @@ _May_raise_ LONG PhDereferenceObjectEx(
     return newRefCount;
 }
 
+/**
+ * Enters an object epoch.
+ *
+ * \return A value to pass to PhLeaveObjectEpoch().
+ *
+ * \remarks While a thread is inside an epoch, objects freed with
+ * PhDereferenceObjectDeferDelete() are not freed. This allows a
+ * reader to follow a pointer which a writer may concurrently
+ * replace, without taking a lock, as long as the writer releases
+ * its reference to the old object using PhDereferenceObjectDeferDelete().
+ * Epochs must be short and must not be nested with blocking
+ * operations.
+ */
+ULONG PhEnterObjectEpoch(
+    VOID
+    )
+{
+    ULONG epoch;
+
+    while (TRUE)
+    {
+        epoch = PhpObjectEpoch;
+        _InterlockedIncrement(&PhpObjectEpochReaders[epoch & 1]);
+
+        // If the epoch was advanced before we were counted, the writer may not be waiting for us.
+        if (PhpObjectEpoch == epoch)
+            break;
+
+        _InterlockedDecrement(&PhpObjectEpochReaders[epoch & 1]);
+    }
+
+    return epoch;
+}
+
+/**
+ * Leaves an object epoch.
+ *
+ * \param Epoch The value returned by PhEnterObjectEpoch().
+ */
+VOID PhLeaveObjectEpoch(
+    _In_ ULONG Epoch
+    )
+{
+    _InterlockedDecrement(&PhpObjectEpochReaders[Epoch & 1]);
+}
+
+/**
+ * Waits for all threads that are inside an object epoch to leave it.
+ */
+VOID PhpSynchronizeObjectEpoch(
+    VOID
+    )
+{
+    ULONG epoch;
+    ULONG spinCount = 0;
+
+    // Advancing the epoch is serialized so that only readers of the previous epoch can still be
+    // active; new readers are counted under the other index.
+    PhAcquireQueuedLockExclusive(&PhpObjectEpochLock);
+
+    epoch = PhpObjectEpoch;
+    _InterlockedExchange(&PhpObjectEpoch, epoch + 1);
+
+    while (PhpObjectEpochReaders[epoch & 1] != 0)
+    {
+        if (++spinCount < 100)
+            YieldProcessor();
+        else
+            NtYieldExecution();
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpObjectEpochLock);
+}
+
 /**
  * Gets an object's type.
  *
@@ -439,6 +560,129 @@ VOID PhGetObjectTypeInformation(
     Information->NumberOfObjects = ObjectType->NumberOfObjects;
     Information->Flags = ObjectType->Flags;
     Information->TypeIndex = ObjectType->TypeIndex;
+    Information->Reserved = 0;
+    Information->NumberOfCacheHits = ObjectType->NumberOfCacheHits;
+    Information->NumberOfCacheMisses = ObjectType->NumberOfCacheMisses;
+}
+
+/**
+ * Gets the object cache for the current thread.
+ *
+ * \param Create TRUE to create the cache if it does not exist.
+ *
+ * \return A pointer to the cache, or NULL if the cache does not exist or thread caches are
+ * disabled.
+ */
+FORCEINLINE PPH_OBJECT_THREAD_CACHE PhpGetObjectThreadCache(
+    _In_ BOOLEAN Create
+    )
+{
+    PPH_OBJECT_THREAD_CACHE cache;
+
+    if (PhpObjectThreadCacheTlsIndex == TLS_OUT_OF_INDEXES)
+        return NULL;
+
+    cache = NtCurrentTeb()->TlsSlots[PhpObjectThreadCacheTlsIndex];
+
+    if (!cache && Create)
+    {
+        cache = PhAllocate(sizeof(PH_OBJECT_THREAD_CACHE));
+        memset(cache, 0, sizeof(PH_OBJECT_THREAD_CACHE));
+        TlsSetValue(PhpObjectThreadCacheTlsIndex, cache);
+    }
+
+    return cache;
+}
+
+/**
+ * Frees a block to the cache of the current thread.
+ *
+ * \param SizeClass The size class of the block.
+ * \param Memory A pointer to a block allocated from the size class free list.
+ */
+VOID PhpFreeToSizeClass(
+    _In_ ULONG SizeClass,
+    _In_ PVOID Memory
+    )
+{
+    PPH_OBJECT_THREAD_CACHE cache;
+    PSLIST_ENTRY listEntry;
+    ULONG i;
+
+    cache = PhpGetObjectThreadCache(TRUE);
+
+    if (!cache)
+    {
+        PhFreeToFreeList(&PhObjectSizeClassFreeLists[SizeClass], Memory);
+        REF_STAT_UP(RefObjectsFreedToSizeClassFreeList);
+        return;
+    }
+
+    if (cache->Lists[SizeClass].Count >= PH_OBJECT_THREAD_CACHE_MAXIMUM_COUNT)
+    {
+        // The list is full. Move half of it to the size class free list so that other threads
+        // can use the blocks.
+
+        for (i = 0; i < PH_OBJECT_THREAD_CACHE_MAXIMUM_COUNT / 2; i++)
+        {
+            listEntry = cache->Lists[SizeClass].ListHead;
+            cache->Lists[SizeClass].ListHead = listEntry->Next;
+            PhFreeToFreeList(
+                &PhObjectSizeClassFreeLists[SizeClass],
+                &CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry)->Body
+                );
+            REF_STAT_UP(RefObjectsFreedToSizeClassFreeList);
+        }
+
+        cache->Lists[SizeClass].Count -= PH_OBJECT_THREAD_CACHE_MAXIMUM_COUNT / 2;
+    }
+
+    listEntry = &CONTAINING_RECORD(Memory, PH_FREE_LIST_ENTRY, Body)->ListEntry;
+    listEntry->Next = cache->Lists[SizeClass].ListHead;
+    cache->Lists[SizeClass].ListHead = listEntry;
+    cache->Lists[SizeClass].Count++;
+    REF_STAT_UP(RefObjectsFreedToThreadCache);
+}
+
+/**
+ * Frees all blocks in the object cache of the current thread.
+ *
+ * \remarks Threads created using PhCreateThread() call this function automatically before
+ * they exit. Other threads that create objects should call this function before they exit,
+ * otherwise the blocks in their cache are leaked.
+ */
+VOID PhFlushObjectThreadCache(
+    VOID
+    )
+{
+    PPH_OBJECT_THREAD_CACHE cache;
+    PSLIST_ENTRY listEntry;
+    ULONG i;
+
+    cache = PhpGetObjectThreadCache(FALSE);
+
+    if (!cache)
+        return;
+
+    for (i = 0; i < PH_OBJECT_SIZE_CLASS_COUNT; i++)
+    {
+        listEntry = cache->Lists[i].ListHead;
+
+        while (listEntry)
+        {
+            PSLIST_ENTRY nextEntry = listEntry->Next;
+
+            PhFreeToFreeList(
+                &PhObjectSizeClassFreeLists[i],
+                &CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry)->Body
+                );
+            REF_STAT_UP(RefObjectsFreedToSizeClassFreeList);
+            listEntry = nextEntry;
+        }
+    }
+
+    TlsSetValue(PhpObjectThreadCacheTlsIndex, NULL);
+    PhFree(cache);
 }
 
 /**
@@ -454,7 +698,15 @@ PPH_OBJECT_HEADER PhpAllocateObject(
 {
     PPH_OBJECT_HEADER objectHeader;
 
-    if (ObjectType->Flags & PH_OBJECT_TYPE_USE_FREE_LIST)
+    if (
+        !(ObjectType->Flags & PH_OBJECT_TYPE_USE_FREE_LIST) &&
+        ObjectSize <= PH_AUTO_POOL_ARENA_MAXIMUM_OBJECT_SIZE &&
+        (objectHeader = PhpAllocateFromAutoPoolArena(ObjectSize))
+        )
+    {
+        objectHeader->Flags = PH_OBJECT_FROM_ARENA;
+    }
+    else if (ObjectType->Flags & PH_OBJECT_TYPE_USE_FREE_LIST)
     {
         assert(ObjectType->FreeList.Size == PhAddObjectHeaderSize(ObjectSize));
 
@@ -462,16 +714,38 @@ PPH_OBJECT_HEADER PhpAllocateObject(
         objectHeader->Flags = PH_OBJECT_FROM_TYPE_FREE_LIST;
         REF_STAT_UP(RefObjectsAllocatedFromTypeFreeList);
     }
-    else if (ObjectSize <= PH_OBJECT_SMALL_OBJECT_SIZE)
+    else if (ObjectSize <= PH_OBJECT_SIZE_CLASS_MAXIMUM_SIZE)
     {
-        objectHeader = PhAllocateFromFreeList(&PhObjectSmallFreeList);
-        objectHeader->Flags = PH_OBJECT_FROM_SMALL_FREE_LIST;
-        REF_STAT_UP(RefObjectsAllocatedFromSmallFreeList);
+        ULONG sizeClass;
+        PPH_OBJECT_THREAD_CACHE cache;
+        PSLIST_ENTRY listEntry;
+
+        sizeClass = PhpObjectSizeClassIndex[(ObjectSize + 15) / 16];
+        cache = PhpGetObjectThreadCache(FALSE);
+
+        if (cache && (listEntry = cache->Lists[sizeClass].ListHead))
+        {
+            cache->Lists[sizeClass].ListHead = listEntry->Next;
+            cache->Lists[sizeClass].Count--;
+            objectHeader = (PPH_OBJECT_HEADER)&CONTAINING_RECORD(listEntry, PH_FREE_LIST_ENTRY, ListEntry)->Body;
+            _InterlockedIncrement((PLONG)&ObjectType->NumberOfCacheHits);
+            REF_STAT_UP(RefObjectsAllocatedFromThreadCache);
+        }
+        else
+        {
+            objectHeader = PhAllocateFromFreeList(&PhObjectSizeClassFreeLists[sizeClass]);
+            _InterlockedIncrement((PLONG)&ObjectType->NumberOfCacheMisses);
+            REF_STAT_UP(RefObjectsAllocatedFromSizeClassFreeList);
+        }
+
+        objectHeader->Flags = PH_OBJECT_FROM_SIZE_CLASS;
+        objectHeader->SizeClass = (UCHAR)sizeClass;
     }
     else
     {
         objectHeader = PhAllocate(PhAddObjectHeaderSize(ObjectSize));
         objectHeader->Flags = 0;
+        _InterlockedIncrement((PLONG)&ObjectType->NumberOfCacheMisses);
         REF_STAT_UP(RefObjectsAllocated);
     }
 
@@ -503,6 +777,12 @@ VOID PhpFreeObject(
 
     REF_STAT_UP(RefObjectsDestroyed);
 
+    // The string intern table holds weak references; remove the object before it goes away.
+    if (ObjectHeader->Flags & PH_OBJECT_INTERNED)
+    {
+        PhpRemoveInternedString(PhObjectHeaderToObject(ObjectHeader));
+    }
+
     // Call the delete procedure if we have one.
     if (objectType->DeleteProcedure)
     {
@@ -514,10 +794,13 @@ VOID PhpFreeObject(
         PhFreeToFreeList(&objectType->FreeList, ObjectHeader);
         REF_STAT_UP(RefObjectsFreedToTypeFreeList);
     }
-    else if (ObjectHeader->Flags & PH_OBJECT_FROM_SMALL_FREE_LIST)
+    else if (ObjectHeader->Flags & PH_OBJECT_FROM_SIZE_CLASS)
     {
-        PhFreeToFreeList(&PhObjectSmallFreeList, ObjectHeader);
-        REF_STAT_UP(RefObjectsFreedToSmallFreeList);
+        PhpFreeToSizeClass(ObjectHeader->SizeClass, ObjectHeader);
+    }
+    else if (ObjectHeader->Flags & PH_OBJECT_FROM_ARENA)
+    {
+        PhpFreeToAutoPoolArena(ObjectHeader);
     }
     else
     {
@@ -562,6 +845,10 @@ NTSTATUS PhpDeferDeleteObjectRoutine(
     // Clear the list and obtain the first object to free.
     listEntry = RtlInterlockedFlushSList(&PhObjectDeferDeleteListHead);
 
+    // Readers inside an epoch may still be looking at these objects.
+    if (listEntry)
+        PhpSynchronizeObjectEpoch();
+
     while (listEntry)
     {
         objectHeader = CONTAINING_RECORD(listEntry, PH_OBJECT_HEADER, DeferDeleteListEntry);
@@ -632,11 +919,36 @@ _May_raise_ FORCEINLINE VOID PhpSetCurrentAutoPool(
 VOID PhInitializeAutoPool(
     _Out_ PPH_AUTO_POOL AutoPool
     )
+{
+    PhInitializeAutoPoolEx(AutoPool, 0);
+}
+
+/**
+ * Initializes an auto-dereference pool and sets it as the current pool
+ * for the current thread. You must call PhDeleteAutoPool() before storage
+ * for the auto-dereference pool is freed.
+ *
+ * \param AutoPool The auto-dereference pool.
+ * \param Flags A combination of flags.
+ * \li \c PH_AUTO_POOL_USE_ARENA Objects created by Pha* functions are
+ * bump-allocated from memory owned by the pool, which is reused after the
+ * pool is drained. Use this for pools that are drained frequently and
+ * produce many short-lived strings, such as message loops.
+ */
+VOID PhInitializeAutoPoolEx(
+    _Out_ PPH_AUTO_POOL AutoPool,
+    _In_ ULONG Flags
+    )
 {
     AutoPool->StaticCount = 0;
     AutoPool->DynamicCount = 0;
     AutoPool->DynamicAllocated = 0;
     AutoPool->DynamicObjects = NULL;
+    AutoPool->LocalCount = 0;
+    memset(AutoPool->LocalReferences, 0, sizeof(AutoPool->LocalReferences));
+    AutoPool->Flags = Flags;
+    AutoPool->ArenaDepth = 0;
+    AutoPool->ArenaChunk = NULL;
 
     // Add the pool to the stack.
     AutoPool->NextPool = PhpGetCurrentAutoPool();
@@ -669,6 +981,10 @@ _May_raise_ VOID PhDeleteAutoPool(
     if (AutoPool->DynamicObjects)
         PhFree(AutoPool->DynamicObjects);
 
+    // Objects that are still alive keep the chunk until they are freed.
+    if (AutoPool->ArenaChunk && _InterlockedDecrement(&AutoPool->ArenaChunk->LiveCount) == 0)
+        PhFree(AutoPool->ArenaChunk);
+
     REF_STAT_UP(RefAutoPoolsDestroyed);
 }
 
@@ -683,6 +999,29 @@ VOID PhDrainAutoPool(
 {
     ULONG i;
 
+    if (AutoPool->LocalCount != 0)
+    {
+        for (i = 0; i < PH_AUTO_POOL_LOCAL_SIZE; i++)
+        {
+            PPH_AUTO_POOL_LOCAL_REFERENCE localReference = &AutoPool->LocalReferences[i];
+
+            if (!localReference->Object)
+                continue;
+
+            // The pool holds one real reference to the object. Convert the local references
+            // that are still outstanding into real references.
+            if (localReference->Count == 0)
+                PhDereferenceObject(localReference->Object);
+            else if (localReference->Count > 1)
+                PhReferenceObjectEx(localReference->Object, localReference->Count - 1);
+
+            localReference->Object = NULL;
+            localReference->Count = 0;
+        }
+
+        AutoPool->LocalCount = 0;
+    }
+
     for (i = 0; i < AutoPool->StaticCount; i++)
         PhDereferenceObject(AutoPool->StaticObjects[i]);
 
@@ -704,6 +1043,229 @@ VOID PhDrainAutoPool(
             AutoPool->DynamicObjects = NULL;
         }
     }
+
+    if (AutoPool->ArenaChunk)
+    {
+        PPH_AUTO_POOL_ARENA_CHUNK chunk = AutoPool->ArenaChunk;
+
+        // Only this thread allocates from the chunk, so if nothing else is alive the count
+        // can't change under us.
+        if (chunk->LiveCount == 1)
+        {
+            chunk->Used = 0;
+        }
+        else
+        {
+            AutoPool->ArenaChunk = NULL;
+
+            if (_InterlockedDecrement(&chunk->LiveCount) == 0)
+                PhFree(chunk);
+        }
+    }
+}
+
+/**
+ * Starts allocating objects from the arena of the current auto-dereference pool.
+ *
+ * \return The pool, which must be passed to PhEndAutoPoolArena().
+ *
+ * \remarks Only objects that are added to the pool should be created in
+ * this state, since they keep arena memory alive until they are freed.
+ */
+PPH_AUTO_POOL PhBeginAutoPoolArena(
+    VOID
+    )
+{
+    PPH_AUTO_POOL autoPool = PhpGetCurrentAutoPool();
+
+    if (autoPool && (autoPool->Flags & PH_AUTO_POOL_USE_ARENA))
+    {
+        autoPool->ArenaDepth++;
+        return autoPool;
+    }
+
+    return NULL;
+}
+
+/**
+ * Stops allocating objects from the arena of an auto-dereference pool.
+ *
+ * \param AutoPool The value returned by PhBeginAutoPoolArena().
+ */
+VOID PhEndAutoPoolArena(
+    _In_opt_ PPH_AUTO_POOL AutoPool
+    )
+{
+    if (AutoPool)
+        AutoPool->ArenaDepth--;
+}
+
+/**
+ * Allocates storage for an object from the arena of the current
+ * auto-dereference pool.
+ *
+ * \param ObjectSize The size of the object, excluding the header.
+ *
+ * \return The object header, or NULL if arena allocation is not active.
+ */
+PPH_OBJECT_HEADER PhpAllocateFromAutoPoolArena(
+    _In_ SIZE_T ObjectSize
+    )
+{
+    PPH_AUTO_POOL autoPool;
+    PPH_AUTO_POOL_ARENA_CHUNK chunk;
+    SIZE_T blockSize;
+    PPH_AUTO_POOL_ARENA_CHUNK *block;
+
+    autoPool = PhpGetCurrentAutoPool();
+
+    if (!autoPool || autoPool->ArenaDepth == 0)
+        return NULL;
+
+    blockSize = ALIGN_UP_BY(sizeof(QUAD_PTR) + PhAddObjectHeaderSize(ObjectSize), MEMORY_ALLOCATION_ALIGNMENT);
+    chunk = autoPool->ArenaChunk;
+
+    if (!chunk || chunk->Used + blockSize > PH_AUTO_POOL_ARENA_DATA_SIZE)
+    {
+        if (chunk)
+        {
+            if (chunk->LiveCount == 1)
+            {
+                chunk->Used = 0;
+                goto AllocateBlock;
+            }
+
+            if (_InterlockedDecrement(&chunk->LiveCount) == 0)
+                PhFree(chunk);
+        }
+
+        chunk = PhAllocate(PH_AUTO_POOL_ARENA_CHUNK_SIZE);
+        chunk->LiveCount = 1;
+        chunk->Used = 0;
+        autoPool->ArenaChunk = chunk;
+    }
+
+AllocateBlock:
+    block = (PPH_AUTO_POOL_ARENA_CHUNK *)((PCHAR)chunk + PH_AUTO_POOL_ARENA_DATA_OFFSET + chunk->Used);
+    chunk->Used += (ULONG)blockSize;
+    _InterlockedIncrement(&chunk->LiveCount);
+    *block = chunk;
+
+    return (PPH_OBJECT_HEADER)((PCHAR)block + sizeof(QUAD_PTR));
+}
+
+/**
+ * Frees storage for an object allocated from an auto-dereference pool arena.
+ *
+ * \param ObjectHeader The object header.
+ *
+ * \remarks This function may be called from any thread.
+ */
+VOID PhpFreeToAutoPoolArena(
+    _In_ PPH_OBJECT_HEADER ObjectHeader
+    )
+{
+    PPH_AUTO_POOL_ARENA_CHUNK chunk;
+
+    chunk = *(PPH_AUTO_POOL_ARENA_CHUNK *)((PCHAR)ObjectHeader - sizeof(QUAD_PTR));
+
+    if (_InterlockedDecrement(&chunk->LiveCount) == 0)
+        PhFree(chunk);
+}
+
+FORCEINLINE PPH_AUTO_POOL_LOCAL_REFERENCE PhpFindLocalReferenceAutoPool(
+    _In_ PPH_AUTO_POOL AutoPool,
+    _In_ PVOID Object,
+    _In_ BOOLEAN Create
+    )
+{
+    ULONG index;
+    ULONG i;
+
+    index = (ULONG)((ULONG_PTR)Object >> 4);
+
+    for (i = 0; i < PH_AUTO_POOL_LOCAL_SIZE; i++)
+    {
+        PPH_AUTO_POOL_LOCAL_REFERENCE localReference;
+
+        localReference = &AutoPool->LocalReferences[(index + i) & (PH_AUTO_POOL_LOCAL_SIZE - 1)];
+
+        if (localReference->Object == Object)
+            return localReference;
+
+        // Entries are never removed before the pool is drained, so an empty entry ends the probe.
+        if (!localReference->Object)
+        {
+            if (!Create)
+                return NULL;
+
+            // Take the real reference that backs all local references to the object.
+            PhReferenceObject(Object);
+            localReference->Object = Object;
+            localReference->Count = 0;
+            AutoPool->LocalCount++;
+
+            return localReference;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * References an object without modifying the object's reference count, if possible.
+ *
+ * \param Object A pointer to the object to reference.
+ *
+ * \remarks The first local reference to an object takes a real reference, which is kept
+ * by the current auto-dereference pool until the pool is drained. Further local references
+ * and PhDereferenceObjectLocal() only update a count in the pool, so repeatedly referencing and
+ * dereferencing the same objects on one thread (e.g. while painting or sorting) does not
+ * need interlocked operations on shared memory. The object is not freed before the pool is
+ * drained even if all references to it are released. If the current thread does not have
+ * an auto-dereference pool, this function behaves like PhReferenceObject().
+ */
+VOID PhReferenceObjectLocal(
+    _In_ PVOID Object
+    )
+{
+    PPH_AUTO_POOL autoPool = PhpGetCurrentAutoPool();
+    PPH_AUTO_POOL_LOCAL_REFERENCE localReference;
+
+    if (autoPool && (localReference = PhpFindLocalReferenceAutoPool(autoPool, Object, TRUE)))
+        localReference->Count++;
+    else
+        PhReferenceObject(Object);
+}
+
+/**
+ * Dereferences an object that was referenced using PhReferenceObjectLocal().
+ *
+ * \param Object A pointer to the object to dereference.
+ *
+ * \remarks This function must be called on the same thread as PhReferenceObjectLocal().
+ * References are interchangeable, so an object referenced with PhReferenceObject() may also
+ * be dereferenced with this function.
+ */
+VOID PhDereferenceObjectLocal(
+    _In_ PVOID Object
+    )
+{
+    PPH_AUTO_POOL autoPool = PhpGetCurrentAutoPool();
+    PPH_AUTO_POOL_LOCAL_REFERENCE localReference;
+
+    if (
+        autoPool &&
+        (localReference = PhpFindLocalReferenceAutoPool(autoPool, Object, FALSE)) &&
+        localReference->Count > 0
+        )
+    {
+        localReference->Count--;
+    }
+    else
+    {
+        PhDereferenceObject(Object);
+    }
 }
 
 /**
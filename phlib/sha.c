@@ -21,6 +21,9 @@
 
 #include <phbase.h>
 #include <sha.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 /* SHA1 Helper Macros */
 
@@ -88,6 +91,146 @@ static void SHATransform(ULONG State[5], UCHAR Buffer[64])
    a = b = c = d = e = 0;
 }
 
+#if defined(_M_IX86) || defined(_M_X64)
+
+/* Hash whole 512-bit blocks using the SHA extensions. */
+static void SHATransformShaNi(ULONG State[5], const UCHAR *Data, ULONG Length)
+{
+   __m128i abcd, abcdSave, e0, e1, e0Save, mask, tmp;
+   __m128i msg[4];
+   ULONG i;
+
+   mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+   abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)State), 0x1B);
+   e0 = _mm_set_epi32(State[4], 0, 0, 0);
+
+   while (Length >= 64)
+   {
+      abcdSave = abcd;
+      e0Save = e0;
+
+      for (i = 0; i < 4; i++)
+         msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Data + i * 16)), mask);
+
+      /* Each iteration is 4 rounds. The message schedule for rounds
+         16-79 is computed in the 4 registers as they are consumed. */
+      e0 = _mm_add_epi32(e0, msg[0]);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+      for (i = 1; i < 20; i++)
+      {
+         if (i & 1)
+         {
+            e1 = _mm_sha1nexte_epu32(e1, msg[i & 3]);
+            e0 = abcd;
+         }
+         else
+         {
+            e0 = _mm_sha1nexte_epu32(e0, msg[i & 3]);
+            e1 = abcd;
+         }
+
+         if (i >= 3 && i <= 18)
+            msg[(i + 1) & 3] = _mm_sha1msg2_epu32(msg[(i + 1) & 3], msg[i & 3]);
+
+         /* The round function constant must be an immediate. */
+         tmp = (i & 1) ? e1 : e0;
+
+         switch (i / 5)
+         {
+         case 0:
+            abcd = _mm_sha1rnds4_epu32(abcd, tmp, 0);
+            break;
+         case 1:
+            abcd = _mm_sha1rnds4_epu32(abcd, tmp, 1);
+            break;
+         case 2:
+            abcd = _mm_sha1rnds4_epu32(abcd, tmp, 2);
+            break;
+         default:
+            abcd = _mm_sha1rnds4_epu32(abcd, tmp, 3);
+            break;
+         }
+
+         if (i <= 16)
+            msg[(i + 3) & 3] = _mm_sha1msg1_epu32(msg[(i + 3) & 3], msg[i & 3]);
+         if (i >= 2 && i <= 17)
+            msg[(i + 2) & 3] = _mm_xor_si128(msg[(i + 2) & 3], msg[i & 3]);
+      }
+
+      e0 = _mm_sha1nexte_epu32(e0, e0Save);
+      abcd = _mm_add_epi32(abcd, abcdSave);
+
+      Data += 64;
+      Length -= 64;
+   }
+
+   _mm_storeu_si128((__m128i *)State, _mm_shuffle_epi32(abcd, 0x1B));
+   State[4] = _mm_extract_epi32(e0, 3);
+}
+
+#endif
+
+/* Returns TRUE if the processor implements the SHA extensions. */
+BOOLEAN A_SHAHasHardwareSupport(
+    VOID
+    )
+{
+   static PH_INITONCE initOnce = PH_INITONCE_INIT;
+   static BOOLEAN supported = FALSE;
+
+   if (PhBeginInitOnce(&initOnce))
+   {
+#if defined(_M_IX86) || defined(_M_X64)
+      INT cpuInfo[4];
+
+      __cpuid(cpuInfo, 0);
+
+      if (cpuInfo[0] >= 7)
+      {
+         /* SHA (CPUID.7.0:EBX[29]) is only usable together with
+            SSSE3 (CPUID.1:ECX[9]) and SSE4.1 (CPUID.1:ECX[19]). */
+         __cpuid(cpuInfo, 1);
+
+         if ((cpuInfo[2] & (1 << 9)) && (cpuInfo[2] & (1 << 19)))
+         {
+            __cpuidex(cpuInfo, 7, 0);
+
+            if (cpuInfo[1] & (1 << 29))
+               supported = TRUE;
+         }
+      }
+#endif
+      PhEndInitOnce(&initOnce);
+   }
+
+   return supported;
+}
+
+/* Hash whole 512-bit blocks. Length must be a multiple of 64. */
+static void SHATransformBlocks(ULONG State[5], const UCHAR *Data, ULONG Length)
+{
+   UCHAR Block[64];
+
+#if defined(_M_IX86) || defined(_M_X64)
+   if (A_SHAHasHardwareSupport())
+   {
+      SHATransformShaNi(State, Data, Length);
+      return;
+   }
+#endif
+
+   /* SHATransform modifies its input. */
+   while (Length >= 64)
+   {
+      RtlCopyMemory(Block, Data, 64);
+      SHATransform(State, Block);
+      Data += 64;
+      Length -= 64;
+   }
+}
+
 VOID A_SHAInit(
     _Out_ A_SHA_CTX *Context
     )
@@ -123,16 +266,24 @@ VOID A_SHAUpdate(
    }
    else
    {
-      while (InputContentSize + Length >= 64)
+      ULONG BlocksLength;
+
+      if (InputContentSize != 0)
       {
          RtlCopyMemory(Context->buffer + InputContentSize, Input,
                        64 - InputContentSize);
          Input += 64 - InputContentSize;
          Length -= 64 - InputContentSize;
-         SHATransform(Context->state, Context->buffer);
-         InputContentSize = 0;
+         SHATransformBlocks(Context->state, Context->buffer, 64);
       }
-      RtlCopyMemory(Context->buffer + InputContentSize, Input, Length);
+
+      /* Hash whole blocks straight from the input. */
+      BlocksLength = Length & ~63;
+      SHATransformBlocks(Context->state, Input, BlocksLength);
+      Input += BlocksLength;
+      Length -= BlocksLength;
+
+      RtlCopyMemory(Context->buffer, Input, Length);
    }
 }
 
@@ -0,0 +1,292 @@
+/*
+ * Process Hacker -
+ *   SHA-256 hash
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SHA-256 as specified in FIPS 180-4. Whole blocks are hashed with the
+ * SHA extensions when the processor has them; see A_SHAHasHardwareSupport.
+ */
+
+#include <phbase.h>
+#include <sha.h>
+#include <sha256.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#define ROTR(x, n) (_rotr((x), (n)))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define EP1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static DECLSPEC_ALIGN(16) const ULONG SHA256K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static VOID SHA256TransformPortable(
+    _Inout_ ULONG State[8],
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ ULONG Length
+    )
+{
+    ULONG w[64];
+    ULONG a, b, c, d, e, f, g, h;
+    ULONG t1, t2;
+    ULONG i;
+
+    while (Length >= 64)
+    {
+        for (i = 0; i < 16; i++)
+        {
+            w[i] = ((ULONG)Data[i * 4] << 24) | ((ULONG)Data[i * 4 + 1] << 16) |
+                ((ULONG)Data[i * 4 + 2] << 8) | (ULONG)Data[i * 4 + 3];
+        }
+
+        for (i = 16; i < 64; i++)
+            w[i] = SIG1(w[i - 2]) + w[i - 7] + SIG0(w[i - 15]) + w[i - 16];
+
+        a = State[0];
+        b = State[1];
+        c = State[2];
+        d = State[3];
+        e = State[4];
+        f = State[5];
+        g = State[6];
+        h = State[7];
+
+        for (i = 0; i < 64; i++)
+        {
+            t1 = h + EP1(e) + CH(e, f, g) + SHA256K[i] + w[i];
+            t2 = EP0(a) + MAJ(a, b, c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        State[0] += a;
+        State[1] += b;
+        State[2] += c;
+        State[3] += d;
+        State[4] += e;
+        State[5] += f;
+        State[6] += g;
+        State[7] += h;
+
+        Data += 64;
+        Length -= 64;
+    }
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+static VOID SHA256TransformShaNi(
+    _Inout_ ULONG State[8],
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ ULONG Length
+    )
+{
+    __m128i state0, state1, state0Save, state1Save;
+    __m128i mask, message, tmp;
+    __m128i msg[4];
+    ULONG i;
+
+    mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Convert the state from ABCD/EFGH to the ABEF/CDGH layout used by the instructions.
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&State[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&State[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (Length >= 64)
+    {
+        state0Save = state0;
+        state1Save = state1;
+
+        for (i = 0; i < 4; i++)
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Data + i * 16)), mask);
+
+        // Each iteration is 4 rounds. The message schedule for rounds 16-63
+        // is computed in the 4 registers as they are consumed.
+        for (i = 0; i < 16; i++)
+        {
+            message = _mm_add_epi32(msg[i & 3], _mm_load_si128((const __m128i *)&SHA256K[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+
+            if (i >= 3 && i <= 14)
+            {
+                tmp = _mm_alignr_epi8(msg[i & 3], msg[(i + 3) & 3], 4);
+                msg[(i + 1) & 3] = _mm_add_epi32(msg[(i + 1) & 3], tmp);
+                msg[(i + 1) & 3] = _mm_sha256msg2_epu32(msg[(i + 1) & 3], msg[i & 3]);
+            }
+
+            message = _mm_shuffle_epi32(message, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+
+            if (i >= 1 && i <= 12)
+                msg[(i + 3) & 3] = _mm_sha256msg1_epu32(msg[(i + 3) & 3], msg[i & 3]);
+        }
+
+        state0 = _mm_add_epi32(state0, state0Save);
+        state1 = _mm_add_epi32(state1, state1Save);
+
+        Data += 64;
+        Length -= 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i *)&State[0], state0);
+    _mm_storeu_si128((__m128i *)&State[4], state1);
+}
+
+#endif
+
+// Length must be a multiple of 64.
+static VOID SHA256Transform(
+    _Inout_ ULONG State[8],
+    _In_reads_bytes_(Length) const UCHAR *Data,
+    _In_ ULONG Length
+    )
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    if (A_SHAHasHardwareSupport())
+    {
+        SHA256TransformShaNi(State, Data, Length);
+        return;
+    }
+#endif
+
+    SHA256TransformPortable(State, Data, Length);
+}
+
+VOID SHA256Init(
+    _Out_ SHA256_CTX *Context
+    )
+{
+    Context->state[0] = 0x6a09e667;
+    Context->state[1] = 0xbb67ae85;
+    Context->state[2] = 0x3c6ef372;
+    Context->state[3] = 0xa54ff53a;
+    Context->state[4] = 0x510e527f;
+    Context->state[5] = 0x9b05688c;
+    Context->state[6] = 0x1f83d9ab;
+    Context->state[7] = 0x5be0cd19;
+    Context->count[0] = 0;
+    Context->count[1] = 0;
+}
+
+VOID SHA256Update(
+    _Inout_ SHA256_CTX *Context,
+    _In_reads_bytes_(Length) UCHAR *Input,
+    _In_ ULONG Length
+    )
+{
+    ULONG bufferLength;
+    ULONG blocksLength;
+
+    // count[0] is the high part of the byte count, count[1] is the low part.
+    bufferLength = Context->count[1] & 63;
+    Context->count[1] += Length;
+
+    if (Context->count[1] < Length)
+        Context->count[0]++;
+
+    if (bufferLength + Length < 64)
+    {
+        memcpy(&Context->buffer[bufferLength], Input, Length);
+        return;
+    }
+
+    if (bufferLength != 0)
+    {
+        memcpy(&Context->buffer[bufferLength], Input, 64 - bufferLength);
+        Input += 64 - bufferLength;
+        Length -= 64 - bufferLength;
+        SHA256Transform(Context->state, Context->buffer, 64);
+    }
+
+    // Hash whole blocks straight from the input.
+    blocksLength = Length & ~63;
+    SHA256Transform(Context->state, Input, blocksLength);
+    Input += blocksLength;
+    Length -= blocksLength;
+
+    memcpy(Context->buffer, Input, Length);
+}
+
+VOID SHA256Final(
+    _Inout_ SHA256_CTX *Context,
+    _Out_writes_bytes_(32) UCHAR *Hash
+    )
+{
+    UCHAR padding[72];
+    ULONG bufferLength;
+    ULONG paddingLength;
+    ULONG lengthHigh;
+    ULONG lengthLow;
+    ULONG i;
+
+    bufferLength = Context->count[1] & 63;
+    paddingLength = bufferLength < 56 ? 56 - bufferLength : 120 - bufferLength;
+
+    // Message length in bits, big-endian.
+    lengthHigh = (Context->count[0] << 3) | (Context->count[1] >> 29);
+    lengthLow = Context->count[1] << 3;
+
+    memset(padding, 0, paddingLength);
+    padding[0] = 0x80;
+
+    for (i = 0; i < 4; i++)
+    {
+        padding[paddingLength + i] = (UCHAR)(lengthHigh >> (24 - i * 8));
+        padding[paddingLength + 4 + i] = (UCHAR)(lengthLow >> (24 - i * 8));
+    }
+
+    SHA256Update(Context, padding, paddingLength + 8);
+
+    for (i = 0; i < 8; i++)
+    {
+        Hash[i * 4] = (UCHAR)(Context->state[i] >> 24);
+        Hash[i * 4 + 1] = (UCHAR)(Context->state[i] >> 16);
+        Hash[i * 4 + 2] = (UCHAR)(Context->state[i] >> 8);
+        Hash[i * 4 + 3] = (UCHAR)Context->state[i];
+    }
+
+    SHA256Init(Context);
+}
@@ -25,6 +25,8 @@
 #include <winsta.h>
 #include <md5.h>
 #include <sha.h>
+#include <sha256.h>
+#include <filepool.h>
 
 // We may want to change this for debugging purposes.
 #define PHP_USE_IFILEDIALOG (WINDOWS_HAS_IFILEDIALOG)
@@ -1232,17 +1234,59 @@ PPH_STRING PhFormatDateTime(
     return string;
 }
 
+static VOID PhpAppendTimeSpanUnit(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ ULONG Value,
+    _In_ PWSTR Singular,
+    _In_ PWSTR Plural,
+    _In_ BOOLEAN Leading
+    )
+{
+    PH_FORMAT format[3];
+
+    if (Leading && Value == 1)
+    {
+        // Turn 1 into "a", e.g. 1 minute -> a minute
+        // Special vowel case: a hour -> an hour
+        PhInitFormatS(&format[0], Singular[0] != 'h' ? L"a " : L"an ");
+        PhInitFormatS(&format[1], Singular);
+        PhAppendFormatFixedStringBuilder(StringBuilder, format, 2);
+    }
+    else
+    {
+        PhInitFormatU(&format[0], Value);
+        PhInitFormatC(&format[1], ' ');
+        PhInitFormatS(&format[2], Value == 1 ? Singular : Plural);
+        PhAppendFormatFixedStringBuilder(StringBuilder, format, 3);
+    }
+}
+
+static VOID PhpAppendTimeSpanUnitPartial(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
+    _In_ ULONG Value,
+    _In_ PWSTR Singular,
+    _In_ PWSTR Plural
+    )
+{
+    if (Value >= 1)
+    {
+        PhAppendFixedStringBuilder2(StringBuilder, L" and ");
+        PhpAppendTimeSpanUnit(StringBuilder, Value, Singular, Plural, FALSE);
+    }
+}
+
 /**
- * Formats a relative time span.
+ * Formats a relative time span into a fixed string builder.
  *
+ * \param StringBuilder A fixed string builder object. A buffer of
+ * PH_TIMESPAN_RELATIVE_STR_LEN_1 characters is always large enough.
  * \param TimeSpan The time span, in ticks.
  */
-PPH_STRING PhFormatTimeSpanRelative(
+VOID PhFormatTimeSpanRelativeToBuilder(
+    _Inout_ PPH_FIXED_STRING_BUILDER StringBuilder,
     _In_ ULONG64 TimeSpan
     )
 {
-    PH_AUTO_POOL autoPool;
-    PPH_STRING string;
     DOUBLE days;
     DOUBLE weeks;
     DOUBLE fortnights;
@@ -1250,8 +1294,6 @@ PPH_STRING PhFormatTimeSpanRelative(
     DOUBLE years;
     DOUBLE centuries;
 
-    PhInitializeAutoPool(&autoPool);
-
     days = (DOUBLE)TimeSpan / PH_TICKS_PER_DAY;
     weeks = days / 7;
     fortnights = weeks / 2;
@@ -1261,23 +1303,23 @@ PPH_STRING PhFormatTimeSpanRelative(
 
     if (centuries >= 1)
     {
-        string = PhaFormatString(L"%u %s", (ULONG)centuries, (ULONG)centuries == 1 ? L"century" : L"centuries");
+        PhpAppendTimeSpanUnit(StringBuilder, (ULONG)centuries, L"century", L"centuries", TRUE);
     }
     else if (years >= 1)
     {
-        string = PhaFormatString(L"%u %s", (ULONG)years, (ULONG)years == 1 ? L"year" : L"years");
+        PhpAppendTimeSpanUnit(StringBuilder, (ULONG)years, L"year", L"years", TRUE);
     }
     else if (months >= 1)
     {
-        string = PhaFormatString(L"%u %s", (ULONG)months, (ULONG)months == 1 ? L"month" : L"months");
+        PhpAppendTimeSpanUnit(StringBuilder, (ULONG)months, L"month", L"months", TRUE);
     }
     else if (fortnights >= 1)
     {
-        string = PhaFormatString(L"%u %s", (ULONG)fortnights, (ULONG)fortnights == 1 ? L"fortnight" : L"fortnights");
+        PhpAppendTimeSpanUnit(StringBuilder, (ULONG)fortnights, L"fortnight", L"fortnights", TRUE);
     }
     else if (weeks >= 1)
     {
-        string = PhaFormatString(L"%u %s", (ULONG)weeks, (ULONG)weeks == 1 ? L"week" : L"weeks");
+        PhpAppendTimeSpanUnit(StringBuilder, (ULONG)weeks, L"week", L"weeks", TRUE);
     }
     else
     {
@@ -1285,9 +1327,6 @@ PPH_STRING PhFormatTimeSpanRelative(
         DOUBLE seconds;
         DOUBLE minutes;
         DOUBLE hours;
-        ULONG secondsPartial;
-        ULONG minutesPartial;
-        ULONG hoursPartial;
 
         milliseconds = (DOUBLE)TimeSpan / PH_TICKS_PER_MS;
         seconds = (DOUBLE)TimeSpan / PH_TICKS_PER_SEC;
@@ -1296,62 +1335,50 @@ PPH_STRING PhFormatTimeSpanRelative(
 
         if (days >= 1)
         {
-            string = PhaFormatString(L"%u %s", (ULONG)days, (ULONG)days == 1 ? L"day" : L"days");
-            hoursPartial = (ULONG)PH_TICKS_PARTIAL_HOURS(TimeSpan);
-
-            if (hoursPartial >= 1)
-            {
-                string = PhaFormatString(L"%s and %u %s", string->Buffer, hoursPartial, hoursPartial == 1 ? L"hour" : L"hours");
-            }
+            PhpAppendTimeSpanUnit(StringBuilder, (ULONG)days, L"day", L"days", TRUE);
+            PhpAppendTimeSpanUnitPartial(StringBuilder, (ULONG)PH_TICKS_PARTIAL_HOURS(TimeSpan), L"hour", L"hours");
         }
         else if (hours >= 1)
         {
-            string = PhaFormatString(L"%u %s", (ULONG)hours, (ULONG)hours == 1 ? L"hour" : L"hours");
-            minutesPartial = (ULONG)PH_TICKS_PARTIAL_MIN(TimeSpan);
-
-            if (minutesPartial >= 1)
-            {
-                string = PhaFormatString(L"%s and %u %s", string->Buffer, (ULONG)minutesPartial, (ULONG)minutesPartial == 1 ? L"minute" : L"minutes");
-            }
+            PhpAppendTimeSpanUnit(StringBuilder, (ULONG)hours, L"hour", L"hours", TRUE);
+            PhpAppendTimeSpanUnitPartial(StringBuilder, (ULONG)PH_TICKS_PARTIAL_MIN(TimeSpan), L"minute", L"minutes");
         }
         else if (minutes >= 1)
         {
-            string = PhaFormatString(L"%u %s", (ULONG)minutes, (ULONG)minutes == 1 ? L"minute" : L"minutes");
-            secondsPartial = (ULONG)PH_TICKS_PARTIAL_SEC(TimeSpan);
-
-            if (secondsPartial >= 1)
-            {
-                string = PhaFormatString(L"%s and %u %s", string->Buffer, (ULONG)secondsPartial, (ULONG)secondsPartial == 1 ? L"second" : L"seconds");
-            }
+            PhpAppendTimeSpanUnit(StringBuilder, (ULONG)minutes, L"minute", L"minutes", TRUE);
+            PhpAppendTimeSpanUnitPartial(StringBuilder, (ULONG)PH_TICKS_PARTIAL_SEC(TimeSpan), L"second", L"seconds");
         }
         else if (seconds >= 1)
         {
-            string = PhaFormatString(L"%u %s", (ULONG)seconds, (ULONG)seconds == 1 ? L"second" : L"seconds");
+            PhpAppendTimeSpanUnit(StringBuilder, (ULONG)seconds, L"second", L"seconds", TRUE);
         }
         else if (milliseconds >= 1)
         {
-            string = PhaFormatString(L"%u %s", (ULONG)milliseconds, (ULONG)milliseconds == 1 ? L"millisecond" : L"milliseconds");
+            PhpAppendTimeSpanUnit(StringBuilder, (ULONG)milliseconds, L"millisecond", L"milliseconds", TRUE);
         }
         else
         {
-            string = PhaCreateString(L"a very short time");
+            PhAppendFixedStringBuilder2(StringBuilder, L"a very short time");
         }
     }
+}
 
-    // Turn 1 into "a", e.g. 1 minute -> a minute
-    if (PhStartsWithString2(string, L"1 ", FALSE))
-    {
-        // Special vowel case: a hour -> an hour
-        if (string->Buffer[2] != 'h')
-            string = PhaConcatStrings2(L"a ", &string->Buffer[2]);
-        else
-            string = PhaConcatStrings2(L"an ", &string->Buffer[2]);
-    }
+/**
+ * Formats a relative time span.
+ *
+ * \param TimeSpan The time span, in ticks.
+ */
+PPH_STRING PhFormatTimeSpanRelative(
+    _In_ ULONG64 TimeSpan
+    )
+{
+    PH_FIXED_STRING_BUILDER stringBuilder;
+    WCHAR buffer[PH_TIMESPAN_RELATIVE_STR_LEN_1];
 
-    PhReferenceObject(string);
-    PhDeleteAutoPool(&autoPool);
+    PhInitializeFixedStringBuilder(&stringBuilder, buffer, sizeof(buffer));
+    PhFormatTimeSpanRelativeToBuilder(&stringBuilder, TimeSpan);
 
-    return string;
+    return PhCreateString2(&stringBuilder.String);
 }
 
 /**
@@ -1365,12 +1392,12 @@ PPH_STRING PhFormatUInt64(
     _In_ BOOLEAN GroupDigits
     )
 {
-    PH_FORMAT format;
+    WCHAR buffer[PH_INT64_STR_LEN_1];
+    SIZE_T returnLength;
 
-    format.Type = UInt64FormatType | (GroupDigits ? FormatGroupDigits : 0);
-    format.u.UInt64 = Value;
+    PhFormatUInt64ToBuffer(Value, GroupDigits, buffer, sizeof(buffer), &returnLength);
 
-    return PhFormat(&format, 1, 0);
+    return PhCreateStringEx(buffer, returnLength - sizeof(WCHAR));
 }
 
 PPH_STRING PhFormatDecimal(
@@ -1444,15 +1471,12 @@ PPH_STRING PhFormatSize(
     _In_ ULONG MaxSizeUnit
     )
 {
-    PH_FORMAT format;
-
-    // PhFormat handles this better than the old method.
+    WCHAR buffer[PH_INT64_STR_LEN_1];
+    SIZE_T returnLength;
 
-    format.Type = SizeFormatType | FormatUseRadix;
-    format.Radix = (UCHAR)(MaxSizeUnit != -1 ? MaxSizeUnit : PhMaxSizeUnit);
-    format.u.Size = Size;
+    PhFormatSizeToBuffer(Size, MaxSizeUnit, buffer, sizeof(buffer), &returnLength);
 
-    return PhFormat(&format, 1, 0);
+    return PhCreateStringEx(buffer, returnLength - sizeof(WCHAR));
 }
 
 /**
@@ -4405,6 +4429,7 @@ ULONG PhCrc32(
 
 C_ASSERT(RTL_FIELD_SIZE(PH_HASH_CONTEXT, Context) >= sizeof(MD5_CTX));
 C_ASSERT(RTL_FIELD_SIZE(PH_HASH_CONTEXT, Context) >= sizeof(A_SHA_CTX));
+C_ASSERT(RTL_FIELD_SIZE(PH_HASH_CONTEXT, Context) >= sizeof(SHA256_CTX));
 
 /**
  * Initializes hashing.
@@ -4414,6 +4439,7 @@ C_ASSERT(RTL_FIELD_SIZE(PH_HASH_CONTEXT, Context) >= sizeof(A_SHA_CTX));
  * \li \c Md5HashAlgorithm MD5 (128 bits)
  * \li \c Sha1HashAlgorithm SHA-1 (160 bits)
  * \li \c Crc32HashAlgorithm CRC-32-IEEE 802.3 (32 bits)
+ * \li \c Sha256HashAlgorithm SHA-256 (256 bits)
  */
 VOID PhInitializeHash(
     _Out_ PPH_HASH_CONTEXT Context,
@@ -4433,6 +4459,9 @@ VOID PhInitializeHash(
     case Crc32HashAlgorithm:
         Context->Context[0] = 0;
         break;
+    case Sha256HashAlgorithm:
+        SHA256Init((SHA256_CTX *)Context->Context);
+        break;
     default:
         PhRaiseStatus(STATUS_INVALID_PARAMETER_2);
         break;
@@ -4463,6 +4492,9 @@ VOID PhUpdateHash(
     case Crc32HashAlgorithm:
         Context->Context[0] = PhCrc32(Context->Context[0], (PUCHAR)Buffer, Length);
         break;
+    case Sha256HashAlgorithm:
+        SHA256Update((SHA256_CTX *)Context->Context, (PUCHAR)Buffer, Length);
+        break;
     default:
         PhRaiseStatus(STATUS_INVALID_PARAMETER);
     }
@@ -4521,6 +4553,16 @@ BOOLEAN PhFinalHash(
 
         returnLength = 4;
 
+        break;
+    case Sha256HashAlgorithm:
+        if (HashLength >= 32)
+        {
+            SHA256Final((SHA256_CTX *)Context->Context, (PUCHAR)Hash);
+            result = TRUE;
+        }
+
+        returnLength = 32;
+
         break;
     default:
         PhRaiseStatus(STATUS_INVALID_PARAMETER);
@@ -4532,6 +4574,607 @@ BOOLEAN PhFinalHash(
     return result;
 }
 
+#define PH_HASH_FILE_BUFFER_SIZE (1024 * 1024)
+
+typedef struct _PH_HASH_FILE_WORKER
+{
+    PPH_HASH_CONTEXT Contexts;
+    ULONG NumberOfContexts;
+
+    HANDLE StartEventHandle;
+    HANDLE CompletedEventHandle;
+    PVOID Buffer;
+    ULONG Length; // 0 tells the worker to exit
+} PH_HASH_FILE_WORKER, *PPH_HASH_FILE_WORKER;
+
+static VOID PhpUpdateHashes(
+    _Inout_updates_(NumberOfContexts) PPH_HASH_CONTEXT Contexts,
+    _In_ ULONG NumberOfContexts,
+    _In_reads_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Length
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < NumberOfContexts; i++)
+        PhUpdateHash(&Contexts[i], Buffer, Length);
+}
+
+static NTSTATUS PhpHashFileWorkerThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_HASH_FILE_WORKER worker = Parameter;
+
+    while (TRUE)
+    {
+        NtWaitForSingleObject(worker->StartEventHandle, FALSE, NULL);
+
+        if (worker->Length == 0)
+            break;
+
+        PhpUpdateHashes(worker->Contexts, worker->NumberOfContexts, worker->Buffer, worker->Length);
+        NtSetEvent(worker->CompletedEventHandle, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS PhpReadHashFileBlock(
+    _In_ HANDLE FileHandle,
+    _Out_writes_bytes_(PH_HASH_FILE_BUFFER_SIZE) PVOID Buffer,
+    _In_ PLARGE_INTEGER Offset,
+    _Out_ PULONG ReturnLength
+    )
+{
+    NTSTATUS status;
+    IO_STATUS_BLOCK isb;
+
+    status = NtReadFile(
+        FileHandle,
+        NULL,
+        NULL,
+        NULL,
+        &isb,
+        Buffer,
+        PH_HASH_FILE_BUFFER_SIZE,
+        Offset,
+        NULL
+        );
+
+    if (status == STATUS_PENDING)
+    {
+        // The handle was opened for asynchronous I/O.
+        status = NtWaitForSingleObject(FileHandle, FALSE, NULL);
+
+        if (NT_SUCCESS(status))
+            status = isb.Status;
+    }
+
+    if (status == STATUS_END_OF_FILE)
+    {
+        *ReturnLength = 0;
+        return STATUS_SUCCESS;
+    }
+
+    if (NT_SUCCESS(status))
+        *ReturnLength = (ULONG)isb.Information;
+
+    return status;
+}
+
+/**
+ * Hashes the contents of a file.
+ *
+ * \param FileHandle A handle to a file. The handle must have FILE_READ_DATA access.
+ * \param Contexts An array of hashing contexts initialized using PhInitializeHash(). All
+ * contexts are updated in a single pass over the file.
+ * \param NumberOfContexts The number of elements in \a Contexts.
+ *
+ * \remarks The file is read from the beginning using large reads. Once the file is
+ * larger than one read, the next block is read while the previous block is being
+ * hashed on a separate thread. Call PhFinalHash() on each context to get the results.
+ */
+NTSTATUS PhHashFile(
+    _In_ HANDLE FileHandle,
+    _Inout_updates_(NumberOfContexts) PPH_HASH_CONTEXT Contexts,
+    _In_ ULONG NumberOfContexts
+    )
+{
+    NTSTATUS status;
+    PVOID buffers[2];
+    ULONG index;
+    ULONG length;
+    LARGE_INTEGER offset;
+    PH_HASH_FILE_WORKER worker;
+    HANDLE workerThreadHandle;
+    BOOLEAN workerBusy;
+
+    buffers[0] = PhAllocatePage(PH_HASH_FILE_BUFFER_SIZE, NULL);
+    buffers[1] = PhAllocatePage(PH_HASH_FILE_BUFFER_SIZE, NULL);
+
+    if (!buffers[0] || !buffers[1])
+    {
+        PhFreePage(buffers[0]);
+        PhFreePage(buffers[1]);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    memset(&worker, 0, sizeof(PH_HASH_FILE_WORKER));
+    worker.Contexts = Contexts;
+    worker.NumberOfContexts = NumberOfContexts;
+    workerThreadHandle = NULL;
+    workerBusy = FALSE;
+
+    index = 0;
+    offset.QuadPart = 0;
+
+    while (TRUE)
+    {
+        status = PhpReadHashFileBlock(FileHandle, buffers[index], &offset, &length);
+
+        // The worker must be done with the other buffer before we hand it this one.
+        if (workerBusy)
+        {
+            NtWaitForSingleObject(worker.CompletedEventHandle, FALSE, NULL);
+            workerBusy = FALSE;
+        }
+
+        if (!NT_SUCCESS(status) || length == 0)
+            break;
+
+        // Small files are hashed inline. Start the worker once a full block has been read.
+        if (!workerThreadHandle && length == PH_HASH_FILE_BUFFER_SIZE && !worker.StartEventHandle)
+        {
+            if (
+                NT_SUCCESS(NtCreateEvent(&worker.StartEventHandle, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE)) &&
+                NT_SUCCESS(NtCreateEvent(&worker.CompletedEventHandle, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE))
+                )
+            {
+                workerThreadHandle = PhCreateThread(0, PhpHashFileWorkerThreadStart, &worker);
+            }
+        }
+
+        if (workerThreadHandle)
+        {
+            worker.Buffer = buffers[index];
+            worker.Length = length;
+            NtSetEvent(worker.StartEventHandle, NULL);
+            workerBusy = TRUE;
+        }
+        else
+        {
+            PhpUpdateHashes(Contexts, NumberOfContexts, buffers[index], length);
+        }
+
+        offset.QuadPart += length;
+        index ^= 1;
+    }
+
+    if (workerThreadHandle)
+    {
+        worker.Length = 0;
+        NtSetEvent(worker.StartEventHandle, NULL);
+        NtWaitForSingleObject(workerThreadHandle, FALSE, NULL);
+        NtClose(workerThreadHandle);
+    }
+
+    if (worker.StartEventHandle)
+        NtClose(worker.StartEventHandle);
+    if (worker.CompletedEventHandle)
+        NtClose(worker.CompletedEventHandle);
+
+    PhFreePage(buffers[0]);
+    PhFreePage(buffers[1]);
+
+    return status;
+}
+
+#define PH_FILE_HASH_CACHE_MAXIMUM_ENTRIES 4096
+// Hashes don't go stale while the file is unchanged, but records for files that were deleted or
+// modified are never matched again.
+#define PH_FILE_HASH_CACHE_STORE_MAXIMUM_AGE (30 * PH_TICKS_PER_DAY)
+
+typedef struct _PH_FILE_HASH_CACHE_KEY
+{
+    ULONG VolumeSerialNumber;
+    ULONG Kind;
+    LARGE_INTEGER FileId;
+    LARGE_INTEGER EndOfFile;
+    LARGE_INTEGER LastWriteTime;
+} PH_FILE_HASH_CACHE_KEY, *PPH_FILE_HASH_CACHE_KEY;
+
+typedef struct _PH_FILE_HASH_CACHE_ENTRY
+{
+    PH_FILE_HASH_CACHE_KEY Key;
+    ULONG HashLength;
+    UCHAR Hash[PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH];
+} PH_FILE_HASH_CACHE_ENTRY, *PPH_FILE_HASH_CACHE_ENTRY;
+
+// Records are kept in a singly-linked list ordered from newest to oldest. The RVA of the first
+// record is stored in the low part of the user context of the file pool.
+typedef struct _PH_FILE_HASH_CACHE_STORE_RECORD
+{
+    ULONG NextRva;
+    ULONG Size;
+    LARGE_INTEGER StoreTime;
+    PH_FILE_HASH_CACHE_ENTRY Entry;
+} PH_FILE_HASH_CACHE_STORE_RECORD, *PPH_FILE_HASH_CACHE_STORE_RECORD;
+
+static PH_INITONCE PhpFileHashCacheInitOnce = PH_INITONCE_INIT;
+static PPH_HASHTABLE PhpFileHashCacheHashtable = NULL;
+static PH_QUEUED_LOCK PhpFileHashCacheLock = PH_QUEUED_LOCK_INIT;
+// The store is protected by PhpFileHashCacheLock.
+static PPH_FILE_POOL PhpFileHashCacheStore = NULL;
+static ULONG PhpFileHashCacheStoreCount;
+
+static BOOLEAN NTAPI PhpFileHashCacheCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return memcmp(
+        &((PPH_FILE_HASH_CACHE_ENTRY)Entry1)->Key,
+        &((PPH_FILE_HASH_CACHE_ENTRY)Entry2)->Key,
+        sizeof(PH_FILE_HASH_CACHE_KEY)
+        ) == 0;
+}
+
+static ULONG NTAPI PhpFileHashCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_FILE_HASH_CACHE_KEY key = &((PPH_FILE_HASH_CACHE_ENTRY)Entry)->Key;
+
+    return PhHashInt64(key->FileId.QuadPart) ^ PhHashInt64(key->LastWriteTime.QuadPart) ^
+        PhHashInt32(key->VolumeSerialNumber) ^ key->Kind;
+}
+
+static VOID PhpFileHashCacheInitialization(
+    VOID
+    )
+{
+    if (PhBeginInitOnce(&PhpFileHashCacheInitOnce))
+    {
+        PhpFileHashCacheHashtable = PhCreateHashtable(
+            sizeof(PH_FILE_HASH_CACHE_ENTRY),
+            PhpFileHashCacheCompareFunction,
+            PhpFileHashCacheHashFunction,
+            64
+            );
+        PhEndInitOnce(&PhpFileHashCacheInitOnce);
+    }
+}
+
+static NTSTATUS PhpGetFileHashCacheKey(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Kind,
+    _Out_ PPH_FILE_HASH_CACHE_KEY Key
+    )
+{
+    NTSTATUS status;
+    IO_STATUS_BLOCK isb;
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+    FILE_INTERNAL_INFORMATION internalInfo;
+    FILE_FS_VOLUME_INFORMATION volumeInfo;
+
+    if (!NT_SUCCESS(status = NtQueryInformationFile(
+        FileHandle,
+        &isb,
+        &networkOpenInfo,
+        sizeof(FILE_NETWORK_OPEN_INFORMATION),
+        FileNetworkOpenInformation
+        )))
+        return status;
+
+    if (!NT_SUCCESS(status = NtQueryInformationFile(
+        FileHandle,
+        &isb,
+        &internalInfo,
+        sizeof(FILE_INTERNAL_INFORMATION),
+        FileInternalInformation
+        )))
+        return status;
+
+    // The volume label doesn't fit, but we only need the serial number.
+    status = NtQueryVolumeInformationFile(
+        FileHandle,
+        &isb,
+        &volumeInfo,
+        sizeof(FILE_FS_VOLUME_INFORMATION),
+        FileFsVolumeInformation
+        );
+
+    if (!NT_SUCCESS(status) && status != STATUS_BUFFER_OVERFLOW)
+        return status;
+
+    memset(Key, 0, sizeof(PH_FILE_HASH_CACHE_KEY));
+    Key->VolumeSerialNumber = volumeInfo.VolumeSerialNumber;
+    Key->Kind = Kind;
+    Key->FileId = internalInfo.IndexNumber;
+    Key->EndOfFile = networkOpenInfo.EndOfFile;
+    Key->LastWriteTime = networkOpenInfo.LastWriteTime;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Adds a record to the file hash store. The cache lock must be held exclusively.
+ */
+static VOID PhpAddFileHashCacheStoreRecord(
+    _In_ PPH_FILE_HASH_CACHE_ENTRY Entry
+    )
+{
+    ULONGLONG userContext;
+    PPH_FILE_HASH_CACHE_STORE_RECORD record;
+    ULONG rva;
+
+    record = PhAllocateFilePool(PhpFileHashCacheStore, sizeof(PH_FILE_HASH_CACHE_STORE_RECORD), &rva);
+
+    if (!record)
+        return;
+
+    PhGetUserContextFilePool(PhpFileHashCacheStore, &userContext);
+
+    record->NextRva = (ULONG)userContext;
+    record->Size = sizeof(PH_FILE_HASH_CACHE_STORE_RECORD);
+    PhQuerySystemTime(&record->StoreTime);
+    record->Entry = *Entry;
+
+    PhDereferenceFilePool(PhpFileHashCacheStore, record);
+
+    userContext = ((ULONGLONG)PH_FILE_HASH_CACHE_STORE_MAGIC << 32) | rva;
+    PhSetUserContextFilePool(PhpFileHashCacheStore, &userContext);
+    PhpFileHashCacheStoreCount++;
+}
+
+/**
+ * Finds a previously computed hash of a file.
+ *
+ * \param FileHandle A handle to a file. The handle must have FILE_READ_ATTRIBUTES access.
+ * \param Kind The kind of hash. This is a PH_HASH_ALGORITHM value or one of the
+ * PH_FILE_HASH_* values.
+ * \param Hash A buffer which receives the hash.
+ * \param HashLength The size of the buffer, in bytes.
+ * \param ReturnLength A variable which receives the length of the hash, in bytes.
+ *
+ * \return TRUE if the hash was found in the cache, otherwise FALSE.
+ *
+ * \remarks Hashes are cached by file ID, size and last write time, so a cached hash is
+ * not used once the file has been modified. If the application has set a store with
+ * PhSetFileHashCacheStore, hashes computed in previous sessions are also found.
+ */
+BOOLEAN PhFindFileHashCache(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Kind,
+    _Out_writes_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    PH_FILE_HASH_CACHE_ENTRY lookupEntry;
+    PPH_FILE_HASH_CACHE_ENTRY entry;
+    BOOLEAN found;
+
+    if (!PhpFileHashCacheHashtable)
+        return FALSE;
+    if (!NT_SUCCESS(PhpGetFileHashCacheKey(FileHandle, Kind, &lookupEntry.Key)))
+        return FALSE;
+
+    found = FALSE;
+
+    PhAcquireQueuedLockShared(&PhpFileHashCacheLock);
+
+    entry = PhFindEntryHashtable(PhpFileHashCacheHashtable, &lookupEntry);
+
+    if (entry && entry->HashLength <= HashLength)
+    {
+        memcpy(Hash, entry->Hash, entry->HashLength);
+
+        if (ReturnLength)
+            *ReturnLength = entry->HashLength;
+
+        found = TRUE;
+    }
+
+    PhReleaseQueuedLockShared(&PhpFileHashCacheLock);
+
+    return found;
+}
+
+/**
+ * Adds the hash of a file to the cache.
+ *
+ * \param FileHandle A handle to the file that was hashed. The handle must have
+ * FILE_READ_ATTRIBUTES access.
+ * \param Kind The kind of hash. This is a PH_HASH_ALGORITHM value or one of the
+ * PH_FILE_HASH_* values.
+ * \param Hash The hash.
+ * \param HashLength The length of the hash, in bytes. This cannot be larger than
+ * PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH.
+ */
+VOID PhAddFileHashCache(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Kind,
+    _In_reads_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength
+    )
+{
+    PH_FILE_HASH_CACHE_ENTRY entry;
+    PPH_FILE_HASH_CACHE_ENTRY existingEntry;
+    BOOLEAN added;
+
+    if (HashLength > PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH)
+        return;
+    if (!NT_SUCCESS(PhpGetFileHashCacheKey(FileHandle, Kind, &entry.Key)))
+        return;
+
+    PhpFileHashCacheInitialization();
+
+    entry.HashLength = HashLength;
+    memset(entry.Hash, 0, sizeof(entry.Hash));
+    memcpy(entry.Hash, Hash, HashLength);
+
+    PhAcquireQueuedLockExclusive(&PhpFileHashCacheLock);
+
+    // Keep the cache bounded. Entries for files that have changed are never looked up again.
+    if (PhpFileHashCacheHashtable->Count >= PH_FILE_HASH_CACHE_MAXIMUM_ENTRIES)
+        PhClearHashtable(PhpFileHashCacheHashtable);
+
+    existingEntry = PhAddEntryHashtableEx(PhpFileHashCacheHashtable, &entry, &added);
+
+    if (added || existingEntry->HashLength != entry.HashLength || memcmp(existingEntry->Hash, entry.Hash, HashLength) != 0)
+    {
+        *existingEntry = entry;
+
+        // The store is pruned when it is loaded, so it only needs a limit for long sessions.
+        if (PhpFileHashCacheStore && PhpFileHashCacheStoreCount < PH_FILE_HASH_CACHE_MAXIMUM_ENTRIES * 2)
+            PhpAddFileHashCacheStoreRecord(&entry);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpFileHashCacheLock);
+}
+
+/**
+ * Loads previously computed hashes from a file pool and saves new hashes to it.
+ *
+ * \param Pool The file pool. The high part of its user context must already identify it as a
+ * file hash store (PH_FILE_HASH_CACHE_STORE_MAGIC); the store is empty if the low part is 0.
+ * The pool is owned by the cache after this call.
+ *
+ * \remarks Records that are too old, malformed or beyond the cache limit are removed from the
+ * store. Hashes added to the cache before this function is called are not saved.
+ */
+VOID PhSetFileHashCacheStore(
+    _In_ struct _PH_FILE_POOL *Pool
+    )
+{
+    ULONGLONG userContext;
+    LARGE_INTEGER currentTime;
+    PPH_FILE_HASH_CACHE_STORE_RECORD previousRecord;
+    PPH_FILE_HASH_CACHE_STORE_RECORD record;
+    ULONG rva;
+    ULONG count;
+
+    PhpFileHashCacheInitialization();
+
+    PhGetUserContextFilePool(Pool, &userContext);
+    PhQuerySystemTime(&currentTime);
+    previousRecord = NULL;
+    rva = (ULONG)userContext;
+    count = 0;
+
+    PhAcquireQueuedLockExclusive(&PhpFileHashCacheLock);
+
+    assert(!PhpFileHashCacheStore);
+
+    while (record = PhReferenceFilePoolByRva(Pool, rva))
+    {
+        ULONG nextRva;
+        BOOLEAN valid;
+
+        nextRva = record->NextRva;
+        valid = FALSE;
+
+        if (
+            record->Size == sizeof(PH_FILE_HASH_CACHE_STORE_RECORD) &&
+            record->Entry.HashLength != 0 &&
+            record->Entry.HashLength <= PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH &&
+            record->StoreTime.QuadPart <= currentTime.QuadPart &&
+            currentTime.QuadPart - record->StoreTime.QuadPart < PH_FILE_HASH_CACHE_STORE_MAXIMUM_AGE &&
+            count < PH_FILE_HASH_CACHE_MAXIMUM_ENTRIES
+            )
+        {
+            // Newer records come first, so a duplicate key is an outdated record.
+            PhAddEntryHashtableEx(PhpFileHashCacheHashtable, &record->Entry, &valid);
+        }
+
+        if (valid)
+        {
+            if (previousRecord)
+                PhDereferenceFilePool(Pool, previousRecord);
+
+            previousRecord = record;
+            count++;
+        }
+        else
+        {
+            // Unlink and free the record.
+
+            if (previousRecord)
+            {
+                previousRecord->NextRva = nextRva;
+            }
+            else
+            {
+                userContext = ((ULONGLONG)PH_FILE_HASH_CACHE_STORE_MAGIC << 32) | nextRva;
+                PhSetUserContextFilePool(Pool, &userContext);
+            }
+
+            PhFreeFilePool(Pool, record);
+        }
+
+        rva = nextRva;
+    }
+
+    if (previousRecord)
+        PhDereferenceFilePool(Pool, previousRecord);
+
+    PhpFileHashCacheStore = Pool;
+    PhpFileHashCacheStoreCount = count;
+
+    PhReleaseQueuedLockExclusive(&PhpFileHashCacheLock);
+}
+
+/**
+ * Hashes the contents of a file, using the file hash cache.
+ *
+ * \param FileHandle A handle to a file. The handle must have FILE_READ_DATA and
+ * FILE_READ_ATTRIBUTES access.
+ * \param Algorithm The hash algorithm to use.
+ * \param Hash A buffer which receives the hash.
+ * \param HashLength The size of the buffer, in bytes.
+ * \param ReturnLength A variable which receives the length of the hash, in bytes.
+ *
+ * \remarks The file is only read if it has not been hashed using this algorithm
+ * since it was last modified.
+ */
+NTSTATUS PhHashFileCached(
+    _In_ HANDLE FileHandle,
+    _In_ PH_HASH_ALGORITHM Algorithm,
+    _Out_writes_bytes_(HashLength) PVOID Hash,
+    _In_ ULONG HashLength,
+    _Out_opt_ PULONG ReturnLength
+    )
+{
+    NTSTATUS status;
+    PH_HASH_CONTEXT hashContext;
+    ULONG returnLength;
+
+    if (PhFindFileHashCache(FileHandle, Algorithm, Hash, HashLength, ReturnLength))
+        return STATUS_SUCCESS;
+
+    PhInitializeHash(&hashContext, Algorithm);
+
+    if (!NT_SUCCESS(status = PhHashFile(FileHandle, &hashContext, 1)))
+        return status;
+
+    if (!PhFinalHash(&hashContext, Hash, HashLength, &returnLength))
+    {
+        if (ReturnLength)
+            *ReturnLength = returnLength;
+
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    PhAddFileHashCache(FileHandle, Algorithm, Hash, returnLength);
+
+    if (ReturnLength)
+        *ReturnLength = returnLength;
+
+    return STATUS_SUCCESS;
+}
+
 /**
  * Parses one part of a command line string. Quotation marks and
  * backslashes are handled appropriately.
@@ -30,6 +30,37 @@
 
 #include <symprv.h>
 #include <symprvp.h>
+#include <tracelog.h>
+
+// These are from cvconst.h.
+#define PH_SYMTAG_FUNCTION 5
+#define PH_SYMTAG_PUBLIC_SYMBOL 10
+
+typedef struct _PH_SYMBOL_TABLE_ENTRY
+{
+    ULONG Rva;
+    ULONG Tag;
+    ULONG NameOffset; // In characters
+    ULONG NameLength; // In characters
+} PH_SYMBOL_TABLE_ENTRY, *PPH_SYMBOL_TABLE_ENTRY;
+
+// A symbol table is immutable once it has been built, so it can be searched without locks.
+typedef struct _PH_SYMBOL_TABLE
+{
+    ULONG Count;
+    PPH_SYMBOL_TABLE_ENTRY Entries; // Sorted by RVA
+    PPH_BYTES EntriesBuffer;
+    PPH_STRING Names;
+} PH_SYMBOL_TABLE, *PPH_SYMBOL_TABLE;
+
+#ifdef _WIN64
+// An unwind table is immutable once it has been built, so it can be searched without locks.
+typedef struct _PH_UNWIND_TABLE
+{
+    ULONG Count;
+    PRUNTIME_FUNCTION Functions; // Sorted by BeginAddress
+} PH_UNWIND_TABLE, *PPH_UNWIND_TABLE;
+#endif
 
 typedef struct _PH_SYMBOL_MODULE
 {
@@ -39,8 +70,35 @@ typedef struct _PH_SYMBOL_MODULE
     ULONG Size;
     PPH_STRING FileName;
     ULONG BaseNameIndex;
+
+    PH_INITONCE SymbolTableInitOnce;
+    PPH_SYMBOL_TABLE SymbolTable;
+    BOOLEAN PdbPrefetched; // claimed by PhPrefetchSymbolProvider
+#ifdef _WIN64
+    PH_INITONCE UnwindTableInitOnce;
+    PPH_UNWIND_TABLE UnwindTable;
+#endif
 } PH_SYMBOL_MODULE, *PPH_SYMBOL_MODULE;
 
+typedef struct _PH_SYMBOL_TABLE_BUILD_CONTEXT
+{
+    ULONG64 BaseAddress;
+    ULONG Size;
+    PH_BYTES_BUILDER Entries;
+    PH_STRING_BUILDER Names;
+} PH_SYMBOL_TABLE_BUILD_CONTEXT, *PPH_SYMBOL_TABLE_BUILD_CONTEXT;
+
+typedef struct _PH_SYMBOL_CACHE_ENTRY
+{
+    ULONG64 Address;
+    ULONG Generation;
+    PH_SYMBOL_RESOLVE_LEVEL ResolveLevel;
+    PPH_STRING Symbol;
+    PPH_STRING FileName;
+    PPH_STRING SymbolName;
+    ULONG64 Displacement;
+} PH_SYMBOL_CACHE_ENTRY, *PPH_SYMBOL_CACHE_ENTRY;
+
 VOID NTAPI PhpSymbolProviderDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
@@ -54,6 +112,14 @@ VOID PhpFreeSymbolModule(
     _In_ PPH_SYMBOL_MODULE SymbolModule
     );
 
+VOID PhpClearSymbolCache(
+    _In_ PPH_HASHTABLE SymbolCache
+    );
+
+VOID PhpInvalidateSymbolCache(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
+    );
+
 LONG NTAPI PhpSymbolModuleCompareFunction(
     _In_ PPH_AVL_LINKS Links1,
     _In_ PPH_AVL_LINKS Links2
@@ -66,10 +132,16 @@ DECLSPEC_SELECTANY PH_CALLBACK_DECLARE(PhSymInitCallback);
 
 static HANDLE PhNextFakeHandle = (HANDLE)0;
 static PH_FAST_LOCK PhSymMutex = PH_FAST_LOCK_INIT;
+static ULONG PhSymOptionsGeneration = 0; // Symbol options are global, so they invalidate every cache
 
 #define PH_LOCK_SYMBOLS() PhAcquireFastLockExclusive(&PhSymMutex)
 #define PH_UNLOCK_SYMBOLS() PhReleaseFastLockExclusive(&PhSymMutex)
 
+// Modules are usually loaded with deferred symbol loading, in which case the PDB is loaded when
+// the symbol table of the module is created.
+PH_TRACE_EVENT_DECLARE(PhpSymbolModuleLoadTraceEvent, "SymbolModuleLoad", PH_TRACE_KEYWORD_SYMBOLS, "FileName", PhTraceFieldUnicodeString);
+PH_TRACE_EVENT_DECLARE(PhpSymbolTableCreateTraceEvent, "SymbolTableCreate", PH_TRACE_KEYWORD_SYMBOLS, "FileName", PhTraceFieldUnicodeString);
+
 _SymInitialize SymInitialize_I;
 _SymCleanup SymCleanup_I;
 _SymEnumSymbols SymEnumSymbols_I;
@@ -96,6 +168,7 @@ _StackWalk64 StackWalk64_I;
 _MiniDumpWriteDump MiniDumpWriteDump_I;
 _SymbolServerGetOptions SymbolServerGetOptions;
 _SymbolServerSetOptions SymbolServerSetOptions;
+_SymbolServerW SymbolServerW_I;
 
 BOOLEAN PhSymbolProviderInitialization(
     VOID
@@ -150,6 +223,7 @@ VOID PhSymbolProviderCompleteInitialization(
     MiniDumpWriteDump_I = (PVOID)GetProcAddress(dbghelpHandle, "MiniDumpWriteDump");
     SymbolServerGetOptions = (PVOID)GetProcAddress(symsrvHandle, "SymbolServerGetOptions");
     SymbolServerSetOptions = (PVOID)GetProcAddress(symsrvHandle, "SymbolServerSetOptions");
+    SymbolServerW_I = (PVOID)GetProcAddress(symsrvHandle, "SymbolServerW");
 
     if (SymGetOptions_I && SymSetOptions_I)
         SymSetOptions_I(SymGetOptions_I() | SYMOPT_DEFERRED_LOADS | SYMOPT_FAVOR_COMPRESSED);
@@ -165,6 +239,7 @@ PPH_SYMBOL_PROVIDER PhCreateSymbolProvider(
     memset(symbolProvider, 0, sizeof(PH_SYMBOL_PROVIDER));
     InitializeListHead(&symbolProvider->ModulesListHead);
     PhInitializeQueuedLock(&symbolProvider->ModulesListLock);
+    PhInitializeQueuedLock(&symbolProvider->SymbolCacheLock);
     PhInitializeAvlTree(&symbolProvider->ModulesSet, PhpSymbolModuleCompareFunction);
     PhInitializeCallback(&symbolProvider->EventCallback);
     PhInitializeInitOnce(&symbolProvider->InitOnce);
@@ -216,6 +291,12 @@ VOID NTAPI PhpSymbolProviderDeleteProcedure(
 
     PhDeleteCallback(&symbolProvider->EventCallback);
 
+    if (symbolProvider->SymbolCache)
+    {
+        PhpClearSymbolCache(symbolProvider->SymbolCache);
+        PhDereferenceObject(symbolProvider->SymbolCache);
+    }
+
     if (SymCleanup_I)
     {
         PH_LOCK_SYMBOLS();
@@ -266,6 +347,9 @@ BOOL CALLBACK PhpSymbolCallbackFunction(
     PPH_SYMBOL_EVENT_DATA data;
     PIMAGEHLP_DEFERRED_SYMBOL_LOADW64 callbackData;
 
+    if (ActionCode == SymbolSymbolsUnloaded)
+        PhpInvalidateSymbolCache(symbolProvider);
+
     if (!IsListEmpty(&symbolProvider->EventCallback.ListHead))
     {
         switch (ActionCode)
@@ -337,6 +421,21 @@ VOID PhpFreeSymbolModule(
 {
     if (SymbolModule->FileName) PhDereferenceObject(SymbolModule->FileName);
 
+    if (SymbolModule->SymbolTable)
+    {
+        PhDereferenceObject(SymbolModule->SymbolTable->EntriesBuffer);
+        PhDereferenceObject(SymbolModule->SymbolTable->Names);
+        PhFree(SymbolModule->SymbolTable);
+    }
+
+#ifdef _WIN64
+    if (SymbolModule->UnwindTable)
+    {
+        PhFree(SymbolModule->UnwindTable->Functions);
+        PhFree(SymbolModule->UnwindTable);
+    }
+#endif
+
     PhFree(SymbolModule);
 }
 
@@ -425,22 +524,17 @@ BOOLEAN PhGetLineFromAddress(
     return TRUE;
 }
 
-ULONG64 PhGetModuleFromAddress(
+PPH_SYMBOL_MODULE PhpFindSymbolModule(
     _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
-    _In_ ULONG64 Address,
-    _Out_opt_ PPH_STRING *FileName
+    _In_ ULONG64 Address
     )
 {
     PH_SYMBOL_MODULE lookupModule;
     PPH_AVL_LINKS links;
     PPH_SYMBOL_MODULE module;
     LONG result;
-    PPH_STRING foundFileName;
-    ULONG64 foundBaseAddress;
 
     module = NULL;
-    foundFileName = NULL;
-    foundBaseAddress = 0;
 
     // Do an approximate search on the modules set to locate the module with the largest
     // base address that is still smaller than the given address.
@@ -480,14 +574,36 @@ ULONG64 PhGetModuleFromAddress(
         // No modules loaded.
     }
 
-    if (module && Address < module->BaseAddress + module->Size)
+    if (module && Address >= module->BaseAddress + module->Size)
+        module = NULL;
+
+    PhReleaseQueuedLockShared(&SymbolProvider->ModulesListLock);
+
+    // Modules are only freed along with the provider, so the pointer stays valid.
+    return module;
+}
+
+ULONG64 PhGetModuleFromAddress(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG64 Address,
+    _Out_opt_ PPH_STRING *FileName
+    )
+{
+    PPH_SYMBOL_MODULE module;
+    PPH_STRING foundFileName;
+    ULONG64 foundBaseAddress;
+
+    foundFileName = NULL;
+    foundBaseAddress = 0;
+
+    module = PhpFindSymbolModule(SymbolProvider, Address);
+
+    if (module)
     {
         PhSetReference(&foundFileName, module->FileName);
         foundBaseAddress = module->BaseAddress;
     }
 
-    PhReleaseQueuedLockShared(&SymbolProvider->ModulesListLock);
-
     if (foundFileName)
     {
         if (FileName)
@@ -503,6 +619,191 @@ ULONG64 PhGetModuleFromAddress(
     return foundBaseAddress;
 }
 
+static BOOL CALLBACK PhpSymbolTableEnumCallback(
+    _In_ PSYMBOL_INFOW SymbolInfo,
+    _In_ ULONG SymbolSize,
+    _In_opt_ PVOID UserContext
+    )
+{
+    PPH_SYMBOL_TABLE_BUILD_CONTEXT context = UserContext;
+    PH_SYMBOL_TABLE_ENTRY entry;
+
+    if (SymbolInfo->Tag != PH_SYMTAG_FUNCTION && SymbolInfo->Tag != PH_SYMTAG_PUBLIC_SYMBOL)
+        return TRUE;
+    if (SymbolInfo->Address < context->BaseAddress || SymbolInfo->Address - context->BaseAddress >= context->Size)
+        return TRUE;
+    if (SymbolInfo->NameLen == 0)
+        return TRUE;
+
+    entry.Rva = (ULONG)(SymbolInfo->Address - context->BaseAddress);
+    entry.Tag = SymbolInfo->Tag;
+    entry.NameOffset = (ULONG)(context->Names.String->Length / sizeof(WCHAR));
+    entry.NameLength = SymbolInfo->NameLen;
+
+    PhAppendStringBuilderEx(&context->Names, SymbolInfo->Name, SymbolInfo->NameLen * sizeof(WCHAR));
+    PhAppendBytesBuilderEx(&context->Entries, &entry, sizeof(PH_SYMBOL_TABLE_ENTRY), 0, NULL);
+
+    return TRUE;
+}
+
+static int __cdecl PhpSymbolTableEntryCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_SYMBOL_TABLE_ENTRY entry1 = (PPH_SYMBOL_TABLE_ENTRY)elem1;
+    PPH_SYMBOL_TABLE_ENTRY entry2 = (PPH_SYMBOL_TABLE_ENTRY)elem2;
+    int result;
+
+    result = uintcmp(entry1->Rva, entry2->Rva);
+
+    // Functions sort before public symbols at the same address; see below.
+    if (result == 0)
+        result = uintcmp(entry1->Tag, entry2->Tag);
+
+    return result;
+}
+
+PPH_SYMBOL_TABLE PhpCreateSymbolTable(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ PPH_SYMBOL_MODULE SymbolModule
+    )
+{
+    PH_SYMBOL_TABLE_BUILD_CONTEXT context;
+    PPH_SYMBOL_TABLE symbolTable;
+    PPH_SYMBOL_TABLE_ENTRY entries;
+    ULONG count;
+    ULONG i;
+    ULONG j;
+    BOOL result;
+
+    if (!SymEnumSymbolsW_I)
+        return NULL;
+
+    context.BaseAddress = SymbolModule->BaseAddress;
+    context.Size = SymbolModule->Size;
+    PhInitializeBytesBuilder(&context.Entries, 0x1000 * sizeof(PH_SYMBOL_TABLE_ENTRY));
+    PhInitializeStringBuilder(&context.Names, 0x10000);
+
+    // This forces the symbols for the module to be loaded, which would have happened on the first
+    // SymFromAddr call anyway.
+    PH_LOCK_SYMBOLS();
+    result = SymEnumSymbolsW_I(
+        SymbolProvider->ProcessHandle,
+        SymbolModule->BaseAddress,
+        NULL,
+        PhpSymbolTableEnumCallback,
+        &context
+        );
+    PH_UNLOCK_SYMBOLS();
+
+    if (!result)
+    {
+        PhDeleteBytesBuilder(&context.Entries);
+        PhDeleteStringBuilder(&context.Names);
+        return NULL;
+    }
+
+    symbolTable = PhAllocate(sizeof(PH_SYMBOL_TABLE));
+    symbolTable->EntriesBuffer = PhFinalBytesBuilderBytes(&context.Entries);
+    symbolTable->Names = PhFinalStringBuilderString(&context.Names);
+
+    entries = (PPH_SYMBOL_TABLE_ENTRY)symbolTable->EntriesBuffer->Buffer;
+    count = (ULONG)(symbolTable->EntriesBuffer->Length / sizeof(PH_SYMBOL_TABLE_ENTRY));
+    qsort(entries, count, sizeof(PH_SYMBOL_TABLE_ENTRY), PhpSymbolTableEntryCompare);
+
+    // Remove duplicate addresses, keeping the first (function) entry for each.
+    for (i = 0, j = 0; i < count; i++)
+    {
+        if (j == 0 || entries[i].Rva != entries[j - 1].Rva)
+            entries[j++] = entries[i];
+    }
+
+    symbolTable->Entries = entries;
+    symbolTable->Count = j;
+
+    return symbolTable;
+}
+
+PPH_SYMBOL_TABLE PhpGetSymbolTable(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ PPH_SYMBOL_MODULE SymbolModule
+    )
+{
+    if (PhBeginInitOnce(&SymbolModule->SymbolTableInitOnce))
+    {
+        PH_TRACE_ACTIVITY traceActivity;
+
+        PhTraceStartEvent(&PhpSymbolTableCreateTraceEvent, &traceActivity, (ULONG_PTR)SymbolModule->FileName->Buffer);
+        SymbolModule->SymbolTable = PhpCreateSymbolTable(SymbolProvider, SymbolModule);
+        PhTraceStopEvent(&PhpSymbolTableCreateTraceEvent, &traceActivity);
+        PhEndInitOnce(&SymbolModule->SymbolTableInitOnce);
+    }
+
+    return SymbolModule->SymbolTable;
+}
+
+BOOLEAN PhpGetSymbolFromTable(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG64 Address,
+    _Out_ PULONG64 ModuleBase,
+    _Out_ PPH_STRING *FileName,
+    _Out_ PPH_STRING *SymbolName,
+    _Out_ PULONG64 Displacement
+    )
+{
+    PPH_SYMBOL_MODULE module;
+    PPH_SYMBOL_TABLE symbolTable;
+    PPH_SYMBOL_TABLE_ENTRY entry;
+    ULONG rva;
+    ULONG low;
+    ULONG high;
+
+    if (!(module = PhpFindSymbolModule(SymbolProvider, Address)) || !module->FileName)
+        return FALSE;
+    if (!(symbolTable = PhpGetSymbolTable(SymbolProvider, module)))
+        return FALSE;
+
+    rva = (ULONG)(Address - module->BaseAddress);
+
+    // Find the last entry whose RVA is not greater than the address.
+
+    entry = NULL;
+    low = 0;
+    high = symbolTable->Count;
+
+    while (low < high)
+    {
+        ULONG mid = low + (high - low) / 2;
+
+        if (symbolTable->Entries[mid].Rva <= rva)
+        {
+            entry = &symbolTable->Entries[mid];
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    *ModuleBase = module->BaseAddress;
+    PhSetReference(FileName, module->FileName);
+
+    if (entry)
+    {
+        *SymbolName = PhCreateStringEx(symbolTable->Names->Buffer + entry->NameOffset, entry->NameLength * sizeof(WCHAR));
+        *Displacement = rva - entry->Rva;
+    }
+    else
+    {
+        *SymbolName = NULL;
+        *Displacement = 0;
+    }
+
+    return TRUE;
+}
+
 VOID PhpSymbolInfoAnsiToUnicode(
     _Out_ PSYMBOL_INFOW SymbolInfoW,
     _In_ PSYMBOL_INFO SymbolInfoA
@@ -539,6 +840,179 @@ VOID PhpSymbolInfoAnsiToUnicode(
     }
 }
 
+static BOOLEAN NTAPI PhpSymbolCacheEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PPH_SYMBOL_CACHE_ENTRY)Entry1)->Address == ((PPH_SYMBOL_CACHE_ENTRY)Entry2)->Address;
+}
+
+static ULONG NTAPI PhpSymbolCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashInt64(((PPH_SYMBOL_CACHE_ENTRY)Entry)->Address);
+}
+
+VOID PhpClearSymbolCache(
+    _In_ PPH_HASHTABLE SymbolCache
+    )
+{
+    ULONG enumerationKey = 0;
+    PPH_SYMBOL_CACHE_ENTRY entry;
+
+    while (PhEnumHashtable(SymbolCache, &entry, &enumerationKey))
+    {
+        PhClearReference(&entry->Symbol);
+        PhClearReference(&entry->FileName);
+        PhClearReference(&entry->SymbolName);
+    }
+
+    PhClearHashtable(SymbolCache);
+}
+
+VOID PhpInvalidateSymbolCache(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
+    )
+{
+    // Entries are checked against the generation on lookup, so there is no need to take the
+    // cache lock here. This matters because we may be called from inside dbghelp.
+    _InterlockedIncrement(&SymbolProvider->SymbolCacheGeneration);
+}
+
+FORCEINLINE ULONG PhpGetSymbolCacheGeneration(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
+    )
+{
+    return SymbolProvider->SymbolCacheGeneration + PhSymOptionsGeneration;
+}
+
+BOOLEAN PhpLookupSymbolCache(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG64 Address,
+    _In_ ULONG Generation,
+    _Out_opt_ PPH_SYMBOL_RESOLVE_LEVEL ResolveLevel,
+    _Out_opt_ PPH_STRING *FileName,
+    _Out_opt_ PPH_STRING *SymbolName,
+    _Out_opt_ PULONG64 Displacement,
+    _Out_ PPH_STRING *Symbol
+    )
+{
+    PH_SYMBOL_CACHE_ENTRY lookupEntry;
+    PPH_SYMBOL_CACHE_ENTRY entry;
+    BOOLEAN found = FALSE;
+
+    if (!SymbolProvider->SymbolCache)
+        return FALSE;
+
+    lookupEntry.Address = Address;
+
+    PhAcquireQueuedLockShared(&SymbolProvider->SymbolCacheLock);
+
+    entry = PhFindEntryHashtable(SymbolProvider->SymbolCache, &lookupEntry);
+
+    if (entry && entry->Generation == Generation)
+    {
+        if (ResolveLevel)
+            *ResolveLevel = entry->ResolveLevel;
+        if (FileName)
+            PhSetReference(FileName, entry->FileName);
+        if (SymbolName)
+            PhSetReference(SymbolName, entry->SymbolName);
+        if (Displacement)
+            *Displacement = entry->Displacement;
+
+        PhSetReference(Symbol, entry->Symbol);
+        found = TRUE;
+    }
+
+    PhReleaseQueuedLockShared(&SymbolProvider->SymbolCacheLock);
+
+    if (found)
+        _InterlockedIncrement(&SymbolProvider->SymbolCacheHits);
+    else
+        _InterlockedIncrement(&SymbolProvider->SymbolCacheMisses);
+
+    return found;
+}
+
+VOID PhpAddSymbolCache(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG64 Address,
+    _In_ ULONG Generation,
+    _In_ PH_SYMBOL_RESOLVE_LEVEL ResolveLevel,
+    _In_ PPH_STRING Symbol,
+    _In_opt_ PPH_STRING FileName,
+    _In_opt_ PPH_STRING SymbolName,
+    _In_ ULONG64 Displacement
+    )
+{
+    PH_SYMBOL_CACHE_ENTRY newEntry;
+    PPH_SYMBOL_CACHE_ENTRY entry;
+    BOOLEAN added;
+
+    // Don't cache results computed while something was being invalidated.
+    if (PhpGetSymbolCacheGeneration(SymbolProvider) != Generation)
+        return;
+
+    newEntry.Address = Address;
+    newEntry.Generation = Generation;
+    newEntry.ResolveLevel = ResolveLevel;
+    newEntry.Symbol = Symbol;
+    newEntry.FileName = FileName;
+    newEntry.SymbolName = SymbolName;
+    newEntry.Displacement = Displacement;
+
+    PhAcquireQueuedLockExclusive(&SymbolProvider->SymbolCacheLock);
+
+    if (!SymbolProvider->SymbolCache)
+    {
+        SymbolProvider->SymbolCache = PhCreateHashtable(
+            sizeof(PH_SYMBOL_CACHE_ENTRY),
+            PhpSymbolCacheEqualFunction,
+            PhpSymbolCacheHashFunction,
+            64
+            );
+    }
+
+    // Stale entries are only replaced when their address is looked up again, so the cache is
+    // simply emptied when it gets too large.
+    if (SymbolProvider->SymbolCache->Count >= PH_SYMBOL_CACHE_MAXIMUM_ENTRIES)
+        PhpClearSymbolCache(SymbolProvider->SymbolCache);
+
+    entry = PhAddEntryHashtableEx(SymbolProvider->SymbolCache, &newEntry, &added);
+
+    if (!added)
+    {
+        PhClearReference(&entry->Symbol);
+        PhClearReference(&entry->FileName);
+        PhClearReference(&entry->SymbolName);
+        *entry = newEntry;
+    }
+
+    PhReferenceObject(Symbol);
+    if (FileName) PhReferenceObject(FileName);
+    if (SymbolName) PhReferenceObject(SymbolName);
+
+    PhReleaseQueuedLockExclusive(&SymbolProvider->SymbolCacheLock);
+}
+
+/**
+ * Gets the symbol for an address.
+ *
+ * \param SymbolProvider The symbol provider.
+ * \param Address The address.
+ * \param ResolveLevel A variable which receives how much of the symbol could be resolved.
+ * \param FileName A variable which receives the file name of the module containing the address.
+ * \param SymbolName A variable which receives the name of the symbol.
+ * \param Displacement A variable which receives the offset of the address from the symbol.
+ *
+ * \return The symbol as a string, or NULL if the address is invalid.
+ *
+ * \remarks Results are cached per provider until a module is loaded or unloaded, or symbol
+ * options or search paths change.
+ */
 PPH_STRING PhGetSymbolFromAddress(
     _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
     _In_ ULONG64 Address,
@@ -548,7 +1022,7 @@ PPH_STRING PhGetSymbolFromAddress(
     _Out_opt_ PULONG64 Displacement
     )
 {
-    PSYMBOL_INFOW symbolInfo;
+    PSYMBOL_INFOW symbolInfo = NULL;
     ULONG nameLength;
     PPH_STRING symbol = NULL;
     PH_SYMBOL_RESOLVE_LEVEL resolveLevel;
@@ -557,6 +1031,7 @@ PPH_STRING PhGetSymbolFromAddress(
     PPH_STRING modBaseName = NULL;
     ULONG64 modBase;
     PPH_STRING symbolName = NULL;
+    ULONG generation;
 
     if (Address == 0)
     {
@@ -573,6 +1048,19 @@ PPH_STRING PhGetSymbolFromAddress(
     if (!SymFromAddrW_I && !SymFromAddr_I)
         return NULL;
 
+    generation = PhpGetSymbolCacheGeneration(SymbolProvider);
+
+    if (PhpLookupSymbolCache(SymbolProvider, Address, generation, ResolveLevel, FileName, SymbolName, Displacement, &symbol))
+        return symbol;
+
+    displacement = 0;
+
+    if (SymbolProvider->Flags & PH_SYMBOL_PROVIDER_SYMBOL_TABLES)
+    {
+        if (PhpGetSymbolFromTable(SymbolProvider, Address, &modBase, &modFileName, &symbolName, &displacement))
+            goto FormatSymbol;
+    }
+
     symbolInfo = PhAllocate(FIELD_OFFSET(SYMBOL_INFOW, Name) + PH_MAX_SYMBOL_NAME_LEN * 2);
     memset(symbolInfo, 0, sizeof(SYMBOL_INFOW));
     symbolInfo->SizeOfStruct = sizeof(SYMBOL_INFOW);
@@ -660,6 +1148,9 @@ PPH_STRING PhGetSymbolFromAddress(
 
     PH_UNLOCK_SYMBOLS();
 
+    if (symbolInfo->NameLen != 0)
+        symbolName = PhCreateStringEx(symbolInfo->Name, symbolInfo->NameLen * 2);
+
     // Find the module name.
 
     if (symbolInfo->ModBase == 0)
@@ -677,6 +1168,7 @@ PPH_STRING PhGetSymbolFromAddress(
         PPH_SYMBOL_MODULE symbolModule;
 
         lookupSymbolModule.BaseAddress = symbolInfo->ModBase;
+        modBase = symbolInfo->ModBase;
 
         PhAcquireQueuedLockShared(&SymbolProvider->ModulesListLock);
 
@@ -702,12 +1194,13 @@ PPH_STRING PhGetSymbolFromAddress(
         goto CleanupExit;
     }
 
+FormatSymbol:
     modBaseName = PhGetBaseName(modFileName);
 
     // If we have a module name but not a symbol name,
     // return the module plus an offset: module+offset.
 
-    if (symbolInfo->NameLen == 0)
+    if (!symbolName)
     {
         PH_FORMAT format[3];
 
@@ -724,7 +1217,6 @@ PPH_STRING PhGetSymbolFromAddress(
     // If we have everything, return the full symbol
     // name: module!symbol+offset.
 
-    symbolName = PhCreateStringEx(symbolInfo->Name, symbolInfo->NameLen * 2);
     resolveLevel = PhsrlFunction;
 
     if (displacement == 0)
@@ -752,6 +1244,8 @@ PPH_STRING PhGetSymbolFromAddress(
 
 CleanupExit:
 
+    PhpAddSymbolCache(SymbolProvider, Address, generation, resolveLevel, symbol, modFileName, symbolName, displacement);
+
     if (ResolveLevel)
         *ResolveLevel = resolveLevel;
     if (FileName)
@@ -764,7 +1258,7 @@ CleanupExit:
     PhClearReference(&modFileName);
     PhClearReference(&modBaseName);
     PhClearReference(&symbolName);
-    PhFree(symbolInfo);
+    if (symbolInfo) PhFree(symbolInfo);
 
     return symbol;
 }
@@ -854,6 +1348,7 @@ BOOLEAN PhLoadModuleSymbolProvider(
     PPH_SYMBOL_MODULE symbolModule = NULL;
     PPH_AVL_LINKS existingLinks;
     PH_SYMBOL_MODULE lookupSymbolModule;
+    PH_TRACE_ACTIVITY traceActivity;
 
     PhpRegisterSymbolProvider(SymbolProvider);
 
@@ -871,6 +1366,7 @@ BOOLEAN PhLoadModuleSymbolProvider(
     if (existingLinks)
         return TRUE;
 
+    PhTraceStartEvent(&PhpSymbolModuleLoadTraceEvent, &traceActivity, (ULONG_PTR)FileName);
     PH_LOCK_SYMBOLS();
 
     if (SymLoadModuleExW_I)
@@ -903,6 +1399,7 @@ BOOLEAN PhLoadModuleSymbolProvider(
     }
 
     PH_UNLOCK_SYMBOLS();
+    PhTraceStopEvent(&PhpSymbolModuleLoadTraceEvent, &traceActivity);
 
     // Add the module to the list, even if we couldn't load symbols for the module.
 
@@ -918,6 +1415,13 @@ BOOLEAN PhLoadModuleSymbolProvider(
         symbolModule->BaseAddress = BaseAddress;
         symbolModule->Size = Size;
         symbolModule->FileName = PhGetFullPath(FileName, &symbolModule->BaseNameIndex);
+        PhInitializeInitOnce(&symbolModule->SymbolTableInitOnce);
+        symbolModule->SymbolTable = NULL;
+        symbolModule->PdbPrefetched = FALSE;
+#ifdef _WIN64
+        PhInitializeInitOnce(&symbolModule->UnwindTableInitOnce);
+        symbolModule->UnwindTable = NULL;
+#endif
 
         existingLinks = PhAddElementAvlTree(&SymbolProvider->ModulesSet, &symbolModule->Links);
         assert(!existingLinks);
@@ -926,6 +1430,9 @@ BOOLEAN PhLoadModuleSymbolProvider(
 
     PhReleaseQueuedLockExclusive(&SymbolProvider->ModulesListLock);
 
+    // Addresses in this module may have been cached as plain addresses.
+    PhpInvalidateSymbolCache(SymbolProvider);
+
     if (!baseAddress)
     {
         if (GetLastError() != ERROR_SUCCESS)
@@ -957,6 +1464,8 @@ VOID PhSetOptionsSymbolProvider(
     SymSetOptions_I(options);
 
     PH_UNLOCK_SYMBOLS();
+
+    _InterlockedIncrement(&PhSymOptionsGeneration);
 }
 
 VOID PhSetSearchPathSymbolProvider(
@@ -985,21 +1494,246 @@ VOID PhSetSearchPathSymbolProvider(
     }
 
     PH_UNLOCK_SYMBOLS();
+
+    PhpInvalidateSymbolCache(SymbolProvider);
 }
 
-#ifdef _WIN64
+typedef struct _PH_SYMBOL_PREFETCH_CONTEXT
+{
+    PPH_LIST ServerList; // symbol server parameters ("cache*server") from the search path
+    PPH_SYMBOL_PREFETCH_CALLBACK Callback;
+    PVOID Context;
+    BOOLEAN Cancelled;
 
-NTSTATUS PhpLookupDynamicFunctionTable(
-    _In_ HANDLE ProcessHandle,
-    _In_ ULONG64 Address,
-    _Out_opt_ PDYNAMIC_FUNCTION_TABLE *FunctionTableAddress,
-    _Out_opt_ PDYNAMIC_FUNCTION_TABLE FunctionTable,
-    _Out_writes_bytes_opt_(OutOfProcessCallbackDllBufferSize) PWCHAR OutOfProcessCallbackDllBuffer,
-    _In_ ULONG OutOfProcessCallbackDllBufferSize,
-    _Out_opt_ PUNICODE_STRING OutOfProcessCallbackDllString
+    PH_QUEUED_LOCK ProgressLock;
+    PH_SYMBOL_PREFETCH_PROGRESS Progress;
+} PH_SYMBOL_PREFETCH_CONTEXT, *PPH_SYMBOL_PREFETCH_CONTEXT;
+
+typedef struct _PH_SYMBOL_PREFETCH_ITEM
+{
+    PPH_SYMBOL_PREFETCH_CONTEXT Context;
+    PPH_STRING FileName;
+} PH_SYMBOL_PREFETCH_ITEM, *PPH_SYMBOL_PREFETCH_ITEM;
+
+static PPH_LIST PhpGetSymbolServerList(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider
     )
 {
-    NTSTATUS status;
+    static PH_STRINGREF srvPrefix = PH_STRINGREF_INIT(L"srv*");
+    static PH_STRINGREF symsrvPrefix = PH_STRINGREF_INIT(L"symsrv*symsrv.dll*");
+
+    PPH_LIST serverList;
+    WCHAR searchPath[0x800];
+    BOOL result;
+    PH_STRINGREF remainingPart;
+    PH_STRINGREF part;
+
+    if (!SymGetSearchPathW_I)
+        return NULL;
+
+    PH_LOCK_SYMBOLS();
+    result = SymGetSearchPathW_I(SymbolProvider->ProcessHandle, searchPath, RTL_NUMBER_OF(searchPath));
+    PH_UNLOCK_SYMBOLS();
+
+    if (!result)
+        return NULL;
+
+    serverList = PhCreateList(2);
+    PhInitializeStringRefLongHint(&remainingPart, searchPath);
+
+    while (remainingPart.Length != 0)
+    {
+        PhSplitStringRefAtChar(&remainingPart, ';', &part, &remainingPart);
+
+        if (PhStartsWithStringRef(&part, &srvPrefix, TRUE))
+            PhSkipStringRef(&part, srvPrefix.Length);
+        else if (PhStartsWithStringRef(&part, &symsrvPrefix, TRUE))
+            PhSkipStringRef(&part, symsrvPrefix.Length);
+        else
+            continue;
+
+        if (part.Length != 0)
+            PhAddItemList(serverList, PhCreateString2(&part));
+    }
+
+    if (serverList->Count == 0)
+    {
+        PhDereferenceObject(serverList);
+        return NULL;
+    }
+
+    return serverList;
+}
+
+static NTSTATUS PhpSymbolPrefetchWorker(
+    _In_ PVOID Parameter
+    )
+{
+    PPH_SYMBOL_PREFETCH_ITEM item = Parameter;
+    PPH_SYMBOL_PREFETCH_CONTEXT context = item->Context;
+    PH_MAPPED_IMAGE mappedImage;
+    GUID guid;
+    ULONG age;
+    PPH_STRING pdbFileName;
+    BOOLEAN found;
+    BOOLEAN failed;
+    ULONG i;
+
+    found = FALSE;
+    failed = FALSE;
+
+    if (!context->Cancelled && NT_SUCCESS(PhLoadMappedImage(item->FileName->Buffer, NULL, TRUE, &mappedImage)))
+    {
+        if (NT_SUCCESS(PhGetMappedImagePdbInfo(&mappedImage, &guid, &age, &pdbFileName)))
+        {
+            PPH_STRING pdbBaseName;
+            WCHAR path[MAX_PATH + 1];
+
+            // symsrv checks the local cache before contacting the server, so PDBs that have
+            // already been downloaded are found quickly.
+            pdbBaseName = PhGetBaseName(pdbFileName);
+
+            for (i = 0; i < context->ServerList->Count && !found && !context->Cancelled; i++)
+            {
+                if (SymbolServerW_I(((PPH_STRING)context->ServerList->Items[i])->Buffer, pdbBaseName->Buffer, &guid, age, 0, path))
+                    found = TRUE;
+            }
+
+            failed = !found;
+
+            PhDereferenceObject(pdbBaseName);
+            PhDereferenceObject(pdbFileName);
+        }
+
+        PhUnloadMappedImage(&mappedImage);
+    }
+
+    PhAcquireQueuedLockExclusive(&context->ProgressLock);
+
+    context->Progress.CompletedCount++;
+    if (found) context->Progress.FoundCount++;
+    if (failed) context->Progress.FailedCount++;
+    context->Progress.FileName = item->FileName;
+
+    if (context->Callback && !context->Cancelled)
+    {
+        if (!context->Callback(&context->Progress, context->Context))
+            context->Cancelled = TRUE;
+    }
+
+    PhReleaseQueuedLockExclusive(&context->ProgressLock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Downloads the PDBs of the modules loaded into a symbol provider into the local symbol cache.
+ *
+ * \param SymbolProvider A symbol provider object.
+ * \param MaximumConcurrency The maximum number of PDBs to download at the same time.
+ * \param Callback A callback function which is executed each time a module has been completed.
+ * \param Context A user-defined value to pass to the callback function.
+ *
+ * \remarks dbghelp downloads PDBs one at a time as addresses are resolved, so this should be
+ * called once the modules of a process are known and before resolving many addresses. Each
+ * module is only prefetched once, and modules without a PDB signature are skipped. The search
+ * path must contain at least one symbol server (srv*).
+ */
+NTSTATUS PhPrefetchSymbolProvider(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG MaximumConcurrency,
+    _In_opt_ PPH_SYMBOL_PREFETCH_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    )
+{
+    PH_SYMBOL_PREFETCH_CONTEXT context;
+    PPH_LIST itemList;
+    PLIST_ENTRY listEntry;
+    PH_WORK_QUEUE workQueue;
+    PH_WORK_QUEUE_BATCH batch;
+    ULONG i;
+
+    if (!SymbolServerW_I || !SymbolServerSetOptions)
+        return STATUS_NOT_SUPPORTED;
+
+    memset(&context, 0, sizeof(PH_SYMBOL_PREFETCH_CONTEXT));
+
+    if (!(context.ServerList = PhpGetSymbolServerList(SymbolProvider)))
+        return STATUS_NOT_SUPPORTED;
+
+    context.Callback = Callback;
+    context.Context = Context;
+    PhInitializeQueuedLock(&context.ProgressLock);
+
+    // Claim the modules that haven't been prefetched yet.
+
+    itemList = PhCreateList(32);
+
+    PhAcquireQueuedLockExclusive(&SymbolProvider->ModulesListLock);
+
+    for (listEntry = SymbolProvider->ModulesListHead.Flink; listEntry != &SymbolProvider->ModulesListHead; listEntry = listEntry->Flink)
+    {
+        PPH_SYMBOL_MODULE symbolModule = CONTAINING_RECORD(listEntry, PH_SYMBOL_MODULE, ListEntry);
+        PPH_SYMBOL_PREFETCH_ITEM item;
+
+        if (symbolModule->PdbPrefetched || !symbolModule->FileName)
+            continue;
+
+        symbolModule->PdbPrefetched = TRUE;
+
+        item = PhAllocate(sizeof(PH_SYMBOL_PREFETCH_ITEM));
+        item->Context = &context;
+        item->FileName = symbolModule->FileName;
+        PhReferenceObject(item->FileName);
+        PhAddItemList(itemList, item);
+    }
+
+    PhReleaseQueuedLockExclusive(&SymbolProvider->ModulesListLock);
+
+    context.Progress.TotalCount = itemList->Count;
+
+    if (itemList->Count != 0)
+    {
+        // The IDs we pass to symsrv are GUIDs, not timestamps.
+        PH_LOCK_SYMBOLS();
+        SymbolServerSetOptions(SSRVOPT_GUIDPTR, TRUE);
+        PH_UNLOCK_SYMBOLS();
+
+        PhInitializeWorkQueue(&workQueue, 0, max(MaximumConcurrency, 1), 1000);
+        PhInitializeWorkQueueBatch(&batch);
+        PhQueueItemsWorkQueueEx(&workQueue, PhpSymbolPrefetchWorker, itemList->Items, itemList->Count, &batch);
+        PhWaitForWorkQueueBatch(&batch, NULL);
+        PhDeleteWorkQueue(&workQueue);
+    }
+
+    for (i = 0; i < itemList->Count; i++)
+    {
+        PPH_SYMBOL_PREFETCH_ITEM item = itemList->Items[i];
+
+        PhDereferenceObject(item->FileName);
+        PhFree(item);
+    }
+
+    PhDereferenceObject(itemList);
+    PhDereferenceObjects(context.ServerList->Items, context.ServerList->Count);
+    PhDereferenceObject(context.ServerList);
+
+    return context.Cancelled ? STATUS_CANCELLED : STATUS_SUCCESS;
+}
+
+#ifdef _WIN64
+
+NTSTATUS PhpLookupDynamicFunctionTable(
+    _In_ HANDLE ProcessHandle,
+    _In_ ULONG64 Address,
+    _Out_opt_ PDYNAMIC_FUNCTION_TABLE *FunctionTableAddress,
+    _Out_opt_ PDYNAMIC_FUNCTION_TABLE FunctionTable,
+    _Out_writes_bytes_opt_(OutOfProcessCallbackDllBufferSize) PWCHAR OutOfProcessCallbackDllBuffer,
+    _In_ ULONG OutOfProcessCallbackDllBufferSize,
+    _Out_opt_ PUNICODE_STRING OutOfProcessCallbackDllString
+    )
+{
+    NTSTATUS status;
     PLIST_ENTRY (NTAPI *rtlGetFunctionTableListHead)(VOID);
     PLIST_ENTRY tableListHead;
     LIST_ENTRY tableListHeadEntry;
@@ -1333,6 +2067,543 @@ NTSTATUS PhAccessOutOfProcessFunctionEntry(
     return status;
 }
 
+#define PH_UWOP_PUSH_NONVOL 0
+#define PH_UWOP_ALLOC_LARGE 1
+#define PH_UWOP_ALLOC_SMALL 2
+#define PH_UWOP_SET_FPREG 3
+#define PH_UWOP_SAVE_NONVOL 4
+#define PH_UWOP_SAVE_NONVOL_FAR 5
+#define PH_UWOP_EPILOG 6
+#define PH_UWOP_SAVE_XMM128 8
+#define PH_UWOP_SAVE_XMM128_FAR 9
+#define PH_UWOP_PUSH_MACHFRAME 10
+
+#define PH_UNW_FLAG_CHAININFO 0x4
+
+typedef union _PH_UNWIND_CODE
+{
+    struct
+    {
+        UCHAR CodeOffset;
+        UCHAR UnwindOp : 4;
+        UCHAR OpInfo : 4;
+    };
+    USHORT FrameOffset;
+} PH_UNWIND_CODE, *PPH_UNWIND_CODE;
+
+typedef struct _PH_UNWIND_INFO
+{
+    UCHAR Version : 3;
+    UCHAR Flags : 5;
+    UCHAR SizeOfProlog;
+    UCHAR CountOfCodes;
+    UCHAR FrameRegister : 4;
+    UCHAR FrameOffset : 4;
+    // CountOfCodes entries, rounded up to an even number and followed by a chained
+    // RUNTIME_FUNCTION if PH_UNW_FLAG_CHAININFO is set.
+    PH_UNWIND_CODE UnwindCode[256 + sizeof(RUNTIME_FUNCTION) / sizeof(PH_UNWIND_CODE)];
+} PH_UNWIND_INFO, *PPH_UNWIND_INFO;
+
+#define PH_NATIVE_UNWIND_STACK_WINDOW_SIZE 0x2000
+#define PH_NATIVE_UNWIND_STACK_PREFETCH_SIZE 0x200
+#define PH_NATIVE_UNWIND_MAXIMUM_FRAMES 1024
+#define PH_NATIVE_UNWIND_MAXIMUM_CHAIN 32
+
+typedef struct _PH_NATIVE_UNWIND_CONTEXT
+{
+    HANDLE ProcessHandle;
+    PPH_SYMBOL_PROVIDER SymbolProvider;
+
+    // Stack memory is read in large blocks instead of once for each value.
+    ULONG64 StackWindowAddress;
+    SIZE_T StackWindowLength;
+    UCHAR StackWindow[PH_NATIVE_UNWIND_STACK_WINDOW_SIZE];
+} PH_NATIVE_UNWIND_CONTEXT, *PPH_NATIVE_UNWIND_CONTEXT;
+
+static int __cdecl PhpRuntimeFunctionCompare(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PRUNTIME_FUNCTION function1 = (PRUNTIME_FUNCTION)elem1;
+    PRUNTIME_FUNCTION function2 = (PRUNTIME_FUNCTION)elem2;
+
+    return uintcmp(function1->BeginAddress, function2->BeginAddress);
+}
+
+PPH_UNWIND_TABLE PhpCreateUnwindTable(
+    _In_ HANDLE ProcessHandle,
+    _In_ PPH_SYMBOL_MODULE SymbolModule
+    )
+{
+    IMAGE_DOS_HEADER dosHeader;
+    IMAGE_NT_HEADERS64 ntHeaders;
+    PIMAGE_DATA_DIRECTORY dataDirectory;
+    PPH_UNWIND_TABLE unwindTable;
+    PRUNTIME_FUNCTION functions;
+    ULONG count;
+    ULONG i;
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        ProcessHandle,
+        (PVOID)SymbolModule->BaseAddress,
+        &dosHeader,
+        sizeof(IMAGE_DOS_HEADER),
+        NULL
+        )))
+        return NULL;
+
+    if (dosHeader.e_magic != IMAGE_DOS_SIGNATURE || (ULONG)dosHeader.e_lfanew >= SymbolModule->Size)
+        return NULL;
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        ProcessHandle,
+        PTR_ADD_OFFSET(SymbolModule->BaseAddress, dosHeader.e_lfanew),
+        &ntHeaders,
+        sizeof(IMAGE_NT_HEADERS64),
+        NULL
+        )))
+        return NULL;
+
+    if (ntHeaders.Signature != IMAGE_NT_SIGNATURE || ntHeaders.OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+        return NULL;
+    if (ntHeaders.OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_EXCEPTION)
+        return NULL;
+
+    dataDirectory = &ntHeaders.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION];
+    count = dataDirectory->Size / sizeof(RUNTIME_FUNCTION);
+
+    // Put a reasonable limit on the number of entries we read.
+    if (count == 0 || count > 0x100000 || dataDirectory->VirtualAddress >= SymbolModule->Size)
+        return NULL;
+
+    functions = PhAllocateSafe(count * sizeof(RUNTIME_FUNCTION));
+
+    if (!functions)
+        return NULL;
+
+    if (!NT_SUCCESS(PhReadVirtualMemory(
+        ProcessHandle,
+        PTR_ADD_OFFSET(SymbolModule->BaseAddress, dataDirectory->VirtualAddress),
+        functions,
+        count * sizeof(RUNTIME_FUNCTION),
+        NULL
+        )))
+    {
+        PhFree(functions);
+        return NULL;
+    }
+
+    // The linker sorts the table, but check anyway since we do a binary search on it.
+    for (i = 1; i < count; i++)
+    {
+        if (functions[i].BeginAddress < functions[i - 1].BeginAddress)
+        {
+            qsort(functions, count, sizeof(RUNTIME_FUNCTION), PhpRuntimeFunctionCompare);
+            break;
+        }
+    }
+
+    unwindTable = PhAllocate(sizeof(PH_UNWIND_TABLE));
+    unwindTable->Count = count;
+    unwindTable->Functions = functions;
+
+    return unwindTable;
+}
+
+PPH_UNWIND_TABLE PhpGetUnwindTable(
+    _In_ HANDLE ProcessHandle,
+    _In_ PPH_SYMBOL_MODULE SymbolModule
+    )
+{
+    if (PhBeginInitOnce(&SymbolModule->UnwindTableInitOnce))
+    {
+        SymbolModule->UnwindTable = PhpCreateUnwindTable(ProcessHandle, SymbolModule);
+        PhEndInitOnce(&SymbolModule->UnwindTableInitOnce);
+    }
+
+    return SymbolModule->UnwindTable;
+}
+
+static BOOLEAN PhpIsInStackWindow(
+    _In_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _In_ ULONG64 Address,
+    _In_ SIZE_T Length
+    )
+{
+    return
+        Address >= UnwindContext->StackWindowAddress &&
+        Address - UnwindContext->StackWindowAddress + Length <= UnwindContext->StackWindowLength;
+}
+
+static VOID PhpPrepareStackWindowRead(
+    _In_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _In_ ULONG64 Address,
+    _Out_ PPH_VIRTUAL_MEMORY_READ_ENTRY Entry
+    )
+{
+    Entry->BaseAddress = (PVOID)Address;
+    Entry->Buffer = UnwindContext->StackWindow;
+    Entry->BufferSize = PH_NATIVE_UNWIND_STACK_WINDOW_SIZE;
+}
+
+static VOID PhpCompleteStackWindowRead(
+    _Inout_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _In_ PPH_VIRTUAL_MEMORY_READ_ENTRY Entry
+    )
+{
+    // The window usually runs past the top of the stack, so keep whatever could be read.
+    UnwindContext->StackWindowAddress = (ULONG64)Entry->BaseAddress;
+
+    if (NT_SUCCESS(Entry->Status) || Entry->Status == STATUS_PARTIAL_COPY)
+        UnwindContext->StackWindowLength = Entry->NumberOfBytesRead;
+    else
+        UnwindContext->StackWindowLength = 0;
+}
+
+static BOOLEAN PhpReadNativeUnwindStack(
+    _Inout_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _In_ ULONG64 Address,
+    _Out_ PULONG64 Value
+    )
+{
+    if (!PhpIsInStackWindow(UnwindContext, Address, sizeof(ULONG64)))
+    {
+        PH_VIRTUAL_MEMORY_READ_ENTRY entry;
+
+        PhpPrepareStackWindowRead(UnwindContext, Address, &entry);
+        PhReadVirtualMemoryBatch(UnwindContext->ProcessHandle, &entry, 1);
+        PhpCompleteStackWindowRead(UnwindContext, &entry);
+
+        if (!PhpIsInStackWindow(UnwindContext, Address, sizeof(ULONG64)))
+            return FALSE;
+    }
+
+    *Value = *(PULONG64)&UnwindContext->StackWindow[Address - UnwindContext->StackWindowAddress];
+
+    return TRUE;
+}
+
+static BOOLEAN PhpReadNativeUnwindInfo(
+    _Inout_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _In_ PPH_SYMBOL_MODULE SymbolModule,
+    _In_ ULONG UnwindData,
+    _In_ ULONG64 StackAddress,
+    _Out_ PPH_UNWIND_INFO UnwindInfo
+    )
+{
+    PH_VIRTUAL_MEMORY_READ_ENTRY entries[2];
+    ULONG numberOfEntries;
+    SIZE_T requiredLength;
+
+    // The low bit marks indirect entries, which we don't handle.
+    if ((UnwindData & 1) || UnwindData >= SymbolModule->Size)
+        return FALSE;
+
+    // Read the top of the caller's stack along with the unwind information since the unwind
+    // codes for this frame will need it.
+
+    entries[0].BaseAddress = PTR_ADD_OFFSET(SymbolModule->BaseAddress, UnwindData);
+    entries[0].Buffer = UnwindInfo;
+    entries[0].BufferSize = min(sizeof(PH_UNWIND_INFO), SymbolModule->Size - UnwindData);
+    numberOfEntries = 1;
+
+    if (!PhpIsInStackWindow(UnwindContext, StackAddress, PH_NATIVE_UNWIND_STACK_PREFETCH_SIZE))
+    {
+        PhpPrepareStackWindowRead(UnwindContext, StackAddress, &entries[1]);
+        numberOfEntries++;
+    }
+
+    PhReadVirtualMemoryBatch(UnwindContext->ProcessHandle, entries, numberOfEntries);
+
+    if (numberOfEntries == 2)
+        PhpCompleteStackWindowRead(UnwindContext, &entries[1]);
+
+    if (!NT_SUCCESS(entries[0].Status) && entries[0].Status != STATUS_PARTIAL_COPY)
+        return FALSE;
+    if (entries[0].NumberOfBytesRead < FIELD_OFFSET(PH_UNWIND_INFO, UnwindCode))
+        return FALSE;
+
+    requiredLength = FIELD_OFFSET(PH_UNWIND_INFO, UnwindCode[(UnwindInfo->CountOfCodes + 1) & ~1]);
+
+    if (UnwindInfo->Flags & PH_UNW_FLAG_CHAININFO)
+        requiredLength += sizeof(RUNTIME_FUNCTION);
+
+    return entries[0].NumberOfBytesRead >= requiredLength && (UnwindInfo->Version == 1 || UnwindInfo->Version == 2);
+}
+
+static ULONG PhpGetUnwindCodeSlots(
+    _In_ PH_UNWIND_CODE UnwindCode
+    )
+{
+    switch (UnwindCode.UnwindOp)
+    {
+    case PH_UWOP_ALLOC_LARGE:
+        return UnwindCode.OpInfo ? 3 : 2;
+    case PH_UWOP_SAVE_NONVOL:
+    case PH_UWOP_SAVE_XMM128:
+    case PH_UWOP_EPILOG:
+        return 2;
+    case PH_UWOP_SAVE_NONVOL_FAR:
+    case PH_UWOP_SAVE_XMM128_FAR:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+static BOOLEAN PhpIsFrameRegisterEstablished(
+    _In_ PPH_UNWIND_INFO UnwindInfo,
+    _In_ ULONG64 PrologOffset
+    )
+{
+    ULONG i;
+
+    if (PrologOffset >= UnwindInfo->SizeOfProlog)
+        return TRUE;
+
+    for (i = 0; i < UnwindInfo->CountOfCodes; i += PhpGetUnwindCodeSlots(UnwindInfo->UnwindCode[i]))
+    {
+        if (UnwindInfo->UnwindCode[i].UnwindOp == PH_UWOP_SET_FPREG)
+            return UnwindInfo->UnwindCode[i].CodeOffset <= PrologOffset;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Unwinds one frame using the unwind data of the module containing the
+ * instruction pointer.
+ *
+ * \param UnwindContext The unwind context.
+ * \param Context The context of the frame. On success, this receives the
+ * non-volatile registers, instruction pointer and stack pointer of the
+ * caller.
+ *
+ * \remarks Epilogs are not detected, so a frame whose instruction pointer
+ * is inside an epilog may be unwound incorrectly.
+ */
+BOOLEAN PhpVirtualUnwindAmd64(
+    _Inout_ PPH_NATIVE_UNWIND_CONTEXT UnwindContext,
+    _Inout_ PCONTEXT Context
+    )
+{
+    PPH_SYMBOL_MODULE module;
+    PPH_UNWIND_TABLE unwindTable;
+    PRUNTIME_FUNCTION function;
+    RUNTIME_FUNCTION runtimeFunction;
+    PH_UNWIND_INFO unwindInfo;
+    PULONG64 registers;
+    ULONG64 prologOffset;
+    ULONG64 frame;
+    ULONG chainCount;
+    ULONG i;
+
+    if (!(module = PhpFindSymbolModule(UnwindContext->SymbolProvider, Context->Rip)))
+        return FALSE;
+    if (!(unwindTable = PhpGetUnwindTable(UnwindContext->ProcessHandle, module)))
+        return FALSE;
+
+    // Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi and Rdi, R8 to R15 are stored in register number order.
+    registers = &Context->Rax;
+
+    function = PhpLookupFunctionEntry(
+        unwindTable->Functions,
+        unwindTable->Count,
+        TRUE,
+        Context->Rip - module->BaseAddress
+        );
+
+    if (function)
+    {
+        runtimeFunction = *function;
+        prologOffset = Context->Rip - module->BaseAddress - runtimeFunction.BeginAddress;
+        chainCount = 0;
+
+        while (TRUE)
+        {
+            if (!PhpReadNativeUnwindInfo(UnwindContext, module, runtimeFunction.UnwindData, Context->Rsp, &unwindInfo))
+                return FALSE;
+
+            if (unwindInfo.FrameRegister != 0 && PhpIsFrameRegisterEstablished(&unwindInfo, prologOffset))
+                frame = registers[unwindInfo.FrameRegister] - unwindInfo.FrameOffset * 16;
+            else
+                frame = Context->Rsp;
+
+            for (i = 0; i < unwindInfo.CountOfCodes; i += PhpGetUnwindCodeSlots(unwindInfo.UnwindCode[i]))
+            {
+                PH_UNWIND_CODE unwindCode = unwindInfo.UnwindCode[i];
+
+                if (i + PhpGetUnwindCodeSlots(unwindCode) > unwindInfo.CountOfCodes)
+                    return FALSE;
+
+                // Skip codes for the part of the prolog that hasn't executed yet.
+                if (unwindCode.UnwindOp == PH_UWOP_EPILOG || unwindCode.CodeOffset > prologOffset)
+                    continue;
+
+                switch (unwindCode.UnwindOp)
+                {
+                case PH_UWOP_PUSH_NONVOL:
+                    if (!PhpReadNativeUnwindStack(UnwindContext, Context->Rsp, &registers[unwindCode.OpInfo]))
+                        return FALSE;
+                    Context->Rsp += sizeof(ULONG64);
+                    break;
+                case PH_UWOP_ALLOC_LARGE:
+                    if (unwindCode.OpInfo == 0)
+                        Context->Rsp += unwindInfo.UnwindCode[i + 1].FrameOffset * 8;
+                    else
+                        Context->Rsp += unwindInfo.UnwindCode[i + 1].FrameOffset | ((ULONG)unwindInfo.UnwindCode[i + 2].FrameOffset << 16);
+                    break;
+                case PH_UWOP_ALLOC_SMALL:
+                    Context->Rsp += unwindCode.OpInfo * 8 + 8;
+                    break;
+                case PH_UWOP_SET_FPREG:
+                    Context->Rsp = registers[unwindInfo.FrameRegister] - unwindInfo.FrameOffset * 16;
+                    break;
+                case PH_UWOP_SAVE_NONVOL:
+                    if (!PhpReadNativeUnwindStack(UnwindContext, frame + unwindInfo.UnwindCode[i + 1].FrameOffset * 8, &registers[unwindCode.OpInfo]))
+                        return FALSE;
+                    break;
+                case PH_UWOP_SAVE_NONVOL_FAR:
+                    if (!PhpReadNativeUnwindStack(
+                        UnwindContext,
+                        frame + (unwindInfo.UnwindCode[i + 1].FrameOffset | ((ULONG)unwindInfo.UnwindCode[i + 2].FrameOffset << 16)),
+                        &registers[unwindCode.OpInfo]
+                        ))
+                        return FALSE;
+                    break;
+                case PH_UWOP_SAVE_XMM128:
+                case PH_UWOP_SAVE_XMM128_FAR:
+                    // XMM registers aren't needed to walk the stack.
+                    break;
+                case PH_UWOP_PUSH_MACHFRAME:
+                    {
+                        ULONG64 stackPointer;
+
+                        // The processor pushed a machine frame, which holds the interrupted
+                        // instruction and stack pointers instead of a return address.
+                        if (unwindCode.OpInfo)
+                            Context->Rsp += sizeof(ULONG64); // error code
+
+                        if (!PhpReadNativeUnwindStack(UnwindContext, Context->Rsp, &Context->Rip))
+                            return FALSE;
+                        if (!PhpReadNativeUnwindStack(UnwindContext, Context->Rsp + 3 * sizeof(ULONG64), &stackPointer))
+                            return FALSE;
+
+                        Context->Rsp = stackPointer;
+                    }
+                    return TRUE;
+                default:
+                    return FALSE;
+                }
+            }
+
+            if (!(unwindInfo.Flags & PH_UNW_FLAG_CHAININFO))
+                break;
+            if (++chainCount > PH_NATIVE_UNWIND_MAXIMUM_CHAIN)
+                return FALSE;
+
+            // The prolog of the function we were chained from has always completed.
+            runtimeFunction = *(PRUNTIME_FUNCTION)&unwindInfo.UnwindCode[(unwindInfo.CountOfCodes + 1) & ~1];
+            prologOffset = MAXULONG64;
+        }
+    }
+    else
+    {
+        // Leaf functions don't have unwind data, and their return address is at the top of the
+        // stack.
+    }
+
+    if (!PhpReadNativeUnwindStack(UnwindContext, Context->Rsp, &Context->Rip))
+        return FALSE;
+
+    Context->Rsp += sizeof(ULONG64);
+
+    return TRUE;
+}
+
+/**
+ * Walks an AMD64 stack using the unwind tables of the modules known to a
+ * symbol provider.
+ *
+ * \param ProcessHandle A handle to the thread's parent process.
+ * \param SymbolProvider The associated symbol provider.
+ * \param Context The thread's context. When the walk stops at a frame that
+ * can't be unwound, this receives the context of that frame.
+ * \param Callback A callback function which is executed for each stack frame.
+ * \param CallbackContext A user-defined value to pass to the callback function.
+ * \param Cancelled A variable which receives TRUE if the callback stopped the walk.
+ *
+ * \return TRUE if the walk reached the end of the stack, FALSE if the rest
+ * of the stack needs to be walked some other way.
+ */
+BOOLEAN PhpWalkNativeStackAmd64(
+    _In_ HANDLE ProcessHandle,
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _Inout_ PCONTEXT Context,
+    _In_ PPH_WALK_THREAD_STACK_CALLBACK Callback,
+    _In_opt_ PVOID CallbackContext,
+    _Out_ PBOOLEAN Cancelled
+    )
+{
+    PPH_NATIVE_UNWIND_CONTEXT unwindContext;
+    CONTEXT callerContext;
+    PH_THREAD_STACK_FRAME threadStackFrame;
+    ULONG numberOfFrames;
+    BOOLEAN completed;
+    ULONG i;
+
+    unwindContext = PhAllocate(sizeof(PH_NATIVE_UNWIND_CONTEXT));
+    unwindContext->ProcessHandle = ProcessHandle;
+    unwindContext->SymbolProvider = SymbolProvider;
+    unwindContext->StackWindowAddress = 0;
+    unwindContext->StackWindowLength = 0;
+
+    *Cancelled = FALSE;
+    completed = FALSE;
+
+    for (numberOfFrames = 0; numberOfFrames < PH_NATIVE_UNWIND_MAXIMUM_FRAMES; numberOfFrames++)
+    {
+        callerContext = *Context;
+
+        if (!PhpVirtualUnwindAmd64(unwindContext, &callerContext))
+            break;
+
+        memset(&threadStackFrame, 0, sizeof(PH_THREAD_STACK_FRAME));
+        threadStackFrame.PcAddress = (PVOID)Context->Rip;
+        threadStackFrame.ReturnAddress = (PVOID)callerContext.Rip;
+        threadStackFrame.FrameAddress = (PVOID)Context->Rbp;
+        threadStackFrame.StackAddress = (PVOID)Context->Rsp;
+        threadStackFrame.Flags = PH_THREAD_STACK_FRAME_AMD64;
+
+        // Like dbghelp, report the parameter home area above the return address.
+        for (i = 0; i < 4; i++)
+            PhpReadNativeUnwindStack(unwindContext, callerContext.Rsp + i * sizeof(ULONG64), (PULONG64)&threadStackFrame.Params[i]);
+
+        if (!Callback(&threadStackFrame, CallbackContext))
+        {
+            *Cancelled = TRUE;
+            break;
+        }
+
+        *Context = callerContext;
+
+        // Stop at the end of the stack, or if the stack pointer stops moving up.
+        if (callerContext.Rip == 0 || callerContext.Rsp <= (ULONG64)threadStackFrame.StackAddress)
+        {
+            completed = TRUE;
+            break;
+        }
+    }
+
+    if (numberOfFrames == PH_NATIVE_UNWIND_MAXIMUM_FRAMES)
+        completed = TRUE;
+
+    PhFree(unwindContext);
+
+    return completed;
+}
+
 #endif
 
 ULONG64 __stdcall PhGetModuleBase64(
@@ -1661,6 +2932,20 @@ NTSTATUS PhWalkThreadStack(
             )))
             goto SkipAmd64Stack;
 
+        // Unwind as much of the stack as possible using the unwind tables of the modules known
+        // to the symbol provider. This doesn't need the symbol lock, so walking the stacks of
+        // many threads doesn't serialize on dbghelp. dbghelp continues from the first frame we
+        // can't unwind, for example code described by dynamic function tables.
+        if (SymbolProvider)
+        {
+            BOOLEAN cancelled;
+
+            if (PhpWalkNativeStackAmd64(ProcessHandle, SymbolProvider, &context, Callback, Context, &cancelled))
+                goto SkipAmd64Stack;
+            if (cancelled)
+                goto ResumeExit;
+        }
+
         memset(&stackFrame, 0, sizeof(STACKFRAME64));
         stackFrame.AddrPC.Mode = AddrModeFlat;
         stackFrame.AddrPC.Offset = context.Rip;
@@ -0,0 +1,328 @@
+/*
+ * Process Hacker -
+ *   TraceLogging self-instrumentation
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Events are written in the self-describing TraceLogging format, but without
+ * TraceLoggingProvider.h: that header imports EventRegister and EventWriteTransfer statically,
+ * and phlib still has to load on Windows XP. The ntdll equivalents are located at run time
+ * instead, and tracing is simply unavailable before Windows 7 (which added
+ * EtwEventWriteTransfer).
+ *
+ * Every event carries the provider metadata (name) and its own event metadata (name and field
+ * types) in two extra data descriptors, which is what allows WPA to decode the events without a
+ * manifest. Start and stop events share an activity ID so that WPA can pair them up as regions.
+ */
+
+#include <phbase.h>
+#include <evntprov.h>
+#include <tracelog.h>
+
+#define PH_TRACE_PROVIDER_NAME "ProcessHacker"
+
+// The name hash GUID of PH_TRACE_PROVIDER_NAME, as used by EventSource and TraceLogging.
+static GUID PhpTraceProviderGuid = { 0x62134317, 0x8f4c, 0x5c63, { 0xa9, 0xad, 0x52, 0x66, 0x1c, 0xfd, 0x4e, 0xaa } };
+
+// TraceLogging encoding
+#define PH_TRACE_CHANNEL 11 // WINEVENT_CHANNEL_TRACELOGGING
+#define PH_TRACE_LEVEL 5 // WINEVENT_LEVEL_VERBOSE
+#define PH_TRACE_OPCODE_START 1
+#define PH_TRACE_OPCODE_STOP 2
+#define PH_TRACE_DESCRIPTOR_TYPE_EVENT_METADATA 1
+#define PH_TRACE_DESCRIPTOR_TYPE_PROVIDER_METADATA 2
+#define PH_TRACE_IN_UNICODESTRING 1
+#define PH_TRACE_IN_ANSISTRING 2
+#define PH_TRACE_IN_UINT32 8
+#define PH_TRACE_IN_HEXINT64 21
+
+#define PH_TRACE_EVENT_PROVIDER_SET_TRAITS 2 // EventProviderSetTraits
+#define PH_TRACE_EVENT_PROVIDER_USE_DESCRIPTOR_TYPE 3 // EventProviderUseDescriptorType
+#define PH_TRACE_ACTIVITY_CTRL_CREATE_ID 3 // EVENT_ACTIVITY_CTRL_CREATE_ID
+
+typedef ULONG (NTAPI *_EtwEventRegister)(
+    _In_ LPCGUID ProviderId,
+    _In_opt_ PENABLECALLBACK EnableCallback,
+    _In_opt_ PVOID CallbackContext,
+    _Out_ PREGHANDLE RegHandle
+    );
+
+typedef ULONG (NTAPI *_EtwEventSetInformation)(
+    _In_ REGHANDLE RegHandle,
+    _In_ ULONG InformationClass,
+    _In_reads_bytes_(InformationLength) PVOID EventInformation,
+    _In_ ULONG InformationLength
+    );
+
+typedef ULONG (NTAPI *_EtwEventWriteTransfer)(
+    _In_ REGHANDLE RegHandle,
+    _In_ PCEVENT_DESCRIPTOR EventDescriptor,
+    _In_opt_ LPCGUID ActivityId,
+    _In_opt_ LPCGUID RelatedActivityId,
+    _In_ ULONG UserDataCount,
+    _In_reads_opt_(UserDataCount) PEVENT_DATA_DESCRIPTOR UserData
+    );
+
+typedef ULONG (NTAPI *_EtwEventActivityIdControl)(
+    _In_ ULONG ControlCode,
+    _Inout_ LPGUID ActivityId
+    );
+
+PHLIBAPI ULONGLONG volatile PhTraceKeywords = 0;
+
+static REGHANDLE PhpTraceRegHandle = 0;
+static _EtwEventWriteTransfer EtwEventWriteTransfer_I = NULL;
+static _EtwEventActivityIdControl EtwEventActivityIdControl_I = NULL;
+// The size (including the size field itself) followed by the provider name.
+static UCHAR PhpTraceProviderMetadata[sizeof(USHORT) + sizeof(PH_TRACE_PROVIDER_NAME)];
+
+static VOID NTAPI PhpTraceEnableCallback(
+    _In_ LPCGUID SourceId,
+    _In_ ULONG IsEnabled,
+    _In_ UCHAR Level,
+    _In_ ULONGLONG MatchAnyKeyword,
+    _In_ ULONGLONG MatchAllKeyword,
+    _In_opt_ PEVENT_FILTER_DESCRIPTOR FilterData,
+    _Inout_opt_ PVOID CallbackContext
+    )
+{
+    // ETW still filters each event for each session, so this only has to be a superset of the
+    // enabled keywords. A keyword mask of 0 enables all keywords.
+    if (IsEnabled == 1)
+        PhTraceKeywords = MatchAnyKeyword ? MatchAnyKeyword : MAXULONG64;
+    else if (IsEnabled == 0)
+        PhTraceKeywords = 0;
+}
+
+BOOLEAN PhTraceInitialization(
+    VOID
+    )
+{
+    PVOID ntdll;
+    _EtwEventRegister etwEventRegister;
+    _EtwEventSetInformation etwEventSetInformation;
+    USHORT size;
+    BOOLEAN useDescriptorType;
+
+    if (WindowsVersion < WINDOWS_7)
+        return TRUE;
+
+    if (!(ntdll = PhGetDllHandle(L"ntdll.dll")))
+        return TRUE;
+
+    etwEventRegister = PhGetProcedureAddress(ntdll, "EtwEventRegister", 0);
+    etwEventSetInformation = PhGetProcedureAddress(ntdll, "EtwEventSetInformation", 0); // Windows 8 and above
+    EtwEventWriteTransfer_I = PhGetProcedureAddress(ntdll, "EtwEventWriteTransfer", 0);
+    EtwEventActivityIdControl_I = PhGetProcedureAddress(ntdll, "EtwEventActivityIdControl", 0);
+
+    if (!etwEventRegister || !EtwEventWriteTransfer_I || !EtwEventActivityIdControl_I)
+        return TRUE;
+
+    size = sizeof(PhpTraceProviderMetadata);
+    memcpy(PhpTraceProviderMetadata, &size, sizeof(USHORT));
+    memcpy(PhpTraceProviderMetadata + sizeof(USHORT), PH_TRACE_PROVIDER_NAME, sizeof(PH_TRACE_PROVIDER_NAME));
+
+    // The enable callback may be called before this returns, if a session is already running.
+    if (etwEventRegister(&PhpTraceProviderGuid, PhpTraceEnableCallback, NULL, &PhpTraceRegHandle) != ERROR_SUCCESS)
+    {
+        PhpTraceRegHandle = 0;
+        PhTraceKeywords = 0;
+        return TRUE;
+    }
+
+    if (etwEventSetInformation)
+    {
+        // Without these, newer versions of ETW record the metadata descriptors as payload.
+        etwEventSetInformation(PhpTraceRegHandle, PH_TRACE_EVENT_PROVIDER_SET_TRAITS,
+            PhpTraceProviderMetadata, sizeof(PhpTraceProviderMetadata));
+        useDescriptorType = TRUE;
+        etwEventSetInformation(PhpTraceRegHandle, PH_TRACE_EVENT_PROVIDER_USE_DESCRIPTOR_TYPE,
+            &useDescriptorType, sizeof(BOOLEAN));
+    }
+
+    return TRUE;
+}
+
+static PUCHAR PhpCreateTraceEventMetadata(
+    _In_ PPH_TRACE_EVENT Event,
+    _In_ BOOLEAN IncludeField
+    )
+{
+    SIZE_T nameLength;
+    SIZE_T fieldNameLength;
+    SIZE_T size;
+    PUCHAR metadata;
+    PUCHAR position;
+    USHORT size16;
+
+    nameLength = strlen(Event->Name) + 1;
+    fieldNameLength = IncludeField ? strlen(Event->FieldName) + 1 : 0;
+
+    // Size, tags, event name, then the field name and its input type.
+    size = sizeof(USHORT) + sizeof(UCHAR) + nameLength;
+
+    if (IncludeField)
+        size += fieldNameLength + sizeof(UCHAR);
+
+    metadata = PhAllocate(size);
+    size16 = (USHORT)size;
+    memcpy(metadata, &size16, sizeof(USHORT));
+    position = metadata + sizeof(USHORT);
+    *position++ = 0; // no tags
+    memcpy(position, Event->Name, nameLength);
+    position += nameLength;
+
+    if (IncludeField)
+    {
+        memcpy(position, Event->FieldName, fieldNameLength);
+        position += fieldNameLength;
+
+        switch (Event->FieldType)
+        {
+        case PhTraceFieldUInt32:
+            *position = PH_TRACE_IN_UINT32;
+            break;
+        case PhTraceFieldPointer:
+            *position = PH_TRACE_IN_HEXINT64;
+            break;
+        case PhTraceFieldAnsiString:
+            *position = PH_TRACE_IN_ANSISTRING;
+            break;
+        case PhTraceFieldUnicodeString:
+            *position = PH_TRACE_IN_UNICODESTRING;
+            break;
+        }
+    }
+
+    return metadata;
+}
+
+static VOID PhpWriteTraceEvent(
+    _In_ PPH_TRACE_EVENT Event,
+    _In_ UCHAR Opcode,
+    _In_ PGUID ActivityId,
+    _In_ PUCHAR Metadata,
+    _In_opt_ PVOID FieldData,
+    _In_ ULONG FieldSize
+    )
+{
+    EVENT_DESCRIPTOR descriptor;
+    EVENT_DATA_DESCRIPTOR data[3];
+
+    descriptor.Id = 0;
+    descriptor.Version = 0;
+    descriptor.Channel = PH_TRACE_CHANNEL;
+    descriptor.Level = PH_TRACE_LEVEL;
+    descriptor.Opcode = Opcode;
+    descriptor.Task = 0;
+    descriptor.Keyword = Event->Keyword;
+
+    EventDataDescCreate(&data[0], PhpTraceProviderMetadata, sizeof(PhpTraceProviderMetadata));
+    data[0].Reserved = PH_TRACE_DESCRIPTOR_TYPE_PROVIDER_METADATA;
+    EventDataDescCreate(&data[1], Metadata, *(PUSHORT)Metadata);
+    data[1].Reserved = PH_TRACE_DESCRIPTOR_TYPE_EVENT_METADATA;
+
+    if (FieldData)
+        EventDataDescCreate(&data[2], FieldData, FieldSize);
+
+    EtwEventWriteTransfer_I(
+        PhpTraceRegHandle,
+        &descriptor,
+        ActivityId,
+        NULL,
+        FieldData ? 3 : 2,
+        data
+        );
+}
+
+/**
+ * Writes a start event. Use PhTraceStartEvent() instead, which avoids the call when no session is
+ * listening.
+ *
+ * \param Event The event.
+ * \param Activity A variable which receives the activity.
+ * \param Value The value of the field of the event.
+ */
+VOID NTAPI PhTraceStart(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _Out_ PPH_TRACE_ACTIVITY Activity,
+    _In_ ULONG64 Value
+    )
+{
+    ULONG value32;
+    PVOID fieldData;
+    ULONG fieldSize;
+
+    Activity->Started = FALSE;
+
+    if (!PhpTraceRegHandle)
+        return;
+
+    if (PhBeginInitOnce(&Event->InitOnce))
+    {
+        Event->StartMetadata = PhpCreateTraceEventMetadata(Event, Event->FieldType != PhTraceFieldNone);
+        Event->StopMetadata = PhpCreateTraceEventMetadata(Event, FALSE);
+        PhEndInitOnce(&Event->InitOnce);
+    }
+
+    memset(&Activity->ActivityId, 0, sizeof(GUID));
+    EtwEventActivityIdControl_I(PH_TRACE_ACTIVITY_CTRL_CREATE_ID, &Activity->ActivityId);
+
+    switch (Event->FieldType)
+    {
+    case PhTraceFieldUInt32:
+        value32 = (ULONG)Value;
+        fieldData = &value32;
+        fieldSize = sizeof(ULONG);
+        break;
+    case PhTraceFieldPointer:
+        fieldData = &Value;
+        fieldSize = sizeof(ULONG64);
+        break;
+    case PhTraceFieldAnsiString:
+        fieldData = Value ? (PSTR)(ULONG_PTR)Value : "";
+        fieldSize = (ULONG)strlen(fieldData) + 1;
+        break;
+    case PhTraceFieldUnicodeString:
+        fieldData = Value ? (PWSTR)(ULONG_PTR)Value : L"";
+        fieldSize = ((ULONG)wcslen(fieldData) + 1) * sizeof(WCHAR);
+        break;
+    default:
+        fieldData = NULL;
+        fieldSize = 0;
+        break;
+    }
+
+    PhpWriteTraceEvent(Event, PH_TRACE_OPCODE_START, &Activity->ActivityId, Event->StartMetadata, fieldData, fieldSize);
+    Activity->Started = TRUE;
+}
+
+/**
+ * Writes a stop event. Use PhTraceStopEvent() instead, which only writes the event if the start
+ * event was written.
+ *
+ * \param Event The event.
+ * \param Activity The activity of the start event.
+ */
+VOID NTAPI PhTraceStop(
+    _Inout_ PPH_TRACE_EVENT Event,
+    _In_ PPH_TRACE_ACTIVITY Activity
+    )
+{
+    PhpWriteTraceEvent(Event, PH_TRACE_OPCODE_STOP, &Activity->ActivityId, Event->StopMetadata, NULL, 0);
+}
@@ -49,11 +49,15 @@
 #include <vssym32.h>
 #include <treenew.h>
 #include <treenewp.h>
+#include <tracelog.h>
 
 static PVOID ComCtl32Handle;
 static LONG SmallIconWidth;
 static LONG SmallIconHeight;
 
+PH_TRACE_EVENT_DECLARE(PhpTreeNewPaintTraceEvent, "TreeNewPaint", PH_TRACE_KEYWORD_TREENEW, "Window", PhTraceFieldPointer);
+PH_TRACE_EVENT_DECLARE(PhpTreeNewSortTraceEvent, "TreeNewSort", PH_TRACE_KEYWORD_TREENEW, "Column", PhTraceFieldUInt32);
+
 BOOLEAN PhTreeNewInitialization(
     VOID
     )
@@ -134,7 +138,11 @@ LRESULT CALLBACK PhTnpWndProc(
         return TRUE;
     case WM_PAINT:
         {
+            PH_TRACE_ACTIVITY traceActivity;
+
+            PhTraceStartEvent(&PhpTreeNewPaintTraceEvent, &traceActivity, (ULONG_PTR)hwnd);
             PhTnpOnPaint(hwnd, context);
+            PhTraceStopEvent(&PhpTreeNewPaintTraceEvent, &traceActivity);
         }
         return 0;
     case WM_PRINTCLIENT:
@@ -379,6 +387,8 @@ VOID PhTnpDestroyTreeNewContext(
     if (Context->BufferedContext)
         PhTnpDestroyBufferedContext(Context);
 
+    PhTnpResetDamageTracking(Context);
+
     if (Context->SuspendUpdateRegion)
         DeleteObject(Context->SuspendUpdateRegion);
 
@@ -600,6 +610,15 @@ VOID PhTnpOnPaint(
     RECT updateRect;
     HDC hdc;
     PAINTSTRUCT paintStruct;
+    HRGN updateRegion;
+    union
+    {
+        RGNDATA RegionData;
+        UCHAR Buffer[sizeof(RGNDATAHEADER) + sizeof(RECT) * TNP_MAXIMUM_PAINT_RECTS];
+    } regionBuffer;
+    PRECT paintRects;
+    ULONG numberOfPaintRects;
+    ULONG i;
 
     if (GetUpdateRect(hwnd, &updateRect, FALSE) && (updateRect.left | updateRect.right | updateRect.top | updateRect.bottom))
     {
@@ -635,24 +654,58 @@ VOID PhTnpOnPaint(
             }
         }
 
+        // When only a few scattered cells have changed, the bounding box of the update region can
+        // cover most of the window. Keep the individual rectangles so we only paint and blit those.
+
+        paintRects = NULL;
+        numberOfPaintRects = 0;
+
+        if (Context->BufferedContext)
+        {
+            updateRegion = CreateRectRgn(0, 0, 0, 0);
+
+            if (GetUpdateRgn(hwnd, updateRegion, FALSE) == COMPLEXREGION &&
+                GetRegionData(updateRegion, 0, NULL) <= sizeof(regionBuffer) &&
+                GetRegionData(updateRegion, sizeof(regionBuffer), &regionBuffer.RegionData) &&
+                regionBuffer.RegionData.rdh.iType == RDH_RECTANGLES)
+            {
+                paintRects = (PRECT)regionBuffer.RegionData.Buffer;
+                numberOfPaintRects = regionBuffer.RegionData.rdh.nCount;
+            }
+
+            DeleteObject(updateRegion);
+        }
+
         if (hdc = BeginPaint(hwnd, &paintStruct))
         {
             updateRect = paintStruct.rcPaint;
 
+            if (!paintRects)
+            {
+                paintRects = &updateRect;
+                numberOfPaintRects = 1;
+            }
+
             if (Context->BufferedContext)
             {
-                PhTnpPaint(hwnd, Context, Context->BufferedContext, &updateRect);
-                BitBlt(
-                    hdc,
-                    updateRect.left,
-                    updateRect.top,
-                    updateRect.right - updateRect.left,
-                    updateRect.bottom - updateRect.top,
-                    Context->BufferedContext,
-                    updateRect.left,
-                    updateRect.top,
-                    SRCCOPY
-                    );
+                for (i = 0; i < numberOfPaintRects; i++)
+                {
+                    PhTnpPaint(hwnd, Context, Context->BufferedContext, &paintRects[i]);
+                    BitBlt(
+                        hdc,
+                        paintRects[i].left,
+                        paintRects[i].top,
+                        paintRects[i].right - paintRects[i].left,
+                        paintRects[i].bottom - paintRects[i].top,
+                        Context->BufferedContext,
+                        paintRects[i].left,
+                        paintRects[i].top,
+                        SRCCOPY
+                        );
+
+                    if (Context->ExtendedFlags & TN_FLAG_DAMAGE_TRACKING)
+                        PhTnpRecordPaintedCells(Context, &paintRects[i]);
+                }
             }
             else
             {
@@ -1002,8 +1055,8 @@ VOID PhTnpOnXxxButtonXxx(
 
                 if (saveIndex == -1)
                     hitTest.Node = NULL;
-                else if (saveIndex < Context->FlatList->Count)
-                    hitTest.Node = Context->FlatList->Items[saveIndex];
+                else if (saveIndex < PhTnpGetFlatNodeCount(Context))
+                    hitTest.Node = PhTnpGetFlatNode(Context, saveIndex);
                 else
                     return;
 
@@ -1230,6 +1283,7 @@ VOID PhTnpOnContextMenu(
     if (CursorScreenX == -1 && CursorScreenY == -1)
     {
         ULONG i;
+        PPH_TREENEW_NODE node;
         BOOLEAN found;
         RECT windowRect;
         RECT rect;
@@ -1241,9 +1295,9 @@ VOID PhTnpOnContextMenu(
 
         found = FALSE;
 
-        for (i = 0; i < Context->FlatList->Count; i++)
+        for (i = 0; i < PhTnpGetFlatNodeCount(Context); i++)
         {
-            if (((PPH_TREENEW_NODE)Context->FlatList->Items[i])->Selected)
+            if ((node = PhTnpGetExistingFlatNode(Context, i)) && node->Selected)
             {
                 found = TRUE;
                 break;
@@ -1326,7 +1380,7 @@ VOID PhTnpOnVScroll(
     case SB_THUMBPOSITION:
         // Touch scrolling seems to give us Position but not nTrackPos. The problem is that
         // Position is a 16-bit value, so don't use it if we have too many rows.
-        if (Context->FlatList->Count <= 0xffff)
+        if (PhTnpGetFlatNodeCount(Context) <= 0xffff)
             scrollInfo.nPos = Position;
         break;
     case SB_THUMBTRACK:
@@ -1383,7 +1437,7 @@ VOID PhTnpOnHScroll(
     case SB_THUMBPOSITION:
         // Touch scrolling seems to give us Position but not nTrackPos. The problem is that
         // Position is a 16-bit value, so don't use it if we have too many rows.
-        if (Context->FlatList->Count <= 0xffff)
+        if (PhTnpGetFlatNodeCount(Context) <= 0xffff)
             scrollInfo.nPos = Position;
         break;
     case SB_THUMBTRACK:
@@ -1486,7 +1540,7 @@ BOOLEAN PhTnpOnNotify(
                             Context->ResizingColumn = NULL;
 
                             // Redraw the entire window if we are displaying empty text.
-                            if (Context->FlatList->Count == 0 && Context->EmptyText.Length != 0)
+                            if (PhTnpGetFlatNodeCount(Context) == 0 && Context->EmptyText.Length != 0)
                                 InvalidateRect(Context->Handle, NULL, FALSE);
                         }
                         else
@@ -1631,6 +1685,17 @@ ULONG_PTR PhTnpOnUserMessage(
                 Context->Callback = PhTnpNullCallback;
         }
         return TRUE;
+    case TNM_SETVIRTUALCOUNT:
+        {
+            if (!Context->VirtualMode)
+            {
+                Context->VirtualMode = TRUE;
+                PhClearList(Context->FlatList);
+            }
+
+            Context->VirtualCount = (ULONG)WParam;
+        }
+        // Fall through to restructure.
     case TNM_NODESSTRUCTURED:
         {
             if (Context->EnableRedraw <= 0)
@@ -1643,7 +1708,11 @@ ULONG_PTR PhTnpOnUserMessage(
 
             PhTnpRestructureNodes(Context);
             PhTnpLayout(Context);
-            InvalidateRect(Context->Handle, NULL, FALSE);
+
+            if (Context->ExtendedFlags & TN_FLAG_DAMAGE_TRACKING)
+                PhTnpInvalidateChangedCells(Context);
+            else
+                InvalidateRect(Context->Handle, NULL, FALSE);
         }
         return TRUE;
     case TNM_ADDCOLUMN:
@@ -1745,7 +1814,7 @@ ULONG_PTR PhTnpOnUserMessage(
 
             PhTnpSetColumnHeaderSortIcon(Context, column);
 
-            Context->Callback(Context->Handle, TreeNewSortChanged, NULL, NULL, Context->CallbackContext);
+            PhTnpNotifySortChanged(Context);
         }
         return TRUE;
     case TNM_SETTRISTATE:
@@ -1758,17 +1827,17 @@ ULONG_PTR PhTnpOnUserMessage(
         return TRUE;
     case TNM_GETFLATNODECOUNT:
         if (!Context->SuspendUpdateStructure)
-            return (LRESULT)Context->FlatList->Count;
+            return (LRESULT)PhTnpGetFlatNodeCount(Context);
         else
             return 0;
     case TNM_GETFLATNODE:
         {
             ULONG index = (ULONG)WParam;
 
-            if (index >= Context->FlatList->Count)
+            if (index >= PhTnpGetFlatNodeCount(Context))
                 return (LRESULT)NULL;
 
-            return (LRESULT)Context->FlatList->Items[index];
+            return (LRESULT)PhTnpGetFlatNode(Context, index);
         }
         break;
     case TNM_GETCELLTEXT:
@@ -1961,6 +2030,17 @@ ULONG_PTR PhTnpOnUserMessage(
         return TRUE;
     case TNM_ISFLATNODEVALID:
         return !Context->SuspendUpdateStructure;
+    case TNM_INVALIDATECHANGEDCELLS:
+        {
+            if (Context->EnableRedraw <= 0 || Context->SuspendUpdateStructure || !(Context->ExtendedFlags & TN_FLAG_DAMAGE_TRACKING))
+            {
+                InvalidateRect(Context->Handle, NULL, FALSE);
+                return TRUE;
+            }
+
+            PhTnpInvalidateChangedCells(Context);
+        }
+        return TRUE;
     }
 
     return 0;
@@ -2185,7 +2265,7 @@ VOID PhTnpLayout(
     PhTnpLayoutHeader(Context);
 
     // Redraw the entire window if we are displaying empty text.
-    if (Context->FlatList->Count == 0 && Context->EmptyText.Length != 0)
+    if (PhTnpGetFlatNodeCount(Context) == 0 && Context->EmptyText.Length != 0)
         InvalidateRect(Context->Handle, NULL, FALSE);
 }
 
@@ -2980,7 +3060,19 @@ VOID PhTnpProcessSortColumn(
 
     PhTnpSetColumnHeaderSortIcon(Context, NewColumn);
 
+    PhTnpNotifySortChanged(Context);
+}
+
+VOID PhTnpNotifySortChanged(
+    _In_ PPH_TREENEW_CONTEXT Context
+    )
+{
+    PH_TRACE_ACTIVITY traceActivity;
+
+    // The owner sorts its nodes in response to this notification.
+    PhTraceStartEvent(&PhpTreeNewSortTraceEvent, &traceActivity, Context->SortColumn);
     Context->Callback(Context->Handle, TreeNewSortChanged, NULL, NULL, Context->CallbackContext);
+    PhTraceStopEvent(&PhpTreeNewSortTraceEvent, &traceActivity);
 }
 
 BOOLEAN PhTnpSetColumnHeaderSortIcon(
@@ -3065,18 +3157,31 @@ VOID PhTnpAutoSizeColumnHeader(
     else
     {
         ULONG i;
+        ULONG start;
+        ULONG end;
         LONG maximumWidth;
         PH_TREENEW_CELL_PARTS parts;
         LONG width;
 
-        if (Context->FlatList->Count == 0)
+        if (PhTnpGetFlatNodeCount(Context) == 0)
             return;
         if (Column->CustomDraw)
             return;
 
+        start = 0;
+        end = PhTnpGetFlatNodeCount(Context);
+
+        if (Context->VirtualMode)
+        {
+            // Measuring every row would make the model create a node for each one, so only
+            // measure the rows in view.
+            start = Context->VScrollPosition;
+            end = min(end, start + (ULONG)((Context->ClientRect.bottom - Context->HeaderHeight) / Context->RowHeight) + 1);
+        }
+
         maximumWidth = 0;
 
-        for (i = 0; i < Context->FlatList->Count; i++)
+        for (i = start; i < end; i++)
         {
             if (PhTnpGetCellParts(Context, i, Column, TN_MEASURE_TEXT, &parts) &&
                 (parts.Flags & TN_PART_CELL) && (parts.Flags & TN_PART_CONTENT) && (parts.Flags & TN_PART_TEXT))
@@ -3158,6 +3263,43 @@ BOOLEAN PhTnpIsNodeLeaf(
     return FALSE;
 }
 
+PPH_TREENEW_NODE PhTnpGetVirtualNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ ULONG Index,
+    _In_ BOOLEAN ExistingOnly
+    )
+{
+    PH_TREENEW_GET_VIRTUAL_NODE getVirtualNode;
+    PPH_TREENEW_NODE node;
+
+    getVirtualNode.Flags = ExistingOnly ? TN_VIRTUAL_NODE_EXISTING_ONLY : 0;
+    getVirtualNode.Index = Index;
+    getVirtualNode.Node = NULL;
+
+    Context->Callback(
+        Context->Handle,
+        TreeNewGetVirtualNode,
+        &getVirtualNode,
+        NULL,
+        Context->CallbackContext
+        );
+
+    node = getVirtualNode.Node;
+    assert(node || ExistingOnly);
+
+    if (node)
+    {
+        // Virtual rows are always flat. The index is refreshed on every request because the
+        // model may have reordered its rows since the node was last handed out.
+        node->Index = Index;
+        node->Level = 0;
+        node->Visible = TRUE;
+        node->s.IsLeaf = TRUE;
+    }
+
+    return node;
+}
+
 BOOLEAN PhTnpGetCellText(
     _In_ PPH_TREENEW_CONTEXT Context,
     _In_ PPH_TREENEW_NODE Node,
@@ -3167,10 +3309,18 @@ BOOLEAN PhTnpGetCellText(
 {
     PH_TREENEW_GET_CELL_TEXT getCellText;
 
-    if (Id < Node->TextCacheSize && Node->TextCache[Id].Buffer)
+    if (Id < Node->TextCacheSize)
     {
-        *Text = Node->TextCache[Id];
-        return TRUE;
+        if (Node->TextCacheDirtyMask && (Node->TextCacheDirtyMask[Id / 32] & ((ULONG)1 << (Id % 32))))
+        {
+            Node->TextCacheDirtyMask[Id / 32] &= ~((ULONG)1 << (Id % 32));
+            PhInitializeEmptyStringRef(&Node->TextCache[Id]);
+        }
+        else if (Node->TextCache[Id].Buffer)
+        {
+            *Text = Node->TextCache[Id];
+            return TRUE;
+        }
     }
 
     getCellText.Flags = 0;
@@ -3205,6 +3355,23 @@ VOID PhTnpRestructureNodes(
     ULONG numberOfChildren;
     ULONG i;
 
+    if (Context->VirtualMode)
+    {
+        // The model owns the row order and may have freed any node it gave us, so the focused
+        // node cannot be preserved.
+
+        Context->FocusNode = NULL;
+        Context->CanAnyExpand = FALSE;
+
+        if (Context->HotNodeIndex >= Context->VirtualCount)
+            Context->HotNodeIndex = -1;
+
+        if (Context->MarkNodeIndex >= Context->VirtualCount)
+            Context->MarkNodeIndex = -1;
+
+        return;
+    }
+
     if (!PhTnpGetNodeChildren(Context, NULL, &children, &numberOfChildren))
         return;
 
@@ -3219,21 +3386,22 @@ VOID PhTnpRestructureNodes(
 
     for (i = 0; i < numberOfChildren; i++)
     {
-        PhTnpInsertNodeChildren(Context, children[i], 0);
+        PhTnpInsertNodeChildren(Context, Context->FlatList, children[i], 0);
     }
 
     if (!Context->FocusNodeFound)
         Context->FocusNode = NULL; // focused node is no longer present
 
-    if (Context->HotNodeIndex >= Context->FlatList->Count) // covers -1 case as well
+    if (Context->HotNodeIndex >= PhTnpGetFlatNodeCount(Context)) // covers -1 case as well
         Context->HotNodeIndex = -1;
 
-    if (Context->MarkNodeIndex >= Context->FlatList->Count)
+    if (Context->MarkNodeIndex >= PhTnpGetFlatNodeCount(Context))
         Context->MarkNodeIndex = -1;
 }
 
 VOID PhTnpInsertNodeChildren(
     _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PPH_LIST List,
     _In_ PPH_TREENEW_NODE Node,
     _In_ ULONG Level
     )
@@ -3247,8 +3415,8 @@ VOID PhTnpInsertNodeChildren(
     {
         Node->Level = Level;
 
-        Node->Index = Context->FlatList->Count;
-        PhAddItemList(Context->FlatList, Node);
+        Node->Index = List->Count;
+        PhAddItemList(List, Node);
 
         if (Context->FocusNode == Node)
             Context->FocusNodeFound = TRUE;
@@ -3270,7 +3438,7 @@ VOID PhTnpInsertNodeChildren(
             {
                 for (i = 0; i < numberOfChildren; i++)
                 {
-                    PhTnpInsertNodeChildren(Context, children[i], nextLevel);
+                    PhTnpInsertNodeChildren(Context, List, children[i], nextLevel);
                 }
 
                 if (numberOfChildren == 0)
@@ -3280,6 +3448,107 @@ VOID PhTnpInsertNodeChildren(
     }
 }
 
+BOOLEAN PhTnpSpliceExpandedNode(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PPH_TREENEW_NODE Node
+    )
+{
+    ULONG start;
+    ULONG count;
+    ULONG i;
+    PPH_TREENEW_NODE node;
+
+    // Only the subtree below the node has changed, so we insert or remove that range of the flat
+    // list instead of walking the entire hierarchy again. If the flat list is out of date we let
+    // the caller do a full restructure.
+
+    if (Context->VirtualMode || Context->SuspendUpdateStructure)
+        return FALSE;
+    if (!Node->Visible || Node->s.IsLeaf)
+        return FALSE;
+    if (Node->Index >= Context->FlatList->Count || Context->FlatList->Items[Node->Index] != Node)
+        return FALSE;
+
+    start = Node->Index + 1;
+
+    if (Node->Expanded)
+    {
+        PPH_TREENEW_NODE *children;
+        ULONG numberOfChildren;
+        PPH_LIST list;
+
+        if (!PhTnpGetNodeChildren(Context, Node, &children, &numberOfChildren))
+            return FALSE;
+
+        list = PhCreateList(numberOfChildren != 0 ? numberOfChildren : 1);
+
+        for (i = 0; i < numberOfChildren; i++)
+        {
+            PhTnpInsertNodeChildren(Context, list, children[i], Node->Level + 1);
+        }
+
+        if (numberOfChildren == 0)
+            Node->s.IsLeaf = TRUE;
+
+        count = list->Count;
+
+        if (count != 0)
+            PhInsertItemsList(Context->FlatList, start, list->Items, count);
+
+        PhDereferenceObject(list);
+
+        if (Context->HotNodeIndex != -1 && Context->HotNodeIndex >= start)
+            Context->HotNodeIndex += count;
+        if (Context->MarkNodeIndex != -1 && Context->MarkNodeIndex >= start)
+            Context->MarkNodeIndex += count;
+    }
+    else
+    {
+        for (i = start; i < Context->FlatList->Count; i++)
+        {
+            node = Context->FlatList->Items[i];
+
+            if (node->Level <= Node->Level)
+                break; // no more children
+        }
+
+        count = i - start;
+
+        if (Context->FocusNode && Context->FocusNode->Index >= start && Context->FocusNode->Index < start + count &&
+            Context->FlatList->Items[Context->FocusNode->Index] == Context->FocusNode)
+        {
+            Context->FocusNode = NULL; // focused node is no longer present
+        }
+
+        if (count != 0)
+            PhRemoveItemsList(Context->FlatList, start, count);
+
+        if (Context->HotNodeIndex != -1 && Context->HotNodeIndex >= start)
+        {
+            if (Context->HotNodeIndex >= start + count)
+                Context->HotNodeIndex -= count;
+            else
+                Context->HotNodeIndex = -1;
+        }
+
+        if (Context->MarkNodeIndex != -1 && Context->MarkNodeIndex >= start)
+        {
+            if (Context->MarkNodeIndex >= start + count)
+                Context->MarkNodeIndex -= count;
+            else
+                Context->MarkNodeIndex = -1;
+        }
+    }
+
+    for (i = start; i < Context->FlatList->Count; i++)
+    {
+        node = Context->FlatList->Items[i];
+        node->Index = i;
+    }
+
+    return TRUE;
+}
+
 VOID PhTnpSetExpandedNode(
     _In_ PPH_TREENEW_CONTEXT Context,
     _In_ PPH_TREENEW_NODE Node,
@@ -3307,9 +3576,9 @@ VOID PhTnpSetExpandedNode(
 
                 changed = FALSE;
 
-                for (i = Node->Index + 1; i < Context->FlatList->Count; i++)
+                for (i = Node->Index + 1; i < PhTnpGetFlatNodeCount(Context); i++)
                 {
-                    node = Context->FlatList->Items[i];
+                    node = PhTnpGetFlatNode(Context, i);
 
                     if (node->Level <= Node->Level)
                         break; // no more children
@@ -3328,7 +3597,10 @@ VOID PhTnpSetExpandedNode(
             }
 
             Node->Expanded = Expanded;
-            PhTnpRestructureNodes(Context);
+
+            if (!PhTnpSpliceExpandedNode(Context, Node))
+                PhTnpRestructureNodes(Context);
+
             // We need to update the window before the scrollbars get updated in order for the scroll processing
             // to work properly.
             InvalidateRect(Context->Handle, NULL, FALSE);
@@ -3352,10 +3624,10 @@ BOOLEAN PhTnpGetCellParts(
     LONG iconVerticalMargin;
     LONG currentX;
 
-    if (Index >= Context->FlatList->Count)
+    if (Index >= PhTnpGetFlatNodeCount(Context))
         return FALSE;
 
-    node = Context->FlatList->Items[Index];
+    node = PhTnpGetFlatNode(Context, Index);
     nodeY = Context->HeaderHeight + ((LONG)Index - Context->VScrollPosition) * Context->RowHeight;
 
     Parts->Flags = 0;
@@ -3492,7 +3764,7 @@ BOOLEAN PhTnpGetRowRects(
     LONG endY;
     LONG viewWidth;
 
-    if (End >= Context->FlatList->Count)
+    if (End >= PhTnpGetFlatNodeCount(Context))
         return FALSE;
     if (Start > End)
         return FALSE;
@@ -3560,10 +3832,10 @@ VOID PhTnpHitTest(
         {
             index = (y - Context->HeaderHeight) / Context->RowHeight + Context->VScrollPosition;
 
-            if (index < Context->FlatList->Count)
+            if (index < PhTnpGetFlatNodeCount(Context))
             {
                 HitTest->Flags |= TN_HIT_ITEM;
-                node = Context->FlatList->Items[index];
+                node = PhTnpGetFlatNode(Context, index);
                 HitTest->Node = node;
 
                 if (HitTest->InFlags & TN_TEST_COLUMN)
@@ -3661,10 +3933,10 @@ VOID PhTnpSelectRange(
     ULONG changedStart;
     ULONG changedEnd;
 
-    if (Context->FlatList->Count == 0)
+    if (PhTnpGetFlatNodeCount(Context) == 0)
         return;
 
-    maximum = Context->FlatList->Count - 1;
+    maximum = PhTnpGetFlatNodeCount(Context) - 1;
 
     if (End > maximum)
     {
@@ -3687,9 +3959,9 @@ VOID PhTnpSelectRange(
     {
         for (i = 0; i < Start; i++)
         {
-            node = Context->FlatList->Items[i];
+            node = PhTnpGetExistingFlatNode(Context, i);
 
-            if (node->Selected)
+            if (node && node->Selected)
             {
                 node->Selected = FALSE;
 
@@ -3703,7 +3975,16 @@ VOID PhTnpSelectRange(
 
     for (i = Start; i <= End; i++)
     {
-        node = Context->FlatList->Items[i];
+        if (!targetValue && !(Flags & TN_SELECT_TOGGLE))
+        {
+            // Rows without a node are never selected, so there is nothing to deselect.
+            if (!(node = PhTnpGetExistingFlatNode(Context, i)))
+                continue;
+        }
+        else
+        {
+            node = PhTnpGetFlatNode(Context, i);
+        }
 
         if (!node->Unselectable && ((Flags & TN_SELECT_TOGGLE) || node->Selected != targetValue))
         {
@@ -3720,9 +4001,9 @@ VOID PhTnpSelectRange(
     {
         for (i = End + 1; i <= maximum; i++)
         {
-            node = Context->FlatList->Items[i];
+            node = PhTnpGetExistingFlatNode(Context, i);
 
-            if (node->Selected)
+            if (node && node->Selected)
             {
                 node->Selected = FALSE;
 
@@ -3889,7 +4170,7 @@ BOOLEAN PhTnpEnsureVisibleNode(
     LONG deltaY;
     LONG deltaRows;
 
-    if (Index >= Context->FlatList->Count)
+    if (Index >= PhTnpGetFlatNodeCount(Context))
         return FALSE;
 
     viewTop = Context->HeaderHeight;
@@ -4116,7 +4397,7 @@ BOOLEAN PhTnpProcessFocusKey(
         return FALSE;
     }
 
-    count = Context->FlatList->Count;
+    count = PhTnpGetFlatNodeCount(Context);
 
     if (count == 0)
         return TRUE;
@@ -4228,7 +4509,7 @@ BOOLEAN PhTnpProcessFocusKey(
     controlKey = GetKeyState(VK_CONTROL) < 0;
     shiftKey = GetKeyState(VK_SHIFT) < 0;
 
-    Context->FocusNode = Context->FlatList->Items[index];
+    Context->FocusNode = PhTnpGetFlatNode(Context, index);
     PhTnpSetHotNode(Context, Context->FocusNode, FALSE);
 
     if (shiftKey && Context->MarkNodeIndex != -1)
@@ -4353,7 +4634,7 @@ BOOLEAN PhTnpProcessNodeKey(
                 while (i != 0)
                 {
                     i--;
-                    newNode = Context->FlatList->Items[i];
+                    newNode = PhTnpGetFlatNode(Context, i);
 
                     if (newNode->Level == targetLevel)
                     {
@@ -4390,9 +4671,9 @@ BOOLEAN PhTnpProcessNodeKey(
                 }
                 else
                 {
-                    if (Context->FocusNode->Index + 1 < Context->FlatList->Count)
+                    if (Context->FocusNode->Index + 1 < PhTnpGetFlatNodeCount(Context))
                     {
-                        newNode = Context->FlatList->Items[Context->FocusNode->Index + 1];
+                        newNode = PhTnpGetFlatNode(Context, Context->FocusNode->Index + 1);
 
                         if (newNode->Level == Context->FocusNode->Level + 1)
                         {
@@ -4432,7 +4713,7 @@ VOID PhTnpProcessSearchKey(
     ULONG changedEnd;
     RECT rect;
 
-    if (Context->FlatList->Count == 0)
+    if (PhTnpGetFlatNodeCount(Context) == 0)
         return;
 
     messageTime = GetMessageTime();
@@ -4495,7 +4776,7 @@ VOID PhTnpProcessSearchKey(
             // If it's a new search, start at the next item so the user doesn't find the same item again.
             searchEvent.StartIndex++;
 
-            if (searchEvent.StartIndex == Context->FlatList->Count)
+            if (searchEvent.StartIndex == PhTnpGetFlatNodeCount(Context))
                 searchEvent.StartIndex = 0;
         }
     }
@@ -4535,10 +4816,10 @@ VOID PhTnpProcessSearchKey(
         return;
     }
 
-    if (searchEvent.FoundIndex < 0 || searchEvent.FoundIndex >= (LONG)Context->FlatList->Count)
+    if (searchEvent.FoundIndex < 0 || searchEvent.FoundIndex >= (LONG)PhTnpGetFlatNodeCount(Context))
         return;
 
-    foundNode = Context->FlatList->Items[searchEvent.FoundIndex];
+    foundNode = PhTnpGetFlatNode(Context, searchEvent.FoundIndex);
     Context->FocusNode = foundNode;
     PhTnpEnsureVisibleNode(Context, searchEvent.FoundIndex);
     PhTnpSetHotNode(Context, foundNode, FALSE);
@@ -4564,7 +4845,7 @@ BOOLEAN PhTnpDefaultIncrementalSearch(
     LONG foundIndex;
     BOOLEAN firstTime;
 
-    if (Context->FlatList->Count == 0)
+    if (PhTnpGetFlatNodeCount(Context) == 0)
         return FALSE;
     if (!Context->FirstColumn)
         return FALSE;
@@ -4578,7 +4859,7 @@ BOOLEAN PhTnpDefaultIncrementalSearch(
     {
         PH_STRINGREF text;
 
-        if (currentIndex >= (LONG)Context->FlatList->Count)
+        if (currentIndex >= (LONG)PhTnpGetFlatNodeCount(Context))
         {
             if (Wrap)
                 currentIndex = 0;
@@ -4594,7 +4875,7 @@ BOOLEAN PhTnpDefaultIncrementalSearch(
         if (!firstTime && currentIndex == startIndex)
             break;
 
-        if (PhTnpGetCellText(Context, Context->FlatList->Items[currentIndex], Context->FirstColumn->Id, &text))
+        if (PhTnpGetCellText(Context, PhTnpGetFlatNode(Context, currentIndex), Context->FirstColumn->Id, &text))
         {
             if (Partial)
             {
@@ -4644,7 +4925,7 @@ VOID PhTnpUpdateScrollBars(
     height = clientRect.bottom - Context->HeaderHeight;
 
     contentWidth = Context->TotalViewX;
-    contentHeight = (LONG)Context->FlatList->Count * Context->RowHeight;
+    contentHeight = (LONG)PhTnpGetFlatNodeCount(Context) * Context->RowHeight;
 
     if (contentHeight > height)
     {
@@ -4669,7 +4950,7 @@ VOID PhTnpUpdateScrollBars(
 
     scrollInfo.fMask = SIF_RANGE | SIF_PAGE;
     scrollInfo.nMin = 0;
-    scrollInfo.nMax = Context->FlatList->Count != 0 ? Context->FlatList->Count - 1 : 0;
+    scrollInfo.nMax = PhTnpGetFlatNodeCount(Context) != 0 ? PhTnpGetFlatNodeCount(Context) - 1 : 0;
     scrollInfo.nPage = height / Context->RowHeight;
     SetScrollInfo(Context->VScrollHandle, SB_CTL, &scrollInfo, TRUE);
 
@@ -4761,7 +5042,7 @@ VOID PhTnpScroll(
         if (DeltaRows == MINLONG)
             scrollInfo.nPos = 0;
         else if (DeltaRows == MAXLONG)
-            scrollInfo.nPos = Context->FlatList->Count - 1;
+            scrollInfo.nPos = PhTnpGetFlatNodeCount(Context) - 1;
         else
             scrollInfo.nPos += DeltaRows;
 
@@ -4823,7 +5104,7 @@ VOID PhTnpProcessScroll(
     else
     {
         // Don't scroll if there are no rows. This is especially important if the user wants us to display empty text.
-        if (Context->FlatList->Count != 0)
+        if (PhTnpGetFlatNodeCount(Context) != 0)
         {
             deltaY = DeltaRows * Context->RowHeight;
 
@@ -4949,8 +5230,8 @@ VOID PhTnpPaint(
     firstRowToUpdate += vScrollPosition;
     lastRowToUpdate += vScrollPosition;
 
-    if (lastRowToUpdate >= (LONG)Context->FlatList->Count)
-        lastRowToUpdate = Context->FlatList->Count - 1; // becomes -1 when there are no items, handled correctly by loop below
+    if (lastRowToUpdate >= (LONG)PhTnpGetFlatNodeCount(Context))
+        lastRowToUpdate = PhTnpGetFlatNodeCount(Context) - 1; // becomes -1 when there are no items, handled correctly by loop below
 
     // Determine whether the fixed column needs painting, and which normal columns need painting.
 
@@ -4999,7 +5280,7 @@ VOID PhTnpPaint(
 
     for (i = firstRowToUpdate; i <= lastRowToUpdate; i++)
     {
-        node = Context->FlatList->Items[i];
+        node = PhTnpGetFlatNode(Context, i);
 
         // Prepare the row for drawing.
 
@@ -5119,7 +5400,7 @@ VOID PhTnpPaint(
         rowRect.bottom += Context->RowHeight;
     }
 
-    if (lastRowToUpdate == Context->FlatList->Count - 1) // works even if there are no items
+    if (lastRowToUpdate == PhTnpGetFlatNodeCount(Context) - 1) // works even if there are no items
     {
         // Fill the rest of the space on the bottom with the window color.
         rowRect.bottom = viewRect.bottom;
@@ -5136,7 +5417,7 @@ VOID PhTnpPaint(
         FillRect(hdc, &rowRect, GetSysColorBrush(COLOR_WINDOW));
     }
 
-    if (Context->FlatList->Count == 0 && Context->EmptyText.Length != 0)
+    if (PhTnpGetFlatNodeCount(Context) == 0 && Context->EmptyText.Length != 0)
     {
         RECT textRect;
 
@@ -5718,6 +5999,327 @@ VOID PhTnpDrawThemedBorder(
     }
 }
 
+/**
+ * Invalidates the visible cells whose contents differ from what was last painted.
+ *
+ * \param Context The tree list context.
+ *
+ * \remarks The hashes recorded by PhTnpRecordPaintedCells() are compared against the current
+ * text and row state of each cell. Consecutive changed cells in the same column are combined
+ * into a single rectangle. Custom drawn columns are always invalidated.
+ */
+VOID PhTnpInvalidateChangedCells(
+    _In_ PPH_TREENEW_CONTEXT Context
+    )
+{
+    PULONG rowHashes;
+    LONG viewRight;
+    LONG x;
+    ULONG i;
+    ULONG j;
+    ULONG runStart;
+    PPH_TREENEW_COLUMN column;
+    RECT cellRect;
+
+    if (PhTnpUpdateDamageGeometry(Context))
+    {
+        InvalidateRect(Context->Handle, NULL, FALSE);
+        return;
+    }
+
+    if (Context->DamageRows == 0)
+        return;
+
+    rowHashes = PhAllocate(Context->DamageRows * sizeof(ULONG));
+
+    for (i = 0; i < Context->DamageRows; i++)
+        rowHashes[i] = PhTnpGetRowDamageHash(Context, Context->VScrollPosition + i);
+
+    viewRight = Context->ClientRect.right - (Context->VScrollVisible ? Context->VScrollWidth : 0);
+    x = Context->NormalLeft - Context->HScrollPosition;
+
+    for (j = 0; j < Context->DamageColumns; j++)
+    {
+        if (j == 0)
+        {
+            if (!Context->FixedColumnVisible)
+                continue;
+
+            column = Context->FixedColumn;
+            cellRect.left = 0;
+            cellRect.right = Context->FixedWidth;
+        }
+        else
+        {
+            column = Context->ColumnsByDisplay[j - 1];
+            cellRect.left = max(x, Context->NormalLeft);
+            cellRect.right = min(x + column->Width, viewRight);
+            x += column->Width;
+
+            if (cellRect.left >= cellRect.right)
+                continue;
+        }
+
+        runStart = -1;
+
+        for (i = 0; i <= Context->DamageRows; i++)
+        {
+            BOOLEAN changed = FALSE;
+
+            if (i < Context->DamageRows)
+            {
+                ULONG hash;
+
+                hash = PhTnpGetCellDamageHash(Context, Context->VScrollPosition + i, column, rowHashes[i]);
+                changed = hash == 0 || hash != Context->DamageCellHashes[i * Context->DamageColumns + j];
+            }
+
+            if (changed)
+            {
+                if (runStart == -1)
+                    runStart = i;
+            }
+            else if (runStart != -1)
+            {
+                cellRect.top = Context->HeaderHeight + runStart * Context->RowHeight;
+                cellRect.bottom = Context->HeaderHeight + i * Context->RowHeight;
+                InvalidateRect(Context->Handle, &cellRect, FALSE);
+                runStart = -1;
+            }
+        }
+    }
+
+    PhFree(rowHashes);
+}
+
+/**
+ * Records the contents of the cells which have been completely painted.
+ *
+ * \param Context The tree list context.
+ * \param PaintRect The rectangle that was painted.
+ */
+VOID PhTnpRecordPaintedCells(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ PRECT PaintRect
+    )
+{
+    LONG viewRight;
+    LONG firstRow;
+    LONG lastRow;
+    LONG x;
+    LONG i;
+    ULONG j;
+    ULONG rowHash;
+    PPH_TREENEW_COLUMN column;
+    RECT cellRect;
+
+    PhTnpUpdateDamageGeometry(Context);
+
+    viewRight = Context->ClientRect.right - (Context->VScrollVisible ? Context->VScrollWidth : 0);
+    firstRow = (PaintRect->top - Context->HeaderHeight) / Context->RowHeight;
+    lastRow = (PaintRect->bottom - 1 - Context->HeaderHeight) / Context->RowHeight;
+
+    if (firstRow < 0)
+        firstRow = 0;
+    if (lastRow >= (LONG)Context->DamageRows)
+        lastRow = Context->DamageRows - 1;
+
+    for (i = firstRow; i <= lastRow; i++)
+    {
+        rowHash = PhTnpGetRowDamageHash(Context, Context->VScrollPosition + i);
+        cellRect.top = Context->HeaderHeight + i * Context->RowHeight;
+        cellRect.bottom = cellRect.top + Context->RowHeight;
+        x = Context->NormalLeft - Context->HScrollPosition;
+
+        for (j = 0; j < Context->DamageColumns; j++)
+        {
+            if (j == 0)
+            {
+                if (!Context->FixedColumnVisible)
+                    continue;
+
+                column = Context->FixedColumn;
+                cellRect.left = 0;
+                cellRect.right = Context->FixedWidth;
+            }
+            else
+            {
+                column = Context->ColumnsByDisplay[j - 1];
+                cellRect.left = max(x, Context->NormalLeft);
+                cellRect.right = min(x + column->Width, viewRight);
+                x += column->Width;
+            }
+
+            if (cellRect.left >= cellRect.right || cellRect.right <= PaintRect->left || cellRect.left >= PaintRect->right)
+                continue;
+
+            if (cellRect.left >= PaintRect->left && cellRect.right <= PaintRect->right &&
+                cellRect.top >= PaintRect->top && cellRect.bottom <= PaintRect->bottom)
+            {
+                Context->DamageCellHashes[i * Context->DamageColumns + j] =
+                    PhTnpGetCellDamageHash(Context, Context->VScrollPosition + i, column, rowHash);
+            }
+            else
+            {
+                // The cell was only partially painted.
+                Context->DamageCellHashes[i * Context->DamageColumns + j] = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Resets the recorded cell hashes if the layout of the view has changed.
+ *
+ * \param Context The tree list context.
+ *
+ * \return TRUE if the recorded cell hashes were discarded, otherwise FALSE.
+ */
+BOOLEAN PhTnpUpdateDamageGeometry(
+    _In_ PPH_TREENEW_CONTEXT Context
+    )
+{
+    struct
+    {
+        RECT ClientRect;
+        LONG HeaderHeight;
+        LONG RowHeight;
+        LONG VScrollPosition;
+        LONG HScrollPosition;
+        LONG FixedWidth;
+        LONG NormalLeft;
+        ULONG Flags;
+        ULONG NumberOfColumns;
+        ULONG Empty;
+    } geometry;
+    ULONG geometryHash;
+    ULONG numberOfRows;
+    ULONG numberOfColumns;
+    ULONG i;
+
+    memset(&geometry, 0, sizeof(geometry));
+    geometry.ClientRect = Context->ClientRect;
+    geometry.HeaderHeight = Context->HeaderHeight;
+    geometry.RowHeight = Context->RowHeight;
+    geometry.VScrollPosition = Context->VScrollPosition;
+    geometry.HScrollPosition = Context->HScrollPosition;
+    geometry.FixedWidth = Context->FixedWidth;
+    geometry.NormalLeft = Context->NormalLeft;
+    geometry.Flags = Context->VScrollVisible | (Context->HScrollVisible << 1) | (Context->FixedColumnVisible << 2) |
+        (Context->HasFocus << 3) | (Context->ThemeActive << 4) | (Context->DragSelectionActive << 5);
+    geometry.NumberOfColumns = Context->NumberOfColumnsByDisplay;
+    geometry.Empty = PhTnpGetFlatNodeCount(Context) == 0;
+    geometryHash = PhHashBytes((PUCHAR)&geometry, sizeof(geometry));
+
+    for (i = 0; i < Context->NumberOfColumnsByDisplay; i++)
+    {
+        geometryHash ^= PhHashInt32(Context->ColumnsByDisplay[i]->Id ^ (Context->ColumnsByDisplay[i]->Width << 16)) + (geometryHash << 6) + (geometryHash >> 2);
+    }
+
+    numberOfRows = 0;
+
+    if (Context->ClientRect.bottom > Context->HeaderHeight)
+        numberOfRows = (Context->ClientRect.bottom - Context->HeaderHeight + Context->RowHeight - 1) / Context->RowHeight;
+
+    numberOfColumns = Context->NumberOfColumnsByDisplay + 1;
+
+    if (Context->DamageCellHashes && Context->DamageGeometryHash == geometryHash &&
+        Context->DamageRows == numberOfRows && Context->DamageColumns == numberOfColumns)
+    {
+        return FALSE;
+    }
+
+    if (Context->DamageCellHashes)
+        PhFree(Context->DamageCellHashes);
+
+    Context->DamageRows = numberOfRows;
+    Context->DamageColumns = numberOfColumns;
+    Context->DamageGeometryHash = geometryHash;
+    Context->DamageCellHashes = PhAllocate(max(numberOfRows * numberOfColumns, 1) * sizeof(ULONG));
+    memset(Context->DamageCellHashes, 0, max(numberOfRows * numberOfColumns, 1) * sizeof(ULONG));
+
+    return TRUE;
+}
+
+ULONG PhTnpGetRowDamageHash(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ LONG Index
+    )
+{
+    PPH_TREENEW_NODE node;
+    struct
+    {
+        PPH_TREENEW_NODE Node;
+        ULONG Flags;
+        ULONG Level;
+        ULONG Glyph;
+        COLORREF BackColor;
+        COLORREF ForeColor;
+        HFONT Font;
+        HICON Icon;
+        ULONG Hot;
+    } row;
+
+    if (Index < 0 || Index >= (LONG)PhTnpGetFlatNodeCount(Context))
+        return 0;
+
+    node = PhTnpGetFlatNode(Context, Index);
+    PhTnpPrepareRowForDraw(Context, NULL, node);
+
+    memset(&row, 0, sizeof(row));
+    row.Node = node;
+    row.Flags = node->Flags;
+    row.Level = node->Level;
+    row.Glyph = node->s.IsLeaf | (node->s.PlusMinusHot << 1);
+    row.BackColor = node->s.DrawBackColor;
+    row.ForeColor = node->s.DrawForeColor;
+    row.Font = node->Font;
+    row.Icon = node->Icon;
+    row.Hot = Index == (LONG)Context->HotNodeIndex;
+
+    return PhHashBytes((PUCHAR)&row, sizeof(row));
+}
+
+ULONG PhTnpGetCellDamageHash(
+    _In_ PPH_TREENEW_CONTEXT Context,
+    _In_ LONG Index,
+    _In_ PPH_TREENEW_COLUMN Column,
+    _In_ ULONG RowHash
+    )
+{
+    PH_STRINGREF text;
+    ULONG hash;
+
+    if (Index < 0 || Index >= (LONG)PhTnpGetFlatNodeCount(Context))
+        return 1; // empty row
+
+    if (Column->CustomDraw)
+        return 0; // always repaint
+
+    if (PhTnpGetCellText(Context, PhTnpGetFlatNode(Context, Index), Column->Id, &text))
+        hash = PhHashBytes((PUCHAR)text.Buffer, text.Length);
+    else
+        hash = 0;
+
+    hash ^= RowHash + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+    return hash ? hash : 1; // 0 means the cell must be repainted
+}
+
+VOID PhTnpResetDamageTracking(
+    _In_ PPH_TREENEW_CONTEXT Context
+    )
+{
+    if (Context->DamageCellHashes)
+    {
+        PhFree(Context->DamageCellHashes);
+        Context->DamageCellHashes = NULL;
+    }
+
+    Context->DamageRows = 0;
+    Context->DamageColumns = 0;
+}
+
 VOID PhTnpInitializeTooltips(
     _In_ PPH_TREENEW_CONTEXT Context
     )
@@ -6402,7 +7004,7 @@ VOID PhTnpDragSelect(
                 viewLeft = Context->FixedColumnVisible ? 0 : -Context->HScrollPosition;
                 viewTop = Context->HeaderHeight - Context->VScrollPosition;
                 viewRight = Context->NormalLeft + Context->TotalViewX - Context->HScrollPosition;
-                viewBottom = Context->HeaderHeight + ((LONG)Context->FlatList->Count - Context->VScrollPosition) * Context->RowHeight;
+                viewBottom = Context->HeaderHeight + ((LONG)PhTnpGetFlatNodeCount(Context) - Context->VScrollPosition) * Context->RowHeight;
 
                 temp = Context->ClientRect.right - (Context->VScrollVisible ? Context->VScrollWidth : 0);
                 viewRight = max(viewRight, temp);
@@ -6532,8 +7134,8 @@ VOID PhTnpProcessDragSelect(
 
     if (firstRow < 0)
         firstRow = 0;
-    if (lastRow >= (LONG)Context->FlatList->Count)
-        lastRow = Context->FlatList->Count - 1;
+    if (lastRow >= (LONG)PhTnpGetFlatNodeCount(Context))
+        lastRow = PhTnpGetFlatNodeCount(Context) - 1;
 
     rowRect.left = 0;
     rowRect.top = Context->HeaderHeight + (firstRow - Context->VScrollPosition) * Context->RowHeight;
@@ -6549,7 +7151,7 @@ VOID PhTnpProcessDragSelect(
         BOOLEAN inOldRect;
         BOOLEAN inNewRect;
 
-        node = Context->FlatList->Items[i];
+        node = PhTnpGetFlatNode(Context, i);
 
         inOldRect = rowRect.top < OldRect->bottom && rowRect.bottom > OldRect->top &&
             rowRect.left < OldRect->right && rowRect.right > OldRect->left;
@@ -6657,3 +7259,250 @@ VOID PhTnpGetMessagePos(
 
     *ClientPoint = point;
 }
+
+static int __cdecl PhpTreeNewSortFunctionThunk(
+    _In_ void *context,
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PPH_TREENEW_SORT_FUNCTION sortFunction = context;
+
+    return sortFunction(elem1, elem2);
+}
+
+/**
+ * Sorts an array of nodes, taking advantage of an existing order.
+ *
+ * \param Nodes The array of nodes to sort.
+ * \param NumberOfNodes The number of nodes.
+ * \param SortFunction A qsort-style comparison function.
+ *
+ * \remarks See PhSortTreeNewNodesEx() for details.
+ */
+VOID PhSortTreeNewNodes(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_FUNCTION SortFunction
+    )
+{
+    PhSortTreeNewNodesEx(Nodes, NumberOfNodes, PhpTreeNewSortFunctionThunk, SortFunction);
+}
+
+/**
+ * Sorts an array of nodes, taking advantage of an existing order.
+ *
+ * \param Nodes The array of nodes to sort.
+ * \param NumberOfNodes The number of nodes.
+ * \param SortFunction A qsort_s-style comparison function.
+ * \param Context A user-defined value to pass to the comparison function.
+ *
+ * \remarks Lists are usually re-sorted after only a few of their nodes
+ * have changed, or after new nodes have been appended. This function keeps
+ * the nodes which are still in order where they are, sorts the remaining
+ * (dirty) nodes and merges them back in. This takes a linear number of
+ * comparisons when few nodes have changed. If more than a quarter of the
+ * nodes are out of order, the whole array is sorted using qsort_s().
+ * The comparison function should define a total order (e.g. by breaking
+ * ties using a unique key), otherwise the relative order of equal nodes is
+ * unspecified.
+ */
+VOID PhSortTreeNewNodesEx(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_FUNCTION_EX SortFunction,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_TREENEW_NODE *dirtyNodes;
+    ULONG maximumDirtyNodes;
+    ULONG numberOfCleanNodes;
+    ULONG numberOfDirtyNodes;
+    BOOLEAN previousClean;
+    ULONG i;
+    LONG j;
+    LONG k;
+
+    maximumDirtyNodes = NumberOfNodes / 4;
+
+    if (maximumDirtyNodes < 4)
+    {
+        qsort_s(Nodes, NumberOfNodes, sizeof(PVOID), SortFunction, Context);
+        return;
+    }
+
+    dirtyNodes = PhAllocate(sizeof(PPH_TREENEW_NODE) * maximumDirtyNodes);
+    numberOfCleanNodes = 0;
+    numberOfDirtyNodes = 0;
+    previousClean = FALSE;
+
+    // Compact the nodes which are in order at the front of the array, and move the others to the
+    // dirty array. A node is clean if it is not less than the last clean node and not greater
+    // than the node after it. The second check prevents a single node which has moved towards the
+    // end from causing all of the nodes after it to be treated as dirty.
+
+    for (i = 0; i < NumberOfNodes; i++)
+    {
+        PPH_TREENEW_NODE node = Nodes[i];
+        BOOLEAN clean;
+
+        // If the previous node was clean, we already know that it is not greater than this one.
+        clean = numberOfCleanNodes == 0 || previousClean ||
+            SortFunction(Context, &Nodes[numberOfCleanNodes - 1], &node) <= 0;
+
+        if (clean && i + 1 < NumberOfNodes)
+            clean = SortFunction(Context, &node, &Nodes[i + 1]) <= 0;
+
+        if (clean)
+        {
+            Nodes[numberOfCleanNodes++] = node;
+        }
+        else
+        {
+            if (numberOfDirtyNodes == maximumDirtyNodes)
+            {
+                // Too many nodes have changed. Put the dirty nodes back in the gap left by
+                // compaction and sort everything.
+                memcpy(&Nodes[numberOfCleanNodes], dirtyNodes, sizeof(PPH_TREENEW_NODE) * numberOfDirtyNodes);
+                PhFree(dirtyNodes);
+                qsort_s(Nodes, NumberOfNodes, sizeof(PVOID), SortFunction, Context);
+                return;
+            }
+
+            dirtyNodes[numberOfDirtyNodes++] = node;
+        }
+
+        previousClean = clean;
+    }
+
+    if (numberOfDirtyNodes != 0)
+    {
+        qsort_s(dirtyNodes, numberOfDirtyNodes, sizeof(PVOID), SortFunction, Context);
+
+        // Merge from the end so that the clean nodes can be moved in place.
+
+        j = numberOfCleanNodes - 1;
+        k = numberOfDirtyNodes - 1;
+
+        for (i = NumberOfNodes; k >= 0; )
+        {
+            if (j >= 0 && SortFunction(Context, &Nodes[j], &dirtyNodes[k]) > 0)
+                Nodes[--i] = Nodes[j--];
+            else
+                Nodes[--i] = dirtyNodes[k--];
+        }
+    }
+
+    PhFree(dirtyNodes);
+}
+
+typedef struct _PHP_TREENEW_SORT_KEY
+{
+    ULONG64 Key;
+    PPH_TREENEW_NODE Node;
+} PHP_TREENEW_SORT_KEY, *PPHP_TREENEW_SORT_KEY;
+
+/**
+ * Sorts an array of nodes using a key extracted from each node.
+ *
+ * \param Nodes The array of nodes to sort.
+ * \param NumberOfNodes The number of nodes.
+ * \param KeyFunction A function which returns the sort key of a node. Nodes with smaller keys are
+ * placed first in ascending order.
+ * \param SortOrder The sort order.
+ * \param SortFunction A qsort_s-style comparison function used to order nodes with equal keys.
+ * \param Context A user-defined value to pass to the key and comparison functions.
+ *
+ * \remarks The key function is called once for each node, and the keys are sorted using a radix
+ * sort without any further calls. This is much faster than PhSortTreeNewNodesEx() for columns
+ * whose values change on every update, where most of the nodes end up out of order.
+ */
+VOID PhSortTreeNewNodesByKey(
+    _Inout_updates_(NumberOfNodes) PPH_TREENEW_NODE *Nodes,
+    _In_ ULONG NumberOfNodes,
+    _In_ PPH_TREENEW_SORT_KEY_FUNCTION KeyFunction,
+    _In_ PH_SORT_ORDER SortOrder,
+    _In_opt_ PPH_TREENEW_SORT_FUNCTION_EX SortFunction,
+    _In_opt_ PVOID Context
+    )
+{
+    PPHP_TREENEW_SORT_KEY keys;
+    PPHP_TREENEW_SORT_KEY source;
+    PPHP_TREENEW_SORT_KEY destination;
+    PPHP_TREENEW_SORT_KEY temp;
+    ULONG64 differentBits;
+    ULONG count[256];
+    ULONG shift;
+    ULONG offset;
+    ULONG i;
+    ULONG j;
+
+    if (NumberOfNodes < 2)
+        return;
+
+    keys = PhAllocate(sizeof(PHP_TREENEW_SORT_KEY) * NumberOfNodes * 2);
+    differentBits = 0;
+
+    for (i = 0; i < NumberOfNodes; i++)
+    {
+        keys[i].Key = KeyFunction(Nodes[i], Context);
+        keys[i].Node = Nodes[i];
+
+        if (SortOrder == DescendingSortOrder)
+            keys[i].Key = ~keys[i].Key;
+
+        differentBits |= keys[i].Key ^ keys[0].Key;
+    }
+
+    // LSD radix sort, one byte at a time. Bytes which are the same in every key (e.g. the high
+    // bytes of small counters) don't need a pass.
+
+    source = keys;
+    destination = keys + NumberOfNodes;
+
+    for (shift = 0; shift < 64; shift += 8)
+    {
+        if (!((differentBits >> shift) & 0xff))
+            continue;
+
+        memset(count, 0, sizeof(count));
+
+        for (i = 0; i < NumberOfNodes; i++)
+            count[(source[i].Key >> shift) & 0xff]++;
+
+        offset = 0;
+
+        for (j = 0; j < 256; j++)
+        {
+            ULONG c = count[j];
+
+            count[j] = offset;
+            offset += c;
+        }
+
+        for (i = 0; i < NumberOfNodes; i++)
+            destination[count[(source[i].Key >> shift) & 0xff]++] = source[i];
+
+        temp = source;
+        source = destination;
+        destination = temp;
+    }
+
+    for (i = 0; i < NumberOfNodes; i++)
+        Nodes[i] = source[i].Node;
+
+    if (SortFunction)
+    {
+        // Order runs of equal keys with the comparison function.
+        for (i = 0; i < NumberOfNodes; i = j)
+        {
+            for (j = i + 1; j < NumberOfNodes && source[j].Key == source[i].Key; j++)
+                NOTHING;
+
+            if (j - i > 1)
+                qsort_s(&Nodes[i], j - i, sizeof(PVOID), SortFunction, Context);
+        }
+    }
+
+    PhFree(keys);
+}
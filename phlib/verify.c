@@ -43,6 +43,43 @@ static PH_INITONCE PhpVerifyInitOnce = PH_INITONCE_INIT;
 static GUID WinTrustActionGenericVerifyV2 = WINTRUST_ACTION_GENERIC_VERIFY_V2;
 static GUID DriverActionVerify = DRIVER_ACTION_VERIFY;
 
+// Acquiring a catalog admin context loads the catalog database, which costs more than
+// verifying most files. Released contexts are kept for the next verification instead, one
+// pool for each hash algorithm we use.
+
+#define PH_CAT_ADMIN_POOL_SHA1 0
+#define PH_CAT_ADMIN_POOL_SHA256 1
+#define PH_CAT_ADMIN_POOL_COUNT 2
+#define PH_CAT_ADMIN_POOL_MAXIMUM 8
+
+typedef struct _PH_CAT_ADMIN_POOL
+{
+    ULONG Count;
+    HANDLE Handles[PH_CAT_ADMIN_POOL_MAXIMUM];
+} PH_CAT_ADMIN_POOL, *PPH_CAT_ADMIN_POOL;
+
+static PH_CAT_ADMIN_POOL PhpCatAdminPools[PH_CAT_ADMIN_POOL_COUNT];
+static PH_QUEUED_LOCK PhpCatAdminPoolLock = PH_QUEUED_LOCK_INIT;
+
+// Files with the same contents (e.g. copies of a DLL in WinSxS) have the same hash, so the
+// catalog that contains a hash is cached instead of being searched for again. Hashes that are
+// in no catalog are only cached for a while, since catalogs can be installed at any time.
+
+#define PH_CATALOG_CACHE_MAXIMUM_ENTRIES 4096
+#define PH_CATALOG_CACHE_NEGATIVE_TTL (60 * PH_TIMEOUT_SEC) // 1 minute
+
+typedef struct _PH_CATALOG_CACHE_ENTRY
+{
+    ULONG HashKind; // PH_FILE_HASH_CATALOG_*
+    ULONG HashLength;
+    UCHAR Hash[PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH];
+    PPH_STRING CatalogFileName; // NULL if no system catalog contains the hash
+    LARGE_INTEGER ExpiryTime; // only for entries without a catalog
+} PH_CATALOG_CACHE_ENTRY, *PPH_CATALOG_CACHE_ENTRY;
+
+static PPH_HASHTABLE PhpCatalogCacheHashtable = NULL;
+static PH_QUEUED_LOCK PhpCatalogCacheLock = PH_QUEUED_LOCK_INIT;
+
 static VOID PhpVerifyInitialization(
     VOID
     )
@@ -69,6 +106,245 @@ static VOID PhpVerifyInitialization(
     CertFreeCertificateContext_I = (PVOID)GetProcAddress(crypt32, "CertFreeCertificateContext");
 }
 
+static ULONG PhpGetCatalogHashKind(
+    _In_opt_ PWSTR HashAlgorithm
+    )
+{
+    if (!HashAlgorithm)
+        return PH_FILE_HASH_CATALOG_SHA1;
+    else if (PhEqualStringZ(HashAlgorithm, BCRYPT_SHA256_ALGORITHM, TRUE))
+        return PH_FILE_HASH_CATALOG_SHA256;
+    else
+        return 0;
+}
+
+static PPH_CAT_ADMIN_POOL PhpGetCatAdminPool(
+    _In_ ULONG HashKind
+    )
+{
+    switch (HashKind)
+    {
+    case PH_FILE_HASH_CATALOG_SHA1:
+        return &PhpCatAdminPools[PH_CAT_ADMIN_POOL_SHA1];
+    case PH_FILE_HASH_CATALOG_SHA256:
+        return &PhpCatAdminPools[PH_CAT_ADMIN_POOL_SHA256];
+    default:
+        return NULL;
+    }
+}
+
+static BOOLEAN PhpAcquireCatAdminContext(
+    _In_opt_ PWSTR HashAlgorithm,
+    _Out_ HANDLE *CatAdminHandle
+    )
+{
+    PPH_CAT_ADMIN_POOL pool;
+    HANDLE catAdminHandle = NULL;
+
+    // Contexts can't be used by more than one thread at a time, so a context is taken out of
+    // the pool while it is in use.
+    if (pool = PhpGetCatAdminPool(PhpGetCatalogHashKind(HashAlgorithm)))
+    {
+        PhAcquireQueuedLockExclusive(&PhpCatAdminPoolLock);
+
+        if (pool->Count != 0)
+            catAdminHandle = pool->Handles[--pool->Count];
+
+        PhReleaseQueuedLockExclusive(&PhpCatAdminPoolLock);
+
+        if (catAdminHandle)
+        {
+            *CatAdminHandle = catAdminHandle;
+            return TRUE;
+        }
+    }
+
+    if (CryptCATAdminAcquireContext2)
+    {
+        if (!CryptCATAdminAcquireContext2(&catAdminHandle, &DriverActionVerify, HashAlgorithm, NULL, 0))
+            return FALSE;
+    }
+    else
+    {
+        if (!CryptCATAdminAcquireContext(&catAdminHandle, &DriverActionVerify, 0))
+            return FALSE;
+    }
+
+    *CatAdminHandle = catAdminHandle;
+
+    return TRUE;
+}
+
+static VOID PhpReleaseCatAdminContext(
+    _In_opt_ PWSTR HashAlgorithm,
+    _In_ HANDLE CatAdminHandle
+    )
+{
+    PPH_CAT_ADMIN_POOL pool;
+
+    if (pool = PhpGetCatAdminPool(PhpGetCatalogHashKind(HashAlgorithm)))
+    {
+        PhAcquireQueuedLockExclusive(&PhpCatAdminPoolLock);
+
+        if (pool->Count < PH_CAT_ADMIN_POOL_MAXIMUM)
+        {
+            pool->Handles[pool->Count++] = CatAdminHandle;
+            CatAdminHandle = NULL;
+        }
+
+        PhReleaseQueuedLockExclusive(&PhpCatAdminPoolLock);
+    }
+
+    if (CatAdminHandle)
+        CryptCATAdminReleaseContext(CatAdminHandle, 0);
+}
+
+static BOOLEAN NTAPI PhpCatalogCacheCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PPH_CATALOG_CACHE_ENTRY entry1 = Entry1;
+    PPH_CATALOG_CACHE_ENTRY entry2 = Entry2;
+
+    return
+        entry1->HashKind == entry2->HashKind &&
+        entry1->HashLength == entry2->HashLength &&
+        memcmp(entry1->Hash, entry2->Hash, entry1->HashLength) == 0;
+}
+
+static ULONG NTAPI PhpCatalogCacheHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PPH_CATALOG_CACHE_ENTRY entry = Entry;
+
+    return PhHashBytes(entry->Hash, entry->HashLength) ^ entry->HashKind;
+}
+
+static BOOLEAN PhpInitializeCatalogCacheEntry(
+    _Out_ PPH_CATALOG_CACHE_ENTRY Entry,
+    _In_ ULONG HashKind,
+    _In_ PUCHAR FileHash,
+    _In_ ULONG FileHashLength
+    )
+{
+    if (!HashKind || FileHashLength > PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH)
+        return FALSE;
+
+    Entry->HashKind = HashKind;
+    Entry->HashLength = FileHashLength;
+    memcpy(Entry->Hash, FileHash, FileHashLength);
+
+    return TRUE;
+}
+
+static BOOLEAN PhpFindCatalogCache(
+    _In_ ULONG HashKind,
+    _In_ PUCHAR FileHash,
+    _In_ ULONG FileHashLength,
+    _Out_ PPH_STRING *CatalogFileName
+    )
+{
+    PH_CATALOG_CACHE_ENTRY lookupEntry;
+    PPH_CATALOG_CACHE_ENTRY entry;
+    LARGE_INTEGER currentTime;
+    BOOLEAN found;
+
+    if (!PhpCatalogCacheHashtable)
+        return FALSE;
+    if (!PhpInitializeCatalogCacheEntry(&lookupEntry, HashKind, FileHash, FileHashLength))
+        return FALSE;
+
+    PhQuerySystemTime(&currentTime);
+    found = FALSE;
+
+    PhAcquireQueuedLockShared(&PhpCatalogCacheLock);
+
+    entry = PhFindEntryHashtable(PhpCatalogCacheHashtable, &lookupEntry);
+
+    if (entry && (entry->CatalogFileName || currentTime.QuadPart < entry->ExpiryTime.QuadPart))
+    {
+        *CatalogFileName = entry->CatalogFileName;
+
+        if (entry->CatalogFileName)
+            PhReferenceObject(entry->CatalogFileName);
+
+        found = TRUE;
+    }
+
+    PhReleaseQueuedLockShared(&PhpCatalogCacheLock);
+
+    return found;
+}
+
+static VOID PhpClearCatalogCache(
+    VOID
+    )
+{
+    PPH_CATALOG_CACHE_ENTRY entry;
+    ULONG enumerationKey;
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(PhpCatalogCacheHashtable, &entry, &enumerationKey))
+        PhClearReference(&entry->CatalogFileName);
+
+    PhClearHashtable(PhpCatalogCacheHashtable);
+}
+
+static VOID PhpUpdateCatalogCache(
+    _In_ ULONG HashKind,
+    _In_ PUCHAR FileHash,
+    _In_ ULONG FileHashLength,
+    _In_opt_ PPH_STRING CatalogFileName,
+    _In_ BOOLEAN Remove
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PH_CATALOG_CACHE_ENTRY entry;
+    PPH_CATALOG_CACHE_ENTRY existingEntry;
+
+    if (!PhpInitializeCatalogCacheEntry(&entry, HashKind, FileHash, FileHashLength))
+        return;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PhpCatalogCacheHashtable = PhCreateHashtable(
+            sizeof(PH_CATALOG_CACHE_ENTRY),
+            PhpCatalogCacheCompareFunction,
+            PhpCatalogCacheHashFunction,
+            64
+            );
+        PhEndInitOnce(&initOnce);
+    }
+
+    PhAcquireQueuedLockExclusive(&PhpCatalogCacheLock);
+
+    if (existingEntry = PhFindEntryHashtable(PhpCatalogCacheHashtable, &entry))
+    {
+        PhClearReference(&existingEntry->CatalogFileName);
+        PhRemoveEntryHashtable(PhpCatalogCacheHashtable, existingEntry);
+    }
+
+    if (!Remove)
+    {
+        if (PhpCatalogCacheHashtable->Count >= PH_CATALOG_CACHE_MAXIMUM_ENTRIES)
+            PhpClearCatalogCache();
+
+        entry.CatalogFileName = CatalogFileName;
+        PhQuerySystemTime(&entry.ExpiryTime);
+        entry.ExpiryTime.QuadPart += PH_CATALOG_CACHE_NEGATIVE_TTL;
+
+        if (CatalogFileName)
+            PhReferenceObject(CatalogFileName);
+
+        PhAddEntryHashtable(PhpCatalogCacheHashtable, &entry);
+    }
+
+    PhReleaseQueuedLockExclusive(&PhpCatalogCacheLock);
+}
+
 VERIFY_RESULT PhpStatusToVerifyResult(
     _In_ LONG Status
     )
@@ -240,24 +516,24 @@ VERIFY_RESULT PhpVerifyFile(
 BOOLEAN PhpCalculateFileHash(
     _In_ HANDLE FileHandle,
     _In_ PWSTR HashAlgorithm,
+    _In_ HANDLE CatAdminHandle,
     _Out_ PUCHAR *FileHash,
-    _Out_ PULONG FileHashLength,
-    _Out_ HANDLE *CatAdminHandle
+    _Out_ PULONG FileHashLength
     )
 {
-    HANDLE catAdminHandle;
     PUCHAR fileHash;
     ULONG fileHashLength;
+    ULONG cacheKind;
+    UCHAR cachedHash[PH_FILE_HASH_CACHE_MAXIMUM_HASH_LENGTH];
 
-    if (CryptCATAdminAcquireContext2)
-    {
-        if (!CryptCATAdminAcquireContext2(&catAdminHandle, &DriverActionVerify, HashAlgorithm, NULL, 0))
-            return FALSE;
-    }
-    else
+    cacheKind = PhpGetCatalogHashKind(HashAlgorithm);
+
+    if (cacheKind && PhFindFileHashCache(FileHandle, cacheKind, cachedHash, sizeof(cachedHash), &fileHashLength))
     {
-        if (!CryptCATAdminAcquireContext(&catAdminHandle, &DriverActionVerify, 0))
-            return FALSE;
+        *FileHash = PhAllocateCopy(cachedHash, fileHashLength);
+        *FileHashLength = fileHashLength;
+
+        return TRUE;
     }
 
     fileHashLength = 32;
@@ -265,14 +541,13 @@ BOOLEAN PhpCalculateFileHash(
 
     if (CryptCATAdminCalcHashFromFileHandle2)
     {
-        if (!CryptCATAdminCalcHashFromFileHandle2(catAdminHandle, FileHandle, &fileHashLength, fileHash, 0))
+        if (!CryptCATAdminCalcHashFromFileHandle2(CatAdminHandle, FileHandle, &fileHashLength, fileHash, 0))
         {
             PhFree(fileHash);
             fileHash = PhAllocate(fileHashLength);
 
-            if (!CryptCATAdminCalcHashFromFileHandle2(catAdminHandle, FileHandle, &fileHashLength, fileHash, 0))
+            if (!CryptCATAdminCalcHashFromFileHandle2(CatAdminHandle, FileHandle, &fileHashLength, fileHash, 0))
             {
-                CryptCATAdminReleaseContext(catAdminHandle, 0);
                 PhFree(fileHash);
                 return FALSE;
             }
@@ -287,16 +562,17 @@ BOOLEAN PhpCalculateFileHash(
 
             if (!CryptCATAdminCalcHashFromFileHandle(FileHandle, &fileHashLength, fileHash, 0))
             {
-                CryptCATAdminReleaseContext(catAdminHandle, 0);
                 PhFree(fileHash);
                 return FALSE;
             }
         }
     }
 
+    if (cacheKind)
+        PhAddFileHashCache(FileHandle, cacheKind, fileHash, fileHashLength);
+
     *FileHash = fileHash;
     *FileHashLength = fileHashLength;
-    *CatAdminHandle = catAdminHandle;
 
     return TRUE;
 }
@@ -318,8 +594,11 @@ VERIFY_RESULT PhpVerifyFileFromCatalog(
     PUCHAR fileHash;
     ULONG fileHashLength;
     PPH_STRING fileHashTag;
+    ULONG hashKind;
     HANDLE catAdminHandle;
     HANDLE catInfoHandle;
+    PPH_STRING catalogFileName;
+    BOOLEAN catalogFileNameCached;
     ULONG i;
 
     *Signatures = NULL;
@@ -342,44 +621,67 @@ VERIFY_RESULT PhpVerifyFileFromCatalog(
             return VrNoSignature;
     }
 
-    if (PhpCalculateFileHash(FileHandle, HashAlgorithm, &fileHash, &fileHashLength, &catAdminHandle))
+    if (!PhpAcquireCatAdminContext(HashAlgorithm, &catAdminHandle))
+        return VrNoSignature;
+
+    if (PhpCalculateFileHash(FileHandle, HashAlgorithm, catAdminHandle, &fileHash, &fileHashLength))
     {
         fileHashTag = PhBufferToHexStringEx(fileHash, fileHashLength, TRUE);
+        hashKind = PhpGetCatalogHashKind(HashAlgorithm);
 
         // Search the system catalogs.
 
-        catInfoHandle = CryptCATAdminEnumCatalogFromHash(
-            catAdminHandle,
-            fileHash,
-            fileHashLength,
-            0,
-            NULL
-            );
+        catalogFileName = NULL;
+        catalogFileNameCached = PhpFindCatalogCache(hashKind, fileHash, fileHashLength, &catalogFileName);
 
-        if (catInfoHandle)
+        if (!catalogFileNameCached)
         {
-            CATALOG_INFO ci = { 0 };
-            DRIVER_VER_INFO verInfo = { 0 };
-
-            if (CryptCATCatalogInfoFromContext(catInfoHandle, &ci, 0))
+            catInfoHandle = CryptCATAdminEnumCatalogFromHash(
+                catAdminHandle,
+                fileHash,
+                fileHashLength,
+                0,
+                NULL
+                );
+
+            if (catInfoHandle)
             {
-                // Disable OS version checking by passing in a DRIVER_VER_INFO structure.
-                verInfo.cbStruct = sizeof(DRIVER_VER_INFO);
+                CATALOG_INFO ci = { 0 };
 
-                catalogInfo.cbStruct = sizeof(catalogInfo);
-                catalogInfo.pcwszCatalogFilePath = ci.wszCatalogFile;
-                catalogInfo.pcwszMemberFilePath = Information->FileName;
-                catalogInfo.pcwszMemberTag = fileHashTag->Buffer;
-                catalogInfo.pbCalculatedFileHash = fileHash;
-                catalogInfo.cbCalculatedFileHash = fileHashLength;
-                catalogInfo.hCatAdmin = catAdminHandle;
-                verifyResult = PhpVerifyFile(Information, FileHandle, WTD_CHOICE_CATALOG, &catalogInfo, &DriverActionVerify, &verInfo, &signatures, &numberOfSignatures);
+                if (CryptCATCatalogInfoFromContext(catInfoHandle, &ci, 0))
+                    catalogFileName = PhCreateString(ci.wszCatalogFile);
 
-                if (verInfo.pcSignerCertContext)
-                    CertFreeCertificateContext_I(verInfo.pcSignerCertContext);
+                CryptCATAdminReleaseCatalogContext(catAdminHandle, catInfoHandle, 0);
             }
 
-            CryptCATAdminReleaseCatalogContext(catAdminHandle, catInfoHandle, 0);
+            PhpUpdateCatalogCache(hashKind, fileHash, fileHashLength, catalogFileName, FALSE);
+        }
+
+        if (catalogFileName)
+        {
+            DRIVER_VER_INFO verInfo = { 0 };
+
+            // Disable OS version checking by passing in a DRIVER_VER_INFO structure.
+            verInfo.cbStruct = sizeof(DRIVER_VER_INFO);
+
+            catalogInfo.cbStruct = sizeof(catalogInfo);
+            catalogInfo.pcwszCatalogFilePath = catalogFileName->Buffer;
+            catalogInfo.pcwszMemberFilePath = Information->FileName;
+            catalogInfo.pcwszMemberTag = fileHashTag->Buffer;
+            catalogInfo.pbCalculatedFileHash = fileHash;
+            catalogInfo.cbCalculatedFileHash = fileHashLength;
+            catalogInfo.hCatAdmin = catAdminHandle;
+            verifyResult = PhpVerifyFile(Information, FileHandle, WTD_CHOICE_CATALOG, &catalogInfo, &DriverActionVerify, &verInfo, &signatures, &numberOfSignatures);
+
+            if (verInfo.pcSignerCertContext)
+                CertFreeCertificateContext_I(verInfo.pcSignerCertContext);
+
+            // The catalog may have been replaced or removed since it was cached, so search
+            // again next time.
+            if (catalogFileNameCached && verifyResult != VrTrusted)
+                PhpUpdateCatalogCache(hashKind, fileHash, fileHashLength, NULL, TRUE);
+
+            PhDereferenceObject(catalogFileName);
         }
         else
         {
@@ -405,9 +707,10 @@ VERIFY_RESULT PhpVerifyFileFromCatalog(
 
         PhDereferenceObject(fileHashTag);
         PhFree(fileHash);
-        CryptCATAdminReleaseContext(catAdminHandle, 0);
     }
 
+    PhpReleaseCatAdminContext(HashAlgorithm, catAdminHandle);
+
     *Signatures = signatures;
     *NumberOfSignatures = numberOfSignatures;
 
@@ -23,6 +23,7 @@
 #define _PH_WORKQUEUE_PRIVATE
 #include <phbase.h>
 #include <phintrnl.h>
+#include <tracelog.h>
 
 HANDLE PhpGetSemaphoreWorkQueue(
     _Inout_ PPH_WORK_QUEUE WorkQueue
@@ -36,6 +37,10 @@ NTSTATUS PhpWorkQueueThreadStart(
     _In_ PVOID Parameter
     );
 
+PPH_WORK_QUEUE_ITEM PhpPopRingWorkQueue(
+    _Inout_ PPH_WORK_QUEUE WorkQueue
+    );
+
 static PH_FREE_LIST PhWorkQueueItemFreeList;
 static PH_WORK_QUEUE PhGlobalWorkQueue;
 static PH_INITONCE PhGlobalWorkQueueInitOnce = PH_INITONCE_INIT;
@@ -44,6 +49,8 @@ PPH_LIST PhDbgWorkQueueList;
 PH_QUEUED_LOCK PhDbgWorkQueueListLock = PH_QUEUED_LOCK_INIT;
 #endif
 
+PH_TRACE_EVENT_DECLARE(PhpWorkQueueItemTraceEvent, "WorkQueueItem", PH_TRACE_KEYWORD_WORK_QUEUE, "Function", PhTraceFieldPointer);
+
 VOID PhWorkQueueInitialization(
     VOID
     )
@@ -67,25 +74,52 @@ FORCEINLINE PPH_WORK_QUEUE_ITEM PhpCreateWorkQueueItem(
     workQueueItem->Function = Function;
     workQueueItem->Context = Context;
     workQueueItem->DeleteFunction = DeleteFunction;
+    workQueueItem->QueueTime = 0;
+    workQueueItem->Batch = NULL;
 
     return workQueueItem;
 }
 
+FORCEINLINE VOID PhpDereferenceWorkQueueBatch(
+    _Inout_ PPH_WORK_QUEUE_BATCH Batch
+    )
+{
+    if (_InterlockedDecrement(&Batch->PendingCount) == 0)
+    {
+        PhSetEvent(&Batch->CompletedEvent);
+        // This must be the last access to the batch, since the waiter may free it as soon as
+        // it sees the flag.
+        _InterlockedExchange(&Batch->Completed, TRUE);
+    }
+}
+
 FORCEINLINE VOID PhpDestroyWorkQueueItem(
     _In_ PPH_WORK_QUEUE_ITEM WorkQueueItem
     )
 {
+    PPH_WORK_QUEUE_BATCH batch;
+
+    batch = WorkQueueItem->Batch;
+
     if (WorkQueueItem->DeleteFunction)
         WorkQueueItem->DeleteFunction(WorkQueueItem->Function, WorkQueueItem->Context);
 
     PhFreeToFreeList(&PhWorkQueueItemFreeList, WorkQueueItem);
+
+    // The batch is complete once its items have been executed (or discarded) and freed.
+    if (batch)
+        PhpDereferenceWorkQueueBatch(batch);
 }
 
 FORCEINLINE VOID PhpExecuteWorkQueueItem(
     _Inout_ PPH_WORK_QUEUE_ITEM WorkQueueItem
     )
 {
+    PH_TRACE_ACTIVITY traceActivity;
+
+    PhTraceStartEvent(&PhpWorkQueueItemTraceEvent, &traceActivity, (ULONG_PTR)WorkQueueItem->Function);
     WorkQueueItem->Function(WorkQueueItem->Context);
+    PhTraceStopEvent(&PhpWorkQueueItemTraceEvent, &traceActivity);
 }
 
 /**
@@ -104,6 +138,31 @@ VOID PhInitializeWorkQueue(
     _In_ ULONG MaximumThreads,
     _In_ ULONG NoWorkTimeout
     )
+{
+    PhInitializeWorkQueueEx(WorkQueue, MinimumThreads, MaximumThreads, NoWorkTimeout, 0);
+}
+
+/**
+ * Initializes a work queue.
+ *
+ * \param WorkQueue A work queue object.
+ * \param MinimumThreads The suggested minimum number of threads to keep alive, even
+ * when there is no work to be performed.
+ * \param MaximumThreads The suggested maximum number of threads to create.
+ * \param NoWorkTimeout The number of milliseconds after which threads without work
+ * will terminate.
+ * \param Flags A combination of flags.
+ * \li \c PH_WORK_QUEUE_LOCK_FREE Work items are passed to worker threads through a lock-free
+ * ring of PH_WORK_QUEUE_RING_SIZE items. Use this for queues that receive a large number of
+ * small work items from several threads. Items are only approximately executed in order.
+ */
+VOID PhInitializeWorkQueueEx(
+    _Out_ PPH_WORK_QUEUE WorkQueue,
+    _In_ ULONG MinimumThreads,
+    _In_ ULONG MaximumThreads,
+    _In_ ULONG NoWorkTimeout,
+    _In_ ULONG Flags
+    )
 {
     PhInitializeRundownProtection(&WorkQueue->RundownProtect);
     WorkQueue->Terminating = FALSE;
@@ -122,6 +181,32 @@ VOID PhInitializeWorkQueue(
     WorkQueue->CurrentThreads = 0;
     WorkQueue->BusyCount = 0;
 
+    WorkQueue->Flags = Flags;
+    WorkQueue->Cells = NULL;
+    WorkQueue->EnqueuePosition = 0;
+    WorkQueue->DequeuePosition = 0;
+
+    if (Flags & PH_WORK_QUEUE_LOCK_FREE)
+    {
+        ULONG i;
+
+        WorkQueue->Cells = PhAllocate(sizeof(PH_WORK_QUEUE_CELL) * PH_WORK_QUEUE_RING_SIZE);
+
+        for (i = 0; i < PH_WORK_QUEUE_RING_SIZE; i++)
+        {
+            WorkQueue->Cells[i].Sequence = i;
+            WorkQueue->Cells[i].Item = NULL;
+        }
+    }
+
+    WorkQueue->Depth = 0;
+    WorkQueue->MaximumDepth = 0;
+    WorkQueue->NumberOfItemsQueued = 0;
+    WorkQueue->NumberOfItemsDequeued = 0;
+    WorkQueue->EnqueueCycles = 0;
+    WorkQueue->WaitCycles = 0;
+    WorkQueue->MaximumWaitCycles = 0;
+
 #ifdef DEBUG
     PhAcquireQueuedLockExclusive(&PhDbgWorkQueueListLock);
     PhAddItemList(PhDbgWorkQueueList, WorkQueue);
@@ -172,10 +257,25 @@ VOID PhDeleteWorkQueue(
         PhpDestroyWorkQueueItem(workQueueItem);
     }
 
+    if (WorkQueue->Cells)
+    {
+        while (workQueueItem = PhpPopRingWorkQueue(WorkQueue))
+            PhpDestroyWorkQueueItem(workQueueItem);
+
+        PhFree(WorkQueue->Cells);
+    }
+
     if (WorkQueue->SemaphoreHandle)
         NtClose(WorkQueue->SemaphoreHandle);
 }
 
+FORCEINLINE BOOLEAN PhpIsEmptyWorkQueue(
+    _In_ PPH_WORK_QUEUE WorkQueue
+    )
+{
+    return IsListEmpty(&WorkQueue->QueueListHead) && WorkQueue->DequeuePosition == WorkQueue->EnqueuePosition;
+}
+
 /**
  * Waits for all queued work items to be executed.
  *
@@ -187,12 +287,164 @@ VOID PhWaitForWorkQueue(
 {
     PhAcquireQueuedLockExclusive(&WorkQueue->QueueLock);
 
-    while (!IsListEmpty(&WorkQueue->QueueListHead))
+    // Workers that empty the ring acquire the queue lock before pulsing the condition, so we
+    // can't miss the wake-up between the check and the wait.
+    while (!PhpIsEmptyWorkQueue(WorkQueue))
         PhWaitForCondition(&WorkQueue->QueueEmptyCondition, &WorkQueue->QueueLock, NULL);
 
     PhReleaseQueuedLockExclusive(&WorkQueue->QueueLock);
 }
 
+/**
+ * Adds a work item to the lock-free ring of a work queue.
+ *
+ * \return TRUE if the item was added, or FALSE if the ring is full.
+ */
+BOOLEAN PhpPushRingWorkQueue(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_ PPH_WORK_QUEUE_ITEM WorkQueueItem
+    )
+{
+    PPH_WORK_QUEUE_CELL cell;
+    LONG position;
+    LONG difference;
+
+    position = WorkQueue->EnqueuePosition;
+
+    while (TRUE)
+    {
+        cell = &WorkQueue->Cells[position & (PH_WORK_QUEUE_RING_SIZE - 1)];
+        difference = cell->Sequence - position;
+
+        if (difference == 0)
+        {
+            // The cell is free. Try to claim it.
+            if (_InterlockedCompareExchange(&WorkQueue->EnqueuePosition, position + 1, position) == position)
+                break;
+
+            position = WorkQueue->EnqueuePosition;
+        }
+        else if (difference < 0)
+        {
+            // The cell still holds an item from the previous lap, so the ring is full.
+            return FALSE;
+        }
+        else
+        {
+            // Another thread claimed the cell first.
+            position = WorkQueue->EnqueuePosition;
+        }
+    }
+
+    cell->Item = WorkQueueItem;
+    // Publish the item.
+    _InterlockedExchange(&cell->Sequence, position + 1);
+
+    return TRUE;
+}
+
+/**
+ * Removes a work item from the lock-free ring of a work queue.
+ *
+ * \return The work item, or NULL if the ring is empty.
+ */
+PPH_WORK_QUEUE_ITEM PhpPopRingWorkQueue(
+    _Inout_ PPH_WORK_QUEUE WorkQueue
+    )
+{
+    PPH_WORK_QUEUE_CELL cell;
+    PPH_WORK_QUEUE_ITEM workQueueItem;
+    LONG position;
+    LONG difference;
+
+    position = WorkQueue->DequeuePosition;
+
+    while (TRUE)
+    {
+        cell = &WorkQueue->Cells[position & (PH_WORK_QUEUE_RING_SIZE - 1)];
+        difference = cell->Sequence - (position + 1);
+
+        if (difference == 0)
+        {
+            // The cell holds a published item. Try to claim it.
+            if (_InterlockedCompareExchange(&WorkQueue->DequeuePosition, position + 1, position) == position)
+                break;
+
+            position = WorkQueue->DequeuePosition;
+        }
+        else if (difference < 0)
+        {
+            // Either the ring is empty, or a producer has claimed the cell but hasn't published
+            // its item yet. In the second case the item must not be skipped because its
+            // semaphore count may already have been consumed, so wait for the producer.
+            if (WorkQueue->EnqueuePosition == position)
+                return NULL;
+
+            YieldProcessor();
+            position = WorkQueue->DequeuePosition;
+        }
+        else
+        {
+            // Another thread took the item first.
+            position = WorkQueue->DequeuePosition;
+        }
+    }
+
+    workQueueItem = cell->Item;
+    // Release the cell for the next lap.
+    _InterlockedExchange(&cell->Sequence, position + PH_WORK_QUEUE_RING_SIZE);
+
+    return workQueueItem;
+}
+
+PPH_WORK_QUEUE_ITEM PhpDequeueWorkQueueItem(
+    _Inout_ PPH_WORK_QUEUE WorkQueue
+    )
+{
+    PPH_WORK_QUEUE_ITEM workQueueItem = NULL;
+    PLIST_ENTRY listEntry;
+    ULONG64 waitCycles;
+
+    if (WorkQueue->Cells)
+        workQueueItem = PhpPopRingWorkQueue(WorkQueue);
+
+    if (workQueueItem)
+    {
+        if (PhpIsEmptyWorkQueue(WorkQueue))
+        {
+            PhAcquireQueuedLockExclusive(&WorkQueue->QueueLock);
+            PhPulseCondition(&WorkQueue->QueueEmptyCondition);
+            PhReleaseQueuedLockExclusive(&WorkQueue->QueueLock);
+        }
+    }
+    else
+    {
+        PhAcquireQueuedLockExclusive(&WorkQueue->QueueLock);
+
+        listEntry = RemoveHeadList(&WorkQueue->QueueListHead);
+
+        if (PhpIsEmptyWorkQueue(WorkQueue))
+            PhPulseCondition(&WorkQueue->QueueEmptyCondition);
+
+        PhReleaseQueuedLockExclusive(&WorkQueue->QueueLock);
+
+        if (listEntry == &WorkQueue->QueueListHead)
+            return NULL;
+
+        workQueueItem = CONTAINING_RECORD(listEntry, PH_WORK_QUEUE_ITEM, ListEntry);
+    }
+
+    _InterlockedDecrement(&WorkQueue->Depth);
+    WorkQueue->NumberOfItemsDequeued++;
+    waitCycles = ReadTimeStampCounter() - workQueueItem->QueueTime;
+    WorkQueue->WaitCycles += waitCycles;
+
+    if (WorkQueue->MaximumWaitCycles < waitCycles)
+        WorkQueue->MaximumWaitCycles = waitCycles;
+
+    return workQueueItem;
+}
+
 HANDLE PhpGetSemaphoreWorkQueue(
     _Inout_ PPH_WORK_QUEUE WorkQueue
     )
@@ -302,24 +554,9 @@ NTSTATUS PhpWorkQueueThreadStart(
 
         if (status == STATUS_WAIT_0 && !workQueue->Terminating)
         {
-            PLIST_ENTRY listEntry;
-
-            // Dequeue the work item.
-
-            PhAcquireQueuedLockExclusive(&workQueue->QueueLock);
-
-            listEntry = RemoveHeadList(&workQueue->QueueListHead);
-
-            if (IsListEmpty(&workQueue->QueueListHead))
-                PhPulseCondition(&workQueue->QueueEmptyCondition);
-
-            PhReleaseQueuedLockExclusive(&workQueue->QueueLock);
-
-            // Make sure we got work.
-            if (listEntry != &workQueue->QueueListHead)
+            // Dequeue the work item, and make sure we got work.
+            if (workQueueItem = PhpDequeueWorkQueueItem(workQueue))
             {
-                workQueueItem = CONTAINING_RECORD(listEntry, PH_WORK_QUEUE_ITEM, ListEntry);
-
                 PhpExecuteWorkQueueItem(workQueueItem);
                 _InterlockedDecrement(&workQueue->BusyCount);
 
@@ -353,6 +590,78 @@ NTSTATUS PhpWorkQueueThreadStart(
     return STATUS_SUCCESS;
 }
 
+VOID PhpEnqueueWorkQueueItems(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_reads_(Count) PPH_WORK_QUEUE_ITEM *WorkQueueItems,
+    _In_ ULONG Count
+    )
+{
+    ULONG64 startTime;
+    BOOLEAN locked = FALSE;
+    LONG depth;
+    ULONG i;
+
+    startTime = ReadTimeStampCounter();
+
+    // Enqueue the work items. The locked list is only used if the ring is full or disabled,
+    // and the lock is taken at most once for the whole batch.
+    for (i = 0; i < Count; i++)
+    {
+        WorkQueueItems[i]->QueueTime = startTime;
+
+        if (WorkQueue->Cells && PhpPushRingWorkQueue(WorkQueue, WorkQueueItems[i]))
+            continue;
+
+        if (!locked)
+        {
+            PhAcquireQueuedLockExclusive(&WorkQueue->QueueLock);
+            locked = TRUE;
+        }
+
+        InsertTailList(&WorkQueue->QueueListHead, &WorkQueueItems[i]->ListEntry);
+    }
+
+    _InterlockedExchangeAdd(&WorkQueue->BusyCount, Count);
+
+    if (locked)
+        PhReleaseQueuedLockExclusive(&WorkQueue->QueueLock);
+
+    // Signal the semaphore once for each item to let worker threads continue.
+    NtReleaseSemaphore(PhpGetSemaphoreWorkQueue(WorkQueue), Count, NULL);
+
+    PHLIB_ADD_STATISTIC(WqWorkItemsQueued, Count);
+
+    depth = _InterlockedExchangeAdd(&WorkQueue->Depth, Count) + Count;
+
+    if (WorkQueue->MaximumDepth < depth)
+        WorkQueue->MaximumDepth = depth;
+
+    // Check if all worker threads are currently busy, and if we can create more threads.
+    if (WorkQueue->BusyCount >= WorkQueue->CurrentThreads &&
+        WorkQueue->CurrentThreads < WorkQueue->MaximumThreads)
+    {
+        // Lock and re-check.
+        PhAcquireQueuedLockExclusive(&WorkQueue->StateLock);
+
+        // Create one thread as before, then more if the batch is larger than the number of
+        // threads.
+        if (WorkQueue->CurrentThreads < WorkQueue->MaximumThreads)
+        {
+            do
+            {
+                if (!PhpCreateWorkQueueThread(WorkQueue))
+                    break;
+            } while (WorkQueue->BusyCount > WorkQueue->CurrentThreads &&
+                WorkQueue->CurrentThreads < WorkQueue->MaximumThreads);
+        }
+
+        PhReleaseQueuedLockExclusive(&WorkQueue->StateLock);
+    }
+
+    WorkQueue->NumberOfItemsQueued += Count;
+    WorkQueue->EnqueueCycles += ReadTimeStampCounter() - startTime;
+}
+
 /**
  * Queues a work item to a work queue.
  *
@@ -387,29 +696,147 @@ VOID PhQueueItemWorkQueueEx(
     PPH_WORK_QUEUE_ITEM workQueueItem;
 
     workQueueItem = PhpCreateWorkQueueItem(Function, Context, DeleteFunction);
+    PhpEnqueueWorkQueueItems(WorkQueue, &workQueueItem, 1);
+}
 
-    // Enqueue the work item.
-    PhAcquireQueuedLockExclusive(&WorkQueue->QueueLock);
-    InsertTailList(&WorkQueue->QueueListHead, &workQueueItem->ListEntry);
-    _InterlockedIncrement(&WorkQueue->BusyCount);
-    PhReleaseQueuedLockExclusive(&WorkQueue->QueueLock);
-    // Signal the semaphore once to let a worker thread continue.
-    NtReleaseSemaphore(PhpGetSemaphoreWorkQueue(WorkQueue), 1, NULL);
+/**
+ * Queues a batch of work items to a work queue. This is faster than calling
+ * PhQueueItemWorkQueue() for each item.
+ *
+ * \param WorkQueue A work queue object.
+ * \param Function A function to execute for each item.
+ * \param Contexts An array of user-defined values. \a Function is executed once for each value.
+ * \param Count The number of elements in \a Contexts.
+ */
+VOID PhQueueItemsWorkQueue(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_ PUSER_THREAD_START_ROUTINE Function,
+    _In_reads_(Count) PVOID *Contexts,
+    _In_ ULONG Count
+    )
+{
+    PhQueueItemsWorkQueueEx(WorkQueue, Function, Contexts, Count, NULL);
+}
 
-    PHLIB_INC_STATISTIC(WqWorkItemsQueued);
+/**
+ * Queues a batch of work items to a work queue.
+ *
+ * \param WorkQueue A work queue object.
+ * \param Function A function to execute for each item.
+ * \param Contexts An array of user-defined values. \a Function is executed once for each value.
+ * \param Count The number of elements in \a Contexts.
+ * \param Batch A batch object initialized by PhInitializeWorkQueueBatch(). Use
+ * PhWaitForWorkQueueBatch() to wait for the items to finish executing. The same batch object
+ * can be used for several calls, even with different work queues.
+ */
+VOID PhQueueItemsWorkQueueEx(
+    _Inout_ PPH_WORK_QUEUE WorkQueue,
+    _In_ PUSER_THREAD_START_ROUTINE Function,
+    _In_reads_(Count) PVOID *Contexts,
+    _In_ ULONG Count,
+    _Inout_opt_ PPH_WORK_QUEUE_BATCH Batch
+    )
+{
+    PPH_WORK_QUEUE_ITEM localItems[64];
+    PPH_WORK_QUEUE_ITEM *workQueueItems;
+    ULONG i;
 
-    // Check if all worker threads are currently busy, and if we can create more threads.
-    if (WorkQueue->BusyCount >= WorkQueue->CurrentThreads &&
-        WorkQueue->CurrentThreads < WorkQueue->MaximumThreads)
+    if (Count == 0)
+        return;
+
+    if (Count <= sizeof(localItems) / sizeof(PPH_WORK_QUEUE_ITEM))
+        workQueueItems = localItems;
+    else
+        workQueueItems = PhAllocate(sizeof(PPH_WORK_QUEUE_ITEM) * Count);
+
+    if (Batch)
+        _InterlockedExchangeAdd(&Batch->PendingCount, Count);
+
+    for (i = 0; i < Count; i++)
     {
-        // Lock and re-check.
-        PhAcquireQueuedLockExclusive(&WorkQueue->StateLock);
+        workQueueItems[i] = PhpCreateWorkQueueItem(Function, Contexts[i], NULL);
+        workQueueItems[i]->Batch = Batch;
+    }
 
-        if (WorkQueue->CurrentThreads < WorkQueue->MaximumThreads)
-            PhpCreateWorkQueueThread(WorkQueue);
+    PhpEnqueueWorkQueueItems(WorkQueue, workQueueItems, Count);
 
-        PhReleaseQueuedLockExclusive(&WorkQueue->StateLock);
+    if (workQueueItems != localItems)
+        PhFree(workQueueItems);
+}
+
+/**
+ * Initializes a work queue batch object.
+ *
+ * \param Batch A batch object.
+ */
+VOID PhInitializeWorkQueueBatch(
+    _Out_ PPH_WORK_QUEUE_BATCH Batch
+    )
+{
+    Batch->PendingCount = 1;
+    Batch->Released = FALSE;
+    Batch->Completed = FALSE;
+    PhInitializeEvent(&Batch->CompletedEvent);
+}
+
+/**
+ * Waits for all work items in a batch to finish executing. Unlike PhWaitForWorkQueue(), this
+ * does not wait for unrelated work items.
+ *
+ * \param Batch A batch object. No more items can be added to the batch after this function is
+ * called.
+ * \param Timeout The timeout, or NULL to wait indefinitely.
+ *
+ * \return TRUE if all items have finished executing, otherwise FALSE if the timeout expired.
+ */
+BOOLEAN PhWaitForWorkQueueBatch(
+    _Inout_ PPH_WORK_QUEUE_BATCH Batch,
+    _In_opt_ PLARGE_INTEGER Timeout
+    )
+{
+    if (!Batch->Released)
+    {
+        // Release the reference that kept the batch from completing while items were being
+        // added.
+        Batch->Released = TRUE;
+        PhpDereferenceWorkQueueBatch(Batch);
     }
+
+    if (!PhWaitForEvent(&Batch->CompletedEvent, Timeout))
+        return FALSE;
+
+    // The event is set just before the worker's last access to the batch. Wait for that access
+    // so that the caller can free the batch.
+    while (!Batch->Completed)
+        YieldProcessor();
+
+    return TRUE;
+}
+
+/**
+ * Retrieves statistics for a work queue.
+ *
+ * \param WorkQueue A work queue object.
+ * \param Statistics A variable which receives the statistics.
+ */
+VOID PhGetStatisticsWorkQueue(
+    _In_ PPH_WORK_QUEUE WorkQueue,
+    _Out_ PPH_WORK_QUEUE_STATISTICS Statistics
+    )
+{
+    ULONG numberOfItemsQueued;
+    ULONG numberOfItemsDequeued;
+
+    numberOfItemsQueued = WorkQueue->NumberOfItemsQueued;
+    numberOfItemsDequeued = WorkQueue->NumberOfItemsDequeued;
+
+    Statistics->Depth = WorkQueue->Depth > 0 ? WorkQueue->Depth : 0;
+    Statistics->MaximumDepth = WorkQueue->MaximumDepth;
+    Statistics->NumberOfItemsQueued = numberOfItemsQueued;
+    Statistics->NumberOfItemsDequeued = numberOfItemsDequeued;
+    Statistics->AverageEnqueueCycles = numberOfItemsQueued != 0 ? WorkQueue->EnqueueCycles / numberOfItemsQueued : 0;
+    Statistics->AverageWaitCycles = numberOfItemsDequeued != 0 ? WorkQueue->WaitCycles / numberOfItemsDequeued : 0;
+    Statistics->MaximumWaitCycles = WorkQueue->MaximumWaitCycles;
 }
 
 /**
@@ -0,0 +1,592 @@
+/*
+ * Process Hacker .NET Tools -
+ *   assembly monitor
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A rundown session has to be started every time the .NET Assemblies page is opened, and it
+ * can take several seconds before the runtime of a busy process answers. Instead, one session
+ * listens to the loader events of the CLR runtime provider for as long as Process Hacker runs.
+ * The load events carry the same data as the rundown events, so they are kept (under the event
+ * ID of the matching rundown event) for each process, and removed again when the runtime
+ * unloads the AppDomain, assembly or module. The page replays the recorded events of processes
+ * that were started after the session, and only falls back to a rundown for other processes.
+ */
+
+#include "dn.h"
+#include <evntcons.h>
+#include "clretw.h"
+
+typedef struct _ASM_MONITOR_RECORD
+{
+    USHORT EventId; // rundown event ID
+    USHORT ClrInstanceID;
+    ULONG64 Id; // AppDomainID, AssemblyID or ModuleID
+    ULONG64 ParentId; // AppDomainID of an assembly, AssemblyID of a module
+    ULONG UserDataLength;
+    UCHAR UserData[1];
+} ASM_MONITOR_RECORD, *PASM_MONITOR_RECORD;
+
+typedef struct _ASM_MONITOR_PROCESS
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime; // 0 if the process couldn't be opened
+    PPH_LIST Records; // PASM_MONITOR_RECORD in the order they were loaded
+} ASM_MONITOR_PROCESS, *PASM_MONITOR_PROCESS;
+
+static GUID ClrRuntimeProviderGuid = { 0xe13c0d23, 0xccbc, 0x4e12, { 0x93, 0x1b, 0xd9, 0xcc, 0x2e, 0xee, 0x27, 0xe4 } };
+static UNICODE_STRING AsmMonitorLoggerName = RTL_CONSTANT_STRING(L"PhDnAsmLogger");
+
+static BOOLEAN AsmMonitorEnabled;
+static BOOLEAN AsmMonitorStartedSession;
+static BOOLEAN AsmMonitorExiting;
+static TRACEHANDLE AsmMonitorSessionHandle;
+static PEVENT_TRACE_PROPERTIES AsmMonitorTraceProperties;
+static HANDLE AsmMonitorThreadHandle;
+static LARGE_INTEGER AsmMonitorStartTime; // processes created after this time are fully recorded
+
+static PPH_HASHTABLE AsmMonitorHashtable; // PASM_MONITOR_PROCESS by process ID
+static PH_QUEUED_LOCK AsmMonitorLock = PH_QUEUED_LOCK_INIT;
+static PH_CALLBACK_REGISTRATION AsmMonitorProcessRemovedRegistration;
+
+static VOID FreeAsmMonitorProcess(
+    _In_ PASM_MONITOR_PROCESS Process
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Process->Records->Count; i++)
+        PhFree(Process->Records->Items[i]);
+
+    PhDereferenceObject(Process->Records);
+    PhFree(Process);
+}
+
+static VOID ClearAsmMonitorProcesses(
+    VOID
+    )
+{
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PPH_KEY_VALUE_PAIR entry;
+
+    PhBeginEnumHashtable(AsmMonitorHashtable, &enumContext);
+
+    while (entry = PhNextEnumHashtable(&enumContext))
+        FreeAsmMonitorProcess(entry->Value);
+
+    PhClearHashtable(AsmMonitorHashtable);
+}
+
+static VOID NTAPI AsmMonitorProcessRemovedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_PROCESS_ITEM processItem = Parameter;
+    PASM_MONITOR_PROCESS process = NULL;
+    PVOID *item;
+
+    PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+
+    if (item = PhFindItemSimpleHashtable(AsmMonitorHashtable, processItem->ProcessId))
+    {
+        process = *item;
+
+        if (process->CreateTime.QuadPart == 0 || process->CreateTime.QuadPart == processItem->CreateTime.QuadPart)
+            PhRemoveItemSimpleHashtable(AsmMonitorHashtable, processItem->ProcessId);
+        else
+            process = NULL;
+    }
+
+    PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+
+    if (process)
+        FreeAsmMonitorProcess(process);
+}
+
+static ULONG StartAsmMonitorSession(
+    VOID
+    )
+{
+    static _EnableTraceEx EnableTraceEx_I = NULL;
+    ULONG result;
+    ULONG bufferSize;
+
+    if (!EnableTraceEx_I)
+        EnableTraceEx_I = PhGetModuleProcAddress(L"advapi32.dll", "EnableTraceEx");
+    if (!EnableTraceEx_I)
+        return ERROR_NOT_SUPPORTED;
+
+    bufferSize = sizeof(EVENT_TRACE_PROPERTIES) + AsmMonitorLoggerName.Length + sizeof(WCHAR);
+
+    if (!AsmMonitorTraceProperties)
+        AsmMonitorTraceProperties = PhAllocate(bufferSize);
+
+    memset(AsmMonitorTraceProperties, 0, sizeof(EVENT_TRACE_PROPERTIES));
+
+    AsmMonitorTraceProperties->Wnode.BufferSize = bufferSize;
+    AsmMonitorTraceProperties->Wnode.ClientContext = 2; // System time clock resolution
+    AsmMonitorTraceProperties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    AsmMonitorTraceProperties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE | EVENT_TRACE_USE_PAGED_MEMORY;
+    AsmMonitorTraceProperties->FlushTimer = 1;
+    AsmMonitorTraceProperties->LogFileNameOffset = 0;
+    AsmMonitorTraceProperties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+
+    result = StartTrace(&AsmMonitorSessionHandle, AsmMonitorLoggerName.Buffer, AsmMonitorTraceProperties);
+
+    if (result == ERROR_SUCCESS)
+    {
+        AsmMonitorStartedSession = TRUE;
+    }
+    else if (result == ERROR_ALREADY_EXISTS)
+    {
+        // Another instance owns the session, so just listen to it.
+        result = ControlTrace(0, AsmMonitorLoggerName.Buffer, AsmMonitorTraceProperties, EVENT_TRACE_CONTROL_QUERY);
+
+        if (result != ERROR_SUCCESS)
+            return result;
+
+        AsmMonitorSessionHandle = AsmMonitorTraceProperties->Wnode.HistoricalContext;
+        AsmMonitorStartedSession = FALSE;
+    }
+    else
+    {
+        return result;
+    }
+
+    result = EnableTraceEx_I(
+        &ClrRuntimeProviderGuid,
+        NULL,
+        AsmMonitorSessionHandle,
+        1,
+        TRACE_LEVEL_INFORMATION,
+        CLR_LOADER_KEYWORD,
+        0,
+        0,
+        NULL
+        );
+
+    if (result != ERROR_SUCCESS)
+    {
+        if (AsmMonitorStartedSession)
+            ControlTrace(AsmMonitorSessionHandle, NULL, AsmMonitorTraceProperties, EVENT_TRACE_CONTROL_STOP);
+
+        return result;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static BOOLEAN GetEventStringEnd(
+    _In_ PEVENT_RECORD EventRecord,
+    _In_ ULONG Offset,
+    _Out_ PULONG EndOffset
+    )
+{
+    PWCHAR buffer = (PWCHAR)((PCHAR)EventRecord->UserData + Offset);
+    ULONG count;
+    ULONG i;
+
+    if (Offset >= EventRecord->UserDataLength)
+        return FALSE;
+
+    count = (EventRecord->UserDataLength - Offset) / sizeof(WCHAR);
+
+    for (i = 0; i < count; i++)
+    {
+        if (buffer[i] == 0)
+        {
+            *EndOffset = Offset + (i + 1) * sizeof(WCHAR);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static PASM_MONITOR_PROCESS GetAsmMonitorProcess(
+    _In_ HANDLE ProcessId
+    )
+{
+    PASM_MONITOR_PROCESS process;
+    PVOID *item;
+    HANDLE processHandle;
+    KERNEL_USER_TIMES times;
+
+    if (item = PhFindItemSimpleHashtable(AsmMonitorHashtable, ProcessId))
+        return *item;
+
+    process = PhAllocate(sizeof(ASM_MONITOR_PROCESS));
+    process->ProcessId = ProcessId;
+    process->CreateTime.QuadPart = 0;
+    process->Records = PhCreateList(16);
+
+    if (NT_SUCCESS(PhOpenProcess(&processHandle, ProcessQueryAccess, ProcessId)))
+    {
+        if (NT_SUCCESS(PhGetProcessTimes(processHandle, &times)))
+            process->CreateTime = times.CreateTime;
+
+        NtClose(processHandle);
+    }
+
+    PhAddItemSimpleHashtable(AsmMonitorHashtable, ProcessId, process);
+
+    return process;
+}
+
+static VOID AddAsmMonitorRecord(
+    _In_ PEVENT_RECORD EventRecord,
+    _In_ USHORT EventId,
+    _In_ USHORT ClrInstanceID,
+    _In_ ULONG64 Id,
+    _In_ ULONG64 ParentId
+    )
+{
+    PASM_MONITOR_PROCESS process;
+    PASM_MONITOR_RECORD record;
+
+    record = PhAllocate(FIELD_OFFSET(ASM_MONITOR_RECORD, UserData) + EventRecord->UserDataLength);
+    record->EventId = EventId;
+    record->ClrInstanceID = ClrInstanceID;
+    record->Id = Id;
+    record->ParentId = ParentId;
+    record->UserDataLength = EventRecord->UserDataLength;
+    memcpy(record->UserData, EventRecord->UserData, EventRecord->UserDataLength);
+
+    PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+    process = GetAsmMonitorProcess(UlongToHandle(EventRecord->EventHeader.ProcessId));
+    PhAddItemList(process->Records, record);
+    PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+}
+
+static VOID RemoveAsmMonitorRecords(
+    _In_ PASM_MONITOR_PROCESS Process,
+    _In_ USHORT EventId,
+    _In_ USHORT ClrInstanceID,
+    _In_ ULONG64 Id,
+    _In_ BOOLEAN MatchParent
+    )
+{
+    ULONG i;
+
+    // Children are always loaded after their parent, so removing them never moves the records
+    // we haven't looked at yet.
+
+    i = 0;
+
+    while (i < Process->Records->Count)
+    {
+        PASM_MONITOR_RECORD record = Process->Records->Items[i];
+
+        if (
+            record->EventId == EventId &&
+            record->ClrInstanceID == ClrInstanceID &&
+            (MatchParent ? record->ParentId : record->Id) == Id
+            )
+        {
+            PhRemoveItemList(Process->Records, i);
+
+            if (EventId == AppDomainDCStart_V1)
+                RemoveAsmMonitorRecords(Process, AssemblyDCStart_V1, ClrInstanceID, record->Id, TRUE);
+            else if (EventId == AssemblyDCStart_V1)
+                RemoveAsmMonitorRecords(Process, ModuleDCStart_V1, ClrInstanceID, record->Id, TRUE);
+
+            PhFree(record);
+            continue;
+        }
+
+        i++;
+    }
+}
+
+static VOID RemoveAsmMonitorRecord(
+    _In_ PEVENT_RECORD EventRecord,
+    _In_ USHORT EventId,
+    _In_ USHORT ClrInstanceID,
+    _In_ ULONG64 Id
+    )
+{
+    PVOID *item;
+
+    PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+
+    if (item = PhFindItemSimpleHashtable(AsmMonitorHashtable, UlongToHandle(EventRecord->EventHeader.ProcessId)))
+        RemoveAsmMonitorRecords(*item, EventId, ClrInstanceID, Id, FALSE);
+
+    PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+}
+
+static ULONG NTAPI AsmMonitorBufferCallback(
+    _In_ PEVENT_TRACE_LOGFILE Buffer
+    )
+{
+    return !AsmMonitorExiting;
+}
+
+static VOID NTAPI AsmMonitorEventCallback(
+    _In_ PEVENT_RECORD EventRecord
+    )
+{
+    PEVENT_HEADER eventHeader = &EventRecord->EventHeader;
+    ULONG offset;
+
+    if (memcmp(&eventHeader->ProviderId, &ClrRuntimeProviderGuid, sizeof(GUID)) != 0)
+        return;
+
+    // Every payload is checked here so that the page can parse the recorded copies without
+    // checking them again.
+
+    switch (eventHeader->EventDescriptor.Id)
+    {
+    case RuntimeInformationStart:
+        {
+            PRuntimeInformationRundown data = EventRecord->UserData;
+
+            if (!GetEventStringEnd(EventRecord, FIELD_OFFSET(RuntimeInformationRundown, CommandLine), &offset))
+                break;
+
+            AddAsmMonitorRecord(EventRecord, RuntimeInformationDCStart, data->ClrInstanceID, 0, 0);
+        }
+        break;
+    case AppDomainLoad_V1:
+    case AppDomainUnLoad_V1:
+        {
+            PAppDomainLoadUnloadRundown_V1 data = EventRecord->UserData;
+            USHORT clrInstanceID;
+
+            if (!GetEventStringEnd(EventRecord, FIELD_OFFSET(AppDomainLoadUnloadRundown_V1, AppDomainName), &offset))
+                break;
+            if (offset + sizeof(ULONG) + sizeof(USHORT) > EventRecord->UserDataLength)
+                break;
+
+            clrInstanceID = *(PUSHORT)((PCHAR)data + offset + sizeof(ULONG));
+
+            if (eventHeader->EventDescriptor.Id == AppDomainLoad_V1)
+                AddAsmMonitorRecord(EventRecord, AppDomainDCStart_V1, clrInstanceID, data->AppDomainID, 0);
+            else
+                RemoveAsmMonitorRecord(EventRecord, AppDomainDCStart_V1, clrInstanceID, data->AppDomainID);
+        }
+        break;
+    case AssemblyLoad_V1:
+    case AssemblyUnload_V1:
+        {
+            PAssemblyLoadUnloadRundown_V1 data = EventRecord->UserData;
+            USHORT clrInstanceID;
+
+            if (!GetEventStringEnd(EventRecord, FIELD_OFFSET(AssemblyLoadUnloadRundown_V1, FullyQualifiedAssemblyName), &offset))
+                break;
+            if (offset + sizeof(USHORT) > EventRecord->UserDataLength)
+                break;
+
+            clrInstanceID = *(PUSHORT)((PCHAR)data + offset);
+
+            if (eventHeader->EventDescriptor.Id == AssemblyLoad_V1)
+                AddAsmMonitorRecord(EventRecord, AssemblyDCStart_V1, clrInstanceID, data->AssemblyID, data->AppDomainID);
+            else
+                RemoveAsmMonitorRecord(EventRecord, AssemblyDCStart_V1, clrInstanceID, data->AssemblyID);
+        }
+        break;
+    case ModuleLoad_V2:
+    case ModuleUnload_V2:
+        {
+            PModuleLoadUnloadRundown_V1 data = EventRecord->UserData;
+            USHORT clrInstanceID;
+
+            if (!GetEventStringEnd(EventRecord, FIELD_OFFSET(ModuleLoadUnloadRundown_V1, ModuleILPath), &offset))
+                break;
+            if (!GetEventStringEnd(EventRecord, offset, &offset))
+                break;
+            if (offset + sizeof(USHORT) > EventRecord->UserDataLength)
+                break;
+
+            clrInstanceID = *(PUSHORT)((PCHAR)data + offset);
+
+            if (eventHeader->EventDescriptor.Id == ModuleLoad_V2)
+                AddAsmMonitorRecord(EventRecord, ModuleDCStart_V1, clrInstanceID, data->ModuleID, data->AssemblyID);
+            else
+                RemoveAsmMonitorRecord(EventRecord, ModuleDCStart_V1, clrInstanceID, data->ModuleID);
+        }
+        break;
+    }
+}
+
+static NTSTATUS AsmMonitorThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    ULONG result;
+    EVENT_TRACE_LOGFILE logFile;
+    TRACEHANDLE traceHandle;
+
+    memset(&logFile, 0, sizeof(EVENT_TRACE_LOGFILE));
+    logFile.LoggerName = AsmMonitorLoggerName.Buffer;
+    logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
+    logFile.BufferCallback = AsmMonitorBufferCallback;
+    logFile.EventRecordCallback = AsmMonitorEventCallback;
+
+    while (TRUE)
+    {
+        result = ERROR_SUCCESS;
+        traceHandle = OpenTrace(&logFile);
+
+        if (traceHandle != INVALID_PROCESSTRACE_HANDLE)
+        {
+            // Events are only delivered while we are consuming them, so anything recorded before
+            // this point may be incomplete.
+            PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+            ClearAsmMonitorProcesses();
+            PhQuerySystemTime(&AsmMonitorStartTime);
+            PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+
+            while (!AsmMonitorExiting && (result = ProcessTrace(&traceHandle, 1, NULL, NULL)) == ERROR_SUCCESS)
+                NOTHING;
+
+            CloseTrace(traceHandle);
+        }
+
+        if (AsmMonitorExiting)
+            break;
+
+        if (result == ERROR_WMI_INSTANCE_NOT_FOUND)
+        {
+            PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+            AsmMonitorStartTime.QuadPart = MAXLONGLONG;
+            PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+
+            // The session was stopped by another program. Start it again.
+            if (StartAsmMonitorSession() != ERROR_SUCCESS)
+            {
+                PhAcquireQueuedLockExclusive(&AsmMonitorLock);
+                AsmMonitorEnabled = FALSE;
+                ClearAsmMonitorProcesses();
+                PhReleaseQueuedLockExclusive(&AsmMonitorLock);
+                break;
+            }
+        }
+        else
+        {
+            Sleep(250);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID InitializeAsmMonitor(
+    VOID
+    )
+{
+    if (!PhElevated || !PhGetIntegerSetting(SETTING_NAME_ENABLE_ASM_MONITOR))
+        return;
+
+    AsmMonitorHashtable = PhCreateSimpleHashtable(16);
+    AsmMonitorStartTime.QuadPart = MAXLONGLONG; // until the thread starts consuming events
+
+    if (StartAsmMonitorSession() != ERROR_SUCCESS)
+        return;
+
+    AsmMonitorEnabled = TRUE;
+
+    PhRegisterCallback(
+        &PhProcessRemovedEvent,
+        AsmMonitorProcessRemovedCallback,
+        NULL,
+        &AsmMonitorProcessRemovedRegistration
+        );
+
+    AsmMonitorThreadHandle = PhCreateThread(0, AsmMonitorThreadStart, NULL);
+}
+
+VOID UninitializeAsmMonitor(
+    VOID
+    )
+{
+    if (!AsmMonitorEnabled)
+        return;
+
+    AsmMonitorExiting = TRUE;
+
+    if (AsmMonitorStartedSession)
+        ControlTrace(AsmMonitorSessionHandle, NULL, AsmMonitorTraceProperties, EVENT_TRACE_CONTROL_STOP);
+}
+
+/**
+ * Enumerates the recorded assembly events of a process.
+ *
+ * \param ProcessItem The process item.
+ * \param Callback A function which receives each event, in the layout of the
+ * matching CLR v4 rundown event (RuntimeInformationDCStart, AppDomainDCStart_V1,
+ * AssemblyDCStart_V1 or ModuleDCStart_V1). The callback is executed with the
+ * monitor lock held, and may be NULL to only check the process.
+ * \param Context A user-defined value to pass to the callback.
+ *
+ * \return TRUE if the process has been monitored since it started and its
+ * runtime has been seen, otherwise FALSE. In that case the callback is not
+ * executed and a rundown is needed instead.
+ */
+BOOLEAN EnumAsmMonitorEvents(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_opt_ PDN_ASM_EVENT_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    )
+{
+    BOOLEAN result = FALSE;
+    PASM_MONITOR_PROCESS process;
+    PVOID *item;
+    ULONG i;
+
+    if (!AsmMonitorEnabled)
+        return FALSE;
+
+    PhAcquireQueuedLockShared(&AsmMonitorLock);
+
+    if (
+        AsmMonitorEnabled &&
+        ProcessItem->CreateTime.QuadPart > AsmMonitorStartTime.QuadPart &&
+        (item = PhFindItemSimpleHashtable(AsmMonitorHashtable, ProcessItem->ProcessId))
+        )
+    {
+        process = *item;
+
+        if (process->CreateTime.QuadPart == ProcessItem->CreateTime.QuadPart)
+        {
+            for (i = 0; i < process->Records->Count; i++)
+            {
+                if (((PASM_MONITOR_RECORD)process->Records->Items[i])->EventId == RuntimeInformationDCStart)
+                {
+                    result = TRUE;
+                    break;
+                }
+            }
+        }
+
+        if (result && Callback)
+        {
+            for (i = 0; i < process->Records->Count; i++)
+            {
+                PASM_MONITOR_RECORD record = process->Records->Items[i];
+
+                Callback(record->EventId, record->UserData, Context);
+            }
+        }
+    }
+
+    PhReleaseQueuedLockShared(&AsmMonitorLock);
+
+    return result;
+}
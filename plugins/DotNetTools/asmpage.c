@@ -98,18 +98,6 @@ typedef struct _FLAG_DEFINITION
     ULONG Flag;
 } FLAG_DEFINITION, *PFLAG_DEFINITION;
 
-typedef ULONG (__stdcall *_EnableTraceEx)(
-    _In_ LPCGUID ProviderId,
-    _In_opt_ LPCGUID SourceId,
-    _In_ TRACEHANDLE TraceHandle,
-    _In_ ULONG IsEnabled,
-    _In_ UCHAR Level,
-    _In_ ULONGLONG MatchAnyKeyword,
-    _In_ ULONGLONG MatchAllKeyword,
-    _In_ ULONG EnableProperty,
-    _In_opt_ PEVENT_FILTER_DESCRIPTOR EnableFilterDesc
-    );
-
 INT_PTR CALLBACK DotNetAsmPageDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -542,177 +530,192 @@ ULONG NTAPI DotNetBufferCallback(
     return TRUE;
 }
 
-VOID NTAPI DotNetEventCallback(
-    _In_ PEVENT_RECORD EventRecord
+VOID NTAPI AddDotNetAsmEvent(
+    _In_ USHORT EventId,
+    _In_ PVOID UserData,
+    _In_opt_ PVOID Context
     )
 {
-    PASMPAGE_CONTEXT context = EventRecord->UserContext;
-    PEVENT_HEADER eventHeader = &EventRecord->EventHeader;
-    PEVENT_DESCRIPTOR eventDescriptor = &eventHeader->EventDescriptor;
+    PASMPAGE_CONTEXT context = Context;
 
-    if (UlongToHandle(eventHeader->ProcessId) == context->ProcessItem->ProcessId)
-    {
-        // .NET 4.0+
+    // .NET 4.0+
 
-        switch (eventDescriptor->Id)
+    switch (EventId)
+    {
+    case RuntimeInformationDCStart:
         {
-        case RuntimeInformationDCStart:
-            {
-                PRuntimeInformationRundown data = EventRecord->UserData;
-                PDNA_NODE node;
-                PPH_STRING startupFlagsString;
-                PPH_STRING startupModeString;
-
-                // Check for duplicates.
-                if (FindClrNode(context, data->ClrInstanceID))
-                    break;
-
-                node = AddNode(context);
-                node->Type = DNA_TYPE_CLR;
-                node->u.Clr.ClrInstanceID = data->ClrInstanceID;
-                node->u.Clr.DisplayName = PhFormatString(L"CLR v%u.%u.%u.%u", data->VMMajorVersion, data->VMMinorVersion, data->VMBuildNumber, data->VMQfeNumber);
-                node->StructureText = node->u.Clr.DisplayName->sr;
-                node->IdText = PhFormatString(L"%u", data->ClrInstanceID);
+            PRuntimeInformationRundown data = UserData;
+            PDNA_NODE node;
+            PPH_STRING startupFlagsString;
+            PPH_STRING startupModeString;
 
-                startupFlagsString = FlagsToString(data->StartupFlags, StartupFlagsMap, sizeof(StartupFlagsMap));
-                startupModeString = FlagsToString(data->StartupMode, StartupModeMap, sizeof(StartupModeMap));
+            // Check for duplicates.
+            if (FindClrNode(context, data->ClrInstanceID))
+                break;
 
-                if (startupFlagsString->Length != 0 && startupModeString->Length != 0)
-                {
-                    node->FlagsText = PhConcatStrings(3, startupFlagsString->Buffer, L", ", startupModeString->Buffer);
-                    PhDereferenceObject(startupFlagsString);
-                    PhDereferenceObject(startupModeString);
-                }
-                else if (startupFlagsString->Length != 0)
-                {
-                    node->FlagsText = startupFlagsString;
-                    PhDereferenceObject(startupModeString);
-                }
-                else if (startupModeString->Length != 0)
-                {
-                    node->FlagsText = startupModeString;
-                    PhDereferenceObject(startupFlagsString);
-                }
+            node = AddNode(context);
+            node->Type = DNA_TYPE_CLR;
+            node->u.Clr.ClrInstanceID = data->ClrInstanceID;
+            node->u.Clr.DisplayName = PhFormatString(L"CLR v%u.%u.%u.%u", data->VMMajorVersion, data->VMMinorVersion, data->VMBuildNumber, data->VMQfeNumber);
+            node->StructureText = node->u.Clr.DisplayName->sr;
+            node->IdText = PhFormatString(L"%u", data->ClrInstanceID);
 
-                if (data->CommandLine[0])
-                    node->PathText = PhCreateString(data->CommandLine);
+            startupFlagsString = FlagsToString(data->StartupFlags, StartupFlagsMap, sizeof(StartupFlagsMap));
+            startupModeString = FlagsToString(data->StartupMode, StartupModeMap, sizeof(StartupModeMap));
 
-                PhAddItemList(context->NodeRootList, node);
+            if (startupFlagsString->Length != 0 && startupModeString->Length != 0)
+            {
+                node->FlagsText = PhConcatStrings(3, startupFlagsString->Buffer, L", ", startupModeString->Buffer);
+                PhDereferenceObject(startupFlagsString);
+                PhDereferenceObject(startupModeString);
             }
-            break;
-        case AppDomainDCStart_V1:
+            else if (startupFlagsString->Length != 0)
             {
-                PAppDomainLoadUnloadRundown_V1 data = EventRecord->UserData;
-                SIZE_T appDomainNameLength;
-                USHORT clrInstanceID;
-                PDNA_NODE parentNode;
-                PDNA_NODE node;
+                node->FlagsText = startupFlagsString;
+                PhDereferenceObject(startupModeString);
+            }
+            else if (startupModeString->Length != 0)
+            {
+                node->FlagsText = startupModeString;
+                PhDereferenceObject(startupFlagsString);
+            }
 
-                appDomainNameLength = PhCountStringZ(data->AppDomainName) * sizeof(WCHAR);
-                clrInstanceID = *(PUSHORT)((PCHAR)data + FIELD_OFFSET(AppDomainLoadUnloadRundown_V1, AppDomainName) + appDomainNameLength + sizeof(WCHAR) + sizeof(ULONG));
+            if (data->CommandLine[0])
+                node->PathText = PhCreateString(data->CommandLine);
 
-                // Find the CLR node to add the AppDomain node to.
-                parentNode = FindClrNode(context, clrInstanceID);
+            PhAddItemList(context->NodeRootList, node);
+        }
+        break;
+    case AppDomainDCStart_V1:
+        {
+            PAppDomainLoadUnloadRundown_V1 data = UserData;
+            SIZE_T appDomainNameLength;
+            USHORT clrInstanceID;
+            PDNA_NODE parentNode;
+            PDNA_NODE node;
 
-                if (parentNode)
-                {
-                    // Check for duplicates.
-                    if (FindAppDomainNode(parentNode, data->AppDomainID))
-                        break;
-
-                    node = AddNode(context);
-                    node->Type = DNA_TYPE_APPDOMAIN;
-                    node->u.AppDomain.AppDomainID = data->AppDomainID;
-                    node->u.AppDomain.DisplayName = PhConcatStrings2(L"AppDomain: ", data->AppDomainName);
-                    node->StructureText = node->u.AppDomain.DisplayName->sr;
-                    node->IdText = PhFormatString(L"%I64u", data->AppDomainID);
-                    node->FlagsText = FlagsToString(data->AppDomainFlags, AppDomainFlagsMap, sizeof(AppDomainFlagsMap));
-
-                    PhAddItemList(parentNode->Children, node);
-                }
-            }
-            break;
-        case AssemblyDCStart_V1:
+            appDomainNameLength = PhCountStringZ(data->AppDomainName) * sizeof(WCHAR);
+            clrInstanceID = *(PUSHORT)((PCHAR)data + FIELD_OFFSET(AppDomainLoadUnloadRundown_V1, AppDomainName) + appDomainNameLength + sizeof(WCHAR) + sizeof(ULONG));
+
+            // Find the CLR node to add the AppDomain node to.
+            parentNode = FindClrNode(context, clrInstanceID);
+
+            if (parentNode)
             {
-                PAssemblyLoadUnloadRundown_V1 data = EventRecord->UserData;
-                SIZE_T fullyQualifiedAssemblyNameLength;
-                USHORT clrInstanceID;
-                PDNA_NODE parentNode;
-                PDNA_NODE node;
-                PH_STRINGREF remainingPart;
+                // Check for duplicates.
+                if (FindAppDomainNode(parentNode, data->AppDomainID))
+                    break;
 
-                fullyQualifiedAssemblyNameLength = PhCountStringZ(data->FullyQualifiedAssemblyName) * sizeof(WCHAR);
-                clrInstanceID = *(PUSHORT)((PCHAR)data + FIELD_OFFSET(AssemblyLoadUnloadRundown_V1, FullyQualifiedAssemblyName) + fullyQualifiedAssemblyNameLength + sizeof(WCHAR));
+                node = AddNode(context);
+                node->Type = DNA_TYPE_APPDOMAIN;
+                node->u.AppDomain.AppDomainID = data->AppDomainID;
+                node->u.AppDomain.DisplayName = PhConcatStrings2(L"AppDomain: ", data->AppDomainName);
+                node->StructureText = node->u.AppDomain.DisplayName->sr;
+                node->IdText = PhFormatString(L"%I64u", data->AppDomainID);
+                node->FlagsText = FlagsToString(data->AppDomainFlags, AppDomainFlagsMap, sizeof(AppDomainFlagsMap));
+
+                PhAddItemList(parentNode->Children, node);
+            }
+        }
+        break;
+    case AssemblyDCStart_V1:
+        {
+            PAssemblyLoadUnloadRundown_V1 data = UserData;
+            SIZE_T fullyQualifiedAssemblyNameLength;
+            USHORT clrInstanceID;
+            PDNA_NODE parentNode;
+            PDNA_NODE node;
+            PH_STRINGREF remainingPart;
 
-                // Find the AppDomain node to add the Assembly node to.
+            fullyQualifiedAssemblyNameLength = PhCountStringZ(data->FullyQualifiedAssemblyName) * sizeof(WCHAR);
+            clrInstanceID = *(PUSHORT)((PCHAR)data + FIELD_OFFSET(AssemblyLoadUnloadRundown_V1, FullyQualifiedAssemblyName) + fullyQualifiedAssemblyNameLength + sizeof(WCHAR));
 
-                parentNode = FindClrNode(context, clrInstanceID);
+            // Find the AppDomain node to add the Assembly node to.
 
-                if (parentNode)
-                    parentNode = FindAppDomainNode(parentNode, data->AppDomainID);
+            parentNode = FindClrNode(context, clrInstanceID);
 
-                if (parentNode)
-                {
-                    // Check for duplicates.
-                    if (FindAssemblyNode(parentNode, data->AssemblyID))
-                        break;
+            if (parentNode)
+                parentNode = FindAppDomainNode(parentNode, data->AppDomainID);
 
-                    node = AddNode(context);
-                    node->Type = DNA_TYPE_ASSEMBLY;
-                    node->u.Assembly.AssemblyID = data->AssemblyID;
-                    node->u.Assembly.FullyQualifiedAssemblyName = PhCreateStringEx(data->FullyQualifiedAssemblyName, fullyQualifiedAssemblyNameLength);
+            if (parentNode)
+            {
+                // Check for duplicates.
+                if (FindAssemblyNode(parentNode, data->AssemblyID))
+                    break;
+
+                node = AddNode(context);
+                node->Type = DNA_TYPE_ASSEMBLY;
+                node->u.Assembly.AssemblyID = data->AssemblyID;
+                node->u.Assembly.FullyQualifiedAssemblyName = PhCreateStringEx(data->FullyQualifiedAssemblyName, fullyQualifiedAssemblyNameLength);
 
-                    // Display only the assembly name, not the whole fully qualified name.
-                    if (!PhSplitStringRefAtChar(&node->u.Assembly.FullyQualifiedAssemblyName->sr, ',', &node->StructureText, &remainingPart))
-                        node->StructureText = node->u.Assembly.FullyQualifiedAssemblyName->sr;
+                // Display only the assembly name, not the whole fully qualified name.
+                if (!PhSplitStringRefAtChar(&node->u.Assembly.FullyQualifiedAssemblyName->sr, ',', &node->StructureText, &remainingPart))
+                    node->StructureText = node->u.Assembly.FullyQualifiedAssemblyName->sr;
 
-                    node->IdText = PhFormatString(L"%I64u", data->AssemblyID);
-                    node->FlagsText = FlagsToString(data->AssemblyFlags, AssemblyFlagsMap, sizeof(AssemblyFlagsMap));
+                node->IdText = PhFormatString(L"%I64u", data->AssemblyID);
+                node->FlagsText = FlagsToString(data->AssemblyFlags, AssemblyFlagsMap, sizeof(AssemblyFlagsMap));
 
-                    PhAddItemList(parentNode->Children, node);
-                }
+                PhAddItemList(parentNode->Children, node);
             }
-            break;
-        case ModuleDCStart_V1:
-            {
-                PModuleLoadUnloadRundown_V1 data = EventRecord->UserData;
-                PWSTR moduleILPath;
-                SIZE_T moduleILPathLength;
-                PWSTR moduleNativePath;
-                SIZE_T moduleNativePathLength;
-                USHORT clrInstanceID;
-                PDNA_NODE node;
+        }
+        break;
+    case ModuleDCStart_V1:
+        {
+            PModuleLoadUnloadRundown_V1 data = UserData;
+            PWSTR moduleILPath;
+            SIZE_T moduleILPathLength;
+            PWSTR moduleNativePath;
+            SIZE_T moduleNativePathLength;
+            USHORT clrInstanceID;
+            PDNA_NODE node;
 
-                moduleILPath = data->ModuleILPath;
-                moduleILPathLength = PhCountStringZ(moduleILPath) * sizeof(WCHAR);
-                moduleNativePath = (PWSTR)((PCHAR)moduleILPath + moduleILPathLength + sizeof(WCHAR));
-                moduleNativePathLength = PhCountStringZ(moduleNativePath) * sizeof(WCHAR);
-                clrInstanceID = *(PUSHORT)((PCHAR)moduleNativePath + moduleNativePathLength + sizeof(WCHAR));
+            moduleILPath = data->ModuleILPath;
+            moduleILPathLength = PhCountStringZ(moduleILPath) * sizeof(WCHAR);
+            moduleNativePath = (PWSTR)((PCHAR)moduleILPath + moduleILPathLength + sizeof(WCHAR));
+            moduleNativePathLength = PhCountStringZ(moduleNativePath) * sizeof(WCHAR);
+            clrInstanceID = *(PUSHORT)((PCHAR)moduleNativePath + moduleNativePathLength + sizeof(WCHAR));
 
-                // Find the Assembly node to set the path on.
+            // Find the Assembly node to set the path on.
 
-                node = FindClrNode(context, clrInstanceID);
+            node = FindClrNode(context, clrInstanceID);
 
-                if (node)
-                    node = FindAssemblyNode2(node, data->AssemblyID);
+            if (node)
+                node = FindAssemblyNode2(node, data->AssemblyID);
 
-                if (node)
-                {
-                    PhMoveReference(&node->PathText, PhCreateStringEx(moduleILPath, moduleILPathLength));
+            if (node)
+            {
+                PhMoveReference(&node->PathText, PhCreateStringEx(moduleILPath, moduleILPathLength));
 
-                    if (moduleNativePathLength != 0)
-                        PhMoveReference(&node->NativePathText, PhCreateStringEx(moduleNativePath, moduleNativePathLength));
-                }
+                if (moduleNativePathLength != 0)
+                    PhMoveReference(&node->NativePathText, PhCreateStringEx(moduleNativePath, moduleNativePathLength));
             }
-            break;
-        case DCStartComplete_V1:
+        }
+        break;
+    }
+}
+
+VOID NTAPI DotNetEventCallback(
+    _In_ PEVENT_RECORD EventRecord
+    )
+{
+    PASMPAGE_CONTEXT context = EventRecord->UserContext;
+    PEVENT_HEADER eventHeader = &EventRecord->EventHeader;
+    PEVENT_DESCRIPTOR eventDescriptor = &eventHeader->EventDescriptor;
+
+    if (UlongToHandle(eventHeader->ProcessId) == context->ProcessItem->ProcessId)
+    {
+        // .NET 4.0+
+
+        if (eventDescriptor->Id == DCStartComplete_V1)
+        {
+            if (_InterlockedExchange(&context->TraceHandleActive, 0) == 1)
             {
-                if (_InterlockedExchange(&context->TraceHandleActive, 0) == 1)
-                {
-                    CloseTrace(context->TraceHandle);
-                }
+                CloseTrace(context->TraceHandle);
             }
-            break;
+        }
+        else
+        {
+            AddDotNetAsmEvent(eventDescriptor->Id, EventRecord->UserData, context);
         }
 
         // .NET 2.0
@@ -925,18 +928,17 @@ BOOLEAN IsProcessSuspended(
     _In_ HANDLE ProcessId
     )
 {
-    PVOID processes;
-    PSYSTEM_PROCESS_INFORMATION process;
+    PPH_PROCESS_ITEM processItem;
+    BOOLEAN suspended = FALSE;
 
-    if (NT_SUCCESS(PhEnumProcesses(&processes)))
+    // The process provider already tracks this; don't take a system-wide snapshot.
+    if (processItem = PhReferenceProcessItem(ProcessId))
     {
-        if (process = PhFindProcessInformation(processes, ProcessId))
-            return PhGetProcessIsSuspended(process);
-
-        PhFree(processes);
+        suspended = !!processItem->IsSuspended;
+        PhDereferenceObject(processItem);
     }
 
-    return FALSE;
+    return suspended;
 }
 
 INT_PTR CALLBACK DotNetAsmPageDlgProc(
@@ -965,6 +967,7 @@ INT_PTR CALLBACK DotNetAsmPageDlgProc(
     case WM_INITDIALOG:
         {
             ULONG result = 0;
+            BOOLEAN monitored = FALSE;
             PPH_STRING settings;
             LARGE_INTEGER timeout;
             HWND tnHandle;
@@ -1002,7 +1005,12 @@ INT_PTR CALLBACK DotNetAsmPageDlgProc(
 
             SetCursor(LoadCursor(NULL, IDC_WAIT));
 
+            // Processes started after the assembly monitor don't need a CLR v4 rundown.
+            if (context->ClrVersions & PH_CLR_VERSION_4_ABOVE)
+                monitored = EnumAsmMonitorEvents(processItem, NULL, NULL);
+
             if (
+                (monitored && !(context->ClrVersions & PH_CLR_VERSION_2_0)) ||
                 !IsProcessSuspended(processItem->ProcessId) ||
                 PhShowMessage(hwndDlg, MB_ICONWARNING | MB_YESNO, L".NET assembly enumeration may not work properly because the process is currently suspended. Do you want to continue?") == IDYES
                 )
@@ -1037,12 +1045,15 @@ INT_PTR CALLBACK DotNetAsmPageDlgProc(
 
                 if (context->ClrVersions & PH_CLR_VERSION_4_ABOVE)
                 {
-                    result = UpdateDotNetTraceInfoWithTimeout(context, FALSE, &timeout);
-
-                    if (result == ERROR_TIMEOUT)
+                    if (!monitored || !EnumAsmMonitorEvents(processItem, AddDotNetAsmEvent, context))
                     {
-                        timeoutReached = TRUE;
-                        result = ERROR_SUCCESS;
+                        result = UpdateDotNetTraceInfoWithTimeout(context, FALSE, &timeout);
+
+                        if (result == ERROR_TIMEOUT)
+                        {
+                            timeoutReached = TRUE;
+                            result = ERROR_SUCCESS;
+                        }
                     }
                 }
 
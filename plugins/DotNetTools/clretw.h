@@ -29,6 +29,16 @@
 
 // Event IDs
 
+// Runtime provider
+#define ModuleLoad_V2 152
+#define ModuleUnload_V2 153
+#define AssemblyLoad_V1 154
+#define AssemblyUnload_V1 155
+#define AppDomainLoad_V1 156
+#define AppDomainUnLoad_V1 157
+#define RuntimeInformationStart 187
+
+// Rundown provider
 #define DCStartComplete_V1 145
 #define ModuleDCStart_V1 153
 #define AssemblyDCStart_V1 155
@@ -143,4 +153,16 @@ typedef struct _RuntimeInformationRundown
 
 #include <poppack.h>
 
+typedef ULONG (__stdcall *_EnableTraceEx)(
+    _In_ LPCGUID ProviderId,
+    _In_opt_ LPCGUID SourceId,
+    _In_ TRACEHANDLE TraceHandle,
+    _In_ ULONG IsEnabled,
+    _In_ UCHAR Level,
+    _In_ ULONGLONG MatchAnyKeyword,
+    _In_ ULONGLONG MatchAllKeyword,
+    _In_ ULONG EnableProperty,
+    _In_opt_ PEVENT_FILTER_DESCRIPTOR EnableFilterDesc
+    );
+
 #endif
@@ -138,6 +138,349 @@ PPH_STRING GetRuntimeNameByAddressClrProcess(
     return buffer;
 }
 
+// The DAC is expensive to load and builds up its own view of the target as it is used, so one
+// data process object is kept for each process and reused by every stack walk. Method names are
+// cached by address range: a name is resolved once for each method, and its known range grows as
+// more addresses inside the method are seen. JIT-compiled code only moves when its AppDomain or
+// assembly is unloaded, so the performance counters of the runtime are checked before each walk:
+// new JIT activity only flushes the DAC, while unloads also clear the names. Without counters
+// (e.g. .NET Core) the names only live for a single walk.
+
+#define CLR_METHOD_CACHE_MAXIMUM_ENTRIES 4096
+
+typedef struct _CLR_METHOD_RANGE
+{
+    ULONG64 StartAddress;
+    ULONG64 EndAddress; // one past the highest address seen so far
+    PPH_STRING Name;
+} CLR_METHOD_RANGE, *PCLR_METHOD_RANGE;
+
+static PPH_OBJECT_TYPE ClrProcessCacheObjectType = NULL;
+static PPH_HASHTABLE ClrProcessCacheHashtable = NULL; // PCLR_PROCESS_CACHE by process ID
+static PH_QUEUED_LOCK ClrProcessCacheHashtableLock = PH_QUEUED_LOCK_INIT;
+static PH_CALLBACK_REGISTRATION ClrProcessCacheProcessRemovedRegistration;
+
+static VOID ClearClrMethodList(
+    _In_ PCLR_PROCESS_CACHE Cache
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Cache->MethodList->Count; i++)
+    {
+        PCLR_METHOD_RANGE range = Cache->MethodList->Items[i];
+
+        PhDereferenceObject(range->Name);
+        PhFree(range);
+    }
+
+    PhClearList(Cache->MethodList);
+}
+
+static VOID NTAPI ClrProcessCacheDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PCLR_PROCESS_CACHE cache = Object;
+
+    ClearClrMethodList(cache);
+    PhDereferenceObject(cache->MethodList);
+
+    if (cache->Support)
+        FreeClrProcessSupport(cache->Support);
+    if (cache->PerfBlock)
+        PhDereferenceObject(cache->PerfBlock);
+}
+
+static VOID NTAPI ClrProcessCacheProcessRemovedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_PROCESS_ITEM processItem = Parameter;
+    PCLR_PROCESS_CACHE cache = NULL;
+    PVOID *item;
+
+    PhAcquireQueuedLockExclusive(&ClrProcessCacheHashtableLock);
+
+    if (item = PhFindItemSimpleHashtable(ClrProcessCacheHashtable, processItem->ProcessId))
+    {
+        cache = *item;
+
+        if (cache->CreateTime.QuadPart == processItem->CreateTime.QuadPart)
+            PhRemoveItemSimpleHashtable(ClrProcessCacheHashtable, processItem->ProcessId);
+        else
+            cache = NULL;
+    }
+
+    PhReleaseQueuedLockExclusive(&ClrProcessCacheHashtableLock);
+
+    // Stack windows still using the cache keep their own reference.
+    if (cache)
+        PhDereferenceObject(cache);
+}
+
+/**
+ * Gets the cached CLR support of a process.
+ *
+ * \param ProcessId The ID of the process.
+ *
+ * \return A referenced cache, or NULL if the process does not exist. You
+ * must call RefreshClrProcessCache() before each stack walk, and dereference
+ * the cache when you no longer need it.
+ */
+PCLR_PROCESS_CACHE ReferenceClrProcessCache(
+    _In_ HANDLE ProcessId
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PPH_PROCESS_ITEM processItem;
+    PCLR_PROCESS_CACHE cache = NULL;
+    PCLR_PROCESS_CACHE staleCache = NULL;
+    PVOID *item;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        ClrProcessCacheObjectType = PhCreateObjectType(L"DnClrProcessCache", 0, ClrProcessCacheDeleteProcedure);
+        ClrProcessCacheHashtable = PhCreateSimpleHashtable(8);
+
+        PhRegisterCallback(
+            &PhProcessRemovedEvent,
+            ClrProcessCacheProcessRemovedCallback,
+            NULL,
+            &ClrProcessCacheProcessRemovedRegistration
+            );
+
+        PhEndInitOnce(&initOnce);
+    }
+
+    if (!(processItem = PhReferenceProcessItem(ProcessId)))
+        return NULL;
+
+    PhAcquireQueuedLockExclusive(&ClrProcessCacheHashtableLock);
+
+    if (item = PhFindItemSimpleHashtable(ClrProcessCacheHashtable, ProcessId))
+    {
+        cache = *item;
+
+        if (cache->CreateTime.QuadPart != processItem->CreateTime.QuadPart)
+        {
+            PhRemoveItemSimpleHashtable(ClrProcessCacheHashtable, ProcessId);
+            staleCache = cache;
+            cache = NULL;
+        }
+    }
+
+    if (!cache)
+    {
+        // The data process is created by the first refresh so that the hashtable lock isn't held
+        // while the DAC is loaded.
+        cache = PhCreateObject(sizeof(CLR_PROCESS_CACHE), ClrProcessCacheObjectType);
+        memset(cache, 0, sizeof(CLR_PROCESS_CACHE));
+        cache->ProcessId = ProcessId;
+        cache->CreateTime = processItem->CreateTime;
+        PhInitializeQueuedLock(&cache->Lock);
+        cache->MethodList = PhCreateList(64);
+
+        PhAddItemSimpleHashtable(ClrProcessCacheHashtable, ProcessId, cache);
+    }
+
+    PhReferenceObject(cache);
+
+    PhReleaseQueuedLockExclusive(&ClrProcessCacheHashtableLock);
+
+    if (staleCache)
+        PhDereferenceObject(staleCache);
+
+    PhDereferenceObject(processItem);
+
+    return cache;
+}
+
+/**
+ * Prepares a cached CLR support for a stack walk. The data process is created
+ * if necessary, and cached information is discarded if the runtime has
+ * compiled or unloaded code since the last walk.
+ *
+ * \param Cache The cache.
+ */
+VOID RefreshClrProcessCache(
+    _In_ PCLR_PROCESS_CACHE Cache
+    )
+{
+    BOOLEAN flush = TRUE;
+    BOOLEAN clear = TRUE;
+    ULONG methodsJitted;
+    ULONG unloadCount;
+
+    PhAcquireQueuedLockExclusive(&Cache->Lock);
+
+    if (!Cache->Support)
+        Cache->Support = CreateClrProcessSupport(Cache->ProcessId);
+
+    if (!Cache->PerfBlock || !IsDotNetPerfBlockCurrent(Cache->PerfBlock))
+    {
+        PPH_PROCESS_ITEM processItem;
+        HANDLE processHandle;
+
+        if (processItem = PhReferenceProcessItem(Cache->ProcessId))
+        {
+            if (NT_SUCCESS(PhOpenProcess(
+                &processHandle,
+                PROCESS_VM_READ | ProcessQueryAccess | PROCESS_DUP_HANDLE | SYNCHRONIZE,
+                Cache->ProcessId
+                )))
+            {
+                PhMoveReference(&Cache->PerfBlock, ReferenceDotNetPerfBlock(processItem, processHandle));
+                NtClose(processHandle);
+            }
+
+            PhDereferenceObject(processItem);
+        }
+    }
+
+    if (Cache->PerfBlock && QueryDotNetPerfBlockLoaderCounters(Cache->PerfBlock, &methodsJitted, &unloadCount))
+    {
+        if (Cache->CountersValid && unloadCount == Cache->UnloadCount)
+        {
+            clear = FALSE;
+            flush = methodsJitted != Cache->MethodsJitted;
+        }
+
+        Cache->CountersValid = TRUE;
+        Cache->MethodsJitted = methodsJitted;
+        Cache->UnloadCount = unloadCount;
+    }
+    else
+    {
+        Cache->CountersValid = FALSE;
+    }
+
+    if (flush && Cache->Support)
+        IXCLRDataProcess_Flush(Cache->Support->DataProcess);
+    if (clear)
+        ClearClrMethodList(Cache);
+
+    PhReleaseQueuedLockExclusive(&Cache->Lock);
+}
+
+static LONG FindClrMethodRange(
+    _In_ PCLR_PROCESS_CACHE Cache,
+    _In_ ULONG64 Address
+    )
+{
+    LONG low;
+    LONG high;
+    LONG result;
+
+    // Find the last range that starts at or before the address.
+
+    low = 0;
+    high = (LONG)Cache->MethodList->Count - 1;
+    result = -1;
+
+    while (low <= high)
+    {
+        LONG i = (low + high) / 2;
+        PCLR_METHOD_RANGE range = Cache->MethodList->Items[i];
+
+        if (range->StartAddress <= Address)
+        {
+            result = i;
+            low = i + 1;
+        }
+        else
+        {
+            high = i - 1;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Gets the name of the managed method containing an address, using the
+ * method names cached for the process where possible.
+ *
+ * \param Cache The cache.
+ * \param Address The address.
+ * \param Displacement A variable which receives the offset of the address
+ * from the start of the method.
+ *
+ * \return The name of the method, or NULL if the address is not in managed
+ * code.
+ */
+PPH_STRING GetRuntimeNameByAddressClrProcessCache(
+    _In_ PCLR_PROCESS_CACHE Cache,
+    _In_ ULONG64 Address,
+    _Out_opt_ PULONG64 Displacement
+    )
+{
+    PPH_STRING name = NULL;
+    ULONG64 displacement;
+    LONG index;
+    PCLR_METHOD_RANGE range;
+
+    // The DAC isn't thread-safe, so lookups are done with the lock held exclusively.
+    PhAcquireQueuedLockExclusive(&Cache->Lock);
+
+    if (!Cache->Support)
+        goto CleanupExit;
+
+    index = FindClrMethodRange(Cache, Address);
+
+    if (index != -1)
+    {
+        range = Cache->MethodList->Items[index];
+
+        if (Address < range->EndAddress)
+        {
+            PhSetReference(&name, range->Name);
+            displacement = Address - range->StartAddress;
+            goto CleanupExit;
+        }
+    }
+
+    if (!(name = GetRuntimeNameByAddressClrProcess(Cache->Support, Address, &displacement)))
+        goto CleanupExit;
+
+    // Ranges must stay sorted and must not overlap.
+    if (displacement > Address)
+        goto CleanupExit;
+    if (index != -1 && (range = Cache->MethodList->Items[index])->StartAddress > Address - displacement)
+        goto CleanupExit;
+
+    if (index != -1 && range->StartAddress == Address - displacement)
+    {
+        // A larger offset into a method we already know.
+        range->EndAddress = Address + 1;
+    }
+    else
+    {
+        if (Cache->MethodList->Count >= CLR_METHOD_CACHE_MAXIMUM_ENTRIES)
+        {
+            ClearClrMethodList(Cache);
+            index = -1;
+        }
+
+        range = PhAllocate(sizeof(CLR_METHOD_RANGE));
+        range->StartAddress = Address - displacement;
+        range->EndAddress = Address + 1;
+        range->Name = name;
+        PhReferenceObject(name);
+        PhInsertItemList(Cache->MethodList, index + 1, range);
+    }
+
+CleanupExit:
+    PhReleaseQueuedLockExclusive(&Cache->Lock);
+
+    if (name && Displacement)
+        *Displacement = displacement;
+
+    return name;
+}
+
 PPH_STRING GetNameXClrDataAppDomain(
     _In_ PVOID AppDomain
     )
@@ -50,6 +50,36 @@ PPH_STRING GetRuntimeNameByAddressClrProcess(
     _Out_opt_ PULONG64 Displacement
     );
 
+// Cached process support
+
+typedef struct _CLR_PROCESS_CACHE
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+
+    PH_QUEUED_LOCK Lock; // guards Support and the fields below
+    PCLR_PROCESS_SUPPORT Support;
+    PDN_PERF_BLOCK PerfBlock;
+    BOOLEAN CountersValid;
+    ULONG MethodsJitted;
+    ULONG UnloadCount;
+    PPH_LIST MethodList; // PCLR_METHOD_RANGE sorted by StartAddress
+} CLR_PROCESS_CACHE, *PCLR_PROCESS_CACHE;
+
+PCLR_PROCESS_CACHE ReferenceClrProcessCache(
+    _In_ HANDLE ProcessId
+    );
+
+VOID RefreshClrProcessCache(
+    _In_ PCLR_PROCESS_CACHE Cache
+    );
+
+PPH_STRING GetRuntimeNameByAddressClrProcessCache(
+    _In_ PCLR_PROCESS_CACHE Cache,
+    _In_ ULONG64 Address,
+    _Out_opt_ PULONG64 Displacement
+    );
+
 PPH_STRING GetNameXClrDataAppDomain(
     _In_ PVOID AppDomain
     );
@@ -1157,4 +1157,301 @@ PPH_LIST QueryDotNetAppDomainsForPid_V4(
     }
 
     return appDomainsList;
-}
\ No newline at end of file
+}
+static PPH_OBJECT_TYPE PerfBlockObjectType = NULL;
+static PPH_HASHTABLE PerfBlockHashtable = NULL; // PDN_PERF_BLOCK by process ID
+static PH_QUEUED_LOCK PerfBlockHashtableLock = PH_QUEUED_LOCK_INIT;
+static PH_CALLBACK_REGISTRATION PerfBlockProcessRemovedRegistration;
+
+static VOID NTAPI PerfBlockDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
+    )
+{
+    PDN_PERF_BLOCK perfBlock = Object;
+
+    if (perfBlock->BlockTableAddress)
+        NtUnmapViewOfSection(NtCurrentProcess(), perfBlock->BlockTableAddress);
+    if (perfBlock->BlockTableHandle)
+        NtClose(perfBlock->BlockTableHandle);
+}
+
+static VOID NTAPI PerfBlockProcessRemovedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    PPH_PROCESS_ITEM processItem = Parameter;
+    PDN_PERF_BLOCK perfBlock = NULL;
+    PVOID *item;
+
+    PhAcquireQueuedLockExclusive(&PerfBlockHashtableLock);
+
+    if (item = PhFindItemSimpleHashtable(PerfBlockHashtable, processItem->ProcessId))
+    {
+        perfBlock = *item;
+
+        if (perfBlock->CreateTime.QuadPart == processItem->CreateTime.QuadPart)
+            PhRemoveItemSimpleHashtable(PerfBlockHashtable, processItem->ProcessId);
+        else
+            perfBlock = NULL;
+    }
+
+    PhReleaseQueuedLockExclusive(&PerfBlockHashtableLock);
+
+    // Pages still using the block keep their own reference.
+    if (perfBlock)
+        PhDereferenceObject(perfBlock);
+}
+
+static VOID SnapPerfBlockHeader(
+    _In_ PDN_PERF_BLOCK PerfBlock,
+    _Out_ PULONG RuntimeId,
+    _Out_ PUSHORT Version,
+    _Out_ PULONG BlockSize
+    )
+{
+    if (PerfBlock->ClrV4)
+    {
+        // The 32bit and 64bit tables share the same header layout.
+        IPCControlBlockTable* ipcBlockTable = PerfBlock->BlockTableAddress;
+
+        *RuntimeId = ipcBlockTable->Blocks->Header.RuntimeId;
+        *Version = ipcBlockTable->Blocks->Header.Version;
+        *BlockSize = ipcBlockTable->Blocks->Header.blockSize;
+    }
+    else
+    {
+        LegacyPublicIPCControlBlock* ipcLegacyBlockTable = PerfBlock->BlockTableAddress;
+
+        // Legacy blocks don't carry a runtime ID; the mapping is per-process.
+        *RuntimeId = 0;
+        *Version = ipcLegacyBlockTable->FullIPCHeaderLegacyPublic.Header.Version;
+        *BlockSize = ipcLegacyBlockTable->FullIPCHeaderLegacyPublic.Header.BlockSize;
+    }
+}
+
+static VOID ProbePerfBlock(
+    _Inout_ PDN_PERF_BLOCK PerfBlock,
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ HANDLE ProcessHandle
+    )
+{
+    ULONG flags = 0;
+
+    if (NT_SUCCESS(PhGetProcessIsDotNetEx(
+        ProcessItem->ProcessId,
+        ProcessHandle,
+        ProcessItem->IsImmersive == 1 ? 0 : PH_CLR_USE_SECTION_CHECK,
+        NULL,
+        &flags
+        )))
+    {
+        if (flags & PH_CLR_VERSION_4_ABOVE)
+        {
+            PerfBlock->ClrV4 = TRUE;
+        }
+    }
+
+    if (PerfBlock->ClrV4)
+    {
+        if (!OpenDotNetPublicControlBlock_V4(
+            ProcessItem->IsImmersive == 1 ? TRUE : FALSE,
+            ProcessHandle,
+            ProcessItem->ProcessId,
+            &PerfBlock->BlockTableHandle,
+            &PerfBlock->BlockTableAddress
+            ))
+        {
+            PerfBlock->BlockTableHandle = NULL;
+            PerfBlock->BlockTableAddress = NULL;
+        }
+    }
+    else
+    {
+        if (!OpenDotNetPublicControlBlock_V2(
+            ProcessItem->ProcessId,
+            &PerfBlock->BlockTableHandle,
+            &PerfBlock->BlockTableAddress
+            ))
+        {
+            PerfBlock->BlockTableHandle = NULL;
+            PerfBlock->BlockTableAddress = NULL;
+        }
+    }
+
+    if (PerfBlock->BlockTableAddress)
+    {
+        SnapPerfBlockHeader(
+            PerfBlock,
+            &PerfBlock->RuntimeId,
+            &PerfBlock->Version,
+            &PerfBlock->BlockSize
+            );
+    }
+}
+
+/**
+ * Checks whether the header of a mapped IPC block still matches the header
+ * that was seen when the block was mapped.
+ *
+ * \param PerfBlock A cached IPC block.
+ *
+ * \return FALSE if the process has no block, or the runtime has released
+ * or re-created its block since it was mapped.
+ */
+BOOLEAN IsDotNetPerfBlockCurrent(
+    _In_ PDN_PERF_BLOCK PerfBlock
+    )
+{
+    ULONG runtimeId;
+    USHORT version;
+    ULONG blockSize;
+
+    if (!PerfBlock->BlockTableAddress)
+        return FALSE;
+
+    SnapPerfBlockHeader(PerfBlock, &runtimeId, &version, &blockSize);
+
+    if (PerfBlock->ClrV4 && runtimeId == 0) // chunk was freed
+        return FALSE;
+
+    return runtimeId == PerfBlock->RuntimeId && version == PerfBlock->Version && blockSize == PerfBlock->BlockSize;
+}
+
+/**
+ * Gets the cached IPC block of a process, mapping it if necessary.
+ *
+ * \param ProcessItem The process item.
+ * \param ProcessHandle A handle to the process, used only when the process
+ * needs to be probed.
+ *
+ * \return A referenced block. BlockTableAddress is NULL if the process does
+ * not expose performance counters. You must dereference the block when you
+ * no longer need it.
+ *
+ * \remarks Processes without a block are only probed again when the process
+ * provider changes its .NET state, i.e. after the CLR modules are loaded.
+ */
+PDN_PERF_BLOCK ReferenceDotNetPerfBlock(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ HANDLE ProcessHandle
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    PDN_PERF_BLOCK perfBlock = NULL;
+    PDN_PERF_BLOCK staleBlock = NULL;
+    PVOID *item;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        PerfBlockObjectType = PhCreateObjectType(L"DnPerfBlock", 0, PerfBlockDeleteProcedure);
+        PerfBlockHashtable = PhCreateSimpleHashtable(8);
+
+        PhRegisterCallback(
+            &PhProcessRemovedEvent,
+            PerfBlockProcessRemovedCallback,
+            NULL,
+            &PerfBlockProcessRemovedRegistration
+            );
+
+        PhEndInitOnce(&initOnce);
+    }
+
+    PhAcquireQueuedLockExclusive(&PerfBlockHashtableLock);
+
+    if (item = PhFindItemSimpleHashtable(PerfBlockHashtable, ProcessItem->ProcessId))
+    {
+        perfBlock = *item;
+
+        if (
+            perfBlock->CreateTime.QuadPart != ProcessItem->CreateTime.QuadPart ||
+            (perfBlock->BlockTableAddress ? !IsDotNetPerfBlockCurrent(perfBlock) : perfBlock->IsDotNet != !!ProcessItem->IsDotNet)
+            )
+        {
+            PhRemoveItemSimpleHashtable(PerfBlockHashtable, ProcessItem->ProcessId);
+            staleBlock = perfBlock;
+            perfBlock = NULL;
+        }
+    }
+
+    if (!perfBlock)
+    {
+        perfBlock = PhCreateObject(sizeof(DN_PERF_BLOCK), PerfBlockObjectType);
+        memset(perfBlock, 0, sizeof(DN_PERF_BLOCK));
+
+        perfBlock->ProcessId = ProcessItem->ProcessId;
+        perfBlock->CreateTime = ProcessItem->CreateTime;
+        perfBlock->IsDotNet = !!ProcessItem->IsDotNet;
+#ifdef _WIN64
+        perfBlock->IsWow64 = ProcessItem->IsWow64 == 1 ? TRUE : FALSE;
+#else
+        // HACK: Work-around for Appdomain enumeration on 32bit.
+        perfBlock->IsWow64 = TRUE;
+#endif
+
+        ProbePerfBlock(perfBlock, ProcessItem, ProcessHandle);
+
+        PhAddItemSimpleHashtable(PerfBlockHashtable, ProcessItem->ProcessId, perfBlock);
+    }
+
+    PhReferenceObject(perfBlock);
+
+    PhReleaseQueuedLockExclusive(&PerfBlockHashtableLock);
+
+    if (staleBlock)
+        PhDereferenceObject(staleBlock);
+
+    return perfBlock;
+}
+
+/**
+ * Gets the loader counters of a process that affect code addresses.
+ *
+ * \param PerfBlock A cached IPC block.
+ * \param MethodsJitted A variable which receives the number of methods
+ * compiled by the JIT.
+ * \param UnloadCount A variable which receives the number of AppDomains
+ * and assemblies that have been unloaded.
+ *
+ * \return TRUE if the counters were read, FALSE if the process does not
+ * expose performance counters or the block is no longer current.
+ */
+BOOLEAN QueryDotNetPerfBlockLoaderCounters(
+    _In_ PDN_PERF_BLOCK PerfBlock,
+    _Out_ PULONG MethodsJitted,
+    _Out_ PULONG UnloadCount
+    )
+{
+    PVOID perfStatBlock;
+
+    if (!IsDotNetPerfBlockCurrent(PerfBlock))
+        return FALSE;
+
+    if (PerfBlock->ClrV4)
+        perfStatBlock = GetPerfIpcBlock_V4(PerfBlock->IsWow64, PerfBlock->BlockTableAddress);
+    else
+        perfStatBlock = GetPerfIpcBlock_V2(PerfBlock->IsWow64, PerfBlock->BlockTableAddress);
+
+    if (!perfStatBlock)
+        return FALSE;
+
+    if (PerfBlock->IsWow64)
+    {
+        PerfCounterIPCControlBlock_Wow64* perfBlock = perfStatBlock;
+
+        *MethodsJitted = perfBlock->Jit.cMethodsJitted;
+        *UnloadCount = perfBlock->Loading.cAppDomainsUnloaded.Total +
+            (perfBlock->Loading.cAssemblies.Total - perfBlock->Loading.cAssemblies.Current);
+    }
+    else
+    {
+        PerfCounterIPCControlBlock* perfBlock = perfStatBlock;
+
+        *MethodsJitted = perfBlock->Jit.cMethodsJitted;
+        *UnloadCount = perfBlock->Loading.cAppDomainsUnloaded.Total +
+            (perfBlock->Loading.cAssemblies.Total - perfBlock->Loading.cAssemblies.Current);
+    }
+
+    return TRUE;
+}
@@ -34,6 +34,7 @@
 #define SETTING_NAME_ASM_TREE_LIST_COLUMNS (PLUGIN_NAME L".AsmTreeListColumns")
 #define SETTING_NAME_DOT_NET_CATEGORY_INDEX (PLUGIN_NAME L".DotNetCategoryIndex")
 #define SETTING_NAME_DOT_NET_COUNTERS_COLUMNS (PLUGIN_NAME L".DotNetListColumns")
+#define SETTING_NAME_ENABLE_ASM_MONITOR (PLUGIN_NAME L".EnableAssemblyMonitor")
 
 #define MSG_UPDATE (WM_APP + 1)
 
@@ -49,6 +50,38 @@ typedef struct _DN_THREAD_ITEM
 
 // counters
 
+typedef struct _DN_PERF_BLOCK
+{
+    HANDLE ProcessId;
+    LARGE_INTEGER CreateTime;
+    BOOLEAN IsDotNet; // process item state when the process was probed
+    BOOLEAN ClrV4;
+    BOOLEAN IsWow64;
+
+    HANDLE BlockTableHandle;
+    PVOID BlockTableAddress;
+
+    // Header values seen when the block was mapped
+    ULONG RuntimeId;
+    USHORT Version;
+    ULONG BlockSize;
+} DN_PERF_BLOCK, *PDN_PERF_BLOCK;
+
+PDN_PERF_BLOCK ReferenceDotNetPerfBlock(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_ HANDLE ProcessHandle
+    );
+
+BOOLEAN IsDotNetPerfBlockCurrent(
+    _In_ PDN_PERF_BLOCK PerfBlock
+    );
+
+BOOLEAN QueryDotNetPerfBlockLoaderCounters(
+    _In_ PDN_PERF_BLOCK PerfBlock,
+    _Out_ PULONG MethodsJitted,
+    _Out_ PULONG UnloadCount
+    );
+
 PVOID GetPerfIpcBlock_V2(
     _In_ BOOLEAN Wow64,
     _In_ PVOID BlockTableAddress
@@ -85,6 +118,28 @@ PPH_LIST QueryDotNetAppDomainsForPid_V4(
     _In_ HANDLE ProcessId
     );
 
+// asmmon
+
+typedef VOID (NTAPI *PDN_ASM_EVENT_CALLBACK)(
+    _In_ USHORT EventId,
+    _In_ PVOID UserData,
+    _In_opt_ PVOID Context
+    );
+
+VOID InitializeAsmMonitor(
+    VOID
+    );
+
+VOID UninitializeAsmMonitor(
+    VOID
+    );
+
+BOOLEAN EnumAsmMonitorEvents(
+    _In_ PPH_PROCESS_ITEM ProcessItem,
+    _In_opt_ PDN_ASM_EVENT_CALLBACK Callback,
+    _In_opt_ PVOID Context
+    );
+
 // asmpage
 
 VOID AddAsmPageToPropContext(
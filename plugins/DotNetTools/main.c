@@ -46,7 +46,7 @@ static VOID NTAPI LoadCallback(
     _In_opt_ PVOID Context
     )
 {
-    NOTHING;
+    InitializeAsmMonitor();
 }
 
 static VOID NTAPI UnloadCallback(
@@ -54,7 +54,7 @@ static VOID NTAPI UnloadCallback(
     _In_opt_ PVOID Context
     )
 {
-    NOTHING;
+    UninitializeAsmMonitor();
 }
 
 static VOID NTAPI ShowOptionsCallback(
@@ -213,6 +213,7 @@ LOGICAL DllMain(
                 { StringSettingType, SETTING_NAME_ASM_TREE_LIST_COLUMNS, L"" },
                 { IntegerSettingType, SETTING_NAME_DOT_NET_CATEGORY_INDEX, L"5" },
                 { StringSettingType, SETTING_NAME_DOT_NET_COUNTERS_COLUMNS, L"" },
+                { IntegerSettingType, SETTING_NAME_ENABLE_ASM_MONITOR, L"1" },
             };
 
             PluginInstance = PhRegisterPlugin(PLUGIN_NAME, Instance, &info);
@@ -67,8 +67,7 @@ typedef struct _PERFPAGE_CONTEXT
     BOOLEAN IsWow64;
     DOTNET_CATEGORY CategoryIndex;
     HANDLE ProcessHandle;
-    HANDLE BlockTableHandle;
-    PVOID BlockTableAddress;
+    PDN_PERF_BLOCK PerfBlock;
 
     PH_CALLBACK_REGISTRATION ProcessesUpdatedCallbackRegistration;
 } PERFPAGE_CONTEXT, *PPERFPAGE_CONTEXT;
@@ -444,14 +443,14 @@ static VOID UpdateCounterData(
     {
         perfStatBlock = GetPerfIpcBlock_V4(
             Context->IsWow64,
-            Context->BlockTableAddress
+            Context->PerfBlock->BlockTableAddress
             );
     }
     else
     {
         perfStatBlock = GetPerfIpcBlock_V2(
             Context->IsWow64,
-            Context->BlockTableAddress
+            Context->PerfBlock->BlockTableAddress
             );
     }
 
@@ -732,34 +731,18 @@ static INT_PTR CALLBACK DotNetPerfPageDlgProc(
             context->CategoryIndex = PhGetIntegerSetting(SETTING_NAME_DOT_NET_CATEGORY_INDEX);
             ComboBox_SetCurSel(context->CategoriesCb, context->CategoryIndex);
 
-#ifdef _WIN64
-            context->IsWow64 = context->ProcessItem->IsWow64 == 1 ? TRUE : FALSE;
-#else
-            // HACK: Work-around for Appdomain enumeration on 32bit.
-            context->IsWow64 = TRUE;
-#endif
-
             if (NT_SUCCESS(PhOpenProcess(
                 &context->ProcessHandle,
                 PROCESS_VM_READ | ProcessQueryAccess | PROCESS_DUP_HANDLE | SYNCHRONIZE,
                 context->ProcessItem->ProcessId
                 )))
             {
-                ULONG flags = 0;
-
-                if (NT_SUCCESS(PhGetProcessIsDotNetEx(
-                    context->ProcessItem->ProcessId,
-                    context->ProcessHandle,
-                    context->ProcessItem->IsImmersive == 1 ? 0 : PH_CLR_USE_SECTION_CHECK,
-                    NULL,
-                    &flags
-                    )))
-                {
-                    if (flags & PH_CLR_VERSION_4_ABOVE)
-                    {
-                        context->ClrV4 = TRUE;
-                    }
-                }
+                // The IPC block stays mapped in the cache between page opens; the process
+                // is only probed again if its runtime or .NET state changes.
+                context->PerfBlock = ReferenceDotNetPerfBlock(context->ProcessItem, context->ProcessHandle);
+                context->ClrV4 = context->PerfBlock->ClrV4;
+                context->IsWow64 = context->PerfBlock->IsWow64;
+                context->ControlBlockValid = !!context->PerfBlock->BlockTableAddress;
 
                 // Skip AppDomain enumeration of 'Modern' .NET applications as they don't expose the CLR 'Private IPC' block.
                 if (!context->ProcessItem->IsImmersive)
@@ -768,31 +751,6 @@ static INT_PTR CALLBACK DotNetPerfPageDlgProc(
                 }
             }
 
-            if (context->ClrV4)
-            {
-                if (OpenDotNetPublicControlBlock_V4(
-                    context->ProcessItem->IsImmersive == 1 ? TRUE : FALSE,
-                    context->ProcessHandle,
-                    context->ProcessItem->ProcessId,
-                    &context->BlockTableHandle,
-                    &context->BlockTableAddress
-                    ))
-                {
-                    context->ControlBlockValid = TRUE;
-                }
-            }
-            else
-            {
-                if (OpenDotNetPublicControlBlock_V2(
-                    context->ProcessItem->ProcessId,
-                    &context->BlockTableHandle,
-                    &context->BlockTableAddress
-                    ))
-                {
-                    context->ControlBlockValid = TRUE;
-                }
-            }
-
             if (context->ControlBlockValid)
             {
                 UpdateCategoryValues(hwndDlg, context);
@@ -814,14 +772,9 @@ static INT_PTR CALLBACK DotNetPerfPageDlgProc(
                 &context->ProcessesUpdatedCallbackRegistration
                 );
 
-            if (context->BlockTableAddress)
-            {
-                NtUnmapViewOfSection(NtCurrentProcess(), context->BlockTableAddress);
-            }
-
-            if (context->BlockTableHandle)
+            if (context->PerfBlock)
             {
-                NtClose(context->BlockTableHandle);
+                PhDereferenceObject(context->PerfBlock);
             }
 
             if (context->ProcessHandle)
@@ -891,6 +844,18 @@ static INT_PTR CALLBACK DotNetPerfPageDlgProc(
         break;
     case MSG_UPDATE:
         {
+            if (context->ControlBlockValid && !IsDotNetPerfBlockCurrent(context->PerfBlock))
+            {
+                // The runtime released or re-created its block; map the new one.
+                PhDereferenceObject(context->PerfBlock);
+                context->PerfBlock = ReferenceDotNetPerfBlock(context->ProcessItem, context->ProcessHandle);
+                context->ClrV4 = context->PerfBlock->ClrV4;
+                context->ControlBlockValid = !!context->PerfBlock->BlockTableAddress;
+
+                if (context->ControlBlockValid)
+                    UpdateCategoryValues(hwndDlg, context);
+            }
+
             if (context->Enabled && context->ControlBlockValid)
             {
                 UpdateCounterData(hwndDlg, context);
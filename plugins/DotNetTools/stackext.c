@@ -27,7 +27,8 @@
 
 typedef struct _THREAD_STACK_CONTEXT
 {
-    PCLR_PROCESS_SUPPORT Support;
+    PCLR_PROCESS_CACHE Cache;
+    PCLR_PROCESS_SUPPORT Support; // valid during a walk
     HANDLE ProcessId;
     HANDLE ThreadId;
     HANDLE ThreadHandle;
@@ -112,6 +113,9 @@ VOID ProcessThreadStackControl(
             if (!context)
                 return;
 
+            if (context->Cache)
+                PhDereferenceObject(context->Cache);
+
             PhFree(context);
 
             PhAcquireQueuedLockExclusive(&ContextHashtableLock);
@@ -139,6 +143,7 @@ VOID ProcessThreadStackControl(
                 predictedEbp = context->PredictedEbp;
                 predictedEsp = context->PredictedEsp;
 
+                PhAcquireQueuedLockExclusive(&context->Cache->Lock);
                 PredictAddressesFromClrData(
                     context->Support,
                     context->ThreadId,
@@ -149,6 +154,7 @@ VOID ProcessThreadStackControl(
                     &context->PredictedEbp,
                     &context->PredictedEsp
                     );
+                PhReleaseQueuedLockExclusive(&context->Cache->Lock);
 
                 // Fix up dbghelp EBP with real EBP given by the CLR data routines.
                 if (Control->u.ResolveSymbol.StackFrame->PcAddress == predictedEip)
@@ -158,8 +164,8 @@ VOID ProcessThreadStackControl(
                 }
 #endif
 
-                managedSymbol = GetRuntimeNameByAddressClrProcess(
-                    context->Support,
+                managedSymbol = GetRuntimeNameByAddressClrProcessCache(
+                    context->Cache,
                     (ULONG64)Control->u.ResolveSymbol.StackFrame->PcAddress,
                     &displacement
                     );
@@ -224,7 +230,16 @@ VOID ProcessThreadStackControl(
             if (!NT_SUCCESS(PhGetProcessIsDotNet(context->ProcessId, &isDotNet)) || !isDotNet)
                 return;
 
-            context->Support = CreateClrProcessSupport(context->ProcessId);
+            // The CLR support is kept across walks (and shared with other windows showing the
+            // same process), and only refreshed here.
+            if (!context->Cache)
+                context->Cache = ReferenceClrProcessCache(context->ProcessId);
+
+            if (context->Cache)
+            {
+                RefreshClrProcessCache(context->Cache);
+                context->Support = context->Cache->Support;
+            }
 
 #ifdef _WIN64
             if (context->IsWow64)
@@ -239,11 +254,7 @@ VOID ProcessThreadStackControl(
             if (!context)
                 return;
 
-            if (context->Support)
-            {
-                FreeClrProcessSupport(context->Support);
-                context->Support = NULL;
-            }
+            context->Support = NULL;
 
 #ifdef _WIN64
             if (context->ConnectedToPhSvc)
@@ -4,6 +4,8 @@
 #define PLUGIN_NAME L"ProcessHacker.ExtendedNotifications"
 #define SETTING_NAME_ENABLE_GROWL (PLUGIN_NAME L".EnableGrowl")
 #define SETTING_NAME_LOG_FILENAME (PLUGIN_NAME L".LogFileName")
+#define SETTING_NAME_LOG_FLUSH_INTERVAL (PLUGIN_NAME L".LogFlushInterval")
+#define SETTING_NAME_LOG_MAXIMUM_SIZE (PLUGIN_NAME L".LogMaximumSize")
 #define SETTING_NAME_PROCESS_LIST (PLUGIN_NAME L".ProcessList")
 #define SETTING_NAME_SERVICE_LIST (PLUGIN_NAME L".ServiceList")
 
@@ -21,10 +23,53 @@ typedef struct _FILTER_ENTRY
     PPH_STRING Filter;
 } FILTER_ENTRY, *PFILTER_ENTRY;
 
+// filter
+
+typedef struct _FILTER_TRIE
+{
+    PPH_HASHTABLE Edges;
+    struct _FILTER_TRIE_NODE *Nodes;
+    ULONG NumberOfNodes;
+    ULONG AllocatedNodes;
+} FILTER_TRIE, *PFILTER_TRIE;
+
+typedef struct _FILTER_MATCHER
+{
+    FILTER_TRIE Prefixes;
+    FILTER_TRIE Suffixes;
+    PPH_LIST Wildcards; // indexes of the remaining filters, in order
+} FILTER_MATCHER, *PFILTER_MATCHER;
+
+typedef struct _COMPILED_FILTER_LIST
+{
+    PPH_LIST FilterList;
+    FILTER_MATCHER AllFilters;
+    FILTER_MATCHER FileNameFilters;
+} COMPILED_FILTER_LIST, *PCOMPILED_FILTER_LIST;
+
+VOID CompileFilterList(
+    _Inout_ PCOMPILED_FILTER_LIST CompiledList,
+    _In_ PPH_LIST FilterList
+    );
+
+VOID DeleteCompiledFilterList(
+    _Inout_ PCOMPILED_FILTER_LIST CompiledList
+    );
+
+BOOLEAN MatchCompiledFilterList(
+    _In_ PCOMPILED_FILTER_LIST CompiledList,
+    _In_ PPH_STRING String,
+    _Out_ FILTER_TYPE *FilterType
+    );
+
 // filelog
 
 VOID FileLogInitialization(
     VOID
     );
 
+VOID FileLogUninitialization(
+    VOID
+    );
+
 #endif
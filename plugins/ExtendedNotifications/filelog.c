@@ -23,46 +23,312 @@
 #include <phdk.h>
 #include "extnoti.h"
 
+// The log callback can be invoked on any thread, including the one that drives notifications, so
+// it only formats the entry and places it in a bounded lock-free queue. A writer thread empties
+// the queue in batches, flushes the file every LogFlushInterval milliseconds and rotates it when
+// it grows beyond the maximum size. Entries that arrive while the queue is full are counted and
+// reported in the file instead of blocking the producer.
+
+#define FILE_LOG_BUFFER_SIZE 4096 // must be a power of two
+#define FILE_LOG_WAKE_THRESHOLD (FILE_LOG_BUFFER_SIZE / 2)
+
+typedef struct _FILE_LOG_SLOT
+{
+    volatile ULONG Sequence;
+    PPH_STRING Line;
+} FILE_LOG_SLOT, *PFILE_LOG_SLOT;
+
 VOID NTAPI LoggedCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
     );
 
+NTSTATUS FileLogWriterThreadStart(
+    _In_ PVOID Parameter
+    );
+
+PPH_STRING LogFileName = NULL;
 PPH_FILE_STREAM LogFileStream = NULL;
 PH_CALLBACK_REGISTRATION LoggedCallbackRegistration;
+ULONG LogFlushInterval;
+ULONG LogMaximumSize;
+
+FILE_LOG_SLOT LogBuffer[FILE_LOG_BUFFER_SIZE];
+volatile ULONG LogBufferEnqueuePosition = 0;
+volatile ULONG LogBufferDequeuePosition = 0;
+volatile LONG LogDroppedCount = 0;
+HANDLE LogWriterThreadHandle = NULL;
+HANDLE LogWriterEventHandle = NULL;
+volatile BOOLEAN LogWriterStop = FALSE;
+
+NTSTATUS FileLogOpenStream(
+    VOID
+    )
+{
+    return PhCreateFileStream(
+        &LogFileStream,
+        LogFileName->Buffer,
+        FILE_GENERIC_WRITE,
+        FILE_SHARE_READ,
+        FILE_OPEN_IF,
+        PH_FILE_STREAM_APPEND
+        );
+}
 
 VOID FileLogInitialization(
     VOID
     )
 {
-    NTSTATUS status;
-    PPH_STRING fileName;
+    ULONG i;
+
+    LogFileName = PhGetStringSetting(SETTING_NAME_LOG_FILENAME);
+
+    if (LogFileName->Length == 0)
+    {
+        PhClearReference(&LogFileName);
+        return;
+    }
+
+    LogFlushInterval = PhGetIntegerSetting(SETTING_NAME_LOG_FLUSH_INTERVAL);
+    LogMaximumSize = PhGetIntegerSetting(SETTING_NAME_LOG_MAXIMUM_SIZE);
+
+    if (LogFlushInterval == 0)
+        LogFlushInterval = 1;
+
+    if (!NT_SUCCESS(FileLogOpenStream()))
+    {
+        PhClearReference(&LogFileName);
+        return;
+    }
 
-    fileName = PhGetStringSetting(SETTING_NAME_LOG_FILENAME);
+    for (i = 0; i < FILE_LOG_BUFFER_SIZE; i++)
+        LogBuffer[i].Sequence = i;
 
-    if (fileName->Length != 0)
+    if (!NT_SUCCESS(NtCreateEvent(&LogWriterEventHandle, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE)))
+        LogWriterEventHandle = NULL;
+
+    if (LogWriterEventHandle && (LogWriterThreadHandle = PhCreateThread(0, FileLogWriterThreadStart, NULL)))
     {
-        status = PhCreateFileStream(
-            &LogFileStream,
-            fileName->Buffer,
-            FILE_GENERIC_WRITE,
-            FILE_SHARE_READ,
-            FILE_OPEN_IF,
-            PH_FILE_STREAM_APPEND | PH_FILE_STREAM_UNBUFFERED
+        PhRegisterCallback(
+            &PhLoggedCallback,
+            LoggedCallback,
+            NULL,
+            &LoggedCallbackRegistration
             );
+    }
+    else
+    {
+        if (LogWriterEventHandle)
+        {
+            NtClose(LogWriterEventHandle);
+            LogWriterEventHandle = NULL;
+        }
+
+        PhClearReference(&LogFileStream);
+        PhClearReference(&LogFileName);
+    }
+}
+
+VOID FileLogUninitialization(
+    VOID
+    )
+{
+    if (!LogWriterThreadHandle)
+        return;
+
+    PhUnregisterCallback(&PhLoggedCallback, &LoggedCallbackRegistration);
+
+    // Let the writer thread write out whatever is still queued.
+    LogWriterStop = TRUE;
+    NtSetEvent(LogWriterEventHandle, NULL);
+    NtWaitForSingleObject(LogWriterThreadHandle, FALSE, NULL);
+
+    NtClose(LogWriterThreadHandle);
+    LogWriterThreadHandle = NULL;
+    NtClose(LogWriterEventHandle);
+    LogWriterEventHandle = NULL;
+
+    PhClearReference(&LogFileStream);
+    PhClearReference(&LogFileName);
+}
+
+/**
+ * Adds a line to the queue. This function can be called from any number of threads at once.
+ *
+ * \param Line The line to write. The queue takes ownership of the reference if the function
+ * succeeds.
+ *
+ * \return TRUE if the line was queued, or FALSE if the queue is full.
+ */
+BOOLEAN FileLogEnqueue(
+    _In_ PPH_STRING Line
+    )
+{
+    ULONG position;
+    ULONG oldPosition;
+    PFILE_LOG_SLOT slot;
+    LONG difference;
 
-        if (NT_SUCCESS(status))
+    position = LogBufferEnqueuePosition;
+
+    while (TRUE)
+    {
+        slot = &LogBuffer[position & (FILE_LOG_BUFFER_SIZE - 1)];
+        difference = (LONG)(slot->Sequence - position);
+
+        if (difference == 0)
         {
-            PhRegisterCallback(
-                &PhLoggedCallback,
-                LoggedCallback,
-                NULL,
-                &LoggedCallbackRegistration
+            // The slot is free. Try to claim it.
+            oldPosition = (ULONG)_InterlockedCompareExchange(
+                (volatile LONG *)&LogBufferEnqueuePosition,
+                (LONG)(position + 1),
+                (LONG)position
                 );
+
+            if (oldPosition == position)
+                break;
+
+            position = oldPosition;
+        }
+        else if (difference < 0)
+        {
+            // The writer hasn't consumed this slot yet, so the queue is full.
+            return FALSE;
+        }
+        else
+        {
+            position = LogBufferEnqueuePosition;
         }
     }
 
-    PhDereferenceObject(fileName);
+    slot->Line = Line;
+    MemoryBarrier();
+    slot->Sequence = position + 1;
+
+    if (position - LogBufferDequeuePosition >= FILE_LOG_WAKE_THRESHOLD)
+        NtSetEvent(LogWriterEventHandle, NULL);
+
+    return TRUE;
+}
+
+/**
+ * Removes a line from the queue. This function must only be called by the writer thread.
+ */
+PPH_STRING FileLogDequeue(
+    VOID
+    )
+{
+    ULONG position;
+    PFILE_LOG_SLOT slot;
+    PPH_STRING line;
+
+    position = LogBufferDequeuePosition;
+    slot = &LogBuffer[position & (FILE_LOG_BUFFER_SIZE - 1)];
+
+    if ((LONG)(slot->Sequence - (position + 1)) < 0)
+        return NULL;
+
+    MemoryBarrier();
+    line = slot->Line;
+    slot->Line = NULL;
+    slot->Sequence = position + FILE_LOG_BUFFER_SIZE;
+    LogBufferDequeuePosition = position + 1;
+
+    return line;
+}
+
+VOID FileLogRotate(
+    VOID
+    )
+{
+    PPH_STRING backupFileName;
+
+    PhClearReference(&LogFileStream);
+
+    backupFileName = PhConcatStrings2(LogFileName->Buffer, L".1");
+    MoveFileEx(LogFileName->Buffer, backupFileName->Buffer, MOVEFILE_REPLACE_EXISTING);
+    PhDereferenceObject(backupFileName);
+
+    // If the file can't be reopened, lines are discarded and the next batch tries again.
+    if (!NT_SUCCESS(FileLogOpenStream()))
+        LogFileStream = NULL;
+}
+
+VOID FileLogWriteBatch(
+    VOID
+    )
+{
+    PPH_STRING line;
+    LONG droppedCount;
+    BOOLEAN written;
+    LARGE_INTEGER position;
+
+    written = FALSE;
+
+    if (!LogFileStream && !NT_SUCCESS(FileLogOpenStream()))
+        LogFileStream = NULL;
+
+    while (line = FileLogDequeue())
+    {
+        if (LogFileStream)
+        {
+            PhWriteStringAsUtf8FileStream(LogFileStream, &line->sr);
+            written = TRUE;
+        }
+
+        PhDereferenceObject(line);
+    }
+
+    if (droppedCount = _InterlockedExchange(&LogDroppedCount, 0))
+    {
+        if (LogFileStream)
+        {
+            PPH_STRING formattedTime;
+
+            formattedTime = PhFormatDateTime(NULL);
+            PhWriteStringFormatAsUtf8FileStream(
+                LogFileStream,
+                L"%s: %d log entries were dropped because the log buffer was full\r\n",
+                formattedTime->Buffer,
+                droppedCount
+                );
+            PhDereferenceObject(formattedTime);
+            written = TRUE;
+        }
+    }
+
+    if (written)
+    {
+        PhFlushFileStream(LogFileStream, FALSE);
+
+        if (LogMaximumSize != 0)
+        {
+            PhGetPositionFileStream(LogFileStream, &position);
+
+            if ((ULONG64)position.QuadPart >= LogMaximumSize)
+                FileLogRotate();
+        }
+    }
+}
+
+NTSTATUS FileLogWriterThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    LARGE_INTEGER timeout;
+    BOOLEAN stop;
+
+    do
+    {
+        NtWaitForSingleObject(LogWriterEventHandle, FALSE, PhTimeoutFromMilliseconds(&timeout, LogFlushInterval));
+
+        // Read the flag before draining so that lines queued before the stop request are written.
+        stop = LogWriterStop;
+        MemoryBarrier();
+        FileLogWriteBatch();
+    } while (!stop);
+
+    return STATUS_SUCCESS;
 }
 
 VOID NTAPI LoggedCallback(
@@ -71,14 +337,24 @@ VOID NTAPI LoggedCallback(
     )
 {
     PPH_LOG_ENTRY logEntry = Parameter;
+    SYSTEMTIME systemTime;
     PPH_STRING formattedTime;
     PPH_STRING formatted;
+    PPH_STRING line;
 
-    formattedTime = PhFormatDateTime(NULL);
+    // Use the time of the event, not the time the line is written.
+    PhLargeIntegerToLocalSystemTime(&systemTime, &logEntry->Time);
+    formattedTime = PhFormatDateTime(&systemTime);
     formatted = PhFormatLogEntry(logEntry);
 
-    PhWriteStringFormatAsUtf8FileStream(LogFileStream, L"%s: %s\r\n", formattedTime->Buffer, formatted->Buffer);
+    line = PhFormatString(L"%s: %s\r\n", formattedTime->Buffer, formatted->Buffer);
 
     PhDereferenceObject(formatted);
     PhDereferenceObject(formattedTime);
+
+    if (!FileLogEnqueue(line))
+    {
+        PhDereferenceObject(line);
+        _InterlockedIncrement(&LogDroppedCount);
+    }
 }
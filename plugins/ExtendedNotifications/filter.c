@@ -0,0 +1,332 @@
+/*
+ * Process Hacker Extended Notifications -
+ *   compiled filter lists
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A filter list is matched in order and the first matching filter wins. Most filters are plain
+ * names, "name*" or "*name", so these are compiled into two tries (one over the characters from
+ * the start of the string and one from the end). Walking a trie gives the lowest matching index
+ * among those filters in time proportional to the length of the string. Filters with other
+ * wildcards are kept in order and only the ones before the best trie match are tried with
+ * PhMatchWildcards.
+ */
+
+#include <phdk.h>
+#include "extnoti.h"
+
+#define FILTER_NO_MATCH MAXULONG
+
+typedef struct _FILTER_TRIE_EDGE
+{
+    ULONG Parent;
+    WCHAR Character;
+    ULONG Child;
+} FILTER_TRIE_EDGE, *PFILTER_TRIE_EDGE;
+
+typedef struct _FILTER_TRIE_NODE
+{
+    ULONG ExactIndex; // the filter is exactly this string
+    ULONG PrefixIndex; // the filter is this string followed by a single asterisk
+} FILTER_TRIE_NODE, *PFILTER_TRIE_NODE;
+
+static BOOLEAN NTAPI FilterTrieEdgeEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PFILTER_TRIE_EDGE edge1 = Entry1;
+    PFILTER_TRIE_EDGE edge2 = Entry2;
+
+    return edge1->Parent == edge2->Parent && edge1->Character == edge2->Character;
+}
+
+static ULONG NTAPI FilterTrieEdgeHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PFILTER_TRIE_EDGE edge = Entry;
+
+    return (edge->Parent * 31) ^ edge->Character;
+}
+
+static VOID InitializeFilterTrie(
+    _Out_ PFILTER_TRIE Trie
+    )
+{
+    Trie->Edges = PhCreateHashtable(
+        sizeof(FILTER_TRIE_EDGE),
+        FilterTrieEdgeEqualFunction,
+        FilterTrieEdgeHashFunction,
+        64
+        );
+    Trie->AllocatedNodes = 64;
+    Trie->Nodes = PhAllocate(Trie->AllocatedNodes * sizeof(FILTER_TRIE_NODE));
+
+    // The root node.
+    Trie->Nodes[0].ExactIndex = FILTER_NO_MATCH;
+    Trie->Nodes[0].PrefixIndex = FILTER_NO_MATCH;
+    Trie->NumberOfNodes = 1;
+}
+
+static VOID DeleteFilterTrie(
+    _Inout_ PFILTER_TRIE Trie
+    )
+{
+    PhDereferenceObject(Trie->Edges);
+    PhFree(Trie->Nodes);
+}
+
+static PFILTER_TRIE_NODE AddFilterTrieString(
+    _Inout_ PFILTER_TRIE Trie,
+    _In_ PWCHAR Buffer,
+    _In_ SIZE_T Count,
+    _In_ BOOLEAN Reverse
+    )
+{
+    FILTER_TRIE_EDGE lookupEdge;
+    PFILTER_TRIE_EDGE edge;
+    ULONG node;
+    SIZE_T i;
+
+    node = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        lookupEdge.Parent = node;
+        lookupEdge.Character = towupper(Buffer[Reverse ? Count - i - 1 : i]);
+
+        if (edge = PhFindEntryHashtable(Trie->Edges, &lookupEdge))
+        {
+            node = edge->Child;
+            continue;
+        }
+
+        if (Trie->NumberOfNodes == Trie->AllocatedNodes)
+        {
+            Trie->AllocatedNodes *= 2;
+            Trie->Nodes = PhReAllocate(Trie->Nodes, Trie->AllocatedNodes * sizeof(FILTER_TRIE_NODE));
+        }
+
+        node = Trie->NumberOfNodes++;
+        Trie->Nodes[node].ExactIndex = FILTER_NO_MATCH;
+        Trie->Nodes[node].PrefixIndex = FILTER_NO_MATCH;
+
+        lookupEdge.Child = node;
+        PhAddEntryHashtable(Trie->Edges, &lookupEdge);
+    }
+
+    return &Trie->Nodes[node];
+}
+
+static ULONG MatchFilterTrie(
+    _In_ PFILTER_TRIE Trie,
+    _In_ PPH_STRINGREF String,
+    _In_ BOOLEAN Reverse
+    )
+{
+    FILTER_TRIE_EDGE lookupEdge;
+    PFILTER_TRIE_EDGE edge;
+    ULONG bestIndex;
+    ULONG node;
+    SIZE_T count;
+    SIZE_T i;
+
+    count = String->Length / sizeof(WCHAR);
+    node = 0;
+    bestIndex = Trie->Nodes[0].PrefixIndex;
+
+    for (i = 0; i < count; i++)
+    {
+        lookupEdge.Parent = node;
+        lookupEdge.Character = towupper(String->Buffer[Reverse ? count - i - 1 : i]);
+
+        if (!(edge = PhFindEntryHashtable(Trie->Edges, &lookupEdge)))
+            return bestIndex;
+
+        node = edge->Child;
+
+        if (bestIndex > Trie->Nodes[node].PrefixIndex)
+            bestIndex = Trie->Nodes[node].PrefixIndex;
+    }
+
+    if (bestIndex > Trie->Nodes[node].ExactIndex)
+        bestIndex = Trie->Nodes[node].ExactIndex;
+
+    return bestIndex;
+}
+
+static VOID SetFilterIndex(
+    _Inout_ PULONG Index,
+    _In_ ULONG NewIndex
+    )
+{
+    // Filters are added in order, so an earlier duplicate keeps priority.
+    if (*Index == FILTER_NO_MATCH)
+        *Index = NewIndex;
+}
+
+static VOID CompileFilterMatcher(
+    _Out_ PFILTER_MATCHER Matcher,
+    _In_ PPH_LIST FilterList,
+    _In_ BOOLEAN FileNamesOnly
+    )
+{
+    ULONG i;
+
+    InitializeFilterTrie(&Matcher->Prefixes);
+    InitializeFilterTrie(&Matcher->Suffixes);
+    Matcher->Wildcards = PhCreateList(4);
+
+    for (i = 0; i < FilterList->Count; i++)
+    {
+        PFILTER_ENTRY entry = FilterList->Items[i];
+        PWCHAR buffer = entry->Filter->Buffer;
+        SIZE_T count = entry->Filter->Length / sizeof(WCHAR);
+        SIZE_T wildcards;
+        SIZE_T j;
+
+        // Filters without backslashes are ignored when matching file names.
+        if (FileNamesOnly && PhFindCharInString(entry->Filter, 0, '\\') == -1)
+            continue;
+
+        wildcards = 0;
+
+        for (j = 0; j < count; j++)
+        {
+            if (buffer[j] == '*' || buffer[j] == '?')
+                wildcards++;
+        }
+
+        if (wildcards == 0)
+        {
+            SetFilterIndex(&AddFilterTrieString(&Matcher->Prefixes, buffer, count, FALSE)->ExactIndex, i);
+        }
+        else if (wildcards == 1 && buffer[count - 1] == '*')
+        {
+            // This also covers "*" on its own, which ends up on the root node.
+            SetFilterIndex(&AddFilterTrieString(&Matcher->Prefixes, buffer, count - 1, FALSE)->PrefixIndex, i);
+        }
+        else if (wildcards == 1 && buffer[0] == '*')
+        {
+            SetFilterIndex(&AddFilterTrieString(&Matcher->Suffixes, buffer + 1, count - 1, TRUE)->PrefixIndex, i);
+        }
+        else
+        {
+            PhAddItemList(Matcher->Wildcards, UlongToPtr(i));
+        }
+    }
+}
+
+static VOID DeleteFilterMatcher(
+    _Inout_ PFILTER_MATCHER Matcher
+    )
+{
+    DeleteFilterTrie(&Matcher->Prefixes);
+    DeleteFilterTrie(&Matcher->Suffixes);
+    PhDereferenceObject(Matcher->Wildcards);
+}
+
+static ULONG MatchFilterMatcher(
+    _In_ PFILTER_MATCHER Matcher,
+    _In_ PPH_LIST FilterList,
+    _In_ PPH_STRING String
+    )
+{
+    ULONG bestIndex;
+    ULONG index;
+    ULONG i;
+
+    bestIndex = MatchFilterTrie(&Matcher->Prefixes, &String->sr, FALSE);
+    index = MatchFilterTrie(&Matcher->Suffixes, &String->sr, TRUE);
+
+    if (bestIndex > index)
+        bestIndex = index;
+
+    // Only the wildcard filters that come before the best match so far can change the result.
+    for (i = 0; i < Matcher->Wildcards->Count; i++)
+    {
+        PFILTER_ENTRY entry;
+
+        index = PtrToUlong(Matcher->Wildcards->Items[i]);
+
+        if (index >= bestIndex)
+            break;
+
+        entry = FilterList->Items[index];
+
+        if (PhMatchWildcards(entry->Filter->Buffer, String->Buffer, TRUE))
+            return index;
+    }
+
+    return bestIndex;
+}
+
+VOID CompileFilterList(
+    _Inout_ PCOMPILED_FILTER_LIST CompiledList,
+    _In_ PPH_LIST FilterList
+    )
+{
+    if (CompiledList->FilterList)
+        DeleteCompiledFilterList(CompiledList);
+
+    CompiledList->FilterList = FilterList;
+    PhReferenceObject(FilterList);
+
+    CompileFilterMatcher(&CompiledList->AllFilters, FilterList, FALSE);
+    CompileFilterMatcher(&CompiledList->FileNameFilters, FilterList, TRUE);
+}
+
+VOID DeleteCompiledFilterList(
+    _Inout_ PCOMPILED_FILTER_LIST CompiledList
+    )
+{
+    if (!CompiledList->FilterList)
+        return;
+
+    DeleteFilterMatcher(&CompiledList->AllFilters);
+    DeleteFilterMatcher(&CompiledList->FileNameFilters);
+    PhClearReference(&CompiledList->FilterList);
+}
+
+BOOLEAN MatchCompiledFilterList(
+    _In_ PCOMPILED_FILTER_LIST CompiledList,
+    _In_ PPH_STRING String,
+    _Out_ FILTER_TYPE *FilterType
+    )
+{
+    BOOLEAN isFileName;
+    ULONG index;
+
+    if (!CompiledList->FilterList)
+        return FALSE;
+
+    isFileName = PhFindCharInString(String, 0, '\\') != -1;
+    index = MatchFilterMatcher(
+        isFileName ? &CompiledList->FileNameFilters : &CompiledList->AllFilters,
+        CompiledList->FilterList,
+        String
+        );
+
+    if (index == FILTER_NO_MATCH)
+        return FALSE;
+
+    *FilterType = ((PFILTER_ENTRY)CompiledList->FilterList->Items[index])->Type;
+
+    return TRUE;
+}
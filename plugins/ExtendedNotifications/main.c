@@ -31,6 +31,11 @@ VOID NTAPI LoadCallback(
     _In_opt_ PVOID Context
     );
 
+VOID NTAPI UnloadCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
 VOID NTAPI ShowOptionsCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -83,11 +88,14 @@ INT_PTR CALLBACK GrowlDlgProc(
 
 PPH_PLUGIN PluginInstance;
 PH_CALLBACK_REGISTRATION PluginLoadCallbackRegistration;
+PH_CALLBACK_REGISTRATION PluginUnloadCallbackRegistration;
 PH_CALLBACK_REGISTRATION PluginShowOptionsCallbackRegistration;
 PH_CALLBACK_REGISTRATION NotifyEventCallbackRegistration;
 
 PPH_LIST ProcessFilterList;
 PPH_LIST ServiceFilterList;
+COMPILED_FILTER_LIST CompiledProcessFilterList;
+COMPILED_FILTER_LIST CompiledServiceFilterList;
 
 PSTR GrowlNotifications[] =
 {
@@ -96,7 +104,8 @@ PSTR GrowlNotifications[] =
     "Service Created",
     "Service Deleted",
     "Service Started",
-    "Service Stopped"
+    "Service Stopped",
+    "Process Alert"
 };
 
 LOGICAL DllMain(
@@ -128,6 +137,12 @@ LOGICAL DllMain(
                 NULL,
                 &PluginLoadCallbackRegistration
                 );
+            PhRegisterCallback(
+                PhGetPluginCallback(PluginInstance, PluginCallbackUnload),
+                UnloadCallback,
+                NULL,
+                &PluginUnloadCallbackRegistration
+                );
             PhRegisterCallback(
                 PhGetPluginCallback(PluginInstance, PluginCallbackShowOptions),
                 ShowOptionsCallback,
@@ -147,6 +162,8 @@ LOGICAL DllMain(
                 {
                     { IntegerSettingType, SETTING_NAME_ENABLE_GROWL, L"0" },
                     { StringSettingType, SETTING_NAME_LOG_FILENAME, L"" },
+                    { IntegerSettingType, SETTING_NAME_LOG_FLUSH_INTERVAL, L"3e8" }, // 1000 ms
+                    { IntegerSettingType, SETTING_NAME_LOG_MAXIMUM_SIZE, L"a00000" }, // 10 MB
                     { StringSettingType, SETTING_NAME_PROCESS_LIST, L"\\i*" },
                     { StringSettingType, SETTING_NAME_SERVICE_LIST, L"\\i*" }
                 };
@@ -326,10 +343,12 @@ VOID NTAPI LoadCallback(
     string = PhGetStringSetting(SETTING_NAME_PROCESS_LIST);
     LoadFilterList(ProcessFilterList, string);
     PhDereferenceObject(string);
+    CompileFilterList(&CompiledProcessFilterList, ProcessFilterList);
 
     string = PhGetStringSetting(SETTING_NAME_SERVICE_LIST);
     LoadFilterList(ServiceFilterList, string);
     PhDereferenceObject(string);
+    CompileFilterList(&CompiledServiceFilterList, ServiceFilterList);
 
     FileLogInitialization();
 
@@ -339,6 +358,14 @@ VOID NTAPI LoadCallback(
     }
 }
 
+VOID NTAPI UnloadCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    FileLogUninitialization();
+}
+
 VOID NTAPI ShowOptionsCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -393,40 +420,6 @@ VOID NTAPI ShowOptionsCallback(
     PropertySheet(&propSheetHeader);
 }
 
-BOOLEAN MatchFilterList(
-    _In_ PPH_LIST FilterList,
-    _In_ PPH_STRING String,
-    _Out_ FILTER_TYPE *FilterType
-    )
-{
-    ULONG i;
-    BOOLEAN isFileName;
-
-    isFileName = PhFindCharInString(String, 0, '\\') != -1;
-
-    for (i = 0; i < FilterList->Count; i++)
-    {
-        PFILTER_ENTRY entry = FilterList->Items[i];
-
-        if (isFileName && PhFindCharInString(entry->Filter, 0, '\\') == -1)
-            continue; // ignore filters without backslashes if we're matching a file name
-
-        if (entry->Filter->Length == 2 && entry->Filter->Buffer[0] == '*') // shortcut
-        {
-            *FilterType = entry->Type;
-            return TRUE;
-        }
-
-        if (PhMatchWildcards(entry->Filter->Buffer, String->Buffer, TRUE))
-        {
-            *FilterType = entry->Type;
-            return TRUE;
-        }
-    }
-
-    return FALSE;
-}
-
 VOID NTAPI NotifyEventCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -444,13 +437,17 @@ VOID NTAPI NotifyEventCallback(
     {
     case PH_NOTIFY_PROCESS_CREATE:
     case PH_NOTIFY_PROCESS_DELETE:
-        processItem = notifyEvent->Parameter;
+    case PH_NOTIFY_PROCESS_ALERT:
+        if (notifyEvent->Type == PH_NOTIFY_PROCESS_ALERT)
+            processItem = ((PPH_PROCESS_ALERT)notifyEvent->Parameter)->ProcessItem;
+        else
+            processItem = notifyEvent->Parameter;
 
         if (processItem->FileName)
-            found = MatchFilterList(ProcessFilterList, processItem->FileName, &filterType);
+            found = MatchCompiledFilterList(&CompiledProcessFilterList, processItem->FileName, &filterType);
 
         if (!found)
-            MatchFilterList(ProcessFilterList, processItem->ProcessName, &filterType);
+            MatchCompiledFilterList(&CompiledProcessFilterList, processItem->ProcessName, &filterType);
 
         break;
 
@@ -460,7 +457,7 @@ VOID NTAPI NotifyEventCallback(
     case PH_NOTIFY_SERVICE_STOP:
         serviceItem = notifyEvent->Parameter;
 
-        MatchFilterList(ServiceFilterList, serviceItem->Name, &filterType);
+        MatchCompiledFilterList(&CompiledServiceFilterList, serviceItem->Name, &filterType);
 
         break;
     }
@@ -498,6 +495,7 @@ VOID NotifyGrowl(
     PPH_PROCESS_ITEM processItem;
     PPH_SERVICE_ITEM serviceItem;
     PPH_PROCESS_ITEM parentProcessItem;
+    PPH_PROCESS_ALERT alert;
 
     if (NotifyEvent->Handled)
         return;
@@ -586,6 +584,16 @@ VOID NotifyGrowl(
             serviceItem->DisplayName->Buffer
             );
 
+        break;
+    case PH_NOTIFY_PROCESS_ALERT:
+        alert = NotifyEvent->Parameter;
+        notification = GrowlNotifications[6];
+        title = alert->ProcessItem->ProcessName;
+        PhReferenceObject(title);
+
+        message = alert->Message;
+        PhReferenceObject(message);
+
         break;
     default:
         return;
@@ -937,6 +945,7 @@ INT_PTR CALLBACK ProcessesDlgProc(
 
                     ClearFilterList(ProcessFilterList);
                     CopyFilterList(ProcessFilterList, EditingProcessFilterList);
+                    CompileFilterList(&CompiledProcessFilterList, ProcessFilterList);
 
                     string = SaveFilterList(ProcessFilterList);
                     PhSetStringSetting2(SETTING_NAME_PROCESS_LIST, &string->sr);
@@ -1001,6 +1010,7 @@ INT_PTR CALLBACK ServicesDlgProc(
 
                     ClearFilterList(ServiceFilterList);
                     CopyFilterList(ServiceFilterList, EditingServiceFilterList);
+                    CompileFilterList(&CompiledServiceFilterList, ServiceFilterList);
 
                     string = SaveFilterList(ServiceFilterList);
                     PhSetStringSetting2(SETTING_NAME_SERVICE_LIST, &string->sr);
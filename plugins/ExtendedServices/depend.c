@@ -31,61 +31,6 @@ typedef struct _SERVICE_LIST_CONTEXT
     PH_LAYOUT_MANAGER LayoutManager;
 } SERVICE_LIST_CONTEXT, *PSERVICE_LIST_CONTEXT;
 
-LPENUM_SERVICE_STATUS EsEnumDependentServices(
-    _In_ SC_HANDLE ServiceHandle,
-    _In_opt_ ULONG State,
-    _Out_ PULONG Count
-    )
-{
-    LOGICAL result;
-    PVOID buffer;
-    ULONG bufferSize;
-    ULONG returnLength;
-    ULONG servicesReturned;
-
-    if (!State)
-        State = SERVICE_STATE_ALL;
-
-    bufferSize = 0x800;
-    buffer = PhAllocate(bufferSize);
-
-    if (!(result = EnumDependentServices(
-        ServiceHandle,
-        State,
-        buffer,
-        bufferSize,
-        &returnLength,
-        &servicesReturned
-        )))
-    {
-        if (GetLastError() == ERROR_MORE_DATA)
-        {
-            PhFree(buffer);
-            bufferSize = returnLength;
-            buffer = PhAllocate(bufferSize);
-
-            result = EnumDependentServices(
-                ServiceHandle,
-                State,
-                buffer,
-                bufferSize,
-                &returnLength,
-                &servicesReturned
-                );
-        }
-
-        if (!result)
-        {
-            PhFree(buffer);
-            return NULL;
-        }
-    }
-
-    *Count = servicesReturned;
-
-    return buffer;
-}
-
 static VOID EspLayoutServiceListControl(
     _In_ HWND hwndDlg,
     _In_ HWND ServiceListHandle
@@ -140,80 +85,20 @@ INT_PTR CALLBACK EspServiceDependenciesDlgProc(
             LPPROPSHEETPAGE propSheetPage = (LPPROPSHEETPAGE)lParam;
             PPH_SERVICE_ITEM serviceItem = (PPH_SERVICE_ITEM)propSheetPage->lParam;
             HWND serviceListHandle;
-            PPH_LIST serviceList;
-            SC_HANDLE serviceHandle;
-            ULONG win32Result = 0;
-            BOOLEAN success = FALSE;
             PPH_SERVICE_ITEM *services;
+            ULONG numberOfServices;
 
             SetDlgItemText(hwndDlg, IDC_MESSAGE, L"This service depends on the following services:");
 
             PhInitializeLayoutManager(&context->LayoutManager, hwndDlg);
             PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_SERVICES_LAYOUT), NULL, PH_ANCHOR_ALL);
 
-            if (serviceHandle = PhOpenService(serviceItem->Name->Buffer, SERVICE_QUERY_CONFIG))
-            {
-                LPQUERY_SERVICE_CONFIG serviceConfig;
-
-                if (serviceConfig = PhGetServiceConfig(serviceHandle))
-                {
-                    PWSTR dependency;
-                    PPH_SERVICE_ITEM dependencyService;
+            services = PhGetServiceDependencies(serviceItem, 0, &numberOfServices);
 
-                    dependency = serviceConfig->lpDependencies;
-                    serviceList = PhCreateList(8);
-                    success = TRUE;
-
-                    if (dependency)
-                    {
-                        ULONG dependencyLength;
-
-                        while (TRUE)
-                        {
-                            dependencyLength = (ULONG)PhCountStringZ(dependency);
-
-                            if (dependencyLength == 0)
-                                break;
-
-                            if (dependency[0] == SC_GROUP_IDENTIFIER)
-                                goto ContinueLoop;
-
-                            if (dependencyService = PhReferenceServiceItem(dependency))
-                                PhAddItemList(serviceList, dependencyService);
-
-ContinueLoop:
-                            dependency += dependencyLength + 1;
-                        }
-                    }
-
-                    services = PhAllocateCopy(serviceList->Items, sizeof(PPH_SERVICE_ITEM) * serviceList->Count);
-
-                    serviceListHandle = PhCreateServiceListControl(hwndDlg, services, serviceList->Count);
-                    context->ServiceListHandle = serviceListHandle;
-                    EspLayoutServiceListControl(hwndDlg, serviceListHandle);
-                    ShowWindow(serviceListHandle, SW_SHOW);
-
-                    PhDereferenceObject(serviceList);
-                    PhFree(serviceConfig);
-                }
-                else
-                {
-                    win32Result = GetLastError();
-                }
-
-                CloseServiceHandle(serviceHandle);
-            }
-            else
-            {
-                win32Result = GetLastError();
-            }
-
-            if (!success)
-            {
-                SetDlgItemText(hwndDlg, IDC_SERVICES_LAYOUT, PhaConcatStrings2(L"Unable to enumerate dependencies: ",
-                    ((PPH_STRING)PhAutoDereferenceObject(PhGetWin32Message(win32Result)))->Buffer)->Buffer);
-                ShowWindow(GetDlgItem(hwndDlg, IDC_SERVICES_LAYOUT), SW_SHOW);
-            }
+            serviceListHandle = PhCreateServiceListControl(hwndDlg, services, numberOfServices);
+            context->ServiceListHandle = serviceListHandle;
+            EspLayoutServiceListControl(hwndDlg, serviceListHandle);
+            ShowWindow(serviceListHandle, SW_SHOW);
         }
         break;
     case WM_DESTROY:
@@ -269,64 +154,20 @@ INT_PTR CALLBACK EspServiceDependentsDlgProc(
             LPPROPSHEETPAGE propSheetPage = (LPPROPSHEETPAGE)lParam;
             PPH_SERVICE_ITEM serviceItem = (PPH_SERVICE_ITEM)propSheetPage->lParam;
             HWND serviceListHandle;
-            PPH_LIST serviceList;
-            SC_HANDLE serviceHandle;
-            ULONG win32Result = 0;
-            BOOLEAN success = FALSE;
             PPH_SERVICE_ITEM *services;
+            ULONG numberOfServices;
 
             SetDlgItemText(hwndDlg, IDC_MESSAGE, L"The following services depend on this service:");
 
             PhInitializeLayoutManager(&context->LayoutManager, hwndDlg);
             PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDC_SERVICES_LAYOUT), NULL, PH_ANCHOR_ALL);
 
-            if (serviceHandle = PhOpenService(serviceItem->Name->Buffer, SERVICE_ENUMERATE_DEPENDENTS))
-            {
-                LPENUM_SERVICE_STATUS dependentServices;
-                ULONG numberOfDependentServices;
-
-                if (dependentServices = EsEnumDependentServices(serviceHandle, 0, &numberOfDependentServices))
-                {
-                    ULONG i;
-                    PPH_SERVICE_ITEM dependentService;
-
-                    serviceList = PhCreateList(8);
-                    success = TRUE;
-
-                    for (i = 0; i < numberOfDependentServices; i++)
-                    {
-                        if (dependentService = PhReferenceServiceItem(dependentServices[i].lpServiceName))
-                            PhAddItemList(serviceList, dependentService);
-                    }
-
-                    services = PhAllocateCopy(serviceList->Items, sizeof(PPH_SERVICE_ITEM) * serviceList->Count);
-
-                    serviceListHandle = PhCreateServiceListControl(hwndDlg, services, serviceList->Count);
-                    context->ServiceListHandle = serviceListHandle;
-                    EspLayoutServiceListControl(hwndDlg, serviceListHandle);
-                    ShowWindow(serviceListHandle, SW_SHOW);
-
-                    PhDereferenceObject(serviceList);
-                    PhFree(dependentServices);
-                }
-                else
-                {
-                    win32Result = GetLastError();
-                }
-
-                CloseServiceHandle(serviceHandle);
-            }
-            else
-            {
-                win32Result = GetLastError();
-            }
+            services = PhGetServiceDependencies(serviceItem, PH_SERVICE_DEPENDENCIES_DEPENDENTS, &numberOfServices);
 
-            if (!success)
-            {
-                SetDlgItemText(hwndDlg, IDC_SERVICES_LAYOUT, PhaConcatStrings2(L"Unable to enumerate dependents: ",
-                    ((PPH_STRING)PhAutoDereferenceObject(PhGetWin32Message(win32Result)))->Buffer)->Buffer);
-                ShowWindow(GetDlgItem(hwndDlg, IDC_SERVICES_LAYOUT), SW_SHOW);
-            }
+            serviceListHandle = PhCreateServiceListControl(hwndDlg, services, numberOfServices);
+            context->ServiceListHandle = serviceListHandle;
+            EspLayoutServiceListControl(hwndDlg, serviceListHandle);
+            ShowWindow(serviceListHandle, SW_SHOW);
         }
         break;
     case WM_DESTROY:
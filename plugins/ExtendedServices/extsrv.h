@@ -17,12 +17,6 @@ extern _RtlCreateServiceSid RtlCreateServiceSid_I;
 
 // depend
 
-LPENUM_SERVICE_STATUS EsEnumDependentServices(
-    _In_ SC_HANDLE ServiceHandle,
-    _In_opt_ ULONG State,
-    _Out_ PULONG Count
-    );
-
 INT_PTR CALLBACK EspServiceDependenciesDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
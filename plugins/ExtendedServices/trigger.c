@@ -87,6 +87,15 @@ typedef struct _ETW_PUBLISHER_ENTRY
     GUID Guid;
 } ETW_PUBLISHER_ENTRY, *PETW_PUBLISHER_ENTRY;
 
+typedef struct _ETW_PUBLISHER_INDEX
+{
+    LARGE_INTEGER LastWriteTime;
+    PETW_PUBLISHER_ENTRY Entries; // sorted by name
+    ULONG NumberOfEntries;
+    PPH_HASHTABLE GuidHashtable;
+    PPH_HASHTABLE NameHashtable;
+} ETW_PUBLISHER_INDEX, *PETW_PUBLISHER_INDEX;
+
 INT_PTR CALLBACK EspServiceTriggerDlgProc(
     _In_ HWND hwndDlg,
     _In_ UINT uMsg,
@@ -373,77 +382,81 @@ VOID EsDestroyServiceTriggerContext(
     PhFree(Context);
 }
 
-PPH_STRING EspLookupEtwPublisherName(
-    _In_ PGUID Guid
+static PPH_OBJECT_TYPE EtwPublisherIndexType;
+static PH_QUEUED_LOCK EtwPublisherIndexLock = PH_QUEUED_LOCK_INIT;
+static PETW_PUBLISHER_INDEX EtwPublisherIndex;
+
+static VOID NTAPI EspEtwPublisherIndexDeleteProcedure(
+    _In_ PVOID Object,
+    _In_ ULONG Flags
     )
 {
-    PPH_STRING guidString;
-    PPH_STRING keyName;
-    HANDLE keyHandle;
-    PPH_STRING publisherName = NULL;
+    PETW_PUBLISHER_INDEX index = (PETW_PUBLISHER_INDEX)Object;
+    ULONG i;
 
-    // Copied from ProcessHacker\hndlinfo.c.
+    for (i = 0; i < index->NumberOfEntries; i++)
+        PhDereferenceObject(index->Entries[i].PublisherName);
 
-    guidString = PhFormatGuid(Guid);
+    PhFree(index->Entries);
+    PhDereferenceObject(index->GuidHashtable);
+    PhDereferenceObject(index->NameHashtable);
+}
 
-    keyName = PhConcatStringRef2(&PublishersKeyName, &guidString->sr);
+static BOOLEAN NTAPI EspEtwPublisherGuidCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return IsEqualGUID(&(*(PETW_PUBLISHER_ENTRY *)Entry1)->Guid, &(*(PETW_PUBLISHER_ENTRY *)Entry2)->Guid);
+}
 
-    if (NT_SUCCESS(PhOpenKey(
-        &keyHandle,
-        KEY_READ,
-        PH_KEY_LOCAL_MACHINE,
-        &keyName->sr,
-        0
-        )))
-    {
-        publisherName = PhQueryRegistryString(keyHandle, NULL);
+static ULONG NTAPI EspEtwPublisherGuidHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashBytes((PUCHAR)&(*(PETW_PUBLISHER_ENTRY *)Entry)->Guid, sizeof(GUID));
+}
 
-        if (publisherName && publisherName->Length == 0)
-        {
-            PhDereferenceObject(publisherName);
-            publisherName = NULL;
-        }
+static BOOLEAN NTAPI EspEtwPublisherNameCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return PhEqualString((*(PETW_PUBLISHER_ENTRY *)Entry1)->PublisherName, (*(PETW_PUBLISHER_ENTRY *)Entry2)->PublisherName, TRUE);
+}
 
-        NtClose(keyHandle);
-    }
+static ULONG NTAPI EspEtwPublisherNameHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashStringRef(&(*(PETW_PUBLISHER_ENTRY *)Entry)->PublisherName->sr, TRUE);
+}
 
-    PhDereferenceObject(keyName);
+static int __cdecl EtwPublisherByNameCompareFunction(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    PETW_PUBLISHER_ENTRY entry1 = (PETW_PUBLISHER_ENTRY)elem1;
+    PETW_PUBLISHER_ENTRY entry2 = (PETW_PUBLISHER_ENTRY)elem2;
 
-    if (publisherName)
-    {
-        PhDereferenceObject(guidString);
-        return publisherName;
-    }
-    else
-    {
-        return guidString;
-    }
+    return PhCompareString(entry1->PublisherName, entry2->PublisherName, TRUE);
 }
 
-BOOLEAN EspEnumerateEtwPublishers(
-    _Out_ PETW_PUBLISHER_ENTRY *Entries,
-    _Out_ PULONG NumberOfEntries
+static PETW_PUBLISHER_INDEX EspCreateEtwPublisherIndex(
+    _In_ HANDLE PublishersKeyHandle,
+    _In_ PLARGE_INTEGER LastWriteTime
     )
 {
     NTSTATUS status;
-    HANDLE publishersKeyHandle;
+    PETW_PUBLISHER_INDEX publisherIndex;
     ULONG index;
     PKEY_BASIC_INFORMATION buffer;
     ULONG bufferSize;
     PETW_PUBLISHER_ENTRY entries;
     ULONG numberOfEntries;
     ULONG allocatedEntries;
-
-    if (!NT_SUCCESS(PhOpenKey(
-        &publishersKeyHandle,
-        KEY_READ,
-        PH_KEY_LOCAL_MACHINE,
-        &PublishersKeyName,
-        0
-        )))
-    {
-        return FALSE;
-    }
+    ULONG i;
 
     numberOfEntries = 0;
     allocatedEntries = 256;
@@ -456,7 +469,7 @@ BOOLEAN EspEnumerateEtwPublishers(
     while (TRUE)
     {
         status = NtEnumerateKey(
-            publishersKeyHandle,
+            PublishersKeyHandle,
             index,
             KeyBasicInformation,
             buffer,
@@ -483,7 +496,7 @@ BOOLEAN EspEnumerateEtwPublishers(
                 if (NT_SUCCESS(PhOpenKey(
                     &keyHandle,
                     KEY_READ,
-                    publishersKeyHandle,
+                    PublishersKeyHandle,
                     &name,
                     0
                     )))
@@ -534,12 +547,122 @@ BOOLEAN EspEnumerateEtwPublishers(
     }
 
     PhFree(buffer);
+
+    // Sort the entries by name once so the subtype list can be filled directly.
+    qsort(entries, numberOfEntries, sizeof(ETW_PUBLISHER_ENTRY), EtwPublisherByNameCompareFunction);
+
+    publisherIndex = PhCreateObject(sizeof(ETW_PUBLISHER_INDEX), EtwPublisherIndexType);
+    publisherIndex->LastWriteTime = *LastWriteTime;
+    publisherIndex->Entries = entries;
+    publisherIndex->NumberOfEntries = numberOfEntries;
+    publisherIndex->GuidHashtable = PhCreateHashtable(
+        sizeof(PETW_PUBLISHER_ENTRY),
+        EspEtwPublisherGuidCompareFunction,
+        EspEtwPublisherGuidHashFunction,
+        numberOfEntries
+        );
+    publisherIndex->NameHashtable = PhCreateHashtable(
+        sizeof(PETW_PUBLISHER_ENTRY),
+        EspEtwPublisherNameCompareFunction,
+        EspEtwPublisherNameHashFunction,
+        numberOfEntries
+        );
+
+    for (i = 0; i < numberOfEntries; i++)
+    {
+        PETW_PUBLISHER_ENTRY entry = &entries[i];
+
+        PhAddEntryHashtable(publisherIndex->GuidHashtable, &entry);
+        PhAddEntryHashtable(publisherIndex->NameHashtable, &entry);
+    }
+
+    return publisherIndex;
+}
+
+/**
+ * Gets the index of ETW publishers. The index is shared by all trigger dialogs
+ * and is only rebuilt when the last write time of the publishers key changes,
+ * i.e. when a publisher is registered or unregistered.
+ *
+ * \return A referenced index, or NULL if the publishers key could not be opened.
+ */
+PETW_PUBLISHER_INDEX EspReferenceEtwPublisherIndex(
+    VOID
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    HANDLE publishersKeyHandle;
+    KEY_BASIC_INFORMATION basicInfo;
+    ULONG returnLength;
+    PETW_PUBLISHER_INDEX publisherIndex;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        EtwPublisherIndexType = PhCreateObjectType(L"EtwPublisherIndex", 0, EspEtwPublisherIndexDeleteProcedure);
+        PhEndInitOnce(&initOnce);
+    }
+
+    if (!NT_SUCCESS(PhOpenKey(
+        &publishersKeyHandle,
+        KEY_READ,
+        PH_KEY_LOCAL_MACHINE,
+        &PublishersKeyName,
+        0
+        )))
+    {
+        return NULL;
+    }
+
+    // We only need the fixed part of the structure; the name may not fit.
+    memset(&basicInfo, 0, sizeof(KEY_BASIC_INFORMATION));
+    NtQueryKey(publishersKeyHandle, KeyBasicInformation, &basicInfo, sizeof(KEY_BASIC_INFORMATION), &returnLength);
+
+    PhAcquireQueuedLockExclusive(&EtwPublisherIndexLock);
+
+    if (!EtwPublisherIndex || EtwPublisherIndex->LastWriteTime.QuadPart != basicInfo.LastWriteTime.QuadPart)
+    {
+        PhMoveReference(&EtwPublisherIndex, EspCreateEtwPublisherIndex(publishersKeyHandle, &basicInfo.LastWriteTime));
+    }
+
+    publisherIndex = EtwPublisherIndex;
+    PhReferenceObject(publisherIndex);
+
+    PhReleaseQueuedLockExclusive(&EtwPublisherIndexLock);
+
     NtClose(publishersKeyHandle);
 
-    *Entries = entries;
-    *NumberOfEntries = numberOfEntries;
+    return publisherIndex;
+}
+
+PPH_STRING EspLookupEtwPublisherName(
+    _In_ PGUID Guid
+    )
+{
+    PETW_PUBLISHER_INDEX publisherIndex;
+    PPH_STRING publisherName = NULL;
+
+    if (publisherIndex = EspReferenceEtwPublisherIndex())
+    {
+        ETW_PUBLISHER_ENTRY lookupEntry;
+        PETW_PUBLISHER_ENTRY lookupEntryPtr = &lookupEntry;
+        PETW_PUBLISHER_ENTRY *entry;
+
+        lookupEntry.Guid = *Guid;
+        entry = PhFindEntryHashtable(publisherIndex->GuidHashtable, &lookupEntryPtr);
+
+        if (entry)
+        {
+            publisherName = (*entry)->PublisherName;
+            PhReferenceObject(publisherName);
+        }
+
+        PhDereferenceObject(publisherIndex);
+    }
 
-    return TRUE;
+    if (publisherName)
+        return publisherName;
+    else
+        return PhFormatGuid(Guid);
 }
 
 BOOLEAN EspLookupEtwPublisherGuid(
@@ -547,28 +670,26 @@ BOOLEAN EspLookupEtwPublisherGuid(
     _Out_ PGUID Guid
     )
 {
-    BOOLEAN result;
-    PETW_PUBLISHER_ENTRY entries;
-    ULONG numberOfEntries;
-    ULONG i;
+    BOOLEAN result = FALSE;
+    PETW_PUBLISHER_INDEX publisherIndex;
+    ETW_PUBLISHER_ENTRY lookupEntry;
+    PETW_PUBLISHER_ENTRY lookupEntryPtr = &lookupEntry;
+    PETW_PUBLISHER_ENTRY *entry;
 
-    if (!EspEnumerateEtwPublishers(&entries, &numberOfEntries))
+    if (!(publisherIndex = EspReferenceEtwPublisherIndex()))
         return FALSE;
 
-    result = FALSE;
+    lookupEntry.PublisherName = PhCreateString2(PublisherName);
+    entry = PhFindEntryHashtable(publisherIndex->NameHashtable, &lookupEntryPtr);
+    PhDereferenceObject(lookupEntry.PublisherName);
 
-    for (i = 0; i < numberOfEntries; i++)
+    if (entry)
     {
-        if (!result && PhEqualStringRef(&entries[i].PublisherName->sr, PublisherName, TRUE))
-        {
-            *Guid = entries[i].Guid;
-            result = TRUE;
-        }
-
-        PhDereferenceObject(entries[i].PublisherName);
+        *Guid = (*entry)->Guid;
+        result = TRUE;
     }
 
-    PhFree(entries);
+    PhDereferenceObject(publisherIndex);
 
     return result;
 }
@@ -1025,17 +1146,6 @@ static ULONG EspTriggerTypeStringToInteger(
     return 0;
 }
 
-static int __cdecl EtwPublisherByNameCompareFunction(
-    _In_ const void *elem1,
-    _In_ const void *elem2
-    )
-{
-    PETW_PUBLISHER_ENTRY entry1 = (PETW_PUBLISHER_ENTRY)elem1;
-    PETW_PUBLISHER_ENTRY entry2 = (PETW_PUBLISHER_ENTRY)elem2;
-
-    return PhCompareString(entry1->PublisherName, entry2->PublisherName, TRUE);
-}
-
 static VOID EspFixServiceTriggerControls(
     _In_ HWND hwndDlg,
     _In_ PES_TRIGGER_CONTEXT Context
@@ -1075,25 +1185,20 @@ static VOID EspFixServiceTriggerControls(
             break;
         case SERVICE_TRIGGER_TYPE_CUSTOM:
             {
-                PETW_PUBLISHER_ENTRY entries;
-                ULONG numberOfEntries;
+                PETW_PUBLISHER_INDEX publisherIndex;
                 ULONG i;
 
                 ComboBox_AddString(subTypeComboBox, L"Custom");
 
-                // Display a list of publishers.
-                if (EspEnumerateEtwPublishers(&entries, &numberOfEntries))
+                // Display a list of publishers (already sorted by name).
+                if (publisherIndex = EspReferenceEtwPublisherIndex())
                 {
-                    // Sort the list by name.
-                    qsort(entries, numberOfEntries, sizeof(ETW_PUBLISHER_ENTRY), EtwPublisherByNameCompareFunction);
-
-                    for (i = 0; i < numberOfEntries; i++)
+                    for (i = 0; i < publisherIndex->NumberOfEntries; i++)
                     {
-                        ComboBox_AddString(subTypeComboBox, entries[i].PublisherName->Buffer);
-                        PhDereferenceObject(entries[i].PublisherName);
+                        ComboBox_AddString(subTypeComboBox, publisherIndex->Entries[i].PublisherName->Buffer);
                     }
 
-                    PhFree(entries);
+                    PhDereferenceObject(publisherIndex);
                 }
             }
             break;
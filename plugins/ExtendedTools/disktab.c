@@ -86,6 +86,8 @@ HWND NTAPI EtpDiskTabCreateFunction(
 {
     HWND hwnd;
 
+    PhPluginEnsureInitialized(PluginInstance);
+
     if (EtEtwEnabled)
     {
         ULONG thinRows;
@@ -241,6 +243,9 @@ VOID EtInitializeDiskTreeList(
     PhAddTreeNewColumnEx(hwnd, ETDSTNC_TOTALRATEAVERAGE, TRUE, L"Total Rate Average", 70, PH_ALIGN_RIGHT, 4, DT_RIGHT, TRUE);
     PhAddTreeNewColumnEx(hwnd, ETDSTNC_IOPRIORITY, TRUE, L"I/O Priority", 70, PH_ALIGN_LEFT, 5, 0, TRUE);
     PhAddTreeNewColumnEx(hwnd, ETDSTNC_RESPONSETIME, TRUE, L"Response Time (ms)", 70, PH_ALIGN_RIGHT, 6, 0, TRUE);
+    PhAddTreeNewColumnEx(hwnd, ETDSTNC_RESPONSETIMEP50, FALSE, L"Response Time 50th (ms)", 70, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumnEx(hwnd, ETDSTNC_RESPONSETIMEP95, FALSE, L"Response Time 95th (ms)", 70, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
+    PhAddTreeNewColumnEx(hwnd, ETDSTNC_RESPONSETIMEP99, FALSE, L"Response Time 99th (ms)", 70, PH_ALIGN_RIGHT, -1, DT_RIGHT, TRUE);
 
     TreeNew_SetRedraw(hwnd, TRUE);
 
@@ -362,6 +367,9 @@ VOID EtRemoveDiskNode(
     if (DiskNode->WriteRateAverageText) PhDereferenceObject(DiskNode->WriteRateAverageText);
     if (DiskNode->TotalRateAverageText) PhDereferenceObject(DiskNode->TotalRateAverageText);
     if (DiskNode->ResponseTimeText) PhDereferenceObject(DiskNode->ResponseTimeText);
+    if (DiskNode->ResponseTimeP50Text) PhDereferenceObject(DiskNode->ResponseTimeP50Text);
+    if (DiskNode->ResponseTimeP95Text) PhDereferenceObject(DiskNode->ResponseTimeP95Text);
+    if (DiskNode->ResponseTimeP99Text) PhDereferenceObject(DiskNode->ResponseTimeP99Text);
     if (DiskNode->TooltipText) PhDereferenceObject(DiskNode->TooltipText);
 
     PhDereferenceObject(DiskNode->DiskItem);
@@ -396,7 +404,7 @@ VOID EtUpdateDiskNode(
 
 #define END_SORT_FUNCTION \
     if (sortResult == 0) \
-        sortResult = PhCompareString(diskItem1->FileNameWin32, diskItem2->FileNameWin32, TRUE); \
+        sortResult = PhCompareString(EtGetDiskItemFileNameWin32(diskItem1), EtGetDiskItemFileNameWin32(diskItem2), TRUE); \
     \
     return PhModifySort(sortResult, DiskTreeNewSortOrder); \
 }
@@ -409,7 +417,7 @@ END_SORT_FUNCTION
 
 BEGIN_SORT_FUNCTION(File)
 {
-    sortResult = PhCompareString(diskItem1->FileNameWin32, diskItem2->FileNameWin32, TRUE);
+    sortResult = PhCompareString(EtGetDiskItemFileNameWin32(diskItem1), EtGetDiskItemFileNameWin32(diskItem2), TRUE);
 }
 END_SORT_FUNCTION
 
@@ -443,6 +451,24 @@ BEGIN_SORT_FUNCTION(ResponseTime)
 }
 END_SORT_FUNCTION
 
+BEGIN_SORT_FUNCTION(ResponseTimeP50)
+{
+    sortResult = singlecmp(diskItem1->ResponseTimeP50, diskItem2->ResponseTimeP50);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(ResponseTimeP95)
+{
+    sortResult = singlecmp(diskItem1->ResponseTimeP95, diskItem2->ResponseTimeP95);
+}
+END_SORT_FUNCTION
+
+BEGIN_SORT_FUNCTION(ResponseTimeP99)
+{
+    sortResult = singlecmp(diskItem1->ResponseTimeP99, diskItem2->ResponseTimeP99);
+}
+END_SORT_FUNCTION
+
 BOOLEAN NTAPI EtpDiskTreeNewCallback(
     _In_ HWND hwnd,
     _In_ PH_TREENEW_MESSAGE Message,
@@ -469,7 +495,10 @@ BOOLEAN NTAPI EtpDiskTreeNewCallback(
                     SORT_FUNCTION(WriteRateAverage),
                     SORT_FUNCTION(TotalRateAverage),
                     SORT_FUNCTION(IoPriority),
-                    SORT_FUNCTION(ResponseTime)
+                    SORT_FUNCTION(ResponseTime),
+                    SORT_FUNCTION(ResponseTimeP50),
+                    SORT_FUNCTION(ResponseTimeP95),
+                    SORT_FUNCTION(ResponseTimeP99)
                 };
                 int (__cdecl *sortFunction)(const void *, const void *);
 
@@ -509,7 +538,7 @@ BOOLEAN NTAPI EtpDiskTreeNewCallback(
                 getCellText->Text = node->ProcessNameText->sr;
                 break;
             case ETDSTNC_FILE:
-                getCellText->Text = diskItem->FileNameWin32->sr;
+                getCellText->Text = EtGetDiskItemFileNameWin32(diskItem)->sr;
                 break;
             case ETDSTNC_READRATEAVERAGE:
                 EtFormatRate(diskItem->ReadAverage, &node->ReadRateAverageText, &getCellText->Text);
@@ -552,6 +581,33 @@ BOOLEAN NTAPI EtpDiskTreeNewCallback(
                     getCellText->Text = node->ResponseTimeText->sr;
                 }
                 break;
+            case ETDSTNC_RESPONSETIMEP50:
+                {
+                    PH_FORMAT format;
+
+                    PhInitFormatF(&format, diskItem->ResponseTimeP50, 3);
+                    PhMoveReference(&node->ResponseTimeP50Text, PhFormat(&format, 1, 0));
+                    getCellText->Text = node->ResponseTimeP50Text->sr;
+                }
+                break;
+            case ETDSTNC_RESPONSETIMEP95:
+                {
+                    PH_FORMAT format;
+
+                    PhInitFormatF(&format, diskItem->ResponseTimeP95, 3);
+                    PhMoveReference(&node->ResponseTimeP95Text, PhFormat(&format, 1, 0));
+                    getCellText->Text = node->ResponseTimeP95Text->sr;
+                }
+                break;
+            case ETDSTNC_RESPONSETIMEP99:
+                {
+                    PH_FORMAT format;
+
+                    PhInitFormatF(&format, diskItem->ResponseTimeP99, 3);
+                    PhMoveReference(&node->ResponseTimeP99Text, PhFormat(&format, 1, 0));
+                    getCellText->Text = node->ResponseTimeP99Text->sr;
+                }
+                break;
             default:
                 return FALSE;
             }
@@ -861,7 +917,7 @@ VOID EtHandleDiskCommand(
 
             if (diskItem)
             {
-                PhShellExploreFile(PhMainWndHandle, diskItem->FileNameWin32->Buffer);
+                PhShellExploreFile(PhMainWndHandle, EtGetDiskItemFileNameWin32(diskItem)->Buffer);
             }
         }
         break;
@@ -876,7 +932,30 @@ VOID EtHandleDiskCommand(
 
             if (diskItem)
             {
-                PhShellProperties(PhMainWndHandle, diskItem->FileNameWin32->Buffer);
+                PhShellProperties(PhMainWndHandle, EtGetDiskItemFileNameWin32(diskItem)->Buffer);
+            }
+        }
+        break;
+    case ID_DISK_LATENCYHISTOGRAM:
+        {
+            PET_DISK_ITEM diskItem = EtGetSelectedDiskItem();
+
+            if (diskItem)
+            {
+                PPH_STRING title;
+
+                PhReferenceObject(diskItem);
+
+                title = PhFormatString(
+                    L"%s (%u): %s",
+                    PhGetStringOrDefault(diskItem->ProcessName, L"Unknown process"),
+                    HandleToUlong(diskItem->ProcessId),
+                    EtGetDiskItemFileNameWin32(diskItem)->Buffer
+                    );
+                EtShowLatencyHistogramDialog(PhMainWndHandle, title, &diskItem->ResponseTimeHistogram);
+                PhDereferenceObject(title);
+
+                PhDereferenceObject(diskItem);
             }
         }
         break;
@@ -1092,7 +1171,7 @@ BOOLEAN NTAPI EtpSearchDiskListFilterCallback(
     if (wordMatch(&diskNode->ProcessNameText->sr))
         return TRUE;
 
-    if (wordMatch(&diskNode->DiskItem->FileNameWin32->sr))
+    if (wordMatch(&EtGetDiskItemFileNameWin32(diskNode->DiskItem)->sr))
         return TRUE;
 
     return FALSE;
@@ -30,6 +30,25 @@ typedef struct _ETP_DISK_PACKET
     PPH_STRING FileName;
 } ETP_DISK_PACKET, *PETP_DISK_PACKET;
 
+// The file name cache is bounded. When it is full, the least recently used
+// file object is evicted. Names are interned so that file objects for the
+// same file share one string, which is also used by the disk items.
+
+#define ETP_FILE_NAME_CACHE_MAXIMUM_ENTRIES 65536
+
+typedef struct _ETP_FILE_NAME_ENTRY
+{
+    PVOID FileObject;
+    struct _ETP_INTERNED_FILE_NAME *Name;
+    LIST_ENTRY LruListEntry;
+} ETP_FILE_NAME_ENTRY, *PETP_FILE_NAME_ENTRY;
+
+typedef struct _ETP_INTERNED_FILE_NAME
+{
+    PPH_STRING FileName;
+    ULONG UseCount; // number of cache entries using this name
+} ETP_INTERNED_FILE_NAME, *PETP_INTERNED_FILE_NAME;
+
 VOID NTAPI EtpDiskItemDeleteProcedure(
     _In_ PVOID Object,
     _In_ ULONG Flags
@@ -62,9 +81,41 @@ PH_CALLBACK_DECLARE(EtDiskItemsUpdatedEvent);
 
 PH_FREE_LIST EtDiskPacketFreeList;
 SLIST_HEADER EtDiskPacketListHead;
-PPH_HASHTABLE EtFileNameHashtable;
+PPH_HASHTABLE EtFileNameHashtable; // file object -> PETP_FILE_NAME_ENTRY
+PPH_HASHTABLE EtpInternedFileNameHashtable;
+LIST_ENTRY EtpFileNameLruListHead; // most recently used first
 PH_QUEUED_LOCK EtFileNameHashtableLock = PH_QUEUED_LOCK_INIT;
 
+static BOOLEAN NTAPI EtpFileNameEntryCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return (*(PETP_FILE_NAME_ENTRY *)Entry1)->FileObject == (*(PETP_FILE_NAME_ENTRY *)Entry2)->FileObject;
+}
+
+static ULONG NTAPI EtpFileNameEntryHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashIntPtr((ULONG_PTR)(*(PETP_FILE_NAME_ENTRY *)Entry)->FileObject);
+}
+
+static BOOLEAN NTAPI EtpInternedFileNameCompareFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return PhEqualString((*(PETP_INTERNED_FILE_NAME *)Entry1)->FileName, (*(PETP_INTERNED_FILE_NAME *)Entry2)->FileName, FALSE);
+}
+
+static ULONG NTAPI EtpInternedFileNameHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashStringRef(&(*(PETP_INTERNED_FILE_NAME *)Entry)->FileName->sr, FALSE);
+}
+
 static LARGE_INTEGER EtpPerformanceFrequency;
 static PH_CALLBACK_REGISTRATION ProcessesUpdatedCallbackRegistration;
 
@@ -85,7 +136,19 @@ VOID EtInitializeDiskInformation(
 
     PhInitializeFreeList(&EtDiskPacketFreeList, sizeof(ETP_DISK_PACKET), 64);
     RtlInitializeSListHead(&EtDiskPacketListHead);
-    EtFileNameHashtable = PhCreateSimpleHashtable(128);
+    EtFileNameHashtable = PhCreateHashtable(
+        sizeof(PETP_FILE_NAME_ENTRY),
+        EtpFileNameEntryCompareFunction,
+        EtpFileNameEntryHashFunction,
+        128
+        );
+    EtpInternedFileNameHashtable = PhCreateHashtable(
+        sizeof(PETP_INTERNED_FILE_NAME),
+        EtpInternedFileNameCompareFunction,
+        EtpInternedFileNameHashFunction,
+        128
+        );
+    InitializeListHead(&EtpFileNameLruListHead);
 
     NtQueryPerformanceCounter(&performanceCounter, &EtpPerformanceFrequency);
 
@@ -202,41 +265,105 @@ VOID EtDiskProcessDiskEvent(
     RtlInterlockedPushEntrySList(&EtDiskPacketListHead, &packet->ListEntry);
 }
 
+static PETP_INTERNED_FILE_NAME EtpReferenceInternedFileName(
+    _In_ PPH_STRINGREF FileName
+    )
+{
+    PETP_INTERNED_FILE_NAME name;
+    PETP_INTERNED_FILE_NAME *namePtr;
+    BOOLEAN added;
+
+    // The caller must hold EtFileNameHashtableLock exclusively.
+
+    name = PhAllocate(sizeof(ETP_INTERNED_FILE_NAME));
+    name->FileName = PhCreateString2(FileName);
+    name->UseCount = 0;
+    namePtr = PhAddEntryHashtableEx(EtpInternedFileNameHashtable, &name, &added);
+
+    if (!added)
+    {
+        PhDereferenceObject(name->FileName);
+        PhFree(name);
+        name = *namePtr;
+    }
+
+    name->UseCount++;
+
+    return name;
+}
+
+static VOID EtpDereferenceInternedFileName(
+    _In_ PETP_INTERNED_FILE_NAME Name
+    )
+{
+    if (--Name->UseCount == 0)
+    {
+        // Disk items and packets keep their own references to the string.
+        PhRemoveEntryHashtable(EtpInternedFileNameHashtable, &Name);
+        PhDereferenceObject(Name->FileName);
+        PhFree(Name);
+    }
+}
+
+static VOID EtpRemoveFileNameEntry(
+    _In_ PETP_FILE_NAME_ENTRY Entry
+    )
+{
+    RemoveEntryList(&Entry->LruListEntry);
+    PhRemoveEntryHashtable(EtFileNameHashtable, &Entry);
+    EtpDereferenceInternedFileName(Entry->Name);
+    PhFree(Entry);
+}
+
 VOID EtDiskProcessFileEvent(
     _In_ PET_ETW_FILE_EVENT Event
     )
 {
-    PH_KEY_VALUE_PAIR pair;
-    PPH_KEY_VALUE_PAIR realPair;
+    ETP_FILE_NAME_ENTRY lookupEntry;
+    PETP_FILE_NAME_ENTRY lookupEntryPtr = &lookupEntry;
+    PETP_FILE_NAME_ENTRY *entryPtr;
+    PETP_FILE_NAME_ENTRY entry;
 
     if (!EtDiskEnabled)
         return;
 
+    lookupEntry.FileObject = Event->FileObject;
+
     if (Event->Type == EtEtwFileCreateType || Event->Type == EtEtwFileRundownType)
     {
-        pair.Key = Event->FileObject;
-        pair.Value = NULL;
-
         PhAcquireQueuedLockExclusive(&EtFileNameHashtableLock);
 
-        realPair = PhAddEntryHashtableEx(EtFileNameHashtable, &pair, NULL);
-        PhMoveReference(&realPair->Value, PhCreateString2(&Event->FileName));
+        if (entryPtr = PhFindEntryHashtable(EtFileNameHashtable, &lookupEntryPtr))
+        {
+            // The file object address was re-used.
+            entry = *entryPtr;
+            EtpDereferenceInternedFileName(entry->Name);
+            entry->Name = EtpReferenceInternedFileName(&Event->FileName);
+            RemoveEntryList(&entry->LruListEntry);
+            InsertHeadList(&EtpFileNameLruListHead, &entry->LruListEntry);
+        }
+        else
+        {
+            if (EtFileNameHashtable->Count >= ETP_FILE_NAME_CACHE_MAXIMUM_ENTRIES)
+            {
+                EtpRemoveFileNameEntry(CONTAINING_RECORD(EtpFileNameLruListHead.Blink, ETP_FILE_NAME_ENTRY, LruListEntry));
+            }
+
+            entry = PhAllocate(sizeof(ETP_FILE_NAME_ENTRY));
+            entry->FileObject = Event->FileObject;
+            entry->Name = EtpReferenceInternedFileName(&Event->FileName);
+            InsertHeadList(&EtpFileNameLruListHead, &entry->LruListEntry);
+            PhAddEntryHashtable(EtFileNameHashtable, &entry);
+        }
 
         PhReleaseQueuedLockExclusive(&EtFileNameHashtableLock);
     }
     else if (Event->Type == EtEtwFileDeleteType)
     {
-        pair.Key = Event->FileObject;
-
         PhAcquireQueuedLockExclusive(&EtFileNameHashtableLock);
 
-        realPair = PhFindEntryHashtable(EtFileNameHashtable, &pair);
-
-        if (realPair)
-        {
-            PhDereferenceObject(realPair->Value);
-            PhRemoveEntryHashtable(EtFileNameHashtable, &pair);
-        }
+        if (entryPtr = PhFindEntryHashtable(EtFileNameHashtable, &lookupEntryPtr))
+            EtpRemoveFileNameEntry(*entryPtr);
 
         PhReleaseQueuedLockExclusive(&EtFileNameHashtableLock);
     }
@@ -246,25 +373,42 @@ PPH_STRING EtFileObjectToFileName(
     _In_ PVOID FileObject
     )
 {
-    PH_KEY_VALUE_PAIR pair;
-    PPH_KEY_VALUE_PAIR realPair;
+    ETP_FILE_NAME_ENTRY lookupEntry;
+    PETP_FILE_NAME_ENTRY lookupEntryPtr = &lookupEntry;
+    PETP_FILE_NAME_ENTRY *entryPtr;
     PPH_STRING fileName;
 
-    pair.Key = FileObject;
+    lookupEntry.FileObject = FileObject;
     fileName = NULL;
 
-    PhAcquireQueuedLockShared(&EtFileNameHashtableLock);
-
-    realPair = PhFindEntryHashtable(EtFileNameHashtable, &pair);
+    // This is exclusive because it updates the LRU list.
+    PhAcquireQueuedLockExclusive(&EtFileNameHashtableLock);
 
-    if (realPair)
-        PhSetReference(&fileName, realPair->Value);
+    if (entryPtr = PhFindEntryHashtable(EtFileNameHashtable, &lookupEntryPtr))
+    {
+        PhSetReference(&fileName, (*entryPtr)->Name->FileName);
+        RemoveEntryList(&(*entryPtr)->LruListEntry);
+        InsertHeadList(&EtpFileNameLruListHead, &(*entryPtr)->LruListEntry);
+    }
 
-    PhReleaseQueuedLockShared(&EtFileNameHashtableLock);
+    PhReleaseQueuedLockExclusive(&EtFileNameHashtableLock);
 
     return fileName;
 }
 
+PPH_STRING EtGetDiskItemFileNameWin32(
+    _In_ PET_DISK_ITEM DiskItem
+    )
+{
+    // The Win32 name is only needed when the item is displayed, sorted or
+    // searched, so it is created on first use. This is only called from the
+    // UI thread.
+    if (!DiskItem->FileNameWin32)
+        DiskItem->FileNameWin32 = PhGetFileName(DiskItem->FileName);
+
+    return DiskItem->FileNameWin32;
+}
+
 VOID EtpProcessDiskPacket(
     _In_ PETP_DISK_PACKET Packet,
     _In_ ULONG RunId
@@ -298,7 +442,6 @@ VOID EtpProcessDiskPacket(
 
         diskItem->ProcessId = diskEvent->ClientId.UniqueProcess;
         PhSetReference(&diskItem->FileName, Packet->FileName);
-        diskItem->FileNameWin32 = PhGetFileName(diskItem->FileName);
 
         if (processItem = PhReferenceProcessItem(diskItem->ProcessId))
         {
@@ -348,6 +491,9 @@ VOID EtpProcessDiskPacket(
         diskItem->ResponseTimeCount++;
     }
 
+    // Disk items are only modified on this thread, so the histogram doesn't need a lock.
+    EtAddLatencyHistogramSample(&diskItem->ResponseTimeHistogram, EtHighResResponseTimeToMicroseconds(diskEvent->HighResResponseTime));
+
     if (!added)
     {
         if (diskItem->FreshTime != RunId)
@@ -481,6 +627,17 @@ static VOID NTAPI ProcessesUpdatedCallback(
             }
         }
 
+        if (diskItem->ResponseTimeHistogramCount != diskItem->ResponseTimeHistogram.Count)
+        {
+            EtQueryLatencyHistogramPercentiles(
+                &diskItem->ResponseTimeHistogram,
+                &diskItem->ResponseTimeP50,
+                &diskItem->ResponseTimeP95,
+                &diskItem->ResponseTimeP99
+                );
+            diskItem->ResponseTimeHistogramCount = diskItem->ResponseTimeHistogram.Count;
+        }
+
         diskItem->ReadTotal += diskItem->ReadDelta;
         diskItem->WriteTotal += diskItem->WriteDelta;
         diskItem->ReadDelta = 0;
@@ -35,6 +35,10 @@ NTSTATUS EtpEtwMonitorThreadStart(
     _In_ PVOID Parameter
     );
 
+ULONG EtpEnableDxgKrnlProvider(
+    _In_ ULONG ControlCode
+    );
+
 ULONG EtpStopEtwRundownSession(
     VOID
     );
@@ -58,6 +62,7 @@ static GUID DiskIoGuid_I = { 0x3d6fa8d4, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc
 static GUID FileIoGuid_I = { 0x90cbdc39, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
 static GUID TcpIpGuid_I = { 0x9a280ac0, 0xc8e0, 0x11d1, { 0x84, 0xe2, 0x00, 0xc0, 0x4f, 0xb9, 0x98, 0xa2 } };
 static GUID UdpIpGuid_I = { 0xbf3a50c5, 0xa9c9, 0x4988, { 0xa0, 0x05, 0x2d, 0xf0, 0xb7, 0xc8, 0x0f, 0x80 } };
+static GUID DxgKrnlGuid_I = { 0x802ec45a, 0x1e99, 0x4b83, { 0x99, 0x20, 0x87, 0xc9, 0x82, 0x77, 0xba, 0x9d } };
 
 // ETW tracing layer
 
@@ -72,6 +77,17 @@ static BOOLEAN EtpEtwActive;
 static BOOLEAN EtpStartedSession;
 static BOOLEAN EtpEtwExiting;
 static HANDLE EtpEtwMonitorThreadHandle;
+static BOOLEAN EtpGpuEventsEnabled;
+static BOOLEAN EtpGpuCaptureStatePending;
+
+// The buffers of a session that we started are grown when events are lost,
+// up to this many buffers.
+#define ET_ETW_MAXIMUM_BUFFERS_LIMIT 1024
+
+ULONG EtEtwEventsLost;
+ULONG EtEtwBuffersLost;
+PH_UINT32_DELTA EtEtwEventsLostDelta;
+PH_UINT32_DELTA EtEtwBuffersLostDelta;
 
 // ETW rundown layer
 
@@ -90,7 +106,10 @@ VOID EtEtwMonitorInitialization(
         EtStartEtwSession();
 
         if (EtEtwEnabled)
+        {
             EtpEtwMonitorThreadHandle = PhCreateThread(0, EtpEtwMonitorThreadStart, NULL);
+            PhSetNetworkProviderChangeNotifications(TRUE);
+        }
     }
 }
 
@@ -100,6 +119,7 @@ VOID EtEtwMonitorUninitialization(
 {
     if (EtEtwEnabled)
     {
+        PhSetNetworkProviderChangeNotifications(FALSE);
         EtpEtwExiting = TRUE;
         EtStopEtwSession();
     }
@@ -139,9 +159,11 @@ VOID EtStartEtwSession(
     EtpTraceProperties->Wnode.Guid = *EtpActualSessionGuid;
     EtpTraceProperties->Wnode.ClientContext = 1;
     EtpTraceProperties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
-    EtpTraceProperties->MinimumBuffers = 1;
+    EtpTraceProperties->BufferSize = PhGetIntegerSetting(SETTING_NAME_ETW_BUFFER_SIZE); // KB, 0 for the default
+    EtpTraceProperties->MinimumBuffers = PhGetIntegerSetting(SETTING_NAME_ETW_MINIMUM_BUFFERS);
+    EtpTraceProperties->MaximumBuffers = PhGetIntegerSetting(SETTING_NAME_ETW_MAXIMUM_BUFFERS); // 0 for the default
     EtpTraceProperties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
-    EtpTraceProperties->FlushTimer = 1;
+    EtpTraceProperties->FlushTimer = PhGetIntegerSetting(SETTING_NAME_ETW_FLUSH_TIMER); // seconds
     EtpTraceProperties->EnableFlags = EVENT_TRACE_FLAG_DISK_IO | EVENT_TRACE_FLAG_DISK_FILE_IO | EVENT_TRACE_FLAG_NETWORK_TCPIP;
     EtpTraceProperties->LogFileNameOffset = 0;
     EtpTraceProperties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
@@ -156,6 +178,10 @@ VOID EtStartEtwSession(
         EtEtwEnabled = TRUE;
         EtpEtwActive = TRUE;
         EtpStartedSession = TRUE;
+
+        // The session was restarted; enable the GPU events in the new one.
+        if (EtpGpuEventsEnabled && EtpEnableDxgKrnlProvider(EVENT_CONTROL_CODE_ENABLE_PROVIDER) == ERROR_SUCCESS)
+            EtpGpuCaptureStatePending = TRUE;
     }
     else if (result == ERROR_ALREADY_EXISTS)
     {
@@ -188,6 +214,48 @@ ULONG EtpControlEtwSession(
         );
 }
 
+ULONG EtpEnableDxgKrnlProvider(
+    _In_ ULONG ControlCode
+    )
+{
+    return EnableTraceEx2(
+        EtpSessionHandle,
+        &DxgKrnlGuid_I,
+        ControlCode,
+        TRACE_LEVEL_INFORMATION,
+        0x1, // Base
+        0,
+        0,
+        NULL
+        );
+}
+
+/**
+ * Enables the Microsoft-Windows-DxgKrnl provider in the ETW session.
+ *
+ * \return TRUE if the events will be delivered to EtGpuProcessEtwEvent, otherwise FALSE.
+ *
+ * \remarks Providers other than the kernel can only be enabled in the private session that
+ * we start on Windows 8 and above.
+ */
+BOOLEAN EtEnableEtwGpuEvents(
+    VOID
+    )
+{
+    if (!EtEtwEnabled || !EtpStartedSession || WindowsVersion < WINDOWS_8)
+        return FALSE;
+
+    if (EtpEnableDxgKrnlProvider(EVENT_CONTROL_CODE_ENABLE_PROVIDER) != ERROR_SUCCESS)
+        return FALSE;
+
+    EtpGpuEventsEnabled = TRUE;
+    // Contexts that already exist are only known after a rundown. Request it once the consumer
+    // is receiving events so that the rundown events aren't lost.
+    EtpGpuCaptureStatePending = TRUE;
+
+    return TRUE;
+}
+
 VOID EtStopEtwSession(
     VOID
     )
@@ -204,10 +272,74 @@ VOID EtFlushEtwSession(
         EtpControlEtwSession(EVENT_TRACE_CONTROL_FLUSH);
 }
 
+VOID EtUpdateEtwSessionStatistics(
+    VOID
+    )
+{
+    ULONG eventsLost;
+    ULONG buffersLost;
+    ULONG maximumBuffers;
+
+    if (!EtEtwEnabled)
+        return;
+
+    if (EtpControlEtwSession(EVENT_TRACE_CONTROL_QUERY) != ERROR_SUCCESS)
+        return;
+
+    eventsLost = EtpTraceProperties->EventsLost;
+    buffersLost = EtpTraceProperties->RealTimeBuffersLost + EtpTraceProperties->LogBuffersLost;
+
+    // The counters start again from zero if the session was restarted.
+    if (eventsLost < EtEtwEventsLost || buffersLost < EtEtwBuffersLost)
+    {
+        PhInitializeDelta(&EtEtwEventsLostDelta);
+        PhInitializeDelta(&EtEtwBuffersLostDelta);
+    }
+
+    EtEtwEventsLost = eventsLost;
+    EtEtwBuffersLost = buffersLost;
+    PhUpdateDelta(&EtEtwEventsLostDelta, eventsLost);
+    PhUpdateDelta(&EtEtwBuffersLostDelta, buffersLost);
+
+    if (EtEtwEventsLostDelta.Delta == 0 && EtEtwBuffersLostDelta.Delta == 0)
+        return;
+
+    dprintf("ETW: %u events and %u buffers lost\n", EtEtwEventsLostDelta.Delta, EtEtwBuffersLostDelta.Delta);
+
+    // We can only resize sessions that we own. The query filled in the
+    // current number of buffers.
+    maximumBuffers = EtpTraceProperties->MaximumBuffers;
+
+    if (EtpStartedSession && maximumBuffers < ET_ETW_MAXIMUM_BUFFERS_LIMIT)
+    {
+        PPH_STRING message;
+
+        EtpTraceProperties->MaximumBuffers = min(max(maximumBuffers * 2, EtpTraceProperties->NumberOfBuffers + 1), ET_ETW_MAXIMUM_BUFFERS_LIMIT);
+
+        if (EtpControlEtwSession(EVENT_TRACE_CONTROL_UPDATE) == ERROR_SUCCESS)
+        {
+            message = PhFormatString(
+                L"ETW: %u events lost, increased the maximum number of buffers from %u to %u",
+                EtEtwEventsLostDelta.Delta + EtEtwBuffersLostDelta.Delta,
+                maximumBuffers,
+                EtpTraceProperties->MaximumBuffers
+                );
+            PhLogMessageEntry(PH_LOG_ENTRY_MESSAGE, message);
+            PhDereferenceObject(message);
+        }
+    }
+}
+
 ULONG NTAPI EtpEtwBufferCallback(
     _In_ PEVENT_TRACE_LOGFILE Buffer
     )
 {
+    if (EtpGpuCaptureStatePending)
+    {
+        EtpGpuCaptureStatePending = FALSE;
+        EtpEnableDxgKrnlProvider(EVENT_CONTROL_CODE_CAPTURE_STATE);
+    }
+
     return !EtpEtwExiting;
 }
 
@@ -327,6 +459,18 @@ VOID NTAPI EtpEtwEventCallback(
             networkEvent.Type = EtEtwNetworkReceiveType;
             networkEvent.ProtocolType = PH_IPV6_NETWORK_TYPE;
             break;
+        case EVENT_TRACE_TYPE_CONNECT: // connect
+        case EVENT_TRACE_TYPE_DISCONNECT: // disconnect
+        case EVENT_TRACE_TYPE_ACCEPT: // accept
+        case EVENT_TRACE_TYPE_RECONNECT: // reconnect
+        case EVENT_TRACE_TYPE_CONNECT + 16: // connect ipv6
+        case EVENT_TRACE_TYPE_DISCONNECT + 16: // disconnect ipv6
+        case EVENT_TRACE_TYPE_ACCEPT + 16: // accept ipv6
+        case EVENT_TRACE_TYPE_RECONNECT + 16: // reconnect ipv6
+            // The network provider only enumerates connections when we tell it
+            // that something has changed.
+            PhNotifyNetworkConnectionsChanged();
+            break;
         }
 
         if (memcmp(&EventRecord->EventHeader.ProviderId, &TcpIpGuid_I, sizeof(GUID)) == 0)
@@ -376,6 +520,12 @@ VOID NTAPI EtpEtwEventCallback(
             EtProcessNetworkEvent(&networkEvent);
         }
     }
+    else if (memcmp(&EventRecord->EventHeader.ProviderId, &DxgKrnlGuid_I, sizeof(GUID)) == 0)
+    {
+        // DxgKrnl
+
+        EtGpuProcessEtwEvent(EventRecord);
+    }
 }
 
 NTSTATUS EtpEtwMonitorThreadStart(
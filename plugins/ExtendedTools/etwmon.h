@@ -64,10 +64,23 @@ VOID EtFlushEtwSession(
     VOID
     );
 
+VOID EtUpdateEtwSessionStatistics(
+    VOID
+    );
+
+extern ULONG EtEtwEventsLost;
+extern ULONG EtEtwBuffersLost;
+extern PH_UINT32_DELTA EtEtwEventsLostDelta;
+extern PH_UINT32_DELTA EtEtwBuffersLostDelta;
+
 ULONG EtStartEtwRundown(
     VOID
     );
 
+BOOLEAN EtEnableEtwGpuEvents(
+    VOID
+    );
+
 // etwstat
 
 typedef enum _ET_ETW_EVENT_TYPE
@@ -133,4 +146,10 @@ VOID EtDiskProcessFileEvent(
     _In_ PET_ETW_FILE_EVENT Event
     );
 
+// gpuetw
+
+VOID EtGpuProcessEtwEvent(
+    _In_ PEVENT_RECORD EventRecord
+    );
+
 #endif
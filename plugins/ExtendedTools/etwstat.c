@@ -23,6 +23,43 @@
 #include "exttools.h"
 #include "etwmon.h"
 
+typedef struct _ET_PROCESS_EVENT_TOTALS
+{
+    HANDLE ProcessId;
+    ULONG DiskReadCount;
+    ULONG DiskWriteCount;
+    ULONG NetworkReceiveCount;
+    ULONG NetworkSendCount;
+    ULONG64 DiskReadRaw;
+    ULONG64 DiskWriteRaw;
+    ULONG64 NetworkReceiveRaw;
+    ULONG64 NetworkSendRaw;
+    ET_LATENCY_HISTOGRAM DiskResponseTime;
+} ET_PROCESS_EVENT_TOTALS, *PET_PROCESS_EVENT_TOTALS;
+
+#define ET_CONNECTION_TOTALS_STRIPES 8
+#define ET_CONNECTION_TOTALS_MAXIMUM_AGE 2 // updates to wait for the network item to appear
+
+typedef struct _ET_CONNECTION_EVENT_TOTALS
+{
+    ULONG ProtocolType;
+    PH_IP_ENDPOINT LocalEndpoint;
+    PH_IP_ENDPOINT RemoteEndpoint;
+    HANDLE ProcessId;
+    ULONG Age;
+    ULONG ReceiveCount;
+    ULONG SendCount;
+    ULONG64 ReceiveRaw;
+    ULONG64 SendRaw;
+} ET_CONNECTION_EVENT_TOTALS, *PET_CONNECTION_EVENT_TOTALS;
+
+typedef struct _ET_CONNECTION_TOTALS_STRIPE
+{
+    PH_QUEUED_LOCK Lock;
+    PPH_HASHTABLE Hashtable;
+    PPH_HASHTABLE SpareHashtable;
+} ET_CONNECTION_TOTALS_STRIPE, *PET_CONNECTION_TOTALS_STRIPE;
+
 VOID NTAPI ProcessesUpdatedCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -37,6 +74,14 @@ VOID EtpUpdateProcessInformation(
     VOID
     );
 
+VOID EtpFlushProcessEventTotals(
+    VOID
+    );
+
+VOID EtpFlushConnectionEventTotals(
+    VOID
+    );
+
 static PH_CALLBACK_REGISTRATION EtpProcessesUpdatedCallbackRegistration;
 static PH_CALLBACK_REGISTRATION EtpNetworkItemsUpdatedCallbackRegistration;
 
@@ -67,13 +112,110 @@ PH_CIRCULAR_BUFFER_ULONG EtNetworkSendHistory;
 PH_CIRCULAR_BUFFER_ULONG EtMaxDiskHistory; // ID of max. disk usage process
 PH_CIRCULAR_BUFFER_ULONG EtMaxNetworkHistory; // ID of max. network usage process
 
-PVOID EtpProcessInformation;
+PPH_HASHTABLE EtpThreadIdToProcessIdHashtable; // thread ID -> process ID
 PH_QUEUED_LOCK EtpProcessInformationLock = PH_QUEUED_LOCK_INIT;
 
+// Per-process event totals are accumulated by the ETW consumer thread and
+// merged into the process blocks once per update. The two hashtables are
+// swapped on each update, so the lock is only held for short periods.
+PPH_HASHTABLE EtpProcessEventTotals;
+PPH_HASHTABLE EtpSpareProcessEventTotals;
+PH_QUEUED_LOCK EtpProcessEventTotalsLock = PH_QUEUED_LOCK_INIT;
+
+// Per-connection event totals are accumulated the same way, keyed by the protocol, endpoints
+// and process of the connection, and joined with the network items once per update instead of
+// looking up the network item for every event. The hashtables are split into stripes by key so
+// that a flush only blocks the ETW consumer thread for events that fall into the stripe being
+// swapped. Totals for connections that don't have a network item yet are kept for a few
+// updates, since the network provider only sees new connections when it next polls.
+ET_CONNECTION_TOTALS_STRIPE EtpConnectionTotalsStripes[ET_CONNECTION_TOTALS_STRIPES];
+PPH_HASHTABLE EtpPendingConnectionTotals;
+PPH_HASHTABLE EtpSparePendingConnectionTotals;
+
+static BOOLEAN NTAPI EtpProcessEventTotalsEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PET_PROCESS_EVENT_TOTALS)Entry1)->ProcessId == ((PET_PROCESS_EVENT_TOTALS)Entry2)->ProcessId;
+}
+
+static ULONG NTAPI EtpProcessEventTotalsHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return HandleToUlong(((PET_PROCESS_EVENT_TOTALS)Entry)->ProcessId) / 4;
+}
+
+static BOOLEAN NTAPI EtpConnectionEventTotalsEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    PET_CONNECTION_EVENT_TOTALS totals1 = Entry1;
+    PET_CONNECTION_EVENT_TOTALS totals2 = Entry2;
+
+    return
+        totals1->ProtocolType == totals2->ProtocolType &&
+        totals1->ProcessId == totals2->ProcessId &&
+        PhEqualIpEndpoint(&totals1->LocalEndpoint, &totals2->LocalEndpoint) &&
+        PhEqualIpEndpoint(&totals1->RemoteEndpoint, &totals2->RemoteEndpoint);
+}
+
+static ULONG NTAPI EtpConnectionEventTotalsHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    PET_CONNECTION_EVENT_TOTALS totals = Entry;
+
+    return
+        (PhHashIpEndpoint(&totals->LocalEndpoint) + PhHashIpEndpoint(&totals->RemoteEndpoint)) ^
+        totals->ProtocolType ^
+        (HandleToUlong(totals->ProcessId) / 4);
+}
+
+static PPH_HASHTABLE EtpCreateConnectionEventTotalsHashtable(
+    VOID
+    )
+{
+    return PhCreateHashtable(
+        sizeof(ET_CONNECTION_EVENT_TOTALS),
+        EtpConnectionEventTotalsEqualFunction,
+        EtpConnectionEventTotalsHashFunction,
+        16
+        );
+}
+
 VOID EtEtwStatisticsInitialization(
     VOID
     )
 {
+    ULONG i;
+
+    // These must exist before the monitor thread starts delivering events.
+    EtpProcessEventTotals = PhCreateHashtable(
+        sizeof(ET_PROCESS_EVENT_TOTALS),
+        EtpProcessEventTotalsEqualFunction,
+        EtpProcessEventTotalsHashFunction,
+        64
+        );
+    EtpSpareProcessEventTotals = PhCreateHashtable(
+        sizeof(ET_PROCESS_EVENT_TOTALS),
+        EtpProcessEventTotalsEqualFunction,
+        EtpProcessEventTotalsHashFunction,
+        64
+        );
+
+    for (i = 0; i < ET_CONNECTION_TOTALS_STRIPES; i++)
+    {
+        PhInitializeQueuedLock(&EtpConnectionTotalsStripes[i].Lock);
+        EtpConnectionTotalsStripes[i].Hashtable = EtpCreateConnectionEventTotalsHashtable();
+        EtpConnectionTotalsStripes[i].SpareHashtable = EtpCreateConnectionEventTotalsHashtable();
+    }
+
+    EtpPendingConnectionTotals = EtpCreateConnectionEventTotalsHashtable();
+    EtpSparePendingConnectionTotals = EtpCreateConnectionEventTotalsHashtable();
+
     EtEtwMonitorInitialization();
 
     if (EtEtwEnabled)
@@ -110,12 +252,32 @@ VOID EtEtwStatisticsUninitialization(
     EtEtwMonitorUninitialization();
 }
 
+static PET_PROCESS_EVENT_TOTALS EtpGetProcessEventTotals(
+    _In_ HANDLE ProcessId
+    )
+{
+    ET_PROCESS_EVENT_TOTALS lookupTotals;
+    PET_PROCESS_EVENT_TOTALS totals;
+
+    // The caller must hold EtpProcessEventTotalsLock.
+
+    lookupTotals.ProcessId = ProcessId;
+
+    // Entries are large because of the histogram, so only clear one when it is added.
+    if (totals = PhFindEntryHashtable(EtpProcessEventTotals, &lookupTotals))
+        return totals;
+
+    memset(&lookupTotals, 0, sizeof(ET_PROCESS_EVENT_TOTALS));
+    lookupTotals.ProcessId = ProcessId;
+
+    return PhAddEntryHashtableEx(EtpProcessEventTotals, &lookupTotals, NULL);
+}
+
 VOID EtProcessDiskEvent(
     _In_ PET_ETW_DISK_EVENT Event
     )
 {
-    PPH_PROCESS_ITEM processItem;
-    PET_PROCESS_BLOCK block;
+    PET_PROCESS_EVENT_TOTALS totals;
 
     if (Event->Type == EtEtwDiskReadType)
     {
@@ -128,33 +290,34 @@ VOID EtProcessDiskEvent(
         EtDiskWriteCount++;
     }
 
-    if (processItem = PhReferenceProcessItem(Event->ClientId.UniqueProcess))
-    {
-        block = EtGetProcessBlock(processItem);
+    PhAcquireQueuedLockExclusive(&EtpProcessEventTotalsLock);
 
-        if (Event->Type == EtEtwDiskReadType)
-        {
-            block->DiskReadRaw += Event->TransferSize;
-            block->DiskReadCount++;
-        }
-        else
-        {
-            block->DiskWriteRaw += Event->TransferSize;
-            block->DiskWriteCount++;
-        }
+    totals = EtpGetProcessEventTotals(Event->ClientId.UniqueProcess);
 
-        PhDereferenceObject(processItem);
+    if (Event->Type == EtEtwDiskReadType)
+    {
+        totals->DiskReadRaw += Event->TransferSize;
+        totals->DiskReadCount++;
+    }
+    else
+    {
+        totals->DiskWriteRaw += Event->TransferSize;
+        totals->DiskWriteCount++;
     }
+
+    EtAddLatencyHistogramSample(&totals->DiskResponseTime, EtHighResResponseTimeToMicroseconds(Event->HighResResponseTime));
+
+    PhReleaseQueuedLockExclusive(&EtpProcessEventTotalsLock);
 }
 
 VOID EtProcessNetworkEvent(
     _In_ PET_ETW_NETWORK_EVENT Event
     )
 {
-    PPH_PROCESS_ITEM processItem;
-    PET_PROCESS_BLOCK block;
-    PPH_NETWORK_ITEM networkItem;
-    PET_NETWORK_BLOCK networkBlock;
+    PET_PROCESS_EVENT_TOTALS totals;
+    ET_CONNECTION_EVENT_TOTALS lookupConnectionTotals;
+    PET_CONNECTION_EVENT_TOTALS connectionTotals;
+    PET_CONNECTION_TOTALS_STRIPE stripe;
 
     if (Event->Type == EtEtwNetworkReceiveType)
     {
@@ -170,46 +333,46 @@ VOID EtProcessNetworkEvent(
     // Note: there is always the possibility of us receiving the event too early,
     // before the process item or network item is created. So events may be lost.
 
-    if (processItem = PhReferenceProcessItem(Event->ClientId.UniqueProcess))
-    {
-        block = EtGetProcessBlock(processItem);
+    PhAcquireQueuedLockExclusive(&EtpProcessEventTotalsLock);
 
-        if (Event->Type == EtEtwNetworkReceiveType)
-        {
-            block->NetworkReceiveRaw += Event->TransferSize;
-            block->NetworkReceiveCount++;
-        }
-        else
-        {
-            block->NetworkSendRaw += Event->TransferSize;
-            block->NetworkSendCount++;
-        }
+    totals = EtpGetProcessEventTotals(Event->ClientId.UniqueProcess);
 
-        PhDereferenceObject(processItem);
+    if (Event->Type == EtEtwNetworkReceiveType)
+    {
+        totals->NetworkReceiveRaw += Event->TransferSize;
+        totals->NetworkReceiveCount++;
     }
-
-    if (networkItem = PhReferenceNetworkItem(
-        Event->ProtocolType,
-        &Event->LocalEndpoint,
-        &Event->RemoteEndpoint,
-        Event->ClientId.UniqueProcess
-        ))
+    else
     {
-        networkBlock = EtGetNetworkBlock(networkItem);
+        totals->NetworkSendRaw += Event->TransferSize;
+        totals->NetworkSendCount++;
+    }
 
-        if (Event->Type == EtEtwNetworkReceiveType)
-        {
-            networkBlock->ReceiveRaw += Event->TransferSize;
-            networkBlock->ReceiveCount++;
-        }
-        else
-        {
-            networkBlock->SendRaw += Event->TransferSize;
-            networkBlock->SendCount++;
-        }
+    PhReleaseQueuedLockExclusive(&EtpProcessEventTotalsLock);
 
-        PhDereferenceObject(networkItem);
+    memset(&lookupConnectionTotals, 0, sizeof(ET_CONNECTION_EVENT_TOTALS));
+    lookupConnectionTotals.ProtocolType = Event->ProtocolType;
+    lookupConnectionTotals.LocalEndpoint = Event->LocalEndpoint;
+    lookupConnectionTotals.RemoteEndpoint = Event->RemoteEndpoint;
+    lookupConnectionTotals.ProcessId = Event->ClientId.UniqueProcess;
+    stripe = &EtpConnectionTotalsStripes[EtpConnectionEventTotalsHashFunction(&lookupConnectionTotals) % ET_CONNECTION_TOTALS_STRIPES];
+
+    PhAcquireQueuedLockExclusive(&stripe->Lock);
+
+    connectionTotals = PhAddEntryHashtableEx(stripe->Hashtable, &lookupConnectionTotals, NULL);
+
+    if (Event->Type == EtEtwNetworkReceiveType)
+    {
+        connectionTotals->ReceiveRaw += Event->TransferSize;
+        connectionTotals->ReceiveCount++;
     }
+    else
+    {
+        connectionTotals->SendRaw += Event->TransferSize;
+        connectionTotals->SendCount++;
+    }
+
+    PhReleaseQueuedLockExclusive(&stripe->Lock);
 }
 
 static VOID NTAPI ProcessesUpdatedCallback(
@@ -231,9 +394,12 @@ static VOID NTAPI ProcessesUpdatedCallback(
     if (WindowsVersion >= WINDOWS_8)
         EtpUpdateProcessInformation();
 
+    EtpFlushProcessEventTotals();
+
     // ETW is extremely lazy when it comes to flushing buffers, so we must do it
     // manually.
     EtFlushEtwSession();
+    EtUpdateEtwSessionStatistics();
 
     // Update global statistics.
 
@@ -338,6 +504,8 @@ static VOID NTAPI NetworkItemsUpdatedCallback(
     // ETW is flushed in the processes-updated callback above. This may cause us the network
     // blocks to all fall one update interval behind, however.
 
+    EtpFlushConnectionEventTotals();
+
     // Update per-connection statistics.
     // Note: no lock is needed because we only ever modify the list on this same thread.
 
@@ -347,17 +515,48 @@ static VOID NTAPI NetworkItemsUpdatedCallback(
     {
         PET_NETWORK_BLOCK block;
         PH_UINT64_DELTA oldDeltas[4];
+        ULONG64 oldReceiveAverage;
+        ULONG64 oldSendAverage;
 
         block = CONTAINING_RECORD(listEntry, ET_NETWORK_BLOCK, ListEntry);
 
         memcpy(oldDeltas, block->Deltas, sizeof(block->Deltas));
+        oldReceiveAverage = block->ReceiveAverage;
+        oldSendAverage = block->SendAverage;
 
         PhUpdateDelta(&block->ReceiveDelta, block->ReceiveCount);
         PhUpdateDelta(&block->ReceiveRawDelta, block->ReceiveRaw);
         PhUpdateDelta(&block->SendDelta, block->SendCount);
         PhUpdateDelta(&block->SendRawDelta, block->SendRaw);
 
-        if (memcmp(oldDeltas, block->Deltas, sizeof(block->Deltas)))
+        // Update the history. The sums are kept up to date so that the averages don't need
+        // to go through the whole history.
+
+        if (block->HistoryPosition != 0)
+            block->HistoryPosition--;
+        else
+            block->HistoryPosition = HISTORY_SIZE - 1;
+
+        if (block->HistoryCount == HISTORY_SIZE)
+        {
+            block->ReceiveHistorySum -= block->ReceiveHistory[block->HistoryPosition];
+            block->SendHistorySum -= block->SendHistory[block->HistoryPosition];
+        }
+        else
+        {
+            block->HistoryCount++;
+        }
+
+        block->ReceiveHistory[block->HistoryPosition] = block->ReceiveRawDelta.Delta;
+        block->SendHistory[block->HistoryPosition] = block->SendRawDelta.Delta;
+        block->ReceiveHistorySum += block->ReceiveRawDelta.Delta;
+        block->SendHistorySum += block->SendRawDelta.Delta;
+        block->ReceiveAverage = block->ReceiveHistorySum / block->HistoryCount;
+        block->SendAverage = block->SendHistorySum / block->HistoryCount;
+
+        if (memcmp(oldDeltas, block->Deltas, sizeof(block->Deltas)) ||
+            block->ReceiveAverage != oldReceiveAverage ||
+            block->SendAverage != oldSendAverage)
         {
             // Values have changed. Invalidate the network node.
             PhReferenceObject(block->NetworkItem);
@@ -372,49 +571,207 @@ VOID EtpUpdateProcessInformation(
     VOID
     )
 {
+    PPH_PROCESS_INFORMATION_SNAPSHOT snapshot;
+    PSYSTEM_PROCESS_INFORMATION process;
+    PPH_HASHTABLE hashtable;
+    PPH_HASHTABLE oldHashtable;
+    ULONG i;
+
+    // We run right after the process provider, so its snapshot is current.
+    if (!(snapshot = PhReferenceProcessInformationSnapshot()))
+        return;
+
+    // Build the index outside of the lock so that the ETW consumer thread
+    // is only blocked for the swap.
+
+    hashtable = PhCreateSimpleHashtable(EtpThreadIdToProcessIdHashtable ? EtpThreadIdToProcessIdHashtable->Count : 1024);
+    process = PH_FIRST_PROCESS(snapshot->Processes);
+
+    do
+    {
+        for (i = 0; i < process->NumberOfThreads; i++)
+            PhAddItemSimpleHashtable(hashtable, process->Threads[i].ClientId.UniqueThread, process->UniqueProcessId);
+    } while (process = PH_NEXT_PROCESS(process));
+
+    PhDereferenceObject(snapshot);
+
     PhAcquireQueuedLockExclusive(&EtpProcessInformationLock);
+    oldHashtable = EtpThreadIdToProcessIdHashtable;
+    EtpThreadIdToProcessIdHashtable = hashtable;
+    PhReleaseQueuedLockExclusive(&EtpProcessInformationLock);
 
-    if (EtpProcessInformation)
+    if (oldHashtable)
+        PhDereferenceObject(oldHashtable);
+}
+
+VOID EtpFlushProcessEventTotals(
+    VOID
+    )
+{
+    PPH_HASHTABLE totalsHashtable;
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PET_PROCESS_EVENT_TOTALS totals;
+
+    PhAcquireQueuedLockExclusive(&EtpProcessEventTotalsLock);
+    totalsHashtable = EtpProcessEventTotals;
+    EtpProcessEventTotals = EtpSpareProcessEventTotals;
+    PhReleaseQueuedLockExclusive(&EtpProcessEventTotalsLock);
+
+    PhBeginEnumHashtable(totalsHashtable, &enumContext);
+
+    while (totals = PhNextEnumHashtable(&enumContext))
     {
-        PhFree(EtpProcessInformation);
-        EtpProcessInformation = NULL;
+        PPH_PROCESS_ITEM processItem;
+        PET_PROCESS_BLOCK block;
+
+        // Note: events for processes that don't have a process item yet are lost.
+        if (processItem = PhReferenceProcessItem(totals->ProcessId))
+        {
+            block = EtGetProcessBlock(processItem);
+            block->DiskReadRaw += totals->DiskReadRaw;
+            block->DiskWriteRaw += totals->DiskWriteRaw;
+            block->NetworkReceiveRaw += totals->NetworkReceiveRaw;
+            block->NetworkSendRaw += totals->NetworkSendRaw;
+            block->DiskReadCount += totals->DiskReadCount;
+            block->DiskWriteCount += totals->DiskWriteCount;
+            block->NetworkReceiveCount += totals->NetworkReceiveCount;
+            block->NetworkSendCount += totals->NetworkSendCount;
+
+            // Only this thread uses the process histograms, so they are merged without a lock.
+            if (totals->DiskResponseTime.Count != 0)
+            {
+                if (!block->DiskResponseTimeHistogram)
+                {
+                    block->DiskResponseTimeHistogram = PhAllocate(sizeof(ET_LATENCY_HISTOGRAM));
+                    memset(block->DiskResponseTimeHistogram, 0, sizeof(ET_LATENCY_HISTOGRAM));
+                }
+
+                EtMergeLatencyHistogram(block->DiskResponseTimeHistogram, &totals->DiskResponseTime);
+                EtQueryLatencyHistogramPercentiles(
+                    block->DiskResponseTimeHistogram,
+                    &block->DiskResponseTimeP50,
+                    &block->DiskResponseTimeP95,
+                    &block->DiskResponseTimeP99
+                    );
+            }
+
+            PhDereferenceObject(processItem);
+        }
     }
 
-    PhEnumProcesses(&EtpProcessInformation);
+    // Only this thread uses the spare hashtable.
+    PhClearHashtable(totalsHashtable);
+    EtpSpareProcessEventTotals = totalsHashtable;
+}
 
-    PhReleaseQueuedLockExclusive(&EtpProcessInformationLock);
+static BOOLEAN EtpApplyConnectionEventTotals(
+    _In_ PET_CONNECTION_EVENT_TOTALS Totals
+    )
+{
+    PPH_NETWORK_ITEM networkItem;
+    PET_NETWORK_BLOCK block;
+
+    if (networkItem = PhReferenceNetworkItem(
+        Totals->ProtocolType,
+        &Totals->LocalEndpoint,
+        &Totals->RemoteEndpoint,
+        Totals->ProcessId
+        ))
+    {
+        block = EtGetNetworkBlock(networkItem);
+        block->ReceiveRaw += Totals->ReceiveRaw;
+        block->SendRaw += Totals->SendRaw;
+        block->ReceiveCount += Totals->ReceiveCount;
+        block->SendCount += Totals->SendCount;
+
+        PhDereferenceObject(networkItem);
+
+        return TRUE;
+    }
+
+    return FALSE;
 }
 
-HANDLE EtThreadIdToProcessId(
-    _In_ HANDLE ThreadId
+static VOID EtpDeferConnectionEventTotals(
+    _In_ PPH_HASHTABLE Hashtable,
+    _In_ PET_CONNECTION_EVENT_TOTALS Totals
     )
 {
-    PSYSTEM_PROCESS_INFORMATION process;
+    PET_CONNECTION_EVENT_TOTALS pendingTotals;
+    BOOLEAN added;
+
+    pendingTotals = PhAddEntryHashtableEx(Hashtable, Totals, &added);
+
+    if (!added)
+    {
+        pendingTotals->ReceiveRaw += Totals->ReceiveRaw;
+        pendingTotals->SendRaw += Totals->SendRaw;
+        pendingTotals->ReceiveCount += Totals->ReceiveCount;
+        pendingTotals->SendCount += Totals->SendCount;
+    }
+}
+
+VOID EtpFlushConnectionEventTotals(
+    VOID
+    )
+{
+    PPH_HASHTABLE pendingHashtable;
+    PPH_HASHTABLE totalsHashtable;
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PET_CONNECTION_EVENT_TOTALS totals;
     ULONG i;
-    HANDLE processId;
 
-    if (!EtpProcessInformation)
-        return NULL;
+    // Only this thread uses the pending hashtables. Totals that still have no network item are
+    // moved to the spare pending hashtable, and dropped once they are too old.
 
-    PhAcquireQueuedLockShared(&EtpProcessInformationLock);
+    pendingHashtable = EtpPendingConnectionTotals;
+    PhBeginEnumHashtable(pendingHashtable, &enumContext);
 
-    process = PH_FIRST_PROCESS(EtpProcessInformation);
+    while (totals = PhNextEnumHashtable(&enumContext))
+    {
+        if (!EtpApplyConnectionEventTotals(totals) && ++totals->Age < ET_CONNECTION_TOTALS_MAXIMUM_AGE)
+            EtpDeferConnectionEventTotals(EtpSparePendingConnectionTotals, totals);
+    }
 
-    do
+    PhClearHashtable(pendingHashtable);
+    EtpPendingConnectionTotals = EtpSparePendingConnectionTotals;
+    EtpSparePendingConnectionTotals = pendingHashtable;
+
+    for (i = 0; i < ET_CONNECTION_TOTALS_STRIPES; i++)
     {
-        for (i = 0; i < process->NumberOfThreads; i++)
-        {
-            if (process->Threads[i].ClientId.UniqueThread == ThreadId)
-            {
-                processId = process->UniqueProcessId;
-                PhReleaseQueuedLockShared(&EtpProcessInformationLock);
+        PET_CONNECTION_TOTALS_STRIPE stripe = &EtpConnectionTotalsStripes[i];
 
-                return processId;
-            }
+        PhAcquireQueuedLockExclusive(&stripe->Lock);
+        totalsHashtable = stripe->Hashtable;
+        stripe->Hashtable = stripe->SpareHashtable;
+        PhReleaseQueuedLockExclusive(&stripe->Lock);
+
+        PhBeginEnumHashtable(totalsHashtable, &enumContext);
+
+        while (totals = PhNextEnumHashtable(&enumContext))
+        {
+            if (!EtpApplyConnectionEventTotals(totals))
+                EtpDeferConnectionEventTotals(EtpPendingConnectionTotals, totals);
         }
-    } while (process = PH_NEXT_PROCESS(process));
 
+        // Only this thread uses the spare hashtable.
+        PhClearHashtable(totalsHashtable);
+        stripe->SpareHashtable = totalsHashtable;
+    }
+}
+
+HANDLE EtThreadIdToProcessId(
+    _In_ HANDLE ThreadId
+    )
+{
+    HANDLE processId;
+
+    if (!EtpThreadIdToProcessIdHashtable)
+        return NULL;
+
+    PhAcquireQueuedLockShared(&EtpProcessInformationLock);
+    processId = PhFindItemSimpleHashtable2(EtpThreadIdToProcessIdHashtable, ThreadId);
     PhReleaseQueuedLockShared(&EtpProcessInformationLock);
 
-    return NULL;
+    return processId;
 }
@@ -5,6 +5,7 @@
 #include <phdk.h>
 
 extern PPH_PLUGIN PluginInstance;
+extern BOOLEAN EtInitialized;
 extern LIST_ENTRY EtProcessBlockListHead;
 extern LIST_ENTRY EtNetworkBlockListHead;
 extern HWND ProcessTreeNewHandle;
@@ -14,9 +15,14 @@ extern HWND NetworkTreeNewHandle;
 #define SETTING_NAME_DISK_TREE_LIST_COLUMNS (PLUGIN_NAME L".DiskTreeListColumns")
 #define SETTING_NAME_DISK_TREE_LIST_SORT (PLUGIN_NAME L".DiskTreeListSort")
 #define SETTING_NAME_ENABLE_ETW_MONITOR (PLUGIN_NAME L".EnableEtwMonitor")
+#define SETTING_NAME_ETW_BUFFER_SIZE (PLUGIN_NAME L".EtwBufferSize")
+#define SETTING_NAME_ETW_FLUSH_TIMER (PLUGIN_NAME L".EtwFlushTimer")
+#define SETTING_NAME_ETW_MINIMUM_BUFFERS (PLUGIN_NAME L".EtwMinimumBuffers")
+#define SETTING_NAME_ETW_MAXIMUM_BUFFERS (PLUGIN_NAME L".EtwMaximumBuffers")
 #define SETTING_NAME_ENABLE_GPU_MONITOR (PLUGIN_NAME L".EnableGpuMonitor")
 #define SETTING_NAME_GPU_NODE_BITMAP (PLUGIN_NAME L".GpuNodeBitmap")
 #define SETTING_NAME_GPU_LAST_NODE_COUNT (PLUGIN_NAME L".GpuLastNodeCount")
+#define SETTING_NAME_ENABLE_GPU_ETW_MONITOR (PLUGIN_NAME L".EnableGpuEtwMonitor")
 
 // Process icon
 
@@ -26,6 +32,21 @@ typedef struct _ET_PROCESS_ICON
     HICON Icon;
 } ET_PROCESS_ICON, *PET_PROCESS_ICON;
 
+// Latency histogram
+
+// Latencies are counted in buckets whose width grows with the latency: each power of two is
+// split into ET_LATENCY_SUB_BUCKET_COUNT equal buckets, so a value is known to within 12.5%
+// no matter how large it is, and the histogram has a fixed size.
+#define ET_LATENCY_SUB_BUCKET_BITS 3
+#define ET_LATENCY_SUB_BUCKET_COUNT (1 << ET_LATENCY_SUB_BUCKET_BITS)
+#define ET_LATENCY_BUCKET_COUNT ((32 - ET_LATENCY_SUB_BUCKET_BITS + 1) * ET_LATENCY_SUB_BUCKET_COUNT)
+
+typedef struct _ET_LATENCY_HISTOGRAM
+{
+    ULONG Count;
+    ULONG Buckets[ET_LATENCY_BUCKET_COUNT]; // in microseconds
+} ET_LATENCY_HISTOGRAM, *PET_LATENCY_HISTOGRAM;
+
 // Disk item
 
 #define HISTORY_SIZE 60
@@ -48,6 +69,11 @@ typedef struct _ET_DISK_ITEM
     ULONG ResponseTimeCount;
     FLOAT ResponseTimeTotal; // in milliseconds
     FLOAT ResponseTimeAverage;
+    FLOAT ResponseTimeP50; // in milliseconds
+    FLOAT ResponseTimeP95;
+    FLOAT ResponseTimeP99;
+    ULONG ResponseTimeHistogramCount; // count when the percentiles were last calculated
+    ET_LATENCY_HISTOGRAM ResponseTimeHistogram;
 
     ULONG64 ReadTotal;
     ULONG64 WriteTotal;
@@ -71,7 +97,10 @@ typedef struct _ET_DISK_ITEM
 #define ETDSTNC_TOTALRATEAVERAGE 4
 #define ETDSTNC_IOPRIORITY 5
 #define ETDSTNC_RESPONSETIME 6
-#define ETDSTNC_MAXIMUM 7
+#define ETDSTNC_RESPONSETIMEP50 7
+#define ETDSTNC_RESPONSETIMEP95 8
+#define ETDSTNC_RESPONSETIMEP99 9
+#define ETDSTNC_MAXIMUM 10
 
 typedef struct _ET_DISK_NODE
 {
@@ -86,6 +115,9 @@ typedef struct _ET_DISK_NODE
     PPH_STRING WriteRateAverageText;
     PPH_STRING TotalRateAverageText;
     PPH_STRING ResponseTimeText;
+    PPH_STRING ResponseTimeP50Text;
+    PPH_STRING ResponseTimeP95Text;
+    PPH_STRING ResponseTimeP99Text;
 
     PPH_STRING TooltipText;
 } ET_DISK_NODE, *PET_DISK_NODE;
@@ -124,7 +156,10 @@ typedef struct _ET_DISK_NODE
 #define ETPRTNC_NETWORKRECEIVERATE 30
 #define ETPRTNC_NETWORKSENDRATE 31
 #define ETPRTNC_NETWORKTOTALRATE 32
-#define ETPRTNC_MAXIMUM 32
+#define ETPRTNC_DISKRESPONSETIMEP50 33
+#define ETPRTNC_DISKRESPONSETIMEP95 34
+#define ETPRTNC_DISKRESPONSETIMEP99 35
+#define ETPRTNC_MAXIMUM 35
 
 // Network list columns
 
@@ -142,7 +177,10 @@ typedef struct _ET_DISK_NODE
 #define ETNETNC_RECEIVERATE 12
 #define ETNETNC_SENDRATE 13
 #define ETNETNC_TOTALRATE 14
-#define ETNETNC_MAXIMUM 14
+#define ETNETNC_RECEIVERATEAVERAGE 15
+#define ETNETNC_SENDRATEAVERAGE 16
+#define ETNETNC_TOTALRATEAVERAGE 17
+#define ETNETNC_MAXIMUM 17
 
 // Firewall status
 
@@ -186,9 +224,17 @@ typedef struct _ET_PROCESS_BLOCK
     FLOAT GpuNodeUsage;
     ULONG64 GpuDedicatedUsage;
     ULONG64 GpuSharedUsage;
+    ULONG64 GpuLastQueryTime; // performance counter value at the last node query
+    ULONG64 GpuEventRunningTime; // total from DxgKrnl events, in 100ns units
+    BOOLEAN GpuHasAllocations;
 
     PH_UINT32_DELTA HardFaultsDelta;
 
+    PET_LATENCY_HISTOGRAM DiskResponseTimeHistogram; // created on the first disk event
+    FLOAT DiskResponseTimeP50; // in milliseconds
+    FLOAT DiskResponseTimeP95;
+    FLOAT DiskResponseTimeP99;
+
     PH_QUEUED_LOCK TextCacheLock;
     PPH_STRING TextCache[ETPRTNC_MAXIMUM + 1];
     BOOLEAN TextCacheValid[ETPRTNC_MAXIMUM + 1];
@@ -218,6 +264,15 @@ typedef struct _ET_NETWORK_BLOCK
         PH_UINT64_DELTA Deltas[4];
     };
 
+    ULONG64 ReceiveHistory[HISTORY_SIZE]; // bytes per update
+    ULONG64 SendHistory[HISTORY_SIZE];
+    ULONG HistoryCount;
+    ULONG HistoryPosition;
+    ULONG64 ReceiveHistorySum;
+    ULONG64 SendHistorySum;
+    ULONG64 ReceiveAverage;
+    ULONG64 SendAverage;
+
     ET_FIREWALL_STATUS FirewallStatus;
     BOOLEAN FirewallStatusValid;
 
@@ -244,6 +299,41 @@ VOID EtFormatRate(
     _Out_opt_ PPH_STRINGREF String
     );
 
+// latency
+
+ULONG EtHighResResponseTimeToMicroseconds(
+    _In_ ULONG64 ResponseTime
+    );
+
+VOID EtAddLatencyHistogramSample(
+    _Inout_ PET_LATENCY_HISTOGRAM Histogram,
+    _In_ ULONG Microseconds
+    );
+
+VOID EtMergeLatencyHistogram(
+    _Inout_ PET_LATENCY_HISTOGRAM Destination,
+    _In_ PET_LATENCY_HISTOGRAM Source
+    );
+
+VOID EtGetLatencyBucketRange(
+    _In_ ULONG Index,
+    _Out_ PULONG64 LowerBound,
+    _Out_ PULONG64 UpperBound
+    );
+
+VOID EtQueryLatencyHistogramPercentiles(
+    _In_ PET_LATENCY_HISTOGRAM Histogram,
+    _Out_ PFLOAT P50,
+    _Out_ PFLOAT P95,
+    _Out_ PFLOAT P99
+    );
+
+VOID EtShowLatencyHistogramDialog(
+    _In_ HWND ParentWindowHandle,
+    _In_ PPH_STRING Title,
+    _In_ PET_LATENCY_HISTOGRAM Histogram
+    );
+
 // etwmon
 
 extern BOOLEAN EtEtwEnabled;
@@ -303,6 +393,10 @@ PET_DISK_ITEM EtReferenceDiskItem(
     _In_ PPH_STRING FileName
     );
 
+PPH_STRING EtGetDiskItemFileNameWin32(
+    _In_ PET_DISK_ITEM DiskItem
+    );
+
 PPH_STRING EtFileObjectToFileName(
     _In_ PVOID FileObject
     );
@@ -413,6 +507,15 @@ ULONG EtGetGpuAdapterIndexFromNodeIndex(
     _In_ ULONG NodeIndex
     );
 
+ULONG EtGetGpuAdapterIndexFromLuid(
+    _In_ LUID AdapterLuid
+    );
+
+ULONG EtGetGpuNodeIndex(
+    _In_ ULONG AdapterIndex,
+    _In_ ULONG NodeOrdinal
+    );
+
 PPH_STRING EtGetGpuAdapterDescription(
     _In_ ULONG Index
     );
@@ -430,6 +533,18 @@ VOID EtQueryProcessGpuStatistics(
     _Out_ PET_PROCESS_GPU_STATISTICS Statistics
     );
 
+// gpuetw
+
+extern BOOLEAN EtGpuEtwEnabled;
+
+BOOLEAN EtGpuEtwInitialization(
+    VOID
+    );
+
+VOID EtGpuFlushEtwEventTotals(
+    VOID
+    );
+
 // gpuprprp
 
 VOID EtProcessGpuPropertiesInitializing(
@@ -491,6 +606,10 @@ VOID EtGpuMiniInformationInitializing(
 
 // iconext
 
+BOOLEAN EtAnyNotifyIconsEnabled(
+    VOID
+    );
+
 VOID EtRegisterNotifyIcons(
     VOID
     );
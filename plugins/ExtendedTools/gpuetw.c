@@ -0,0 +1,757 @@
+/*
+ * Process Hacker Extended Tools -
+ *   GPU event monitoring
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-process GPU usage is normally obtained by querying the running time of every process on
+ * every GPU node with D3DKMTQueryStatistics. On Windows 8 and above this module can instead
+ * consume the DMA packet events of the Microsoft-Windows-DxgKrnl provider in our ETW session.
+ * Each node runs the packets queued to it in order, so the time between the completion of one
+ * packet (or the submission of a packet to an idle node) and the completion of the next is the
+ * busy time of the process that submitted the next packet. Contexts map packets to processes and
+ * nodes; they are learned from context events, and from a rundown for contexts that existed
+ * before the provider was enabled.
+ *
+ * The event layouts are not documented, so the offsets of the fields we need are looked up by
+ * name with TDH the first time each event is seen. If a layout can't be used, event mode is
+ * turned off and gpumon goes back to polling.
+ *
+ * Busy time is accumulated per process and node on the ETW consumer thread and merged into the
+ * process blocks once per update, in the same way as the disk and network totals in etwstat.
+ * The time of a packet is only counted when it completes.
+ */
+
+#include "exttools.h"
+#include "etwmon.h"
+#include <tdh.h>
+
+#define ETP_GPU_EVENT_MAXIMUM_FIELDS 3
+#define ETP_GPU_ENGINE_MAXIMUM_PACKETS 32
+
+typedef enum _ETP_GPU_EVENT_TYPE
+{
+    EtpGpuEventIgnored,
+    EtpGpuEventAdapterStart,
+    EtpGpuEventDeviceStart,
+    EtpGpuEventDeviceStop,
+    EtpGpuEventContextStart,
+    EtpGpuEventContextStop,
+    EtpGpuEventDmaPacketStart,
+    EtpGpuEventDmaPacketInfo
+} ETP_GPU_EVENT_TYPE;
+
+typedef struct _ETP_GPU_EVENT_DEFINITION
+{
+    PWSTR TaskName;
+    PWSTR OpcodeName;
+    ETP_GPU_EVENT_TYPE Type;
+    ULONG RequiredFields; // bit mask of the fields that must be present
+    PWSTR FieldNames[ETP_GPU_EVENT_MAXIMUM_FIELDS];
+} ETP_GPU_EVENT_DEFINITION, *PETP_GPU_EVENT_DEFINITION;
+
+typedef struct _ETP_GPU_EVENT_LAYOUT
+{
+    ETP_GPU_EVENT_TYPE Type;
+    USHORT FieldOffsets[ETP_GPU_EVENT_MAXIMUM_FIELDS];
+    UCHAR FieldSizes[ETP_GPU_EVENT_MAXIMUM_FIELDS]; // 0 if the field is not present
+} ETP_GPU_EVENT_LAYOUT, *PETP_GPU_EVENT_LAYOUT;
+
+typedef struct _ETP_GPU_EVENT_ADAPTER
+{
+    ULONG AdapterIndex; // -1 if the adapter could not be matched
+    ULONG NumberOfEngines;
+    struct _ETP_GPU_ENGINE **Engines; // indexed by node ordinal
+} ETP_GPU_EVENT_ADAPTER, *PETP_GPU_EVENT_ADAPTER;
+
+typedef struct _ETP_GPU_DEVICE
+{
+    PVOID DxgAdapter;
+    HANDLE ProcessId; // NULL if the event doesn't have it
+} ETP_GPU_DEVICE, *PETP_GPU_DEVICE;
+
+typedef struct _ETP_GPU_PACKET
+{
+    ULONG Sequence;
+    HANDLE ProcessId;
+} ETP_GPU_PACKET, *PETP_GPU_PACKET;
+
+typedef struct _ETP_GPU_ENGINE
+{
+    PETP_GPU_EVENT_ADAPTER Adapter;
+    ULONG NodeOrdinal;
+    ULONG64 RunningSince; // when the packet at the head of the queue started running
+    ULONG PacketHead;
+    ULONG PacketCount;
+    ETP_GPU_PACKET Packets[ETP_GPU_ENGINE_MAXIMUM_PACKETS];
+} ETP_GPU_ENGINE, *PETP_GPU_ENGINE;
+
+typedef struct _ETP_GPU_CONTEXT
+{
+    HANDLE ProcessId;
+    PETP_GPU_ENGINE Engine;
+} ETP_GPU_CONTEXT, *PETP_GPU_CONTEXT;
+
+typedef struct _ETP_GPU_PROCESS_TOTALS
+{
+    HANDLE ProcessId;
+    // Busy time in performance counter ticks, per node. The last element is for engines that
+    // could not be matched to a node.
+    ULONG64 RunningTime[1];
+} ETP_GPU_PROCESS_TOTALS, *PETP_GPU_PROCESS_TOTALS;
+
+typedef ULONG (WINAPI *_TdhGetEventInformation)(
+    _In_ PEVENT_RECORD Event,
+    _In_ ULONG TdhContextCount,
+    _In_reads_opt_(TdhContextCount) PTDH_CONTEXT TdhContext,
+    _Out_writes_bytes_opt_(*BufferSize) PTRACE_EVENT_INFO Buffer,
+    _Inout_ PULONG BufferSize
+    );
+
+static ETP_GPU_EVENT_DEFINITION EtpGpuEventDefinitions[] =
+{
+    { L"Adapter", L"Start", EtpGpuEventAdapterStart, 0x1, { L"pDxgAdapter", L"AdapterLuid" } },
+    { L"Adapter", L"DCStart", EtpGpuEventAdapterStart, 0x1, { L"pDxgAdapter", L"AdapterLuid" } },
+    { L"Device", L"Start", EtpGpuEventDeviceStart, 0x3, { L"pDxgDevice", L"pDxgAdapter", L"hProcessId" } },
+    { L"Device", L"DCStart", EtpGpuEventDeviceStart, 0x3, { L"pDxgDevice", L"pDxgAdapter", L"hProcessId" } },
+    { L"Device", L"Stop", EtpGpuEventDeviceStop, 0x1, { L"pDxgDevice" } },
+    { L"Context", L"Start", EtpGpuEventContextStart, 0x5, { L"hContext", L"pDxgDevice", L"NodeOrdinal" } },
+    { L"Context", L"DCStart", EtpGpuEventContextStart, 0x5, { L"hContext", L"pDxgDevice", L"NodeOrdinal" } },
+    { L"Context", L"Stop", EtpGpuEventContextStop, 0x1, { L"hContext" } },
+    { L"DmaPacket", L"Start", EtpGpuEventDmaPacketStart, 0x3, { L"hContext", L"ulQueueSubmitSequence" } },
+    { L"DmaPacket", L"Info", EtpGpuEventDmaPacketInfo, 0x3, { L"hContext", L"ulQueueSubmitSequence" } }
+};
+
+BOOLEAN EtGpuEtwEnabled;
+static _TdhGetEventInformation TdhGetEventInformation_I;
+
+// These are only used by the ETW consumer thread.
+static PPH_HASHTABLE EtpGpuEventLayouts; // event ID and version -> PETP_GPU_EVENT_LAYOUT
+static PPH_HASHTABLE EtpGpuEventAdapters; // pDxgAdapter -> PETP_GPU_EVENT_ADAPTER
+static PPH_HASHTABLE EtpGpuEventDevices; // pDxgDevice -> PETP_GPU_DEVICE
+static PPH_HASHTABLE EtpGpuEventContexts; // hContext -> PETP_GPU_CONTEXT
+static PETP_GPU_PROCESS_TOTALS EtpGpuProcessTotalsTemplate;
+
+static SIZE_T EtpGpuProcessTotalsSize;
+static PPH_HASHTABLE EtpGpuProcessTotals;
+static PPH_HASHTABLE EtpSpareGpuProcessTotals;
+static PH_QUEUED_LOCK EtpGpuProcessTotalsLock = PH_QUEUED_LOCK_INIT;
+
+static BOOLEAN NTAPI EtpGpuProcessTotalsEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PETP_GPU_PROCESS_TOTALS)Entry1)->ProcessId == ((PETP_GPU_PROCESS_TOTALS)Entry2)->ProcessId;
+}
+
+static ULONG NTAPI EtpGpuProcessTotalsHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return HandleToUlong(((PETP_GPU_PROCESS_TOTALS)Entry)->ProcessId) / 4;
+}
+
+BOOLEAN EtGpuEtwInitialization(
+    VOID
+    )
+{
+    HMODULE tdhHandle;
+
+    if (!EtEtwEnabled || WindowsVersion < WINDOWS_8 || !PhGetIntegerSetting(SETTING_NAME_ENABLE_GPU_ETW_MONITOR))
+        return FALSE;
+
+    if (tdhHandle = LoadLibrary(L"tdh.dll"))
+        TdhGetEventInformation_I = PhGetProcedureAddress(tdhHandle, "TdhGetEventInformation", 0);
+
+    if (!TdhGetEventInformation_I)
+        return FALSE;
+
+    EtpGpuEventLayouts = PhCreateSimpleHashtable(16);
+    EtpGpuEventAdapters = PhCreateSimpleHashtable(4);
+    EtpGpuEventDevices = PhCreateSimpleHashtable(64);
+    EtpGpuEventContexts = PhCreateSimpleHashtable(64);
+
+    EtpGpuProcessTotalsSize = FIELD_OFFSET(ETP_GPU_PROCESS_TOTALS, RunningTime) + sizeof(ULONG64) * (EtGpuTotalNodeCount + 1);
+    EtpGpuProcessTotalsTemplate = PhAllocate(EtpGpuProcessTotalsSize);
+    memset(EtpGpuProcessTotalsTemplate, 0, EtpGpuProcessTotalsSize);
+    EtpGpuProcessTotals = PhCreateHashtable(
+        (ULONG)EtpGpuProcessTotalsSize,
+        EtpGpuProcessTotalsEqualFunction,
+        EtpGpuProcessTotalsHashFunction,
+        16
+        );
+    EtpSpareGpuProcessTotals = PhCreateHashtable(
+        (ULONG)EtpGpuProcessTotalsSize,
+        EtpGpuProcessTotalsEqualFunction,
+        EtpGpuProcessTotalsHashFunction,
+        16
+        );
+
+    // Everything above must exist before the first event is delivered.
+    EtGpuEtwEnabled = TRUE;
+
+    if (!EtEnableEtwGpuEvents())
+    {
+        EtGpuEtwEnabled = FALSE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static ULONG EtpGetGpuEventPropertySize(
+    _In_ PEVENT_PROPERTY_INFO Property,
+    _In_ ULONG PointerSize
+    )
+{
+    if (Property->Flags & (PropertyStruct | PropertyParamLength | PropertyParamCount))
+        return 0;
+    if (Property->count != 1)
+        return 0;
+
+    switch (Property->nonStructType.InType)
+    {
+    case TDH_INTYPE_INT8:
+    case TDH_INTYPE_UINT8:
+        return 1;
+    case TDH_INTYPE_INT16:
+    case TDH_INTYPE_UINT16:
+        return 2;
+    case TDH_INTYPE_INT32:
+    case TDH_INTYPE_UINT32:
+    case TDH_INTYPE_HEXINT32:
+    case TDH_INTYPE_BOOLEAN:
+    case TDH_INTYPE_FLOAT:
+        return 4;
+    case TDH_INTYPE_INT64:
+    case TDH_INTYPE_UINT64:
+    case TDH_INTYPE_HEXINT64:
+    case TDH_INTYPE_DOUBLE:
+    case TDH_INTYPE_FILETIME:
+        return 8;
+    case TDH_INTYPE_POINTER:
+    case TDH_INTYPE_SIZET:
+        return PointerSize;
+    case TDH_INTYPE_GUID:
+    case TDH_INTYPE_SYSTEMTIME:
+        return 16;
+    default:
+        return 0; // strings, binary data, etc.
+    }
+}
+
+static BOOLEAN EtpEqualGpuEventName(
+    _In_ PWSTR Name,
+    _In_ PWSTR DefinitionName
+    )
+{
+    static PH_STRINGREF whitespace = PH_STRINGREF_INIT(L" \t");
+
+    PH_STRINGREF name;
+    PH_STRINGREF definitionName;
+
+    // The names in the manifest may have trailing spaces.
+    PhInitializeStringRef(&name, Name);
+    PhInitializeStringRef(&definitionName, DefinitionName);
+    PhTrimStringRef(&name, &whitespace, PH_TRIM_END_ONLY);
+
+    return PhEqualStringRef(&name, &definitionName, TRUE);
+}
+
+static VOID EtpInitializeGpuEventLayout(
+    _In_ PEVENT_RECORD EventRecord,
+    _Out_ PETP_GPU_EVENT_LAYOUT Layout
+    )
+{
+    PTRACE_EVENT_INFO info;
+    ULONG bufferSize;
+    PWSTR taskName;
+    PWSTR opcodeName;
+    PETP_GPU_EVENT_DEFINITION definition;
+    ULONG pointerSize;
+    ULONG offset;
+    ULONG presentFields;
+    ULONG i;
+    ULONG j;
+
+    memset(Layout, 0, sizeof(ETP_GPU_EVENT_LAYOUT));
+    Layout->Type = EtpGpuEventIgnored;
+
+    bufferSize = 0;
+
+    if (TdhGetEventInformation_I(EventRecord, 0, NULL, NULL, &bufferSize) != ERROR_INSUFFICIENT_BUFFER)
+        return;
+
+    info = PhAllocate(bufferSize);
+
+    if (TdhGetEventInformation_I(EventRecord, 0, NULL, info, &bufferSize) != ERROR_SUCCESS)
+    {
+        PhFree(info);
+        return;
+    }
+
+    taskName = info->TaskNameOffset ? (PWSTR)PTR_ADD_OFFSET(info, info->TaskNameOffset) : L"";
+    opcodeName = info->OpcodeNameOffset ? (PWSTR)PTR_ADD_OFFSET(info, info->OpcodeNameOffset) : L"";
+    definition = NULL;
+
+    for (i = 0; i < sizeof(EtpGpuEventDefinitions) / sizeof(ETP_GPU_EVENT_DEFINITION); i++)
+    {
+        if (
+            EtpEqualGpuEventName(taskName, EtpGpuEventDefinitions[i].TaskName) &&
+            EtpEqualGpuEventName(opcodeName, EtpGpuEventDefinitions[i].OpcodeName)
+            )
+        {
+            definition = &EtpGpuEventDefinitions[i];
+            break;
+        }
+    }
+
+    if (!definition)
+    {
+        PhFree(info);
+        return;
+    }
+
+    pointerSize = (EventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) ? 4 : 8;
+    offset = 0;
+    presentFields = 0;
+
+    // Walk the properties until one without a fixed size. Anything after it can't be located
+    // without decoding each event.
+    for (i = 0; i < info->TopLevelPropertyCount; i++)
+    {
+        PEVENT_PROPERTY_INFO property = &info->EventPropertyInfoArray[i];
+        PWSTR propertyName = (PWSTR)PTR_ADD_OFFSET(info, property->NameOffset);
+        ULONG size;
+
+        if (!(size = EtpGetGpuEventPropertySize(property, pointerSize)))
+            break;
+
+        for (j = 0; j < ETP_GPU_EVENT_MAXIMUM_FIELDS; j++)
+        {
+            if (definition->FieldNames[j] && size <= sizeof(ULONG64) && PhEqualStringZ(propertyName, definition->FieldNames[j], TRUE))
+            {
+                Layout->FieldOffsets[j] = (USHORT)offset;
+                Layout->FieldSizes[j] = (UCHAR)size;
+                presentFields |= 1 << j;
+            }
+        }
+
+        offset += size;
+    }
+
+    PhFree(info);
+
+    if ((presentFields & definition->RequiredFields) == definition->RequiredFields)
+    {
+        Layout->Type = definition->Type;
+    }
+    else if (definition->Type >= EtpGpuEventContextStart)
+    {
+        // Without these events nothing can be attributed to processes.
+        dprintf("GPU: unsupported layout for DxgKrnl event %u, using polling\n", EventRecord->EventHeader.EventDescriptor.Id);
+        EtGpuEtwEnabled = FALSE;
+    }
+}
+
+static PETP_GPU_EVENT_LAYOUT EtpGetGpuEventLayout(
+    _In_ PEVENT_RECORD EventRecord
+    )
+{
+    PVOID key;
+    PETP_GPU_EVENT_LAYOUT layout;
+
+    key = (PVOID)(ULONG_PTR)(EventRecord->EventHeader.EventDescriptor.Id | ((ULONG)EventRecord->EventHeader.EventDescriptor.Version << 16));
+
+    if (layout = PhFindItemSimpleHashtable2(EtpGpuEventLayouts, key))
+        return layout;
+
+    layout = PhAllocate(sizeof(ETP_GPU_EVENT_LAYOUT));
+    EtpInitializeGpuEventLayout(EventRecord, layout);
+    PhAddItemSimpleHashtable(EtpGpuEventLayouts, key, layout);
+
+    return layout;
+}
+
+static ULONG64 EtpReadGpuEventField(
+    _In_ PEVENT_RECORD EventRecord,
+    _In_ PETP_GPU_EVENT_LAYOUT Layout,
+    _In_ ULONG Index
+    )
+{
+    ULONG64 value = 0;
+
+    if (Layout->FieldSizes[Index] != 0 && (ULONG)Layout->FieldOffsets[Index] + Layout->FieldSizes[Index] <= EventRecord->UserDataLength)
+        memcpy(&value, PTR_ADD_OFFSET(EventRecord->UserData, Layout->FieldOffsets[Index]), Layout->FieldSizes[Index]);
+
+    return value;
+}
+
+static PETP_GPU_EVENT_ADAPTER EtpGetGpuEventAdapter(
+    _In_opt_ PVOID DxgAdapter
+    )
+{
+    PETP_GPU_EVENT_ADAPTER adapter;
+
+    if (adapter = PhFindItemSimpleHashtable2(EtpGpuEventAdapters, DxgAdapter))
+        return adapter;
+
+    adapter = PhAllocate(sizeof(ETP_GPU_EVENT_ADAPTER));
+    memset(adapter, 0, sizeof(ETP_GPU_EVENT_ADAPTER));
+    adapter->AdapterIndex = -1;
+    PhAddItemSimpleHashtable(EtpGpuEventAdapters, DxgAdapter, adapter);
+
+    return adapter;
+}
+
+static PETP_GPU_ENGINE EtpGetGpuEngine(
+    _In_opt_ PVOID DxgAdapter,
+    _In_ ULONG NodeOrdinal
+    )
+{
+    PETP_GPU_EVENT_ADAPTER adapter;
+    PETP_GPU_ENGINE engine;
+
+    adapter = EtpGetGpuEventAdapter(DxgAdapter);
+
+    if (NodeOrdinal >= adapter->NumberOfEngines)
+    {
+        ULONG numberOfEngines;
+
+        numberOfEngines = NodeOrdinal + 1;
+
+        if (adapter->Engines)
+            adapter->Engines = PhReAllocate(adapter->Engines, sizeof(PETP_GPU_ENGINE) * numberOfEngines);
+        else
+            adapter->Engines = PhAllocate(sizeof(PETP_GPU_ENGINE) * numberOfEngines);
+
+        memset(&adapter->Engines[adapter->NumberOfEngines], 0, sizeof(PETP_GPU_ENGINE) * (numberOfEngines - adapter->NumberOfEngines));
+        adapter->NumberOfEngines = numberOfEngines;
+    }
+
+    if (!(engine = adapter->Engines[NodeOrdinal]))
+    {
+        engine = PhAllocate(sizeof(ETP_GPU_ENGINE));
+        memset(engine, 0, sizeof(ETP_GPU_ENGINE));
+        engine->Adapter = adapter;
+        engine->NodeOrdinal = NodeOrdinal;
+        adapter->Engines[NodeOrdinal] = engine;
+    }
+
+    return engine;
+}
+
+static ULONG EtpGetGpuEngineNodeIndex(
+    _In_ PETP_GPU_ENGINE Engine
+    )
+{
+    ULONG adapterIndex;
+    ULONG nodeIndex;
+
+    adapterIndex = Engine->Adapter->AdapterIndex;
+
+    // With a single adapter there is nothing to match.
+    if (adapterIndex == -1 && EtGetGpuAdapterCount() == 1)
+        adapterIndex = 0;
+
+    if (adapterIndex != -1 && (nodeIndex = EtGetGpuNodeIndex(adapterIndex, Engine->NodeOrdinal)) != -1)
+        return nodeIndex;
+
+    return EtGpuTotalNodeCount;
+}
+
+static VOID EtpAddGpuRunningTime(
+    _In_ HANDLE ProcessId,
+    _In_ ULONG NodeIndex,
+    _In_ ULONG64 RunningTime
+    )
+{
+    PETP_GPU_PROCESS_TOTALS totals;
+
+    PhAcquireQueuedLockExclusive(&EtpGpuProcessTotalsLock);
+
+    EtpGpuProcessTotalsTemplate->ProcessId = ProcessId;
+
+    if (!(totals = PhFindEntryHashtable(EtpGpuProcessTotals, EtpGpuProcessTotalsTemplate)))
+        totals = PhAddEntryHashtableEx(EtpGpuProcessTotals, EtpGpuProcessTotalsTemplate, NULL);
+
+    totals->RunningTime[NodeIndex] += RunningTime;
+
+    PhReleaseQueuedLockExclusive(&EtpGpuProcessTotalsLock);
+}
+
+static VOID EtpSetGpuDevice(
+    _In_ PVOID DxgDevice,
+    _In_opt_ PVOID DxgAdapter,
+    _In_opt_ HANDLE ProcessId
+    )
+{
+    PETP_GPU_DEVICE device;
+
+    if (!(device = PhFindItemSimpleHashtable2(EtpGpuEventDevices, DxgDevice)))
+    {
+        device = PhAllocate(sizeof(ETP_GPU_DEVICE));
+        PhAddItemSimpleHashtable(EtpGpuEventDevices, DxgDevice, device);
+    }
+
+    device->DxgAdapter = DxgAdapter;
+    device->ProcessId = ProcessId;
+}
+
+static VOID EtpRemoveGpuDevice(
+    _In_ PVOID DxgDevice
+    )
+{
+    PETP_GPU_DEVICE device;
+
+    if (device = PhFindItemSimpleHashtable2(EtpGpuEventDevices, DxgDevice))
+    {
+        PhRemoveItemSimpleHashtable(EtpGpuEventDevices, DxgDevice);
+        PhFree(device);
+    }
+}
+
+static VOID EtpSetGpuContext(
+    _In_ PVOID Context,
+    _In_ HANDLE ProcessId,
+    _In_ PETP_GPU_ENGINE Engine
+    )
+{
+    PETP_GPU_CONTEXT context;
+
+    // Contexts that already exist are reported again by the rundown.
+    if (!(context = PhFindItemSimpleHashtable2(EtpGpuEventContexts, Context)))
+    {
+        context = PhAllocate(sizeof(ETP_GPU_CONTEXT));
+        PhAddItemSimpleHashtable(EtpGpuEventContexts, Context, context);
+    }
+
+    context->ProcessId = ProcessId;
+    context->Engine = Engine;
+}
+
+static VOID EtpRemoveGpuContext(
+    _In_ PVOID Context
+    )
+{
+    PETP_GPU_CONTEXT context;
+
+    if (context = PhFindItemSimpleHashtable2(EtpGpuEventContexts, Context))
+    {
+        PhRemoveItemSimpleHashtable(EtpGpuEventContexts, Context);
+        PhFree(context);
+    }
+}
+
+static VOID EtpStartGpuPacket(
+    _In_ PETP_GPU_CONTEXT Context,
+    _In_ ULONG Sequence,
+    _In_ ULONG64 TimeStamp
+    )
+{
+    PETP_GPU_ENGINE engine = Context->Engine;
+    PETP_GPU_PACKET packet;
+
+    if (engine->PacketCount == ETP_GPU_ENGINE_MAXIMUM_PACKETS)
+    {
+        // Completions have been lost. Forget the oldest packet.
+        engine->PacketHead = (engine->PacketHead + 1) % ETP_GPU_ENGINE_MAXIMUM_PACKETS;
+        engine->PacketCount--;
+    }
+
+    // The node was idle, so the packet starts running now.
+    if (engine->PacketCount == 0)
+        engine->RunningSince = TimeStamp;
+
+    packet = &engine->Packets[(engine->PacketHead + engine->PacketCount) % ETP_GPU_ENGINE_MAXIMUM_PACKETS];
+    packet->Sequence = Sequence;
+    packet->ProcessId = Context->ProcessId;
+    engine->PacketCount++;
+}
+
+static VOID EtpCompleteGpuPacket(
+    _In_ PETP_GPU_CONTEXT Context,
+    _In_ ULONG Sequence,
+    _In_ ULONG64 TimeStamp
+    )
+{
+    PETP_GPU_ENGINE engine = Context->Engine;
+    PETP_GPU_PACKET packet;
+    ULONG i;
+
+    for (i = 0; i < engine->PacketCount; i++)
+    {
+        packet = &engine->Packets[(engine->PacketHead + i) % ETP_GPU_ENGINE_MAXIMUM_PACKETS];
+
+        if (packet->Sequence == Sequence)
+            break;
+    }
+
+    // Other kinds of packets (for example preemption requests) are never started.
+    if (i == engine->PacketCount)
+        return;
+
+    // Packets ahead of this one in the queue completed without an event; their time is counted
+    // as part of this packet.
+    if (TimeStamp > engine->RunningSince)
+        EtpAddGpuRunningTime(packet->ProcessId, EtpGetGpuEngineNodeIndex(engine), TimeStamp - engine->RunningSince);
+
+    engine->PacketHead = (engine->PacketHead + i + 1) % ETP_GPU_ENGINE_MAXIMUM_PACKETS;
+    engine->PacketCount -= i + 1;
+    engine->RunningSince = TimeStamp;
+}
+
+VOID EtGpuProcessEtwEvent(
+    _In_ PEVENT_RECORD EventRecord
+    )
+{
+    PETP_GPU_EVENT_LAYOUT layout;
+    PETP_GPU_CONTEXT context;
+
+    if (!EtGpuEtwEnabled)
+        return;
+
+    layout = EtpGetGpuEventLayout(EventRecord);
+
+    switch (layout->Type)
+    {
+    case EtpGpuEventAdapterStart:
+        {
+            PETP_GPU_EVENT_ADAPTER adapter;
+            ULONG64 luid;
+
+            adapter = EtpGetGpuEventAdapter((PVOID)EtpReadGpuEventField(EventRecord, layout, 0));
+
+            if (luid = EtpReadGpuEventField(EventRecord, layout, 1))
+            {
+                LUID adapterLuid;
+
+                adapterLuid.LowPart = (ULONG)luid;
+                adapterLuid.HighPart = (LONG)(luid >> 32);
+                adapter->AdapterIndex = EtGetGpuAdapterIndexFromLuid(adapterLuid);
+            }
+        }
+        break;
+    case EtpGpuEventDeviceStart:
+        EtpSetGpuDevice(
+            (PVOID)EtpReadGpuEventField(EventRecord, layout, 0),
+            (PVOID)EtpReadGpuEventField(EventRecord, layout, 1),
+            (HANDLE)EtpReadGpuEventField(EventRecord, layout, 2)
+            );
+        break;
+    case EtpGpuEventDeviceStop:
+        EtpRemoveGpuDevice((PVOID)EtpReadGpuEventField(EventRecord, layout, 0));
+        break;
+    case EtpGpuEventContextStart:
+        {
+            PETP_GPU_DEVICE device;
+            HANDLE processId;
+
+            device = PhFindItemSimpleHashtable2(EtpGpuEventDevices, (PVOID)EtpReadGpuEventField(EventRecord, layout, 1));
+
+            // Contexts are created in their process, but rundown events may be logged elsewhere.
+            // Prefer the process of the device if it is known.
+            if (device && device->ProcessId)
+                processId = device->ProcessId;
+            else
+                processId = UlongToHandle(EventRecord->EventHeader.ProcessId);
+
+            EtpSetGpuContext(
+                (PVOID)EtpReadGpuEventField(EventRecord, layout, 0),
+                processId,
+                EtpGetGpuEngine(device ? device->DxgAdapter : NULL, (ULONG)EtpReadGpuEventField(EventRecord, layout, 2))
+                );
+        }
+        break;
+    case EtpGpuEventContextStop:
+        EtpRemoveGpuContext((PVOID)EtpReadGpuEventField(EventRecord, layout, 0));
+        break;
+    case EtpGpuEventDmaPacketStart:
+        if (context = PhFindItemSimpleHashtable2(EtpGpuEventContexts, (PVOID)EtpReadGpuEventField(EventRecord, layout, 0)))
+        {
+            EtpStartGpuPacket(
+                context,
+                (ULONG)EtpReadGpuEventField(EventRecord, layout, 1),
+                EventRecord->EventHeader.TimeStamp.QuadPart
+                );
+        }
+        break;
+    case EtpGpuEventDmaPacketInfo:
+        if (context = PhFindItemSimpleHashtable2(EtpGpuEventContexts, (PVOID)EtpReadGpuEventField(EventRecord, layout, 0)))
+        {
+            EtpCompleteGpuPacket(
+                context,
+                (ULONG)EtpReadGpuEventField(EventRecord, layout, 1),
+                EventRecord->EventHeader.TimeStamp.QuadPart
+                );
+        }
+        break;
+    }
+}
+
+/**
+ * Adds the GPU busy time collected since the last update to the process blocks.
+ *
+ * \remarks This must be called on the provider thread, after the node bitmap and
+ * EtClockTotalRunningTimeFrequency have been updated.
+ */
+VOID EtGpuFlushEtwEventTotals(
+    VOID
+    )
+{
+    PPH_HASHTABLE totalsHashtable;
+    PH_HASHTABLE_ENUM_CONTEXT enumContext;
+    PETP_GPU_PROCESS_TOTALS totals;
+
+    PhAcquireQueuedLockExclusive(&EtpGpuProcessTotalsLock);
+    totalsHashtable = EtpGpuProcessTotals;
+    EtpGpuProcessTotals = EtpSpareGpuProcessTotals;
+    PhReleaseQueuedLockExclusive(&EtpGpuProcessTotalsLock);
+
+    PhBeginEnumHashtable(totalsHashtable, &enumContext);
+
+    while (EtClockTotalRunningTimeFrequency.QuadPart != 0 && (totals = PhNextEnumHashtable(&enumContext)))
+    {
+        PPH_PROCESS_ITEM processItem;
+        ULONG64 runningTime;
+        ULONG i;
+
+        // Note: time for processes that don't have a process item yet is lost.
+        if (processItem = PhReferenceProcessItem(totals->ProcessId))
+        {
+            // Engines that could not be matched to a node are always counted.
+            runningTime = totals->RunningTime[EtGpuTotalNodeCount];
+
+            for (i = 0; i < EtGpuTotalNodeCount; i++)
+            {
+                if (RtlCheckBit(&EtGpuNodeBitMap, i))
+                    runningTime += totals->RunningTime[i];
+            }
+
+            EtGetProcessBlock(processItem)->GpuEventRunningTime +=
+                runningTime * 10000000 / EtClockTotalRunningTimeFrequency.QuadPart;
+
+            PhDereferenceObject(processItem);
+        }
+    }
+
+    // Only this thread uses the spare hashtable.
+    PhClearHashtable(totalsHashtable);
+    EtpSpareGpuProcessTotals = totalsHashtable;
+}
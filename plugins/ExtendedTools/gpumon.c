@@ -36,6 +36,12 @@ static _SetupDiEnumDeviceInterfaces SetupDiEnumDeviceInterfaces_I;
 static _SetupDiGetDeviceInterfaceDetailW SetupDiGetDeviceInterfaceDetailW_I;
 static _SetupDiGetDeviceRegistryPropertyW SetupDiGetDeviceRegistryPropertyW_I;
 
+// Processes with GPU allocations have their running time queried on every update and their
+// memory usage every ETP_GPU_SEGMENT_QUERY_INTERVAL updates. Processes without allocations
+// are only checked every ETP_GPU_IDLE_QUERY_INTERVAL updates.
+#define ETP_GPU_SEGMENT_QUERY_INTERVAL 4
+#define ETP_GPU_IDLE_QUERY_INTERVAL 8
+
 BOOLEAN EtGpuEnabled;
 static PPH_LIST EtpGpuAdapterList;
 static PH_CALLBACK_REGISTRATION ProcessesUpdatedCallbackRegistration;
@@ -191,6 +197,9 @@ VOID EtGpuMonitorInitialization(
 
             PhSetIntegerSetting(SETTING_NAME_GPU_LAST_NODE_COUNT, EtGpuTotalNodeCount);
         }
+
+        // Use DxgKrnl events for per-process usage if possible.
+        EtGpuEtwInitialization();
     }
 }
 
@@ -469,6 +478,7 @@ static VOID EtpUpdateSegmentInformation(
     {
         Block->GpuDedicatedUsage = dedicatedUsage;
         Block->GpuSharedUsage = sharedUsage;
+        Block->GpuHasAllocations = dedicatedUsage != 0 || sharedUsage != 0;
     }
     else
     {
@@ -609,23 +619,72 @@ static VOID NTAPI ProcessesUpdatedCallback(
     // Update per-process statistics.
     // Note: no lock is needed because we only ever modify the list on this same thread.
 
+    if (EtGpuEtwEnabled)
+        EtGpuFlushEtwEventTotals();
+
     listEntry = EtProcessBlockListHead.Flink;
 
     while (listEntry != &EtProcessBlockListHead)
     {
         PET_PROCESS_BLOCK block;
+        BOOLEAN firstQuery;
+        ULONG slot;
 
         block = CONTAINING_RECORD(listEntry, ET_PROCESS_BLOCK, ListEntry);
 
-        EtpUpdateSegmentInformation(block);
-        EtpUpdateNodeInformation(block);
+        // Stagger processes by their ID so the queries are spread across updates.
+        firstQuery = block->GpuLastQueryTime == 0;
+        slot = runCount + HandleToUlong(block->ProcessItem->ProcessId) / 4;
 
-        if (elapsedTime != 0)
+        if (firstQuery || slot % (block->GpuHasAllocations ? ETP_GPU_SEGMENT_QUERY_INTERVAL : ETP_GPU_IDLE_QUERY_INTERVAL) == 0)
+            EtpUpdateSegmentInformation(block);
+
+        if (EtGpuEtwEnabled)
         {
-            block->GpuNodeUsage = (FLOAT)(block->GpuRunningTimeDelta.Delta / (elapsedTime * EtGpuNodeBitMapBitsSet));
+            // The running time is collected from events for every process, so the usage is
+            // always over the last update.
+            PhUpdateDelta(&block->GpuRunningTimeDelta, block->GpuEventRunningTime);
+
+            if (block->GpuRunningTimeDelta.Delta != 0)
+                block->GpuHasAllocations = TRUE;
+
+            if (elapsedTime != 0 && EtGpuNodeBitMapBitsSet != 0)
+            {
+                block->GpuNodeUsage = (FLOAT)(block->GpuRunningTimeDelta.Delta / (elapsedTime * EtGpuNodeBitMapBitsSet));
+
+                if (block->GpuNodeUsage > 1)
+                    block->GpuNodeUsage = 1;
+            }
 
-            if (block->GpuNodeUsage > 1)
-                block->GpuNodeUsage = 1;
+            // Polling starts from scratch if event monitoring stops.
+            block->GpuLastQueryTime = 0;
+        }
+        else if (firstQuery || block->GpuHasAllocations || slot % ETP_GPU_IDLE_QUERY_INTERVAL == 0)
+        {
+            DOUBLE blockElapsedTime;
+
+            EtpUpdateNodeInformation(block);
+
+            if (block->GpuRunningTimeDelta.Delta != 0)
+                block->GpuHasAllocations = TRUE;
+
+            // The usage is averaged over the time since this process was last queried, and
+            // is held until the next query.
+            if (!firstQuery)
+            {
+                blockElapsedTime = (DOUBLE)(EtClockTotalRunningTimeDelta.Value - block->GpuLastQueryTime) * 10000000 /
+                    EtClockTotalRunningTimeFrequency.QuadPart;
+
+                if (blockElapsedTime != 0 && EtGpuNodeBitMapBitsSet != 0)
+                {
+                    block->GpuNodeUsage = (FLOAT)(block->GpuRunningTimeDelta.Delta / (blockElapsedTime * EtGpuNodeBitMapBitsSet));
+
+                    if (block->GpuNodeUsage > 1)
+                        block->GpuNodeUsage = 1;
+                }
+            }
+
+            block->GpuLastQueryTime = EtClockTotalRunningTimeDelta.Value;
         }
 
         if (maxNodeValue < block->GpuNodeUsage)
@@ -691,6 +750,42 @@ ULONG EtGetGpuAdapterCount(
     return EtpGpuAdapterList->Count;
 }
 
+ULONG EtGetGpuAdapterIndexFromLuid(
+    _In_ LUID AdapterLuid
+    )
+{
+    ULONG i;
+    PETP_GPU_ADAPTER gpuAdapter;
+
+    for (i = 0; i < EtpGpuAdapterList->Count; i++)
+    {
+        gpuAdapter = EtpGpuAdapterList->Items[i];
+
+        if (RtlIsEqualLuid(&gpuAdapter->AdapterLuid, &AdapterLuid))
+            return i;
+    }
+
+    return -1;
+}
+
+ULONG EtGetGpuNodeIndex(
+    _In_ ULONG AdapterIndex,
+    _In_ ULONG NodeOrdinal
+    )
+{
+    PETP_GPU_ADAPTER gpuAdapter;
+
+    if (AdapterIndex >= EtpGpuAdapterList->Count)
+        return -1;
+
+    gpuAdapter = EtpGpuAdapterList->Items[AdapterIndex];
+
+    if (NodeOrdinal >= gpuAdapter->NodeCount)
+        return -1;
+
+    return gpuAdapter->FirstNodeIndex + NodeOrdinal;
+}
+
 ULONG EtGetGpuAdapterIndexFromNodeIndex(
     _In_ ULONG NodeIndex
     )
@@ -71,6 +71,22 @@ BOOLEAN EtpNetworkIconMessageCallback(
     _In_opt_ PVOID Context
     );
 
+BOOLEAN EtAnyNotifyIconsEnabled(
+    VOID
+    )
+{
+    static PH_STRINGREF compoundIdPrefix = PH_STRINGREF_INIT(L"+" PLUGIN_NAME L"+");
+    PPH_STRING iconList;
+    BOOLEAN result;
+
+    // Our icons are saved in IconMaskList as +PluginName+SubId.
+    iconList = PhGetStringSetting(L"IconMaskList");
+    result = PhFindStringInStringRef(&iconList->sr, &compoundIdPrefix, TRUE) != -1;
+    PhDereferenceObject(iconList);
+
+    return result;
+}
+
 VOID EtRegisterNotifyIcons(
     VOID
     )
@@ -86,7 +102,7 @@ VOID EtRegisterNotifyIcons(
         GPU_ICON_ID,
         NULL,
         L"GPU History",
-        PH_NF_ICON_SHOW_MINIINFO | (EtGpuEnabled ? 0 : PH_NF_ICON_UNAVAILABLE),
+        PH_NF_ICON_SHOW_MINIINFO | (EtGpuEnabled || !EtInitialized ? 0 : PH_NF_ICON_UNAVAILABLE),
         &data
         );
 
@@ -97,7 +113,7 @@ VOID EtRegisterNotifyIcons(
         DISK_ICON_ID,
         NULL,
         L"Disk History",
-        PH_NF_ICON_SHOW_MINIINFO | (EtEtwEnabled ? 0 : PH_NF_ICON_UNAVAILABLE),
+        PH_NF_ICON_SHOW_MINIINFO | (EtEtwEnabled || !EtInitialized ? 0 : PH_NF_ICON_UNAVAILABLE),
         &data
         );
 
@@ -108,7 +124,7 @@ VOID EtRegisterNotifyIcons(
         NETWORK_ICON_ID,
         NULL,
         L"Network History",
-        PH_NF_ICON_SHOW_MINIINFO | (EtEtwEnabled ? 0 : PH_NF_ICON_UNAVAILABLE),
+        PH_NF_ICON_SHOW_MINIINFO | (EtEtwEnabled || !EtInitialized ? 0 : PH_NF_ICON_UNAVAILABLE),
         &data
         );
 }
@@ -148,6 +164,9 @@ VOID EtpGpuIconUpdateCallback(
     PPH_PROCESS_ITEM maxGpuProcessItem;
     PH_FORMAT format[8];
 
+    // The icon may have been enabled after startup without anything else needing our data.
+    PhPluginEnsureInitialized(PluginInstance);
+
     // Icon
 
     Icon->Pointers->BeginBitmap(&drawInfo.Width, &drawInfo.Height, &bitmap, &bits, &hdc, &oldBitmap);
@@ -257,6 +276,9 @@ VOID EtpDiskIconUpdateCallback(
     PPH_PROCESS_ITEM maxDiskProcessItem;
     PH_FORMAT format[6];
 
+    // The icon may have been enabled after startup without anything else needing our data.
+    PhPluginEnsureInitialized(PluginInstance);
+
     // Icon
 
     Icon->Pointers->BeginBitmap(&drawInfo.Width, &drawInfo.Height, &bitmap, &bits, &hdc, &oldBitmap);
@@ -380,6 +402,9 @@ VOID EtpNetworkIconUpdateCallback(
     PPH_PROCESS_ITEM maxNetworkProcessItem;
     PH_FORMAT format[6];
 
+    // The icon may have been enabled after startup without anything else needing our data.
+    PhPluginEnsureInitialized(PluginInstance);
+
     // Icon
 
     Icon->Pointers->BeginBitmap(&drawInfo.Width, &drawInfo.Height, &bitmap, &bits, &hdc, &oldBitmap);
@@ -0,0 +1,455 @@
+/*
+ * Process Hacker Extended Tools -
+ *   latency histograms
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An average response time hides the slow requests that are usually the ones that matter, so
+ * disk latencies are also counted in histograms from which percentiles can be read. The bucket
+ * layout is the same as in HDR histograms: bucket widths double with each power of two, which
+ * keeps the relative error constant and the histogram small enough to have one for each disk
+ * item and process. Histograms have no locks; each one is only updated by a single thread, and
+ * readers on other threads take a copy, which at worst is off by the samples being added.
+ *
+ * Counts are halved once a histogram reaches ET_LATENCY_HISTOGRAM_DECAY_COUNT samples, so
+ * older samples gradually lose their weight and the counts cannot overflow.
+ */
+
+#include "exttools.h"
+#include "resource.h"
+
+#define ET_LATENCY_HISTOGRAM_DECAY_COUNT 65536
+#define ET_LATENCY_HISTOGRAM_BAR_LENGTH 40
+
+typedef struct _LATENCY_HISTOGRAM_CONTEXT
+{
+    PPH_STRING Title;
+    ET_LATENCY_HISTOGRAM Histogram;
+} LATENCY_HISTOGRAM_CONTEXT, *PLATENCY_HISTOGRAM_CONTEXT;
+
+INT_PTR CALLBACK EtpLatencyHistogramDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    );
+
+ULONG EtHighResResponseTimeToMicroseconds(
+    _In_ ULONG64 ResponseTime
+    )
+{
+    static PH_INITONCE initOnce = PH_INITONCE_INIT;
+    static LARGE_INTEGER frequency;
+    ULONG64 microseconds;
+
+    if (PhBeginInitOnce(&initOnce))
+    {
+        LARGE_INTEGER performanceCounter;
+
+        NtQueryPerformanceCounter(&performanceCounter, &frequency);
+        PhEndInitOnce(&initOnce);
+    }
+
+    if (frequency.QuadPart == 0)
+        return 0;
+
+    microseconds = ResponseTime * 1000000 / frequency.QuadPart;
+
+    if (microseconds > MAXULONG)
+        microseconds = MAXULONG;
+
+    return (ULONG)microseconds;
+}
+
+static ULONG EtpGetLatencyBucketIndex(
+    _In_ ULONG Microseconds
+    )
+{
+    ULONG exponent;
+
+    if (Microseconds < ET_LATENCY_SUB_BUCKET_COUNT)
+        return Microseconds;
+
+    _BitScanReverse(&exponent, Microseconds);
+
+    return (exponent - ET_LATENCY_SUB_BUCKET_BITS + 1) * ET_LATENCY_SUB_BUCKET_COUNT +
+        ((Microseconds >> (exponent - ET_LATENCY_SUB_BUCKET_BITS)) & (ET_LATENCY_SUB_BUCKET_COUNT - 1));
+}
+
+static VOID EtpDecayLatencyHistogram(
+    _Inout_ PET_LATENCY_HISTOGRAM Histogram
+    )
+{
+    ULONG count;
+    ULONG i;
+
+    count = 0;
+
+    for (i = 0; i < ET_LATENCY_BUCKET_COUNT; i++)
+    {
+        Histogram->Buckets[i] /= 2;
+        count += Histogram->Buckets[i];
+    }
+
+    Histogram->Count = count;
+}
+
+VOID EtAddLatencyHistogramSample(
+    _Inout_ PET_LATENCY_HISTOGRAM Histogram,
+    _In_ ULONG Microseconds
+    )
+{
+    Histogram->Buckets[EtpGetLatencyBucketIndex(Microseconds)]++;
+
+    if (++Histogram->Count >= ET_LATENCY_HISTOGRAM_DECAY_COUNT)
+        EtpDecayLatencyHistogram(Histogram);
+}
+
+VOID EtMergeLatencyHistogram(
+    _Inout_ PET_LATENCY_HISTOGRAM Destination,
+    _In_ PET_LATENCY_HISTOGRAM Source
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < ET_LATENCY_BUCKET_COUNT; i++)
+        Destination->Buckets[i] += Source->Buckets[i];
+
+    Destination->Count += Source->Count;
+
+    while (Destination->Count >= ET_LATENCY_HISTOGRAM_DECAY_COUNT)
+        EtpDecayLatencyHistogram(Destination);
+}
+
+/**
+ * Gets the range of latencies counted by a histogram bucket.
+ *
+ * \param Index The index of the bucket.
+ * \param LowerBound A variable which receives the smallest latency in the bucket, in
+ * microseconds.
+ * \param UpperBound A variable which receives the latency just past the end of the bucket, in
+ * microseconds.
+ */
+VOID EtGetLatencyBucketRange(
+    _In_ ULONG Index,
+    _Out_ PULONG64 LowerBound,
+    _Out_ PULONG64 UpperBound
+    )
+{
+    ULONG shift;
+
+    if (Index < ET_LATENCY_SUB_BUCKET_COUNT)
+    {
+        *LowerBound = Index;
+        *UpperBound = Index + 1;
+        return;
+    }
+
+    shift = Index / ET_LATENCY_SUB_BUCKET_COUNT - 1;
+    *LowerBound = (ULONG64)(ET_LATENCY_SUB_BUCKET_COUNT + Index % ET_LATENCY_SUB_BUCKET_COUNT) << shift;
+    *UpperBound = *LowerBound + (1ULL << shift);
+}
+
+/**
+ * Gets the 50th, 95th and 99th percentiles of a latency histogram.
+ *
+ * \param Histogram The histogram.
+ * \param P50 A variable which receives the median, in milliseconds.
+ * \param P95 A variable which receives the 95th percentile, in milliseconds.
+ * \param P99 A variable which receives the 99th percentile, in milliseconds.
+ *
+ * \remarks Each percentile is the largest latency counted by the bucket that contains it, so
+ * it may be up to 12.5% more than the real value. All values are 0 if the histogram is empty.
+ */
+VOID EtQueryLatencyHistogramPercentiles(
+    _In_ PET_LATENCY_HISTOGRAM Histogram,
+    _Out_ PFLOAT P50,
+    _Out_ PFLOAT P95,
+    _Out_ PFLOAT P99
+    )
+{
+    static ULONG percentiles[] = { 50, 95, 99 };
+    PFLOAT values[] = { P50, P95, P99 };
+    ULONG64 total;
+    ULONG64 count;
+    ULONG64 lowerBound;
+    ULONG64 upperBound;
+    ULONG i;
+    ULONG j;
+
+    total = 0;
+
+    for (i = 0; i < ET_LATENCY_BUCKET_COUNT; i++)
+        total += Histogram->Buckets[i];
+
+    count = 0;
+    j = 0;
+
+    for (i = 0; i < ET_LATENCY_BUCKET_COUNT && j < RTL_NUMBER_OF(percentiles); i++)
+    {
+        count += Histogram->Buckets[i];
+
+        if (Histogram->Buckets[i] == 0)
+            continue;
+
+        EtGetLatencyBucketRange(i, &lowerBound, &upperBound);
+
+        while (j < RTL_NUMBER_OF(percentiles) && count * 100 >= total * percentiles[j])
+        {
+            *values[j] = (FLOAT)(upperBound - 1) / 1000;
+            j++;
+        }
+    }
+
+    for (; j < RTL_NUMBER_OF(percentiles); j++)
+        *values[j] = 0;
+}
+
+static PPH_STRING EtpFormatLatency(
+    _In_ ULONG64 Microseconds
+    )
+{
+    PH_FORMAT format[2];
+
+    if (Microseconds < 1000)
+    {
+        PhInitFormatI64U(&format[0], Microseconds);
+        PhInitFormatS(&format[1], L" \xb5s");
+    }
+    else
+    {
+        PhInitFormatF(&format[0], (FLOAT)Microseconds / 1000, 3);
+        PhInitFormatS(&format[1], L" ms");
+    }
+
+    return PhFormat(format, 2, 0);
+}
+
+/**
+ * Shows a histogram of latencies.
+ *
+ * \param ParentWindowHandle The parent window.
+ * \param Title The text to show above the histogram.
+ * \param Histogram The histogram. A copy is taken, so the histogram can be updated while the
+ * dialog is open.
+ */
+VOID EtShowLatencyHistogramDialog(
+    _In_ HWND ParentWindowHandle,
+    _In_ PPH_STRING Title,
+    _In_ PET_LATENCY_HISTOGRAM Histogram
+    )
+{
+    PLATENCY_HISTOGRAM_CONTEXT context;
+
+    context = PhAllocate(sizeof(LATENCY_HISTOGRAM_CONTEXT));
+    context->Title = Title;
+    memcpy(&context->Histogram, Histogram, sizeof(ET_LATENCY_HISTOGRAM));
+
+    DialogBoxParam(
+        PluginInstance->DllBase,
+        MAKEINTRESOURCE(IDD_LATENCYHISTOGRAM),
+        ParentWindowHandle,
+        EtpLatencyHistogramDlgProc,
+        (LPARAM)context
+        );
+
+    PhFree(context);
+}
+
+static VOID EtpRefreshLatencyHistogram(
+    _In_ HWND hwndDlg,
+    _In_ PLATENCY_HISTOGRAM_CONTEXT Context
+    )
+{
+    HWND lvHandle;
+    PET_LATENCY_HISTOGRAM histogram;
+    ULONG64 total;
+    ULONG64 count;
+    ULONG maximum;
+    ULONG first;
+    ULONG last;
+    ULONG i;
+    FLOAT p50;
+    FLOAT p95;
+    FLOAT p99;
+    PH_FORMAT format[7];
+    PPH_STRING string;
+
+    lvHandle = GetDlgItem(hwndDlg, IDC_LIST);
+    histogram = &Context->Histogram;
+    total = 0;
+    maximum = 0;
+    first = MAXULONG;
+    last = 0;
+
+    for (i = 0; i < ET_LATENCY_BUCKET_COUNT; i++)
+    {
+        if (histogram->Buckets[i] == 0)
+            continue;
+
+        total += histogram->Buckets[i];
+
+        if (maximum < histogram->Buckets[i])
+            maximum = histogram->Buckets[i];
+        if (first == MAXULONG)
+            first = i;
+
+        last = i;
+    }
+
+    EtQueryLatencyHistogramPercentiles(histogram, &p50, &p95, &p99);
+    PhInitFormatS(&format[0], L"50th percentile: ");
+    PhInitFormatF(&format[1], p50, 3);
+    PhInitFormatS(&format[2], L" ms, 95th percentile: ");
+    PhInitFormatF(&format[3], p95, 3);
+    PhInitFormatS(&format[4], L" ms, 99th percentile: ");
+    PhInitFormatF(&format[5], p99, 3);
+    PhInitFormatS(&format[6], L" ms");
+    string = PhFormat(format, 7, 0);
+    SetDlgItemText(hwndDlg, IDC_SUMMARY, string->Buffer);
+    PhDereferenceObject(string);
+
+    if (total == 0)
+        return;
+
+    ExtendedListView_SetRedraw(lvHandle, FALSE);
+
+    count = 0;
+
+    for (i = first; i <= last; i++)
+    {
+        ULONG64 lowerBound;
+        ULONG64 upperBound;
+        INT lvItemIndex;
+        WCHAR bar[ET_LATENCY_HISTOGRAM_BAR_LENGTH + 1];
+        ULONG barLength;
+        ULONG j;
+
+        EtGetLatencyBucketRange(i, &lowerBound, &upperBound);
+        count += histogram->Buckets[i];
+
+        // From
+        string = EtpFormatLatency(lowerBound);
+        lvItemIndex = PhAddListViewItem(lvHandle, MAXINT, string->Buffer, NULL);
+        PhDereferenceObject(string);
+
+        // To
+        string = EtpFormatLatency(upperBound);
+        PhSetListViewSubItem(lvHandle, lvItemIndex, 1, string->Buffer);
+        PhDereferenceObject(string);
+
+        // Count
+        string = PhFormatUInt64(histogram->Buckets[i], TRUE);
+        PhSetListViewSubItem(lvHandle, lvItemIndex, 2, string->Buffer);
+        PhDereferenceObject(string);
+
+        // Percent
+        PhInitFormatF(&format[0], (FLOAT)histogram->Buckets[i] * 100 / total, 2);
+        PhInitFormatC(&format[1], L'%');
+        string = PhFormat(format, 2, 0);
+        PhSetListViewSubItem(lvHandle, lvItemIndex, 3, string->Buffer);
+        PhDereferenceObject(string);
+
+        // Cumulative
+        PhInitFormatF(&format[0], (FLOAT)count * 100 / total, 2);
+        PhInitFormatC(&format[1], L'%');
+        string = PhFormat(format, 2, 0);
+        PhSetListViewSubItem(lvHandle, lvItemIndex, 4, string->Buffer);
+        PhDereferenceObject(string);
+
+        // Distribution
+
+        barLength = (ULONG)((ULONG64)histogram->Buckets[i] * ET_LATENCY_HISTOGRAM_BAR_LENGTH / maximum);
+
+        if (barLength == 0 && histogram->Buckets[i] != 0)
+            barLength = 1;
+
+        for (j = 0; j < barLength; j++)
+            bar[j] = L'\x2588';
+
+        bar[barLength] = 0;
+        PhSetListViewSubItem(lvHandle, lvItemIndex, 5, bar);
+    }
+
+    ExtendedListView_SetRedraw(lvHandle, TRUE);
+}
+
+INT_PTR CALLBACK EtpLatencyHistogramDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    PLATENCY_HISTOGRAM_CONTEXT context;
+
+    if (uMsg == WM_INITDIALOG)
+    {
+        context = (PLATENCY_HISTOGRAM_CONTEXT)lParam;
+        SetProp(hwndDlg, L"Context", (HANDLE)context);
+    }
+    else
+    {
+        context = (PLATENCY_HISTOGRAM_CONTEXT)GetProp(hwndDlg, L"Context");
+
+        if (uMsg == WM_DESTROY)
+            RemoveProp(hwndDlg, L"Context");
+    }
+
+    if (!context)
+        return FALSE;
+
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            HWND lvHandle;
+
+            PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+
+            SetDlgItemText(hwndDlg, IDC_TITLE, context->Title->Buffer);
+
+            lvHandle = GetDlgItem(hwndDlg, IDC_LIST);
+            PhSetListViewStyle(lvHandle, FALSE, TRUE);
+            PhSetControlTheme(lvHandle, L"explorer");
+            PhAddListViewColumn(lvHandle, 0, 0, 0, LVCFMT_RIGHT, 80, L"From");
+            PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_LEFT, 70, L"To");
+            PhAddListViewColumn(lvHandle, 2, 2, 2, LVCFMT_RIGHT, 60, L"Count");
+            PhAddListViewColumn(lvHandle, 3, 3, 3, LVCFMT_RIGHT, 55, L"Percent");
+            PhAddListViewColumn(lvHandle, 4, 4, 4, LVCFMT_RIGHT, 70, L"Cumulative");
+            PhAddListViewColumn(lvHandle, 5, 5, 5, LVCFMT_LEFT, 200, L"Distribution");
+            PhSetExtendedListView(lvHandle);
+
+            EtpRefreshLatencyHistogram(hwndDlg, context);
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (LOWORD(wParam))
+            {
+            case IDCANCEL:
+            case IDOK:
+                EndDialog(hwndDlg, IDOK);
+                break;
+            }
+        }
+        break;
+    }
+
+    return FALSE;
+}
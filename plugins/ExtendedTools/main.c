@@ -28,6 +28,11 @@ VOID NTAPI LoadCallback(
     _In_opt_ PVOID Context
     );
 
+VOID NTAPI InitializeCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
 VOID NTAPI UnloadCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -133,11 +138,13 @@ VOID NTAPI NetworkItemDeleteCallback(
     );
 
 PPH_PLUGIN PluginInstance;
+BOOLEAN EtInitialized;
 LIST_ENTRY EtProcessBlockListHead;
 LIST_ENTRY EtNetworkBlockListHead;
 HWND ProcessTreeNewHandle;
 HWND NetworkTreeNewHandle;
 PH_CALLBACK_REGISTRATION PluginLoadCallbackRegistration;
+PH_CALLBACK_REGISTRATION PluginInitializeCallbackRegistration;
 PH_CALLBACK_REGISTRATION PluginUnloadCallbackRegistration;
 PH_CALLBACK_REGISTRATION PluginShowOptionsCallbackRegistration;
 PH_CALLBACK_REGISTRATION PluginMenuItemCallbackRegistration;
@@ -179,6 +186,7 @@ LOGICAL DllMain(
             info->Description = L"Extended functionality for Windows Vista and above, including ETW monitoring, GPU monitoring and a Disk tab.";
             info->Url = L"http://processhacker.sf.net/forums/viewtopic.php?t=1114";
             info->HasOptions = TRUE;
+            info->LazyInitialization = TRUE;
 
             PhRegisterCallback(
                 PhGetPluginCallback(PluginInstance, PluginCallbackLoad),
@@ -186,6 +194,12 @@ LOGICAL DllMain(
                 NULL,
                 &PluginLoadCallbackRegistration
                 );
+            PhRegisterCallback(
+                PhGetPluginCallback(PluginInstance, PluginCallbackInitialize),
+                InitializeCallback,
+                NULL,
+                &PluginInitializeCallbackRegistration
+                );
             PhRegisterCallback(
                 PhGetPluginCallback(PluginInstance, PluginCallbackUnload),
                 UnloadCallback,
@@ -309,9 +323,14 @@ LOGICAL DllMain(
                     { StringSettingType, SETTING_NAME_DISK_TREE_LIST_COLUMNS, L"" },
                     { IntegerPairSettingType, SETTING_NAME_DISK_TREE_LIST_SORT, L"4,2" }, // 4, DescendingSortOrder
                     { IntegerSettingType, SETTING_NAME_ENABLE_ETW_MONITOR, L"1" },
+                    { IntegerSettingType, SETTING_NAME_ETW_BUFFER_SIZE, L"0" },
+                    { IntegerSettingType, SETTING_NAME_ETW_FLUSH_TIMER, L"1" },
+                    { IntegerSettingType, SETTING_NAME_ETW_MINIMUM_BUFFERS, L"1" },
+                    { IntegerSettingType, SETTING_NAME_ETW_MAXIMUM_BUFFERS, L"0" },
                     { IntegerSettingType, SETTING_NAME_ENABLE_GPU_MONITOR, L"1" },
                     { StringSettingType, SETTING_NAME_GPU_NODE_BITMAP, L"01000000" },
-                    { IntegerSettingType, SETTING_NAME_GPU_LAST_NODE_COUNT, L"0" }
+                    { IntegerSettingType, SETTING_NAME_GPU_LAST_NODE_COUNT, L"0" },
+                    { IntegerSettingType, SETTING_NAME_ENABLE_GPU_ETW_MONITOR, L"1" }
                 };
 
                 PhAddSettings(settings, sizeof(settings) / sizeof(PH_SETTING_CREATE));
@@ -328,12 +347,25 @@ VOID NTAPI LoadCallback(
     _In_opt_ PVOID Context
     )
 {
-    EtEtwStatisticsInitialization();
-    EtGpuMonitorInitialization();
+    // Starting the ETW session and enumerating GPU adapters is deferred until the disk tab, one
+    // of our columns, graphs or property pages is first used. Tray icons are shown as soon as
+    // the main window is created, so they need the data straight away.
+    if (EtAnyNotifyIconsEnabled())
+        PhPluginEnsureInitialized(PluginInstance);
 
     EtRegisterNotifyIcons();
 }
 
+VOID NTAPI InitializeCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    EtEtwStatisticsInitialization();
+    EtGpuMonitorInitialization();
+    EtInitialized = TRUE;
+}
+
 VOID NTAPI UnloadCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -413,6 +445,7 @@ VOID NTAPI ProcessPropertiesInitializingCallback(
     _In_opt_ PVOID Context
     )
 {
+    PhPluginEnsureInitialized(PluginInstance);
     EtProcessGpuPropertiesInitializing(Parameter);
     EtProcessEtwPropertiesInitializing(Parameter);
 }
@@ -550,6 +583,8 @@ VOID NTAPI SystemInformationInitializingCallback(
     _In_opt_ PVOID Context
     )
 {
+    PhPluginEnsureInitialized(PluginInstance);
+
     if (EtGpuEnabled)
         EtGpuSystemInformationInitializing(Parameter);
     if (EtEtwEnabled)
@@ -561,6 +596,8 @@ VOID NTAPI MiniInformationInitializingCallback(
     _In_opt_ PVOID Context
     )
 {
+    PhPluginEnsureInitialized(PluginInstance);
+
     if (EtGpuEnabled)
         EtGpuMiniInformationInitializing(Parameter);
     if (EtEtwEnabled)
@@ -656,6 +693,9 @@ VOID EtDeleteProcessBlock(
 
     EtProcIconNotifyProcessDelete(Block);
 
+    if (Block->DiskResponseTimeHistogram)
+        PhFree(Block->DiskResponseTimeHistogram);
+
     for (i = 1; i <= ETPRTNC_MAXIMUM; i++)
     {
         PhClearReference(&Block->TextCache[i]);
@@ -30,6 +30,7 @@
 #define IDD_DISKTABRESTART              127
 #define IDD_DISKTABERROR                128
 #define IDD_PROCDISKNET_PANEL           129
+#define IDD_LATENCYHISTOGRAM            130
 #define IDC_LIST                        1001
 #define IDC_REFRESH                     1002
 #define IDC_SEQUENCENUMBER              1003
@@ -95,6 +96,7 @@
 #define IDC_ERROR                       1087
 #define IDC_GROUPDISK                   1088
 #define IDC_GROUPNETWORK                1089
+#define IDC_SUMMARY                     1090
 #define ID_EMPTY_EMPTYWORKINGSETS       40001
 #define ID_EMPTY_EMPTYMODIFIEDPAGELIST  40002
 #define ID_EMPTY_EMPTYSTANDBYLIST       40003
@@ -103,14 +105,15 @@
 #define ID_DISK_COPY                    40006
 #define ID_DISK_PROPERTIES              40007
 #define ID_DISK_OPENFILELOCATION        40008
+#define ID_DISK_LATENCYHISTOGRAM        40009
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        130
-#define _APS_NEXT_COMMAND_VALUE         40009
-#define _APS_NEXT_CONTROL_VALUE         1090
-#define _APS_NEXT_SYMED_VALUE           130
+#define _APS_NEXT_RESOURCE_VALUE        131
+#define _APS_NEXT_COMMAND_VALUE         40010
+#define _APS_NEXT_CONTROL_VALUE         1091
+#define _APS_NEXT_SYMED_VALUE           131
 #endif
 #endif
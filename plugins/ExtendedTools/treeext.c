@@ -122,7 +122,10 @@ VOID EtProcessTreeNewInitializing(
         { ETPRTNC_DISKTOTALRATE, L"Disk Total Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
         { ETPRTNC_NETWORKRECEIVERATE, L"Network Receive Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
         { ETPRTNC_NETWORKSENDRATE, L"Network Send Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
-        { ETPRTNC_NETWORKTOTALRATE, L"Network Total Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE }
+        { ETPRTNC_NETWORKTOTALRATE, L"Network Total Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETPRTNC_DISKRESPONSETIMEP50, L"Disk Response Time 50th (ms)", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETPRTNC_DISKRESPONSETIMEP95, L"Disk Response Time 95th (ms)", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETPRTNC_DISKRESPONSETIMEP99, L"Disk Response Time 99th (ms)", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE }
     };
 
     PPH_PLUGIN_TREENEW_INFORMATION treeNewInfo = Parameter;
@@ -327,6 +330,25 @@ VOID EtProcessTreeNewMessage(
                 if (block->NetworkReceiveRawDelta.Delta + block->NetworkSendRawDelta.Delta != 0)
                     EtFormatRate(block->NetworkReceiveRawDelta.Delta + block->NetworkSendRawDelta.Delta, &text, NULL);
                 break;
+            case ETPRTNC_DISKRESPONSETIMEP50:
+            case ETPRTNC_DISKRESPONSETIMEP95:
+            case ETPRTNC_DISKRESPONSETIMEP99:
+                if (block->DiskResponseTimeHistogram)
+                {
+                    FLOAT responseTime;
+                    PH_FORMAT format;
+
+                    if (message->SubId == ETPRTNC_DISKRESPONSETIMEP50)
+                        responseTime = block->DiskResponseTimeP50;
+                    else if (message->SubId == ETPRTNC_DISKRESPONSETIMEP95)
+                        responseTime = block->DiskResponseTimeP95;
+                    else
+                        responseTime = block->DiskResponseTimeP99;
+
+                    PhInitFormatF(&format, responseTime, 3);
+                    text = PhFormat(&format, 1, 0);
+                }
+                break;
             }
 
             if (text)
@@ -470,6 +492,15 @@ LONG EtpProcessTreeNewSortFunction(
     case ETPRTNC_NETWORKTOTALRATE:
         result = uint64cmp(block1->NetworkReceiveRawDelta.Delta + block1->NetworkSendRawDelta.Delta, block2->NetworkReceiveRawDelta.Delta + block2->NetworkSendRawDelta.Delta);
         break;
+    case ETPRTNC_DISKRESPONSETIMEP50:
+        result = singlecmp(block1->DiskResponseTimeP50, block2->DiskResponseTimeP50);
+        break;
+    case ETPRTNC_DISKRESPONSETIMEP95:
+        result = singlecmp(block1->DiskResponseTimeP95, block2->DiskResponseTimeP95);
+        break;
+    case ETPRTNC_DISKRESPONSETIMEP99:
+        result = singlecmp(block1->DiskResponseTimeP99, block2->DiskResponseTimeP99);
+        break;
     }
 
     return result;
@@ -494,7 +525,10 @@ VOID EtNetworkTreeNewInitializing(
         { ETNETNC_FIREWALLSTATUS, L"Firewall Status", 170, PH_ALIGN_LEFT, 0, FALSE },
         { ETNETNC_RECEIVERATE, L"Receive Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
         { ETNETNC_SENDRATE, L"Send Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
-        { ETNETNC_TOTALRATE, L"Total Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE }
+        { ETNETNC_TOTALRATE, L"Total Rate", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETNETNC_RECEIVERATEAVERAGE, L"Receive Rate Average", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETNETNC_SENDRATEAVERAGE, L"Send Rate Average", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE },
+        { ETNETNC_TOTALRATEAVERAGE, L"Total Rate Average", 70, PH_ALIGN_RIGHT, DT_RIGHT, TRUE }
     };
 
     PPH_PLUGIN_TREENEW_INFORMATION treeNewInfo = Parameter;
@@ -619,6 +653,18 @@ VOID EtNetworkTreeNewMessage(
                 if (block->ReceiveRawDelta.Delta + block->SendRawDelta.Delta != 0)
                     EtFormatRate(block->ReceiveRawDelta.Delta + block->SendRawDelta.Delta, &text, NULL);
                 break;
+            case ETNETNC_RECEIVERATEAVERAGE:
+                if (block->ReceiveAverage != 0)
+                    EtFormatRate(block->ReceiveAverage, &text, NULL);
+                break;
+            case ETNETNC_SENDRATEAVERAGE:
+                if (block->SendAverage != 0)
+                    EtFormatRate(block->SendAverage, &text, NULL);
+                break;
+            case ETNETNC_TOTALRATEAVERAGE:
+                if (block->ReceiveAverage + block->SendAverage != 0)
+                    EtFormatRate(block->ReceiveAverage + block->SendAverage, &text, NULL);
+                break;
             }
 
             if (text)
@@ -698,6 +744,15 @@ LONG EtpNetworkTreeNewSortFunction(
     case ETNETNC_TOTALRATE:
         result = uint64cmp(block1->ReceiveRawDelta.Delta + block1->SendRawDelta.Delta, block2->ReceiveRawDelta.Delta + block2->SendRawDelta.Delta);
         break;
+    case ETNETNC_RECEIVERATEAVERAGE:
+        result = uint64cmp(block1->ReceiveAverage, block2->ReceiveAverage);
+        break;
+    case ETNETNC_SENDRATEAVERAGE:
+        result = uint64cmp(block1->SendAverage, block2->SendAverage);
+        break;
+    case ETNETNC_TOTALRATEAVERAGE:
+        result = uint64cmp(block1->ReceiveAverage + block1->SendAverage, block2->ReceiveAverage + block2->SendAverage);
+        break;
     }
 
     return result;
@@ -24,6 +24,18 @@
 #include "resource.h"
 #include <symprv.h>
 
+// Faults are drained from the watch buffer on a background thread at this interval so that
+// the buffer doesn't overflow between display updates.
+#define ET_WS_WATCH_DRAIN_INTERVAL 50 // ms
+
+typedef struct _WS_WATCH_SYMBOL
+{
+    PPH_STRING Name;
+    ULONG Count;
+    BOOLEAN Changed; // in ChangedSymbolList
+    BOOLEAN Added; // in the list view
+} WS_WATCH_SYMBOL, *PWS_WATCH_SYMBOL;
+
 typedef struct _WS_WATCH_CONTEXT
 {
     LONG RefCount;
@@ -33,24 +45,20 @@ typedef struct _WS_WATCH_CONTEXT
     HWND ListViewHandle;
     BOOLEAN Enabled;
     BOOLEAN Destroying;
-    PPH_HASHTABLE Hashtable;
     HANDLE ProcessHandle;
     PVOID Buffer;
     ULONG BufferSize;
 
     PPH_SYMBOL_PROVIDER SymbolProvider;
     HANDLE LoadingSymbolsForProcessId;
-    SINGLE_LIST_ENTRY ResultListHead;
-    PH_QUEUED_LOCK ResultListLock;
-} WS_WATCH_CONTEXT, *PWS_WATCH_CONTEXT;
 
-typedef struct _SYMBOL_LOOKUP_RESULT
-{
-    SINGLE_LIST_ENTRY ListEntry;
-    PWS_WATCH_CONTEXT Context;
-    PVOID Address;
-    PPH_STRING Symbol;
-} SYMBOL_LOOKUP_RESULT, *PSYMBOL_LOOKUP_RESULT;
+    // Only accessed by the drain thread once it has started.
+    PPH_HASHTABLE AddressHashtable; // faulting PC to PWS_WATCH_SYMBOL
+    PPH_HASHTABLE SymbolHashtable; // PWS_WATCH_SYMBOL by name
+
+    PH_QUEUED_LOCK SymbolLock; // protects symbol counts and ChangedSymbolList
+    PPH_LIST ChangedSymbolList;
+} WS_WATCH_CONTEXT, *PWS_WATCH_CONTEXT;
 
 VOID EtpReferenceWsWatchContext(
     _Inout_ PWS_WATCH_CONTEXT Context
@@ -102,87 +110,53 @@ static VOID EtpDereferenceWsWatchContext(
 {
     if (_InterlockedDecrement(&Context->RefCount) == 0)
     {
-        PSINGLE_LIST_ENTRY listEntry;
-
-        if (Context->SymbolProvider)
-            PhDereferenceObject(Context->SymbolProvider);
-
-        // Free all unused results.
-
-        PhAcquireQueuedLockExclusive(&Context->ResultListLock);
+        if (Context->SymbolHashtable)
+        {
+            PH_HASHTABLE_ENUM_CONTEXT enumContext;
+            PWS_WATCH_SYMBOL *symbol;
 
-        listEntry = Context->ResultListHead.Next;
+            PhBeginEnumHashtable(Context->SymbolHashtable, &enumContext);
 
-        while (listEntry)
-        {
-            PSYMBOL_LOOKUP_RESULT result;
+            while (symbol = PhNextEnumHashtable(&enumContext))
+            {
+                PhDereferenceObject((*symbol)->Name);
+                PhFree(*symbol);
+            }
 
-            result = CONTAINING_RECORD(listEntry, SYMBOL_LOOKUP_RESULT, ListEntry);
-            listEntry = listEntry->Next;
-            PhDereferenceObject(result->Symbol);
-            PhFree(result);
+            PhDereferenceObject(Context->SymbolHashtable);
         }
 
-        PhReleaseQueuedLockExclusive(&Context->ResultListLock);
+        if (Context->AddressHashtable)
+            PhDereferenceObject(Context->AddressHashtable);
+        if (Context->ChangedSymbolList)
+            PhDereferenceObject(Context->ChangedSymbolList);
+        if (Context->Buffer)
+            PhFree(Context->Buffer);
+        if (Context->SymbolProvider)
+            PhDereferenceObject(Context->SymbolProvider);
 
         PhFree(Context);
     }
 }
 
-static NTSTATUS EtpSymbolLookupFunction(
-    _In_ PVOID Parameter
+static BOOLEAN NTAPI EtpWsWatchSymbolEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
     )
 {
-    PSYMBOL_LOOKUP_RESULT result;
-
-    result = Parameter;
-
-    // Don't bother looking up the symbol if the window has already closed.
-    if (result->Context->Destroying)
-    {
-        EtpDereferenceWsWatchContext(result->Context);
-        PhFree(result);
-        return STATUS_SUCCESS;
-    }
-
-    result->Symbol = PhGetSymbolFromAddress(
-        result->Context->SymbolProvider,
-        (ULONG64)result->Address,
-        NULL,
-        NULL,
-        NULL,
-        NULL
-        );
+    PWS_WATCH_SYMBOL symbol1 = *(PWS_WATCH_SYMBOL *)Entry1;
+    PWS_WATCH_SYMBOL symbol2 = *(PWS_WATCH_SYMBOL *)Entry2;
 
-    // Fail if we don't have a symbol.
-    if (!result->Symbol)
-    {
-        EtpDereferenceWsWatchContext(result->Context);
-        PhFree(result);
-        return STATUS_SUCCESS;
-    }
-
-    PhAcquireQueuedLockExclusive(&result->Context->ResultListLock);
-    PushEntryList(&result->Context->ResultListHead, &result->ListEntry);
-    PhReleaseQueuedLockExclusive(&result->Context->ResultListLock);
-    EtpDereferenceWsWatchContext(result->Context);
-
-    return STATUS_SUCCESS;
+    return PhEqualString(symbol1->Name, symbol2->Name, FALSE);
 }
 
-static VOID EtpQueueSymbolLookup(
-    _In_ PWS_WATCH_CONTEXT Context,
-    _In_ PVOID Address
+static ULONG NTAPI EtpWsWatchSymbolHashFunction(
+    _In_ PVOID Entry
     )
 {
-    PSYMBOL_LOOKUP_RESULT result;
-
-    result = PhAllocate(sizeof(SYMBOL_LOOKUP_RESULT));
-    result->Context = Context;
-    result->Address = Address;
-    EtpReferenceWsWatchContext(Context);
+    PWS_WATCH_SYMBOL symbol = *(PWS_WATCH_SYMBOL *)Entry;
 
-    PhQueueItemGlobalWorkQueue(EtpSymbolLookupFunction, result);
+    return PhHashStringRef(&symbol->Name->sr, FALSE);
 }
 
 static PPH_STRING EtpGetBasicSymbol(
@@ -224,54 +198,92 @@ static PPH_STRING EtpGetBasicSymbol(
     return symbol;
 }
 
-static VOID EtpProcessSymbolLookupResults(
-    _In_ HWND hwndDlg,
-    _In_ PWS_WATCH_CONTEXT Context
+static PPH_STRING EtpGetAggregateSymbol(
+    _In_ PPH_SYMBOL_PROVIDER SymbolProvider,
+    _In_ ULONG64 Address
     )
 {
-    PSINGLE_LIST_ENTRY listEntry;
+    PPH_STRING symbol;
+    PH_SYMBOL_RESOLVE_LEVEL resolveLevel;
+    PPH_STRING fileName = NULL;
+    PPH_STRING symbolName = NULL;
+
+    symbol = PhGetSymbolFromAddress(
+        SymbolProvider,
+        Address,
+        &resolveLevel,
+        &fileName,
+        &symbolName,
+        NULL
+        );
 
-    // Remove all results.
-    PhAcquireQueuedLockExclusive(&Context->ResultListLock);
-    listEntry = Context->ResultListHead.Next;
-    Context->ResultListHead.Next = NULL;
-    PhReleaseQueuedLockExclusive(&Context->ResultListLock);
+    if (resolveLevel == PhsrlFunction && fileName && symbolName)
+    {
+        PPH_STRING baseName;
 
-    // Update the list view with the results.
-    while (listEntry)
+        // Count all faults within a function together.
+        baseName = PhGetBaseName(fileName);
+        PhMoveReference(&symbol, PhConcatStrings(3, baseName->Buffer, L"!", symbolName->Buffer));
+        PhDereferenceObject(baseName);
+    }
+    else if (!symbol)
     {
-        PSYMBOL_LOOKUP_RESULT result;
+        symbol = EtpGetBasicSymbol(SymbolProvider, Address);
+    }
 
-        result = CONTAINING_RECORD(listEntry, SYMBOL_LOOKUP_RESULT, ListEntry);
-        listEntry = listEntry->Next;
+    if (fileName)
+        PhDereferenceObject(fileName);
+    if (symbolName)
+        PhDereferenceObject(symbolName);
 
-        PhSetListViewSubItem(
-            Context->ListViewHandle,
-            PhFindListViewItemByParam(Context->ListViewHandle, -1, result->Address),
-            0,
-            result->Symbol->Buffer
-            );
+    return symbol;
+}
+
+static PWS_WATCH_SYMBOL EtpLookupWsWatchSymbol(
+    _In_ PWS_WATCH_CONTEXT Context,
+    _In_ PVOID Address
+    )
+{
+    PVOID *entry;
+    WS_WATCH_SYMBOL lookupSymbol;
+    PWS_WATCH_SYMBOL lookupSymbolPtr = &lookupSymbol;
+    PWS_WATCH_SYMBOL *symbolPtr;
+    PWS_WATCH_SYMBOL symbol;
 
-        PhDereferenceObject(result->Symbol);
-        PhFree(result);
+    if (entry = PhFindItemSimpleHashtable(Context->AddressHashtable, Address))
+        return *entry;
+
+    lookupSymbol.Name = EtpGetAggregateSymbol(Context->SymbolProvider, (ULONG64)Address);
+    symbolPtr = PhFindEntryHashtable(Context->SymbolHashtable, &lookupSymbolPtr);
+
+    if (symbolPtr)
+    {
+        symbol = *symbolPtr;
+        PhDereferenceObject(lookupSymbol.Name);
+    }
+    else
+    {
+        symbol = PhAllocate(sizeof(WS_WATCH_SYMBOL));
+        memset(symbol, 0, sizeof(WS_WATCH_SYMBOL));
+        symbol->Name = lookupSymbol.Name;
+        PhAddEntryHashtable(Context->SymbolHashtable, &symbol);
     }
+
+    PhAddItemSimpleHashtable(Context->AddressHashtable, Address, symbol);
+
+    return symbol;
 }
 
-static BOOLEAN EtpUpdateWsWatch(
-    _In_ HWND hwndDlg,
+static BOOLEAN EtpDrainWsWatch(
     _In_ PWS_WATCH_CONTEXT Context
     )
 {
     NTSTATUS status;
-    BOOLEAN result;
     ULONG returnLength;
     PPROCESS_WS_WATCH_INFORMATION_EX wsWatchInfo;
 
     // Query WS watch information.
 
-    if (!Context->Buffer)
-        return FALSE;
-
     status = NtQueryInformationProcess(
         Context->ProcessHandle,
         ProcessWorkingSetWatchEx,
@@ -288,9 +300,8 @@ static BOOLEAN EtpUpdateWsWatch(
 
     if (status == STATUS_NO_MORE_ENTRIES)
     {
-        // There were no new faults, but we still need to process symbol lookup results.
-        result = TRUE;
-        goto SkipBuffer;
+        // There were no new faults.
+        return TRUE;
     }
 
     if (status == STATUS_BUFFER_TOO_SMALL || status == STATUS_INFO_LENGTH_MISMATCH)
@@ -311,52 +322,106 @@ static BOOLEAN EtpUpdateWsWatch(
     if (!NT_SUCCESS(status))
     {
         // Error related to the buffer size. Try again later.
-        result = FALSE;
-        goto SkipBuffer;
+        return FALSE;
     }
 
-    // Update the hashtable and list view.
-
-    ExtendedListView_SetRedraw(Context->ListViewHandle, FALSE);
+    // Update the counts. Symbols are resolved outside of the lock since a lookup may need to
+    // load symbols.
 
     wsWatchInfo = Context->Buffer;
 
     while (wsWatchInfo->BasicInfo.FaultingPc)
     {
-        PVOID *entry;
-        WCHAR buffer[PH_INT32_STR_LEN_1];
-        INT lvItemIndex;
-        ULONG newCount;
+        PWS_WATCH_SYMBOL symbol;
+
+        symbol = EtpLookupWsWatchSymbol(Context, wsWatchInfo->BasicInfo.FaultingPc);
 
-        // Update the count in the entry for this instruction pointer, or add a new entry if it doesn't exist.
+        PhAcquireQueuedLockExclusive(&Context->SymbolLock);
 
-        entry = PhFindItemSimpleHashtable(Context->Hashtable, wsWatchInfo->BasicInfo.FaultingPc);
+        symbol->Count++;
 
-        if (entry)
+        if (!symbol->Changed)
         {
-            newCount = PtrToUlong(*entry) + 1;
-            *entry = UlongToPtr(newCount);
-            lvItemIndex = PhFindListViewItemByParam(Context->ListViewHandle, -1, wsWatchInfo->BasicInfo.FaultingPc);
+            symbol->Changed = TRUE;
+            PhAddItemList(Context->ChangedSymbolList, symbol);
         }
-        else
-        {
-            PPH_STRING basicSymbol;
 
-            newCount = 1;
-            PhAddItemSimpleHashtable(Context->Hashtable, wsWatchInfo->BasicInfo.FaultingPc, UlongToPtr(1));
+        PhReleaseQueuedLockExclusive(&Context->SymbolLock);
+
+        wsWatchInfo++;
+    }
+
+    return TRUE;
+}
 
-            // Get a basic symbol name (module+offset).
-            basicSymbol = EtpGetBasicSymbol(Context->SymbolProvider, (ULONG64)wsWatchInfo->BasicInfo.FaultingPc);
+static NTSTATUS EtpWsWatchDrainThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PWS_WATCH_CONTEXT context = Parameter;
+    LARGE_INTEGER interval;
 
-            lvItemIndex = PhAddListViewItem(Context->ListViewHandle, MAXINT, basicSymbol->Buffer, wsWatchInfo->BasicInfo.FaultingPc);
-            PhDereferenceObject(basicSymbol);
+    PhTimeoutFromMilliseconds(&interval, ET_WS_WATCH_DRAIN_INTERVAL);
 
-            // Queue a full symbol lookup.
-            EtpQueueSymbolLookup(Context, wsWatchInfo->BasicInfo.FaultingPc);
+    while (!context->Destroying)
+    {
+        EtpDrainWsWatch(context);
+        NtDelayExecution(FALSE, &interval);
+    }
+
+    EtpDereferenceWsWatchContext(context);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID EtpStartWsWatch(
+    _In_ HWND hwndDlg,
+    _In_ PWS_WATCH_CONTEXT Context
+    )
+{
+    HANDLE threadHandle;
+
+    EtpReferenceWsWatchContext(Context);
+
+    if (threadHandle = PhCreateThread(0, EtpWsWatchDrainThreadStart, Context))
+        NtClose(threadHandle);
+    else
+        EtpDereferenceWsWatchContext(Context);
+
+    EnableWindow(GetDlgItem(hwndDlg, IDC_ENABLE), FALSE);
+    ShowWindow(GetDlgItem(hwndDlg, IDC_WSWATCHENABLED), SW_SHOW);
+    SetTimer(hwndDlg, 1, 1000, NULL);
+}
+
+static VOID EtpUpdateWsWatch(
+    _In_ HWND hwndDlg,
+    _In_ PWS_WATCH_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    ExtendedListView_SetRedraw(Context->ListViewHandle, FALSE);
+
+    PhAcquireQueuedLockExclusive(&Context->SymbolLock);
+
+    for (i = 0; i < Context->ChangedSymbolList->Count; i++)
+    {
+        PWS_WATCH_SYMBOL symbol = Context->ChangedSymbolList->Items[i];
+        WCHAR buffer[PH_INT32_STR_LEN_1];
+        INT lvItemIndex;
+
+        if (!symbol->Added)
+        {
+            lvItemIndex = PhAddListViewItem(Context->ListViewHandle, MAXINT, symbol->Name->Buffer, symbol);
+            symbol->Added = TRUE;
+        }
+        else
+        {
+            lvItemIndex = PhFindListViewItemByParam(Context->ListViewHandle, -1, symbol);
         }
 
         // Update the count in the list view item.
-        PhPrintUInt32(buffer, newCount);
+        PhPrintUInt32(buffer, symbol->Count);
         PhSetListViewSubItem(
             Context->ListViewHandle,
             lvItemIndex,
@@ -364,17 +429,15 @@ static BOOLEAN EtpUpdateWsWatch(
             buffer
             );
 
-        wsWatchInfo++;
+        symbol->Changed = FALSE;
     }
 
-    ExtendedListView_SetRedraw(Context->ListViewHandle, TRUE);
-    result = TRUE;
+    PhClearList(Context->ChangedSymbolList);
 
-SkipBuffer:
-    EtpProcessSymbolLookupResults(hwndDlg, Context);
-    ExtendedListView_SortItems(Context->ListViewHandle);
+    PhReleaseQueuedLockExclusive(&Context->SymbolLock);
 
-    return result;
+    ExtendedListView_SetRedraw(Context->ListViewHandle, TRUE);
+    ExtendedListView_SortItems(Context->ListViewHandle);
 }
 
 static BOOLEAN NTAPI EnumGenericModulesCallback(
@@ -442,11 +505,19 @@ INT_PTR CALLBACK EtpWsWatchDlgProc(
             PhSetExtendedListView(lvHandle);
             ExtendedListView_SetSort(lvHandle, 1, DescendingSortOrder);
 
-            context->Hashtable = PhCreateSimpleHashtable(64);
-            context->BufferSize = 0x2000;
+            context->AddressHashtable = PhCreateSimpleHashtable(64);
+            context->SymbolHashtable = PhCreateHashtable(
+                sizeof(PWS_WATCH_SYMBOL),
+                EtpWsWatchSymbolEqualFunction,
+                EtpWsWatchSymbolHashFunction,
+                64
+                );
+            context->ChangedSymbolList = PhCreateList(64);
+            // Start large so that draining a busy process rarely needs a second query.
+            context->BufferSize = 0x10000;
             context->Buffer = PhAllocate(context->BufferSize);
 
-            PhInitializeQueuedLock(&context->ResultListLock);
+            PhInitializeQueuedLock(&context->SymbolLock);
             context->SymbolProvider = PhCreateSymbolProvider(context->ProcessItem->ProcessId);
             PhLoadSymbolProviderOptions(context->SymbolProvider);
 
@@ -477,14 +548,13 @@ INT_PTR CALLBACK EtpWsWatchDlgProc(
                 context
                 );
 
-            context->Enabled = EtpUpdateWsWatch(hwndDlg, context);
+            context->Enabled = EtpDrainWsWatch(context);
 
             if (context->Enabled)
             {
                 // WS Watch is already enabled for the process. Enable updating.
-                EnableWindow(GetDlgItem(hwndDlg, IDC_ENABLE), FALSE);
-                ShowWindow(GetDlgItem(hwndDlg, IDC_WSWATCHENABLED), SW_SHOW);
-                SetTimer(hwndDlg, 1, 1000, NULL);
+                EtpUpdateWsWatch(hwndDlg, context);
+                EtpStartWsWatch(hwndDlg, context);
             }
             else
             {
@@ -494,15 +564,8 @@ INT_PTR CALLBACK EtpWsWatchDlgProc(
         break;
     case WM_DESTROY:
         {
+            // The drain thread exits and releases its reference to the context.
             context->Destroying = TRUE;
-
-            PhDereferenceObject(context->Hashtable);
-
-            if (context->Buffer)
-            {
-                PhFree(context->Buffer);
-                context->Buffer = NULL;
-            }
         }
         break;
     case WM_COMMAND:
@@ -535,9 +598,7 @@ INT_PTR CALLBACK EtpWsWatchDlgProc(
 
                     if (NT_SUCCESS(status))
                     {
-                        EnableWindow(GetDlgItem(hwndDlg, IDC_ENABLE), FALSE);
-                        ShowWindow(GetDlgItem(hwndDlg, IDC_WSWATCHENABLED), SW_SHOW);
-                        SetTimer(hwndDlg, 1, 1000, NULL);
+                        EtpStartWsWatch(hwndDlg, context);
                     }
                     else
                     {
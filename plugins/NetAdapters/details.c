@@ -713,7 +713,12 @@ static INT_PTR CALLBACK AdapterDetailsDlgProc(
         break;
     case MSG_UPDATE:
         {
-            NetAdapterUpdateDetails(context);
+            // Don't refresh the page while nobody can see it. The next sample after the
+            // page is restored starts the rates from zero again.
+            if (IsWindowVisible(hwndDlg) && !IsMinimized(hwndDlg))
+                NetAdapterUpdateDetails(context);
+            else
+                context->HaveFirstDetailsSample = FALSE;
         }
         break;
     }
@@ -442,8 +442,26 @@ static BOOLEAN NetAdapterSectionCallback(
             ULONG64 networkRcvSpeed = 0;
             ULONG64 networkXmitSpeed = 0;
             //ULONG64 networkLinkSpeed = 0;
+            MIB_IF_ROW2 cachedInterfaceRow;
 
-            if (context->DeviceHandle)
+            if (NetworkAdapterQueryCachedInterfaceRow(context->AdapterEntry, &cachedInterfaceRow))
+            {
+                // Use the snapshot shared by all adapters instead of querying the device.
+                networkInOctets = cachedInterfaceRow.InOctets;
+                networkOutOctets = cachedInterfaceRow.OutOctets;
+                networkRcvSpeed = networkInOctets - context->LastInboundValue;
+                networkXmitSpeed = networkOutOctets - context->LastOutboundValue;
+
+                // HACK: Pull the Adapter name from the current query.
+                if (context->SysinfoSection->Name.Length == 0)
+                {
+                    if (context->AdapterName = PhCreateString(cachedInterfaceRow.Description))
+                    {
+                        context->SysinfoSection->Name = context->AdapterName->sr;
+                    }
+                }
+            }
+            else if (context->DeviceHandle)
             {
                 NDIS_STATISTICS_INFO interfaceStats;
                 //NDIS_LINK_STATE interfaceState;
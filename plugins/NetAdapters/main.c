@@ -28,6 +28,7 @@ static PH_CALLBACK_REGISTRATION PluginLoadCallbackRegistration;
 static PH_CALLBACK_REGISTRATION PluginUnloadCallbackRegistration;
 static PH_CALLBACK_REGISTRATION PluginShowOptionsCallbackRegistration;
 static PH_CALLBACK_REGISTRATION SystemInformationInitializingCallbackRegistration;
+static PH_CALLBACK_REGISTRATION ProcessesUpdatedCallbackRegistration;
 
 static VOID NTAPI LoadCallback(
     _In_opt_ PVOID Parameter,
@@ -41,6 +42,8 @@ static VOID NTAPI LoadCallback(
         if (IphlpHandle = PhGetDllHandle(L"iphlpapi.dll"))
         {
             GetIfEntry2_I = PhGetProcedureAddress(IphlpHandle, "GetIfEntry2", 0);
+            GetIfTable2_I = PhGetProcedureAddress(IphlpHandle, "GetIfTable2", 0);
+            FreeMibTable_I = PhGetProcedureAddress(IphlpHandle, "FreeMibTable", 0);
             GetInterfaceDescriptionFromGuid_I = PhGetProcedureAddress(IphlpHandle, "NhGetInterfaceDescriptionFromGuid", 0);
             NotifyIpInterfaceChange_I = PhGetProcedureAddress(IphlpHandle, "NotifyUnicastIpAddressChange", 0);
             CancelMibChangeNotify2_I = PhGetProcedureAddress(IphlpHandle, "CancelMibChangeNotify2", 0);
@@ -71,6 +74,15 @@ static VOID NTAPI ShowOptionsCallback(
     ShowOptionsDialog((HWND)Parameter);
 }
 
+static VOID NTAPI ProcessesUpdatedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    // Graphs and details pages share one snapshot of the interface table per update.
+    NetworkAdapterInvalidateInterfaceTable();
+}
+
 static VOID NTAPI SystemInformationInitializingCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -139,6 +151,12 @@ LOGICAL DllMain(
                 NULL,
                 &SystemInformationInitializingCallbackRegistration
                 );
+            PhRegisterCallback(
+                &PhProcessesUpdatedEvent,
+                ProcessesUpdatedCallback,
+                NULL,
+                &ProcessesUpdatedCallbackRegistration
+                );
 
             PhAddSettings(settings, ARRAYSIZE(settings));
         }
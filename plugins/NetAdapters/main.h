@@ -225,6 +225,14 @@ typedef ULONG (WINAPI* _GetIfEntry2)(
     _Inout_ PMIB_IF_ROW2 Row
     );
 
+typedef NETIO_STATUS (WINAPI* _GetIfTable2)(
+    _Out_ PMIB_IF_TABLE2 *Table
+    );
+
+typedef VOID (WINAPI* _FreeMibTable)(
+    _In_ PVOID Memory
+    );
+
 // dmex: rev
 typedef ULONG (WINAPI* _GetInterfaceDescriptionFromGuid)(
     _Inout_ PGUID InterfaceGuid,
@@ -236,6 +244,8 @@ typedef ULONG (WINAPI* _GetInterfaceDescriptionFromGuid)(
 
 extern PVOID IphlpHandle;
 extern _GetIfEntry2 GetIfEntry2_I;
+extern _GetIfTable2 GetIfTable2_I;
+extern _FreeMibTable FreeMibTable_I;
 extern _GetInterfaceDescriptionFromGuid GetInterfaceDescriptionFromGuid_I;
 extern _NotifyIpInterfaceChange NotifyIpInterfaceChange_I;
 extern _CancelMibChangeNotify2 CancelMibChangeNotify2_I;
@@ -280,6 +290,15 @@ ULONG64 NetworkAdapterQueryValue(
     _In_ NDIS_OID OpCode
     );
 
+VOID NetworkAdapterInvalidateInterfaceTable(
+    VOID
+    );
+
+BOOLEAN NetworkAdapterQueryCachedInterfaceRow(
+    _In_ PPH_NETADAPTER_ENTRY AdapterEntry,
+    _Out_ PMIB_IF_ROW2 InterfaceRow
+    );
+
 MIB_IF_ROW2 QueryInterfaceRowVista(
     _In_ PPH_NETADAPTER_ENTRY AdapterEntry
     );
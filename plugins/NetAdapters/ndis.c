@@ -24,6 +24,13 @@
 
 PVOID IphlpHandle = NULL;
 _GetIfEntry2 GetIfEntry2_I = NULL;
+_GetIfTable2 GetIfTable2_I = NULL;
+_FreeMibTable FreeMibTable_I = NULL;
+
+static PH_QUEUED_LOCK InterfaceTableLock = PH_QUEUED_LOCK_INIT;
+static PMIB_IF_TABLE2 InterfaceTable = NULL;
+static PPH_HASHTABLE InterfaceTableIndex = NULL; // interface index to row
+static BOOLEAN InterfaceTableStale = TRUE;
 _GetInterfaceDescriptionFromGuid GetInterfaceDescriptionFromGuid_I = NULL;
 
 BOOLEAN NetworkAdapterQuerySupported(
@@ -384,12 +391,95 @@ ULONG64 NetworkAdapterQueryValue(
     return 0;
 }
 
+VOID NetworkAdapterInvalidateInterfaceTable(
+    VOID
+    )
+{
+    InterfaceTableStale = TRUE;
+}
+
+/**
+ * Retrieves an interface row from a snapshot of the interface table. The snapshot is
+ * taken with a single GetIfTable2 call the first time it is needed after each update,
+ * instead of one GetIfEntry2 call per adapter.
+ *
+ * \param AdapterEntry The adapter.
+ * \param InterfaceRow A variable which receives the interface row.
+ *
+ * \return TRUE if the adapter was found in the snapshot, otherwise FALSE.
+ */
+BOOLEAN NetworkAdapterQueryCachedInterfaceRow(
+    _In_ PPH_NETADAPTER_ENTRY AdapterEntry,
+    _Out_ PMIB_IF_ROW2 InterfaceRow
+    )
+{
+    BOOLEAN result = FALSE;
+    PVOID *entry;
+
+    if (!GetIfTable2_I || !FreeMibTable_I)
+        return FALSE;
+
+    PhAcquireQueuedLockExclusive(&InterfaceTableLock);
+
+    if (InterfaceTableStale)
+    {
+        PMIB_IF_TABLE2 table;
+
+        if (InterfaceTable)
+        {
+            FreeMibTable_I(InterfaceTable);
+            InterfaceTable = NULL;
+        }
+
+        if (InterfaceTableIndex)
+            PhClearHashtable(InterfaceTableIndex);
+        else
+            InterfaceTableIndex = PhCreateSimpleHashtable(16);
+
+        if (GetIfTable2_I(&table) == NO_ERROR)
+        {
+            ULONG i;
+
+            InterfaceTable = table;
+
+            for (i = 0; i < table->NumEntries; i++)
+            {
+                PhAddItemSimpleHashtable(
+                    InterfaceTableIndex,
+                    UlongToPtr(table->Table[i].InterfaceIndex),
+                    &table->Table[i]
+                    );
+            }
+        }
+
+        InterfaceTableStale = FALSE;
+    }
+
+    if (entry = PhFindItemSimpleHashtable(InterfaceTableIndex, UlongToPtr(AdapterEntry->InterfaceIndex)))
+    {
+        PMIB_IF_ROW2 row = *entry;
+
+        if (row->InterfaceLuid.Value == AdapterEntry->InterfaceLuid.Value)
+        {
+            *InterfaceRow = *row;
+            result = TRUE;
+        }
+    }
+
+    PhReleaseQueuedLockExclusive(&InterfaceTableLock);
+
+    return result;
+}
+
 MIB_IF_ROW2 QueryInterfaceRowVista(
     _In_ PPH_NETADAPTER_ENTRY AdapterEntry
     )
 {
     MIB_IF_ROW2 interfaceRow;
 
+    if (NetworkAdapterQueryCachedInterfaceRow(AdapterEntry, &interfaceRow))
+        return interfaceRow;
+
     memset(&interfaceRow, 0, sizeof(MIB_IF_ROW2));
 
     interfaceRow.InterfaceLuid = AdapterEntry->InterfaceLuid;
@@ -0,0 +1,404 @@
+/*
+ * Process Hacker Network Tools -
+ *   asynchronous ICMP engine
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The engine owns a single thread which issues every echo request with
+ * IcmpSendEcho2/Icmp6SendEcho2 in APC mode. Completions are delivered back
+ * to the same thread while it waits alertably, so any number of targets
+ * (and, for traceroute, any number of TTLs) can be in flight at once without
+ * a thread or an event per probe. All targets share the round timer: a round
+ * ends when every probe has completed or the timeout has elapsed, and the
+ * next round starts when the interval has elapsed.
+ */
+
+#include "nettools.h"
+
+// Same payload as the Windows ping utility.
+static CHAR NetworkIcmpEchoData[32] = "abcdefghijklmnopqrstuvwabcdefghi";
+
+// Upper bounds (exclusive) of each latency histogram bucket, in milliseconds.
+static ULONG NetworkIcmpHistogramLimits[NETWORK_ICMP_HISTOGRAM_COUNT] = { 10, 50, 100, 250, 500, ULONG_MAX };
+
+static VOID NTAPI NetworkIcmpApcRoutine(
+    _In_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock,
+    _In_ ULONG Reserved
+    )
+{
+    PNETWORK_ICMP_TARGET target = (PNETWORK_ICMP_TARGET)ApcContext;
+    PNETWORK_ICMP_ENGINE engine = target->Engine;
+    ULONG status = IP_REQ_TIMED_OUT;
+    ULONG roundTripTime = 0;
+    PH_IP_ADDRESS replyAddress;
+    ULONG i;
+
+    memset(&replyAddress, 0, sizeof(PH_IP_ADDRESS));
+
+    if (NT_SUCCESS(IoStatusBlock->Status))
+    {
+        // The parse functions return zero for error replies (e.g. TTL expired in transit),
+        // but the reply structure is still filled in, so we always read it.
+        if (target->Address.Type == PH_IPV6_NETWORK_TYPE)
+        {
+            PICMPV6_ECHO_REPLY reply = (PICMPV6_ECHO_REPLY)target->ReplyBuffer;
+
+            Icmp6ParseReplies(target->ReplyBuffer, target->ReplyLength);
+
+            status = reply->Status;
+            roundTripTime = reply->RoundTripTime;
+            replyAddress.Type = PH_IPV6_NETWORK_TYPE;
+            memcpy(replyAddress.Ipv6, reply->Address.sin6_addr, sizeof(replyAddress.Ipv6));
+        }
+        else
+        {
+            PICMP_ECHO_REPLY reply = (PICMP_ECHO_REPLY)target->ReplyBuffer;
+
+            IcmpParseReplies(target->ReplyBuffer, target->ReplyLength);
+
+            status = reply->Status;
+            roundTripTime = reply->RoundTripTime;
+            replyAddress.Type = PH_IPV4_NETWORK_TYPE;
+            replyAddress.Ipv4 = reply->Address;
+        }
+    }
+
+    PhAcquireQueuedLockExclusive(&engine->Lock);
+
+    target->Pending = FALSE;
+    target->LastStatus = status;
+
+    if (status == IP_SUCCESS || status == IP_TTL_EXPIRED_TRANSIT || status == IP_TTL_EXPIRED_REASSEM)
+    {
+        target->RecvCount++;
+        target->LastMs = roundTripTime;
+        target->TotalMs += roundTripTime;
+        target->ReplyAddress = replyAddress;
+
+        if (target->RecvCount == 1 || roundTripTime < target->MinMs)
+            target->MinMs = roundTripTime;
+        if (roundTripTime > target->MaxMs)
+            target->MaxMs = roundTripTime;
+
+        for (i = 0; i < NETWORK_ICMP_HISTOGRAM_COUNT; i++)
+        {
+            if (roundTripTime < NetworkIcmpHistogramLimits[i])
+            {
+                target->Histogram[i]++;
+                break;
+            }
+        }
+    }
+    else
+    {
+        target->LossCount++;
+    }
+
+    PhReleaseQueuedLockExclusive(&engine->Lock);
+
+    engine->PendingCount--;
+}
+
+static VOID NetworkIcmpSendEcho(
+    _In_ PNETWORK_ICMP_ENGINE Engine,
+    _In_ PNETWORK_ICMP_TARGET Target
+    )
+{
+    IP_OPTION_INFORMATION options;
+    ULONG result;
+
+    memset(&options, 0, sizeof(IP_OPTION_INFORMATION));
+    options.Ttl = Target->Ttl;
+
+    memset(Target->ReplyBuffer, 0, Target->ReplyLength);
+
+    PhAcquireQueuedLockExclusive(&Engine->Lock);
+    Target->SentCount++;
+    Target->Pending = TRUE;
+    PhReleaseQueuedLockExclusive(&Engine->Lock);
+
+    if (Target->Address.Type == PH_IPV6_NETWORK_TYPE)
+    {
+        SOCKADDR_IN6 localAddress = { 0 };
+        SOCKADDR_IN6 remoteAddress = { 0 };
+
+        localAddress.sin6_family = AF_INET6;
+        localAddress.sin6_addr = in6addr_any;
+        remoteAddress.sin6_family = AF_INET6;
+        remoteAddress.sin6_addr = Target->Address.In6Addr;
+
+        result = Icmp6SendEcho2(
+            Engine->Icmp6Handle,
+            NULL,
+            NetworkIcmpApcRoutine,
+            Target,
+            &localAddress,
+            &remoteAddress,
+            NetworkIcmpEchoData,
+            sizeof(NetworkIcmpEchoData),
+            &options,
+            Target->ReplyBuffer,
+            Target->ReplyLength,
+            Engine->Timeout
+            );
+    }
+    else
+    {
+        result = IcmpSendEcho2(
+            Engine->IcmpHandle,
+            NULL,
+            NetworkIcmpApcRoutine,
+            Target,
+            Target->Address.Ipv4,
+            NetworkIcmpEchoData,
+            sizeof(NetworkIcmpEchoData),
+            &options,
+            Target->ReplyBuffer,
+            Target->ReplyLength,
+            Engine->Timeout
+            );
+    }
+
+    if (result == 0 && GetLastError() == ERROR_IO_PENDING)
+    {
+        Engine->PendingCount++;
+    }
+    else
+    {
+        // The request failed (or completed) without queuing an APC.
+        PhAcquireQueuedLockExclusive(&Engine->Lock);
+        Target->Pending = FALSE;
+        Target->LossCount++;
+        PhReleaseQueuedLockExclusive(&Engine->Lock);
+    }
+}
+
+static NTSTATUS NetworkIcmpEngineThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PNETWORK_ICMP_ENGINE engine = (PNETWORK_ICMP_ENGINE)Parameter;
+    BOOLEAN stop = FALSE;
+    LARGE_INTEGER timeout;
+    ULONG64 roundStartTime;
+    ULONG64 elapsed;
+    ULONG i;
+
+    while (!stop && (engine->MaximumRounds == 0 || engine->Round < engine->MaximumRounds))
+    {
+        BOOLEAN completed = FALSE;
+
+        roundStartTime = NtGetTickCount64();
+
+        for (i = 0; i < engine->NumberOfTargets; i++)
+        {
+            // Skip targets whose previous probe is still outstanding.
+            if (!engine->Targets[i].Pending)
+                NetworkIcmpSendEcho(engine, &engine->Targets[i]);
+        }
+
+        while (TRUE)
+        {
+            ULONG waitTime;
+
+            elapsed = NtGetTickCount64() - roundStartTime;
+
+            if (!completed && (engine->PendingCount == 0 || elapsed >= engine->Timeout))
+            {
+                completed = TRUE;
+                engine->Round++;
+
+                if (engine->RoundCallback)
+                    engine->RoundCallback(engine, engine->Context);
+
+                if (engine->MaximumRounds != 0 && engine->Round >= engine->MaximumRounds)
+                    break;
+            }
+
+            if (completed)
+            {
+                if (elapsed >= engine->Interval)
+                    break;
+
+                waitTime = engine->Interval - (ULONG)elapsed;
+            }
+            else
+            {
+                waitTime = engine->Timeout - (ULONG)elapsed;
+            }
+
+            // Completions are queued to this thread as APCs; they run during this wait.
+            if (NtWaitForSingleObject(
+                engine->StopEventHandle,
+                TRUE,
+                PhTimeoutFromMilliseconds(&timeout, waitTime)
+                ) == STATUS_WAIT_0)
+            {
+                stop = TRUE;
+                break;
+            }
+        }
+    }
+
+    // Let outstanding requests complete so their reply buffers can be freed.
+    roundStartTime = NtGetTickCount64();
+
+    while (engine->PendingCount != 0 && NtGetTickCount64() - roundStartTime < engine->Timeout + 1000)
+    {
+        NtDelayExecution(TRUE, PhTimeoutFromMilliseconds(&timeout, 50));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Creates an ICMP engine.
+ *
+ * \param NumberOfTargets The number of targets. The caller must fill in the
+ * Address and Ttl of each target before starting the engine.
+ * \param Interval The minimum time between the start of each round, in milliseconds.
+ * \param Timeout The time to wait for each reply, in milliseconds.
+ * \param MaximumRounds The number of rounds to send, or 0 to send until the
+ * engine is destroyed.
+ * \param RoundCallback A function which is called on the engine thread after
+ * each round. The callback must not wait for the thread that destroys the engine.
+ * \param Context A user-defined value to pass to the callback.
+ */
+PNETWORK_ICMP_ENGINE NetworkIcmpCreateEngine(
+    _In_ ULONG NumberOfTargets,
+    _In_ ULONG Interval,
+    _In_ ULONG Timeout,
+    _In_ ULONG MaximumRounds,
+    _In_opt_ PNETWORK_ICMP_ROUND_CALLBACK RoundCallback,
+    _In_opt_ PVOID Context
+    )
+{
+    PNETWORK_ICMP_ENGINE engine;
+    ULONG replyLength;
+    ULONG i;
+
+    engine = PhAllocate(FIELD_OFFSET(NETWORK_ICMP_ENGINE, Targets) + sizeof(NETWORK_ICMP_TARGET) * NumberOfTargets);
+    memset(engine, 0, FIELD_OFFSET(NETWORK_ICMP_ENGINE, Targets) + sizeof(NETWORK_ICMP_TARGET) * NumberOfTargets);
+
+    PhInitializeQueuedLock(&engine->Lock);
+    engine->IcmpHandle = INVALID_HANDLE_VALUE;
+    engine->Icmp6Handle = INVALID_HANDLE_VALUE;
+    engine->Interval = Interval;
+    engine->Timeout = Timeout;
+    engine->MaximumRounds = MaximumRounds;
+    engine->RoundCallback = RoundCallback;
+    engine->Context = Context;
+    engine->NumberOfTargets = NumberOfTargets;
+
+    // See ICMP_BUFFER_SIZE.
+    replyLength = (ULONG)max(sizeof(ICMP_ECHO_REPLY), sizeof(ICMPV6_ECHO_REPLY)) +
+        sizeof(NetworkIcmpEchoData) + 8 + sizeof(IO_STATUS_BLOCK);
+
+    for (i = 0; i < NumberOfTargets; i++)
+    {
+        engine->Targets[i].Engine = engine;
+        engine->Targets[i].Ttl = 255;
+        engine->Targets[i].ReplyLength = replyLength;
+        engine->Targets[i].ReplyBuffer = PhAllocate(replyLength);
+    }
+
+    return engine;
+}
+
+BOOLEAN NetworkIcmpStartEngine(
+    _In_ PNETWORK_ICMP_ENGINE Engine
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Engine->NumberOfTargets; i++)
+    {
+        if (Engine->Targets[i].Address.Type == PH_IPV6_NETWORK_TYPE)
+        {
+            if (Engine->Icmp6Handle == INVALID_HANDLE_VALUE)
+                Engine->Icmp6Handle = Icmp6CreateFile();
+        }
+        else
+        {
+            if (Engine->IcmpHandle == INVALID_HANDLE_VALUE)
+                Engine->IcmpHandle = IcmpCreateFile();
+        }
+    }
+
+    if (!NT_SUCCESS(NtCreateEvent(&Engine->StopEventHandle, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE)))
+        return FALSE;
+
+    Engine->ThreadHandle = PhCreateThread(0, NetworkIcmpEngineThreadStart, Engine);
+
+    return Engine->ThreadHandle != NULL;
+}
+
+/**
+ * Stops and frees an ICMP engine.
+ *
+ * \param Engine The engine. This function waits for the engine thread to exit.
+ */
+VOID NetworkIcmpDestroyEngine(
+    _In_ PNETWORK_ICMP_ENGINE Engine
+    )
+{
+    ULONG i;
+
+    if (Engine->ThreadHandle)
+    {
+        NtSetEvent(Engine->StopEventHandle, NULL);
+        NtWaitForSingleObject(Engine->ThreadHandle, FALSE, NULL);
+        NtClose(Engine->ThreadHandle);
+    }
+
+    if (Engine->StopEventHandle)
+        NtClose(Engine->StopEventHandle);
+    if (Engine->IcmpHandle != INVALID_HANDLE_VALUE)
+        IcmpCloseHandle(Engine->IcmpHandle);
+    if (Engine->Icmp6Handle != INVALID_HANDLE_VALUE)
+        IcmpCloseHandle(Engine->Icmp6Handle);
+
+    // If a request never completed the driver may still write to its buffer, so we leak
+    // the buffers rather than freeing memory that is in use.
+    if (Engine->PendingCount == 0)
+    {
+        for (i = 0; i < Engine->NumberOfTargets; i++)
+            PhFree(Engine->Targets[i].ReplyBuffer);
+
+        PhFree(Engine);
+    }
+}
+
+/**
+ * Copies the statistics of a target.
+ *
+ * \param Engine The engine.
+ * \param Index The index of the target.
+ * \param Statistics A variable which receives a copy of the target.
+ */
+VOID NetworkIcmpQueryTarget(
+    _In_ PNETWORK_ICMP_ENGINE Engine,
+    _In_ ULONG Index,
+    _Out_ PNETWORK_ICMP_TARGET Statistics
+    )
+{
+    PhAcquireQueuedLockShared(&Engine->Lock);
+    *Statistics = Engine->Targets[Index];
+    PhReleaseQueuedLockShared(&Engine->Lock);
+}
@@ -64,9 +64,25 @@ VOID NTAPI MenuItemCallback(
     case NETWORK_ACTION_PATHPING:
         PerformNetworkAction(NETWORK_ACTION_PATHPING, networkItem);
         break;
+    case NETWORK_ACTION_PING_MULTIPLE:
+        PerformNetworkPingMultiple((PPH_LIST)menuItem->Context);
+        break;
     }
 }
 
+static VOID NTAPI PingMultipleMenuItemDeleteFunction(
+    _In_ PPH_PLUGIN_MENU_ITEM MenuItem
+    )
+{
+    PPH_LIST networkItems = (PPH_LIST)MenuItem->Context;
+    ULONG i;
+
+    for (i = 0; i < networkItems->Count; i++)
+        PhDereferenceObject(networkItems->Items[i]);
+
+    PhDereferenceObject(networkItems);
+}
+
 VOID NTAPI NetworkMenuInitializingCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -76,6 +92,8 @@ VOID NTAPI NetworkMenuInitializingCallback(
     PPH_NETWORK_ITEM networkItem;
     PPH_EMENU_ITEM toolsMenu;
     PPH_EMENU_ITEM closeMenuItem;
+    PPH_LIST networkItems = NULL;
+    ULONG i;
 
     if (menuInfo->u.Network.NumberOfNetworkItems == 1)
         networkItem = menuInfo->u.Network.NetworkItems[0];
@@ -89,6 +107,28 @@ VOID NTAPI NetworkMenuInitializingCallback(
     PhInsertEMenuItem(toolsMenu, PhPluginCreateEMenuItem(PluginInstance, 0, NETWORK_ACTION_WHOIS, L"Whois", networkItem), -1);
     PhInsertEMenuItem(toolsMenu, PhPluginCreateEMenuItem(PluginInstance, 0, NETWORK_ACTION_PATHPING, L"PathPing", networkItem), -1);
 
+    if (menuInfo->u.Network.NumberOfNetworkItems > 1)
+    {
+        PPH_EMENU_ITEM pingMultipleMenuItem;
+
+        // The menu item keeps its own references since the selection may change before it is chosen.
+        networkItems = PhCreateList(menuInfo->u.Network.NumberOfNetworkItems);
+
+        for (i = 0; i < menuInfo->u.Network.NumberOfNetworkItems; i++)
+        {
+            if (!PhIsNullIpAddress(&menuInfo->u.Network.NetworkItems[i]->RemoteEndpoint.Address))
+            {
+                PhReferenceObject(menuInfo->u.Network.NetworkItems[i]);
+                PhAddItemList(networkItems, menuInfo->u.Network.NetworkItems[i]);
+            }
+        }
+
+        pingMultipleMenuItem = PhPluginCreateEMenuItem(PluginInstance, 0, NETWORK_ACTION_PING_MULTIPLE, L"Ping selected", networkItems);
+        ((PPH_PLUGIN_MENU_ITEM)pingMultipleMenuItem->Context)->DeleteFunction = PingMultipleMenuItemDeleteFunction;
+        PhInsertEMenuItem(toolsMenu, PhPluginCreateEMenuItem(PluginInstance, PH_EMENU_SEPARATOR, 0, L"", NULL), -1);
+        PhInsertEMenuItem(toolsMenu, pingMultipleMenuItem, -1);
+    }
+
     // Insert the Tools menu into the network menu.
     closeMenuItem = PhFindEMenuItem(menuInfo->Menu, 0, L"Close", 0);
     PhInsertEMenuItem(menuInfo->Menu, toolsMenu, closeMenuItem ? PhIndexOfEMenuItem(menuInfo->Menu, closeMenuItem) : 1);
@@ -102,6 +142,19 @@ VOID NTAPI NetworkMenuInitializingCallback(
             toolsMenu->Flags &= ~PH_EMENU_DISABLED;
         }
     }
+    else if (networkItems && networkItems->Count != 0)
+    {
+        // Only "Ping selected" applies to multiple connections.
+        toolsMenu->Flags &= ~PH_EMENU_DISABLED;
+
+        for (i = 0; i < toolsMenu->Items->Count; i++)
+        {
+            PPH_EMENU_ITEM item = toolsMenu->Items->Items[i];
+
+            if (item->Id != NETWORK_ACTION_PING_MULTIPLE && !(item->Flags & PH_EMENU_SEPARATOR))
+                item->Flags |= PH_EMENU_DISABLED;
+        }
+    }
 }
 
 LOGICAL DllMain(
@@ -121,7 +174,9 @@ LOGICAL DllMain(
                 { IntegerPairSettingType, SETTING_NAME_TRACERT_WINDOW_SIZE, L"600,365" },
                 { IntegerPairSettingType, SETTING_NAME_PING_WINDOW_POSITION, L"0,0" },
                 { IntegerPairSettingType, SETTING_NAME_PING_WINDOW_SIZE, L"420,250" },
-                { IntegerSettingType, SETTING_NAME_PING_TIMEOUT, L"3e8" } // 1000 timeout.
+                { IntegerSettingType, SETTING_NAME_PING_TIMEOUT, L"3e8" }, // 1000 timeout.
+                { IntegerPairSettingType, SETTING_NAME_PING_MULTIPLE_WINDOW_POSITION, L"0,0" },
+                { IntegerPairSettingType, SETTING_NAME_PING_MULTIPLE_WINDOW_SIZE, L"640,365" }
             };
 
             PluginInstance = PhRegisterPlugin(PLUGIN_NAME, Instance, &info);
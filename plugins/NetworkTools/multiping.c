@@ -0,0 +1,323 @@
+/*
+ * Process Hacker Network Tools -
+ *   multiple target ping dialog
+ *
+ * This file is part of Process Hacker.
+ *
+ * Process Hacker is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Process Hacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Process Hacker.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nettools.h"
+
+#define PING_MULTIPLE_COLUMN_ADDRESS 0
+#define PING_MULTIPLE_COLUMN_SENT 1
+#define PING_MULTIPLE_COLUMN_LOST 2
+#define PING_MULTIPLE_COLUMN_LAST 3
+#define PING_MULTIPLE_COLUMN_MIN 4
+#define PING_MULTIPLE_COLUMN_AVG 5
+#define PING_MULTIPLE_COLUMN_MAX 6
+#define PING_MULTIPLE_COLUMN_HISTOGRAM 7 // first of NETWORK_ICMP_HISTOGRAM_COUNT columns
+
+#define PING_MULTIPLE_MAXIMUM_TARGETS 256
+
+static PWSTR HistogramColumnNames[NETWORK_ICMP_HISTOGRAM_COUNT] =
+{
+    L"< 10 ms",
+    L"< 50 ms",
+    L"< 100 ms",
+    L"< 250 ms",
+    L"< 500 ms",
+    L"500+ ms"
+};
+
+static VOID NTAPI NetworkPingMultipleRoundCallback(
+    _In_ PNETWORK_ICMP_ENGINE Engine,
+    _In_opt_ PVOID Context
+    )
+{
+    PNETWORK_PING_MULTIPLE_CONTEXT context = (PNETWORK_PING_MULTIPLE_CONTEXT)Context;
+
+    PostMessage(context->WindowHandle, NTM_RECEIVEDICMP, 0, 0);
+}
+
+static VOID NetworkPingMultipleUpdateList(
+    _In_ PNETWORK_PING_MULTIPLE_CONTEXT Context
+    )
+{
+    ULONG i;
+    ULONG j;
+
+    ExtendedListView_SetRedraw(Context->ListViewHandle, FALSE);
+
+    for (i = 0; i < Context->IcmpEngine->NumberOfTargets; i++)
+    {
+        NETWORK_ICMP_TARGET target;
+
+        NetworkIcmpQueryTarget(Context->IcmpEngine, i, &target);
+
+        PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_SENT, PhaFormatUInt64(target.SentCount, TRUE)->Buffer);
+        PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_LOST, PhaFormatString(
+            L"%lu (%.0f%%)",
+            target.LossCount,
+            target.SentCount ? (FLOAT)target.LossCount / target.SentCount * 100 : 0
+            )->Buffer);
+
+        if (target.RecvCount != 0)
+        {
+            PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_LAST, PhaFormatString(L"%lu ms", target.LastMs)->Buffer);
+            PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_MIN, PhaFormatString(L"%lu ms", target.MinMs)->Buffer);
+            PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_AVG, PhaFormatString(L"%lu ms", (ULONG)(target.TotalMs / target.RecvCount))->Buffer);
+            PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_MAX, PhaFormatString(L"%lu ms", target.MaxMs)->Buffer);
+
+            for (j = 0; j < NETWORK_ICMP_HISTOGRAM_COUNT; j++)
+            {
+                PhSetListViewSubItem(Context->ListViewHandle, i, PING_MULTIPLE_COLUMN_HISTOGRAM + j, PhaFormatString(
+                    L"%.0f%%",
+                    (FLOAT)target.Histogram[j] / target.RecvCount * 100
+                    )->Buffer);
+            }
+        }
+    }
+
+    ExtendedListView_SetRedraw(Context->ListViewHandle, TRUE);
+}
+
+static INT_PTR CALLBACK NetworkPingMultipleDlgProc(
+    _In_ HWND hwndDlg,
+    _In_ UINT uMsg,
+    _In_ WPARAM wParam,
+    _In_ LPARAM lParam
+    )
+{
+    PNETWORK_PING_MULTIPLE_CONTEXT context;
+
+    if (uMsg == WM_INITDIALOG)
+    {
+        context = (PNETWORK_PING_MULTIPLE_CONTEXT)lParam;
+        SetProp(hwndDlg, L"Context", (HANDLE)context);
+    }
+    else
+    {
+        context = (PNETWORK_PING_MULTIPLE_CONTEXT)GetProp(hwndDlg, L"Context");
+    }
+
+    if (!context)
+        return FALSE;
+
+    switch (uMsg)
+    {
+    case WM_INITDIALOG:
+        {
+            PH_RECTANGLE windowRectangle;
+            ULONG i;
+
+            context->WindowHandle = hwndDlg;
+            context->ListViewHandle = GetDlgItem(hwndDlg, IDC_PINGLIST);
+
+            PhSetListViewStyle(context->ListViewHandle, FALSE, TRUE);
+            PhSetControlTheme(context->ListViewHandle, L"explorer");
+            PhAddListViewColumn(context->ListViewHandle, 0, 0, 0, LVCFMT_LEFT, 140, L"Address");
+            PhAddListViewColumn(context->ListViewHandle, 1, 1, 1, LVCFMT_RIGHT, 40, L"Sent");
+            PhAddListViewColumn(context->ListViewHandle, 2, 2, 2, LVCFMT_RIGHT, 60, L"Lost");
+            PhAddListViewColumn(context->ListViewHandle, 3, 3, 3, LVCFMT_RIGHT, 50, L"Last");
+            PhAddListViewColumn(context->ListViewHandle, 4, 4, 4, LVCFMT_RIGHT, 50, L"Min.");
+            PhAddListViewColumn(context->ListViewHandle, 5, 5, 5, LVCFMT_RIGHT, 50, L"Avg.");
+            PhAddListViewColumn(context->ListViewHandle, 6, 6, 6, LVCFMT_RIGHT, 50, L"Max.");
+
+            for (i = 0; i < NETWORK_ICMP_HISTOGRAM_COUNT; i++)
+            {
+                PhAddListViewColumn(
+                    context->ListViewHandle,
+                    PING_MULTIPLE_COLUMN_HISTOGRAM + i,
+                    PING_MULTIPLE_COLUMN_HISTOGRAM + i,
+                    PING_MULTIPLE_COLUMN_HISTOGRAM + i,
+                    LVCFMT_RIGHT,
+                    55,
+                    HistogramColumnNames[i]
+                    );
+            }
+
+            PhSetExtendedListView(context->ListViewHandle);
+
+            for (i = 0; i < context->IcmpEngine->NumberOfTargets; i++)
+            {
+                PPH_IP_ADDRESS address = &context->IcmpEngine->Targets[i].Address;
+                WCHAR addressString[INET6_ADDRSTRLEN];
+
+                if (address->Type == PH_IPV6_NETWORK_TYPE)
+                    RtlIpv6AddressToString(&address->In6Addr, addressString);
+                else
+                    RtlIpv4AddressToString(&address->InAddr, addressString);
+
+                PhAddListViewItem(context->ListViewHandle, MAXINT, addressString, NULL);
+            }
+
+            PhInitializeLayoutManager(&context->LayoutManager, hwndDlg);
+            PhAddLayoutItem(&context->LayoutManager, context->ListViewHandle, NULL, PH_ANCHOR_ALL);
+            PhAddLayoutItem(&context->LayoutManager, GetDlgItem(hwndDlg, IDOK), NULL, PH_ANCHOR_BOTTOM | PH_ANCHOR_RIGHT);
+
+            windowRectangle.Position = PhGetIntegerPairSetting(SETTING_NAME_PING_MULTIPLE_WINDOW_POSITION);
+            windowRectangle.Size = PhGetIntegerPairSetting(SETTING_NAME_PING_MULTIPLE_WINDOW_SIZE);
+
+            // Check for first-run default position.
+            if (windowRectangle.Position.X == 0 || windowRectangle.Position.Y == 0)
+            {
+                PhCenterWindow(hwndDlg, GetParent(hwndDlg));
+            }
+            else
+            {
+                PhLoadWindowPlacementFromSetting(SETTING_NAME_PING_MULTIPLE_WINDOW_POSITION, SETTING_NAME_PING_MULTIPLE_WINDOW_SIZE, hwndDlg);
+            }
+
+            PhLayoutManagerLayout(&context->LayoutManager);
+
+            SetWindowText(hwndDlg, PhaFormatString(L"Ping %lu addresses", context->IcmpEngine->NumberOfTargets)->Buffer);
+
+            NetworkIcmpStartEngine(context->IcmpEngine);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PhSaveWindowPlacementToSetting(SETTING_NAME_PING_MULTIPLE_WINDOW_POSITION, SETTING_NAME_PING_MULTIPLE_WINDOW_SIZE, hwndDlg);
+            PhDeleteLayoutManager(&context->LayoutManager);
+
+            NetworkIcmpDestroyEngine(context->IcmpEngine);
+
+            RemoveProp(hwndDlg, L"Context");
+            PhFree(context);
+        }
+        break;
+    case WM_COMMAND:
+        {
+            switch (GET_WM_COMMAND_ID(wParam, lParam))
+            {
+            case IDCANCEL:
+            case IDOK:
+                PostQuitMessage(0);
+                break;
+            }
+        }
+        break;
+    case WM_SIZE:
+        PhLayoutManagerLayout(&context->LayoutManager);
+        break;
+    case WM_SIZING:
+        PhResizingMinimumSize((PRECT)lParam, wParam, 420, 250);
+        break;
+    case NTM_RECEIVEDICMP:
+        NetworkPingMultipleUpdateList(context);
+        break;
+    }
+
+    return FALSE;
+}
+
+static NTSTATUS NetworkPingMultipleDialogThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    BOOL result;
+    MSG message;
+    HWND windowHandle;
+    PH_AUTO_POOL autoPool;
+
+    PhInitializeAutoPool(&autoPool);
+
+    windowHandle = CreateDialogParam(
+        (HINSTANCE)PluginInstance->DllBase,
+        MAKEINTRESOURCE(IDD_PINGMULTIPLE),
+        PhMainWndHandle,
+        NetworkPingMultipleDlgProc,
+        (LPARAM)Parameter
+        );
+
+    ShowWindow(windowHandle, SW_SHOW);
+    SetForegroundWindow(windowHandle);
+
+    while (result = GetMessage(&message, NULL, 0, 0))
+    {
+        if (result == -1)
+            break;
+
+        if (!IsDialogMessage(windowHandle, &message))
+        {
+            TranslateMessage(&message);
+            DispatchMessage(&message);
+        }
+
+        PhDrainAutoPool(&autoPool);
+    }
+
+    PhDeleteAutoPool(&autoPool);
+    DestroyWindow(windowHandle);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Pings the remote addresses of several network items at once and shows
+ * the results in a single window.
+ *
+ * \param NetworkItems A list of network items. Duplicate remote addresses
+ * are only pinged once.
+ */
+VOID PerformNetworkPingMultiple(
+    _In_ PPH_LIST NetworkItems
+    )
+{
+    PNETWORK_PING_MULTIPLE_CONTEXT context;
+    PH_IP_ADDRESS addresses[PING_MULTIPLE_MAXIMUM_TARGETS];
+    ULONG numberOfAddresses = 0;
+    HANDLE dialogThread;
+    ULONG i;
+    ULONG j;
+
+    for (i = 0; i < NetworkItems->Count && numberOfAddresses < RTL_NUMBER_OF(addresses); i++)
+    {
+        PPH_NETWORK_ITEM networkItem = NetworkItems->Items[i];
+
+        if (PhIsNullIpAddress(&networkItem->RemoteEndpoint.Address))
+            continue;
+
+        for (j = 0; j < numberOfAddresses; j++)
+        {
+            if (PhEqualIpAddress(&addresses[j], &networkItem->RemoteEndpoint.Address))
+                break;
+        }
+
+        if (j == numberOfAddresses)
+            addresses[numberOfAddresses++] = networkItem->RemoteEndpoint.Address;
+    }
+
+    if (numberOfAddresses == 0)
+        return;
+
+    context = PhAllocate(sizeof(NETWORK_PING_MULTIPLE_CONTEXT));
+    memset(context, 0, sizeof(NETWORK_PING_MULTIPLE_CONTEXT));
+
+    context->IcmpEngine = NetworkIcmpCreateEngine(
+        numberOfAddresses,
+        1000,
+        PhGetIntegerSetting(SETTING_NAME_PING_TIMEOUT),
+        0,
+        NetworkPingMultipleRoundCallback,
+        context
+        );
+
+    for (i = 0; i < numberOfAddresses; i++)
+        context->IcmpEngine->Targets[i].Address = addresses[i];
+
+    if (dialogThread = PhCreateThread(0, NetworkPingMultipleDialogThreadStart, context))
+        NtClose(dialogThread);
+}
@@ -36,6 +36,8 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
+// Use PIO_APC_ROUTINE for IcmpSendEcho2 instead of FARPROC.
+#define PIO_APC_ROUTINE_DEFINED
 #include <icmpapi.h>
 
 #include "resource.h"
@@ -46,6 +48,8 @@
 #define SETTING_NAME_PING_WINDOW_POSITION (PLUGIN_NAME L".PingWindowPosition")
 #define SETTING_NAME_PING_WINDOW_SIZE (PLUGIN_NAME L".PingWindowSize")
 #define SETTING_NAME_PING_TIMEOUT (PLUGIN_NAME L".PingMaxTimeout")
+#define SETTING_NAME_PING_MULTIPLE_WINDOW_POSITION (PLUGIN_NAME L".PingMultipleWindowPosition")
+#define SETTING_NAME_PING_MULTIPLE_WINDOW_SIZE (PLUGIN_NAME L".PingMultipleWindowSize")
 
 // ICMP Packet Length: (msdn: IcmpSendEcho2/Icmp6SendEcho2)
 // The buffer must be large enough to hold at least one ICMP_ECHO_REPLY or ICMPV6_ECHO_REPLY structure
@@ -62,13 +66,95 @@ typedef enum _PH_NETWORK_ACTION
     NETWORK_ACTION_TRACEROUTE,
     NETWORK_ACTION_WHOIS,
     NETWORK_ACTION_FINISH,
-    NETWORK_ACTION_PATHPING
+    NETWORK_ACTION_PATHPING,
+    NETWORK_ACTION_PING_MULTIPLE
 } PH_NETWORK_ACTION;
 
 // output
 #define NTM_RECEIVEDTRACE (WM_APP + NETWORK_ACTION_TRACEROUTE)
 #define NTM_RECEIVEDWHOIS (WM_APP + NETWORK_ACTION_WHOIS)
 #define NTM_RECEIVEDFINISH (WM_APP + NETWORK_ACTION_FINISH)
+#define NTM_RECEIVEDICMP (WM_APP + NETWORK_ACTION_PING_MULTIPLE)
+
+// icmp
+
+#define NETWORK_ICMP_HISTOGRAM_COUNT 6
+
+typedef struct _NETWORK_ICMP_TARGET
+{
+    PH_IP_ADDRESS Address;
+    UCHAR Ttl;
+
+    BOOLEAN Pending;
+    ULONG SentCount;
+    ULONG RecvCount;
+    ULONG LossCount;
+    ULONG LastStatus;
+    ULONG LastMs;
+    ULONG MinMs;
+    ULONG MaxMs;
+    ULONG64 TotalMs;
+    PH_IP_ADDRESS ReplyAddress;
+    ULONG Histogram[NETWORK_ICMP_HISTOGRAM_COUNT]; // <10, <50, <100, <250, <500, 500+ ms
+
+    struct _NETWORK_ICMP_ENGINE *Engine;
+    ULONG ReplyLength;
+    PVOID ReplyBuffer;
+} NETWORK_ICMP_TARGET, *PNETWORK_ICMP_TARGET;
+
+typedef VOID (NTAPI *PNETWORK_ICMP_ROUND_CALLBACK)(
+    _In_ struct _NETWORK_ICMP_ENGINE *Engine,
+    _In_opt_ PVOID Context
+    );
+
+typedef struct _NETWORK_ICMP_ENGINE
+{
+    PH_QUEUED_LOCK Lock;
+    HANDLE ThreadHandle;
+    HANDLE StopEventHandle;
+    HANDLE IcmpHandle;
+    HANDLE Icmp6Handle;
+
+    ULONG Interval;
+    ULONG Timeout;
+    ULONG MaximumRounds;
+    ULONG Round;
+    ULONG PendingCount;
+
+    PNETWORK_ICMP_ROUND_CALLBACK RoundCallback;
+    PVOID Context;
+
+    ULONG NumberOfTargets;
+    NETWORK_ICMP_TARGET Targets[1];
+} NETWORK_ICMP_ENGINE, *PNETWORK_ICMP_ENGINE;
+
+PNETWORK_ICMP_ENGINE NetworkIcmpCreateEngine(
+    _In_ ULONG NumberOfTargets,
+    _In_ ULONG Interval,
+    _In_ ULONG Timeout,
+    _In_ ULONG MaximumRounds,
+    _In_opt_ PNETWORK_ICMP_ROUND_CALLBACK RoundCallback,
+    _In_opt_ PVOID Context
+    );
+
+BOOLEAN NetworkIcmpStartEngine(
+    _In_ PNETWORK_ICMP_ENGINE Engine
+    );
+
+VOID NetworkIcmpDestroyEngine(
+    _In_ PNETWORK_ICMP_ENGINE Engine
+    );
+
+VOID NetworkIcmpQueryTarget(
+    _In_ PNETWORK_ICMP_ENGINE Engine,
+    _In_ ULONG Index,
+    _Out_ PNETWORK_ICMP_TARGET Statistics
+    );
+
+// tracert
+
+#define NETWORK_TRACERT_MAXIMUM_HOPS 30
+#define NETWORK_TRACERT_PROBES 3
 
 typedef struct _NETWORK_OUTPUT_CONTEXT
 {
@@ -102,8 +188,20 @@ typedef struct _NETWORK_OUTPUT_CONTEXT
     PPH_NETWORK_ITEM NetworkItem;
     PH_IP_ADDRESS IpAddress;
     WCHAR IpAddressString[INET6_ADDRSTRLEN];
+
+    PNETWORK_ICMP_ENGINE IcmpEngine;
+    BOOLEAN TraceFinished;
+    PPH_STRING HopNames[NETWORK_TRACERT_MAXIMUM_HOPS];
 } NETWORK_OUTPUT_CONTEXT, *PNETWORK_OUTPUT_CONTEXT;
 
+typedef struct _NETWORK_PING_MULTIPLE_CONTEXT
+{
+    PH_LAYOUT_MANAGER LayoutManager;
+    HWND WindowHandle;
+    HWND ListViewHandle;
+    PNETWORK_ICMP_ENGINE IcmpEngine;
+} NETWORK_PING_MULTIPLE_CONTEXT, *PNETWORK_PING_MULTIPLE_CONTEXT;
+
 NTSTATUS PhNetworkPingDialogThreadStart(
     _In_ PVOID Parameter
     );
@@ -121,6 +219,18 @@ NTSTATUS NetworkTracertThreadStart(
     _In_ PVOID Parameter
     );
 
+BOOLEAN NetworkTracertStart(
+    _In_ PNETWORK_OUTPUT_CONTEXT Context
+    );
+
+VOID NetworkTracertFormatOutput(
+    _In_ PNETWORK_OUTPUT_CONTEXT Context
+    );
+
+VOID PerformNetworkPingMultiple(
+    _In_ PPH_LIST NetworkItems
+    );
+
 NTSTATUS NetworkWhoisThreadStart(
     _In_ PVOID Parameter
     );
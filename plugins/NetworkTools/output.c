@@ -48,6 +48,16 @@ static INT_PTR CALLBACK NetworkOutputDlgProc(
             PhSaveWindowPlacementToSetting(SETTING_NAME_TRACERT_WINDOW_POSITION, SETTING_NAME_TRACERT_WINDOW_SIZE, hwndDlg);
             PhDeleteLayoutManager(&context->LayoutManager);
 
+            if (context->IcmpEngine)
+            {
+                ULONG i;
+
+                NetworkIcmpDestroyEngine(context->IcmpEngine);
+
+                for (i = 0; i < NETWORK_TRACERT_MAXIMUM_HOPS; i++)
+                    PhClearReference(&context->HopNames[i]);
+            }
+
             if (context->ProcessHandle)
             {
                 // Terminate the child process.
@@ -122,14 +132,11 @@ static INT_PTR CALLBACK NetworkOutputDlgProc(
             {
             case NETWORK_ACTION_TRACEROUTE:
                 {
-                    HANDLE dialogThread = INVALID_HANDLE_VALUE;
-
                     Static_SetText(context->WindowHandle,
                         PhaFormatString(L"Tracing route to %s...", context->IpAddressString)->Buffer
                         );
 
-                    if (dialogThread = PhCreateThread(0, NetworkTracertThreadStart, (PVOID)context))
-                        NtClose(dialogThread);
+                    NetworkTracertStart(context);
                 }
                 break;
             case NETWORK_ACTION_WHOIS:
@@ -332,6 +339,15 @@ static INT_PTR CALLBACK NetworkOutputDlgProc(
             }
         }
         break;
+    case NTM_RECEIVEDICMP:
+        {
+            NetworkTracertFormatOutput(context);
+
+            // wParam is set for the last round only.
+            if (wParam)
+                SendMessage(hwndDlg, NTM_RECEIVEDFINISH, 0, 0);
+        }
+        break;
     case NTM_RECEIVEDFINISH:
         {
             PPH_STRING windowText = PhGetWindowText(context->WindowHandle);
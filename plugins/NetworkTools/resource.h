@@ -5,6 +5,7 @@
 #define IDD_OUTPUT                      101
 #define IDD_PINGDIALOG                  102
 #define IDD_OPTIONS                     103
+#define IDD_PINGMULTIPLE                104
 #define IDC_MAXTIMEOUTTEXT              1008
 #define IDC_NETOUTPUTEDIT               1009
 #define IDC_ICMP_PANEL                  1011
@@ -18,14 +19,15 @@
 #define IDC_PINGS_SENT                  1020
 #define IDC_PING_LAYOUT                 1021
 #define IDC_BAD_HASH                    1022
+#define IDC_PINGLIST                    1023
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        104
+#define _APS_NEXT_RESOURCE_VALUE        105
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1022
+#define _APS_NEXT_CONTROL_VALUE         1024
 #define _APS_NEXT_SYMED_VALUE           104
 #endif
 #endif
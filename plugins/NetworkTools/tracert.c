@@ -22,6 +22,190 @@
 
 #include "nettools.h"
 
+static VOID NTAPI NetworkTracertRoundCallback(
+    _In_ PNETWORK_ICMP_ENGINE Engine,
+    _In_opt_ PVOID Context
+    )
+{
+    PNETWORK_OUTPUT_CONTEXT context = (PNETWORK_OUTPUT_CONTEXT)Context;
+
+    if (Engine->Round >= Engine->MaximumRounds)
+    {
+        if (PhGetIntegerSetting(L"EnableNetworkResolve"))
+        {
+            WSADATA wsaData;
+            ULONG i;
+
+            if (WSAStartup(WINSOCK_VERSION, &wsaData) == 0)
+            {
+                for (i = 0; i < Engine->NumberOfTargets; i++)
+                {
+                    NETWORK_ICMP_TARGET target;
+                    WCHAR hostName[NI_MAXHOST];
+                    INT result;
+
+                    NetworkIcmpQueryTarget(Engine, i, &target);
+
+                    if (target.RecvCount == 0)
+                        continue;
+
+                    if (target.ReplyAddress.Type == PH_IPV6_NETWORK_TYPE)
+                    {
+                        SOCKADDR_IN6 address = { 0 };
+
+                        address.sin6_family = AF_INET6;
+                        address.sin6_addr = target.ReplyAddress.In6Addr;
+
+                        result = GetNameInfoW((PSOCKADDR)&address, sizeof(address), hostName, NI_MAXHOST, NULL, 0, NI_NAMEREQD);
+                    }
+                    else
+                    {
+                        SOCKADDR_IN address = { 0 };
+
+                        address.sin_family = AF_INET;
+                        address.sin_addr = target.ReplyAddress.InAddr;
+
+                        result = GetNameInfoW((PSOCKADDR)&address, sizeof(address), hostName, NI_MAXHOST, NULL, 0, NI_NAMEREQD);
+                    }
+
+                    if (result == 0)
+                        context->HopNames[i] = PhCreateString(hostName);
+
+                    if (target.LastStatus == IP_SUCCESS)
+                        break;
+                }
+
+                WSACleanup();
+            }
+        }
+
+        // The window only reads the host names once this is set.
+        MemoryBarrier();
+        context->TraceFinished = TRUE;
+    }
+
+    PostMessage(context->WindowHandle, NTM_RECEIVEDICMP, context->TraceFinished, 0);
+}
+
+/**
+ * Starts an in-process traceroute. A probe is sent for every TTL at once,
+ * NETWORK_TRACERT_PROBES times, and the output is updated after each round.
+ */
+BOOLEAN NetworkTracertStart(
+    _In_ PNETWORK_OUTPUT_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    Context->IcmpEngine = NetworkIcmpCreateEngine(
+        NETWORK_TRACERT_MAXIMUM_HOPS,
+        0,
+        PhGetIntegerSetting(SETTING_NAME_PING_TIMEOUT),
+        NETWORK_TRACERT_PROBES,
+        NetworkTracertRoundCallback,
+        Context
+        );
+
+    for (i = 0; i < NETWORK_TRACERT_MAXIMUM_HOPS; i++)
+    {
+        Context->IcmpEngine->Targets[i].Address = Context->IpAddress;
+        Context->IcmpEngine->Targets[i].Ttl = (UCHAR)(i + 1);
+    }
+
+    return NetworkIcmpStartEngine(Context->IcmpEngine);
+}
+
+static PPH_STRING NetworkTracertFormatTime(
+    _In_ PNETWORK_ICMP_TARGET Target,
+    _In_ ULONG Value
+    )
+{
+    if (Target->RecvCount == 0)
+        return PhCreateString(L"*");
+    if (Value == 0)
+        return PhCreateString(L"<1 ms");
+
+    return PhFormatString(L"%lu ms", Value);
+}
+
+VOID NetworkTracertFormatOutput(
+    _In_ PNETWORK_OUTPUT_CONTEXT Context
+    )
+{
+    PH_STRING_BUILDER stringBuilder;
+    ULONG i;
+
+    PhInitializeStringBuilder(&stringBuilder, PAGE_SIZE);
+
+    PhAppendFormatStringBuilder(
+        &stringBuilder,
+        L"Tracing route to %s over a maximum of %lu hops (%lu of %lu probes sent)\r\n\r\n",
+        Context->IpAddressString,
+        NETWORK_TRACERT_MAXIMUM_HOPS,
+        Context->IcmpEngine->Round,
+        NETWORK_TRACERT_PROBES
+        );
+    PhAppendStringBuilder2(&stringBuilder, L"Hop       Min       Avg       Max  Lost  Address\r\n");
+
+    for (i = 0; i < Context->IcmpEngine->NumberOfTargets; i++)
+    {
+        NETWORK_ICMP_TARGET target;
+        PPH_STRING minString;
+        PPH_STRING avgString;
+        PPH_STRING maxString;
+
+        NetworkIcmpQueryTarget(Context->IcmpEngine, i, &target);
+
+        minString = NetworkTracertFormatTime(&target, target.MinMs);
+        avgString = NetworkTracertFormatTime(&target, target.RecvCount ? (ULONG)(target.TotalMs / target.RecvCount) : 0);
+        maxString = NetworkTracertFormatTime(&target, target.MaxMs);
+
+        PhAppendFormatStringBuilder(
+            &stringBuilder,
+            L"%3lu  %8s  %8s  %8s  %4lu  ",
+            i + 1,
+            minString->Buffer,
+            avgString->Buffer,
+            maxString->Buffer,
+            target.LossCount
+            );
+
+        PhDereferenceObject(minString);
+        PhDereferenceObject(avgString);
+        PhDereferenceObject(maxString);
+
+        if (target.RecvCount != 0)
+        {
+            WCHAR addressString[INET6_ADDRSTRLEN];
+
+            if (target.ReplyAddress.Type == PH_IPV6_NETWORK_TYPE)
+                RtlIpv6AddressToString(&target.ReplyAddress.In6Addr, addressString);
+            else
+                RtlIpv4AddressToString(&target.ReplyAddress.InAddr, addressString);
+
+            if (Context->TraceFinished && Context->HopNames[i])
+                PhAppendFormatStringBuilder(&stringBuilder, L"%s [%s]\r\n", Context->HopNames[i]->Buffer, addressString);
+            else
+                PhAppendFormatStringBuilder(&stringBuilder, L"%s\r\n", addressString);
+        }
+        else if (target.Pending)
+        {
+            PhAppendStringBuilder2(&stringBuilder, L"...\r\n");
+        }
+        else
+        {
+            PhAppendStringBuilder2(&stringBuilder, L"Request timed out.\r\n");
+        }
+
+        // Higher TTLs also reach the destination; stop at the first one that did.
+        if (target.RecvCount != 0 && PhEqualIpAddress(&target.ReplyAddress, &Context->IpAddress))
+            break;
+    }
+
+    SetWindowText(Context->OutputHandle, stringBuilder.String->Buffer);
+    PhDeleteStringBuilder(&stringBuilder);
+}
+
 static NTSTATUS StdOutNetworkTracertThreadStart(
     _In_ PVOID Parameter
     )
@@ -78,27 +262,6 @@ NTSTATUS NetworkTracertThreadStart(
 
         switch (context->Action)
         {
-        case NETWORK_ACTION_TRACEROUTE:
-            {
-                if (PhGetIntegerSetting(L"EnableNetworkResolve"))
-                {
-                    command = PhFormatString(
-                        L"%s\\system32\\tracert.exe %s",
-                        USER_SHARED_DATA->NtSystemRoot,
-                        context->IpAddressString
-                        );
-                }
-                else
-                {
-                    // Disable hostname lookup.
-                    command = PhFormatString(
-                        L"%s\\system32\\tracert.exe -d %s",
-                        USER_SHARED_DATA->NtSystemRoot,
-                        context->IpAddressString
-                        );
-                }
-            }
-            break;
         case NETWORK_ACTION_PATHPING:
             {
                 if (PhGetIntegerSetting(L"EnableNetworkResolve"))
@@ -32,7 +32,6 @@
 #include <windowsx.h>
 #include <winhttp.h>
 
-#include "sha256.h"
 #include "resource.h"
 
 #define PLUGIN_NAME L"ProcessHacker.OnlineChecks"
@@ -24,6 +24,8 @@
 #include "onlnchk.h"
 #include "json-c/json.h"
 
+#define UPLOAD_BUFFER_SIZE (64 * 1024)
+
 static SERVICE_INFO UploadServiceInfo[] =
 {
     { UPLOAD_SERVICE_VIRUSTOTAL, L"www.virustotal.com", INTERNET_DEFAULT_HTTPS_PORT, WINHTTP_FLAG_SECURE, L"???", L"file" },
@@ -292,76 +294,28 @@ static BOOLEAN PerformSubRequest(
 
 static NTSTATUS HashFileAndResetPosition(
     _In_ HANDLE FileHandle,
-    _In_ PLARGE_INTEGER FileSize,
     _In_ ULONG Algorithm,
     _Out_ PVOID Hash
     )
 {
     NTSTATUS status;
     IO_STATUS_BLOCK iosb;
-    PH_HASH_CONTEXT hashContext;
-    sha256_context sha256;
-    ULONG64 bytesRemaining;
     FILE_POSITION_INFORMATION positionInfo;
-    UCHAR buffer[PAGE_SIZE];
-
-    bytesRemaining = FileSize->QuadPart;
 
     switch (Algorithm)
     {
     case HASH_SHA1:
-        PhInitializeHash(&hashContext, Sha1HashAlgorithm);
+        status = PhHashFileCached(FileHandle, Sha1HashAlgorithm, Hash, 20, NULL);
         break;
     case HASH_SHA256:
-        sha256_starts(&sha256);
+        status = PhHashFileCached(FileHandle, Sha256HashAlgorithm, Hash, 32, NULL);
         break;
+    default:
+        return STATUS_INVALID_PARAMETER;
     }
 
-    while (bytesRemaining)
-    {
-        status = NtReadFile(
-            FileHandle,
-            NULL,
-            NULL,
-            NULL,
-            &iosb,
-            buffer,
-            sizeof(buffer),
-            NULL,
-            NULL
-            );
-
-        if (!NT_SUCCESS(status))
-            break;
-
-        switch (Algorithm)
-        {
-        case HASH_SHA1:
-            PhUpdateHash(&hashContext, buffer, (ULONG)iosb.Information);
-            break;
-        case HASH_SHA256:
-            sha256_update(&sha256, (PUCHAR)buffer, (ULONG)iosb.Information);
-            break;
-        }
-
-        bytesRemaining -= (ULONG)iosb.Information;
-    }
-
-    if (status == STATUS_END_OF_FILE)
-        status = STATUS_SUCCESS;
-
     if (NT_SUCCESS(status))
     {
-        switch (Algorithm)
-        {
-        case HASH_SHA1:
-            PhFinalHash(&hashContext, Hash, 20, NULL);
-            break;
-        case HASH_SHA256:
-            sha256_finish(&sha256, Hash);
-            break;
-        }
-
         positionInfo.CurrentByteOffset.QuadPart = 0;
         status = NtSetInformationFile(
             FileHandle,
@@ -375,6 +329,21 @@ static NTSTATUS HashFileAndResetPosition(
     return status;
 }
 
+static NTSTATUS WaitForUploadRead(
+    _In_ HANDLE EventHandle,
+    _In_ NTSTATUS Status,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock
+    )
+{
+    if (Status == STATUS_PENDING)
+    {
+        NtWaitForSingleObject(EventHandle, FALSE, NULL);
+        Status = IoStatusBlock->Status;
+    }
+
+    return Status;
+}
+
 static NTSTATUS UploadFileThreadStart(
     _In_ PVOID Parameter
     )
@@ -390,11 +359,18 @@ static NTSTATUS UploadFileThreadStart(
     ULONG totalWriteLength = 0;
     LARGE_INTEGER timeNow;
     LARGE_INTEGER timeStart;
+    LARGE_INTEGER timeLastUpdate;
     ULONG64 timeTicks = 0;
     ULONG64 timeBitsPerSecond = 0;
 
     HANDLE fileHandle = INVALID_HANDLE_VALUE;
-    IO_STATUS_BLOCK isb;
+    HANDLE readEvents[2] = { NULL, NULL };
+    IO_STATUS_BLOCK readIsb[2];
+    NTSTATUS readStatus[2] = { STATUS_SUCCESS, STATUS_SUCCESS };
+    PVOID readBuffers[2] = { NULL, NULL };
+    LARGE_INTEGER readOffset;
+    ULONG current = 0;
+    ULONG bytesRead;
     PSERVICE_INFO serviceInfo = NULL;
     HINTERNET connectHandle = NULL;
     HINTERNET requestHandle = NULL;
@@ -405,7 +381,6 @@ static NTSTATUS UploadFileThreadStart(
     PH_STRING_BUILDER httpRequestHeaders = { 0 };
     PH_STRING_BUILDER httpPostHeader = { 0 };
     PH_STRING_BUILDER httpPostFooter = { 0 };
-    BYTE buffer[PAGE_SIZE];
 
     PUPLOAD_CONTEXT context = (PUPLOAD_CONTEXT)Parameter;
 
@@ -413,7 +388,8 @@ static NTSTATUS UploadFileThreadStart(
 
     __try
     {
-        // Open the file and check its size.
+        // Open the file for asynchronous reads so the next chunk can be read while the current
+        // one is being sent.
         status = PhCreateFileWin32(
             &fileHandle,
             context->FileName->Buffer,
@@ -421,7 +397,7 @@ static NTSTATUS UploadFileThreadStart(
             0,
             FILE_SHARE_READ | FILE_SHARE_DELETE,
             FILE_OPEN,
-            FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+            FILE_NON_DIRECTORY_FILE | FILE_SEQUENTIAL_ONLY
             );
 
         if (!NT_SUCCESS(status))
@@ -430,6 +406,16 @@ static NTSTATUS UploadFileThreadStart(
             __leave;
         }
 
+        if (!NT_SUCCESS(status = NtCreateEvent(&readEvents[0], EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE)) ||
+            !NT_SUCCESS(status = NtCreateEvent(&readEvents[1], EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE)))
+        {
+            RaiseUploadError(context, L"Unable to create the read events", RtlNtStatusToDosError(status));
+            __leave;
+        }
+
+        readBuffers[0] = PhAllocate(UPLOAD_BUFFER_SIZE);
+        readBuffers[1] = PhAllocate(UPLOAD_BUFFER_SIZE);
+
         // Connect to the online service.
         if (!(connectHandle = WinHttpConnect(
             context->HttpHandle,
@@ -588,6 +574,7 @@ static NTSTATUS UploadFileThreadStart(
 
         // Start the clock.
         PhQuerySystemTime(&timeStart);
+        timeLastUpdate = timeStart;
 
         // Write the header
         if (!WinHttpWriteData(
@@ -601,35 +588,72 @@ static NTSTATUS UploadFileThreadStart(
             __leave;
         }
 
-        // Upload the file...
+        // Upload the file. The read of the next chunk is queued before the current chunk is
+        // written, so the disk and the network are kept busy at the same time.
+        readOffset.QuadPart = 0;
+        readStatus[current] = NtReadFile(
+            fileHandle,
+            readEvents[current],
+            NULL,
+            NULL,
+            &readIsb[current],
+            readBuffers[current],
+            UPLOAD_BUFFER_SIZE,
+            &readOffset,
+            NULL
+            );
+
         while (TRUE)
         {
-            status = NtReadFile(
+            status = WaitForUploadRead(readEvents[current], readStatus[current], &readIsb[current]);
+            readStatus[current] = STATUS_SUCCESS;
+
+            if (status == STATUS_END_OF_FILE)
+            {
+                status = STATUS_SUCCESS;
+                break;
+            }
+
+            if (!NT_SUCCESS(status))
+            {
+                RaiseUploadError(context, L"Unable to read the file", RtlNtStatusToDosError(status));
+                __leave;
+            }
+
+            if ((bytesRead = (ULONG)readIsb[current].Information) == 0)
+                break;
+
+            readOffset.QuadPart += bytesRead;
+            readStatus[!current] = NtReadFile(
                 fileHandle,
+                readEvents[!current],
                 NULL,
                 NULL,
-                NULL,
-                &isb,
-                buffer,
-                PAGE_SIZE,
-                NULL,
+                &readIsb[!current],
+                readBuffers[!current],
+                UPLOAD_BUFFER_SIZE,
+                &readOffset,
                 NULL
                 );
 
-            if (!NT_SUCCESS(status))
-                break;
-
-            if (!WinHttpWriteData(requestHandle, buffer, (ULONG)isb.Information, &totalWriteLength))
+            if (!WinHttpWriteData(requestHandle, readBuffers[current], bytesRead, &totalWriteLength))
             {
                 RaiseUploadError(context, L"Unable to upload the file data", GetLastError());
                 __leave;
             }
 
             totalUploadedLength += totalWriteLength;
+            current = !current;
 
             // Query the current time
             PhQuerySystemTime(&timeNow);
 
+            // Formatting the status text is relatively expensive, so only do it a few times a second.
+            if (timeNow.QuadPart - timeLastUpdate.QuadPart < PH_TICKS_PER_MS * 250 && totalUploadedLength < context->TotalFileLength)
+                continue;
+
+            timeLastUpdate = timeNow;
+
             // Calculate the number of ticks
             timeTicks = (timeNow.QuadPart - timeStart.QuadPart) / PH_TICKS_PER_SEC;
             timeBitsPerSecond = totalUploadedLength / __max(timeTicks, 1);
@@ -824,6 +848,30 @@ static NTSTATUS UploadFileThreadStart(
             PhDeleteStringBuilder(&httpRequestHeaders);
         }
 
+        // Make sure no read is still writing into the buffers before they are freed.
+        WaitForUploadRead(readEvents[0], readStatus[0], &readIsb[0]);
+        WaitForUploadRead(readEvents[1], readStatus[1], &readIsb[1]);
+
+        if (readBuffers[1])
+        {
+            PhFree(readBuffers[1]);
+        }
+
+        if (readBuffers[0])
+        {
+            PhFree(readBuffers[0]);
+        }
+
+        if (readEvents[1])
+        {
+            NtClose(readEvents[1]);
+        }
+
+        if (readEvents[0])
+        {
+            NtClose(readEvents[0]);
+        }
+
         if (fileHandle != INVALID_HANDLE_VALUE)
         {
             NtClose(fileHandle);
@@ -945,7 +993,7 @@ static NTSTATUS UploadCheckThreadStart(
                 UCHAR hash[32];
                 json_object_ptr rootJsonObject;
 
-                if (!NT_SUCCESS(status = HashFileAndResetPosition(fileHandle, &fileSize64, HASH_SHA256, hash)))
+                if (!NT_SUCCESS(status = HashFileAndResetPosition(fileHandle, HASH_SHA256, hash)))
                 {
                     RaiseUploadError(context, L"Unable to hash the file", RtlNtStatusToDosError(status));
                     __leave;
@@ -1006,7 +1054,7 @@ static NTSTATUS UploadCheckThreadStart(
                 ULONG status = 0;
                 ULONG statusLength = sizeof(statusLength);
 
-                if (!NT_SUCCESS(status = HashFileAndResetPosition(fileHandle, &fileSize64, HASH_SHA256, hash)))
+                if (!NT_SUCCESS(status = HashFileAndResetPosition(fileHandle, HASH_SHA256, hash)))
                 {
                     RaiseUploadError(context, L"Unable to hash the file", RtlNtStatusToDosError(status));
                     __leave;
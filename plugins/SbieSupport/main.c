@@ -62,6 +62,11 @@ VOID NTAPI ProcessesUpdatedCallback(
     _In_opt_ PVOID Context
     );
 
+VOID NTAPI ProcessAddedOrRemovedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    );
+
 VOID NTAPI GetProcessHighlightingColorCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -95,6 +100,8 @@ PH_CALLBACK_REGISTRATION PluginShowOptionsCallbackRegistration;
 PH_CALLBACK_REGISTRATION PluginMenuItemCallbackRegistration;
 PH_CALLBACK_REGISTRATION MainMenuInitializingCallbackRegistration;
 PH_CALLBACK_REGISTRATION ProcessesUpdatedCallbackRegistration;
+PH_CALLBACK_REGISTRATION ProcessAddedCallbackRegistration;
+PH_CALLBACK_REGISTRATION ProcessRemovedCallbackRegistration;
 PH_CALLBACK_REGISTRATION GetProcessHighlightingColorCallbackRegistration;
 PH_CALLBACK_REGISTRATION GetProcessTooltipTextCallbackRegistration;
 
@@ -106,6 +113,8 @@ P_SbieDll_KillAll SbieDll_KillAll;
 PPH_HASHTABLE BoxedProcessesHashtable;
 PH_QUEUED_LOCK BoxedProcessesLock = PH_QUEUED_LOCK_INIT;
 BOOLEAN BoxedProcessesUpdated = FALSE;
+PPH_LIST BoxedProcessesChangedList; // IDs of processes that entered or left a box since the last update
+LONG ProcessSetChanged = TRUE;
 
 BOX_INFO BoxInfo[16];
 ULONG BoxInfoCount;
@@ -164,6 +173,18 @@ LOGICAL DllMain(
                 NULL,
                 &ProcessesUpdatedCallbackRegistration
                 );
+            PhRegisterCallback(
+                &PhProcessAddedEvent,
+                ProcessAddedOrRemovedCallback,
+                NULL,
+                &ProcessAddedCallbackRegistration
+                );
+            PhRegisterCallback(
+                &PhProcessRemovedEvent,
+                ProcessAddedOrRemovedCallback,
+                NULL,
+                &ProcessRemovedCallbackRegistration
+                );
             PhRegisterCallback(
                 PhGetGeneralCallback(GeneralCallbackGetProcessHighlightingColor),
                 GetProcessHighlightingColorCallback,
@@ -207,6 +228,18 @@ ULONG NTAPI BoxedProcessesHashFunction(
     return HandleToUlong(((PBOXED_PROCESS)Entry)->ProcessId) / 4;
 }
 
+PPH_HASHTABLE CreateBoxedProcessesHashtable(
+    VOID
+    )
+{
+    return PhCreateHashtable(
+        sizeof(BOXED_PROCESS),
+        BoxedProcessesCompareFunction,
+        BoxedProcessesHashFunction,
+        32
+        );
+}
+
 VOID NTAPI LoadCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -217,12 +250,8 @@ VOID NTAPI LoadCallback(
     HANDLE timerQueueHandle;
     HANDLE timerHandle;
 
-    BoxedProcessesHashtable = PhCreateHashtable(
-        sizeof(BOXED_PROCESS),
-        BoxedProcessesCompareFunction,
-        BoxedProcessesHashFunction,
-        32
-        );
+    BoxedProcessesHashtable = CreateBoxedProcessesHashtable();
+    BoxedProcessesChangedList = PhCreateList(8);
 
     sbieDllPath = PhGetStringSetting(SETTING_NAME_SBIE_DLL_PATH);
     module = LoadLibrary(sbieDllPath->Buffer);
@@ -318,32 +347,42 @@ VOID NTAPI ProcessesUpdatedCallback(
     _In_opt_ PVOID Context
     )
 {
-    PBOXED_PROCESS boxedProcess;
-    ULONG enumerationKey = 0;
+    ULONG i;
 
     if (BoxedProcessesUpdated)
     {
-        // Invalidate the nodes of boxed processes (so they use the correct highlighting color).
+        // Invalidate the nodes of processes that entered or left a box (so they use the correct
+        // highlighting color).
 
-        PhAcquireQueuedLockShared(&BoxedProcessesLock);
+        PhAcquireQueuedLockExclusive(&BoxedProcessesLock);
 
         if (BoxedProcessesUpdated)
         {
-            while (PhEnumHashtable(BoxedProcessesHashtable, &boxedProcess, &enumerationKey))
+            for (i = 0; i < BoxedProcessesChangedList->Count; i++)
             {
                 PPH_PROCESS_NODE processNode;
 
-                if (processNode = PhFindProcessNode(boxedProcess->ProcessId))
+                if (processNode = PhFindProcessNode(BoxedProcessesChangedList->Items[i]))
                     PhUpdateProcessNode(processNode);
             }
 
+            PhClearList(BoxedProcessesChangedList);
             BoxedProcessesUpdated = FALSE;
         }
 
-        PhReleaseQueuedLockShared(&BoxedProcessesLock);
+        PhReleaseQueuedLockExclusive(&BoxedProcessesLock);
     }
 }
 
+VOID NTAPI ProcessAddedOrRemovedCallback(
+    _In_opt_ PVOID Parameter,
+    _In_opt_ PVOID Context
+    )
+{
+    // Sandboxie is only queried again when the set of processes has changed.
+    InterlockedExchange(&ProcessSetChanged, TRUE);
+}
+
 VOID NTAPI GetProcessHighlightingColorCallback(
     _In_opt_ PVOID Parameter,
     _In_opt_ PVOID Context
@@ -397,13 +436,23 @@ VOID NTAPI RefreshSandboxieInfo(
     WCHAR boxName[34];
     ULONG pids[512];
     PBOX_INFO boxInfo;
+    PPH_HASHTABLE oldHashtable;
+    PBOXED_PROCESS boxedProcess;
+    PBOXED_PROCESS otherBoxedProcess;
+    ULONG enumerationKey;
 
     if (!SbieApi_QueryBoxPath || !SbieApi_EnumBoxes || !SbieApi_EnumProcessEx)
         return;
 
+    // Reset the flag before enumerating so that changes made during the enumeration cause
+    // another refresh.
+    if (!InterlockedExchange(&ProcessSetChanged, FALSE))
+        return;
+
     PhAcquireQueuedLockExclusive(&BoxedProcessesLock);
 
-    PhClearHashtable(BoxedProcessesHashtable);
+    oldHashtable = BoxedProcessesHashtable;
+    BoxedProcessesHashtable = CreateBoxedProcessesHashtable();
 
     BoxInfoCount = 0;
 
@@ -481,7 +530,30 @@ VOID NTAPI RefreshSandboxieInfo(
         }
     }
 
-    BoxedProcessesUpdated = TRUE;
+    // Only the processes that entered, left or moved between boxes need their nodes updated.
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(BoxedProcessesHashtable, &boxedProcess, &enumerationKey))
+    {
+        otherBoxedProcess = PhFindEntryHashtable(oldHashtable, boxedProcess);
+
+        if (!otherBoxedProcess || !PhEqualStringZ(otherBoxedProcess->BoxName, boxedProcess->BoxName, FALSE))
+            PhAddItemList(BoxedProcessesChangedList, boxedProcess->ProcessId);
+    }
+
+    enumerationKey = 0;
+
+    while (PhEnumHashtable(oldHashtable, &boxedProcess, &enumerationKey))
+    {
+        if (!PhFindEntryHashtable(BoxedProcessesHashtable, boxedProcess))
+            PhAddItemList(BoxedProcessesChangedList, boxedProcess->ProcessId);
+    }
+
+    PhDereferenceObject(oldHashtable);
+
+    if (BoxedProcessesChangedList->Count != 0)
+        BoxedProcessesUpdated = TRUE;
 
     PhReleaseQueuedLockExclusive(&BoxedProcessesLock);
 }
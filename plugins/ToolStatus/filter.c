@@ -28,23 +28,10 @@ BOOLEAN WordMatchStringRef(
     _In_ PPH_STRINGREF Text
     )
 {
-    PH_STRINGREF part;
-    PH_STRINGREF remainingPart;
+    if (!SearchboxQuery)
+        return FALSE;
 
-    remainingPart = SearchboxText->sr;
-
-    while (remainingPart.Length != 0)
-    {
-        PhSplitStringRefAtChar(&remainingPart, '|', &part, &remainingPart);
-
-        if (part.Length != 0)
-        {
-            if (PhFindStringInStringRef(Text, &part, TRUE) != -1)
-                return TRUE;
-        }
-    }
-
-    return FALSE;
+    return PhMatchTreeNewFilterQueryString(SearchboxQuery, Text);
 }
 
 static BOOLEAN WordMatchStringZ(
@@ -57,6 +44,17 @@ static BOOLEAN WordMatchStringZ(
     return WordMatchStringRef(&text);
 }
 
+static BOOLEAN WordMatchNumber(
+    _In_ PWSTR FieldName,
+    _In_ DOUBLE Value
+    )
+{
+    if (!SearchboxQuery)
+        return FALSE;
+
+    return PhMatchTreeNewFilterQueryNumber(SearchboxQuery, FieldName, Value);
+}
+
 BOOLEAN ProcessTreeFilterCallback(
     _In_ PPH_TREENEW_NODE Node,
     _In_opt_ PVOID Context
@@ -67,6 +65,23 @@ BOOLEAN ProcessTreeFilterCallback(
     if (PhIsNullOrEmptyString(SearchboxText))
         return TRUE;
 
+    // Numeric comparisons are cheap, so check them before the string fields.
+    if (SearchboxQuery && PhIsTreeNewFilterQueryNumeric(SearchboxQuery))
+    {
+        if (WordMatchNumber(L"cpu", processNode->ProcessItem->CpuUsage * 100))
+            return TRUE;
+        if (WordMatchNumber(L"pid", HandleToUlong(processNode->ProcessItem->ProcessId)))
+            return TRUE;
+        if (WordMatchNumber(L"threads", processNode->ProcessItem->NumberOfThreads))
+            return TRUE;
+        if (WordMatchNumber(L"handles", processNode->ProcessItem->NumberOfHandles))
+            return TRUE;
+        if (WordMatchNumber(L"private", (DOUBLE)processNode->ProcessItem->VmCounters.PagefileUsage))
+            return TRUE;
+        if (WordMatchNumber(L"ws", (DOUBLE)processNode->ProcessItem->VmCounters.WorkingSetSize))
+            return TRUE;
+    }
+
     if (!PhIsNullOrEmptyString(processNode->ProcessItem->ProcessName))
     {
         if (WordMatchStringRef(&processNode->ProcessItem->ProcessName->sr))
@@ -356,6 +371,9 @@ BOOLEAN ServiceTreeFilterCallback(
     if (PhIsNullOrEmptyString(SearchboxText))
         return TRUE;
 
+    if (serviceNode->ServiceItem->ProcessId && WordMatchNumber(L"pid", HandleToUlong(serviceNode->ServiceItem->ProcessId)))
+        return TRUE;
+
     if (WordMatchStringZ(PhGetServiceTypeString(serviceNode->ServiceItem->Type)))
         return TRUE;
 
@@ -403,6 +421,13 @@ BOOLEAN NetworkTreeFilterCallback(
     if (PhIsNullOrEmptyString(SearchboxText))
         return TRUE;
 
+    if (WordMatchNumber(L"pid", HandleToUlong(networkNode->NetworkItem->ProcessId)))
+        return TRUE;
+    if (WordMatchNumber(L"localport", networkNode->NetworkItem->LocalEndpoint.Port))
+        return TRUE;
+    if (WordMatchNumber(L"remoteport", networkNode->NetworkItem->RemoteEndpoint.Port))
+        return TRUE;
+
     if (!PhIsNullOrEmptyString(networkNode->NetworkItem->ProcessName))
     {
         if (WordMatchStringRef(&networkNode->NetworkItem->ProcessName->sr))
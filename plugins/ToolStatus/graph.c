@@ -30,11 +30,28 @@ static PH_GRAPH_STATE CpuGraphState;
 static PH_GRAPH_STATE MemGraphState;
 static PH_GRAPH_STATE CommitGraphState;
 static PH_GRAPH_STATE IoGraphState;
+static PPH_SETTING ColorCpuKernelSetting = NULL;
+static PPH_SETTING ColorCpuUserSetting;
+static PPH_SETTING ColorPhysicalSetting;
+static PPH_SETTING ColorPrivateSetting;
+static PPH_SETTING ColorIoReadOtherSetting;
+static PPH_SETTING ColorIoWriteSetting;
 
 VOID ToolbarCreateGraphs(VOID)
 {
     UINT height = (UINT)SendMessage(RebarHandle, RB_GETROWHEIGHT, 0, 0);
 
+    // The graph colors are read every time a graph is drawn.
+    if (!ColorCpuKernelSetting)
+    {
+        ColorCpuKernelSetting = PhGetSettingHandle(L"ColorCpuKernel");
+        ColorCpuUserSetting = PhGetSettingHandle(L"ColorCpuUser");
+        ColorPhysicalSetting = PhGetSettingHandle(L"ColorPhysical");
+        ColorPrivateSetting = PhGetSettingHandle(L"ColorPrivate");
+        ColorIoReadOtherSetting = PhGetSettingHandle(L"ColorIoReadOther");
+        ColorIoWriteSetting = PhGetSettingHandle(L"ColorIoWrite");
+    }
+
     if (ToolStatusConfig.CpuGraphEnabled && !CpuGraphHandle)
     {
         CpuGraphHandle = CreateWindow(
@@ -397,7 +414,7 @@ VOID ToolbarUpdateGraphsInfo(LPNMHDR Header)
                 PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
 
                 drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
-                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSetting(L"ColorCpuKernel"), PhGetIntegerSetting(L"ColorCpuUser"));
+                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSettingValue(ColorCpuKernelSetting), PhGetIntegerSettingValue(ColorCpuUserSetting));
 
                 if (ProcessesUpdatedCount < 2)
                     return;
@@ -420,7 +437,7 @@ VOID ToolbarUpdateGraphsInfo(LPNMHDR Header)
                 PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
 
                 drawInfo->Flags = PH_GRAPH_USE_GRID;
-                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSetting(L"ColorPhysical"), 0);
+                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSettingValue(ColorPhysicalSetting), 0);
 
                 if (ProcessesUpdatedCount < 2)
                     return;
@@ -449,7 +466,7 @@ VOID ToolbarUpdateGraphsInfo(LPNMHDR Header)
                 PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
 
                 drawInfo->Flags = PH_GRAPH_USE_GRID;
-                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSetting(L"ColorPrivate"), 0);
+                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSettingValue(ColorPrivateSetting), 0);
 
                 if (ProcessesUpdatedCount < 2)
                     return;
@@ -478,7 +495,7 @@ VOID ToolbarUpdateGraphsInfo(LPNMHDR Header)
                 PPH_GRAPH_DRAW_INFO drawInfo = getDrawInfo->DrawInfo;
 
                 drawInfo->Flags = PH_GRAPH_USE_GRID | PH_GRAPH_USE_LINE_2;
-                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSetting(L"ColorIoReadOther"), PhGetIntegerSetting(L"ColorIoWrite"));
+                PhSiSetColorsGraphDrawInfo(drawInfo, PhGetIntegerSettingValue(ColorIoReadOtherSetting), PhGetIntegerSettingValue(ColorIoWriteSetting));
 
                 if (ProcessesUpdatedCount < 2)
                     return;
@@ -53,6 +53,7 @@ HWND SearchboxHandle = NULL;
 HMENU MainMenu = NULL;
 HACCEL AcceleratorTable = NULL;
 PPH_STRING SearchboxText = NULL;
+PPH_TN_FILTER_QUERY SearchboxQuery = NULL; // compiled from SearchboxText
 PH_PLUGIN_SYSTEM_STATISTICS SystemStatistics = { 0 };
 PH_CALLBACK_DECLARE(SearchChangedEvent);
 PPH_HASHTABLE TabInfoHashtable;
@@ -109,6 +110,10 @@ static VOID NTAPI ProcessesUpdatedCallback(
 
     if (ToolStatusConfig.StatusBarEnabled)
         StatusBarUpdate(FALSE);
+
+    // Comparisons such as "cpu>5" depend on the latest statistics.
+    if (SearchboxQuery && PhIsTreeNewFilterQueryNumeric(SearchboxQuery))
+        PhApplyTreeNewFilters(PhGetFilterSupportProcessTreeList());
 }
 
 VOID NTAPI TreeNewInitializingCallback(
@@ -613,6 +618,24 @@ static VOID DrawWindowBorderForTargeting(
     }
 }
 
+static VOID ApplySearchboxFilter(
+    VOID
+    )
+{
+    KillTimer(PhMainWndHandle, TIMER_SEARCHBOX_APPLY_FILTER);
+
+    // Expand the nodes so we can search them
+    PhExpandAllProcessNodes(TRUE);
+    PhDeselectAllProcessNodes();
+    PhDeselectAllServiceNodes();
+
+    PhApplyTreeNewFilters(PhGetFilterSupportProcessTreeList());
+    PhApplyTreeNewFilters(PhGetFilterSupportServiceTreeList());
+    PhApplyTreeNewFilters(PhGetFilterSupportNetworkTreeList());
+
+    PhInvokeCallback(&SearchChangedEvent, SearchboxText);
+}
+
 static LRESULT CALLBACK MainWndSubclassProc(
     _In_ HWND hWnd,
     _In_ UINT uMsg,
@@ -633,19 +656,18 @@ static LRESULT CALLBACK MainWndSubclassProc(
                     if (GET_WM_COMMAND_HWND(wParam, lParam) != SearchboxHandle)
                         break;
 
-                    // Cache the current search text for our callback.
+                    // Cache the current search text for our callback, and compile it once instead
+                    // of parsing it for every node.
                     PhMoveReference(&SearchboxText, PhGetWindowText(SearchboxHandle));
+                    PhMoveReference(&SearchboxQuery, PhCreateTreeNewFilterQuery(&SearchboxText->sr));
 
-                    // Expand the nodes so we can search them
-                    PhExpandAllProcessNodes(TRUE);
-                    PhDeselectAllProcessNodes();
-                    PhDeselectAllServiceNodes();
-
-                    PhApplyTreeNewFilters(PhGetFilterSupportProcessTreeList());
-                    PhApplyTreeNewFilters(PhGetFilterSupportServiceTreeList());
-                    PhApplyTreeNewFilters(PhGetFilterSupportNetworkTreeList());
-
-                    PhInvokeCallback(&SearchChangedEvent, SearchboxText);
+                    // Clearing the search restores the trees immediately. Otherwise wait until the
+                    // user pauses typing and filter every tree in one pass; each keystroke restarts
+                    // the timer, which cancels the pending pass.
+                    if (SearchboxText->Length == 0)
+                        ApplySearchboxFilter();
+                    else
+                        SetTimer(PhMainWndHandle, TIMER_SEARCHBOX_APPLY_FILTER, SEARCHBOX_APPLY_FILTER_DELAY, NULL);
 
                     goto DefaultWndProc;
                 }
@@ -1227,6 +1249,15 @@ static LRESULT CALLBACK MainWndSubclassProc(
             }
         }
         break;
+    case WM_TIMER:
+        {
+            if (wParam == TIMER_SEARCHBOX_APPLY_FILTER)
+            {
+                ApplySearchboxFilter();
+                return 0;
+            }
+        }
+        break;
     case WM_SIZE:
         // Resize PH main window client-area.
         ProcessHacker_InvalidateLayoutPadding(hWnd);
@@ -57,6 +57,9 @@
 #define TIDC_FINDWINDOWKILL (WM_APP + 4)
 #define TIDC_POWERMENUDROPDOWN (WM_APP + 5)
 
+#define TIMER_SEARCHBOX_APPLY_FILTER (WM_APP + 6)
+#define SEARCHBOX_APPLY_FILTER_DELAY 150
+
 typedef enum _TOOLBAR_DISPLAY_STYLE
 {
     TOOLBAR_DISPLAY_STYLE_IMAGEONLY,
@@ -149,6 +152,7 @@ extern HWND SearchboxHandle;
 extern HMENU MainMenu;
 extern HACCEL AcceleratorTable;
 extern PPH_STRING SearchboxText;
+extern PPH_TN_FILTER_QUERY SearchboxQuery;
 extern PH_PLUGIN_SYSTEM_STATISTICS SystemStatistics;
 
 extern HIMAGELIST ToolBarImageList;
@@ -652,13 +652,84 @@ static NTSTATUS UpdateCheckThread(
     return STATUS_SUCCESS;
 }
 
+static NTSTATUS SetDownloadFilePosition(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG Position
+    )
+{
+    IO_STATUS_BLOCK isb;
+    FILE_POSITION_INFORMATION positionInfo;
+
+    positionInfo.CurrentByteOffset.QuadPart = Position;
+
+    return NtSetInformationFile(
+        FileHandle,
+        &isb,
+        &positionInfo,
+        sizeof(FILE_POSITION_INFORMATION),
+        FilePositionInformation
+        );
+}
+
+static NTSTATUS HashExistingDownload(
+    _In_ HANDLE FileHandle,
+    _Inout_ PPH_HASH_CONTEXT HashContext,
+    _Out_ PULONG DownloadedBytes
+    )
+{
+    NTSTATUS status;
+    IO_STATUS_BLOCK isb;
+    BYTE buffer[PAGE_SIZE];
+    ULONG downloadedBytes = 0;
+
+    // Reads whatever a previous attempt left in the file and leaves the file position at the end,
+    // ready for the remaining bytes to be appended.
+
+    while (TRUE)
+    {
+        status = NtReadFile(
+            FileHandle,
+            NULL,
+            NULL,
+            NULL,
+            &isb,
+            buffer,
+            sizeof(buffer),
+            NULL,
+            NULL
+            );
+
+        if (status == STATUS_END_OF_FILE)
+            break;
+        if (!NT_SUCCESS(status))
+            return status;
+        if (isb.Information == 0)
+            break;
+
+        PhUpdateHash(HashContext, buffer, (ULONG)isb.Information);
+        downloadedBytes += (ULONG)isb.Information;
+    }
+
+    *DownloadedBytes = downloadedBytes;
+
+    return STATUS_SUCCESS;
+}
+
 static NTSTATUS UpdateDownloadThread(
     _In_ PVOID Parameter
     )
 {
     BOOLEAN downloadSuccess = FALSE;
+    BOOLEAN downloadComplete = FALSE;
     BOOLEAN hashSuccess = FALSE;
     BOOLEAN verifySuccess = FALSE;
+    ULONG attempt;
+    ULONG downloadedBytes = 0;
+    ULONG contentLength = 0;
+    BYTE buffer[PAGE_SIZE];
+    BYTE hashBuffer[20];
+    PH_HASH_CONTEXT hashContext;
+    IO_STATUS_BLOCK isb;
     HANDLE tempFileHandle = NULL;
     HINTERNET httpSessionHandle = NULL;
     HINTERNET httpConnectionHandle = NULL;
@@ -713,7 +784,7 @@ static NTSTATUS UpdateDownloadThread(
             FILE_GENERIC_READ | FILE_GENERIC_WRITE,
             FILE_ATTRIBUTE_NOT_CONTENT_INDEXED | FILE_ATTRIBUTE_TEMPORARY,
             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-            FILE_OVERWRITE_IF,
+            FILE_OPEN_IF,
             FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
             )))
         {
@@ -791,53 +862,110 @@ static NTSTATUS UpdateDownloadThread(
             __leave;
         }
 
-        if (!(httpRequestHandle = WinHttpOpenRequest(
-            httpConnectionHandle,
-            NULL,
-            downloadUrlPath->Buffer,
-            NULL,
-            WINHTTP_NO_REFERER,
-            WINHTTP_DEFAULT_ACCEPT_TYPES,
-            WINHTTP_FLAG_REFRESH | (httpUrlComponents.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0)
-            )))
-        {
-            __leave;
-        }
-
-        SetDlgItemText(context->DialogHandle, IDC_STATUS, L"Sending request...");
+        // Resume a previous partial download of this release. The bytes that are already on disk
+        // are hashed first so that the final digest covers the whole file; everything received
+        // from now on is hashed as it arrives.
+        PhInitializeHash(&hashContext, Sha1HashAlgorithm);
 
-        if (!WinHttpSendRequest(
-            httpRequestHandle,
-            WINHTTP_NO_ADDITIONAL_HEADERS,
-            0,
-            WINHTTP_NO_REQUEST_DATA,
-            0,
-            WINHTTP_IGNORE_REQUEST_TOTAL_LENGTH,
-            0
-            ))
-        {
+        if (!NT_SUCCESS(HashExistingDownload(tempFileHandle, &hashContext, &downloadedBytes)))
             __leave;
-        }
 
-        SetDlgItemText(context->DialogHandle, IDC_STATUS, L"Waiting for response...");
-
-        if (WinHttpReceiveResponse(httpRequestHandle, NULL))
+        for (attempt = 0; attempt < UPDATE_DOWNLOAD_MAX_ATTEMPTS && !downloadComplete; attempt++)
         {
-            ULONG bytesDownloaded = 0;
-            ULONG downloadedBytes = 0;
+            ULONG httpStatus = 0;
+            ULONG httpStatusSize = sizeof(ULONG);
             ULONG contentLengthSize = sizeof(ULONG);
-            ULONG contentLength = 0;
-            BYTE buffer[PAGE_SIZE];
-            BYTE hashBuffer[20];
+            ULONG responseLength = 0;
+            ULONG bytesDownloaded = 0;
 
-            PH_HASH_CONTEXT hashContext;
-            IO_STATUS_BLOCK isb;
+            if (attempt != 0)
+            {
+                // Give a lossy link a moment before asking for the rest of the file.
+                SetDlgItemText(context->DialogHandle, IDC_STATUS, L"Connection lost, resuming...");
+                Sleep(UPDATE_DOWNLOAD_RETRY_DELAY);
+            }
+
+            if (!UpdateDialogThreadHandle)
+                __leave;
+
+            if (httpRequestHandle)
+            {
+                WinHttpCloseHandle(httpRequestHandle);
+                httpRequestHandle = NULL;
+            }
+
+            if (!(httpRequestHandle = WinHttpOpenRequest(
+                httpConnectionHandle,
+                NULL,
+                downloadUrlPath->Buffer,
+                NULL,
+                WINHTTP_NO_REFERER,
+                WINHTTP_DEFAULT_ACCEPT_TYPES,
+                WINHTTP_FLAG_REFRESH | (httpUrlComponents.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0)
+                )))
+            {
+                continue;
+            }
+
+            if (downloadedBytes != 0)
+            {
+                PPH_STRING rangeHeader;
+
+                rangeHeader = PhFormatString(L"Range: bytes=%lu-", downloadedBytes);
+                WinHttpAddRequestHeaders(
+                    httpRequestHandle,
+                    rangeHeader->Buffer,
+                    (ULONG)rangeHeader->Length / sizeof(WCHAR),
+                    WINHTTP_ADDREQ_FLAG_ADD | WINHTTP_ADDREQ_FLAG_REPLACE
+                    );
+                PhDereferenceObject(rangeHeader);
+            }
+
+            SetDlgItemText(context->DialogHandle, IDC_STATUS, L"Sending request...");
+
+            if (!WinHttpSendRequest(
+                httpRequestHandle,
+                WINHTTP_NO_ADDITIONAL_HEADERS,
+                0,
+                WINHTTP_NO_REQUEST_DATA,
+                0,
+                WINHTTP_IGNORE_REQUEST_TOTAL_LENGTH,
+                0
+                ))
+            {
+                continue;
+            }
+
+            SetDlgItemText(context->DialogHandle, IDC_STATUS, L"Waiting for response...");
+
+            if (!WinHttpReceiveResponse(httpRequestHandle, NULL))
+                continue;
+
+            WinHttpQueryHeaders(
+                httpRequestHandle,
+                WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                WINHTTP_HEADER_NAME_BY_INDEX,
+                &httpStatus,
+                &httpStatusSize,
+                0
+                );
+
+            if (httpStatus == HTTP_STATUS_RANGE_NOT_SATISFIABLE && downloadedBytes != 0)
+            {
+                // The file on disk is already complete (or is not a prefix of this release, in
+                // which case the hash check fails and the file is discarded).
+                downloadComplete = TRUE;
+                break;
+            }
+
+            if (httpStatus != HTTP_STATUS_OK && httpStatus != HTTP_STATUS_PARTIAL_CONTENT)
+                __leave;
 
             if (!WinHttpQueryHeaders(
                 httpRequestHandle,
                 WINHTTP_QUERY_CONTENT_LENGTH | WINHTTP_QUERY_FLAG_NUMBER,
                 WINHTTP_HEADER_NAME_BY_INDEX,
-                &contentLength,
+                &responseLength,
                 &contentLengthSize,
                 0
                 ))
@@ -845,16 +973,29 @@ static NTSTATUS UpdateDownloadThread(
                 __leave;
             }
 
-            // Initialize hash algorithm.
-            PhInitializeHash(&hashContext, Sha1HashAlgorithm);
+            if (httpStatus == HTTP_STATUS_OK && downloadedBytes != 0)
+            {
+                LARGE_INTEGER fileSize;
+
+                // The server ignored the range, so start over from the beginning.
+                fileSize.QuadPart = 0;
 
-            // Zero the buffer.
-            memset(buffer, 0, PAGE_SIZE);
+                if (!NT_SUCCESS(PhSetFileSize(tempFileHandle, &fileSize)) ||
+                    !NT_SUCCESS(SetDownloadFilePosition(tempFileHandle, 0)))
+                {
+                    __leave;
+                }
+
+                PhInitializeHash(&hashContext, Sha1HashAlgorithm);
+                downloadedBytes = 0;
+            }
+
+            contentLength = downloadedBytes + responseLength;
 
             // Download the data.
-            while (WinHttpReadData(httpRequestHandle, buffer, PAGE_SIZE, &bytesDownloaded))
+            while (WinHttpReadData(httpRequestHandle, buffer, sizeof(buffer), &bytesDownloaded))
             {
-                // If we get zero bytes, the file was uploaded or there was an error
+                // If we get zero bytes, the file was downloaded or there was an error
                 if (bytesDownloaded == 0)
                     break;
 
@@ -882,7 +1023,7 @@ static NTSTATUS UpdateDownloadThread(
                     __leave;
                 }
 
-                downloadedBytes += (DWORD)isb.Information;
+                downloadedBytes += (ULONG)isb.Information;
 
                 // Check the number of bytes written are the same we downloaded.
                 if (bytesDownloaded != isb.Information)
@@ -913,19 +1054,38 @@ static NTSTATUS UpdateDownloadThread(
                 }
             }
 
-            // Compute hash result (will fail if file not downloaded correctly).
-            if (PhFinalHash(&hashContext, &hashBuffer, 20, NULL))
-            {
-                // Allocate our hash string, hex the final hash result in our hashBuffer.
-                PPH_STRING hexString = PhBufferToHexString(hashBuffer, 20);
+            // A short read means the connection dropped; the next attempt asks for the rest.
+            if (downloadedBytes >= contentLength)
+                downloadComplete = TRUE;
+        }
 
-                if (PhEqualString(hexString, context->Hash, TRUE))
-                {
-                    hashSuccess = TRUE;
-                }
+        if (!downloadComplete)
+            __leave;
 
-                PhDereferenceObject(hexString);
+        // Compute hash result (will fail if file not downloaded correctly).
+        if (PhFinalHash(&hashContext, &hashBuffer, 20, NULL))
+        {
+            // Allocate our hash string, hex the final hash result in our hashBuffer.
+            PPH_STRING hexString = PhBufferToHexString(hashBuffer, 20);
+
+            if (PhEqualString(hexString, context->Hash, TRUE))
+            {
+                hashSuccess = TRUE;
+
+                // We hashed the setup file while writing it; don't let anyone hash it again.
+                PhAddFileHashCache(tempFileHandle, Sha1HashAlgorithm, hashBuffer, 20);
             }
+
+            PhDereferenceObject(hexString);
+        }
+
+        if (!hashSuccess)
+        {
+            LARGE_INTEGER fileSize;
+
+            // Don't resume from a corrupt file next time.
+            fileSize.QuadPart = 0;
+            PhSetFileSize(tempFileHandle, &fileSize);
         }
 
         downloadSuccess = TRUE;
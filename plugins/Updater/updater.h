@@ -50,6 +50,9 @@
 #define PH_UPDATEFAILURE   (WM_APP + 106)
 #define WM_SHOWDIALOG      (WM_APP + 150)
 
+#define UPDATE_DOWNLOAD_MAX_ATTEMPTS 10
+#define UPDATE_DOWNLOAD_RETRY_DELAY 2000 // ms
+
 #define PLUGIN_NAME L"ProcessHacker.UpdateChecker"
 #define SETTING_NAME_AUTO_CHECK (PLUGIN_NAME L".PromptStart")
 #define SETTING_NAME_LAST_CHECK (PLUGIN_NAME L".LastUpdateCheckTime")
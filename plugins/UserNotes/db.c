@@ -35,9 +35,46 @@ ULONG NTAPI ObjectDbHashFunction(
     _In_ PVOID Entry
     );
 
+// The database is kept in a binary store next to the XML file. Changes are appended to the store
+// as records, and the store is rewritten (compacted) once most of its records are stale. The XML
+// file is imported when it is newer than the store, and exported when the plugin unloads.
+
+#define DB_STORE_MAGIC ('BDNU')
+#define DB_STORE_VERSION 1
+
+#define DB_STORE_RECORD_PUT 1
+#define DB_STORE_RECORD_DELETE 2
+
+#define DB_STORE_COMPACT_THRESHOLD 256
+
+typedef struct _DB_STORE_HEADER
+{
+    ULONG Magic;
+    ULONG Version;
+    LARGE_INTEGER XmlLastWriteTime; // last write time of the XML file when it was last imported or exported
+} DB_STORE_HEADER, *PDB_STORE_HEADER;
+
+typedef struct _DB_STORE_RECORD
+{
+    ULONG Size; // size of the record, including the strings and padding
+    USHORT Type;
+    USHORT Reserved;
+    ULONG Tag;
+    ULONG PriorityClass;
+    ULONG IoPriorityPlusOne;
+    COLORREF BackColor;
+    ULONG NameLength; // in bytes
+    ULONG CommentLength; // in bytes
+    // WCHAR Name[NameLength / sizeof(WCHAR)];
+    // WCHAR Comment[CommentLength / sizeof(WCHAR)];
+} DB_STORE_RECORD, *PDB_STORE_RECORD;
+
 PPH_HASHTABLE ObjectDb;
 PH_QUEUED_LOCK ObjectDbLock = PH_QUEUED_LOCK_INIT;
 PPH_STRING ObjectDbPath;
+PPH_STRING ObjectDbStorePath;
+PPH_LIST ObjectDbPendingDeletes; // deleted objects that are still in the store
+ULONG ObjectDbStoreRecordCount;
 
 VOID InitializeDb(
     VOID
@@ -49,6 +86,7 @@ VOID InitializeDb(
         ObjectDbHashFunction,
         64
         );
+    ObjectDbPendingDeletes = PhCreateList(4);
 }
 
 BOOLEAN NTAPI ObjectDbCompareFunction(
@@ -153,22 +191,373 @@ PDB_OBJECT CreateDbObject(
     return object;
 }
 
-VOID DeleteDbObject(
+static VOID FreeDbObject(
     _In_ PDB_OBJECT Object
     )
 {
-    PhRemoveEntryHashtable(ObjectDb, &Object);
-
     PhDereferenceObject(Object->Name);
     PhDereferenceObject(Object->Comment);
+    PhClearReference(&Object->StoredComment);
     PhFree(Object);
 }
 
+VOID DeleteDbObject(
+    _In_ PDB_OBJECT Object
+    )
+{
+    PhRemoveEntryHashtable(ObjectDb, &Object);
+
+    // Keep the object until SaveDb has appended a delete record for it.
+    if (Object->Stored)
+        PhAddItemList(ObjectDbPendingDeletes, Object);
+    else
+        FreeDbObject(Object);
+}
+
+static VOID ClearDb(
+    VOID
+    )
+{
+    ULONG enumerationKey = 0;
+    PDB_OBJECT *object;
+    PPH_LIST objects;
+    ULONG i;
+
+    objects = PhCreateList(ObjectDb->Count);
+
+    while (PhEnumHashtable(ObjectDb, (PVOID *)&object, &enumerationKey))
+        PhAddItemList(objects, *object);
+
+    PhClearHashtable(ObjectDb);
+
+    for (i = 0; i < objects->Count; i++)
+        FreeDbObject(objects->Items[i]);
+    for (i = 0; i < ObjectDbPendingDeletes->Count; i++)
+        FreeDbObject(ObjectDbPendingDeletes->Items[i]);
+
+    PhClearList(ObjectDbPendingDeletes);
+    PhDereferenceObject(objects);
+}
+
 VOID SetDbPath(
     _In_ PPH_STRING Path
     )
 {
+    static PH_STRINGREF xmlExtension = PH_STRINGREF_INIT(L".xml");
+    static PH_STRINGREF storeExtension = PH_STRINGREF_INIT(L".db");
+    PH_STRINGREF baseName;
+
     PhSwapReference(&ObjectDbPath, Path);
+
+    baseName = Path->sr;
+
+    if (PhEndsWithStringRef(&baseName, &xmlExtension, TRUE))
+        baseName.Length -= xmlExtension.Length;
+
+    PhMoveReference(&ObjectDbStorePath, PhConcatStringRef2(&baseName, &storeExtension));
+}
+
+static VOID MarkDbObjectStored(
+    _Inout_ PDB_OBJECT Object
+    )
+{
+    Object->Stored = TRUE;
+    PhSwapReference(&Object->StoredComment, Object->Comment);
+    Object->StoredPriorityClass = Object->PriorityClass;
+    Object->StoredIoPriorityPlusOne = Object->IoPriorityPlusOne;
+    Object->StoredBackColor = Object->BackColor;
+}
+
+static BOOLEAN IsDbObjectStored(
+    _In_ PDB_OBJECT Object
+    )
+{
+    // Comments are immutable strings; callers replace the reference when they change one.
+    return Object->Stored &&
+        Object->StoredComment == Object->Comment &&
+        Object->StoredPriorityClass == Object->PriorityClass &&
+        Object->StoredIoPriorityPlusOne == Object->IoPriorityPlusOne &&
+        Object->StoredBackColor == Object->BackColor;
+}
+
+static VOID AppendDbStoreRecord(
+    _Inout_ PPH_BYTES_BUILDER BytesBuilder,
+    _In_ USHORT Type,
+    _In_ PDB_OBJECT Object
+    )
+{
+    static ULONG zero = 0;
+    DB_STORE_RECORD record;
+    ULONG dataLength;
+
+    memset(&record, 0, sizeof(DB_STORE_RECORD));
+    record.Type = Type;
+    record.Tag = Object->Tag;
+    record.NameLength = (ULONG)Object->Name->Length;
+
+    if (Type == DB_STORE_RECORD_PUT)
+    {
+        record.PriorityClass = Object->PriorityClass;
+        record.IoPriorityPlusOne = Object->IoPriorityPlusOne;
+        record.BackColor = Object->BackColor;
+        record.CommentLength = (ULONG)Object->Comment->Length;
+    }
+
+    dataLength = sizeof(DB_STORE_RECORD) + record.NameLength + record.CommentLength;
+    record.Size = (ULONG)ALIGN_UP_BY(dataLength, sizeof(ULONG));
+
+    PhAppendBytesBuilderEx(BytesBuilder, &record, sizeof(DB_STORE_RECORD), 0, NULL);
+    PhAppendBytesBuilderEx(BytesBuilder, Object->Name->Buffer, record.NameLength, 0, NULL);
+
+    if (record.CommentLength)
+        PhAppendBytesBuilderEx(BytesBuilder, Object->Comment->Buffer, record.CommentLength, 0, NULL);
+    if (record.Size != dataLength)
+        PhAppendBytesBuilderEx(BytesBuilder, &zero, record.Size - dataLength, 0, NULL);
+
+    ObjectDbStoreRecordCount++;
+}
+
+static NTSTATUS WriteDbStore(
+    _In_ BOOLEAN Append,
+    _In_ PVOID Buffer,
+    _In_ ULONG Length
+    )
+{
+    NTSTATUS status;
+    HANDLE fileHandle;
+    IO_STATUS_BLOCK isb;
+    LARGE_INTEGER offset;
+
+    // Create the directory if it does not exist.
+    if (!Append)
+    {
+        PPH_STRING fullPath;
+        ULONG indexOfFileName;
+        PPH_STRING directoryName;
+
+        fullPath = PhGetFullPath(ObjectDbStorePath->Buffer, &indexOfFileName);
+
+        if (fullPath)
+        {
+            if (indexOfFileName != -1)
+            {
+                directoryName = PhSubstring(fullPath, 0, indexOfFileName);
+                SHCreateDirectoryEx(NULL, directoryName->Buffer, NULL);
+                PhDereferenceObject(directoryName);
+            }
+
+            PhDereferenceObject(fullPath);
+        }
+    }
+
+    status = PhCreateFileWin32(
+        &fileHandle,
+        ObjectDbStorePath->Buffer,
+        FILE_GENERIC_WRITE,
+        0,
+        FILE_SHARE_READ,
+        Append ? FILE_OPEN : FILE_OVERWRITE_IF,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    offset.HighPart = -1;
+    offset.LowPart = FILE_WRITE_TO_END_OF_FILE;
+
+    status = NtWriteFile(fileHandle, NULL, NULL, NULL, &isb, Buffer, Length, Append ? &offset : NULL, NULL);
+    NtClose(fileHandle);
+
+    return status;
+}
+
+static NTSTATUS SetDbStoreXmlLastWriteTime(
+    _In_ PLARGE_INTEGER XmlLastWriteTime
+    )
+{
+    NTSTATUS status;
+    HANDLE fileHandle;
+    IO_STATUS_BLOCK isb;
+    LARGE_INTEGER offset;
+
+    status = PhCreateFileWin32(
+        &fileHandle,
+        ObjectDbStorePath->Buffer,
+        FILE_GENERIC_WRITE,
+        0,
+        FILE_SHARE_READ,
+        FILE_OPEN,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT
+        );
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    offset.QuadPart = FIELD_OFFSET(DB_STORE_HEADER, XmlLastWriteTime);
+    status = NtWriteFile(fileHandle, NULL, NULL, NULL, &isb, XmlLastWriteTime, sizeof(LARGE_INTEGER), &offset, NULL);
+    NtClose(fileHandle);
+
+    return status;
+}
+
+static BOOLEAN GetXmlLastWriteTime(
+    _Out_ PLARGE_INTEGER LastWriteTime
+    )
+{
+    FILE_NETWORK_OPEN_INFORMATION networkOpenInfo;
+
+    if (NT_SUCCESS(PhQueryFullAttributesFileWin32(ObjectDbPath->Buffer, &networkOpenInfo)))
+    {
+        *LastWriteTime = networkOpenInfo.LastWriteTime;
+        return TRUE;
+    }
+
+    LastWriteTime->QuadPart = 0;
+
+    return FALSE;
+}
+
+/**
+ * Rewrites the binary store with only the current objects.
+ */
+static NTSTATUS CompactDbStore(
+    _In_ PLARGE_INTEGER XmlLastWriteTime
+    )
+{
+    NTSTATUS status;
+    PH_BYTES_BUILDER bytesBuilder;
+    DB_STORE_HEADER header;
+    ULONG enumerationKey = 0;
+    PDB_OBJECT *object;
+    ULONG i;
+
+    PhInitializeBytesBuilder(&bytesBuilder, sizeof(DB_STORE_HEADER) + ObjectDb->Count * (sizeof(DB_STORE_RECORD) + 64));
+
+    header.Magic = DB_STORE_MAGIC;
+    header.Version = DB_STORE_VERSION;
+    header.XmlLastWriteTime = *XmlLastWriteTime;
+    PhAppendBytesBuilderEx(&bytesBuilder, &header, sizeof(DB_STORE_HEADER), 0, NULL);
+
+    ObjectDbStoreRecordCount = 0;
+
+    while (PhEnumHashtable(ObjectDb, (PVOID *)&object, &enumerationKey))
+        AppendDbStoreRecord(&bytesBuilder, DB_STORE_RECORD_PUT, *object);
+
+    status = WriteDbStore(FALSE, bytesBuilder.Bytes->Buffer, (ULONG)bytesBuilder.Bytes->Length);
+    PhDeleteBytesBuilder(&bytesBuilder);
+
+    if (NT_SUCCESS(status))
+    {
+        enumerationKey = 0;
+
+        while (PhEnumHashtable(ObjectDb, (PVOID *)&object, &enumerationKey))
+            MarkDbObjectStored(*object);
+
+        for (i = 0; i < ObjectDbPendingDeletes->Count; i++)
+            FreeDbObject(ObjectDbPendingDeletes->Items[i]);
+
+        PhClearList(ObjectDbPendingDeletes);
+    }
+
+    return status;
+}
+
+/**
+ * Replays the binary store.
+ *
+ * \param XmlLastWriteTime A variable which receives the last write time of the XML file
+ * that the store was last synchronized with.
+ * \param NeedsCompaction A variable which receives TRUE if the store has a damaged tail
+ * that must be rewritten before any more records are appended.
+ */
+static NTSTATUS LoadDbStore(
+    _Out_ PLARGE_INTEGER XmlLastWriteTime,
+    _Out_ PBOOLEAN NeedsCompaction
+    )
+{
+    NTSTATUS status;
+    PVOID viewBase;
+    SIZE_T viewSize;
+    PDB_STORE_HEADER header;
+    PDB_STORE_RECORD record;
+    SIZE_T offset;
+
+    *NeedsCompaction = FALSE;
+
+    status = PhMapViewOfEntireFile(ObjectDbStorePath->Buffer, NULL, TRUE, &viewBase, &viewSize);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    header = viewBase;
+
+    if (viewSize < sizeof(DB_STORE_HEADER) || header->Magic != DB_STORE_MAGIC || header->Version != DB_STORE_VERSION)
+    {
+        NtUnmapViewOfSection(NtCurrentProcess(), viewBase);
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    *XmlLastWriteTime = header->XmlLastWriteTime;
+    ObjectDbStoreRecordCount = 0;
+    offset = sizeof(DB_STORE_HEADER);
+
+    LockDb();
+
+    while (offset < viewSize)
+    {
+        PH_STRINGREF name;
+        PDB_OBJECT object;
+
+        record = PTR_ADD_OFFSET(viewBase, offset);
+
+        // A record written partially (e.g. the process was killed) ends the store.
+        if (
+            viewSize - offset < sizeof(DB_STORE_RECORD) ||
+            record->Size < sizeof(DB_STORE_RECORD) ||
+            record->Size > viewSize - offset ||
+            (ULONG64)record->NameLength + record->CommentLength > record->Size - sizeof(DB_STORE_RECORD) ||
+            (record->NameLength & 1) || (record->CommentLength & 1)
+            )
+        {
+            *NeedsCompaction = TRUE;
+            break;
+        }
+
+        name.Buffer = PTR_ADD_OFFSET(record, sizeof(DB_STORE_RECORD));
+        name.Length = record->NameLength;
+
+        if (record->Type == DB_STORE_RECORD_PUT)
+        {
+            PPH_STRING comment;
+
+            comment = PhCreateStringEx(PTR_ADD_OFFSET(name.Buffer, name.Length), record->CommentLength);
+            object = CreateDbObject(record->Tag, &name, comment);
+            PhDereferenceObject(comment);
+
+            object->PriorityClass = record->PriorityClass;
+            object->IoPriorityPlusOne = record->IoPriorityPlusOne;
+            object->BackColor = record->BackColor;
+            MarkDbObjectStored(object);
+        }
+        else if (record->Type == DB_STORE_RECORD_DELETE)
+        {
+            if (object = FindDbObject(record->Tag, &name))
+            {
+                PhRemoveEntryHashtable(ObjectDb, &object);
+                FreeDbObject(object);
+            }
+        }
+
+        ObjectDbStoreRecordCount++;
+        offset += record->Size;
+    }
+
+    UnlockDb();
+
+    NtUnmapViewOfSection(NtCurrentProcess(), viewBase);
+
+    return STATUS_SUCCESS;
 }
 
 mxml_type_t MxmlLoadCallback(
@@ -195,6 +584,116 @@ PPH_STRING GetOpaqueXmlNodeText(
 NTSTATUS LoadDb(
     VOID
     )
+{
+    NTSTATUS status;
+    LARGE_INTEGER storeXmlLastWriteTime;
+    LARGE_INTEGER xmlLastWriteTime;
+    BOOLEAN xmlExists;
+    BOOLEAN needsCompaction;
+
+    status = LoadDbStore(&storeXmlLastWriteTime, &needsCompaction);
+    xmlExists = GetXmlLastWriteTime(&xmlLastWriteTime);
+
+    // Import the XML file if there's no store yet, or if the XML file has been replaced or edited
+    // since the store was last synchronized with it.
+    if (!NT_SUCCESS(status) || (xmlExists && xmlLastWriteTime.QuadPart != storeXmlLastWriteTime.QuadPart))
+    {
+        LockDb();
+        ClearDb();
+        UnlockDb();
+
+        status = ImportDb();
+
+        if (!NT_SUCCESS(status) && xmlExists)
+            return status;
+
+        needsCompaction = TRUE;
+    }
+
+    if (needsCompaction)
+    {
+        LockDb();
+        CompactDbStore(&xmlLastWriteTime);
+        UnlockDb();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS SaveDb(
+    VOID
+    )
+{
+    NTSTATUS status;
+    PH_BYTES_BUILDER bytesBuilder;
+    ULONG enumerationKey = 0;
+    PDB_OBJECT *object;
+    ULONG i;
+
+    LockDb();
+
+    // Rewrite the store once most of its records are stale.
+    if (ObjectDbStoreRecordCount >= ObjectDb->Count * 2 + DB_STORE_COMPACT_THRESHOLD)
+    {
+        LARGE_INTEGER xmlLastWriteTime;
+
+        GetXmlLastWriteTime(&xmlLastWriteTime);
+        status = CompactDbStore(&xmlLastWriteTime);
+        UnlockDb();
+
+        return status;
+    }
+
+    PhInitializeBytesBuilder(&bytesBuilder, 256);
+
+    // Deletes go first, so an object that was deleted and created again ends up being stored.
+    for (i = 0; i < ObjectDbPendingDeletes->Count; i++)
+        AppendDbStoreRecord(&bytesBuilder, DB_STORE_RECORD_DELETE, ObjectDbPendingDeletes->Items[i]);
+
+    while (PhEnumHashtable(ObjectDb, (PVOID *)&object, &enumerationKey))
+    {
+        if (!IsDbObjectStored(*object))
+            AppendDbStoreRecord(&bytesBuilder, DB_STORE_RECORD_PUT, *object);
+    }
+
+    status = STATUS_SUCCESS;
+
+    if (bytesBuilder.Bytes->Length != 0)
+    {
+        status = WriteDbStore(TRUE, bytesBuilder.Bytes->Buffer, (ULONG)bytesBuilder.Bytes->Length);
+
+        if (status == STATUS_OBJECT_NAME_NOT_FOUND)
+        {
+            // The store was deleted.
+            LARGE_INTEGER xmlLastWriteTime;
+
+            GetXmlLastWriteTime(&xmlLastWriteTime);
+            status = CompactDbStore(&xmlLastWriteTime);
+        }
+        else if (NT_SUCCESS(status))
+        {
+            enumerationKey = 0;
+
+            while (PhEnumHashtable(ObjectDb, (PVOID *)&object, &enumerationKey))
+                MarkDbObjectStored(*object);
+
+            for (i = 0; i < ObjectDbPendingDeletes->Count; i++)
+                FreeDbObject(ObjectDbPendingDeletes->Items[i]);
+
+            PhClearList(ObjectDbPendingDeletes);
+        }
+    }
+
+    PhDeleteBytesBuilder(&bytesBuilder);
+
+    UnlockDb();
+
+    return status;
+}
+
+NTSTATUS ImportDb(
+    VOID
+    )
 {
     NTSTATUS status;
     HANDLE fileHandle;
@@ -388,12 +887,13 @@ mxml_node_t *CreateObjectElement(
     return objectNode;
 }
 
-NTSTATUS SaveDb(
+NTSTATUS ExportDb(
     VOID
     )
 {
     NTSTATUS status;
     HANDLE fileHandle;
+    LARGE_INTEGER xmlLastWriteTime;
     mxml_node_t *topNode;
     ULONG enumerationKey = 0;
     PDB_OBJECT *object;
@@ -465,5 +965,9 @@ NTSTATUS SaveDb(
     mxmlDelete(topNode);
     NtClose(fileHandle);
 
+    // Remember which XML file the store matches, so we don't import it again.
+    if (GetXmlLastWriteTime(&xmlLastWriteTime))
+        SetDbStoreXmlLastWriteTime(&xmlLastWriteTime);
+
     return STATUS_SUCCESS;
 }
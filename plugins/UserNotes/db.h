@@ -42,6 +42,13 @@ typedef struct _DB_OBJECT
     ULONG PriorityClass;
     ULONG IoPriorityPlusOne;
     COLORREF BackColor;
+
+    // State last written to the binary store
+    BOOLEAN Stored;
+    PPH_STRING StoredComment;
+    ULONG StoredPriorityClass;
+    ULONG StoredIoPriorityPlusOne;
+    COLORREF StoredBackColor;
 } DB_OBJECT, *PDB_OBJECT;
 
 VOID InitializeDb(
@@ -87,4 +94,12 @@ NTSTATUS SaveDb(
     VOID
     );
 
+NTSTATUS ImportDb(
+    VOID
+    );
+
+NTSTATUS ExportDb(
+    VOID
+    );
+
 #endif
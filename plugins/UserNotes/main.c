@@ -334,6 +334,7 @@ static VOID NTAPI UnloadCallback(
     PhDereferenceObject(customColors);
 
     SaveDb();
+    ExportDb();
 }
 
 VOID NTAPI ShowOptionsCallback(
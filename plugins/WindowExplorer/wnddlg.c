@@ -155,6 +155,44 @@ VOID WepAddChildWindows(
     HWND childWindow = NULL;
     ULONG i = 0;
 
+    // Top-level windows come from the window snapshot shared with the process tree.
+    if (hwnd == GetDesktopWindow())
+    {
+        PPH_WINDOW_SNAPSHOT snapshot;
+
+        snapshot = PhReferenceWindowSnapshot();
+
+        if (FilterProcessId)
+        {
+            PULONG indices;
+            ULONG numberOfWindows;
+
+            numberOfWindows = PhFindProcessWindowsSnapshot(snapshot, FilterProcessId, &indices);
+
+            for (i = 0; i < numberOfWindows; i++)
+            {
+                PPH_WINDOW_SNAPSHOT_ENTRY entry = &snapshot->Windows[indices[i]];
+
+                if (!FilterThreadId || entry->ThreadId == FilterThreadId)
+                    WepAddChildWindowNode(&Context->TreeContext, ParentNode, entry->WindowHandle);
+            }
+        }
+        else
+        {
+            for (i = 0; i < snapshot->NumberOfWindows; i++)
+            {
+                PPH_WINDOW_SNAPSHOT_ENTRY entry = &snapshot->Windows[i];
+
+                if (!FilterThreadId || entry->ThreadId == FilterThreadId)
+                    WepAddChildWindowNode(&Context->TreeContext, ParentNode, entry->WindowHandle);
+            }
+        }
+
+        PhDereferenceObject(snapshot);
+
+        return;
+    }
+
     // We use FindWindowEx because EnumWindows doesn't return Metro app windows.
     // Set a reasonable limit to prevent infinite loops.
     while (i < 0x800 && (childWindow = FindWindowEx(hwnd, childWindow, NULL, NULL)))
@@ -385,6 +423,8 @@ INT_PTR CALLBACK WepWindowsDlgProc(
                 DestroyWindow(hwndDlg);
                 break;
             case IDC_REFRESH:
+                // The user wants to see the current windows, not the ones from the last update.
+                PhInvalidateWindowSnapshot();
                 WepRefreshWindows(context);
                 break;
             case ID_SHOWCONTEXTMENU:
@@ -0,0 +1,307 @@
+#include "bench.h"
+
+#define BENCH_ITEMS 10000
+
+typedef struct _BENCH_HASHTABLE_ENTRY
+{
+    ULONG_PTR Key;
+    PVOID Value;
+} BENCH_HASHTABLE_ENTRY, *PBENCH_HASHTABLE_ENTRY;
+
+typedef struct _BENCH_AVL_ELEMENT
+{
+    PH_AVL_LINKS Links;
+    ULONG Key;
+} BENCH_AVL_ELEMENT, *PBENCH_AVL_ELEMENT;
+
+static ULONG BenchKeys[BENCH_ITEMS];
+
+static BOOLEAN NTAPI BenchHashtableEqualFunction(
+    _In_ PVOID Entry1,
+    _In_ PVOID Entry2
+    )
+{
+    return ((PBENCH_HASHTABLE_ENTRY)Entry1)->Key == ((PBENCH_HASHTABLE_ENTRY)Entry2)->Key;
+}
+
+static ULONG NTAPI BenchHashtableHashFunction(
+    _In_ PVOID Entry
+    )
+{
+    return PhHashIntPtr(((PBENCH_HASHTABLE_ENTRY)Entry)->Key);
+}
+
+static LONG NTAPI BenchAvlCompareFunction(
+    _In_ PPH_AVL_LINKS Links1,
+    _In_ PPH_AVL_LINKS Links2
+    )
+{
+    PBENCH_AVL_ELEMENT element1 = CONTAINING_RECORD(Links1, BENCH_AVL_ELEMENT, Links);
+    PBENCH_AVL_ELEMENT element2 = CONTAINING_RECORD(Links2, BENCH_AVL_ELEMENT, Links);
+
+    return uintcmp(element1->Key, element2->Key);
+}
+
+static VOID NTAPI Bench_hashtable_add(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PPH_HASHTABLE hashtable;
+    BENCH_HASHTABLE_ENTRY entry;
+    ULONG i;
+
+    hashtable = PhCreateHashtable(sizeof(BENCH_HASHTABLE_ENTRY), BenchHashtableEqualFunction, BenchHashtableHashFunction, 16);
+    entry.Value = NULL;
+
+    for (i = 0; i < Context->Iterations; i++)
+    {
+        entry.Key = BenchKeys[i % BENCH_ITEMS] + i / BENCH_ITEMS;
+        PhAddEntryHashtable(hashtable, &entry);
+    }
+
+    BenchStopTimer(Context);
+    PhDereferenceObject(hashtable);
+}
+
+static VOID NTAPI Bench_hashtable_find(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PPH_HASHTABLE hashtable = Context->Parameter;
+    BENCH_HASHTABLE_ENTRY entry;
+    ULONG found = 0;
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+    {
+        // Every other lookup misses.
+        entry.Key = BenchKeys[i % BENCH_ITEMS] + (i & 1);
+
+        if (PhFindEntryHashtable(hashtable, &entry))
+            found++;
+    }
+
+    assert(found >= Context->Iterations / 2);
+}
+
+static VOID NTAPI Bench_string_create(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        PhDereferenceObject(PhCreateString(L"C:\\Windows\\System32\\svchost.exe"));
+}
+
+static VOID NTAPI Bench_string_concat(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        PhDereferenceObject(PhConcatStrings(4, L"C:\\Windows\\", L"System32\\", L"svchost", L".exe"));
+}
+
+static VOID NTAPI Bench_stringbuilder(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PH_STRING_BUILDER sb;
+    ULONG i;
+
+    // One builder per 100 appends, similar to building a tooltip or a copied row.
+    for (i = 0; i < Context->Iterations; i += 100)
+    {
+        ULONG j;
+
+        PhInitializeStringBuilder(&sb, 256);
+
+        for (j = 0; j < 100; j++)
+            PhAppendStringBuilder2(&sb, L"svchost.exe (1234), ");
+
+        PhDeleteStringBuilder(&sb);
+    }
+}
+
+static VOID NTAPI Bench_format(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PH_FORMAT format[5];
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+    {
+        PhInitFormatS(&format[0], L"CPU: ");
+        PhInitFormatF(&format[1], 12.345 + i % 100, 2);
+        PhInitFormatS(&format[2], L"%, Private bytes: ");
+        PhInitFormatSize(&format[3], 123456789 + (ULONG64)i * 4096);
+        PhInitFormatI64U(&format[4], 1234567 + i);
+        format[4].Type |= FormatGroupDigits;
+
+        PhDereferenceObject(PhFormat(format, 5, 64));
+    }
+}
+
+static PH_STRINGREF BenchStringHaystack = PH_STRINGREF_INIT(L"C:\\Program Files\\WindowsApps\\Microsoft.WindowsStore_12107.1001.15.0_x64__8wekyb3d8bbwe\\WinStore.App.exe");
+static PH_STRINGREF BenchStringNeedle = PH_STRINGREF_INIT(L"winstore.app");
+static PH_STRINGREF BenchStringSame = PH_STRINGREF_INIT(L"C:\\PROGRAM FILES\\WINDOWSAPPS\\MICROSOFT.WINDOWSSTORE_12107.1001.15.0_X64__8WEKYB3D8BBWE\\WINSTORE.APP.EXE");
+
+static VOID NTAPI Bench_string_find(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    BOOLEAN ignoreCase = (BOOLEAN)(ULONG_PTR)Context->Parameter;
+    ULONG found = 0;
+    ULONG i;
+
+    // The needle only matches when ignoring case.
+    for (i = 0; i < Context->Iterations; i++)
+    {
+        if (PhFindStringInStringRef(&BenchStringHaystack, &BenchStringNeedle, ignoreCase) != -1)
+            found++;
+    }
+
+    assert(found == (ignoreCase ? Context->Iterations : 0));
+}
+
+static VOID NTAPI Bench_string_equal_ignorecase(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        assert(PhEqualStringRef(&BenchStringHaystack, &BenchStringSame, TRUE));
+}
+
+static VOID NTAPI Bench_string_compare_ignorecase(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        assert(PhCompareStringRef(&BenchStringHaystack, &BenchStringSame, TRUE) == 0);
+}
+
+static VOID NTAPI Bench_utf16_to_utf8(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    CHAR buffer[256];
+    SIZE_T bytes;
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        PhConvertUtf16ToUtf8Buffer(buffer, sizeof(buffer), &bytes, BenchStringHaystack.Buffer, BenchStringHaystack.Length);
+}
+
+static VOID NTAPI Bench_avl_add_remove(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PH_AVL_TREE tree;
+    PBENCH_AVL_ELEMENT elements;
+    ULONG count;
+    ULONG i;
+
+    count = min(Context->Iterations, BENCH_ITEMS);
+    elements = PhAllocate(sizeof(BENCH_AVL_ELEMENT) * count);
+
+    for (i = 0; i < count; i++)
+        elements[i].Key = BenchKeys[i];
+
+    PhInitializeAvlTree(&tree, BenchAvlCompareFunction);
+    BenchResetTimer(Context);
+
+    // Each iteration counts as one insertion and one removal.
+    for (i = 0; i < Context->Iterations; i += count)
+    {
+        ULONG j;
+
+        for (j = 0; j < count; j++)
+            PhAddElementAvlTree(&tree, &elements[j].Links);
+        for (j = 0; j < count; j++)
+            PhRemoveElementAvlTree(&tree, &elements[j].Links);
+    }
+
+    BenchStopTimer(Context);
+    PhFree(elements);
+}
+
+static VOID NTAPI Bench_avl_find(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PPH_AVL_TREE tree = Context->Parameter;
+    BENCH_AVL_ELEMENT lookup;
+    ULONG found = 0;
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+    {
+        lookup.Key = BenchKeys[i % BENCH_ITEMS] + (i & 1);
+
+        if (PhFindElementAvlTree(tree, &lookup.Links))
+            found++;
+    }
+
+    assert(found >= Context->Iterations / 2);
+}
+
+VOID Bench_basesup(
+    VOID
+    )
+{
+    ULONG seed = 1;
+    PPH_HASHTABLE hashtable;
+    BENCH_HASHTABLE_ENTRY entry;
+    PH_AVL_TREE tree;
+    PBENCH_AVL_ELEMENT elements;
+    ULONG i;
+
+    // Even keys only, so that key + 1 is always a miss.
+    for (i = 0; i < BENCH_ITEMS; i++)
+        BenchKeys[i] = (BenchNextRandom(&seed) << 1) | (i << 24);
+
+    BenchRun("hashtable_add", Bench_hashtable_add, NULL, 100000);
+
+    hashtable = PhCreateHashtable(sizeof(BENCH_HASHTABLE_ENTRY), BenchHashtableEqualFunction, BenchHashtableHashFunction, BENCH_ITEMS);
+    entry.Value = NULL;
+
+    for (i = 0; i < BENCH_ITEMS; i++)
+    {
+        entry.Key = BenchKeys[i];
+        PhAddEntryHashtable(hashtable, &entry);
+    }
+
+    BenchRun("hashtable_find", Bench_hashtable_find, hashtable, 1000000);
+    PhDereferenceObject(hashtable);
+
+    BenchRun("string_create", Bench_string_create, NULL, 1000000);
+    BenchRun("string_concat", Bench_string_concat, NULL, 1000000);
+    BenchRun("stringbuilder_append", Bench_stringbuilder, NULL, 1000000);
+    BenchRun("format", Bench_format, NULL, 100000);
+    BenchRun("string_find", Bench_string_find, (PVOID)FALSE, 1000000);
+    BenchRun("string_find_ignorecase", Bench_string_find, (PVOID)TRUE, 1000000);
+    BenchRun("string_equal_ignorecase", Bench_string_equal_ignorecase, NULL, 1000000);
+    BenchRun("string_compare_ignorecase", Bench_string_compare_ignorecase, NULL, 1000000);
+    BenchRun("utf16_to_utf8", Bench_utf16_to_utf8, NULL, 1000000);
+
+    BenchRun("avl_add_remove", Bench_avl_add_remove, NULL, 100000);
+
+    PhInitializeAvlTree(&tree, BenchAvlCompareFunction);
+    elements = PhAllocate(sizeof(BENCH_AVL_ELEMENT) * BENCH_ITEMS);
+
+    for (i = 0; i < BENCH_ITEMS; i++)
+    {
+        elements[i].Key = BenchKeys[i];
+        PhAddElementAvlTree(&tree, &elements[i].Links);
+    }
+
+    BenchRun("avl_find", Bench_avl_find, &tree, 1000000);
+    PhFree(elements);
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include <md5.h>
+#include <sha.h>
+#include <sha256.h>
+
+// Each operation processes one block, so throughput in MB/s is 65536 / 1.048576 / ns.
+#define BENCH_HASH_BLOCK_SIZE 0x10000
+
+static VOID NTAPI Bench_checksum(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PUSHORT block = Context->Parameter;
+    ULONG sum = 0;
+    ULONG i;
+
+    for (i = 0; i < Context->Iterations; i++)
+        sum = PhCheckSum(sum, block, BENCH_HASH_BLOCK_SIZE / sizeof(USHORT));
+
+    assert(sum != 0);
+}
+
+static VOID NTAPI Bench_md5(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    MD5_CTX context;
+    ULONG i;
+
+    MD5Init(&context);
+
+    for (i = 0; i < Context->Iterations; i++)
+        MD5Update(&context, Context->Parameter, BENCH_HASH_BLOCK_SIZE);
+
+    MD5Final(&context);
+}
+
+static VOID NTAPI Bench_sha1(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    A_SHA_CTX context;
+    UCHAR hash[20];
+    ULONG i;
+
+    A_SHAInit(&context);
+
+    for (i = 0; i < Context->Iterations; i++)
+        A_SHAUpdate(&context, Context->Parameter, BENCH_HASH_BLOCK_SIZE);
+
+    A_SHAFinal(&context, hash);
+}
+
+static VOID NTAPI Bench_sha256(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    SHA256_CTX context;
+    UCHAR hash[32];
+    ULONG i;
+
+    SHA256Init(&context);
+
+    for (i = 0; i < Context->Iterations; i++)
+        SHA256Update(&context, Context->Parameter, BENCH_HASH_BLOCK_SIZE);
+
+    SHA256Final(&context, hash);
+}
+
+VOID Bench_hash(
+    VOID
+    )
+{
+    ULONG seed = 1;
+    PULONG block;
+    ULONG i;
+
+    block = PhAllocate(BENCH_HASH_BLOCK_SIZE);
+
+    for (i = 0; i < BENCH_HASH_BLOCK_SIZE / sizeof(ULONG); i++)
+        block[i] = BenchNextRandom(&seed);
+
+    BenchRun("checksum_64k", Bench_checksum, block, 1000);
+    BenchRun("md5_64k", Bench_md5, block, 100);
+    // Uses SHA-NI when the processor supports it (see A_SHAHasHardwareSupport).
+    BenchRun("sha1_64k", Bench_sha1, block, 100);
+    BenchRun("sha256_64k", Bench_sha256, block, 100);
+
+    PhFree(block);
+}
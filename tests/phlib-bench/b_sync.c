@@ -0,0 +1,131 @@
+#include "bench.h"
+
+#define BENCH_MAXIMUM_THREADS 8
+
+typedef struct _BENCH_LOCK_CONTEXT
+{
+    PH_QUEUED_LOCK Lock;
+    PH_BARRIER Barrier;
+    ULONG Iterations;
+    ULONG Shared; // a non-zero value makes odd threads acquire the lock in shared mode
+    volatile ULONG Counter;
+} BENCH_LOCK_CONTEXT, *PBENCH_LOCK_CONTEXT;
+
+static NTSTATUS NTAPI BenchLockThreadStart(
+    _In_ PVOID Parameter
+    )
+{
+    PBENCH_LOCK_CONTEXT context = Parameter;
+    BOOLEAN shared;
+    ULONG i;
+
+    shared = context->Shared && (InterlockedIncrement((PLONG)&context->Shared) & 1);
+    PhWaitForBarrier(&context->Barrier, FALSE);
+
+    for (i = 0; i < context->Iterations; i++)
+    {
+        if (shared)
+        {
+            PhAcquireQueuedLockShared(&context->Lock);
+            PhReleaseQueuedLockShared(&context->Lock);
+        }
+        else
+        {
+            PhAcquireQueuedLockExclusive(&context->Lock);
+            context->Counter++;
+            PhReleaseQueuedLockExclusive(&context->Lock);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static VOID BenchRunLockThreads(
+    _Inout_ PBENCH_CONTEXT Context,
+    _In_ ULONG NumberOfThreads,
+    _In_ BOOLEAN Shared
+    )
+{
+    BENCH_LOCK_CONTEXT context;
+    HANDLE threadHandles[BENCH_MAXIMUM_THREADS];
+    ULONG i;
+
+    PhInitializeQueuedLock(&context.Lock);
+    // The main thread takes part in the barrier so that thread creation is not measured.
+    PhInitializeBarrier(&context.Barrier, NumberOfThreads + 1);
+    context.Iterations = Context->Iterations / NumberOfThreads;
+    context.Shared = Shared;
+    context.Counter = 0;
+
+    for (i = 0; i < NumberOfThreads; i++)
+        threadHandles[i] = PhCreateThread(0, BenchLockThreadStart, &context);
+
+    PhWaitForBarrier(&context.Barrier, FALSE);
+    BenchResetTimer(Context);
+    NtWaitForMultipleObjects(NumberOfThreads, threadHandles, WaitAll, FALSE, NULL);
+    BenchStopTimer(Context);
+
+    for (i = 0; i < NumberOfThreads; i++)
+        NtClose(threadHandles[i]);
+}
+
+static VOID NTAPI Bench_queuedlock_exclusive(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    BenchRunLockThreads(Context, PtrToUlong(Context->Parameter), FALSE);
+}
+
+static VOID NTAPI Bench_queuedlock_mixed(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    BenchRunLockThreads(Context, PtrToUlong(Context->Parameter), TRUE);
+}
+
+static NTSTATUS NTAPI BenchWorkItemFunction(
+    _In_ PVOID Parameter
+    )
+{
+    _InterlockedIncrement((PLONG)Parameter);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID NTAPI Bench_workqueue(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    PH_WORK_QUEUE workQueue;
+    volatile LONG counter = 0;
+    ULONG i;
+
+    PhInitializeWorkQueue(&workQueue, 0, PtrToUlong(Context->Parameter), 1000);
+    BenchResetTimer(Context);
+
+    for (i = 0; i < Context->Iterations; i++)
+        PhQueueItemWorkQueue(&workQueue, BenchWorkItemFunction, (PVOID)&counter);
+
+    // PhWaitForWorkQueue only waits for the queue to drain; the last items may still be running.
+    PhWaitForWorkQueue(&workQueue);
+
+    while (counter != (LONG)Context->Iterations)
+        YieldProcessor();
+
+    BenchStopTimer(Context);
+    PhDeleteWorkQueue(&workQueue);
+}
+
+VOID Bench_sync(
+    VOID
+    )
+{
+    BenchRun("queuedlock_exclusive_1", Bench_queuedlock_exclusive, UlongToPtr(1), 1000000);
+    BenchRun("queuedlock_exclusive_2", Bench_queuedlock_exclusive, UlongToPtr(2), 1000000);
+    BenchRun("queuedlock_exclusive_4", Bench_queuedlock_exclusive, UlongToPtr(4), 1000000);
+    BenchRun("queuedlock_exclusive_8", Bench_queuedlock_exclusive, UlongToPtr(8), 1000000);
+    BenchRun("queuedlock_mixed_4", Bench_queuedlock_mixed, UlongToPtr(4), 1000000);
+
+    BenchRun("workqueue_1", Bench_workqueue, UlongToPtr(1), 100000);
+    BenchRun("workqueue_4", Bench_workqueue, UlongToPtr(4), 100000);
+}
@@ -0,0 +1,64 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <ph.h>
+
+typedef struct _BENCH_CONTEXT
+{
+    /** The number of operations to perform. */
+    ULONG Iterations;
+    /** The benchmark-specific context. */
+    PVOID Parameter;
+
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER StopTime;
+} BENCH_CONTEXT, *PBENCH_CONTEXT;
+
+typedef VOID (NTAPI *PBENCH_FUNCTION)(
+    _Inout_ PBENCH_CONTEXT Context
+    );
+
+/**
+ * Restarts the timer of a benchmark. Call this after any setup that should not be measured.
+ */
+FORCEINLINE VOID BenchResetTimer(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    NtQueryPerformanceCounter(&Context->StartTime, NULL);
+}
+
+/**
+ * Stops the timer of a benchmark. Call this before any cleanup that should not be measured.
+ */
+FORCEINLINE VOID BenchStopTimer(
+    _Inout_ PBENCH_CONTEXT Context
+    )
+{
+    NtQueryPerformanceCounter(&Context->StopTime, NULL);
+}
+
+ULONG BenchNextRandom(
+    _Inout_ PULONG Seed
+    );
+
+VOID BenchRun(
+    _In_ PSTR Name,
+    _In_ PBENCH_FUNCTION Function,
+    _In_opt_ PVOID Parameter,
+    _In_ ULONG Iterations
+    );
+
+VOID Bench_basesup(
+    VOID
+    );
+
+VOID Bench_sync(
+    VOID
+    );
+
+VOID Bench_hash(
+    VOID
+    );
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Benchmarks for phlib primitives that are used heavily by the UI.
+ *
+ * Each benchmark is run a number of times (samples), each sample performing a fixed number of
+ * operations. The time per operation is reported as CSV on stdout:
+ *
+ *   name,iterations,samples,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns
+ *
+ * Usage: phlib-bench [-n samples] [-f filter]
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_SAMPLES 25
+
+static ULONG BenchSamples = BENCH_DEFAULT_SAMPLES;
+static PSTR BenchFilter = NULL;
+static LARGE_INTEGER BenchFrequency;
+
+static int __cdecl BenchCompareDoubles(
+    _In_ const void *elem1,
+    _In_ const void *elem2
+    )
+{
+    DOUBLE value1 = *(DOUBLE *)elem1;
+    DOUBLE value2 = *(DOUBLE *)elem2;
+
+    if (value1 < value2)
+        return -1;
+    else if (value1 > value2)
+        return 1;
+    else
+        return 0;
+}
+
+static DOUBLE BenchGetPercentile(
+    _In_reads_(Count) DOUBLE *Values,
+    _In_ ULONG Count,
+    _In_ ULONG Percentile
+    )
+{
+    ULONG index;
+
+    // Nearest-rank method on the sorted samples.
+    index = (Percentile * Count + 99) / 100;
+
+    if (index != 0)
+        index--;
+
+    return Values[index];
+}
+
+/**
+ * Generates a pseudo-random number. The sequence is the same on every run so that benchmarks
+ * are repeatable.
+ *
+ * \param Seed The generator state.
+ */
+ULONG BenchNextRandom(
+    _Inout_ PULONG Seed
+    )
+{
+    *Seed = *Seed * 1103515245 + 12345;
+
+    return *Seed >> 8;
+}
+
+/**
+ * Runs a benchmark and prints its statistics.
+ *
+ * \param Name The name of the benchmark.
+ * \param Function The benchmark function, which performs \a Iterations operations per call.
+ * \param Parameter A value passed to \a Function.
+ * \param Iterations The number of operations performed by each sample.
+ */
+VOID BenchRun(
+    _In_ PSTR Name,
+    _In_ PBENCH_FUNCTION Function,
+    _In_opt_ PVOID Parameter,
+    _In_ ULONG Iterations
+    )
+{
+    BENCH_CONTEXT context;
+    DOUBLE *samples;
+    DOUBLE sum;
+    ULONG i;
+
+    if (BenchFilter && !strstr(Name, BenchFilter))
+        return;
+
+    samples = PhAllocate(sizeof(DOUBLE) * BenchSamples);
+    sum = 0;
+
+    context.Iterations = Iterations;
+    context.Parameter = Parameter;
+
+    // The first call warms up caches, free lists and lazily created objects and is not counted.
+    for (i = 0; i <= BenchSamples; i++)
+    {
+        context.StopTime.QuadPart = 0;
+        BenchResetTimer(&context);
+        Function(&context);
+
+        if (context.StopTime.QuadPart == 0)
+            BenchStopTimer(&context);
+
+        if (i != 0)
+        {
+            samples[i - 1] = (DOUBLE)(context.StopTime.QuadPart - context.StartTime.QuadPart) *
+                1000000000.0 / BenchFrequency.QuadPart / Iterations;
+            sum += samples[i - 1];
+        }
+    }
+
+    qsort(samples, BenchSamples, sizeof(DOUBLE), BenchCompareDoubles);
+
+    printf(
+        "%s,%lu,%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+        Name,
+        Iterations,
+        BenchSamples,
+        samples[0],
+        BenchGetPercentile(samples, BenchSamples, 50),
+        BenchGetPercentile(samples, BenchSamples, 90),
+        BenchGetPercentile(samples, BenchSamples, 99),
+        samples[BenchSamples - 1],
+        sum / BenchSamples
+        );
+    fflush(stdout);
+
+    PhFree(samples);
+}
+
+int __cdecl main(int argc, char *argv[])
+{
+    NTSTATUS status;
+    LARGE_INTEGER counter;
+    int i;
+
+    status = PhInitializePhLib();
+
+    if (!NT_SUCCESS(status))
+        return 1;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            BenchSamples = strtoul(argv[++i], NULL, 10);
+
+            if (BenchSamples == 0)
+                BenchSamples = BENCH_DEFAULT_SAMPLES;
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            BenchFilter = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: phlib-bench [-n samples] [-f filter]\n");
+            return 1;
+        }
+    }
+
+    NtQueryPerformanceCounter(&counter, &BenchFrequency);
+
+    // Reduce noise: keep the main thread on one processor and ahead of normal activity.
+    // Worker threads created by the benchmarks are not restricted.
+    SetThreadAffinityMask(NtCurrentThread(), 1);
+    SetPriorityClass(NtCurrentProcess(), HIGH_PRIORITY_CLASS);
+
+    printf("name,iterations,samples,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+
+    Bench_basesup();
+    Bench_sync();
+    Bench_hash();
+
+    return 0;
+}
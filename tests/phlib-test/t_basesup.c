@@ -1,4 +1,17 @@
 #include "tests.h"
+#include <circbuf.h>
+
+#undef T
+#undef K
+#define T ULONG
+#define K ULONG
+#include <ohashtbl_h.h>
+#include <tarray_h.h>
+// A poor hash function, so that long probe sequences are exercised.
+#define PH_OPEN_HASHTABLE_KEY(Entry) (Entry)
+#define PH_OPEN_HASHTABLE_HASH(Key) ((Key) % 7)
+#define PH_OPEN_HASHTABLE_EQUAL(Key1, Key2) ((Key1) == (Key2))
+#include <ohashtbl_i.h>
 
 static VOID Test_time(
     VOID
@@ -214,6 +227,32 @@ VOID Test_stringref(
     DO_STRSTR_TEST(PhFindStringInStringRef, L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", 0, FALSE);
     DO_STRSTR_TEST(PhFindStringInStringRef, L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", L"asdg4sdfg", 28, FALSE);
     DO_STRSTR_TEST(PhFindStringInStringRef, L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", L"asdg4Gdfg", -1, FALSE);
+    // Case-insensitive searches across vector blocks, with and without non-ASCII characters
+    DO_STRSTR_TEST(PhFindStringInStringRef, L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", L"ASDG4SDFG", 28, TRUE);
+    DO_STRSTR_TEST(PhFindStringInStringRef, L"0sdfasdf1sdfasdf2sdfasdf3sdfasdg4sdfg", L"asdg4Gdfg", -1, TRUE);
+    DO_STRSTR_TEST(PhFindStringInStringRef, L"C:\\Windows\\System32\\\u00e9t\u00e9\\svchost.exe", L"SVCHOST", 24, TRUE);
+    DO_STRSTR_TEST(PhFindStringInStringRef, L"C:\\Windows\\System32\\\u00e9t\u00e9\\svchost.exe", L"\u00c9T\u00c9\\S", 20, TRUE);
+
+    // PhCompareStringRef
+
+#define DO_STRCMP_TEST(s1, s2, expected, ignoreCase) \
+    do { \
+        PH_STRINGREF ___t1; \
+        PH_STRINGREF ___t2; \
+        LONG ___r; \
+        PhInitializeStringRef(&___t1, s1); \
+        PhInitializeStringRef(&___t2, s2); \
+        ___r = PhCompareStringRef(&___t1, &___t2, ignoreCase); \
+        assert((___r < 0 ? -1 : ___r > 0 ? 1 : 0) == expected); \
+    } while (0)
+
+    DO_STRCMP_TEST(L"0123456789abcdefghij", L"0123456789abcdefghij", 0, FALSE);
+    DO_STRCMP_TEST(L"0123456789abcdefghij", L"0123456789ABCDEFGHIJ", 1, FALSE);
+    DO_STRCMP_TEST(L"0123456789abcdefghij", L"0123456789ABCDEFGHIJ", 0, TRUE);
+    DO_STRCMP_TEST(L"0123456789abcdefghij", L"0123456789ABCDEFGHIK", -1, TRUE);
+    DO_STRCMP_TEST(L"0123456789abcdefghij", L"0123456789ABCDEFGHIJK", -1, TRUE);
+    DO_STRCMP_TEST(L"0123456\u00e989abcdefghij", L"0123456\u00c989ABCDEFGHIJ", 0, TRUE);
+    DO_STRCMP_TEST(L"0123456\u00e989abcdefghiz", L"0123456\u00c989ABCDEFGHIJ", 1, TRUE);
 }
 
 VOID Test_hexstring(
@@ -339,6 +378,588 @@ VOID Test_unicode(
     assert(memcmp(utf8_2->Buffer, utf8_3->Buffer, utf8_2->Length) == 0);
 }
 
+static VOID Test_handleindex(
+    VOID
+    )
+{
+    PH_HANDLE_INDEX index;
+    ULONG i;
+    ULONG enumerationKey;
+    ULONG count;
+    HANDLE key;
+    PVOID value;
+
+    PhInitializeHandleIndex(&index, 4);
+
+    for (i = 0; i < 10000; i++)
+        assert(PhAddItemHandleIndex(&index, UlongToHandle(i * 4), UlongToPtr(i + 1)));
+
+    assert(index.Count == 10000);
+    assert(index.Capacity >= 20000);
+    assert(!PhAddItemHandleIndex(&index, UlongToHandle(0), UlongToPtr(1)));
+
+    for (i = 0; i < 10000; i++)
+        assert(PhFindItemHandleIndex(&index, UlongToHandle(i * 4)) == UlongToPtr(i + 1));
+
+    assert(!PhFindItemHandleIndex(&index, UlongToHandle(40000)));
+
+    for (i = 0; i < 10000; i += 2)
+        assert(PhRemoveItemHandleIndex(&index, UlongToHandle(i * 4)));
+
+    assert(!PhRemoveItemHandleIndex(&index, UlongToHandle(0)));
+    assert(index.Count == 5000);
+
+    for (i = 0; i < 10000; i++)
+    {
+        if (i & 1)
+            assert(PhFindItemHandleIndex(&index, UlongToHandle(i * 4)) == UlongToPtr(i + 1));
+        else
+            assert(!PhFindItemHandleIndex(&index, UlongToHandle(i * 4)));
+    }
+
+    enumerationKey = 0;
+    count = 0;
+
+    while (PhEnumHandleIndex(&index, &enumerationKey, &key, &value))
+    {
+        assert(HandleToUlong(key) / 4 + 1 == PtrToUlong(value));
+        count++;
+    }
+
+    assert(count == 5000);
+    assert(PhGetAverageProbeLengthHandleIndex(&index) >= 100);
+
+    PhClearHandleIndex(&index);
+    assert(index.Count == 0 && !PhFindItemHandleIndex(&index, UlongToHandle(4)));
+
+    PhDeleteHandleIndex(&index);
+}
+
+static VOID Test_circbuftier(
+    VOID
+    )
+{
+    static ULONG expected[] = { 12, 11, 10, 9, 7, 7, 5, 5, 5, 2, 2, 2 };
+    PH_CIRCULAR_BUFFER_ULONG buffer;
+    PH_CIRCULAR_BUFFER_TIER_ULONG tier;
+    ULONG data[20];
+    ULONG minimum;
+    ULONG maximum;
+    ULONG i;
+
+    PhInitializeCircularBuffer_ULONG(&buffer, 4);
+    PhInitializeCircularBufferTier_ULONG(&tier, 3, 2);
+
+    for (i = 1; i <= 4; i++)
+        PhAddItemCircularBufferTiered_ULONG(&buffer, &tier, i);
+
+    assert(PhGetCountCircularBufferTiered_ULONG(&buffer, &tier) == 4);
+
+    // 1-8 fall out of the buffer: buckets {1, 2, 3}, {4, 5, 6}, pending {7, 8}.
+    for (i = 5; i <= 12; i++)
+        PhAddItemCircularBufferTiered_ULONG(&buffer, &tier, i);
+
+    assert(PhGetCountCircularBufferTiered_ULONG(&buffer, &tier) == 12);
+    PhCopyCircularBufferTiered_ULONG(&buffer, &tier, data, 20);
+    assert(memcmp(data, expected, sizeof(expected)) == 0);
+
+    assert(PhGetItemCircularBufferTiered_ULONG(&buffer, &tier, 4, &minimum, &maximum) == 7);
+    assert(minimum == 7 && maximum == 8);
+    assert(PhGetItemCircularBufferTiered_ULONG(&buffer, &tier, 7, &minimum, &maximum) == 5);
+    assert(minimum == 4 && maximum == 6);
+
+    // The oldest bucket is replaced by {7, 8, 9}.
+    for (i = 13; i <= 15; i++)
+        PhAddItemCircularBufferTiered_ULONG(&buffer, &tier, i);
+
+    assert(PhGetCountCircularBufferTiered_ULONG(&buffer, &tier) == 12);
+    assert(PhGetItemCircularBufferTiered_ULONG(&buffer, &tier, 6, &minimum, &maximum) == 8);
+    assert(minimum == 7 && maximum == 9);
+    assert(PhGetItemCircularBufferTiered_ULONG(&buffer, &tier, 9, NULL, NULL) == 5);
+
+    PhDeleteCircularBufferTier_ULONG(&tier);
+
+    // A disabled tier behaves like a plain circular buffer.
+    PhInitializeCircularBufferTier_ULONG(&tier, 0, 0);
+
+    for (i = 0; i < 10; i++)
+        PhAddItemCircularBufferTiered_ULONG(&buffer, &tier, i);
+
+    assert(PhGetCountCircularBufferTiered_ULONG(&buffer, &tier) == 4);
+    assert(PhGetItemCircularBufferTiered_ULONG(&buffer, &tier, 0, NULL, NULL) == 9);
+
+    PhDeleteCircularBufferTier_ULONG(&tier);
+    PhDeleteCircularBuffer_ULONG(&buffer);
+}
+
+static VOID Test_vector(
+    VOID
+    )
+{
+    ULONG64 source[40];
+    FLOAT a[40];
+    FLOAT b[40];
+    FLOAT c[40];
+    FLOAT maximums[40];
+    ULONG fill[40];
+    ULONG count;
+    ULONG offset;
+    ULONG i;
+
+    // Exercise the vector loops, the scalar tails and unaligned starts.
+
+    for (count = 0; count <= 32; count++)
+    {
+        for (offset = 0; offset < 4; offset++)
+        {
+            FLOAT max = 0;
+
+            for (i = 0; i < 40; i++)
+            {
+                source[i] = ((ULONG64)i << 40) + i * 12345;
+                a[i] = (FLOAT)((i * 37) % 23) - 5;
+                b[i] = (FLOAT)((i * 11) % 17);
+            }
+
+            PhConvertUlong64sToSingles(c + offset, source + offset, count);
+
+            for (i = offset; i < offset + count; i++)
+                assert(c[i] == (FLOAT)source[i]);
+
+            PhFillMemoryUlong(fill + offset, 0xdeadbeef, count);
+
+            for (i = offset; i < offset + count; i++)
+                assert(fill[i] == 0xdeadbeef);
+
+            for (i = offset; i < offset + count; i++)
+            {
+                if (max < a[i] + b[i])
+                    max = a[i] + b[i];
+            }
+
+            assert(PhMaximumSumSingles(a + offset, b + offset, count) == max);
+            assert(PhRunningMaximumSumSingles(maximums + offset, a + offset, b + offset, count) == max);
+
+            max = 0;
+
+            for (i = offset; i < offset + count; i++)
+            {
+                if (max < a[i] + b[i])
+                    max = a[i] + b[i];
+
+                assert(maximums[i] == max);
+            }
+
+            memcpy(c, a, sizeof(a));
+            PhAddSinglesToSingles(c + offset, b + offset, count);
+
+            for (i = offset; i < offset + count; i++)
+                assert(c[i] == a[i] + b[i]);
+
+            PhDivideSinglesBySingle(c + offset, 4, count);
+
+            for (i = offset; i < offset + count; i++)
+                assert(c[i] == (a[i] + b[i]) / 4);
+        }
+    }
+}
+
+static VOID Test_openhashtable(
+    VOID
+    )
+{
+    PH_OPEN_HASHTABLE_ULONG hashtable;
+    BOOLEAN added;
+    PULONG entry;
+    ULONG enumerationKey;
+    ULONG count;
+    ULONG i;
+
+    PhInitializeOpenHashtable_ULONG(&hashtable, 0);
+
+    for (i = 0; i < 1000; i++)
+    {
+        entry = PhAddEntryOpenHashtable_ULONG(&hashtable, i * 3, &added);
+        assert(entry && *entry == i * 3 && added);
+    }
+
+    assert(hashtable.Count == 1000);
+    entry = PhAddEntryOpenHashtable_ULONG(&hashtable, 30, &added);
+    assert(entry && *entry == 30 && !added);
+    assert(hashtable.Count == 1000);
+
+    for (i = 0; i < 3000; i++)
+    {
+        entry = PhFindEntryOpenHashtable_ULONG(&hashtable, i);
+        assert(i % 3 == 0 ? (entry && *entry == i) : !entry);
+    }
+
+    // Remove every other entry; the remaining probe sequences must stay intact.
+    for (i = 0; i < 1000; i += 2)
+        assert(PhRemoveEntryOpenHashtable_ULONG(&hashtable, i * 3));
+
+    assert(!PhRemoveEntryOpenHashtable_ULONG(&hashtable, 0));
+    assert(hashtable.Count == 500);
+
+    for (i = 0; i < 1000; i++)
+        assert(!PhFindEntryOpenHashtable_ULONG(&hashtable, i * 3) == !(i & 1));
+
+    enumerationKey = 0;
+    count = 0;
+
+    while (PhEnumOpenHashtable_ULONG(&hashtable, &entry, &enumerationKey))
+    {
+        assert(*entry % 6 == 3);
+        count++;
+    }
+
+    assert(count == 500);
+
+    PhClearOpenHashtable_ULONG(&hashtable);
+    assert(hashtable.Count == 0 && !PhFindEntryOpenHashtable_ULONG(&hashtable, 3));
+
+    PhDeleteOpenHashtable_ULONG(&hashtable);
+}
+
+static VOID Test_objectcache(
+    VOID
+    )
+{
+    PH_OBJECT_TYPE_INFORMATION before;
+    PH_OBJECT_TYPE_INFORMATION after;
+    PPH_STRING strings[16];
+    ULONG i;
+    ULONG j;
+
+    PhGetObjectTypeInformation(PhStringType, &before);
+
+    // Strings of different lengths end up in different size classes, and freed strings
+    // should be reused by the next allocations of the same size.
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 16; j++)
+        {
+            strings[j] = PhCreateStringEx(NULL, j * 16 * sizeof(WCHAR));
+            memset(strings[j]->Buffer, 'a', strings[j]->Length);
+        }
+
+        for (j = 0; j < 16; j++)
+            PhDereferenceObject(strings[j]);
+    }
+
+    PhGetObjectTypeInformation(PhStringType, &after);
+    assert(after.NumberOfObjects == before.NumberOfObjects);
+    assert(after.NumberOfCacheHits - before.NumberOfCacheHits >= 3 * 16);
+
+    PhFlushObjectThreadCache();
+}
+
+static VOID Test_localref(
+    VOID
+    )
+{
+    PH_AUTO_POOL autoPool;
+    PH_OBJECT_TYPE_INFORMATION before;
+    PH_OBJECT_TYPE_INFORMATION info;
+    PPH_STRING string;
+    ULONG i;
+
+    PhInitializeAutoPool(&autoPool);
+    PhGetObjectTypeInformation(PhStringType, &before);
+
+    // The pool keeps the object alive until it is drained.
+    string = PhCreateString(L"local");
+
+    for (i = 0; i < 3; i++)
+        PhReferenceObjectLocal(string);
+    for (i = 0; i < 3; i++)
+        PhDereferenceObjectLocal(string);
+
+    PhDereferenceObject(string);
+    PhGetObjectTypeInformation(PhStringType, &info);
+    assert(info.NumberOfObjects == before.NumberOfObjects + 1);
+    PhDrainAutoPool(&autoPool);
+    PhGetObjectTypeInformation(PhStringType, &info);
+    assert(info.NumberOfObjects == before.NumberOfObjects);
+
+    // Outstanding local references become real references.
+    string = PhCreateString(L"local");
+    PhReferenceObjectLocal(string);
+    PhReferenceObjectLocal(string);
+    PhDrainAutoPool(&autoPool);
+    PhDereferenceObject(string);
+    PhDereferenceObject(string);
+    PhGetObjectTypeInformation(PhStringType, &info);
+    assert(info.NumberOfObjects == before.NumberOfObjects + 1);
+    PhDereferenceObject(string);
+    PhGetObjectTypeInformation(PhStringType, &info);
+    assert(info.NumberOfObjects == before.NumberOfObjects);
+
+    PhDeleteAutoPool(&autoPool);
+}
+
+static VOID Test_autopoolarena(
+    VOID
+    )
+{
+    PH_AUTO_POOL autoPool;
+    PH_OBJECT_TYPE_INFORMATION before;
+    PH_OBJECT_TYPE_INFORMATION info;
+    PPH_STRING string;
+    PPH_STRING kept;
+    ULONG i;
+    ULONG j;
+
+    PhInitializeAutoPoolEx(&autoPool, PH_AUTO_POOL_USE_ARENA);
+    PhGetObjectTypeInformation(PhStringType, &before);
+
+    for (i = 0; i < 4; i++)
+    {
+        // Enough strings to fill more than one chunk.
+        for (j = 0; j < 200; j++)
+        {
+            string = PhaFormatString(L"%u:%u", i, j);
+            assert(string->Buffer[0] == '0' + i && string->Buffer[1] == ':');
+        }
+
+        PhDrainAutoPool(&autoPool);
+        PhGetObjectTypeInformation(PhStringType, &info);
+        assert(info.NumberOfObjects == before.NumberOfObjects);
+    }
+
+    // A string that outlives the pool keeps its memory.
+    kept = PhaCreateString(L"kept");
+    PhReferenceObject(kept);
+    PhDrainAutoPool(&autoPool);
+    string = PhaCreateString(L"overwrite");
+    assert(PhEqualStringZ(kept->Buffer, L"kept", FALSE));
+    PhDeleteAutoPool(&autoPool);
+
+    assert(PhEqualStringZ(kept->Buffer, L"kept", FALSE));
+    PhDereferenceObject(kept);
+    PhGetObjectTypeInformation(PhStringType, &info);
+    assert(info.NumberOfObjects == before.NumberOfObjects);
+}
+
+static VOID Test_intern(
+    VOID
+    )
+{
+    static PH_STRINGREF text = PH_STRINGREF_INIT(L"InternedTestString");
+    PPH_STRING string1;
+    PPH_STRING string2;
+    PPH_STRING string3;
+
+    string1 = PhCreateString2(&text);
+    string2 = PhInternString(string1);
+    assert(string2 == string1);
+    string3 = PhInternStringRef(&text);
+    assert(string3 == string1);
+    PhDereferenceObject(string3);
+    PhDereferenceObject(string2);
+    PhDereferenceObject(string1);
+
+    // The intern table doesn't keep strings alive.
+    string1 = PhInternStringRef(&text);
+    assert(PhEqualStringRef(&string1->sr, &text, FALSE));
+    string2 = PhCreateString2(&text);
+    string3 = PhInternString(string2);
+    assert(string3 == string1 && string3 != string2);
+    PhDereferenceObject(string3);
+    PhDereferenceObject(string2);
+    PhDereferenceObject(string1);
+}
+
+static VOID Test_fixedstringbuilder(
+    VOID
+    )
+{
+    PH_FIXED_STRING_BUILDER sb;
+    WCHAR buffer[12];
+    PH_FORMAT format[2];
+
+    PhInitializeFixedStringBuilder(&sb, buffer, sizeof(buffer));
+    assert(sb.String.Length == 0 && buffer[0] == 0);
+    assert(PhAppendFixedStringBuilder2(&sb, L"abc"));
+    PhInitFormatU(&format[0], 1234);
+    PhInitFormatC(&format[1], '!');
+    assert(PhAppendFormatFixedStringBuilder(&sb, format, 2));
+    assert(wcscmp(buffer, L"abc1234!") == 0 && sb.String.Length == 8 * sizeof(WCHAR));
+    assert(!sb.Overflow);
+
+    // Appends that don't fit are discarded as a whole.
+    assert(!PhAppendFixedStringBuilder2(&sb, L"defg"));
+    assert(!PhAppendFormatFixedStringBuilder(&sb, format, 2));
+    assert(sb.Overflow);
+    assert(wcscmp(buffer, L"abc1234!") == 0 && sb.String.Length == 8 * sizeof(WCHAR));
+    assert(PhAppendFixedStringBuilder2(&sb, L"xyz"));
+    assert(wcscmp(buffer, L"abc1234!xyz") == 0);
+}
+
+static VOID Test_array(
+    VOID
+    )
+{
+    PH_ARRAY_ULONG array;
+    ULONG i;
+
+    PhInitializeArray_ULONG(&array, 1);
+
+    for (i = 0; i < 100; i++)
+        PhAddItemArray_ULONG(&array, i * 2);
+
+    assert(array.Count == 100 && array.AllocatedCount >= 100);
+    assert(PhFindItemArray_ULONG(&array, 42) == 21);
+    assert(PhFindItemArray_ULONG(&array, 43) == -1);
+
+    PhRemoveItemArray_ULONG(&array, 21);
+    assert(array.Count == 99);
+    assert(PhFindItemArray_ULONG(&array, 42) == -1);
+    assert(array.Items[20] == 40 && array.Items[21] == 44 && array.Items[98] == 198);
+
+    PhRemoveItemArray_ULONG(&array, 98);
+    assert(array.Count == 98 && array.Items[97] == 196);
+
+    PhClearArray_ULONG(&array);
+    assert(array.Count == 0);
+
+    PhDeleteArray_ULONG(&array);
+}
+
+static VOID Test_bytepattern(
+    VOID
+    )
+{
+    UCHAR buffer[100];
+    UCHAR pattern[] = { 0x12, 0x34, 0x56 };
+    UCHAR wildcardMask[] = { 0xff, 0x00, 0xff };
+    UCHAR text[] = { 'A', 'b', 'C' };
+    UCHAR ignoreCaseMask[] = { 0xdf, 0xdf, 0xdf };
+    UCHAR allWildcards[] = { 0x00, 0x00 };
+    SIZE_T index;
+    ULONG i;
+
+    memset(buffer, 0, sizeof(buffer));
+
+    // Exercise the vector loops and the scalar tail.
+
+    for (i = 0; i + sizeof(pattern) <= sizeof(buffer); i++)
+    {
+        memcpy(&buffer[i], pattern, sizeof(pattern));
+        assert(PhFindBytePattern(buffer, sizeof(buffer), pattern, NULL, sizeof(pattern), &index) && index == i);
+        assert(!PhFindBytePattern(buffer, i + sizeof(pattern) - 1, pattern, NULL, sizeof(pattern), &index));
+        buffer[i + 1] = 0x99;
+        assert(!PhFindBytePattern(buffer, sizeof(buffer), pattern, NULL, sizeof(pattern), &index));
+        assert(PhFindBytePattern(buffer, sizeof(buffer), pattern, wildcardMask, sizeof(pattern), &index) && index == i);
+        memset(&buffer[i], 0, sizeof(pattern));
+    }
+
+    memcpy(&buffer[70], "xaBc", 4);
+    assert(!PhFindBytePattern(buffer, sizeof(buffer), text, NULL, sizeof(text), &index));
+    assert(PhFindBytePattern(buffer, sizeof(buffer), text, ignoreCaseMask, sizeof(text), &index) && index == 71);
+    assert(PhFindBytePattern(buffer, sizeof(buffer), allWildcards, allWildcards, sizeof(allWildcards), &index) && index == 0);
+    assert(!PhFindBytePattern(buffer, 1, allWildcards, allWildcards, sizeof(allWildcards), &index));
+}
+
+static VOID Test_countequalbytes(
+    VOID
+    )
+{
+    UCHAR buffer1[100];
+    UCHAR buffer2[100];
+    ULONG i;
+
+    memset(buffer1, 0x5a, sizeof(buffer1));
+    memset(buffer2, 0x5a, sizeof(buffer2));
+    assert(PhCountEqualBytes(buffer1, buffer2, sizeof(buffer1)) == sizeof(buffer1));
+    assert(PhCountEqualBytes(buffer1, buffer2, 0) == 0);
+
+    // Exercise the vector loops and the scalar tail.
+
+    for (i = 0; i < sizeof(buffer2); i++)
+    {
+        buffer2[i] = 0xa5;
+        assert(PhCountEqualBytes(buffer1, buffer2, sizeof(buffer1)) == i);
+        assert(PhCountEqualBytes(buffer1, buffer2, i) == i);
+        buffer2[i] = 0x5a;
+    }
+}
+
+static VOID Test_hashbytes64(
+    VOID
+    )
+{
+    UCHAR buffer[PAGE_SIZE];
+    UCHAR stripe[64];
+    ULONG64 hash;
+    ULONG i;
+
+    for (i = 0; i < sizeof(buffer); i++)
+        buffer[i] = (UCHAR)(i * 7 + (i >> 8));
+
+    hash = PhHashBytes64(buffer, sizeof(buffer));
+    assert(hash == PhHashBytes64(buffer, sizeof(buffer)));
+    assert(hash != PhHashBytes64(buffer, sizeof(buffer) - 1));
+
+    buffer[1000] ^= 1;
+    assert(hash != PhHashBytes64(buffer, sizeof(buffer)));
+    buffer[1000] ^= 1;
+
+    // Swapping two stripes must change the hash.
+    memcpy(stripe, buffer, 64);
+    memcpy(buffer, &buffer[64], 64);
+    memcpy(&buffer[64], stripe, 64);
+    assert(hash != PhHashBytes64(buffer, sizeof(buffer)));
+
+    assert(PhHashBytes64(buffer, 0) != PhHashBytes64(buffer, 1));
+}
+
+static LONG Test_naturalsortkey_compare(
+    _In_ PWSTR A,
+    _In_ PWSTR B,
+    _In_ BOOLEAN IgnoreCase
+    )
+{
+    PH_STRINGREF a;
+    PH_STRINGREF b;
+    PPH_BYTES key1;
+    PPH_BYTES key2;
+    LONG result;
+
+    PhInitializeStringRefLongHint(&a, A);
+    PhInitializeStringRefLongHint(&b, B);
+    key1 = PhCreateNaturalSortKey(&a, IgnoreCase);
+    key2 = PhCreateNaturalSortKey(&b, IgnoreCase);
+    result = PhCompareNaturalSortKey(key1, key2);
+    PhDereferenceObject(key1);
+    PhDereferenceObject(key2);
+
+    return result;
+}
+
+static VOID Test_naturalsortkey(
+    VOID
+    )
+{
+    assert(Test_naturalsortkey_compare(L"abc", L"abc", FALSE) == 0);
+    assert(Test_naturalsortkey_compare(L"abc", L"ABC", FALSE) != 0);
+    assert(Test_naturalsortkey_compare(L"abc", L"ABC", TRUE) == 0);
+    assert(Test_naturalsortkey_compare(L"abc", L"abd", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"ab", L"abc", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"1", L"2", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"12", L"9", FALSE) > 0);
+    assert(Test_naturalsortkey_compare(L"file-1", L"file-9", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"file-12", L"file-9", FALSE) > 0);
+    assert(Test_naturalsortkey_compare(L"file-12", L"file-90", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"file-12a", L"file-12b", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"a 1", L"a1", FALSE) == 0);
+    assert(Test_naturalsortkey_compare(L"x007", L"x7", FALSE) > 0);
+    assert(Test_naturalsortkey_compare(L"x007", L"x8", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"a1", L"a:", FALSE) < 0);
+    assert(Test_naturalsortkey_compare(L"a1", L"a/", FALSE) > 0);
+    assert(Test_naturalsortkey_compare(L"", L"a", FALSE) < 0);
+}
+
 VOID Test_basesup(
     VOID
     )
@@ -349,4 +970,18 @@ VOID Test_basesup(
     Test_hexstring();
     Test_strint();
     Test_unicode();
+    Test_handleindex();
+    Test_circbuftier();
+    Test_openhashtable();
+    Test_array();
+    Test_objectcache();
+    Test_localref();
+    Test_autopoolarena();
+    Test_intern();
+    Test_fixedstringbuilder();
+    Test_vector();
+    Test_bytepattern();
+    Test_hashbytes64();
+    Test_countequalbytes();
+    Test_naturalsortkey();
 }
@@ -498,6 +498,81 @@ static VOID Test_width(
     assert(result && wcscmp(buffer, L"   1234asdf      ") == 0);
 }
 
+static VOID Test_fast(
+    VOID
+    )
+{
+    BOOLEAN result;
+    WCHAR buffer[1024];
+    SIZE_T returnLength;
+
+    // Buffer handling
+
+    result = PhFormatUInt64ToBuffer(1234567890, FALSE, buffer, 11 * sizeof(WCHAR), &returnLength);
+    assert(result && wcscmp(buffer, L"1234567890") == 0 && returnLength == 11 * sizeof(WCHAR));
+    result = PhFormatUInt64ToBuffer(1234567890, FALSE, buffer, 10 * sizeof(WCHAR), &returnLength);
+    assert(!result && buffer[0] == 0 && returnLength == 11 * sizeof(WCHAR));
+    result = PhFormatUInt64ToBuffer(1234567890, FALSE, NULL, 9999, &returnLength);
+    assert(!result && returnLength == 11 * sizeof(WCHAR));
+
+    // Integers
+
+    result = PhFormatUInt64ToBuffer(0, FALSE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"0") == 0);
+    result = PhFormatUInt64ToBuffer(7, FALSE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"7") == 0);
+    result = PhFormatUInt64ToBuffer(100, FALSE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"100") == 0);
+    result = PhFormatUInt64ToBuffer(12345678901234567890, FALSE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"12345678901234567890") == 0);
+
+    // Fixed precision
+
+    result = PhFormatFixedToBuffer(0, 2, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"0.00") == 0);
+    result = PhFormatFixedToBuffer(3.14159265358979, 0, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"3") == 0);
+    result = PhFormatFixedToBuffer(3.14159265358979, 4, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"3.1416") == 0);
+    result = PhFormatFixedToBuffer(99.999, 2, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"100.00") == 0);
+    result = PhFormatFixedToBuffer(-1.23, 3, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"-1.230") == 0);
+    result = PhFormatFixedToBuffer(1234.12, 6, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1234.120000") == 0);
+
+    // Digit grouping and sizes
+
+    if (!IsThousandSepComma())
+        return;
+
+    result = PhFormatUInt64ToBuffer(999, TRUE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"999") == 0);
+    result = PhFormatUInt64ToBuffer(1000, TRUE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1,000") == 0);
+    result = PhFormatUInt64ToBuffer(1234567, TRUE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1,234,567") == 0);
+    result = PhFormatUInt64ToBuffer(12345678901234567890, TRUE, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"12,345,678,901,234,567,890") == 0);
+
+    result = PhFormatSizeToBuffer(0, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"0") == 0);
+    result = PhFormatSizeToBuffer(999, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"999 B") == 0);
+    result = PhFormatSizeToBuffer(1000, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"0.98 kB") == 0);
+    result = PhFormatSizeToBuffer(1536, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1.5 kB") == 0);
+    result = PhFormatSizeToBuffer(1024 * 1024, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1 MB") == 0);
+    result = PhFormatSizeToBuffer(1023999, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1,000 kB") == 0);
+    result = PhFormatSizeToBuffer(1234567, 1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"1,205.63 kB") == 0);
+    result = PhFormatSizeToBuffer(MAXULONG64, -1, buffer, sizeof(buffer), NULL);
+    assert(result && wcscmp(buffer, L"16 EB") == 0);
+}
+
 static VOID Test_wildcards(
     VOID
     )
@@ -562,5 +637,6 @@ VOID Test_format(
     Test_integer();
     Test_float();
     Test_width();
+    Test_fast();
     Test_wildcards();
 }
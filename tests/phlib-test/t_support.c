@@ -151,6 +151,49 @@ static VOID Test_ellipsis(
     assert(wcscmp(output->Buffer, L"C:\\abcdef\\1234.abc") == 0);
 }
 
+static VOID Test_hash(
+    VOID
+    )
+{
+    static UCHAR sha1Abc[20] = { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e, 0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d };
+    static UCHAR sha1Million[20] = { 0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e, 0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f };
+    static UCHAR sha256Abc[32] =
+    {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    static UCHAR sha256Million[32] =
+    {
+        0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92, 0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+        0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e, 0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0
+    };
+    PH_HASH_CONTEXT contexts[2];
+    UCHAR buffer[1000];
+    UCHAR hash[32];
+    ULONG i;
+
+    PhInitializeHash(&contexts[0], Sha1HashAlgorithm);
+    PhInitializeHash(&contexts[1], Sha256HashAlgorithm);
+    PhUpdateHash(&contexts[0], "abc", 3);
+    PhUpdateHash(&contexts[1], "abc", 3);
+    assert(PhFinalHash(&contexts[0], hash, sizeof(hash), NULL) && memcmp(hash, sha1Abc, 20) == 0);
+    assert(PhFinalHash(&contexts[1], hash, sizeof(hash), NULL) && memcmp(hash, sha256Abc, 32) == 0);
+
+    // One million 'a's, in pieces that don't line up with the block size.
+    memset(buffer, 'a', sizeof(buffer));
+    PhInitializeHash(&contexts[0], Sha1HashAlgorithm);
+    PhInitializeHash(&contexts[1], Sha256HashAlgorithm);
+
+    for (i = 0; i < 1000; i++)
+    {
+        PhUpdateHash(&contexts[0], buffer, 1000);
+        PhUpdateHash(&contexts[1], buffer, 1000);
+    }
+
+    assert(PhFinalHash(&contexts[0], hash, sizeof(hash), NULL) && memcmp(hash, sha1Million, 20) == 0);
+    assert(PhFinalHash(&contexts[1], hash, sizeof(hash), NULL) && memcmp(hash, sha256Million, 32) == 0);
+}
+
 VOID Test_compareignoremenuprefix(
     VOID
     )
@@ -198,5 +241,6 @@ VOID Test_support(
     Test_rectangle();
     Test_guid();
     Test_ellipsis();
+    Test_hash();
     Test_compareignoremenuprefix();
 }
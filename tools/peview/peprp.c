@@ -71,6 +71,23 @@ PH_IMAGE_VERSION_INFO PvImageVersionInfo;
 VERIFY_RESULT PvImageVerifyResult;
 PPH_STRING PvImageSignerName;
 
+// The check sum and signature are computed in the background as soon as the image is mapped.
+// Results are posted to the General page once it exists.
+static PH_QUEUED_LOCK PvpAnalysisLock = PH_QUEUED_LOCK_INIT;
+static HWND PvpAnalysisWindowHandle;
+static BOOLEAN PvpCheckSumDone;
+static ULONG PvpCheckSum;
+static BOOLEAN PvpVerifyDone;
+static PH_EVENT PvpCheckSumEvent = PH_EVENT_INIT;
+
+static NTSTATUS CheckSumImageThreadStart(
+    _In_ PVOID Parameter
+    );
+
+static NTSTATUS VerifyImageThreadStart(
+    _In_ PVOID Parameter
+    );
+
 VOID PvPeProperties(
     VOID
     )
@@ -91,6 +108,10 @@ VOID PvPeProperties(
         return;
     }
 
+    // Start the slow analyses now so they overlap with creating the property pages.
+    PhQueueItemGlobalWorkQueue(CheckSumImageThreadStart, NULL);
+    PhQueueItemGlobalWorkQueue(VerifyImageThreadStart, NULL);
+
     propSheetHeader.dwFlags =
         PSH_NOAPPLYNOW |
         PSH_NOCONTEXTHELP |
@@ -168,6 +189,9 @@ VOID PvPeProperties(
 
     PropertySheet(&propSheetHeader);
 
+    // The check sum reads the mapped image.
+    PhWaitForEvent(&PvpCheckSumEvent, NULL);
+
     PhUnloadMappedImage(&PvMappedImage);
 }
 
@@ -175,18 +199,21 @@ static NTSTATUS CheckSumImageThreadStart(
     _In_ PVOID Parameter
     )
 {
-    HWND windowHandle;
     ULONG checkSum;
 
-    windowHandle = Parameter;
     checkSum = PhCheckSumMappedImage(&PvMappedImage);
 
-    PostMessage(
-        windowHandle,
-        PVM_CHECKSUM_DONE,
-        checkSum,
-        0
-        );
+    PhAcquireQueuedLockExclusive(&PvpAnalysisLock);
+
+    PvpCheckSum = checkSum;
+    PvpCheckSumDone = TRUE;
+
+    if (PvpAnalysisWindowHandle)
+        PostMessage(PvpAnalysisWindowHandle, PVM_CHECKSUM_DONE, checkSum, 0);
+
+    PhReleaseQueuedLockExclusive(&PvpAnalysisLock);
+
+    PhSetEvent(&PvpCheckSumEvent);
 
     return STATUS_SUCCESS;
 }
@@ -270,11 +297,21 @@ static NTSTATUS VerifyImageThreadStart(
     _In_ PVOID Parameter
     )
 {
-    HWND windowHandle;
+    VERIFY_RESULT result;
+    PPH_STRING signerName;
+
+    result = PvpVerifyFileWithAdditionalCatalog(PvFileName, PH_VERIFY_PREVENT_NETWORK_ACCESS, NULL, &signerName);
+
+    PhAcquireQueuedLockExclusive(&PvpAnalysisLock);
+
+    PvImageVerifyResult = result;
+    PvImageSignerName = signerName;
+    PvpVerifyDone = TRUE;
 
-    windowHandle = Parameter;
-    PvImageVerifyResult = PvpVerifyFileWithAdditionalCatalog(PvFileName, PH_VERIFY_PREVENT_NETWORK_ACCESS, NULL, &PvImageSignerName);
-    PostMessage(windowHandle, PVM_VERIFY_DONE, 0, 0);
+    if (PvpAnalysisWindowHandle)
+        PostMessage(PvpAnalysisWindowHandle, PVM_VERIFY_DONE, 0, 0);
+
+    PhReleaseQueuedLockExclusive(&PvpAnalysisLock);
 
     return STATUS_SUCCESS;
 }
@@ -331,8 +368,6 @@ INT_PTR CALLBACK PvpPeGeneralDlgProc(
                 SetDlgItemText(hwndDlg, IDC_COMPANYNAME, string->Buffer);
                 PhDereferenceObject(string);
                 SetDlgItemText(hwndDlg, IDC_VERSION, PvpGetStringOrNa(PvImageVersionInfo.FileVersion));
-
-                PhQueueItemGlobalWorkQueue(VerifyImageThreadStart, hwndDlg);
             }
 
             // PE properties
@@ -386,8 +421,6 @@ INT_PTR CALLBACK PvpPeGeneralDlgProc(
             SetDlgItemText(hwndDlg, IDC_CHECKSUM, string->Buffer);
             PhDereferenceObject(string);
 
-            PhQueueItemGlobalWorkQueue(CheckSumImageThreadStart, hwndDlg);
-
             switch (PvMappedImage.NtHeaders->OptionalHeader.Subsystem)
             {
             case IMAGE_SUBSYSTEM_NATIVE:
@@ -512,6 +545,25 @@ INT_PTR CALLBACK PvpPeGeneralDlgProc(
                     PhSetListViewSubItem(lvHandle, lvItemIndex, 2, pointer);
                 }
             }
+
+            // Show any results that arrived before the page was created, and receive the rest.
+            PhAcquireQueuedLockExclusive(&PvpAnalysisLock);
+
+            PvpAnalysisWindowHandle = hwndDlg;
+
+            if (PvpCheckSumDone)
+                PostMessage(hwndDlg, PVM_CHECKSUM_DONE, PvpCheckSum, 0);
+            if (PvpVerifyDone)
+                PostMessage(hwndDlg, PVM_VERIFY_DONE, 0, 0);
+
+            PhReleaseQueuedLockExclusive(&PvpAnalysisLock);
+        }
+        break;
+    case WM_DESTROY:
+        {
+            PhAcquireQueuedLockExclusive(&PvpAnalysisLock);
+            PvpAnalysisWindowHandle = NULL;
+            PhReleaseQueuedLockExclusive(&PvpAnalysisLock);
         }
         break;
     case PVM_CHECKSUM_DONE:
@@ -680,6 +732,7 @@ INT_PTR CALLBACK PvpPeImportsDlgProc(
             PhAddListViewColumn(lvHandle, 2, 2, 2, LVCFMT_LEFT, 50, L"Hint");
             PhSetExtendedListView(lvHandle);
             ExtendedListView_AddFallbackColumns(lvHandle, 3, fallbackColumns);
+            ExtendedListView_SetRedraw(lvHandle, FALSE);
 
             if (NT_SUCCESS(PhGetMappedImageImports(&imports, &PvMappedImage)))
             {
@@ -692,6 +745,7 @@ INT_PTR CALLBACK PvpPeImportsDlgProc(
             }
 
             ExtendedListView_SortItems(lvHandle);
+            ExtendedListView_SetRedraw(lvHandle, TRUE);
         }
         break;
     case WM_NOTIFY:
@@ -733,6 +787,7 @@ INT_PTR CALLBACK PvpPeExportsDlgProc(
             PhAddListViewColumn(lvHandle, 1, 1, 1, LVCFMT_LEFT, 50, L"Ordinal");
             PhAddListViewColumn(lvHandle, 2, 2, 2, LVCFMT_LEFT, 120, L"VA");
             PhSetExtendedListView(lvHandle);
+            ExtendedListView_SetRedraw(lvHandle, FALSE);
 
             if (NT_SUCCESS(PhGetMappedImageExports(&exports, &PvMappedImage)))
             {
@@ -782,6 +837,7 @@ INT_PTR CALLBACK PvpPeExportsDlgProc(
             }
 
             ExtendedListView_SortItems(lvHandle);
+            ExtendedListView_SetRedraw(lvHandle, TRUE);
         }
         break;
     case WM_NOTIFY: